@@ -0,0 +1,440 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Implementation of the checkpoints declared in @see checkpoint.h
+ *
+ * A checkpoint consists of the magic number, the start time and the tag of the
+ * environment, the state regions as a count followed by a name, a size and the
+ * bytes of each, and the events as a count followed by the name of the trigger,
+ * the tag, and the token of each. A token is a flag followed, if set, by the
+ * array length and the size of the payload in bytes and the payload itself.
+ * Names are a length followed by the characters. Events appear in the order of
+ * their tags for each trigger, so that scheduling them again in that order
+ * rebuilds the chains of events at the same time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "environment.h"
+#include "lf_token.h"
+#include "platform.h"
+#include "reactor_common.h"
+#include "util.h"
+
+#define CHECKPOINT_MAGIC "LFCKPT01"
+#define CHECKPOINT_FILE_NAME_LENGTH 512
+
+extern instant_t start_time;
+
+/** A registered trigger or state region. */
+typedef struct {
+    char* name;
+    void* data;
+    size_t size;
+} lf_checkpoint_entry_t;
+
+/** The registrations of an environment and its pending request. */
+typedef struct lf_checkpoint_registry_t {
+    lf_checkpoint_entry_t* triggers;
+    size_t num_triggers;
+    size_t triggers_capacity;
+    lf_checkpoint_entry_t* states;
+    size_t num_states;
+    size_t states_capacity;
+    char* requested;
+} lf_checkpoint_registry_t;
+
+/**
+ * Return the registry of the environment, creating it if needed.
+ * This assumes that the caller is in a critical section.
+ */
+static lf_checkpoint_registry_t* _lf_checkpoint_registry(environment_t* env) {
+    if (env->checkpoint == NULL) {
+        env->checkpoint = (lf_checkpoint_registry_t*)calloc(1, sizeof(lf_checkpoint_registry_t));
+        lf_assert(env->checkpoint != NULL, "Out of memory");
+    }
+    return env->checkpoint;
+}
+
+static void _lf_checkpoint_add(lf_checkpoint_entry_t** entries, size_t* count, size_t* capacity,
+        const char* name, void* data, size_t size) {
+    if (*count == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+        *entries = (lf_checkpoint_entry_t*)realloc(*entries, *capacity * sizeof(lf_checkpoint_entry_t));
+        lf_assert(*entries != NULL, "Out of memory");
+    }
+    lf_checkpoint_entry_t* entry = &(*entries)[(*count)++];
+    entry->name = strdup(name);
+    lf_assert(entry->name != NULL, "Out of memory");
+    entry->data = data;
+    entry->size = size;
+}
+
+/** Return the registered entry with the specified name, or NULL if there is none. */
+static lf_checkpoint_entry_t* _lf_checkpoint_find(lf_checkpoint_entry_t* entries, size_t count,
+        const char* name, size_t name_length) {
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(entries[i].name, name, name_length) == 0 && entries[i].name[name_length] == '\0') {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+void lf_checkpoint_register_trigger(environment_t* env, const char* name, trigger_t* trigger) {
+    // Trigger objects may be initialized in parallel.
+    lf_critical_section_enter(GLOBAL_ENVIRONMENT);
+    lf_checkpoint_registry_t* registry = _lf_checkpoint_registry(env);
+    _lf_checkpoint_add(&registry->triggers, &registry->num_triggers, &registry->triggers_capacity,
+            name, trigger, 0);
+    lf_critical_section_exit(GLOBAL_ENVIRONMENT);
+}
+
+void lf_checkpoint_register_state(environment_t* env, const char* name, void* state, size_t size) {
+    lf_critical_section_enter(GLOBAL_ENVIRONMENT);
+    lf_checkpoint_registry_t* registry = _lf_checkpoint_registry(env);
+    _lf_checkpoint_add(&registry->states, &registry->num_states, &registry->states_capacity,
+            name, state, size);
+    lf_critical_section_exit(GLOBAL_ENVIRONMENT);
+}
+
+void lf_request_checkpoint(environment_t* env, const char* file_name) {
+    char* copy = strdup(file_name);
+    lf_assert(copy != NULL, "Out of memory");
+    lf_critical_section_enter(env);
+    lf_checkpoint_registry_t* registry = _lf_checkpoint_registry(env);
+    free(registry->requested);
+    registry->requested = copy;
+    lf_critical_section_exit(env);
+}
+
+/**
+ * Write the name of the checkpoint file of the environment into 'buffer'.
+ * @return Whether the name fits in the buffer.
+ */
+static bool _lf_checkpoint_file_name(environment_t* env, const char* file_name, char* buffer, size_t length) {
+    int written = env->id == 0
+        ? snprintf(buffer, length, "%s", file_name)
+        : snprintf(buffer, length, "%s.%d", file_name, env->id);
+    return written >= 0 && (size_t)written < length;
+}
+
+static bool _lf_checkpoint_write_name(FILE* file, const char* name) {
+    uint64_t length = (uint64_t)strlen(name);
+    return fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(name, 1, length, file) == length;
+}
+
+/** Return the name of the registered trigger, or NULL if it is not registered. */
+static const char* _lf_checkpoint_trigger_name(lf_checkpoint_registry_t* registry, trigger_t* trigger) {
+    for (size_t i = 0; i < registry->num_triggers; i++) {
+        if (registry->triggers[i].data == trigger) return registry->triggers[i].name;
+    }
+    return NULL;
+}
+
+const char* _lf_checkpoint_name_of_trigger(environment_t* env, trigger_t* trigger) {
+    if (env->checkpoint == NULL) return NULL;
+    return _lf_checkpoint_trigger_name(env->checkpoint, trigger);
+}
+
+trigger_t* _lf_checkpoint_trigger_named(environment_t* env, const char* name, size_t length) {
+    if (env->checkpoint == NULL) return NULL;
+    lf_checkpoint_entry_t* entry = _lf_checkpoint_find(env->checkpoint->triggers, env->checkpoint->num_triggers,
+            name, length);
+    return (entry == NULL) ? NULL : (trigger_t*)entry->data;
+}
+
+/**
+ * Write the event and the events lined up behind it in superdense time.
+ * @param microstep The microstep of the event.
+ * @param count Incremented by the number of events written.
+ * @param skipped Incremented by the number of events that cannot be saved.
+ * @return Whether writing succeeded.
+ */
+static bool _lf_checkpoint_write_events(FILE* file, lf_checkpoint_registry_t* registry,
+        event_t* event, microstep_t microstep, uint64_t* count, size_t* skipped) {
+    for (; event != NULL; event = event->next, microstep++) {
+        if (event->is_dummy || event->trigger == NULL) continue;
+        const char* name = _lf_checkpoint_trigger_name(registry, event->trigger);
+        lf_token_t* token = event->token;
+        if (name == NULL || (token != NULL && (token->type->destructor != NULL
+                || token->type->copy_constructor != NULL))) {
+            (*skipped)++;
+            continue;
+        }
+        uint8_t has_token = (token != NULL);
+        bool ok = _lf_checkpoint_write_name(file, name)
+            && fwrite(&event->time, sizeof(instant_t), 1, file) == 1
+            && fwrite(&microstep, sizeof(microstep_t), 1, file) == 1
+            && fwrite(&has_token, sizeof(has_token), 1, file) == 1;
+        if (ok && has_token) {
+            uint64_t length = (uint64_t)token->length;
+            uint64_t size = (token->value == NULL) ? 0 : (uint64_t)(token->length * token->type->element_size);
+            ok = fwrite(&length, sizeof(length), 1, file) == 1
+                && fwrite(&size, sizeof(size), 1, file) == 1
+                && fwrite(token->value, 1, size, file) == size;
+        }
+        if (!ok) return false;
+        (*count)++;
+    }
+    return true;
+}
+
+int lf_checkpoint_save(environment_t* env, const char* file_name) {
+    lf_checkpoint_registry_t* registry = _lf_checkpoint_registry(env);
+    char name[CHECKPOINT_FILE_NAME_LENGTH];
+    char temporary[CHECKPOINT_FILE_NAME_LENGTH + 4];
+    if (!_lf_checkpoint_file_name(env, file_name, name, sizeof(name))) {
+        lf_print_warning("Checkpoint file name %s is too long.", file_name);
+        return -1;
+    }
+    snprintf(temporary, sizeof(temporary), "%s.tmp", name);
+    FILE* file = fopen(temporary, "wb");
+    if (file == NULL) {
+        lf_print_warning("Failed to open %s to write a checkpoint.", temporary);
+        return -1;
+    }
+    uint64_t num_states = (uint64_t)registry->num_states;
+    bool ok = fwrite(CHECKPOINT_MAGIC, 1, 8, file) == 8
+        && fwrite(&start_time, sizeof(instant_t), 1, file) == 1
+        && fwrite(&env->current_tag.time, sizeof(instant_t), 1, file) == 1
+        && fwrite(&env->current_tag.microstep, sizeof(microstep_t), 1, file) == 1
+        && fwrite(&num_states, sizeof(num_states), 1, file) == 1;
+    for (size_t i = 0; ok && i < registry->num_states; i++) {
+        lf_checkpoint_entry_t* state = &registry->states[i];
+        uint64_t size = (uint64_t)state->size;
+        ok = _lf_checkpoint_write_name(file, state->name)
+            && fwrite(&size, sizeof(size), 1, file) == 1
+            && fwrite(state->data, 1, state->size, file) == state->size;
+    }
+
+    // The number of events is only known once they are written.
+    long count_position = ftell(file);
+    uint64_t count = 0;
+    size_t skipped = 0;
+    ok = ok && count_position >= 0 && fwrite(&count, sizeof(count), 1, file) == 1;
+    // Events waiting for the next microstep precede those on the event queue.
+    vector_t* next_microstep = &env->next_microstep;
+    for (void** p = next_microstep->start; ok && p < next_microstep->next; p++) {
+        ok = _lf_checkpoint_write_events(file, registry, (event_t*)*p,
+                env->current_tag.microstep + 1, &count, &skipped);
+    }
+    size_t queued = pqueue_size(env->event_q);
+    if (ok && queued > 0) {
+        event_t** events = (event_t**)malloc(queued * sizeof(event_t*));
+        lf_assert(events != NULL, "Out of memory");
+        pqueue_copy_entries(env->event_q, (void**)events);
+        for (size_t i = 0; ok && i < queued; i++) {
+            ok = _lf_checkpoint_write_events(file, registry, events[i], 0, &count, &skipped);
+        }
+        free(events);
+    }
+    ok = ok && fseek(file, count_position, SEEK_SET) == 0
+        && fwrite(&count, sizeof(count), 1, file) == 1;
+    if (fclose(file) != 0 || !ok || rename(temporary, name) != 0) {
+        lf_print_warning("Failed to write a checkpoint to %s.", name);
+        remove(temporary);
+        return -1;
+    }
+    if (skipped > 0) {
+        lf_print_warning("Checkpoint %s omits %zu events of unregistered triggers or with tokens that "
+                "cannot be copied bytewise.", name, skipped);
+    }
+    LF_PRINT_LOG("Wrote a checkpoint with %llu events at tag " PRINTF_TAG " to %s.",
+            (unsigned long long)count, env->current_tag.time - start_time, env->current_tag.microstep, name);
+    return 0;
+}
+
+void _lf_checkpoint_at_tag_end(environment_t* env) {
+    lf_checkpoint_registry_t* registry = env->checkpoint;
+    if (registry == NULL || registry->requested == NULL) return;
+    lf_checkpoint_save(env, registry->requested);
+    free(registry->requested);
+    registry->requested = NULL;
+}
+
+/** A cursor over the contents of a checkpoint file. */
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t position;
+    bool valid;
+} lf_checkpoint_reader_t;
+
+/** Return a pointer to the next 'size' bytes and skip them, or NULL if the file is too short. */
+static const void* _lf_checkpoint_read(lf_checkpoint_reader_t* reader, size_t size) {
+    if (!reader->valid || size > reader->length - reader->position) {
+        reader->valid = false;
+        return NULL;
+    }
+    const void* result = reader->data + reader->position;
+    reader->position += size;
+    return result;
+}
+
+static uint64_t _lf_checkpoint_read_u64(lf_checkpoint_reader_t* reader) {
+    uint64_t value = 0;
+    const void* bytes = _lf_checkpoint_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static instant_t _lf_checkpoint_read_time(lf_checkpoint_reader_t* reader) {
+    instant_t value = 0;
+    const void* bytes = _lf_checkpoint_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static microstep_t _lf_checkpoint_read_microstep(lf_checkpoint_reader_t* reader) {
+    microstep_t value = 0;
+    const void* bytes = _lf_checkpoint_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/**
+ * Read a name and return the registered entry with that name. The reader
+ * becomes invalid if the name is malformed or not registered.
+ */
+static lf_checkpoint_entry_t* _lf_checkpoint_read_entry(lf_checkpoint_reader_t* reader,
+        lf_checkpoint_entry_t* entries, size_t count) {
+    uint64_t length = _lf_checkpoint_read_u64(reader);
+    const char* name = (const char*)_lf_checkpoint_read(reader, (size_t)length);
+    if (name == NULL) return NULL;
+    lf_checkpoint_entry_t* entry = _lf_checkpoint_find(entries, count, name, (size_t)length);
+    if (entry == NULL) {
+        lf_print_error("Checkpoint refers to %.*s, which is not registered.", (int)length, name);
+        reader->valid = false;
+    }
+    return entry;
+}
+
+/**
+ * Read the checkpoint and, if 'apply' is true, restore the environment from it.
+ * Reading without applying validates the checkpoint so that the environment is
+ * either fully restored or not at all.
+ * @return Whether the checkpoint is valid.
+ */
+static bool _lf_checkpoint_load(environment_t* env, lf_checkpoint_reader_t* reader, bool apply) {
+    lf_checkpoint_registry_t* registry = _lf_checkpoint_registry(env);
+    const void* magic = _lf_checkpoint_read(reader, 8);
+    if (magic == NULL || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0) return false;
+    instant_t saved_start_time = _lf_checkpoint_read_time(reader);
+    tag_t saved_tag;
+    saved_tag.time = _lf_checkpoint_read_time(reader);
+    saved_tag.microstep = _lf_checkpoint_read_microstep(reader);
+    interval_t shift = 0;
+    if (apply) {
+        // The first environment to resume shifts the start time so that the
+        // elapsed logical time of the checkpoint is now. Other environments
+        // follow the same start time.
+        static bool start_time_shifted = false;
+        if (!start_time_shifted) {
+            start_time -= saved_tag.time - saved_start_time;
+            start_time_shifted = true;
+        }
+        shift = start_time - saved_start_time;
+        env->current_tag = (tag_t){.time = saved_tag.time + shift, .microstep = saved_tag.microstep};
+        if (duration >= 0LL) {
+            env->stop_tag = (tag_t){.time = start_time + duration, .microstep = 0};
+        }
+    }
+
+    uint64_t num_states = _lf_checkpoint_read_u64(reader);
+    for (uint64_t i = 0; reader->valid && i < num_states; i++) {
+        lf_checkpoint_entry_t* state = _lf_checkpoint_read_entry(reader, registry->states, registry->num_states);
+        uint64_t size = _lf_checkpoint_read_u64(reader);
+        const void* bytes = _lf_checkpoint_read(reader, (size_t)size);
+        if (bytes == NULL) break;
+        if (size != state->size) {
+            lf_print_error("Checkpoint holds %llu bytes for %s, which has %zu.",
+                    (unsigned long long)size, state->name, state->size);
+            reader->valid = false;
+        } else if (apply) {
+            memcpy(state->data, bytes, state->size);
+        }
+    }
+
+    uint64_t num_events = _lf_checkpoint_read_u64(reader);
+    for (uint64_t i = 0; reader->valid && i < num_events; i++) {
+        lf_checkpoint_entry_t* entry = _lf_checkpoint_read_entry(reader, registry->triggers, registry->num_triggers);
+        tag_t tag;
+        tag.time = _lf_checkpoint_read_time(reader);
+        tag.microstep = _lf_checkpoint_read_microstep(reader);
+        const uint8_t* has_token = (const uint8_t*)_lf_checkpoint_read(reader, 1);
+        uint64_t length = 0, size = 0;
+        const void* payload = NULL;
+        if (has_token != NULL && *has_token) {
+            length = _lf_checkpoint_read_u64(reader);
+            size = _lf_checkpoint_read_u64(reader);
+            payload = _lf_checkpoint_read(reader, (size_t)size);
+        }
+        if (!reader->valid || !apply) continue;
+        trigger_t* trigger = (trigger_t*)entry->data;
+        lf_token_t* token = NULL;
+        if (*has_token) {
+            if (size == 0) {
+                token = _lf_new_token((token_type_t*)trigger, NULL, 0);
+            } else {
+                token = _lf_new_token_with_payload((token_type_t*)trigger, (size_t)length, (size_t)size);
+                lf_assert(token != NULL, "Out of memory");
+                memcpy(token->value, payload, (size_t)size);
+            }
+        }
+        tag.time += shift;
+        _lf_schedule_at_tag(env, trigger, tag, token);
+    }
+    return reader->valid;
+}
+
+bool _lf_checkpoint_resume(environment_t* env) {
+    if (_lf_resume_file == NULL) return false;
+#ifdef FEDERATED
+    lf_print_error_and_exit("Federates cannot resume from a checkpoint.");
+#endif
+    char name[CHECKPOINT_FILE_NAME_LENGTH];
+    if (!_lf_checkpoint_file_name(env, _lf_resume_file, name, sizeof(name))) {
+        lf_print_error_and_exit("Checkpoint file name %s is too long.", _lf_resume_file);
+    }
+    FILE* file = fopen(name, "rb");
+    if (file == NULL) {
+        lf_print("---- No checkpoint in %s. Starting from scratch.", name);
+        return false;
+    }
+    unsigned char* data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = (unsigned char*)malloc(length > 0 ? (size_t)length : 1);
+        lf_assert(data != NULL, "Out of memory");
+        if (fread(data, 1, (size_t)length, file) != (size_t)length) length = -1;
+    }
+    fclose(file);
+    lf_checkpoint_reader_t reader = {.data = data, .length = (size_t)length, .position = 0, .valid = length >= 0};
+    if (!_lf_checkpoint_load(env, &reader, false)) {
+        lf_print_error_and_exit("Checkpoint %s is malformed or does not match this program.", name);
+    }
+    reader = (lf_checkpoint_reader_t){.data = data, .length = (size_t)length, .position = 0, .valid = true};
+    _lf_checkpoint_load(env, &reader, true);
+    free(data);
+    lf_print("---- Resumed from %s at tag " PRINTF_TAG ".", name,
+            env->current_tag.time - start_time, env->current_tag.microstep);
+    return true;
+}
+
+void _lf_checkpoint_free(environment_t* env) {
+    lf_checkpoint_registry_t* registry = env->checkpoint;
+    if (registry == NULL) return;
+    for (size_t i = 0; i < registry->num_triggers; i++) free(registry->triggers[i].name);
+    for (size_t i = 0; i < registry->num_states; i++) free(registry->states[i].name);
+    free(registry->triggers);
+    free(registry->states);
+    free(registry->requested);
+    free(registry);
+    env->checkpoint = NULL;
+}
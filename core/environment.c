@@ -34,8 +34,16 @@
 #include "lf_types.h"
 #include <string.h>
 #include "trace.h"
+#include "reaction_stats.h"
+#include "checkpoint.h"
+#include "pqueue_calendar.h"
+#include "pqueue_dary.h"
+#include "pqueue_level.h"
+#include "reactor_common.h"
 #if !defined(LF_SINGLE_THREADED)
 #include "scheduler.h"
+#include "reactor_threaded.h"
+#include "enclave_channel.h"
 #endif
 
 /**
@@ -48,7 +56,22 @@ static void environment_init_threaded(environment_t* env, int num_workers) {
     lf_assert(env->thread_ids != NULL, "Out of memory");
     env->barrier.requestors = 0;
     env->barrier.horizon = FOREVER_TAG;
-    
+    env->barrier.version = 0;
+    env->barrier.waiting = 0;
+    env->inbox = NULL;
+    env->incoming_channels = NULL;
+    env->sleeping_until = NEVER;
+    env->notifications = 0;
+    env->present_lists = (lf_present_list_t*)calloc(num_workers, sizeof(lf_present_list_t));
+    lf_assert(env->present_lists != NULL, "Out of memory");
+    env->worker_slots_claimed = 0;
+    env->min_workers = num_workers;
+    env->worker_priority = 0;
+    env->workers_executing = 0;
+    env->workers_waiting = 0;
+    // The last list is for threads other than the workers.
+    env->num_token_copy_lists = num_workers + 1;
+
     // Initialize synchronization objects.
     if (lf_mutex_init(&env->mutex) != 0) {
         lf_print_error_and_exit("Could not initialize environment mutex");
@@ -56,6 +79,10 @@ static void environment_init_threaded(environment_t* env, int num_workers) {
     if (lf_cond_init(&env->event_q_changed, &env->mutex) != 0) {
         lf_print_error_and_exit("Could not initialize environment event queue condition variable");
     }
+    if (lf_cond_init(&env->bounded_event_handled, &env->mutex) != 0) {
+        lf_print_error_and_exit("Could not initialize environment bounded event condition variable");
+    }
+    env->producers_blocked = 0;
     if (lf_cond_init(&env->global_tag_barrier_requestors_reached_zero, &env->mutex)) {
         lf_print_error_and_exit("Could not initialize environment tag barrier condition variable");
     }
@@ -68,11 +95,14 @@ static void environment_init_threaded(environment_t* env, int num_workers) {
  */
 static void environment_init_single_threaded(environment_t* env) {
 #ifdef LF_SINGLE_THREADED
+    env->num_token_copy_lists = 1;
     // Reaction queue ordered first by deadline, then by level.
     // The index of the reaction holds the deadline in the 48 most significant bits,
-    // the level in the 16 least significant bits.
-    env->reaction_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+    // the level in the 16 least significant bits. Most reactions share the deadline
+    // part, so a level queue holds them in FIFOs per level rather than in a heap.
+    env->reaction_q = pqueue_level_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
                 get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+    lf_assert(env->reaction_q != NULL, "Out of memory");
 
 #endif
 }
@@ -128,7 +158,13 @@ void environment_init_tags( environment_t *env, instant_t start_time, interval_t
 static void environment_free_threaded(environment_t* env) {
 #if !defined(LF_SINGLE_THREADED)
     free(env->thread_ids);
-    lf_sched_free(env->scheduler);   
+    for (int i = 0; i < env->num_workers; i++) {
+        free(env->present_lists[i].fields);
+    }
+    free(env->present_lists);
+    lf_sched_free(env->scheduler);
+    _lf_inbox_free(env);
+    _lf_enclave_channels_free(env);
 #endif
 }
 
@@ -143,6 +179,7 @@ static void environment_free_modes(environment_t* env) {
     if (env->modes) {
         free(env->modes->modal_reactor_states);
         free(env->modes->state_resets);
+        free(env->modes->state_reset_snapshot);
         free(env->modes);
     }
 #endif
@@ -156,19 +193,40 @@ static void environment_free_federated(environment_t* env) {
 
 void environment_free(environment_t* env) {
     free(env->timer_triggers);
+    free(env->timer_groups);
     free(env->startup_reactions);
     free(env->shutdown_reactions);
     free(env->reset_reactions);
     free(env->is_present_fields);
     free(env->is_present_fields_abbreviated);
+    free(env->token_copies);
+    _lf_scratch_free(env);
+    free(env->scratch_arenas);
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    free(env->port_presence);
+    free(env->port_presence_group);
+    free(env->port_presence_width);
+#endif
     pqueue_free(env->event_q);
-    pqueue_free(env->recycle_q);
-    pqueue_free(env->next_q);
+    vector_free(&env->next_microstep);
+    vector_free(&env->draining_microstep);
+    while (env->event_slabs != NULL) {
+        lf_event_slab_t* slab = env->event_slabs;
+        env->event_slabs = slab->next;
+        free(slab);
+    }
+    while (env->fan_outs != NULL) {
+        lf_fan_out_t* fan_out = env->fan_outs;
+        env->fan_outs = fan_out->next;
+        free(fan_out);
+    }
 
     environment_free_threaded(env);
     environment_free_single_threaded(env);
     environment_free_modes(env);
     environment_free_federated(env);
+    _lf_free_reaction_stats(env);
+    _lf_checkpoint_free(env);
     trace_free(env->trace);
 }
 
@@ -193,6 +251,7 @@ int environment_init(
     env->timer_triggers_size=num_timers;
     env->timer_triggers = (trigger_t **) calloc(num_timers, sizeof(trigger_t));
     lf_assert(env->timer_triggers != NULL, "Out of memory");
+    env->timer_groups = NULL;
 
     env->startup_reactions_size=num_startup_reactions;
     env->startup_reactions = (reaction_t **) calloc(num_startup_reactions, sizeof(reaction_t));
@@ -215,15 +274,42 @@ int environment_init(
     env->is_present_fields_abbreviated = (bool**)calloc(num_is_present_fields, sizeof(bool*));
     lf_assert(env->is_present_fields_abbreviated != NULL, "Out of memory");
 
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    env->port_presence_size = num_is_present_fields;
+    env->port_presence_used = 0;
+    env->port_presence = (bool*)calloc(num_is_present_fields, sizeof(bool));
+    env->port_presence_group = (int*)calloc(num_is_present_fields, sizeof(int));
+    env->port_presence_width = (int*)calloc(num_is_present_fields, sizeof(int));
+    lf_assert(env->port_presence != NULL && env->port_presence_group != NULL
+            && env->port_presence_width != NULL, "Out of memory");
+#endif
+
     env->_lf_handle=1;
+
+    env->batched_events = NULL;
+    env->free_events = NULL;
+    env->event_slabs = NULL;
+    env->fan_outs = NULL;
+    env->checkpoint = NULL;
+    env->replay = NULL;
+    env->events_allocated = 0;
+    env->events_live = 0;
+    env->events_peak = 0;
+    env->event_budget = 0;
+    // With a memory profile, make the queues large enough for all its events.
+    size_t queue_size = _lf_apply_memory_profile(env);
+    if (queue_size < INITIAL_EVENT_QUEUE_SIZE) queue_size = INITIAL_EVENT_QUEUE_SIZE;
     
     // Initialize our priority queues.
-    env->event_q = pqueue_init(INITIAL_EVENT_QUEUE_SIZE, in_reverse_order, get_event_time,
-            get_event_position, set_event_position, event_matches, print_event);
-    env->recycle_q = pqueue_init(INITIAL_EVENT_QUEUE_SIZE, in_no_particular_order, get_event_time,
+#ifdef LF_EVENT_QUEUE_CALENDAR
+    env->event_q = pqueue_calendar_init(queue_size, in_reverse_order, get_event_time,
             get_event_position, set_event_position, event_matches, print_event);
-    env->next_q = pqueue_init(INITIAL_EVENT_QUEUE_SIZE, in_no_particular_order, get_event_time,
+#else
+    env->event_q = pqueue_dary_init(queue_size, in_reverse_order, get_event_time,
             get_event_position, set_event_position, event_matches, print_event);
+#endif
+    env->next_microstep = vector_new(queue_size);
+    env->draining_microstep = vector_new(queue_size);
 
     // If tracing is enabled. Initialize a tracing struct on the env struct.
     env->trace = trace_new(env, trace_file_name);
@@ -231,9 +317,45 @@ int environment_init(
     // Initialize functionality depending on target properties.
     environment_init_threaded(env, num_workers);
     environment_init_single_threaded(env);
+    env->token_copies = (lf_token_t**)calloc(env->num_token_copy_lists, sizeof(lf_token_t*));
+    lf_assert(env->token_copies != NULL, "Out of memory");
+    env->scratch_arenas = (struct lf_scratch_chunk_t**)calloc(env->num_token_copy_lists,
+            sizeof(struct lf_scratch_chunk_t*));
+    lf_assert(env->scratch_arenas != NULL, "Out of memory");
+    env->scratch_bytes = 0;
     environment_init_modes(env, num_modes, num_state_resets);
     environment_init_federated(env, num_is_present_fields);
 
     env->initialized = true;
     return 0;
 }
+
+void environment_set_workers(environment_t* env, int min_workers, int max_workers, int priority) {
+#if !defined(LF_SINGLE_THREADED)
+    if (max_workers <= 0) max_workers = (int)_lf_number_of_workers;
+    if (max_workers <= 0) max_workers = 1;
+    if (min_workers < 0) min_workers = 0;
+    if (min_workers > max_workers) min_workers = max_workers;
+    if (max_workers != env->num_workers) {
+        for (int i = 0; i < env->num_token_copy_lists; i++) {
+            lf_assert(env->token_copies[i] == NULL && env->scratch_arenas[i] == NULL,
+                    "Workers of an environment set after it started.");
+        }
+        free(env->thread_ids);
+        free(env->present_lists);
+        free(env->token_copies);
+        free(env->scratch_arenas);
+        env->num_workers = max_workers;
+        env->thread_ids = (lf_thread_t*)calloc(max_workers, sizeof(lf_thread_t));
+        env->present_lists = (lf_present_list_t*)calloc(max_workers, sizeof(lf_present_list_t));
+        env->num_token_copy_lists = max_workers + 1;
+        env->token_copies = (lf_token_t**)calloc(env->num_token_copy_lists, sizeof(lf_token_t*));
+        env->scratch_arenas = (struct lf_scratch_chunk_t**)calloc(env->num_token_copy_lists,
+                sizeof(struct lf_scratch_chunk_t*));
+        lf_assert(env->thread_ids != NULL && env->present_lists != NULL && env->token_copies != NULL
+                && env->scratch_arenas != NULL, "Out of memory");
+    }
+    env->min_workers = min_workers;
+    env->worker_priority = priority;
+#endif
+}
@@ -11,6 +11,22 @@ extern instant_t start_time;
 // RTI mutex, which is the main lock  
 extern lf_mutex_t rti_mutex;
 
+// Whether the paths of connections between enclaves have been found.
+static bool paths_found = false;
+
+// The mutexes of the shards of the federation, or NULL until they are formed.
+static lf_mutex_t* shard_mutexes = NULL;
+
+// Number of shards.
+static int number_of_shards = 0;
+
+// Whether lock_shard() measures the time spent waiting for the mutexes.
+static bool lock_waits_measured = false;
+
+// Total time spent by threads waiting in lock_shard() and number of waits.
+static int64_t lock_wait_time = 0LL;
+static int64_t lock_waits = 0LL;
+
 // FIXME: For log and debug message in this file, what sould be kept: 'enclave', 
 //        'federate', or 'enlcave/federate'? Currently its is 'enclave/federate'.
 // FIXME: Should enclaves tracing use the same mechanism as federates? 
@@ -28,20 +44,24 @@ void initialize_enclave(enclave_t* e, uint16_t id) {
     e->upstream = NULL;
     e->upstream_delay = NULL;
     e->num_upstream = 0;
+    e->min_output_delay = 0LL;
     e->downstream = NULL;
     e->num_downstream = 0;
     e->mode = REALTIME;
+    e->paths = NULL;
+    e->shard_mutex = &rti_mutex;
 
     // Initialize the next event condition variable.
     lf_cond_init(&e->next_event_condition, &rti_mutex);
 }
 
-void logical_tag_complete(enclave_t* enclave, tag_t completed) {
+void enclave_logical_tag_complete(enclave_t* enclave, tag_t completed) {
     // FIXME: Consolidate this message with NET to get NMR (Next Message Request).
     // Careful with handling startup and shutdown.
-    lf_mutex_lock(&rti_mutex);
+    lf_mutex_t* mutex = lock_shard(enclave);
 
     enclave->completed = completed;
+    update_paths_from_enclave(enclave);
 
     LF_PRINT_LOG("RTI received from federate/enclave %d the Logical Tag Complete (LTC) " PRINTF_TAG ".",
                 enclave->id, enclave->completed.time - start_time, enclave->completed.microstep);
@@ -57,14 +77,353 @@ void logical_tag_complete(enclave_t* enclave, tag_t completed) {
         free(visited);
     }
 
-    lf_mutex_unlock(&rti_mutex);
+    lf_mutex_unlock(mutex);
+}
+
+/**
+ * Return the delay of the connection from the upstream enclave at the
+ * given index to the specified enclave, extended by the minimum output
+ * delay of the upstream enclave. As for upstream_delay, "no delay" is
+ * encoded as NEVER, whereas one microstep delay is encoded as 0LL.
+ * @param e The enclave.
+ * @param j The index of the upstream enclave in e->upstream.
+ */
+static interval_t upstream_delay(enclave_t* e, int j) {
+    interval_t delay = e->upstream_delay[j];
+    interval_t output_delay = _e_rti->enclaves[e->upstream[j]]->min_output_delay;
+    if (output_delay <= 0LL) {
+        return delay;
+    }
+    if (delay == NEVER) {
+        return output_delay;
+    }
+    // A microstep delay is subsumed by the output delay.
+    return lf_time_add(delay, output_delay);
+}
+
+/**
+ * Return the latest tag that precedes the given tag, or the given tag itself
+ * if it is NEVER or FOREVER.
+ * @param tag The tag.
+ */
+static tag_t latest_tag_before(tag_t tag) {
+    if (tag.time == NEVER || tag.time == FOREVER) {
+        return tag;
+    }
+    if (tag.microstep > 0) {
+        tag.microstep--;
+    } else {
+        tag.time--;
+        tag.microstep = UINT_MAX;
+    }
+    return tag;
+}
+
+/**
+ * Return the kind of a connection with the given delay, encoded as for upstream_delay.
+ * @param delay The delay.
+ */
+static path_kind_t path_kind(interval_t delay) {
+    if (delay == NEVER) {
+        return PATH_NO_DELAY;
+    }
+    if (delay == 0LL) {
+        return PATH_MICROSTEP_DELAY;
+    }
+    return PATH_TIME_DELAY;
+}
+
+/**
+ * Return the delay over a path consisting of one connection with the given
+ * delay, encoded as for upstream_delay. See enclave_paths_t.
+ * @param delay The delay.
+ */
+static tag_t connection_path_delay(interval_t delay) {
+    if (delay == NEVER) {
+        return (tag_t){.time = 0LL, .microstep = 0u};
+    }
+    if (delay == 0LL) {
+        return (tag_t){.time = 0LL, .microstep = 1u};
+    }
+    return (tag_t){.time = delay, .microstep = 0u};
+}
+
+/**
+ * Return the delay over a path that follows the first path with the second one.
+ * Since a tag can be seen as a delay from time 0, this also gives the tag at
+ * which a message sent at tag first arrives over a path with delay second.
+ * @param first The delay over the first path, or a tag.
+ * @param second The delay over the second path.
+ */
+static tag_t concatenate_path_delays(tag_t first, tag_t second) {
+    if (second.time <= 0LL) {
+        first.microstep += second.microstep;
+        return first;
+    }
+    tag_t result = {.time = lf_time_add(first.time, second.time), .microstep = second.microstep};
+    return result;
+}
+
+/**
+ * Return the tag at which a message sent at the given tag arrives over a path
+ * with the given delay.
+ * @param tag The tag.
+ * @param delay The delay over the path.
+ */
+static tag_t apply_path_delay(tag_t tag, tag_t delay) {
+    if (tag.time == NEVER || tag.time == FOREVER) {
+        return tag;
+    }
+    return concatenate_path_delays(tag, delay);
+}
+
+/**
+ * Return the earliest tag at which the specified enclave may send a message,
+ * regardless of the enclaves upstream of it, or FOREVER_TAG if it is no longer
+ * connected.
+ * @param e The enclave.
+ */
+static tag_t earliest_event(enclave_t* e) {
+    if (e->state == NOT_CONNECTED) {
+        return FOREVER_TAG;
+    }
+    tag_t result = e->next_event;
+    if (result.time < start_time) {
+        result = (tag_t){.time = start_time, .microstep = 0u};
+    }
+    if (lf_tag_compare(result, e->completed) < 0) {
+        result = e->completed;
+    }
+    return result;
+}
+
+/**
+ * Restore the order of a min-heap after the key at the given position has changed.
+ * @param heap The heap, as an array of indices into keys.
+ * @param size The number of elements of the heap.
+ * @param i The position of the changed key in the heap.
+ * @param keys The keys.
+ * @param positions The position of each index in the heap, which this updates.
+ */
+static void fix_heap(int* heap, int size, int i, tag_t* keys, int* positions) {
+    while (i > 0 && lf_tag_compare(keys[heap[i]], keys[heap[(i - 1) / 2]]) < 0) {
+        int parent = (i - 1) / 2;
+        int index = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = index;
+        positions[heap[i]] = i;
+        positions[index] = parent;
+        i = parent;
+    }
+    while (true) {
+        int smallest = i;
+        for (int child = 2 * i + 1; child <= 2 * i + 2 && child < size; child++) {
+            if (lf_tag_compare(keys[heap[child]], keys[heap[smallest]]) < 0) {
+                smallest = child;
+            }
+        }
+        if (smallest == i) {
+            break;
+        }
+        int index = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = index;
+        positions[heap[i]] = i;
+        positions[index] = smallest;
+        i = smallest;
+    }
+}
+
+/**
+ * Add an index to a min-heap.
+ * @param heap The heap, which must have room for the index.
+ * @param size The number of elements of the heap, which this increments.
+ * @param index The index.
+ * @param keys The keys.
+ * @param positions The position of each index in the heap, which this updates.
+ */
+static void push_heap(int* heap, int* size, int index, tag_t* keys, int* positions) {
+    heap[*size] = index;
+    positions[index] = *size;
+    (*size)++;
+    fix_heap(heap, *size, *size - 1, keys, positions);
+}
+
+/**
+ * Return the earliest tag at which a message can arrive over the paths of the given kind.
+ * @param paths The paths to an enclave.
+ * @param kind The kind.
+ */
+static tag_t earliest_arrival(enclave_paths_t* paths, path_kind_t kind) {
+    if (paths->heap_size[kind] == 0) {
+        return FOREVER_TAG;
+    }
+    return paths->arrival[paths->heap[kind][0]];
+}
+
+/**
+ * Record a path of the given delay to an enclave from the specified upstream enclave
+ * if it is shorter than the ones found so far.
+ * @param upstream The ID of the upstream enclave.
+ * @param path_delay The delay over the path.
+ * @param delay The delay of the shortest path found so far from each enclave.
+ * @param heap The heap of enclaves whose shortest path may still be followed upstream.
+ * @param size The number of elements of the heap.
+ * @param position The position of each enclave in the heap, or -1.
+ */
+static void shorten_path(int upstream, tag_t path_delay, tag_t* delay, int* heap, int* size, int* position) {
+    if (lf_tag_compare(path_delay, delay[upstream]) >= 0) {
+        return;
+    }
+    delay[upstream] = path_delay;
+    if (position[upstream] < 0) {
+        push_heap(heap, size, upstream, delay, position);
+    } else {
+        fix_heap(heap, *size, position[upstream], delay, position);
+    }
+}
+
+/**
+ * Find the minimum delays over the paths to the specified enclave whose last connection
+ * has a delay of the given kind, from each (transitively) upstream enclave. Since delays
+ * compare like tags and never decrease as a path is extended upstream, this uses
+ * Dijkstra's algorithm.
+ * @param e The enclave.
+ * @param kind The kind.
+ * @param delay The delay from each enclave, which this fills in (FOREVER_TAG if there is no path).
+ * @param heap An array of size number_of_enclaves.
+ * @param position An array of size number_of_enclaves.
+ */
+static void find_path_delays(enclave_t* e, path_kind_t kind, tag_t* delay, int* heap, int* position) {
+    int size = 0;
+    for (int i = 0; i < _e_rti->number_of_enclaves; i++) {
+        delay[i] = FOREVER_TAG;
+        position[i] = -1;
+    }
+    for (int j = 0; j < e->num_upstream; j++) {
+        interval_t connection_delay = upstream_delay(e, j);
+        if (path_kind(connection_delay) == kind) {
+            shorten_path(e->upstream[j], connection_path_delay(connection_delay), delay, heap, &size, position);
+        }
+    }
+    while (size > 0) {
+        // The shortest path from the enclave at the top of the heap is final.
+        int id = heap[0];
+        position[id] = -1;
+        size--;
+        if (size > 0) {
+            heap[0] = heap[size];
+            position[heap[0]] = 0;
+            fix_heap(heap, size, 0, delay, position);
+        }
+        enclave_t* upstream = _e_rti->enclaves[id];
+        for (int j = 0; j < upstream->num_upstream; j++) {
+            tag_t path_delay = concatenate_path_delays(
+                    connection_path_delay(upstream_delay(upstream, j)), delay[id]);
+            shorten_path(upstream->upstream[j], path_delay, delay, heap, &size, position);
+        }
+    }
+}
+
+/**
+ * Find the paths of connections between enclaves (see enclave_paths_t) and
+ * the earliest tags at which messages can arrive over them. This is done once,
+ * upon the first tag advance grant decision, when all enclaves have connected.
+ */
+static void find_paths() {
+    int n = _e_rti->number_of_enclaves;
+    tag_t* delay = (tag_t*)calloc(n, sizeof(tag_t));
+    int* heap = (int*)calloc(n, sizeof(int));
+    int* position = (int*)calloc(n, sizeof(int));
+    uint16_t* upstream = (uint16_t*)calloc(NUMBER_OF_PATH_KINDS * n, sizeof(uint16_t));
+    path_kind_t* kind = (path_kind_t*)calloc(NUMBER_OF_PATH_KINDS * n, sizeof(path_kind_t));
+    tag_t* path_delay = (tag_t*)calloc(NUMBER_OF_PATH_KINDS * n, sizeof(tag_t));
+    if (delay == NULL || heap == NULL || position == NULL
+            || upstream == NULL || kind == NULL || path_delay == NULL) {
+        lf_print_error_and_exit("RTI failed to allocate memory for the paths between enclaves.");
+    }
+    for (int i = 0; i < n; i++) {
+        _e_rti->enclaves[i]->paths = (enclave_paths_t*)calloc(1, sizeof(enclave_paths_t));
+        if (_e_rti->enclaves[i]->paths == NULL) {
+            lf_print_error_and_exit("RTI failed to allocate memory for the paths between enclaves.");
+        }
+    }
+
+    // Find the paths to each enclave.
+    for (int i = 0; i < n; i++) {
+        enclave_t* e = _e_rti->enclaves[i];
+        int num_paths = 0;
+        for (int k = 0; k < NUMBER_OF_PATH_KINDS; k++) {
+            find_path_delays(e, (path_kind_t)k, delay, heap, position);
+            for (int j = 0; j < n; j++) {
+                if (lf_tag_compare(delay[j], FOREVER_TAG) < 0) {
+                    upstream[num_paths] = (uint16_t)j;
+                    kind[num_paths] = (path_kind_t)k;
+                    path_delay[num_paths] = delay[j];
+                    num_paths++;
+                }
+            }
+        }
+        enclave_paths_t* paths = e->paths;
+        paths->num_paths = num_paths;
+        paths->upstream = (uint16_t*)calloc(num_paths, sizeof(uint16_t));
+        paths->kind = (path_kind_t*)calloc(num_paths, sizeof(path_kind_t));
+        paths->delay = (tag_t*)calloc(num_paths, sizeof(tag_t));
+        paths->arrival = (tag_t*)calloc(num_paths, sizeof(tag_t));
+        paths->position = (int*)calloc(num_paths, sizeof(int));
+        for (int k = 0; k < NUMBER_OF_PATH_KINDS; k++) {
+            paths->heap[k] = (int*)calloc(num_paths, sizeof(int));
+        }
+        if (num_paths > 0 && (paths->upstream == NULL || paths->kind == NULL || paths->delay == NULL
+                || paths->arrival == NULL || paths->position == NULL || paths->heap[PATH_NO_DELAY] == NULL
+                || paths->heap[PATH_MICROSTEP_DELAY] == NULL || paths->heap[PATH_TIME_DELAY] == NULL)) {
+            lf_print_error_and_exit("RTI failed to allocate memory for the paths between enclaves.");
+        }
+        for (int p = 0; p < num_paths; p++) {
+            paths->upstream[p] = upstream[p];
+            paths->kind[p] = kind[p];
+            paths->delay[p] = path_delay[p];
+            paths->arrival[p] = apply_path_delay(earliest_event(_e_rti->enclaves[upstream[p]]), path_delay[p]);
+            push_heap(paths->heap[kind[p]], &(paths->heap_size[kind[p]]), p, paths->arrival, paths->position);
+            _e_rti->enclaves[upstream[p]]->paths->num_downstream_paths++;
+        }
+        LF_PRINT_DEBUG("RTI found %d paths to federate/enclave %d.", num_paths, e->id);
+    }
+    free(delay);
+    free(heap);
+    free(position);
+    free(upstream);
+    free(kind);
+    free(path_delay);
+
+    // Index the paths from each enclave.
+    for (int i = 0; i < n; i++) {
+        enclave_paths_t* paths = _e_rti->enclaves[i]->paths;
+        paths->downstream = (uint16_t*)calloc(paths->num_downstream_paths, sizeof(uint16_t));
+        paths->downstream_path = (int*)calloc(paths->num_downstream_paths, sizeof(int));
+        if (paths->num_downstream_paths > 0 && (paths->downstream == NULL || paths->downstream_path == NULL)) {
+            lf_print_error_and_exit("RTI failed to allocate memory for the paths between enclaves.");
+        }
+        paths->num_downstream_paths = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        enclave_paths_t* paths = _e_rti->enclaves[i]->paths;
+        for (int p = 0; p < paths->num_paths; p++) {
+            enclave_paths_t* from = _e_rti->enclaves[paths->upstream[p]]->paths;
+            from->downstream[from->num_downstream_paths] = (uint16_t)i;
+            from->downstream_path[from->num_downstream_paths] = p;
+            from->num_downstream_paths++;
+        }
+    }
+    paths_found = true;
 }
 
 tag_advance_grant_t tag_advance_grant_if_safe(enclave_t* e) {
     tag_advance_grant_t result = {.tag = NEVER_TAG, .is_provisional = false};
 
-    // Find the earliest LTC of upstream enclaves (M).
-    tag_t min_upstream_completed = FOREVER_TAG;
+    // Find the earliest LTC of upstream enclaves (M), keeping it packed so
+    // that the loop does not branch on the comparisons.
+    lf_packed_tag_t min_completed = lf_tag_pack(FOREVER_TAG);
 
     for (int j = 0; j < e->num_upstream; j++) {
         enclave_t *upstream = _e_rti->enclaves[e->upstream[j]];
@@ -75,12 +434,10 @@ tag_advance_grant_t tag_advance_grant_if_safe(enclave_t* e) {
         // Adjust by the "after" delay.
         // Note that "no delay" is encoded as NEVER,
         // whereas one microstep delay is encoded as 0LL.
-        tag_t candidate = lf_delay_strict(upstream->completed, e->upstream_delay[j]);
-
-        if (lf_tag_compare(candidate, min_upstream_completed) < 0) {
-            min_upstream_completed = candidate;
-        }
+        tag_t candidate = _lf_delay_strict(upstream->completed, upstream_delay(e, j));
+        min_completed = lf_packed_tag_min(min_completed, lf_tag_pack(candidate));
     }
+    tag_t min_upstream_completed = lf_tag_unpack(min_completed);
     LF_PRINT_LOG("Minimum upstream LTC for federate/enclave %d is " PRINTF_TAG 
             "(adjusted by after delay).",
             e->id,
@@ -96,59 +453,47 @@ tag_advance_grant_t tag_advance_grant_if_safe(enclave_t* e) {
     // If all (transitive) upstream enclaves of the enclave
     // have earliest event tags such that the
     // enclave can now advance its tag, then send it a TAG message.
-    // Find the earliest event time of each such upstream enclave,
-    // adjusted by delays on the connections.
-
-    // To handle cycles, need to create a boolean array to keep
-    // track of which upstream enclave have been visited.
-    bool *visited = (bool *)calloc(_e_rti->number_of_enclaves, sizeof(bool)); // Initializes to 0.
+    // The earliest tags at which messages can arrive over the paths
+    // from upstream enclaves are kept up to date as their states change.
+    if (!paths_found) {
+        find_paths();
+    }
 
-    // Find the tag of the earliest possible incoming message from
-    // upstream enclaves.
-    tag_t t_d_nonzero_delay = FOREVER_TAG;
     // The tag of the earliest possible incoming message from a zero-delay connection.
     // Delayed connections are not guarded from STP violations by the MLAA; this property is
     // acceptable because delayed connections impose no deadlock risk and in some cases (startup)
     // this property is necessary to avoid deadlocks. However, it requires some special care here
     // when potentially sending a PTAG because we must not send a PTAG for a tag at which data may
     // still be received over nonzero-delay connections.
-    tag_t t_d_zero_delay = FOREVER_TAG;
+    tag_t t_d_zero_delay = earliest_arrival(e->paths, PATH_NO_DELAY);
+    // Find the tag of the earliest possible incoming message from
+    // upstream enclaves over delayed connections. A message over a
+    // connection with a positive delay arrives at microstep 0,
+    // so all microsteps of the preceding time are safe.
+    tag_t microstep_delay_arrival = earliest_arrival(e->paths, PATH_MICROSTEP_DELAY);
+    tag_t time_delay_arrival = earliest_arrival(e->paths, PATH_TIME_DELAY);
+    tag_t t_d_nonzero_delay = time_delay_arrival;
+    if (t_d_nonzero_delay.time != NEVER && t_d_nonzero_delay.time != FOREVER) {
+        t_d_nonzero_delay.time--;
+        t_d_nonzero_delay.microstep = UINT_MAX;
+    }
+    if (lf_tag_compare(microstep_delay_arrival, t_d_nonzero_delay) < 0) {
+        t_d_nonzero_delay = microstep_delay_arrival;
+    }
     LF_PRINT_DEBUG("NOTE: FOREVER is displayed as " PRINTF_TAG " and NEVER as " PRINTF_TAG,
                    FOREVER_TAG.time - start_time, FOREVER_TAG.microstep,
                    NEVER_TAG.time - start_time, 0);
 
-    for (int j = 0; j < e->num_upstream; j++) {
-        enclave_t *upstream = _e_rti->enclaves[e->upstream[j]];
-
-        // Ignore this enclave if it is no longer connected.
-        if (upstream->state == NOT_CONNECTED) continue;
-
-        // Find the (transitive) next event tag upstream.
-        tag_t upstream_next_event = transitive_next_event(
-                upstream, upstream->next_event, visited);
-
-        LF_PRINT_DEBUG("Earliest next event upstream of fed/encl %d at fed/encl %d has tag " PRINTF_TAG ".",
-                e->id,
-                upstream->id,
-                upstream_next_event.time - start_time, upstream_next_event.microstep);
-
-        // Adjust by the "after" delay.
-        // Note that "no delay" is encoded as NEVER,
-        // whereas one microstep delay is encoded as 0LL.
-        tag_t candidate = lf_delay_strict(upstream_next_event, e->upstream_delay[j]);
+    tag_t t_d = (lf_tag_compare(t_d_zero_delay, t_d_nonzero_delay) < 0) ? t_d_zero_delay : t_d_nonzero_delay;
 
-        if (e->upstream_delay[j] == NEVER) {
-            if (lf_tag_compare(candidate, t_d_zero_delay) < 0) {
-                t_d_zero_delay = candidate;
-            }
-        } else {
-            if (lf_tag_compare(candidate, t_d_nonzero_delay) < 0) {
-                t_d_nonzero_delay = candidate;
-            }
-        }
+    // The latest tag that precedes any possible incoming message, which can be granted
+    // instead of the next event tag of the enclave if grant_ahead is set.
+    tag_t earliest = (lf_tag_compare(t_d_zero_delay, microstep_delay_arrival) < 0) ?
+            t_d_zero_delay : microstep_delay_arrival;
+    if (lf_tag_compare(time_delay_arrival, earliest) < 0) {
+        earliest = time_delay_arrival;
     }
-    free(visited);
-    tag_t t_d = (lf_tag_compare(t_d_zero_delay, t_d_nonzero_delay) < 0) ? t_d_zero_delay : t_d_nonzero_delay;
+    tag_t horizon = latest_tag_before(earliest);
 
     LF_PRINT_LOG("Earliest next event upstream has tag " PRINTF_TAG ".",
             t_d.time - start_time, t_d.microstep);
@@ -168,6 +513,14 @@ tag_advance_grant_t tag_advance_grant_if_safe(enclave_t* e) {
                 e->next_event.time - lf_time_start(),
                 e->next_event.microstep);
         result.tag = e->next_event;
+        if (_e_rti->grant_ahead && lf_tag_compare(horizon, e->next_event) > 0) {
+            // No message can arrive before the horizon, so let the enclave
+            // process its events up to there without further NETs.
+            LF_PRINT_LOG("Granting fed/encl %d a tag advance ahead to " PRINTF_TAG ".",
+                    e->id,
+                    horizon.time - start_time, horizon.microstep);
+            result.tag = horizon;
+        }
     } else if (
         lf_tag_compare(t_d_zero_delay, e->next_event) == 0      // The enclave has something to do.
         && lf_tag_compare(t_d_zero_delay, t_d_nonzero_delay) < 0  // The statuses of nonzero-delay connections are known at tag t_d_zero_delay
@@ -198,6 +551,7 @@ void notify_downstream_advance_grant_if_safe(enclave_t* e, bool visited[]) {
 
 void update_enclave_next_event_tag_locked(enclave_t* e, tag_t next_event_tag) {
     e->next_event = next_event_tag;
+    update_paths_from_enclave(e);
 
     LF_PRINT_DEBUG(
        "RTI: Updated the recorded next event tag for federate/enclave %d to " PRINTF_TAG,
@@ -266,20 +620,26 @@ void notify_advance_grant_if_safe(enclave_t* e) {
     }
 }
 
-tag_t transitive_next_event(enclave_t* e, tag_t candidate, bool visited[]) {
-    if (visited[e->id] || e->state == NOT_CONNECTED) {
-        // Enclave has stopped executing or we have visited it before.
-        // No point in checking upstream enclaves.
-        return candidate;
+void update_paths_from_enclave(enclave_t* e) {
+    if (!paths_found) {
+        return;
     }
+    enclave_paths_t* from = e->paths;
+    tag_t earliest = earliest_event(e);
+    for (int i = 0; i < from->num_downstream_paths; i++) {
+        enclave_paths_t* to = _e_rti->enclaves[from->downstream[i]]->paths;
+        int p = from->downstream_path[i];
+        to->arrival[p] = apply_path_delay(earliest, to->delay[p]);
+        path_kind_t kind = to->kind[p];
+        fix_heap(to->heap[kind], to->heap_size[kind], to->position[p], to->arrival, to->position);
+    }
+}
 
-    visited[e->id] = true;
-    tag_t result = e->next_event;
-
-    // If the candidate is less than this enclave's next_event, use the candidate.
-    if (lf_tag_compare(candidate, result) < 0) {
-        result = candidate;
+tag_t earliest_next_event(enclave_t* e) {
+    if (!paths_found) {
+        find_paths();
     }
+    tag_t result = e->next_event;
 
     // The result cannot be earlier than the start time.
     if (result.time < start_time) {
@@ -287,18 +647,12 @@ tag_t transitive_next_event(enclave_t* e, tag_t candidate, bool visited[]) {
         result = (tag_t){.time = start_time, .microstep = 0u};
     }
 
-    // Check upstream enclaves to see whether any of them might send
-    // an event that would result in an earlier next event.
-    for (int i = 0; i < e->num_upstream; i++) {
-        tag_t upstream_result = transitive_next_event(
-            _e_rti->enclaves[e->upstream[i]], result, visited);
-
-        // Add the "after" delay of the connection to the result.
-        upstream_result = lf_delay_tag(upstream_result, e->upstream_delay[i]);
-
-        // If the adjusted event time is less than the result so far, update the result.
-        if (lf_tag_compare(upstream_result, result) < 0) {
-            result = upstream_result;
+    // Check whether any upstream enclave might send a message
+    // that would result in an earlier next event.
+    for (int kind = 0; kind < NUMBER_OF_PATH_KINDS; kind++) {
+        tag_t arrival = earliest_arrival(e->paths, (path_kind_t)kind);
+        if (lf_tag_compare(arrival, result) < 0) {
+            result = arrival;
         }
     }
     if (lf_tag_compare(result, e->completed) < 0) {
@@ -306,3 +660,90 @@ tag_t transitive_next_event(enclave_t* e, tag_t candidate, bool visited[]) {
     }
     return result;
 }
+
+void form_shards() {
+    int n = _e_rti->number_of_enclaves;
+    // Find the paths between enclaves now, since they span shards.
+    if (!paths_found) {
+        find_paths();
+    }
+    int* shard = (int*)calloc(n, sizeof(int));
+    int* queue = (int*)calloc(n, sizeof(int));
+    if (shard == NULL || queue == NULL) {
+        lf_print_error_and_exit("RTI failed to allocate memory for the shards.");
+    }
+    for (int i = 0; i < n; i++) {
+        shard[i] = -1;
+    }
+    // Find the shard of each enclave with a breadth-first search
+    // following connections in both directions.
+    for (int i = 0; i < n; i++) {
+        if (shard[i] >= 0) continue;
+        int head = 0;
+        int tail = 0;
+        shard[i] = number_of_shards;
+        queue[tail++] = i;
+        while (head < tail) {
+            enclave_t* e = _e_rti->enclaves[queue[head++]];
+            for (int j = 0; j < e->num_upstream + e->num_downstream; j++) {
+                int neighbor = (j < e->num_upstream) ? e->upstream[j] : e->downstream[j - e->num_upstream];
+                if (shard[neighbor] < 0) {
+                    shard[neighbor] = number_of_shards;
+                    queue[tail++] = neighbor;
+                }
+            }
+        }
+        number_of_shards++;
+    }
+    shard_mutexes = (lf_mutex_t*)calloc(number_of_shards, sizeof(lf_mutex_t));
+    if (shard_mutexes == NULL) {
+        lf_print_error_and_exit("RTI failed to allocate memory for the shards.");
+    }
+    for (int i = 0; i < number_of_shards; i++) {
+        lf_mutex_init(&shard_mutexes[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        _e_rti->enclaves[i]->shard_mutex = &shard_mutexes[shard[i]];
+    }
+    free(shard);
+    free(queue);
+    LF_PRINT_LOG("RTI partitioned %d federates/enclaves into %d shards.", n, number_of_shards);
+}
+
+lf_mutex_t* lock_shard(enclave_t* e) {
+    instant_t wait_start = lock_waits_measured ? lf_time_physical() : NEVER;
+    while (true) {
+        lf_mutex_t* mutex = e->shard_mutex;
+        lf_mutex_lock(mutex);
+        // The shards may have been formed while this thread waited for rti_mutex.
+        if (mutex == e->shard_mutex) {
+            if (wait_start != NEVER) {
+                lf_atomic_fetch_add(&lock_wait_time, lf_time_physical() - wait_start);
+                lf_atomic_fetch_add(&lock_waits, 1);
+            }
+            return mutex;
+        }
+        lf_mutex_unlock(mutex);
+    }
+}
+
+void measure_lock_waits() {
+    lock_waits_measured = true;
+}
+
+interval_t get_lock_wait_time(int64_t* waits) {
+    *waits = lock_waits;
+    return lock_wait_time;
+}
+
+void lock_all_shards() {
+    for (int i = 0; i < number_of_shards; i++) {
+        lf_mutex_lock(&shard_mutexes[i]);
+    }
+}
+
+void unlock_all_shards() {
+    for (int i = number_of_shards - 1; i >= 0; i--) {
+        lf_mutex_unlock(&shard_mutexes[i]);
+    }
+}
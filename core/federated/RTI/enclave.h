@@ -23,6 +23,9 @@
 #include "tag.h"        // Time-related types and functions.
 #include "trace.h"      // Tracing related functions
 
+// The runtime defines the trace object only with LF_TRACE.
+typedef struct trace_t trace_t;
+
 
 /** Mode of execution of a federate. */
 typedef enum execution_mode_t {
@@ -37,6 +40,41 @@ typedef enum fed_state_t {
     PENDING         // Waiting for upstream federates.
 } fed_state_t;
 
+/** Kind of delay on the last connection of a path of connections to an enclave. */
+typedef enum path_kind_t {
+    PATH_NO_DELAY,          // The last connection has no delay.
+    PATH_MICROSTEP_DELAY,   // The last connection has a microstep delay.
+    PATH_TIME_DELAY,        // The last connection has a positive delay.
+    NUMBER_OF_PATH_KINDS
+} path_kind_t;
+
+/**
+ * The paths of connections to an enclave from the enclaves (transitively)
+ * upstream of it, and the paths from it to the enclaves downstream of it.
+ * For each upstream enclave and each kind of delay on the last connection,
+ * only the path with the minimum delay is kept, along with the earliest tag
+ * at which a message can arrive over it given the current state of the
+ * upstream enclave. The paths of each kind are in a min-heap by that tag,
+ * so that tag_advance_grant_if_safe() does not need to traverse the federation.
+ *
+ * A delay over a path is represented as a tag (d, n), which, applied to a
+ * tag (t, m), gives (t + d, n) if d is positive and (t, m + n) otherwise.
+ */
+typedef struct enclave_paths_t {
+    int num_paths;          // Number of paths to the enclave.
+    uint16_t* upstream;     // ID of the upstream enclave of each path.
+    path_kind_t* kind;      // Kind of delay on the last connection of each path.
+    tag_t* delay;           // Delay over each path.
+    tag_t* arrival;         // Earliest tag at which a message can arrive over each path.
+    int* position;          // Position of each path in the heap of its kind.
+    int* heap[NUMBER_OF_PATH_KINDS];        // Min-heaps of the paths of each kind by arrival.
+    int heap_size[NUMBER_OF_PATH_KINDS];    // Number of paths in each heap.
+    int num_downstream_paths;   // Number of paths from the enclave.
+    uint16_t* downstream;       // ID of the downstream enclave of each path from the enclave.
+    int* downstream_path;       // Index of each path from the enclave among the paths to its
+                                // downstream enclave.
+} enclave_paths_t;
+
 /**
  * Information about enclave known to the RTI, including its runtime state,
  * mode of execution, and connectivity with other enclaves.
@@ -56,9 +94,15 @@ typedef struct enclave_t {
     interval_t* upstream_delay;    // Minimum delay on connections from upstream federates.
     							   // Here, NEVER encodes no delay. 0LL is a microstep delay.
     int num_upstream;              // Size of the array of upstream federates and delays.
+    interval_t min_output_delay;   // Minimum delay between a tag of the enclave and the tags of
+                                   // its outputs, added to the delays of its outgoing connections.
     int* downstream;        // Array of downstream federate ids.
     int num_downstream;     // Size of the array of downstream federates.
     execution_mode_t mode;  // FAST or REALTIME.
+    enclave_paths_t* paths; // Paths of connections to and from the enclave, or NULL until
+                            // they have been found upon the first tag advance grant decision.
+    lf_mutex_t* shard_mutex;    // Mutex guarding the state of the enclave, which is rti_mutex
+                                // until the enclaves are partitioned into shards (see form_shards()).
     lf_cond_t next_event_condition; // Condition variable used by enclaves to notify an enclave
                                     // that it's call to next_event_tag() should unblock.
 } enclave_t;
@@ -91,6 +135,9 @@ typedef struct enclave_rti_t {
 
     // Trace object
     trace_t* trace;
+
+    // Boolean indicating that tags beyond the next event tag may be granted.
+    bool grant_ahead;
 } enclave_rti_t;
 
 
@@ -102,7 +149,7 @@ typedef struct enclave_rti_t {
  * @param enclave The enclave
  * @param completed The completed tag of the enclave
  */
-void logical_tag_complete(enclave_t* enclave, tag_t completed);
+void enclave_logical_tag_complete(enclave_t* enclave, tag_t completed);
 
 typedef struct {
     tag_t tag;           // NEVER if there is no tag advance grant.
@@ -228,7 +275,7 @@ tag_advance_grant_t next_event_tag(enclave_t* e, tag_t next_event_tag);
  *
  * This will notify downstream enclaves with a TAG or PTAG if appropriate.
  *
- * This function assumes that the caller is holding the rti_mutex.
+ * This function assumes that the caller is holding the mutex of the shard of e.
  *
  * @param e The enclave.
  * @param next_event_tag The next event tag for e.
@@ -236,28 +283,90 @@ tag_advance_grant_t next_event_tag(enclave_t* e, tag_t next_event_tag);
 void update_enclave_next_event_tag_locked(enclave_t* e, tag_t next_event_tag);
 
 /**
- * Find the earliest tag at which the specified federate may
- * experience its next event. This is the least next event tag (NET)
- * of the specified federate and (transitively) upstream federates
- * (with delays of the connections added). For upstream federates,
- * we assume (conservatively) that federate upstream of those
- * may also send an event. The result will never be less than
- * the completion time of the federate (which may be NEVER,
- * if the federate has not yet completed a logical time).
+ * Update the earliest tags at which messages can arrive over the paths from
+ * the specified enclave. This must be called whenever the next event tag, the
+ * completed tag, or the state of the enclave changes.
+ *
+ * This function assumes that the caller holds the mutex lock.
+ *
+ * @param e The enclave.
+ */
+void update_paths_from_enclave(enclave_t* e);
+
+/**
+ * Partition the enclaves into shards, which are the largest sets of enclaves
+ * connected to each other, directly or transitively, in either direction,
+ * and give each shard its own mutex. From then on, the state of an enclave is
+ * guarded by the mutex of its shard (see lock_shard()) instead of rti_mutex,
+ * so that the RTI handles enclaves of different shards in parallel. Since tag
+ * advance grants only depend on the state of connected enclaves, the grant
+ * logic is unaffected.
+ *
+ * Operations that involve enclaves of several shards hold rti_mutex and
+ * then lock all shards (see lock_all_shards()). A thread that holds the mutex
+ * of a shard must not acquire rti_mutex or the mutex of another shard.
+ *
+ * This function must be called once all enclaves have connected and
+ * been given the start time, by a thread that holds rti_mutex.
+ */
+void form_shards();
+
+/**
+ * Lock the mutex guarding the state of the specified enclave, which is
+ * rti_mutex until the shards are formed.
+ *
+ * @param e The enclave.
+ * @return The mutex, which the caller must unlock.
+ */
+lf_mutex_t* lock_shard(enclave_t* e);
+
+/**
+ * Make lock_shard() measure the time that threads wait for the mutexes,
+ * which costs two readings of the physical clock per call.
+ */
+void measure_lock_waits();
+
+/**
+ * Return the total time that threads have waited in lock_shard() since
+ * measure_lock_waits() was called.
+ *
+ * @param waits Where to store the number of calls to lock_shard() measured.
+ */
+interval_t get_lock_wait_time(int64_t* waits);
+
+/**
+ * Lock the mutexes of all shards, in order. This does nothing before the
+ * shards are formed.
+ *
+ * This function assumes that the caller holds rti_mutex.
+ */
+void lock_all_shards();
+
+/**
+ * Unlock the mutexes of all shards locked by lock_all_shards().
+ */
+void unlock_all_shards();
+
+/**
+ * Find the earliest tag at which the specified enclave may
+ * experience its next event. This is the least of the next event tag (NET)
+ * of the specified enclave and the earliest tags at which messages can
+ * arrive over the paths of connections from (transitively) upstream
+ * enclaves, which are assumed (conservatively) to send a message at their
+ * own next event tag. The result will never be less than
+ * the completion time of the enclave (which may be NEVER,
+ * if the enclave has not yet completed a logical time).
  *
  * FIXME: This could be made less conservative by building
  * at code generation time a causality interface table indicating
  * which outputs can be triggered by which inputs. For now, we
  * assume any output can be triggered by any input.
  *
+ * This function assumes that the caller holds the mutex lock.
+ *
  * @param e The enclave.
- * @param candidate A candidate tag (for the first invocation,
- *  this should be fed->next_event).
- * @param visited An array of booleans indicating which federates
- *  have been visited (for the first invocation, this should be
- *  an array of falses of size _RTI.number_of_federates).
  * @return The earliest next event tag of the enclave e.
  */
-tag_t transitive_next_event(enclave_t *e, tag_t candidate, bool visited[]);
+tag_t earliest_next_event(enclave_t* e);
 
 #endif // ENCLAVE_H
\ No newline at end of file
@@ -1,7 +1,16 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Tag advance grants for enclaves that run in the same process as the
+ * RTI logic (see rti_local.h), which unblock the enclave instead of sending it
+ * a message, as rti_lib.c does for federates.
+ */
+
 #include "enclave.h"
 
-// References to the enclave RTI.    
-extern enclave_rti_t * _e_rti;
+// References to the enclave RTI.
+extern enclave_rti_t* _e_rti;
 
 void notify_tag_advance_grant(enclave_t* e, tag_t tag) {
     if (e->state == NOT_CONNECTED
@@ -10,11 +19,23 @@ void notify_tag_advance_grant(enclave_t* e, tag_t tag) {
     ) {
         return;
     }
-    if (_e_rti.tracing_enabled) {
-        tracepoint_rti_to_federate(_e_rti.trace, send_TAG, e->id, &tag);
+    if (_e_rti->tracing_enabled) {
+        tracepoint_rti_to_federate(_e_rti->trace, send_TAG, e->id, &tag);
     }
     e->last_granted = tag;
     lf_cond_signal(&e->next_event_condition);
 }
 
-
+void notify_provisional_tag_advance_grant(enclave_t* e, tag_t tag) {
+    if (e->state == NOT_CONNECTED
+            || lf_tag_compare(tag, e->last_granted) <= 0
+            || lf_tag_compare(tag, e->last_provisionally_granted) <= 0
+    ) {
+        return;
+    }
+    if (_e_rti->tracing_enabled) {
+        tracepoint_rti_to_federate(_e_rti->trace, send_PTAG, e->id, &tag);
+    }
+    e->last_provisionally_granted = tag;
+    lf_cond_signal(&e->next_event_condition);
+}
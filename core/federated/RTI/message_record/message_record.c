@@ -29,9 +29,15 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ***************/
 
 #include "message_record.h"
+#include "pqueue_dary.h"
 #include "platform.h"
 #include <stdlib.h>
 
+/**
+ * Initial capacity of the ring buffer of an in-transit message record queue.
+ */
+#define IN_TRANSIT_RING_INITIAL_CAPACITY 16
+
 /**
  * @brief Initialize the in-transit message record queue.
  * 
@@ -43,7 +49,10 @@ in_transit_message_record_q_t* initialize_in_transit_message_q() {
             1, 
             sizeof(in_transit_message_record_q_t)
         );
-    queue->main_queue = pqueue_init(
+    queue->ring = (tag_t*)malloc(IN_TRANSIT_RING_INITIAL_CAPACITY * sizeof(tag_t));
+    queue->ring_capacity = IN_TRANSIT_RING_INITIAL_CAPACITY;
+
+    queue->main_queue = pqueue_dary_init(
         10, 
         in_reverse_order, 
         get_message_record_index,
@@ -53,7 +62,7 @@ in_transit_message_record_q_t* initialize_in_transit_message_q() {
         print_message_record
     );
 
-    queue->transfer_queue = pqueue_init(
+    queue->transfer_queue = pqueue_dary_init(
         10, 
         in_reverse_order, 
         get_message_record_index,
@@ -72,11 +81,37 @@ in_transit_message_record_q_t* initialize_in_transit_message_q() {
  * @param queue The queue to free.
  */
 void free_in_transit_message_q(in_transit_message_record_q_t* queue) {
+    in_transit_message_record_t* record;
+    while ((record = (in_transit_message_record_t*)pqueue_pop(queue->main_queue)) != NULL) {
+        free(record);
+    }
+    for (size_t i = 0; i < queue->pool_size; i++) {
+        free(queue->pool[i]);
+    }
+    free(queue->pool);
+    free(queue->ring);
     pqueue_free(queue->main_queue);
     pqueue_free(queue->transfer_queue);
     free(queue);
 }
 
+/**
+ * @brief Return a record to the pool of the queue for reuse.
+ *
+ * @param queue The queue.
+ * @param record The record, which is no longer in the priority queue.
+ */
+static void release_record(in_transit_message_record_q_t* queue, in_transit_message_record_t* record) {
+    if (queue->pool_size == queue->pool_capacity) {
+        queue->pool_capacity = (queue->pool_capacity == 0) ? 8 : 2 * queue->pool_capacity;
+        queue->pool = (in_transit_message_record_t**)realloc(
+            queue->pool,
+            queue->pool_capacity * sizeof(in_transit_message_record_t*)
+        );
+    }
+    queue->pool[queue->pool_size++] = record;
+}
+
 /**
  * @brief Add a record of the in-transit message.
  * 
@@ -85,7 +120,29 @@ void free_in_transit_message_q(in_transit_message_record_q_t* queue) {
  * @return 0 on success.
  */
 int add_in_transit_message_record(in_transit_message_record_q_t* queue, tag_t tag) {
-    in_transit_message_record_t* in_transit_record = malloc(sizeof(in_transit_message_record_t));
+    size_t mask = queue->ring_capacity - 1;
+    if (queue->ring_size == 0
+            || lf_tag_compare(tag, queue->ring[(queue->ring_head + queue->ring_size - 1) & mask]) >= 0) {
+        if (queue->ring_size == queue->ring_capacity) {
+            // Double the capacity, unwrapping the tags at the start of the new buffer.
+            tag_t* ring = (tag_t*)malloc(2 * queue->ring_capacity * sizeof(tag_t));
+            for (size_t i = 0; i < queue->ring_size; i++) {
+                ring[i] = queue->ring[(queue->ring_head + i) & mask];
+            }
+            free(queue->ring);
+            queue->ring = ring;
+            queue->ring_head = 0;
+            queue->ring_capacity *= 2;
+            mask = queue->ring_capacity - 1;
+        }
+        queue->ring[(queue->ring_head + queue->ring_size) & mask] = tag;
+        queue->ring_size++;
+        return 0;
+    }
+    // The message is out of order.
+    in_transit_message_record_t* in_transit_record = (queue->pool_size > 0) ?
+            queue->pool[--queue->pool_size]
+            : (in_transit_message_record_t*)malloc(sizeof(in_transit_message_record_t));
     in_transit_record->tag = tag;
     return pqueue_insert(
         queue->main_queue, 
@@ -100,6 +157,20 @@ int add_in_transit_message_record(in_transit_message_record_q_t* queue, tag_t ta
  * @param tag Will clean all messages with tags <= tag.
  */
 void clean_in_transit_message_record_up_to_tag(in_transit_message_record_q_t* queue, tag_t tag) {
+    size_t mask = queue->ring_capacity - 1;
+    while (queue->ring_size > 0 && lf_tag_compare(queue->ring[queue->ring_head], tag) <= 0) {
+        LF_PRINT_DEBUG(
+            "RTI: Removed a message with tag (" PRINTF_TIME ", %u) from the list of in-transit messages.",
+            queue->ring[queue->ring_head].time - lf_time_start(),
+            queue->ring[queue->ring_head].microstep
+        );
+        queue->ring_head = (queue->ring_head + 1) & mask;
+        queue->ring_size--;
+    }
+    if (pqueue_size(queue->main_queue) == 0) {
+        return;
+    }
+
     in_transit_message_record_t* head_of_in_transit_messages = (in_transit_message_record_t*)pqueue_peek(queue->main_queue);
     while (
         head_of_in_transit_messages != NULL &&              // Queue is not empty
@@ -119,7 +190,7 @@ void clean_in_transit_message_record_up_to_tag(in_transit_message_record_q_t* qu
                 head_of_in_transit_messages->tag.microstep
             );
 
-            free(pqueue_pop(queue->main_queue));
+            release_record(queue, (in_transit_message_record_t*)pqueue_pop(queue->main_queue));
         } else {
             // Add it to the transfer queue
             pqueue_insert(queue->transfer_queue, pqueue_pop(queue->main_queue));
@@ -137,7 +208,11 @@ void clean_in_transit_message_record_up_to_tag(in_transit_message_record_q_t* qu
  * @return tag_t The minimum tag of all currently recorded in-transit messages. Return `FOREVER_TAG` if the queue is empty.
  */
 tag_t get_minimum_in_transit_message_tag(in_transit_message_record_q_t* queue) {
-    tag_t minimum_tag = FOREVER_TAG;
+    // The tags in the ring buffer are in order.
+    tag_t minimum_tag = (queue->ring_size > 0) ? queue->ring[queue->ring_head] : FOREVER_TAG;
+    if (pqueue_size(queue->main_queue) == 0) {
+        return minimum_tag;
+    }
 
     in_transit_message_record_t* head_of_in_transit_messages = (in_transit_message_record_t*)pqueue_peek(queue->main_queue);
     while (head_of_in_transit_messages != NULL) { // Queue is not empty
@@ -161,13 +236,15 @@ tag_t get_minimum_in_transit_message_tag(in_transit_message_record_q_t* queue) {
     // Empty the transfer queue (which holds messages with equal time but larger microstep) into the main queue.
     pqueue_empty_into(&queue->main_queue, &queue->transfer_queue);
 
-    if (head_of_in_transit_messages != NULL) {
-        LF_PRINT_DEBUG(
-            "RTI: Minimum tag of all in-transit messages: " PRINTF_TAG,
-            head_of_in_transit_messages->tag.time - lf_time_start(),
-            head_of_in_transit_messages->tag.microstep
-        );
-    }
+    LF_PRINT_DEBUG(
+        "RTI: Minimum tag of all in-transit messages: " PRINTF_TAG,
+        minimum_tag.time - lf_time_start(),
+        minimum_tag.microstep
+    );
 
     return minimum_tag;
 }
+
+size_t get_in_transit_message_count(in_transit_message_record_q_t* queue) {
+    return queue->ring_size + pqueue_size(queue->main_queue);
+}
@@ -35,11 +35,24 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /**
  * @brief Queue to keep a record of in-transit messages.
- * 
+ *
+ * Messages to a federate are usually forwarded in tag order, so the tags
+ * of the records are kept in a ring buffer in nondecreasing order, which
+ * makes adding, cleaning, and finding the minimum constant-time operations
+ * without any allocation. A message whose tag is less than the last tag in
+ * the ring buffer is recorded in a priority queue instead, with a record
+ * taken from a pool of records that is refilled when records are cleaned.
  */
 typedef struct {
-    pqueue_t* main_queue;       // The primary queue.
+    tag_t* ring;                // Tags of the records in nondecreasing order.
+    size_t ring_capacity;       // Capacity of the ring buffer, which is a power of two.
+    size_t ring_head;           // Index of the least tag in the ring buffer.
+    size_t ring_size;           // Number of tags in the ring buffer.
+    pqueue_t* main_queue;       // The queue of records that arrived out of order.
     pqueue_t* transfer_queue;   // Queue used for housekeeping.
+    in_transit_message_record_t** pool;  // Records available for reuse.
+    size_t pool_size;           // Number of records in the pool.
+    size_t pool_capacity;       // Capacity of the pool.
 } in_transit_message_record_q_t;
 
 /**
@@ -81,4 +94,12 @@ void clean_in_transit_message_record_up_to_tag(in_transit_message_record_q_t* qu
  */
 tag_t get_minimum_in_transit_message_tag(in_transit_message_record_q_t* queue);
 
+/**
+ * @brief Get the number of currently recorded in-transit messages.
+ *
+ * @param queue The queue (of type `in_transit_message_record_q`).
+ * @return size_t The number of records in the queue.
+ */
+size_t get_in_transit_message_count(in_transit_message_record_q_t* queue);
+
 #endif // RTI_MESSAGE_RECORD_H
@@ -0,0 +1,507 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley
+ * License in [BSD 2-clause](https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md)
+ * @brief Splitting a large federation among regional RTIs (see region.h).
+ */
+
+#include "region.h"
+#include <string.h>
+#include <netdb.h>      // Defines getaddrinfo().
+
+// Global variables defined in tag.c:
+extern instant_t start_time;
+
+extern federation_rti_t* _f_rti;
+extern lf_mutex_t rti_mutex;
+
+/** Number of regions, or 0 if the federation is not split into regions. */
+static int32_t number_of_regions = 0;
+
+/**
+ * The ID of the first federate of each region, followed by the number
+ * of federates in the federation.
+ */
+static uint16_t* first_federate = NULL;
+
+/** The region coordinated by this RTI, or -1 if this RTI is not a regional RTI. */
+static int32_t my_region = -1;
+
+/** Host name and port of the parent RTI. */
+static char* parent_host = NULL;
+static uint16_t parent_port = 0;
+
+/**
+ * For each region, the least delay over connections from its federates to the federates
+ * of this region, encoded as in enclave_t, or FOREVER if there are no such connections.
+ */
+static interval_t* region_upstream_delay = NULL;
+
+/** For each region, whether federates of this region have connections to its federates. */
+static bool* region_downstream = NULL;
+
+/** For each federate of this region, whether it has connections to other regions. */
+static bool* connected_to_other_regions = NULL;
+
+/** The next event tag and the completed tag last sent to the parent RTI. */
+static tag_t reported_next_event = {.time = NEVER, .microstep = 0u};
+static tag_t reported_completed = {.time = NEVER, .microstep = 0u};
+
+/** Whether the stop tag of the region has been reported to the parent RTI. */
+static bool stop_reported = false;
+
+/** Whether the region has resigned from the parent RTI. */
+static bool resigned = false;
+
+bool set_region_sizes(const char* sizes) {
+    number_of_regions = 0;
+    uint32_t total = 0;
+    const char* next = sizes;
+    while (*next != '\0') {
+        char* end;
+        long size = strtol(next, &end, 10);
+        if (end == next || size <= 0L || total + size > UINT16_MAX || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        first_federate = (uint16_t*)realloc(first_federate, (number_of_regions + 2) * sizeof(uint16_t));
+        first_federate[number_of_regions++] = (uint16_t)total;
+        total += (uint32_t)size;
+        first_federate[number_of_regions] = (uint16_t)total;
+        next = (*end == ',') ? end + 1 : end;
+    }
+    return number_of_regions > 0;
+}
+
+bool set_region(int32_t region, const char* parent) {
+    const char* colon = strrchr(parent, ':');
+    if (region < 0 || colon == NULL || colon == parent) {
+        return false;
+    }
+    long port = strtol(colon + 1, NULL, 10);
+    if (port <= 0L || port >= UINT16_MAX) {
+        return false;
+    }
+    size_t length = (size_t)(colon - parent);
+    parent_host = (char*)malloc(length + 1);
+    memcpy(parent_host, parent, length);
+    parent_host[length] = '\0';
+    parent_port = (uint16_t)port;
+    my_region = region;
+    return true;
+}
+
+bool initialize_regions() {
+    if (number_of_regions == 0) {
+        if (my_region >= 0) {
+            lf_print_error("--region requires --regions.");
+            return false;
+        }
+        return true;
+    }
+    if (my_region >= number_of_regions) {
+        lf_print_error("There is no region %d among %d regions.", my_region, number_of_regions);
+        return false;
+    }
+    int32_t expected = number_of_regions;
+    if (my_region >= 0) {
+        expected = first_federate[my_region + 1] - first_federate[my_region];
+    }
+    if (_f_rti->number_of_enclaves != 0 && _f_rti->number_of_enclaves != expected) {
+        lf_print_error("--number_of_federates (%d) should be %d for the given regions.",
+                _f_rti->number_of_enclaves, expected);
+        return false;
+    }
+    if (my_region < 0) {
+        lf_print("RTI: Parent of %d regions of %u federates.", number_of_regions, first_federate[number_of_regions]);
+        _f_rti->number_of_enclaves = number_of_regions;
+        return true;
+    }
+    lf_print("RTI: Region %d of %d with federates %u to %u, parent RTI at %s:%u.",
+            my_region, number_of_regions, first_federate[my_region], first_federate[my_region + 1] - 1,
+            parent_host, parent_port);
+    region_upstream_delay = (interval_t*)malloc(number_of_regions * sizeof(interval_t));
+    region_downstream = (bool*)calloc(number_of_regions, sizeof(bool));
+    for (int i = 0; i < number_of_regions; i++) {
+        region_upstream_delay[i] = FOREVER;
+    }
+    connected_to_other_regions = (bool*)calloc(expected, sizeof(bool));
+    // One more enclave represents the parent RTI.
+    _f_rti->number_of_enclaves = expected + 1;
+    return true;
+}
+
+bool is_regional_rti() {
+    return my_region >= 0;
+}
+
+bool is_parent_rti(federate_t* fed) {
+    return my_region >= 0 && fed == _f_rti->enclaves[_f_rti->number_of_enclaves - 1];
+}
+
+/**
+ * Return the region of the specified federate.
+ * @param federate_id The ID of the federate, which must be in range.
+ */
+static int32_t region_of(uint16_t federate_id) {
+    int32_t low = 0;
+    int32_t high = number_of_regions - 1;
+    while (low < high) {
+        int32_t middle = (low + high + 1) / 2;
+        if (first_federate[middle] <= federate_id) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+int32_t federate_index(uint16_t federate_id) {
+    if (my_region < 0) {
+        return (federate_id < _f_rti->number_of_enclaves) ? federate_id : -1;
+    }
+    if (federate_id < first_federate[my_region] || federate_id >= first_federate[my_region + 1]) {
+        return -1;
+    }
+    return federate_id - first_federate[my_region];
+}
+
+federate_t* destination_federate(uint16_t federate_id) {
+    if (number_of_regions == 0) {
+        return (federate_id < _f_rti->number_of_enclaves) ? _f_rti->enclaves[federate_id] : NULL;
+    }
+    if (federate_id >= first_federate[number_of_regions]) {
+        return NULL;
+    }
+    if (my_region < 0) {
+        return _f_rti->enclaves[region_of(federate_id)];
+    }
+    int32_t index = federate_index(federate_id);
+    return _f_rti->enclaves[(index >= 0) ? index : _f_rti->number_of_enclaves - 1];
+}
+
+void localize_connections(federate_t* fed) {
+    if (my_region < 0) {
+        return;
+    }
+    enclave_t* e = &(fed->enclave);
+    enclave_t* parent = &(_f_rti->enclaves[_f_rti->number_of_enclaves - 1]->enclave);
+    uint16_t total = first_federate[number_of_regions];
+
+    int num_upstream = 0;
+    bool from_other_regions = false;
+    for (int i = 0; i < e->num_upstream; i++) {
+        int32_t index = federate_index((uint16_t)e->upstream[i]);
+        if (index >= 0) {
+            e->upstream[num_upstream] = index;
+            e->upstream_delay[num_upstream] = e->upstream_delay[i];
+            num_upstream++;
+        } else if (e->upstream[i] < total) {
+            int32_t region = region_of((uint16_t)e->upstream[i]);
+            if (e->upstream_delay[i] < region_upstream_delay[region]) {
+                region_upstream_delay[region] = e->upstream_delay[i];
+            }
+            from_other_regions = true;
+        } else {
+            lf_print_warning("RTI: Ignoring upstream federate %d of federate %d, which is out of range.",
+                    e->upstream[i], e->id);
+        }
+    }
+    if (from_other_regions) {
+        // The parent RTI accounts for the delays when it grants a tag to the region.
+        e->upstream[num_upstream] = parent->id;
+        e->upstream_delay[num_upstream] = NEVER;
+        num_upstream++;
+        parent->downstream = (int*)realloc(parent->downstream, (parent->num_downstream + 1) * sizeof(int));
+        parent->downstream[parent->num_downstream++] = e->id;
+    }
+    e->num_upstream = num_upstream;
+
+    int num_downstream = 0;
+    for (int i = 0; i < e->num_downstream; i++) {
+        int32_t index = federate_index((uint16_t)e->downstream[i]);
+        if (index >= 0) {
+            e->downstream[num_downstream++] = index;
+        } else if (e->downstream[i] < total) {
+            region_downstream[region_of((uint16_t)e->downstream[i])] = true;
+            connected_to_other_regions[e->id] = true;
+        } else {
+            lf_print_warning("RTI: Ignoring downstream federate %d of federate %d, which is out of range.",
+                    e->downstream[i], e->id);
+        }
+    }
+    e->num_downstream = num_downstream;
+}
+
+/**
+ * Connect to the parent RTI, retrying every CONNECT_RETRY_INTERVAL
+ * up to CONNECT_NUM_RETRIES times, and exit if that fails.
+ * @return The socket.
+ */
+static int connect_to_parent() {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;          /* Allow IPv4 */
+    hints.ai_socktype = SOCK_STREAM;    /* Stream socket */
+    hints.ai_protocol = IPPROTO_TCP;    /* TCP protocol */
+    hints.ai_flags = AI_NUMERICSERV;    /* Allow only numeric port numbers */
+    char port[6];
+    snprintf(port, sizeof(port), "%u", parent_port);
+
+    for (int retries = 0; retries <= CONNECT_NUM_RETRIES; retries++) {
+        struct addrinfo *res;
+        if (getaddrinfo(parent_host, port, &hints, &res) != 0) {
+            lf_print_error_and_exit("No host for the parent RTI matching given hostname: %s", parent_host);
+        }
+        int socket_id = create_real_time_tcp_socket_errexit();
+        int result = connect(socket_id, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        if (result == 0) {
+            lf_print("RTI: Connected to the parent RTI at %s:%u.", parent_host, parent_port);
+            return socket_id;
+        }
+        close(socket_id);
+        lf_print("RTI: Could not connect to the parent RTI at %s:%u. Will try again every %lld seconds.",
+                parent_host, parent_port, CONNECT_RETRY_INTERVAL / BILLION);
+        lf_sleep(CONNECT_RETRY_INTERVAL);
+    }
+    lf_print_error_and_exit("RTI failed to connect to the parent RTI after %d retries. Giving up.",
+            CONNECT_NUM_RETRIES);
+    return -1;
+}
+
+/**
+ * Send the IDs of the region and of the federation to the parent RTI
+ * on a MSG_TYPE_FED_IDS message, and exit if the parent RTI rejects them.
+ * @param socket_id The socket connected to the parent RTI.
+ */
+static void send_region_id(int socket_id) {
+    unsigned char buffer[2 + sizeof(uint16_t)];
+    buffer[0] = MSG_TYPE_FED_IDS;
+    encode_uint16((uint16_t)my_region, &buffer[1]);
+    size_t federation_id_length = strnlen(_f_rti->federation_id, 255);
+    buffer[1 + sizeof(uint16_t)] = (unsigned char)(federation_id_length & 0xff);
+    write_header_and_body_to_socket_with_mutex(socket_id, sizeof(buffer), buffer,
+            federation_id_length, (unsigned char*)_f_rti->federation_id, NULL,
+            "RTI failed to send the region and federation IDs to the parent RTI.");
+
+    unsigned char response[2];
+    read_from_socket_errexit(socket_id, 1, response, "RTI failed to read the response of the parent RTI.");
+    if (response[0] == MSG_TYPE_REJECT) {
+        read_from_socket_errexit(socket_id, 1, &response[1], "RTI failed to read the cause of rejection.");
+        lf_print_error_and_exit("The parent RTI rejected region %d with cause %u (see net_common.h).",
+                my_region, response[1]);
+    } else if (response[0] != MSG_TYPE_ACK) {
+        lf_print_error_and_exit("RTI expected a MSG_TYPE_ACK from the parent RTI. Got %u.", response[0]);
+    }
+}
+
+/**
+ * Send the connections of the region to other regions to the parent RTI
+ * on a MSG_TYPE_NEIGHBOR_STRUCTURE message.
+ * @param socket_id The socket connected to the parent RTI.
+ */
+static void send_region_connections(int socket_id) {
+    int32_t num_upstream = 0;
+    int32_t num_downstream = 0;
+    for (int i = 0; i < number_of_regions; i++) {
+        if (region_upstream_delay[i] != FOREVER) num_upstream++;
+        if (region_downstream[i]) num_downstream++;
+    }
+    size_t length = MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE
+            + num_upstream * (sizeof(uint16_t) + sizeof(int64_t))
+            + num_downstream * sizeof(uint16_t);
+    unsigned char* buffer = (unsigned char*)malloc(length);
+    buffer[0] = MSG_TYPE_NEIGHBOR_STRUCTURE;
+    encode_int32(num_upstream, &buffer[1]);
+    encode_int32(num_downstream, &buffer[1 + sizeof(int32_t)]);
+    size_t head = MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE;
+    for (int i = 0; i < number_of_regions; i++) {
+        if (region_upstream_delay[i] != FOREVER) {
+            encode_uint16((uint16_t)i, &buffer[head]);
+            head += sizeof(uint16_t);
+            encode_int64(region_upstream_delay[i], &buffer[head]);
+            head += sizeof(int64_t);
+        }
+    }
+    for (int i = 0; i < number_of_regions; i++) {
+        if (region_downstream[i]) {
+            encode_uint16((uint16_t)i, &buffer[head]);
+            head += sizeof(uint16_t);
+        }
+    }
+    write_to_socket_errexit(socket_id, length, buffer,
+            "RTI failed to send the connections of region %d to the parent RTI.", my_region);
+    free(buffer);
+    LF_PRINT_LOG("RTI sent to the parent RTI %d upstream and %d downstream regions.", num_upstream, num_downstream);
+}
+
+void propose_start_time_to_parent_locked(instant_t start_time) {
+    federate_t* parent = _f_rti->enclaves[_f_rti->number_of_enclaves - 1];
+    int socket_id = connect_to_parent();
+    send_region_id(socket_id);
+    send_region_connections(socket_id);
+
+    // Clock synchronization with the parent RTI is not supported.
+    unsigned char udp_port[1 + sizeof(uint16_t)];
+    udp_port[0] = MSG_TYPE_UDP_PORT;
+    encode_uint16(UINT16_MAX, &udp_port[1]);
+    write_to_socket_errexit(socket_id, sizeof(udp_port), udp_port,
+            "RTI failed to send MSG_TYPE_UDP_PORT to the parent RTI.");
+
+    // Messages to other regions are sent by the federates that are connected to them.
+    interval_t min_output_delay = FOREVER;
+    for (int i = 0; i < _f_rti->number_of_enclaves - 1; i++) {
+        if (connected_to_other_regions[i] && _f_rti->enclaves[i]->enclave.min_output_delay < min_output_delay) {
+            min_output_delay = _f_rti->enclaves[i]->enclave.min_output_delay;
+        }
+    }
+    if (min_output_delay > 0LL && min_output_delay != FOREVER) {
+        unsigned char delay[MSG_TYPE_MIN_OUTPUT_DELAY_LENGTH];
+        delay[0] = MSG_TYPE_MIN_OUTPUT_DELAY;
+        encode_int64(min_output_delay, &delay[1]);
+        write_to_socket_errexit(socket_id, sizeof(delay), delay,
+                "RTI failed to send MSG_TYPE_MIN_OUTPUT_DELAY to the parent RTI.");
+    }
+
+    unsigned char timestamp[MSG_TYPE_TIMESTAMP_LENGTH];
+    timestamp[0] = MSG_TYPE_TIMESTAMP;
+    encode_int64(swap_bytes_if_big_endian_int64(start_time), &timestamp[1]);
+    write_to_socket_errexit(socket_id, sizeof(timestamp), timestamp,
+            "RTI failed to propose a start time to the parent RTI.");
+    LF_PRINT_LOG("RTI proposed start time " PRINTF_TIME " to the parent RTI.", start_time);
+
+    parent->socket = socket_id;
+    parent->clock_synchronization_enabled = false;
+    parent->enclave.state = PENDING;
+    // The start time is handled by handle_timestamp().
+    if (_f_rti->listener_threads > 0) {
+        int result = socket_poller_add(&_f_rti->poller, socket_id, handle_federate_input, parent);
+        if (result != 0) {
+            lf_print_error_and_exit("RTI failed to watch the socket of the parent RTI. Error code: %d.", result);
+        }
+    } else {
+        lf_thread_create(&(parent->thread_id), federate_thread_TCP, parent);
+    }
+}
+
+void handle_parent_message(federate_t* parent, unsigned char message_type) {
+    unsigned char buffer[sizeof(int64_t) + sizeof(uint32_t)];
+    read_from_socket_errexit(parent->socket, sizeof(buffer), buffer,
+            "RTI failed to read a message of type %u from the parent RTI.", message_type);
+    tag_t tag = extract_tag(buffer);
+
+    lf_mutex_lock(&rti_mutex);
+    if (message_type == MSG_TYPE_STOP_GRANTED) {
+        LF_PRINT_LOG("RTI received from the parent RTI MSG_TYPE_STOP_GRANTED with tag " PRINTF_TAG ".",
+                tag.time - start_time, tag.microstep);
+        _f_rti->max_stop_tag = tag;
+        _lf_rti_broadcast_stop_time_to_federates_locked();
+        lf_mutex_unlock(&rti_mutex);
+        return;
+    }
+    enclave_t* e = &(parent->enclave);
+    if (message_type == MSG_TYPE_TAG_ADVANCE_GRANT) {
+        LF_PRINT_LOG("RTI received from the parent RTI the tag advance grant (TAG) " PRINTF_TAG ".",
+                tag.time - start_time, tag.microstep);
+        // All messages to the region with tags up to the granted tag have been forwarded.
+        if (lf_tag_compare(tag, e->completed) > 0) {
+            e->completed = tag;
+        }
+    } else {
+        LF_PRINT_LOG("RTI received from the parent RTI the Provisional Tag Advance Grant (PTAG) " PRINTF_TAG ".",
+                tag.time - start_time, tag.microstep);
+    }
+    // Messages to the region over connections without delay may arrive at the granted tag.
+    e->next_event = tag;
+    update_paths_from_enclave(e);
+    bool* visited = (bool*)calloc(_f_rti->number_of_enclaves, sizeof(bool)); // Initializes to 0.
+    notify_downstream_advance_grant_if_safe(e, visited);
+    free(visited);
+    lf_mutex_unlock(&rti_mutex);
+}
+
+void report_stop_to_parent_locked() {
+    federate_t* parent = _f_rti->enclaves[_f_rti->number_of_enclaves - 1];
+    if (stop_reported || parent->enclave.state == NOT_CONNECTED) {
+        return;
+    }
+    for (int i = 0; i < _f_rti->number_of_enclaves - 1; i++) {
+        if (!_f_rti->enclaves[i]->requested_stop) {
+            return;
+        }
+    }
+    unsigned char buffer[MSG_TYPE_STOP_REQUEST_LENGTH];
+    if (parent->requested_stop) {
+        ENCODE_STOP_REQUEST_REPLY(buffer, _f_rti->max_stop_tag.time, _f_rti->max_stop_tag.microstep);
+    } else {
+        ENCODE_STOP_REQUEST(buffer, _f_rti->max_stop_tag.time, _f_rti->max_stop_tag.microstep);
+    }
+    if (write_to_socket(parent->socket, MSG_TYPE_STOP_REQUEST_LENGTH, buffer) < (ssize_t)MSG_TYPE_STOP_REQUEST_LENGTH) {
+        lf_print_error("RTI failed to report the stop tag of region %d to the parent RTI.", my_region);
+    }
+    LF_PRINT_LOG("RTI reported to the parent RTI the stop tag " PRINTF_TAG ".",
+            _f_rti->max_stop_tag.time - start_time, _f_rti->max_stop_tag.microstep);
+    stop_reported = true;
+}
+
+/**
+ * Send a message with the specified type and tag to the parent RTI.
+ * @return false if the message could not be sent.
+ */
+static bool send_tag_to_parent(federate_t* parent, unsigned char message_type, tag_t tag) {
+    unsigned char buffer[1 + sizeof(int64_t) + sizeof(uint32_t)];
+    buffer[0] = message_type;
+    encode_tag(&(buffer[1]), tag);
+    if (write_to_socket(parent->socket, sizeof(buffer), buffer) < (ssize_t)sizeof(buffer)) {
+        lf_print_error("RTI failed to send a message of type %u to the parent RTI.", message_type);
+        return false;
+    }
+    return true;
+}
+
+void report_region_to_parent() {
+    lf_mutex_lock(&rti_mutex);
+    federate_t* parent = _f_rti->enclaves[_f_rti->number_of_enclaves - 1];
+    if (resigned || parent->enclave.state != GRANTED) {
+        // The region has not started yet or the parent RTI is gone.
+        lf_mutex_unlock(&rti_mutex);
+        return;
+    }
+    tag_t next_event = FOREVER_TAG;
+    tag_t completed = FOREVER_TAG;
+    bool any_connected = false;
+    for (int i = 0; i < _f_rti->number_of_enclaves - 1; i++) {
+        enclave_t* e = &(_f_rti->enclaves[i]->enclave);
+        if (e->state == NOT_CONNECTED) continue;
+        any_connected = true;
+        tag_t earliest = (lf_tag_compare(e->next_event, e->completed) > 0) ? e->next_event : e->completed;
+        if (lf_tag_compare(earliest, next_event) < 0) next_event = earliest;
+        if (lf_tag_compare(e->completed, completed) < 0) completed = e->completed;
+    }
+    if (!any_connected) {
+        send_tag_to_parent(parent, MSG_TYPE_RESIGN, reported_completed);
+        shutdown(parent->socket, SHUT_WR);
+        resigned = true;
+        lf_print("RTI: Region %d has resigned from the parent RTI.", my_region);
+        lf_mutex_unlock(&rti_mutex);
+        return;
+    }
+    tag_t start_tag = {.time = start_time, .microstep = 0u};
+    if (lf_tag_compare(next_event, start_tag) < 0) {
+        next_event = start_tag;
+    }
+    if (lf_tag_compare(completed, reported_completed) > 0
+            && send_tag_to_parent(parent, MSG_TYPE_LOGICAL_TAG_COMPLETE, completed)) {
+        reported_completed = completed;
+        LF_PRINT_LOG("RTI sent to the parent RTI the completed tag " PRINTF_TAG " of region %d.",
+                completed.time - start_time, completed.microstep, my_region);
+    }
+    if (lf_tag_compare(next_event, reported_next_event) != 0
+            && send_tag_to_parent(parent, MSG_TYPE_NEXT_EVENT_TAG, next_event)) {
+        reported_next_event = next_event;
+        LF_PRINT_LOG("RTI sent to the parent RTI the next event tag " PRINTF_TAG " of region %d.",
+                next_event.time - start_time, next_event.microstep, my_region);
+    }
+    lf_mutex_unlock(&rti_mutex);
+}
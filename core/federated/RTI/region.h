@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley
+ * License in [BSD 2-clause](https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md)
+ * @brief Declarations for splitting a large federation among regional RTIs.
+ *
+ * The federates are numbered consecutively across regions, so that region 0
+ * has the first federates, region 1 the next ones, and so on. Each region has
+ * its own RTI, to which the federates of the region connect as usual. A regional
+ * RTI connects in turn to a parent RTI, to which it appears as one federate whose
+ * ID is the number of the region. The parent RTI coordinates the regions as it
+ * would coordinate federates, without knowledge of the federates in them.
+ *
+ * To the parent RTI, a region is upstream of another if a federate of the former
+ * is upstream of a federate of the latter, with the least delay over such connections.
+ * Connections within a region are assumed to have no delay, which is conservative.
+ * The next event tag (NET) of a region is the least of those of its federates, and
+ * the completed tag of a region is the least of those of its federates.
+ *
+ * In a regional RTI, the parent RTI is represented by a federate that follows the
+ * federates of the region in the array of enclaves. It is upstream of every federate of
+ * the region that has a connection from outside the region, over a connection without
+ * delay, since the parent RTI has accounted for the delays when it granted a tag to the
+ * region. Tagged messages and port absent messages to federates outside the region are
+ * forwarded to it, which means to the socket connected to the parent RTI. Stop requests
+ * are settled among the federates of the region before being reported to the parent RTI.
+ *
+ * A regional RTI does not partition its federates into shards (see form_shards()),
+ * so its state is guarded by rti_mutex. Physical connections across regions, clock
+ * synchronization between the regional RTIs and the parent RTI, and authentication
+ * of regional RTIs are not supported.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include "rti_lib.h"
+
+/**
+ * Set the number of federates in each region from a comma-separated list.
+ * @param sizes The list, e.g., "4,4,2" for federates 0-3, 4-7, and 8-9.
+ * @return false if the list is not valid.
+ */
+bool set_region_sizes(const char* sizes);
+
+/**
+ * Make this RTI the RTI of the specified region.
+ * @param region The region.
+ * @param parent The host name and port of the parent RTI, separated by a colon.
+ * @return false if the address is not valid.
+ */
+bool set_region(int32_t region, const char* parent);
+
+/**
+ * Check that the configuration of regions given on the command line is consistent
+ * and set the number of enclaves of the RTI accordingly, which is the number of
+ * regions for the parent RTI, and the number of federates of the region plus one
+ * for a regional RTI.
+ * @return false if the configuration is not valid.
+ */
+bool initialize_regions();
+
+/** Return true if this RTI is the RTI of a region. */
+bool is_regional_rti();
+
+/**
+ * Return true if the specified federate represents the parent RTI
+ * in a regional RTI.
+ * @param fed The federate.
+ */
+bool is_parent_rti(federate_t* fed);
+
+/**
+ * Return the index among the enclaves of the federate with the specified ID,
+ * as given by the federate upon connecting to this RTI.
+ * @param federate_id The ID of the federate, or of the region for the parent RTI.
+ * @return The index or -1 if no such federate can connect to this RTI.
+ */
+int32_t federate_index(uint16_t federate_id);
+
+/**
+ * Return the federate to which a message to the specified federate
+ * is forwarded, which is the region of the federate for the parent RTI
+ * and the parent RTI for a federate outside of the region.
+ * @param federate_id The ID of the destination federate.
+ * @return The federate or NULL if the ID is out of range.
+ */
+federate_t* destination_federate(uint16_t federate_id);
+
+/**
+ * Replace the IDs of the upstream and downstream federates of the specified
+ * federate of a region with their indexes among the enclaves, connecting
+ * federates outside the region to the parent RTI instead, and record the
+ * connections of the region to other regions.
+ * This function assumes that the caller holds rti_mutex.
+ * @param fed The federate.
+ */
+void localize_connections(federate_t* fed);
+
+/**
+ * Connect to the parent RTI as the federate representing the region and propose
+ * the specified start time to it. The parent RTI replies with the start time,
+ * which is handled by handle_timestamp() as if the parent RTI were a federate.
+ * This function assumes that the caller holds rti_mutex.
+ * @param start_time The latest start time proposed by the federates of the region.
+ */
+void propose_start_time_to_parent_locked(instant_t start_time);
+
+/**
+ * Handle a message of the specified type from the parent RTI that federates
+ * do not send, i.e., a MSG_TYPE_TAG_ADVANCE_GRANT, a
+ * MSG_TYPE_PROVISIONAL_TAG_ADVANCE_GRANT, or a MSG_TYPE_STOP_GRANTED.
+ * @param parent The federate representing the parent RTI.
+ * @param message_type The type of the message, which has been read.
+ */
+void handle_parent_message(federate_t* parent, unsigned char message_type);
+
+/**
+ * Report the stop tag of the region to the parent RTI if all federates of the
+ * region have requested to stop or replied to a stop request. This sends a
+ * MSG_TYPE_STOP_REQUEST_REPLY if the parent RTI has forwarded a stop request
+ * to the region and a MSG_TYPE_STOP_REQUEST otherwise. The stop is granted
+ * to the federates of the region when the parent RTI grants it.
+ * This function assumes that the caller holds rti_mutex.
+ */
+void report_stop_to_parent_locked();
+
+/**
+ * Send the next event tag (NET) and the completed tag of the region to the parent
+ * RTI if they have changed since they were last sent, or resign from the parent RTI
+ * if no federate of the region is connected anymore.
+ */
+void report_region_to_parent();
+
+#endif // REGION_H
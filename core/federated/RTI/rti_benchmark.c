@@ -0,0 +1,696 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file
+ * @brief Benchmark of the coordination of synthetic federations by the RTI.
+ *
+ * This runs the RTI in the same process, unless the address of an RTI is given
+ * with --rti, and synthetic federates that speak the same protocol as
+ * federate.c, each with a thread that sends its messages and a thread that
+ * listens to the RTI. The federates are connected in a chain, a star, or all
+ * to all, over connections whose delay is the period of the federates, so that
+ * every federate has an event at each multiple of the period. At each tag, a
+ * federate waits until it may process the tag, then sends a message to each
+ * downstream federate (every few tags, with -e) and completes the tag.
+ *
+ * With centralized coordination, a federate with upstream federates sends a
+ * next event tag (NET) and waits for a tag advance grant (TAG). With
+ * decentralized coordination, federates do not send NETs, and a federate waits
+ * for the messages from its upstream federates instead, as if its safe-to-process
+ * offset were unbounded. Federates run as fast as possible unless a physical
+ * period is given with -P.
+ *
+ * The benchmark reports the messages and tags per second, the percentiles of
+ * the latency from sending a message to receiving it, and the percentiles of
+ * the time from sending a NET to receiving the TAG. A federation can be split
+ * among hosts by running the federates first-last of it on each host with
+ * --federates and the address of the RTI with --rti, in which case the
+ * latencies include the offsets between the clocks of the hosts.
+ *
+ * The benchmark checks that every message is received before its tag is granted
+ * and that no message is lost, and it exits with a nonzero status otherwise.
+ *
+ * Usage: rti_benchmark [-n federates] [-t chain|star|all] [-s bytes] [-r tags] [-e every]
+ *     [-c centralized|decentralized] [-P period_us] [-i id] [--rti host:port]
+ *     [--federates first-last] [-- RTI arguments]
+ */
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rti_lib.h"
+
+extern federation_rti_t* _f_rti;
+extern enclave_rti_t* _e_rti;
+extern lf_mutex_t rti_mutex;
+extern lf_cond_t received_start_times;
+extern lf_cond_t sent_start_time;
+
+// The tracing mechanism of the RTI uses the number of workers.
+unsigned int _lf_number_of_workers = 0u;
+
+/** The logical time between tags if federates run as fast as possible. */
+#define BENCHMARK_LOGICAL_PERIOD MSEC(1)
+
+/** The maximum number of latencies of each kind kept by a federate. */
+#define BENCHMARK_MAX_SAMPLES (1 << 14)
+
+/** The number of attempts to connect to the RTI, and the time between them. */
+#define BENCHMARK_CONNECT_ATTEMPTS 100
+#define BENCHMARK_CONNECT_RETRY_INTERVAL MSEC(100)
+
+/** Size of the header of a MSG_TYPE_TAGGED_MESSAGE, including the type. */
+#define BENCHMARK_TAGGED_HEADER_SIZE (1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t) + sizeof(int64_t) + sizeof(uint32_t))
+
+/** Size of a tag in messages. */
+#define BENCHMARK_TAG_SIZE (sizeof(int64_t) + sizeof(uint32_t))
+
+typedef enum { CHAIN, STAR, ALL_TO_ALL } topology_t;
+
+/**
+ * A random sample of at most BENCHMARK_MAX_SAMPLES latencies,
+ * kept by reservoir sampling.
+ */
+typedef struct {
+    interval_t* samples;
+    size_t size;
+    uint64_t seen;
+    unsigned int seed;
+} sample_set_t;
+
+/** A synthetic federate. */
+typedef struct {
+    uint16_t id;
+    int socket;
+    socket_reader_t reader;
+    lf_thread_t thread;
+    lf_thread_t listener;
+    uint16_t* upstream;
+    size_t num_upstream;
+    uint16_t* downstream;
+    size_t num_downstream;
+    instant_t start_time;
+
+    // The following are guarded by mutex.
+    lf_mutex_t mutex;
+    lf_cond_t changed;
+    tag_t last_granted;
+    tag_t* last_received;          // The tag of the last message from each upstream federate.
+    uint64_t messages_received;
+    size_t stp_violations;
+    sample_set_t latencies;
+
+    // The following are written by the thread of the federate only.
+    sample_set_t round_trips;
+    instant_t loop_started;
+    instant_t loop_ended;
+} bench_federate_t;
+
+static int num_federates = 4;
+static topology_t topology = CHAIN;
+static size_t message_size = 64;
+static int64_t num_tags = 1000;
+static int64_t every = 1;
+static bool decentralized = false;
+static interval_t physical_period = 0;
+static interval_t period = BENCHMARK_LOGICAL_PERIOD;
+static const char* federation_id = "benchmark";
+static const char* rti_host = "localhost";
+static uint16_t rti_port = 0;
+
+static void sample_set_init(sample_set_t* set, unsigned int seed) {
+    set->samples = (interval_t*)malloc(BENCHMARK_MAX_SAMPLES * sizeof(interval_t));
+    lf_assert(set->samples, "Out of memory");
+    set->size = 0;
+    set->seen = 0;
+    set->seed = seed;
+}
+
+static void sample_set_add(sample_set_t* set, interval_t sample) {
+    set->seen++;
+    if (set->size < BENCHMARK_MAX_SAMPLES) {
+        set->samples[set->size++] = sample;
+    } else {
+        uint64_t i = (((uint64_t)rand_r(&set->seed) << 31) | (uint64_t)rand_r(&set->seed)) % set->seen;
+        if (i < BENCHMARK_MAX_SAMPLES) {
+            set->samples[i] = sample;
+        }
+    }
+}
+
+/** Return whether there is a connection from federate 'from' to federate 'to'. */
+static bool connected(int from, int to) {
+    switch (topology) {
+        case CHAIN: return to == from + 1;
+        case STAR: return (from == 0) != (to == 0);
+        default: return from != to;
+    }
+}
+
+/** Return the index of the upstream federate with the specified ID, or -1. */
+static int upstream_index(bench_federate_t* fed, uint16_t id) {
+    for (size_t i = 0; i < fed->num_upstream; i++) {
+        if (fed->upstream[i] == id) return (int)i;
+    }
+    return -1;
+}
+
+/** Initialize the synthetic federate with the specified ID. */
+static void federate_init(bench_federate_t* fed, uint16_t id) {
+    memset(fed, 0, sizeof(bench_federate_t));
+    fed->id = id;
+    fed->upstream = (uint16_t*)calloc(num_federates, sizeof(uint16_t));
+    fed->downstream = (uint16_t*)calloc(num_federates, sizeof(uint16_t));
+    fed->last_received = (tag_t*)calloc(num_federates, sizeof(tag_t));
+    lf_assert(fed->upstream && fed->downstream && fed->last_received, "Out of memory");
+    for (int i = 0; i < num_federates; i++) {
+        if (connected(i, id)) {
+            fed->last_received[fed->num_upstream] = NEVER_TAG;
+            fed->upstream[fed->num_upstream++] = (uint16_t)i;
+        }
+        if (connected(id, i)) fed->downstream[fed->num_downstream++] = (uint16_t)i;
+    }
+    fed->last_granted = NEVER_TAG;
+    lf_mutex_init(&fed->mutex);
+    lf_cond_init(&fed->changed, &fed->mutex);
+    sample_set_init(&fed->latencies, id * 2 + 1);
+    sample_set_init(&fed->round_trips, id * 2 + 2);
+}
+
+/** Free the memory allocated by federate_init(). */
+static void federate_free(bench_federate_t* fed) {
+    free(fed->upstream);
+    free(fed->downstream);
+    free(fed->last_received);
+    free(fed->latencies.samples);
+    free(fed->round_trips.samples);
+}
+
+/** Connect to the RTI, retrying while it is not listening yet. */
+static int connect_to_rti_or_exit(uint16_t id) {
+    char port[8];
+    snprintf(port, sizeof(port), "%u", rti_port);
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* address;
+    int result = getaddrinfo(rti_host, port, &hints, &address);
+    if (result != 0) {
+        lf_print_error_and_exit("Federate %u cannot resolve %s: %s.", id, rti_host, gai_strerror(result));
+    }
+    for (int attempt = 0; attempt < BENCHMARK_CONNECT_ATTEMPTS; attempt++) {
+        int socket_id = create_real_time_tcp_socket_errexit();
+        if (connect(socket_id, address->ai_addr, address->ai_addrlen) == 0) {
+            freeaddrinfo(address);
+            return socket_id;
+        }
+        close(socket_id);
+        lf_sleep(BENCHMARK_CONNECT_RETRY_INTERVAL);
+    }
+    lf_print_error_and_exit("Federate %u failed to connect to the RTI at %s:%s.", id, rti_host, port);
+    return -1;
+}
+
+/** Send a message consisting of the specified type and tag to the RTI. */
+static void send_tag(bench_federate_t* fed, unsigned char type, tag_t tag) {
+    unsigned char buffer[1 + BENCHMARK_TAG_SIZE];
+    buffer[0] = type;
+    encode_tag(&buffer[1], tag);
+    write_to_socket_errexit(fed->socket, sizeof(buffer), buffer,
+            "Federate %u failed to send message type %u.", fed->id, type);
+}
+
+/**
+ * Connect the federate to the RTI, send it the IDs and the neighbor structure,
+ * and return the start time of the federation.
+ */
+static instant_t join_federation(bench_federate_t* fed) {
+    fed->socket = connect_to_rti_or_exit(fed->id);
+    size_t id_length = strlen(federation_id);
+    unsigned char buffer[1 + sizeof(uint16_t) + 1 + UINT8_MAX];
+    buffer[0] = MSG_TYPE_FED_IDS;
+    encode_uint16(fed->id, &buffer[1]);
+    buffer[1 + sizeof(uint16_t)] = (unsigned char)id_length;
+    memcpy(&buffer[2 + sizeof(uint16_t)], federation_id, id_length);
+    write_to_socket_errexit(fed->socket, 2 + sizeof(uint16_t) + id_length, buffer,
+            "Federate %u failed to send its ID.", fed->id);
+    read_from_socket_errexit(fed->socket, 1, buffer, "Federate %u failed to read the reply to its ID.", fed->id);
+    if (buffer[0] != MSG_TYPE_ACK) {
+        lf_print_error_and_exit("The RTI rejected federate %u.", fed->id);
+    }
+
+    size_t structure_size = MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE
+            + fed->num_upstream * (sizeof(uint16_t) + sizeof(int64_t))
+            + fed->num_downstream * sizeof(uint16_t);
+    unsigned char* structure = (unsigned char*)malloc(structure_size);
+    lf_assert(structure, "Out of memory");
+    structure[0] = MSG_TYPE_NEIGHBOR_STRUCTURE;
+    encode_int32((int32_t)fed->num_upstream, &structure[1]);
+    encode_int32((int32_t)fed->num_downstream, &structure[1 + sizeof(int32_t)]);
+    unsigned char* next = &structure[MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE];
+    for (size_t i = 0; i < fed->num_upstream; i++) {
+        encode_uint16(fed->upstream[i], next);
+        encode_int64(period, next + sizeof(uint16_t));
+        next += sizeof(uint16_t) + sizeof(int64_t);
+    }
+    for (size_t i = 0; i < fed->num_downstream; i++) {
+        encode_uint16(fed->downstream[i], next);
+        next += sizeof(uint16_t);
+    }
+    write_to_socket_errexit(fed->socket, structure_size, structure,
+            "Federate %u failed to send its neighbor structure.", fed->id);
+    free(structure);
+
+    // Do not synchronize clocks.
+    buffer[0] = MSG_TYPE_UDP_PORT;
+    encode_uint16(UINT16_MAX, &buffer[1]);
+    write_to_socket_errexit(fed->socket, 1 + sizeof(uint16_t), buffer,
+            "Federate %u failed to send its UDP port.", fed->id);
+
+    buffer[0] = MSG_TYPE_TIMESTAMP;
+    encode_int64(lf_time_physical(), &buffer[1]);
+    write_to_socket_errexit(fed->socket, MSG_TYPE_TIMESTAMP_LENGTH, buffer,
+            "Federate %u failed to send its timestamp.", fed->id);
+    read_from_socket_errexit(fed->socket, MSG_TYPE_TIMESTAMP_LENGTH, buffer,
+            "Federate %u failed to read the start time.", fed->id);
+    if (buffer[0] != MSG_TYPE_TIMESTAMP) {
+        lf_print_error_and_exit("Federate %u expected the start time and got message type %u.",
+                fed->id, buffer[0]);
+    }
+    return extract_int64(&buffer[1]);
+}
+
+/**
+ * Thread that handles the messages from the RTI to a federate,
+ * like the thread that listens to the RTI in federate.c.
+ */
+static void* listen_to_rti(void* arg) {
+    bench_federate_t* fed = (bench_federate_t*)arg;
+    size_t buffer_size = LF_MAX(message_size, BENCHMARK_TAGGED_HEADER_SIZE);
+    unsigned char* buffer = (unsigned char*)malloc(buffer_size);
+    lf_assert(buffer, "Out of memory");
+    while (true) {
+        if (read_from_socket_reader_errexit(&fed->reader, 1, buffer, NULL) <= 0) {
+            break;
+        }
+        unsigned char type = buffer[0];
+        if (type == MSG_TYPE_TAGGED_MESSAGE) {
+            read_from_socket_reader_errexit(&fed->reader, BENCHMARK_TAGGED_HEADER_SIZE - 1, &buffer[1],
+                    "Federate %u failed to read a message header.", fed->id);
+            uint16_t port;
+            uint16_t destination;
+            size_t length;
+            tag_t tag;
+            extract_timed_header(&buffer[1], &port, &destination, &length, &tag);
+            if (length != message_size) {
+                lf_print_error_and_exit("Federate %u received a message of %zu bytes.", fed->id, length);
+            }
+            read_from_socket_reader_errexit(&fed->reader, length, buffer,
+                    "Federate %u failed to read a message.", fed->id);
+            interval_t latency = lf_time_physical() - extract_int64(buffer);
+            // The port is the ID of the sender.
+            int upstream = upstream_index(fed, port);
+            lf_mutex_lock(&fed->mutex);
+            if (upstream < 0) {
+                lf_print_error("Federate %u received a message from federate %u, which is not upstream.",
+                        fed->id, port);
+                fed->stp_violations++;
+            } else {
+                fed->last_received[upstream] = tag;
+            }
+            if (lf_tag_compare(tag, fed->last_granted) <= 0 && !decentralized) {
+                fed->stp_violations++;
+            }
+            fed->messages_received++;
+            sample_set_add(&fed->latencies, latency);
+            lf_cond_broadcast(&fed->changed);
+            lf_mutex_unlock(&fed->mutex);
+        } else if (type == MSG_TYPE_TAG_ADVANCE_GRANT || type == MSG_TYPE_PROVISIONAL_TAG_ADVANCE_GRANT
+                || type == MSG_TYPE_STOP_GRANTED || type == MSG_TYPE_STOP_REQUEST) {
+            read_from_socket_reader_errexit(&fed->reader, BENCHMARK_TAG_SIZE, buffer,
+                    "Federate %u failed to read a tag.", fed->id);
+            if (type == MSG_TYPE_TAG_ADVANCE_GRANT) {
+                tag_t tag = extract_tag(buffer);
+                lf_mutex_lock(&fed->mutex);
+                if (lf_tag_compare(tag, fed->last_granted) > 0) {
+                    fed->last_granted = tag;
+                }
+                lf_cond_broadcast(&fed->changed);
+                lf_mutex_unlock(&fed->mutex);
+            }
+        } else {
+            lf_print_error_and_exit("Federate %u received unexpected message type %u.", fed->id, type);
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Wait until the federate may process the specified tag, which is the
+ * specified number of periods after the start time.
+ */
+static void wait_for_tag(bench_federate_t* fed, tag_t tag, int64_t k) {
+    if (!decentralized) {
+        if (fed->num_upstream == 0) {
+            // As in federate.c, a federate without upstream federates does not wait.
+            send_tag(fed, MSG_TYPE_NEXT_EVENT_TAG, tag);
+            return;
+        }
+        lf_mutex_lock(&fed->mutex);
+        bool granted = lf_tag_compare(fed->last_granted, tag) >= 0;
+        lf_mutex_unlock(&fed->mutex);
+        if (granted) {
+            // The RTI granted this tag ahead of time.
+            return;
+        }
+        instant_t sent = lf_time_physical();
+        send_tag(fed, MSG_TYPE_NEXT_EVENT_TAG, tag);
+        lf_mutex_lock(&fed->mutex);
+        while (lf_tag_compare(fed->last_granted, tag) < 0) {
+            lf_cond_wait(&fed->changed);
+        }
+        lf_mutex_unlock(&fed->mutex);
+        sample_set_add(&fed->round_trips, lf_time_physical() - sent);
+    } else if (k > 1 && (k - 1) % every == 0) {
+        // The upstream federates sent messages at the previous tag,
+        // which arrive at this tag in order.
+        lf_mutex_lock(&fed->mutex);
+        for (size_t i = 0; i < fed->num_upstream; i++) {
+            while (lf_tag_compare(fed->last_received[i], tag) < 0) {
+                lf_cond_wait(&fed->changed);
+            }
+        }
+        lf_mutex_unlock(&fed->mutex);
+    }
+}
+
+/** Thread that runs a synthetic federate. */
+static void* run_federate(void* arg) {
+    bench_federate_t* fed = (bench_federate_t*)arg;
+    fed->start_time = join_federation(fed);
+    socket_reader_init(&fed->reader, fed->socket);
+    lf_thread_create(&fed->listener, listen_to_rti, fed);
+
+    size_t size = BENCHMARK_TAGGED_HEADER_SIZE + message_size;
+    unsigned char* message = (unsigned char*)calloc(size, 1);
+    lf_assert(message, "Out of memory");
+    message[0] = MSG_TYPE_TAGGED_MESSAGE;
+    if (physical_period > 0) {
+        instant_t now = lf_time_physical();
+        if (fed->start_time > now) lf_sleep(fed->start_time - now);
+    }
+    fed->loop_started = lf_time_physical();
+    tag_t tag = {.time = fed->start_time, .microstep = 0u};
+    for (int64_t k = 1; k <= num_tags; k++) {
+        tag.time = fed->start_time + k * period;
+        if (physical_period > 0) {
+            instant_t now = lf_time_physical();
+            if (tag.time > now) lf_sleep(tag.time - now);
+        }
+        wait_for_tag(fed, tag, k);
+        if (k < num_tags && k % every == 0) {
+            tag_t arrival = {.time = tag.time + period, .microstep = 0u};
+            for (size_t i = 0; i < fed->num_downstream; i++) {
+                // The port is the ID of the sender.
+                encode_uint16(fed->id, &message[1]);
+                encode_uint16(fed->downstream[i], &message[1 + sizeof(uint16_t)]);
+                encode_int32((int32_t)message_size, &message[1 + 2 * sizeof(uint16_t)]);
+                encode_tag(&message[1 + 2 * sizeof(uint16_t) + sizeof(int32_t)], arrival);
+                encode_int64(lf_time_physical(), &message[BENCHMARK_TAGGED_HEADER_SIZE]);
+                write_to_socket_errexit(fed->socket, size, message,
+                        "Federate %u failed to send a message.", fed->id);
+            }
+        }
+        send_tag(fed, MSG_TYPE_LOGICAL_TAG_COMPLETE, tag);
+    }
+    fed->loop_ended = lf_time_physical();
+    free(message);
+
+    send_tag(fed, MSG_TYPE_RESIGN, tag);
+    shutdown(fed->socket, SHUT_WR);
+    lf_thread_join(fed->listener, NULL);
+    close(fed->socket);
+    return NULL;
+}
+
+/** Arguments of the thread running the RTI in this process. */
+typedef struct {
+    int socket_descriptor;
+} rti_thread_args_t;
+
+static void* run_rti(void* arg) {
+    wait_for_federates(((rti_thread_args_t*)arg)->socket_descriptor);
+    if (_f_rti->tracing_enabled) {
+        stop_trace(_f_rti->trace);
+        trace_free(_f_rti->trace);
+    }
+    return NULL;
+}
+
+/**
+ * Start the RTI in this process with the specified additional arguments
+ * and set rti_port to its port.
+ */
+static void start_rti(lf_thread_t* thread, rti_thread_args_t* args, int argc, const char* argv[]) {
+    initialize_RTI();
+    lf_mutex_init(&rti_mutex);
+    lf_cond_init(&received_start_times, &rti_mutex);
+    lf_cond_init(&sent_start_time, &rti_mutex);
+
+    char federates[16];
+    char port[8];
+    snprintf(federates, sizeof(federates), "%d", num_federates);
+    snprintf(port, sizeof(port), "%u", rti_port);
+    const char** rti_argv = (const char**)malloc((argc + 10) * sizeof(char*));
+    lf_assert(rti_argv, "Out of memory");
+    int rti_argc = 0;
+    rti_argv[rti_argc++] = "RTI";
+    rti_argv[rti_argc++] = "-i";
+    rti_argv[rti_argc++] = federation_id;
+    rti_argv[rti_argc++] = "-n";
+    rti_argv[rti_argc++] = federates;
+    if (rti_port != 0) {
+        rti_argv[rti_argc++] = "-p";
+        rti_argv[rti_argc++] = port;
+    }
+    for (int i = 0; i < argc; i++) {
+        rti_argv[rti_argc++] = argv[i];
+    }
+    // The clock synchronization arguments consume the rest of the arguments.
+    rti_argv[rti_argc++] = "-c";
+    rti_argv[rti_argc++] = "off";
+    if (!process_args(rti_argc, rti_argv)) {
+        exit(1);
+    }
+    free(rti_argv);
+    if (_f_rti->tracing_enabled) {
+        _lf_number_of_workers = _f_rti->number_of_enclaves;
+        _f_rti->trace = trace_new(NULL, "rti.lft");
+        lf_assert(_f_rti->trace, "Out of memory");
+        start_trace(_f_rti->trace);
+    }
+    _f_rti->enclaves = (federate_t**)calloc(_f_rti->number_of_enclaves, sizeof(federate_t*));
+    lf_assert(_f_rti->enclaves, "Out of memory");
+    for (uint16_t i = 0; i < _f_rti->number_of_enclaves; i++) {
+        _f_rti->enclaves[i] = (federate_t*)malloc(sizeof(federate_t));
+        lf_assert(_f_rti->enclaves[i], "Out of memory");
+        initialize_federate(_f_rti->enclaves[i], i);
+    }
+    _e_rti = (enclave_rti_t*)_f_rti;
+    args->socket_descriptor = start_rti_server(_f_rti->user_specified_port);
+    rti_port = (uint16_t)_f_rti->final_port_TCP;
+    lf_thread_create(thread, run_rti, args);
+}
+
+static int compare_intervals(const void* a, const void* b) {
+    interval_t x = *(const interval_t*)a;
+    interval_t y = *(const interval_t*)b;
+    return (x > y) - (x < y);
+}
+
+/** Print the percentiles of the samples of the specified kind of all federates. */
+static void print_percentiles(const char* name, bench_federate_t* feds, size_t count, bool round_trips) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += round_trips ? feds[i].round_trips.size : feds[i].latencies.size;
+    }
+    if (total == 0) {
+        printf("%-24s %12s\n", name, "none");
+        return;
+    }
+    interval_t* samples = (interval_t*)malloc(total * sizeof(interval_t));
+    lf_assert(samples, "Out of memory");
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        sample_set_t* set = round_trips ? &feds[i].round_trips : &feds[i].latencies;
+        memcpy(&samples[n], set->samples, set->size * sizeof(interval_t));
+        n += set->size;
+    }
+    qsort(samples, n, sizeof(interval_t), compare_intervals);
+    printf("%-24s %12.1f %12.1f %12.1f %12.1f\n", name,
+            samples[n / 2] / 1000.0, samples[(n * 90) / 100] / 1000.0,
+            samples[(n * 99) / 100] / 1000.0, samples[n - 1] / 1000.0);
+    free(samples);
+}
+
+static void benchmark_usage(const char* command) {
+    printf("Usage: %s [options] [-- RTI arguments]\n", command);
+    printf("  -n <n>      Number of federates (default: 4).\n");
+    printf("  -t <name>   Topology: chain, star (federate 0 to and from all), or all (default: chain).\n");
+    printf("  -s <bytes>  Size of the messages, at least 8 (default: 64).\n");
+    printf("  -r <n>      Number of tags to execute (default: 1000).\n");
+    printf("  -e <n>      Send messages every n tags (default: 1).\n");
+    printf("  -c <name>   Coordination: centralized or decentralized (default: centralized).\n");
+    printf("  -P <us>     Execute a tag every given number of microseconds of physical time\n");
+    printf("              instead of as fast as possible.\n");
+    printf("  -i <id>     Federation ID (default: benchmark).\n");
+    printf("  --rti <host:port>       Use the RTI at the given address instead of starting one.\n");
+    printf("  --federates <first-last> Run only the given federates in this process.\n");
+    printf("The arguments after -- are given to the RTI started by the benchmark.\n");
+}
+
+int main(int argc, const char* argv[]) {
+    int first = 0;
+    int last = -1;
+    bool local_rti = true;
+    int rti_argc = 0;
+    const char** rti_args = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_federates = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "chain") == 0) topology = CHAIN;
+            else if (strcmp(argv[i], "star") == 0) topology = STAR;
+            else if (strcmp(argv[i], "all") == 0) topology = ALL_TO_ALL;
+            else {
+                benchmark_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            message_size = (size_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            num_tags = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            every = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            decentralized = strcmp(argv[++i], "decentralized") == 0;
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            physical_period = USEC(atoll(argv[++i]));
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            federation_id = argv[++i];
+        } else if (strcmp(argv[i], "--rti") == 0 && i + 1 < argc) {
+            static char host[256];
+            unsigned int port;
+            if (sscanf(argv[++i], "%255[^:]:%u", host, &port) != 2 || port == 0 || port >= UINT16_MAX) {
+                benchmark_usage(argv[0]);
+                return 1;
+            }
+            rti_host = host;
+            rti_port = (uint16_t)port;
+            local_rti = false;
+        } else if (strcmp(argv[i], "--federates") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d-%d", &first, &last) != 2) {
+                benchmark_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--") == 0) {
+            rti_argc = argc - i - 1;
+            rti_args = &argv[i + 1];
+            break;
+        } else {
+            benchmark_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (last < 0) last = num_federates - 1;
+    if (num_federates < 1 || num_federates >= UINT16_MAX || first < 0 || first > last || last >= num_federates
+            || message_size < sizeof(int64_t) || message_size > INT32_MAX || num_tags < 1 || every < 1
+            || strlen(federation_id) > UINT8_MAX) {
+        benchmark_usage(argv[0]);
+        return 1;
+    }
+    if (physical_period > 0) period = physical_period;
+
+    lf_thread_t rti_thread;
+    rti_thread_args_t rti_thread_args;
+    if (local_rti) {
+        start_rti(&rti_thread, &rti_thread_args, rti_argc, rti_args);
+    }
+
+    size_t count = (size_t)(last - first + 1);
+    bench_federate_t* feds = (bench_federate_t*)calloc(count, sizeof(bench_federate_t));
+    lf_assert(feds, "Out of memory");
+    for (size_t i = 0; i < count; i++) {
+        federate_init(&feds[i], (uint16_t)(first + i));
+    }
+    for (size_t i = 0; i < count; i++) {
+        lf_thread_create(&feds[i].thread, run_federate, &feds[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        lf_thread_join(feds[i].thread, NULL);
+    }
+    if (local_rti) {
+        lf_thread_join(rti_thread, NULL);
+    }
+
+    instant_t started = FOREVER;
+    instant_t ended = NEVER;
+    uint64_t messages = 0;
+    size_t errors = 0;
+    for (size_t i = 0; i < count; i++) {
+        bench_federate_t* fed = &feds[i];
+        started = LF_MIN(started, fed->loop_started);
+        ended = LF_MAX(ended, fed->loop_ended);
+        messages += fed->messages_received;
+        uint64_t expected = fed->num_upstream * (uint64_t)((num_tags - 1) / every);
+        if (fed->messages_received != expected) {
+            lf_print_error("Federate %u received %" PRIu64 " messages instead of %" PRIu64 ".",
+                    fed->id, fed->messages_received, expected);
+            errors++;
+        }
+        if (fed->stp_violations > 0) {
+            lf_print_error("Federate %u received %zu messages after their tags were granted.",
+                    fed->id, fed->stp_violations);
+            errors++;
+        }
+    }
+    double seconds = (double)(ended - started) / BILLION;
+    const char* topology_names[] = {"chain", "star", "all"};
+    printf("\n%d federates (%zu here), %s, %s, %" PRId64 " tags, messages of %zu bytes every %" PRId64 " tags\n",
+            num_federates, count, topology_names[topology], decentralized ? "decentralized" : "centralized",
+            num_tags, message_size, every);
+    printf("%.3f s, %.0f tags/s, %.0f messages/s received\n",
+            seconds, num_tags / seconds, messages / seconds);
+    printf("%-24s %12s %12s %12s %12s\n", "(us)", "p50", "p90", "p99", "max");
+    print_percentiles("message latency", feds, count, false);
+    print_percentiles("NET to TAG round trip", feds, count, true);
+    for (size_t i = 0; i < count; i++) {
+        federate_free(&feds[i]);
+    }
+    free(feds);
+    return errors ? 1 : 0;
+}
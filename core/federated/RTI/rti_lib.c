@@ -24,6 +24,7 @@
  */
 
 #include "rti_lib.h"
+#include "region.h"
 #include <string.h>
 
 // Global variables defined in tag.c:
@@ -161,8 +162,34 @@ int create_server(int32_t specified_port, uint16_t port, socket_type_t socket_ty
     return socket_descriptor;
 }
 
+/**
+ * Count a grant to the specified federate in its statistics and, if it is
+ * a tag advance grant, record the time since the federate sent its pending
+ * next event tag in the histogram of grant latencies.
+ * This function assumes that the caller holds the mutex of the shard of the federate.
+ * @param fed The federate.
+ * @param provisional True for a provisional tag advance grant.
+ */
+static void record_grant(federate_t* fed, bool provisional) {
+    if (provisional) {
+        fed->stats.ptags_granted++;
+        return;
+    }
+    fed->stats.tags_granted++;
+    if (fed->stats.net_received_at != NEVER) {
+        interval_t latency = lf_time_physical() - fed->stats.net_received_at;
+        int bucket = 0;
+        while (bucket < GRANT_LATENCY_BUCKETS - 1 && latency >= USEC(1LL << bucket)) {
+            bucket++;
+        }
+        fed->stats.grant_latency[bucket]++;
+        fed->stats.net_received_at = NEVER;
+    }
+}
+
 void notify_tag_advance_grant(enclave_t* e, tag_t tag) {
     if (e->state == NOT_CONNECTED
+            || is_parent_rti((federate_t*)e)
             || lf_tag_compare(tag, e->last_granted) <= 0
             || lf_tag_compare(tag, e->last_provisionally_granted) < 0
     ) {
@@ -191,10 +218,14 @@ void notify_tag_advance_grant(enclave_t* e, tag_t tag) {
         lf_print_error("RTI failed to send tag advance grant to federate %d.", e->id);
         if (bytes_written < 0) {
             e->state = NOT_CONNECTED;
+            update_paths_from_enclave(e);
             // FIXME: We need better error handling, but don't stop other execution here.
         }
     } else {
         e->last_granted = tag;
+        if (_f_rti->stats_period > 0) {
+            record_grant((federate_t*)e, false);
+        }
         LF_PRINT_LOG("RTI sent to federate %d the tag advance grant (TAG) " PRINTF_TAG ".",
                 e->id, tag.time - start_time, tag.microstep);
     }
@@ -202,6 +233,7 @@ void notify_tag_advance_grant(enclave_t* e, tag_t tag) {
 
 void notify_provisional_tag_advance_grant(enclave_t* e, tag_t tag) {
     if (e->state == NOT_CONNECTED
+            || is_parent_rti((federate_t*)e)
             || lf_tag_compare(tag, e->last_granted) <= 0
             || lf_tag_compare(tag, e->last_provisionally_granted) <= 0
     ) {
@@ -231,10 +263,14 @@ void notify_provisional_tag_advance_grant(enclave_t* e, tag_t tag) {
         lf_print_error("RTI failed to send tag advance grant to federate %d.", e->id);
         if (bytes_written < 0) {
             e->state = NOT_CONNECTED;
+            update_paths_from_enclave(e);
             // FIXME: We need better error handling, but don't stop other execution here.
         }
     } else {
         e->last_provisionally_granted = tag;
+        if (_f_rti->stats_period > 0) {
+            record_grant((federate_t*)e, true);
+        }
         LF_PRINT_LOG("RTI sent to federate %d the Provisional Tag Advance Grant (PTAG) " PRINTF_TAG ".",
                      e->id, tag.time - start_time, tag.microstep);
 
@@ -249,14 +285,9 @@ void notify_provisional_tag_advance_grant(enclave_t* e, tag_t tag) {
 
             // Ignore this federate if it has resigned.
             if (upstream->enclave.state == NOT_CONNECTED) continue;
-            // To handle cycles, need to create a boolean array to keep
-            // track of which upstream federates have been visited.
-            bool* visited = (bool*)calloc(_f_rti->number_of_enclaves, sizeof(bool)); // Initializes to 0.
 
             // Find the (transitive) next event tag upstream.
-            tag_t upstream_next_event = transitive_next_event(
-                    &(upstream->enclave), upstream->enclave.next_event, visited);
-            free(visited);
+            tag_t upstream_next_event = earliest_next_event(&(upstream->enclave));
             // If these tags are equal, then
             // a TAG or PTAG should have already been granted,
             // in which case, another will not be sent. But it
@@ -283,7 +314,12 @@ void update_federate_next_event_tag_locked(uint16_t federate_id, tag_t next_even
 }
 
 void handle_port_absent_message(federate_t* sending_federate, unsigned char* buffer) {
-    size_t message_size = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int64_t) + sizeof(uint32_t);
+    // A batch has the header of a single message without the port, plus the
+    // length of the port IDs that follow it.
+    bool batch = (buffer[0] == MSG_TYPE_PORT_ABSENT_BATCH);
+    size_t message_size = batch ?
+            MSG_TYPE_PORT_ABSENT_BATCH_HEADER_SIZE - 1
+            : sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int64_t) + sizeof(uint32_t);
 
     read_from_socket_errexit(sending_federate->socket, message_size, &(buffer[1]),
                             " RTI failed to read port absent message from federate %u.",
@@ -291,22 +327,37 @@ void handle_port_absent_message(federate_t* sending_federate, unsigned char* buf
 
     uint16_t reactor_port_id = extract_uint16(&(buffer[1]));
     uint16_t federate_id = extract_uint16(&(buffer[1 + sizeof(uint16_t)]));
-    tag_t tag = extract_tag(&(buffer[1 + 2 * sizeof(uint16_t)]));
+    size_t ports_length = 0;
+    tag_t tag;
+    if (batch) {
+        ports_length = (size_t)extract_int32(&(buffer[1 + 2 * sizeof(uint16_t)]));
+        tag = extract_tag(&(buffer[1 + 2 * sizeof(uint16_t) + sizeof(int32_t)]));
+    } else {
+        tag = extract_tag(&(buffer[1 + 2 * sizeof(uint16_t)]));
+    }
+    // The number of absent ports, for tracing.
+    size_t ports = batch ? ports_length / sizeof(uint16_t) : 1;
 
     if (_f_rti->tracing_enabled) {
-        tracepoint_rti_from_federate(_f_rti->trace, receive_PORT_ABS, sending_federate->enclave.id, &tag);
+        for (size_t i = 0; i < ports; i++) {
+            tracepoint_rti_from_federate(_f_rti->trace, receive_PORT_ABS, sending_federate->enclave.id, &tag);
+        }
     }
 
-    // Need to acquire the mutex lock to ensure that the thread handling
-    // messages coming from the socket connected to the destination does not
-    // issue a TAG before this message has been forwarded.
-    lf_mutex_lock(&rti_mutex);
+    // Need to acquire the lock of the shard of the destination to ensure that
+    // the thread handling messages coming from the socket connected to the
+    // destination does not issue a TAG before this message has been forwarded.
+    federate_t* fed = destination_federate(federate_id);
+    if (fed == NULL) {
+        lf_print_error_and_exit("RTI received a port absent message for federate %u, which is out of range.",
+                federate_id);
+    }
+    lf_mutex_t* mutex = lock_shard(&(fed->enclave));
 
     // If the destination federate is no longer connected, issue a warning
     // and return.
-    federate_t* fed = (federate_t*) _f_rti->enclaves[federate_id];
     if (fed->enclave.state == NOT_CONNECTED) {
-        lf_mutex_unlock(&rti_mutex);
+        lf_mutex_unlock(mutex);
         lf_print_warning("RTI: Destination federate %d is no longer connected. Dropping message.",
                 federate_id);
         LF_PRINT_LOG("Fed status: next_event (" PRINTF_TIME ", %d), "
@@ -322,12 +373,25 @@ void handle_port_absent_message(federate_t* sending_federate, unsigned char* buf
                 fed->enclave.last_provisionally_granted.time - start_time,
                 fed->enclave.last_provisionally_granted.microstep
         );
+        // Discard the port IDs of a batch.
+        while (ports_length > 0) {
+            size_t bytes_to_read = (ports_length < FED_COM_BUFFER_SIZE) ? ports_length : FED_COM_BUFFER_SIZE;
+            read_from_socket_errexit(sending_federate->socket, bytes_to_read, buffer,
+                    "RTI failed to read port absent batch.");
+            ports_length -= bytes_to_read;
+        }
         return;
     }
 
-    LF_PRINT_LOG("RTI forwarding port absent message for port %u to federate %u.",
-                reactor_port_id,
-                federate_id);
+    if (batch) {
+        LF_PRINT_LOG("RTI forwarding port absent messages for %zu ports to federate %u.",
+                    ports,
+                    federate_id);
+    } else {
+        LF_PRINT_LOG("RTI forwarding port absent message for port %u to federate %u.",
+                    reactor_port_id,
+                    federate_id);
+    }
 
     // Need to make sure that the destination federate's thread has already
     // sent the starting MSG_TYPE_TIMESTAMP message.
@@ -339,12 +403,24 @@ void handle_port_absent_message(federate_t* sending_federate, unsigned char* buf
     // Forward the message.
     int destination_socket = fed->socket;
     if (_f_rti->tracing_enabled) {
-        tracepoint_rti_to_federate(_f_rti->trace, send_PORT_ABS, federate_id, &tag);
+        for (size_t i = 0; i < ports; i++) {
+            tracepoint_rti_to_federate(_f_rti->trace, send_PORT_ABS, federate_id, &tag);
+        }
     }
     write_to_socket_errexit(destination_socket, message_size + 1, buffer,
             "RTI failed to forward message to federate %d.", federate_id);
 
-    lf_mutex_unlock(&rti_mutex);
+    // Forward the port IDs of a batch in chunks.
+    while (ports_length > 0) {
+        size_t bytes_to_read = (ports_length < FED_COM_BUFFER_SIZE) ? ports_length : FED_COM_BUFFER_SIZE;
+        read_from_socket_errexit(sending_federate->socket, bytes_to_read, buffer,
+                "RTI failed to read port absent batch.");
+        write_to_socket_errexit(destination_socket, bytes_to_read, buffer,
+                "RTI failed to forward port absent batch to federate %d.", federate_id);
+        ports_length -= bytes_to_read;
+    }
+
+    lf_mutex_unlock(mutex);
 }
 
 void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
@@ -388,16 +464,19 @@ void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
         tracepoint_rti_from_federate(_f_rti->trace, receive_TAGGED_MSG, sending_federate->enclave.id, &intended_tag);
     }
 
-    // Need to acquire the mutex lock to ensure that the thread handling
-    // messages coming from the socket connected to the destination does not
-    // issue a TAG before this message has been forwarded.
-    lf_mutex_lock(&rti_mutex);
+    // Need to acquire the lock of the shard of the destination to ensure that
+    // the thread handling messages coming from the socket connected to the
+    // destination does not issue a TAG before this message has been forwarded.
+    federate_t *fed = destination_federate(federate_id);
+    if (fed == NULL) {
+        lf_print_error_and_exit("RTI received a message for federate %u, which is out of range.", federate_id);
+    }
+    lf_mutex_t* mutex = lock_shard(&(fed->enclave));
 
     // If the destination federate is no longer connected, issue a warning
     // and return.
-    federate_t *fed = _f_rti->enclaves[federate_id];
     if (fed->enclave.state == NOT_CONNECTED) {
-        lf_mutex_unlock(&rti_mutex);
+        lf_mutex_unlock(mutex);
         lf_print_warning("RTI: Destination federate %d is no longer connected. Dropping message.",
                 federate_id);
         LF_PRINT_LOG("Fed status: next_event (" PRINTF_TIME ", %d), "
@@ -427,7 +506,10 @@ void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
     );
 
     // Record this in-transit message in federate's in-transit message queue.
-    if (lf_tag_compare(fed->enclave.completed, intended_tag) < 0) {
+    // A message leaving the region is recorded by the parent RTI instead.
+    if (is_parent_rti(fed)) {
+        LF_PRINT_DEBUG("RTI: Forwarding a message for federate %d to the parent RTI.", federate_id);
+    } else if (lf_tag_compare(fed->enclave.completed, intended_tag) < 0) {
         // Add a record of this message to the list of in-transit messages to this federate.
         add_in_transit_message_record(
             fed->in_transit_message_tags,
@@ -465,33 +547,38 @@ void handle_timed_message(federate_t* sending_federate, unsigned char* buffer) {
         tracepoint_rti_to_federate(_f_rti->trace, send_TAGGED_MSG, federate_id, &intended_tag);
     }
 
+    // The header and the first chunk are contiguous in the buffer,
+    // so forward them with a single system call.
     write_to_socket_errexit(destination_socket, bytes_read, buffer,
             "RTI failed to forward message to federate %d.", federate_id);
 
-    // The message length may be longer than the buffer,
-    // in which case we have to handle it in chunks.
-    size_t total_bytes_read = bytes_read;
-    while (total_bytes_read < total_bytes_to_read) {
-        LF_PRINT_DEBUG("Forwarding message in chunks.");
-        bytes_to_read = total_bytes_to_read - total_bytes_read;
-        if (bytes_to_read > FED_COM_BUFFER_SIZE) {
-            bytes_to_read = FED_COM_BUFFER_SIZE;
+    // The message length may be longer than the buffer, in which case
+    // forward the rest of it, within the kernel if possible.
+    // The lock of the shard is held meanwhile because a TAG or PTAG
+    // written to the destination must not interleave with the body.
+    if (bytes_read < total_bytes_to_read) {
+        LF_PRINT_DEBUG("Forwarding the rest of the message.");
+        size_t remaining = total_bytes_to_read - bytes_read;
+        ssize_t bytes_forwarded = forward_socket_bytes(sending_federate->socket, destination_socket,
+                remaining, buffer, FED_COM_BUFFER_SIZE);
+        if (bytes_forwarded < 0) {
+            lf_print_error_and_exit("RTI failed to read message chunks.");
+        } else if ((size_t)bytes_forwarded < remaining) {
+            lf_print_error("RTI failed to send message chunks to federate %d.", federate_id);
         }
-        read_from_socket_errexit(sending_federate->socket, bytes_to_read, buffer,
-                "RTI failed to read message chunks.");
-        total_bytes_read += bytes_to_read;
-
-        // FIXME: a mutex needs to be held for this so that other threads
-        // do not write to destination_socket and cause interleaving. However,
-        // holding the rti_mutex might be very expensive. Instead, each outgoing
-        // socket should probably have its own mutex.
-        write_to_socket_errexit(destination_socket, bytes_to_read, buffer,
-                "RTI failed to send message chunks.");
     }
 
-    update_federate_next_event_tag_locked(federate_id, intended_tag);
+    fed->stats.bytes_forwarded += total_bytes_to_read;
 
-    lf_mutex_unlock(&rti_mutex);
+    // If the message tag is less than the most recently received NET from the federate,
+    // then update the federate's next event tag to match the message tag. A later
+    // message tag must not raise it, since the federate may not have completed its
+    // next event yet.
+    if (!is_parent_rti(fed) && lf_tag_compare(intended_tag, fed->enclave.next_event) < 0) {
+        update_federate_next_event_tag_locked(fed->enclave.id, intended_tag);
+    }
+
+    lf_mutex_unlock(mutex);
 }
 
 void handle_logical_tag_complete(federate_t* fed) {
@@ -502,13 +589,13 @@ void handle_logical_tag_complete(federate_t* fed) {
     if (_f_rti->tracing_enabled) {
         tracepoint_rti_from_federate(_f_rti->trace, receive_LTC, fed->enclave.id, &completed);
     }
-    logical_tag_complete(&(fed->enclave), completed);
+    enclave_logical_tag_complete(&(fed->enclave), completed);
 
     // FIXME: Should this function be in the enclave version?
-    lf_mutex_lock(&rti_mutex);
+    lf_mutex_t* mutex = lock_shard(&(fed->enclave));
     // See if we can remove any of the recorded in-transit messages for this.
     clean_in_transit_message_record_up_to_tag(fed->in_transit_message_tags, fed->enclave.completed);
-    lf_mutex_unlock(&rti_mutex);
+    lf_mutex_unlock(mutex);
 }
 
 void handle_next_event_tag(federate_t* fed) {
@@ -518,7 +605,7 @@ void handle_next_event_tag(federate_t* fed) {
 
     // Acquire a mutex lock to ensure that this state does not change while a
     // message is in transport or being used to determine a TAG.
-    lf_mutex_lock(&rti_mutex); // FIXME: Instead of using a mutex,
+    lf_mutex_t* mutex = lock_shard(&(fed->enclave)); // FIXME: Instead of using a mutex,
                                          // it might be more efficient to use a
                                          // select() mechanism to read and process
                                          // federates' buffers in an orderly fashion.
@@ -531,11 +618,16 @@ void handle_next_event_tag(federate_t* fed) {
     LF_PRINT_LOG("RTI received from federate %d the Next Event Tag (NET) " PRINTF_TAG,
         fed->enclave.id, intended_tag.time - start_time,
         intended_tag.microstep);
+    // The grant latency is measured from the first NET that is not yet granted.
+    if (_f_rti->stats_period > 0 && fed->stats.net_received_at == NEVER
+            && lf_tag_compare(intended_tag, fed->enclave.last_granted) > 0) {
+        fed->stats.net_received_at = lf_time_physical();
+    }
     update_federate_next_event_tag_locked(
         fed->enclave.id,
         intended_tag
     );
-    lf_mutex_unlock(&rti_mutex);
+    lf_mutex_unlock(mutex);
 }
 
 /////////////////// STOP functions ////////////////////
@@ -552,7 +644,8 @@ bool _lf_rti_stop_granted_already_sent_to_federates = false;
  * This function also checks the most recently received NET from
  * each federate and resets that be no greater than the _RTI.max_stop_tag.
  *
- * This function assumes the caller holds the _RTI.rti_mutex lock.
+ * This function assumes the caller holds the _RTI.rti_mutex lock and the locks
+ * of all shards (see lock_all_shards()).
  */
 void _lf_rti_broadcast_stop_time_to_federates_locked() {
     if (_lf_rti_stop_granted_already_sent_to_federates == true) {
@@ -565,12 +658,13 @@ void _lf_rti_broadcast_stop_time_to_federates_locked() {
     // Iterate over federates and send each the message.
     for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
         federate_t *fed = _f_rti->enclaves[i];
-        if (fed->enclave.state == NOT_CONNECTED) {
+        if (fed->enclave.state == NOT_CONNECTED || is_parent_rti(fed)) {
             continue;
         }
         if (lf_tag_compare(fed->enclave.next_event, _f_rti->max_stop_tag) >= 0) {
             // Need the next_event to be no greater than the stop tag.
             fed->enclave.next_event = _f_rti->max_stop_tag;
+            update_paths_from_enclave(&(fed->enclave));
         }
         if (_f_rti->tracing_enabled) {
             tracepoint_rti_to_federate(_f_rti->trace, send_STOP_GRN, fed->enclave.id, &_f_rti->max_stop_tag);
@@ -592,7 +686,10 @@ void mark_federate_requesting_stop(federate_t* fed) {
         _f_rti->num_enclaves_handling_stop++;
         fed->requested_stop = true;
     }
-    if (_f_rti->num_enclaves_handling_stop == _f_rti->number_of_enclaves) {
+    if (is_regional_rti()) {
+        // The parent RTI grants the stop once all regions have reported theirs.
+        report_stop_to_parent_locked();
+    } else if (_f_rti->num_enclaves_handling_stop == _f_rti->number_of_enclaves) {
         // We now have information about the stop time of all
         // federates.
         _lf_rti_broadcast_stop_time_to_federates_locked();
@@ -610,11 +707,14 @@ void handle_stop_request_message(federate_t* fed) {
     // Acquire a mutex lock to ensure that this state does change while a
     // message is in transport or being used to determine a TAG.
     lf_mutex_lock(&rti_mutex);
+    // The stop request is forwarded to federates of all shards.
+    lock_all_shards();
 
     // Check whether we have already received a stop_tag
     // from this federate
     if (fed->requested_stop) {
         // Ignore this request
+        unlock_all_shards();
         lf_mutex_unlock(&rti_mutex);
         return;
     }
@@ -642,6 +742,7 @@ void handle_stop_request_message(federate_t* fed) {
         // We now have information about the stop time of all
         // federates. This is extremely unlikely, but it can occur
         // all federates call lf_request_stop() at the same tag.
+        unlock_all_shards();
         lf_mutex_unlock(&rti_mutex);
         return;
     }
@@ -653,12 +754,15 @@ void handle_stop_request_message(federate_t* fed) {
     // Iterate over federates and send each the MSG_TYPE_STOP_REQUEST message
     // if we do not have a stop_time already for them. Do not do this more than once.
     if (_f_rti->stop_in_progress) {
+        unlock_all_shards();
         lf_mutex_unlock(&rti_mutex);
         return;
     }
     _f_rti->stop_in_progress = true;
     for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
         federate_t *f = _f_rti->enclaves[i];
+        // The stop request is reported to the parent RTI by report_stop_to_parent_locked().
+        if (is_parent_rti(f)) continue;
         if (f->enclave.id != fed->enclave.id && f->requested_stop == false) {
             if (f->enclave.state == NOT_CONNECTED) {
                 mark_federate_requesting_stop(f);
@@ -677,6 +781,7 @@ void handle_stop_request_message(federate_t* fed) {
     LF_PRINT_LOG("RTI forwarded to federates MSG_TYPE_STOP_REQUEST with tag (" PRINTF_TIME ", %u).",
                 _f_rti->max_stop_tag.time - start_time,
                 _f_rti->max_stop_tag.microstep);
+    unlock_all_shards();
     lf_mutex_unlock(&rti_mutex);
 }
 
@@ -696,13 +801,16 @@ void handle_stop_request_reply(federate_t* fed) {
             federate_stop_tag.time - start_time,
             federate_stop_tag.microstep);
 
-    // Acquire the mutex lock so that we can change the state of the RTI
+    // Acquire the mutex lock so that we can change the state of the RTI,
+    // and the locks of all shards, since this may grant the stop to all federates.
     lf_mutex_lock(&rti_mutex);
+    lock_all_shards();
     // If the federate has not requested stop before, count the reply
     if (lf_tag_compare(federate_stop_tag, _f_rti->max_stop_tag) > 0) {
         _f_rti->max_stop_tag = federate_stop_tag;
     }
     mark_federate_requesting_stop(fed);
+    unlock_all_shards();
     lf_mutex_unlock(&rti_mutex);
 }
 
@@ -730,16 +838,23 @@ void handle_address_query(uint16_t fed_id) {
     // from this federate. In that case, it will respond by sending -1.
 
     // Encode the port number.
-    federate_t *remote_fed = _f_rti->enclaves[remote_fed_id];
+    int32_t remote_index = federate_index(remote_fed_id);
+    if (remote_index < 0) {
+        lf_print_error("RTI cannot give the address of federate %d to federate %d. "
+                "Physical connections across regions are not supported.", remote_fed_id, fed_id);
+        struct in_addr unknown_addr = {0};
+        encode_int32(-1, (unsigned char*)buffer);
+        write_header_and_body_to_socket_with_mutex(fed->socket, sizeof(int32_t), (unsigned char*)buffer,
+                sizeof(unknown_addr), (unsigned char*)&unknown_addr, NULL,
+                "Failed to write port number and ip address to socket of federate %d.", fed_id);
+        return;
+    }
+    federate_t *remote_fed = _f_rti->enclaves[remote_index];
     encode_int32(remote_fed->server_port, (unsigned char*)buffer);
-    // Send the port number (which could be -1).
-    write_to_socket_errexit(fed->socket, sizeof(int32_t), (unsigned char*)buffer,
-                        "Failed to write port number to socket of federate %d.", fed_id);
-
-    // Send the server IP address to federate.
-    write_to_socket_errexit(fed->socket, sizeof(remote_fed->server_ip_addr),
-                        (unsigned char *)&remote_fed->server_ip_addr,
-                        "Failed to write ip address to socket of federate %d.", fed_id);
+    // Send the port number (which could be -1) followed by the server IP address.
+    write_header_and_body_to_socket_with_mutex(fed->socket, sizeof(int32_t), (unsigned char*)buffer,
+                        sizeof(remote_fed->server_ip_addr), (unsigned char *)&remote_fed->server_ip_addr, NULL,
+                        "Failed to write port number and ip address to socket of federate %d.", fed_id);
 
     if (remote_fed->server_port != -1) {
         LF_PRINT_DEBUG("Replied to address query from federate %d with address %s:%d.",
@@ -774,6 +889,34 @@ void handle_address_ad(uint16_t federate_id) {
     lf_mutex_unlock(&rti_mutex);
 }
 
+/**
+ * Send the start time to the given federate on a MSG_TYPE_TIMESTAMP message,
+ * which grants it time advance to the start time.
+ * This function assumes the caller holds the mutex.
+ */
+static void send_start_time(federate_t* fed) {
+    unsigned char start_time_buffer[MSG_TYPE_TIMESTAMP_LENGTH];
+    start_time_buffer[0] = MSG_TYPE_TIMESTAMP;
+    encode_int64(swap_bytes_if_big_endian_int64(start_time), &start_time_buffer[1]);
+
+    if (_f_rti->tracing_enabled) {
+        tag_t tag = {.time = start_time, .microstep = 0};
+        tracepoint_rti_to_federate(_f_rti->trace, send_TIMESTAMP, fed->enclave.id, &tag);
+    }
+    ssize_t bytes_written = write_to_socket(
+        fed->socket, MSG_TYPE_TIMESTAMP_LENGTH,
+        start_time_buffer
+    );
+    if (bytes_written < MSG_TYPE_TIMESTAMP_LENGTH) {
+        lf_print_error("Failed to send the starting time to federate %d.", fed->enclave.id);
+    }
+
+    // Update state for the federate to indicate that the MSG_TYPE_TIMESTAMP
+    // message has been sent.
+    fed->enclave.state = GRANTED;
+    LF_PRINT_LOG("RTI sent start time " PRINTF_TIME " to federate %d.", start_time, fed->enclave.id);
+}
+
 void handle_timestamp(federate_t *my_fed) {
     unsigned char buffer[sizeof(int64_t)];
     // Read bytes from the socket. We need 8 bytes.
@@ -797,48 +940,41 @@ void handle_timestamp(federate_t *my_fed) {
     if (_f_rti->num_feds_proposed_start == _f_rti->number_of_enclaves) {
         // All federates have proposed a start time.
         lf_cond_broadcast(&received_start_times);
-    } else {
-        // Some federates have not yet proposed a start time.
-        // wait for a notification.
-        while (_f_rti->num_feds_proposed_start < _f_rti->number_of_enclaves) {
-            // FIXME: Should have a timeout here?
-            lf_cond_wait(&received_start_times);
+        // Add an offset to this start time to get everyone starting together.
+        // The start time given by the parent RTI of a region already has it.
+        start_time = _f_rti->max_start_time + (is_regional_rti() ? 0LL : DELAY_START);
+        // Rather than having the handler of each federate wait for the others,
+        // which would tie up the threads shared by federates when
+        // listener_threads is set, send the start time to all federates here.
+        for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
+            if (is_parent_rti(_f_rti->enclaves[i])) {
+                _f_rti->enclaves[i]->enclave.state = GRANTED;
+                continue;
+            }
+            send_start_time(_f_rti->enclaves[i]);
         }
+        lf_cond_broadcast(&sent_start_time);
+        // No federate is waiting for the start time anymore, so the
+        // state of the federates can now be guarded by their shards.
+        // The state of a region stays guarded by rti_mutex because
+        // it is reported to the parent RTI as a whole.
+        if (!is_regional_rti()) {
+            form_shards();
+        }
+    } else if (is_regional_rti() && _f_rti->num_feds_proposed_start == _f_rti->number_of_enclaves - 1) {
+        // All federates of the region have proposed a start time. The parent
+        // RTI proposes the start time of the federation as the last one.
+        propose_start_time_to_parent_locked(_f_rti->max_start_time);
     }
-
-    lf_mutex_unlock(&rti_mutex);
-
-    // Send back to the federate the maximum time plus an offset on a TIMESTAMP
-    // message.
-    unsigned char start_time_buffer[MSG_TYPE_TIMESTAMP_LENGTH];
-    start_time_buffer[0] = MSG_TYPE_TIMESTAMP;
-    // Add an offset to this start time to get everyone starting together.
-    start_time = _f_rti->max_start_time + DELAY_START;
-    encode_int64(swap_bytes_if_big_endian_int64(start_time), &start_time_buffer[1]);
-
-    if (_f_rti->tracing_enabled) {
-        tag_t tag = {.time = start_time, .microstep = 0};
-        tracepoint_rti_to_federate(_f_rti->trace, send_TIMESTAMP, my_fed->enclave.id, &tag);
-    }
-    ssize_t bytes_written = write_to_socket(
-        my_fed->socket, MSG_TYPE_TIMESTAMP_LENGTH,
-        start_time_buffer
-    );
-    if (bytes_written < MSG_TYPE_TIMESTAMP_LENGTH) {
-        lf_print_error("Failed to send the starting time to federate %d.", my_fed->enclave.id);
-    }
-
-    lf_mutex_lock(&rti_mutex);
-    // Update state for the federate to indicate that the MSG_TYPE_TIMESTAMP
-    // message has been sent. That MSG_TYPE_TIMESTAMP message grants time advance to
-    // the federate to the start time.
-    my_fed->enclave.state = GRANTED;
-    lf_cond_broadcast(&sent_start_time);
-    LF_PRINT_LOG("RTI sent start time " PRINTF_TIME " to federate %d.", start_time, my_fed->enclave.id);
     lf_mutex_unlock(&rti_mutex);
 }
 
-void send_physical_clock(unsigned char message_type, federate_t* fed, socket_type_t socket_type) {
+/**
+ * Send the physical clock time, shifted by the specified interval, to a federate.
+ * @see send_physical_clock()
+ */
+static void send_shifted_physical_clock(unsigned char message_type, federate_t* fed,
+        socket_type_t socket_type, interval_t shift) {
     if (fed->enclave.state == NOT_CONNECTED) {
         lf_print_warning("Clock sync: RTI failed to send physical time to federate %d. Socket not connected.",
                 fed->enclave.id);
@@ -846,7 +982,7 @@ void send_physical_clock(unsigned char message_type, federate_t* fed, socket_typ
     }
     unsigned char buffer[sizeof(int64_t) + 1];
     buffer[0] = message_type;
-    int64_t current_physical_time = lf_time_physical();
+    int64_t current_physical_time = lf_time_physical() + shift;
     encode_int64(current_physical_time, &(buffer[1]));
 
     // Send the message
@@ -873,16 +1009,23 @@ void send_physical_clock(unsigned char message_type, federate_t* fed, socket_typ
                  fed->enclave.id);
 }
 
-void handle_physical_clock_sync_message(federate_t* my_fed, socket_type_t socket_type) {
+void send_physical_clock(unsigned char message_type, federate_t* fed, socket_type_t socket_type) {
+    send_shifted_physical_clock(message_type, fed, socket_type, 0LL);
+}
+
+void handle_physical_clock_sync_message(federate_t* my_fed, socket_type_t socket_type, instant_t t3_received) {
     // Lock the mutex to prevent interference between sending the two
     // coded probe messages.
     lf_mutex_lock(&rti_mutex);
+    // The coded probe is shifted as T4 is so that the federate sees
+    // the interval between sending them.
+    interval_t shift = (t3_received == NEVER) ? 0LL : t3_received - lf_time_physical();
     // Reply with a T4 type message
-    send_physical_clock(MSG_TYPE_CLOCK_SYNC_T4, my_fed, socket_type);
+    send_shifted_physical_clock(MSG_TYPE_CLOCK_SYNC_T4, my_fed, socket_type, shift);
     // Send the corresponding coded probe immediately after,
     // but only if this is a UDP channel.
     if (socket_type == UDP) {
-        send_physical_clock(MSG_TYPE_CLOCK_SYNC_CODED_PROBE, my_fed, socket_type);
+        send_shifted_physical_clock(MSG_TYPE_CLOCK_SYNC_CODED_PROBE, my_fed, socket_type, shift);
     }
     lf_mutex_unlock(&rti_mutex);
 }
@@ -940,7 +1083,9 @@ void* clock_synchronization_thread(void* noargs) {
             int remaining_attempts = 5;
             while (remaining_attempts > 0) {
                 remaining_attempts--;
-                int bytes_read = read_from_socket(_f_rti->socket_descriptor_UDP, message_size, buffer);
+                instant_t receive_time;
+                ssize_t bytes_read = receive_timestamped_datagram(_f_rti->socket_descriptor_UDP,
+                        message_size, buffer, NULL, &receive_time);
                 // If any errors occur, either discard the message or the clock sync round.
                 if (bytes_read == message_size) {
                     if (buffer[0] == MSG_TYPE_CLOCK_SYNC_T3) {
@@ -954,7 +1099,8 @@ void* clock_synchronization_thread(void* noargs) {
                             continue;
                         }
                         LF_PRINT_DEBUG("Clock sync: RTI received T3 message from federate %d.", fed_id_2);
-                        handle_physical_clock_sync_message(_f_rti->enclaves[fed_id_2], UDP);
+                        handle_physical_clock_sync_message(_f_rti->enclaves[fed_id_2], UDP,
+                                _f_rti->clock_sync_timestamps == SOCKET_TIMESTAMPS_NONE ? NEVER : receive_time);
                         break;
                     } else {
                         // The message is not a T3 message. Discard the message and
@@ -985,7 +1131,7 @@ void* clock_synchronization_thread(void* noargs) {
 
 void handle_federate_resign(federate_t *my_fed) {
     // Nothing more to do. Close the socket and exit.
-    lf_mutex_lock(&rti_mutex);
+    lf_mutex_t* mutex = lock_shard(&(my_fed->enclave));
     if (_f_rti->tracing_enabled) {
         // Extract the tag, for tracing purposes
         size_t header_size = 1 + sizeof(tag_t);
@@ -1002,6 +1148,7 @@ void handle_federate_resign(federate_t *my_fed) {
 
     // Indicate that there will no further events from this federate.
     my_fed->enclave.next_event = FOREVER_TAG;
+    update_paths_from_enclave(&(my_fed->enclave));
 
     // According to this: https://stackoverflow.com/questions/4160347/close-vs-shutdown-socket,
     // the close should happen when receiving a 0 length message from the other end.
@@ -1021,70 +1168,134 @@ void handle_federate_resign(federate_t *my_fed) {
     notify_downstream_advance_grant_if_safe(&(my_fed->enclave), visited);
     free(visited);
 
-    lf_mutex_unlock(&rti_mutex);
+    lf_mutex_unlock(mutex);
 }
 
-void* federate_thread_TCP(void* fed) {
-    federate_t* my_fed = (federate_t*)fed;
+/**
+ * Handle a MSG_TYPE_MIN_OUTPUT_DELAY message from the given federate by
+ * recording the minimum delay of its outputs.
+ * @param my_fed The federate.
+ */
+static void handle_min_output_delay(federate_t* my_fed) {
+    unsigned char buffer[sizeof(int64_t)];
+    read_from_socket_errexit(my_fed->socket, sizeof(int64_t), buffer,
+            "RTI failed to read the minimum output delay of federate %d.", my_fed->enclave.id);
+    interval_t delay = extract_int64(buffer);
+    if (delay < 0LL) {
+        lf_print_warning("RTI: Ignoring negative minimum output delay of federate %d.", my_fed->enclave.id);
+        return;
+    }
+    LF_PRINT_LOG("RTI: Federate %d has a minimum output delay of " PRINTF_TIME ".",
+            my_fed->enclave.id, delay);
+
+    // Federates send this before proposing a start time, so no grants
+    // have been made yet based on the previous value.
+    lf_mutex_lock(&rti_mutex);
+    my_fed->enclave.min_output_delay = delay;
+    lf_mutex_unlock(&rti_mutex);
+}
 
+/**
+ * Read one message from the given federate and handle it.
+ * @param my_fed The federate.
+ * @return false if the socket to the federate is closed or the federate
+ *  has resigned, and true otherwise.
+ */
+static bool handle_federate_message(federate_t* my_fed) {
     // Buffer for incoming messages.
     // This does not constrain the message size because messages
     // are forwarded piece by piece.
     unsigned char buffer[FED_COM_BUFFER_SIZE];
 
-    // Listen for messages from the federate.
-    while (my_fed->enclave.state != NOT_CONNECTED) {
-        // Read no more than one byte to get the message type.
-        ssize_t bytes_read = read_from_socket(my_fed->socket, 1, buffer);
-        if (bytes_read < 1) {
-            // Socket is closed
-            lf_print_warning("RTI: Socket to federate %d is closed. Exiting the thread.", my_fed->enclave.id);
-            my_fed->enclave.state = NOT_CONNECTED;
-            my_fed->socket = -1;
-            // FIXME: We need better error handling here, but do not stop execution here.
-            break;
+    // Read no more than one byte to get the message type.
+    ssize_t bytes_read = read_from_socket(my_fed->socket, 1, buffer);
+    if (bytes_read < 1) {
+        // Socket is closed
+        lf_print_warning("RTI: Socket to federate %d is closed. Exiting the thread.", my_fed->enclave.id);
+        lf_mutex_t* mutex = lock_shard(&(my_fed->enclave));
+        my_fed->enclave.state = NOT_CONNECTED;
+        update_paths_from_enclave(&(my_fed->enclave));
+        lf_mutex_unlock(mutex);
+        my_fed->socket = -1;
+        if (is_regional_rti()) {
+            report_region_to_parent();
         }
-        LF_PRINT_DEBUG("RTI: Received message type %u from federate %d.", buffer[0], my_fed->enclave.id);
-        switch(buffer[0]) {
-            case MSG_TYPE_TIMESTAMP:
-                handle_timestamp(my_fed);
-                break;
-            case MSG_TYPE_ADDRESS_QUERY:
-                handle_address_query(my_fed->enclave.id);
-                break;
-            case MSG_TYPE_ADDRESS_ADVERTISEMENT:
-                handle_address_ad(my_fed->enclave.id);
-                break;
-            case MSG_TYPE_TAGGED_MESSAGE:
-                handle_timed_message(my_fed, buffer);
-                break;
-            case MSG_TYPE_RESIGN:
-                handle_federate_resign(my_fed);
-                return NULL;
-                break;
-            case MSG_TYPE_NEXT_EVENT_TAG:
-                handle_next_event_tag(my_fed);
-                break;
-            case MSG_TYPE_LOGICAL_TAG_COMPLETE:
-                handle_logical_tag_complete(my_fed);
-                break;
-            case MSG_TYPE_STOP_REQUEST:
-                handle_stop_request_message(my_fed); // FIXME: Reviewed until here.
-                                                     // Need to also look at
-                                                     // notify_advance_grant_if_safe()
-                                                     // and notify_downstream_advance_grant_if_safe()
-                break;
-            case MSG_TYPE_STOP_REQUEST_REPLY:
-                handle_stop_request_reply(my_fed);
-                break;
-            case MSG_TYPE_PORT_ABSENT:
-                handle_port_absent_message(my_fed, buffer);
+        // FIXME: We need better error handling here, but do not stop execution here.
+        return false;
+    }
+    LF_PRINT_DEBUG("RTI: Received message type %u from federate %d.", buffer[0], my_fed->enclave.id);
+    // Only the thread handling the socket of the federate writes this counter.
+    my_fed->stats.messages_received[buffer[0]]++;
+    switch(buffer[0]) {
+        case MSG_TYPE_TIMESTAMP:
+            handle_timestamp(my_fed);
+            break;
+        case MSG_TYPE_ADDRESS_QUERY:
+            handle_address_query(my_fed->enclave.id);
+            break;
+        case MSG_TYPE_ADDRESS_ADVERTISEMENT:
+            handle_address_ad(my_fed->enclave.id);
+            break;
+        case MSG_TYPE_TAGGED_MESSAGE:
+        case MSG_TYPE_TAGGED_MESSAGE_BATCH:
+            handle_timed_message(my_fed, buffer);
+            break;
+        case MSG_TYPE_RESIGN:
+            handle_federate_resign(my_fed);
+            if (is_regional_rti()) {
+                report_region_to_parent();
+            }
+            return false;
+        case MSG_TYPE_NEXT_EVENT_TAG:
+            handle_next_event_tag(my_fed);
+            break;
+        case MSG_TYPE_LOGICAL_TAG_COMPLETE:
+            handle_logical_tag_complete(my_fed);
+            break;
+        case MSG_TYPE_STOP_REQUEST:
+            handle_stop_request_message(my_fed); // FIXME: Reviewed until here.
+                                                 // Need to also look at
+                                                 // notify_advance_grant_if_safe()
+                                                 // and notify_downstream_advance_grant_if_safe()
+            break;
+        case MSG_TYPE_STOP_REQUEST_REPLY:
+            handle_stop_request_reply(my_fed);
+            break;
+        case MSG_TYPE_PORT_ABSENT:
+        case MSG_TYPE_PORT_ABSENT_BATCH:
+            handle_port_absent_message(my_fed, buffer);
+            break;
+        case MSG_TYPE_MIN_OUTPUT_DELAY:
+            handle_min_output_delay(my_fed);
+            break;
+        case MSG_TYPE_TAG_ADVANCE_GRANT:
+        case MSG_TYPE_PROVISIONAL_TAG_ADVANCE_GRANT:
+        case MSG_TYPE_STOP_GRANTED:
+            if (is_parent_rti(my_fed)) {
+                handle_parent_message(my_fed, buffer[0]);
                 break;
-            default:
-                lf_print_error("RTI received from federate %d an unrecognized TCP message type: %u.", my_fed->enclave.id, buffer[0]);
-                if (_f_rti->tracing_enabled) {
-                    tracepoint_rti_from_federate(_f_rti->trace, receive_UNIDENTIFIED, my_fed->enclave.id, NULL);
-                }
+            }
+            // Federates do not send these messages.
+            // Fall through.
+        default:
+            lf_print_error("RTI received from federate %d an unrecognized TCP message type: %u.", my_fed->enclave.id, buffer[0]);
+            if (_f_rti->tracing_enabled) {
+                tracepoint_rti_from_federate(_f_rti->trace, receive_UNIDENTIFIED, my_fed->enclave.id, NULL);
+            }
+    }
+    if (is_regional_rti()) {
+        report_region_to_parent();
+    }
+    return true;
+}
+
+void* federate_thread_TCP(void* fed) {
+    federate_t* my_fed = (federate_t*)fed;
+
+    // Listen for messages from the federate.
+    while (my_fed->enclave.state != NOT_CONNECTED) {
+        if (!handle_federate_message(my_fed)) {
+            return NULL;
         }
     }
 
@@ -1094,6 +1305,19 @@ void* federate_thread_TCP(void* fed) {
     return NULL;
 }
 
+bool handle_federate_input(void* fed) {
+    federate_t* my_fed = (federate_t*)fed;
+    if (my_fed->enclave.state != NOT_CONNECTED && !handle_federate_message(my_fed)) {
+        return false;
+    }
+    if (my_fed->enclave.state == NOT_CONNECTED) {
+        // As in federate_thread_TCP(), close the socket.
+        close(my_fed->socket);
+        return false;
+    }
+    return true;
+}
+
 void send_reject(int socket_id, unsigned char error_code) {
     LF_PRINT_DEBUG("RTI sending MSG_TYPE_REJECT.");
     unsigned char response[2];
@@ -1169,7 +1393,7 @@ int32_t receive_and_check_fed_id_message(int socket_id, struct sockaddr_in* clie
             send_reject(socket_id, FEDERATION_ID_DOES_NOT_MATCH);
             return -1;
         } else {
-            if (fed_id >= _f_rti->number_of_enclaves) {
+            if (federate_index(fed_id) < 0) {
                 // Federate ID is out of range.
                 lf_print_error("RTI received federate ID %d, which is out of range.", fed_id);
                 if (_f_rti->tracing_enabled){
@@ -1178,7 +1402,18 @@ int32_t receive_and_check_fed_id_message(int socket_id, struct sockaddr_in* clie
                 send_reject(socket_id, FEDERATE_ID_OUT_OF_RANGE);
                 return -1;
             } else {
-                if ((_f_rti->enclaves[fed_id])->enclave.state != NOT_CONNECTED) {
+                // Handshakes proceed in parallel, so claim the ID under the mutex.
+                // Set the federate's state as pending
+                // because it is waiting for the start time to be
+                // sent by the RTI before beginning its execution.
+                lf_mutex_lock(&rti_mutex);
+                federate_t* fed = _f_rti->enclaves[federate_index(fed_id)];
+                bool in_use = (fed->enclave.state != NOT_CONNECTED);
+                if (!in_use) {
+                    fed->enclave.state = PENDING;
+                }
+                lf_mutex_unlock(&rti_mutex);
+                if (in_use) {
                     lf_print_error("RTI received duplicate federate ID: %d.", fed_id);
                     if (_f_rti->tracing_enabled) {
                         tracepoint_rti_to_federate(_f_rti->trace, send_REJECT, fed_id, NULL);
@@ -1189,7 +1424,7 @@ int32_t receive_and_check_fed_id_message(int socket_id, struct sockaddr_in* clie
             }
         }
     }
-    federate_t* fed = _f_rti->enclaves[fed_id];
+    federate_t* fed = _f_rti->enclaves[federate_index(fed_id)];
     // The MSG_TYPE_FED_IDS message has the right federation ID.
     // Assign the address information for federate.
     // The IP address is stored here as an in_addr struct (in .server_ip_addr) that can be useful
@@ -1210,11 +1445,6 @@ int32_t receive_and_check_fed_id_message(int socket_id, struct sockaddr_in* clie
 #endif
     fed->socket = socket_id;
 
-    // Set the federate's state as pending
-    // because it is waiting for the start time to be
-    // sent by the RTI before beginning its execution.
-    fed->enclave.state = PENDING;
-
     LF_PRINT_DEBUG("RTI responding with MSG_TYPE_ACK to federate %d.", fed_id);
     // Send an MSG_TYPE_ACK message.
     unsigned char ack_message = MSG_TYPE_ACK;
@@ -1224,7 +1454,7 @@ int32_t receive_and_check_fed_id_message(int socket_id, struct sockaddr_in* clie
     write_to_socket_errexit(socket_id, 1, &ack_message,
             "RTI failed to write MSG_TYPE_ACK message to federate %d.", fed_id);
 
-    return (int32_t)fed_id;
+    return (int32_t)fed->enclave.id;
 }
 
 int receive_connection_information(int socket_id, uint16_t fed_id) {
@@ -1255,8 +1485,8 @@ int receive_connection_information(int socket_id, uint16_t fed_id) {
             fed_id);
 
         // Allocate memory for the upstream and downstream pointers
-        fed->enclave.upstream = (int*)malloc(sizeof(uint16_t) * fed->enclave.num_upstream);
-        fed->enclave.downstream = (int*)malloc(sizeof(uint16_t) * fed->enclave.num_downstream);
+        fed->enclave.upstream = (int*)malloc(sizeof(int) * fed->enclave.num_upstream);
+        fed->enclave.downstream = (int*)malloc(sizeof(int) * fed->enclave.num_downstream);
 
         // Allocate memory for the upstream delay pointers
         fed->enclave.upstream_delay =
@@ -1292,6 +1522,12 @@ int receive_connection_information(int socket_id, uint16_t fed_id) {
         }
 
         free(connections_info_body);
+
+        if (is_regional_rti()) {
+            lf_mutex_lock(&rti_mutex);
+            localize_connections(fed);
+            lf_mutex_unlock(&rti_mutex);
+        }
         return 1;
     }
 }
@@ -1334,7 +1570,7 @@ int receive_udp_message_and_set_up_clock_sync(int socket_id, uint16_t fed_id) {
                         assert(fed_id > -1);
                         assert(fed_id < 65536);
                         LF_PRINT_DEBUG("RTI received T3 clock sync message from federate %d.", fed_id);
-                        handle_physical_clock_sync_message(fed, TCP);
+                        handle_physical_clock_sync_message(fed, TCP, NEVER);
                     } else {
                         lf_print_error("Unexpected message %u from federate %d.", buffer[0], fed_id);
                         send_reject(socket_id, UNEXPECTED_MESSAGE);
@@ -1432,15 +1668,120 @@ bool authenticate_federate(int socket) {
 }
 #endif
 
+/**
+ * Number of federates that have completed their handshake with the RTI and number
+ * of handshakes in progress, guarded by rti_mutex. Handshakes proceed in parallel,
+ * each on its own thread, so that a large federation starts up in about the time
+ * of one handshake.
+ */
+static int32_t federates_connected = 0;
+static int32_t handshakes_in_progress = 0;
+
+/** Condition variable signaled when a handshake finishes. */
+static lf_cond_t handshake_finished;
+
+/** An accepted connection whose handshake is in progress. */
+typedef struct handshake_t {
+    int socket_id;
+    struct sockaddr client_fd;
+    bool succeeded;
+} handshake_t;
+
+/**
+ * Thread that performs the handshake of a federate that has connected on the
+ * socket of the specified handshake_t: authentication, if enabled, the IDs of
+ * the federate and its federation, its neighbor structure, and the initial clock
+ * synchronization. If the handshake succeeds, this creates a thread to communicate
+ * with the federate or has the poller of the RTI watch its socket.
+ */
+static void* handshake_with_federate(void* arg) {
+    handshake_t* handshake = (handshake_t*)arg;
+    int socket_id = handshake->socket_id;
+    handshake->succeeded = false;
+
+    // Wait for the first message from the federate when RTI -a option is on.
+    #ifdef __RTI_AUTH__
+    if (_f_rti->authentication_enabled && !authenticate_federate(socket_id)) {
+        lf_print_warning("RTI failed to authenticate the incoming federate.");
+        // Ignore the federate that failed authentication.
+        socket_id = -1;
+    }
+    #endif
+
+    // The first message from the federate should contain its ID and the federation ID.
+    int32_t fed_id = (socket_id < 0) ? -1
+            : receive_and_check_fed_id_message(socket_id, (struct sockaddr_in*)&handshake->client_fd);
+    if (fed_id >= 0
+            && receive_connection_information(socket_id, (uint16_t)fed_id)
+            && receive_udp_message_and_set_up_clock_sync(socket_id, (uint16_t)fed_id)) {
+
+        // Create a thread to communicate with the federate.
+        // This has to be done after clock synchronization is finished
+        // or that thread may end up attempting to handle incoming clock
+        // synchronization messages.
+        federate_t *fed = _f_rti->enclaves[fed_id];
+        if (_f_rti->listener_threads > 0) {
+            int result = socket_poller_add(&_f_rti->poller, socket_id, handle_federate_input, fed);
+            if (result != 0) {
+                lf_print_error_and_exit("RTI failed to watch the socket of federate %d. Error code: %d.",
+                        fed_id, result);
+            }
+        } else {
+            lf_thread_create(&(fed->thread_id), federate_thread_TCP, fed);
+        }
+        handshake->succeeded = true;
+    } else if (fed_id >= 0) {
+        // The federate was rejected after its ID was accepted,
+        // so let it connect again.
+        lf_mutex_lock(&rti_mutex);
+        _f_rti->enclaves[fed_id]->enclave.state = NOT_CONNECTED;
+        _f_rti->enclaves[fed_id]->socket = -1;
+        lf_mutex_unlock(&rti_mutex);
+    }
+
+    lf_mutex_lock(&rti_mutex);
+    handshakes_in_progress--;
+    if (handshake->succeeded) {
+        federates_connected++;
+    }
+    lf_cond_broadcast(&handshake_finished);
+    lf_mutex_unlock(&rti_mutex);
+    return NULL;
+}
+
 void connect_to_federates(int socket_descriptor) {
-    for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
+    // A regional RTI connects to its parent RTI once its federates have connected.
+    int32_t number_of_federates = _f_rti->number_of_enclaves - (is_regional_rti() ? 1 : 0);
+    lf_cond_init(&handshake_finished, &rti_mutex);
+    // The handshakes, which are joined once all federates have connected.
+    size_t handshakes_capacity = (size_t)number_of_federates;
+    size_t number_of_handshakes = 0;
+    handshake_t** handshakes = (handshake_t**)malloc(handshakes_capacity * sizeof(handshake_t*));
+    lf_thread_t* handshake_threads = (lf_thread_t*)malloc(handshakes_capacity * sizeof(lf_thread_t));
+    if (handshakes == NULL || handshake_threads == NULL) {
+        lf_print_error_and_exit("RTI failed to allocate memory for the handshakes with federates.");
+    }
+
+    lf_mutex_lock(&rti_mutex);
+    while (federates_connected < number_of_federates) {
+        // Accept a connection only if its federate may still be missing.
+        // Otherwise, wait for a handshake in progress to finish.
+        if (federates_connected + handshakes_in_progress >= number_of_federates) {
+            lf_cond_wait(&handshake_finished);
+            continue;
+        }
+        lf_mutex_unlock(&rti_mutex);
+
         // Wait for an incoming connection request.
-        struct sockaddr client_fd;
-        uint32_t client_length = sizeof(client_fd);
+        handshake_t* handshake = (handshake_t*)malloc(sizeof(handshake_t));
+        if (handshake == NULL) {
+            lf_print_error_and_exit("RTI failed to allocate memory for a handshake with a federate.");
+        }
+        uint32_t client_length = sizeof(handshake->client_fd);
         // The following blocks until a federate connects.
         int socket_id = -1;
         while(1) {
-            socket_id = accept(_f_rti->socket_descriptor_TCP, &client_fd, &client_length);
+            socket_id = accept(_f_rti->socket_descriptor_TCP, &handshake->client_fd, &client_length);
             if (socket_id >= 0) {
                 // Got a socket
                 break;
@@ -1452,37 +1793,31 @@ void connect_to_federates(int socket_descriptor) {
                 continue;
             }
         }
-
-        // Wait for the first message from the federate when RTI -a option is on.
-        #ifdef __RTI_AUTH__
-        if (_f_rti->authentication_enabled) {
-            if (!authenticate_federate(socket_id)) {
-                lf_print_warning("RTI failed to authenticate the incoming federate.");
-                // Ignore the federate that failed authentication.
-                i--;
-                continue;
+        handshake->socket_id = socket_id;
+
+        if (number_of_handshakes == handshakes_capacity) {
+            handshakes_capacity *= 2;
+            handshakes = (handshake_t**)realloc(handshakes, handshakes_capacity * sizeof(handshake_t*));
+            handshake_threads = (lf_thread_t*)realloc(handshake_threads, handshakes_capacity * sizeof(lf_thread_t));
+            if (handshakes == NULL || handshake_threads == NULL) {
+                lf_print_error_and_exit("RTI failed to allocate memory for the handshakes with federates.");
             }
         }
-        #endif
-        
-        // The first message from the federate should contain its ID and the federation ID.
-        int32_t fed_id = receive_and_check_fed_id_message(socket_id, (struct sockaddr_in*)&client_fd);
-        if (fed_id >= 0
-                && receive_connection_information(socket_id, (uint16_t)fed_id)
-                && receive_udp_message_and_set_up_clock_sync(socket_id, (uint16_t)fed_id)) {
-
-            // Create a thread to communicate with the federate.
-            // This has to be done after clock synchronization is finished
-            // or that thread may end up attempting to handle incoming clock
-            // synchronization messages.
-            federate_t *fed = _f_rti->enclaves[fed_id];
-            lf_thread_create(&(fed->thread_id), federate_thread_TCP, fed);
+        handshakes[number_of_handshakes] = handshake;
+        lf_mutex_lock(&rti_mutex);
+        handshakes_in_progress++;
+        lf_thread_create(&handshake_threads[number_of_handshakes], handshake_with_federate, handshake);
+        number_of_handshakes++;
+    }
+    lf_mutex_unlock(&rti_mutex);
 
-        } else {
-            // Received message was rejected. Try again.
-            i--;
-        }
+    for (size_t i = 0; i < number_of_handshakes; i++) {
+        lf_thread_join(handshake_threads[i], NULL);
+        free(handshakes[i]);
     }
+    free(handshakes);
+    free(handshake_threads);
+
     // All federates have connected.
     LF_PRINT_DEBUG("All federates have connected to RTI.");
 
@@ -1491,7 +1826,7 @@ void connect_to_federates(int socket_descriptor) {
         // over the UDP channel, but only if the UDP channel is open and at least one
         // federate is performing runtime clock synchronization.
         bool clock_sync_enabled = false;
-        for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
+        for (int i = 0; i < number_of_federates; i++) {
             if ((_f_rti->enclaves[i])->clock_synchronization_enabled) {
                 clock_sync_enabled = true;
                 break;
@@ -1530,6 +1865,132 @@ void* respond_to_erroneous_connections(void* nothing) {
     return NULL;
 }
 
+/**
+ * Return a short name for the specified message type, for statistics.
+ * @param type The message type.
+ */
+static const char* message_type_name(int type) {
+    switch (type) {
+        case MSG_TYPE_TIMESTAMP: return "TIMESTAMP";
+        case MSG_TYPE_RESIGN: return "RESIGN";
+        case MSG_TYPE_TAGGED_MESSAGE: return "TAGGED_MSG";
+        case MSG_TYPE_TAGGED_MESSAGE_BATCH: return "TAGGED_MSG_BATCH";
+        case MSG_TYPE_NEXT_EVENT_TAG: return "NET";
+        case MSG_TYPE_LOGICAL_TAG_COMPLETE: return "LTC";
+        case MSG_TYPE_STOP_REQUEST: return "STOP_REQ";
+        case MSG_TYPE_STOP_REQUEST_REPLY: return "STOP_REQ_REP";
+        case MSG_TYPE_ADDRESS_QUERY: return "ADR_QR";
+        case MSG_TYPE_ADDRESS_ADVERTISEMENT: return "ADR_AD";
+        case MSG_TYPE_PORT_ABSENT: return "PORT_ABS";
+        case MSG_TYPE_PORT_ABSENT_BATCH: return "PORT_ABS_BATCH";
+        case MSG_TYPE_MIN_OUTPUT_DELAY: return "MIN_OUT_DELAY";
+        default: return NULL;
+    }
+}
+
+/**
+ * Return an upper bound of the specified percentile of the grant latencies
+ * in the specified histogram, in microseconds, or -1 if the histogram is empty.
+ * The last bucket has no upper bound, so the lower bound of the last bucket
+ * is returned for it.
+ * @param histogram The histogram of grant latencies.
+ * @param percentile The percentile, between 0 and 100.
+ */
+static int64_t grant_latency_percentile(uint64_t* histogram, int percentile) {
+    uint64_t total = 0;
+    for (int i = 0; i < GRANT_LATENCY_BUCKETS; i++) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return -1;
+    }
+    uint64_t rank = (total * percentile + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < GRANT_LATENCY_BUCKETS - 1; i++) {
+        count += histogram[i];
+        if (count >= rank) {
+            return 1LL << i;
+        }
+    }
+    return 1LL << (GRANT_LATENCY_BUCKETS - 2);
+}
+
+void print_rti_stats() {
+    int n = _f_rti->number_of_enclaves;
+    federate_stats_t* stats = (federate_stats_t*)malloc(n * sizeof(federate_stats_t));
+    size_t* in_transit = (size_t*)calloc(n, sizeof(size_t));
+    if (stats == NULL || in_transit == NULL) {
+        lf_print_error("RTI failed to allocate memory for statistics.");
+        free(stats);
+        free(in_transit);
+        return;
+    }
+    // Take a snapshot, so that the federates are not held up by the printing.
+    lf_mutex_lock(&rti_mutex);
+    lock_all_shards();
+    for (int i = 0; i < n; i++) {
+        federate_t* fed = _f_rti->enclaves[i];
+        stats[i] = fed->stats;
+        // The records of in-transit messages are freed when all federates have exited.
+        if (!_f_rti->all_federates_exited) {
+            in_transit[i] = get_in_transit_message_count(fed->in_transit_message_tags);
+        }
+    }
+    unlock_all_shards();
+    lf_mutex_unlock(&rti_mutex);
+
+    int64_t lock_waits;
+    interval_t lock_wait_time = get_lock_wait_time(&lock_waits);
+    lf_print("RTI stats: waited " PRINTF_TIME " us for locks over %" PRId64 " acquisitions.",
+            lock_wait_time / 1000, lock_waits);
+    for (int i = 0; i < n; i++) {
+        char line[512];
+        int length = snprintf(line, sizeof(line), "RTI stats: federate %d received", i);
+        for (int type = 0; type < 256 && length < (int)sizeof(line); type++) {
+            const char* name = message_type_name(type);
+            if (stats[i].messages_received[type] == 0) continue;
+            if (name != NULL) {
+                length += snprintf(line + length, sizeof(line) - length, " %s %" PRIu64 ",",
+                        name, stats[i].messages_received[type]);
+            } else {
+                length += snprintf(line + length, sizeof(line) - length, " type %d %" PRIu64 ",",
+                        type, stats[i].messages_received[type]);
+            }
+        }
+        if (length < (int)sizeof(line)) {
+            length += snprintf(line + length, sizeof(line) - length,
+                    " was sent TAG %" PRIu64 ", PTAG %" PRIu64 ", and %" PRIu64 " bytes of messages,"
+                    " has %zu messages in transit",
+                    stats[i].tags_granted, stats[i].ptags_granted, stats[i].bytes_forwarded, in_transit[i]);
+        }
+        int64_t p50 = grant_latency_percentile(stats[i].grant_latency, 50);
+        if (p50 >= 0 && length < (int)sizeof(line)) {
+            snprintf(line + length, sizeof(line) - length, ", grant latency p50 <= %" PRId64 " us, p99 <= %" PRId64 " us.",
+                    p50, grant_latency_percentile(stats[i].grant_latency, 99));
+        } else if (length < (int)sizeof(line)) {
+            snprintf(line + length, sizeof(line) - length, ".");
+        }
+        lf_print("%s", line);
+    }
+    free(stats);
+    free(in_transit);
+}
+
+/**
+ * Thread that prints statistics with the period given by stats_period
+ * until all federates have exited.
+ * @param nothing Nothing needed here.
+ */
+static void* stats_thread(void* nothing) {
+    while (true) {
+        lf_sleep(_f_rti->stats_period);
+        if (_f_rti->all_federates_exited) {
+            return NULL;
+        }
+        print_rti_stats();
+    }
+}
+
 void initialize_federate(federate_t* fed, uint16_t id) {
     initialize_enclave(&(fed->enclave), id);
     fed->requested_stop = false;
@@ -1539,6 +2000,8 @@ void initialize_federate(federate_t* fed, uint16_t id) {
     strncpy(fed->server_hostname ,"localhost", INET_ADDRSTRLEN);
     fed->server_ip_addr.s_addr = 0;
     fed->server_port = -1;
+    memset(&fed->stats, 0, sizeof(federate_stats_t));
+    fed->stats.net_received_at = NEVER;
 }
 
 int32_t start_rti_server(uint16_t port) {
@@ -1555,11 +2018,28 @@ int32_t start_rti_server(uint16_t port) {
     // Try to get the _f_rti->final_port_TCP + 1 port
     if (_f_rti->clock_sync_global_status >= clock_sync_on) {
         _f_rti->socket_descriptor_UDP = create_server(specified_port, _f_rti->final_port_TCP + 1, UDP);
+        if (enable_socket_timestamps(_f_rti->socket_descriptor_UDP, _f_rti->clock_sync_timestamps, false) != 0) {
+            lf_print_warning("RTI failed to enable timestamps on its UDP socket: %s. "
+                    "Timestamping clock sync messages itself.", strerror(errno));
+            _f_rti->clock_sync_timestamps = SOCKET_TIMESTAMPS_NONE;
+        }
     }
     return _f_rti->socket_descriptor_TCP;
 }
 
 void wait_for_federates(int socket_descriptor) {
+    if (_f_rti->stats_period > 0) {
+        measure_lock_waits();
+    }
+    if (_f_rti->listener_threads > 0) {
+        int result = socket_poller_open(&_f_rti->poller, (size_t)_f_rti->listener_threads);
+        if (result != 0) {
+            lf_print_warning("RTI cannot share %d threads among federates (error code %d)."
+                    " Using a thread per federate.", _f_rti->listener_threads, result);
+            _f_rti->listener_threads = 0;
+        }
+    }
+
     // Wait for connections from federates and create a thread for each.
     connect_to_federates(socket_descriptor);
 
@@ -1573,18 +2053,36 @@ void wait_for_federates(int socket_descriptor) {
     lf_thread_t responder_thread;
     lf_thread_create(&responder_thread, respond_to_erroneous_connections, NULL);
 
+    if (_f_rti->stats_period > 0) {
+        lf_thread_t stats_thread_id;
+        lf_thread_create(&stats_thread_id, stats_thread, NULL);
+    }
+
     // Wait for federate threads to exit.
-    void* thread_exit_status;
-    for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
-        federate_t* fed = _f_rti->enclaves[i];
-        lf_print("RTI: Waiting for thread handling federate %d.", fed->enclave.id);
-        lf_thread_join(fed->thread_id, &thread_exit_status);
-        free_in_transit_message_q(fed->in_transit_message_tags);
-        lf_print("RTI: Federate %d thread exited.", fed->enclave.id);
+    if (_f_rti->listener_threads > 0) {
+        lf_print("RTI: Waiting for the sockets of all federates to close.");
+        socket_poller_wait(&_f_rti->poller);
+        socket_poller_close(&_f_rti->poller);
+        for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
+            free_in_transit_message_q(_f_rti->enclaves[i]->in_transit_message_tags);
+        }
+    } else {
+        void* thread_exit_status;
+        for (int i = 0; i < _f_rti->number_of_enclaves; i++) {
+            federate_t* fed = _f_rti->enclaves[i];
+            lf_print("RTI: Waiting for thread handling federate %d.", fed->enclave.id);
+            lf_thread_join(fed->thread_id, &thread_exit_status);
+            free_in_transit_message_q(fed->in_transit_message_tags);
+            lf_print("RTI: Federate %d thread exited.", fed->enclave.id);
+        }
     }
 
     _f_rti->all_federates_exited = true;
 
+    if (_f_rti->stats_period > 0) {
+        print_rti_stats();
+    }
+
     // Shutdown and close the socket so that the accept() call in
     // respond_to_erroneous_connections returns. That thread should then
     // check _f_rti->all_federates_exited and it should exit.
@@ -1614,7 +2112,7 @@ void usage(int argc, const char* argv[]) {
     lf_print("   The number of federates in the federation that this RTI will control.");
     lf_print("  -p, --port <n>");
     lf_print("   The port number to use for the RTI. Must be larger than 0 and smaller than %d. Default is %d.", UINT16_MAX, STARTING_PORT);
-    lf_print("  -c, --clock_sync [off|init|on] [period <n>] [exchanges-per-interval <n>]");
+    lf_print("  -c, --clock_sync [off|init|on] [period <n>] [exchanges-per-interval <n>] [timestamps [software|hardware]]");
     lf_print("   The status of clock synchronization for this federate.");
     lf_print("       - off: Clock synchronization is off.");
     lf_print("       - init (default): Clock synchronization is done only during startup.");
@@ -1624,8 +2122,23 @@ void usage(int argc, const char* argv[]) {
     lf_print("          (period in nanoseconds, default is 5 msec). Only applies to 'on'.");
     lf_print("       - exchanges-per-interval <n>: Controls the number of messages that are exchanged for each");
     lf_print("          clock sync attempt (default is 10). Applies to 'init' and 'on'.");
+    lf_print("       - timestamps [software|hardware]: Use the times at which the kernel (software, the default)");
+    lf_print("          or the network interface (hardware) received UDP clock sync messages. Only applies to 'on'.");
     lf_print("  -a, --auth Turn on HMAC authentication options.");
     lf_print("  -t, --tracing Turn on tracing.");
+    lf_print("  -l, --listener_threads <n>");
+    lf_print("   Handle messages from all federates on n threads that wait on the sockets");
+    lf_print("   together (using epoll or kqueue). By default, each federate has its own thread.");
+    lf_print("  -g, --grant_ahead");
+    lf_print("   Grant federates tags beyond their next event tags, up to the earliest tag at which");
+    lf_print("   a message can arrive, so that they need fewer round trips to the RTI.");
+    lf_print("  -r, --regions <n,n,...>");
+    lf_print("   Split the federation into regions with the given numbers of federates, numbered");
+    lf_print("   consecutively. Without --region, this RTI is the parent RTI of the regions.");
+    lf_print("  --region <n> --parent <host:port>");
+    lf_print("   Coordinate the federates of region n and connect to the parent RTI at the given address.");
+    lf_print("  -s, --stats <seconds>");
+    lf_print("   Print counts of messages, grant latencies, and lock wait times at the given period.");
 
     lf_print("Command given:");
     for (int i = 0; i < argc; i++) {
@@ -1682,6 +2195,21 @@ int process_clock_sync_args(int argc, const char* argv[]) {
              }
             _f_rti->clock_sync_exchanges_per_interval = (int32_t)exchanges; // FIXME: Loses numbers on 64-bit machines
             lf_print("RTI: Clock sync exchanges per interval: %d", _f_rti->clock_sync_exchanges_per_interval);
+        } else if (strcmp(argv[i], "timestamps") == 0) {
+            if (_f_rti->clock_sync_global_status != clock_sync_on) {
+                lf_print_error("clock sync timestamps can only be used if --clock-sync is set to on.");
+                usage(argc, argv);
+                continue; // Try to parse the rest of the arguments as clock sync args.
+            }
+            _f_rti->clock_sync_timestamps = SOCKET_TIMESTAMPS_SOFTWARE;
+            if (argc >= i + 2 && strcmp(argv[i + 1], "hardware") == 0) {
+                _f_rti->clock_sync_timestamps = SOCKET_TIMESTAMPS_HARDWARE;
+                i++;
+            } else if (argc >= i + 2 && strcmp(argv[i + 1], "software") == 0) {
+                i++;
+            }
+            lf_print("RTI: Clock sync timestamps: %s",
+                    _f_rti->clock_sync_timestamps == SOCKET_TIMESTAMPS_HARDWARE ? "hardware" : "software");
         } else if (strcmp(argv[i], " ") == 0) {
             // Tolerate spaces
             continue;
@@ -1696,6 +2224,8 @@ int process_clock_sync_args(int argc, const char* argv[]) {
 }
 
 int process_args(int argc, const char* argv[]) {
+    long region = -1L;
+    const char* parent = NULL;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--id") == 0) {
             if (argc < i + 2) {
@@ -1758,6 +2288,60 @@ int process_args(int argc, const char* argv[]) {
             _f_rti->authentication_enabled = true;
         } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--tracing") == 0) {
             _f_rti->tracing_enabled = true;
+        } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--listener_threads") == 0) {
+            if (argc < i + 2) {
+                lf_print_error("--listener_threads needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            long threads = strtol(argv[i], NULL, 10);
+            if (threads <= 0L || threads > INT32_MAX) {
+                lf_print_error("--listener_threads needs a valid positive integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            _f_rti->listener_threads = (int32_t)threads;
+            lf_print("RTI: Listener threads: %d", _f_rti->listener_threads);
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--grant_ahead") == 0) {
+            _f_rti->grant_ahead = true;
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--regions") == 0) {
+            if (argc < i + 2 || !set_region_sizes(argv[i + 1])) {
+                lf_print_error("--regions needs a comma-separated list of positive integers.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--region") == 0) {
+            if (argc < i + 2) {
+                lf_print_error("--region needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            region = strtol(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--parent") == 0) {
+            if (argc < i + 2) {
+                lf_print_error("--parent needs a host:port argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            parent = argv[i];
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0) {
+            if (argc < i + 2) {
+                lf_print_error("--stats needs a period in seconds.");
+                usage(argc, argv);
+                return 0;
+            }
+            i++;
+            double period = strtod(argv[i], NULL);
+            if (period <= 0.0 || period > (double)(FOREVER / BILLION)) {
+                lf_print_error("--stats needs a valid positive period in seconds.");
+                usage(argc, argv);
+                return 0;
+            }
+            _f_rti->stats_period = (interval_t)(period * BILLION);
         } else if (strcmp(argv[i], " ") == 0) {
             // Tolerate spaces
             continue;
@@ -1767,6 +2351,16 @@ int process_args(int argc, const char* argv[]) {
            return 0;
        }
     }
+    if ((region >= 0L || parent != NULL)
+            && (parent == NULL || region < 0L || region > INT32_MAX || !set_region((int32_t)region, parent))) {
+        lf_print_error("--region needs a non-negative integer argument and --parent a host:port argument.");
+        usage(argc, argv);
+        return 0;
+    }
+    if (!initialize_regions()) {
+        usage(argc, argv);
+        return 0;
+    }
     if (_f_rti->number_of_enclaves == 0) {
         lf_print_error("--number_of_federates needs a valid positive integer argument.");
         usage(argc, argv);
@@ -1794,7 +2388,11 @@ void initialize_RTI(){
     _f_rti->clock_sync_global_status = clock_sync_init,
     _f_rti->clock_sync_period_ns = MSEC(10),
     _f_rti->clock_sync_exchanges_per_interval = 10,
+    _f_rti->clock_sync_timestamps = SOCKET_TIMESTAMPS_NONE,
     _f_rti->authentication_enabled = false,
     _f_rti->tracing_enabled = false;
     _f_rti->stop_in_progress = false;
+    _f_rti->listener_threads = 0;
+    _f_rti->grant_ahead = false;
+    _f_rti->stats_period = 0LL;
 }
\ No newline at end of file
@@ -30,6 +30,7 @@
 
 #include "lf_types.h"
 #include "message_record/message_record.h"
+#include "socket_poller.h"
 
 /////////////////////////////////////////////
 //// Data structures
@@ -39,6 +40,27 @@ typedef enum socket_type_t {
     UDP
 } socket_type_t;
 
+/**
+ * Number of buckets of the histogram of grant latencies of a federate.
+ * Bucket i counts the latencies less than 2^i microseconds that are not
+ * counted by bucket i - 1, and the last bucket counts all larger latencies.
+ */
+#define GRANT_LATENCY_BUCKETS 20
+
+/**
+ * Statistics about the messages exchanged with a federate. The RTI always counts
+ * messages, which is cheap, but only measures the grant latencies if the
+ * --stats command-line option is given (see print_rti_stats()).
+ */
+typedef struct federate_stats_t {
+    uint64_t messages_received[256];    // Number of messages received from the federate by type.
+    uint64_t bytes_forwarded;           // Number of bytes of tagged messages forwarded to the federate.
+    uint64_t tags_granted;              // Number of TAG messages sent to the federate.
+    uint64_t ptags_granted;             // Number of PTAG messages sent to the federate.
+    instant_t net_received_at;          // Physical time at which the pending NET was received, or NEVER.
+    uint64_t grant_latency[GRANT_LATENCY_BUCKETS];  // Histogram of the times from NETs to grants.
+} federate_stats_t;
+
 /**
  * Information about a federate known to the RTI, including its runtime state,
  * mode of execution, and connectivity with other federates.
@@ -67,6 +89,7 @@ typedef struct federate_t {
                             // RTI has not been informed of the port number.
     struct in_addr server_ip_addr; // Information about the IP address of the socket
                                 // server of the federate.
+    federate_stats_t stats;     // Statistics about the messages exchanged with the federate.
 } federate_t;
 
 /**
@@ -111,6 +134,9 @@ typedef struct federation_rti_t {
     
     // Pointer to a tracing object
     trace_t* trace;
+
+    // Boolean indicating that tags beyond the next event tag may be granted.
+    bool grant_ahead;
     ////////////// Federation only specific attributes //////////////
 
     // Maximum start time seen so far from the federates.
@@ -173,6 +199,12 @@ typedef struct federation_rti_t {
      */
     int32_t clock_sync_exchanges_per_interval;
 
+    /**
+     * Source of the timestamps of the UDP clock sync messages. With timestamps,
+     * T4 is the time at which the kernel or the network interface received T3.
+     */
+    socket_timestamps_t clock_sync_timestamps;
+
     /**
      * Boolean indicating that authentication is enabled.
      */
@@ -182,6 +214,25 @@ typedef struct federation_rti_t {
      * Boolean indicating that a stop request is already in progress.
      */
     bool stop_in_progress;
+
+    /**
+     * The number of threads that handle messages from all federates, as set
+     * by the --listener_threads command-line option, or 0 to have a thread
+     * per federate.
+     */
+    int32_t listener_threads;
+
+    /**
+     * The poller watching the sockets of all federates if listener_threads
+     * is greater than 0.
+     */
+    socket_poller_t poller;
+
+    /**
+     * The period at which statistics are printed, as set by the --stats
+     * command-line option, or 0 if they are not printed.
+     */
+    interval_t stats_period;
 } federation_rti_t;
 
 /**
@@ -224,7 +275,8 @@ int create_server(int32_t specified_port, uint16_t port, socket_type_t socket_ty
  * Will try to see if the RTI can grant new TAG or PTAG messages to any
  * downstream federates based on this new next event tag.
  *
- * This function assumes that the caller is holding the _RTI.rti_mutex.
+ * This function assumes that the caller is holding the mutex of the shard of
+ * the federate (see lock_shard()).
  *
  * @param federate_id The id of the federate that needs to be updated.
  * @param next_event_tag The next event tag for `federate_id`.
@@ -233,13 +285,21 @@ void update_federate_next_event_tag_locked(uint16_t federate_id, tag_t next_even
 
 /**
  * Handle a port absent message being received rom a federate via the RIT.
+ * This is either a MSG_TYPE_PORT_ABSENT or a MSG_TYPE_PORT_ABSENT_BATCH,
+ * which is forwarded to the destination federate as it is.
  *
  * This function assumes the caller does not hold the mutex.
+ *
+ * @param sending_federate The sending federate.
+ * @param buffer A buffer of at least FED_COM_BUFFER_SIZE bytes whose first
+ *  byte is the message type, which has already been read.
  */
 void handle_port_absent_message(federate_t* sending_federate, unsigned char* buffer);
 
 /**
  * Handle a timed message being received from a federate by the RTI to relay to another federate.
+ * This also relays batches of timed messages (MSG_TYPE_TAGGED_MESSAGE_BATCH), whose header
+ * has the same layout.
  *
  * This function assumes the caller does not hold the mutex.
  *
@@ -269,13 +329,26 @@ void handle_next_event_tag(federate_t* fed);
 
 /////////////////// STOP functions ////////////////////
 
+/**
+ * Once the RTI has seen proposed tags from all connected federates,
+ * broadcast a MSG_TYPE_STOP_GRANTED carrying the max_stop_tag and reset
+ * the next event tags of the federates to be no greater than it.
+ *
+ * This function assumes the caller holds rti_mutex and the locks
+ * of all shards (see lock_all_shards()).
+ */
+void _lf_rti_broadcast_stop_time_to_federates_locked();
+
 /**
  * Mark a federate requesting stop.
  *
  * If the number of federates handling stop reaches the
  * NUM_OF_FEDERATES, broadcast MSG_TYPE_STOP_GRANTED to every federate.
+ * A regional RTI reports the stop tag to its parent RTI instead
+ * (see report_stop_to_parent_locked()).
  *
- * This function assumes the _RTI.rti_mutex is already locked.
+ * This function assumes the _RTI.rti_mutex is already locked, as well as
+ * the mutexes of all shards (see lock_all_shards()).
  *
  * @param fed The federate that has requested a stop or has suddenly
  *  stopped (disconnected).
@@ -334,6 +407,8 @@ void handle_address_ad(uint16_t federate_id);
 
 /**
  * A function to handle timestamp messages.
+ * Once every federate has proposed a start time, this sends the start time
+ * to all of them. Before that, it returns without waiting.
  * This function assumes the caller does not hold the mutex.
  */
 void handle_timestamp(federate_t *my_fed);
@@ -360,10 +435,15 @@ void send_physical_clock(unsigned char message_type, federate_t* fed, socket_typ
  * used by the federate to decide whether to discard this
  * clock synchronization round.
  *
+ * If the time at which T3 was received is given, from a timestamp of the
+ * kernel or of the network interface, then it is sent as T4, and the time
+ * sent with the coded probe is shifted accordingly.
+ *
  * @param my_fed The sending federate.
  * @param socket_type The RTI's socket type used for the communication (TCP or UDP)
+ * @param t3_received The time at which T3 was received, or NEVER to send the current time.
  */
-void handle_physical_clock_sync_message(federate_t* my_fed, socket_type_t socket_type);
+void handle_physical_clock_sync_message(federate_t* my_fed, socket_type_t socket_type, instant_t t3_received);
 
 /**
  * A (quasi-)periodic thread that performs clock synchronization with each
@@ -413,6 +493,16 @@ void handle_federate_resign(federate_t *my_fed);
  */
 void* federate_thread_TCP(void* fed);
 
+/**
+ * Handle the next message from a federate whose socket is watched by the
+ * poller of the RTI. This is the socket_poller_handler_t counterpart of
+ * federate_thread_TCP().
+ * @param fed A pointer to the federate's struct that has the
+ *  socket descriptor for the federate.
+ * @return true to keep watching the socket, or false once it is closed.
+ */
+bool handle_federate_input(void* fed);
+
 /**
  * Send a MSG_TYPE_REJECT message to the specified socket and close the socket.
  * @param socket_id The socket.
@@ -465,7 +555,10 @@ bool authenticate_federate(int socket);
 /**
  * Wait for one incoming connection request from each federate,
  * and upon receiving it, create a thread to communicate with
- * that federate. Return when all federates have connected.
+ * that federate, or have the poller of the RTI watch its socket
+ * if listener_threads is greater than 0. The handshakes with federates,
+ * which follow the acceptance of their connections, proceed in parallel,
+ * each on its own thread. Return when all federates have connected.
  * @param socket_descriptor The socket on which to accept connections.
  */
 void connect_to_federates(int socket_descriptor);
@@ -499,6 +592,14 @@ int32_t start_rti_server(uint16_t port);
  */
 void wait_for_federates(int socket_descriptor);
 
+/**
+ * Print statistics about the messages exchanged with each federate, the latencies
+ * of tag advance grants, and the time spent waiting for locks, which are kept
+ * if the stats_period of the RTI is positive. The RTI calls this function
+ * periodically and when all federates have exited.
+ */
+void print_rti_stats();
+
 /**
  * Print a usage message.
  */
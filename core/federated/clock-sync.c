@@ -37,16 +37,37 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#if defined(_LF_CLOCK_SYNC_EXTERNAL) && defined(PLATFORM_Linux)
+#include <sys/timex.h>  // Defines ntp_adjtime()
+#endif
 
 #include "platform.h"
 #include "clock-sync.h"
 #include "net_common.h"
 #include "net_util.h"
 #include "util.h"
+#include "trace.h"
+#include "federate.h"
+#include "reactor_common.h"
 
 // Global variables defined in tag.c:
 extern interval_t _lf_time_physical_clock_offset;
 extern interval_t _lf_time_test_physical_clock_offset;
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+// Functions defined in tag.c:
+extern interval_t _lf_physical_clock_offset_at(instant_t unadjusted_time);
+extern void _lf_adjust_physical_clock(interval_t step, interval_t drift);
+extern instant_t _lf_last_reported_unadjusted_physical_time_ns;
+
+/**
+ * The drift of the local clock relative to the clock of the RTI, in nanoseconds
+ * per second, as estimated by the integral term of the drift compensation.
+ */
+static interval_t _lf_clock_sync_drift_estimate = 0LL;
+#endif
+
+// Global variable defined in federate.c:
+extern federate_instance_t _fed;
 
 /**
  * Keep a record of connection statistics
@@ -60,7 +81,9 @@ socket_stat_t _lf_rti_socket_stat = {
     .history = 0LL,
     .network_stat_round_trip_delay_max = 0LL,
     .network_stat_sample_index = 0,
-    .clock_synchronization_error_bound = 0LL
+    .clock_synchronization_error_bound = 0LL,
+    .window_round_trip_delay_max = 0LL,
+    .window_clock_error_sum = 0LL
 };
 
 /**
@@ -69,6 +92,15 @@ socket_stat_t _lf_rti_socket_stat = {
  */
 instant_t _lf_last_clock_sync_instant = 0LL;
 
+/**
+ * The physical time at which the bound on the clock synchronization error,
+ * growing at _LF_CLOCK_SYNC_DRIFT_BOUND from its value at the last synchronization,
+ * would have been zero, or NEVER if the clock has not been synchronized.
+ * Encoding the bound as one instant lets lf_clock_sync_error_bound() read it
+ * without a lock while the clock synchronization thread updates it.
+ */
+static volatile instant_t _lf_clock_sync_error_bound_origin = NEVER;
+
 /**
  * The UDP socket descriptor for this federate to communicate with the RTI.
  * This is set by setup_clock_synchronization_with_rti() in connect_to_rti()
@@ -77,6 +109,14 @@ instant_t _lf_last_clock_sync_instant = 0LL;
  */
 int _lf_rti_socket_UDP = -1;
 
+/**
+ * Whether the kernel or the network interface timestamps the clock sync
+ * messages on _lf_rti_socket_UDP. This is set by setup_clock_synchronization_with_rti()
+ * if _LF_CLOCK_SYNC_KERNEL_TIMESTAMPS or _LF_CLOCK_SYNC_HARDWARE_TIMESTAMPS is defined
+ * and the platform supports it.
+ */
+static bool _lf_rti_socket_UDP_timestamps = false;
+
 #ifdef _LF_CLOCK_SYNC_COLLECT_STATS
 /**
  * Update statistic on the socket based on the newly calculated network delay
@@ -140,6 +180,8 @@ void reset_socket_stat(struct socket_stat_t* socket_stat) {
     socket_stat->received_T4_messages_in_current_sync_window = 0;
     socket_stat->history = 0LL;
     socket_stat->network_stat_sample_index = 0;
+    socket_stat->window_round_trip_delay_max = 0LL;
+    socket_stat->window_clock_error_sum = 0LL;
 }
 
 /**
@@ -153,7 +195,20 @@ void reset_socket_stat(struct socket_stat_t* socket_stat) {
  */
 uint16_t setup_clock_synchronization_with_rti() {
     uint16_t port_to_return = UINT16_MAX;
-#ifdef _LF_CLOCK_SYNC_ON
+#if defined(_LF_CLOCK_SYNC_EXTERNAL)
+    // The clock is disciplined by an external source, such as PTP,
+    // so no clock synchronization is performed with the RTI.
+#if defined(PLATFORM_Linux)
+    struct timex clock_status = {.modes = 0};
+    int clock_state = ntp_adjtime(&clock_status);
+    if (clock_state == TIME_ERROR || (clock_status.status & STA_UNSYNC)) {
+        lf_print_warning("Clock sync: The system clock is not reported as synchronized by an external source.");
+    } else {
+        LF_PRINT_LOG("Clock sync: The system clock is synchronized by an external source "
+                "with an estimated error of %ld usec.", clock_status.esterror);
+    }
+#endif
+#elif defined(_LF_CLOCK_SYNC_ON)
     // Initialize the UDP socket
     _lf_rti_socket_UDP = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     // Initialize the necessary information for the UDP address
@@ -197,6 +252,19 @@ uint16_t setup_clock_synchronization_with_rti() {
     if (setsockopt(_lf_rti_socket_UDP, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout_time, sizeof(timeout_time)) < 0) {
         lf_print_error("Failed to set SO_SNDTIMEO option on the socket: %s.", strerror(errno));
     }
+#if defined(_LF_CLOCK_SYNC_KERNEL_TIMESTAMPS) || defined(_LF_CLOCK_SYNC_HARDWARE_TIMESTAMPS)
+#ifdef _LF_CLOCK_SYNC_HARDWARE_TIMESTAMPS
+    socket_timestamps_t timestamps = SOCKET_TIMESTAMPS_HARDWARE;
+#else
+    socket_timestamps_t timestamps = SOCKET_TIMESTAMPS_SOFTWARE;
+#endif
+    if (enable_socket_timestamps(_lf_rti_socket_UDP, timestamps, true) == 0) {
+        _lf_rti_socket_UDP_timestamps = true;
+    } else {
+        lf_print_warning("Clock sync: Failed to enable timestamps on the UDP socket: %s. "
+                "Using timestamps taken by the federate.", strerror(errno));
+    }
+#endif
 #else // No runtime clock synchronization. Send port -1 or 0 instead.
 #ifdef _LF_CLOCK_SYNC_INITIAL
     port_to_return = 0u;
@@ -221,6 +289,10 @@ uint16_t setup_clock_synchronization_with_rti() {
  * @param rti_socket_TCP The rti's socket
  */
 void synchronize_initial_physical_clock_with_rti(int rti_socket_TCP) {
+#ifdef _LF_CLOCK_SYNC_EXTERNAL
+    // The RTI does not synchronize a clock that is disciplined externally.
+    return;
+#endif
     LF_PRINT_DEBUG("Waiting for initial clock synchronization messages from the RTI.");
 
     size_t message_size = 1 + sizeof(instant_t);
@@ -302,10 +374,44 @@ int handle_T1_clock_sync_message(unsigned char* buffer, int socket, instant_t t2
     // Measure the time _after_ the write on the assumption that the read
     // from the socket, which occurs before this function is called, takes
     // about the same amount of time as the write of the reply.
-    _lf_rti_socket_stat.local_delay = lf_time_physical() - t2;
+    // With timestamps, t2 is when T1 arrived and T3 is when the reply left.
+    instant_t t3;
+    if (socket != _lf_rti_socket_UDP || !_lf_rti_socket_UDP_timestamps
+            || get_transmit_timestamp(socket, &t3) != 0) {
+        t3 = lf_time_physical();
+    }
+    _lf_rti_socket_stat.local_delay = t3 - t2;
     return 0;
 }
 
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+/**
+ * Correct the specified clock error, measured over a synchronization interval
+ * of the specified duration, by changing the rate at which the physical clock
+ * drifts (see _LF_CLOCK_SYNC_PROPORTIONAL_GAIN), or by stepping the clock
+ * if the error exceeds _LF_CLOCK_SYNC_STEP_THRESHOLD.
+ * @param clock_error The average clock error over the interval, positive if
+ *  the local clock is behind the clock of the RTI.
+ * @param interval The duration of the interval.
+ */
+static void compensate_drift(interval_t clock_error, interval_t interval) {
+    if (llabs(clock_error) > _LF_CLOCK_SYNC_STEP_THRESHOLD || interval <= 0LL) {
+        LF_PRINT_LOG("Clock sync: Stepping the clock by " PRINTF_TIME ".", clock_error);
+        _lf_adjust_physical_clock(clock_error, _lf_clock_sync_drift_estimate);
+        return;
+    }
+    // The rate in nanoseconds per second that would correct the error over one interval.
+    interval_t rate = clock_error * BILLION / interval;
+    _lf_clock_sync_drift_estimate = LF_MAX(-CLOCK_SYNC_MAX_DRIFT, LF_MIN(CLOCK_SYNC_MAX_DRIFT,
+            _lf_clock_sync_drift_estimate + rate * _LF_CLOCK_SYNC_INTEGRAL_GAIN / 100));
+    interval_t drift = LF_MAX(-CLOCK_SYNC_MAX_DRIFT, LF_MIN(CLOCK_SYNC_MAX_DRIFT,
+            _lf_clock_sync_drift_estimate + rate * _LF_CLOCK_SYNC_PROPORTIONAL_GAIN / 100));
+    LF_PRINT_DEBUG("Clock sync: Estimated drift " PRINTF_TIME " ns/s. Slewing at " PRINTF_TIME " ns/s.",
+            _lf_clock_sync_drift_estimate, drift);
+    _lf_adjust_physical_clock(0LL, drift);
+}
+#endif
+
 /**
  * Handle a clock synchronization message T4 coming from the RTI.
  * If the socket is _lf_rti_socket_TCP, then assume we are in the
@@ -361,9 +467,8 @@ void handle_T4_clock_sync_message(unsigned char* buffer, int socket, instant_t r
     if (socket == _lf_rti_socket_UDP) {
         // Read the coded probe message.
         // We can reuse the same buffer.
-        ssize_t bytes_read = read_from_socket(socket, 1 + sizeof(instant_t), buffer);
-
-        instant_t r5 = lf_time_physical();
+        instant_t r5;
+        ssize_t bytes_read = receive_timestamped_datagram(socket, 1 + sizeof(instant_t), buffer, NULL, &r5);
 
         if ((bytes_read < 1 + (ssize_t)sizeof(instant_t))
                 || buffer[0] != MSG_TYPE_CLOCK_SYNC_CODED_PROBE) {
@@ -395,11 +500,16 @@ void handle_T4_clock_sync_message(unsigned char* buffer, int socket, instant_t r
             _lf_rti_socket_stat.received_T4_messages_in_current_sync_window--;
             return;
         }
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+        // The drift compensation attenuates the error by its gains.
+        adjustment = estimated_clock_error;
+#else
         // Apply a jitter attenuator to the estimated clock error to prevent
         // large jumps in the underlying clock.
         // Note that estimated_clock_error is calculated using lf_time_physical() which includes
         // the _lf_time_physical_clock_offset adjustment.
         adjustment = estimated_clock_error / _LF_CLOCK_SYNC_ATTENUATION;
+#endif
     } else {
         // Use of TCP socket means we are in the startup phase, so
         // rather than adjust the clock offset, we simply set it to the
@@ -412,6 +522,12 @@ void handle_T4_clock_sync_message(unsigned char* buffer, int socket, instant_t r
     update_socket_stat(&_lf_rti_socket_stat, network_round_trip_delay, estimated_clock_error);
 #endif
 
+    // Keep what bounds the error of the clock once the window is complete.
+    if (_lf_rti_socket_stat.window_round_trip_delay_max < network_round_trip_delay) {
+        _lf_rti_socket_stat.window_round_trip_delay_max = network_round_trip_delay;
+    }
+    _lf_rti_socket_stat.window_clock_error_sum += estimated_clock_error;
+
     // FIXME: Enable alternative regression mechanism here.
     LF_PRINT_DEBUG("Clock sync: Adjusting clock offset running average by " PRINTF_TIME ".",
             adjustment/_LF_CLOCK_SYNC_EXCHANGES_PER_INTERVAL);
@@ -438,7 +554,21 @@ void handle_T4_clock_sync_message(unsigned char* buffer, int socket, instant_t r
         // which means we can now adjust the clock offset.
         // For the AVG algorithm, history is a running average and can be directly
         // applied
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+        if (socket == _lf_rti_socket_UDP) {
+            compensate_drift(_lf_rti_socket_stat.history, r4 - _lf_last_clock_sync_instant);
+        } else {
+            _lf_time_physical_clock_offset += _lf_rti_socket_stat.history;
+        }
+        // The current offset, which is what tools merging traces need.
+        interval_t offset = _lf_physical_clock_offset_at(_lf_last_reported_unadjusted_physical_time_ns);
+#else
         _lf_time_physical_clock_offset += _lf_rti_socket_stat.history;
+        interval_t offset = _lf_time_physical_clock_offset;
+#endif
+        // Record the new offset so that tools merging the traces of the federation
+        // can line up the physical times of this federate with those of the RTI.
+        tracepoint_federate_clock_sync(_fed.trace, _lf_my_fed_id, offset);
         // @note AVG and SD will be zero if collect-stats is set to false
         LF_PRINT_LOG("Clock sync:"
                     " New offset: " PRINTF_TIME "."
@@ -447,12 +577,23 @@ void handle_T4_clock_sync_message(unsigned char* buffer, int socket, instant_t r
                     " (SD): " PRINTF_TIME "."
                     " Local round trip delay: " PRINTF_TIME "."
                     " Test offset: " PRINTF_TIME ".",
-                    _lf_time_physical_clock_offset,
+                    offset,
                     network_round_trip_delay,
                     stats.average,
                     stats.standard_deviation,
                     _lf_rti_socket_stat.local_delay,
                     _lf_time_test_physical_clock_offset);
+        // Each estimate of the clock error is off by at most half its round trip delay,
+        // the difference between the delays in either direction. At runtime, only part
+        // of the average estimate has been corrected.
+        interval_t error_bound = _lf_rti_socket_stat.window_round_trip_delay_max / 2;
+        if (socket == _lf_rti_socket_UDP) {
+            error_bound += llabs(_lf_rti_socket_stat.window_clock_error_sum / _LF_CLOCK_SYNC_EXCHANGES_PER_INTERVAL);
+        }
+        _lf_clock_sync_error_bound_origin = r4
+                - (error_bound / _LF_CLOCK_SYNC_DRIFT_BOUND) * BILLION
+                - (error_bound % _LF_CLOCK_SYNC_DRIFT_BOUND) * BILLION / _LF_CLOCK_SYNC_DRIFT_BOUND;
+        LF_PRINT_DEBUG("Clock sync: Clock error bound: " PRINTF_TIME ".", error_bound);
         // Reset the stats
         reset_socket_stat(&_lf_rti_socket_stat);
         // Set the last instant at which the clocks were synchronized
@@ -480,25 +621,17 @@ void* listen_to_rti_UDP_thread(void* args) {
         struct sockaddr_in RTI_UDP_addr;
         socklen_t RTI_UDP_addr_length = sizeof(RTI_UDP_addr);
         ssize_t bytes_read = 0;
-        // Read from the UDP socket
+        // The time of reception, given by the kernel or the network interface
+        // if timestamps are enabled and taken right after the read otherwise.
+        instant_t receive_time;
+        // Read from the UDP socket, recording the RTI's address.
+        // Try reading again if errno indicates the need to try again.
         do {
-            ssize_t bytes = recvfrom(_lf_rti_socket_UDP,                    // The UDP socket
-                                    &buffer[bytes_read],                // The buffer to read into
-                                    message_size - (size_t)bytes_read,  // Number of bytes to read
-                                    MSG_WAITALL,                        // Read the entire datagram
-                                    (struct sockaddr*)&RTI_UDP_addr,    // Record the RTI's address
-                                    &RTI_UDP_addr_length);              // The RTI's address length
-            // Try reading again if errno indicates the need to try again and there are more
-            // bytes to read.
-            if (bytes > 0) {
-                bytes_read += bytes;
-            }
-        } while ((errno == EAGAIN || errno == EWOULDBLOCK) && bytes_read < message_size);
+            bytes_read = receive_timestamped_datagram(_lf_rti_socket_UDP, message_size, buffer,
+                    &RTI_UDP_addr, &receive_time);
+        } while (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
 
-        // Get local physical time before doing anything else.
-        instant_t receive_time = lf_time_physical();
-
-        if (bytes_read < message_size) {
+        if (bytes_read < (ssize_t)message_size) {
             // Either the socket has closed or the RTI has sent EOF.
             // Exit the thread to halt clock synchronization.
             lf_print_error("Clock sync: UDP socket to RTI is broken: %s. Clock sync is now disabled.",
@@ -566,10 +699,49 @@ void* listen_to_rti_UDP_thread(void* args) {
  * \ingroup agroup
  */
 int create_clock_sync_thread(lf_thread_t* thread_id) {
-#ifdef _LF_CLOCK_SYNC_ON
+#if defined(_LF_CLOCK_SYNC_ON) && !defined(_LF_CLOCK_SYNC_EXTERNAL)
     // One for UDP messages if clock synchronization is enabled for this federate
     return lf_thread_create(thread_id, listen_to_rti_UDP_thread, NULL);
 #endif // _LF_CLOCK_SYNC_ON
     return 0;
 }
+
+interval_t lf_clock_sync_error_bound() {
+#if defined(_LF_CLOCK_SYNC_EXTERNAL)
+#if defined(PLATFORM_Linux)
+    struct timex clock_status = {.modes = 0};
+    int clock_state = ntp_adjtime(&clock_status);
+    if (clock_state != TIME_ERROR && !(clock_status.status & STA_UNSYNC)) {
+        return USEC(clock_status.maxerror);
+    }
+#endif
+    return FOREVER;
+#else
+    instant_t origin = _lf_clock_sync_error_bound_origin;
+    if (origin == NEVER) {
+        return FOREVER;
+    }
+    interval_t elapsed = lf_time_physical() - origin;
+    return (elapsed / BILLION) * _LF_CLOCK_SYNC_DRIFT_BOUND
+            + (elapsed % BILLION) * _LF_CLOCK_SYNC_DRIFT_BOUND / BILLION;
+#endif
+}
+
+interval_t _lf_adaptive_STA_offset() {
+#ifdef _LF_CLOCK_SYNC_ADAPTIVE_STP
+    interval_t allowance = _LF_CLOCK_SYNC_ADAPTIVE_STP;
+    if (allowance > _lf_fed_STA_offset) {
+        allowance = _lf_fed_STA_offset;
+    }
+    // The clocks of a sender and this federate differ by up to the sum of their errors,
+    // and the sender is assumed to be synchronized no worse than this federate.
+    interval_t error_bound = lf_clock_sync_error_bound();
+    if (error_bound >= allowance / 2) {
+        return _lf_fed_STA_offset;
+    }
+    return _lf_fed_STA_offset - allowance + 2 * error_bound;
+#else
+    return _lf_fed_STA_offset;
+#endif
+}
 #endif
@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+ * @section DESCRIPTION
+ * Compression of the bodies of messages between federates.
+ * See compression.h for an overview.
+ */
+
+#ifdef FEDERATED
+#include <limits.h>
+
+#include "compression.h"
+
+#ifdef FEDERATED_COMPRESSION_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef FEDERATED_COMPRESSION_ZSTD
+#include <zstd.h>
+#endif
+
+uint8_t compression_supported(void) {
+    uint8_t result = 0;
+#ifdef FEDERATED_COMPRESSION_LZ4
+    result |= COMPRESSION_LZ4;
+#endif
+#ifdef FEDERATED_COMPRESSION_ZSTD
+    result |= COMPRESSION_ZSTD;
+#endif
+    return result;
+}
+
+compression_t compression_choose(uint8_t offered) {
+    uint8_t common = offered & compression_supported();
+    // zstd compresses better, which matters more on the slow links where
+    // compression pays off at all.
+    if (common & COMPRESSION_ZSTD) return COMPRESSION_ZSTD;
+    if (common & COMPRESSION_LZ4) return COMPRESSION_LZ4;
+    return COMPRESSION_NONE;
+}
+
+const char* compression_name(compression_t algorithm) {
+    switch (algorithm) {
+        case COMPRESSION_LZ4: return "LZ4";
+        case COMPRESSION_ZSTD: return "zstd";
+        default: return "no compression";
+    }
+}
+
+size_t compression_bound(compression_t algorithm, size_t length) {
+    switch (algorithm) {
+#ifdef FEDERATED_COMPRESSION_LZ4
+        case COMPRESSION_LZ4:
+            if (length > LZ4_MAX_INPUT_SIZE) return 0;
+            return (size_t)LZ4_compressBound((int)length);
+#endif
+#ifdef FEDERATED_COMPRESSION_ZSTD
+        case COMPRESSION_ZSTD:
+            return ZSTD_compressBound(length);
+#endif
+        default:
+            return 0;
+    }
+}
+
+size_t compression_compress(
+        compression_t algorithm,
+        size_t length,
+        const unsigned char* body,
+        size_t capacity,
+        unsigned char* destination) {
+    switch (algorithm) {
+#ifdef FEDERATED_COMPRESSION_LZ4
+        case COMPRESSION_LZ4: {
+            if (length > LZ4_MAX_INPUT_SIZE) return 0;
+            int limit = (capacity > INT_MAX) ? INT_MAX : (int)capacity;
+            int result;
+            if (FEDERATED_COMPRESSION_LEVEL > 0) {
+                result = LZ4_compress_HC((const char*)body, (char*)destination, (int)length, limit,
+                        FEDERATED_COMPRESSION_LEVEL);
+            } else {
+                result = LZ4_compress_default((const char*)body, (char*)destination, (int)length, limit);
+            }
+            return (result > 0) ? (size_t)result : 0;
+        }
+#endif
+#ifdef FEDERATED_COMPRESSION_ZSTD
+        case COMPRESSION_ZSTD: {
+            size_t result = ZSTD_compress(destination, capacity, body, length, FEDERATED_COMPRESSION_LEVEL);
+            return ZSTD_isError(result) ? 0 : result;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+int compression_decompress(
+        compression_t algorithm,
+        size_t length,
+        const unsigned char* compressed,
+        size_t original_length,
+        unsigned char* destination) {
+    switch (algorithm) {
+#ifdef FEDERATED_COMPRESSION_LZ4
+        case COMPRESSION_LZ4: {
+            if (length > INT_MAX || original_length > INT_MAX) return -1;
+            int result = LZ4_decompress_safe((const char*)compressed, (char*)destination,
+                    (int)length, (int)original_length);
+            return (result >= 0 && (size_t)result == original_length) ? 0 : -1;
+        }
+#endif
+#ifdef FEDERATED_COMPRESSION_ZSTD
+        case COMPRESSION_ZSTD: {
+            size_t result = ZSTD_decompress(destination, original_length, compressed, length);
+            return (!ZSTD_isError(result) && result == original_length) ? 0 : -1;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+#endif // FEDERATED
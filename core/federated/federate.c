@@ -53,15 +53,21 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>     // Defines read(), write(), and close()
 
 #include "clock-sync.h"
+#include "compression.h"
 #include "federate.h"
 #include "lf_types.h"
 #include "net_common.h"
 #include "net_util.h"
+#include "outbound_queue.h"
 #include "platform.h"
+#include "rdma_transport.h"
 #include "reactor.h"
 #include "reactor_common.h"
 #include "reactor_threaded.h"
+#include "replay.h"
 #include "scheduler.h"
+#include "probes.h"
+#include "shm_ring.h"
 #include "trace.h"
 #ifdef FEDERATED_AUTHENTICATED
 #include <openssl/rand.h> // For secure random number generation.
@@ -76,7 +82,9 @@ extern instant_t start_time;
 char* ERROR_SENDING_HEADER = "ERROR sending header information to federate via RTI";
 char* ERROR_SENDING_MESSAGE = "ERROR sending message to federate via RTI";
 
-// Mutex lock held while performing socket write and close operations.
+// Mutex lock held while closing outbound sockets and while checking or setting
+// whether a stop request has been received from the RTI. Sends do not hold it;
+// they go through the outbound queue of the destination (see outbound_queue.h).
 lf_mutex_t outbound_socket_mutex;
 lf_cond_t port_status_changed;
 lf_cond_t logical_time_changed;
@@ -97,6 +105,8 @@ federate_instance_t _fed = {
         .inbound_p2p_handling_thread_id = 0,
         .server_socket = -1,
         .server_port = -1,
+        .udp_socket_for_inbound_datagrams = -1,
+        .udp_socket_for_outbound_datagrams = -1,
         .last_TAG = {.time = NEVER, .microstep = 0u},
         .is_last_TAG_provisional = false,
         .has_upstream = false,
@@ -115,6 +125,30 @@ federation_metadata_t federation_metadata = {
     .rti_user = NULL
 };
 
+/**
+ * Give the specified network thread the real-time priority requested with the
+ * --net-priority command-line option, if any. Failure is not fatal because the
+ * process may lack the privilege to use real-time scheduling policies.
+ * @param thread The thread that handles network communication.
+ * @param name A description of the thread for the warning on failure.
+ */
+static void _lf_set_network_thread_priority(lf_thread_t thread, const char* name) {
+    if (_lf_network_thread_priority < 0) {
+        return;
+    }
+    lf_scheduling_policy_t policy = {
+        .policy = LF_SCHED_PRIORITY,
+        .priority = _lf_network_thread_priority
+    };
+    if (lf_thread_set_scheduling_policy(thread, &policy) != 0) {
+        lf_print_warning("Failed to set the priority of the %s thread to %d.",
+                name, _lf_network_thread_priority);
+    }
+}
+
+#ifdef FEDERATED_UDP_PHYSICAL
+static void open_datagram_listener(void);
+#endif
 
 /**
  * Create a server to listen to incoming physical
@@ -136,7 +170,8 @@ federation_metadata_t federation_metadata = {
  * However, it contains specific log messages for the peer to
  * peer connections between federates. It also additionally
  * sends an address advertisement (MSG_TYPE_ADDRESS_ADVERTISEMENT) message to the
- * RTI informing it of the port.
+ * RTI informing it of the port. With FEDERATED_UDP_PHYSICAL, it also opens the
+ * UDP socket on which messages of physical connections arrive as datagrams.
  *
  * @param specified_port The specified port by the user.
  */
@@ -220,12 +255,113 @@ void create_server(int specified_port) {
 
     // Set the global server socket
     _fed.server_socket = socket_descriptor;
+#ifdef FEDERATED_UDP_PHYSICAL
+    open_datagram_listener();
+#endif
+}
+
+/**
+ * Queue the given P2P message for the given federate with its body compressed
+ * (see MSG_TYPE_P2P_COMPRESSED_MESSAGE), if the federate has agreed to an
+ * algorithm, the body is at least FEDERATED_COMPRESSION_THRESHOLD bytes long,
+ * and compression makes it smaller.
+ * @param queue The queue of the federate.
+ * @param federate The ID of the federate.
+ * @param header_length The length of the header of the message.
+ * @param header The header of a MSG_TYPE_P2P_MESSAGE or MSG_TYPE_P2P_TAGGED_MESSAGE.
+ * @param length The length of the body.
+ * @param body The body.
+ * @param tag The tag of the message, or NULL if it has none.
+ * @param result Where to put the result of outbound_queue_send().
+ * @return true if the message was queued, false if the caller should queue
+ *  it uncompressed.
+ */
+static bool send_compressed_message(
+        outbound_queue_t* queue,
+        unsigned short federate,
+        size_t header_length,
+        unsigned char* header,
+        size_t length,
+        unsigned char* body,
+        tag_t* tag,
+        int* result) {
+    compression_t algorithm = _fed.compression_for_p2p_connections[federate];
+    if (algorithm == COMPRESSION_NONE || length < FEDERATED_COMPRESSION_THRESHOLD || length > INT32_MAX) {
+        return false;
+    }
+    size_t capacity = compression_bound(algorithm, length);
+    unsigned char* compressed = (capacity > 0) ? (unsigned char*)malloc(capacity) : NULL;
+    if (compressed == NULL) return false;
+    tracepoint_federate_compression(_fed.trace, compression_starts, _lf_my_fed_id, federate, tag, length);
+    size_t compressed_length = compression_compress(algorithm, length, body, capacity, compressed);
+    tracepoint_federate_compression(_fed.trace, compression_ends, _lf_my_fed_id, federate, tag, compressed_length);
+    if (compressed_length == 0 || compressed_length >= length) {
+        free(compressed);
+        return false;
+    }
+    // The compressed message is the original one with its length field
+    // replaced, preceded by the algorithm and the original length.
+    size_t prefix_length = MSG_TYPE_P2P_COMPRESSED_MESSAGE_HEADER_SIZE;
+    unsigned char compressed_header[prefix_length + header_length];
+    compressed_header[0] = MSG_TYPE_P2P_COMPRESSED_MESSAGE;
+    compressed_header[1] = (unsigned char)algorithm;
+    encode_int32((int32_t)length, &compressed_header[2]);
+    memcpy(&compressed_header[prefix_length], header, header_length);
+    encode_int32((int32_t)compressed_length,
+            &compressed_header[prefix_length + 1 + sizeof(uint16_t) + sizeof(uint16_t)]);
+    *result = outbound_queue_send(queue, sizeof(compressed_header), compressed_header,
+            compressed_length, compressed);
+    free(compressed);
+    return true;
 }
 
+#ifdef FEDERATED_UDP_PHYSICAL
+/**
+ * Send the given message of a physical connection as a UDP datagram (see
+ * MSG_TYPE_P2P_DATAGRAM), if the destination federate has accepted
+ * MSG_TYPE_P2P_UDP and the datagram is at most FEDERATED_UDP_MAX_DATAGRAM
+ * bytes long. Unlike the socket, this does not wait for the network, and a
+ * datagram that is lost is not sent again.
+ * @param port The ID of the destination port.
+ * @param federate The ID of the destination federate.
+ * @param length The length of the message.
+ * @param message The message.
+ * @return true if the datagram has been sent, false if the message is to go
+ *  through the socket instead.
+ */
+static bool send_datagram(unsigned short port, unsigned short federate, size_t length, unsigned char* message) {
+    struct sockaddr_in* address = &_fed.udp_addresses_for_p2p_connections[federate];
+    if (address->sin_port == 0 || length > FEDERATED_UDP_MAX_DATAGRAM - MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE) {
+        return false;
+    }
+    unsigned char datagram[FEDERATED_UDP_MAX_DATAGRAM];
+    datagram[0] = MSG_TYPE_P2P_DATAGRAM;
+    encode_uint16((uint16_t)_lf_my_fed_id, &datagram[1]);
+    encode_uint16(port, &datagram[1 + sizeof(uint16_t)]);
+    encode_uint16(federate, &datagram[1 + 2 * sizeof(uint16_t)]);
+    encode_uint32(lf_atomic_add_fetch(&_fed.udp_sequence_numbers[federate], 1),
+            &datagram[1 + 3 * sizeof(uint16_t)]);
+    encode_int32((int32_t)length, &datagram[1 + 3 * sizeof(uint16_t) + sizeof(uint32_t)]);
+    memcpy(&datagram[MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE], message, length);
+    ssize_t sent = sendto(_fed.udp_socket_for_outbound_datagrams, datagram,
+            MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE + length, 0, (struct sockaddr*)address, sizeof(*address));
+    if (sent < 0) {
+        lf_print_warning("Failed to send a datagram to federate %d: %s. Sending the message through the socket.",
+                federate, strerror(errno));
+        return false;
+    }
+    return true;
+}
+#endif // FEDERATED_UDP_PHYSICAL
+
 /**
  * Send a message to another federate directly or via the RTI.
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
- * which it acquires to perform the send.
+ * The message is copied into the outbound queue of the destination and
+ * written by that queue's writer thread, so this does not wait for the network
+ * unless the queue is full. A large message sent directly to a federate may
+ * have its body compressed first (see send_compressed_message()). With
+ * FEDERATED_UDP_PHYSICAL, a message small enough to fit in a datagram is
+ * instead sent as one to a federate that accepts it (see send_datagram()).
  *
  * If the socket connection to the remote federate or the RTI has been broken,
  * then this returns 0 without sending. Otherwise, it returns 1.
@@ -279,20 +415,10 @@ int send_message(int message_type,
 
     // Header:  message_type + port_id + federate_id + length of message + timestamp + microstep
     const int header_length = 1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t);
-    // Use a mutex lock to prevent multiple threads from simultaneously sending.
-    lf_mutex_lock(&outbound_socket_mutex);
-    // First, check that the socket is still connected. This must done
-    // while holding the mutex lock.
-    int socket = -1;
+    // Queue the message for the destination without waiting for the network.
+    outbound_queue_t* queue = &_fed.outbound_queue_to_RTI;
     if (message_type == MSG_TYPE_P2P_MESSAGE) {
-        socket = _fed.sockets_for_outbound_p2p_connections[federate];
-    } else {
-        socket = _fed.socket_TCP_RTI;
-    }
-    if (socket < 0) {
-        lf_print_warning("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
-        return 0;
+        queue = &_fed.outbound_queues_for_p2p_connections[federate];
     }
     // Trace the event when tracing is enabled
     if (message_type == MSG_TYPE_P2P_MESSAGE) {
@@ -300,59 +426,46 @@ int send_message(int message_type,
     } else { // message_type == MSG_TYPE_MESSAGE)
         tracepoint_federate_to_rti(_fed.trace, send_MSG, _lf_my_fed_id, NULL);
     }
-    write_to_socket_with_mutex(socket, header_length, header_buffer, &outbound_socket_mutex,
-            "Failed to send message header to to %s.", next_destination_str);
-    write_to_socket_with_mutex(socket, length, message, &outbound_socket_mutex,
-            "Failed to send message body to to %s.", next_destination_str);
-    lf_mutex_unlock(&outbound_socket_mutex);
-    return 1;
+    LF_PROBE5(federate_send, message_type, message_type == MSG_TYPE_P2P_MESSAGE ? (int)federate : -1,
+            length, NEVER, 0u);
+#ifdef FEDERATED_UDP_PHYSICAL
+    if (message_type == MSG_TYPE_P2P_MESSAGE && send_datagram(port, federate, length, message)) {
+        return 1;
+    }
+#endif
+    int result;
+    if (message_type != MSG_TYPE_P2P_MESSAGE
+            || !send_compressed_message(queue, federate, header_length, header_buffer, length, message, NULL, &result)) {
+        result = outbound_queue_send(queue, header_length, header_buffer, length, message);
+    }
+    if (result == 0) {
+        lf_print_warning("Socket is no longer connected. Dropping message.");
+    } else if (result < 0) {
+        lf_print_error("Failed to send message to %s.", next_destination_str);
+    }
+    return (result > 0) ? 1 : 0;
 }
 
 /**
- * Send the specified timestamped message to the specified port in the
- * specified federate via the RTI or directly to a federate depending on
- * the given socket. The timestamp is calculated as current_logical_time +
- * additional delay which is greater than or equal to zero.
- * The port should be an input port of a reactor in
- * the destination federate. This version does include the timestamp
- * in the message. The caller can reuse or free the memory after this returns.
- *
- * If the socket connection to the remote federate or the RTI has been broken,
- * then this returns 0 without sending. Otherwise, it returns 1.
- *
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
- * which it acquires to perform the send.
- *
- * @note This function is similar to send_message() except that it
- *   sends timed messages and also contains logics related to time.
- *
- * @param env The environment of the federate
- * @param additional_delay The offset applied to the timestamp
- *  using after. The additional delay will be greater or equal to zero
- *  if an after is used on the connection. If no after is given in the
- *  program, -1 is passed.
- * @param message_type The type of the message being sent.
- *  Currently can be MSG_TYPE_TAGGED_MESSAGE for messages sent via
- *  RTI or MSG_TYPE_P2P_TAGGED_MESSAGE for messages sent between
- *  federates.
- * @param port The ID of the destination port.
- * @param federate The ID of the destination federate.
- * @param next_destination_str The next destination in string format (RTI or federate)
- *  (used for reporting errors).
- * @param length The message length.
- * @param message The message.
- * @return 1 if the message has been sent, 0 otherwise.
+ * Send the timestamped message whose body is made of the given segments,
+ * as send_timed_message() does (see send_timed_value()).
+ * @param count The number of segments of the body, which may be 0.
+ * @param segments The segments of the body, in order.
  */
-int send_timed_message(environment_t* env,
+static int send_timed_message_segments(environment_t* env,
                         interval_t additional_delay,
                         int message_type,
                         unsigned short port,
                         unsigned short federate,
                         const char* next_destination_str,
-                        size_t length,
-                        unsigned char* message) {
+                        int count,
+                        const struct iovec* segments) {
     assert(env != GLOBAL_ENVIRONMENT);
 
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += segments[i].iov_len;
+    }
     unsigned char header_buffer[1 + sizeof(uint16_t) + sizeof(uint16_t)
              + sizeof(int32_t) + sizeof(instant_t) + sizeof(microstep_t)];
     // First byte identifies this as a timed message.
@@ -365,6 +478,15 @@ int send_timed_message(environment_t* env,
         );
         return 0;
     }
+    if (FEDERATED_MIN_OUTPUT_DELAY > 0LL && additional_delay < FEDERATED_MIN_OUTPUT_DELAY) {
+        // The RTI may already have granted the destination a tag beyond
+        // the tag of this message.
+        lf_print_error_and_exit(
+            "Federate %d sent a message to %s with a delay of " PRINTF_TIME
+            ", which is less than its declared minimum output delay of " PRINTF_TIME ".",
+            _lf_my_fed_id, next_destination_str, additional_delay, (interval_t)FEDERATED_MIN_OUTPUT_DELAY
+        );
+    }
     size_t buffer_head = 0;
     header_buffer[buffer_head] = (unsigned char)message_type;
     buffer_head += sizeof(unsigned char);
@@ -383,7 +505,7 @@ int send_timed_message(environment_t* env,
 
     // Apply the additional delay to the current tag and use that as the intended
     // tag of the outgoing message
-    tag_t current_message_intended_tag = lf_delay_tag(env->current_tag,
+    tag_t current_message_intended_tag = _lf_delay_tag(env->current_tag,
                                                     additional_delay);
 
     // Next 8 + 4 will be the tag (timestamp, microstep)
@@ -405,20 +527,10 @@ int send_timed_message(environment_t* env,
         return 0;
     }
 
-    // Use a mutex lock to prevent multiple threads from simultaneously sending.
-    lf_mutex_lock(&outbound_socket_mutex);
-    // First, check that the socket is still connected. This must done
-    // while holding the mutex lock.
-    int socket = -1;
+    // Queue the message for the destination without waiting for the network.
+    outbound_queue_t* queue = &_fed.outbound_queue_to_RTI;
     if (message_type == MSG_TYPE_P2P_TAGGED_MESSAGE) {
-        socket = _fed.sockets_for_outbound_p2p_connections[federate];
-    } else {
-        socket = _fed.socket_TCP_RTI;
-    }
-    if (socket < 0) {
-        lf_print_warning("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
-        return 0;
+        queue = &_fed.outbound_queues_for_p2p_connections[federate];
     }
     // Trace the event when tracing is enabled
     if (message_type == MSG_TYPE_TAGGED_MESSAGE) {
@@ -426,12 +538,126 @@ int send_timed_message(environment_t* env,
     } else { // message_type == MSG_TYPE_P2P_TAGGED_MESSAGE
         tracepoint_federate_to_federate(_fed.trace, send_P2P_TAGGED_MSG, _lf_my_fed_id, federate, &current_message_intended_tag);
     }
-    write_to_socket_with_mutex(socket, header_length, header_buffer, &outbound_socket_mutex,
-            "Failed to send timed message header to %s.", next_destination_str);
-    write_to_socket_with_mutex(socket, length, message, &outbound_socket_mutex,
-            "Failed to send timed message body to %s.", next_destination_str);
-    lf_mutex_unlock(&outbound_socket_mutex);
-    return 1;
+    LF_PROBE5(federate_send, message_type, message_type == MSG_TYPE_P2P_TAGGED_MESSAGE ? (int)federate : -1,
+            length, current_message_intended_tag.time, current_message_intended_tag.microstep);
+    int result;
+    bool compressed = false;
+    if (message_type == MSG_TYPE_P2P_TAGGED_MESSAGE
+            && _fed.compression_for_p2p_connections[federate] != COMPRESSION_NONE
+            && length >= FEDERATED_COMPRESSION_THRESHOLD) {
+        // Compression needs the body in a single buffer.
+        unsigned char* body = (count == 1) ? (unsigned char*)segments[0].iov_base : NULL;
+        if (count > 1 && (body = (unsigned char*)malloc(length)) != NULL) {
+            size_t offset = 0;
+            for (int i = 0; i < count; i++) {
+                memcpy(body + offset, segments[i].iov_base, segments[i].iov_len);
+                offset += segments[i].iov_len;
+            }
+        }
+        if (body != NULL) {
+            compressed = send_compressed_message(queue, federate, header_length, header_buffer, length, body,
+                    &current_message_intended_tag, &result);
+            if (count > 1) free(body);
+        }
+    }
+    if (compressed) {
+        // Queued with its body compressed.
+    }
+#ifdef FEDERATED_BATCH_MESSAGES
+    else if (length < OUTBOUND_QUEUE_MAX_BATCH) {
+        // Pack the message with the others sent to the same federate at the same tag.
+        // The batch is written at the end of the tag, or earlier if it fills up.
+        unsigned char batch_header[sizeof(header_buffer)];
+        memcpy(batch_header, header_buffer, header_length);
+        batch_header[0] = (message_type == MSG_TYPE_TAGGED_MESSAGE) ?
+                MSG_TYPE_TAGGED_MESSAGE_BATCH : MSG_TYPE_P2P_TAGGED_MESSAGE_BATCH;
+        encode_uint16(0, &(batch_header[1]));
+        unsigned char entry_header[sizeof(uint16_t) + sizeof(int32_t)];
+        encode_uint16(port, entry_header);
+        encode_int32((int32_t)length, &(entry_header[sizeof(uint16_t)]));
+        result = outbound_queue_send_batched(queue, header_length, batch_header,
+                1 + sizeof(uint16_t) + sizeof(uint16_t),
+                sizeof(entry_header), entry_header, count, segments);
+    }
+#endif // FEDERATED_BATCH_MESSAGES
+    else {
+        result = outbound_queue_sendv(queue, header_length, header_buffer, count, segments);
+    }
+    if (result == 0) {
+        lf_print_warning("Socket is no longer connected. Dropping message.");
+    } else if (result < 0) {
+        lf_print_error("Failed to send timed message to %s.", next_destination_str);
+    }
+    return (result > 0) ? 1 : 0;
+}
+
+/**
+ * Send the specified timestamped message to the specified port in the
+ * specified federate via the RTI or directly to a federate depending on
+ * the given socket. The timestamp is calculated as current_logical_time +
+ * additional delay which is greater than or equal to zero.
+ * The port should be an input port of a reactor in
+ * the destination federate. This version does include the timestamp
+ * in the message. The caller can reuse or free the memory after this returns.
+ *
+ * If the socket connection to the remote federate or the RTI has been broken,
+ * then this returns 0 without sending. Otherwise, it returns 1.
+ *
+ * The message is copied into the outbound queue of the destination and
+ * written by that queue's writer thread, so this does not wait for the network
+ * unless the queue is full. A large message sent directly to a federate may
+ * have its body compressed first (see send_compressed_message()).
+ *
+ * @note This function is similar to send_message() except that it
+ *   sends timed messages and also contains logics related to time.
+ *
+ * @param env The environment of the federate
+ * @param additional_delay The offset applied to the timestamp
+ *  using after. The additional delay will be greater or equal to zero
+ *  if an after is used on the connection. If no after is given in the
+ *  program, -1 is passed.
+ * @param message_type The type of the message being sent.
+ *  Currently can be MSG_TYPE_TAGGED_MESSAGE for messages sent via
+ *  RTI or MSG_TYPE_P2P_TAGGED_MESSAGE for messages sent between
+ *  federates.
+ * @param port The ID of the destination port.
+ * @param federate The ID of the destination federate.
+ * @param next_destination_str The next destination in string format (RTI or federate)
+ *  (used for reporting errors).
+ * @param length The message length.
+ * @param message The message.
+ * @return 1 if the message has been sent, 0 otherwise.
+ */
+int send_timed_message(environment_t* env,
+                        interval_t additional_delay,
+                        int message_type,
+                        unsigned short port,
+                        unsigned short federate,
+                        const char* next_destination_str,
+                        size_t length,
+                        unsigned char* message) {
+    struct iovec segment = { .iov_base = message, .iov_len = length };
+    return send_timed_message_segments(env, additional_delay, message_type, port, federate,
+            next_destination_str, (length > 0) ? 1 : 0, &segment);
+}
+
+int send_timed_value(environment_t* env,
+                        interval_t additional_delay,
+                        int message_type,
+                        unsigned short port,
+                        unsigned short federate,
+                        const char* next_destination_str,
+                        const lf_port_serializer_t* serializer,
+                        void* value) {
+    struct iovec segments[FEDERATED_MAX_SEGMENTS];
+    int count = serializer->gather(value, segments, FEDERATED_MAX_SEGMENTS);
+    if (count < 0 || count > FEDERATED_MAX_SEGMENTS) {
+        lf_print_error("The value sent to %s has more than FEDERATED_MAX_SEGMENTS (%d) segments.",
+                next_destination_str, FEDERATED_MAX_SEGMENTS);
+        return 0;
+    }
+    return send_timed_message_segments(env, additional_delay, message_type, port, federate,
+            next_destination_str, count, segments);
 }
 
 /**
@@ -449,19 +675,16 @@ void _lf_send_time(unsigned char type, instant_t time, bool exit_on_error) {
     unsigned char buffer[bytes_to_write];
     buffer[0] = type;
     encode_int64(time, &(buffer[1]));
-    lf_mutex_lock(&outbound_socket_mutex);
-    if (_fed.socket_TCP_RTI < 0) {
-        lf_print_warning("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
-        return;
-    }
 
     tag_t tag = {.time = time, .microstep = 0};
     // Trace the event when tracing is enabled
     tracepoint_federate_to_rti(_fed.trace, send_TIMESTAMP, _lf_my_fed_id, &tag);
 
-    ssize_t bytes_written = write_to_socket(_fed.socket_TCP_RTI, bytes_to_write, buffer);
-    if (bytes_written < (ssize_t)bytes_to_write) {
+    // A failed write to the RTI is reported by the first send after it.
+    int result = outbound_queue_send(&_fed.outbound_queue_to_RTI, bytes_to_write, buffer, 0, NULL);
+    if (result == 0) {
+        lf_print_warning("Socket is no longer connected. Dropping message.");
+    } else if (result < 0) {
         if (!exit_on_error) {
             lf_print_error("Failed to send time " PRINTF_TIME " to the RTI."
                             " Error code %d: %s",
@@ -482,7 +705,6 @@ void _lf_send_time(unsigned char type, instant_t time, bool exit_on_error) {
                                 );
         }
     }
-    lf_mutex_unlock(&outbound_socket_mutex);
 }
 
 /**
@@ -501,17 +723,14 @@ void _lf_send_tag(unsigned char type, tag_t tag, bool exit_on_error) {
     buffer[0] = type;
     encode_tag(&(buffer[1]), tag);
 
-    lf_mutex_lock(&outbound_socket_mutex);
-    if (_fed.socket_TCP_RTI < 0) {
-        lf_print_warning("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
-        return;
-    }
     trace_event_t event_type = (type == MSG_TYPE_NEXT_EVENT_TAG) ? send_NET : send_LTC;
     // Trace the event when tracing is enabled
     tracepoint_federate_to_rti(_fed.trace, event_type, _lf_my_fed_id, &tag);
-    ssize_t bytes_written = write_to_socket(_fed.socket_TCP_RTI, bytes_to_write, buffer);
-    if (bytes_written < (ssize_t)bytes_to_write) {
+    // A failed write to the RTI is reported by the first send after it.
+    int result = outbound_queue_send(&_fed.outbound_queue_to_RTI, bytes_to_write, buffer, 0, NULL);
+    if (result == 0) {
+        lf_print_warning("Socket is no longer connected. Dropping message.");
+    } else if (result < 0) {
         if (!exit_on_error) {
             lf_print_error("Failed to send tag " PRINTF_TAG " to the RTI."
                             " Error code %d: %s",
@@ -525,7 +744,6 @@ void _lf_send_tag(unsigned char type, tag_t tag, bool exit_on_error) {
             lf_print_error("Socket to the RTI is no longer connected. Considering this a soft error.");
             return;
         } else {
-            lf_mutex_unlock(&outbound_socket_mutex);
             lf_print_error_and_exit("Failed to send tag " PRINTF_TAG " to the RTI."
                                     " Error code %d: %s",
                                     tag.time - start_time,
@@ -535,9 +753,10 @@ void _lf_send_tag(unsigned char type, tag_t tag, bool exit_on_error) {
                                 );
         }
     }
-    lf_mutex_unlock(&outbound_socket_mutex);
 }
 
+static void watch_inbound_socket(int fed_id);
+
 /**
  * Thread to accept connections from other federates that send this federate
  * messages directly (not through the RTI). This thread starts a thread for
@@ -550,6 +769,7 @@ void* handle_p2p_connections_from_federates(void* env_arg) {
     assert(env_arg);
     environment_t* env = (environment_t *) env_arg;
     int received_federates = 0;
+    _lf_set_network_thread_priority(lf_thread_self(), "connection handler");
     // Allocate memory to store thread IDs.
     _fed.inbound_socket_listeners = (lf_thread_t*)calloc(_fed.number_of_inbound_p2p_connections, sizeof(lf_thread_t));
     while (received_federates < _fed.number_of_inbound_p2p_connections) {
@@ -625,6 +845,13 @@ void* handle_p2p_connections_from_federates(void* env_arg) {
                 "Failed to write MSG_TYPE_ACK in response to federate %d.",
                 remote_fed_id);
 
+        if (_fed.socket_poller.threads != NULL) {
+            // Have the socket poller listen for incoming messages instead of a thread.
+            watch_inbound_socket(remote_fed_id);
+            received_federates++;
+            continue;
+        }
+
         // Start a thread to listen for incoming messages from other federates.
         // The fed_id is a uint16_t, which we assume can be safely cast to and from void*.
         void* fed_id_arg = (void*)(uintptr_t)remote_fed_id;
@@ -641,6 +868,8 @@ void* handle_p2p_connections_from_federates(void* env_arg) {
                     result
             );
         }
+        _lf_set_network_thread_priority(
+                _fed.inbound_socket_listeners[received_federates], "federate listener");
 
         received_federates++;
     }
@@ -655,9 +884,12 @@ void* handle_p2p_connections_from_federates(void* env_arg) {
  * the outbound_socket_mutex mutex lock.
  * @param fed_id The ID of the peer federate receiving messages from this
  *  federate, or -1 if the RTI (centralized coordination).
+ * @param flush If true, first write out the messages queued for the federate.
+ *  Otherwise, drop them.
  */
-void _lf_close_outbound_socket(int fed_id) {
+void _lf_close_outbound_socket(int fed_id, bool flush) {
     assert (fed_id >= 0 && fed_id < NUMBER_OF_FEDERATES);
+    outbound_queue_close(&_fed.outbound_queues_for_p2p_connections[fed_id], flush);
     if (_fed.sockets_for_outbound_p2p_connections[fed_id] >= 0) {
         shutdown(_fed.sockets_for_outbound_p2p_connections[fed_id], SHUT_RDWR);
         close(_fed.sockets_for_outbound_p2p_connections[fed_id]);
@@ -696,19 +928,19 @@ void* listen_for_upstream_messages_from_downstream_federates(void* fed_id_ptr) {
             LF_PRINT_DEBUG("Received MSG_TYPE_CLOSE_REQUEST from federate %d.", fed_id);
             // Trace the event when tracing is enabled
             tracepoint_federate_from_federate(_fed.trace, receive_CLOSE_RQ, _lf_my_fed_id, fed_id, NULL);
-            _lf_close_outbound_socket(fed_id);
+            _lf_close_outbound_socket(fed_id, false);
             break;
         }
         if (bytes_read == 0) {
             // EOF.
             LF_PRINT_DEBUG("Received EOF from federate %d.", fed_id);
-            _lf_close_outbound_socket(fed_id);
+            _lf_close_outbound_socket(fed_id, false);
             break;
         }
         if (bytes_read < 0) {
             // EOF.
             LF_PRINT_DEBUG("Error on socket from federate %d.", fed_id);
-            _lf_close_outbound_socket(fed_id);
+            _lf_close_outbound_socket(fed_id, false);
             break;
         }
     }
@@ -716,6 +948,169 @@ void* listen_for_upstream_messages_from_downstream_federates(void* fed_id_ptr) {
     return NULL;
 }
 
+#if defined(FEDERATED_SHARED_MEMORY) || defined(FEDERATED_RDMA)
+/**
+ * Read the reply of the given federate to the offer of a transport.
+ * @param remote_federate_id The ID of the remote federate.
+ * @param socket_id The socket connected to the remote federate.
+ * @param transport The offered transport, used in messages.
+ * @return true if the federate accepted the offer.
+ */
+static bool transport_offer_accepted(uint16_t remote_federate_id, int socket_id, transport_t* transport) {
+    unsigned char reply;
+    read_from_socket_errexit(socket_id, 1, &reply,
+            "Failed to read the reply of federate %d to the offer of %s.",
+            remote_federate_id, transport->name);
+    if (reply == MSG_TYPE_ACK) return true;
+    read_from_socket_errexit(socket_id, 1, &reply,
+            "Failed to read error code from federate %d in response to the offer of %s.",
+            remote_federate_id, transport->name);
+    lf_print_warning("Federate %d rejected %s with error code %d. "
+            "Messages to it will go through the socket.", remote_federate_id, transport->name, reply);
+    return false;
+}
+#endif
+
+#ifdef FEDERATED_SHARED_MEMORY
+/**
+ * Offer to send the messages for the given federate, which runs on the same
+ * host, through a ring in shared memory (see MSG_TYPE_P2P_SHARED_MEMORY).
+ * @param remote_federate_id The ID of the remote federate.
+ * @param socket_id The socket connected to the remote federate.
+ * @return The writing side of the ring if the federate accepts, or NULL.
+ */
+static transport_t* offer_shared_memory(uint16_t remote_federate_id, int socket_id) {
+    char name[SHM_RING_NAME_LENGTH];
+    snprintf(name, sizeof(name), "/lf-%ld-%d-%d", (long)getpid(), _lf_my_fed_id, remote_federate_id);
+    transport_t* transport;
+    int result = shm_ring_create(name, socket_id, &transport);
+    if (result != 0) {
+        LF_PRINT_LOG("Failed to create shared memory for messages to federate %d. Error code: %d.",
+                remote_federate_id, result);
+        return NULL;
+    }
+    unsigned char name_length = (unsigned char)strlen(name);
+    unsigned char buffer[2];
+    buffer[0] = MSG_TYPE_P2P_SHARED_MEMORY;
+    buffer[1] = name_length;
+    write_header_and_body_to_socket_with_mutex(socket_id, 2, buffer, name_length, (unsigned char*)name, NULL,
+            "Failed to offer shared memory to federate %d.", remote_federate_id);
+    if (!transport_offer_accepted(remote_federate_id, socket_id, transport)) {
+        transport_close(transport);
+        return NULL;
+    }
+    return transport;
+}
+#endif // FEDERATED_SHARED_MEMORY
+
+#ifdef FEDERATED_RDMA
+/**
+ * Offer to send the messages for the given federate over RDMA
+ * (see MSG_TYPE_P2P_RDMA).
+ * @param remote_federate_id The ID of the remote federate.
+ * @param socket_id The socket connected to the remote federate.
+ * @return The writing side of the transport if the federate accepts, or NULL.
+ */
+static transport_t* offer_rdma(uint16_t remote_federate_id, int socket_id) {
+    transport_t* transport;
+    rdma_endpoint_t endpoint;
+    int result = rdma_transport_open(true, socket_id, &transport, &endpoint);
+    if (result != 0) {
+        LF_PRINT_LOG("Failed to open RDMA for messages to federate %d. Error code: %d.",
+                remote_federate_id, result);
+        return NULL;
+    }
+    unsigned char buffer[1 + RDMA_ENDPOINT_SIZE];
+    buffer[0] = MSG_TYPE_P2P_RDMA;
+    rdma_endpoint_encode(&endpoint, buffer + 1);
+    write_to_socket_errexit(socket_id, sizeof(buffer), buffer,
+            "Failed to offer RDMA to federate %d.", remote_federate_id);
+    if (!transport_offer_accepted(remote_federate_id, socket_id, transport)) {
+        transport_close(transport);
+        return NULL;
+    }
+    read_from_socket_errexit(socket_id, RDMA_ENDPOINT_SIZE, buffer,
+            "Failed to read the RDMA endpoint of federate %d.", remote_federate_id);
+    rdma_endpoint_decode(buffer, &endpoint);
+    result = rdma_transport_connect(transport, &endpoint);
+    if (result != 0) {
+        // The federate already reads from the transport, so the socket cannot be used instead.
+        lf_print_error_and_exit("Failed to connect over RDMA to federate %d. Error code: %d.",
+                remote_federate_id, result);
+    }
+    return transport;
+}
+#endif // FEDERATED_RDMA
+
+/**
+ * Offer to compress the bodies of large messages for the given federate
+ * (see MSG_TYPE_P2P_COMPRESSION).
+ * @param remote_federate_id The ID of the remote federate.
+ * @param socket_id The socket connected to the remote federate.
+ * @return The algorithm that the federate picked, or COMPRESSION_NONE if it
+ *  rejected the offer.
+ */
+static compression_t offer_compression(uint16_t remote_federate_id, int socket_id) {
+    unsigned char buffer[2];
+    buffer[0] = MSG_TYPE_P2P_COMPRESSION;
+    buffer[1] = compression_supported();
+    write_to_socket_errexit(socket_id, 2, buffer,
+            "Failed to offer compression to federate %d.", remote_federate_id);
+    // Both MSG_TYPE_ACK and MSG_TYPE_REJECT are followed by one byte.
+    read_from_socket_errexit(socket_id, 2, buffer,
+            "Failed to read the reply of federate %d to the offer of compression.", remote_federate_id);
+    if (buffer[0] != MSG_TYPE_ACK) {
+        LF_PRINT_LOG("Federate %d rejected compression with error code %d.", remote_federate_id, buffer[1]);
+        return COMPRESSION_NONE;
+    }
+    compression_t algorithm = (compression_t)buffer[1];
+    if (algorithm == COMPRESSION_NONE || compression_choose(buffer[1]) != algorithm) {
+        lf_print_error_and_exit("Federate %d picked compression algorithm %d, which was not offered.",
+                remote_federate_id, buffer[1]);
+    }
+    return algorithm;
+}
+
+#ifdef FEDERATED_UDP_PHYSICAL
+/**
+ * Offer to send the messages of physical connections to the given federate
+ * as UDP datagrams (see MSG_TYPE_P2P_UDP). If the federate accepts, this sets
+ * its element of _fed.udp_addresses_for_p2p_connections.
+ * @param remote_federate_id The ID of the remote federate.
+ * @param socket_id The socket connected to the remote federate.
+ * @param host_ip_addr The address of the remote federate.
+ */
+static void offer_udp(uint16_t remote_federate_id, int socket_id, struct in_addr host_ip_addr) {
+    if (_fed.udp_socket_for_outbound_datagrams < 0) {
+        _fed.udp_socket_for_outbound_datagrams = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (_fed.udp_socket_for_outbound_datagrams < 0) {
+            lf_print_warning("Failed to create a UDP socket for physical connections: %s.", strerror(errno));
+            return;
+        }
+    }
+    unsigned char buffer[1 + sizeof(uint16_t)];
+    buffer[0] = MSG_TYPE_P2P_UDP;
+    write_to_socket_errexit(socket_id, 1, buffer,
+            "Failed to offer UDP to federate %d.", remote_federate_id);
+    // MSG_TYPE_ACK is followed by two bytes and MSG_TYPE_REJECT by one.
+    read_from_socket_errexit(socket_id, 2, buffer,
+            "Failed to read the reply of federate %d to the offer of UDP.", remote_federate_id);
+    if (buffer[0] != MSG_TYPE_ACK) {
+        LF_PRINT_LOG("Federate %d rejected UDP with error code %d.", remote_federate_id, buffer[1]);
+        return;
+    }
+    read_from_socket_errexit(socket_id, 1, &buffer[2],
+            "Failed to read the UDP port of federate %d.", remote_federate_id);
+    struct sockaddr_in* address = &_fed.udp_addresses_for_p2p_connections[remote_federate_id];
+    bzero((char*)address, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr = host_ip_addr;
+    address->sin_port = htons(extract_uint16(&buffer[1]));
+    lf_print("Sending messages of physical connections to federate %d as datagrams to UDP port %d.",
+            remote_federate_id, extract_uint16(&buffer[1]));
+}
+#endif // FEDERATED_UDP_PHYSICAL
+
 /**
  * Connect to the federate with the specified id. This established
  * connection will then be used in functions such as send_timed_message()
@@ -726,6 +1121,14 @@ void* listen_for_upstream_messages_from_downstream_federates(void* fed_id_ptr) {
  * If this fails, the program exits. If it succeeds, it sets element [id] of
  * the _fed.sockets_for_outbound_p2p_connections global array to
  * refer to the socket for communicating directly with the federate.
+ * Messages for the federate then go through a faster transport, if the
+ * federate agrees (see transport.h): shared memory with FEDERATED_SHARED_MEMORY
+ * if the address of the federate is an address of this host, or otherwise
+ * RDMA with FEDERATED_RDMA. Messages that go through the socket have large
+ * bodies compressed, if this federate was compiled with support for
+ * compression and the federate agrees (see compression.h). With
+ * FEDERATED_UDP_PHYSICAL, messages of physical connections that go through
+ * the socket are sent as UDP datagrams instead, if the federate agrees.
  * @param remote_federate_id The ID of the remote federate.
  */
 void connect_to_federate(uint16_t remote_federate_id) {
@@ -852,13 +1255,10 @@ void connect_to_federate(uint16_t remote_federate_id) {
             buffer[sizeof(uint16_t) + 1] = federation_id_length;
             // Trace the event when tracing is enabled
             tracepoint_federate_to_federate(_fed.trace, send_FED_ID, _lf_my_fed_id, remote_federate_id, NULL);
-            write_to_socket_errexit(socket_id,
+            write_header_and_body_to_socket_with_mutex(socket_id,
                     buffer_length, buffer,
-                    "Failed to send fed_id to federate %d.", remote_federate_id);
-            write_to_socket_errexit(socket_id,
-                    federation_id_length, (unsigned char*)federation_metadata.federation_id,
-                    "Failed to send federation id to federate %d.",
-                    remote_federate_id);
+                    federation_id_length, (unsigned char*)federation_metadata.federation_id, NULL,
+                    "Failed to send fed_id and federation id to federate %d.", remote_federate_id);
 
             read_from_socket_errexit(socket_id, 1, (unsigned char*)buffer,
                     "Failed to read MSG_TYPE_ACK from federate %d in response to sending fed_id.",
@@ -881,6 +1281,52 @@ void connect_to_federate(uint16_t remote_federate_id) {
     // socket ID should reset it to -1 within a critical section.
     _fed.sockets_for_outbound_p2p_connections[remote_federate_id] = socket_id;
 
+    // Start the thread that writes the messages queued for this federate.
+    char destination[32];
+    snprintf(destination, sizeof(destination), "federate %d", remote_federate_id);
+    outbound_queue_open(&_fed.outbound_queues_for_p2p_connections[remote_federate_id], socket_id, destination);
+#if defined(FEDERATED_SHARED_MEMORY) || defined(FEDERATED_RDMA)
+    transport_t* transport = NULL;
+#ifdef FEDERATED_SHARED_MEMORY
+    if (host_address_is_local(host_ip_addr)) {
+        transport = offer_shared_memory(remote_federate_id, socket_id);
+    }
+#endif
+#ifdef FEDERATED_RDMA
+    if (transport == NULL) {
+        transport = offer_rdma(remote_federate_id, socket_id);
+    }
+#endif
+    if (transport != NULL) {
+        outbound_queue_use_transport(&_fed.outbound_queues_for_p2p_connections[remote_federate_id], transport);
+        lf_print("Sending messages to federate %d through %s.", remote_federate_id, transport->name);
+    }
+#endif
+    // Over a transport, compression would cost more time than it saves.
+    if (compression_supported() != 0
+            && _fed.outbound_queues_for_p2p_connections[remote_federate_id].transport == NULL) {
+        compression_t algorithm = offer_compression(remote_federate_id, socket_id);
+        if (algorithm != COMPRESSION_NONE) {
+            lf_print("Compressing messages to federate %d with %s.", remote_federate_id, compression_name(algorithm));
+        }
+        _fed.compression_for_p2p_connections[remote_federate_id] = algorithm;
+    }
+#ifdef FEDERATED_UDP_PHYSICAL
+    // A transport does not hold up messages the way a TCP socket does.
+    if (_fed.outbound_queues_for_p2p_connections[remote_federate_id].transport == NULL) {
+        offer_udp(remote_federate_id, socket_id, host_ip_addr);
+    }
+#endif
+    result = outbound_queue_start(&_fed.outbound_queues_for_p2p_connections[remote_federate_id]);
+    if (result != 0) {
+        lf_print_warning("Failed to create a thread to send messages to federate %d. "
+                "Messages to it will be sent synchronously. Error code: %d.",
+                remote_federate_id, result);
+    } else if (_fed.outbound_queues_for_p2p_connections[remote_federate_id].started) {
+        _lf_set_network_thread_priority(
+                _fed.outbound_queues_for_p2p_connections[remote_federate_id].writer, "outbound writer");
+    }
+
     // Start a thread to listen for upstream messages (MSG_TYPE_CLOSE_REQUEST) from
     // this downstream federate.
     uint16_t* remote_fed_id_copy = (uint16_t*)malloc(sizeof(uint16_t));
@@ -900,6 +1346,7 @@ void connect_to_federate(uint16_t remote_federate_id) {
                 result
         );
     }
+    _lf_set_network_thread_priority(thread_id, "upstream message listener");
 }
 
 #ifdef FEDERATED_AUTHENTICATED
@@ -969,6 +1416,44 @@ void perform_hmac_authentication(int rti_socket) {
 }
 #endif
 
+#ifdef FEDERATED_LISTENER_THREADS
+/**
+ * Open the poller that listens for messages on the sockets connected to the
+ * RTI and to other federates on FEDERATED_LISTENER_THREADS threads.
+ * If this fails, each socket gets its own listener thread.
+ */
+static void open_socket_poller(void) {
+    if (_fed.socket_poller.threads != NULL) return;
+    int result = socket_poller_open(&_fed.socket_poller, FEDERATED_LISTENER_THREADS);
+    if (result != 0) {
+        lf_print_warning("Failed to share %d threads among the sockets (error code %d)."
+                " Using a listener thread per socket.", FEDERATED_LISTENER_THREADS, result);
+        return;
+    }
+    for (size_t i = 0; i < _fed.socket_poller.number_of_threads; i++) {
+        _lf_set_network_thread_priority(_fed.socket_poller.threads[i], "socket poller");
+    }
+}
+#endif
+
+/**
+ * Return the interval to wait before the specified retry to connect to the RTI,
+ * which doubles with each retry from CONNECT_RETRY_INITIAL_INTERVAL up to
+ * CONNECT_RETRY_INTERVAL, less a random fraction of up to half of it.
+ * @param count_retries The number of retries so far, including this one.
+ * @param seed The state of the random number generator.
+ */
+static interval_t connect_retry_interval(int count_retries, unsigned int* seed) {
+    interval_t interval = CONNECT_RETRY_INITIAL_INTERVAL;
+    for (int i = 1; i < count_retries && interval < CONNECT_RETRY_INTERVAL; i++) {
+        interval *= 2;
+    }
+    if (interval > CONNECT_RETRY_INTERVAL) {
+        interval = CONNECT_RETRY_INTERVAL;
+    }
+    return interval - (interval / 2) * (rand_r(seed) % 1024) / 1024;
+}
+
 /**
  * Connect to the RTI at the specified host and port and return
  * the socket descriptor for the connection. If this fails, the
@@ -996,7 +1481,7 @@ void connect_to_rti(const char* hostname, int port) {
         uport = (uint16_t)port;
     }
 
-    // Repeatedly try to connect, one attempt every 2 seconds, until
+    // Repeatedly try to connect, backing off up to one attempt every 2 seconds, until
     // either the program is killed, the sleep is interrupted,
     // or the connection succeeds.
     // If the specified port is 0, set it instead to the start of the
@@ -1008,6 +1493,7 @@ void connect_to_rti(const char* hostname, int port) {
     }
     int result = -1;
     int count_retries = 0;
+    unsigned int retry_seed = (unsigned int)(lf_time_physical() ^ _lf_my_fed_id);
 
     struct addrinfo hints;
     struct addrinfo *res;
@@ -1067,10 +1553,10 @@ void connect_to_rti(const char* hostname, int port) {
                 lf_print_error_and_exit("Failed to connect to the RTI after %d retries. Giving up.",
                                      CONNECT_NUM_RETRIES);
             }
-            lf_print("Could not connect to RTI at %s. Will try again every %lld seconds.",
-                   hostname, CONNECT_RETRY_INTERVAL / BILLION);
-            // Wait CONNECT_RETRY_INTERVAL nanoseconds.
-            if (lf_sleep(CONNECT_RETRY_INTERVAL) != 0) {
+            interval_t retry_interval = connect_retry_interval(count_retries, &retry_seed);
+            lf_print("Could not connect to RTI at %s. Will try again in %lld msec.",
+                   hostname, retry_interval / MSEC(1));
+            if (lf_sleep(retry_interval) != 0) {
                 // Sleep was interrupted.
                 continue;
             }
@@ -1102,12 +1588,10 @@ void connect_to_rti(const char* hostname, int port) {
             // Trace the event when tracing is enabled
             tracepoint_federate_to_rti(_fed.trace, send_FED_ID, _lf_my_fed_id, NULL);
 
-            write_to_socket_errexit(_fed.socket_TCP_RTI, 2 + sizeof(uint16_t), buffer,
-                    "Failed to send federate ID to RTI.");
-
-            // Next send the federation ID itself.
-            write_to_socket_errexit(_fed.socket_TCP_RTI, federation_id_length, (unsigned char*)federation_metadata.federation_id,
-                            "Failed to send federation ID to RTI.");
+            // Send it together with the federation ID itself.
+            write_header_and_body_to_socket_with_mutex(_fed.socket_TCP_RTI, 2 + sizeof(uint16_t), buffer,
+                    federation_id_length, (unsigned char*)federation_metadata.federation_id, NULL,
+                    "Failed to send federate ID and federation ID to RTI.");
 
             // Wait for a response.
             // The response will be MSG_TYPE_REJECT if the federation ID doesn't match.
@@ -1156,6 +1640,12 @@ void connect_to_rti(const char* hostname, int port) {
                         response);
             }
             lf_print("Connected to RTI at %s:%d.", hostname, uport);
+            // Messages to the RTI are written synchronously until
+            // synchronize_with_other_federates() starts the writer thread.
+            outbound_queue_open(&_fed.outbound_queue_to_RTI, _fed.socket_TCP_RTI, "the RTI");
+#ifdef FEDERATED_LISTENER_THREADS
+            open_socket_poller();
+#endif
         }
     }
 }
@@ -1170,6 +1660,18 @@ void connect_to_rti(const char* hostname, int port) {
  * @return The designated start time for the federate.
  */
 instant_t get_start_time_from_rti(instant_t my_physical_time) {
+    if (FEDERATED_MIN_OUTPUT_DELAY > 0LL) {
+        // Declare the minimum output delay before proposing a start time
+        // so that the RTI knows it before granting any tag.
+        unsigned char delay_buffer[MSG_TYPE_MIN_OUTPUT_DELAY_LENGTH];
+        delay_buffer[0] = MSG_TYPE_MIN_OUTPUT_DELAY;
+        encode_int64((interval_t)FEDERATED_MIN_OUTPUT_DELAY, &(delay_buffer[1]));
+        if (outbound_queue_send(&_fed.outbound_queue_to_RTI,
+                MSG_TYPE_MIN_OUTPUT_DELAY_LENGTH, delay_buffer, 0, NULL) <= 0) {
+            lf_print_error_and_exit("Failed to send the minimum output delay to the RTI.");
+        }
+    }
+
     // Send the timestamp marker first.
     _lf_send_time(MSG_TYPE_TIMESTAMP, my_physical_time, true);
 
@@ -1216,24 +1718,195 @@ extern size_t staa_lst_size;
 #endif
 
 /**
- * Return a pointer to the action struct for the action
- * corresponding to the specified port ID.
- * @param port_id The port ID.
- * @return A pointer to an action struct or null if the ID is out of range.
+ * A network input port that can hold back the MLAA (max_level_allowed_to_advance).
+ * It does so while its status is not known at the current tag, that is, while
+ * the current tag is greater than its key, which is the later of its last known
+ * status tag and the tag until which it is exempt from holding back the MLAA.
  */
-lf_action_base_t* _lf_action_for_port(int port_id) {
-    if (port_id < _lf_action_table_size) {
-        return _lf_action_table[port_id];
-    }
-    lf_print_error("Invalid port ID: %d", port_id);
-    return NULL;
-}
+typedef struct mlaa_port_t {
+    lf_action_base_t* action;
+    int level;              // The level of the reaction of the port.
+    tag_t exempt_until;     // The tag up to which the port does not hold back the MLAA.
+    size_t heap_position;   // The position of the port in its heap.
+    bool unresolved;        // Whether the port is in the heap of unresolved ports.
+} mlaa_port_t;
+
+#define DARY_HEAP(token) mlaa_level_heap ## _ ## token
+#define E mlaa_port_t*
+#define P int
+#define SET_POS(heap, element, position) ((element)->heap_position = (position))
+#include "impl/dary_heap.h"
+#undef DARY_HEAP
+#undef E
+#undef P
+
+#define DARY_HEAP(token) mlaa_tag_heap ## _ ## token
+#define E mlaa_port_t*
+#define P tag_t
+#define DARY_HEAP_LESS(a, b) (lf_tag_compare((a), (b)) < 0)
+#include "impl/dary_heap.h"
+#undef DARY_HEAP
+#undef E
+#undef P
+#undef ARITY
+#undef SET_POS
 
 /**
- * Set the status of network port with id portID.
- *
- * @param portID The network port ID
- * @param status The network port status (port_status_t)
+ * The ports that can hold back the MLAA, indexed by port ID. An entry is NULL
+ * for a physical port and, under centralized coordination, for a port with a
+ * delay on its connection. Each port is in one of two heaps: the unresolved
+ * ports, whose minimum level is the MLAA, and the others, ordered by their key,
+ * whose minimum tells when the next of them becomes unresolved. This makes each
+ * update of the MLAA cost O(log n) per port whose status changes rather than a
+ * scan of all the ports.
+ */
+static mlaa_port_t** mlaa_ports = NULL;
+static mlaa_port_t* mlaa_port_storage = NULL;
+static mlaa_level_heap_t mlaa_unresolved;
+static mlaa_tag_heap_t mlaa_resolved;
+static instant_t mlaa_start_time = NEVER;
+
+/** Return the tag after which the port no longer holds back the MLAA, unless its status is unknown. */
+static tag_t mlaa_key(mlaa_port_t* port) {
+    tag_t last_known_status_tag = port->action->trigger->last_known_status_tag;
+    return (lf_tag_compare(last_known_status_tag, port->exempt_until) > 0)
+            ? last_known_status_tag : port->exempt_until;
+}
+
+/**
+ * Put all the ports that can hold back the MLAA among the resolved ones.
+ * This is done again if the start time changes, as it does when the federation
+ * agrees on it, because the exemptions at startup depend on it.
+ */
+static void mlaa_build() {
+    if (mlaa_ports == NULL) {
+        mlaa_ports = (mlaa_port_t**)calloc(LF_MAX(_lf_action_table_size, 1), sizeof(mlaa_port_t*));
+        mlaa_port_storage = (mlaa_port_t*)calloc(LF_MAX(_lf_action_table_size, 1), sizeof(mlaa_port_t));
+        if (mlaa_ports == NULL || mlaa_port_storage == NULL
+                || !mlaa_level_heap_init(&mlaa_unresolved, _lf_action_table_size, NULL)
+                || !mlaa_tag_heap_init(&mlaa_resolved, _lf_action_table_size, NULL)) {
+            lf_print_error_and_exit("Out of memory.");
+        }
+    }
+    mlaa_unresolved.size = 0;
+    mlaa_resolved.size = 0;
+#ifdef FEDERATED_DECENTRALIZED
+    size_t action_table_size = _lf_action_table_size;
+    lf_action_base_t** action_table = _lf_action_table;
+#else
+    size_t action_table_size = _lf_zero_delay_action_table_size;
+    lf_action_base_t** action_table = _lf_zero_delay_action_table;
+#endif // FEDERATED_DECENTRALIZED
+    for (size_t i = 0; i < action_table_size; i++) {
+        lf_action_base_t* input_port_action = action_table[i];
+        if (input_port_action->trigger->is_physical) {
+            continue;
+        }
+        size_t port_id = 0;
+        while (port_id < _lf_action_table_size && _lf_action_table[port_id] != input_port_action) {
+            port_id++;
+        }
+        if (port_id == _lf_action_table_size) {
+            continue;
+        }
+        mlaa_port_t* port = &mlaa_port_storage[port_id];
+        port->action = input_port_action;
+        port->level = (int)LF_LEVEL(input_port_action->trigger->reactions[0]->index);
+        port->exempt_until = NEVER_TAG;
+#ifdef FEDERATED_DECENTRALIZED
+        // In decentralized execution, if the current_tag is close enough to the
+        // start tag and there is a large enough delay on an incoming
+        // connection, then there is no need to block progress waiting for this
+        // port status.
+        if (_lf_action_delay_table[i] == 0) {
+            port->exempt_until = (tag_t) {.time = start_time, .microstep = 0};
+        } else if (_lf_action_delay_table[i] > 0) {
+            port->exempt_until = lf_delay_strict((tag_t) {.time = start_time, .microstep = 0},
+                    _lf_action_delay_table[i]);
+        }
+#endif // FEDERATED_DECENTRALIZED
+        port->unresolved = false;
+        mlaa_tag_heap_append(&mlaa_resolved, port, mlaa_key(port));
+        mlaa_ports[port_id] = port;
+    }
+    mlaa_tag_heap_heapify(&mlaa_resolved);
+    mlaa_start_time = start_time;
+}
+
+/**
+ * Move the port with the specified ID to the heap that it belongs in now that
+ * its last known status tag has increased. This assumes the caller holds the mutex.
+ */
+static void mlaa_port_status_updated(int port_id) {
+    if (mlaa_ports == NULL || mlaa_ports[port_id] == NULL) {
+        return;
+    }
+    environment_t *env;
+    _lf_get_environments(&env);
+    mlaa_port_t* port = mlaa_ports[port_id];
+    tag_t key = mlaa_key(port);
+    if (!port->unresolved) {
+        // The key only increases.
+        mlaa_resolved.entries[port->heap_position].priority = key;
+        mlaa_tag_heap_sift_down(&mlaa_resolved, port->heap_position);
+    } else if (lf_tag_compare(env->current_tag, key) <= 0) {
+        mlaa_level_heap_remove_at(&mlaa_unresolved, port->heap_position);
+        port->unresolved = false;
+        if (mlaa_tag_heap_insert(&mlaa_resolved, port, key)) {
+            lf_print_error_and_exit("Out of memory.");
+        }
+    }
+}
+
+/**
+ * Return a pointer to the action struct for the action
+ * corresponding to the specified port ID.
+ * @param port_id The port ID.
+ * @return A pointer to an action struct or null if the ID is out of range.
+ */
+lf_action_base_t* _lf_action_for_port(int port_id) {
+    if (port_id < _lf_action_table_size) {
+        return _lf_action_table[port_id];
+    }
+    lf_print_error("Invalid port ID: %d", port_id);
+    return NULL;
+}
+
+/**
+ * The serializers of the network input ports, indexed by port ID, or NULL if
+ * no port has one (see lf_set_port_serializer()).
+ */
+static const lf_port_serializer_t** port_serializers = NULL;
+
+void lf_set_port_serializer(int port_id, const lf_port_serializer_t* serializer) {
+    if (port_id < 0 || (size_t)port_id >= _lf_action_table_size) {
+        lf_print_error("Invalid port ID: %d", port_id);
+        return;
+    }
+    if (port_serializers == NULL) {
+        port_serializers = (const lf_port_serializer_t**)calloc(_lf_action_table_size, sizeof(lf_port_serializer_t*));
+        lf_assert(port_serializers != NULL, "Out of memory");
+    }
+    port_serializers[port_id] = serializer;
+}
+
+/**
+ * Return the serializer of the network input port with the given ID, or NULL
+ * if it has none.
+ * @param port_id The port ID.
+ */
+static const lf_port_serializer_t* serializer_for_port(int port_id) {
+    if (port_serializers == NULL || port_id < 0 || (size_t)port_id >= _lf_action_table_size) {
+        return NULL;
+    }
+    return port_serializers[port_id];
+}
+
+/**
+ * Set the status of network port with id portID.
+ *
+ * @param portID The network port ID
+ * @param status The network port status (port_status_t)
  */
 void set_network_port_status(int portID, port_status_t status) {
     lf_action_base_t* network_input_port_action = _lf_action_for_port(portID);
@@ -1275,6 +1948,7 @@ void update_last_known_status_on_input_ports(tag_t tag) {
                 tag.microstep
             );
             input_port_action->trigger->last_known_status_tag = tag;
+            mlaa_port_status_updated(i);
             notify = true;
         }
     }
@@ -1319,6 +1993,7 @@ void update_last_known_status_on_input_port(tag_t tag, int port_id) {
             tag.microstep
         );
         input_port_action->last_known_status_tag = tag;
+        mlaa_port_status_updated(port_id);
         // There is no guarantee that there is either a TAG or a PTAG for this time.
         // The message that triggered this to be called could be from an upstream
         // federate that is far ahead of other upstream federates in logical time.
@@ -1386,22 +2061,22 @@ void enqueue_port_absent_reactions(environment_t* env){
  *  program, -1 is passed.
  * @param port_ID The ID of the receiving port.
  * @param fed_ID The fed ID of the receiving federate.
+ *
+ * With FEDERATED_BATCH_MESSAGES, the port is added to a batch of ports
+ * found absent at the same tag for the same federate
+ * (see MSG_TYPE_PORT_ABSENT_BATCH).
  */
 void send_port_absent_to_federate(environment_t* env, interval_t additional_delay,
                                     unsigned short port_ID,
                                   unsigned short fed_ID) {
     assert(env != GLOBAL_ENVIRONMENT);
 
-    // Construct the message
-    size_t message_length = 1 + sizeof(port_ID) + sizeof(fed_ID) + sizeof(instant_t) + sizeof(microstep_t);
-    unsigned char buffer[message_length];
-
     // Apply the additional delay to the current tag and use that as the intended
     // tag of the outgoing message. Note that if there is delay on the connection,
     // then we cannot promise no message with tag = current_tag + delay because a
     // subsequent reaction might produce such a message. But we can promise no
     // message with a tag strictly less than current_tag + delay.
-    tag_t current_message_intended_tag = lf_delay_strict(env->current_tag,
+    tag_t current_message_intended_tag = _lf_delay_strict(env->current_tag,
                                                     additional_delay);
 
     LF_PRINT_LOG("Sending port "
@@ -1410,28 +2085,44 @@ void send_port_absent_to_federate(environment_t* env, interval_t additional_dela
             current_message_intended_tag.microstep,
             port_ID, fed_ID);
 
-    buffer[0] = MSG_TYPE_PORT_ABSENT;
-    encode_uint16(port_ID, &(buffer[1]));
-    encode_uint16(fed_ID, &(buffer[1+sizeof(port_ID)]));
-    encode_tag(&(buffer[1+sizeof(port_ID)+sizeof(fed_ID)]), current_message_intended_tag);
-
-    lf_mutex_lock(&outbound_socket_mutex);
 #ifdef FEDERATED_CENTRALIZED
     // Send the absent message through the RTI
-    int socket = _fed.socket_TCP_RTI;
+    outbound_queue_t* queue = &_fed.outbound_queue_to_RTI;
 #else
     // Send the absent message directly to the federate
-    int socket = _fed.sockets_for_outbound_p2p_connections[fed_ID];
+    outbound_queue_t* queue = &_fed.outbound_queues_for_p2p_connections[fed_ID];
 #endif
-    // Do not write if the socket is closed.
-    if (socket >= 0) {
-        // Trace the event when tracing is enabled
-        tracepoint_federate_to_rti(_fed.trace, send_PORT_ABS, _lf_my_fed_id, &current_message_intended_tag);
-        write_to_socket_with_mutex(socket, message_length, buffer, &outbound_socket_mutex,
-                "Failed to send port absent message for port %hu to federate %hu.",
+    // Trace the event when tracing is enabled
+    tracepoint_federate_to_rti(_fed.trace, send_PORT_ABS, _lf_my_fed_id, &current_message_intended_tag);
+#ifdef FEDERATED_BATCH_MESSAGES
+    // Pack the port with the others found absent for the same federate at the
+    // same tag. The batch is written at the end of the tag, or earlier if
+    // this federate has to wait for network inputs.
+    unsigned char batch_header[MSG_TYPE_PORT_ABSENT_BATCH_HEADER_SIZE];
+    batch_header[0] = MSG_TYPE_PORT_ABSENT_BATCH;
+    encode_uint16(0, &(batch_header[1]));
+    encode_uint16(fed_ID, &(batch_header[1 + sizeof(uint16_t)]));
+    encode_int32(0, &(batch_header[1 + 2 * sizeof(uint16_t)]));
+    encode_tag(&(batch_header[1 + 2 * sizeof(uint16_t) + sizeof(int32_t)]), current_message_intended_tag);
+    unsigned char entry[sizeof(uint16_t)];
+    encode_uint16(port_ID, entry);
+    int result = outbound_queue_send_batched(queue, sizeof(batch_header), batch_header,
+            1 + 2 * sizeof(uint16_t), sizeof(entry), entry, 0, NULL);
+#else
+    // Construct the message
+    size_t message_length = 1 + sizeof(port_ID) + sizeof(fed_ID) + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[message_length];
+    buffer[0] = MSG_TYPE_PORT_ABSENT;
+    encode_uint16(port_ID, &(buffer[1]));
+    encode_uint16(fed_ID, &(buffer[1+sizeof(port_ID)]));
+    encode_tag(&(buffer[1+sizeof(port_ID)+sizeof(fed_ID)]), current_message_intended_tag);
+    int result = outbound_queue_send(queue, message_length, buffer, 0, NULL);
+#endif // FEDERATED_BATCH_MESSAGES
+    // The message is dropped if the socket is closed.
+    if (result < 0) {
+        lf_print_error("Failed to send port absent message for port %hu to federate %hu.",
                 port_ID, fed_ID);
     }
-    lf_mutex_unlock(&outbound_socket_mutex);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -1474,6 +2165,10 @@ static trigger_handle_t schedule_message_received_from_network_locked(
     // Assign the intended tag
     trigger->intended_tag = tag;
 
+    if (env->replay != NULL) {
+        _lf_replay_record_message(env, trigger, tag, token);
+    }
+
     // Calculate the extra_delay required to be passed
     // to the schedule function.
     interval_t extra_delay = tag.time - env->current_tag.time;
@@ -1555,6 +2250,7 @@ int _lf_request_close_inbound_socket(int fed_id) {
 void _lf_close_inbound_socket(int fed_id) {
     if (fed_id < 0) {
         // socket connection is to the RTI.
+        outbound_queue_close(&_fed.outbound_queue_to_RTI, false);
         int socket = _fed.socket_TCP_RTI;
         // First, set the global socket to -1.
         _fed.socket_TCP_RTI = -1;
@@ -1569,72 +2265,239 @@ void _lf_close_inbound_socket(int fed_id) {
 }
 
 /**
- * Handle a port absent message received from a remote federate.
- * This just sets the last known status tag of the port specified
+ * Handle a port absent message (MSG_TYPE_PORT_ABSENT or
+ * MSG_TYPE_PORT_ABSENT_BATCH) received from a remote federate.
+ * This just sets the last known status tag of the ports specified
  * in the message.
  *
- * @param socket The socket to read the message from
- * @param buffer The buffer to read
+ * @param reader The reader of the socket to read the message from.
  * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param message_type The type of the message, which has already been read.
  */
-static void handle_port_absent_message(int socket, int fed_id) {
-    size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(instant_t) + sizeof(microstep_t);
-    unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
+static void handle_port_absent_message(socket_reader_t* reader, int fed_id, unsigned char message_type) {
+    // A batch has the header of a single message without the port, plus the
+    // length of the port IDs that follow it.
+    bool batch = (message_type == MSG_TYPE_PORT_ABSENT_BATCH);
+    size_t bytes_to_read = batch ?
+            MSG_TYPE_PORT_ABSENT_BATCH_HEADER_SIZE - 1
+            : sizeof(uint16_t) + sizeof(uint16_t) + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[FED_COM_BUFFER_SIZE];
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read port absent message.");
 
     // Extract the header information.
-    unsigned short port_id = extract_uint16(buffer);
-    // The next part of the message is the federate_id, but we don't need it.
-    // unsigned short federate_id = extract_uint16(&(buffer[sizeof(uint16_t)]));
-    tag_t intended_tag = extract_tag(&(buffer[sizeof(uint16_t)+sizeof(uint16_t)]));
-
-    // Trace the event when tracing is enabled
-    if (fed_id == -1) {
-        tracepoint_federate_from_rti(_fed.trace, receive_PORT_ABS, _lf_my_fed_id, &intended_tag);
+    // The federate_id is only needed by the RTI.
+    size_t ports_length = sizeof(uint16_t);
+    tag_t intended_tag;
+    if (batch) {
+        ports_length = (size_t)extract_int32(&(buffer[2 * sizeof(uint16_t)]));
+        intended_tag = extract_tag(&(buffer[2 * sizeof(uint16_t) + sizeof(int32_t)]));
+        if (ports_length % sizeof(uint16_t) != 0) {
+            lf_print_error_and_exit("Received a malformed port absent batch.");
+        }
     } else {
-        tracepoint_federate_from_federate(_fed.trace, receive_PORT_ABS, _lf_my_fed_id, fed_id, &intended_tag);
+        intended_tag = extract_tag(&(buffer[sizeof(uint16_t)+sizeof(uint16_t)]));
     }
-    LF_PRINT_LOG("Handling port absent for tag " PRINTF_TAG " for port %hu of fed %d.",
-            intended_tag.time - lf_time_start(),
-            intended_tag.microstep,
-            port_id,
-            fed_id
-    );
 
     // Environment is always the one corresponding to the top-level scheduling enclave.
     environment_t *env;
     _lf_get_environments(&env);
 
-    lf_mutex_lock(&env->mutex);
-#ifdef FEDERATED_DECENTRALIZED
-    trigger_t* network_input_port_action = _lf_action_for_port(port_id)->trigger;
-    if (lf_tag_compare(intended_tag,
-            network_input_port_action->last_known_status_tag) < 0) {
+    // The ports are handled as many at a time as fit in the buffer.
+    while (ports_length > 0) {
+        size_t chunk_length = sizeof(uint16_t);
+        if (batch) {
+            chunk_length = (ports_length < FED_COM_BUFFER_SIZE) ? ports_length : FED_COM_BUFFER_SIZE;
+            read_from_socket_reader_errexit(reader, chunk_length, buffer,
+                    "Failed to read port absent batch.");
+        }
+        ports_length -= chunk_length;
+
+        lf_mutex_lock(&env->mutex);
+        for (size_t i = 0; i < chunk_length; i += sizeof(uint16_t)) {
+            unsigned short port_id = extract_uint16(&(buffer[i]));
+
+            // Trace the event when tracing is enabled
+            if (fed_id == -1) {
+                tracepoint_federate_from_rti(_fed.trace, receive_PORT_ABS, _lf_my_fed_id, &intended_tag);
+            } else {
+                tracepoint_federate_from_federate(_fed.trace, receive_PORT_ABS, _lf_my_fed_id, fed_id, &intended_tag);
+            }
+            LF_PRINT_LOG("Handling port absent for tag " PRINTF_TAG " for port %hu of fed %d.",
+                    intended_tag.time - lf_time_start(),
+                    intended_tag.microstep,
+                    port_id,
+                    fed_id
+            );
+
+            // Set the port status as absent. This ignores tags earlier than the
+            // last known status tag of the port, which, in centralized coordination,
+            // a TAG message from the RTI can set to a future tag where messages
+            // have not arrived yet.
+            update_last_known_status_on_input_port(intended_tag, port_id);
+        }
         lf_mutex_unlock(&env->mutex);
     }
-#endif // In centralized coordination, a TAG message from the RTI
-       // can set the last_known_status_tag to a future tag where messages
-       // have not arrived yet.
-    // Set the mutex status as absent
-    update_last_known_status_on_input_port(intended_tag, port_id);
-    lf_mutex_unlock(&env->mutex);
+}
+
+/**
+ * Return a new token for a message of the given length received for the
+ * given network input action. The payload is allocated from the pools of
+ * token payloads and left uninitialized, so that the caller can read the
+ * message into it directly.
+ * @param action The action of the network input port.
+ * @param length The length of the message in bytes.
+ */
+static lf_token_t* new_message_token(lf_action_base_t* action, size_t length) {
+    lf_token_t* result = _lf_new_token_with_payload((token_type_t*)action, length, length);
+    if (result == NULL) {
+        lf_print_error_and_exit("Out of memory for a message of %zu bytes.", length);
+    }
+    return result;
+}
+
+/**
+ * How the body of a message received in a MSG_TYPE_P2P_COMPRESSED_MESSAGE
+ * is compressed.
+ */
+typedef struct compressed_body_t {
+    compression_t algorithm;
+    size_t original_length;
+} compressed_body_t;
+
+/**
+ * Return a new token carrying the value into which the given serializer
+ * deserializes the given body of a message (see lf_set_port_serializer()).
+ * The payload is allocated with the element size of the type of the given
+ * network input action.
+ * @param serializer The serializer of the port.
+ * @param fed_id The sending federate ID or -1 if the RTI.
+ * @param action The action of the network input port.
+ * @param length The length of the body.
+ * @param body The body.
+ */
+static lf_token_t* deserialize_message_token(
+        const lf_port_serializer_t* serializer,
+        int fed_id,
+        lf_action_base_t* action,
+        size_t length,
+        const unsigned char* body) {
+    size_t element_size = ((token_type_t*)action)->element_size;
+    lf_token_t* result = _lf_new_token_with_payload((token_type_t*)action, 1, element_size);
+    if (result == NULL) {
+        lf_print_error_and_exit("Out of memory for a value of %zu bytes.", element_size);
+    }
+    if (serializer->scatter(length, body, result->value) != 0) {
+        lf_print_error_and_exit("Failed to deserialize a message of %zu bytes from federate %d.", length, fed_id);
+    }
+    return result;
+}
+
+#ifdef FEDERATED_UDP_PHYSICAL
+/**
+ * Return a new token for the given body of a message received for the given
+ * network input port, which carries either the body itself or, if the port
+ * has a serializer, the value deserialized from it.
+ * @param fed_id The sending federate ID or -1 if the RTI.
+ * @param port_id The ID of the network input port.
+ * @param action The action of the network input port.
+ * @param length The length of the body.
+ * @param body The body.
+ */
+static lf_token_t* copy_message_token(
+        int fed_id,
+        int port_id,
+        lf_action_base_t* action,
+        size_t length,
+        const unsigned char* body) {
+    const lf_port_serializer_t* serializer = serializer_for_port(port_id);
+    if (serializer != NULL) {
+        return deserialize_message_token(serializer, fed_id, action, length, body);
+    }
+    lf_token_t* result = new_message_token(action, length);
+    memcpy(result->value, body, length);
+    return result;
+}
+#endif // FEDERATED_UDP_PHYSICAL
+
+/**
+ * Read the body of a message received for the given network input port
+ * into a new token (see new_message_token()), decompressing it if needed.
+ * If the port has a serializer (see lf_set_port_serializer()), the token
+ * instead carries the value deserialized from the body.
+ * @param reader The reader of the socket to read the body from.
+ * @param fed_id The sending federate ID or -1 if the RTI.
+ * @param port_id The ID of the network input port.
+ * @param action The action of the network input port.
+ * @param length The length of the body in the message.
+ * @param compressed How the body is compressed, or NULL if it is not.
+ * @param tag The tag of the message, or NULL if it has none.
+ */
+static lf_token_t* read_message_token(
+        socket_reader_t* reader,
+        int fed_id,
+        int port_id,
+        lf_action_base_t* action,
+        size_t length,
+        const compressed_body_t* compressed,
+        tag_t* tag) {
+    const lf_port_serializer_t* serializer = serializer_for_port(port_id);
+    if (compressed == NULL && serializer == NULL) {
+        // Read the payload directly into the token that will carry it.
+        lf_token_t* result = new_message_token(action, length);
+        read_from_socket_reader_errexit(reader, length, (unsigned char*)result->value,
+                "Failed to read message body.");
+        return result;
+    }
+    unsigned char* buffer = (unsigned char*)malloc(length);
+    if (buffer == NULL) {
+        lf_print_error_and_exit("Out of memory for a message of %zu bytes.", length);
+    }
+    read_from_socket_reader_errexit(reader, length, buffer, "Failed to read message body.");
+    if (compressed == NULL) {
+        lf_token_t* result = deserialize_message_token(serializer, fed_id, action, length, buffer);
+        free(buffer);
+        return result;
+    }
+    // Without a serializer, decompress directly into the token that will carry the payload.
+    lf_token_t* result = NULL;
+    unsigned char* body;
+    if (serializer == NULL) {
+        result = new_message_token(action, compressed->original_length);
+        body = (unsigned char*)result->value;
+    } else if ((body = (unsigned char*)malloc(compressed->original_length)) == NULL) {
+        lf_print_error_and_exit("Out of memory for a message of %zu bytes.", compressed->original_length);
+    }
+    tracepoint_federate_compression(_fed.trace, decompression_starts, _lf_my_fed_id, fed_id, tag, length);
+    if (compression_decompress(compressed->algorithm, length, buffer,
+            compressed->original_length, body) != 0) {
+        lf_print_error_and_exit("Failed to decompress a message of %zu bytes from federate %d with %s.",
+                length, fed_id, compression_name(compressed->algorithm));
+    }
+    tracepoint_federate_compression(_fed.trace, decompression_ends, _lf_my_fed_id, fed_id, tag,
+            compressed->original_length);
+    free(buffer);
+    if (serializer != NULL) {
+        result = deserialize_message_token(serializer, fed_id, action, compressed->original_length, body);
+        free(body);
+    }
+    return result;
 }
 
 /**
  * Handle a message being received from a remote federate.
  *
  * This function assumes the caller does not hold the mutex lock.
- * @param socket The socket to read the message from
- * @param buffer The buffer to read
+ * @param reader The reader of the socket to read the message from.
  * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param compressed How the body of the message is compressed, or NULL if it is not.
  */
-void handle_message(int socket, int fed_id) {
+void handle_message(socket_reader_t* reader, int fed_id, const compressed_body_t* compressed) {
     // FIXME: Need better error handling?
     // Read the header.
     size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read message header.");
 
     // Extract the header information.
@@ -1649,117 +2512,227 @@ void handle_message(int socket, int fed_id) {
     // Get the triggering action for the corresponding port
     lf_action_base_t* action = _lf_action_for_port(port_id);
 
-    // Read the payload.
-    // Allocate memory for the message contents.
-    unsigned char* message_contents = (unsigned char*)malloc(length);
-    read_from_socket_errexit(socket, length, message_contents,
-            "Failed to read message body.");
+    lf_token_t* message_token = read_message_token(reader, fed_id, port_id, action, length, compressed, NULL);
     // Trace the event when tracing is enabled
     tracepoint_federate_from_federate(_fed.trace, receive_P2P_MSG, _lf_my_fed_id, federate_id, NULL);
-    LF_PRINT_LOG("Message received by federate: %s. Length: %zu.", message_contents, length);
+    LF_PROBE5(federate_receive, MSG_TYPE_P2P_MESSAGE, fed_id, length, NEVER, 0u);
+    LF_PRINT_LOG("Message received by federate: %s. Length: %zu.", (char*)message_token->value, length);
 
     LF_PRINT_DEBUG("Calling schedule for message received on a physical connection.");
-    _lf_schedule_value(action, 0, message_contents, length);
+    _lf_schedule_token(action, 0, message_token);
 }
 
-void stall_advance_level_federation(environment_t* env, size_t level) {
-    LF_PRINT_DEBUG("Acquiring the environment mutex.");
-    lf_mutex_lock(&env->mutex);
-    LF_PRINT_DEBUG("Waiting on MLAA with next_reaction_level %zu and MLAA %d.", level, max_level_allowed_to_advance);
-    while (((int) level) >= max_level_allowed_to_advance) {
-        lf_cond_wait(&port_status_changed);
-    };
-    LF_PRINT_DEBUG("Exiting wait with MLAA %d and next_reaction_level %zu.", max_level_allowed_to_advance, level);
-    lf_mutex_unlock(&env->mutex);
-}
+#ifdef FEDERATED_UDP_PHYSICAL
+/** The UDP port on which this federate receives datagrams, or 0 if it does not. */
+static uint16_t udp_datagram_port = 0;
+
+/** Whether terminate_execution() has asked the datagram listener to stop. */
+static bool udp_datagram_listener_stopping = false;
+
+/** The number of datagrams dropped because a later one had been delivered to the same port. */
+static size_t udp_stale_datagrams = 0;
 
 /**
- * Handle a timed message being received from a remote federate via the RTI
- * or directly from other federates.
- * This will read the tag encoded in the header
- * and calculate an offset to pass to the schedule function.
+ * Deliver the message of a physical connection carried by the given datagram
+ * (see MSG_TYPE_P2P_DATAGRAM), unless a datagram sent after it has already
+ * been delivered to the same port. Malformed datagrams are dropped.
  * This function assumes the caller does not hold the mutex lock.
- * Instead of holding the mutex lock, this function calls
- * _lf_increment_tag_barrier with the tag carried in
- * the message header as an argument. This ensures that the current tag
- * will not advance to the tag of the message if it is in the future, or
- * the tag will not advance at all if the tag of the message is
- * now or in the past.
- * @param socket The socket to read the message from.
- * @param buffer The buffer to read.
- * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param last_sequence_numbers The sequence number of the last datagram
+ *  delivered to each port, or 0 if none has been, which this updates.
+ * @param length The length of the datagram.
+ * @param datagram The datagram.
  */
-void handle_tagged_message(int socket, int fed_id) {
-    // Environment is always the one corresponding to the top-level scheduling enclave.
-    environment_t *env;
-    _lf_get_environments(&env);
-
-    // FIXME: Need better error handling?
-    // Read the header which contains the timestamp.
-    size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t)
-            + sizeof(instant_t) + sizeof(microstep_t);
-    unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(socket, bytes_to_read, buffer,
-            "Failed to read timed message header");
+static void handle_datagram(uint32_t* last_sequence_numbers, size_t length, unsigned char* datagram) {
+    if (length < MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE || datagram[0] != MSG_TYPE_P2P_DATAGRAM) {
+        lf_print_warning("Dropping a malformed datagram of %zu bytes.", length);
+        return;
+    }
+    uint16_t fed_id = extract_uint16(&datagram[1]);
+    uint16_t port_id = extract_uint16(&datagram[1 + sizeof(uint16_t)]);
+    uint16_t federate_id = extract_uint16(&datagram[1 + 2 * sizeof(uint16_t)]);
+    uint32_t sequence_number = extract_uint32(&datagram[1 + 3 * sizeof(uint16_t)]);
+    int32_t body_length = extract_int32(&datagram[1 + 3 * sizeof(uint16_t) + sizeof(uint32_t)]);
+    if (federate_id != _lf_my_fed_id || port_id >= _lf_action_table_size
+            || body_length < 0 || (size_t)body_length != length - MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE) {
+        lf_print_warning("Dropping a malformed datagram from federate %d.", fed_id);
+        return;
+    }
+    // Sequence numbers wrap around, so compare them by their difference.
+    uint32_t last = last_sequence_numbers[port_id];
+    if (last != 0 && (int32_t)(sequence_number - last) <= 0) {
+        LF_PRINT_DEBUG("Dropping datagram %u from federate %d, since datagram %u has been delivered.",
+                sequence_number, fed_id, last);
+        udp_stale_datagrams++;
+        return;
+    }
+    last_sequence_numbers[port_id] = sequence_number;
 
-    // Extract the header information.
-    unsigned short port_id;
-    unsigned short federate_id;
-    size_t length;
-    tag_t intended_tag;
-    extract_timed_header(buffer, &port_id, &federate_id, &length, &intended_tag);
+    lf_action_base_t* action = _lf_action_for_port(port_id);
+    lf_token_t* message_token = copy_message_token(fed_id, port_id, action, (size_t)body_length,
+            &datagram[MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE]);
     // Trace the event when tracing is enabled
-    if (fed_id == -1) {
-        tracepoint_federate_from_rti(_fed.trace, receive_TAGGED_MSG, _lf_my_fed_id, &intended_tag);
-    } else {
-        tracepoint_federate_from_federate(_fed.trace, receive_P2P_TAGGED_MSG, _lf_my_fed_id, fed_id, &intended_tag);
+    tracepoint_federate_from_federate(_fed.trace, receive_P2P_MSG, _lf_my_fed_id, fed_id, NULL);
+    LF_PROBE5(federate_receive, MSG_TYPE_P2P_MESSAGE, fed_id, (size_t)body_length, NEVER, 0u);
+    LF_PRINT_LOG("Datagram %u received from federate %d. Length: %d.", sequence_number, fed_id, body_length);
+    _lf_schedule_token(action, 0, message_token);
+}
+
+/**
+ * Thread that reads the datagrams on _fed.udp_socket_for_inbound_datagrams
+ * until terminate_execution() asks it to stop.
+ * @param args Ignored.
+ */
+static void* listen_for_datagrams(void* args) {
+    unsigned char* datagram = (unsigned char*)malloc(FEDERATED_UDP_MAX_DATAGRAM);
+    // Allocated once the first datagram arrives, when the action table is set.
+    uint32_t* last_sequence_numbers = NULL;
+    if (datagram == NULL) {
+        lf_print_error_and_exit("Out of memory for datagrams.");
     }
-    // Check if the message is intended for this federate
-    assert(_lf_my_fed_id == federate_id);
-    LF_PRINT_DEBUG("Receiving message to port %d of length %zu.", port_id, length);
+    while (!lf_atomic_load_explicit(&udp_datagram_listener_stopping, LF_ATOMIC_ACQUIRE)) {
+        ssize_t length = recv(_fed.udp_socket_for_inbound_datagrams, datagram, FEDERATED_UDP_MAX_DATAGRAM, 0);
+        if (lf_atomic_load_explicit(&udp_datagram_listener_stopping, LF_ATOMIC_ACQUIRE)) {
+            break;
+        }
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                // The receive timed out, so check whether to stop.
+                continue;
+            }
+            lf_print_error("Failed to receive a datagram: %s. No more datagrams will be received.",
+                    strerror(errno));
+            break;
+        }
+        if (last_sequence_numbers == NULL) {
+            last_sequence_numbers = (uint32_t*)calloc(LF_MAX(_lf_action_table_size, 1), sizeof(uint32_t));
+            if (last_sequence_numbers == NULL) {
+                lf_print_error_and_exit("Out of memory for datagrams.");
+            }
+        }
+        handle_datagram(last_sequence_numbers, (size_t)length, datagram);
+    }
+    free(last_sequence_numbers);
+    free(datagram);
+    return NULL;
+}
 
-    // Get the triggering action for the corresponding port
-    lf_action_base_t* action = _lf_action_for_port(port_id);
+/**
+ * Open the UDP socket on which this federate receives the messages of
+ * physical connections as datagrams and start the thread that reads it.
+ * On failure, this federate rejects MSG_TYPE_P2P_UDP, and the messages go
+ * through the sockets.
+ */
+static void open_datagram_listener(void) {
+    int udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp_socket < 0) {
+        lf_print_warning("Failed to create a UDP socket for physical connections: %s.", strerror(errno));
+        return;
+    }
+    struct sockaddr_in address;
+    bzero((char*)&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(0);  // Any available port.
+    socklen_t address_length = sizeof(address);
+    // A timeout lets the listener notice that it is to stop.
+    struct timeval timeout_time = {.tv_sec = UDP_TIMEOUT_TIME / BILLION, .tv_usec = (UDP_TIMEOUT_TIME % BILLION) / 1000};
+    if (bind(udp_socket, (struct sockaddr*)&address, sizeof(address)) != 0
+            || getsockname(udp_socket, (struct sockaddr*)&address, &address_length) != 0
+            || setsockopt(udp_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_time, sizeof(timeout_time)) != 0) {
+        lf_print_warning("Failed to set up a UDP socket for physical connections: %s.", strerror(errno));
+        close(udp_socket);
+        return;
+    }
+    _fed.udp_socket_for_inbound_datagrams = udp_socket;
+    int result = lf_thread_create(&_fed.udp_datagram_listener, listen_for_datagrams, NULL);
+    if (result != 0) {
+        lf_print_warning("Failed to create a thread to receive datagrams. Error code: %d.", result);
+        close(udp_socket);
+        _fed.udp_socket_for_inbound_datagrams = -1;
+        return;
+    }
+    _lf_set_network_thread_priority(_fed.udp_datagram_listener, "datagram listener");
+    udp_datagram_port = ntohs(address.sin_port);
+    LF_PRINT_LOG("Receiving messages of physical connections as datagrams on UDP port %d.", udp_datagram_port);
+}
 
-    // Record the physical time of arrival of the message
-    instant_t time_of_arrival = lf_time_physical();
+/**
+ * Stop the thread that receives datagrams, if any, and close the UDP sockets.
+ */
+static void close_datagram_sockets(void) {
+    if (_fed.udp_socket_for_inbound_datagrams >= 0) {
+        lf_bool_compare_and_swap(&udp_datagram_listener_stopping, false, true);
+        // Unblock the listener right away where shutdown() does so on UDP sockets.
+        shutdown(_fed.udp_socket_for_inbound_datagrams, SHUT_RDWR);
+        lf_thread_join(_fed.udp_datagram_listener, NULL);
+        close(_fed.udp_socket_for_inbound_datagrams);
+        _fed.udp_socket_for_inbound_datagrams = -1;
+        if (udp_stale_datagrams > 0) {
+            LF_PRINT_LOG("Dropped %zu datagrams that arrived after later ones.", udp_stale_datagrams);
+        }
+    }
+    if (_fed.udp_socket_for_outbound_datagrams >= 0) {
+        close(_fed.udp_socket_for_outbound_datagrams);
+        _fed.udp_socket_for_outbound_datagrams = -1;
+    }
+}
+#endif // FEDERATED_UDP_PHYSICAL
 
-    if (action->trigger->is_physical) {
-        // Messages sent on physical connections should be handled via handle_message().
-        lf_print_error_and_exit("Received a timed message on a physical connection.");
+void _lf_end_outbound_batches(void) {
+    outbound_queue_end_batch(&_fed.outbound_queue_to_RTI);
+    for (int i = 0; i < NUMBER_OF_FEDERATES; i++) {
+        outbound_queue_end_batch(&_fed.outbound_queues_for_p2p_connections[i]);
     }
+}
 
-#ifdef FEDERATED_DECENTRALIZED
-    // Only applicable for federated programs with decentralized coordination:
-    // For logical connections in decentralized coordination,
-    // increment the barrier to prevent advancement of tag beyond
-    // the received tag if possible. The following function call
-    // suggests that the tag barrier be raised to the tag provided
-    // by the message. If this tag is in the past, the function will cause
-    // the tag to freeze at the current level.
-    // If something happens, make sure to release the barrier.
-    _lf_increment_tag_barrier(env, intended_tag);
+#if defined(FEDERATED_DECENTRALIZED) && defined(FEDERATED_EVENT_DRIVEN_STAA)
+static void wait_for_port_status_or_staa(environment_t* env);
 #endif
-    LF_PRINT_LOG("Received message on port %d with tag: " PRINTF_TAG ", Current tag: " PRINTF_TAG ".",
-            port_id, intended_tag.time - start_time, intended_tag.microstep,
-            lf_time_logical_elapsed(env), env->current_tag.microstep);
 
-    // Read the payload.
-    // Allocate memory for the message contents.
-    unsigned char* message_contents = (unsigned char*)malloc(length);
-    read_from_socket_errexit(socket, length, message_contents,
-            "Failed to read message body.");
-
-    // The following is only valid for string messages.
-    // LF_PRINT_DEBUG("Message received: %s.", message_contents);
+void stall_advance_level_federation(environment_t* env, size_t level) {
+    LF_PRINT_DEBUG("Acquiring the environment mutex.");
+    lf_mutex_lock(&env->mutex);
+    LF_PRINT_DEBUG("Waiting on MLAA with next_reaction_level %zu and MLAA %d.", level, max_level_allowed_to_advance);
+    while (((int) level) >= max_level_allowed_to_advance) {
+#ifdef FEDERATED_BATCH_MESSAGES
+        // The inputs awaited here may depend on messages batched during this tag.
+        _lf_end_outbound_batches();
+#endif
+#if defined(FEDERATED_DECENTRALIZED) && defined(FEDERATED_EVENT_DRIVEN_STAA)
+        wait_for_port_status_or_staa(env);
+#else
+        lf_cond_wait(&port_status_changed);
+#endif
+    };
+    LF_PRINT_DEBUG("Exiting wait with MLAA %d and next_reaction_level %zu.", max_level_allowed_to_advance, level);
+    lf_mutex_unlock(&env->mutex);
+}
 
+/**
+ * Deliver the payload of a timed message to the network input port it is
+ * intended for, either by inserting the reactions to the port directly into
+ * the reaction queue or by scheduling the action of the port.
+ * This function assumes the caller does not hold the mutex lock and, with
+ * decentralized coordination, that it has raised the tag barrier to the
+ * intended tag, which this function lowers.
+ * @param env The environment of the federate.
+ * @param action The action of the port.
+ * @param port_id The ID of the port.
+ * @param intended_tag The tag of the message.
+ * @param time_of_arrival The physical time at which the message arrived.
+ * @param message_token The token carrying the payload.
+ */
+static void deliver_tagged_message(
+        environment_t* env,
+        lf_action_base_t* action,
+        unsigned short port_id,
+        tag_t intended_tag,
+        instant_t time_of_arrival,
+        lf_token_t* message_token) {
     lf_mutex_lock(&env->mutex);
 
     action->trigger->physical_time_of_arrival = time_of_arrival;
 
-    // Create a token for the message
-    lf_token_t* message_token = _lf_new_token((token_type_t*)action, message_contents, length);
-
     // FIXME: It might be enough to just check this field and not the status at all
     update_last_known_status_on_input_port(intended_tag, port_id);
 
@@ -1841,6 +2814,159 @@ void handle_tagged_message(int socket, int fed_id) {
     lf_mutex_unlock(&env->mutex);
 }
 
+/**
+ * Handle a timed message being received from a remote federate via the RTI
+ * or directly from other federates.
+ * This will read the tag encoded in the header
+ * and calculate an offset to pass to the schedule function.
+ * This function assumes the caller does not hold the mutex lock.
+ * Instead of holding the mutex lock, this function calls
+ * _lf_increment_tag_barrier with the tag carried in
+ * the message header as an argument. This ensures that the current tag
+ * will not advance to the tag of the message if it is in the future, or
+ * the tag will not advance at all if the tag of the message is
+ * now or in the past.
+ * @param reader The reader of the socket to read the message from.
+ * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ * @param compressed How the body of the message is compressed, or NULL if it is not.
+ */
+void handle_tagged_message(socket_reader_t* reader, int fed_id, const compressed_body_t* compressed) {
+    // Environment is always the one corresponding to the top-level scheduling enclave.
+    environment_t *env;
+    _lf_get_environments(&env);
+
+    // FIXME: Need better error handling?
+    // Read the header which contains the timestamp.
+    size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t)
+            + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[bytes_to_read];
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
+            "Failed to read timed message header");
+
+    // Extract the header information.
+    unsigned short port_id;
+    unsigned short federate_id;
+    size_t length;
+    tag_t intended_tag;
+    extract_timed_header(buffer, &port_id, &federate_id, &length, &intended_tag);
+    // Trace the event when tracing is enabled
+    if (fed_id == -1) {
+        tracepoint_federate_from_rti(_fed.trace, receive_TAGGED_MSG, _lf_my_fed_id, &intended_tag);
+    } else {
+        tracepoint_federate_from_federate(_fed.trace, receive_P2P_TAGGED_MSG, _lf_my_fed_id, fed_id, &intended_tag);
+    }
+    LF_PROBE5(federate_receive, fed_id == -1 ? MSG_TYPE_TAGGED_MESSAGE : MSG_TYPE_P2P_TAGGED_MESSAGE, fed_id,
+            length, intended_tag.time, intended_tag.microstep);
+    // Check if the message is intended for this federate
+    assert(_lf_my_fed_id == federate_id);
+    LF_PRINT_DEBUG("Receiving message to port %d of length %zu.", port_id, length);
+
+    // Get the triggering action for the corresponding port
+    lf_action_base_t* action = _lf_action_for_port(port_id);
+
+    // Record the physical time of arrival of the message
+    instant_t time_of_arrival = lf_time_physical();
+
+    if (action->trigger->is_physical) {
+        // Messages sent on physical connections should be handled via handle_message().
+        lf_print_error_and_exit("Received a timed message on a physical connection.");
+    }
+
+#ifdef FEDERATED_DECENTRALIZED
+    // Only applicable for federated programs with decentralized coordination:
+    // For logical connections in decentralized coordination,
+    // increment the barrier to prevent advancement of tag beyond
+    // the received tag if possible. The following function call
+    // suggests that the tag barrier be raised to the tag provided
+    // by the message. If this tag is in the past, the function will cause
+    // the tag to freeze at the current level.
+    // If something happens, make sure to release the barrier.
+    _lf_increment_tag_barrier(env, intended_tag);
+#endif
+    LF_PRINT_LOG("Received message on port %d with tag: " PRINTF_TAG ", Current tag: " PRINTF_TAG ".",
+            port_id, intended_tag.time - start_time, intended_tag.microstep,
+            lf_time_logical_elapsed(env), env->current_tag.microstep);
+
+    lf_token_t* message_token = read_message_token(reader, fed_id, port_id, action, length, compressed, &intended_tag);
+
+    // The following is only valid for string messages.
+    // LF_PRINT_DEBUG("Message received: %s.", message_token->value);
+
+    deliver_tagged_message(env, action, port_id, intended_tag, time_of_arrival, message_token);
+}
+
+/**
+ * Handle a batch of timed messages (MSG_TYPE_TAGGED_MESSAGE_BATCH or
+ * MSG_TYPE_P2P_TAGGED_MESSAGE_BATCH) received from a remote federate via the
+ * RTI or directly from other federates. Each message in the batch is handled
+ * as by handle_tagged_message(), in the order in which they were sent.
+ * This function assumes the caller does not hold the mutex lock.
+ * @param reader The reader of the socket to read the batch from.
+ * @param fed_id The sending federate ID or -1 if the centralized coordination.
+ */
+void handle_tagged_message_batch(socket_reader_t* reader, int fed_id) {
+    // Environment is always the one corresponding to the top-level scheduling enclave.
+    environment_t *env;
+    _lf_get_environments(&env);
+
+    // The header has the layout of that of a timed message, without a port.
+    size_t bytes_to_read = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t)
+            + sizeof(instant_t) + sizeof(microstep_t);
+    unsigned char buffer[bytes_to_read];
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
+            "Failed to read timed message batch header");
+    unsigned short unused_port_id;
+    unsigned short federate_id;
+    size_t length;
+    tag_t intended_tag;
+    extract_timed_header(buffer, &unused_port_id, &federate_id, &length, &intended_tag);
+    // Check if the batch is intended for this federate
+    assert(_lf_my_fed_id == federate_id);
+    instant_t time_of_arrival = lf_time_physical();
+
+    // Each entry is read directly into the token that will carry it.
+    size_t entry_header_length = sizeof(uint16_t) + sizeof(int32_t);
+    size_t remaining = length;
+    while (remaining > 0) {
+        if (remaining < entry_header_length) {
+            lf_print_error_and_exit("Received a malformed timed message batch.");
+        }
+        read_from_socket_reader_errexit(reader, entry_header_length, buffer,
+                "Failed to read timed message batch.");
+        unsigned short port_id = extract_uint16(buffer);
+        size_t message_length = (size_t)extract_int32(&buffer[sizeof(uint16_t)]);
+        remaining -= entry_header_length;
+        if (message_length > remaining) {
+            lf_print_error_and_exit("Received a malformed timed message batch.");
+        }
+        remaining -= message_length;
+        // Trace the event when tracing is enabled
+        if (fed_id == -1) {
+            tracepoint_federate_from_rti(_fed.trace, receive_TAGGED_MSG, _lf_my_fed_id, &intended_tag);
+        } else {
+            tracepoint_federate_from_federate(_fed.trace, receive_P2P_TAGGED_MSG, _lf_my_fed_id, fed_id, &intended_tag);
+        }
+        LF_PROBE5(federate_receive, fed_id == -1 ? MSG_TYPE_TAGGED_MESSAGE : MSG_TYPE_P2P_TAGGED_MESSAGE, fed_id,
+                message_length, intended_tag.time, intended_tag.microstep);
+        LF_PRINT_DEBUG("Receiving batched message to port %d of length %zu.", port_id, message_length);
+
+        lf_action_base_t* action = _lf_action_for_port(port_id);
+        if (action->trigger->is_physical) {
+            // Messages sent on physical connections should be handled via handle_message().
+            lf_print_error_and_exit("Received a timed message on a physical connection.");
+        }
+#ifdef FEDERATED_DECENTRALIZED
+        // As in handle_tagged_message(), raise the tag barrier to the tag of
+        // the message. deliver_tagged_message() lowers it again.
+        _lf_increment_tag_barrier(env, intended_tag);
+#endif
+        lf_token_t* message_token = read_message_token(reader, fed_id, port_id, action, message_length,
+                NULL, &intended_tag);
+
+        deliver_tagged_message(env, action, port_id, intended_tag, time_of_arrival, message_token);
+    }
+}
+
 /**
  * Handle a time advance grant (TAG) message from the RTI.
  * This updates the last known status tag for each network input
@@ -1853,15 +2979,16 @@ void handle_tagged_message(int socket, int fed_id) {
  *
  * @note This function is very similar to handle_provisinal_tag_advance_grant() except that
  *  it sets last_TAG_was_provisional to false.
+ * @param reader The reader of the socket connected to the RTI.
  */
-void handle_tag_advance_grant(void) {
+void handle_tag_advance_grant(socket_reader_t* reader) {
     // Environment is always the one corresponding to the top-level scheduling enclave.
     environment_t *env;
     _lf_get_environments(&env);
 
     size_t bytes_to_read = sizeof(instant_t) + sizeof(microstep_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(_fed.socket_TCP_RTI, bytes_to_read, buffer,
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read tag advance grant from RTI.");
     tag_t TAG = extract_tag(buffer);
 
@@ -1925,47 +3052,29 @@ bool update_max_level(tag_t tag, bool is_provisional) {
     max_level_allowed_to_advance = INT_MAX;
     if ((lf_tag_compare(env->current_tag, tag) < 0) || (
         lf_tag_compare(env->current_tag, tag) == 0 && !is_provisional
-    )) {
-        LF_PRINT_DEBUG("Updated MLAA to %d at time " PRINTF_TIME ".",
-              max_level_allowed_to_advance,
-              lf_time_logical_elapsed(env)
-        );
-        // Safe to complete the current tag
-        return (prev_max_level_allowed_to_advance != max_level_allowed_to_advance);
-    }
-#ifdef FEDERATED_DECENTRALIZED
-    size_t action_table_size = _lf_action_table_size;
-    lf_action_base_t** action_table = _lf_action_table;
-#else
-    size_t action_table_size = _lf_zero_delay_action_table_size;
-    lf_action_base_t** action_table = _lf_zero_delay_action_table;
-#endif // FEDERATED_DECENTRALIZED
-    for (int i = 0; i < action_table_size; i++) {
-        lf_action_base_t* input_port_action = action_table[i];
-#ifdef FEDERATED_DECENTRALIZED
-        // In decentralized execution, if the current_tag is close enough to the
-        // start tag and there is a large enough delay on an incoming
-        // connection, then there is no need to block progress waiting for this
-        // port status.
-        if (
-            (_lf_action_delay_table[i] == 0 && env->current_tag.time == start_time && env->current_tag.microstep == 0)
-            || (_lf_action_delay_table[i] > 0 && lf_tag_compare(
-                env->current_tag,
-                lf_delay_strict((tag_t) {.time=start_time, .microstep=0}, _lf_action_delay_table[i])
-            ) <= 0)
-        ) {
-            continue;
-        }
-#endif // FEDERATED_DECENTRALIZED
-        if (lf_tag_compare(env->current_tag,
-                input_port_action->trigger->last_known_status_tag) > 0
-                && !input_port_action->trigger->is_physical) {
-            max_level_allowed_to_advance = LF_MIN(
-                max_level_allowed_to_advance,
-                ((int) LF_LEVEL(input_port_action->trigger->reactions[0]->index))
-            );
+    )) {
+        LF_PRINT_DEBUG("Updated MLAA to %d at time " PRINTF_TIME ".",
+              max_level_allowed_to_advance,
+              lf_time_logical_elapsed(env)
+        );
+        // Safe to complete the current tag
+        return (prev_max_level_allowed_to_advance != max_level_allowed_to_advance);
+    }
+    if (mlaa_ports == NULL || mlaa_start_time != start_time) {
+        mlaa_build();
+    }
+    // The ports whose status is not known at the current tag hold back the MLAA.
+    while (mlaa_resolved.size > 0
+            && lf_tag_compare(env->current_tag, mlaa_resolved.entries[0].priority) > 0) {
+        mlaa_port_t* port = mlaa_tag_heap_pop(&mlaa_resolved);
+        port->unresolved = true;
+        if (mlaa_level_heap_insert(&mlaa_unresolved, port, port->level)) {
+            lf_print_error_and_exit("Out of memory.");
         }
     }
+    if (mlaa_unresolved.size > 0) {
+        max_level_allowed_to_advance = mlaa_unresolved.entries[0].priority;
+    }
     LF_PRINT_DEBUG("Updated MLAA to %d at time " PRINTF_TIME ".",
         max_level_allowed_to_advance,
         lf_time_logical_elapsed(env)
@@ -2001,61 +3110,203 @@ static int id_of_action(lf_action_base_t* input_port_action) {
     // There will be no UB buffer overrun because _lf_action_for_port(i) has a check.
 }
 
+#ifdef FEDERATED_DECENTRALIZED
+/**
+ * An entry of the schedule by which unknown ports are assumed absent.
+ */
+typedef struct staa_deadline_t {
+    /** The STAA struct of the ports. */
+    staa_t* staa;
+    /**
+     * The offset from the current time, before the STA offset is added,
+     * at which the unknown ports are assumed absent.
+     */
+    interval_t offset;
+    /** The port IDs of the actions of the STAA struct. */
+    int* port_ids;
+} staa_deadline_t;
+
+/**
+ * The STAA structs sorted by offset, which are the same at every tag,
+ * or NULL if there are none.
+ */
+static staa_deadline_t* staa_schedule = NULL;
+
+#ifdef FEDERATED_EVENT_DRIVEN_STAA
+/** The tag at which staa_next_deadline applies. */
+static tag_t staa_tag = {.time = NEVER, .microstep = 0u};
+
+/**
+ * The index in staa_schedule of the first STAA struct whose deadline has not
+ * been handled at staa_tag. This is guarded by the environment mutex.
+ */
+static size_t staa_next_deadline = 0;
+#endif
+
+/**
+ * Compare two entries of the STAA schedule by their offsets, for qsort().
+ */
+static int compare_staa_deadlines(const void* a, const void* b) {
+    interval_t offset_a = ((const staa_deadline_t*)a)->offset;
+    interval_t offset_b = ((const staa_deadline_t*)b)->offset;
+    return (offset_a > offset_b) - (offset_a < offset_b);
+}
+
+/**
+ * Sort the STAA structs by offset into staa_schedule.
+ */
+static void initialize_staa_schedule() {
+    if (staa_lst_size == 0) return;
+    staa_schedule = (staa_deadline_t*)calloc(staa_lst_size, sizeof(staa_deadline_t));
+    lf_assert(staa_schedule != NULL, "Out of memory");
+    for (size_t i = 0; i < staa_lst_size; i++) {
+        staa_schedule[i].staa = staa_lst[i];
+        staa_schedule[i].offset = (interval_t)staa_lst[i]->STAA - _lf_action_delay_table[i];
+        staa_schedule[i].port_ids = (int*)calloc(staa_lst[i]->numActions, sizeof(int));
+        lf_assert(staa_schedule[i].port_ids != NULL, "Out of memory");
+        for (size_t j = 0; j < staa_lst[i]->numActions; j++) {
+            staa_schedule[i].port_ids[j] = id_of_action(staa_lst[i]->actions[j]);
+        }
+    }
+    qsort(staa_schedule, staa_lst_size, sizeof(staa_deadline_t), compare_staa_deadlines);
+}
+
+/**
+ * Return the deadline at the specified tag of the STAA struct at the specified
+ * index in staa_schedule, which includes the STA offset that currently applies.
+ * @param tag The current tag.
+ * @param index The index in staa_schedule.
+ */
+static instant_t staa_deadline(tag_t tag, size_t index) {
+    return tag.time + staa_schedule[index].offset + _lf_adaptive_STA_offset();
+}
+
+/**
+ * Skip the STAA structs of the schedule from the specified one on whose ports
+ * are all known, and return the index of the first one with an unknown port,
+ * or staa_lst_size if there is none.
+ * This function assumes the caller holds the environment mutex.
+ * @param next The index in staa_schedule at which to start.
+ */
+static size_t next_unknown_staa(size_t next) {
+    while (next < staa_lst_size && !a_port_is_unknown(staa_schedule[next].staa)) {
+        next++;
+    }
+    return next;
+}
+
+/**
+ * Assume absent the unknown ports of the STAA structs of the schedule,
+ * from the specified one on, whose deadlines at the specified tag are
+ * no later than the specified deadline, and update the MLAA if any port
+ * was assumed absent.
+ * This function assumes the caller holds the environment mutex.
+ * @param tag The current tag.
+ * @param deadline The deadline that has passed.
+ * @param next The index in staa_schedule at which to start.
+ * @return The index of the first STAA struct whose deadline has not passed.
+ */
+static size_t assume_ports_absent(tag_t tag, instant_t deadline, size_t next) {
+    bool changed = false;
+    for (; next < staa_lst_size && staa_deadline(tag, next) <= deadline; next++) {
+        staa_t* staa_elem = staa_schedule[next].staa;
+        for (int j = 0; j < staa_elem->numActions; ++j) {
+            lf_action_base_t* input_port_action = staa_elem->actions[j];
+            if (input_port_action->trigger->status == unknown) {
+                input_port_action->trigger->status = absent;
+                LF_PRINT_DEBUG("Assuming port absent at time %lld.", (long long) (tag.time - start_time));
+                update_last_known_status_on_input_port(tag, staa_schedule[next].port_ids[j]);
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        update_max_level(_fed.last_TAG, _fed.is_last_TAG_provisional);
+        lf_cond_broadcast(&port_status_changed);
+    }
+    return next;
+}
+
+#ifdef FEDERATED_EVENT_DRIVEN_STAA
+/**
+ * Wait on port_status_changed as a worker that is stalled on the MLAA does,
+ * but only until the earliest deadline at the current tag of an STAA struct
+ * with an unknown port, after which its unknown ports are assumed absent.
+ * This replaces the thread that otherwise assumes ports absent, so that
+ * no thread wakes up at every tag unless a port is actually unknown.
+ * This function assumes the caller holds the environment mutex.
+ * @param env The environment.
+ */
+static void wait_for_port_status_or_staa(environment_t* env) {
+    tag_t tag = lf_tag(env);
+    if (lf_tag_compare(tag, staa_tag) != 0) {
+        staa_tag = tag;
+        staa_next_deadline = 0;
+    }
+    staa_next_deadline = next_unknown_staa(staa_next_deadline);
+    if (staa_next_deadline >= staa_lst_size) {
+        lf_cond_wait(&port_status_changed);
+        return;
+    }
+    instant_t deadline = staa_deadline(tag, staa_next_deadline);
+    // The wait returns early if a port status changes, and busy waiting
+    // releases the mutex, so check the tag again afterwards.
+    if (wait_until(env, deadline, &port_status_changed)
+            && lf_tag_compare(lf_tag(env), tag) == 0) {
+        staa_next_deadline = assume_ports_absent(tag, deadline, staa_next_deadline);
+    }
+}
+#else
 /**
  * @brief Given a list of staa offsets and its associated triggers,
- * have a single thread work to set ports to absent at a given logical time
+ * have a single thread work to set ports to absent at a given logical time.
  *
+ * The offsets are the same at every tag, so the STAA structs are sorted
+ * by offset once. At each tag, the thread then sleeps until the earliest
+ * deadline with a port still unknown, assumes absent the unknown ports of
+ * all STAA structs whose deadlines have passed, and moves on to the next
+ * deadline. It holds the mutex except while sleeping and is woken early
+ * only when the tag changes.
  */
-#ifdef FEDERATED_DECENTRALIZED
 static void* update_ports_from_staa_offsets(void* args) {
+    if (staa_lst_size == 0) return NULL;
     environment_t *env;
-    int num_envs = _lf_get_environments(&env);
+    _lf_get_environments(&env);
+
+    lf_mutex_lock(&env->mutex);
     while (1) {
-        bool restart = false;
-        tag_t tag_when_started_waiting = lf_tag(env);
-        for (int i = 0; i < staa_lst_size; ++i) {
-            staa_t* staa_elem = staa_lst[i];
-            interval_t wait_until_time = env->current_tag.time + staa_elem->STAA + _lf_fed_STA_offset - _lf_action_delay_table[i];
-            lf_mutex_lock(&env->mutex);
-            // Both before and after the wait, check that the tag has not changed
-            if (a_port_is_unknown(staa_elem) && lf_tag_compare(lf_tag(env), tag_when_started_waiting) == 0 && wait_until(env, wait_until_time, &port_status_changed) && lf_tag_compare(lf_tag(env), tag_when_started_waiting) == 0) {
-                for (int j = 0; j < staa_elem->numActions; ++j) {
-                    lf_action_base_t* input_port_action = staa_elem->actions[j];
-                    if (input_port_action->trigger->status == unknown) {
-                        input_port_action->trigger->status = absent;
-                        LF_PRINT_DEBUG("Assuming port absent at time %lld.", (long long) (lf_tag(env).time - start_time));
-                        update_last_known_status_on_input_port(lf_tag(env), id_of_action(input_port_action));
-                        update_max_level(_fed.last_TAG, _fed.is_last_TAG_provisional);
-                        lf_cond_broadcast(&port_status_changed);
-                    }
-                }
-                lf_mutex_unlock(&env->mutex);
-            } else if (lf_tag_compare(lf_tag(env), tag_when_started_waiting) != 0) {
-                // We have committed to a new tag before we finish processing the list. Start over.
-                restart = true;
-                lf_mutex_unlock(&env->mutex);
-                break;
-            } else {
-                lf_mutex_unlock(&env->mutex);
+        tag_t tag = lf_tag(env);
+        size_t next = 0;
+        while ((next = next_unknown_staa(next)) < staa_lst_size
+                && lf_tag_compare(lf_tag(env), tag) == 0) {
+            instant_t deadline = staa_deadline(tag, next);
+            // The wait returns early if the tag changes, and busy waiting
+            // releases the mutex, so check the tag again afterwards.
+            if (!wait_until(env, deadline, &logical_time_changed)
+                    || lf_tag_compare(lf_tag(env), tag) != 0) {
+                continue;
             }
+            // Assume absent the unknown ports of all STAA structs whose deadlines have passed.
+            next = assume_ports_absent(tag, deadline, next);
         }
-        if (restart) continue;
-
-        lf_mutex_lock(&env->mutex);
-        while (lf_tag_compare(lf_tag(env), tag_when_started_waiting) == 0) {
+        while (lf_tag_compare(lf_tag(env), tag) == 0) {
             lf_cond_wait(&logical_time_changed);
         }
-        lf_mutex_unlock(&env->mutex);
     }
 }
+#endif // FEDERATED_EVENT_DRIVEN_STAA
 
 /**
  * @brief Spawns a thread to iterate through STAA structs, setting its associated ports absent
  * at an offset if the port is not present with a value by a certain physical time.
- *
+ * With FEDERATED_EVENT_DRIVEN_STAA, no thread is spawned and the workers
+ * stalled on the MLAA set the ports absent instead.
  */
 void spawn_staa_thread(){
+    initialize_staa_schedule();
+#ifndef FEDERATED_EVENT_DRIVEN_STAA
     lf_thread_create(&_fed.staaSetter, update_ports_from_staa_offsets, NULL);
+#endif
 }
 #endif
 
@@ -2073,15 +3324,16 @@ void spawn_staa_thread(){
  * @note This function is similar to handle_tag_advance_grant() except that
  *  it sets last_TAG_was_provisional to true and also it does not update the
  *  last known tag for input ports.
+ * @param reader The reader of the socket connected to the RTI.
  */
-void handle_provisional_tag_advance_grant() {
+void handle_provisional_tag_advance_grant(socket_reader_t* reader) {
     // Environment is always the one corresponding to the top-level scheduling enclave.
     environment_t *env;
     _lf_get_environments(&env);
 
     size_t bytes_to_read = sizeof(instant_t) + sizeof(microstep_t);
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(_fed.socket_TCP_RTI, bytes_to_read, buffer,
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read provisional tag advance grant from RTI.");
     tag_t PTAG = extract_tag(buffer);
 
@@ -2163,7 +3415,7 @@ void handle_provisional_tag_advance_grant() {
         // Dummy event points to a NULL trigger and NULL real event.
         event_t* dummy = _lf_create_dummy_events(env,
                 NULL, dummy_event_time, NULL, dummy_event_relative_microstep);
-        pqueue_insert(env->event_q, dummy);
+        _lf_insert_event(env, dummy);
     }
 
     lf_mutex_unlock(&env->mutex);
@@ -2190,17 +3442,17 @@ int _lf_fd_send_stop_request_to_rti(tag_t stop_tag) {
                 stop_tag.time - start_time,
                 stop_tag.microstep);
 
-        if (_fed.socket_TCP_RTI < 0) {
-            lf_print_warning("Socket is no longer connected. Dropping message.");
-            lf_mutex_unlock(&outbound_socket_mutex);
-            return -1;
-        }
         // Trace the event when tracing is enabled
         tracepoint_federate_to_rti(_fed.trace, send_STOP_REQ, _lf_my_fed_id, &stop_tag);
-        write_to_socket_with_mutex(_fed.socket_TCP_RTI, MSG_TYPE_STOP_REQUEST_LENGTH,
-                buffer, &outbound_socket_mutex,
-                "Failed to send stop time " PRINTF_TIME " to the RTI.", stop_tag.time - start_time);
+        int result = outbound_queue_send(&_fed.outbound_queue_to_RTI, MSG_TYPE_STOP_REQUEST_LENGTH,
+                buffer, 0, NULL);
         lf_mutex_unlock(&outbound_socket_mutex);
+        if (result == 0) {
+            lf_print_warning("Socket is no longer connected. Dropping message.");
+            return -1;
+        } else if (result < 0) {
+            lf_print_error("Failed to send stop time " PRINTF_TIME " to the RTI.", stop_tag.time - start_time);
+        }
         return 0;
     } else {
         lf_mutex_unlock(&outbound_socket_mutex);
@@ -2214,12 +3466,13 @@ int _lf_fd_send_stop_request_to_rti(tag_t stop_tag) {
  * This function removes the global barrier on
  * logical time raised when lf_request_stop() was
  * called in the environment for each enclave.
+ * @param reader The reader of the socket connected to the RTI.
  */
-void handle_stop_granted_message() {
+void handle_stop_granted_message(socket_reader_t* reader) {
 
     size_t bytes_to_read = MSG_TYPE_STOP_GRANTED_LENGTH - 1;
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(_fed.socket_TCP_RTI, bytes_to_read, buffer,
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read stop granted from RTI.");
 
     tag_t received_stop_tag = extract_tag(buffer);
@@ -2261,11 +3514,12 @@ void handle_stop_granted_message() {
 
 /**
  * Handle a MSG_TYPE_STOP_REQUEST message from the RTI.
+ * @param reader The reader of the socket connected to the RTI.
  */
-void handle_stop_request_message() {
+void handle_stop_request_message(socket_reader_t* reader) {
     size_t bytes_to_read = MSG_TYPE_STOP_REQUEST_LENGTH - 1;
     unsigned char buffer[bytes_to_read];
-    read_from_socket_errexit(_fed.socket_TCP_RTI, bytes_to_read, buffer,
+    read_from_socket_reader_errexit(reader, bytes_to_read, buffer,
             "Failed to read stop request from RTI.");
     tag_t tag_to_stop = extract_tag(buffer);
 
@@ -2321,20 +3575,17 @@ void handle_stop_request_message() {
     unsigned char outgoing_buffer[MSG_TYPE_STOP_REQUEST_REPLY_LENGTH];
     ENCODE_STOP_REQUEST_REPLY(outgoing_buffer, tag_to_stop.time, tag_to_stop.microstep);
 
-    lf_mutex_lock(&outbound_socket_mutex);
-    if (_fed.socket_TCP_RTI < 0) {
-        lf_print_warning("Socket is no longer connected. Dropping message.");
-        lf_mutex_unlock(&outbound_socket_mutex);
-        return;
-    }
     // Trace the event when tracing is enabled
     tracepoint_federate_to_rti(_fed.trace, send_STOP_REQ_REP, _lf_my_fed_id, &tag_to_stop);
     // Send the current logical time to the RTI. This message does not have an identifying byte
     // since the RTI is waiting for a response from this federate.
-    write_to_socket_with_mutex(
-            _fed.socket_TCP_RTI, MSG_TYPE_STOP_REQUEST_REPLY_LENGTH, outgoing_buffer, &outbound_socket_mutex,
-            "Failed to send the answer to MSG_TYPE_STOP_REQUEST to RTI.");
-    lf_mutex_unlock(&outbound_socket_mutex);
+    int result = outbound_queue_send(&_fed.outbound_queue_to_RTI,
+            MSG_TYPE_STOP_REQUEST_REPLY_LENGTH, outgoing_buffer, 0, NULL);
+    if (result == 0) {
+        lf_print_warning("Socket is no longer connected. Dropping message.");
+    } else if (result < 0) {
+        lf_print_error("Failed to send the answer to MSG_TYPE_STOP_REQUEST to RTI.");
+    }
 }
 
 /**
@@ -2360,7 +3611,7 @@ void terminate_execution(environment_t* env) {
     for (int i=0; i < NUMBER_OF_FEDERATES; i++) {
         // Close outbound connections, in case they have not closed themselves.
         // This will result in EOF being sent to the remote federate, I think.
-        _lf_close_outbound_socket(i);
+        _lf_close_outbound_socket(i, true);
     }
     // Resign the federation, which will close the socket to the RTI.
     if (_fed.socket_TCP_RTI >= 0) {
@@ -2371,8 +3622,10 @@ void terminate_execution(environment_t* env) {
         encode_tag(&(buffer[1]), tag);
         // Trace the event when tracing is enabled
         tracepoint_federate_to_rti(_fed.trace, send_RESIGN, _lf_my_fed_id, &tag);
-        ssize_t written = write_to_socket(_fed.socket_TCP_RTI, bytes_to_write, &(buffer[0]));
-        if (written == bytes_to_write) {
+        int result = outbound_queue_send(&_fed.outbound_queue_to_RTI, bytes_to_write, &(buffer[0]), 0, NULL);
+        // Write out everything queued for the RTI, ending with the resignation.
+        outbound_queue_close(&_fed.outbound_queue_to_RTI, true);
+        if (result > 0) {
             LF_PRINT_LOG("Resigned.");
         }
     }
@@ -2387,27 +3640,302 @@ void terminate_execution(environment_t* env) {
         }
     }
 
-    LF_PRINT_DEBUG("Waiting for inbound p2p socket listener threads.");
-    // Wait for each inbound socket listener thread to close.
-    if (_fed.number_of_inbound_p2p_connections > 0) {
-        LF_PRINT_LOG("Waiting for %zu threads listening for incoming messages to exit.",
-                _fed.number_of_inbound_p2p_connections);
-        for (int i=0; i < _fed.number_of_inbound_p2p_connections; i++) {
+    if (_fed.socket_poller.threads != NULL) {
+        LF_PRINT_DEBUG("Waiting for the inbound sockets to close.");
+        socket_poller_wait(&_fed.socket_poller);
+        socket_poller_close(&_fed.socket_poller);
+        for (size_t i = 0; i < _fed.number_of_transport_listeners; i++) {
             // Ignoring errors here.
             lf_thread_join(_fed.inbound_socket_listeners[i], NULL);
         }
+    } else {
+        LF_PRINT_DEBUG("Waiting for inbound p2p socket listener threads.");
+        // Wait for each inbound socket listener thread to close.
+        if (_fed.number_of_inbound_p2p_connections > 0) {
+            LF_PRINT_LOG("Waiting for %zu threads listening for incoming messages to exit.",
+                    _fed.number_of_inbound_p2p_connections);
+            for (int i=0; i < _fed.number_of_inbound_p2p_connections; i++) {
+                // Ignoring errors here.
+                lf_thread_join(_fed.inbound_socket_listeners[i], NULL);
+            }
+        }
+
+        LF_PRINT_DEBUG("Waiting for RTI's socket listener threads.");
+        // Wait for the thread listening for messages from the RTI to close.
+        lf_thread_join(_fed.RTI_socket_listener, NULL);
     }
 
-    LF_PRINT_DEBUG("Waiting for RTI's socket listener threads.");
-    // Wait for the thread listening for messages from the RTI to close.
-    lf_thread_join(_fed.RTI_socket_listener, NULL);
+#ifdef FEDERATED_UDP_PHYSICAL
+    close_datagram_sockets();
+#endif
 
     LF_PRINT_DEBUG("Freeing memory occupied by the federate.");
     free(_fed.inbound_socket_listeners);
+    free(port_serializers);
+    port_serializers = NULL;
     free(federation_metadata.rti_host);
     free(federation_metadata.rti_user);
 }
 
+/**
+ * Reply to the offer of a transport by a peer federate. If the given
+ * transport is not NULL, the offer is accepted, and further reads through
+ * the given reader come from the transport.
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ * @param transport The reading side of the transport, or NULL to reject the offer.
+ * @param body_length The number of bytes to send after MSG_TYPE_ACK.
+ * @param body The bytes to send after MSG_TYPE_ACK.
+ */
+static void reply_to_transport_offer(
+        socket_reader_t* reader,
+        int fed_id,
+        transport_t* transport,
+        size_t body_length,
+        unsigned char* body) {
+    unsigned char response[2];
+    if (transport != NULL) {
+        LF_PRINT_LOG("Receiving messages from federate %d through %s.", fed_id, transport->name);
+        reader->transport = transport;
+        response[0] = MSG_TYPE_ACK;
+        write_header_and_body_to_socket_with_mutex(reader->socket, 1, response, body_length, body, NULL,
+                "Failed to accept the offer of %s from federate %d.", transport->name, fed_id);
+    } else {
+        response[0] = MSG_TYPE_REJECT;
+        response[1] = TRANSPORT_UNAVAILABLE;
+        write_to_socket_errexit(reader->socket, 2, response,
+                "Failed to reject an offer from federate %d.", fed_id);
+    }
+}
+
+/**
+ * Handle an offer of a peer federate to send its messages through a ring in
+ * shared memory (see MSG_TYPE_P2P_SHARED_MEMORY).
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ */
+static void handle_shared_memory_offer(socket_reader_t* reader, int fed_id) {
+    unsigned char name_length;
+    read_from_socket_reader_errexit(reader, 1, &name_length,
+            "Failed to read offer of shared memory from federate %d.", fed_id);
+    char name[name_length + 1];
+    read_from_socket_reader_errexit(reader, name_length, (unsigned char*)name,
+            "Failed to read offer of shared memory from federate %d.", fed_id);
+    name[name_length] = '\0';
+
+    transport_t* transport = NULL;
+    int result = (reader->transport == NULL) ? shm_ring_attach(name, reader->socket, &transport) : EALREADY;
+    if (result != 0) {
+        lf_print_warning("Failed to use shared memory %s offered by federate %d. Error code: %d.",
+                name, fed_id, result);
+    }
+    reply_to_transport_offer(reader, fed_id, transport, 0, NULL);
+}
+
+/**
+ * Handle an offer of a peer federate to send its messages over RDMA
+ * (see MSG_TYPE_P2P_RDMA). Without FEDERATED_RDMA, the offer is rejected.
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ */
+static void handle_rdma_offer(socket_reader_t* reader, int fed_id) {
+    unsigned char buffer[RDMA_ENDPOINT_SIZE];
+    read_from_socket_reader_errexit(reader, RDMA_ENDPOINT_SIZE, buffer,
+            "Failed to read offer of RDMA from federate %d.", fed_id);
+    transport_t* transport = NULL;
+#ifdef FEDERATED_RDMA
+    rdma_endpoint_t remote;
+    rdma_endpoint_decode(buffer, &remote);
+    rdma_endpoint_t local;
+    int result = (reader->transport == NULL)
+            ? rdma_transport_open(false, reader->socket, &transport, &local) : EALREADY;
+    if (result == 0) {
+        result = rdma_transport_connect(transport, &remote);
+        if (result != 0) {
+            transport_close(transport);
+            transport = NULL;
+        }
+    }
+    if (result != 0) {
+        lf_print_warning("Failed to use RDMA offered by federate %d. Error code: %d.", fed_id, result);
+    } else {
+        rdma_endpoint_encode(&local, buffer);
+    }
+#else
+    LF_PRINT_LOG("Rejecting RDMA offered by federate %d, since FEDERATED_RDMA is not defined.", fed_id);
+#endif
+    reply_to_transport_offer(reader, fed_id, transport, RDMA_ENDPOINT_SIZE, buffer);
+}
+
+/**
+ * Handle an offer of a peer federate to compress the bodies of large messages
+ * (see MSG_TYPE_P2P_COMPRESSION).
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ */
+static void handle_compression_offer(socket_reader_t* reader, int fed_id) {
+    unsigned char offered;
+    read_from_socket_reader_errexit(reader, 1, &offered,
+            "Failed to read offer of compression from federate %d.", fed_id);
+    compression_t algorithm = compression_choose(offered);
+    unsigned char response[2];
+    if (algorithm != COMPRESSION_NONE) {
+        LF_PRINT_LOG("Receiving messages from federate %d compressed with %s.",
+                fed_id, compression_name(algorithm));
+        response[0] = MSG_TYPE_ACK;
+        response[1] = (unsigned char)algorithm;
+    } else {
+        response[0] = MSG_TYPE_REJECT;
+        response[1] = COMPRESSION_UNAVAILABLE;
+    }
+    write_to_socket_errexit(reader->socket, 2, response,
+            "Failed to reply to the offer of compression from federate %d.", fed_id);
+}
+
+/**
+ * Handle an offer of a peer federate to send the messages of physical
+ * connections as UDP datagrams (see MSG_TYPE_P2P_UDP). Without
+ * FEDERATED_UDP_PHYSICAL, the offer is rejected.
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ */
+static void handle_udp_offer(socket_reader_t* reader, int fed_id) {
+    unsigned char response[1 + sizeof(uint16_t)];
+#ifdef FEDERATED_UDP_PHYSICAL
+    if (udp_datagram_port != 0) {
+        LF_PRINT_LOG("Receiving messages of physical connections from federate %d as datagrams.", fed_id);
+        response[0] = MSG_TYPE_ACK;
+        encode_uint16(udp_datagram_port, &response[1]);
+        write_to_socket_errexit(reader->socket, sizeof(response), response,
+                "Failed to accept the offer of UDP from federate %d.", fed_id);
+        return;
+    }
+#else
+    LF_PRINT_LOG("Rejecting UDP offered by federate %d, since FEDERATED_UDP_PHYSICAL is not defined.", fed_id);
+#endif
+    response[0] = MSG_TYPE_REJECT;
+    response[1] = UDP_UNAVAILABLE;
+    write_to_socket_errexit(reader->socket, 2, response,
+            "Failed to reject the offer of UDP from federate %d.", fed_id);
+}
+
+/**
+ * Handle a message with a compressed body (MSG_TYPE_P2P_COMPRESSED_MESSAGE)
+ * received from a peer federate.
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ */
+static void handle_compressed_message(socket_reader_t* reader, int fed_id) {
+    // The algorithm, the original length, and the type of the enclosed message.
+    unsigned char buffer[1 + sizeof(int32_t) + 1];
+    read_from_socket_reader_errexit(reader, sizeof(buffer), buffer,
+            "Failed to read compressed message header.");
+    compressed_body_t compressed;
+    compressed.algorithm = (compression_t)buffer[0];
+    compressed.original_length = (size_t)extract_int32(&buffer[1]);
+    switch (buffer[1 + sizeof(int32_t)]) {
+        case MSG_TYPE_P2P_MESSAGE:
+            handle_message(reader, fed_id, &compressed);
+            break;
+        case MSG_TYPE_P2P_TAGGED_MESSAGE:
+            handle_tagged_message(reader, fed_id, &compressed);
+            break;
+        default:
+            lf_print_error_and_exit("Received a compressed message of type %d from federate %d.",
+                    buffer[1 + sizeof(int32_t)], fed_id);
+    }
+}
+
+/**
+ * Close the transport that the given reader has been reading, if any.
+ * @param reader The reader.
+ */
+static void close_reader_transport(socket_reader_t* reader) {
+    if (reader->transport != NULL) {
+        transport_close(reader->transport);
+        reader->transport = NULL;
+    }
+}
+
+/**
+ * Read one message from a peer federate and call the appropriate handler.
+ * @param reader The reader of the socket connected to the federate.
+ * @param fed_id The ID of the federate.
+ * @return false if the connection to the federate has been closed, and true otherwise.
+ */
+static bool handle_message_from_federate(socket_reader_t* reader, uint16_t fed_id) {
+    // Buffer for incoming messages.
+    // This does not constrain the message size
+    // because the message will be put into malloc'd memory.
+    unsigned char buffer[FED_COM_BUFFER_SIZE];
+
+    // Read one byte to get the message type.
+    LF_PRINT_DEBUG("Waiting for a P2P message on socket %d.", reader->socket);
+    ssize_t bytes_read = read_from_socket_reader_errexit(reader, 1, buffer, NULL);
+    if (bytes_read == 0) {
+        // EOF occurred. This breaks the connection.
+        lf_print("Received EOF from peer federate %d. Closing the socket.", fed_id);
+        _lf_close_inbound_socket(fed_id);
+        return false;
+    } else if (bytes_read < 0) {
+        lf_print_error("P2P socket to federate %d is broken.", fed_id);
+        _lf_close_inbound_socket(fed_id);
+        return false;
+    }
+    LF_PRINT_DEBUG("Received a P2P message on socket %d of type %d.",
+            reader->socket, buffer[0]);
+    bool bad_message = false;
+    switch (buffer[0]) {
+        case MSG_TYPE_P2P_MESSAGE:
+            LF_PRINT_LOG("Received untimed message from federate %d.", fed_id);
+            handle_message(reader, fed_id, NULL);
+            break;
+        case MSG_TYPE_P2P_TAGGED_MESSAGE:
+            LF_PRINT_LOG("Received timed message from federate %d.", fed_id);
+            handle_tagged_message(reader, fed_id, NULL);
+            break;
+        case MSG_TYPE_P2P_TAGGED_MESSAGE_BATCH:
+            LF_PRINT_LOG("Received batch of timed messages from federate %d.", fed_id);
+            handle_tagged_message_batch(reader, fed_id);
+            break;
+        case MSG_TYPE_PORT_ABSENT:
+        case MSG_TYPE_PORT_ABSENT_BATCH:
+            LF_PRINT_LOG("Received port absent message from federate %d.", fed_id);
+            handle_port_absent_message(reader, fed_id, buffer[0]);
+            break;
+        case MSG_TYPE_P2P_SHARED_MEMORY:
+            LF_PRINT_LOG("Received offer of shared memory from federate %d.", fed_id);
+            handle_shared_memory_offer(reader, fed_id);
+            break;
+        case MSG_TYPE_P2P_RDMA:
+            LF_PRINT_LOG("Received offer of RDMA from federate %d.", fed_id);
+            handle_rdma_offer(reader, fed_id);
+            break;
+        case MSG_TYPE_P2P_COMPRESSION:
+            LF_PRINT_LOG("Received offer of compression from federate %d.", fed_id);
+            handle_compression_offer(reader, fed_id);
+            break;
+        case MSG_TYPE_P2P_COMPRESSED_MESSAGE:
+            LF_PRINT_LOG("Received compressed message from federate %d.", fed_id);
+            handle_compressed_message(reader, fed_id);
+            break;
+        case MSG_TYPE_P2P_UDP:
+            LF_PRINT_LOG("Received offer of UDP from federate %d.", fed_id);
+            handle_udp_offer(reader, fed_id);
+            break;
+        default:
+            bad_message = true;
+    }
+    if (bad_message) {
+        // FIXME: Better error handling needed.
+        lf_print_error("Received erroneous message type: %d. Closing the socket.", buffer[0]);
+        return false;
+        // Trace the event when tracing is enabled
+        tracepoint_federate_from_federate(_fed.trace, receive_UNIDENTIFIED, _lf_my_fed_id, fed_id, NULL);
+    }
+    return true;
+}
+
 /**
  * Thread that listens for inputs from other federates.
  * This thread listens for messages of type MSG_TYPE_P2P_MESSAGE,
@@ -2426,55 +3954,14 @@ void* listen_to_federates(void* _args) {
 
     LF_PRINT_LOG("Listening to federate %d.", fed_id);
 
-    int socket_id = _fed.sockets_for_inbound_p2p_connections[fed_id];
-
-    // Buffer for incoming messages.
-    // This does not constrain the message size
-    // because the message will be put into malloc'd memory.
-    unsigned char buffer[FED_COM_BUFFER_SIZE];
+    // All reads of the socket go through this reader, which lets the
+    // type, header, and payload of small messages arrive with one read.
+    socket_reader_t reader;
+    socket_reader_init(&reader, _fed.sockets_for_inbound_p2p_connections[fed_id]);
 
     // Listen for messages from the federate.
-    while (1) {
-        // Read one byte to get the message type.
-        LF_PRINT_DEBUG("Waiting for a P2P message on socket %d.", socket_id);
-        ssize_t bytes_read = read_from_socket(socket_id, 1, buffer);
-        if (bytes_read == 0) {
-            // EOF occurred. This breaks the connection.
-            lf_print("Received EOF from peer federate %d. Closing the socket.", fed_id);
-            _lf_close_inbound_socket(fed_id);
-            break;
-        } else if (bytes_read < 0) {
-            lf_print_error("P2P socket to federate %d is broken.", fed_id);
-            _lf_close_inbound_socket(fed_id);
-            break;
-        }
-        LF_PRINT_DEBUG("Received a P2P message on socket %d of type %d.",
-                socket_id, buffer[0]);
-        bool bad_message = false;
-        switch (buffer[0]) {
-            case MSG_TYPE_P2P_MESSAGE:
-                LF_PRINT_LOG("Received untimed message from federate %d.", fed_id);
-                handle_message(socket_id, fed_id);
-                break;
-            case MSG_TYPE_P2P_TAGGED_MESSAGE:
-                LF_PRINT_LOG("Received timed message from federate %d.", fed_id);
-                handle_tagged_message(socket_id, fed_id);
-                break;
-            case MSG_TYPE_PORT_ABSENT:
-                LF_PRINT_LOG("Received port absent message from federate %d.", fed_id);
-                handle_port_absent_message(socket_id, fed_id);
-                break;
-            default:
-                bad_message = true;
-        }
-        if (bad_message) {
-            // FIXME: Better error handling needed.
-            lf_print_error("Received erroneous message type: %d. Closing the socket.", buffer[0]);
-            break;
-            // Trace the event when tracing is enabled
-            tracepoint_federate_from_federate(_fed.trace, receive_UNIDENTIFIED, _lf_my_fed_id, fed_id, NULL);
-        }
-    }
+    while (handle_message_from_federate(&reader, fed_id));
+    close_reader_transport(&reader);
     return NULL;
 }
 
@@ -2490,84 +3977,189 @@ static void stop_all_traces() {
 }
 
 /**
- * Thread that listens for TCP inputs from the RTI.
- * When messages arrive, this calls the appropriate handler.
- * @param args Ignored
+ * Read one message from the RTI and call the appropriate handler.
+ * @param reader The reader of the socket connected to the RTI.
+ * @return false if the connection to the RTI has been closed, and true otherwise.
  */
-void* listen_to_rti_TCP(void* args) {
+static bool handle_message_from_rti(socket_reader_t* reader) {
     // Buffer for incoming messages.
     // This does not constrain the message size
     // because the message will be put into malloc'd memory.
     unsigned char buffer[FED_COM_BUFFER_SIZE];
 
-    // Listen for messages from the federate.
-    while (1) {
-        // Check whether the RTI socket is still valid
-        if (_fed.socket_TCP_RTI < 0) {
-            lf_print_warning("Socket to the RTI unexpectedly closed.");
-            return NULL;
-        }
-        // Read one byte to get the message type.
-        // This will exit if the read fails.
-        ssize_t bytes_read = read_from_socket(_fed.socket_TCP_RTI, 1, buffer);
-        if (bytes_read < 0) {
-            if (errno == ECONNRESET) {
-                lf_print_error("Socket connection to the RTI was closed by the RTI without"
-                            " properly sending an EOF first. Considering this a soft error.");
-                // FIXME: If this happens, possibly a new RTI must be elected.
-                _fed.socket_TCP_RTI = -1;
-                return NULL;
-            } else {
-                lf_print_error("Socket connection to the RTI has been broken"
-                                    " with error %d: %s. The RTI should"
-                                    " close connections with an EOF first."
-                                    " Considering this a soft error.",
-                                    errno,
-                                    strerror(errno));
-                // FIXME: If this happens, possibly a new RTI must be elected.
-                _fed.socket_TCP_RTI = -1;
-                return NULL;
-            }
-        } else if (bytes_read == 0) {
-            // EOF received.
-            lf_print("Connection to the RTI closed with an EOF.");
+    // Check whether the RTI socket is still valid
+    if (_fed.socket_TCP_RTI < 0) {
+        lf_print_warning("Socket to the RTI unexpectedly closed.");
+        return false;
+    }
+    // Read one byte to get the message type.
+    // This will exit if the read fails.
+    ssize_t bytes_read = read_from_socket_reader_errexit(reader, 1, buffer, NULL);
+    if (bytes_read < 0) {
+        if (errno == ECONNRESET) {
+            lf_print_error("Socket connection to the RTI was closed by the RTI without"
+                        " properly sending an EOF first. Considering this a soft error.");
+            // FIXME: If this happens, possibly a new RTI must be elected.
+            outbound_queue_close(&_fed.outbound_queue_to_RTI, false);
             _fed.socket_TCP_RTI = -1;
-            stop_all_traces();
-            return NULL;
+            return false;
+        } else {
+            lf_print_error("Socket connection to the RTI has been broken"
+                                " with error %d: %s. The RTI should"
+                                " close connections with an EOF first."
+                                " Considering this a soft error.",
+                                errno,
+                                strerror(errno));
+            // FIXME: If this happens, possibly a new RTI must be elected.
+            outbound_queue_close(&_fed.outbound_queue_to_RTI, false);
+            _fed.socket_TCP_RTI = -1;
+            return false;
         }
-        switch (buffer[0]) {
-            case MSG_TYPE_TAGGED_MESSAGE:
-                handle_tagged_message(_fed.socket_TCP_RTI, -1);
-                break;
-            case MSG_TYPE_TAG_ADVANCE_GRANT:
-                handle_tag_advance_grant();
-                break;
-            case MSG_TYPE_PROVISIONAL_TAG_ADVANCE_GRANT:
-                handle_provisional_tag_advance_grant();
-                break;
-            case MSG_TYPE_STOP_REQUEST:
-                handle_stop_request_message();
-                break;
-            case MSG_TYPE_STOP_GRANTED:
-                handle_stop_granted_message();
-                break;
-            case MSG_TYPE_PORT_ABSENT:
-                handle_port_absent_message(_fed.socket_TCP_RTI, -1);
-                break;
-            case MSG_TYPE_CLOCK_SYNC_T1:
-            case MSG_TYPE_CLOCK_SYNC_T4:
-                lf_print_error("Federate %d received unexpected clock sync message from RTI on TCP socket.",
-                            _lf_my_fed_id);
-                break;
-            default:
-                lf_print_error_and_exit("Received from RTI an unrecognized TCP message type: %hhx.", buffer[0]);
-                // Trace the event when tracing is enabled
-                tracepoint_federate_from_rti(_fed.trace, receive_UNIDENTIFIED, _lf_my_fed_id, NULL);
-            }
+    } else if (bytes_read == 0) {
+        // EOF received.
+        lf_print("Connection to the RTI closed with an EOF.");
+        outbound_queue_close(&_fed.outbound_queue_to_RTI, false);
+        _fed.socket_TCP_RTI = -1;
+        stop_all_traces();
+        return false;
+    }
+    switch (buffer[0]) {
+        case MSG_TYPE_TAGGED_MESSAGE:
+            handle_tagged_message(reader, -1, NULL);
+            break;
+        case MSG_TYPE_TAGGED_MESSAGE_BATCH:
+            handle_tagged_message_batch(reader, -1);
+            break;
+        case MSG_TYPE_TAG_ADVANCE_GRANT:
+            handle_tag_advance_grant(reader);
+            break;
+        case MSG_TYPE_PROVISIONAL_TAG_ADVANCE_GRANT:
+            handle_provisional_tag_advance_grant(reader);
+            break;
+        case MSG_TYPE_STOP_REQUEST:
+            handle_stop_request_message(reader);
+            break;
+        case MSG_TYPE_STOP_GRANTED:
+            handle_stop_granted_message(reader);
+            break;
+        case MSG_TYPE_PORT_ABSENT:
+        case MSG_TYPE_PORT_ABSENT_BATCH:
+            handle_port_absent_message(reader, -1, buffer[0]);
+            break;
+        case MSG_TYPE_CLOCK_SYNC_T1:
+        case MSG_TYPE_CLOCK_SYNC_T4:
+            lf_print_error("Federate %d received unexpected clock sync message from RTI on TCP socket.",
+                        _lf_my_fed_id);
+            break;
+        default:
+            lf_print_error_and_exit("Received from RTI an unrecognized TCP message type: %hhx.", buffer[0]);
+            // Trace the event when tracing is enabled
+            tracepoint_federate_from_rti(_fed.trace, receive_UNIDENTIFIED, _lf_my_fed_id, NULL);
     }
+    return true;
+}
+
+/**
+ * Thread that listens for TCP inputs from the RTI.
+ * When messages arrive, this calls the appropriate handler.
+ * @param args Ignored
+ */
+void* listen_to_rti_TCP(void* args) {
+    // All reads of the socket go through this reader, as in listen_to_federates().
+    socket_reader_t reader;
+    socket_reader_init(&reader, _fed.socket_TCP_RTI);
+
+    // Listen for messages from the federate.
+    while (handle_message_from_rti(&reader));
+    return NULL;
+}
+
+/**
+ * An inbound socket watched by the socket poller.
+ */
+typedef struct inbound_connection_t {
+    /** The reader through which all reads of the socket go. */
+    socket_reader_t reader;
+    /** The ID of the sending federate, or -1 for the RTI. */
+    int fed_id;
+} inbound_connection_t;
+
+/**
+ * Thread that listens for messages from a federate that sends them through
+ * a transport, for a connection that was watched by the socket poller until
+ * the federate switched to the transport.
+ * @param connection_arg The inbound_connection_t of the connection, which
+ *  this frees before returning.
+ */
+static void* listen_to_transport(void* connection_arg) {
+    inbound_connection_t* connection = (inbound_connection_t*)connection_arg;
+    while (handle_message_from_federate(&connection->reader, (uint16_t)connection->fed_id));
+    close_reader_transport(&connection->reader);
+    free(connection);
     return NULL;
 }
 
+/**
+ * Start a thread running listen_to_transport() for the given connection.
+ * terminate_execution() waits for it with the listener threads.
+ */
+static void start_transport_listener(inbound_connection_t* connection) {
+    size_t index = lf_atomic_fetch_add(&_fed.number_of_transport_listeners, 1);
+    assert(index < _fed.number_of_inbound_p2p_connections);
+    int result = lf_thread_create(&_fed.inbound_socket_listeners[index], listen_to_transport, connection);
+    if (result != 0) {
+        lf_print_error_and_exit("Failed to create a thread to listen to federate %d. Error code: %d.",
+                connection->fed_id, result);
+    }
+    _lf_set_network_thread_priority(_fed.inbound_socket_listeners[index], "federate listener");
+}
+
+/**
+ * Handle the messages that have arrived on a socket watched by the socket
+ * poller. This is the socket_poller_handler_t counterpart of
+ * listen_to_federates() and listen_to_rti_TCP(). Messages left in the buffer
+ * of the reader are handled before returning, since the poller only notices
+ * input that has not yet been read from the socket.
+ * @param connection_arg The inbound_connection_t of the socket.
+ * @return false once the socket is closed, and true otherwise.
+ */
+static bool handle_inbound_input(void* connection_arg) {
+    inbound_connection_t* connection = (inbound_connection_t*)connection_arg;
+    do {
+        bool open = (connection->fed_id < 0)
+                ? handle_message_from_rti(&connection->reader)
+                : handle_message_from_federate(&connection->reader, (uint16_t)connection->fed_id);
+        if (!open) {
+            close_reader_transport(&connection->reader);
+            free(connection);
+            return false;
+        }
+        if (connection->reader.transport != NULL) {
+            // The federate has switched to a transport, which the poller
+            // cannot watch, so the connection gets a thread of its own.
+            start_transport_listener(connection);
+            return false;
+        }
+    } while (socket_reader_has_input(&connection->reader));
+    return true;
+}
+
+/**
+ * Have the socket poller listen for messages from the given federate.
+ * @param fed_id The ID of the federate, or -1 for the RTI.
+ */
+static void watch_inbound_socket(int fed_id) {
+    int socket = (fed_id < 0) ? _fed.socket_TCP_RTI : _fed.sockets_for_inbound_p2p_connections[fed_id];
+    inbound_connection_t* connection = (inbound_connection_t*)malloc(sizeof(inbound_connection_t));
+    lf_assert(connection, "Out of memory");
+    socket_reader_init(&connection->reader, socket);
+    connection->fed_id = fed_id;
+    int result = socket_poller_add(&_fed.socket_poller, socket, handle_inbound_input, connection);
+    if (result != 0) {
+        lf_print_error_and_exit("Failed to listen for messages on socket %d. Error code: %d.", socket, result);
+    }
+}
+
 void synchronize_with_other_federates(void) {
 
     LF_PRINT_DEBUG("Synchronizing with other federates.");
@@ -2580,11 +4172,30 @@ void synchronize_with_other_federates(void) {
     // @note Up until this point, the federate has been listening for messages
     //  from the RTI in a sequential manner in the main thread. From now on, a
     //  separate thread is created to allow for asynchronous communication.
-    lf_thread_create(&_fed.RTI_socket_listener, listen_to_rti_TCP, NULL);
+    if (_fed.socket_poller.threads != NULL) {
+        watch_inbound_socket(-1);
+    } else {
+        lf_thread_create(&_fed.RTI_socket_listener, listen_to_rti_TCP, NULL);
+        _lf_set_network_thread_priority(_fed.RTI_socket_listener, "RTI listener");
+    }
+
+    // From now on, messages to the RTI are queued and written by a separate thread.
+    int result = outbound_queue_start(&_fed.outbound_queue_to_RTI);
+    if (result != 0) {
+        lf_print_warning("Failed to create a thread to send messages to the RTI. "
+                "Messages to it will be sent synchronously. Error code: %d.", result);
+    } else {
+        _lf_set_network_thread_priority(_fed.outbound_queue_to_RTI.writer, "outbound writer");
+    }
     lf_thread_t thread_id;
     if (create_clock_sync_thread(&thread_id)) {
         lf_print_warning("Failed to create thread to handle clock synchronization.");
     }
+#if defined(_LF_CLOCK_SYNC_ON) && !defined(_LF_CLOCK_SYNC_EXTERNAL)
+    else {
+        _lf_set_network_thread_priority(thread_id, "clock synchronization");
+    }
+#endif // _LF_CLOCK_SYNC_ON
 }
 
 /**
@@ -2793,7 +4404,7 @@ tag_t _lf_send_next_event_tag(environment_t* env, tag_t tag, bool wait_for_reply
             // Create a dummy event that will force this federate to advance time and subsequently enable progress for
             // downstream federates.
             event_t* dummy = _lf_create_dummy_events(env, NULL, tag.time, NULL, 0);
-            pqueue_insert(env->event_q, dummy);
+            _lf_insert_event(env, dummy);
         }
 
         LF_PRINT_DEBUG("Inserted a dummy event for logical time " PRINTF_TIME ".",
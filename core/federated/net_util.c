@@ -30,6 +30,10 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Utility functions for a federate in a federated execution.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // For splice().
+#endif
+
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
@@ -48,6 +52,13 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Define socket functions only for federated execution.
 #ifdef FEDERATED
 #include <unistd.h>     // Defines read(), write(), and close()
+#include <sys/uio.h>    // Defines writev()
+#if defined(PLATFORM_Linux)
+#include <fcntl.h>      // Defines splice()
+#include <poll.h>
+#include <linux/errqueue.h>     // Defines struct scm_timestamping
+#include <linux/net_tstamp.h>   // Defines SOF_TIMESTAMPING_*
+#endif
 
 #ifndef NUMBER_OF_FEDERATES
 #define NUMBER_OF_FEDERATES 1
@@ -84,6 +95,25 @@ int create_real_time_tcp_socket_errexit() {
     return sock;
 }
 
+bool host_address_is_local(struct in_addr address) {
+    if ((ntohl(address.s_addr) >> 24) == 127) {
+        // Loopback.
+        return true;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return false;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr = address;
+    local.sin_port = 0;
+    bool result = bind(sock, (struct sockaddr*)&local, sizeof(local)) == 0;
+    close(sock);
+    return result;
+}
+
 ssize_t read_from_socket_errexit(
 		int socket,
 		size_t num_bytes,
@@ -128,6 +158,209 @@ ssize_t read_from_socket(int socket, size_t num_bytes, unsigned char* buffer) {
     return read_from_socket_errexit(socket, num_bytes, buffer, NULL);
 }
 
+#if defined(PLATFORM_Linux)
+/**
+ * Return the physical time, as given by lf_time_physical(), of the kernel or
+ * hardware timestamp in the specified control message, or NEVER if it has none.
+ * Timestamps are given by the system clock (CLOCK_REALTIME), so they are converted
+ * by the difference between lf_time_physical() and that clock now.
+ */
+static instant_t timestamp_from_control_message(struct msghdr* message) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(message); cmsg != NULL; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SO_TIMESTAMPING) continue;
+        struct scm_timestamping timestamps;
+        memcpy(&timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+        // The hardware timestamp, if any, is the third one, and the software one the first.
+        struct timespec* stamp = &timestamps.ts[2];
+        if (stamp->tv_sec == 0 && stamp->tv_nsec == 0) {
+            stamp = &timestamps.ts[0];
+        }
+        if (stamp->tv_sec == 0 && stamp->tv_nsec == 0) {
+            return NEVER;
+        }
+        instant_t physical_time = lf_time_physical();
+        struct timespec system_time;
+        clock_gettime(CLOCK_REALTIME, &system_time);
+        return ((instant_t)stamp->tv_sec * BILLION + stamp->tv_nsec)
+                + physical_time - ((instant_t)system_time.tv_sec * BILLION + system_time.tv_nsec);
+    }
+    return NEVER;
+}
+#endif
+
+int enable_socket_timestamps(int socket, socket_timestamps_t source, bool transmit) {
+#if defined(PLATFORM_Linux)
+    if (source == SOCKET_TIMESTAMPS_NONE) return 0;
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (source == SOCKET_TIMESTAMPS_HARDWARE) {
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    // Transmit timestamps that are not collected would fill the error queue.
+    if (transmit) {
+        flags |= (source == SOCKET_TIMESTAMPS_HARDWARE)
+                ? SOF_TIMESTAMPING_TX_HARDWARE : SOF_TIMESTAMPING_TX_SOFTWARE;
+    }
+#ifdef SOF_TIMESTAMPING_OPT_TSONLY
+    // Report transmit timestamps without a copy of the datagram.
+    flags |= SOF_TIMESTAMPING_OPT_TSONLY;
+#endif
+    return setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+#else
+    if (source == SOCKET_TIMESTAMPS_NONE) return 0;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+ssize_t receive_timestamped_datagram(int socket, size_t num_bytes, unsigned char* buffer,
+        struct sockaddr_in* sender, instant_t* timestamp) {
+    struct sockaddr_in address;
+    struct iovec iov = {.iov_base = buffer, .iov_len = num_bytes};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &address;
+    message.msg_namelen = sizeof(address);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+#if defined(PLATFORM_Linux)
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+#endif
+    ssize_t bytes_read;
+    do {
+        bytes_read = recvmsg(socket, &message, 0);
+    } while (bytes_read < 0 && errno == EINTR);
+    *timestamp = NEVER;
+#if defined(PLATFORM_Linux)
+    if (bytes_read >= 0) {
+        *timestamp = timestamp_from_control_message(&message);
+    }
+#endif
+    if (*timestamp == NEVER) {
+        *timestamp = lf_time_physical();
+    }
+    if (sender != NULL) {
+        *sender = address;
+    }
+    return bytes_read;
+}
+
+int get_transmit_timestamp(int socket, instant_t* timestamp) {
+#if defined(PLATFORM_Linux)
+    // Transmit timestamps are reported on the error queue of the socket,
+    // which signals POLLERR when it is not empty.
+    instant_t give_up = lf_time_physical() + MSEC(1);
+    while (1) {
+        char data[64];
+        struct iovec iov = {.iov_base = data, .iov_len = sizeof(data)};
+        char control[CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+            *timestamp = timestamp_from_control_message(&message);
+            if (*timestamp != NEVER) return 0;
+            continue;
+        }
+        interval_t remaining = give_up - lf_time_physical();
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || remaining <= 0) {
+            return -1;
+        }
+        struct pollfd descriptor = {.fd = socket, .events = 0};
+        poll(&descriptor, 1, (int)(remaining / MSEC(1)) + 1);
+    }
+#else
+    return -1;
+#endif
+}
+
+void socket_reader_init(socket_reader_t* reader, int socket) {
+    reader->socket = socket;
+    reader->transport = NULL;
+    reader->start = 0;
+    reader->end = 0;
+}
+
+bool socket_reader_has_input(socket_reader_t* reader) {
+    return reader->start < reader->end
+            || (reader->transport != NULL && transport_available(reader->transport) > 0);
+}
+
+ssize_t read_from_socket_reader_errexit(
+		socket_reader_t* reader,
+		size_t num_bytes,
+		unsigned char* buffer,
+		char* format, ...) {
+    // First, take what has already been received.
+    size_t bytes_read = reader->end - reader->start;
+    if (bytes_read >= num_bytes) {
+        memcpy(buffer, reader->buffer + reader->start, num_bytes);
+        reader->start += num_bytes;
+        return (ssize_t)num_bytes;
+    }
+    memcpy(buffer, reader->buffer + reader->start, bytes_read);
+    while (bytes_read < num_bytes) {
+        // Everything received so far has been consumed.
+        reader->start = 0;
+        reader->end = 0;
+        size_t needed = num_bytes - bytes_read;
+        ssize_t more;
+        if (reader->transport != NULL) {
+            // Transports do their own buffering.
+            more = transport_read(reader->transport, needed, buffer + bytes_read);
+            if (more > 0) {
+                bytes_read += (size_t)more;
+            }
+        } else if (needed >= SOCKET_READER_BUFFER_SIZE) {
+            // Read the rest directly into its destination.
+            more = read(reader->socket, buffer + bytes_read, needed);
+            if (more > 0) {
+                bytes_read += (size_t)more;
+            }
+        } else {
+            // Read as much as is available, which may include further messages.
+            more = read(reader->socket, reader->buffer + reader->end,
+                    SOCKET_READER_BUFFER_SIZE - reader->end);
+            if (more > 0) {
+                reader->end += (size_t)more;
+                size_t used = reader->end - reader->start;
+                if (used > needed) {
+                    used = needed;
+                }
+                memcpy(buffer + bytes_read, reader->buffer + reader->start, used);
+                reader->start += used;
+                bytes_read += used;
+            }
+        }
+        if (more < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            // The error code set by the socket indicates
+            // that we should try again (@see man errno).
+            LF_PRINT_DEBUG("Reading from socket was blocked. Will try again.");
+            continue;
+        } else if (more <= 0) {
+            if (format != NULL) {
+                shutdown(reader->socket, SHUT_RDWR);
+                close(reader->socket);
+                lf_print_error("Read %zu bytes, but expected %zu. errno=%d",
+                        bytes_read, num_bytes, errno);
+                va_list args;
+                va_start(args, format);
+                lf_vprint_error_and_exit(format, args);
+                va_end(args);
+            } else if (more == 0) {
+                // As in read_from_socket_errexit(), close the socket on EOF.
+                close(reader->socket);
+            }
+            return more;
+        }
+    }
+    return (ssize_t)bytes_read;
+}
+
 ssize_t write_to_socket_with_mutex(
 		int socket,
 		size_t num_bytes,
@@ -160,6 +393,69 @@ ssize_t write_to_socket_with_mutex(
     return bytes_written;
 }
 
+ssize_t write_header_and_body_to_socket_with_mutex(
+		int socket,
+		size_t header_length,
+		unsigned char* header,
+		size_t body_length,
+		unsigned char* body,
+		lf_mutex_t* mutex,
+		char* format, ...) {
+    struct iovec vector[2];
+    vector[0].iov_base = header;
+    vector[0].iov_len = header_length;
+    vector[1].iov_base = body;
+    vector[1].iov_len = body_length;
+    ssize_t bytes_written = write_vector_to_socket(socket, (body_length > 0) ? 2 : 1, vector);
+    if (bytes_written <= 0 && format != NULL) {
+        int error = errno;
+        shutdown(socket, SHUT_RDWR);
+        close(socket);
+        if (mutex != NULL) {
+            lf_mutex_unlock(mutex);
+        }
+        va_list args;
+        va_start(args, format);
+        lf_vprint_error(format, args);
+        va_end(args);
+        lf_print_error("Code %d: %s.", error, strerror(error));
+    }
+    return bytes_written;
+}
+
+ssize_t write_vector_to_socket(int socket, int count, struct iovec* vector) {
+    struct iovec* remaining = vector;
+    ssize_t bytes_written = 0;
+    // Skip empty buffers, so that a write of nothing is not taken for an EOF.
+    while (count > 0 && remaining->iov_len == 0) {
+        remaining++;
+        count--;
+    }
+    while (count > 0) {
+        ssize_t more = writev(socket, remaining, count);
+        if (more <= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The error code set by the socket indicates
+            // that we should try again (@see man errno).
+            LF_PRINT_DEBUG("Writing to socket was blocked. Will try again.");
+            continue;
+        } else if (more <= 0) {
+            return more;
+        }
+        bytes_written += more;
+        // Skip what was written, which may end in the middle of any buffer.
+        while (count > 0 && (size_t)more >= remaining->iov_len) {
+            more -= (ssize_t)remaining->iov_len;
+            remaining++;
+            count--;
+        }
+        if (count > 0) {
+            remaining->iov_base = (unsigned char*)remaining->iov_base + more;
+            remaining->iov_len -= (size_t)more;
+        }
+    }
+    return bytes_written;
+}
+
 ssize_t write_to_socket_errexit(
 		int socket,
 		size_t num_bytes,
@@ -172,6 +468,66 @@ ssize_t write_to_socket(int socket, size_t num_bytes, unsigned char* buffer) {
     return write_to_socket_with_mutex(socket, num_bytes, buffer, NULL, NULL);
 }
 
+ssize_t forward_socket_bytes(int from, int to, size_t num_bytes, unsigned char* buffer, size_t buffer_size) {
+    size_t bytes_read = 0;
+    size_t bytes_written = 0;
+    bool write_failed = false;
+#if defined(PLATFORM_Linux)
+    int pipe_fds[2];
+    if (num_bytes >= SOCKET_SPLICE_THRESHOLD && pipe(pipe_fds) == 0) {
+        while (bytes_read < num_bytes && !write_failed) {
+            ssize_t more = splice(from, NULL, pipe_fds[1], NULL, num_bytes - bytes_read, SPLICE_F_MOVE);
+            if (more < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                continue;
+            } else if (more < 0 && bytes_read == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // The sockets do not support splice(). Copy the bytes instead.
+                break;
+            } else if (more <= 0) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+                return -1;
+            }
+            bytes_read += (size_t)more;
+            // Empty the pipe into the destination.
+            while (more > 0) {
+                ssize_t out = splice(pipe_fds[0], NULL, to, NULL, (size_t)more,
+                        SPLICE_F_MOVE | (bytes_read < num_bytes ? SPLICE_F_MORE : 0));
+                if (out < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    continue;
+                } else if (out <= 0) {
+                    // Bytes left in the pipe are discarded when it is closed.
+                    write_failed = true;
+                    break;
+                }
+                more -= out;
+                bytes_written += (size_t)out;
+            }
+        }
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+#endif
+    // Copy whatever remains through the buffer.
+    while (bytes_read < num_bytes) {
+        size_t chunk = num_bytes - bytes_read;
+        if (chunk > buffer_size) {
+            chunk = buffer_size;
+        }
+        if (read_from_socket(from, chunk, buffer) <= 0) {
+            return -1;
+        }
+        bytes_read += chunk;
+        if (!write_failed) {
+            if (write_to_socket(to, chunk, buffer) < (ssize_t)chunk) {
+                write_failed = true;
+            } else {
+                bytes_written += chunk;
+            }
+        }
+    }
+    return (ssize_t)bytes_written;
+}
+
 #endif // FEDERATED
 
 // Below are more generally useful functions.
@@ -0,0 +1,754 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Per-connection queues of outgoing messages for federates.
+ * See outbound_queue.h for an overview.
+ */
+
+#ifdef FEDERATED
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "net_util.h"
+#include "outbound_queue.h"
+#include "util.h"
+
+#if defined(LF_IO_URING)
+#if !defined(PLATFORM_Linux)
+#error "LF_IO_URING is only supported on Linux."
+#endif
+#include <pthread.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void outbound_queue_wake_uring_writer();
+#endif
+
+/**
+ * Record that a write of the given queue failed with the given error and
+ * drop the queued messages. This assumes the caller holds the queue mutex.
+ */
+static void outbound_queue_failed(outbound_queue_t* queue, int error) {
+    // A write that returned 0 (EOF) leaves errno unchanged.
+    queue->error = (error != 0) ? error : EPIPE;
+    queue->pending_length = 0;
+    queue->batch_open = false;
+    lf_cond_broadcast(&queue->changed);
+}
+
+/**
+ * Return the number of pending bytes that can be written, which excludes
+ * an open batch. This assumes the caller holds the queue mutex.
+ */
+static size_t outbound_queue_ready(outbound_queue_t* queue) {
+    return queue->batch_open ? queue->batch_start : queue->pending_length;
+}
+
+/**
+ * Signal that the given queue has changed, which wakes up threads waiting for
+ * room and the writer. This assumes the caller holds the queue mutex.
+ */
+static void outbound_queue_changed(outbound_queue_t* queue) {
+    lf_cond_broadcast(&queue->changed);
+#if defined(LF_IO_URING)
+    // While a write is in flight, its completion makes the writer look again.
+    if (queue->uring && !queue->writing) {
+        outbound_queue_wake_uring_writer();
+    }
+#endif
+}
+
+/**
+ * Make room for the given number of bytes at the end of the pending buffer.
+ * This assumes the caller holds the queue mutex.
+ */
+static void outbound_queue_reserve(outbound_queue_t* queue, size_t length) {
+    if (queue->pending_length + length <= queue->pending_capacity) return;
+    size_t capacity = (queue->pending_capacity > 0) ? queue->pending_capacity : 4096;
+    while (capacity < queue->pending_length + length) capacity *= 2;
+    queue->pending = (unsigned char*)realloc(queue->pending, capacity);
+    lf_assert(queue->pending, "Out of memory");
+    queue->pending_capacity = capacity;
+}
+
+/**
+ * Wait until the given queue can take a message of the given length and
+ * return 1, or return 0 if it is closed or -1 with errno set if a write has
+ * failed. This assumes the caller holds the queue mutex.
+ */
+static int outbound_queue_wait_for_room(outbound_queue_t* queue, size_t length) {
+    if (queue->started) {
+        // Wait for room, but always accept a message into an empty queue.
+        while (!queue->closed && queue->error == 0 && queue->pending_length > 0
+                && queue->pending_length + length > OUTBOUND_QUEUE_MAX_PENDING) {
+            lf_cond_wait(&queue->changed);
+        }
+    }
+    if (queue->closed) return 0;
+    if (queue->error != 0) {
+        errno = queue->error;
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Return the total length of the given segments.
+ */
+static size_t outbound_queue_segments_length(int count, const struct iovec* segments) {
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += segments[i].iov_len;
+    }
+    return length;
+}
+
+/**
+ * Copy the given segments to the end of the pending buffer of the given queue,
+ * which must have room for them. This assumes the caller holds the queue mutex.
+ */
+static void outbound_queue_append_segments(outbound_queue_t* queue, int count, const struct iovec* segments) {
+    for (int i = 0; i < count; i++) {
+        if (segments[i].iov_len > 0) {
+            memcpy(queue->pending + queue->pending_length, segments[i].iov_base, segments[i].iov_len);
+            queue->pending_length += segments[i].iov_len;
+        }
+    }
+}
+
+/**
+ * Write the given message synchronously, into the transport of the queue or,
+ * before the writer thread is started, to its socket.
+ * This assumes the caller holds the queue mutex, which keeps messages whole.
+ * @return 1 on success or -1 with errno set on failure.
+ */
+static int outbound_queue_write_now(
+        outbound_queue_t* queue,
+        size_t header_length,
+        unsigned char* header,
+        int count,
+        const struct iovec* segments) {
+    size_t length = header_length + outbound_queue_segments_length(count, segments);
+    ssize_t written;
+    if (queue->transport != NULL) {
+        written = transport_write(queue->transport, header_length, header);
+        size_t expected = header_length;
+        for (int i = 0; i < count && written == (ssize_t)expected; i++) {
+            if (segments[i].iov_len == 0) continue;
+            ssize_t more = transport_write(queue->transport, segments[i].iov_len, (unsigned char*)segments[i].iov_base);
+            written = (more < 0) ? more : written + more;
+            expected += segments[i].iov_len;
+        }
+    } else {
+        struct iovec vector[count + 1];
+        vector[0].iov_base = header;
+        vector[0].iov_len = header_length;
+        memcpy(&vector[1], segments, count * sizeof(struct iovec));
+        written = write_vector_to_socket(queue->socket, count + 1, vector);
+    }
+    if (written < (ssize_t)length) {
+        int error = errno;
+        lf_print_error("Failed to send message to %s. Code %d: %s.",
+                queue->destination, error, strerror(error));
+        outbound_queue_failed(queue, error);
+        errno = queue->error;
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Swap the pending buffer of the given queue with its sending buffer, so that
+ * other threads can queue messages while the writer writes, and mark the queue
+ * as writing. An open batch stays in the pending buffer.
+ * This assumes the caller holds the queue mutex and that messages are ready.
+ * @return The number of bytes to write from the sending buffer.
+ */
+static size_t outbound_queue_take(outbound_queue_t* queue) {
+    size_t length = outbound_queue_ready(queue);
+    unsigned char* buffer = queue->pending;
+    size_t pending_length = queue->pending_length;
+    size_t capacity = queue->pending_capacity;
+    queue->pending = queue->sending;
+    queue->pending_capacity = queue->sending_capacity;
+    queue->pending_length = 0;
+    queue->sending = buffer;
+    queue->sending_capacity = capacity;
+    if (queue->batch_open) {
+        // Move the open batch to the start of the new pending buffer.
+        outbound_queue_reserve(queue, pending_length - length);
+        memcpy(queue->pending, buffer + length, pending_length - length);
+        queue->pending_length = pending_length - length;
+        queue->batch_start = 0;
+    }
+    queue->writing = true;
+    // Wake up threads waiting for room in the queue.
+    lf_cond_broadcast(&queue->changed);
+    return length;
+}
+
+/**
+ * Thread that writes the messages queued for one connection.
+ * It takes the messages that are ready (see outbound_queue_take()) and writes
+ * them, and exits when the queue is closed and drained or when a write fails.
+ * @param arg The queue.
+ */
+static void* outbound_queue_writer(void* arg) {
+    outbound_queue_t* queue = (outbound_queue_t*)arg;
+    lf_mutex_lock(&queue->mutex);
+    while (true) {
+        while (outbound_queue_ready(queue) == 0 && !queue->closed) {
+            lf_cond_wait(&queue->changed);
+        }
+        if (outbound_queue_ready(queue) == 0) {
+            // Closed and nothing left to write.
+            break;
+        }
+        size_t length = outbound_queue_take(queue);
+        unsigned char* buffer = queue->sending;
+        lf_mutex_unlock(&queue->mutex);
+
+        ssize_t written = write_to_socket(queue->socket, length, buffer);
+        int error = errno;
+
+        lf_mutex_lock(&queue->mutex);
+        queue->writing = false;
+        if (written < (ssize_t)length) {
+            // If the queue was closed without flushing, the socket was shut
+            // down on purpose and there is nothing to report.
+            if (!queue->closed) {
+                lf_print_error("Failed to send messages to %s. Code %d: %s.",
+                        queue->destination, error, strerror(error));
+            }
+            outbound_queue_failed(queue, error);
+            break;
+        }
+        lf_cond_broadcast(&queue->changed);
+    }
+    lf_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+#if defined(LF_IO_URING)
+/** Value of user_data of the read of the eventfd that wakes up the writer. */
+#define URING_WAKEUP 0
+
+/**
+ * The io_uring shared by the queues, with its writer thread.
+ * The writer is the only thread that submits to the ring and reaps its completions.
+ */
+static struct {
+    /** Whether the ring and the writer thread could be set up. */
+    bool available;
+    /** The file descriptor of the ring. */
+    int ring;
+    /** The eventfd that the writer reads to be woken up when messages are ready. */
+    int wakeup;
+    /** The buffer of the read of the eventfd. */
+    uint64_t wakeup_count;
+    /** The submission queue, whose tail is only written by the writer. */
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    /** The number of entries added to the submission queue since the last submission. */
+    unsigned to_submit;
+    /** The completion queue. */
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    /** The writer thread. */
+    lf_thread_t writer;
+    /** Mutex guarding the list of queues, which is acquired before the mutex of any queue. */
+    lf_mutex_t mutex;
+    /** The queues that submit their writes to the ring. */
+    outbound_queue_t** queues;
+    size_t count;
+    size_t capacity;
+} uring;
+
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+
+/** Wake up the writer of the shared io_uring so that it looks for messages to write. */
+static void outbound_queue_wake_uring_writer() {
+    uint64_t one = 1;
+    if (write(uring.wakeup, &one, sizeof(one)) < 0) {
+        // The count of the eventfd is saturated, so the writer wakes up anyway.
+        LF_PRINT_DEBUG("Failed to wake up the outbound writer. errno=%d", errno);
+    }
+}
+
+/**
+ * Return whether the kernel supports the given operations on the given ring.
+ * @param ring The file descriptor of the ring.
+ * @param ops The operations.
+ * @param count The number of operations.
+ */
+static bool uring_supports(int ring, const int* ops, size_t count) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (probe == NULL) return false;
+    bool result = syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; result && i < count; i++) {
+        result = ops[i] < probe->ops_len && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return result;
+}
+
+/**
+ * Return a cleared submission queue entry of the shared io_uring with the given user data.
+ * This assumes that fewer than OUTBOUND_QUEUE_URING_ENTRIES operations are in flight.
+ */
+static struct io_uring_sqe* uring_get_sqe(uint64_t user_data) {
+    unsigned tail = *uring.sq_tail;
+    unsigned index = tail & uring.sq_mask;
+    struct io_uring_sqe* sqe = &uring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    uring.sq_array[index] = index;
+    // The entry is published to the kernel when the tail is updated.
+    __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring.to_submit++;
+    return sqe;
+}
+
+/**
+ * Submit a write of the rest of the sending buffer of the given queue to the shared io_uring.
+ * This assumes the caller holds the queue mutex.
+ */
+static void uring_submit_send(outbound_queue_t* queue) {
+    struct io_uring_sqe* sqe = uring_get_sqe((uint64_t)(uintptr_t)queue);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = queue->socket;
+    sqe->addr = (uint64_t)(uintptr_t)(queue->sending + queue->sending_offset);
+    sqe->len = (uint32_t)(queue->sending_length - queue->sending_offset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+/**
+ * Handle the completion of a write of the given queue with the given result,
+ * which is the number of bytes written or a negated error code.
+ * @return true if the rest of the sending buffer has been submitted.
+ */
+static bool uring_complete_send(outbound_queue_t* queue, int result) {
+    bool resubmitted = false;
+    lf_mutex_lock(&queue->mutex);
+    if (result == -EAGAIN || result == -EINTR
+            || (result > 0 && queue->sending_offset + (size_t)result < queue->sending_length)) {
+        // Write the rest.
+        queue->sending_offset += (result > 0) ? (size_t)result : 0;
+        uring_submit_send(queue);
+        resubmitted = true;
+    } else {
+        queue->writing = false;
+        if (result <= 0) {
+            int error = -result;
+            // As in outbound_queue_writer(), a queue closed without flushing failed on purpose.
+            if (!queue->closed) {
+                lf_print_error("Failed to send messages to %s. Code %d: %s.",
+                        queue->destination, error, strerror(error));
+            }
+            outbound_queue_failed(queue, error);
+        }
+        lf_cond_broadcast(&queue->changed);
+    }
+    lf_mutex_unlock(&queue->mutex);
+    return resubmitted;
+}
+
+/**
+ * Thread that writes the messages queued for all the queues that use the shared io_uring.
+ * It submits a write for each queue that has messages ready and no write in flight,
+ * together with a read of the eventfd that other threads signal when messages become
+ * ready, and then waits for any of them to complete.
+ * @param arg Ignored.
+ */
+static void* outbound_queue_uring_writer(void* arg) {
+    (void)arg;
+    bool waiting_for_wakeup = false;
+    unsigned in_flight = 0;
+    while (true) {
+        if (!waiting_for_wakeup) {
+            struct io_uring_sqe* sqe = uring_get_sqe(URING_WAKEUP);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = uring.wakeup;
+            sqe->addr = (uint64_t)(uintptr_t)&uring.wakeup_count;
+            sqe->len = sizeof(uring.wakeup_count);
+            waiting_for_wakeup = true;
+            in_flight++;
+        }
+        lf_mutex_lock(&uring.mutex);
+        for (size_t i = 0; i < uring.count && in_flight < OUTBOUND_QUEUE_URING_ENTRIES; i++) {
+            outbound_queue_t* queue = uring.queues[i];
+            lf_mutex_lock(&queue->mutex);
+            if (!queue->writing && !queue->closed && queue->error == 0 && outbound_queue_ready(queue) > 0) {
+                queue->sending_length = outbound_queue_take(queue);
+                queue->sending_offset = 0;
+                uring_submit_send(queue);
+                in_flight++;
+            }
+            lf_mutex_unlock(&queue->mutex);
+        }
+        lf_mutex_unlock(&uring.mutex);
+
+        // Submit everything and wait for at least one completion.
+        int submitted = (int)syscall(__NR_io_uring_enter, uring.ring, uring.to_submit, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            lf_print_error_and_exit("Failed to submit messages to io_uring. errno=%d", errno);
+        }
+        uring.to_submit -= (submitted > 0) ? (unsigned)submitted : 0;
+
+        unsigned head = *uring.cq_head;
+        unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &uring.cqes[head & uring.cq_mask];
+            if (cqe->user_data == URING_WAKEUP) {
+                waiting_for_wakeup = false;
+                in_flight--;
+            } else if (!uring_complete_send((outbound_queue_t*)(uintptr_t)cqe->user_data, cqe->res)) {
+                in_flight--;
+            }
+        }
+        __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/**
+ * Set up the shared io_uring and start its writer thread, leaving uring.available
+ * false if either fails.
+ */
+static void outbound_queue_initialize_uring() {
+    lf_mutex_init(&uring.mutex);
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    uring.ring = (int)syscall(__NR_io_uring_setup, OUTBOUND_QUEUE_URING_ENTRIES, &params);
+    if (uring.ring < 0) {
+        LF_PRINT_LOG("io_uring is not available. errno=%d", errno);
+        return;
+    }
+    const int ops[] = {IORING_OP_SEND, IORING_OP_READ};
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = (sq_size > cq_size) ? sq_size : cq_size;
+    }
+    unsigned char* sq = MAP_FAILED;
+    unsigned char* cq = MAP_FAILED;
+    void* sqes = MAP_FAILED;
+    uring.wakeup = -1;
+    if (uring_supports(uring.ring, ops, sizeof(ops) / sizeof(ops[0]))) {
+        sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                uring.ring, IORING_OFF_SQ_RING);
+        cq = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq
+                : mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        uring.ring, IORING_OFF_CQ_RING);
+        sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, uring.ring, IORING_OFF_SQES);
+        uring.wakeup = eventfd(0, EFD_CLOEXEC);
+    }
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED || uring.wakeup < 0) {
+        LF_PRINT_LOG("io_uring does not support sending messages.");
+        if (sq != MAP_FAILED) munmap(sq, sq_size);
+        if (cq != MAP_FAILED && cq != sq) munmap(cq, cq_size);
+        if (sqes != MAP_FAILED) munmap(sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+        if (uring.wakeup >= 0) close(uring.wakeup);
+        close(uring.ring);
+        return;
+    }
+    uring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    uring.sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    uring.sq_array = (unsigned*)(sq + params.sq_off.array);
+    uring.sqes = (struct io_uring_sqe*)sqes;
+    uring.cq_head = (unsigned*)(cq + params.cq_off.head);
+    uring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    uring.cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    uring.available = lf_thread_create(&uring.writer, outbound_queue_uring_writer, NULL) == 0;
+}
+
+/**
+ * Have the shared io_uring write the messages of the given queue.
+ * @return true on success, or false if io_uring is not available.
+ */
+static bool outbound_queue_start_uring(outbound_queue_t* queue) {
+    pthread_once(&uring_once, outbound_queue_initialize_uring);
+    if (!uring.available) return false;
+    lf_mutex_lock(&uring.mutex);
+    if (uring.count == uring.capacity) {
+        uring.capacity = (uring.capacity > 0) ? 2 * uring.capacity : 8;
+        uring.queues = (outbound_queue_t**)realloc(uring.queues, uring.capacity * sizeof(outbound_queue_t*));
+        lf_assert(uring.queues, "Out of memory");
+    }
+    uring.queues[uring.count++] = queue;
+    lf_mutex_unlock(&uring.mutex);
+    return true;
+}
+
+/**
+ * Stop the shared io_uring from writing the messages of the given queue, which is closed.
+ * This waits for the write in flight, if any, to complete.
+ */
+static void outbound_queue_stop_uring(outbound_queue_t* queue) {
+    lf_mutex_lock(&queue->mutex);
+    while (queue->writing) {
+        lf_cond_wait(&queue->changed);
+    }
+    lf_mutex_unlock(&queue->mutex);
+    lf_mutex_lock(&uring.mutex);
+    for (size_t i = 0; i < uring.count; i++) {
+        if (uring.queues[i] == queue) {
+            uring.queues[i] = uring.queues[--uring.count];
+            break;
+        }
+    }
+    lf_mutex_unlock(&uring.mutex);
+}
+#endif // LF_IO_URING
+
+void outbound_queue_open(outbound_queue_t* queue, int socket, const char* destination) {
+    if (!queue->initialized) {
+        lf_mutex_init(&queue->mutex);
+        lf_cond_init(&queue->changed, &queue->mutex);
+        queue->initialized = true;
+    }
+    lf_mutex_lock(&queue->mutex);
+    queue->socket = socket;
+    strncpy(queue->destination, destination, sizeof(queue->destination) - 1);
+    queue->destination[sizeof(queue->destination) - 1] = '\0';
+    queue->pending_length = 0;
+    queue->batch_open = false;
+    queue->writing = false;
+    queue->started = false;
+    queue->closed = false;
+    queue->error = 0;
+    queue->transport = NULL;
+#if defined(LF_IO_URING)
+    queue->uring = false;
+#endif
+    lf_mutex_unlock(&queue->mutex);
+}
+
+void outbound_queue_use_transport(outbound_queue_t* queue, transport_t* transport) {
+    lf_mutex_lock(&queue->mutex);
+    queue->transport = transport;
+    lf_mutex_unlock(&queue->mutex);
+}
+
+int outbound_queue_start(outbound_queue_t* queue) {
+    lf_mutex_lock(&queue->mutex);
+    int result = 0;
+    if (!queue->started && !queue->closed && queue->transport == NULL) {
+#if defined(LF_IO_URING)
+        if (outbound_queue_start_uring(queue)) {
+            queue->uring = true;
+            queue->writer = uring.writer;
+            queue->started = true;
+            lf_mutex_unlock(&queue->mutex);
+            return 0;
+        }
+#endif
+        result = lf_thread_create(&queue->writer, outbound_queue_writer, queue);
+        queue->started = (result == 0);
+    }
+    lf_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+int outbound_queue_send(
+        outbound_queue_t* queue,
+        size_t header_length,
+        unsigned char* header,
+        size_t body_length,
+        unsigned char* body) {
+    struct iovec segment = { .iov_base = body, .iov_len = body_length };
+    return outbound_queue_sendv(queue, header_length, header, (body_length > 0) ? 1 : 0, &segment);
+}
+
+int outbound_queue_sendv(
+        outbound_queue_t* queue,
+        size_t header_length,
+        unsigned char* header,
+        int count,
+        const struct iovec* segments) {
+    if (!queue->initialized) return 0;
+    size_t length = header_length + outbound_queue_segments_length(count, segments);
+    lf_mutex_lock(&queue->mutex);
+    int result = outbound_queue_wait_for_room(queue, length);
+    if (result > 0 && !queue->started) {
+        result = outbound_queue_write_now(queue, header_length, header, count, segments);
+    } else if (result > 0) {
+        // This message ends any open batch.
+        queue->batch_open = false;
+        outbound_queue_reserve(queue, length);
+        memcpy(queue->pending + queue->pending_length, header, header_length);
+        queue->pending_length += header_length;
+        outbound_queue_append_segments(queue, count, segments);
+        outbound_queue_changed(queue);
+    }
+    int error = errno;
+    lf_mutex_unlock(&queue->mutex);
+    errno = error;
+    return result;
+}
+
+int outbound_queue_send_batched(
+        outbound_queue_t* queue,
+        size_t batch_header_length,
+        unsigned char* batch_header,
+        size_t length_offset,
+        size_t entry_header_length,
+        unsigned char* entry_header,
+        int count,
+        const struct iovec* segments) {
+    if (!queue->initialized) return 0;
+    size_t entry_length = entry_header_length + outbound_queue_segments_length(count, segments);
+    size_t rest_offset = length_offset + sizeof(int32_t);
+    lf_mutex_lock(&queue->mutex);
+    int result = outbound_queue_wait_for_room(queue, batch_header_length + entry_length);
+    if (result > 0 && !queue->started) {
+        // Write a batch holding just this entry.
+        unsigned char frame[batch_header_length + entry_header_length];
+        memcpy(frame, batch_header, batch_header_length);
+        encode_int32((int32_t)entry_length, frame + length_offset);
+        memcpy(frame + batch_header_length, entry_header, entry_header_length);
+        result = outbound_queue_write_now(queue, sizeof(frame), frame, count, segments);
+    } else if (result > 0) {
+        size_t batch_length = 0;
+        bool append = false;
+        if (queue->batch_open
+                && queue->batch_header_length == batch_header_length
+                && queue->batch_length_offset == length_offset) {
+            unsigned char* open_header = queue->pending + queue->batch_start;
+            batch_length = (size_t)extract_int32(open_header + length_offset);
+            append = memcmp(open_header, batch_header, length_offset) == 0
+                    && memcmp(open_header + rest_offset, batch_header + rest_offset,
+                            batch_header_length - rest_offset) == 0
+                    && batch_length + entry_length <= OUTBOUND_QUEUE_MAX_BATCH;
+        }
+        if (!append) {
+            // Start a new batch, which makes any open batch ready to be written.
+            outbound_queue_reserve(queue, batch_header_length);
+            queue->batch_open = true;
+            queue->batch_start = queue->pending_length;
+            queue->batch_header_length = batch_header_length;
+            queue->batch_length_offset = length_offset;
+            memcpy(queue->pending + queue->pending_length, batch_header, batch_header_length);
+            queue->pending_length += batch_header_length;
+            batch_length = 0;
+            outbound_queue_changed(queue);
+        }
+        outbound_queue_reserve(queue, entry_length);
+        memcpy(queue->pending + queue->pending_length, entry_header, entry_header_length);
+        queue->pending_length += entry_header_length;
+        outbound_queue_append_segments(queue, count, segments);
+        encode_int32((int32_t)(batch_length + entry_length),
+                queue->pending + queue->batch_start + length_offset);
+    }
+    int error = errno;
+    lf_mutex_unlock(&queue->mutex);
+    errno = error;
+    return result;
+}
+
+void outbound_queue_end_batch(outbound_queue_t* queue) {
+    if (!queue->initialized) return;
+    lf_mutex_lock(&queue->mutex);
+    if (queue->batch_open) {
+        queue->batch_open = false;
+        outbound_queue_changed(queue);
+    }
+    lf_mutex_unlock(&queue->mutex);
+}
+
+void outbound_queue_close(outbound_queue_t* queue, bool flush) {
+    if (!queue->initialized) return;
+    lf_mutex_lock(&queue->mutex);
+    if (queue->closed) {
+        lf_mutex_unlock(&queue->mutex);
+        return;
+    }
+    if (flush) {
+        queue->batch_open = false;
+        outbound_queue_changed(queue);
+        while (queue->started && queue->error == 0
+                && (queue->pending_length > 0 || queue->writing)) {
+            lf_cond_wait(&queue->changed);
+        }
+        if (queue->closed) {
+            // Another thread closed the queue while this one waited.
+            lf_mutex_unlock(&queue->mutex);
+            return;
+        }
+    } else {
+        queue->pending_length = 0;
+        queue->batch_open = false;
+        if (queue->writing) {
+            // Make the blocked write return.
+            shutdown(queue->socket, SHUT_RDWR);
+        }
+    }
+    queue->closed = true;
+    bool started = queue->started;
+    lf_cond_broadcast(&queue->changed);
+    lf_mutex_unlock(&queue->mutex);
+#if defined(LF_IO_URING)
+    if (started && queue->uring) {
+        outbound_queue_stop_uring(queue);
+        started = false;
+    }
+#endif
+    if (started) {
+        lf_thread_join(queue->writer, NULL);
+    }
+    lf_mutex_lock(&queue->mutex);
+    free(queue->pending);
+    free(queue->sending);
+    queue->pending = NULL;
+    queue->sending = NULL;
+    queue->pending_capacity = 0;
+    queue->sending_capacity = 0;
+    queue->started = false;
+    if (queue->transport != NULL) {
+        // The reader gets what has been written and then an EOF.
+        transport_close(queue->transport);
+        queue->transport = NULL;
+    }
+    lf_mutex_unlock(&queue->mutex);
+}
+
+#endif // FEDERATED
@@ -0,0 +1,580 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A transport that carries a byte stream between federates over RDMA.
+ * See rdma_transport.h for an overview.
+ */
+
+#if defined(FEDERATED) && defined(FEDERATED_RDMA)
+#include <arpa/inet.h>  // htonl() and ntohl()
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <infiniband/verbs.h>
+
+#include "net_util.h"
+#include "rdma_transport.h"
+#include "util.h"
+
+/** The immediate data of the write that closes the stream. Other writes carry their length. */
+#define RDMA_TRANSPORT_EOF 0
+
+/** The work request ID of receive requests, which tells their completions from those of writes. */
+#define RDMA_TRANSPORT_RECEIVE 1
+
+/** The number of milliseconds between checks of the peer socket while waiting. */
+#define RDMA_TRANSPORT_CHECK_INTERVAL_MS 100
+
+/** The number of nanoseconds that a writer waiting for room sleeps after spinning. */
+#define RDMA_TRANSPORT_WRITER_SLEEP_NS 20000
+
+/**
+ * One side of an RDMA transport.
+ */
+typedef struct rdma_transport_t {
+    /** The functions of the transport. */
+    transport_t base;
+    /** Whether this is the writing side. */
+    bool writing;
+    /** Whether rdma_transport_connect() has succeeded. */
+    bool connected;
+    /** Whether the stream has ended, because of an EOF or an error. */
+    bool closed;
+    /** If the stream is broken, the error code to report. */
+    int error;
+    /** The socket connected to the other side. */
+    int peer_socket;
+    struct ibv_context* context;
+    struct ibv_pd* protection_domain;
+    /** The channel on which the reader sleeps, or NULL for the writer. */
+    struct ibv_comp_channel* channel;
+    struct ibv_cq* completion_queue;
+    struct ibv_qp* queue_pair;
+    enum ibv_mtu mtu;
+    uint32_t psn;
+    /**
+     * For the reader, the ring that the writer writes into.
+     * For the writer, the copy of that ring from which the writes are made.
+     */
+    unsigned char* ring;
+    struct ibv_mr* ring_region;
+    uint64_t capacity;
+    /** For the writer, the number of bytes that the reader has read, written by the reader. */
+    uint64_t* tail_slot;
+    struct ibv_mr* tail_region;
+    /** The number of bytes written (for the writer) or that have arrived (for the reader). */
+    uint64_t head;
+    /** For the reader, the number of bytes read, and the number last sent to the writer. */
+    uint64_t tail;
+    uint64_t tail_sent;
+    /** The number of writes posted whose completion has not been polled. */
+    uint32_t outstanding;
+    /** The memory of the other side that this side writes into. */
+    uint64_t remote_address;
+    uint32_t remote_rkey;
+} rdma_transport_t;
+
+void rdma_endpoint_encode(const rdma_endpoint_t* endpoint, unsigned char* buffer) {
+    encode_uint16(endpoint->lid, buffer);
+    encode_uint32(endpoint->qp_number, buffer + 2);
+    encode_uint32(endpoint->psn, buffer + 6);
+    memcpy(buffer + 10, endpoint->gid, 16);
+    encode_int64((int64_t)endpoint->address, buffer + 26);
+    encode_uint32(endpoint->rkey, buffer + 34);
+    encode_uint32(endpoint->capacity, buffer + 38);
+}
+
+void rdma_endpoint_decode(unsigned char* buffer, rdma_endpoint_t* endpoint) {
+    endpoint->lid = extract_uint16(buffer);
+    endpoint->qp_number = (uint32_t)extract_int32(buffer + 2);
+    endpoint->psn = (uint32_t)extract_int32(buffer + 6);
+    memcpy(endpoint->gid, buffer + 10, 16);
+    endpoint->address = (uint64_t)extract_int64(buffer + 26);
+    endpoint->rkey = (uint32_t)extract_int32(buffer + 34);
+    endpoint->capacity = (uint32_t)extract_int32(buffer + 38);
+}
+
+/**
+ * Mark the stream as ended, with the given error code, or 0 for an EOF.
+ */
+static void rdma_transport_end(rdma_transport_t* transport, int error) {
+    if (!transport->closed && error != 0) {
+        LF_PRINT_LOG("RDMA transport failed with error %d.", error);
+    }
+    transport->closed = true;
+    if (transport->error == 0) transport->error = error;
+}
+
+/**
+ * Give the queue pair a receive request for the next write of the writer.
+ * The writes put their bytes directly into the ring, so the request has no buffer.
+ */
+static void rdma_transport_post_receive(rdma_transport_t* transport) {
+    struct ibv_recv_wr request;
+    memset(&request, 0, sizeof(request));
+    request.wr_id = RDMA_TRANSPORT_RECEIVE;
+    struct ibv_recv_wr* bad_request;
+    int error = ibv_post_recv(transport->queue_pair, &request, &bad_request);
+    if (error != 0) rdma_transport_end(transport, error);
+}
+
+/**
+ * Handle the completions that are ready, without waiting.
+ * @return The number of completions handled.
+ */
+static int rdma_transport_poll(rdma_transport_t* transport) {
+    struct ibv_wc completions[16];
+    int total = 0;
+    int count;
+    while ((count = ibv_poll_cq(transport->completion_queue, 16, completions)) > 0) {
+        for (int i = 0; i < count; i++) {
+            struct ibv_wc* completion = &completions[i];
+            // The opcode of a failed completion is undefined, but the work request ID is not.
+            if (completion->wr_id == RDMA_TRANSPORT_RECEIVE) {
+                if (completion->status == IBV_WC_SUCCESS) {
+                    uint32_t length = ntohl(completion->imm_data);
+                    if (length == RDMA_TRANSPORT_EOF) {
+                        rdma_transport_end(transport, 0);
+                    } else {
+                        transport->head += length;
+                        rdma_transport_post_receive(transport);
+                    }
+                } else {
+                    rdma_transport_end(transport, EPIPE);
+                }
+            } else {
+                transport->outstanding--;
+                if (completion->status != IBV_WC_SUCCESS) {
+                    rdma_transport_end(transport, EPIPE);
+                }
+            }
+        }
+        total += count;
+    }
+    if (count < 0) {
+        rdma_transport_end(transport, EIO);
+    }
+    return total;
+}
+
+/**
+ * Return whether the process on the other side has gone away,
+ * which shows as an EOF or an error on the peer socket.
+ */
+static bool rdma_transport_peer_gone(rdma_transport_t* transport) {
+    if (transport->peer_socket < 0) return false;
+    unsigned char byte;
+    ssize_t result = recv(transport->peer_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return result == 0
+            || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * Post an RDMA write from the given buffer into the given remote memory.
+ * @return 0 on success, or an error code.
+ */
+static int rdma_transport_post_write(
+        rdma_transport_t* transport,
+        enum ibv_wr_opcode opcode,
+        void* buffer,
+        uint32_t length,
+        uint32_t lkey,
+        uint64_t remote_address,
+        uint32_t imm_data,
+        unsigned int flags) {
+    // Make room in the send queue.
+    while (!transport->closed && transport->outstanding >= RDMA_TRANSPORT_QUEUE_DEPTH) {
+        rdma_transport_poll(transport);
+    }
+    if (transport->closed) return transport->error ? transport->error : EPIPE;
+    struct ibv_sge element;
+    element.addr = (uintptr_t)buffer;
+    element.length = length;
+    element.lkey = lkey;
+    struct ibv_send_wr request;
+    memset(&request, 0, sizeof(request));
+    request.opcode = opcode;
+    request.sg_list = (length > 0) ? &element : NULL;
+    request.num_sge = (length > 0) ? 1 : 0;
+    request.imm_data = htonl(imm_data);
+    request.send_flags = IBV_SEND_SIGNALED | flags;
+    request.wr.rdma.remote_addr = remote_address;
+    request.wr.rdma.rkey = transport->remote_rkey;
+    struct ibv_send_wr* bad_request;
+    int error = ibv_post_send(transport->queue_pair, &request, &bad_request);
+    if (error == 0) {
+        transport->outstanding++;
+    }
+    return error;
+}
+
+/**
+ * Tell the writer how many bytes have been read, so that it can reuse their room.
+ * This is done when a quarter of the ring has been read since the last time,
+ * and when the ring becomes empty, so that a writer waiting for room always
+ * hears about it.
+ */
+static void rdma_transport_send_tail(rdma_transport_t* transport) {
+    if (transport->tail - transport->tail_sent < transport->capacity / 4
+            && transport->tail != transport->head) {
+        return;
+    }
+    // An inline write copies the value when it is posted, so it needs no registered memory.
+    uint64_t tail = transport->tail;
+    int error = rdma_transport_post_write(transport, IBV_WR_RDMA_WRITE,
+            &tail, sizeof(tail), 0, transport->remote_address, 0, IBV_SEND_INLINE);
+    if (error != 0) {
+        rdma_transport_end(transport, error);
+    } else {
+        transport->tail_sent = tail;
+    }
+}
+
+static ssize_t rdma_transport_write(transport_t* base, size_t length, const unsigned char* bytes) {
+    rdma_transport_t* transport = (rdma_transport_t*)base;
+    size_t written = 0;
+    int spins = 0;
+    while (written < length) {
+        rdma_transport_poll(transport);
+        if (transport->closed) {
+            errno = transport->error ? transport->error : EPIPE;
+            return -1;
+        }
+        uint64_t tail = __atomic_load_n(transport->tail_slot, __ATOMIC_ACQUIRE);
+        uint64_t room = transport->capacity - (transport->head - tail);
+        if (room == 0) {
+            // Wait for the reader, spinning first.
+            if (spins < RDMA_TRANSPORT_SPIN_COUNT) {
+                spins++;
+                continue;
+            }
+            struct timespec pause = {0, RDMA_TRANSPORT_WRITER_SLEEP_NS};
+            nanosleep(&pause, NULL);
+            if (++spins % (RDMA_TRANSPORT_CHECK_INTERVAL_MS * 1000000 / RDMA_TRANSPORT_WRITER_SLEEP_NS) == 0
+                    && rdma_transport_peer_gone(transport)) {
+                rdma_transport_end(transport, EPIPE);
+            }
+            continue;
+        }
+        spins = 0;
+        // A write does not wrap around the end of the ring.
+        size_t offset = (size_t)(transport->head % transport->capacity);
+        size_t chunk = length - written;
+        if (chunk > room) chunk = (size_t)room;
+        if (chunk > transport->capacity - offset) chunk = (size_t)(transport->capacity - offset);
+        memcpy(transport->ring + offset, bytes + written, chunk);
+        int error = rdma_transport_post_write(transport, IBV_WR_RDMA_WRITE_WITH_IMM,
+                transport->ring + offset, (uint32_t)chunk, transport->ring_region->lkey,
+                transport->remote_address + offset, (uint32_t)chunk, 0);
+        if (error != 0) {
+            rdma_transport_end(transport, error);
+            continue;
+        }
+        transport->head += chunk;
+        written += chunk;
+    }
+    return (ssize_t)length;
+}
+
+/**
+ * Wait until the reader has bytes to read or the stream has ended.
+ * This polls the completion queue, and after RDMA_TRANSPORT_SPIN_COUNT polls,
+ * sleeps on the completion channel.
+ */
+static void rdma_transport_wait_to_read(rdma_transport_t* transport) {
+    int spins = 0;
+    while (transport->head == transport->tail && !transport->closed) {
+        if (rdma_transport_poll(transport) > 0) continue;
+        if (spins < RDMA_TRANSPORT_SPIN_COUNT) {
+            spins++;
+            continue;
+        }
+        // Ask for an event, and poll once more for completions that came before that.
+        int error = ibv_req_notify_cq(transport->completion_queue, 0);
+        if (error != 0) {
+            rdma_transport_end(transport, error);
+            break;
+        }
+        if (rdma_transport_poll(transport) > 0) continue;
+        struct pollfd descriptor;
+        descriptor.fd = transport->channel->fd;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        int ready = poll(&descriptor, 1, RDMA_TRANSPORT_CHECK_INTERVAL_MS);
+        if (ready > 0) {
+            struct ibv_cq* queue;
+            void* context;
+            if (ibv_get_cq_event(transport->channel, &queue, &context) == 0) {
+                ibv_ack_cq_events(queue, 1);
+            }
+        } else if (ready == 0 && rdma_transport_peer_gone(transport)) {
+            // The writer has gone away without closing the stream.
+            rdma_transport_end(transport, 0);
+        }
+    }
+}
+
+static ssize_t rdma_transport_read(transport_t* base, size_t length, unsigned char* buffer) {
+    rdma_transport_t* transport = (rdma_transport_t*)base;
+    rdma_transport_wait_to_read(transport);
+    uint64_t available = transport->head - transport->tail;
+    if (available == 0) {
+        if (transport->error != 0) {
+            errno = transport->error;
+            return -1;
+        }
+        return 0;
+    }
+    size_t chunk = (available < length) ? (size_t)available : length;
+    size_t start = (size_t)(transport->tail % transport->capacity);
+    size_t first = (size_t)transport->capacity - start;
+    if (first > chunk) first = chunk;
+    memcpy(buffer, transport->ring + start, first);
+    memcpy(buffer + first, transport->ring, chunk - first);
+    transport->tail += chunk;
+    if (!transport->closed) {
+        rdma_transport_send_tail(transport);
+    }
+    return (ssize_t)chunk;
+}
+
+static size_t rdma_transport_available(transport_t* base) {
+    rdma_transport_t* transport = (rdma_transport_t*)base;
+    rdma_transport_poll(transport);
+    return (size_t)(transport->head - transport->tail);
+}
+
+static void rdma_transport_close(transport_t* base) {
+    rdma_transport_t* transport = (rdma_transport_t*)base;
+    if (transport->writing && transport->connected && !transport->closed) {
+        // Tell the reader that the stream ends, and wait for the writes to complete.
+        if (rdma_transport_post_write(transport, IBV_WR_RDMA_WRITE_WITH_IMM, NULL, 0, 0,
+                transport->remote_address, RDMA_TRANSPORT_EOF, 0) == 0) {
+            instant_t deadline = lf_time_physical() + SEC(1);
+            while (transport->outstanding > 0 && !transport->closed
+                    && lf_time_physical() < deadline) {
+                rdma_transport_poll(transport);
+            }
+        }
+    }
+    if (transport->queue_pair != NULL) ibv_destroy_qp(transport->queue_pair);
+    if (transport->ring_region != NULL) ibv_dereg_mr(transport->ring_region);
+    if (transport->tail_region != NULL) ibv_dereg_mr(transport->tail_region);
+    if (transport->completion_queue != NULL) ibv_destroy_cq(transport->completion_queue);
+    if (transport->channel != NULL) ibv_destroy_comp_channel(transport->channel);
+    if (transport->protection_domain != NULL) ibv_dealloc_pd(transport->protection_domain);
+    if (transport->context != NULL) ibv_close_device(transport->context);
+    free(transport->ring);
+    free(transport->tail_slot);
+    free(transport);
+}
+
+/**
+ * Allocate and register the given number of bytes for the given transport.
+ * @return 0 on success, or an error code.
+ */
+static int rdma_transport_register(
+        rdma_transport_t* transport,
+        size_t size,
+        int access,
+        void** memory,
+        struct ibv_mr** region) {
+    int error = posix_memalign(memory, 4096, size);
+    if (error != 0) return error;
+    memset(*memory, 0, size);
+    *region = ibv_reg_mr(transport->protection_domain, *memory, size, access);
+    return (*region == NULL) ? (errno ? errno : ENOMEM) : 0;
+}
+
+/**
+ * Open the device and create the queue pair of the given transport, register
+ * the memory that the other side writes into, and describe it in the given endpoint.
+ * @return 0 on success, or an error code.
+ */
+static int rdma_transport_setup(rdma_transport_t* transport, rdma_endpoint_t* local) {
+    int count = 0;
+    struct ibv_device** devices = ibv_get_device_list(&count);
+    if (devices == NULL) return errno ? errno : ENODEV;
+    for (int i = 0; i < count && transport->context == NULL; i++) {
+#ifdef RDMA_TRANSPORT_DEVICE
+        if (strcmp(ibv_get_device_name(devices[i]), RDMA_TRANSPORT_DEVICE) != 0) continue;
+#endif
+        transport->context = ibv_open_device(devices[i]);
+    }
+    ibv_free_device_list(devices);
+    if (transport->context == NULL) return ENODEV;
+
+    struct ibv_port_attr port;
+    int error = ibv_query_port(transport->context, RDMA_TRANSPORT_PORT, &port);
+    if (error != 0) return error;
+    if (port.state != IBV_PORT_ACTIVE) return ENETDOWN;
+    transport->mtu = port.active_mtu;
+    union ibv_gid gid;
+    error = ibv_query_gid(transport->context, RDMA_TRANSPORT_PORT, RDMA_TRANSPORT_GID_INDEX, &gid);
+    if (error != 0) return error;
+
+    transport->protection_domain = ibv_alloc_pd(transport->context);
+    if (transport->protection_domain == NULL) return ENOMEM;
+    if (!transport->writing) {
+        transport->channel = ibv_create_comp_channel(transport->context);
+        if (transport->channel == NULL) return errno ? errno : ENOMEM;
+    }
+    // The reader gets completions for its receive requests and for its writes of the tail.
+    transport->completion_queue = ibv_create_cq(transport->context,
+            2 * RDMA_TRANSPORT_QUEUE_DEPTH, NULL, transport->channel, 0);
+    if (transport->completion_queue == NULL) return errno ? errno : ENOMEM;
+
+    struct ibv_qp_init_attr init;
+    memset(&init, 0, sizeof(init));
+    init.send_cq = transport->completion_queue;
+    init.recv_cq = transport->completion_queue;
+    init.qp_type = IBV_QPT_RC;
+    init.cap.max_send_wr = RDMA_TRANSPORT_QUEUE_DEPTH;
+    init.cap.max_recv_wr = RDMA_TRANSPORT_QUEUE_DEPTH;
+    init.cap.max_send_sge = 1;
+    init.cap.max_recv_sge = 1;
+    init.cap.max_inline_data = sizeof(uint64_t);
+    transport->queue_pair = ibv_create_qp(transport->protection_domain, &init);
+    if (transport->queue_pair == NULL) return errno ? errno : ENOMEM;
+
+    struct ibv_qp_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.qp_state = IBV_QPS_INIT;
+    attributes.pkey_index = 0;
+    attributes.port_num = RDMA_TRANSPORT_PORT;
+    attributes.qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+    error = ibv_modify_qp(transport->queue_pair, &attributes,
+            IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS);
+    if (error != 0) return error;
+
+    memset(local, 0, sizeof(rdma_endpoint_t));
+    if (transport->writing) {
+        // The copy of the ring is allocated once the reader gives its capacity.
+        error = rdma_transport_register(transport, sizeof(uint64_t),
+                IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE,
+                (void**)&transport->tail_slot, &transport->tail_region);
+        if (error != 0) return error;
+        local->address = (uintptr_t)transport->tail_slot;
+        local->rkey = transport->tail_region->rkey;
+    } else {
+        transport->capacity = RDMA_TRANSPORT_CAPACITY;
+        error = rdma_transport_register(transport, RDMA_TRANSPORT_CAPACITY,
+                IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE,
+                (void**)&transport->ring, &transport->ring_region);
+        if (error != 0) return error;
+        for (int i = 0; i < RDMA_TRANSPORT_QUEUE_DEPTH; i++) {
+            rdma_transport_post_receive(transport);
+        }
+        if (transport->closed) return transport->error;
+        local->address = (uintptr_t)transport->ring;
+        local->rkey = transport->ring_region->rkey;
+        local->capacity = RDMA_TRANSPORT_CAPACITY;
+    }
+    transport->psn = (uint32_t)lrand48() & 0xffffff;
+    local->lid = port.lid;
+    local->qp_number = transport->queue_pair->qp_num;
+    local->psn = transport->psn;
+    memcpy(local->gid, gid.raw, sizeof(local->gid));
+    return 0;
+}
+
+int rdma_transport_open(bool writing, int peer_socket, transport_t** result, rdma_endpoint_t* local) {
+    rdma_transport_t* transport = (rdma_transport_t*)calloc(1, sizeof(rdma_transport_t));
+    lf_assert(transport, "Out of memory");
+    transport->base.name = "RDMA";
+    transport->base.write = rdma_transport_write;
+    transport->base.read = rdma_transport_read;
+    transport->base.available = rdma_transport_available;
+    transport->base.close = rdma_transport_close;
+    transport->writing = writing;
+    transport->peer_socket = peer_socket;
+    int error = rdma_transport_setup(transport, local);
+    if (error != 0) {
+        rdma_transport_close(&transport->base);
+        return error;
+    }
+    *result = &transport->base;
+    return 0;
+}
+
+int rdma_transport_connect(transport_t* base, const rdma_endpoint_t* remote) {
+    rdma_transport_t* transport = (rdma_transport_t*)base;
+    if (transport->writing) {
+        if (remote->capacity == 0 || remote->capacity > INT32_MAX) return EPROTO;
+        transport->capacity = remote->capacity;
+        int error = rdma_transport_register(transport, remote->capacity, IBV_ACCESS_LOCAL_WRITE,
+                (void**)&transport->ring, &transport->ring_region);
+        if (error != 0) return error;
+    }
+    transport->remote_address = remote->address;
+    transport->remote_rkey = remote->rkey;
+
+    struct ibv_qp_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.qp_state = IBV_QPS_RTR;
+    attributes.path_mtu = transport->mtu;
+    attributes.dest_qp_num = remote->qp_number;
+    attributes.rq_psn = remote->psn;
+    attributes.max_dest_rd_atomic = 1;
+    attributes.min_rnr_timer = 12;
+    attributes.ah_attr.dlid = remote->lid;
+    attributes.ah_attr.port_num = RDMA_TRANSPORT_PORT;
+    static const uint8_t no_gid[16] = {0};
+    if (memcmp(remote->gid, no_gid, sizeof(no_gid)) != 0) {
+        // RoCE, or InfiniBand across subnets.
+        attributes.ah_attr.is_global = 1;
+        memcpy(attributes.ah_attr.grh.dgid.raw, remote->gid, sizeof(remote->gid));
+        attributes.ah_attr.grh.sgid_index = RDMA_TRANSPORT_GID_INDEX;
+        attributes.ah_attr.grh.hop_limit = 64;
+    }
+    int error = ibv_modify_qp(transport->queue_pair, &attributes,
+            IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN
+            | IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER);
+    if (error != 0) return error;
+
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.qp_state = IBV_QPS_RTS;
+    attributes.timeout = 14;
+    attributes.retry_cnt = 7;
+    // Retry for as long as it takes the reader to post receive requests.
+    attributes.rnr_retry = 7;
+    attributes.sq_psn = transport->psn;
+    attributes.max_rd_atomic = 1;
+    error = ibv_modify_qp(transport->queue_pair, &attributes,
+            IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT | IBV_QP_RNR_RETRY
+            | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC);
+    if (error != 0) return error;
+    transport->connected = true;
+    return 0;
+}
+
+#endif // FEDERATED && FEDERATED_RDMA
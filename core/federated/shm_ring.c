@@ -0,0 +1,318 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A one-way stream of bytes between two processes in shared memory.
+ * See shm_ring.h for an overview.
+ */
+
+#ifdef FEDERATED
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shm_ring.h"
+#include "util.h"
+
+#if defined(PLATFORM_Linux)
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/**
+ * Let a sibling hardware thread run while spinning.
+ */
+static inline void shm_ring_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * Increment the given futex word and wake up the thread waiting on it.
+ */
+static void shm_ring_wake(uint32_t* word) {
+    __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+    // Not FUTEX_PRIVATE_FLAG, since the waiter is in another process.
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * Mark the ring as closed and wake up both sides. The writer then fails,
+ * and the reader reads what is left and then gets an EOF.
+ */
+static void shm_ring_shutdown(shm_ring_t* ring) {
+    shm_ring_control_t* control = ring->control;
+    __atomic_store_n(&control->closed, 1, __ATOMIC_SEQ_CST);
+    shm_ring_wake(&control->written);
+    shm_ring_wake(&control->consumed);
+}
+
+/**
+ * Return whether the process on the other side of the ring has gone away,
+ * which shows as an EOF or an error on the peer socket.
+ */
+static bool shm_ring_peer_gone(shm_ring_t* ring) {
+    if (ring->peer_socket < 0) return false;
+    unsigned char byte;
+    ssize_t result = recv(ring->peer_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return result == 0
+            || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * Return whether the reader (if reading is true) or the writer can proceed,
+ * either because there are bytes or room in the ring or because it is closed.
+ */
+static bool shm_ring_ready(shm_ring_t* ring, bool reading) {
+    shm_ring_control_t* control = ring->control;
+    if (__atomic_load_n(&control->closed, __ATOMIC_SEQ_CST)) return true;
+    uint64_t used = __atomic_load_n(&control->head, __ATOMIC_SEQ_CST)
+            - __atomic_load_n(&control->tail, __ATOMIC_SEQ_CST);
+    return reading ? used > 0 : used < control->capacity;
+}
+
+/**
+ * Wait until the reader (if reading is true) or the writer can proceed.
+ * This first spins, and then sleeps on the futex word that the other side
+ * increments, after announcing that it sleeps. The other side makes the
+ * system call that wakes it up only after seeing that announcement.
+ */
+static void shm_ring_wait(shm_ring_t* ring, bool reading) {
+    // With a single processor, the other side cannot make progress while this spins.
+    static int spin_count = -1;
+    if (spin_count < 0) {
+        spin_count = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SHM_RING_SPIN_COUNT : 0;
+    }
+    for (int i = 0; i < spin_count; i++) {
+        if (shm_ring_ready(ring, reading)) return;
+        shm_ring_pause();
+    }
+    shm_ring_control_t* control = ring->control;
+    uint32_t* waiting = reading ? &control->reader_waiting : &control->writer_waiting;
+    uint32_t* word = reading ? &control->written : &control->consumed;
+    struct timespec timeout;
+    timeout.tv_sec = (time_t)(SHM_RING_CHECK_INTERVAL / 1000000000LL);
+    timeout.tv_nsec = (long)(SHM_RING_CHECK_INTERVAL % 1000000000LL);
+    while (true) {
+        uint32_t seen = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (shm_ring_ready(ring, reading)) break;
+        // This returns at once if the other side has incremented the word since it was read.
+        syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, NULL, 0);
+        if (!shm_ring_ready(ring, reading) && shm_ring_peer_gone(ring)) {
+            shm_ring_shutdown(ring);
+        }
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Map the shared memory object open as the given file descriptor into the
+ * given ring, and close the descriptor.
+ * @return 0 on success, or an error code.
+ */
+static int shm_ring_map(shm_ring_t* ring, int fd, size_t mapped_size, const char* name, int peer_socket) {
+    void* mapped = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (mapped == MAP_FAILED) return error;
+    ring->control = (shm_ring_control_t*)mapped;
+    ring->data = (unsigned char*)mapped + sizeof(shm_ring_control_t);
+    ring->mapped_size = mapped_size;
+    ring->peer_socket = peer_socket;
+    strncpy(ring->name, name, SHM_RING_NAME_LENGTH - 1);
+    ring->name[SHM_RING_NAME_LENGTH - 1] = '\0';
+    return 0;
+}
+
+static ssize_t shm_ring_write(transport_t* transport, size_t length, const unsigned char* bytes) {
+    shm_ring_t* ring = (shm_ring_t*)transport;
+    shm_ring_control_t* control = ring->control;
+    uint64_t capacity = control->capacity;
+    // Only this thread advances head.
+    uint64_t head = __atomic_load_n(&control->head, __ATOMIC_RELAXED);
+    size_t written = 0;
+    while (written < length) {
+        shm_ring_wait(ring, false);
+        if (__atomic_load_n(&control->closed, __ATOMIC_SEQ_CST)) {
+            errno = EPIPE;
+            return -1;
+        }
+        uint64_t room = capacity - (head - __atomic_load_n(&control->tail, __ATOMIC_SEQ_CST));
+        size_t chunk = length - written;
+        if (chunk > room) chunk = (size_t)room;
+        size_t start = (size_t)(head % capacity);
+        size_t first = (size_t)capacity - start;
+        if (first > chunk) first = chunk;
+        memcpy(ring->data + start, bytes + written, first);
+        memcpy(ring->data, bytes + written + first, chunk - first);
+        head += chunk;
+        written += chunk;
+        // Publish the bytes, and then see whether the reader needs waking up.
+        __atomic_store_n(&control->head, head, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&control->reader_waiting, __ATOMIC_SEQ_CST)) {
+            shm_ring_wake(&control->written);
+        }
+    }
+    return (ssize_t)length;
+}
+
+static ssize_t shm_ring_read(transport_t* transport, size_t length, unsigned char* buffer) {
+    shm_ring_t* ring = (shm_ring_t*)transport;
+    shm_ring_control_t* control = ring->control;
+    uint64_t capacity = control->capacity;
+    shm_ring_wait(ring, true);
+    // Only this thread advances tail.
+    uint64_t tail = __atomic_load_n(&control->tail, __ATOMIC_RELAXED);
+    uint64_t available = __atomic_load_n(&control->head, __ATOMIC_SEQ_CST) - tail;
+    if (available == 0) {
+        // Closed, and everything written has been read.
+        return 0;
+    }
+    size_t chunk = (available < length) ? (size_t)available : length;
+    size_t start = (size_t)(tail % capacity);
+    size_t first = (size_t)capacity - start;
+    if (first > chunk) first = chunk;
+    memcpy(buffer, ring->data + start, first);
+    memcpy(buffer + first, ring->data, chunk - first);
+    // Free the room, and then see whether the writer needs waking up.
+    __atomic_store_n(&control->tail, tail + chunk, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&control->writer_waiting, __ATOMIC_SEQ_CST)) {
+        shm_ring_wake(&control->consumed);
+    }
+    return (ssize_t)chunk;
+}
+
+static size_t shm_ring_available(transport_t* transport) {
+    shm_ring_control_t* control = ((shm_ring_t*)transport)->control;
+    return (size_t)(__atomic_load_n(&control->head, __ATOMIC_SEQ_CST)
+            - __atomic_load_n(&control->tail, __ATOMIC_SEQ_CST));
+}
+
+static void shm_ring_close(transport_t* transport) {
+    shm_ring_t* ring = (shm_ring_t*)transport;
+    shm_ring_shutdown(ring);
+    munmap(ring->control, ring->mapped_size);
+    if (ring->creator) {
+        // Fails harmlessly if the other side has removed the name.
+        shm_unlink(ring->name);
+    }
+    free(ring);
+}
+
+/**
+ * Allocate a ring and fill in its functions as a transport.
+ */
+static shm_ring_t* shm_ring_new(void) {
+    shm_ring_t* ring = (shm_ring_t*)calloc(1, sizeof(shm_ring_t));
+    lf_assert(ring, "Out of memory");
+    ring->base.name = "shared memory";
+    ring->base.write = shm_ring_write;
+    ring->base.read = shm_ring_read;
+    ring->base.available = shm_ring_available;
+    ring->base.close = shm_ring_close;
+    return ring;
+}
+
+int shm_ring_create(const char* name, int peer_socket, transport_t** result) {
+    if (strlen(name) >= SHM_RING_NAME_LENGTH) return ENAMETOOLONG;
+    size_t mapped_size = sizeof(shm_ring_control_t) + SHM_RING_CAPACITY;
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) return errno;
+    shm_ring_t* ring = shm_ring_new();
+    // The new object is filled with zeros, which initializes the control block.
+    int error = (ftruncate(fd, (off_t)mapped_size) == 0) ? 0 : errno;
+    if (error != 0) {
+        close(fd);
+    } else {
+        error = shm_ring_map(ring, fd, mapped_size, name, peer_socket);
+    }
+    if (error != 0) {
+        shm_unlink(name);
+        free(ring);
+        return error;
+    }
+    ring->creator = true;
+    ring->control->capacity = SHM_RING_CAPACITY;
+    // Publish the magic number after the other fields.
+    __sync_fetch_and_add(&ring->control->magic, SHM_RING_MAGIC);
+    *result = &ring->base;
+    return 0;
+}
+
+int shm_ring_attach(const char* name, int peer_socket, transport_t** result) {
+    if (strlen(name) >= SHM_RING_NAME_LENGTH) return ENAMETOOLONG;
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) return errno;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size <= sizeof(shm_ring_control_t)) {
+        close(fd);
+        return EPROTO;
+    }
+    shm_ring_t* ring = shm_ring_new();
+    int error = shm_ring_map(ring, fd, (size_t)status.st_size, name, peer_socket);
+    if (error == 0 && (__sync_fetch_and_add(&ring->control->magic, 0) != SHM_RING_MAGIC
+            || ring->control->capacity != ring->mapped_size - sizeof(shm_ring_control_t))) {
+        munmap(ring->control, ring->mapped_size);
+        error = EPROTO;
+    }
+    if (error != 0) {
+        free(ring);
+        return error;
+    }
+    ring->creator = false;
+    shm_unlink(name);
+    *result = &ring->base;
+    return 0;
+}
+
+#else // No futex.
+
+int shm_ring_create(const char* name, int peer_socket, transport_t** result) {
+    return ENOTSUP;
+}
+
+int shm_ring_attach(const char* name, int peer_socket, transport_t** result) {
+    return ENOTSUP;
+}
+
+#endif // PLATFORM_Linux
+#endif // FEDERATED
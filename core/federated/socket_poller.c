@@ -0,0 +1,261 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A small pool of threads that waits for input on many sockets.
+ * See socket_poller.h for an overview.
+ */
+
+#ifdef FEDERATED
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(PLATFORM_Linux)
+#include <sys/epoll.h>
+#elif defined(PLATFORM_Darwin)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include "socket_poller.h"
+#include "util.h"
+
+#if defined(PLATFORM_Linux) || defined(PLATFORM_Darwin)
+
+/** The poller whose thread is the calling thread, if any. */
+static LF_THREAD_LOCAL socket_poller_t* socket_poller_of_thread = NULL;
+
+/**
+ * A socket being watched.
+ */
+typedef struct socket_poller_entry_t {
+    int socket;
+    socket_poller_handler_t handler;
+    void* connection;
+} socket_poller_entry_t;
+
+/**
+ * Ask the given poller to report the next input on the given socket to one
+ * thread, with the given entry (or NULL for the stop pipe).
+ * @param add Whether the socket is new to the poller.
+ * @param once Whether the socket has to be rearmed after each report.
+ * @return 0 on success or an error code.
+ */
+static int socket_poller_arm(socket_poller_t* poller, int socket, void* entry, bool add, bool once) {
+#if defined(PLATFORM_Linux)
+    struct epoll_event event;
+    event.events = EPOLLIN | (once ? EPOLLONESHOT : 0);
+    event.data.ptr = entry;
+    if (epoll_ctl(poller->descriptor, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, socket, &event) != 0) {
+        return errno;
+    }
+#else
+    struct kevent event;
+    EV_SET(&event, socket, EVFILT_READ, (add ? EV_ADD : EV_ENABLE) | (once ? EV_DISPATCH : 0), 0, 0, entry);
+    if (kevent(poller->descriptor, &event, 1, NULL, 0, NULL) != 0) {
+        return errno;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Stop watching the socket of the given entry and free the entry.
+ */
+static void socket_poller_forget(socket_poller_t* poller, socket_poller_entry_t* entry) {
+    // The handler may have closed the socket already, which also
+    // unregisters it, so errors are ignored.
+#if defined(PLATFORM_Linux)
+    struct epoll_event event;
+    epoll_ctl(poller->descriptor, EPOLL_CTL_DEL, entry->socket, &event);
+#else
+    struct kevent event;
+    EV_SET(&event, entry->socket, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent(poller->descriptor, &event, 1, NULL, 0, NULL);
+#endif
+    free(entry);
+    lf_mutex_lock(&poller->mutex);
+    poller->watched--;
+    lf_cond_broadcast(&poller->changed);
+    lf_mutex_unlock(&poller->mutex);
+}
+
+/**
+ * Wait for a socket of the given poller to become readable and return its
+ * entry, or return NULL if the poller is being closed.
+ */
+static socket_poller_entry_t* socket_poller_next(socket_poller_t* poller) {
+    while (true) {
+#if defined(PLATFORM_Linux)
+        struct epoll_event event;
+        int count = epoll_wait(poller->descriptor, &event, 1, -1);
+        if (count == 1) return (socket_poller_entry_t*)event.data.ptr;
+#else
+        struct kevent event;
+        int count = kevent(poller->descriptor, NULL, 0, &event, 1, NULL);
+        if (count == 1) return (socket_poller_entry_t*)event.udata;
+#endif
+        if (count < 0 && errno != EINTR) {
+            lf_print_error("Waiting for input on sockets failed with error %d.", errno);
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Function run by the threads of a poller.
+ * @param poller_arg The poller.
+ */
+static void* socket_poller_thread(void* poller_arg) {
+    socket_poller_t* poller = (socket_poller_t*)poller_arg;
+    socket_poller_of_thread = poller;
+    socket_poller_entry_t* entry;
+    while ((entry = socket_poller_next(poller)) != NULL) {
+        if (!entry->handler(entry->connection)) {
+            socket_poller_forget(poller, entry);
+        } else {
+            int result = socket_poller_arm(poller, entry->socket, entry, false, true);
+            if (result != 0) {
+                lf_print_error("Failed to keep watching socket %d. Error code: %d.", entry->socket, result);
+                socket_poller_forget(poller, entry);
+            }
+        }
+    }
+    return NULL;
+}
+
+int socket_poller_open(socket_poller_t* poller, size_t number_of_threads) {
+    lf_assert(number_of_threads > 0, "A socket poller needs at least one thread.");
+#if defined(PLATFORM_Linux)
+    poller->descriptor = epoll_create1(EPOLL_CLOEXEC);
+#else
+    poller->descriptor = kqueue();
+#endif
+    if (poller->descriptor < 0) return errno;
+    if (pipe(poller->stop_pipe) != 0) {
+        int result = errno;
+        close(poller->descriptor);
+        return result;
+    }
+    // The stop pipe is never read, so once written, it wakes up every thread.
+    int result = socket_poller_arm(poller, poller->stop_pipe[0], NULL, true, false);
+    if (result != 0) {
+        close(poller->stop_pipe[0]);
+        close(poller->stop_pipe[1]);
+        close(poller->descriptor);
+        return result;
+    }
+    lf_mutex_init(&poller->mutex);
+    lf_cond_init(&poller->changed, &poller->mutex);
+    poller->watched = 0;
+    poller->threads = (lf_thread_t*)calloc(number_of_threads, sizeof(lf_thread_t));
+    lf_assert(poller->threads, "Out of memory");
+    poller->number_of_threads = 0;
+    for (size_t i = 0; i < number_of_threads; i++) {
+        result = lf_thread_create(&poller->threads[i], socket_poller_thread, poller);
+        if (result != 0) {
+            socket_poller_close(poller);
+            return result;
+        }
+        poller->number_of_threads++;
+    }
+    return 0;
+}
+
+int socket_poller_add(
+        socket_poller_t* poller,
+        int socket,
+        socket_poller_handler_t handler,
+        void* connection) {
+    socket_poller_entry_t* entry = (socket_poller_entry_t*)malloc(sizeof(socket_poller_entry_t));
+    lf_assert(entry, "Out of memory");
+    entry->socket = socket;
+    entry->handler = handler;
+    entry->connection = connection;
+    lf_mutex_lock(&poller->mutex);
+    poller->watched++;
+    lf_mutex_unlock(&poller->mutex);
+    int result = socket_poller_arm(poller, socket, entry, true, true);
+    if (result != 0) {
+        free(entry);
+        lf_mutex_lock(&poller->mutex);
+        poller->watched--;
+        lf_cond_broadcast(&poller->changed);
+        lf_mutex_unlock(&poller->mutex);
+    }
+    return result;
+}
+
+void socket_poller_wait(socket_poller_t* poller) {
+    // A handler cannot wait for itself to return.
+    if (socket_poller_of_thread == poller) return;
+    lf_mutex_lock(&poller->mutex);
+    while (poller->watched > 0) {
+        lf_cond_wait(&poller->changed);
+    }
+    lf_mutex_unlock(&poller->mutex);
+}
+
+void socket_poller_close(socket_poller_t* poller) {
+    if (poller->threads == NULL || socket_poller_of_thread == poller) return;
+    unsigned char stop = 0;
+    while (write(poller->stop_pipe[1], &stop, 1) < 0 && errno == EINTR);
+    for (size_t i = 0; i < poller->number_of_threads; i++) {
+        lf_thread_join(poller->threads[i], NULL);
+    }
+    free(poller->threads);
+    poller->threads = NULL;
+    poller->number_of_threads = 0;
+    close(poller->stop_pipe[0]);
+    close(poller->stop_pipe[1]);
+    close(poller->descriptor);
+}
+
+#else // Neither epoll nor kqueue.
+
+int socket_poller_open(socket_poller_t* poller, size_t number_of_threads) {
+    poller->threads = NULL;
+    return ENOTSUP;
+}
+
+int socket_poller_add(
+        socket_poller_t* poller,
+        int socket,
+        socket_poller_handler_t handler,
+        void* connection) {
+    return ENOTSUP;
+}
+
+void socket_poller_wait(socket_poller_t* poller) {}
+
+void socket_poller_close(socket_poller_t* poller) {}
+
+#endif
+#endif // FEDERATED
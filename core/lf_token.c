@@ -37,40 +37,389 @@
 int _lf_count_payload_allocations;
 int _lf_count_token_allocations;
 
+/** The largest value that _lf_count_token_allocations has reached. */
+int _lf_count_token_allocations_peak;
+
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>  // Defines memcpy
 #include "lf_token.h"
 #include "environment.h"
 #include "lf_types.h"
-#include "hashset/hashset_itr.h"
 #include "util.h"
 #include "reactor_common.h" // Enter/exit critical sections
 #include "port.h"     // Defines lf_port_base_t.
+#include "probes.h"
+#if !defined(LF_SINGLE_THREADED)
+#include "reactor_threaded.h" // Defines _lf_worker_slot.
+#endif
+
+// Set of token templates, as a map from each template to true.
+#define HASHMAP(token) _lf_template_set ## _ ## token
+#define K token_template_t*
+#define V bool
+#define HASH_OF(key) (size_t) key
+#include "impl/hashmap.h"
+#undef HASHMAP
+#undef K
+#undef V
+#undef HASH_OF
+
+// Map from ports to the index of their readers in _lf_port_readers.
+#define HASHMAP(token) _lf_port_reader_ids ## _ ## token
+#define K lf_port_base_t*
+#define V size_t
+#define HASH_OF(key) (size_t) key
+#include "impl/hashmap.h"
+#undef HASHMAP
+#undef K
+#undef V
+#undef HASH_OF
 
 lf_token_t* _lf_tokens_allocated_in_reactions = NULL;
 
 ////////////////////////////////////////////////////////////////////
 //// Global variables not visible outside this file.
 
+/**
+ * Free list of memory blocks, which are linked through their first word.
+ * Each thread has its own free lists, so recycling does not require a lock.
+ */
+typedef struct _lf_free_list_t {
+    void* head;
+    void* tail;   // The block at the bottom of the list.
+    int size;
+} _lf_free_list_t;
+
+/**
+ * Lock-free stack of blocks that were given up by threads whose free lists
+ * were full. A thread whose free list is empty takes the whole stack, which
+ * avoids the ABA problem of popping single entries.
+ */
+typedef struct _lf_shared_free_list_t {
+    void* volatile head;
+    volatile int size;  // Approximate number of blocks on the stack.
+} _lf_shared_free_list_t;
+
+/** The next block after the given one on a free list. */
+#define _LF_NEXT_FREE(block) (*(void**)(block))
+
 /**
  * Tokens always have the same size in memory so they are easily recycled.
- * When a token is freed, it is inserted into this recycling bin.
+ * When a token is freed, it is pushed onto the free list of the calling thread.
+ */
+static LF_THREAD_LOCAL _lf_free_list_t _lf_token_cache = {NULL, NULL, 0};
+
+/**
+ * To allow a system to recover from burst of activity, the free list of
+ * each thread has a limited size. When it becomes full, its tokens are moved
+ * to the shared recycling bin (or freed using free() in the single-threaded runtime).
  */
-static hashset_t _lf_token_recycling_bin = NULL;
+#define _LF_TOKEN_CACHE_SIZE_LIMIT 64
 
 /**
- * To allow a system to recover from burst of activity, the token recycling
- * bin has a limited size. When it becomes full, token are freed using free().
+ * The shared recycling bin has a limited size as well. When it becomes full,
+ * tokens are freed using free().
  */
 #define _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT 512
 
+/**
+ * The limits on recycled tokens in effect, which _lf_reserve_tokens() raises so
+ * that none of the reserved tokens is ever freed during execution.
+ */
+static int _lf_token_cache_limit = _LF_TOKEN_CACHE_SIZE_LIMIT;
+static int _lf_token_bin_limit = _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT;
+
+/** The number of tokens reserved by _lf_reserve_tokens() or 0 if there is no reserve. */
+static int _lf_token_reserve = 0;
+
+#ifndef LF_PAYLOAD_POOL_MAX_SIZE
+#define LF_PAYLOAD_POOL_MAX_SIZE 65536
+#endif
+
+/**
+ * Payloads that the runtime allocates for types without a destructor are
+ * recycled in pools of power-of-two size classes, starting at this size.
+ * Payloads larger than LF_PAYLOAD_POOL_MAX_SIZE bytes are allocated with
+ * malloc() and freed with free(). Setting LF_PAYLOAD_POOL_MAX_SIZE to 0
+ * disables the pools.
+ */
+#define _LF_PAYLOAD_MIN_SIZE ((size_t)16)
+
+/** Number of size classes, which is enough for any LF_PAYLOAD_POOL_MAX_SIZE. */
+#define _LF_PAYLOAD_NUM_CLASSES 28
+
+/** Limits on the number of payloads of each size class that are kept for reuse. */
+#define _LF_PAYLOAD_CACHE_SIZE_LIMIT 8
+#define _LF_PAYLOAD_RECYCLING_BIN_SIZE_LIMIT 32
+
+/** The payload class of a payload stored in the inline_value field of its token. */
+#define _LF_PAYLOAD_INLINE -2
+
+static LF_THREAD_LOCAL _lf_free_list_t _lf_payload_cache[_LF_PAYLOAD_NUM_CLASSES];
+
+#if !defined(LF_SINGLE_THREADED)
+static _lf_shared_free_list_t _lf_token_recycling_bin = {NULL, 0};
+static _lf_shared_free_list_t _lf_payload_recycling_bin[_LF_PAYLOAD_NUM_CLASSES];
+#endif
+
+static inline void _lf_free_list_push(_lf_free_list_t* list, void* block) {
+    _LF_NEXT_FREE(block) = list->head;
+    if (list->head == NULL) list->tail = block;
+    list->head = block;
+    list->size++;
+}
+
+static inline void* _lf_free_list_pop(_lf_free_list_t* list) {
+    void* block = list->head;
+    if (block != NULL) {
+        list->head = _LF_NEXT_FREE(block);
+        if (list->head == NULL) list->tail = NULL;
+        list->size--;
+    }
+    return block;
+}
+
+/**
+ * Free the given block and the blocks linked after it.
+ */
+static void _lf_free_blocks(void* block) {
+    while (block != NULL) {
+        void* next = _LF_NEXT_FREE(block);
+        LF_PRINT_DEBUG("Freeing recycled memory: %p", block);
+        free(block);
+        block = next;
+    }
+}
+
+#if !defined(LF_SINGLE_THREADED)
+/**
+ * Empty the given free list, either onto the given shared recycling bin or,
+ * if that holds 'limit' blocks or more, by freeing the blocks.
+ */
+static void _lf_free_list_flush(_lf_free_list_t* list, _lf_shared_free_list_t* shared, int limit) {
+    if (list->head == NULL) return;
+    if (shared->size < limit) {
+        lf_atomic_fetch_add(&shared->size, list->size);
+        void* head;
+        do {
+            head = shared->head;
+            _LF_NEXT_FREE(list->tail) = head;
+        } while (!lf_bool_compare_and_swap(&shared->head, head, list->head));
+    } else {
+        _lf_free_blocks(list->head);
+    }
+    list->head = list->tail = NULL;
+    list->size = 0;
+}
+
+/**
+ * Take all blocks from the given shared recycling bin and return the first one.
+ */
+static void* _lf_shared_free_list_take_all(_lf_shared_free_list_t* shared) {
+    void* head;
+    do {
+        head = shared->head;
+    } while (head != NULL && !lf_bool_compare_and_swap(&shared->head, head, NULL));
+    return head;
+}
+
+/**
+ * Refill the given empty free list from the given shared recycling bin.
+ * This keeps at most 'keep' blocks and returns the rest to the bin, so that a
+ * thread that frees a block after this does not immediately flush them back.
+ */
+static void _lf_free_list_refill(_lf_free_list_t* list, _lf_shared_free_list_t* shared, int keep) {
+    if (shared->head == NULL) return;
+    void* head = _lf_shared_free_list_take_all(shared);
+    if (head == NULL) return;
+    int size = 1;
+    void* tail = head;
+    while (_LF_NEXT_FREE(tail) != NULL && size < keep) {
+        tail = _LF_NEXT_FREE(tail);
+        size++;
+    }
+    lf_atomic_fetch_add(&shared->size, -size);
+    void* rest = _LF_NEXT_FREE(tail);
+    _LF_NEXT_FREE(tail) = NULL;
+    if (rest != NULL) {
+        void* rest_tail = rest;
+        while (_LF_NEXT_FREE(rest_tail) != NULL) rest_tail = _LF_NEXT_FREE(rest_tail);
+        void* overflow;
+        do {
+            overflow = shared->head;
+            _LF_NEXT_FREE(rest_tail) = overflow;
+        } while (!lf_bool_compare_and_swap(&shared->head, overflow, rest));
+    }
+    list->head = head;
+    list->tail = tail;
+    list->size = size;
+}
+#endif
+
+/**
+ * Put the given block on the given free list of the calling thread. If that list
+ * holds 'list_limit' blocks, it first moves them to the given shared recycling bin,
+ * which has a limit of its own. The single-threaded runtime frees the block instead.
+ */
+static void _lf_recycle_block(_lf_free_list_t* list, _lf_shared_free_list_t* shared,
+        int list_limit, int shared_limit, void* block) {
+    if (list->size >= list_limit) {
+#if !defined(LF_SINGLE_THREADED)
+        _lf_free_list_flush(list, shared, shared_limit);
+#else
+        LF_PRINT_DEBUG("Freeing memory because the recycling bin is full: %p", block);
+        free(block);
+        return;
+#endif
+    }
+    _lf_free_list_push(list, block);
+}
+
+/**
+ * Return the size class of a payload of the given size, or -1 if payloads of
+ * this size are not pooled.
+ */
+static int _lf_payload_class(size_t size) {
+    if (LF_PAYLOAD_POOL_MAX_SIZE == 0 || size > LF_PAYLOAD_POOL_MAX_SIZE) return -1;
+    int result = 0;
+    size_t class_size = _LF_PAYLOAD_MIN_SIZE;
+    while (class_size < size) {
+        class_size <<= 1;
+        result++;
+    }
+    return result < _LF_PAYLOAD_NUM_CLASSES ? result : -1;
+}
+
+/**
+ * Allocate memory for a payload of the given size that will be carried by the given
+ * token. Unless the type of the token has a destructor, which is then responsible for
+ * freeing it, the memory is inside the token if the payload fits there and otherwise
+ * comes from a pool.
+ * @param token The token that will carry the payload.
+ * @param size The size of the payload in bytes.
+ * @param zero Whether to set the memory to zero, as calloc() would.
+ */
+static void* _lf_allocate_payload(lf_token_t* token, size_t size, bool zero) {
+    token->payload_class = -1;
+#ifndef _PYTHON_TARGET_ENABLED
+    if (token->type->destructor == NULL) {
+#if LF_TOKEN_INLINE_SIZE > 0
+        if (size <= LF_TOKEN_INLINE_SIZE) {
+            if (zero) memset(token->inline_value.bytes, 0, size);
+            token->payload_class = _LF_PAYLOAD_INLINE;
+            return token->inline_value.bytes;
+        }
+#endif
+        int payload_class = _lf_payload_class(size);
+        if (payload_class >= 0) {
+            _lf_free_list_t* list = &_lf_payload_cache[payload_class];
+#if !defined(LF_SINGLE_THREADED)
+            if (list->head == NULL) {
+                _lf_free_list_refill(list, &_lf_payload_recycling_bin[payload_class],
+                        _LF_PAYLOAD_CACHE_SIZE_LIMIT / 2);
+            }
+#endif
+            void* result = _lf_free_list_pop(list);
+            if (result == NULL) {
+                result = malloc(_LF_PAYLOAD_MIN_SIZE << payload_class);
+                if (result == NULL) return NULL;
+            }
+            if (zero) memset(result, 0, size);
+            token->payload_class = payload_class;
+            return result;
+        }
+    }
+#endif
+    return zero ? calloc(1, size) : malloc(size);
+}
+
+/**
+ * Return the payload of the given token to the pool from which it was allocated.
+ */
+static void _lf_free_payload(lf_token_t* token) {
+    int payload_class = token->payload_class;
+#if !defined(LF_SINGLE_THREADED)
+    _lf_shared_free_list_t* shared = &_lf_payload_recycling_bin[payload_class];
+#else
+    _lf_shared_free_list_t* shared = NULL;
+#endif
+    _lf_recycle_block(&_lf_payload_cache[payload_class], shared,
+            _LF_PAYLOAD_CACHE_SIZE_LIMIT, _LF_PAYLOAD_RECYCLING_BIN_SIZE_LIMIT, token->value);
+    token->payload_class = -1;
+}
+
+/**
+ * Reactions that may read the value of a port, as declared with
+ * _lf_declare_port_readers(). The entry of a port is found with _lf_port_reader_ids.
+ */
+typedef struct _lf_port_readers_t {
+    lf_port_base_t* port;
+    reaction_t** readers;
+    size_t num_readers;
+} _lf_port_readers_t;
+
+static _lf_port_readers_t* _lf_port_readers = NULL;
+static size_t _lf_port_readers_size = 0;
+static size_t _lf_port_readers_capacity = 0;
+static _lf_port_reader_ids_t* _lf_port_reader_ids = NULL;
+
+/**
+ * Return whether the value of the given port can be modified by the calling
+ * reaction without a copy. This is the case if readers have been declared for
+ * the port and all of them except one have completed at the current tag. A
+ * reaction completes at most once per tag, so these will not read the value
+ * again. The remaining one must be executing, so it is the calling reaction.
+ */
+static bool _lf_is_last_reader(lf_port_base_t* port) {
+    size_t* index = _lf_port_reader_ids == NULL ? NULL : _lf_port_reader_ids_find(_lf_port_reader_ids, port);
+    if (index == NULL) return false;
+    _lf_port_readers_t* entry = &_lf_port_readers[*index];
+    if (entry->num_readers == 0) return false;
+    environment_t* env = ((self_base_t*)entry->readers[0]->self)->environment;
+    size_t unfinished = 0;
+    for (size_t j = 0; j < entry->num_readers; j++) {
+        reaction_t* reader = entry->readers[j];
+        if (lf_tag_compare(reader->completed_tag, env->current_tag) == 0) continue;
+        if (((self_base_t*)reader->self)->executing_reaction != reader || ++unfinished > 1) {
+            return false;
+        }
+    }
+#if !defined(LF_SINGLE_THREADED)
+    // Do not modify the value before the completions of the others are seen.
+    lf_memory_barrier();
+#endif
+    return unfinished == 1;
+}
+
 /**
  * Set of token templates (trigger_t or port_base_t objects) that
  * have been initialized. This is used to free their tokens at
  * the end of program execution. 
  */
-static hashset_t _lf_token_templates = NULL;
+static _lf_template_set_t* _lf_token_templates = NULL;
+
+/**
+ * A template whose initialization has been deferred and the element size
+ * with which to initialize it.
+ */
+typedef struct {
+    token_template_t* tmplt;
+    size_t element_size;
+} _lf_deferred_template_t;
+
+/**
+ * The templates whose initialization the calling thread has deferred
+ * (@see _lf_defer_template_initialization()).
+ */
+typedef struct {
+    bool deferring;
+    _lf_deferred_template_t* templates;
+    size_t size;
+    size_t capacity;
+} _lf_deferred_templates_t;
+
+static LF_THREAD_LOCAL _lf_deferred_templates_t _lf_deferred_templates = {false, NULL, 0, 0};
 
 ////////////////////////////////////////////////////////////////////
 //// Functions that users may call.
@@ -79,6 +428,66 @@ lf_token_t* lf_new_token(void* port_or_action, void* val, size_t len) {
     return _lf_new_token((token_type_t*)port_or_action, val, len);
 }
 
+/**
+ * Put the given token on the list of tokens allocated in reactions of the given
+ * environment, which releases them at the start of its next time step. A worker
+ * of the environment appends to its own list. Other threads share the last list
+ * of the environment. Without an environment, the token goes on the global list.
+ */
+static void _lf_defer_token_release(environment_t* env, lf_token_t* token) {
+    lf_token_t** list = &_lf_tokens_allocated_in_reactions;
+    if (env != NULL) {
+#if defined(LF_SINGLE_THREADED)
+        list = &env->token_copies[0];
+#else
+        int slot = _lf_worker_slot(env);
+        if (slot < 0) {
+            lf_token_t** shared = &env->token_copies[env->num_token_copy_lists - 1];
+            lf_token_t* head;
+            do {
+                head = *shared;
+                token->next = head;
+            } while (!lf_bool_compare_and_swap(shared, head, token));
+            return;
+        }
+        list = &env->token_copies[slot];
+#endif
+    }
+    token->next = *list;
+    *list = token;
+}
+
+lf_token_t* _lf_copy_token(token_type_t* type, lf_token_t* token) {
+    assert(token != NULL);
+    lf_token_t* result = _lf_new_token(type, NULL, token->length);
+    if (token->value == NULL) {
+        return result;
+    }
+    // Copy the payload.
+    void* copy;
+    if (type->copy_constructor == NULL) {
+        LF_PRINT_DEBUG("_lf_copy_token: Copy constructor is NULL. Using default strategy.");
+        size_t size = type->element_size * token->length;
+        copy = _lf_allocate_payload(result, size, false);
+        LF_PRINT_DEBUG("Allocating memory for copy %p.", copy);
+        memcpy(copy, token->value, size);
+    } else {
+        LF_PRINT_DEBUG("_lf_copy_token: Copy constructor is not NULL. Using copy constructor.");
+        if (type->destructor == NULL) {
+            lf_print_warning("_lf_copy_token: Using non-default copy constructor "
+                    "without setting destructor. Potential memory leak.");
+        }
+        copy = type->copy_constructor(token->value);
+    }
+    LF_PRINT_DEBUG("_lf_copy_token: Allocated memory for payload (token value): %p", copy);
+
+    // Count allocations to issue a warning if this is never freed.
+    _lf_count_payload_allocations++;
+
+    result->value = copy;
+    return result;
+}
+
 lf_token_t* lf_writable_copy(lf_port_base_t* port) {
     assert(port != NULL);
 
@@ -91,39 +500,23 @@ lf_token_t* lf_writable_copy(lf_port_base_t* port) {
                 "is only one reader and the reference count is %zu.", token->ref_count);
         return token;
     }
+    if (token->ref_count == 1 && _lf_is_last_reader(port)) {
+        LF_PRINT_DEBUG("lf_writable_copy: Avoided copy because all other readers "
+                "have completed at this tag.");
+        return token;
+    }
     LF_PRINT_DEBUG("lf_writable_copy: Copying value. Reference count is %zu.",
             token->ref_count);
-    // Copy the payload.
-    void* copy;
-    if (port->tmplt.type.copy_constructor == NULL) {
-        LF_PRINT_DEBUG("lf_writable_copy: Copy constructor is NULL. Using default strategy.");
-        size_t size = port->tmplt.type.element_size * token->length;
-        if (size == 0) {
-            return token;
-        }
-        copy = malloc(size);
-        LF_PRINT_DEBUG("Allocating memory for writable copy %p.", copy);
-        memcpy(copy, token->value, size);
-    } else {
-        LF_PRINT_DEBUG("lf_writable_copy: Copy constructor is not NULL. Using copy constructor.");
-        if (port->tmplt.type.destructor == NULL) {
-            lf_print_warning("lf_writable_copy: Using non-default copy constructor "
-                    "without setting destructor. Potential memory leak.");
-        }
-        copy = port->tmplt.type.copy_constructor(token->value);
+    size_t size = port->tmplt.type.element_size * token->length;
+    if (port->tmplt.type.copy_constructor == NULL && size == 0) {
+        return token;
     }
-    LF_PRINT_DEBUG("lf_writable_copy: Allocated memory for payload (token value): %p", copy);
-
-    // Count allocations to issue a warning if this is never freed.
-    _lf_count_payload_allocations++;
-
     // Create a new, dynamically allocated token.
-    lf_token_t* result = _lf_new_token((token_type_t*)port, copy, token->length);
+    lf_token_t* result = _lf_copy_token((token_type_t*)port, token);
     result->ref_count = 1;
     // Arrange for the token to be released (and possibly freed) at
     // the start of the next time step.
-    result->next = _lf_tokens_allocated_in_reactions;
-    _lf_tokens_allocated_in_reactions = result;
+    _lf_defer_token_release(port->source_reactor ? port->source_reactor->environment : NULL, result);
 
     return result;
 }
@@ -137,8 +530,14 @@ void _lf_free_token_value(lf_token_t* token) {
         // Free the value field (the payload).
         LF_PRINT_DEBUG("_lf_free_token_value: Freeing allocated memory for payload (token value): %p",
             token->value);
-        // First check the token's destructor field and invoke it if it is not NULL.
-        if (token->type->destructor != NULL) {
+        if (token->payload_class >= 0) {
+            // The payload came from a pool.
+            _lf_free_payload(token);
+        }
+        // A payload stored in the token goes away with the token.
+        else if (token->payload_class == _LF_PAYLOAD_INLINE) {}
+        // Otherwise, check the token's destructor field and invoke it if it is not NULL.
+        else if (token->type->destructor != NULL) {
             token->type->destructor(token->value);
         }
         // If Python Target is not enabled and destructor is NULL
@@ -149,6 +548,7 @@ void _lf_free_token_value(lf_token_t* token) {
 #endif
         }
         token->value = NULL;
+        token->payload_class = -1;
     }
 }
 
@@ -156,36 +556,25 @@ token_freed _lf_free_token(lf_token_t* token) {
     token_freed result = NOT_FREED;
     if (token == NULL) return result;
     if (token->ref_count > 0) return result;
+    LF_PROBE1(token_free, token);
     _lf_free_token_value(token);
 
     // Tokens that are created at the start of execution and associated with
     // output ports or actions persist until they are overwritten.
-    // Need to acquire a mutex to access the recycle bin.
-    if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not enter critical section");
-    }
-    if (_lf_token_recycling_bin == NULL) {
-        _lf_token_recycling_bin = hashset_create(4); // Initial size is 16.
-        if (_lf_token_recycling_bin == NULL) {
-            lf_critical_section_exit(GLOBAL_ENVIRONMENT);
-            lf_print_error_and_exit("Out of memory: failed to setup _lf_token_recycling_bin");
-        }
-    }
-    if (hashset_num_items(_lf_token_recycling_bin) < _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT) {
-        // Recycle instead of freeing.
-        LF_PRINT_DEBUG("_lf_free_token: Putting token on the recycling bin: %p", token);
-        if (!hashset_add(_lf_token_recycling_bin, token)) {
-            lf_print_warning("Putting token %p on the recycling bin, but it is already there!", token);
-        }
-    } else {
-        // Recycling bin is full.
-        LF_PRINT_DEBUG("_lf_free_token: Freeing allocated memory for token: %p", token);
-        free(token);
-    }
-    if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not leave critical section");
-    }
+    // Recycle instead of freeing.
+    LF_PRINT_DEBUG("_lf_free_token: Putting token on the recycling bin: %p", token);
+#if !defined(LF_SINGLE_THREADED)
+    _lf_shared_free_list_t* shared = &_lf_token_recycling_bin;
+#else
+    _lf_shared_free_list_t* shared = NULL;
+#endif
+    _lf_recycle_block(&_lf_token_cache, shared,
+            _lf_token_cache_limit, _lf_token_bin_limit, token);
+#if !defined(LF_SINGLE_THREADED)
+    lf_atomic_fetch_add(&_lf_count_token_allocations, -1);
+#else
     _lf_count_token_allocations--;
+#endif
     result &= TOKEN_FREED;
 
     return result;
@@ -194,23 +583,22 @@ token_freed _lf_free_token(lf_token_t* token) {
 lf_token_t* _lf_new_token(token_type_t* type, void* value, size_t length) {
     lf_token_t* result = NULL;
     // Check the recycling bin.
-    if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not enter critical section");
+#if !defined(LF_SINGLE_THREADED)
+    if (_lf_token_cache.head == NULL) {
+        _lf_free_list_refill(&_lf_token_cache, &_lf_token_recycling_bin, _lf_token_cache_limit / 2);
     }
-    if (_lf_token_recycling_bin != NULL) {
-        hashset_itr_t iterator = hashset_iterator(_lf_token_recycling_bin);
-        if (hashset_iterator_next(iterator) >= 0) {
-            result = hashset_iterator_value(iterator);
-            hashset_remove(_lf_token_recycling_bin, result);
-            LF_PRINT_DEBUG("_lf_new_token: Retrieved token from the recycling bin: %p", result);
-        }
-        free(iterator);
-    }
-    if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not leave critical section");
+#endif
+    result = (lf_token_t*)_lf_free_list_pop(&_lf_token_cache);
+    if (result != NULL) {
+        result->next = NULL;
+        LF_PRINT_DEBUG("_lf_new_token: Retrieved token from the recycling bin: %p", result);
     }
     if (result == NULL) {
         // Nothing found on the recycle bin.
+        if (_lf_token_reserve > 0) {
+            lf_print_error_and_exit("More tokens are needed than the %d reserved by the memory profile.",
+                    _lf_token_reserve);
+        }
         result = (lf_token_t*)calloc(1, sizeof(lf_token_t));
         LF_PRINT_DEBUG("_lf_new_token: Allocated memory for token: %p", result);
     }
@@ -218,6 +606,37 @@ lf_token_t* _lf_new_token(token_type_t* type, void* value, size_t length) {
     result->length = length;
     result->value = value;
     result->ref_count = 0;
+    result->payload_class = -1;
+    LF_PROBE1(token_alloc, result);
+    // Count allocations to issue a warning if this is never freed.
+#if !defined(LF_SINGLE_THREADED)
+    // Workers allocate tokens concurrently, so raise the peak with a CAS loop
+    // that gives up as soon as another thread has recorded a larger count.
+    int count = lf_atomic_add_fetch(&_lf_count_token_allocations, 1);
+    int peak = _lf_count_token_allocations_peak;
+    while (count > peak
+            && !lf_bool_compare_and_swap(&_lf_count_token_allocations_peak, peak, count)) {
+        peak = _lf_count_token_allocations_peak;
+    }
+#else
+    if (++_lf_count_token_allocations > _lf_count_token_allocations_peak) {
+        _lf_count_token_allocations_peak = _lf_count_token_allocations;
+    }
+#endif
+    return result;
+}
+
+lf_token_t* _lf_new_token_with_payload(token_type_t* type, size_t length, size_t size) {
+    lf_token_t* result = _lf_new_token(type, NULL, length);
+    result->value = _lf_allocate_payload(result, size, false);
+    if (result->value == NULL && size > 0) {
+        _lf_free_token(result);
+        return NULL;
+    }
+    if (result->value != NULL) {
+        // Count allocations to issue a warning if this is never freed.
+        _lf_count_payload_allocations++;
+    }
     return result;
 }
 
@@ -240,18 +659,11 @@ lf_token_t* _lf_get_token(token_template_t* tmplt) {
     return tmplt->token;
 }
 
-void _lf_initialize_template(token_template_t* tmplt, size_t element_size) {
-    assert(tmplt != NULL);
-    if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not enter critical section");
-    }
-    if (_lf_token_templates == NULL) {
-        _lf_token_templates = hashset_create(4); // Initial size is 16.
-    }
-    hashset_add(_lf_token_templates, tmplt);
-    if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
-        lf_print_error_and_exit("Could not leave critical section");
-    }
+/**
+ * Give the specified template a token with the specified element size.
+ * @see _lf_initialize_template().
+ */
+static void _lf_initialize_template_token(token_template_t* tmplt, size_t element_size) {
     if (tmplt->token != NULL) {
         if (tmplt->token->ref_count == 1 && tmplt->token->type->element_size == element_size) {
             // Template token is already set.
@@ -270,6 +682,71 @@ void _lf_initialize_template(token_template_t* tmplt, size_t element_size) {
     tmplt->token->ref_count = 1;
 }
 
+/**
+ * Record the specified template on the set of templates whose tokens are freed
+ * at the end of execution. This assumes that the caller is in a critical section.
+ */
+static void _lf_register_template(token_template_t* tmplt) {
+    if (_lf_token_templates == NULL) {
+        _lf_token_templates = _lf_template_set_new(16, NULL);
+    }
+    _lf_template_set_put(_lf_token_templates, tmplt, true);
+}
+
+void _lf_initialize_template(token_template_t* tmplt, size_t element_size) {
+    assert(tmplt != NULL);
+    _lf_deferred_templates_t* deferred = &_lf_deferred_templates;
+    if (deferred->deferring) {
+        if (deferred->size == deferred->capacity) {
+            deferred->capacity = (deferred->capacity == 0) ? 64 : 2 * deferred->capacity;
+            deferred->templates = (_lf_deferred_template_t*)realloc(
+                    deferred->templates, deferred->capacity * sizeof(_lf_deferred_template_t));
+            lf_assert(deferred->templates != NULL, "Out of memory");
+        }
+        deferred->templates[deferred->size++] = (_lf_deferred_template_t){tmplt, element_size};
+        if (tmplt->token == NULL) {
+            tmplt->type.element_size = element_size;
+        }
+        return;
+    }
+    if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+    _lf_register_template(tmplt);
+    if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+    _lf_initialize_template_token(tmplt, element_size);
+}
+
+void _lf_defer_template_initialization(void) {
+    _lf_deferred_templates.deferring = true;
+}
+
+void _lf_complete_template_initialization(void) {
+    _lf_deferred_templates_t* deferred = &_lf_deferred_templates;
+    deferred->deferring = false;
+    if (deferred->size == 0) {
+        return;
+    }
+    // Token allocation is counted in globals, so the tokens are created in
+    // the same critical section as the templates are registered.
+    if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+    for (size_t i = 0; i < deferred->size; i++) {
+        _lf_register_template(deferred->templates[i].tmplt);
+        _lf_initialize_template_token(deferred->templates[i].tmplt, deferred->templates[i].element_size);
+    }
+    if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+    free(deferred->templates);
+    deferred->templates = NULL;
+    deferred->size = 0;
+    deferred->capacity = 0;
+}
+
 lf_token_t* _lf_initialize_token_with_value(token_template_t* tmplt, void* value, size_t length) {
     assert(tmplt != NULL);
     LF_PRINT_DEBUG("_lf_initialize_token_with_value: template %p, value %p", tmplt, value);
@@ -283,12 +760,52 @@ lf_token_t* _lf_initialize_token_with_value(token_template_t* tmplt, void* value
 
 lf_token_t* _lf_initialize_token(token_template_t* tmplt, size_t length) {
     assert(tmplt != NULL);
+    lf_token_t* result = _lf_initialize_token_with_value(tmplt, NULL, length);
     // Allocate memory for storing the array.
-    void* value = calloc(length, tmplt->type.element_size);
-    lf_token_t* result = _lf_initialize_token_with_value(tmplt, value, length);
+    result->value = _lf_allocate_payload(result, length * tmplt->type.element_size, true);
     return result;
 }
 
+void _lf_reserve_tokens(int count) {
+    if (count <= 0) return;
+#if !defined(LF_SINGLE_THREADED)
+    // Each thread may hold up to a full free list of tokens that others cannot use.
+    count += (int)(_lf_number_of_workers + 1) * _LF_TOKEN_CACHE_SIZE_LIMIT;
+#endif
+#if defined(LF_SINGLE_THREADED)
+    if (count > _lf_token_cache_limit) _lf_token_cache_limit = count;
+    _lf_free_list_t* list = &_lf_token_cache;
+#else
+    if (count > _lf_token_bin_limit) _lf_token_bin_limit = count;
+    _lf_free_list_t reserve = {NULL, NULL, 0};
+    _lf_free_list_t* list = &reserve;
+#endif
+    for (int i = 0; i < count; i++) {
+        void* token = calloc(1, sizeof(lf_token_t));
+        lf_assert(token != NULL, "Out of memory");
+        _lf_free_list_push(list, token);
+    }
+#if !defined(LF_SINGLE_THREADED)
+    _lf_free_list_flush(list, &_lf_token_recycling_bin, _lf_token_bin_limit);
+#endif
+    _lf_token_reserve = count;
+    LF_PRINT_LOG("Reserved %d tokens.", count);
+}
+
+void _lf_get_token_stats(size_t* recycled_tokens, size_t* pooled_payload_bytes) {
+    *recycled_tokens = (size_t)_lf_token_cache.size;
+    *pooled_payload_bytes = 0;
+    for (int i = 0; i < _LF_PAYLOAD_NUM_CLASSES; i++) {
+        *pooled_payload_bytes += (size_t)_lf_payload_cache[i].size * (_LF_PAYLOAD_MIN_SIZE << i);
+    }
+#if !defined(LF_SINGLE_THREADED)
+    *recycled_tokens += (size_t)_lf_token_recycling_bin.size;
+    for (int i = 0; i < _LF_PAYLOAD_NUM_CLASSES; i++) {
+        *pooled_payload_bytes += (size_t)_lf_payload_recycling_bin[i].size * (_LF_PAYLOAD_MIN_SIZE << i);
+    }
+#endif
+}
+
 void _lf_free_all_tokens() {
     // Free template tokens.
     if (lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
@@ -297,33 +814,91 @@ void _lf_free_all_tokens() {
     // It is possible for a token to be a template token for more than one port
     // or action because the same token may be sent to multiple output ports.
     if (_lf_token_templates != NULL) {
-        hashset_itr_t iterator = hashset_iterator(_lf_token_templates);
-        while (hashset_iterator_next(iterator) >= 0) {
-            token_template_t* tmplt = (token_template_t*)hashset_iterator_value(iterator);
-            _lf_done_using(tmplt->token);
-            tmplt->token = NULL;
+        size_t position = 0;
+        _lf_template_set_entry_t* entry;
+        while ((entry = _lf_template_set_next(_lf_token_templates, &position)) != NULL) {
+            _lf_done_using(entry->key->token);
+            entry->key->token = NULL;
         }
-        free(iterator);
-        hashset_destroy(_lf_token_templates);
+        _lf_template_set_free(_lf_token_templates);
         _lf_token_templates = NULL;
     }
-    if (_lf_token_recycling_bin != NULL) {
-        hashset_itr_t iterator = hashset_iterator(_lf_token_recycling_bin);
-        while (hashset_iterator_next(iterator) >= 0) {
-            void* token = hashset_iterator_value(iterator);
-            LF_PRINT_DEBUG("Freeing token from _lf_token_recycling_bin: %p", token);
-            // Payload should already be freed, so we just free the token:
-            free(token);
-        }
-        free(iterator);
-        hashset_destroy(_lf_token_recycling_bin);
-        _lf_token_recycling_bin = NULL;
+    for (size_t i = 0; i < _lf_port_readers_size; i++) {
+        free(_lf_port_readers[i].readers);
+    }
+    free(_lf_port_readers);
+    _lf_port_readers = NULL;
+    if (_lf_port_reader_ids != NULL) {
+        _lf_port_reader_ids_free(_lf_port_reader_ids);
+        _lf_port_reader_ids = NULL;
+    }
+    _lf_port_readers_size = _lf_port_readers_capacity = 0;
+    // Payloads should already be freed, so we just free the tokens
+    // and the pooled memory for payloads.
+    _lf_free_blocks(_lf_token_cache.head);
+    _lf_token_cache = (_lf_free_list_t){NULL, NULL, 0};
+    _lf_token_reserve = 0;
+    _lf_token_cache_limit = _LF_TOKEN_CACHE_SIZE_LIMIT;
+    _lf_token_bin_limit = _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT;
+    for (int i = 0; i < _LF_PAYLOAD_NUM_CLASSES; i++) {
+        _lf_free_blocks(_lf_payload_cache[i].head);
+        _lf_payload_cache[i] = (_lf_free_list_t){NULL, NULL, 0};
+    }
+#if !defined(LF_SINGLE_THREADED)
+    _lf_free_blocks(_lf_shared_free_list_take_all(&_lf_token_recycling_bin));
+    _lf_token_recycling_bin.size = 0;
+    for (int i = 0; i < _LF_PAYLOAD_NUM_CLASSES; i++) {
+        _lf_free_blocks(_lf_shared_free_list_take_all(&_lf_payload_recycling_bin[i]));
+        _lf_payload_recycling_bin[i].size = 0;
     }
+#endif
     if(lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
         lf_print_error_and_exit("Could not leave critical section");
     }
 }
 
+void _lf_declare_port_readers(lf_port_base_t* port, reaction_t** readers, size_t num_readers) {
+    assert(port != NULL);
+    if (_lf_port_reader_ids == NULL) {
+        _lf_port_reader_ids = _lf_port_reader_ids_new(16, NULL);
+    }
+    size_t* index = _lf_port_reader_ids_find(_lf_port_reader_ids, port);
+    size_t i;
+    if (index == NULL) {
+        if (_lf_port_readers_size == _lf_port_readers_capacity) {
+            size_t capacity = _lf_port_readers_capacity == 0 ? 16 : 2 * _lf_port_readers_capacity;
+            _lf_port_readers_t* entries = (_lf_port_readers_t*)realloc(
+                    _lf_port_readers, capacity * sizeof(_lf_port_readers_t));
+            lf_assert(entries != NULL, "Out of memory");
+            _lf_port_readers = entries;
+            _lf_port_readers_capacity = capacity;
+        }
+        i = _lf_port_readers_size++;
+        _lf_port_reader_ids_put(_lf_port_reader_ids, port, i);
+    } else {
+        i = *index;
+        free(_lf_port_readers[i].readers);
+    }
+    _lf_port_readers[i].port = port;
+    _lf_port_readers[i].readers = NULL;
+    _lf_port_readers[i].num_readers = num_readers;
+    if (num_readers > 0) {
+        _lf_port_readers[i].readers = (reaction_t**)malloc(num_readers * sizeof(reaction_t*));
+        lf_assert(_lf_port_readers[i].readers != NULL, "Out of memory");
+        memcpy(_lf_port_readers[i].readers, readers, num_readers * sizeof(reaction_t*));
+    }
+}
+
+void _lf_release_token_cache() {
+#if !defined(LF_SINGLE_THREADED)
+    _lf_free_list_flush(&_lf_token_cache, &_lf_token_recycling_bin, _lf_token_bin_limit);
+    for (int i = 0; i < _LF_PAYLOAD_NUM_CLASSES; i++) {
+        _lf_free_list_flush(&_lf_payload_cache[i], &_lf_payload_recycling_bin[i],
+                _LF_PAYLOAD_RECYCLING_BIN_SIZE_LIMIT);
+    }
+#endif
+}
+
 void _lf_replace_template_token(token_template_t* tmplt, lf_token_t* newtoken) {
     assert(tmplt != NULL);
     LF_PRINT_DEBUG("_lf_replace_template_token: template: %p newtoken: %p.", tmplt, newtoken);
@@ -353,10 +928,21 @@ token_freed _lf_done_using(lf_token_t* token) {
     return _lf_free_token(token);
 }
 
+/**
+ * Release the tokens on the given list and empty it.
+ */
+static void _lf_release_token_list(lf_token_t** list) {
+    while (*list != NULL) {
+        lf_token_t* next = (*list)->next;
+        _lf_done_using(*list);
+        *list = next;
+    }
+}
+
 void _lf_free_token_copies(struct environment_t* env) {
-    while (_lf_tokens_allocated_in_reactions != NULL) {
-        lf_token_t* next = _lf_tokens_allocated_in_reactions->next;
-        _lf_done_using(_lf_tokens_allocated_in_reactions);
-        _lf_tokens_allocated_in_reactions = next;
+    // The workers of the environment are not executing reactions, so its lists are quiescent.
+    for (int i = 0; i < env->num_token_copy_lists; i++) {
+        _lf_release_token_list(&env->token_copies[i]);
     }
+    _lf_release_token_list(&_lf_tokens_allocated_in_reactions);
 }
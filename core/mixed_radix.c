@@ -35,6 +35,59 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "mixed_radix.h"
 
+/**
+ * Precompute the place values of the digits of the mixed-radix number for
+ * every number of dropped digits, and its current value for each of them.
+ * @param mixed A pointer to the mixed-radix number.
+ */
+void mixed_radix_precompute(mixed_radix_int_t* mixed) {
+	assert(mixed != NULL);
+	assert(mixed->size > 0);
+	int size = mixed->size;
+	if (mixed->strides == NULL) {
+		mixed->strides = (int*)malloc(size * size * sizeof(int));
+		mixed->values = (int*)malloc((size + 1) * sizeof(int));
+		assert(mixed->strides != NULL && mixed->values != NULL);
+		for (int n = 0; n < size; n++) {
+			int factor = 1;
+			for (int i = 0; i < size; i++) {
+				if (i < n) {
+					mixed->strides[n * size + i] = 0;
+				} else {
+					mixed->strides[n * size + i] = factor;
+					factor *= mixed->radixes[i];
+				}
+			}
+		}
+	}
+	// Accumulate the values from the most significant digit down.
+	mixed->values[size] = 0;
+	for (int n = size - 1; n >= 0; n--) {
+		mixed->values[n] = mixed->digits[n] + mixed->radixes[n] * mixed->values[n + 1];
+	}
+}
+
+/**
+ * Free the tables allocated by mixed_radix_precompute(), if any.
+ * @param mixed A pointer to the mixed-radix number.
+ */
+void mixed_radix_free(mixed_radix_int_t* mixed) {
+	free(mixed->strides);
+	free(mixed->values);
+	mixed->strides = NULL;
+	mixed->values = NULL;
+}
+
+/**
+ * Add the given multiple of the place value of the given digit to the
+ * precomputed values of the mixed-radix number that include that digit.
+ */
+static void mixed_radix_add(mixed_radix_int_t* mixed, int digit, int multiple) {
+	for (int n = 0; n <= digit; n++) {
+		mixed->values[n] += multiple * mixed->strides[n * mixed->size + digit];
+	}
+}
+
 /**
  * Increment the mixed radix number by one according to the permutation matrix.
  * @param mixed A pointer to the mixed-radix number.
@@ -49,8 +102,14 @@ void mixed_radix_incr(mixed_radix_int_t* mixed) {
 		mixed->digits[digit_to_increment]++;
 		if (mixed->digits[digit_to_increment] >= mixed->radixes[digit_to_increment]) {
 			mixed->digits[digit_to_increment] = 0;
+			if (mixed->values != NULL) {
+				mixed_radix_add(mixed, digit_to_increment, 1 - mixed->radixes[digit_to_increment]);
+			}
 			i++;
 		} else {
+			if (mixed->values != NULL) {
+				mixed_radix_add(mixed, digit_to_increment, 1);
+			}
 			return; // All done.
 		}
 	}
@@ -70,6 +129,9 @@ int mixed_radix_parent(mixed_radix_int_t* mixed, int n) {
 	assert(mixed != NULL);
 	assert(mixed->size > 0);
 	assert(n >= 0);
+	if (mixed->values != NULL) {
+		return n < mixed->size ? mixed->values[n] : 0;
+	}
 	int result = 0;
 	int factor = 1;
 	for (int i = n; i < mixed->size; i++) {
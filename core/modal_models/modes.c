@@ -37,6 +37,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #ifdef MODAL_REACTORS
 
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "platform.h"
@@ -44,12 +46,6 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "modes.h"
 #include "reactor_common.h"
 
-// Bit masks for the internally used flags on modes
-#define _LF_MODE_FLAG_MASK_ACTIVE        (1 << 0)
-#define _LF_MODE_FLAG_MASK_NEEDS_STARTUP (1 << 1)
-#define _LF_MODE_FLAG_MASK_HAD_STARTUP   (1 << 2)
-#define _LF_MODE_FLAG_MASK_NEEDS_RESET   (1 << 3)
-
 // ----------------------------------------------------------------------------
 
 // Forward declaration of functions and variables supplied by reactor_common.c
@@ -58,86 +54,66 @@ event_t* _lf_create_dummy_events(environment_t* env, trigger_t* trigger, instant
 
 // ----------------------------------------------------------------------------
 
-// Linked list element for suspended events in inactive modes
-typedef struct _lf_suspended_event {
-    struct _lf_suspended_event* next;
-    event_t* event;
-} _lf_suspended_event_t;
-_lf_suspended_event_t* _lf_suspended_events_head = NULL; // Start of linked collection of suspended events (managed automatically!)
-int _lf_suspended_events_num = 0; // Number of suspended events (managed automatically!)
-_lf_suspended_event_t* _lf_unsused_suspended_events_head = NULL; // Internal collection of reusable list elements (managed automatically!)
-
 /**
- * Save the given event as suspended.
+ * Save the given event as suspended in the mode of its trigger.
  */
-void _lf_add_suspended_event(event_t* event) {
+void _lf_add_suspended_event(environment_t* env, event_t* event) {
+    lf_assert(env->modes != NULL && event->trigger != NULL && event->trigger->mode != NULL,
+            "Only events of triggers in modes can be suspended.");
+    mode_environment_t* modes = env->modes;
     _lf_suspended_event_t* new_suspended_event;
-    if (_lf_unsused_suspended_events_head != NULL) {
-        new_suspended_event = _lf_unsused_suspended_events_head;
-        _lf_unsused_suspended_events_head = _lf_unsused_suspended_events_head->next;
+    if (modes->unused_suspended_events != NULL) {
+        new_suspended_event = modes->unused_suspended_events;
+        modes->unused_suspended_events = new_suspended_event->next;
     } else {
         new_suspended_event = (_lf_suspended_event_t*) malloc(sizeof(_lf_suspended_event_t));
+        lf_assert(new_suspended_event != NULL, "Out of memory");
+        new_suspended_event->allocated = modes->allocated_suspended_events;
+        modes->allocated_suspended_events = new_suspended_event;
     }
 
+    // Prepend to the events of the mode
+    reactor_mode_t* mode = event->trigger->mode;
     new_suspended_event->event = event;
-    new_suspended_event->next = _lf_suspended_events_head; // prepend
-    _lf_suspended_events_num++;
-
-    _lf_suspended_events_head = new_suspended_event;
+    new_suspended_event->prev = NULL;
+    new_suspended_event->next = mode->suspended_events;
+    if (mode->suspended_events != NULL) {
+        mode->suspended_events->prev = new_suspended_event;
+    }
+    mode->suspended_events = new_suspended_event;
+    modes->suspended_events_size++;
 }
 
 /**
- * Remove the given node from the list of suspended events and
- * Returns the next element in the list.
+ * Remove the given element from the list of suspended events of the given mode,
+ * store it for reuse, and return the next element in the list.
  */
-_lf_suspended_event_t* _lf_remove_suspended_event(_lf_suspended_event_t* event) {
-    _lf_suspended_event_t* next = event->next;
-
-    // Clear content
-    event->event = NULL;
-    event->next = NULL;
-    _lf_suspended_events_num--;
+static _lf_suspended_event_t* _lf_remove_suspended_event(
+        environment_t* env, reactor_mode_t* mode, _lf_suspended_event_t* suspended_event) {
+    _lf_suspended_event_t* next = suspended_event->next;
 
-    // Store for recycling
-    if (_lf_unsused_suspended_events_head == NULL) {
-        _lf_unsused_suspended_events_head = event;
+    // Remove from the list of the mode
+    if (suspended_event->prev != NULL) {
+        suspended_event->prev->next = next;
     } else {
-        event->next = _lf_unsused_suspended_events_head;
-        _lf_unsused_suspended_events_head = event;
+        mode->suspended_events = next; // Adjust head
     }
-
-    if (_lf_suspended_events_head == event) {
-        _lf_suspended_events_head = next; // Adjust head
-    } else {
-        _lf_suspended_event_t* predecessor = _lf_suspended_events_head;
-        while(predecessor->next != event && predecessor != NULL) {
-                predecessor = predecessor->next;
-        }
-        if (predecessor != NULL) {
-                predecessor->next = next; // Remove from linked list
-        }
+    if (next != NULL) {
+        next->prev = suspended_event->prev;
     }
+    env->modes->suspended_events_size--;
+
+    // Clear content and store for recycling
+    suspended_event->event = NULL;
+    suspended_event->prev = NULL;
+    suspended_event->next = env->modes->unused_suspended_events;
+    env->modes->unused_suspended_events = suspended_event;
 
     return next;
 }
 
 // ----------------------------------------------------------------------------
 
-/**
- * Return true if the given mode is active.
- * This includes checking all enclosing modes.
- * If any of those is inactive, then so is this one.
- *
- * @param mode The mode instance to check.
- */
-bool _lf_mode_is_active(reactor_mode_t* mode) {
-    if (mode != NULL) {
-        // Use cached value (redundant data structure)
-        return mode->flags & _LF_MODE_FLAG_MASK_ACTIVE;
-    }
-    return true;
-}
-
 /**
  * Fallback implementation of _lf_mode_is_active.
  * Does not rely on cached activity flag.
@@ -332,6 +308,7 @@ void _lf_handle_mode_shutdown_reactions(
  *      which must be ordered hierarchically, where an enclosing mode must come before the inner mode.
  * @param states_size
  * @param reset_data A list of initial values for reactor state variables that should be automatically reset.
+ *      It must be grouped by mode as done by _lf_initialize_modes.
  * @param reset_data_size
  * @param timer_triggers Array of pointers to timer triggers.
  * @param timer_triggers_size
@@ -375,12 +352,11 @@ void _lf_process_mode_changes(
                     // Reset state variables (if explicitly requested for automatic reset).
                     // The generated code will not register all state variables by default.
                     // Usually the reset trigger is used.
-                    for (int j = 0; j < reset_data_size; j++) {
-                        mode_state_variable_reset_data_t data = reset_data[j];
-                        if (data.mode == state->next_mode) {
-                            LF_PRINT_DEBUG("Modes: Reseting state variable.");
-                            memcpy(data.target, data.source, data.size);
-                        }
+                    // The reset data of each mode is contiguous (@see _lf_initialize_state_resets).
+                    int end = state->next_mode->state_resets_start + state->next_mode->state_resets_size;
+                    for (int j = state->next_mode->state_resets_start; j < end && j < reset_data_size; j++) {
+                        LF_PRINT_DEBUG("Modes: Reseting state variables.");
+                        memcpy(reset_data[j].target, reset_data[j].source, reset_data[j].size);
                     }
 
                     // Handle timers that have a period of 0. These timers will only trigger
@@ -396,49 +372,45 @@ void _lf_process_mode_changes(
                 }
 
                 // Reset/Reactivate previously suspended events of next state
-                _lf_suspended_event_t* suspended_event = _lf_suspended_events_head;
+                _lf_suspended_event_t* suspended_event = state->next_mode->suspended_events;
                 while(suspended_event != NULL) {
                     event_t* event = suspended_event->event;
-                    if (event != NULL && event->trigger != NULL && event->trigger->mode == state->next_mode) {
-                        if (state->mode_change == reset_transition) { // Reset transition
-                            if (event->trigger->is_timer) { // Only reset timers
-                                trigger_t* timer = event->trigger;
-
-                                LF_PRINT_DEBUG("Modes: Re-enqueuing reset timer.");
-                                // Reschedule the timer with no additional delay.
-                                // This will take care of super dense time when offset is 0.
-                                _lf_schedule(env, timer, event->trigger->offset, NULL);
-                            }
-                            // No further processing; drops all events upon reset (timer event was recreated by schedule and original can be removed here)
-                        } else if (state->next_mode != state->current_mode && event->trigger != NULL) { // History transition to a different mode
-                            // Remaining time that the event would have been waiting before mode was left
-                            instant_t local_remaining_delay = event->time - (state->next_mode->deactivation_time != 0 ? state->next_mode->deactivation_time : lf_time_start());
-                            tag_t current_logical_tag = env->current_tag;
-
-                            // Reschedule event with original local delay
-                            LF_PRINT_DEBUG("Modes: Re-enqueuing event with a suspended delay of " PRINTF_TIME
-                            		" (previous TTH: " PRINTF_TIME ", Mode suspended at: " PRINTF_TIME ").",
-                            		local_remaining_delay, event->time, state->next_mode->deactivation_time);
-                            tag_t schedule_tag = {.time = current_logical_tag.time + local_remaining_delay, .microstep = (local_remaining_delay == 0 ? current_logical_tag.microstep + 1 : 0)};
-                            _lf_schedule_at_tag(env, event->trigger, schedule_tag, event->token);
-
-                            if (event->next != NULL) {
-                                // The event has more events stacked up in super dense time, attach them to the newly created event.
-                                if (event->trigger->last->next == NULL) {
-                                    event->trigger->last->next = event->next;
-                                } else {
-                                    lf_print_error("Modes: Cannot attach events stacked up in super dense to the just unsuspended root event.");
-                                }
+                    if (state->mode_change == reset_transition) { // Reset transition
+                        if (event->trigger->is_timer) { // Only reset timers
+                            trigger_t* timer = event->trigger;
+
+                            LF_PRINT_DEBUG("Modes: Re-enqueuing reset timer.");
+                            // Reschedule the timer with no additional delay.
+                            // This will take care of super dense time when offset is 0.
+                            _lf_schedule(env, timer, event->trigger->offset, NULL);
+                        }
+                        // No further processing; drops all events upon reset (timer event was recreated by schedule and original can be removed here)
+                    } else if (state->next_mode != state->current_mode && event->trigger != NULL) { // History transition to a different mode
+                        // Remaining time that the event would have been waiting before mode was left
+                        instant_t local_remaining_delay = event->time - (state->next_mode->deactivation_time != 0 ? state->next_mode->deactivation_time : lf_time_start());
+                        tag_t current_logical_tag = env->current_tag;
+
+                        // Reschedule event with original local delay
+                        LF_PRINT_DEBUG("Modes: Re-enqueuing event with a suspended delay of " PRINTF_TIME
+                        		" (previous TTH: " PRINTF_TIME ", Mode suspended at: " PRINTF_TIME ").",
+                        		local_remaining_delay, event->time, state->next_mode->deactivation_time);
+                        tag_t schedule_tag = {.time = current_logical_tag.time + local_remaining_delay, .microstep = (local_remaining_delay == 0 ? current_logical_tag.microstep + 1 : 0)};
+                        _lf_schedule_at_tag(env, event->trigger, schedule_tag, event->token);
+
+                        if (event->next != NULL) {
+                            // The event has more events stacked up in super dense time, attach them to the newly created event.
+                            if (event->trigger->last->next == NULL) {
+                                event->trigger->last->next = event->next;
+                            } else {
+                                lf_print_error("Modes: Cannot attach events stacked up in super dense to the just unsuspended root event.");
                             }
                         }
-                        // A fresh event was created by schedule, hence, recycle old one
-                        _lf_recycle_event(env, event);
-
-                        // Remove suspended event and continue
-                        suspended_event = _lf_remove_suspended_event(suspended_event);
-                    } else {
-                        suspended_event = suspended_event->next;
                     }
+                    // A fresh event was created by schedule, hence, recycle old one
+                    _lf_recycle_event(env, event);
+
+                    // Remove suspended event and continue
+                    suspended_event = _lf_remove_suspended_event(env, state->next_mode, suspended_event);
                 }
             }
         }
@@ -498,28 +470,33 @@ void _lf_process_mode_changes(
 
         // Retract all events from the event queue that are associated with now inactive modes
         if (env->event_q != NULL) {
-            size_t q_size = pqueue_size(env->event_q);
+            size_t q_size = _lf_event_count(env);
             if (q_size > 0) {
                 event_t** delayed_removal = (event_t**) calloc(q_size, sizeof(event_t*));
+                event_t** queued_events = (event_t**) calloc(q_size, sizeof(event_t*));
                 size_t delayed_removal_count = 0;
+                size_t next_microstep_size = vector_size(&env->next_microstep);
+                memcpy(queued_events, env->next_microstep.start, next_microstep_size * sizeof(event_t*));
+                pqueue_copy_entries(env->event_q, (void**)(queued_events + next_microstep_size));
 
                 // Find events
                 for (size_t i = 0; i < q_size; i++) {
-                    event_t* event = (event_t*)env->event_q->d[i + 1]; // internal queue data structure omits index 0
+                    event_t* event = queued_events[i];
                     if (event != NULL && event->trigger != NULL && !_lf_mode_is_active(event->trigger->mode)) {
                         delayed_removal[delayed_removal_count++] = event;
                         // This will store the event including possibly those chained up in super dense time
-                        _lf_add_suspended_event(event);
+                        _lf_add_suspended_event(env, event);
                     }
                 }
 
                 // Events are removed delayed in order to allow linear iteration over the queue
-                LF_PRINT_DEBUG("Modes: Pulling %zu events from the event queue to suspend them. %d events are now suspended.",
-                		delayed_removal_count, _lf_suspended_events_num);
+                LF_PRINT_DEBUG("Modes: Pulling %zu events from the event queue to suspend them. %zu events are now suspended.",
+                		delayed_removal_count, env->modes->suspended_events_size);
                 for (size_t i = 0; i < delayed_removal_count; i++) {
-                    pqueue_remove(env->event_q, delayed_removal[i]);
+                    _lf_remove_event(env, delayed_removal[i]);
                 }
 
+                free(queued_events);
                 free(delayed_removal);
             }
         }
@@ -527,7 +504,7 @@ void _lf_process_mode_changes(
         if (env->modes->triggered_reactions_request) {
             // Insert a dummy event in the event queue for the next microstep to make
             // sure startup/reset reactions (if any) are triggered as soon as possible.
-            pqueue_insert(env->event_q, _lf_create_dummy_events(env, NULL, env->current_tag.time, NULL, 1));
+            _lf_insert_event(env, _lf_create_dummy_events(env, NULL, env->current_tag.time, NULL, 1));
         }
     }
 }
@@ -537,28 +514,98 @@ void _lf_process_mode_changes(
  * - Frees all suspended events.
  */
 void _lf_terminate_modal_reactors(environment_t* env) {
-    _lf_suspended_event_t* suspended_event = _lf_suspended_events_head;
+    if (env->modes == NULL) {
+        return;
+    }
+    // Every element ever allocated is either in the list of a mode or unused.
+    _lf_suspended_event_t* suspended_event = env->modes->allocated_suspended_events;
     while(suspended_event != NULL) {
-        _lf_recycle_event(env, suspended_event->event);
-        _lf_suspended_event_t* next = suspended_event->next;
+        if (suspended_event->event != NULL) {
+            suspended_event->event->trigger->mode->suspended_events = NULL;
+            _lf_recycle_event(env, suspended_event->event);
+        }
+        _lf_suspended_event_t* allocated = suspended_event->allocated;
         free(suspended_event);
-        suspended_event = next;
+        suspended_event = allocated;
     }
-    _lf_suspended_events_head = NULL;
-    _lf_suspended_events_num = 0;
+    env->modes->allocated_suspended_events = NULL;
+    env->modes->unused_suspended_events = NULL;
+    env->modes->suspended_events_size = 0;
+}
 
-    // Also free suspended_event elements stored for recycling
-    suspended_event = _lf_unsused_suspended_events_head;
-    while(suspended_event != NULL) {
-        _lf_suspended_event_t* next = suspended_event->next;
-        free(suspended_event);
-        suspended_event = next;
+/**
+ * Order reset data by mode and then by target address.
+ */
+static int _lf_compare_state_resets(const void* a, const void* b) {
+    const mode_state_variable_reset_data_t* x = (const mode_state_variable_reset_data_t*) a;
+    const mode_state_variable_reset_data_t* y = (const mode_state_variable_reset_data_t*) b;
+    if (x->mode != y->mode) {
+        return ((uintptr_t) x->mode < (uintptr_t) y->mode) ? -1 : 1;
+    }
+    if (x->target != y->target) {
+        return ((uintptr_t) x->target < (uintptr_t) y->target) ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Prepare the reset data of the environment so that a reset transition into a mode
+ * copies each run of adjacent state variables of the mode with a single memcpy.
+ * The reset data is grouped by mode, and the range of each mode is stored in the mode.
+ * The initial values are copied into one snapshot, laid out like the state variables,
+ * so that adjacent variables, whose initial values the generated code stores separately,
+ * can be merged into one entry.
+ */
+static void _lf_initialize_state_resets(environment_t* env) {
+    mode_state_variable_reset_data_t* resets = env->modes->state_resets;
+    int size = env->modes->state_resets_size;
+    if (size == 0) {
+        return;
+    }
+    qsort(resets, size, sizeof(mode_state_variable_reset_data_t), _lf_compare_state_resets);
+
+    size_t snapshot_size = 0;
+    for (int i = 0; i < size; i++) {
+        snapshot_size += resets[i].size;
+    }
+    char* snapshot = (char*) malloc(snapshot_size > 0 ? snapshot_size : 1);
+    lf_assert(snapshot != NULL, "Out of memory");
+
+    // Copy the initial values and merge entries of a mode whose targets are adjacent.
+    int merged_size = 0;
+    size_t offset = 0;
+    for (int i = 0; i < size; i++) {
+        mode_state_variable_reset_data_t data = resets[i];
+        memcpy(snapshot + offset, data.source, data.size);
+        mode_state_variable_reset_data_t* last = merged_size > 0 ? &resets[merged_size - 1] : NULL;
+        if (last != NULL && last->mode == data.mode
+                && (char*) last->target + last->size == (char*) data.target) {
+            last->size += data.size;
+        } else {
+            data.source = snapshot + offset;
+            resets[merged_size++] = data;
+        }
+        offset += data.size;
+    }
+    LF_PRINT_DEBUG("Modes: Merged %d state variable resets into %d.", size, merged_size);
+    env->modes->state_resets_size = merged_size;
+    env->modes->state_reset_snapshot = snapshot;
+
+    // Record the range of each mode.
+    for (int i = 0; i < merged_size; i++) {
+        reactor_mode_t* mode = resets[i].mode;
+        if (i == 0 || resets[i - 1].mode != mode) {
+            mode->state_resets_start = i;
+            mode->state_resets_size = 0;
+        }
+        mode->state_resets_size++;
     }
-    _lf_unsused_suspended_events_head = NULL;
 }
+
 void _lf_initialize_modes(environment_t* env) {
     assert(env != GLOBAL_ENVIRONMENT);
     if (env->modes) {
+        _lf_initialize_state_resets(env);
         _lf_initialize_mode_states(
             env, 
             env->modes->modal_reactor_states, 
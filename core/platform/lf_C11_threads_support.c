@@ -15,6 +15,12 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
     return thrd_join((thrd_t)thread, (int*)thread_return);
 }
 
+lf_thread_t lf_thread_self() {
+    return thrd_current();
+}
+
+LF_THREAD_LOCAL void (*lf_thread_release_hook)(void) = NULL;
+
 int lf_mutex_init(lf_mutex_t* mutex) {
     // Set up a timed and recursive mutex (default behavior)
     return mtx_init((mtx_t*)mutex, mtx_timed | mtx_recursive);
@@ -42,6 +48,7 @@ int lf_cond_signal(lf_cond_t* cond) {
 }
 
 int lf_cond_wait(lf_cond_t* cond) {
+    _LF_RUN_THREAD_RELEASE_HOOK();
     return cnd_wait((cnd_t*)&cond->condition, (mtx_t*)cond->mutex);
 }
 
@@ -51,6 +58,7 @@ int lf_cond_timedwait(lf_cond_t* cond, int64_t absolute_time_ns) {
     struct timespec timespec_absolute_time
             = {(time_t)absolute_time_ns / 1000000000LL, (long)absolute_time_ns % 1000000000LL};
     int return_value = 0;
+    _LF_RUN_THREAD_RELEASE_HOOK();
     return_value = cnd_timedwait(
         (cnd_t*)&cond->condition,
         (mtx_t*)cond->mutex,
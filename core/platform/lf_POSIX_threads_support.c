@@ -14,6 +14,14 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
     return pthread_join((pthread_t)thread, thread_return);
 }
 
+lf_thread_t lf_thread_self() {
+    return pthread_self();
+}
+
+LF_THREAD_LOCAL void (*lf_thread_release_hook)(void) = NULL;
+
+// With LF_FUTEX_LOCKS, lf_linux_support.c defines the functions on mutexes and condition variables.
+#if !defined(LF_FUTEX_LOCKS)
 int lf_mutex_init(lf_mutex_t* mutex) {
     // Set up a recursive mutex
     pthread_mutexattr_t attr;
@@ -59,20 +67,44 @@ int lf_cond_signal(lf_cond_t* cond) {
 }
 
 int lf_cond_wait(lf_cond_t* cond) {
+    _LF_RUN_THREAD_RELEASE_HOOK();
     return pthread_cond_wait((pthread_cond_t*)&cond->condition, (pthread_mutex_t*)cond->mutex);
 }
 
 int lf_cond_timedwait(lf_cond_t* cond, int64_t absolute_time_ns) {
+    int return_value = 0;
+#if defined(PLATFORM_Darwin)
+    // pthread_cond_timedwait() measures the absolute time with the calendar
+    // clock, which drifts from the clock of the runtime and is read at a coarse
+    // resolution, so wait for the time that remains on the clock of the runtime.
+    instant_t now;
+    if (_lf_clock_now(&now) != 0) {
+        return errno;
+    }
+    if (absolute_time_ns <= now) {
+        return LF_TIMEOUT;
+    }
+    interval_t relative_time_ns = absolute_time_ns - now;
+    struct timespec timespec_relative_time
+            = {(time_t)(relative_time_ns / 1000000000LL), (long)(relative_time_ns % 1000000000LL)};
+    _LF_RUN_THREAD_RELEASE_HOOK();
+    return_value = pthread_cond_timedwait_relative_np(
+        (pthread_cond_t*)&cond->condition,
+        (pthread_mutex_t*)cond->mutex,
+        &timespec_relative_time
+    );
+#else
     // Convert the absolute time to a timespec.
     // timespec is seconds and nanoseconds.
     struct timespec timespec_absolute_time
             = {(time_t)absolute_time_ns / 1000000000LL, (long)absolute_time_ns % 1000000000LL};
-    int return_value = 0;
+    _LF_RUN_THREAD_RELEASE_HOOK();
     return_value = pthread_cond_timedwait(
         (pthread_cond_t*)&cond->condition,
         (pthread_mutex_t*)cond->mutex,
         &timespec_absolute_time
     );
+#endif
     switch (return_value) {
         case ETIMEDOUT:
             return_value = LF_TIMEOUT;
@@ -83,4 +115,5 @@ int lf_cond_timedwait(lf_cond_t* cond, int64_t absolute_time_ns) {
     }
     return return_value;
 }
+#endif // !LF_FUTEX_LOCKS
 #endif
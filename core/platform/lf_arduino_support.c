@@ -184,6 +184,27 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
    return thread_join(thread, thread_return);
 }
 
+lf_thread_t lf_thread_self() {
+    // The thread wrapper does not expose the current thread.
+    return NULL;
+}
+
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    return -1;
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    return -1;
+}
+
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    return -1;
+}
+
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    return -1;
+}
+
 int lf_mutex_init(lf_mutex_t* mutex) {
     *mutex = (lf_mutex_t) mutex_new();
     return 0;
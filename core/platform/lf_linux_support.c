@@ -1,4 +1,7 @@
 #ifdef PLATFORM_Linux
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // For CPU_SET and pthread_setaffinity_np.
+#endif
 /* MacOS API support for the C target of Lingua Franca. */
 
 /*************
@@ -44,8 +47,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #if !defined LF_SINGLE_THREADED
-    #if __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
-        // (Not C++11 or later) or no threads support
+    #if defined(LF_FUTEX_LOCKS) || __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
+        // Futex-based locks (defined below) or (not C++11 or later) or no threads support
         #include "lf_POSIX_threads_support.c"
     #else
         #include "lf_C11_threads_support.c"
@@ -60,17 +63,313 @@ int lf_sleep(interval_t sleep_duration) {
     return clock_nanosleep(_LF_CLOCK, 0, (const struct timespec*)&tp, (struct timespec*)&remaining);
 }
 
+extern interval_t _lf_time_epoch_offset;
+extern instant_t _lf_last_reported_unadjusted_physical_time_ns;
+
 int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_time) {
     interval_t sleep_duration = wakeup_time - lf_time_physical();
 
     if (sleep_duration < LF_MIN_SLEEP_NS) {
         return 0;
-    } else {
-        return lf_sleep(sleep_duration);
     }
+    // Sleep until an absolute time of the clock so that a preemption between
+    // here and the system call does not delay the wakeup. The reading of the
+    // clock that lf_time_physical() has just taken, without the epoch offset,
+    // is a time of _LF_CLOCK.
+    instant_t now = _lf_last_reported_unadjusted_physical_time_ns - _lf_time_epoch_offset;
+    const struct timespec tp = convert_ns_to_timespec(
+            (FOREVER - now > sleep_duration) ? now + sleep_duration : FOREVER);
+    return clock_nanosleep(_LF_CLOCK, TIMER_ABSTIME, &tp, NULL);
 }
 
 int lf_nanosleep(interval_t sleep_duration) {
     return lf_sleep(sleep_duration);
 }
+
+#if !defined LF_SINGLE_THREADED
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+// With glibc, both lf_thread_t variants (pthread_t and thrd_t) are pthread_t.
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    if (cpu_number >= CPU_SETSIZE) {
+        return EINVAL;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_number, &cpu_set);
+    return pthread_setaffinity_np((pthread_t)thread, sizeof(cpu_set), &cpu_set);
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    // The cores of a node are listed in sysfs as ranges, e.g., "0-3,8-11".
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return errno;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    unsigned int first, last;
+    while (fscanf(file, "%u", &first) == 1) {
+        last = first;
+        if (fscanf(file, "-%u", &last) < 0) {
+            break;
+        }
+        for (unsigned int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &cpu_set);
+        }
+        if (fgetc(file) != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    if (CPU_COUNT(&cpu_set) == 0) {
+        return EINVAL;
+    }
+    return pthread_setaffinity_np((pthread_t)thread, sizeof(cpu_set), &cpu_set);
+}
+
+/**
+ * Map a priority between LF_SCHED_MIN_PRIORITY and LF_SCHED_MAX_PRIORITY onto
+ * the range of priorities of the given POSIX scheduling policy.
+ */
+static int _lf_to_posix_priority(int posix_policy, int priority) {
+    int min = sched_get_priority_min(posix_policy);
+    int max = sched_get_priority_max(posix_policy);
+    if (priority < LF_SCHED_MIN_PRIORITY) {
+        priority = LF_SCHED_MIN_PRIORITY;
+    } else if (priority > LF_SCHED_MAX_PRIORITY) {
+        priority = LF_SCHED_MAX_PRIORITY;
+    }
+    return min + ((priority - LF_SCHED_MIN_PRIORITY) * (max - min))
+            / (LF_SCHED_MAX_PRIORITY - LF_SCHED_MIN_PRIORITY);
+}
+
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    int posix_policy;
+    switch (policy->policy) {
+        case LF_SCHED_FAIR:
+            posix_policy = SCHED_OTHER;
+            break;
+        case LF_SCHED_TIMESLICE:
+            posix_policy = SCHED_RR;
+            break;
+        case LF_SCHED_PRIORITY:
+            posix_policy = SCHED_FIFO;
+            break;
+        default:
+            return EINVAL;
+    }
+    struct sched_param param;
+    param.sched_priority = (posix_policy == SCHED_OTHER) ? 0 : _lf_to_posix_priority(posix_policy, policy->priority);
+    return pthread_setschedparam((pthread_t)thread, posix_policy, &param);
+}
+
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    int posix_policy;
+    struct sched_param param;
+    int result = pthread_getschedparam((pthread_t)thread, &posix_policy, &param);
+    if (result != 0) {
+        return result;
+    }
+    if (posix_policy != SCHED_FIFO && posix_policy != SCHED_RR) {
+        // Priorities are not used by the non real-time policies.
+        return EINVAL;
+    }
+    return pthread_setschedprio((pthread_t)thread, _lf_to_posix_priority(posix_policy, priority));
+}
+
+#if defined(LF_FUTEX_LOCKS)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/**
+ * Maximum number of times a thread spins for a locked mutex before
+ * sleeping. The number actually used adapts to how long the mutex
+ * has recently been held, as for PTHREAD_MUTEX_ADAPTIVE_NP in glibc.
+ */
+#ifndef LF_FUTEX_MAX_SPINS
+#define LF_FUTEX_MAX_SPINS 100
+#endif
+
+/** A variable whose address identifies the thread that owns a mutex. */
+static LF_THREAD_LOCAL char _lf_futex_thread_identity;
+
+/** With a single processor, the owner of a mutex cannot release it while another thread spins. */
+static int _lf_futex_max_spins = -1;
+
+static inline void _lf_futex_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline long _lf_futex(uint32_t* word, int operation, uint32_t value,
+        const struct timespec* timeout, uint32_t* word2, uint32_t value3) {
+    return syscall(SYS_futex, word, operation | FUTEX_PRIVATE_FLAG, value, timeout, word2, value3);
+}
+
+int lf_mutex_init(lf_mutex_t* mutex) {
+    if (_lf_futex_max_spins < 0) {
+        _lf_futex_max_spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? LF_FUTEX_MAX_SPINS : 0;
+    }
+    mutex->state = 0;
+    mutex->owner = 0;
+    mutex->count = 0;
+    mutex->spins = 0;
+    return 0;
+}
+
+/**
+ * Lock the mutex after failing to lock it without contention: spin for a while,
+ * and then mark it as contended and sleep until the owner releases it.
+ */
+static void _lf_futex_lock_contended(lf_mutex_t* mutex) {
+    int max_spins = (int)mutex->spins * 2 + 10;
+    if (max_spins > _lf_futex_max_spins) {
+        max_spins = _lf_futex_max_spins;
+    }
+    int spins = 0;
+    for (; spins < max_spins; spins++) {
+        _lf_futex_pause();
+        uint32_t unlocked = 0;
+        if (__atomic_load_n(&mutex->state, __ATOMIC_RELAXED) == 0
+                && __atomic_compare_exchange_n(&mutex->state, &unlocked, 1, false,
+                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (spins >= max_spins) {
+        while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+            _lf_futex(&mutex->state, FUTEX_WAIT, 2, NULL, NULL, 0);
+        }
+    }
+    // Update the running average, with a weight of 1/8 for the new value.
+    mutex->spins += (spins - (int)mutex->spins) / 8;
+}
+
+int lf_mutex_lock(lf_mutex_t* mutex) {
+    uintptr_t self = (uintptr_t)&_lf_futex_thread_identity;
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == self) {
+        mutex->count++;
+        return 0;
+    }
+    uint32_t unlocked = 0;
+    if (!__atomic_compare_exchange_n(&mutex->state, &unlocked, 1, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        _lf_futex_lock_contended(mutex);
+    }
+    __atomic_store_n(&mutex->owner, self, __ATOMIC_RELAXED);
+    mutex->count = 1;
+    return 0;
+}
+
+/**
+ * Release the mutex, however many times the owner has locked it.
+ */
+static void _lf_futex_release(lf_mutex_t* mutex) {
+    __atomic_store_n(&mutex->owner, 0, __ATOMIC_RELAXED);
+    mutex->count = 0;
+    if (__atomic_exchange_n(&mutex->state, 0, __ATOMIC_RELEASE) == 2) {
+        _lf_futex(&mutex->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+int lf_mutex_unlock(lf_mutex_t* mutex) {
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != (uintptr_t)&_lf_futex_thread_identity) {
+        return EPERM;
+    }
+    if (--mutex->count == 0) {
+        _lf_futex_release(mutex);
+    }
+    return 0;
+}
+
+int lf_cond_init(lf_cond_t* cond, lf_mutex_t* mutex) {
+    cond->mutex = mutex;
+    cond->sequence = 0;
+    cond->waiters = 0;
+    return 0;
+}
+
+int lf_cond_broadcast(lf_cond_t* cond) {
+    __atomic_add_fetch(&cond->sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+    }
+    lf_mutex_t* mutex = cond->mutex;
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == (uintptr_t)&_lf_futex_thread_identity) {
+        // Wake one waiter and move the others to the mutex, which is marked as contended
+        // so that its release wakes the next one. They would otherwise all wake up only
+        // to contend for the mutex that this thread holds.
+        __atomic_store_n(&mutex->state, 2, __ATOMIC_RELAXED);
+        uint32_t sequence = __atomic_load_n(&cond->sequence, __ATOMIC_SEQ_CST);
+        if (_lf_futex(&cond->sequence, FUTEX_CMP_REQUEUE, 1, (const struct timespec*)(uintptr_t)INT_MAX,
+                &mutex->state, sequence) < 0) {
+            // A signal without the mutex changed the sequence meanwhile.
+            _lf_futex(&cond->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        }
+    } else {
+        // Without the mutex, a waiter moved to it might never be woken up.
+        _lf_futex(&cond->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+    return 0;
+}
+
+int lf_cond_signal(lf_cond_t* cond) {
+    __atomic_add_fetch(&cond->sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) != 0) {
+        _lf_futex(&cond->sequence, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+    return 0;
+}
+
+/**
+ * Release the mutex of the condition variable, wait for a signal or a broadcast
+ * or until the specified absolute time of CLOCK_REALTIME, and lock the mutex
+ * again as many times as before, which pthread_cond_wait() does not do for a
+ * recursive mutex.
+ * @return 0 or LF_TIMEOUT.
+ */
+static int _lf_futex_cond_wait(lf_cond_t* cond, const struct timespec* absolute_time) {
+    _LF_RUN_THREAD_RELEASE_HOOK();
+    lf_mutex_t* mutex = cond->mutex;
+    uint32_t count = mutex->count;
+    __atomic_add_fetch(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+    uint32_t sequence = __atomic_load_n(&cond->sequence, __ATOMIC_SEQ_CST);
+    _lf_futex_release(mutex);
+    int result = 0;
+    if (_lf_futex(&cond->sequence, FUTEX_WAIT_BITSET | (absolute_time ? FUTEX_CLOCK_REALTIME : 0),
+            sequence, absolute_time, NULL, FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT) {
+        result = LF_TIMEOUT;
+    }
+    // This thread may have been moved to the mutex by a broadcast, so lock it as
+    // contended to wake the next one when releasing it.
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        _lf_futex(&mutex->state, FUTEX_WAIT, 2, NULL, NULL, 0);
+    }
+    __atomic_store_n(&mutex->owner, (uintptr_t)&_lf_futex_thread_identity, __ATOMIC_RELAXED);
+    mutex->count = count;
+    __atomic_sub_fetch(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+int lf_cond_wait(lf_cond_t* cond) {
+    return _lf_futex_cond_wait(cond, NULL);
+}
+
+int lf_cond_timedwait(lf_cond_t* cond, int64_t absolute_time_ns) {
+    struct timespec timespec_absolute_time
+            = {(time_t)absolute_time_ns / 1000000000LL, (long)absolute_time_ns % 1000000000LL};
+    return _lf_futex_cond_wait(cond, &timespec_absolute_time);
+}
+#endif // LF_FUTEX_LOCKS
+#endif
 #endif
@@ -28,8 +28,20 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /** MacOS API support for the C target of Lingua Franca.
  *
  *  @author{Soroush Bateni <soroush@utdallas.edu>}
+ *
+ * Time is read with mach_absolute_time() (see lf_unix_clock_support.c), and
+ * sleeps end at deadlines of the same clock with mach_wait_until(), which, unlike
+ * nanosleep(), is not subject to the coalescing of timers for threads with a
+ * time-constraint policy. Real-time scheduling policies are mapped onto that
+ * policy.
  */
 
+#include <errno.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+
 #include "lf_macos_support.h"
 #include "platform.h"
 #include "tag.h"
@@ -52,11 +64,20 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "lf_unix_clock_support.h"
 
-// See `man 2 clock_nanosleep` for return values
+/**
+ * @return 0 for success, or -1 with errno set to EINTR if the sleep was
+ *  interrupted.
+ */
 int lf_sleep(interval_t sleep_duration) {
-    const struct timespec tp = convert_ns_to_timespec(sleep_duration);
-    struct timespec remaining;
-    return nanosleep((const struct timespec*)&tp, (struct timespec*)&remaining);
+    if (sleep_duration <= 0) {
+        return 0;
+    }
+    uint64_t deadline = mach_absolute_time() + convert_ns_to_mach_ticks(sleep_duration);
+    if (mach_wait_until(deadline) != KERN_SUCCESS) {
+        errno = EINTR;
+        return -1;
+    }
+    return 0;
 }
 
 int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_time) {
@@ -72,4 +93,68 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_ti
 int lf_nanosleep(interval_t sleep_duration) {
     return lf_sleep(sleep_duration);
 }
+
+#if !defined LF_SINGLE_THREADED
+// MacOS does not support pinning threads to cores or NUMA nodes.
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    return -1;
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    return -1;
+}
+
+/**
+ * The processor time that a thread with a real-time scheduling policy needs
+ * each time it wakes up, and the time by which it has to have received it.
+ * The scheduler demotes a thread that keeps running much longer without
+ * blocking, so these bound the reactions executed between two waits only
+ * loosely. The computation must be between 50 us and 50 ms.
+ */
+#ifndef LF_MACOS_RT_COMPUTATION_NS
+#define LF_MACOS_RT_COMPUTATION_NS MSEC(1)
+#endif
+#ifndef LF_MACOS_RT_CONSTRAINT_NS
+#define LF_MACOS_RT_CONSTRAINT_NS MSEC(5)
+#endif
+
+/**
+ * Real-time scheduling policies are mapped onto the time-constraint policy of
+ * Mach, under which a thread runs in the real-time band, ahead of all other
+ * threads, and wakes up from timed waits without delay. All threads in that
+ * band have the same priority, so the priority of the policy is not used.
+ */
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    thread_act_t mach_thread = pthread_mach_thread_np((pthread_t)thread);
+    kern_return_t result;
+    switch (policy->policy) {
+        case LF_SCHED_FAIR: {
+            thread_standard_policy_data_t standard = {0};
+            result = thread_policy_set(mach_thread, THREAD_STANDARD_POLICY,
+                    (thread_policy_t)&standard, THREAD_STANDARD_POLICY_COUNT);
+            break;
+        }
+        case LF_SCHED_TIMESLICE:
+        case LF_SCHED_PRIORITY: {
+            thread_time_constraint_policy_data_t constraint = {
+                .period = 0,
+                .computation = (uint32_t)convert_ns_to_mach_ticks(LF_MACOS_RT_COMPUTATION_NS),
+                .constraint = (uint32_t)convert_ns_to_mach_ticks(LF_MACOS_RT_CONSTRAINT_NS),
+                .preemptible = (policy->policy == LF_SCHED_TIMESLICE)
+            };
+            result = thread_policy_set(mach_thread, THREAD_TIME_CONSTRAINT_POLICY,
+                    (thread_policy_t)&constraint, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+            break;
+        }
+        default:
+            return EINVAL;
+    }
+    return (result == KERN_SUCCESS) ? 0 : EPERM;
+}
+
+// Threads with the time-constraint policy have no priorities (see above).
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    return ENOTSUP;
+}
+#endif
 #endif
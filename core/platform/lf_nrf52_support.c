@@ -49,11 +49,15 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "app_error.h"
 
 /**
- * True when the last requested sleep has been completed, false otherwise.
+ * True when an event has been scheduled asynchronously during a sleep.
  */
-static volatile bool _lf_sleep_interrupted = false;
 static volatile bool _lf_async_event = false;
 
+/**
+ * Statistics of the wakeups from sleeps.
+ */
+static lf_wakeup_stats_t _lf_wakeup_stats;
+
 /**
  * lf global timer instance
  * timerId = 3 TIMER3
@@ -63,8 +67,7 @@ static const nrfx_timer_t g_lf_timer_inst = NRFX_TIMER_INSTANCE(3);
 // Combine 2 32bit works to a 64 bit word
 #define COMBINE_HI_LO(hi,lo) ((((uint64_t) hi) << 32) | ((uint64_t) lo))
 
-// Maximum and minimum sleep possible
-#define LF_MAX_SLEEP_NS USEC(UINT32_MAX)
+// Minimum sleep possible, below which sleeps busy-wait
 #define LF_MIN_SLEEP_NS USEC(5) 
 
 /**
@@ -81,7 +84,7 @@ uint8_t _lf_nested_region = 0;
 /**
  * @brief Handle LF timer interrupts
  * Using lf_timer instance -> id = 3
- * channel2 -> channel for lf_sleep interrupt
+ * channel2 -> channel for lf_sleep interrupt, which only needs to wake up the CPU
  * channel3 -> channel for overflow interrupt
  *
  * [in] event_type
@@ -92,10 +95,8 @@ uint8_t _lf_nested_region = 0;
  */
 void lf_timer_event_handler(nrf_timer_event_t event_type, void *p_context) {
     
-    if (event_type == NRF_TIMER_EVENT_COMPARE2) {
-        _lf_sleep_interrupted = false;
-    } else if (event_type == NRF_TIMER_EVENT_COMPARE3) {
-        _lf_time_us_high =+ 1;
+    if (event_type == NRF_TIMER_EVENT_COMPARE3) {
+        _lf_time_us_high += 1;
     }
 }
 
@@ -134,8 +135,9 @@ void _lf_initialize_clock() {
  * 
  * The function reads out the upper word before and after reading the timer.
  * If the upper word has changed (i.e. there was an overflow in between),
- * we cannot simply combine them. We read once more to be sure that 
- * we read after the overflow.
+ * we cannot simply combine them, so we read again. Within a critical section,
+ * an overflow is not handled until the section is left, so the upper word is
+ * incremented here if the overflow event is pending.
  *
  * @return 0 for success, or -1 for failure. In case of failure, errno will be
  *  set appropriately (see `man 2 clock_gettime`).
@@ -143,16 +145,21 @@ void _lf_initialize_clock() {
 int _lf_clock_now(instant_t* t) {
     assert(t);
     
-    uint32_t now_us_hi_pre = _lf_time_us_high;
-    uint32_t now_us_low = nrfx_timer_capture(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL1);
-    uint32_t now_us_hi_post = _lf_time_us_high; 
-
-    // Check if we read the time during a wrap
-    if (now_us_hi_pre != now_us_hi_post) {
-        // There was a wrap. read again and return
+    uint32_t now_us_hi;
+    uint32_t now_us_low;
+    bool overflow_pending;
+    do {
+        now_us_hi = _lf_time_us_high;
         now_us_low = nrfx_timer_capture(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL1);
+        overflow_pending = nrf_timer_event_check(g_lf_timer_inst.p_reg, NRF_TIMER_EVENT_COMPARE3);
+    } while (now_us_hi != _lf_time_us_high);
+
+    // An overflow that has not been handled yet happened before the capture
+    // if the timer has not come far since.
+    if (overflow_pending && now_us_low < UINT32_MAX / 2) {
+        now_us_hi++;
     }
-    uint64_t now_us = COMBINE_HI_LO(now_us_hi_post, now_us_low);
+    uint64_t now_us = COMBINE_HI_LO(now_us_hi, now_us_low);
 
     *t = ((instant_t)now_us) * 1000;
 
@@ -193,11 +200,14 @@ static void lf_busy_wait_until(instant_t wakeup_time) {
 }
 
 /**
- * @brief Sleep until the given wakeup time. There are a couple of edge cases to consider
- *  1. Wakeup time is already past
- *  2. Implied sleep duration is below `LF_MAX_SLEEP_NS` threshold
- *  3. Implied sleep duration is above `LF_MAX_SLEEP_NS` limit
- * 
+ * @brief Sleep until the given wakeup time without ticks. Sleeps shorter than
+ * `LF_MIN_SLEEP_NS` busy-wait. Otherwise, the compare channel of the timer is
+ * programmed once for the wakeup time, and the CPU sleeps until an interrupt.
+ * The compare interrupt recurs every time the timer wraps around, as does the
+ * overflow interrupt, so a sleep spanning overflows goes back to sleep until
+ * the wakeup time is reached. Each wakeup by the timer is recorded in the
+ * wakeup statistics (see lf_get_wakeup_stats()).
+ *
  * @param wakeup_time The time instant at which to wake up.
  * @return int 0 if sleep completed, or -1 if it was interrupted.
  */
@@ -212,50 +222,32 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_ti
         return 0;
     } 
 
-    // The sleeping while loop continues until either:
-    // 1) A physical action is scheduled, resulting in a new event on the event queue
-    // 2) Sleep has completed successfully
-    bool sleep_next = true;
-    _lf_sleep_interrupted = false;
     _lf_async_event = false;
 
-    do {
-        // Schedule a new timer interrupt unless we already have one pending
-        if (!_lf_sleep_interrupted) {
-            uint32_t curr_timer_val = nrfx_timer_capture(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL2);
-            uint32_t target_timer_val = 0;
-            // If the remaining sleep is longer than the limit, sleep for the maximum possible time.
-            if (duration > LF_MAX_SLEEP_NS) {
-                target_timer_val = curr_timer_val-1;
-                duration -= LF_MAX_SLEEP_NS;
-            } else {
-                target_timer_val = (uint32_t)(wakeup_time / 1000);
-                sleep_next = false;        
-            }
-            // init timer interrupt for sleep time
-            _lf_sleep_interrupted = true;
-            nrfx_timer_compare(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL2, target_timer_val, true);
-        }
+    // Round the wakeup time up to the resolution of the timer, so that the
+    // time is reached when the compare interrupt fires.
+    uint32_t target_timer_val = (uint32_t)((wakeup_time + 999) / 1000);
+    nrfx_timer_compare(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL2, target_timer_val, true);
 
+    // The time is checked after the compare channel has been programmed, so
+    // if it has not been reached, the compare interrupt is still to come.
+    _lf_clock_now(&now);
+    while (!_lf_async_event && now < wakeup_time) {
         // Leave critical section
         lf_enable_interrupts_nested();
-        
-        // wait for exception
+
+        // Sleep until an interrupt. An interrupt taken since the critical section
+        // was left sets the event register, so that this returns at once.
         __WFE();
 
         // Enter critical section again
         lf_disable_interrupts_nested();
+        _lf_clock_now(&now);
+    }
+    nrfx_timer_compare_int_disable(&g_lf_timer_inst, NRF_TIMER_CC_CHANNEL2);
 
-        // Redo while loop and go back to sleep if:
-        //  1) We didnt have async event AND
-        //  2) We have more sleeps left OR the sleep didnt complete
-        // 
-        // This means we leave the sleep while if:
-        //  1) There was an async event OR
-        //  2) no more sleeps AND sleep not interrupted 
-    } while(!_lf_async_event && (sleep_next || _lf_sleep_interrupted));
-    
     if (!_lf_async_event) {
+        _lf_record_wakeup(&_lf_wakeup_stats, now - wakeup_time);
         return 0;
     } else {
         LF_PRINT_DEBUG("Sleep got interrupted...\n");
@@ -264,20 +256,24 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_ti
 }
 
 /**
- * @brief Enter critical section. Let NRF Softdevice handle nesting
+ * @brief Exit critical section. Let NRF SoftDevice handle nesting
  * @return int 
  */
 int lf_enable_interrupts_nested() {
-    return sd_nvic_critical_region_enter(&_lf_nested_region);
+    return sd_nvic_critical_region_exit(_lf_nested_region);
 }
 
 /**
- * @brief Exit citical section. Let NRF SoftDevice handle nesting
+ * @brief Enter citical section. Let NRF SoftDevice handle nesting
  * 
  * @return int 
  */
 int lf_disable_interrupts_nested() {
-    return sd_nvic_critical_region_exit(_lf_nested_region);
+    return sd_nvic_critical_region_enter(&_lf_nested_region);
+}
+
+void lf_get_wakeup_stats(lf_wakeup_stats_t* stats) {
+    *stats = _lf_wakeup_stats;
 }
 
 /**
@@ -27,14 +27,11 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * @brief RP2040 mcu support for the C target of Lingua Franca. 
  * This utilizes the pico-sdk which provides C methods for a light runtime
  * and a hardware abstraction layer.
+ * The threaded runtime runs a worker on each of the two cores.
  * 
  * @author{Abhi Gundrala <gundralaa@berkeley.edu>}
  */
 
-#if !defined(LF_SINGLE_THREADED)
-#error "Only the single-threaded runtime has support for RP2040"
-#endif
-
 #include "lf_rp2040_support.h"
 #include "platform.h"
 #include "utils/util.h"
@@ -61,6 +58,11 @@ static semaphore_t _lf_sem_irq_event;
 // nested critical section counter
 static uint32_t _lf_num_nested_crit_sec = 0;
 
+/**
+ * Statistics of the wakeups from sleeps.
+ */
+static lf_wakeup_stats_t _lf_wakeup_stats;
+
 /**
  * Initialize basic runtime infrastructure and 
  * synchronization structs for an single-threaded runtime.
@@ -119,6 +121,9 @@ int lf_sleep(interval_t sleep_duration) {
  *
  * The semaphore is released using the _lf_single_threaded_notify_of_event
  * which is called by lf_schedule in the single_threaded runtime for physical actions.
+ * The wait is tickless: the SDK programs a hardware alarm for the target time
+ * and the core waits for events in between. Each wakeup by the alarm is recorded
+ * in the wakeup statistics (see lf_get_wakeup_stats()).
  *
  * @param  env  pointer to environment struct this runs in.
  * @param  wakeup_time  time in nanoseconds since boot to sleep until.
@@ -143,6 +148,10 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_ti
     // return on timeout or on processor event
     if(sem_acquire_block_until(&_lf_sem_irq_event, target)) {
         ret_code = -1;
+    } else {
+        instant_t now;
+        _lf_clock_now(&now);
+        _lf_record_wakeup(&_lf_wakeup_stats, now - wakeup_time);
     }
     // remove interrupts
     lf_critical_section_enter(env);
@@ -216,6 +225,225 @@ int _lf_single_threaded_notify_of_event() {
 }
 #endif // LF_SINGLE_THREADED
 
+#if !defined(LF_SINGLE_THREADED)
+/**
+ * The threaded runtime runs one thread on each core, without an RTOS.
+ * The first thread created is launched on core 1, which receives its function
+ * and argument over the inter-core FIFO and sends back its result when it
+ * returns. Core 0 runs the main thread, which creates the workers and then
+ * joins them, so the second thread created runs on core 0 when the main
+ * thread first joins a thread. Creating more threads fails, so a program can
+ * have at most two workers and no other threads, such as those of watchdogs.
+ *
+ * Mutexes are the recursive mutexes of the pico-sdk, which are built on
+ * hardware spin locks and owned by a core, which is the same as a thread here.
+ * Condition variables count notifications, which wake up the other core with
+ * an event (SEV) while the waiting core sleeps until one (WFE).
+ */
+
+/** Whether the thread of core 1 has been created. */
+static bool _lf_core1_created = false;
+/** Whether the thread of core 1 has returned its result, which is then in _lf_core1_result. */
+static bool _lf_core1_joined = false;
+static void* _lf_core1_result = NULL;
+
+/** Whether the thread of core 0 has been created. */
+static bool _lf_core0_created = false;
+/** The function of the thread of core 0 until it is run, then NULL. */
+static void* (*_lf_core0_function)(void*) = NULL;
+static void* _lf_core0_argument = NULL;
+static void* _lf_core0_result = NULL;
+
+/**
+ * Entry point of core 1, which runs the function received over the FIFO
+ * and sends back its result.
+ */
+static void _lf_core1_entry(void) {
+    void* (*function)(void*) = (void* (*)(void*))multicore_fifo_pop_blocking();
+    void* argument = (void*)multicore_fifo_pop_blocking();
+    void* result = function(argument);
+    multicore_fifo_push_blocking((uint32_t)result);
+}
+
+int lf_available_cores() {
+    return 2;
+}
+
+int lf_thread_create(lf_thread_t* thread, void *(*lf_thread) (void *), void* arguments) {
+    if (!_lf_core1_created) {
+        _lf_core1_created = true;
+        multicore_launch_core1(_lf_core1_entry);
+        multicore_fifo_push_blocking((uint32_t)lf_thread);
+        multicore_fifo_push_blocking((uint32_t)arguments);
+        *thread = 1;
+        return 0;
+    } else if (!_lf_core0_created) {
+        _lf_core0_created = true;
+        _lf_core0_function = lf_thread;
+        _lf_core0_argument = arguments;
+        *thread = 0;
+        return 0;
+    }
+    return -1;
+}
+
+int lf_thread_join(lf_thread_t thread, void** thread_return) {
+    // Run the thread of core 0 first, since the thread of core 1 may wait for it.
+    if (_lf_core0_function != NULL) {
+        void* (*function)(void*) = _lf_core0_function;
+        _lf_core0_function = NULL;
+        _lf_core0_result = function(_lf_core0_argument);
+    }
+    void* result;
+    if (thread == 0 && _lf_core0_created) {
+        result = _lf_core0_result;
+    } else if (thread == 1 && _lf_core1_created) {
+        if (!_lf_core1_joined) {
+            _lf_core1_result = (void*)multicore_fifo_pop_blocking();
+            _lf_core1_joined = true;
+        }
+        result = _lf_core1_result;
+    } else {
+        return -1;
+    }
+    if (thread_return != NULL) {
+        *thread_return = result;
+    }
+    return 0;
+}
+
+lf_thread_t lf_thread_self() {
+    return (lf_thread_t)get_core_num();
+}
+
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    // Each thread runs on its own core.
+    return (cpu_number == (size_t)thread) ? 0 : -1;
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    return -1;
+}
+
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    // Each thread has a core to itself, so there is nothing to schedule.
+    return -1;
+}
+
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    return -1;
+}
+
+int lf_mutex_init(lf_mutex_t* mutex) {
+    recursive_mutex_init(mutex);
+    return 0;
+}
+
+int lf_mutex_lock(lf_mutex_t* mutex) {
+    recursive_mutex_enter_blocking(mutex);
+    return 0;
+}
+
+int lf_mutex_unlock(lf_mutex_t* mutex) {
+    recursive_mutex_exit(mutex);
+    return 0;
+}
+
+int lf_cond_init(lf_cond_t* cond, lf_mutex_t* mutex) {
+    cond->mutex = mutex;
+    cond->sequence = 0;
+    return 0;
+}
+
+int lf_cond_broadcast(lf_cond_t* cond) {
+    // The caller holds the mutex, so the count changes under it.
+    cond->sequence++;
+    __dmb();
+    __sev();
+    return 0;
+}
+
+int lf_cond_signal(lf_cond_t* cond) {
+    // With one thread per core, at most one thread waits.
+    return lf_cond_broadcast(cond);
+}
+
+int lf_cond_wait(lf_cond_t* cond) {
+    uint32_t sequence = cond->sequence;
+    recursive_mutex_exit(cond->mutex);
+    // A notification after the check sets the event register, so WFE returns at once.
+    while (cond->sequence == sequence) {
+        __wfe();
+    }
+    recursive_mutex_enter_blocking(cond->mutex);
+    return 0;
+}
+
+int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns) {
+    uint32_t sequence = cond->sequence;
+    absolute_time_t until = from_us_since_boot((uint64_t)((absolute_time_ns > 0) ? absolute_time_ns / 1000 : 0));
+    int result = 0;
+    recursive_mutex_exit(cond->mutex);
+    while (cond->sequence == sequence) {
+        if (best_effort_wfe_or_timeout(until)) {
+            result = LF_TIMEOUT;
+            break;
+        }
+    }
+    recursive_mutex_enter_blocking(cond->mutex);
+    return result;
+}
+
+// Atomics
+//  The Cortex-M0+ has no exclusive loads and stores, so atomic operations
+//  are done under a hardware spin lock reserved for operating systems.
+
+int _rp2040_atomic_fetch_add(int *ptr, int value) {
+    spin_lock_t* lock = spin_lock_instance(PICO_SPINLOCK_ID_OS1);
+    uint32_t save = spin_lock_blocking(lock);
+    int res = *ptr;
+    *ptr += value;
+    spin_unlock(lock, save);
+    return res;
+}
+
+int _rp2040_atomic_add_fetch(int *ptr, int value) {
+    spin_lock_t* lock = spin_lock_instance(PICO_SPINLOCK_ID_OS1);
+    uint32_t save = spin_lock_blocking(lock);
+    int res = *ptr + value;
+    *ptr = res;
+    spin_unlock(lock, save);
+    return res;
+}
+
+bool _rp2040_bool_compare_and_swap(bool *ptr, bool value, bool newval) {
+    spin_lock_t* lock = spin_lock_instance(PICO_SPINLOCK_ID_OS1);
+    uint32_t save = spin_lock_blocking(lock);
+    bool res = false;
+    if (*ptr == value) {
+        *ptr = newval;
+        res = true;
+    }
+    spin_unlock(lock, save);
+    return res;
+}
+
+int _rp2040_val_compare_and_swap(int *ptr, int value, int newval) {
+    spin_lock_t* lock = spin_lock_instance(PICO_SPINLOCK_ID_OS1);
+    uint32_t save = spin_lock_blocking(lock);
+    int res = *ptr;
+    if (*ptr == value) {
+        *ptr = newval;
+    }
+    spin_unlock(lock, save);
+    return res;
+}
+#endif // !LF_SINGLE_THREADED
+
+void lf_get_wakeup_stats(lf_wakeup_stats_t* stats) {
+    *stats = _lf_wakeup_stats;
+}
+
 
 #endif // PLATFORM_RP2040
 
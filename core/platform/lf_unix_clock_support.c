@@ -17,6 +17,207 @@
  */
 interval_t _lf_time_epoch_offset = 0LL;
 
+#ifdef LF_CLOCK_TSC
+#include <stdbool.h>
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#elif !defined(__aarch64__)
+#error "LF_CLOCK_TSC is only supported on 64-bit x86 and ARM processors."
+#endif
+
+/**
+ * Period at which the cycle counter is calibrated again against _LF_CLOCK.
+ * The first reading of the clock after this period does the calibration.
+ */
+#ifndef LF_CLOCK_TSC_CALIBRATION_PERIOD
+#define LF_CLOCK_TSC_CALIBRATION_PERIOD MSEC(100)
+#endif
+
+/**
+ * With LF_CLOCK_TSC, _lf_clock_now() converts the count of the processor's cycle
+ * counter into the time of _LF_CLOCK rather than calling clock_gettime(). The
+ * conversion is linear from the base sample below, with a rate in nanoseconds
+ * per cycle as a 32.32 fixed-point number. Every LF_CLOCK_TSC_CALIBRATION_PERIOD,
+ * the rate is measured again, and corrected so that the conversion, which does
+ * not jump, converges to _LF_CLOCK by the next calibration.
+ */
+static bool tsc_is_usable = false;
+static uint64_t tsc_base_cycles = 0;
+static instant_t tsc_base_time = 0LL;
+static uint64_t tsc_ns_per_cycle = 0;
+/** The number of cycles in LF_CLOCK_TSC_CALIBRATION_PERIOD. */
+static uint64_t tsc_calibration_cycles = 0;
+/** The last sample of the cycle counter and _LF_CLOCK together. */
+static uint64_t tsc_reference_cycles = 0;
+static instant_t tsc_reference_time = 0LL;
+/**
+ * Version of the conversion, which is odd while a thread calibrates the
+ * cycle counter, so that readers retry rather than taking a lock.
+ */
+static int tsc_version = 0;
+
+/**
+ * Return the count of the processor's cycle counter, which is the
+ * invariant TSC on x86 and the virtual counter on 64-bit ARM.
+ */
+static inline uint64_t tsc_cycle_count(void) {
+#if defined(__x86_64__)
+    return (uint64_t)__rdtsc();
+#else
+    uint64_t count;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(count));
+    return count;
+#endif
+}
+
+/**
+ * Return whether the cycle counter runs at a constant rate across
+ * frequency changes and sleep states, as a clock must.
+ */
+static bool tsc_is_invariant(void) {
+#if defined(__x86_64__)
+    // CPUID.80000007H:EDX[8] is the invariant TSC flag.
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)) != 0;
+#else
+    return true;
+#endif
+}
+
+/**
+ * Sample the cycle counter and _LF_CLOCK together. The count is
+ * the average of the counts read just before and after the clock.
+ */
+static void tsc_sample(uint64_t* cycles, instant_t* time) {
+    struct timespec tp;
+    uint64_t before = tsc_cycle_count();
+    clock_gettime(_LF_CLOCK, &tp);
+    uint64_t after = tsc_cycle_count();
+    *cycles = before + (after - before) / 2;
+    *time = convert_timespec_to_ns(tp);
+}
+
+/**
+ * Convert a count of the cycle counter into the time of _LF_CLOCK.
+ * A count before the base, read on another core or before a calibration,
+ * is converted to the base time.
+ */
+static inline instant_t tsc_to_time(uint64_t cycles) {
+    if ((int64_t)(cycles - tsc_base_cycles) <= 0) {
+        return tsc_base_time;
+    }
+    return tsc_base_time + (instant_t)(((unsigned __int128)(cycles - tsc_base_cycles) * tsc_ns_per_cycle) >> 32);
+}
+
+/**
+ * Measure the rate of the cycle counter since the reference sample and move
+ * the base of the conversion to now. The error of the conversion relative to
+ * _LF_CLOCK is corrected over the next period by adjusting the rate, within
+ * a factor of two, except that the first conversion, or one behind by more
+ * than a period, e.g., after the system was suspended, jumps forward.
+ * This is to be called by one thread at a time, which has made tsc_version odd.
+ */
+static void tsc_calibrate(void) {
+    uint64_t cycles;
+    instant_t time;
+    tsc_sample(&cycles, &time);
+    instant_t converted = tsc_to_time(cycles);
+    if (cycles != tsc_reference_cycles && time > tsc_reference_time) {
+        uint64_t ns_per_cycle = (uint64_t)(((unsigned __int128)(time - tsc_reference_time) << 32)
+                / (cycles - tsc_reference_cycles));
+        tsc_calibration_cycles = (uint64_t)(((unsigned __int128)LF_CLOCK_TSC_CALIBRATION_PERIOD << 32)
+                / ns_per_cycle);
+        interval_t error = time - converted;
+        if (error > LF_CLOCK_TSC_CALIBRATION_PERIOD || tsc_ns_per_cycle == 0) {
+            converted = time;
+            error = 0;
+        }
+        int64_t correction = (int64_t)(((__int128)error << 32) / (__int128)tsc_calibration_cycles);
+        if (correction > (int64_t)ns_per_cycle) {
+            correction = (int64_t)ns_per_cycle;
+        } else if (correction < -(int64_t)(ns_per_cycle / 2)) {
+            correction = -(int64_t)(ns_per_cycle / 2);
+        }
+        tsc_ns_per_cycle = ns_per_cycle + correction;
+    }
+    tsc_base_cycles = cycles;
+    tsc_base_time = converted;
+    tsc_reference_cycles = cycles;
+    tsc_reference_time = time;
+}
+
+/**
+ * Check that the cycle counter can serve as the clock and measure its
+ * rate over a short interval.
+ */
+static void tsc_initialize(void) {
+    if (!tsc_is_invariant()) {
+        lf_print_warning("The cycle counter does not run at a constant rate. Using clock_gettime() instead.");
+        return;
+    }
+    const struct timespec pause = {0, 10000000L};
+    tsc_sample(&tsc_reference_cycles, &tsc_reference_time);
+    tsc_base_cycles = tsc_reference_cycles;
+    tsc_base_time = tsc_reference_time;
+    nanosleep(&pause, NULL);
+    tsc_calibrate();
+    if (tsc_ns_per_cycle == 0) {
+        lf_print_warning("Could not calibrate the cycle counter. Using clock_gettime() instead.");
+        return;
+    }
+    tsc_is_usable = true;
+    LF_PRINT_LOG("Using the cycle counter as the clock, at %llu cycles per second.",
+            (unsigned long long)(((unsigned __int128)BILLION << 32) / tsc_ns_per_cycle));
+}
+
+/**
+ * Return the time of _LF_CLOCK as converted from the cycle counter,
+ * calibrating it if a period has passed since the last calibration.
+ */
+static instant_t tsc_clock_now(void) {
+    uint64_t cycles = tsc_cycle_count();
+    instant_t time;
+    int version;
+    do {
+        version = __atomic_load_n(&tsc_version, __ATOMIC_ACQUIRE);
+        if ((version & 1) == 0
+                && (int64_t)(cycles - tsc_base_cycles) >= (int64_t)tsc_calibration_cycles
+                && lf_bool_compare_and_swap(&tsc_version, version, version + 1)) {
+            tsc_calibrate();
+            lf_atomic_fetch_add(&tsc_version, 1);
+            cycles = tsc_cycle_count();
+            continue;
+        }
+        time = tsc_to_time(cycles);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) != 0 || version != __atomic_load_n(&tsc_version, __ATOMIC_RELAXED));
+    return time;
+}
+#endif // LF_CLOCK_TSC
+
+#ifdef PLATFORM_Darwin
+#include <mach/mach_time.h>
+
+/**
+ * On macOS, _lf_clock_now() reads mach_absolute_time(), which counts the ticks
+ * of CLOCK_UPTIME_RAW without the overhead of clock_gettime(), and whose
+ * deadlines mach_wait_until() takes. This is the ratio of nanoseconds to ticks,
+ * which is 1/1 on Intel processors and 125/3 on Apple silicon.
+ */
+static mach_timebase_info_data_t mach_timebase = {1, 1};
+
+instant_t convert_mach_ticks_to_ns(uint64_t ticks) {
+    return (instant_t)(((unsigned __int128)ticks * mach_timebase.numer) / mach_timebase.denom);
+}
+
+uint64_t convert_ns_to_mach_ticks(instant_t t) {
+    return (uint64_t)(((unsigned __int128)t * mach_timebase.denom + mach_timebase.numer - 1)
+            / mach_timebase.numer);
+}
+#endif // PLATFORM_Darwin
+
 instant_t convert_timespec_to_ns(struct timespec tp) {
     return ((instant_t) tp.tv_sec) * BILLION + tp.tv_nsec;
 }
@@ -50,6 +251,11 @@ void calculate_epoch_offset(void) {
 }
 
 void _lf_initialize_clock() {
+#ifdef PLATFORM_Darwin
+    if (mach_timebase_info(&mach_timebase) != KERN_SUCCESS) {
+        lf_print_error_and_exit("Could not obtain the timebase of mach_absolute_time().");
+    }
+#endif
     calculate_epoch_offset();
 
     struct timespec res;
@@ -59,17 +265,36 @@ void _lf_initialize_clock() {
     }
 
     lf_print("---- System clock resolution: %ld nsec", res.tv_nsec);
+#ifdef LF_CLOCK_TSC
+    tsc_initialize();
+#endif
 }
 
 /**
  * Fetch the value of _LF_CLOCK (see lf_linux_support.h) and store it in tp. The
  * timestamp value in 't' will always be epoch time, which is the number of
- * nanoseconds since January 1st, 1970.
+ * nanoseconds since January 1st, 1970. With LF_CLOCK_TSC, the value is converted
+ * from the cycle counter, if it runs at a constant rate. On macOS, it is
+ * converted from mach_absolute_time().
  *
  * @return 0 for success, or -1 for failure. In case of failure, errno will be
  *  set appropriately (see `man 2 clock_gettime`).
  */
 int _lf_clock_now(instant_t* t) {
+#ifdef LF_CLOCK_TSC
+    if (tsc_is_usable && t != NULL) {
+        *t = tsc_clock_now() + _lf_time_epoch_offset;
+        return 0;
+    }
+#endif
+#ifdef PLATFORM_Darwin
+    if (t == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+    *t = convert_mach_ticks_to_ns(mach_absolute_time()) + _lf_time_epoch_offset;
+    return 0;
+#else
     struct timespec tp;
     // Adjust the clock by the epoch offset, so epoch time is always reported.
     int return_value = clock_gettime(_LF_CLOCK, (struct timespec*) &tp);
@@ -92,5 +317,6 @@ int _lf_clock_now(instant_t* t) {
 
     *t = tp_in_ns;
     return return_value;
+#endif // PLATFORM_Darwin
 }
 #endif
@@ -38,6 +38,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 #include <process.h>
 #include <sysinfoapi.h>
+#include <mmsystem.h> // For timeBeginPeriod
 #include <time.h>
 
 #include "lf_windows_support.h"
@@ -47,6 +48,28 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define LF_MIN_SLEEP_NS USEC(10)
 
+/**
+ * The final part of a sleep that is spent spinning on the performance counter
+ * rather than waiting on a timer, which even with high resolution can wake up
+ * a few hundred microseconds late. A value of 0 disables the spin.
+ */
+#ifndef LF_WINDOWS_SPIN_NS
+#define LF_WINDOWS_SPIN_NS USEC(500)
+#endif
+
+/**
+ * The final part of a timed wait on a condition variable that is instead spent
+ * sleeping precisely. Condition variables wait for whole milliseconds and wake
+ * up at the next tick of the system timer, whose period is 1 ms once
+ * _lf_initialize_clock() has requested it.
+ */
+#define LF_WINDOWS_COND_MARGIN_NS MSEC(2)
+
+// Defined by the Windows SDK from Windows 10, version 1803, on.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 /**
  * Indicate whether or not the underlying hardware
  * supports Windows' high-resolution counter. It should
@@ -55,21 +78,26 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 int _lf_use_performance_counter = 0;
 
 /**
- * The denominator to convert the performance counter
- * to nanoseconds.
+ * The frequency of the performance counter in ticks per second, or that of
+ * the system time, which counts 100 ns intervals, if there is no performance
+ * counter.
  */
-double _lf_frequency_to_ns = 1.0;
+LONGLONG _lf_counter_frequency = 10000000LL;
 
 void _lf_initialize_clock() {
     // Check if the performance counter is available
     LARGE_INTEGER performance_frequency;
     _lf_use_performance_counter = QueryPerformanceFrequency(&performance_frequency);
     if (_lf_use_performance_counter) {
-        _lf_frequency_to_ns = (double)performance_frequency.QuadPart / BILLION;
+        _lf_counter_frequency = performance_frequency.QuadPart;
     } else {
         lf_print_error(
             "High resolution performance counter is not supported on this machine.");
-        _lf_frequency_to_ns = 0.01;
+    }
+    // Let the system timer tick every millisecond rather than every 15.6 ms,
+    // which is what the timeouts of condition variables are rounded up to.
+    if (timeBeginPeriod(1) != TIMERR_NOERROR) {
+        lf_print_warning("Could not set the period of the system timer to 1 ms.");
     }
 }
 
@@ -86,18 +114,17 @@ int _lf_clock_now(instant_t* t) {
     // Adapted from gclib/GResUsage.cpp
     // (https://github.com/gpertea/gclib/blob/8aee376774ccb2f3bd3f8e3bf1c9df1528ac7c5b/GResUsage.cpp)
     // License: https://github.com/gpertea/gclib/blob/master/LICENSE.txt
-    int result = -1;
     if (t == NULL) {
         // The t argument address references invalid memory
         errno = EFAULT;
-        return result;
+        return -1;
     }
     LARGE_INTEGER windows_time;
     if (_lf_use_performance_counter) {
-        int result = QueryPerformanceCounter(&windows_time);
-        if ( result == 0) {
+        if (QueryPerformanceCounter(&windows_time) == 0) {
             lf_print_error("_lf_clock_now(): Failed to read the value of the physical clock.");
-            return result;
+            errno = EINVAL;
+            return -1;
         }
     } else {
         FILETIME f;
@@ -106,42 +133,73 @@ int _lf_clock_now(instant_t* t) {
         windows_time.QuadPart <<= 32;
         windows_time.QuadPart |= f.dwLowDateTime;
     }
-    *t = (instant_t)((double)windows_time.QuadPart / _lf_frequency_to_ns);
+    // Convert whole seconds and the remainder separately, which is exact and
+    // cannot overflow, unlike a conversion through a double.
+    LONGLONG seconds = windows_time.QuadPart / _lf_counter_frequency;
+    LONGLONG remainder = windows_time.QuadPart % _lf_counter_frequency;
+    *t = (instant_t)(seconds * BILLION + remainder * BILLION / _lf_counter_frequency);
     return (0);
 }
 
+/**
+ * Sleep until the physical clock reaches the specified time. This waits on a
+ * high-resolution waitable timer, if the system supports one, until
+ * LF_WINDOWS_SPIN_NS before the time, and spins on the clock for the rest.
+ *
+ * @return 0 for success, or -1 for failure, in which case errno is set to EINVAL.
+ */
+static int _lf_sleep_until(instant_t wakeup_time) {
+    instant_t now;
+    if (_lf_clock_now(&now) != 0) {
+        return -1;
+    }
+    interval_t timer_duration = wakeup_time - now - LF_WINDOWS_SPIN_NS;
+    if (timer_duration > 0) {
+        HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (timer == NULL) {
+            // Versions of Windows before 10, version 1803, only have timers
+            // that expire at ticks of the system timer.
+            timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        }
+        if (timer == NULL) {
+            errno = EINVAL;
+            return -1;
+        }
+        // A negative due time is relative, in units of 100 nanoseconds.
+        LARGE_INTEGER due_time;
+        due_time.QuadPart = -(timer_duration / 100);
+        if (!SetWaitableTimer(timer, &due_time, 0, NULL, NULL, FALSE)
+                || WaitForSingleObject(timer, INFINITE) != WAIT_OBJECT_0) {
+            CloseHandle(timer);
+            errno = EINVAL;
+            return -1;
+        }
+        CloseHandle(timer);
+    }
+    while (now < wakeup_time) {
+        YieldProcessor();
+        if (_lf_clock_now(&now) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /**
  * Pause execution for a number of nanoseconds.
  *
  * @return 0 for success, or -1 for failure. In case of failure, errno will be
- *  set to
- *   - EINTR: The sleep was interrupted by a signal handler
- *   - EINVAL: All other errors
+ *  set to EINVAL.
  */
 int lf_sleep(interval_t sleep_duration) {
-    /* Declarations */
-    HANDLE timer;	/* Timer handle */
-    LARGE_INTEGER li;	/* Time defintion */
-    /* Create timer */
-    if(!(timer = CreateWaitableTimer(NULL, TRUE, NULL))) {
-        return FALSE;
+    instant_t now;
+    if (_lf_clock_now(&now) != 0) {
+        return -1;
     }
-    /**
-    * Set timer properties.
-    * A negative number indicates relative time to wait.
-    * The requested sleep duration must be in number of 100 nanoseconds.
-    */
-    li.QuadPart = -1 * (sleep_duration / 100);
-    if(!SetWaitableTimer(timer, &li, 0, NULL, NULL, FALSE)){
-        CloseHandle(timer);
-        return FALSE;
+    if (sleep_duration <= 0) {
+        return 0;
     }
-    /* Start & wait for timer */
-    WaitForSingleObject(timer, INFINITE);
-    /* Clean resources */
-    CloseHandle(timer);
-    /* Slept without problems */
-    return TRUE;
+    return _lf_sleep_until(sleep_duration < FOREVER - now ? now + sleep_duration : FOREVER);
 }
 
 int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_time) {
@@ -170,8 +228,57 @@ int lf_available_cores() {
     return sysinfo.dwNumberOfProcessors;
 }
 
+/**
+ * Return a handle of the given thread to set its affinity with, or NULL.
+ * C11 threads do not expose their handle, so with them only the calling
+ * thread, which is how workers place themselves, can be placed.
+ */
+static HANDLE _lf_thread_handle(lf_thread_t thread) {
+#if __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
+    return thread;
+#else
+    return thrd_equal(thread, thrd_current()) ? GetCurrentThread() : NULL;
+#endif
+}
+
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    HANDLE handle = _lf_thread_handle(thread);
+    // The mask covers the cores of the processor group of the process.
+    if (handle == NULL || cpu_number >= sizeof(DWORD_PTR) * 8) {
+        return -1;
+    }
+    if (SetThreadAffinityMask(handle, (DWORD_PTR)1 << cpu_number) == 0) {
+        return (int)GetLastError();
+    }
+    return 0;
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    HANDLE handle = _lf_thread_handle(thread);
+    ULONG highest_node;
+    ULONGLONG mask;
+    if (handle == NULL || !GetNumaHighestNodeNumber(&highest_node) || node > highest_node
+            || !GetNumaNodeProcessorMask((UCHAR)node, &mask) || (DWORD_PTR)mask == 0) {
+        return -1;
+    }
+    if (SetThreadAffinityMask(handle, (DWORD_PTR)mask) == 0) {
+        return (int)GetLastError();
+    }
+    return 0;
+}
+
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    return -1;
+}
+
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    return -1;
+}
+
 #if __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__) // (Not C++11 or later) or no threads support
 
+LF_THREAD_LOCAL void (*lf_thread_release_hook)(void) = NULL;
+
 int lf_thread_create(lf_thread_t* thread, void *(*lf_thread) (void *), void* arguments) {
     uintptr_t handle = _beginthreadex(NULL, 0, lf_thread, arguments, 0, NULL);
     *thread = (HANDLE)handle;
@@ -197,6 +304,10 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
     return 0;
 }
 
+lf_thread_t lf_thread_self() {
+    return GetCurrentThread();
+}
+
 int lf_mutex_init(_lf_critical_section_t* critical_section) {
     // Set up a recursive mutex
     InitializeCriticalSection((PCRITICAL_SECTION)critical_section);
@@ -251,6 +362,7 @@ int lf_cond_signal(lf_cond_t* cond) {
 }
 
 int lf_cond_wait(lf_cond_t* cond) {
+    _LF_RUN_THREAD_RELEASE_HOOK();
     // According to synchapi.h, the following Windows API returns 0 on failure,
     // and non-zero on success.
     int return_value =
@@ -273,34 +385,49 @@ int lf_cond_wait(lf_cond_t* cond) {
 }
 
 int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns) {
-    // Convert the absolute time to a relative time
-    instant_t current_time_ns;
-    _lf_clock_now(&current_time_ns);
-    interval_t relative_time_ns = (absolute_time_ns - current_time_ns);
-    if (relative_time_ns <= 0) {
-      // physical time has already caught up sufficiently and we do not need to wait anymore
-      return 0;
-    }
+    _LF_RUN_THREAD_RELEASE_HOOK();
+    while (true) {
+        // Convert the absolute time to a relative time
+        instant_t current_time_ns;
+        _lf_clock_now(&current_time_ns);
+        interval_t relative_time_ns = (absolute_time_ns - current_time_ns);
+        if (relative_time_ns <= 0) {
+            return LF_TIMEOUT;
+        }
+        if (relative_time_ns < LF_WINDOWS_COND_MARGIN_NS + MSEC(1)) {
+            // The condition variable cannot time out this precisely, so sleep
+            // for the rest of the time instead. A signal in the meantime is
+            // not noticed, but the caller then determines what to do next
+            // anyway.
+            LeaveCriticalSection((PCRITICAL_SECTION)cond->critical_section);
+            int result = _lf_sleep_until(absolute_time_ns);
+            EnterCriticalSection((PCRITICAL_SECTION)cond->critical_section);
+            return (result == 0) ? LF_TIMEOUT : -1;
+        }
 
-    // convert ns to ms and round up to closest full integer
-    DWORD relative_time_ms = (relative_time_ns + 999999LL) / 1000000LL;
+        // Time out LF_WINDOWS_COND_MARGIN_NS early, rounded down to whole ms.
+        interval_t relative_time_ms = (relative_time_ns - LF_WINDOWS_COND_MARGIN_NS) / MSEC(1);
+        if (relative_time_ms >= INFINITE) {
+            relative_time_ms = INFINITE - 1;
+        }
+        int return_value =
+         (int)SleepConditionVariableCS(
+             (PCONDITION_VARIABLE)&cond->condition,
+             (PCRITICAL_SECTION)cond->critical_section,
+             (DWORD)relative_time_ms
+         );
+        if (return_value == 0) {
+            // Error
+            if (GetLastError() == ERROR_TIMEOUT) {
+                // Wait for the rest of the time.
+                continue;
+            }
+            return -1;
+        }
 
-    int return_value =
-     (int)SleepConditionVariableCS(
-         (PCONDITION_VARIABLE)&cond->condition,
-         (PCRITICAL_SECTION)cond->critical_section,
-         relative_time_ms
-     );
-    if (return_value == 0) {
-      // Error
-      if (GetLastError() == ERROR_TIMEOUT) {
-        return LF_TIMEOUT;
-      }
-      return -1;
+        // Success
+        return 0;
     }
-
-    // Success
-    return 0;
 }
 #else // If there is C11 support
 #include "lf_C11_threads_support.c"
@@ -54,6 +54,11 @@ static struct counter_alarm_cfg alarm_cfg;
 const struct device *const counter_dev = DEVICE_DT_GET(LF_TIMER);   
 static volatile bool alarm_fired;
 
+/**
+ * Statistics of the wakeups from sleeps.
+ */
+static lf_wakeup_stats_t wakeup_stats;
+
 /**
  * This callback is invoked when the underlying Timer peripheral overflows.
  * Handled by incrementing the epoch variable.
@@ -79,7 +84,6 @@ static void alarm_callback(const struct device *counter_dev,
  */
 void _lf_initialize_clock() {
     struct counter_top_cfg counter_top_cfg;
-    uint32_t counter_max_ticks=0;
     int res;
 	
     // Verify that we have the device
@@ -148,8 +152,11 @@ int _lf_clock_now(instant_t* t) {
 
 /**
  * Handle interruptable sleep by configuring a future alarm callback and waiting
- * on a semaphore. Make sure we can handle sleeps that exceed an entire epoch
- * of the Counter.
+ * on a semaphore, which lets the kernel idle without ticks in the deepest power
+ * state allowed. Make sure we can handle sleeps that exceed an entire epoch
+ * of the Counter, for which the alarm is set to the top value of the Counter,
+ * since a larger one is rejected by Counters narrower than 32 bits. Each
+ * wakeup by the alarm is recorded in the wakeup statistics.
  */
 int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup) {
     // Reset flags
@@ -170,8 +177,9 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup) {
         if (sleep_for_us < epoch_duration_usec) {
             sleep_duration_ticks = counter_us_to_ticks(counter_dev, ((uint64_t) sleep_for_us) - LF_WAKEUP_OVERHEAD_US);
         } else {
-            sleep_duration_ticks = UINT32_MAX;
+            sleep_duration_ticks = counter_max_ticks;
         }
+        instant_t alarm_time = now + counter_ticks_to_us(counter_dev, sleep_duration_ticks) * 1000LL;
 
         alarm_cfg.ticks = sleep_duration_ticks;
         int err = counter_set_channel_alarm(counter_dev, LF_TIMER_ALARM_CHANNEL,  &alarm_cfg);
@@ -188,6 +196,10 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup) {
         if (!async_event) {
             _lf_clock_now(&now);
             sleep_for_us = (wakeup - now)/1000;
+            if (alarm_fired) {
+                _lf_record_wakeup(&wakeup_stats, now - alarm_time);
+                alarm_fired = false;
+            }
         }
     } 
     
@@ -207,6 +219,10 @@ int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup) {
     }
 }
 
+void lf_get_wakeup_stats(lf_wakeup_stats_t* stats) {
+    *stats = wakeup_stats;
+}
+
 /**
  * We notify of async events by setting the flag and giving the semaphore.
  */
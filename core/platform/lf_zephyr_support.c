@@ -151,6 +151,34 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
     return k_thread_join(thread, K_FOREVER);
 }
 
+lf_thread_t lf_thread_self() {
+    return k_current_get();
+}
+
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number) {
+    // Zephyr can only pin threads that are not running (k_thread_cpu_pin),
+    // so thread affinity is not supported here.
+    return -1;
+}
+
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node) {
+    return -1;
+}
+
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy) {
+    // Zephyr threads are always scheduled by priority.
+    return lf_thread_set_priority(thread, policy->priority);
+}
+
+int lf_thread_set_priority(lf_thread_t thread, int priority) {
+    // In Zephyr, lower values are more urgent and preemptible threads use
+    // priorities from 0 to CONFIG_NUM_PREEMPT_PRIORITIES - 1.
+    int zephyr_priority = ((LF_SCHED_MAX_PRIORITY - priority) * (CONFIG_NUM_PREEMPT_PRIORITIES - 1))
+            / (LF_SCHED_MAX_PRIORITY - LF_SCHED_MIN_PRIORITY);
+    k_thread_priority_set(thread, zephyr_priority);
+    return 0;
+}
+
 int lf_mutex_init(lf_mutex_t* mutex) {
     return k_mutex_init(mutex);    
 }
@@ -31,24 +31,162 @@
  * through multiports.
  */
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "port.h"
 #include "vector.h"
+#include "environment.h"
 
 /**
- * Compare two non-negative integers pointed to. Return -1 if a < b, 0 if a == b,
- * and 1 if a > b.
- * @param a Pointer to the first integer.
- * @param b Pointer to the second integer.
+ * Sort the given channel numbers, which agree on all bits above 'bit', into
+ * increasing order. Short runs are sorted by insertion. Longer ones are
+ * partitioned in place on 'bit' and then on the lower bits in turn, so
+ * sorting takes time linear in their number and makes no calls through a
+ * comparison function.
  */
-int compare_sizes(const void* a, const void* b) {
-	if (*(size_t*)a < *(size_t*)b) {
-		return -1;
-	} else if (*(size_t*)a > *(size_t*)b) {
-		return 1;
-	} else {
-		return 0;
+static void _lf_sort_channels(size_t* channels, int size, size_t bit) {
+	while (size > 16 && bit > 0) {
+		int low = 0, high = size - 1;
+		while (low <= high) {
+			if (!(channels[low] & bit)) {
+				low++;
+			} else if (channels[high] & bit) {
+				high--;
+			} else {
+				size_t channel = channels[low];
+				channels[low++] = channels[high];
+				channels[high--] = channel;
+			}
+		}
+		bit >>= 1;
+		// Sort the smaller part recursively and the larger one in this loop.
+		if (low < size - low) {
+			_lf_sort_channels(channels, low, bit);
+			channels += low;
+			size -= low;
+		} else {
+			_lf_sort_channels(channels + low, size - low, bit);
+			size = low;
+		}
+	}
+	for (int i = 1; i < size; i++) {
+		size_t channel = channels[i];
+		int j = i;
+		for (; j > 0 && channels[j - 1] > channel; j--) {
+			channels[j] = channels[j - 1];
+		}
+		channels[j] = channel;
+	}
+}
+
+void _lf_bind_port_presence(environment_t* env, lf_port_base_t** port, int width) {
+#ifdef LF_PORT_PRESENCE_ARRAYS
+	if (width <= 0) return;
+	bool fresh = env->port_presence_used + width <= env->port_presence_size;
+	for (int i = 0; i < width; i++) {
+		if (port[i]->presence != NULL) {
+			// The channel is shared with another multiport, so neither can be scanned as one group.
+			int slot = (int)(port[i]->presence - env->port_presence);
+			env->port_presence_width[env->port_presence_group[slot]] = -1;
+			fresh = false;
+		}
+	}
+	if (!fresh) return;
+	int start = env->port_presence_used;
+	env->port_presence_used += width;
+	env->port_presence_width[start] = width;
+	for (int i = 0; i < width; i++) {
+		if (port[i]->presence != NULL) {
+			// The same port appears twice in this multiport.
+			env->port_presence_width[start] = -1;
+			continue;
+		}
+		port[i]->presence = &env->port_presence[start + i];
+		*port[i]->presence = port[i]->is_present;
+		env->port_presence_group[start + i] = start;
+	}
+#endif
+}
+
+/**
+ * Return the first present channel at or after 'start' by scanning the
+ * presence array, or -2 if the channels of the multiport do not form one
+ * group in that array.
+ */
+static int _lf_scan_port_presence(lf_port_base_t** port, int width, int start) {
+#ifdef LF_PORT_PRESENCE_ARRAYS
+	bool* base = port[0]->presence;
+	if (base == NULL || port[0]->source_reactor == NULL) return -2;
+	environment_t* env = port[0]->source_reactor->environment;
+	int slot = (int)(base - env->port_presence);
+	if (env->port_presence_width[slot] != width || port[width - 1]->presence != base + width - 1) return -2;
+	if (start >= width) return -1;
+	bool* found = (bool*)memchr(base + start, true, (size_t)(width - start));
+	return found ? (int)(found - base) : -1;
+#else
+	return -2;
+#endif
+}
+
+/**
+ * Return the index of the least significant bit that is set in a nonzero word.
+ */
+static inline int _lf_lowest_set_bit(uint32_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(word);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, word);
+	return (int)index;
+#else
+	int index = 0;
+	while (!(word & 1u)) {
+		word >>= 1;
+		index++;
 	}
+	return index;
+#endif
+}
+
+/**
+ * Return the first channel at or after 'start' whose bit is set in the
+ * bitmap of the given sparse record, or -1 if there is none. Whole words
+ * of absent channels are skipped at once.
+ */
+static int _lf_next_set_channel(lf_sparse_io_record_t* record, int start) {
+	int width = record->bitmap_width;
+	if (start >= width) return -1;
+	uint32_t* bits = (uint32_t*)record->present_channels;
+	int num_words = (width + 31) / 32;
+	int w = start / 32;
+	uint32_t word = bits[w] & (~0u << (start % 32));
+	while (word == 0) {
+		if (++w >= num_words) return -1;
+		word = bits[w];
+	}
+	return w * 32 + _lf_lowest_set_bit(word);
+}
+
+/**
+ * If the given sparse record belongs to a wide enough multiport and its storage
+ * can hold one bit per channel, switch it to a bitmap. The bitmap starts out
+ * with the channels that are present now, after which writers set the bits.
+ */
+static void _lf_use_sparse_bitmap(lf_sparse_io_record_t* record, lf_port_base_t** port, int width) {
+	if (record->bitmap_width > 0 || width < LF_SPARSE_BITMAP_WIDTH
+			|| record->capacity * sizeof(size_t) * 8 < (size_t)width) {
+		return;
+	}
+	uint32_t* bits = (uint32_t*)record->present_channels;
+	memset(bits, 0, ((width + 31) / 32) * sizeof(uint32_t));
+	for (int i = 0; i < width; i++) {
+		if (port[i]->is_present) bits[i / 32] |= 1u << (i % 32);
+	}
+	record->bitmap_width = width;
 }
 
 /**
@@ -68,16 +206,26 @@ lf_multiport_iterator_t _lf_multiport_iterator_impl(lf_port_base_t** port, int w
 			.width = width
 	};
 	if (width <= 0) return result;
+	if (port[0]->sparse_record) {
+		_lf_use_sparse_bitmap(port[0]->sparse_record, port, width);
+		if (port[0]->sparse_record->bitmap_width > 0) {
+			// Present channels are found in order, so no sorting is needed.
+			result.next = _lf_next_set_channel(port[0]->sparse_record, 0);
+			return result;
+		}
+	}
 	if (port[0]->sparse_record && port[0]->sparse_record->size >= 0) {
 		// Sparse record is enabled and ready to use.
 		if (port[0]->sparse_record->size > 0) {
 			// Need to sort it first (if the length is greater than 1).
 			if (port[0]->sparse_record->size > 1) {
-				qsort(
+				// Start with the highest bit that a channel below width can have.
+				size_t bit = 1;
+				while (bit <= (size_t)(width - 1) / 2) bit <<= 1;
+				_lf_sort_channels(
 						&port[0]->sparse_record->present_channels[0],
-						(size_t)port[0]->sparse_record->size,
-						sizeof(size_t),
-						&compare_sizes
+						port[0]->sparse_record->size,
+						bit
 				);
 			}
 			// NOTE: Following cast is unsafe if there more than 2^31 channels.
@@ -85,6 +233,11 @@ lf_multiport_iterator_t _lf_multiport_iterator_impl(lf_port_base_t** port, int w
 		}
 		return result;
 	}
+	int scanned = _lf_scan_port_presence(port, width, 0);
+	if (scanned != -2) {
+		result.next = scanned;
+		return result;
+	}
 	// Fallback is to iterate over all port structs representing channels.
 	int start = 0;
 	while(start < width) {
@@ -114,6 +267,10 @@ int lf_multiport_next(lf_multiport_iterator_t* iterator) {
 	}
 	struct lf_sparse_io_record_t* sparse_record
 			= iterator->port[iterator->idx]->sparse_record;
+	if (sparse_record && sparse_record->bitmap_width > 0) {
+		iterator->next = _lf_next_set_channel(sparse_record, iterator->next + 1);
+		return iterator->next;
+	}
 	if (sparse_record && sparse_record->size >= 0) {
 		// Sparse record is enabled and ready to use.
 		iterator->idx++;
@@ -126,6 +283,11 @@ int lf_multiport_next(lf_multiport_iterator_t* iterator) {
 		}
 		return iterator->next;
 	} else {
+		int scanned = _lf_scan_port_presence(iterator->port, iterator->width, iterator->next + 1);
+		if (scanned != -2) {
+			iterator->next = scanned;
+			return iterator->next;
+		}
 		// Fall back to iterate over all port structs representing channels.
 		int start = iterator->next + 1;
 		while(start < iterator->width) {
@@ -0,0 +1,347 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file reaction_stats.c
+ * @brief Execution time statistics of reactions collected without tracing.
+ *
+ * See reaction_stats.h for an overview. Bucket i < SUB holds the time i, and
+ * bucket e * SUB + m, for e >= 0 and SUB <= m < 2 * SUB, holds the times whose
+ * highest bits are m when shifted right by e.
+ */
+
+#include "reaction_stats.h"
+
+#ifdef LF_REACTION_STATS
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "environment.h"
+#include "platform.h"
+#include "util.h"
+
+#if defined(LF_REACTION_COUNTERS) && defined(PLATFORM_Linux)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define SUB LF_REACTION_STATS_SUB_BUCKETS
+
+/** Return the index of the highest set bit of the given positive value. */
+static inline int highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+/** Return the index of the bucket that counts the given execution time. */
+static size_t bucket_of(interval_t time) {
+    if (time < SUB) return (time < 0) ? 0 : (size_t)time;
+    int shift = highest_bit((uint64_t)time) - highest_bit(SUB);
+    size_t bucket = (size_t)shift * SUB + (size_t)(time >> shift);
+    return (bucket < LF_REACTION_STATS_BUCKETS) ? bucket : LF_REACTION_STATS_BUCKETS - 1;
+}
+
+/** Return the largest execution time counted in the given bucket. */
+static interval_t bucket_limit(size_t bucket) {
+    if (bucket < SUB) return (interval_t)bucket;
+    size_t shift = bucket / SUB - 1;
+    return (((interval_t)(bucket % SUB + SUB) + 1) << shift) - 1;
+}
+
+/**
+ * @brief Return the statistics of the given reaction, allocating them if
+ * this is its first execution.
+ */
+static lf_reaction_stats_t* get_reaction_stats(environment_t* env, reaction_t* reaction) {
+    lf_reaction_stats_t* stats = reaction->stats;
+    if (stats != NULL) return stats;
+    lf_critical_section_enter(env);
+    stats = reaction->stats;
+    if (stats == NULL) {
+#if defined(LF_SINGLE_THREADED)
+        int num_workers = 1;
+#else
+        int num_workers = env->num_workers;
+#endif
+        stats = (lf_reaction_stats_t*)calloc(1,
+                sizeof(lf_reaction_stats_t) + num_workers * sizeof(lf_exec_time_histogram_t));
+        lf_assert(stats, "Out of memory");
+        stats->reaction = reaction;
+        stats->num_workers = num_workers;
+        stats->next = env->reaction_stats;
+        env->reaction_stats = stats;
+#if !defined(LF_SINGLE_THREADED)
+        // Other workers may read the pointer without the lock.
+        lf_memory_barrier();
+#endif
+        reaction->stats = stats;
+    }
+    lf_critical_section_exit(env);
+    return stats;
+}
+
+void _lf_record_reaction_time(environment_t* env, reaction_t* reaction, int worker, interval_t execution_time) {
+    lf_reaction_stats_t* stats = get_reaction_stats(env, reaction);
+    if (worker < 0 || worker >= stats->num_workers) worker = 0;
+    lf_exec_time_histogram_t* histogram = &stats->histograms[worker];
+    histogram->counts[bucket_of(execution_time)]++;
+    if (histogram->count == 0 || execution_time < histogram->min) histogram->min = execution_time;
+    if (execution_time > histogram->max) histogram->max = execution_time;
+    histogram->total += execution_time;
+    histogram->count++;
+}
+
+#ifdef LF_REACTION_COUNTERS
+
+#if defined(PLATFORM_Linux)
+/** The hardware events counted, in the order of lf_reaction_counters_t. */
+static const uint64_t counter_events[LF_REACTION_NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/** The layout of a read of the group of counters. */
+typedef struct {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[LF_REACTION_NUM_COUNTERS];
+} counter_group_t;
+
+/** The group leader of the counters of the calling thread, -1 if not opened yet, or -2 if not available. */
+static LF_THREAD_LOCAL int counter_fd = -1;
+
+/** Whether the warning that the counters are not available has been printed. */
+static bool counters_warned = false;
+
+/**
+ * @brief Open the group of counters of the calling thread.
+ * @return The file descriptor of the group leader, or -2 if the counters are not available.
+ */
+static int open_counters() {
+    int leader = -1;
+    for (int i = 0; i < LF_REACTION_NUM_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = counter_events[i];
+        attr.disabled = (leader < 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0) {
+            // Closing the leader closes the group.
+            if (leader >= 0) close(leader);
+            if (!counters_warned) {
+                counters_warned = true;
+                lf_print_warning("Hardware performance counters are not available. "
+                        "Reaction counters will be zero.");
+            }
+            return -2;
+        }
+        if (leader < 0) leader = fd;
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return leader;
+}
+#endif // PLATFORM_Linux
+
+void _lf_read_reaction_counters(lf_counter_sample_t* sample) {
+#if defined(PLATFORM_Linux)
+    if (counter_fd == -1) counter_fd = open_counters();
+    counter_group_t group;
+    if (counter_fd >= 0 && read(counter_fd, &group, sizeof(group)) == sizeof(group)) {
+        sample->time_enabled = group.time_enabled;
+        sample->time_running = group.time_running;
+        memcpy(sample->values, group.values, sizeof(group.values));
+        return;
+    }
+#endif
+    memset(sample, 0, sizeof(lf_counter_sample_t));
+}
+
+void _lf_record_reaction_counters(environment_t* env, reaction_t* reaction, int worker,
+        const lf_counter_sample_t* start) {
+#if defined(PLATFORM_Linux)
+    if (counter_fd < 0) return;
+    lf_counter_sample_t end;
+    _lf_read_reaction_counters(&end);
+    lf_reaction_stats_t* stats = get_reaction_stats(env, reaction);
+    if (worker < 0 || worker >= stats->num_workers) worker = 0;
+    lf_exec_time_histogram_t* histogram = &stats->histograms[worker];
+    // If the kernel multiplexed the counters, they ran only part of the time,
+    // so scale the differences up to the whole time.
+    uint64_t enabled = end.time_enabled - start->time_enabled;
+    uint64_t running = end.time_running - start->time_running;
+    for (int i = 0; i < LF_REACTION_NUM_COUNTERS; i++) {
+        uint64_t difference = end.values[i] - start->values[i];
+        if (running > 0 && running < enabled) {
+            difference = (uint64_t)((double)difference * (double)enabled / (double)running);
+        }
+        histogram->counters[i] += difference;
+    }
+    histogram->counted++;
+#endif
+}
+
+void lf_get_reaction_counters(reaction_t* reaction, int worker, lf_reaction_counters_t* counters) {
+    memset(counters, 0, sizeof(lf_reaction_counters_t));
+    lf_reaction_stats_t* stats = reaction->stats;
+    if (stats == NULL) return;
+    for (int i = 0; i < stats->num_workers; i++) {
+        if (worker >= 0 && i != worker) continue;
+        lf_exec_time_histogram_t* histogram = &stats->histograms[i];
+        counters->count += histogram->counted;
+        counters->cycles += histogram->counters[0];
+        counters->instructions += histogram->counters[1];
+        counters->cache_misses += histogram->counters[2];
+        counters->branch_misses += histogram->counters[3];
+    }
+}
+
+#endif // LF_REACTION_COUNTERS
+
+/**
+ * @brief Merge the histograms of the given workers of the given reaction.
+ * @param worker The worker, or -1 for all of them.
+ * @param merged The place to store the merged histogram.
+ */
+static void merge_histograms(reaction_t* reaction, int worker, lf_exec_time_histogram_t* merged) {
+    memset(merged, 0, sizeof(lf_exec_time_histogram_t));
+    lf_reaction_stats_t* stats = reaction->stats;
+    if (stats == NULL) return;
+    for (int i = 0; i < stats->num_workers; i++) {
+        if (worker >= 0 && i != worker) continue;
+        lf_exec_time_histogram_t* histogram = &stats->histograms[i];
+        if (histogram->count == 0) continue;
+        for (size_t j = 0; j < LF_REACTION_STATS_BUCKETS; j++) {
+            merged->counts[j] += histogram->counts[j];
+        }
+        if (merged->count == 0 || histogram->min < merged->min) merged->min = histogram->min;
+        if (histogram->max > merged->max) merged->max = histogram->max;
+        merged->total += histogram->total;
+        merged->count += histogram->count;
+    }
+}
+
+/**
+ * @brief Return the execution time in the given histogram that the given
+ * fraction of its executions do not exceed.
+ */
+static interval_t histogram_percentile(lf_exec_time_histogram_t* histogram, double percentile) {
+    if (histogram->count == 0) return 0;
+    size_t rank = (size_t)(percentile * (double)histogram->count + 0.5);
+    if (rank < 1) rank = 1;
+    size_t seen = 0;
+    for (size_t i = 0; i < LF_REACTION_STATS_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            // Report the end of the bucket, but never more than the longest time.
+            interval_t limit = bucket_limit(i);
+            return (limit < histogram->max) ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void lf_get_reaction_stats(reaction_t* reaction, int worker, lf_exec_time_stats_t* stats) {
+    lf_exec_time_histogram_t merged;
+    merge_histograms(reaction, worker, &merged);
+    stats->count = merged.count;
+    stats->min = merged.min;
+    stats->max = merged.max;
+    stats->mean = (merged.count > 0) ? merged.total / (interval_t)merged.count : 0;
+    stats->p50 = histogram_percentile(&merged, 0.5);
+    stats->p99 = histogram_percentile(&merged, 0.99);
+}
+
+interval_t lf_reaction_exec_time_percentile(reaction_t* reaction, double percentile) {
+    lf_exec_time_histogram_t merged;
+    merge_histograms(reaction, -1, &merged);
+    return histogram_percentile(&merged, percentile);
+}
+
+interval_t lf_reaction_exec_time_min(reaction_t* reaction) {
+    lf_reaction_stats_t* stats = reaction->stats;
+    if (stats == NULL) return 0;
+    interval_t min = 0;
+    for (int i = 0; i < stats->num_workers; i++) {
+        lf_exec_time_histogram_t* histogram = &stats->histograms[i];
+        if (histogram->count > 0 && (min == 0 || histogram->min < min)) min = histogram->min;
+    }
+    return min;
+}
+
+void lf_print_reaction_stats(environment_t* env) {
+    if (env->reaction_stats == NULL) return;
+    lf_print("---- Reaction execution times in nanoseconds (count, min, p50, p99, max):");
+    for (lf_reaction_stats_t* stats = env->reaction_stats; stats != NULL; stats = stats->next) {
+        lf_exec_time_stats_t summary;
+        lf_get_reaction_stats(stats->reaction, -1, &summary);
+        if (stats->reaction->name != NULL) {
+            lf_print("---- %s: %zu, %lld, %lld, %lld, %lld", stats->reaction->name, summary.count,
+                    (long long)summary.min, (long long)summary.p50, (long long)summary.p99,
+                    (long long)summary.max);
+        } else {
+            lf_print("---- Reaction %d of %p: %zu, %lld, %lld, %lld, %lld", stats->reaction->number,
+                    stats->reaction->self, summary.count, (long long)summary.min, (long long)summary.p50,
+                    (long long)summary.p99, (long long)summary.max);
+        }
+#ifdef LF_REACTION_COUNTERS
+        lf_reaction_counters_t counters;
+        lf_get_reaction_counters(stats->reaction, -1, &counters);
+        if (counters.count > 0) {
+            lf_print("----     per execution: %.0f cycles, %.0f instructions (IPC %.2f), "
+                    "%.1f cache misses, %.1f branch misses",
+                    (double)counters.cycles / counters.count, (double)counters.instructions / counters.count,
+                    counters.cycles > 0 ? (double)counters.instructions / counters.cycles : 0.0,
+                    (double)counters.cache_misses / counters.count, (double)counters.branch_misses / counters.count);
+        }
+#endif
+    }
+}
+
+void _lf_free_reaction_stats(environment_t* env) {
+    while (env->reaction_stats != NULL) {
+        lf_reaction_stats_t* stats = env->reaction_stats;
+        env->reaction_stats = stats->next;
+        stats->reaction->stats = NULL;
+        free(stats);
+    }
+}
+
+#endif // LF_REACTION_STATS
@@ -35,6 +35,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * @author{Erling Jellum <erlingrj@berkeley.edu>}
  */
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "reactor.h"
@@ -42,24 +43,38 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "platform.h"
 #include "reactor_common.h"
 #include "environment.h"
+#include "checkpoint.h"
+#include "replay.h"
+#include "probes.h"
 
 // Embedded platforms with no TTY shouldnt have signals
 #if !defined(NO_TTY)
 #include <signal.h> // To trap ctrl-c and invoke termination().
 #endif
 
+#if defined(LF_EVENT_LOOP)
+#if !defined(PLATFORM_Linux)
+#error "LF_EVENT_LOOP is only supported on Linux."
+#endif
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "lf_unix_clock_support.h"
+#endif
+
 // Global variable defined in tag.c:
 extern instant_t start_time;
 
 /**
  * Mark the given port's is_present field as true. This is_present field
- * will later be cleaned up by _lf_start_time_step. If the port is unconnected,
- * do nothing.
+ * will later be cleaned up by _lf_start_time_step. If the port is unconnected
+ * or already present, do nothing.
  * @param env Environment in which we are executing
  * @param port A pointer to the port struct.
  */
 void _lf_set_present(lf_port_base_t* port) {
-  if (!port->source_reactor) return;
+  if (!port->source_reactor || port->is_present) return;
   environment_t *env = port->source_reactor->environment;
 	bool* is_present_field = &port->is_present;
     if (env->is_present_fields_abbreviated_size < env->is_present_fields_size) {
@@ -68,9 +83,17 @@ void _lf_set_present(lf_port_base_t* port) {
     }
     env->is_present_fields_abbreviated_size++;
     *is_present_field = true;
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    if (port->presence) *port->presence = true;
+#endif
 
     // Support for sparse destination multiports.
     if(port->sparse_record
+    		&& port->destination_channel >= 0
+    		&& port->sparse_record->bitmap_width > 0) {
+    	((uint32_t*)port->sparse_record->present_channels)[port->destination_channel / 32]
+    			|= 1u << (port->destination_channel % 32);
+    } else if(port->sparse_record
     		&& port->destination_channel >= 0
 			&& port->sparse_record->size >= 0) {
     	size_t next = port->sparse_record->size++;
@@ -84,17 +107,149 @@ void _lf_set_present(lf_port_base_t* port) {
     }
 }
 
+void _lf_set_present_range(lf_port_base_t** ports, int start, int count) {
+    // Without other threads, there is nothing to batch.
+    for (int i = start; i < start + count; i++) {
+        _lf_set_present(ports[i]);
+    }
+}
+
+#if defined(LF_EVENT_LOOP)
+/** Maximum number of ready file descriptors handled per wait. */
+#ifndef LF_EVENT_LOOP_MAX_EVENTS
+#define LF_EVENT_LOOP_MAX_EVENTS 16
+#endif
+
+/** The epoll set on which the main loop waits, or -1 if it has not been created. */
+static int _lf_event_loop_epoll = -1;
+
+/**
+ * A timer in the epoll set, which is set to expire at the time of the next event,
+ * and whose epoll data is NULL, while that of the registered file descriptors is
+ * their physical action.
+ */
+static int _lf_event_loop_timer = -1;
+
+/**
+ * Create the epoll set and its timer if they do not exist yet.
+ * @return 0 on success, or -1 with errno set on failure.
+ */
+static int _lf_event_loop_initialize() {
+    if (_lf_event_loop_epoll >= 0) return 0;
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) return -1;
+    int timer = timerfd_create(_LF_CLOCK, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (timer < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &event) != 0) {
+        int error = errno;
+        if (timer >= 0) close(timer);
+        close(epoll);
+        errno = error;
+        return -1;
+    }
+    _lf_event_loop_epoll = epoll;
+    _lf_event_loop_timer = timer;
+    return 0;
+}
+
+int lf_event_loop_add_fd(int fd, uint32_t events, void* action) {
+    if (action == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (_lf_event_loop_initialize() != 0) return -1;
+    struct epoll_event event = {.events = events, .data.ptr = action};
+    return epoll_ctl(_lf_event_loop_epoll, EPOLL_CTL_ADD, fd, &event);
+}
+
+int lf_event_loop_remove_fd(int fd) {
+    if (_lf_event_loop_epoll < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    return epoll_ctl(_lf_event_loop_epoll, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * Wait on the epoll set until the given time, which may be FOREVER, and schedule
+ * the physical actions of the file descriptors that become ready meanwhile.
+ * If the time has passed, the file descriptors are polled without waiting.
+ * @param env Environment in which we are executing
+ * @return 0 if the wait was completed, -1 if it was interrupted by a ready file descriptor.
+ */
+static int _lf_event_loop_wait_until(environment_t* env, instant_t wakeup_time) {
+    if (_lf_event_loop_initialize() != 0) {
+        return _lf_interruptable_sleep_until_locked(env, wakeup_time);
+    }
+    // A disarmed timer, unless there is a wakeup time, in which case the timer expires
+    // at that time of _LF_CLOCK, which is what the timer measures.
+    struct itimerspec timer = {{0, 0}, {0, 0}};
+    int timeout = -1;
+    if (wakeup_time != FOREVER) {
+        interval_t sleep_duration = wakeup_time - lf_time_physical();
+        if (sleep_duration <= 0) {
+            timeout = 0;
+        } else {
+            struct timespec now;
+            clock_gettime(_LF_CLOCK, &now);
+            timer.it_value = convert_ns_to_timespec(convert_timespec_to_ns(now) + sleep_duration);
+        }
+    }
+    timerfd_settime(_lf_event_loop_timer, TFD_TIMER_ABSTIME, &timer, NULL);
+    struct epoll_event events[LF_EVENT_LOOP_MAX_EVENTS];
+    int ready;
+    do {
+        ready = epoll_wait(_lf_event_loop_epoll, events, LF_EVENT_LOOP_MAX_EVENTS, timeout);
+    } while (ready < 0 && errno == EINTR);
+    int result = 0;
+    for (int i = 0; i < ready; i++) {
+        if (events[i].data.ptr == NULL) {
+            uint64_t expirations;
+            if (read(_lf_event_loop_timer, &expirations, sizeof(expirations)) < 0) {
+                LF_PRINT_DEBUG("Event loop: Timer read nothing.");
+            }
+        } else {
+            _lf_schedule_token((lf_action_base_t*)events[i].data.ptr, 0, NULL);
+            result = -1;
+        }
+    }
+    return result;
+}
+
+#define _lf_wait_until_locked _lf_event_loop_wait_until
+#else
+#define _lf_wait_until_locked _lf_interruptable_sleep_until_locked
+#endif // LF_EVENT_LOOP
+
 /**
  * Wait until physical time matches the given logical time or the time of a 
  * concurrently scheduled physical action, which might be earlier than the 
- * requested logical time.
+ * requested logical time. With LF_EVENT_LOOP, the physical actions of file
+ * descriptors that become ready are scheduled while waiting.
  * @param env Environment in which we are executing
  * @return 0 if the wait was completed, -1 if it was skipped or interrupted.
  */ 
 int wait_until(environment_t* env, instant_t wakeup_time) {
+#if defined(LF_EVENT_LOOP)
+    // File descriptors are polled even in fast mode, which does not wait for time.
+    if (fast && _lf_event_loop_epoll >= 0) {
+        return _lf_event_loop_wait_until(env, wakeup_time == FOREVER ? FOREVER : NEVER);
+    }
+#endif
     if (!fast) {
         LF_PRINT_LOG("Waiting for elapsed logical time " PRINTF_TIME ".", wakeup_time - start_time);
-        return _lf_interruptable_sleep_until_locked(env, wakeup_time);
+        if (_lf_busy_wait_guard <= 0) {
+            return _lf_wait_until_locked(env, wakeup_time);
+        }
+        // Sleep until the guard interval before the wakeup time and spin for
+        // the rest, which avoids the jitter of the wakeup from the sleep.
+        int result = _lf_wait_until_locked(env, wakeup_time - _lf_busy_wait_guard);
+        if (result == 0) {
+            while (lf_time_physical() < wakeup_time) {
+                lf_spin_pause();
+            }
+        }
+        return result;
     }
     return 0;
 }
@@ -128,7 +283,7 @@ void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_n
     }
 #endif
     // Do not enqueue this reaction twice.
-    if (reaction->status == inactive) {
+    if (reaction->status == inactive && !_lf_is_pruned_for_deadline(env, reaction)) {
         LF_PRINT_DEBUG("Enqueueing downstream reaction %s, which has level %lld.",
         		reaction->name, reaction->index & 0xffffLL);
         reaction->status = queued;
@@ -138,6 +293,36 @@ void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_n
     }
 }
 
+/**
+ * Trigger the specified reactions, as _lf_trigger_reaction() does for each of them.
+ *
+ * @param env Environment in which we are executing
+ * @param reactions The reactions, sorted by level.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call (see _lf_trigger_reaction()).
+ */
+void _lf_trigger_reactions(environment_t* env, reaction_t** reactions, size_t count, int worker_number) {
+    for (size_t i = 0; i < count; i++) {
+        _lf_trigger_reaction(env, reactions[i], worker_number);
+    }
+}
+
+/**
+ * Execute the iterations of a loop split with lf_parallel_for(). There are no
+ * other workers to help, so this executes all of them at once.
+ *
+ * @param env Environment in which we are executing
+ * @param count The number of iterations.
+ * @param grain The number of iterations per chunk, which is ignored.
+ * @param body The function that executes a range of iterations.
+ * @param arg The argument to pass to the body.
+ */
+void _lf_parallel_for(environment_t* env, size_t count, size_t grain, lf_parallel_body_t body, void* arg) {
+    if (count > 0) {
+        body(arg, 0, count);
+    }
+}
+
 /**
  * Execute all the reactions in the reaction queue at the current tag.
  * 
@@ -177,9 +362,10 @@ int _lf_do_step(environment_t* env) {
             // container deadlines are defined in the container.
             // They can have different deadlines, so we have to check both.
             // Handle the local deadline first.
-            if (reaction->deadline == 0 || physical_time > env->current_tag.time + reaction->deadline) {
+            if (_lf_is_deadline_violated(env, reaction, physical_time)) {
                 LF_PRINT_LOG("Deadline violation. Invoking deadline handler.");
                 tracepoint_reaction_deadline_missed(env->trace, reaction, 0);
+                LF_PROBE2(deadline_missed, reaction->name, 0);
                 // Deadline violation has occurred.
                 violation = true;
                 // Invoke the local handler, if there is one.
@@ -241,7 +427,9 @@ int next(environment_t* env) {
     if (lf_critical_section_enter(env) != 0) {
         lf_print_error_and_exit("Could not enter critical section");
     }
-    event_t* event = (event_t*)pqueue_peek(env->event_q);
+    // The previous tag is complete, so this is where a checkpoint can be taken.
+    _lf_checkpoint_at_tag_end(env);
+    event_t* event = _lf_peek_event(env);
     //pqueue_dump(event_q, event_q->prt);
     // If there is no next event and -keepalive has been specified
     // on the command line, then we will wait the maximum time possible.
@@ -283,6 +471,10 @@ int next(environment_t* env) {
         }
         return 1;
     }
+    if (!fast) {
+        tracepoint_scheduler_wakeup(env->trace, lf_time_physical() - next_tag.time);
+        LF_PROBE1(wakeup, lf_time_physical() - next_tag.time);
+    }
     // Advance current time to match that of the first event on the queue.
     // We can now leave the critical section. Any events that will be added
     // to the queue asynchronously will have a later tag than the current one.
@@ -361,7 +553,9 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         signal(SIGINT, exit);
 #endif
         // Create and initialize the environment
+        instant_t startup_began = lf_time_physical();
         _lf_create_environments();   // code-generated function
+        instant_t environments_created = lf_time_physical();
         environment_t *env;
         int num_environments = _lf_get_environments(&env);
         lf_assert(num_environments == 1,
@@ -371,6 +565,7 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         initialize_global();
         // Set start time
         start_time = lf_time_physical();
+        instant_t trigger_objects_initialized = start_time;
         environment_init_tags(env, start_time, duration);
         // Start tracing if enalbed
         start_trace(env->trace);
@@ -379,14 +574,20 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         _lf_initialize_modes(env);
 #endif
         _lf_execution_started = true;
-        _lf_trigger_startup_reactions(env);
-        _lf_initialize_timers(env);
+        _lf_replay_start(env);
+        if (!_lf_checkpoint_resume(env)) {
+            _lf_trigger_startup_reactions(env);
+            _lf_initialize_timers(env);
+        }
         // If the stop_tag is (0,0), also insert the shutdown
         // reactions. This can only happen if the timeout time
         // was set to 0.
         if (lf_tag_compare(env->current_tag, env->stop_tag) >= 0) {
             _lf_trigger_shutdown_reactions(env);
         }
+        _lf_print_startup_times(environments_created - startup_began,
+                trigger_objects_initialized - environments_created,
+                lf_time_physical() - trigger_objects_initialized);
         LF_PRINT_DEBUG("Running the program's main loop.");
         // Handle reactions triggered at time (T,m).
         if (_lf_do_step(env)) {
@@ -37,6 +37,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *  @author{Erling Rennemo Jellum <erling.r.jellum0@ntnu.no>}
  */
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -53,12 +55,17 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pqueue.h"
 #include "reactor.h"
 #include "reactor_common.h"
+#if !defined(LF_SINGLE_THREADED)
+#include "scheduler.h"
+#include "reactor_threaded.h"
+#endif
 #include "tag.h"
 #include "trace.h"
+#include "probes.h"
+#include "reaction_stats.h"
+#include "replay.h"
 #include "util.h"
 #include "vector.h"
-#include "hashset/hashset.h"
-#include "hashset/hashset_itr.h"
 #include "environment.h"
 
 #if !defined(LF_SINGLE_THREADED)
@@ -92,6 +99,176 @@ bool fast = false;
  */
 unsigned int _lf_number_of_workers = 0u;
 
+#ifndef LF_SPIN_BUDGET
+#define LF_SPIN_BUDGET 0
+#endif
+
+/**
+ * The maximum number of iterations that an idle worker spins waiting for work
+ * before it parks on the scheduler semaphore. A value of 0 disables spinning.
+ * This can be set with the LF_SPIN_BUDGET compile definition or the --spin
+ * command-line option and only affects threaded execution.
+ */
+unsigned int _lf_spin_budget = LF_SPIN_BUDGET;
+
+#ifndef LF_EVENT_POOL_SIZE
+#define LF_EVENT_POOL_SIZE 0
+#endif
+
+/** The smallest number of events in a slab. */
+#define LF_EVENT_SLAB_SIZE 64
+
+/**
+ * The number of events to allocate in one contiguous slab when an environment
+ * gets its first event. Later slabs double the number of events of the
+ * environment. This can be set with the LF_EVENT_POOL_SIZE compile definition
+ * or the --events command-line option.
+ */
+size_t _lf_event_pool_size = LF_EVENT_POOL_SIZE;
+
+#ifndef LF_BUSY_WAIT_GUARD
+#define LF_BUSY_WAIT_GUARD 0
+#endif
+
+/**
+ * If positive, the interval in nanoseconds before the physical time of a tag
+ * at which waiting for physical time stops sleeping and spins on the clock
+ * instead. This bounds the jitter of tag releases by the resolution of the
+ * clock at the cost of a busy core. This can be set with the
+ * LF_BUSY_WAIT_GUARD compile definition or the --busy-wait command-line option.
+ */
+interval_t _lf_busy_wait_guard = LF_BUSY_WAIT_GUARD;
+
+/**
+ * Whether worker i should be pinned to core i modulo the number of cores.
+ * This can be set with the --pin command-line option.
+ */
+bool _lf_pin_workers = false;
+
+/**
+ * If not 0, the number of NUMA nodes to distribute the workers over. Worker i
+ * is restricted to the cores of node i modulo this number. This can be set
+ * with the --numa command-line option and is ignored if workers are pinned.
+ */
+unsigned int _lf_numa_nodes = 0u;
+
+/**
+ * If not NULL, the file that the adaptive scheduler loads the worker counts it
+ * learned in a previous run from and saves them to at shutdown. This can be
+ * set with the --sched-state command-line option.
+ */
+const char* _lf_sched_state_file = NULL;
+
+/**
+ * If not NULL, the name of the scheduler to use, such as NP or GEDF_NP, which
+ * requires a runtime built with LF_SCHED_DYNAMIC unless it is the one chosen
+ * with SCHEDULER. This can be set with the --scheduler command-line option.
+ */
+const char* _lf_scheduler_name = NULL;
+
+/**
+ * If not NULL, the file holding the memory profile. If the file exists, the
+ * events and tokens that it records are preallocated at startup and needing
+ * more is a fatal error. Otherwise, the peak usage of this run is written to
+ * it at shutdown. This can be set with the --memory-profile command-line option.
+ */
+const char* _lf_memory_profile_file = NULL;
+
+/**
+ * If not NULL, the file holding the checkpoint that the program resumes from
+ * if it exists (see checkpoint.h). This can be set with the --resume
+ * command-line option.
+ */
+const char* _lf_resume_file = NULL;
+
+/**
+ * If not NULL, the file to which the schedules of physical actions and the
+ * messages that arrive are recorded (see replay.h). This can be set with the
+ * --record command-line option.
+ */
+const char* _lf_record_file = NULL;
+
+/**
+ * If not NULL, the file whose recorded schedules of physical actions are
+ * replayed (see replay.h). This can be set with the --replay command-line option.
+ */
+const char* _lf_replay_file = NULL;
+
+/**
+ * The factor by which replayed inputs are faster than recorded.
+ * This can be set with the --replay-speed command-line option.
+ */
+double _lf_replay_speed = 1.0;
+
+/**
+ * If not NULL, the destination to which traces are written instead of the
+ * trace file, as described in trace_sink.h. This can be set with the --trace-to
+ * command-line option.
+ */
+const char* _lf_trace_destination = NULL;
+
+/**
+ * If not NULL, the comma-separated categories of trace events to record.
+ * This can be set with the --trace-events command-line option.
+ */
+const char* _lf_trace_events = NULL;
+
+/**
+ * If not NULL, the comma-separated names of the reactors whose reaction and
+ * schedule events are recorded. This can be set with the --trace-reactors
+ * command-line option.
+ */
+const char* _lf_trace_reactors = NULL;
+
+/**
+ * Whether the worker threads should run under a real-time (fixed-priority)
+ * scheduling policy. With the GEDF_NP scheduler, the priority of a worker then
+ * follows the deadline of the reaction it executes. This can be set with the
+ * --realtime command-line option.
+ */
+bool _lf_realtime_workers = false;
+
+/**
+ * How estimates of execution times are used to detect deadline misses early,
+ * one of LF_DEADLINE_ADMISSION_OFF, LF_DEADLINE_ADMISSION_EARLY, or
+ * LF_DEADLINE_ADMISSION_PRUNE. This can be set with the --deadline-admission
+ * command-line option.
+ */
+int _lf_deadline_admission = LF_DEADLINE_ADMISSION_OFF;
+
+/**
+ * What the GEDF_NP scheduler does with reactions less critical than its current
+ * criticality mode, which it raises when a more critical reaction is at risk of
+ * missing its deadline: LF_CRITICALITY_DEFER or LF_CRITICALITY_SHED. This can be
+ * set with the --criticality-policy command-line option.
+ */
+int _lf_criticality_policy = LF_CRITICALITY_DEFER;
+
+/**
+ * The number of workers, starting from worker 0, that the GEDF_NP scheduler
+ * reserves for reactions with a criticality above 0. Such a worker takes any
+ * such reaction ready at the current level before one of criticality 0, even
+ * one with an earlier deadline, but does not idle while only the latter are
+ * ready. This can be set with the --critical-workers command-line option.
+ */
+unsigned int _lf_critical_workers = 0;
+
+/**
+ * The number of workers that the GEDF_NP scheduler adds to those requested for
+ * reactions with deadlines. These urgent workers run at a real-time priority
+ * above that of the others, so that with --realtime they preempt them, and
+ * leave reactions without deadlines to the others while any of these is busy.
+ * This can be set with the --urgent-workers command-line option.
+ */
+unsigned int _lf_urgent_workers = 0;
+
+/**
+ * If not negative, the real-time priority given to the threads that handle
+ * network communication in a federate. This can be set with the
+ * --net-priority command-line option.
+ */
+int _lf_network_thread_priority = -1;
+
 /**
  * The logical time to elapse during execution, or -1 if no timeout time has
  * been given. When the logical equal to start_time + duration has been
@@ -116,10 +293,216 @@ bool keepalive_specified = false;
  */
 interval_t _lf_fed_STA_offset = 0LL;
 
+#ifndef LF_ARENA_CHUNK_SIZE
+#define LF_ARENA_CHUNK_SIZE 0
+#endif
+
+/**
+ * A chunk of memory from which reactors and the memory recorded on allocation
+ * lists are allocated in arena mode, which is enabled by giving the compile
+ * definition LF_ARENA_CHUNK_SIZE a positive size in bytes. In that mode, the
+ * memory is freed all at once by _lf_free_all_reactors().
+ */
+typedef struct _lf_arena_chunk_t {
+    struct _lf_arena_chunk_t* next;
+    size_t size;  // Bytes available in data.
+    size_t used;  // Bytes allocated from data.
+    max_align_t data[];
+} _lf_arena_chunk_t;
+
+/**
+ * The chunks of the arena. The first one is the one that is being filled.
+ * Like reactor construction, allocation from the arena is only thread safe
+ * while _lf_initialize_in_parallel() is running.
+ */
+static _lf_arena_chunk_t* _lf_arena = NULL;
+
+/**
+ * Allocate zeroed memory from the arena.
+ */
+static void* _lf_arena_allocate(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) lf_print_error_and_exit("Out of memory!");
+    size_t bytes = count * size;
+    // Keep every allocation aligned like one from malloc().
+    bytes = (bytes + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    _lf_arena_chunk_t* chunk = _lf_arena;
+    if (chunk == NULL || chunk->size - chunk->used < bytes) {
+        // Large allocations get a chunk of their own, which is put behind the one
+        // being filled so that the remainder of that is not wasted.
+        bool dedicated = bytes > LF_ARENA_CHUNK_SIZE / 4;
+        size_t chunk_size = dedicated ? bytes : LF_ARENA_CHUNK_SIZE;
+        chunk = (_lf_arena_chunk_t*)calloc(1, sizeof(_lf_arena_chunk_t) + chunk_size);
+        if (chunk == NULL) lf_print_error_and_exit("Out of memory!");
+        chunk->size = chunk_size;
+        if (dedicated && _lf_arena != NULL) {
+            chunk->next = _lf_arena->next;
+            _lf_arena->next = chunk;
+        } else {
+            chunk->next = _lf_arena;
+            _lf_arena = chunk;
+        }
+    }
+    void* mem = (char*)chunk->data + chunk->used;
+    chunk->used += bytes;
+    return mem;
+}
+
+/**
+ * Return whether the given memory was allocated from the arena.
+ */
+static bool _lf_arena_contains(void* mem) {
+    for (_lf_arena_chunk_t* chunk = _lf_arena; chunk != NULL; chunk = chunk->next) {
+        if ((char*)mem >= (char*)chunk->data && (char*)mem < (char*)chunk->data + chunk->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The number of bytes allocated outside the arena for reactors and the
+ * memory recorded on allocation lists, including the allocation records.
+ */
+static size_t _lf_reactor_bytes = 0;
+
+/**
+ * Whether several threads may be creating reactors at the same time, in
+ * which case the arena and the allocation lists are updated in a critical
+ * section (@see _lf_initialize_in_parallel()).
+ */
+static volatile bool _lf_initializing_in_parallel = false;
+
+/** Enter the critical section that protects allocation if several threads may allocate. */
+static void _lf_allocation_lock(void) {
+    if (_lf_initializing_in_parallel && lf_critical_section_enter(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+}
+
+/** Leave the critical section entered by _lf_allocation_lock(). */
+static void _lf_allocation_unlock(void) {
+    if (_lf_initializing_in_parallel && lf_critical_section_exit(GLOBAL_ENVIRONMENT) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+}
+
+size_t lf_arena_footprint(size_t* used) {
+    size_t reserved = 0;
+    if (used != NULL) *used = 0;
+    for (_lf_arena_chunk_t* chunk = _lf_arena; chunk != NULL; chunk = chunk->next) {
+        reserved += sizeof(_lf_arena_chunk_t) + chunk->size;
+        if (used != NULL) *used += chunk->used;
+    }
+    return reserved;
+}
+
+#ifndef LF_SCRATCH_CHUNK_SIZE
+#define LF_SCRATCH_CHUNK_SIZE (64 * 1024)
+#endif
+
+/**
+ * A chunk of memory from which lf_scratch_alloc() allocates. Each worker of an
+ * environment fills a list of chunks of its own, and other threads share the
+ * last list of the environment. The lists are reset when the next time step
+ * starts, at which point no reaction of the environment is executing.
+ */
+typedef struct lf_scratch_chunk_t {
+    struct lf_scratch_chunk_t* next;
+    size_t size;  // Bytes available in data.
+    size_t used;  // Bytes allocated from data.
+    max_align_t data[];
+} lf_scratch_chunk_t;
+
+/** Allocate a chunk of at least 'size' bytes and put it at the head of 'list'. */
+static lf_scratch_chunk_t* _lf_scratch_new_chunk(environment_t* env, lf_scratch_chunk_t** list, size_t size) {
+    if (size < LF_SCRATCH_CHUNK_SIZE) size = LF_SCRATCH_CHUNK_SIZE;
+    lf_scratch_chunk_t* chunk = (lf_scratch_chunk_t*)malloc(sizeof(lf_scratch_chunk_t) + size);
+    if (chunk == NULL) lf_print_error_and_exit("Out of memory!");
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = *list;
+    *list = chunk;
+    env->scratch_bytes += sizeof(lf_scratch_chunk_t) + size;
+    return chunk;
+}
+
+/** Allocate 'bytes', a multiple of sizeof(max_align_t), from the chunks on 'list'. */
+static void* _lf_scratch_allocate(environment_t* env, lf_scratch_chunk_t** list, size_t bytes) {
+    lf_scratch_chunk_t* chunk = *list;
+    if (chunk == NULL || chunk->size - chunk->used < bytes) {
+        chunk = _lf_scratch_new_chunk(env, list, bytes);
+    }
+    void* mem = (char*)chunk->data + chunk->used;
+    chunk->used += bytes;
+    return mem;
+}
+
+void* _lf_scratch_alloc(environment_t* env, size_t size) {
+    if (size > SIZE_MAX - sizeof(max_align_t)) lf_print_error_and_exit("Out of memory!");
+    // Keep every allocation aligned like one from malloc().
+    size_t bytes = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    if (bytes == 0) bytes = sizeof(max_align_t);
+#if defined(LF_SINGLE_THREADED)
+    return _lf_scratch_allocate(env, &env->scratch_arenas[0], bytes);
+#else
+    int slot = _lf_worker_slot(env);
+    if (slot >= 0) {
+        return _lf_scratch_allocate(env, &env->scratch_arenas[slot], bytes);
+    }
+    if (lf_critical_section_enter(env) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+    void* mem = _lf_scratch_allocate(env, &env->scratch_arenas[env->num_token_copy_lists - 1], bytes);
+    if (lf_critical_section_exit(env) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+    return mem;
+#endif
+}
+
+void _lf_scratch_reset(environment_t* env) {
+    // The workers of the environment are not executing reactions, so its lists are quiescent.
+    for (int i = 0; i < env->num_token_copy_lists; i++) {
+        lf_scratch_chunk_t* chunk = env->scratch_arenas[i];
+        if (chunk == NULL) continue;
+        if (chunk->next == NULL) {
+            chunk->used = 0;
+            continue;
+        }
+        // The time step needed more than one chunk. Replace them by a single
+        // chunk that is large enough for all of it, so that steps like it do not
+        // allocate at all.
+        size_t used = 0;
+        while (chunk != NULL) {
+            lf_scratch_chunk_t* next = chunk->next;
+            used += chunk->used;
+            env->scratch_bytes -= sizeof(lf_scratch_chunk_t) + chunk->size;
+            free(chunk);
+            chunk = next;
+        }
+        env->scratch_arenas[i] = NULL;
+        _lf_scratch_new_chunk(env, &env->scratch_arenas[i], used);
+    }
+}
+
+void _lf_scratch_free(environment_t* env) {
+    if (env->scratch_arenas == NULL) return;
+    for (int i = 0; i < env->num_token_copy_lists; i++) {
+        while (env->scratch_arenas[i] != NULL) {
+            lf_scratch_chunk_t* chunk = env->scratch_arenas[i];
+            env->scratch_arenas[i] = chunk->next;
+            free(chunk);
+        }
+    }
+    env->scratch_bytes = 0;
+}
+
 /**
  * Allocate memory using calloc (so the allocated memory is zeroed out)
  * and record the allocated memory on the specified self struct so that
  * it will be freed when calling {@link free_reactor(self_base_t)}.
+ * In arena mode, recorded memory comes from the arena instead and is only
+ * freed by _lf_free_all_reactors().
  * @param count The number of items of size 'size' to accomodate.
  * @param size The size of each item.
  * @param head Pointer to the head of a list on which to record
@@ -128,6 +511,12 @@ interval_t _lf_fed_STA_offset = 0LL;
  */
 void* _lf_allocate(
         size_t count, size_t size, struct allocation_record_t** head) {
+    if (LF_ARENA_CHUNK_SIZE > 0 && head != NULL) {
+        _lf_allocation_lock();
+        void* mem = _lf_arena_allocate(count, size);
+        _lf_allocation_unlock();
+        return mem;
+    }
     void *mem = calloc(count, size);
     if (mem == NULL) lf_print_error_and_exit("Out of memory!");
     if (head != NULL) {
@@ -135,9 +524,12 @@ void* _lf_allocate(
                 = (allocation_record_t*)calloc(1, sizeof(allocation_record_t));
         if (record == NULL) lf_print_error_and_exit("Out of memory!");
         record->allocated = mem;
+        _lf_allocation_lock();
+        _lf_reactor_bytes += count * size + sizeof(allocation_record_t);
         allocation_record_t* tmp = *head; // Previous head of the list or NULL.
         *head = record;                   // New head of the list.
         record->next = tmp;
+        _lf_allocation_unlock();
     }
     return mem;
 }
@@ -156,6 +548,12 @@ struct allocation_record_t* _lf_reactors_to_free = NULL;
  * @param size The size of the self struct, obtained with sizeof().
  */
 void* _lf_new_reactor(size_t size) {
+    if (LF_ARENA_CHUNK_SIZE > 0) {
+        _lf_allocation_lock();
+        void* mem = _lf_arena_allocate(1, size);
+        _lf_allocation_unlock();
+        return mem;
+    }
     return _lf_allocate(1, size, &_lf_reactors_to_free);
 }
 
@@ -187,7 +585,9 @@ void _lf_free(struct allocation_record_t** head) {
  */
 void _lf_free_reactor(self_base_t *self) {
     _lf_free(&self->allocations);
-    free(self);
+    if (!_lf_arena_contains(self)) {
+        free(self);
+    }
 }
 
 /**
@@ -203,6 +603,49 @@ void _lf_free_all_reactors(void) {
         head = tmp;
     }
     _lf_reactors_to_free = NULL;
+    _lf_reactor_bytes = 0;
+    while (_lf_arena != NULL) {
+        _lf_arena_chunk_t* chunk = _lf_arena;
+        _lf_arena = chunk->next;
+        free(chunk);
+    }
+}
+
+void lf_get_memory_stats(lf_memory_stats_t* stats) {
+    memset(stats, 0, sizeof(lf_memory_stats_t));
+    stats->tokens_live = _lf_count_token_allocations;
+    stats->tokens_peak = _lf_count_token_allocations_peak;
+    stats->payloads_live = _lf_count_payload_allocations;
+    _lf_get_token_stats(&stats->tokens_recycled, &stats->payload_pool_bytes);
+    environment_t* envs;
+    int num_envs = _lf_get_environments(&envs);
+    for (int i = 0; i < num_envs; i++) {
+        environment_t* env = &envs[i];
+        if (!env->initialized) continue;
+        stats->events_allocated += env->events_allocated;
+        stats->events_live += env->events_live;
+        stats->events_peak += env->events_peak;
+        if (env->event_q != NULL) stats->event_queue_size += _lf_event_count(env);
+        stats->trace_buffer_bytes += trace_buffer_bytes(env->trace);
+        stats->scratch_bytes += env->scratch_bytes;
+    }
+    stats->reactor_bytes = _lf_reactor_bytes + lf_arena_footprint(NULL);
+}
+
+/**
+ * Print the memory statistics of the runtime at the log level.
+ */
+static void _lf_print_memory_stats(void) {
+    lf_memory_stats_t stats;
+    lf_get_memory_stats(&stats);
+    LF_PRINT_LOG("---- Memory: %d live tokens (peak %d), %zu recycled tokens, %d live payloads, "
+            "%zu bytes of pooled payloads.",
+            stats.tokens_live, stats.tokens_peak, stats.tokens_recycled, stats.payloads_live,
+            stats.payload_pool_bytes);
+    LF_PRINT_LOG("---- Memory: %zu events allocated, %zu live (peak %zu), %zu on event queues.",
+            stats.events_allocated, stats.events_live, stats.events_peak, stats.event_queue_size);
+    LF_PRINT_LOG("---- Memory: %zu bytes for reactors, %zu bytes for trace buffers, %zu bytes of scratch arenas.",
+            stats.reactor_bytes, stats.trace_buffer_bytes, stats.scratch_bytes);
 }
 
 /**
@@ -269,6 +712,7 @@ void _lf_start_time_step(environment_t *env) {
     LF_PRINT_LOG("--------- Start time step at tag " PRINTF_TAG ".", env->current_tag.time - start_time, env->current_tag.microstep);
     // Handle dynamically created tokens for mutable inputs.
     _lf_free_token_copies(env);
+    _lf_scratch_reset(env);
 
     bool** is_present_fields = env->is_present_fields_abbreviated;
     int size = env->is_present_fields_abbreviated_size;
@@ -279,6 +723,19 @@ void _lf_start_time_step(environment_t *env) {
     for(int i = 0; i < size; i++) {
         *is_present_fields[i] = false;
     }
+#if !defined(LF_SINGLE_THREADED)
+    // Workers are not executing reactions between time steps, so their lists are quiescent.
+    for (int w = 0; w < env->num_workers; w++) {
+        lf_present_list_t* list = &env->present_lists[w];
+        for (int i = 0; i < list->size; i++) {
+            *list->fields[i] = false;
+        }
+        list->size = 0;
+    }
+#endif
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    memset(env->port_presence, 0, env->port_presence_used * sizeof(bool));
+#endif
     // Reset sparse IO record sizes to 0, if any.
     if (env->sparse_io_record_sizes.start != NULL) {
         for (size_t i = 0; i < vector_size(&env->sparse_io_record_sizes); i++) {
@@ -288,6 +745,11 @@ void _lf_start_time_step(environment_t *env) {
             int** sizep = (int**)vector_at(&env->sparse_io_record_sizes, i);
             if (sizep != NULL && *sizep != NULL) {
                 **sizep = 0;
+                // The size is the first field of the record, so this is the record.
+                lf_sparse_io_record_t* record = (lf_sparse_io_record_t*)*sizep;
+                if (record->bitmap_width > 0) {
+                    memset(record->present_channels, 0, ((record->bitmap_width + 31) / 32) * sizeof(uint32_t));
+                }
             }
         }
     }
@@ -321,145 +783,498 @@ bool _lf_is_tag_after_stop_tag(environment_t* env, tag_t tag) {
 }
 
 /**
- * Pop all events from event_q with timestamp equal to current_tag.time, extract all
- * the reactions triggered by these events, and stick them into the reaction
- * queue.
+ * Insert an event into the event queue and record it among the pending
+ * events of its trigger, if it has one. An event at the current time belongs
+ * to the next microstep and is appended to the next_microstep FIFO instead,
+ * which _lf_pop_events() drains at that microstep without a detour through
+ * the event queue. While a batch of events is being scheduled, the insertion
+ * into the event queue is deferred to the end of the batch. Until then, the
+ * event can only be found among the pending events of its trigger.
  * @param env Environment in which we are executing.
+ * @param e The event.
  */
-void _lf_pop_events(environment_t *env) {
+void _lf_insert_event(environment_t* env, event_t* e) {
     assert(env != GLOBAL_ENVIRONMENT);
-#ifdef MODAL_REACTORS
-    _lf_handle_mode_triggered_reactions(env);
-#endif
+    if (e->time == env->current_tag.time) {
+        vector_push(&env->next_microstep, e);
+    } else if (env->batched_events != NULL) {
+        // Inserted into the event queue at the end of _lf_schedule_batch().
+        vector_push(env->batched_events, e);
+    } else {
+        pqueue_insert(env->event_q, e);
+    }
+    trigger_t* trigger = e->trigger;
+    if (trigger != NULL) {
+        e->prev_pending = NULL;
+        e->next_pending = trigger->pending;
+        if (trigger->pending != NULL) {
+            trigger->pending->prev_pending = e;
+        }
+        trigger->pending = e;
+    }
+}
 
-    event_t* event = (event_t*)pqueue_peek(env->event_q);
-    while(event != NULL && event->time == env->current_tag.time) {
-        event = (event_t*)pqueue_pop(env->event_q);
+/**
+ * Remove an event that has left the event queue from the pending events of
+ * its trigger, if it has one.
+ * @param e The event.
+ */
+static void _lf_forget_pending_event(event_t* e) {
+    trigger_t* trigger = e->trigger;
+    if (trigger != NULL) {
+        if (e->prev_pending != NULL) {
+            e->prev_pending->next_pending = e->next_pending;
+        } else {
+            trigger->pending = e->next_pending;
+        }
+        if (e->next_pending != NULL) {
+            e->next_pending->prev_pending = e->prev_pending;
+        }
+        e->next_pending = NULL;
+        e->prev_pending = NULL;
+    }
+}
 
-        if (event->is_dummy) {
-            LF_PRINT_DEBUG("Popped dummy event from the event queue.");
-            if (event->next != NULL) {
-                LF_PRINT_DEBUG("Putting event from the event queue for the next microstep.");
-                pqueue_insert(env->next_q, event->next);
+/**
+ * Remove an event from the event queue and from the pending events of its
+ * trigger, if it has one.
+ * @param env Environment in which we are executing.
+ * @param e The event, which must be on the event queue.
+ */
+void _lf_remove_event(environment_t* env, event_t* e) {
+    assert(env != GLOBAL_ENVIRONMENT);
+    if (e->time == env->current_tag.time) {
+        // The event may be waiting for the next microstep.
+        vector_t* v = &env->next_microstep;
+        for (void** p = v->start; p < v->next; p++) {
+            if (*p == e) {
+                memmove(p, p + 1, (size_t)(v->next - p - 1) * sizeof(void*));
+                v->next--;
+                _lf_forget_pending_event(e);
+                return;
+            }
+        }
+    }
+    if (env->batched_events != NULL) {
+        // The event may be waiting for the end of a batch.
+        vector_t* v = env->batched_events;
+        for (void** p = v->start; p < v->next; p++) {
+            if (*p == e) {
+                memmove(p, p + 1, (size_t)(v->next - p - 1) * sizeof(void*));
+                v->next--;
+                _lf_forget_pending_event(e);
+                return;
             }
-            _lf_recycle_event(env, event);
-            // Peek at the next event in the event queue.
-            event = (event_t*)pqueue_peek(env->event_q);
-            continue;
         }
+    }
+    pqueue_remove(env->event_q, e);
+    _lf_forget_pending_event(e);
+}
+
+/**
+ * Pop the earliest event from the event queue and remove it from the pending
+ * events of its trigger, if it has one.
+ * @param env Environment in which we are executing.
+ * @return The event or NULL if the event queue is empty.
+ */
+static event_t* _lf_pop_event(environment_t* env) {
+    event_t* e = (event_t*)pqueue_pop(env->event_q);
+    if (e != NULL) _lf_forget_pending_event(e);
+    return e;
+}
+
+/**
+ * Return the earliest event of the environment without removing it, or NULL
+ * if there is none. Events waiting for the next microstep precede the head
+ * of the event queue.
+ * @param env Environment in which we are executing.
+ */
+event_t* _lf_peek_event(environment_t* env) {
+    assert(env != GLOBAL_ENVIRONMENT);
+    if (vector_size(&env->next_microstep) > 0) {
+        return (event_t*)env->next_microstep.start[0];
+    }
+    return (event_t*)pqueue_peek(env->event_q);
+}
+
+/**
+ * Return the number of events of the environment, including those waiting
+ * for the next microstep.
+ * @param env Environment in which we are executing.
+ */
+size_t _lf_event_count(environment_t* env) {
+    assert(env != GLOBAL_ENVIRONMENT);
+    return pqueue_size(env->event_q) + vector_size(&env->next_microstep);
+}
+
+/**
+ * Return the event on the event queue for the specified trigger at the
+ * specified time, or NULL if there is none. Events lined up behind it in
+ * superdense time are reachable through its next pointer. This replaces a
+ * search of the event queue with a search of the few events pending for the
+ * trigger, starting with the most recently queued one.
+ * @param trigger The trigger.
+ * @param time The time.
+ */
+event_t* _lf_find_pending_event(trigger_t* trigger, instant_t time) {
+    for (event_t* e = trigger->pending; e != NULL; e = e->next_pending) {
+        if (e->time == time) return e;
+    }
+    return NULL;
+}
 
+/**
+ * Put the reactions triggered by the given event onto the reaction queue and
+ * mark its trigger present.
+ * @param env Environment in which we are executing.
+ * @param event The event, which is not a dummy event.
+ */
+static void _lf_trigger_event_reactions(environment_t* env, event_t* event) {
 #ifdef MODAL_REACTORS
-        // If this event is associated with an incative it should haven been suspended and no longer on the event queue.
-        // FIXME This should not be possible
-        if (!_lf_mode_is_active(event->trigger->mode)) {
-            lf_print_warning("Assumption violated. There is an event on the event queue that is associated to an inactive mode.");
-        }
+    // If this event is associated with an incative it should haven been suspended and no longer on the event queue.
+    // FIXME This should not be possible
+    if (!_lf_mode_is_active(event->trigger->mode)) {
+        lf_print_warning("Assumption violated. There is an event on the event queue that is associated to an inactive mode.");
+    }
 #endif
 
-        lf_token_t *token = event->token;
-
-        // Put the corresponding reactions onto the reaction queue.
-        for (int i = 0; i < event->trigger->number_of_reactions; i++) {
-            reaction_t *reaction = event->trigger->reactions[i];
-            // Do not enqueue this reaction twice.
-            if (reaction->status == inactive) {
+    // Put the corresponding reactions onto the reaction queue.
+    for (int i = 0; i < event->trigger->number_of_reactions; i++) {
+        reaction_t *reaction = event->trigger->reactions[i];
+        // Do not enqueue this reaction twice.
+        if (reaction->status == inactive) {
 #ifdef FEDERATED_DECENTRALIZED
-                // In federated execution, an intended tag that is not (NEVER, 0)
-                // indicates that this particular event is triggered by a network message.
-                // The intended tag is set in handle_timed_message in federate.c whenever
-                // a timed message arrives from another federate.
-                if (event->intended_tag.time != NEVER) {
-                    // If the intended tag of the event is actually set,
-                    // transfer the intended tag to the trigger so that
-                    // the reaction can access the value.
-                    event->trigger->intended_tag = event->intended_tag;
-                    // And check if it is in the past compared to the current tag.
-                    if (lf_tag_compare(event->intended_tag,
-                                    env->current_tag) < 0) {
-                        // Mark the triggered reaction with a STP violation
-                        reaction->is_STP_violated = true;
-                        LF_PRINT_LOG("Trigger %p has violated the reaction's STP offset. Intended tag: " PRINTF_TAG ". Current tag: " PRINTF_TAG,
-                                    event->trigger,
-                                    event->intended_tag.time - start_time, event->intended_tag.microstep,
-                                    env->current_tag.time - start_time, env->current_tag.microstep);
-                    }
+            // In federated execution, an intended tag that is not (NEVER, 0)
+            // indicates that this particular event is triggered by a network message.
+            // The intended tag is set in handle_timed_message in federate.c whenever
+            // a timed message arrives from another federate.
+            if (event->intended_tag.time != NEVER) {
+                // If the intended tag of the event is actually set,
+                // transfer the intended tag to the trigger so that
+                // the reaction can access the value.
+                event->trigger->intended_tag = event->intended_tag;
+                // And check if it is in the past compared to the current tag.
+                if (lf_tag_compare(event->intended_tag,
+                                env->current_tag) < 0) {
+                    // Mark the triggered reaction with a STP violation
+                    reaction->is_STP_violated = true;
+                    LF_PRINT_LOG("Trigger %p has violated the reaction's STP offset. Intended tag: " PRINTF_TAG ". Current tag: " PRINTF_TAG,
+                                event->trigger,
+                                event->intended_tag.time - start_time, event->intended_tag.microstep,
+                                env->current_tag.time - start_time, env->current_tag.microstep);
                 }
+            }
 #endif
 
 #ifdef MODAL_REACTORS
-                // Check if reaction is disabled by mode inactivity
-                if (!_lf_mode_is_active(reaction->mode)) {
-                    LF_PRINT_DEBUG("Suppressing reaction %s due inactive mode.", reaction->name);
-                    continue; // Suppress reaction by preventing entering reaction queue
-                }
-#endif
-                LF_PRINT_DEBUG("Triggering reaction %s.", reaction->name);
-                _lf_trigger_reaction(env, reaction, -1);
-            } else {
-                LF_PRINT_DEBUG("Reaction is already triggered: %s", reaction->name);
+            // Check if reaction is disabled by mode inactivity
+            if (!_lf_mode_is_active(reaction->mode)) {
+                LF_PRINT_DEBUG("Suppressing reaction %s due inactive mode.", reaction->name);
+                continue; // Suppress reaction by preventing entering reaction queue
             }
+#endif
+            LF_PRINT_DEBUG("Triggering reaction %s.", reaction->name);
+            _lf_trigger_reaction(env, reaction, -1);
+        } else {
+            LF_PRINT_DEBUG("Reaction is already triggered: %s", reaction->name);
         }
+    }
 
-        // Mark the trigger present.
-        event->trigger->status = present;
+    // Mark the trigger present, and if it stands for coalesced timers, each of them.
+    event->trigger->status = present;
+    for (int i = 0; i < event->trigger->number_of_coalesced; i++) {
+        event->trigger->coalesced[i]->status = present;
+    }
+}
 
-        // If the trigger is a periodic timer, create a new event for its next execution.
-        if (event->trigger->is_timer && event->trigger->period > 0LL) {
-            // Reschedule the trigger.
-            _lf_schedule(env, event->trigger, event->trigger->period, NULL);
+/**
+ * Return the time of the next tick of the timer of the given event, which is
+ * at the current tag, if the event is a tick of a periodic timer that can be
+ * moved to its next tick, or NEVER otherwise. A periodic timer thus keeps the
+ * same event for all of its ticks up to the stop time rather than recycling
+ * the event of each tick and taking another one for the next tick.
+ * @param env Environment in which we are executing.
+ * @param event The event.
+ */
+static instant_t _lf_next_timer_tick(environment_t* env, event_t* event) {
+    if (event->is_dummy || event->next != NULL) return NEVER;
+    trigger_t* timer = event->trigger;
+    if (!timer->is_timer || timer->period <= 0LL) return NEVER;
+    instant_t next_tick = lf_time_add(event->time, timer->period);
+    return next_tick > env->stop_tag.time ? NEVER : next_tick;
+}
+
+/**
+ * Move the event of a periodic timer to the given next tick of the timer, as
+ * _lf_schedule() would do for a new event.
+ * @param env Environment in which we are executing.
+ * @param event The event, for which _lf_next_timer_tick() has returned next_tick.
+ * @param next_tick The time of the next tick.
+ * @param at_head Whether the event is still the head of the event queue, in
+ *  which case it is moved down the event queue in place. Otherwise, it has
+ *  been removed from the event queue or the next_microstep FIFO and is
+ *  inserted again.
+ */
+static void _lf_advance_timer_event(environment_t* env, event_t* event, instant_t next_tick, bool at_head) {
+    trigger_t* timer = event->trigger;
+#ifdef FEDERATED_DECENTRALIZED
+    event->intended_tag = timer->intended_tag;
+#endif
+    if (at_head) {
+        pqueue_advance_head(env->event_q, (pqueue_pri_t)next_tick, set_event_time);
+    } else {
+        event->time = next_tick;
+        _lf_insert_event(env, event);
+    }
+    timer->last = event;
+    tracepoint_schedule(env->trace, timer, next_tick - env->current_tag.time);
+    LF_PROBE2(schedule, timer, next_tick - env->current_tag.time);
+}
+
+/**
+ * Put the reactions triggered by the given event, which has been removed from
+ * the event queue or the next_microstep FIFO, onto the reaction queue, defer
+ * the event that follows it in superdense time, if any, to the next
+ * microstep, and recycle the event.
+ * @param env Environment in which we are executing.
+ * @param event The event.
+ */
+static void _lf_handle_event(environment_t* env, event_t* event) {
+    if (event->is_dummy) {
+        LF_PRINT_DEBUG("Popped dummy event from the event queue.");
+        if (event->next != NULL) {
+            LF_PRINT_DEBUG("Putting event from the event queue for the next microstep.");
+            _lf_insert_event(env, event->next);
         }
+        _lf_recycle_event(env, event);
+        return;
+    }
 
-        // Copy the token pointer into the trigger struct so that the
-        // reactions can access it. This overwrites the previous template token,
-        // for which we decrement the reference count.
-        _lf_replace_template_token((token_template_t*)event->trigger, token);
+    _lf_trigger_event_reactions(env, event);
 
-        // Decrement the reference count because the event queue no longer needs this token.
-        // This has to be done after the above call to _lf_replace_template_token because
-        // that call will increment the reference count and we need to not let the token be
-        // freed prematurely.
-        _lf_done_using(token);
+    // If the trigger is a periodic timer, reuse the event for its next tick.
+    instant_t next_tick = _lf_next_timer_tick(env, event);
+    if (next_tick != NEVER) {
+        _lf_advance_timer_event(env, event, next_tick, false);
+        return;
+    }
 
-        // Mark the trigger present.
-        event->trigger->status = present;
+    lf_token_t *token = event->token;
 
-        // If this event points to a next event, insert it into the next queue.
-        if (event->next != NULL) {
-            // Insert the next event into the next queue.
-            pqueue_insert(env->next_q, event->next);
-        }
+    // Otherwise, if the trigger is a periodic timer, schedule its next tick,
+    // which _lf_schedule() discards if it is past the stop time.
+    if (event->trigger->is_timer && event->trigger->period > 0LL) {
+        // Reschedule the trigger.
+        _lf_schedule(env, event->trigger, event->trigger->period, NULL);
+    }
 
-        _lf_recycle_event(env, event);
+    // Copy the token pointer into the trigger struct so that the
+    // reactions can access it. This overwrites the previous template token,
+    // for which we decrement the reference count.
+    _lf_replace_template_token((token_template_t*)event->trigger, token);
+
+    // Decrement the reference count because the event queue no longer needs this token.
+    // This has to be done after the above call to _lf_replace_template_token because
+    // that call will increment the reference count and we need to not let the token be
+    // freed prematurely.
+    _lf_done_using(token);
+
+    // If this event points to a next event, defer it to the next microstep.
+    if (event->next != NULL) {
+        _lf_insert_event(env, event->next);
+    }
+
+    _lf_recycle_event(env, event);
+}
 
+/**
+ * Pop all events from event_q with timestamp equal to current_tag.time and all
+ * events waiting for this microstep, extract all the reactions triggered by
+ * these events, and stick them into the reaction queue. Events that follow
+ * them in superdense time are appended to the next_microstep FIFO.
+ * @param env Environment in which we are executing.
+ */
+void _lf_pop_events(environment_t *env) {
+    assert(env != GLOBAL_ENVIRONMENT);
+#ifdef MODAL_REACTORS
+    _lf_handle_mode_triggered_reactions(env);
+#endif
+
+    // Swap the FIFOs so that the events deferred to this microstep can be
+    // drained while events for the next microstep are appended.
+    vector_t draining = env->next_microstep;
+    env->next_microstep = env->draining_microstep;
+    for (void** p = draining.start; p < draining.next; p++) {
+        event_t* event = (event_t*)*p;
+        _lf_forget_pending_event(event);
+        _lf_handle_event(env, event);
+    }
+    vector_clear(&draining);
+    env->draining_microstep = draining;
+
+    event_t* event = (event_t*)pqueue_peek(env->event_q);
+    while(event != NULL && event->time == env->current_tag.time) {
+        instant_t next_tick = _lf_next_timer_tick(env, event);
+        if (next_tick != NEVER) {
+            // Sift the tick of a periodic timer down to its next tick without
+            // taking it off the event queue.
+            _lf_trigger_event_reactions(env, event);
+            _lf_advance_timer_event(env, event, next_tick, true);
+        } else {
+            _lf_handle_event(env, _lf_pop_event(env));
+        }
         // Peek at the next event in the event queue.
         event = (event_t*)pqueue_peek(env->event_q);
     };
 
-    LF_PRINT_DEBUG("There are %zu events deferred to the next microstep.", pqueue_size(env->next_q));
+    LF_PRINT_DEBUG("There are %zu events deferred to the next microstep.", vector_size(&env->next_microstep));
+}
+
+/**
+ * Add a slab of the given number of events to the free list of the given
+ * environment.
+ * @param env Environment in which we are executing.
+ * @param size The number of events in the new slab.
+ */
+static void _lf_allocate_event_slab(environment_t* env, size_t size) {
+    lf_event_slab_t* slab = (lf_event_slab_t*)calloc(1, sizeof(lf_event_slab_t) + size * sizeof(event_t));
+    if (slab == NULL) lf_print_error_and_exit("Out of memory!");
+    slab->size = size;
+    slab->next = env->event_slabs;
+    env->event_slabs = slab;
+    // Thread the events onto the free list so that the first one is used first.
+    for (size_t i = size; i > 0; i--) {
+        event_t* e = &slab->events[i - 1];
+#ifdef FEDERATED_DECENTRALIZED
+        e->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
+#endif
+        e->next = env->free_events;
+        env->free_events = e;
+    }
+    env->events_allocated += size;
+}
+
+#define MEMORY_PROFILE_MAGIC "lf-memory-profile"
+#define MEMORY_PROFILE_VERSION 1
+
+/**
+ * The memory profile read from _lf_memory_profile_file, which holds the peak
+ * number of tokens in use and the peak number of events of each environment.
+ */
+static struct {
+    bool loaded;      // Whether the file has been read.
+    bool valid;       // Whether a matching profile was found.
+    int tokens;
+    int num_envs;
+    size_t* events;
+} _lf_memory_profile = {false, false, 0, 0, NULL};
+
+/**
+ * Read the memory profile, if a file for it was given with --memory-profile.
+ * The profile is ignored if it does not match the number of environments of
+ * this program.
+ */
+static void _lf_load_memory_profile(void) {
+    _lf_memory_profile.loaded = true;
+    if (_lf_memory_profile_file == NULL) return;
+    FILE* file = fopen(_lf_memory_profile_file, "r");
+    if (file == NULL) {
+        LF_PRINT_LOG("No memory profile in %s. Recording one.", _lf_memory_profile_file);
+        return;
+    }
+    environment_t* envs;
+    int num_envs = _lf_get_environments(&envs);
+    char magic[sizeof(MEMORY_PROFILE_MAGIC)];
+    int version, tokens, profile_envs;
+    bool valid = fscanf(file, "%17s %d %d %d", magic, &version, &tokens, &profile_envs) == 4
+        && strcmp(magic, MEMORY_PROFILE_MAGIC) == 0
+        && version == MEMORY_PROFILE_VERSION
+        && profile_envs == num_envs
+        && tokens >= 0;
+    size_t* events = NULL;
+    if (valid) {
+        events = (size_t*)calloc(num_envs, sizeof(size_t));
+        lf_assert(events != NULL, "Out of memory");
+        for (int i = 0; valid && i < num_envs; i++) {
+            valid = fscanf(file, "%zu", &events[i]) == 1;
+        }
+    }
+    fclose(file);
+    if (!valid) {
+        lf_print_warning("Ignoring the memory profile in %s, which does not match this program.",
+                _lf_memory_profile_file);
+        free(events);
+        return;
+    }
+    _lf_memory_profile.valid = true;
+    _lf_memory_profile.tokens = tokens;
+    _lf_memory_profile.num_envs = num_envs;
+    _lf_memory_profile.events = events;
+    LF_PRINT_LOG("Loaded the memory profile from %s.", _lf_memory_profile_file);
+    _lf_reserve_tokens(tokens);
+}
+
+size_t _lf_apply_memory_profile(environment_t* env) {
+    if (!_lf_memory_profile.loaded) _lf_load_memory_profile();
+    if (!_lf_memory_profile.valid || env->id < 0 || env->id >= _lf_memory_profile.num_envs) return 0;
+    size_t budget = _lf_memory_profile.events[env->id];
+    if (budget == 0) return 0;
+    _lf_allocate_event_slab(env, budget);
+    env->event_budget = budget;
+    return budget;
+}
 
-    // After populating the reaction queue, see if there are things on the
-    // next queue to put back into the event queue.
-    while(pqueue_peek(env->next_q) != NULL) {
-        pqueue_insert(env->event_q, pqueue_pop(env->next_q));
+/**
+ * Write the peak usage of this run to _lf_memory_profile_file, unless this
+ * run was preallocated from a profile that was read from it.
+ * This must be called before the environments are freed.
+ */
+static void _lf_save_memory_profile(void) {
+    if (_lf_memory_profile_file == NULL || _lf_memory_profile.valid) return;
+    FILE* file = fopen(_lf_memory_profile_file, "w");
+    if (file == NULL) {
+        lf_print_warning("Failed to open %s to save the memory profile.", _lf_memory_profile_file);
+        return;
+    }
+    // The token peak is raised atomically by the workers, which may still be
+    // running if termination was triggered by a signal, so take a snapshot.
+#if !defined(LF_SINGLE_THREADED)
+    int tokens_peak = lf_atomic_fetch_add(&_lf_count_token_allocations_peak, 0);
+#else
+    int tokens_peak = _lf_count_token_allocations_peak;
+#endif
+    environment_t* envs;
+    int num_envs = _lf_get_environments(&envs);
+    fprintf(file, "%s %d %d %d\n", MEMORY_PROFILE_MAGIC, MEMORY_PROFILE_VERSION,
+            tokens_peak, num_envs);
+    for (int i = 0; i < num_envs; i++) {
+        fprintf(file, "%zu\n", envs[i].events_peak);
     }
+    fclose(file);
+    LF_PRINT_LOG("Saved the memory profile to %s.", _lf_memory_profile_file);
 }
 
 /**
  * Get a new event. If there is a recycled event available, use that.
- * If not, allocate a new one. In either case, all fields will be zero'ed out.
+ * If not, allocate a new slab of events, which is at least as large as
+ * the preallocation size and doubles the number of events of the environment.
+ * In either case, all fields will be zero'ed out.
  * @param env Environment in which we are executing.
  */
 static event_t* _lf_get_new_event(environment_t* env) {
     assert(env != GLOBAL_ENVIRONMENT);
-    // Recycle event_t structs, if possible.
-    event_t* e = (event_t*)pqueue_pop(env->recycle_q);
-    if (e == NULL) {
-        e = (event_t*)calloc(1, sizeof(struct event_t));
-        if (e == NULL) lf_print_error_and_exit("Out of memory!");
-#ifdef FEDERATED_DECENTRALIZED
-        e->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
-#endif
+    if (env->free_events == NULL) {
+        if (env->event_budget > 0) {
+            lf_print_error_and_exit("Environment %d needs more than the %zu events of its memory profile.",
+                    env->id, env->event_budget);
+        }
+        size_t size = env->events_allocated > 0 ? env->events_allocated : _lf_event_pool_size;
+        _lf_allocate_event_slab(env, size > LF_EVENT_SLAB_SIZE ? size : LF_EVENT_SLAB_SIZE);
     }
+    event_t* e = env->free_events;
+    env->free_events = e->next;
+    e->next = NULL;
+    if (++env->events_live > env->events_peak) env->events_peak = env->events_live;
     return e;
 }
 
@@ -484,7 +1299,7 @@ void _lf_initialize_timer(environment_t* env, trigger_t* timer) {
         event_t* e = _lf_get_new_event(env);
         e->trigger = timer;
         e->time = lf_time_logical(env) + timer->offset;
-        _lf_add_suspended_event(e);
+        _lf_add_suspended_event(env, e);
         return;
     }
 #endif
@@ -492,6 +1307,7 @@ void _lf_initialize_timer(environment_t* env, trigger_t* timer) {
         for (int i = 0; i < timer->number_of_reactions; i++) {
             _lf_trigger_reaction(env, timer->reactions[i], -1);
             tracepoint_schedule(env->trace, timer, 0LL); // Trace even though schedule is not called.
+            LF_PROBE2(schedule, timer, 0LL);
         }
         if (timer->period == 0) {
             return;
@@ -510,21 +1326,123 @@ void _lf_initialize_timer(environment_t* env, trigger_t* timer) {
     e->trigger = timer;
     e->time = lf_time_logical(env) + delay;
     // NOTE: No lock is being held. Assuming this only happens at startup.
-    pqueue_insert(env->event_q, e);
+    _lf_insert_event(env, e);
     tracepoint_schedule(env->trace, timer, delay); // Trace even though schedule is not called.
+    LF_PROBE2(schedule, timer, delay);
+}
+
+/**
+ * Compare timers by offset and then by period. Used with qsort.
+ */
+static int _lf_compare_timers(const void* a, const void* b) {
+    const trigger_t* x = *(trigger_t* const*)a;
+    const trigger_t* y = *(trigger_t* const*)b;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    if (x->period != y->period) return x->period < y->period ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Compare reactions by address. Used with qsort.
+ */
+static int _lf_compare_reaction_addresses(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(reaction_t* const*)a;
+    uintptr_t y = (uintptr_t)*(reaction_t* const*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
 }
 
 /**
  * @brief Initialize all the timers in the environment
+ * Timers outside of modes that have the same offset and period are coalesced
+ * into one timer that triggers the reactions of all of them, so each of their
+ * ticks is a single event on the event queue. The coalesced timers are kept
+ * in env->timer_groups, and each tick marks all of the timers present.
+ * Timers in modes are initialized individually because they are suspended
+ * and reset with their modes.
  * @param env Environment in which we are executing.
  */
 void _lf_initialize_timers(environment_t* env) {
     assert(env != GLOBAL_ENVIRONMENT);
+    trigger_t** timers = (trigger_t**)malloc((env->timer_triggers_size + 1) * sizeof(trigger_t*));
+    lf_assert(timers != NULL, "Out of memory");
+    size_t num_timers = 0;
     for (int i = 0; i < env->timer_triggers_size; i++) {
-        if (env->timer_triggers[i] != NULL) {
-            _lf_initialize_timer(env, env->timer_triggers[i]);
+        trigger_t* timer = env->timer_triggers[i];
+        if (timer == NULL) continue;
+        if (timer->mode != NULL) {
+            _lf_initialize_timer(env, timer);
+        } else {
+            timers[num_timers++] = timer;
+        }
+    }
+    qsort(timers, num_timers, sizeof(trigger_t*), _lf_compare_timers);
+
+    // Count the groups of two or more timers, their timers, and the reactions they trigger.
+    size_t num_groups = 0;
+    size_t num_members = 0;
+    size_t num_reactions = 0;
+    for (size_t i = 0, j; i < num_timers; i = j) {
+        size_t reactions = (size_t)timers[i]->number_of_reactions;
+        for (j = i + 1; j < num_timers && _lf_compare_timers(&timers[i], &timers[j]) == 0; j++) {
+            reactions += (size_t)timers[j]->number_of_reactions;
+        }
+        if (j - i > 1) {
+            num_groups++;
+            num_members += j - i;
+            num_reactions += reactions;
         }
     }
+
+    // The groups and their arrays of timers and of reactions share one allocation.
+    if (num_groups > 0) {
+        env->timer_groups = (trigger_t*)calloc(1, num_groups * sizeof(trigger_t)
+                + num_members * sizeof(trigger_t*) + num_reactions * sizeof(reaction_t*));
+        lf_assert(env->timer_groups != NULL, "Out of memory");
+    }
+    trigger_t* group = env->timer_groups;
+    trigger_t** members = (trigger_t**)(env->timer_groups + num_groups);
+    reaction_t** reactions = (reaction_t**)(members + num_members);
+    for (size_t i = 0, j; i < num_timers; i = j) {
+        for (j = i + 1; j < num_timers && _lf_compare_timers(&timers[i], &timers[j]) == 0; j++);
+        if (j - i == 1) {
+            _lf_initialize_timer(env, timers[i]);
+            continue;
+        }
+        LF_PRINT_DEBUG("Coalescing %zu timers with offset " PRINTF_TIME " and period " PRINTF_TIME ".",
+                j - i, timers[i]->offset, timers[i]->period);
+        size_t n = 0;
+        for (size_t k = i; k < j; k++) {
+            for (int r = 0; r < timers[k]->number_of_reactions; r++) {
+                reactions[n++] = timers[k]->reactions[r];
+            }
+        }
+        // A reaction triggered by several of the timers is triggered once.
+        qsort(reactions, n, sizeof(reaction_t*), _lf_compare_reaction_addresses);
+        size_t unique = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (unique == 0 || reactions[unique - 1] != reactions[k]) reactions[unique++] = reactions[k];
+        }
+        for (size_t k = i; k < j; k++) {
+            members[k - i] = timers[k];
+        }
+        group->coalesced = members;
+        group->number_of_coalesced = (int)(j - i);
+        group->reactions = reactions;
+        group->number_of_reactions = (int)unique;
+        group->is_timer = true;
+        group->offset = timers[i]->offset;
+        group->period = timers[i]->period;
+#ifdef FEDERATED
+        group->last_known_status_tag = NEVER_TAG;
+        group->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
+        group->physical_time_of_arrival = NEVER;
+#endif
+        _lf_initialize_timer(env, group);
+        members += j - i;
+        reactions += n;
+        group++;
+    }
+    free(timers);
 }
 
 /**
@@ -574,16 +1492,33 @@ void _lf_trigger_shutdown_reactions(environment_t *env) {
         _lf_handle_mode_shutdown_reactions(env, env->shutdown_reactions, env->shutdown_reactions_size);
     }
 #endif
+#if !defined(LF_SINGLE_THREADED)
+    // No more events are handled, so producers blocked on bounded physical
+    // actions give up.
+    if (env->producers_blocked > 0) {
+        lf_cond_broadcast(&env->bounded_event_handled);
+    }
+#endif
 }
 
 /**
  * Recycle the given event.
- * Zero it out and pushed it onto the recycle queue.
+ * Zero it out and push it onto the free list of the environment.
  * @param env Environment in which we are executing.
  * @param e The event to recycle.
  */
 void _lf_recycle_event(environment_t* env, event_t* e) {
     assert(env != GLOBAL_ENVIRONMENT);
+    if (e->is_counted) {
+        trigger_t* trigger = e->trigger;
+        trigger->num_queued--;
+#if !defined(LF_SINGLE_THREADED)
+        if (env->producers_blocked > 0 && trigger->num_queued < trigger->max_queued) {
+            lf_cond_broadcast(&env->bounded_event_handled);
+        }
+#endif
+        e->is_counted = false;
+    }
     e->time = 0LL;
     e->trigger = NULL;
     e->pos = 0;
@@ -592,8 +1527,11 @@ void _lf_recycle_event(environment_t* env, event_t* e) {
 #ifdef FEDERATED_DECENTRALIZED
     e->intended_tag = (tag_t) { .time = NEVER, .microstep = 0u};
 #endif
-    e->next = NULL;
-    pqueue_insert(env->recycle_q, e);
+    e->next_pending = NULL;
+    e->prev_pending = NULL;
+    e->next = env->free_events;
+    env->free_events = e;
+    env->events_live--;
 }
 
 /**
@@ -699,6 +1637,7 @@ int _lf_schedule_at_tag(environment_t* env, trigger_t* trigger, tag_t tag, lf_to
     e->time = tag.time;
 
     tracepoint_schedule(env->trace, trigger, tag.time - current_logical_tag.time);
+    LF_PROBE2(schedule, trigger, tag.time - current_logical_tag.time);
 
     // Make sure the event points to this trigger so when it is
     // dequeued, it will trigger this trigger.
@@ -712,7 +1651,7 @@ int _lf_schedule_at_tag(environment_t* env, trigger_t* trigger, tag_t tag, lf_to
     e->intended_tag = trigger->intended_tag;
 #endif
 
-    event_t* found = (event_t *)pqueue_find_equal_same_priority(env->event_q, e);
+    event_t* found = _lf_find_pending_event(trigger, e->time);
     if (found != NULL) {
         if (tag.microstep == 0u) {
                 // The microstep is 0, which means that the event is being scheduled
@@ -831,16 +1770,84 @@ int _lf_schedule_at_tag(environment_t* env, trigger_t* trigger, tag_t tag, lf_to
                 tag.microstep == 0) {
             // Do not need a dummy event if we are scheduling at 1 microstep
             // in the future at current time or at microstep 0 in a future time.
-            pqueue_insert(env->event_q, e);
+            _lf_insert_event(env, e);
         } else {
             // Create a dummy event. Insert it into the queue, and let its next
             // pointer point to the actual event.
-            pqueue_insert(env->event_q, _lf_create_dummy_events(env, trigger, tag.time, e, relative_microstep));
+            _lf_insert_event(env, _lf_create_dummy_events(env, trigger, tag.time, e, relative_microstep));
         }
     }
     return 1;
 }
 
+/**
+ * Apply the overflow policy of a physical action that has as many events
+ * queued as its bound allows to a new schedule of it. This assumes that the
+ * caller holds the mutex of the environment and has incremented the reference
+ * count of the token.
+ * @param env Environment in which we are executing.
+ * @param trigger The physical action.
+ * @param token The token of the new event, or NULL.
+ * @return true if the new event is to be queued, or false if it is not, in
+ *  which case the token has been disposed of.
+ */
+static bool _lf_handle_overflow(environment_t* env, trigger_t* trigger, lf_token_t* token) {
+    lf_overflow_policy_t policy = trigger->overflow_policy;
+#if !defined(LF_SINGLE_THREADED)
+    // Workers handle the events, and the events of a batch are only visible to
+    // them once it is complete, so neither can wait.
+    if (policy == LF_OVERFLOW_BLOCK && env->batched_events == NULL && !lf_is_worker_thread()) {
+        LF_PRINT_DEBUG("_lf_schedule: waiting for room in the queue of a bounded physical action.");
+        trigger->overflow_stats.blocked++;
+        env->producers_blocked++;
+        // Once the stop tag is reached, no more events are handled.
+        while (trigger->num_queued >= trigger->max_queued && lf_tag_compare(env->current_tag, env->stop_tag) < 0) {
+            lf_cond_wait(&env->bounded_event_handled);
+        }
+        env->producers_blocked--;
+        if (trigger->num_queued < trigger->max_queued) {
+            return true;
+        }
+    }
+#endif
+    if (policy == LF_OVERFLOW_DROP_OLDEST) {
+        // Events suspended in an inactive mode count toward the bound but are
+        // not pending, so there may be none to drop.
+        event_t* oldest = NULL;
+        for (event_t* e = trigger->pending; e != NULL; e = e->next_pending) {
+            if (oldest == NULL || e->time <= oldest->time) oldest = e;
+        }
+        if (oldest != NULL) {
+            LF_PRINT_DEBUG("_lf_schedule: dropping the oldest event of a bounded physical action.");
+            _lf_remove_event(env, oldest);
+            // Events lined up behind it in superdense time take its place.
+            if (oldest->next != NULL) {
+                _lf_insert_event(env, oldest->next);
+            }
+            if (trigger->last == oldest) {
+                trigger->last = NULL;
+            }
+            _lf_done_using(oldest->token);
+            _lf_recycle_event(env, oldest);
+            trigger->overflow_stats.dropped++;
+            return true;
+        }
+    } else if (policy == LF_OVERFLOW_COALESCE && trigger->pending != NULL) {
+        LF_PRINT_DEBUG("_lf_schedule: coalescing an event of a bounded physical action.");
+        event_t* latest = trigger->pending;
+        while (latest->next != NULL) {
+            latest = latest->next;
+        }
+        _lf_replace_token(latest, token);
+        trigger->overflow_stats.coalesced++;
+        return false;
+    }
+    LF_PRINT_DEBUG("_lf_schedule: dropping a new event of a bounded physical action.");
+    _lf_done_using(token);
+    trigger->overflow_stats.dropped++;
+    return false;
+}
+
 /**
  * Schedule the specified trigger at env->current_tag.time plus the offset of the
  * specified trigger plus the delay. See schedule_token() in reactor.h for details.
@@ -875,6 +1882,23 @@ int _lf_schedule_at_tag(environment_t* env, trigger_t* trigger, tag_t tag, lf_to
  * @return A handle to the event, or 0 if no new event was scheduled, or -1 for error.
  */
 trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t extra_delay, lf_token_t* token) {
+    return _lf_schedule_at_physical_time(env, trigger, extra_delay, token, NEVER);
+}
+
+/**
+ * Variant of _lf_schedule() for which the physical time at which a physical
+ * action was scheduled is given rather than read from the clock. This is used
+ * for requests that are recorded by another thread and handled later.
+ * @param physical_time The physical time at which the schedule request was
+ *  made, or NEVER to use the current physical time.
+ */
+trigger_handle_t _lf_schedule_at_physical_time(
+        environment_t *env,
+        trigger_t* trigger,
+        interval_t extra_delay,
+        lf_token_t* token,
+        instant_t physical_time
+) {
     assert(env != GLOBAL_ENVIRONMENT);
     if (_lf_is_tag_after_stop_tag(env, env->current_tag)) {
         // If schedule is called after stop_tag
@@ -907,6 +1931,25 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
         return 0;
     }
 
+    if (trigger->is_physical && env->replay != NULL) {
+        if (physical_time == NEVER) physical_time = lf_time_physical();
+        if (!_lf_replay_schedule(env, trigger, physical_time, extra_delay, token)) {
+            // The log being replayed provides the schedules of this action.
+            _lf_done_using(token);
+            return 0;
+        }
+    }
+
+    if (trigger->max_queued > 0 && trigger->num_queued >= trigger->max_queued) {
+        if (!_lf_handle_overflow(env, trigger, token)) {
+            return 0;
+        }
+        // Logical time may have advanced while the caller was blocked.
+        if (physical_time != NEVER && physical_time < env->current_tag.time) {
+            physical_time = env->current_tag.time;
+        }
+    }
+
     // Compute the tag (the logical timestamp for the future event).
     // We first do this assuming it is logical action and then, if it is a
     // physical action, modify it if physical time exceeds the result.
@@ -933,12 +1976,20 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
     // dequeued, it will trigger this trigger.
     e->trigger = trigger;
 
+    // Count the events of physical actions until they are recycled, whether
+    // they are handled or discarded.
+    if (trigger->is_physical) {
+        e->is_counted = true;
+        trigger->num_queued++;
+    }
+
     // If the trigger is physical, then we need to check whether
     // physical time is larger than the intended time and, if so,
     // modify the intended time.
     if (trigger->is_physical) {
         // Get the current physical time and assign it as the intended time.
-        intended_time = lf_time_physical() + delay;
+        if (physical_time == NEVER) physical_time = lf_time_physical();
+        intended_time = physical_time + delay;
     } else {
         // FIXME: We need to verify that we are executing within a reaction?
         // See reactor_threaded.
@@ -970,7 +2021,7 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
         // No minimum spacing defined.
         tag_t intended_tag = (tag_t) {.time = intended_time, .microstep = 0u};
         e->time = intended_tag.time;
-        event_t* found = (event_t *)pqueue_find_equal_same_priority(env->event_q, e);
+        event_t* found = _lf_find_pending_event(trigger, e->time);
         // Check for conflicts. Let events pile up in super dense time.
         if (found != NULL) {
             intended_tag.microstep++;
@@ -1008,7 +2059,7 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
                 case drop:
                     LF_PRINT_DEBUG("Policy is drop. Dropping the event.");
                     if (min_spacing > 0 ||
-                            pqueue_find_equal_same_priority(env->event_q, existing) != NULL) {
+                            _lf_find_pending_event(trigger, existing->time) != NULL) {
                         // Recycle the new event and the token.
                         if (existing->token != token) {
                             _lf_done_using(token);
@@ -1029,7 +2080,7 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
                     // been handled yet.
                     if (existing->time > env->current_tag.time ||
                             (existing->time == env->current_tag.time &&
-                            pqueue_find_equal_same_priority(env->event_q, existing) != NULL)) {
+                            _lf_find_pending_event(trigger, existing->time) != NULL)) {
                         // Recycle the existing token and the new event
                         // and update the token of the existing event.
                         _lf_replace_token(existing, token);
@@ -1042,7 +2093,7 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
                     break;
                 default:
                     if (existing->time == env->current_tag.time &&
-                            pqueue_find_equal_same_priority(env->event_q, existing) != NULL) {
+                            _lf_find_pending_event(trigger, existing->time) != NULL) {
                         if (_lf_is_tag_after_stop_tag(env, (tag_t){.time=existing->time,.microstep=env->current_tag.microstep+1})) {
                             // Scheduling e will incur a microstep at timeout, 
                             // which is illegal.
@@ -1102,9 +2153,10 @@ trigger_handle_t _lf_schedule(environment_t *env, trigger_t* trigger, interval_t
     // same time will automatically be executed at the next microstep.
     LF_PRINT_LOG("Inserting event in the event queue with elapsed time " PRINTF_TIME ".",
             e->time - start_time);
-    pqueue_insert(env->event_q, e);
+    _lf_insert_event(env, e);
 
     tracepoint_schedule(env->trace, trigger, e->time - env->current_tag.time);
+    LF_PROBE2(schedule, trigger, e->time - env->current_tag.time);
 
     // FIXME: make a record of handle and implement unschedule.
     // NOTE: Rather than wrapping around to get a negative number,
@@ -1209,7 +2261,16 @@ trigger_handle_t _lf_insert_reactions_for_trigger(environment_t* env, trigger_t*
  */
 trigger_handle_t _lf_schedule_token(lf_action_base_t* action, interval_t extra_delay, lf_token_t* token) {
     environment_t* env = action->parent->environment;
-    
+#if defined(LF_PHYSICAL_ACTION_INBOX) && !defined(LF_SINGLE_THREADED)
+    // A producer that is to block when the queue of the action is full has to
+    // take the mutex.
+    if (action->trigger != NULL && action->trigger->is_physical
+            && !(action->trigger->max_queued > 0 && action->trigger->overflow_policy == LF_OVERFLOW_BLOCK)) {
+        // Do not contend for the mutex with the workers.
+        return _lf_inbox_push(env, action->trigger, extra_delay, token);
+    }
+#endif
+
     if (lf_critical_section_enter(env) != 0) {
         lf_print_error_and_exit("Could not enter critical section");
     }
@@ -1275,6 +2336,85 @@ trigger_handle_t _lf_schedule_value(lf_action_base_t* action, interval_t extra_d
     return return_value;
 }
 
+/**
+ * Schedule several actions at once.
+ * See reactor.h for documentation.
+ */
+int _lf_schedule_batch(lf_schedule_request_t* requests, size_t count, trigger_handle_t* handles) {
+    int errors = 0;
+    size_t i = 0;
+    while (i < count) {
+        environment_t* env = ((lf_action_base_t*)requests[i].action)->parent->environment;
+        vector_t batch = vector_new(count - i);
+        if (lf_critical_section_enter(env) != 0) {
+            lf_print_error_and_exit("Could not enter critical section");
+        }
+        env->batched_events = &batch;
+        // Handle all consecutive requests for actions in this environment.
+        for (; i < count; i++) {
+            lf_action_base_t* action = (lf_action_base_t*)requests[i].action;
+            if (action->parent->environment != env) break;
+            trigger_handle_t handle = _lf_schedule(env, action->trigger, requests[i].extra_delay, requests[i].token);
+            if (handle < 0) errors++;
+            if (handles != NULL) handles[i] = handle;
+        }
+        env->batched_events = NULL;
+        if (pqueue_insert_all(env->event_q, batch.start, vector_size(&batch)) != 0) {
+            lf_print_error_and_exit("Out of memory while scheduling a batch of events.");
+        }
+        // Notify the main thread in case it is waiting for physical time to elapse.
+        lf_notify_of_event(env);
+        if(lf_critical_section_exit(env) != 0) {
+            lf_print_error_and_exit("Could not leave critical section");
+        }
+        vector_free(&batch);
+    }
+    return errors;
+}
+
+/**
+ * Bound the queued events of a physical action.
+ * See reactor.h for documentation.
+ */
+int _lf_set_action_bound(lf_action_base_t* action, size_t max_queued, lf_overflow_policy_t policy) {
+    trigger_t* trigger = action->trigger;
+    if (trigger == NULL || !trigger->is_physical) {
+        lf_print_error("lf_set_action_bound: Only physical actions can be bounded.");
+        return -1;
+    }
+    environment_t* env = action->parent->environment;
+    if (lf_critical_section_enter(env) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+    trigger->max_queued = max_queued;
+    trigger->overflow_policy = policy;
+#if !defined(LF_SINGLE_THREADED)
+    // Producers blocked on the old bound may fit within the new one.
+    if (env->producers_blocked > 0) {
+        lf_cond_broadcast(&env->bounded_event_handled);
+    }
+#endif
+    if (lf_critical_section_exit(env) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+    return 0;
+}
+
+/**
+ * Report how often the bound of a physical action has been hit.
+ * See reactor.h for documentation.
+ */
+void _lf_get_overflow_stats(lf_action_base_t* action, lf_overflow_stats_t* stats) {
+    environment_t* env = action->parent->environment;
+    if (lf_critical_section_enter(env) != 0) {
+        lf_print_error_and_exit("Could not enter critical section");
+    }
+    *stats = action->trigger->overflow_stats;
+    if (lf_critical_section_exit(env) != 0) {
+        lf_print_error_and_exit("Could not leave critical section");
+    }
+}
+
 void _lf_advance_logical_time(environment_t *env, instant_t next_time) {
     assert(env != GLOBAL_ENVIRONMENT);
 
@@ -1287,7 +2427,7 @@ void _lf_advance_logical_time(environment_t *env, instant_t next_time) {
     // be a need for a target property that enables these kinds of logic
     // assertions for development purposes only.
     #ifndef NDEBUG
-    event_t* next_event = (event_t*)pqueue_peek(env->event_q);
+    event_t* next_event = _lf_peek_event(env);
     if (next_event != NULL) {
         if (next_time > next_event->time) {
             lf_print_error_and_exit("_lf_advance_logical_time(): Attempted to move time to " PRINTF_TIME ", which is "
@@ -1304,6 +2444,7 @@ void _lf_advance_logical_time(environment_t *env, instant_t next_time) {
     } else {
         lf_print_error_and_exit("_lf_advance_logical_time(): Attempted to move tag back in time.");
     }
+    LF_PROBE2(tag_advance, env->current_tag.time, env->current_tag.microstep);
     LF_PRINT_LOG("Advanced (elapsed) tag to " PRINTF_TAG " at physical time " PRINTF_TIME,
         next_time - start_time, env->current_tag.microstep, lf_time_physical_elapsed());
 }
@@ -1329,14 +2470,77 @@ trigger_handle_t _lf_schedule_int(lf_action_base_t* action, interval_t extra_del
 }
 
 /**
-
- * Invoke the given reaction
+ * Return an estimate of the execution time of the given reaction, which is
+ * the one it was annotated with or, failing that, the shortest one measured,
+ * so that a reaction is considered doomed only if it is bound to be late.
+ */
+interval_t _lf_reaction_exec_time_estimate(reaction_t* reaction) {
+    if (reaction->exec_time_estimate > 0) {
+        return reaction->exec_time_estimate;
+    }
+    return lf_reaction_exec_time_min(reaction);
+}
+
+/**
+ * Return whether the deadline of the given reaction, which must have one, is
+ * violated if the reaction starts at the given physical time. With deadline
+ * admission, this is also the case if the reaction cannot complete by its
+ * deadline given the estimate of its execution time, so that its violation
+ * handler runs instead of work whose results would be late.
+ *
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction.
+ * @param physical_time The current physical time.
+ */
+bool _lf_is_deadline_violated(environment_t* env, reaction_t* reaction, instant_t physical_time) {
+    if (reaction->deadline == 0) {
+        return true;
+    }
+    if (_lf_deadline_admission != LF_DEADLINE_ADMISSION_OFF) {
+        physical_time += _lf_reaction_exec_time_estimate(reaction);
+    }
+    return physical_time > env->current_tag.time + reaction->deadline;
+}
+
+/**
+ * Return whether the given reaction should not be triggered because
+ * deadline admission prunes it. This is the case for a reaction without a
+ * deadline of its own whose index carries a deadline inferred from a
+ * reaction downstream of it, if that deadline cannot be met even if the
+ * downstream reaction starts as soon as the given one completes. The chain
+ * of reactions that it would trigger is then not executed either.
+ *
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction to be triggered.
+ */
+bool _lf_is_pruned_for_deadline(environment_t* env, reaction_t* reaction) {
+    if (_lf_deadline_admission != LF_DEADLINE_ADMISSION_PRUNE || reaction->deadline >= 0LL) {
+        return false;
+    }
+    // Reactions without an inferred deadline have the largest deadline part,
+    // and those of indexes that only hold a level have none.
+    index_t inferred_deadline = LF_INDEX_DEADLINE(reaction->index);
+    if (inferred_deadline == 0 || inferred_deadline >= (index_t)(INT64_MAX >> 16)) {
+        return false;
+    }
+    instant_t completion = lf_time_physical() + _lf_reaction_exec_time_estimate(reaction);
+    if (completion > env->current_tag.time + (interval_t)inferred_deadline) {
+        LF_PRINT_LOG("Pruning reaction %s, which cannot complete before the deadline of " PRINTF_TIME
+                " downstream of it.", reaction->name, (interval_t)inferred_deadline);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Mark the given reaction as executing on behalf of the given worker, locking
+ * the mutex of its reactor if it has one, before its function is called.
  *
  * @param env Environment in which we are executing.
- * @param reaction The reaction that has just executed.
+ * @param reaction The reaction that is about to execute.
  * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
  */
-void _lf_invoke_reaction(environment_t* env, reaction_t* reaction, int worker) {
+void _lf_reaction_begins(environment_t* env, reaction_t* reaction, int worker) {
     assert(env != GLOBAL_ENVIRONMENT);
 
 #if !defined(LF_SINGLE_THREADED)
@@ -1346,11 +2550,30 @@ void _lf_invoke_reaction(environment_t* env, reaction_t* reaction, int worker) {
 #endif
 
     tracepoint_reaction_starts(env->trace, reaction, worker);
+    LF_PROBE4(reaction_start, reaction->name, worker, env->current_tag.time, env->current_tag.microstep);
     ((self_base_t*) reaction->self)->executing_reaction = reaction;
-    reaction->function(reaction->self);
+}
+
+/**
+ * Mark the given reaction as completed at the current tag once its function
+ * has returned, unlocking the mutex of its reactor if it has one. The worker
+ * may differ from the one given to _lf_reaction_begins() if the reaction was
+ * suspended in between, in which case its reactor has no mutex.
+ *
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction that has just executed.
+ * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
+ */
+void _lf_reaction_ends(environment_t* env, reaction_t* reaction, int worker) {
+#if !defined(LF_SINGLE_THREADED)
+    // lf_writable_copy() relies on completed_tag to hand out tokens that this
+    // reaction may have read, so its accesses must be visible first.
+    lf_memory_barrier();
+#endif
+    reaction->completed_tag = env->current_tag;
     ((self_base_t*) reaction->self)->executing_reaction = NULL;
     tracepoint_reaction_ends(env->trace, reaction, worker);
-
+    LF_PROBE4(reaction_end, reaction->name, worker, env->current_tag.time, env->current_tag.microstep);
 
 #if !defined(LF_SINGLE_THREADED)
     if (((self_base_t*) reaction->self)->reactor_mutex != NULL) {
@@ -1360,24 +2583,185 @@ void _lf_invoke_reaction(environment_t* env, reaction_t* reaction, int worker) {
 }
 
 /**
- * For the specified reaction, if it has produced outputs, insert the
- * resulting triggered reactions into the reaction queue.
- * This procedure assumes the mutex lock is NOT held and grabs
- * the lock only when it actually inserts something onto the reaction queue.
+ * Invoke the given reaction
+ *
  * @param env Environment in which we are executing.
  * @param reaction The reaction that has just executed.
  * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
  */
-void schedule_output_reactions(environment_t *env, reaction_t* reaction, int worker) {
-    assert(env != GLOBAL_ENVIRONMENT);
+void _lf_invoke_reaction(environment_t* env, reaction_t* reaction, int worker) {
+    _lf_reaction_begins(env, reaction, worker);
+#ifdef LF_REACTION_STATS
+#ifdef LF_REACTION_COUNTERS
+    lf_counter_sample_t counters_start;
+    _lf_read_reaction_counters(&counters_start);
+#endif
+    instant_t reaction_start = lf_time_physical();
+    reaction->function(reaction->self);
+    interval_t execution_time = lf_time_physical() - reaction_start;
+#ifdef LF_REACTION_COUNTERS
+    _lf_record_reaction_counters(env, reaction, worker, &counters_start);
+#endif
+    _lf_record_reaction_time(env, reaction, worker, execution_time);
+#else
+    reaction->function(reaction->self);
+#endif
+    _lf_reaction_ends(env, reaction, worker);
+}
+
+#ifndef LF_EXECUTE_NOW_MAX_CHAIN
+#define LF_EXECUTE_NOW_MAX_CHAIN 16
+#endif
+
+/**
+ * Return whether the specified reaction, which has just been enabled by the
+ * reaction that the calling worker has executed, may be executed immediately
+ * by that worker without violating the order in which reactions would
+ * otherwise be executed. This is not the case if a reaction with an earlier
+ * deadline is ready to execute.
+ * @param env Environment in which we are executing.
+ * @param reaction The candidate reaction to execute immediately.
+ */
+static bool _lf_may_execute_now(environment_t* env, reaction_t* reaction) {
+#ifdef LF_SUSPENDABLE_REACTIONS
+    // A suspendable reaction executes on a coroutine of a worker, which the
+    // worker that would execute it now does not have.
+    if (reaction->suspendable) {
+        return false;
+    }
+#endif
+#ifdef LF_SINGLE_THREADED
+    reaction_t* head = (reaction_t*)pqueue_peek(env->reaction_q);
+    return head == NULL || LF_INDEX_DEADLINE(head->index) >= LF_INDEX_DEADLINE(reaction->index);
+#else
+    return lf_sched_may_execute_now(env->scheduler, reaction);
+#endif
+}
+
+/** A downstream reaction and the position at which it first appears in the triggers of an output. */
+typedef struct {
+    reaction_t* reaction;
+    size_t position;
+} _lf_downstream_t;
+
+/** Order downstream reactions by index and then by address, which makes duplicates adjacent. */
+static int _lf_compare_downstream_by_reaction(const void* a, const void* b) {
+    const _lf_downstream_t* x = (const _lf_downstream_t*)a;
+    const _lf_downstream_t* y = (const _lf_downstream_t*)b;
+    if (x->reaction->index != y->reaction->index) {
+        return (x->reaction->index < y->reaction->index) ? -1 : 1;
+    }
+    if (x->reaction != y->reaction) {
+        return ((uintptr_t)x->reaction < (uintptr_t)y->reaction) ? -1 : 1;
+    }
+    return (x->position < y->position) ? -1 : (x->position > y->position);
+}
+
+/** Order downstream reactions by index and then by position, which keeps the order of the triggers. */
+static int _lf_compare_downstream_by_position(const void* a, const void* b) {
+    const _lf_downstream_t* x = (const _lf_downstream_t*)a;
+    const _lf_downstream_t* y = (const _lf_downstream_t*)b;
+    if (x->reaction->index != y->reaction->index) {
+        return (x->reaction->index < y->reaction->index) ? -1 : 1;
+    }
+    return (x->position < y->position) ? -1 : (x->position > y->position);
+}
+
+/**
+ * Return the fan-out of the specified reaction, building it if the reaction has
+ * not produced an output before. The fan-out is only accessed by the worker
+ * executing the reaction, which no other worker does at the same time.
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction that has just executed.
+ */
+static lf_fan_out_t* _lf_get_fan_out(environment_t* env, reaction_t* reaction) {
+    if (reaction->fan_out != NULL) {
+        return reaction->fan_out;
+    }
+    size_t capacity = 0;
+    for (size_t i = 0; i < reaction->num_outputs; i++) {
+        for (int j = 0; j < reaction->triggered_sizes[i]; j++) {
+            trigger_t* trigger = reaction->triggers[i][j];
+            if (trigger != NULL) {
+                capacity += (size_t)trigger->number_of_reactions;
+            }
+        }
+    }
+    lf_fan_out_t* fan_out = (lf_fan_out_t*)malloc(sizeof(lf_fan_out_t)
+            + (reaction->num_outputs + 1) * sizeof(size_t) + capacity * sizeof(reaction_t*));
+    _lf_downstream_t* downstream = (_lf_downstream_t*)malloc((capacity + 1) * sizeof(_lf_downstream_t));
+    lf_assert(fan_out != NULL && downstream != NULL, "Out of memory");
+    fan_out->offsets = (size_t*)(fan_out + 1);
+    fan_out->reactions = (reaction_t**)(fan_out->offsets + reaction->num_outputs + 1);
+    size_t count = 0;
+    for (size_t i = 0; i < reaction->num_outputs; i++) {
+        fan_out->offsets[i] = count;
+        size_t size = 0;
+        for (int j = 0; j < reaction->triggered_sizes[i]; j++) {
+            trigger_t* trigger = reaction->triggers[i][j];
+            for (int k = 0; trigger != NULL && k < trigger->number_of_reactions; k++) {
+                if (trigger->reactions[k] != NULL) {
+                    downstream[size].reaction = trigger->reactions[k];
+                    downstream[size].position = size;
+                    size++;
+                }
+            }
+        }
+        // Drop the duplicates, keeping the first occurrence of each reaction.
+        qsort(downstream, size, sizeof(_lf_downstream_t), _lf_compare_downstream_by_reaction);
+        size_t unique = 0;
+        for (size_t k = 0; k < size; k++) {
+            if (unique == 0 || downstream[unique - 1].reaction != downstream[k].reaction) {
+                downstream[unique++] = downstream[k];
+            }
+        }
+        qsort(downstream, unique, sizeof(_lf_downstream_t), _lf_compare_downstream_by_position);
+        for (size_t k = 0; k < unique; k++) {
+            fan_out->reactions[count++] = downstream[k].reaction;
+        }
+    }
+    fan_out->offsets[reaction->num_outputs] = count;
+    free(downstream);
+    LF_PRINT_DEBUG("Reaction %s has %zu downstream reactions across %zu outputs.",
+            reaction->name, count, reaction->num_outputs);
+
+    lf_critical_section_enter(env);
+    fan_out->next = env->fan_outs;
+    env->fan_outs = fan_out;
+    lf_critical_section_exit(env);
+    reaction->fan_out = fan_out;
+    return fan_out;
+}
 
+/**
+ * For the specified reaction, if it has produced outputs, insert the
+ * resulting triggered reactions into the reaction queue, except for a
+ * single downstream reaction that may instead be executed immediately.
+ * The reactions downstream of each produced output are taken from the
+ * fan-out of the reaction and inserted into the queue with one call,
+ * so that an output broadcast to many reactions reserves space in the
+ * queue of each level once.
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction that has just executed.
+ * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
+ * @param execute_now_allowed Whether a downstream reaction may be returned to be executed
+ *  immediately. If false, all triggered reactions are put on the reaction queue.
+ * @return The downstream reaction to execute immediately or NULL if there is none.
+ */
+static reaction_t* _lf_trigger_output_reactions(
+        environment_t *env,
+        reaction_t* reaction,
+        int worker,
+        bool execute_now_allowed
+) {
     // If the reaction produced outputs, put the resulting triggered
     // reactions into the reaction queue. As an optimization, if exactly one
     // downstream reaction is enabled by this reaction, then it may be
     // executed immediately in this same thread
     // without going through the reaction queue.
     reaction_t* downstream_to_execute_now = NULL;
-    int num_downstream_reactions = 0;
+    bool queued = false;
+    lf_fan_out_t* fan_out = NULL;
 #ifdef FEDERATED_DECENTRALIZED // Only pass down STP violation for federated programs that use decentralized coordination.
     // Extract the inherited STP violation
     bool inherited_STP_violation = reaction->is_STP_violated;
@@ -1386,136 +2770,190 @@ void schedule_output_reactions(environment_t *env, reaction_t* reaction, int wor
     LF_PRINT_DEBUG("There are %zu outputs from reaction %s.", reaction->num_outputs, reaction->name);
     for (size_t i=0; i < reaction->num_outputs; i++) {
         if (reaction->output_produced[i] != NULL && *(reaction->output_produced[i])) {
-            LF_PRINT_DEBUG("Output %zu has been produced.", i);
-            trigger_t** triggerArray = (reaction->triggers)[i];
-            LF_PRINT_DEBUG("There are %d trigger arrays associated with output %zu.",
-                    reaction->triggered_sizes[i], i);
-            for (int j=0; j < reaction->triggered_sizes[i]; j++) {
-                trigger_t* trigger = triggerArray[j];
-                if (trigger != NULL) {
-                    LF_PRINT_DEBUG("Trigger %p lists %d reactions.", trigger, trigger->number_of_reactions);
-                    for (int k=0; k < trigger->number_of_reactions; k++) {
-                        reaction_t* downstream_reaction = trigger->reactions[k];
+            if (fan_out == NULL) {
+                fan_out = _lf_get_fan_out(env, reaction);
+            }
+            reaction_t** downstream = &fan_out->reactions[fan_out->offsets[i]];
+            size_t size = fan_out->offsets[i + 1] - fan_out->offsets[i];
+            LF_PRINT_DEBUG("Output %zu has been produced, which enables %zu reactions.", i, size);
+            if (size == 0) {
+                continue;
+            }
 #ifdef FEDERATED_DECENTRALIZED // Only pass down tardiness for federated LF programs
-                        // Set the is_STP_violated for the downstream reaction
-                        if (downstream_reaction != NULL) {
-                            downstream_reaction->is_STP_violated = inherited_STP_violation;
-                            LF_PRINT_DEBUG("Passing is_STP_violated of %d to the downstream reaction: %s",
-                                    downstream_reaction->is_STP_violated, downstream_reaction->name);
-                        }
+            // Set the is_STP_violated for the downstream reactions
+            for (size_t k = 0; k < size; k++) {
+                downstream[k]->is_STP_violated = inherited_STP_violation;
+                LF_PRINT_DEBUG("Passing is_STP_violated of %d to the downstream reaction: %s",
+                        downstream[k]->is_STP_violated, downstream[k]->name);
+            }
 #endif
-                        if (downstream_reaction != NULL && downstream_reaction != downstream_to_execute_now) {
-                            num_downstream_reactions++;
-                            // If there is exactly one downstream reaction that is enabled by this
-                            // reaction, then we can execute that reaction immediately without
-                            // going through the reaction queue. In multithreaded execution, this
-                            // avoids acquiring a mutex lock.
-                            // FIXME: Check the earliest deadline on the reaction queue.
-                            // This optimization could violate EDF scheduling otherwise.
-                            if (num_downstream_reactions == 1 && downstream_reaction->last_enabling_reaction == reaction) {
-                                // So far, this downstream reaction is a candidate to execute now.
-                                downstream_to_execute_now = downstream_reaction;
-                            } else {
-                                // If there is a previous candidate reaction to execute now,
-                                // it is no longer a candidate.
-                                if (downstream_to_execute_now != NULL) {
-                                    // More than one downstream reaction is enabled.
-                                    // In this case, if we were to execute the downstream reaction
-                                    // immediately without changing any queues, then the second
-                                    // downstream reaction would be blocked because this reaction
-                                    // remains on the executing queue. Hence, the optimization
-                                    // is not valid. Put the candidate reaction on the queue.
-                                    _lf_trigger_reaction(env, downstream_to_execute_now, worker);
-                                    downstream_to_execute_now = NULL;
-                                }
-                                // Queue the reaction.
-                                _lf_trigger_reaction(env, downstream_reaction, worker);
-                            }
-                        }
-                    }
-                }
+            // If there is exactly one downstream reaction that is enabled by this
+            // reaction, then we can execute that reaction immediately without
+            // going through the reaction queue. In multithreaded execution, this
+            // avoids acquiring a mutex lock.
+            // Whether this is consistent with the order in which the scheduler
+            // executes reactions is checked once all downstream reactions are known.
+            if (size == 1 && downstream[0] == downstream_to_execute_now) {
+                continue;
             }
+            if (execute_now_allowed && !queued && size == 1 && downstream_to_execute_now == NULL
+                    && downstream[0]->last_enabling_reaction == reaction) {
+                // So far, this downstream reaction is a candidate to execute now.
+                downstream_to_execute_now = downstream[0];
+                continue;
+            }
+            if (downstream_to_execute_now != NULL) {
+                // More than one downstream reaction is enabled.
+                // In this case, if we were to execute the downstream reaction
+                // immediately without changing any queues, then the second
+                // downstream reaction would be blocked because this reaction
+                // remains on the executing queue. Hence, the optimization
+                // is not valid. Put the candidate reaction on the queue.
+                _lf_trigger_reaction(env, downstream_to_execute_now, worker);
+                downstream_to_execute_now = NULL;
+            }
+            // Queue the reactions.
+            _lf_trigger_reactions(env, downstream, size, worker);
+            queued = true;
         }
     }
-    if (downstream_to_execute_now != NULL) {
-        LF_PRINT_LOG("Worker %d: Optimizing and executing downstream reaction now: %s", worker, downstream_to_execute_now->name);
-        bool violation = false;
+    if (downstream_to_execute_now != NULL && !_lf_may_execute_now(env, downstream_to_execute_now)) {
+        // A reaction with an earlier deadline is ready. Executing the candidate
+        // first could violate EDF scheduling, so put it on the queue instead.
+        _lf_trigger_reaction(env, downstream_to_execute_now, worker);
+        downstream_to_execute_now = NULL;
+    }
+    return downstream_to_execute_now;
+}
+
+/**
+ * Execute the specified reaction immediately, without it going through the
+ * reaction queue, or handle its STP violation or deadline miss.
+ * If a violation handler is invoked, the reactions triggered by the handler
+ * are scheduled before returning.
+ * @param env Environment in which we are executing.
+ * @param downstream_to_execute_now The reaction to execute.
+ * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
+ * @return True if the reaction itself was invoked, in which case the caller is
+ *  responsible for scheduling the reactions that it triggers.
+ */
+static bool _lf_execute_now(environment_t *env, reaction_t* downstream_to_execute_now, int worker) {
+    LF_PRINT_LOG("Worker %d: Optimizing and executing downstream reaction now: %s", worker, downstream_to_execute_now->name);
+    bool violation = false;
 #ifdef FEDERATED_DECENTRALIZED // Only use the STP handler for federated programs that use decentralized coordination
-        // If the is_STP_violated for the reaction is true,
-        // an input trigger to this reaction has been triggered at a later
-        // logical time than originally anticipated. In this case, a special
-        // STP handler will be invoked.
-        // FIXME: Note that the STP handler will be invoked
-        // at most once per logical time value. If the STP handler triggers the
-        // same reaction at the current time value, even if at a future superdense time,
-        // then the reaction will be invoked and the STP handler will not be invoked again.
-        // However, input ports to a federate reactor are network port types so this possibly should
-        // be disallowed.
-        // @note The STP handler and the deadline handler are not mutually exclusive.
-        //  In other words, both can be invoked for a reaction if it is triggered late
-        //  in logical time (STP offset is violated) and also misses the constraint on
-        //  physical time (deadline).
-        // @note In absence of a STP handler, the is_STP_violated will be passed down the reaction
-        //  chain until it is dealt with in a downstream STP handler.
-        if (downstream_to_execute_now->is_STP_violated == true) {
-            // Tardiness has occurred
-            LF_PRINT_LOG("Event has STP violation.");
-            reaction_function_t handler = downstream_to_execute_now->STP_handler;
-            // Invoke the STP handler if there is one.
+    // If the is_STP_violated for the reaction is true,
+    // an input trigger to this reaction has been triggered at a later
+    // logical time than originally anticipated. In this case, a special
+    // STP handler will be invoked.
+    // FIXME: Note that the STP handler will be invoked
+    // at most once per logical time value. If the STP handler triggers the
+    // same reaction at the current time value, even if at a future superdense time,
+    // then the reaction will be invoked and the STP handler will not be invoked again.
+    // However, input ports to a federate reactor are network port types so this possibly should
+    // be disallowed.
+    // @note The STP handler and the deadline handler are not mutually exclusive.
+    //  In other words, both can be invoked for a reaction if it is triggered late
+    //  in logical time (STP offset is violated) and also misses the constraint on
+    //  physical time (deadline).
+    // @note In absence of a STP handler, the is_STP_violated will be passed down the reaction
+    //  chain until it is dealt with in a downstream STP handler.
+    if (downstream_to_execute_now->is_STP_violated == true) {
+        // Tardiness has occurred
+        LF_PRINT_LOG("Event has STP violation.");
+        reaction_function_t handler = downstream_to_execute_now->STP_handler;
+        // Invoke the STP handler if there is one.
+        if (handler != NULL) {
+            // There is a violation and it is being handled here
+            // If there is no STP handler, pass the is_STP_violated
+            // to downstream reactions.
+            violation = true;
+            LF_PRINT_LOG("Invoke tardiness handler.");
+            (*handler)(downstream_to_execute_now->self);
+
+            // If the reaction produced outputs, put the resulting
+            // triggered reactions into the queue or execute them directly if possible.
+            schedule_output_reactions(env, downstream_to_execute_now, worker);
+
+            // Reset the tardiness because it has been dealt with in the
+            // STP handler
+            downstream_to_execute_now->is_STP_violated = false;
+            LF_PRINT_DEBUG("Reset reaction's is_STP_violated field to false: %s",
+                    downstream_to_execute_now->name);
+        }
+    }
+#endif
+    if (downstream_to_execute_now->deadline >= 0LL) {
+        // Get the current physical time.
+        instant_t physical_time = lf_time_physical();
+        // Check for deadline violation.
+        if (_lf_is_deadline_violated(env, downstream_to_execute_now, physical_time)) {
+            // Deadline violation has occurred.
+            tracepoint_reaction_deadline_missed(env->trace, downstream_to_execute_now, worker);
+            LF_PROBE2(deadline_missed, downstream_to_execute_now->name, worker);
+            violation = true;
+            // Invoke the local handler, if there is one.
+            reaction_function_t handler = downstream_to_execute_now->deadline_violation_handler;
             if (handler != NULL) {
-                // There is a violation and it is being handled here
-                // If there is no STP handler, pass the is_STP_violated
-                // to downstream reactions.
-                violation = true;
-                LF_PRINT_LOG("Invoke tardiness handler.");
+                // Assume the mutex is still not held.
                 (*handler)(downstream_to_execute_now->self);
 
                 // If the reaction produced outputs, put the resulting
                 // triggered reactions into the queue or execute them directly if possible.
                 schedule_output_reactions(env, downstream_to_execute_now, worker);
+            }
+        }
+    }
+    if (!violation) {
+        // Invoke the downstream_reaction function. The caller puts the resulting
+        // triggered reactions into the queue (or executes them directly, if possible).
+        _lf_invoke_reaction(env, downstream_to_execute_now, worker);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * For the specified reaction, if it has produced outputs, insert the
+ * resulting triggered reactions into the reaction queue.
+ * This procedure assumes the mutex lock is NOT held and grabs
+ * the lock only when it actually inserts something onto the reaction queue.
+ *
+ * As an optimization, if exactly one downstream reaction is enabled by a
+ * reaction and no reaction with an earlier deadline is ready, then the
+ * downstream reaction is executed immediately. This is repeated along linear
+ * chains of reactions for up to LF_EXECUTE_NOW_MAX_CHAIN reactions, after which
+ * the rest of the chain goes through the reaction queue so that the worker
+ * does not monopolize the remaining work of the tag.
+ * @param env Environment in which we are executing.
+ * @param reaction The reaction that has just executed.
+ * @param worker The thread number of the worker thread or 0 for single-threaded execution (for tracing).
+ */
+void schedule_output_reactions(environment_t *env, reaction_t* reaction, int worker) {
+    assert(env != GLOBAL_ENVIRONMENT);
 
-                // Reset the tardiness because it has been dealt with in the
-                // STP handler
+    for (int chain_length = 0; reaction != NULL; chain_length++) {
+        reaction_t* downstream_to_execute_now = _lf_trigger_output_reactions(
+                env, reaction, worker, chain_length < LF_EXECUTE_NOW_MAX_CHAIN);
+        if (chain_length > 0) {
+            // Reset the is_STP_violated because it has been passed
+            // down the chain
+            reaction->is_STP_violated = false;
+            LF_PRINT_DEBUG("Finally, reset reaction's is_STP_violated field to false: %s",
+                    reaction->name);
+        }
+        reaction = NULL;
+        if (downstream_to_execute_now != NULL) {
+            if (_lf_execute_now(env, downstream_to_execute_now, worker)) {
+                // Continue along the chain with the outputs of the downstream reaction.
+                reaction = downstream_to_execute_now;
+            } else {
+                // Reset the is_STP_violated because it has been passed
+                // down the chain
                 downstream_to_execute_now->is_STP_violated = false;
-                LF_PRINT_DEBUG("Reset reaction's is_STP_violated field to false: %s",
+                LF_PRINT_DEBUG("Finally, reset reaction's is_STP_violated field to false: %s",
                         downstream_to_execute_now->name);
             }
         }
-#endif
-        if (downstream_to_execute_now->deadline >= 0LL) {
-            // Get the current physical time.
-            instant_t physical_time = lf_time_physical();
-            // Check for deadline violation.
-            if (downstream_to_execute_now->deadline == 0 || physical_time > env->current_tag.time + downstream_to_execute_now->deadline) {
-                // Deadline violation has occurred.
-                tracepoint_reaction_deadline_missed(env->trace, downstream_to_execute_now, worker);
-                violation = true;
-                // Invoke the local handler, if there is one.
-                reaction_function_t handler = downstream_to_execute_now->deadline_violation_handler;
-                if (handler != NULL) {
-                    // Assume the mutex is still not held.
-                    (*handler)(downstream_to_execute_now->self);
-
-                    // If the reaction produced outputs, put the resulting
-                    // triggered reactions into the queue or execute them directly if possible.
-                    schedule_output_reactions(env, downstream_to_execute_now, worker);
-                }
-            }
-        }
-        if (!violation) {
-            // Invoke the downstream_reaction function.
-            _lf_invoke_reaction(env, downstream_to_execute_now, worker);
-
-            // If the downstream_reaction produced outputs, put the resulting triggered
-            // reactions into the queue (or execute them directly, if possible).
-            schedule_output_reactions(env, downstream_to_execute_now, worker);
-        }
-
-        // Reset the is_STP_violated because it has been passed
-        // down the chain
-        downstream_to_execute_now->is_STP_violated = false;
-        LF_PRINT_DEBUG("Finally, reset reaction's is_STP_violated field to false: %s",
-                downstream_to_execute_now->name);
     }
 }
 
@@ -1534,11 +2972,63 @@ void usage(int argc, const char* argv[]) {
     printf("   Whether continue execution even when there are no events to process.\n\n");
     printf("  -w, --workers <n>\n");
     printf("   Executed in <n> threads if possible (optional feature).\n\n");
+    printf("  -p, --pin [true | false]\n");
+    printf("   Whether to pin each worker thread to its own core (optional feature).\n\n");
+    printf("  --numa <n>\n");
+    printf("   Distribute the worker threads over <n> NUMA nodes (optional feature).\n\n");
+    printf("  --scheduler <name>\n");
+    printf("   Use the scheduler <name>, such as NP, GEDF_NP, or ADAPTIVE (optional feature).\n\n");
+    printf("  --sched-state <file>\n");
+    printf("   Load and save the state learned by the adaptive scheduler in <file> (optional feature).\n\n");
+    printf("  --memory-profile <file>\n");
+    printf("   Preallocate the events and tokens recorded in <file> and fail if more are needed,\n");
+    printf("   or record them there if <file> does not exist (optional feature).\n\n");
+    printf("  --resume <file>\n");
+    printf("   Resume from the checkpoint in <file> if it exists rather than from the start.\n\n");
+    printf("  --record <file>\n");
+    printf("   Record the schedules of physical actions and the messages received in <file>.\n\n");
+    printf("  --replay <file>\n");
+    printf("   Schedule the physical actions as recorded in <file> instead of as requested.\n\n");
+    printf("  --replay-speed <factor>\n");
+    printf("   Replay the recorded schedules <factor> times faster than they were made.\n\n");
+    printf("  --binary-log <file>\n");
+    printf("   Write the binary log of LOG and DEBUG messages to <file> (optional feature).\n\n");
+    printf("  --trace-to <destination>\n");
+    printf("   Write the trace to a file, or stream it to tcp://host:port, udp://host:port,\n");
+    printf("   or the shared memory ring shm://name (optional feature).\n\n");
+    printf("  --trace-events <categories>\n");
+    printf("   Trace only the comma-separated categories among reactions, workers, scheduling,\n");
+    printf("   user, and federated (optional feature).\n\n");
+    printf("  --trace-reactors <names>\n");
+    printf("   Trace reactions, calls to schedule, and user events only for the comma-separated\n");
+    printf("   fully qualified reactor names or user event descriptions (optional feature).\n\n");
+    printf("  --realtime [true | false]\n");
+    printf("   Whether to run the worker threads with real-time priorities (optional feature).\n\n");
+    printf("  --deadline-admission [off | early | prune]\n");
+    printf("   Treat reactions that cannot complete by their deadline, given estimates of their\n");
+    printf("   execution times, as violating it, and with prune, do not trigger reactions\n");
+    printf("   feeding such a deadline.\n\n");
+    printf("  --criticality-policy [defer | shed]\n");
+    printf("   Whether reactions less critical than one at risk of missing its deadline are run\n");
+    printf("   last or not at all (optional feature).\n\n");
+    printf("  --critical-workers <n>\n");
+    printf("   Reserve <n> workers for reactions with a criticality above 0 (optional feature).\n\n");
+    printf("  --urgent-workers <n>\n");
+    printf("   Add <n> workers at a higher priority for reactions with deadlines, which preempt\n");
+    printf("   the others with --realtime (optional feature).\n\n");
+    printf("  -s, --spin <n>\n");
+    printf("   Idle workers spin up to <n> iterations before sleeping (0 disables spinning).\n\n");
+    printf("  --busy-wait <n>\n");
+    printf("   Sleep until <n> nanoseconds before each tag and spin for the rest (optional feature).\n\n");
+    printf("  --events <n>\n");
+    printf("   Preallocate <n> events for each environment (optional feature).\n\n");
     printf("  -i, --id <n>\n");
     printf("   The ID of the federation that this reactor will join.\n\n");
     #ifdef FEDERATED
     printf("  -r, --rti <n>\n");
     printf("   The address of the RTI, which can be in the form of user@host:port or ip:port.\n\n");
+    printf("  --net-priority <p>\n");
+    printf("   Run the network threads with real-time priority <p> (optional feature).\n\n");
     #endif
 
     printf("Command given:\n");
@@ -1653,6 +3143,226 @@ int process_args(int argc, const char* argv[]) {
                 num_workers = 1;
             }
             _lf_number_of_workers = (unsigned int)num_workers;
+        } else if (strcmp(arg, "-p") == 0 || strcmp(arg, "--pin") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--pin needs a boolean.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* pin_spec = argv[i++];
+            if (strcmp(pin_spec, "true") == 0) {
+                _lf_pin_workers = true;
+            } else if (strcmp(pin_spec, "false") == 0) {
+                _lf_pin_workers = false;
+            } else {
+                lf_print_error("Invalid value for --pin: %s", pin_spec);
+            }
+        } else if (strcmp(arg, "--numa") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--numa needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* numa_spec = argv[i++];
+            int numa_nodes = atoi(numa_spec);
+            if (numa_nodes < 0) {
+                lf_print_error("Invalid value for --numa: %s. Using 0.", numa_spec);
+                numa_nodes = 0;
+            }
+            _lf_numa_nodes = (unsigned int)numa_nodes;
+        } else if (strcmp(arg, "--scheduler") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--scheduler needs a scheduler name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_scheduler_name = argv[i++];
+        } else if (strcmp(arg, "--sched-state") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--sched-state needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_sched_state_file = argv[i++];
+        } else if (strcmp(arg, "--memory-profile") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--memory-profile needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_memory_profile_file = argv[i++];
+        } else if (strcmp(arg, "--resume") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--resume needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_resume_file = argv[i++];
+        } else if (strcmp(arg, "--record") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--record needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_record_file = argv[i++];
+        } else if (strcmp(arg, "--replay") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--replay needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_replay_file = argv[i++];
+        } else if (strcmp(arg, "--replay-speed") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--replay-speed needs a factor.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* factor = argv[i++];
+            char* end;
+            _lf_replay_speed = strtod(factor, &end);
+            if (*end != '\0' || !(_lf_replay_speed > 0.0)) {
+                lf_print_error("Invalid value for --replay-speed: %s.", factor);
+                usage(argc, argv);
+                return 0;
+            }
+        } else if (strcmp(arg, "--binary-log") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--binary-log needs a file name.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_binary_log_file = argv[i++];
+        } else if (strcmp(arg, "--trace-to") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--trace-to needs a destination.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_trace_destination = argv[i++];
+        } else if (strcmp(arg, "--trace-events") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--trace-events needs a list of categories.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_trace_events = argv[i++];
+        } else if (strcmp(arg, "--trace-reactors") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--trace-reactors needs a list of names.");
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_trace_reactors = argv[i++];
+        } else if (strcmp(arg, "--realtime") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--realtime needs a boolean.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* realtime_spec = argv[i++];
+            if (strcmp(realtime_spec, "true") == 0) {
+                _lf_realtime_workers = true;
+            } else if (strcmp(realtime_spec, "false") == 0) {
+                _lf_realtime_workers = false;
+            } else {
+                lf_print_error("Invalid value for --realtime: %s", realtime_spec);
+            }
+        } else if (strcmp(arg, "--deadline-admission") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--deadline-admission needs off, early, or prune.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* admission_spec = argv[i++];
+            if (strcmp(admission_spec, "off") == 0) {
+                _lf_deadline_admission = LF_DEADLINE_ADMISSION_OFF;
+            } else if (strcmp(admission_spec, "early") == 0) {
+                _lf_deadline_admission = LF_DEADLINE_ADMISSION_EARLY;
+            } else if (strcmp(admission_spec, "prune") == 0) {
+                _lf_deadline_admission = LF_DEADLINE_ADMISSION_PRUNE;
+            } else {
+                lf_print_error("Invalid value for --deadline-admission: %s", admission_spec);
+            }
+        } else if (strcmp(arg, "--criticality-policy") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--criticality-policy needs defer or shed.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* policy_spec = argv[i++];
+            if (strcmp(policy_spec, "defer") == 0) {
+                _lf_criticality_policy = LF_CRITICALITY_DEFER;
+            } else if (strcmp(policy_spec, "shed") == 0) {
+                _lf_criticality_policy = LF_CRITICALITY_SHED;
+            } else {
+                lf_print_error("Invalid value for --criticality-policy: %s", policy_spec);
+            }
+        } else if (strcmp(arg, "--critical-workers") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--critical-workers needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* workers_spec = argv[i++];
+            int critical_workers = atoi(workers_spec);
+            if (critical_workers < 0) {
+                lf_print_error("Invalid value for --critical-workers: %s. Using 0.", workers_spec);
+                critical_workers = 0;
+            }
+            _lf_critical_workers = (unsigned int)critical_workers;
+        } else if (strcmp(arg, "--urgent-workers") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--urgent-workers needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* workers_spec = argv[i++];
+            int urgent_workers = atoi(workers_spec);
+            if (urgent_workers < 0) {
+                lf_print_error("Invalid value for --urgent-workers: %s. Using 0.", workers_spec);
+                urgent_workers = 0;
+            }
+            _lf_urgent_workers = (unsigned int)urgent_workers;
+        } else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--spin") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--spin needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* spin_spec = argv[i++];
+            int spin_budget = atoi(spin_spec);
+            if (spin_budget < 0) {
+                lf_print_error("Invalid value for --spin: %s. Using 0.", spin_spec);
+                spin_budget = 0;
+            }
+            _lf_spin_budget = (unsigned int)spin_budget;
+        } else if (strcmp(arg, "--busy-wait") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--busy-wait needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* guard_spec = argv[i++];
+            long long guard = atoll(guard_spec);
+            if (guard < 0) {
+                lf_print_error("Invalid value for --busy-wait: %s. Using 0.", guard_spec);
+                guard = 0;
+            }
+            _lf_busy_wait_guard = (interval_t)guard;
+        } else if (strcmp(arg, "--events") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--events needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* events_spec = argv[i++];
+            long long pool_size = atoll(events_spec);
+            if (pool_size < 0) {
+                lf_print_error("Invalid value for --events: %s. Using 0.", events_spec);
+                pool_size = 0;
+            }
+            _lf_event_pool_size = (size_t)pool_size;
         }
         #ifdef FEDERATED
           else if (strcmp(arg, "-i") == 0 || strcmp(arg, "--id") == 0) {
@@ -1691,6 +3401,21 @@ int process_args(int argc, const char* argv[]) {
                 usage(argc, argv);
                 return 0;
             }
+        } else if (strcmp(arg, "--net-priority") == 0) {
+            if (argc < i + 1) {
+                lf_print_error("--net-priority needs an integer argument.");
+                usage(argc, argv);
+                return 0;
+            }
+            const char* priority_spec = argv[i++];
+            int priority = atoi(priority_spec);
+            if (priority < LF_SCHED_MIN_PRIORITY || priority > LF_SCHED_MAX_PRIORITY) {
+                lf_print_error("Invalid value for --net-priority: %s. Must be between %d and %d.",
+                        priority_spec, LF_SCHED_MIN_PRIORITY, LF_SCHED_MAX_PRIORITY);
+                usage(argc, argv);
+                return 0;
+            }
+            _lf_network_thread_priority = priority;
         }
         #endif
           else if (strcmp(arg, "--ros-args") == 0) {
@@ -1704,6 +3429,95 @@ int process_args(int argc, const char* argv[]) {
     return 1;
 }
 
+/** The number of calls to _lf_initialize_in_parallel() and the physical time they took. */
+static int _lf_parallel_initializations = 0;
+static interval_t _lf_parallel_initialization_time = 0;
+
+#if !defined(LF_SINGLE_THREADED)
+/** The work shared by the threads of a call to _lf_initialize_in_parallel(). */
+typedef struct {
+    size_t count;
+    size_t chunk_size;
+    int num_chunks;
+    volatile int next_chunk;
+    void (*initialize)(size_t, size_t, void*);
+    void* arg;
+} _lf_parallel_initialization_t;
+
+/**
+ * Initialize chunks of the specified work until none is left.
+ * @return NULL, to be usable as the function of a thread.
+ */
+static void* _lf_initialize_chunks(void* work_arg) {
+    _lf_parallel_initialization_t* work = (_lf_parallel_initialization_t*)work_arg;
+    _lf_defer_template_initialization();
+    int chunk;
+    while ((chunk = lf_atomic_fetch_add(&work->next_chunk, 1)) < work->num_chunks) {
+        size_t first = (size_t)chunk * work->chunk_size;
+        size_t end = (first + work->chunk_size < work->count) ? first + work->chunk_size : work->count;
+        work->initialize(first, end, work->arg);
+    }
+    _lf_complete_template_initialization();
+    return NULL;
+}
+#endif
+
+void _lf_initialize_in_parallel(
+        size_t count, size_t chunk_size, void (*initialize)(size_t, size_t, void*), void* arg) {
+    if (count == 0) return;
+    instant_t began = lf_time_physical();
+#if defined(LF_SINGLE_THREADED)
+    initialize(0, count, arg);
+#else
+    size_t num_threads = (_lf_number_of_workers > 0) ? _lf_number_of_workers : (size_t)lf_available_cores();
+    if (chunk_size == 0) {
+        // Give each thread a few chunks so that uneven chunks balance out.
+        chunk_size = (count + 4 * num_threads - 1) / (4 * num_threads);
+    }
+    _lf_parallel_initialization_t work = {
+        .count = count,
+        .chunk_size = chunk_size,
+        .num_chunks = (int)((count + chunk_size - 1) / chunk_size),
+        .next_chunk = 0,
+        .initialize = initialize,
+        .arg = arg
+    };
+    if (num_threads > (size_t)work.num_chunks) {
+        num_threads = (size_t)work.num_chunks;
+    }
+    lf_thread_t* threads = NULL;
+    if (num_threads > 1) {
+        threads = (lf_thread_t*)malloc((num_threads - 1) * sizeof(lf_thread_t));
+        lf_assert(threads != NULL, "Out of memory");
+        _lf_initializing_in_parallel = true;
+        for (size_t i = 0; i < num_threads - 1; i++) {
+            if (lf_thread_create(&threads[i], _lf_initialize_chunks, &work) != 0) {
+                lf_print_error_and_exit("Could not create a thread to initialize reactors.");
+            }
+        }
+    }
+    // The calling thread helps too.
+    _lf_initialize_chunks(&work);
+    for (size_t i = 0; i + 1 < num_threads; i++) {
+        lf_thread_join(threads[i], NULL);
+    }
+    free(threads);
+    _lf_initializing_in_parallel = false;
+    LF_PRINT_LOG("Initialized %zu instances in %d chunks with %zu threads.",
+            count, work.num_chunks, num_threads);
+#endif
+    _lf_parallel_initializations++;
+    _lf_parallel_initialization_time += lf_time_physical() - began;
+}
+
+void _lf_print_startup_times(interval_t environments, interval_t trigger_objects, interval_t start_tags) {
+    lf_print("---- Started up in " PRINTF_TIME " nsec: environments " PRINTF_TIME
+            ", trigger objects " PRINTF_TIME " (" PRINTF_TIME " in %d parallel initializations)"
+            ", start tags " PRINTF_TIME ".",
+            environments + trigger_objects + start_tags, environments, trigger_objects,
+            _lf_parallel_initialization_time, _lf_parallel_initializations, start_tags);
+}
+
 /**
  * Initialize global variables and start tracing before calling the
  * `_lf_initialize_trigger_objects` function
@@ -1715,7 +3529,13 @@ void initialize_global(void) {
     environment_t *envs;
     int num_envs = _lf_get_environments(&envs);
     for (int i = 0; i<num_envs; i++) {
+        if (_lf_trace_destination != NULL) {
+            trace_set_destination(envs[i].trace, _lf_trace_destination);
+        }
         start_trace(envs[i].trace);
+        if (trace_set_filters(envs[i].trace, _lf_trace_events, _lf_trace_reactors) != 0) {
+            lf_print_error_and_exit("Invalid value for --trace-events: %s", _lf_trace_events);
+        }
     }
 
     // Federation trace object must be set before `initialize_trigger_objects` is called because it
@@ -1740,16 +3560,24 @@ void termination(void) {
     // It should only be called for the top-level environment, which, after convention, is the first environment.
     terminate_execution(env);
 
+    _lf_print_memory_stats();
+    _lf_save_memory_profile();
 
     // In order to free tokens, we perform the same actions we would have for a new time step.
     for (int i = 0; i<num_envs; i++) {
         lf_print("---- Terminating environment %u", env->id);
+    #if !defined(LF_SINGLE_THREADED)
+        // Stop the thread that runs watchdog handlers.
+        _lf_terminate_watchdogs(env);
+    #endif
         if (!env->initialized) {
             lf_print_warning("---- Environment %u was never initialized", env->id);
             continue;
         }
         // Stop any tracing, if it is running.
         stop_trace(env->trace);
+        _lf_replay_free(env);
+        lf_print_reaction_stats(env);
 
         _lf_start_time_step(env);
 
@@ -1759,12 +3587,14 @@ void termination(void) {
     #endif
 
         // If the event queue still has events on it, report that.
-        if (env->event_q != NULL && pqueue_size(env->event_q) > 0) {
-            lf_print_warning("---- There are %zu unprocessed future events on the event queue.", pqueue_size(env->event_q));
-            event_t* event = (event_t*)pqueue_peek(env->event_q);
+        if (env->event_q != NULL && _lf_event_count(env) > 0) {
+            lf_print_warning("---- There are %zu unprocessed future events on the event queue.", _lf_event_count(env));
+            event_t* event = _lf_peek_event(env);
             interval_t event_time = event->time - start_time;
             lf_print_warning("---- The first future event has timestamp " PRINTF_TIME " after start time.", event_time);
         }
+        LF_PRINT_LOG("---- Environment %d allocated %zu events, of which %zu are still in use.",
+                env->id, env->events_allocated, env->events_live);
         // Print elapsed times.
         // If these are negative, then the program failed to start up.
         interval_t elapsed_time = lf_time_logical_elapsed(env);
@@ -1803,5 +3633,10 @@ void termination(void) {
         }
     }
 #endif
+    if (LF_ARENA_CHUNK_SIZE > 0) {
+        size_t used;
+        size_t reserved = lf_arena_footprint(&used);
+        LF_PRINT_LOG("Reactors used %zu of %zu bytes allocated in the arena.", used, reserved);
+    }
     _lf_free_all_reactors();
 }
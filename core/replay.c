@@ -0,0 +1,435 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Implementation of the recording and replay declared in @see replay.h
+ *
+ * A log consists of the magic number followed by records, each of which starts
+ * with its kind. A name record gives the id of a trigger, which the records after
+ * it use, and its name as a length followed by the characters. A schedule record
+ * holds the id of the physical action, the physical time of the schedule relative
+ * to the start time, and the extra delay. A message record holds the id of the
+ * network input action, the physical time of the arrival relative to the start
+ * time, and the tag of the message relative to the start time. Both end with the
+ * token, as a flag followed, if set, by the array length and the size of the
+ * payload in bytes and the payload itself.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "checkpoint.h"
+#include "environment.h"
+#include "lf_token.h"
+#include "platform.h"
+#include "reactor_common.h"
+#include "util.h"
+
+#define REPLAY_MAGIC "LFRPLY01"
+#define REPLAY_FILE_NAME_LENGTH 512
+#define REPLAY_BUFFER_SIZE (64 * 1024)
+
+extern instant_t start_time;
+
+/** The kinds of records in a log. */
+typedef enum {
+    REPLAY_NAME = 0,
+    REPLAY_SCHEDULE = 1,
+    REPLAY_MESSAGE = 2
+} lf_replay_kind_t;
+
+/** A trigger seen while recording. */
+typedef struct {
+    trigger_t* trigger;
+    int64_t id; // The id of the trigger in the log, or -1 if it is not registered and hence not recorded.
+} lf_replay_trigger_t;
+
+/** The recording and replay of an environment. */
+typedef struct lf_replay_t {
+    FILE* record;                  // The log being recorded, or NULL.
+    lf_replay_trigger_t* recorded; // The triggers seen while recording.
+    size_t num_recorded;
+    size_t recorded_capacity;
+    uint32_t num_ids;              // The number of triggers with an id in the log being recorded.
+    unsigned char* log;            // The contents of the log being replayed, or NULL.
+    size_t log_length;
+    trigger_t** replayed;          // The triggers of the log being replayed, indexed by id.
+    size_t num_replayed;
+    bool injecting;                // Whether the replay is scheduling an action.
+#if !defined(LF_SINGLE_THREADED)
+    lf_thread_t thread;
+    lf_mutex_t mutex;
+    lf_cond_t terminated;
+    bool terminate;
+#endif
+} lf_replay_t;
+
+/** A cursor over the contents of a log. */
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t position;
+    bool valid;
+} lf_replay_reader_t;
+
+/**
+ * Write the name of the log file of the environment into 'buffer'.
+ * @return Whether the name fits in the buffer.
+ */
+static bool _lf_replay_file_name(environment_t* env, const char* file_name, char* buffer, size_t length) {
+    int written = env->id == 0
+        ? snprintf(buffer, length, "%s", file_name)
+        : snprintf(buffer, length, "%s.%d", file_name, env->id);
+    return written >= 0 && (size_t)written < length;
+}
+
+#if !defined(LF_SINGLE_THREADED)
+/** Return a pointer to the next 'size' bytes and skip them, or NULL if the log is too short. */
+static const void* _lf_replay_read(lf_replay_reader_t* reader, size_t size) {
+    if (!reader->valid || size > reader->length - reader->position) {
+        reader->valid = false;
+        return NULL;
+    }
+    const void* result = reader->data + reader->position;
+    reader->position += size;
+    return result;
+}
+
+static uint64_t _lf_replay_read_u64(lf_replay_reader_t* reader) {
+    uint64_t value = 0;
+    const void* bytes = _lf_replay_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static int64_t _lf_replay_read_i64(lf_replay_reader_t* reader) {
+    int64_t value = 0;
+    const void* bytes = _lf_replay_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static uint32_t _lf_replay_read_u32(lf_replay_reader_t* reader) {
+    uint32_t value = 0;
+    const void* bytes = _lf_replay_read(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/** A schedule or message record, with its payload pointing into the log. */
+typedef struct {
+    lf_replay_kind_t kind;
+    uint32_t id;
+    interval_t time;       // The physical time relative to the start time.
+    interval_t delay;      // The extra delay of a schedule.
+    tag_t tag;             // The tag of a message relative to the start time.
+    bool has_token;
+    uint64_t length;
+    uint64_t size;
+    const void* payload;
+    const char* name;      // The name given by a name record.
+} lf_replay_record_t;
+
+/** Read the next record. The reader becomes invalid if the record is malformed. */
+static void _lf_replay_read_record(lf_replay_reader_t* reader, lf_replay_record_t* record) {
+    const uint8_t* kind = (const uint8_t*)_lf_replay_read(reader, 1);
+    if (kind == NULL) return;
+    record->kind = (lf_replay_kind_t)*kind;
+    record->id = _lf_replay_read_u32(reader);
+    if (record->kind == REPLAY_NAME) {
+        record->length = _lf_replay_read_u64(reader);
+        record->name = (const char*)_lf_replay_read(reader, (size_t)record->length);
+        return;
+    }
+    if (record->kind != REPLAY_SCHEDULE && record->kind != REPLAY_MESSAGE) {
+        reader->valid = false;
+        return;
+    }
+    record->time = _lf_replay_read_i64(reader);
+    if (record->kind == REPLAY_SCHEDULE) {
+        record->delay = _lf_replay_read_i64(reader);
+    } else {
+        record->tag.time = _lf_replay_read_i64(reader);
+        record->tag.microstep = _lf_replay_read_u32(reader);
+    }
+    const uint8_t* has_token = (const uint8_t*)_lf_replay_read(reader, 1);
+    record->has_token = has_token != NULL && *has_token;
+    record->length = record->size = 0;
+    record->payload = NULL;
+    if (record->has_token) {
+        record->length = _lf_replay_read_u64(reader);
+        record->size = _lf_replay_read_u64(reader);
+        record->payload = _lf_replay_read(reader, (size_t)record->size);
+    }
+}
+#endif // !defined(LF_SINGLE_THREADED)
+
+/**
+ * Return the id of 'trigger' in the log being recorded, writing a name record
+ * when the trigger is first seen, or -1 if the trigger is not registered.
+ */
+static int64_t _lf_replay_recorded_id(environment_t* env, lf_replay_t* replay, trigger_t* trigger) {
+    for (size_t i = 0; i < replay->num_recorded; i++) {
+        if (replay->recorded[i].trigger == trigger) {
+            return replay->recorded[i].id;
+        }
+    }
+    if (replay->num_recorded == replay->recorded_capacity) {
+        replay->recorded_capacity = (replay->recorded_capacity == 0) ? 8 : 2 * replay->recorded_capacity;
+        replay->recorded = (lf_replay_trigger_t*)realloc(replay->recorded,
+                replay->recorded_capacity * sizeof(lf_replay_trigger_t));
+        lf_assert(replay->recorded != NULL, "Out of memory");
+    }
+    const char* name = _lf_checkpoint_name_of_trigger(env, trigger);
+    lf_replay_trigger_t* entry = &replay->recorded[replay->num_recorded++];
+    entry->trigger = trigger;
+    entry->id = (name == NULL) ? -1 : (int64_t)replay->num_ids;
+    if (name == NULL) {
+        lf_print_warning("Inputs of the unregistered trigger %p are not recorded.", (void*)trigger);
+        return -1;
+    }
+    uint32_t id = replay->num_ids++;
+    uint8_t kind = REPLAY_NAME;
+    uint64_t length = (uint64_t)strlen(name);
+    fwrite(&kind, 1, 1, replay->record);
+    fwrite(&id, sizeof(id), 1, replay->record);
+    fwrite(&length, sizeof(length), 1, replay->record);
+    fwrite(name, 1, length, replay->record);
+    return (int64_t)id;
+}
+
+/** Write the token of a record. Payloads that cannot be copied bytewise are omitted. */
+static void _lf_replay_write_token(lf_replay_t* replay, lf_token_t* token) {
+    uint8_t has_token = (token != NULL && token->type->destructor == NULL && token->type->copy_constructor == NULL);
+    fwrite(&has_token, 1, 1, replay->record);
+    if (!has_token) return;
+    uint64_t length = (uint64_t)token->length;
+    uint64_t size = (token->value == NULL) ? 0 : (uint64_t)(token->length * token->type->element_size);
+    fwrite(&length, sizeof(length), 1, replay->record);
+    fwrite(&size, sizeof(size), 1, replay->record);
+    fwrite(token->value, 1, size, replay->record);
+}
+
+/** Return whether the log being replayed holds the inputs of 'trigger'. */
+static bool _lf_replay_holds(lf_replay_t* replay, trigger_t* trigger) {
+    for (size_t i = 0; i < replay->num_replayed; i++) {
+        if (replay->replayed[i] == trigger) return true;
+    }
+    return false;
+}
+
+bool _lf_replay_schedule(environment_t* env, trigger_t* trigger, instant_t physical_time,
+        interval_t extra_delay, lf_token_t* token) {
+    lf_replay_t* replay = env->replay;
+    if (replay->log != NULL && !replay->injecting && _lf_replay_holds(replay, trigger)) {
+        return false;
+    }
+    if (replay->record != NULL) {
+        int64_t id = _lf_replay_recorded_id(env, replay, trigger);
+        if (id >= 0) {
+            uint8_t kind = REPLAY_SCHEDULE;
+            uint32_t id32 = (uint32_t)id;
+            int64_t time = physical_time - start_time;
+            int64_t delay = extra_delay;
+            fwrite(&kind, 1, 1, replay->record);
+            fwrite(&id32, sizeof(id32), 1, replay->record);
+            fwrite(&time, sizeof(time), 1, replay->record);
+            fwrite(&delay, sizeof(delay), 1, replay->record);
+            _lf_replay_write_token(replay, token);
+        }
+    }
+    return true;
+}
+
+void _lf_replay_record_message(environment_t* env, trigger_t* trigger, tag_t tag, lf_token_t* token) {
+    lf_replay_t* replay = env->replay;
+    if (replay == NULL || replay->record == NULL) return;
+    int64_t id = _lf_replay_recorded_id(env, replay, trigger);
+    if (id < 0) return;
+    uint8_t kind = REPLAY_MESSAGE;
+    uint32_t id32 = (uint32_t)id;
+    int64_t time = lf_time_physical() - start_time;
+    int64_t tag_time = tag.time - start_time;
+    uint32_t microstep = tag.microstep;
+    fwrite(&kind, 1, 1, replay->record);
+    fwrite(&id32, sizeof(id32), 1, replay->record);
+    fwrite(&time, sizeof(time), 1, replay->record);
+    fwrite(&tag_time, sizeof(tag_time), 1, replay->record);
+    fwrite(&microstep, sizeof(microstep), 1, replay->record);
+    _lf_replay_write_token(replay, token);
+}
+
+#if !defined(LF_SINGLE_THREADED)
+/**
+ * Wait until physical time reaches 'time' or the replay is terminated.
+ * This assumes that the caller holds the mutex of the replay.
+ * @return Whether the replay is to continue.
+ */
+static bool _lf_replay_wait_until(lf_replay_t* replay, instant_t time) {
+    while (!replay->terminate) {
+        instant_t physical_time = lf_time_physical();
+        if (physical_time >= time) return true;
+        // lf_cond_timedwait() waits until a time of the clock without the offsets
+        // that lf_time_physical() applies.
+        instant_t unadjusted_time;
+        _lf_clock_now(&unadjusted_time);
+        lf_cond_timedwait(&replay->terminated, unadjusted_time + (time - physical_time));
+    }
+    return false;
+}
+
+/**
+ * @brief Thread function of the replay of an environment. It schedules the
+ * physical actions of the log at their recorded times divided by the speed.
+ * @param arg The environment.
+ * @return NULL
+ */
+static void* _lf_replay_run(void* arg) {
+    environment_t* env = (environment_t*)arg;
+    lf_replay_t* replay = env->replay;
+    lf_replay_reader_t reader = {.data = replay->log, .length = replay->log_length, .position = 8, .valid = true};
+    size_t replayed = 0;
+    lf_mutex_lock(&replay->mutex);
+    while (reader.position < reader.length) {
+        lf_replay_record_t record;
+        _lf_replay_read_record(&reader, &record);
+        if (record.kind != REPLAY_SCHEDULE) continue;
+        instant_t time = start_time + (interval_t)((double)record.time / _lf_replay_speed);
+        if (!_lf_replay_wait_until(replay, time)) break;
+        trigger_t* trigger = replay->replayed[record.id];
+        lf_critical_section_enter(env);
+        if (lf_tag_compare(env->current_tag, env->stop_tag) >= 0) {
+            lf_critical_section_exit(env);
+            break;
+        }
+        lf_token_t* token = NULL;
+        if (record.has_token) {
+            if (record.size == 0) {
+                token = _lf_new_token((token_type_t*)trigger, NULL, 0);
+            } else {
+                token = _lf_new_token_with_payload((token_type_t*)trigger, (size_t)record.length, (size_t)record.size);
+                lf_assert(token != NULL, "Out of memory");
+                memcpy(token->value, record.payload, (size_t)record.size);
+            }
+        }
+        // Keep the recorded time unless the replay has fallen behind the current tag.
+        replay->injecting = true;
+        _lf_schedule_at_physical_time(env, trigger, record.delay, token, LF_MAX(time, env->current_tag.time));
+        replay->injecting = false;
+        lf_notify_of_event(env);
+        lf_critical_section_exit(env);
+        replayed++;
+    }
+    lf_mutex_unlock(&replay->mutex);
+    LF_PRINT_LOG("Environment %u: Replayed %zu schedules of physical actions.", env->id, replayed);
+    return NULL;
+}
+
+/**
+ * Load the log to replay and find the triggers that it refers to.
+ * This exits if the log is malformed or does not match the program.
+ */
+static void _lf_replay_load(environment_t* env, lf_replay_t* replay) {
+    char name[REPLAY_FILE_NAME_LENGTH];
+    if (!_lf_replay_file_name(env, _lf_replay_file, name, sizeof(name))) {
+        lf_print_error_and_exit("Replay file name %s is too long.", _lf_replay_file);
+    }
+    FILE* file = fopen(name, "rb");
+    if (file == NULL) {
+        lf_print_error_and_exit("Failed to open %s to replay.", name);
+    }
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        replay->log = (unsigned char*)malloc(length > 0 ? (size_t)length : 1);
+        lf_assert(replay->log != NULL, "Out of memory");
+        if (fread(replay->log, 1, (size_t)length, file) != (size_t)length) length = -1;
+    }
+    fclose(file);
+    lf_replay_reader_t reader = {.data = replay->log, .length = (size_t)length, .position = 0, .valid = length >= 0};
+    const void* magic = _lf_replay_read(&reader, 8);
+    if (magic == NULL || memcmp(magic, REPLAY_MAGIC, 8) != 0) {
+        lf_print_error_and_exit("%s is not a log of inputs.", name);
+    }
+    replay->log_length = (size_t)length;
+    size_t capacity = 0;
+    while (reader.valid && reader.position < reader.length) {
+        lf_replay_record_t record;
+        _lf_replay_read_record(&reader, &record);
+        if (!reader.valid) break;
+        if (record.kind == REPLAY_NAME) {
+            trigger_t* trigger = _lf_checkpoint_trigger_named(env, record.name, (size_t)record.length);
+            if (trigger == NULL || record.id != replay->num_replayed) {
+                lf_print_error_and_exit("%s refers to %.*s, which is not registered.", name,
+                        (int)record.length, record.name);
+            }
+            if (replay->num_replayed == capacity) {
+                capacity = (capacity == 0) ? 8 : 2 * capacity;
+                replay->replayed = (trigger_t**)realloc(replay->replayed, capacity * sizeof(trigger_t*));
+                lf_assert(replay->replayed != NULL, "Out of memory");
+            }
+            replay->replayed[replay->num_replayed++] = trigger;
+        } else if (record.id >= replay->num_replayed) {
+            reader.valid = false;
+        }
+    }
+    if (!reader.valid) {
+        lf_print_error_and_exit("The log %s is malformed.", name);
+    }
+}
+#endif // !defined(LF_SINGLE_THREADED)
+
+void _lf_replay_start(environment_t* env) {
+    if ((_lf_record_file == NULL && _lf_replay_file == NULL) || env->replay != NULL) return;
+    lf_replay_t* replay = (lf_replay_t*)calloc(1, sizeof(lf_replay_t));
+    lf_assert(replay != NULL, "Out of memory");
+    env->replay = replay;
+    if (_lf_replay_file != NULL) {
+#if defined(LF_SINGLE_THREADED)
+        lf_print_error_and_exit("Replaying inputs requires the threaded runtime.");
+#else
+        _lf_replay_load(env, replay);
+        lf_mutex_init(&replay->mutex);
+        lf_cond_init(&replay->terminated, &replay->mutex);
+        lf_thread_create(&replay->thread, _lf_replay_run, env);
+        lf_print("Environment %u: ---- Replaying inputs from %s at %g times their speed.",
+                env->id, _lf_replay_file, _lf_replay_speed);
+#endif
+    }
+    if (_lf_record_file != NULL) {
+        char name[REPLAY_FILE_NAME_LENGTH];
+        if (!_lf_replay_file_name(env, _lf_record_file, name, sizeof(name))) {
+            lf_print_error_and_exit("Record file name %s is too long.", _lf_record_file);
+        }
+        replay->record = fopen(name, "wb");
+        if (replay->record == NULL) {
+            lf_print_error_and_exit("Failed to open %s to record inputs.", name);
+        }
+        setvbuf(replay->record, NULL, _IOFBF, REPLAY_BUFFER_SIZE);
+        fwrite(REPLAY_MAGIC, 1, 8, replay->record);
+    }
+}
+
+void _lf_replay_free(environment_t* env) {
+    lf_replay_t* replay = env->replay;
+    if (replay == NULL) return;
+#if !defined(LF_SINGLE_THREADED)
+    if (replay->log != NULL) {
+        lf_mutex_lock(&replay->mutex);
+        replay->terminate = true;
+        lf_cond_signal(&replay->terminated);
+        lf_mutex_unlock(&replay->mutex);
+        lf_thread_join(replay->thread, NULL);
+    }
+#endif
+    if (replay->record != NULL && fclose(replay->record) != 0) {
+        lf_print_warning("Failed to complete the log of inputs %s.", _lf_record_file);
+    }
+    free(replay->recorded);
+    free(replay->replayed);
+    free(replay->log);
+    free(replay);
+    env->replay = NULL;
+}
@@ -55,6 +55,26 @@ interval_t _lf_time_physical_clock_offset = 0LL;
  */
 interval_t _lf_time_test_physical_clock_offset = 0LL;
 
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+/**
+ * Rate, in nanoseconds per second, at which the physical clock offset drifts
+ * away from _lf_time_physical_clock_offset, which is its value at the unadjusted
+ * physical time _lf_time_physical_clock_reference. Clock synchronization sets it
+ * to compensate for the drift of the local clock and to slew the clock towards
+ * the clock of the RTI rather than stepping it.
+ */
+interval_t _lf_time_physical_clock_drift = 0LL;
+
+/** The unadjusted physical time at which the offset is _lf_time_physical_clock_offset. */
+instant_t _lf_time_physical_clock_reference = 0LL;
+
+/**
+ * Version of the clock model above, which is odd while the model is being changed.
+ * Readers retry if the version changes while they read the model.
+ */
+int _lf_time_physical_clock_model_version = 0;
+#endif
+
 /**
  * Stores the last reported absolute snapshot of the
  * physical clock.
@@ -74,6 +94,48 @@ instant_t _lf_last_reported_unadjusted_physical_time_ns = NEVER;
 
 ////////////////  Functions not declared in tag.h (local use only)
 
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+/**
+ * Return the physical clock offset, excluding the test offset, at the specified
+ * unadjusted physical time.
+ */
+interval_t _lf_physical_clock_offset_at(instant_t unadjusted_time) {
+    interval_t offset;
+    int version;
+    do {
+        version = lf_atomic_fetch_add(&_lf_time_physical_clock_model_version, 0);
+        offset = _lf_time_physical_clock_offset;
+        if (_lf_time_physical_clock_drift != 0LL) {
+            // Microseconds are precise enough and prevent an overflow.
+            offset += (unadjusted_time - _lf_time_physical_clock_reference) / 1000LL
+                    * _lf_time_physical_clock_drift / 1000000LL;
+        }
+    } while ((version & 1) != 0 || version != lf_atomic_fetch_add(&_lf_time_physical_clock_model_version, 0));
+    return offset;
+}
+
+/**
+ * Change the rate at which the physical clock offset drifts from now on and
+ * step the offset by the specified amount, which is zero to not have the
+ * physical clock jump. This is to be called by one thread only.
+ * @param step The change of the offset now.
+ * @param drift The rate in nanoseconds per second.
+ */
+void _lf_adjust_physical_clock(interval_t step, interval_t drift) {
+    instant_t now;
+    if (_lf_clock_now(&now) != 0) {
+        lf_print_error("Failed to read the physical clock.");
+        return;
+    }
+    interval_t offset = _lf_physical_clock_offset_at(now);
+    lf_atomic_fetch_add(&_lf_time_physical_clock_model_version, 1);
+    _lf_time_physical_clock_offset = offset + step;
+    _lf_time_physical_clock_reference = now;
+    _lf_time_physical_clock_drift = drift;
+    lf_atomic_fetch_add(&_lf_time_physical_clock_model_version, 1);
+}
+#endif
+
 /**
  * Return the current physical time in nanoseconds since January 1, 1970,
  * adjusted by the global physical time offset.
@@ -87,8 +149,13 @@ instant_t _lf_physical_time() {
     }
 
     // Adjust the reported clock with the appropriate offsets
+#ifdef _LF_CLOCK_SYNC_DRIFT_COMPENSATION
+    instant_t adjusted_clock_ns = _lf_last_reported_unadjusted_physical_time_ns
+            + _lf_physical_clock_offset_at(_lf_last_reported_unadjusted_physical_time_ns);
+#else
     instant_t adjusted_clock_ns = _lf_last_reported_unadjusted_physical_time_ns
             + _lf_time_physical_clock_offset;
+#endif
 
     // Apply the test offset
     adjusted_clock_ns += _lf_time_test_physical_clock_offset;
@@ -117,49 +184,35 @@ tag_t lf_tag(void *env) {
 }
 
 int lf_tag_compare(tag_t tag1, tag_t tag2) {
-    if (tag1.time < tag2.time) {
-        LF_PRINT_DEBUG(PRINTF_TIME " < " PRINTF_TIME, tag1.time, tag2.time);
-        return -1;
-    } else if (tag1.time > tag2.time) {
-        return 1;
-    } else if (tag1.microstep < tag2.microstep) {
-        LF_PRINT_DEBUG(PRINTF_TIME " and microstep < " PRINTF_TIME, tag1.time, tag2.time);
-        return -1;
-    } else if (tag1.microstep > tag2.microstep) {
-        return 1;
-    } else {
-        return 0;
-    }
+    // The order of the times decides unless they are equal, without branching.
+    int time_order = (tag1.time > tag2.time) - (tag1.time < tag2.time);
+    int microstep_order = (tag1.microstep > tag2.microstep) - (tag1.microstep < tag2.microstep);
+    return time_order + (time_order == 0) * microstep_order;
 }
 
-tag_t lf_delay_tag(tag_t tag, interval_t interval) {
-    if (tag.time == NEVER || interval < 0LL) return tag;
-    tag_t result = tag;
-    if (interval == 0LL) {
-        // Note that unsigned variables will wrap on overflow.
-        // This is probably the only reasonable thing to do with overflowing
-        // microsteps.
-        result.microstep++;
-    } else {
-        // Note that overflow in C is undefined for signed variables.
-        if (FOREVER - interval < result.time) {
-            result.time = FOREVER;
-        } else {
-            result.time += interval;
+tag_t lf_tag_min(const tag_t* tags, size_t count) {
+    lf_packed_tag_t min[4];
+    for (int j = 0; j < 4; j++) {
+        min[j] = lf_tag_pack(FOREVER_TAG);
+    }
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            min[j] = lf_packed_tag_min(min[j], lf_tag_pack(tags[i + j]));
         }
-        result.microstep = 0;
     }
-    return result;
+    for (; i < count; i++) {
+        min[0] = lf_packed_tag_min(min[0], lf_tag_pack(tags[i]));
+    }
+    return lf_tag_unpack(lf_packed_tag_min(lf_packed_tag_min(min[0], min[1]), lf_packed_tag_min(min[2], min[3])));
+}
+
+tag_t lf_delay_tag(tag_t tag, interval_t interval) {
+    return _lf_delay_tag(tag, interval);
 }
 
 tag_t lf_delay_strict(tag_t tag, interval_t interval) {
-    tag_t result = lf_delay_tag(tag, interval);
-    if (interval != 0 && interval != NEVER && interval != FOREVER && result.time != NEVER && result.time != FOREVER) {
-        LF_PRINT_DEBUG("interval=%lld, result time=%lld", (long long) interval, (long long) result.time);
-        result.time -= 1;
-        result.microstep = UINT_MAX;
-    }
-    return result;
+    return _lf_delay_strict(tag, interval);
 }
 
 instant_t lf_time_logical(void *env) {
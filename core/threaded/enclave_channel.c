@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Definitions for channels between enclaves.
+ *
+ * The head and tail of a channel count the messages taken out of and put into
+ * the ring, so the ring is empty when they are equal and full when they differ
+ * by its capacity. Only the sender writes the tail and only the thread that
+ * holds the mutex of the destination writes the head.
+ */
+
+#include <assert.h>
+#include "enclave_channel.h"
+#include "reactor_common.h"
+#include "lf_token.h"
+#include "platform.h"
+#include "util.h"
+
+lf_enclave_channel_t* lf_enclave_channel_create(
+    environment_t* source,
+    environment_t* destination,
+    trigger_t* trigger,
+    interval_t delay,
+    size_t capacity
+) {
+    assert(source != GLOBAL_ENVIRONMENT && destination != GLOBAL_ENVIRONMENT);
+    lf_enclave_channel_t* channel = (lf_enclave_channel_t*)calloc(1, sizeof(lf_enclave_channel_t));
+    lf_assert(channel != NULL, "Out of memory");
+    size_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    channel->messages = (lf_enclave_message_t*)calloc(rounded, sizeof(lf_enclave_message_t));
+    lf_assert(channel->messages != NULL, "Out of memory");
+    channel->capacity = rounded;
+    channel->source = source;
+    channel->destination = destination;
+    channel->trigger = trigger;
+    channel->delay = delay;
+
+    lf_critical_section_enter(destination);
+    channel->next = destination->incoming_channels;
+    destination->incoming_channels = channel;
+    lf_critical_section_exit(destination);
+    return channel;
+}
+
+/**
+ * Schedule the messages in the specified channel into its destination,
+ * whose mutex the caller holds.
+ */
+static void _lf_enclave_channel_drain(lf_enclave_channel_t* channel) {
+    environment_t* env = channel->destination;
+    size_t head = channel->head;
+    size_t tail;
+    do {
+        tail = channel->tail;
+        // Read the messages only after reading the tail that covers them.
+        lf_memory_barrier();
+        for (; head != tail; head++) {
+            lf_enclave_message_t* message = &channel->messages[head & (channel->capacity - 1)];
+            tag_t tag = message->tag;
+            if (lf_tag_compare(tag, env->current_tag) <= 0) {
+                // The destination has advanced past the tag, which only
+                // happens if nothing holds it back for the sender.
+                LF_PRINT_LOG("Message from an enclave at tag " PRINTF_TAG " arrived at tag " PRINTF_TAG ".",
+                        tag.time - lf_time_start(), tag.microstep,
+                        env->current_tag.time - lf_time_start(), env->current_tag.microstep);
+                tag = lf_delay_tag(env->current_tag, 0);
+            }
+            _lf_schedule_at_tag(env, channel->trigger, tag, message->token);
+        }
+        // Release the slots only after reading them.
+        lf_memory_barrier();
+        channel->head = head;
+        lf_memory_barrier();
+    } while (channel->tail != tail);
+}
+
+void _lf_enclave_channels_drain(environment_t* env) {
+    for (lf_enclave_channel_t* channel = env->incoming_channels; channel != NULL; channel = channel->next) {
+        if (channel->head != channel->tail) {
+            _lf_enclave_channel_drain(channel);
+        }
+    }
+}
+
+void lf_enclave_channel_send(lf_enclave_channel_t* channel, lf_token_t* token) {
+    environment_t* destination = channel->destination;
+    if (token != NULL && token->ref_count > 0) {
+        token = _lf_copy_token((token_type_t*)channel->trigger, token);
+    }
+    size_t tail = channel->tail;
+    if (tail - channel->head == channel->capacity) {
+        // The ring is full. Make room by scheduling its messages on behalf of
+        // the destination.
+        lf_critical_section_enter(destination);
+        _lf_enclave_channel_drain(channel);
+        lf_critical_section_exit(destination);
+    }
+    lf_enclave_message_t* message = &channel->messages[tail & (channel->capacity - 1)];
+    message->tag = lf_delay_tag(channel->source->current_tag, channel->delay);
+    message->token = token;
+    // Publish the message only after writing it.
+    lf_memory_barrier();
+    channel->tail = tail + 1;
+    lf_memory_barrier();
+    if (channel->head == tail) {
+        // The destination had taken every earlier message, so it may be waiting
+        // for an event. Schedule the message now so that it bounds that wait.
+        lf_critical_section_enter(destination);
+        _lf_enclave_channel_drain(channel);
+        lf_notify_of_event(destination);
+        lf_critical_section_exit(destination);
+    }
+}
+
+void _lf_enclave_channels_free(environment_t* env) {
+    lf_enclave_channel_t* channel = env->incoming_channels;
+    while (channel != NULL) {
+        for (size_t i = channel->head; i != channel->tail; i++) {
+            lf_token_t* token = channel->messages[i & (channel->capacity - 1)].token;
+            if (token != NULL && token->ref_count == 0) {
+                _lf_free_token(token);
+            }
+        }
+        lf_enclave_channel_t* next = channel->next;
+        free(channel->messages);
+        free(channel);
+        channel = next;
+    }
+    env->incoming_channels = NULL;
+}
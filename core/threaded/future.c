@@ -0,0 +1,250 @@
+#if !defined(LF_SINGLE_THREADED)
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Futures and the coroutines on which suspendable reactions execute.
+ *
+ * A suspendable reaction that awaits a future that is not complete switches
+ * from its coroutine back to its worker, which only then puts the coroutine on
+ * the list of waiters of the future. This way, a thread that completes the
+ * future cannot make the reaction resumable before its context is saved.
+ */
+
+#if defined(LF_SUSPENDABLE_REACTIONS) && defined(PLATFORM_Darwin)
+// The ucontext functions are only declared for X/Open applications on macOS.
+#define _XOPEN_SOURCE 600
+#endif
+
+#include <stdlib.h>
+
+#include "future.h"
+#include "util.h"
+
+#ifdef LF_SUSPENDABLE_REACTIONS
+
+#if !defined(PLATFORM_Linux) && !defined(PLATFORM_Darwin)
+#error "LF_SUSPENDABLE_REACTIONS is only supported on Linux and macOS."
+#endif
+
+#include <ucontext.h>
+
+/** The coroutine on which a suspendable reaction executes. */
+typedef struct lf_coroutine_t {
+    ucontext_t context;           // The context of the reaction.
+    ucontext_t worker_context;    // The context of the worker that last started or resumed the reaction.
+    reaction_t* reaction;         // The reaction.
+    lf_scheduler_t* scheduler;    // The scheduler that resumes the reaction.
+    lf_future_t* awaited;         // The future that the reaction has suspended itself on, or NULL.
+    bool returned;                // Whether the function of the reaction has returned.
+    void* stack;                  // The stack of the coroutine.
+    struct lf_coroutine_t* next;  // The next coroutine on a list of waiters, of resumable or of free coroutines.
+} lf_coroutine_t;
+
+/** The coroutine that the calling worker is executing, or NULL. */
+static LF_THREAD_LOCAL lf_coroutine_t* _lf_current_coroutine = NULL;
+
+/**
+ * Execute the function of the reaction of the current coroutine and switch
+ * back to the worker that last started or resumed it once it returns.
+ */
+static void _lf_coroutine_entry(void) {
+    // This is read before the reaction can suspend itself and be resumed by another thread.
+    lf_coroutine_t* coroutine = _lf_current_coroutine;
+    coroutine->reaction->function(coroutine->reaction->self);
+    coroutine->returned = true;
+    setcontext(&coroutine->worker_context);
+}
+
+/**
+ * Return a coroutine that is ready to execute 'reaction', reusing a free one if
+ * the scheduler has one.
+ */
+static lf_coroutine_t* _lf_coroutine_new(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    lf_mutex_lock(&scheduler->suspension_mutex);
+    lf_coroutine_t* coroutine = scheduler->free_coroutines;
+    if (coroutine != NULL) {
+        scheduler->free_coroutines = coroutine->next;
+    }
+    lf_mutex_unlock(&scheduler->suspension_mutex);
+    if (coroutine == NULL) {
+        coroutine = (lf_coroutine_t*)calloc(1, sizeof(lf_coroutine_t));
+        lf_assert(coroutine != NULL, "Out of memory");
+        coroutine->stack = malloc(LF_SUSPENDABLE_STACK_SIZE);
+        lf_assert(coroutine->stack != NULL, "Out of memory");
+        coroutine->scheduler = scheduler;
+    }
+    if (getcontext(&coroutine->context) != 0) {
+        lf_print_error_and_exit("Failed to get the context of a coroutine.");
+    }
+    coroutine->context.uc_stack.ss_sp = coroutine->stack;
+    coroutine->context.uc_stack.ss_size = LF_SUSPENDABLE_STACK_SIZE;
+    coroutine->context.uc_link = NULL;
+    makecontext(&coroutine->context, _lf_coroutine_entry, 0);
+    coroutine->reaction = reaction;
+    coroutine->awaited = NULL;
+    coroutine->returned = false;
+    coroutine->next = NULL;
+    return coroutine;
+}
+
+/** Put 'coroutine', whose reaction has returned, on the list of free coroutines. */
+static void _lf_coroutine_free(lf_coroutine_t* coroutine) {
+    lf_scheduler_t* scheduler = coroutine->scheduler;
+    lf_mutex_lock(&scheduler->suspension_mutex);
+    coroutine->next = scheduler->free_coroutines;
+    scheduler->free_coroutines = coroutine;
+    lf_mutex_unlock(&scheduler->suspension_mutex);
+}
+
+/** Append 'coroutine', whose future has completed, to the resumable coroutines. */
+static void _lf_coroutine_make_resumable(lf_coroutine_t* coroutine) {
+    lf_scheduler_t* scheduler = coroutine->scheduler;
+    coroutine->next = NULL;
+    lf_mutex_lock(&scheduler->suspension_mutex);
+    if (scheduler->last_resumable_coroutine != NULL) {
+        scheduler->last_resumable_coroutine->next = coroutine;
+    } else {
+        scheduler->resumable_coroutines = coroutine;
+    }
+    scheduler->last_resumable_coroutine = coroutine;
+    lf_cond_signal(&scheduler->reaction_resumable);
+    lf_mutex_unlock(&scheduler->suspension_mutex);
+}
+
+bool _lf_run_suspendable_reaction(environment_t* env, reaction_t* reaction) {
+    lf_coroutine_t* coroutine = reaction->coroutine;
+    if (coroutine == NULL) {
+        coroutine = _lf_coroutine_new(env->scheduler, reaction);
+        reaction->coroutine = coroutine;
+    }
+    while (true) {
+        _lf_current_coroutine = coroutine;
+        swapcontext(&coroutine->worker_context, &coroutine->context);
+        _lf_current_coroutine = NULL;
+        if (coroutine->returned) {
+            reaction->coroutine = NULL;
+            _lf_coroutine_free(coroutine);
+            return true;
+        }
+        // The reaction awaits a future. Unless it has completed in the meantime,
+        // leave the reaction to whichever worker resumes it.
+        lf_future_t* future = coroutine->awaited;
+        lf_mutex_lock(&future->mutex);
+        if (future->completed) {
+            lf_mutex_unlock(&future->mutex);
+            continue;
+        }
+        coroutine->next = future->waiters;
+        future->waiters = coroutine;
+        lf_mutex_lock(&coroutine->scheduler->suspension_mutex);
+        coroutine->scheduler->number_of_suspended_reactions++;
+        lf_mutex_unlock(&coroutine->scheduler->suspension_mutex);
+        lf_mutex_unlock(&future->mutex);
+        LF_PRINT_DEBUG("Suspended reaction %s.", reaction->name);
+        return false;
+    }
+}
+
+reaction_t* lf_sched_pop_resumable_reaction(lf_scheduler_t* scheduler) {
+    // A resumable reaction that this misses is resumed by the last worker to
+    // become idle, so reading the list without the mutex is fine.
+    if (lf_atomic_load_explicit(&scheduler->resumable_coroutines, LF_ATOMIC_RELAXED) == NULL) {
+        return NULL;
+    }
+    lf_mutex_lock(&scheduler->suspension_mutex);
+    lf_coroutine_t* coroutine = scheduler->resumable_coroutines;
+    if (coroutine != NULL) {
+        scheduler->resumable_coroutines = coroutine->next;
+        if (scheduler->resumable_coroutines == NULL) {
+            scheduler->last_resumable_coroutine = NULL;
+        }
+        scheduler->number_of_suspended_reactions--;
+    }
+    lf_mutex_unlock(&scheduler->suspension_mutex);
+    if (coroutine == NULL) {
+        return NULL;
+    }
+    LF_PRINT_DEBUG("Resuming reaction %s.", coroutine->reaction->name);
+    return coroutine->reaction;
+}
+
+bool lf_sched_wait_for_resumable_reaction(lf_scheduler_t* scheduler) {
+    lf_mutex_lock(&scheduler->suspension_mutex);
+    while (scheduler->resumable_coroutines == NULL && scheduler->number_of_suspended_reactions > 0) {
+        lf_cond_wait(&scheduler->reaction_resumable);
+    }
+    bool resumable = scheduler->resumable_coroutines != NULL;
+    lf_mutex_unlock(&scheduler->suspension_mutex);
+    return resumable;
+}
+
+void lf_sched_free_coroutines(lf_scheduler_t* scheduler) {
+    while (scheduler->free_coroutines != NULL) {
+        lf_coroutine_t* coroutine = scheduler->free_coroutines;
+        scheduler->free_coroutines = coroutine->next;
+        free(coroutine->stack);
+        free(coroutine);
+    }
+}
+
+#endif // LF_SUSPENDABLE_REACTIONS
+
+int lf_future_init(lf_future_t* future) {
+    future->completed = false;
+    future->value = NULL;
+    future->waiters = NULL;
+    int result = lf_mutex_init(&future->mutex);
+    if (result != 0) {
+        return result;
+    }
+    return lf_cond_init(&future->completed_cond, &future->mutex);
+}
+
+void lf_future_complete(lf_future_t* future, void* value) {
+    lf_mutex_lock(&future->mutex);
+    lf_assert(!future->completed, "A future was completed twice.");
+    future->value = value;
+    future->completed = true;
+#ifdef LF_SUSPENDABLE_REACTIONS
+    lf_coroutine_t* waiters = future->waiters;
+    future->waiters = NULL;
+#endif
+    lf_cond_broadcast(&future->completed_cond);
+    lf_mutex_unlock(&future->mutex);
+#ifdef LF_SUSPENDABLE_REACTIONS
+    while (waiters != NULL) {
+        lf_coroutine_t* next = waiters->next;
+        _lf_coroutine_make_resumable(waiters);
+        waiters = next;
+    }
+#endif
+}
+
+bool lf_future_is_complete(lf_future_t* future) {
+    lf_mutex_lock(&future->mutex);
+    bool completed = future->completed;
+    lf_mutex_unlock(&future->mutex);
+    return completed;
+}
+
+void* lf_await(lf_future_t* future) {
+#ifdef LF_SUSPENDABLE_REACTIONS
+    lf_coroutine_t* coroutine = _lf_current_coroutine;
+    if (coroutine != NULL && !lf_future_is_complete(future)) {
+        // Switch back to the worker, which suspends the reaction. This returns
+        // once a worker, possibly another one, resumes it after the future completes.
+        coroutine->awaited = future;
+        swapcontext(&coroutine->context, &coroutine->worker_context);
+        coroutine->awaited = NULL;
+    }
+#endif
+    lf_mutex_lock(&future->mutex);
+    while (!future->completed) {
+        lf_cond_wait(&future->completed_cond);
+    }
+    void* value = future->value;
+    lf_mutex_unlock(&future->mutex);
+    return value;
+}
+#endif
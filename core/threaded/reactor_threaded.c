@@ -37,6 +37,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
 #include <signal.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 
@@ -44,13 +45,21 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "platform.h"
 #include "reactor_common.h"
 #include "reactor_threaded.h"
+#include "enclave_channel.h"
+#include "worker_pool.h"
+#include "future.h"
 #include "reactor.h"
 #include "scheduler.h"
 #include "tag.h"
 #include "environment.h"
+#include "checkpoint.h"
+#include "replay.h"
+#include "probes.h"
+#include "rti_local.h"
 
 #ifdef FEDERATED
 #include "federate.h"
+#include "clock-sync.h"
 #endif
 
 // Global variables defined in tag.c and shared across environments:
@@ -80,75 +89,105 @@ extern instant_t start_time;
 lf_mutex_t global_mutex;
 
 
-void _lf_increment_tag_barrier_locked(environment_t *env, tag_t future_tag) {
-    assert(env != GLOBAL_ENVIRONMENT);
-
-    // Check if future_tag is after stop tag.
-    // This will only occur when a federate receives a timed message with
-    // a tag that is after the stop tag
-    if (_lf_is_tag_after_stop_tag(env, future_tag)) {
-        lf_print_warning("Attempting to raise a barrier after the stop tag.");
-        future_tag = env->stop_tag;
-    }
-    tag_t current_tag = env->current_tag;
-    // Check to see if future_tag is actually in the future.
-    if (lf_tag_compare(future_tag, env->current_tag) > 0) {
-        // Future tag is actually in the future.
-        // See whether it is smaller than any pre-existing barrier.
-        if (lf_tag_compare(future_tag, env->barrier.horizon) < 0) {
-            // The future tag is smaller than the current horizon of the barrier.
-            // Therefore, we should prevent logical time from reaching the
-            // future tag.
-            env->barrier.horizon = future_tag;
-            LF_PRINT_DEBUG("Raised barrier at elapsed tag " PRINTF_TAG ".",
-                        env->barrier.horizon.time - start_time,
-                        env->barrier.horizon.microstep);
-        }
-    } else {
-            // The future_tag is not in the future.
+/**
+ * Begin an update of the tag barrier of the specified environment, waiting for
+ * any update by another thread to end. Updates take a few instructions, so
+ * this spins rather than sleeps.
+ * @param env The environment.
+ */
+static void _lf_tag_barrier_begin_update(environment_t* env) {
+    int version;
+    do {
+        version = env->barrier.version;
+    } while ((version & 1) || !lf_bool_compare_and_swap(&env->barrier.version, version, version + 1));
+}
 
-            // One possibility is that the incoming message has violated the STP offset.
-            // Another possibility is that the message is coming from a zero-delay loop,
-            // and port absent reactions are waiting.
+/**
+ * End an update of the tag barrier of the specified environment and publish it.
+ * @param env The environment.
+ */
+static void _lf_tag_barrier_end_update(environment_t* env) {
+    // This is a full memory barrier, so a thread that checks for waiters
+    // afterwards cannot miss a waiter that checks the barrier after this.
+    lf_atomic_fetch_add(&env->barrier.version, 1);
+}
 
-            // Prevent logical time from advancing further so that the measure of
-            // STP violation properly reflects the amount of time (logical or physical)
-            // that has elapsed after the incoming message would have violated the STP offset.
-            env->barrier.horizon = env->current_tag;
-            env->barrier.horizon.microstep++;
-            LF_PRINT_DEBUG("Raised barrier at elapsed tag " PRINTF_TAG ".",
-                        env->barrier.horizon.time - start_time,
-                        env->barrier.horizon.microstep);
+/**
+ * Return whether the tag barrier of the specified environment prevents
+ * advancing to the proposed tag, which is assumed not to be after the stop tag.
+ * The requestors and the horizon are read consistently, without the mutex.
+ * @param env The environment.
+ * @param proposed_tag The tag.
+ */
+static bool _lf_tag_barrier_blocks(environment_t* env, tag_t proposed_tag) {
+    int version, requestors;
+    tag_t horizon;
+    do {
+        version = env->barrier.version;
+        lf_memory_barrier();
+        requestors = env->barrier.requestors;
+        horizon = env->barrier.horizon;
+        lf_memory_barrier();
+    } while ((version & 1) || version != env->barrier.version);
+    if (requestors == 0) return false;
+    // A barrier after the stop tag holds back the stop tag.
+    if (_lf_is_tag_after_stop_tag(env, horizon)) {
+        horizon = env->stop_tag;
     }
-    // Increment the number of requestors
-    env->barrier.requestors++;
+    return lf_tag_compare(proposed_tag, horizon) >= 0;
+}
+
+void _lf_increment_tag_barrier_locked(environment_t *env, tag_t future_tag) {
+    _lf_increment_tag_barrier(env, future_tag);
 }
 
 void _lf_increment_tag_barrier(environment_t *env, tag_t future_tag) {
     assert(env != GLOBAL_ENVIRONMENT);
-    lf_mutex_lock(&env->mutex);
-    _lf_increment_tag_barrier_locked(env, future_tag);
-    lf_mutex_unlock(&env->mutex);
+
+    // The current tag cannot be read consistently without the mutex, so the
+    // barrier is raised at future_tag even if that is not in the future.
+    // A horizon at or before the current tag freezes the advancement of
+    // logical time, just as the current tag plus one microstep would.
+    // This prevents logical time from advancing further if the incoming
+    // message has violated the STP offset, so that the measure of the STP
+    // violation properly reflects the time that has elapsed, or if the message
+    // comes from a zero-delay loop and port absent reactions are waiting.
+    _lf_tag_barrier_begin_update(env);
+    if (lf_tag_compare(future_tag, env->barrier.horizon) < 0) {
+        env->barrier.horizon = future_tag;
+    }
+    tag_t horizon = env->barrier.horizon;
+    // Increment the number of requestors
+    env->barrier.requestors++;
+    _lf_tag_barrier_end_update(env);
+    LF_PRINT_DEBUG("Raised barrier at elapsed tag " PRINTF_TAG ".",
+                horizon.time - start_time,
+                horizon.microstep);
 }
 
 void _lf_decrement_tag_barrier_locked(environment_t* env) {
     assert(env != GLOBAL_ENVIRONMENT);
     // Decrement the number of requestors for the tag barrier.
-    env->barrier.requestors--;
+    _lf_tag_barrier_begin_update(env);
+    int requestors = --env->barrier.requestors;
+    if (requestors == 0) {
+        // When the semaphore reaches zero, reset the horizon to forever.
+        env->barrier.horizon = FOREVER_TAG;
+    }
+    tag_t horizon = env->barrier.horizon;
+    _lf_tag_barrier_end_update(env);
     // Check to see if the semaphore is negative, which indicates that
     // a mismatched call was placed for this function.
-    if (env->barrier.requestors < 0) {
+    if (requestors < 0) {
         lf_print_error_and_exit("Mismatched use of _lf_increment_tag_barrier()"
                 " and  _lf_decrement_tag_barrier_locked().");
-    } else if (env->barrier.requestors == 0) {
-        // When the semaphore reaches zero, reset the horizon to forever.
-        env->barrier.horizon = FOREVER_TAG;
+    } else if (requestors == 0 && env->barrier.waiting > 0) {
         // Notify waiting threads that the semaphore has reached zero.
         lf_cond_broadcast(&env->global_tag_barrier_requestors_reached_zero);
     }
     LF_PRINT_DEBUG("Barrier is at tag " PRINTF_TAG ".",
-                 env->barrier.horizon.time,
-                 env->barrier.horizon.microstep);
+                 horizon.time,
+                 horizon.microstep);
 }
 
 /**
@@ -190,14 +229,19 @@ int _lf_wait_on_tag_barrier(environment_t* env, tag_t proposed_tag) {
     }
     int result = 0;
     // Wait until the global barrier semaphore on logical time is zero
-    // and the proposed_time is larger than or equal to the horizon.
-    while (env->barrier.requestors > 0
-            && lf_tag_compare(proposed_tag, env->barrier.horizon) >= 0
-    ) {
-        result = 1;
-        LF_PRINT_LOG("Waiting on barrier for tag " PRINTF_TAG ".", proposed_tag.time - start_time, proposed_tag.microstep);
-        // Wait until no requestor remains for the barrier on logical time
-        lf_cond_wait(&env->global_tag_barrier_requestors_reached_zero);
+    // or the proposed_time is smaller than the horizon.
+    while (_lf_tag_barrier_blocks(env, proposed_tag)) {
+        // Register as a waiter before checking again, so that the thread that
+        // lowers the requestors to zero either is seen to have done so or
+        // sees the waiter and notifies it.
+        lf_atomic_fetch_add(&env->barrier.waiting, 1);
+        if (_lf_tag_barrier_blocks(env, proposed_tag)) {
+            result = 1;
+            LF_PRINT_LOG("Waiting on barrier for tag " PRINTF_TAG ".", proposed_tag.time - start_time, proposed_tag.microstep);
+            // Wait until no requestor remains for the barrier on logical time
+            lf_cond_wait(&env->global_tag_barrier_requestors_reached_zero);
+        }
+        lf_atomic_fetch_add(&env->barrier.waiting, -1);
 
         // The stop tag may have changed during the wait.
         if (_lf_is_tag_after_stop_tag(env, proposed_tag)) {
@@ -208,25 +252,75 @@ int _lf_wait_on_tag_barrier(environment_t* env, tag_t proposed_tag) {
     return result;
 }
 
+/**
+ * The slot that the calling worker thread claimed among the workers of its
+ * environment and that environment, or -1 and NULL if the calling thread is not a worker.
+ */
+static LF_THREAD_LOCAL int _lf_worker_slot_index = -1;
+static LF_THREAD_LOCAL environment_t* _lf_worker_slot_env = NULL;
+
+int _lf_worker_slot(environment_t* env) {
+    return _lf_worker_slot_env == env ? _lf_worker_slot_index : -1;
+}
+
+/** The number of the calling worker thread, or -1 if it is not a worker thread. */
+static LF_THREAD_LOCAL int _lf_worker_number = -1;
+
+bool lf_is_worker_thread(void) {
+    return _lf_worker_number >= 0;
+}
+
+int lf_worker_number(void) {
+    return _lf_worker_number;
+}
+
 /**
  * Mark the given port's is_present field as true. This is_present field
- * will later be cleaned up by _lf_start_time_step. If the port is unconnected,
- * do nothing.
+ * will later be cleaned up by _lf_start_time_step. If the port is unconnected
+ * or already present, do nothing, so that setting a port repeatedly within a
+ * tag records it once.
+ * A worker thread records the field in its own list of the environment.
+ * Other threads fall back to the shared table of the environment.
  * This assumes that the mutex is not held.
  * @param port A pointer to the port struct.
  */
 void _lf_set_present(lf_port_base_t* port) {
-  if (!port->source_reactor) return;
+  if (!port->source_reactor || port->is_present) return;
   environment_t *env = port->source_reactor->environment;
 	bool* is_present_field = &port->is_present;
-    int ipfas = lf_atomic_fetch_add(&env->is_present_fields_abbreviated_size, 1);
-    if (ipfas < env->is_present_fields_size) {
-        env->is_present_fields_abbreviated[ipfas] = is_present_field;
+    int slot = _lf_worker_slot(env);
+    if (slot >= 0) {
+        lf_present_list_t* list = &env->present_lists[slot];
+        if (list->size == list->capacity) {
+            int capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+            bool** fields = (bool**)realloc(list->fields, capacity * sizeof(bool*));
+            lf_assert(fields != NULL, "Out of memory");
+            list->fields = fields;
+            list->capacity = capacity;
+        }
+        list->fields[list->size++] = is_present_field;
+    } else {
+        int ipfas = lf_atomic_fetch_add(&env->is_present_fields_abbreviated_size, 1);
+        if (ipfas < env->is_present_fields_size) {
+            env->is_present_fields_abbreviated[ipfas] = is_present_field;
+        }
     }
     *is_present_field = true;
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    if (port->presence) *port->presence = true;
+#endif
 
     // Support for sparse destination multiports.
     if(port->sparse_record
+    		&& port->destination_channel >= 0
+    		&& port->sparse_record->bitmap_width > 0) {
+    	uint32_t* word = (uint32_t*)port->sparse_record->present_channels + port->destination_channel / 32;
+    	uint32_t bit = 1u << (port->destination_channel % 32);
+    	uint32_t old;
+    	do {
+    		old = *(volatile uint32_t*)word;
+    	} while (!(old & bit) && !lf_bool_compare_and_swap(word, old, old | bit));
+    } else if(port->sparse_record
     		&& port->destination_channel >= 0
 			&& port->sparse_record->size >= 0) {
     	int next = lf_atomic_fetch_add(&port->sparse_record->size, 1);
@@ -240,9 +334,131 @@ void _lf_set_present(lf_port_base_t* port) {
     }
 }
 
+/**
+ * Set the given bits in the given word of the bitmap of a sparse record.
+ */
+static void _lf_set_sparse_bits(uint32_t* word, uint32_t bits) {
+    uint32_t old;
+    do {
+        old = *(volatile uint32_t*)word;
+    } while ((old & bits) != bits && !lf_bool_compare_and_swap(word, old, old | bits));
+}
+
+/**
+ * Record the destination channels of the given ports, which are connected
+ * and share the given sparse record, with one atomic update of the size of
+ * the record or one of each word of its bitmap.
+ */
+static void _lf_set_sparse_range(lf_sparse_io_record_t* record, lf_port_base_t** ports, int count) {
+    if (record->bitmap_width > 0) {
+        uint32_t* words = (uint32_t*)record->present_channels;
+        int word = ports[0]->destination_channel / 32;
+        uint32_t bits = 0;
+        for (int i = 0; i < count; i++) {
+            int channel = ports[i]->destination_channel;
+            if (channel / 32 != word) {
+                _lf_set_sparse_bits(&words[word], bits);
+                word = channel / 32;
+                bits = 0;
+            }
+            bits |= 1u << (channel % 32);
+        }
+        _lf_set_sparse_bits(&words[word], bits);
+    } else if (record->size >= 0) {
+        int next = lf_atomic_fetch_add(&record->size, count);
+        if (next + count > record->capacity) {
+            // Buffer is full. Have to revert to the classic iteration.
+            record->size = -1;
+        } else {
+            for (int i = 0; i < count; i++) {
+                record->present_channels[next + i] = ports[i]->destination_channel;
+            }
+        }
+    }
+}
+
+void _lf_set_present_range(lf_port_base_t** ports, int start, int count) {
+    int end = start + count;
+    // Skip unconnected channels.
+    while (start < end && !ports[start]->source_reactor) start++;
+    if (start == end) return;
+    environment_t *env = ports[start]->source_reactor->environment;
+    int slot = _lf_worker_slot(env);
+    bool batch = slot >= 0;
+    // Channels that are already present must not be recorded again, which
+    // _lf_set_present() takes care of.
+    for (int i = start; batch && i < end; i++) {
+        if (ports[i]->source_reactor && ports[i]->is_present) batch = false;
+    }
+    if (!batch) {
+        // Other threads share one table, which is not worth batching for.
+        for (int i = start; i < end; i++) {
+            _lf_set_present(ports[i]);
+        }
+        return;
+    }
+    lf_present_list_t* list = &env->present_lists[slot];
+    if (list->size + (end - start) > list->capacity) {
+        int capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+        while (capacity < list->size + (end - start)) capacity *= 2;
+        bool** fields = (bool**)realloc(list->fields, capacity * sizeof(bool*));
+        lf_assert(fields != NULL, "Out of memory");
+        list->fields = fields;
+        list->capacity = capacity;
+    }
+    for (int i = start; i < end; i++) {
+        lf_port_base_t* port = ports[i];
+        if (!port->source_reactor) continue;
+        list->fields[list->size++] = &port->is_present;
+        port->is_present = true;
+#ifdef LF_PORT_PRESENCE_ARRAYS
+        if (port->presence) *port->presence = true;
+#endif
+    }
+
+    // Support for sparse destination multiports, one run of channels
+    // with the same destination at a time.
+    int i = start;
+    while (i < end) {
+        lf_sparse_io_record_t* record = ports[i]->sparse_record;
+        if (!ports[i]->source_reactor || !record || ports[i]->destination_channel < 0) {
+            i++;
+            continue;
+        }
+        int run = i + 1;
+        while (run < end && ports[run]->sparse_record == record
+                && ports[run]->source_reactor && ports[run]->destination_channel >= 0) {
+            run++;
+        }
+        _lf_set_sparse_range(record, &ports[i], run - i);
+        i = run;
+    }
+}
+
 // Forward declaration. See federate.h
 void synchronize_with_other_federates(void);
 
+/**
+ * Spin until physical time reaches the given time. The mutex of the
+ * environment is released while spinning so that other threads can schedule
+ * events. The spin stops early if another thread notifies of an event or
+ * leaves a request in the inbox, as a timed wait on the condition would.
+ * @param env Environment within which we are executing.
+ * @param wakeup_time The physical time to wait until.
+ * @return true if the time was reached and false if the spin was interrupted.
+ */
+static bool _lf_busy_wait_until(environment_t* env, instant_t wakeup_time) {
+    unsigned int notifications = env->notifications;
+    lf_mutex_unlock(&env->mutex);
+    bool reached;
+    while (!(reached = lf_time_physical() >= wakeup_time)
+            && env->notifications == notifications && env->inbox == NULL) {
+        lf_spin_pause();
+    }
+    lf_mutex_lock(&env->mutex);
+    return reached;
+}
+
 /**
  * Wait until physical time matches or exceeds the specified logical time,
  * unless -fast is given.
@@ -274,13 +490,14 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
     interval_t wait_until_time_ns = logical_time;
 #ifdef FEDERATED_DECENTRALIZED // Only apply the STA if coordination is decentralized
     // Apply the STA to the logical time
+    interval_t STA_offset = _lf_adaptive_STA_offset();
     // Prevent an overflow
-    if (start_time != logical_time && wait_until_time_ns < FOREVER - _lf_fed_STA_offset) {
+    if (start_time != logical_time && wait_until_time_ns < FOREVER - STA_offset) {
         // If wait_time is not forever
         LF_PRINT_DEBUG("Adding STA " PRINTF_TIME " to wait until time " PRINTF_TIME ".",
-                _lf_fed_STA_offset,
+                STA_offset,
                 wait_until_time_ns - start_time);
-        wait_until_time_ns += _lf_fed_STA_offset;
+        wait_until_time_ns += STA_offset;
     }
 #endif
     if (!fast) {
@@ -295,6 +512,13 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
                 ns_to_wait, MIN_SLEEP_DURATION);
             return return_value;
         }
+        if (_lf_busy_wait_guard > 0) {
+            // Wake up the guard interval early and spin for the rest.
+            ns_to_wait -= _lf_busy_wait_guard;
+            if (ns_to_wait < MIN_SLEEP_DURATION) {
+                return _lf_busy_wait_until(env, wait_until_time_ns);
+            }
+        }
 
         // We will use lf_cond_timedwait, which takes as an argument the absolute
         // time to wait until. However, that will not include the offset that we
@@ -319,7 +543,14 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
         // lf_cond_timedwait returns 0 if it is awakened before the timeout.
         // Hence, we want to run it repeatedly until either it returns non-zero or the
         // current physical time matches or exceeds the logical time.
-        if (lf_cond_timedwait(condition, unadjusted_wait_until_time_ns) != LF_TIMEOUT) {
+        // Record the time that is waited for so that lf_notify_of_event() can
+        // tell whether an event requires a wakeup.
+        if (condition == &env->event_q_changed) {
+            env->sleeping_until = logical_time;
+        }
+        int result = lf_cond_timedwait(condition, unadjusted_wait_until_time_ns);
+        env->sleeping_until = NEVER;
+        if (result != LF_TIMEOUT) {
             LF_PRINT_DEBUG("-------- wait_until interrupted before timeout.");
 
             // Wait did not time out, which means that there
@@ -331,6 +562,9 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
             return_value = false;
         } else {
             // Reached timeout.
+            if (_lf_busy_wait_guard > 0) {
+                return _lf_busy_wait_until(env, wait_until_time_ns);
+            }
             // FIXME: move this to Mac-specific platform implementation
             // Unfortunately, at least on Macs, pthread_cond_timedwait appears
             // to be implemented incorrectly and it returns well short of the target
@@ -351,6 +585,87 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
     return return_value;
 }
 
+/**
+ * A request to schedule a physical action that is waiting in the inbox of
+ * an environment.
+ */
+typedef struct _lf_inbox_entry_t {
+    struct _lf_inbox_entry_t* next;
+    trigger_t* trigger;
+    interval_t extra_delay;
+    lf_token_t* token;
+    instant_t physical_time; // The physical time at which the request was made.
+} _lf_inbox_entry_t;
+
+trigger_handle_t _lf_inbox_push(environment_t* env, trigger_t* trigger, interval_t extra_delay, lf_token_t* token) {
+    _lf_inbox_entry_t* entry = (_lf_inbox_entry_t*)malloc(sizeof(_lf_inbox_entry_t));
+    lf_assert(entry != NULL, "Out of memory");
+    entry->trigger = trigger;
+    entry->extra_delay = extra_delay;
+    entry->token = token;
+    entry->physical_time = lf_time_physical();
+    _lf_inbox_entry_t* head;
+    do {
+        head = env->inbox;
+        entry->next = head;
+    } while (!lf_bool_compare_and_swap(&env->inbox, head, entry));
+    if (head == NULL) {
+        // The thread that advances time may be waiting with an empty inbox.
+        // Acquiring the mutex ensures that it is either waiting, and is
+        // woken up, or has not drained the inbox yet.
+        lf_mutex_lock(&env->mutex);
+        lf_notify_of_event(env);
+        lf_mutex_unlock(&env->mutex);
+    }
+    return 1;
+}
+
+/**
+ * Take all requests from the inbox of 'env' and return them in the order
+ * in which they were made (for each producer).
+ */
+static _lf_inbox_entry_t* _lf_inbox_take_all(environment_t* env) {
+    _lf_inbox_entry_t* head;
+    do {
+        head = env->inbox;
+    } while (head != NULL && !lf_bool_compare_and_swap(&env->inbox, head, NULL));
+    // The inbox is a stack. Reverse it.
+    _lf_inbox_entry_t* reversed = NULL;
+    while (head != NULL) {
+        _lf_inbox_entry_t* next = head->next;
+        head->next = reversed;
+        reversed = head;
+        head = next;
+    }
+    return reversed;
+}
+
+void _lf_inbox_drain(environment_t* env) {
+    if (env->inbox == NULL) return;
+    _lf_inbox_entry_t* entry = _lf_inbox_take_all(env);
+    while (entry != NULL) {
+        // A request made before logical time advanced past its physical time
+        // is treated as if it had been made now.
+        instant_t physical_time = entry->physical_time;
+        if (physical_time < env->current_tag.time) physical_time = env->current_tag.time;
+        _lf_schedule_at_physical_time(env, entry->trigger, entry->extra_delay, entry->token, physical_time);
+        _lf_inbox_entry_t* next = entry->next;
+        free(entry);
+        entry = next;
+    }
+}
+
+void _lf_inbox_free(environment_t* env) {
+    _lf_inbox_entry_t* entry = _lf_inbox_take_all(env);
+    while (entry != NULL) {
+        _lf_inbox_entry_t* next = entry->next;
+        // The request is discarded, and nothing else holds a reference to its token.
+        _lf_free_token(entry->token);
+        free(entry);
+        entry = next;
+    }
+}
+
 /**
  * Return the tag of the next event on the event queue.
  * If the event queue is empty then return either FOREVER_TAG
@@ -360,8 +675,13 @@ bool wait_until(environment_t* env, instant_t logical_time, lf_cond_t* condition
 tag_t get_next_event_tag(environment_t *env) {
     assert(env != GLOBAL_ENVIRONMENT);
 
+    // Requests from other threads and messages from other enclaves may
+    // precede the head of the event queue.
+    _lf_inbox_drain(env);
+    _lf_enclave_channels_drain(env);
+
     // Peek at the earliest event in the event queue.
-    event_t* event = (event_t*)pqueue_peek(env->event_q);
+    event_t* event = _lf_peek_event(env);
     tag_t next_tag = FOREVER_TAG;
     if (event != NULL) {
         // There is an event in the event queue.
@@ -388,7 +708,7 @@ tag_t get_next_event_tag(environment_t *env) {
         next_tag = env->stop_tag;
     }
     LF_PRINT_LOG("Earliest event on the event queue (or stop time if empty) is " PRINTF_TAG ". Event queue has size %zu.",
-            next_tag.time - start_time, next_tag.microstep, pqueue_size(env->event_q));
+            next_tag.time - start_time, next_tag.microstep, _lf_event_count(env));
     return next_tag;
 }
 
@@ -447,9 +767,29 @@ void _lf_next_locked(environment_t *env) {
     _lf_handle_mode_changes(env);
 #endif
 
+#ifdef FEDERATED_BATCH_MESSAGES
+    // Send the timed messages batched during the tag that just completed.
+    _lf_end_outbound_batches();
+#endif
+
     // Previous logical time is complete.
+    _lf_checkpoint_at_tag_end(env);
     tag_t next_tag = get_next_event_tag(env);
 
+#ifdef LF_IN_PROCESS_FEDERATION
+    // As a federate does with centralized coordination, wait until the
+    // environments upstream of this one can no longer send a message that
+    // precedes the next tag. An event scheduled during the wait interrupts it
+    // with a tag (typically) less than the next tag.
+    tag_t local_grant_tag = _lf_rti_local_next_event_tag_locked(env, next_tag);
+    while (lf_tag_compare(local_grant_tag, next_tag) < 0) {
+        next_tag = get_next_event_tag(env);
+        local_grant_tag = _lf_rti_local_next_event_tag_locked(env, next_tag);
+    }
+    // The mutex was released during the wait, so the next tag may have changed.
+    next_tag = get_next_event_tag(env);
+#endif
+
 #ifdef FEDERATED_CENTRALIZED
     // In case this is in a federation with centralized coordination, notify
     // the RTI of the next earliest tag at which this federate might produce
@@ -476,7 +816,7 @@ void _lf_next_locked(environment_t *env) {
     // behavior with centralized coordination as with unfederated execution.
 
 #else  // not FEDERATED_CENTRALIZED
-    if (pqueue_peek(env->event_q) == NULL && !keepalive_specified) {
+    if (_lf_peek_event(env) == NULL && !keepalive_specified) {
         // There is no event on the event queue and keepalive is false.
         // No event in the queue
         // keepalive is not set so we should stop.
@@ -515,6 +855,10 @@ void _lf_next_locked(environment_t *env) {
 
     LF_PRINT_DEBUG("Physical time is ahead of next tag time by " PRINTF_TIME ". This should be small unless -fast is used.",
                 lf_time_physical() - next_tag.time);
+    if (!fast) {
+        tracepoint_scheduler_wakeup(env->trace, lf_time_physical() - next_tag.time);
+        LF_PROBE1(wakeup, lf_time_physical() - next_tag.time);
+    }
 
 #ifdef FEDERATED
     // In federated execution (at least under decentralized coordination),
@@ -617,6 +961,9 @@ void lf_request_stop() {
         _lf_set_stop_tag(&env[i], (tag_t) {.time = max_current_tag.time, .microstep = max_current_tag.microstep+1});
         // Release the barrier on tag advancement.
         _lf_decrement_tag_barrier_locked(&env[i]);
+#ifdef LF_IN_PROCESS_FEDERATION
+        _lf_rti_local_notify_of_event_locked(&env[i]);
+#endif
 
         // We signal instead of broadcast under the assumption that only
         // one worker thread can call wait_until at a given time because
@@ -640,6 +987,9 @@ void lf_request_stop() {
 void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_number) {
     assert(env != GLOBAL_ENVIRONMENT);
 
+    if (_lf_is_pruned_for_deadline(env, reaction)) {
+        return;
+    }
 #ifdef MODAL_REACTORS
         // Check if reaction is disabled by mode inactivity
         if (_lf_mode_is_active(reaction->mode)) {
@@ -653,6 +1003,40 @@ void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_n
 #endif
 }
 
+/**
+ * Trigger the specified reactions, as _lf_trigger_reaction() does for each of
+ * them, but letting the scheduler insert them in bulk.
+ *
+ * @param env Environment within which we are executing.
+ * @param reactions The reactions, sorted by level.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call (see _lf_trigger_reaction()).
+ */
+void _lf_trigger_reactions(environment_t* env, reaction_t** reactions, size_t count, int worker_number) {
+    assert(env != GLOBAL_ENVIRONMENT);
+
+    if (_lf_deadline_admission == LF_DEADLINE_ADMISSION_PRUNE) {
+        // Trigger them one by one to prune those that cannot meet their deadline.
+        for (size_t i = 0; i < count; i++) {
+            _lf_trigger_reaction(env, reactions[i], worker_number);
+        }
+        return;
+    }
+
+#ifdef MODAL_REACTORS
+    // If a reaction is disabled by mode inactivity, trigger them one by one to suppress it.
+    for (size_t i = 0; i < count; i++) {
+        if (!_lf_mode_is_active(reactions[i]->mode)) {
+            for (size_t j = 0; j < count; j++) {
+                _lf_trigger_reaction(env, reactions[j], worker_number);
+            }
+            return;
+        }
+    }
+#endif
+    lf_scheduler_trigger_reactions(env->scheduler, reactions, count, worker_number);
+}
+
 /**
  * Perform the necessary operations before tag (0,0) can be processed.
  *
@@ -665,6 +1049,16 @@ void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_n
 void _lf_initialize_start_tag(environment_t *env) {
     assert(env != GLOBAL_ENVIRONMENT);
 
+    _lf_replay_start(env);
+    if (_lf_checkpoint_resume(env)) {
+        // The restored events take the place of startup reactions and timers.
+        if (lf_tag_compare(env->current_tag, env->stop_tag) >= 0) {
+            _lf_trigger_shutdown_reactions(env);
+        }
+        _lf_execution_started = true;
+        return;
+    }
+
     // Add reactions invoked at tag (0,0) (including startup reactions) to the reaction queue
     _lf_trigger_startup_reactions(env);
 
@@ -770,9 +1164,10 @@ bool _lf_worker_handle_deadline_violation_for_reaction(environment_t *env, int w
         // Get the current physical time.
         instant_t physical_time = lf_time_physical();
         // Check for deadline violation.
-        if (reaction->deadline == 0 || physical_time > env->current_tag.time + reaction->deadline) {
+        if (_lf_is_deadline_violated(env, reaction, physical_time)) {
             // Deadline violation has occurred.
             tracepoint_reaction_deadline_missed(env->trace, reaction, worker_number);
+            LF_PROBE2(deadline_missed, reaction->name, worker_number);
             violation_occurred = true;
             // Invoke the local handler, if there is one.
             reaction_function_t handler = reaction->deadline_violation_handler;
@@ -896,10 +1291,80 @@ void _lf_worker_invoke_reaction(environment_t *env, int worker_number, reaction_
     reaction->is_STP_violated = false;
 }
 
+#ifdef LF_SUSPENDABLE_REACTIONS
+/**
+ * Start 'reaction', which is suspendable, on a coroutine, or resume it if it
+ * is suspended, and once its function returns, schedule the resulting
+ * triggered reactions as _lf_worker_invoke_reaction() does.
+ * The mutex should NOT be locked when this function is called.
+ * @param env Environment within which we are executing.
+ * @param worker_number The ID of the worker.
+ * @param reaction The reaction to start or resume.
+ * @return true if the reaction is done, false if it is suspended.
+ */
+static bool _lf_worker_run_suspendable_reaction(environment_t *env, int worker_number, reaction_t* reaction) {
+    if (reaction->coroutine == NULL) {
+        if (_lf_worker_handle_violations(env, worker_number, reaction)) {
+            return true;
+        }
+        LF_PRINT_LOG("Worker %d: Invoking suspendable reaction %s at elapsed tag " PRINTF_TAG ".",
+                worker_number,
+                reaction->name,
+                env->current_tag.time - start_time,
+                env->current_tag.microstep);
+        _lf_reaction_begins(env, reaction, worker_number);
+    } else {
+        LF_PRINT_LOG("Worker %d: Resuming reaction %s.", worker_number, reaction->name);
+    }
+    if (!_lf_run_suspendable_reaction(env, reaction)) {
+        LF_PRINT_LOG("Worker %d: Reaction %s is suspended.", worker_number, reaction->name);
+        return false;
+    }
+    _lf_reaction_ends(env, reaction, worker_number);
+    schedule_output_reactions(env, reaction, worker_number);
+    reaction->is_STP_violated = false;
+    return true;
+}
+#endif
+
+#ifndef LF_PARALLEL_CHUNKS_PER_WORKER
+/**
+ * The number of chunks per worker into which lf_parallel_for() splits a loop
+ * if the caller gives no grain, so that the workers that start executing
+ * chunks late still get a share of the work.
+ */
+#define LF_PARALLEL_CHUNKS_PER_WORKER 4
+#endif
+
+void _lf_parallel_for(environment_t* env, size_t count, size_t grain, lf_parallel_body_t body, void* arg) {
+    if (count == 0) {
+        return;
+    }
+    lf_scheduler_t* scheduler = env->scheduler;
+    if (grain == 0) {
+        grain = LF_MAX(count / (scheduler->number_of_workers * LF_PARALLEL_CHUNKS_PER_WORKER), 1);
+    }
+    if (grain >= count || !scheduler->lends_idle_workers) {
+        body(arg, 0, count);
+        return;
+    }
+    lf_parallel_job_t job = {
+        .body = body,
+        .arg = arg,
+        .count = count,
+        .grain = grain,
+        .next_iteration = 0,
+        .helpers = 0,
+        .next = NULL
+    };
+    lf_sched_run_parallel_job(scheduler, &job);
+}
+
 void try_advance_level(environment_t* env, volatile size_t* next_reaction_level) {
     #ifdef FEDERATED
     stall_advance_level_federation(env, *next_reaction_level);
     #endif
+    LF_PROBE1(level_advance, *next_reaction_level);
     *next_reaction_level += 1;
 }
 /**
@@ -934,6 +1399,21 @@ void _lf_worker_do_work(environment_t *env, int worker_number) {
                 current_reaction_to_execute->chain_id,
                 current_reaction_to_execute->deadline);
 
+        // With a pool shared by enclaves, wait for a worker of the pool.
+        _lf_worker_pool_acquire(env);
+
+#ifdef LF_SUSPENDABLE_REACTIONS
+        if (_lf_is_suspendable(env, current_reaction_to_execute)) {
+            // A suspended reaction is done only once it is resumed and returns.
+            bool done = _lf_worker_run_suspendable_reaction(env, worker_number, current_reaction_to_execute);
+            _lf_worker_pool_release(env);
+            if (done) {
+                lf_sched_done_with_reaction(worker_number, current_reaction_to_execute);
+            }
+            continue;
+        }
+#endif
+
         bool violation = _lf_worker_handle_violations(
             env,
             worker_number,
@@ -945,6 +1425,8 @@ void _lf_worker_do_work(environment_t *env, int worker_number) {
             _lf_worker_invoke_reaction(env, worker_number, current_reaction_to_execute);
         }
 
+        _lf_worker_pool_release(env);
+
         LF_PRINT_DEBUG("Worker %d: Done with reaction %s.",
                 worker_number, current_reaction_to_execute->name);
 
@@ -952,6 +1434,31 @@ void _lf_worker_do_work(environment_t *env, int worker_number) {
     }
 }
 
+/**
+ * Pin the calling worker thread to a core or restrict it to a NUMA node if
+ * requested on the command line. This is done before the worker executes
+ * anything so that, on platforms with a first-touch allocation policy, memory
+ * that it writes first, such as its trace buffer, ends up on its local node.
+ * @param worker_number The number assigned to this worker thread.
+ */
+static void _lf_place_worker(int worker_number) {
+    if (_lf_pin_workers) {
+        size_t cpu = (size_t)worker_number % (size_t)lf_available_cores();
+        if (lf_thread_set_cpu(lf_thread_self(), cpu) != 0) {
+            lf_print_warning("Failed to pin worker %d to core %zu.", worker_number, cpu);
+        } else {
+            LF_PRINT_LOG("Pinned worker %d to core %zu.", worker_number, cpu);
+        }
+    } else if (_lf_numa_nodes > 0) {
+        size_t node = (size_t)worker_number % _lf_numa_nodes;
+        if (lf_thread_set_numa_node(lf_thread_self(), node) != 0) {
+            lf_print_warning("Failed to place worker %d on NUMA node %zu.", worker_number, node);
+        } else {
+            LF_PRINT_LOG("Placed worker %d on NUMA node %zu.", worker_number, node);
+        }
+    }
+}
+
 /**
  * Worker thread for the thread pool.
  * This acquires the mutex lock and releases it to wait for time to
@@ -967,9 +1474,41 @@ void* worker(void* arg) {
     int worker_number = worker_thread_count++;
     LF_PRINT_LOG("Worker thread %d started.", worker_number);
     lf_mutex_unlock(&env->mutex);
+    _lf_worker_number = worker_number;
+
+    _lf_place_worker(worker_number);
+
+    // Claim a slot for the lists that this worker appends to without synchronization.
+    int slot = lf_atomic_fetch_add(&env->worker_slots_claimed, 1);
+    if (slot < env->num_workers) {
+        _lf_worker_slot_index = slot;
+        _lf_worker_slot_env = env;
+    }
+
+    if (_lf_realtime_workers) {
+        // Start at the lowest real-time priority. Schedulers that are aware of
+        // deadlines raise it while executing reactions with tight deadlines.
+        lf_scheduling_policy_t policy = {
+            .policy = LF_SCHED_PRIORITY,
+            .priority = LF_SCHED_MIN_PRIORITY
+        };
+        if (lf_thread_set_scheduling_policy(lf_thread_self(), &policy) != 0) {
+            lf_print_warning("Failed to give worker %d a real-time scheduling policy.", worker_number);
+        }
+    }
 
     _lf_worker_do_work(env, worker_number);
 
+    // Release what a target runtime kept across reactions, such as the GIL of Python.
+    _LF_RUN_THREAD_RELEASE_HOOK();
+    lf_thread_release_hook = NULL;
+    _lf_worker_number = -1;
+
+    // Make the tokens recycled by this thread available to the thread that frees them.
+    _lf_release_token_cache();
+    _lf_worker_slot_index = -1;
+    _lf_worker_slot_env = NULL;
+
     lf_mutex_lock(&env->mutex);
 
     // This thread is exiting, so don't count it anymore.
@@ -1045,6 +1584,15 @@ void determine_number_of_workers(void) {
         _lf_number_of_workers = NUMBER_OF_WORKERS;
         #endif
     }
+    if (_lf_urgent_workers > 0u) {
+        if (lf_sched_selected()->kind == SCHED_GEDF_NP) {
+            // The scheduler treats the last workers as the urgent ones.
+            _lf_number_of_workers += _lf_urgent_workers;
+        } else {
+            lf_print_warning("--urgent-workers is only supported by the GEDF_NP scheduler. Ignoring it.");
+            _lf_urgent_workers = 0u;
+        }
+    }
 }
 
 /**
@@ -1098,6 +1646,7 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
     
     // Create and initialize the environments for each enclave
     _lf_create_environments();
+    instant_t environments_created = lf_time_physical();
 
     // Initialize the one global mutex
     if (lf_mutex_init(&global_mutex) != 0) {
@@ -1110,6 +1659,8 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         
     // Initialize the watchdog-specific mutexes. This is still handled globally and not per-environment
     _lf_initialize_watchdog_mutexes();
+    instant_t trigger_objects_initialized = lf_time_physical();
+    interval_t start_tags_time = 0;
     
     environment_t *envs;
     int num_envs = _lf_get_environments(&envs);
@@ -1117,10 +1668,16 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         // TODO: This must be refined when we introduce multiple enclaves
         keepalive_specified = true;
     }
+    _lf_worker_pool_init(envs, num_envs, (int)_lf_number_of_workers);
+#ifdef LF_IN_PROCESS_FEDERATION
+    // The channels between the environments have been created with the trigger objects.
+    _lf_rti_local_init(envs, num_envs);
+#endif
     
     // Do environment-specific setup
     for (int i = 0; i<num_envs; i++) {
         environment_t *env = &envs[i];
+        instant_t setup_began = lf_time_physical();
 
         // Initialize the start and stop tags of the environment
         environment_init_tags(env, start_time, duration);
@@ -1143,8 +1700,12 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         // Call the following function only once, rather than per worker thread (although
         // it can be probably called in that manner as well).
         _lf_initialize_start_tag(env);
+        start_tags_time += lf_time_physical() - setup_began;
 
-
+        if (i == num_envs - 1) {
+            _lf_print_startup_times(environments_created - start_time,
+                    trigger_objects_initialized - environments_created, start_tags_time);
+        }
         lf_print("Environment %u: ---- Spawning %d workers.",env->id, env->num_workers);
         start_threads(env);
         // Unlock mutex and allow threads proceed
@@ -1171,15 +1732,48 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
             LF_PRINT_LOG("---- All worker threads exited successfully.");
         }
     }
+#ifdef LF_IN_PROCESS_FEDERATION
+    _lf_rti_local_free();
+#endif
     return 0;
 }   
 
+#ifdef LF_TICKLESS
+/**
+ * @brief Return whether the thread that waits for physical time to reach the
+ * next tag, if any, has to wake up because the earliest event, the stop tag, or
+ * the inbox of physical actions has changed what it waits for.
+ * Events that do not precede the awaited time cause no wakeup.
+ * @param env Environment within which we are executing.
+ */
+static bool _lf_wakeup_needed(environment_t* env) {
+    instant_t sleeping_until = env->sleeping_until;
+    if (sleeping_until == NEVER || env->inbox != NULL) {
+        return true;
+    }
+    event_t* head = _lf_peek_event(env);
+    return (head != NULL && head->time < sleeping_until) || env->stop_tag.time < sleeping_until;
+}
+#endif
+
 /**
  * @brief Notify of new event by broadcasting on a condition variable. 
+ * With LF_TICKLESS, the broadcast is skipped if it would cause a wakeup
+ * only to wait for the same time again.
  * @param env Environment within which we are executing.
  */
 int lf_notify_of_event(environment_t* env) {
     assert(env != GLOBAL_ENVIRONMENT);
+    // The caller holds the mutex, so the count is not incremented concurrently.
+    env->notifications++;
+#ifdef LF_IN_PROCESS_FEDERATION
+    _lf_rti_local_notify_of_event_locked(env);
+#endif
+#ifdef LF_TICKLESS
+    if (!_lf_wakeup_needed(env)) {
+        return 0;
+    }
+#endif
     return lf_cond_broadcast(&env->event_q_changed);
 }
 
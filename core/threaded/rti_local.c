@@ -0,0 +1,214 @@
+#if defined(LF_IN_PROCESS_FEDERATION) && !defined(LF_SINGLE_THREADED)
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Definitions for in-process federation.
+ *
+ * The state of the enclaves is guarded by rti_mutex. Threads that hold the
+ * mutex of an environment acquire rti_mutex, but a thread that holds rti_mutex
+ * never acquires the mutex of an environment, so the two cannot deadlock.
+ * Whether an environment waits for a grant is only written with its mutex
+ * held, so that the threads that schedule events into it can tell without
+ * acquiring rti_mutex.
+ */
+
+#include <stdlib.h>
+
+#include "rti_local.h"
+#include "enclave.h"
+#include "enclave_channel.h"
+#include "reactor_common.h"
+#include "util.h"
+
+/** The mutex guarding the state of the enclaves, to which enclave.c refers. */
+lf_mutex_t rti_mutex;
+
+/** The RTI logic used by enclave.c. */
+extern enclave_rti_t* _e_rti;
+
+/** The RTI logic of the environments of this program. */
+static enclave_rti_t _lf_rti_local;
+
+/** The environments, whose indices are the IDs of their enclaves. */
+static environment_t* _lf_rti_local_envs = NULL;
+
+/** The enclaves, indexed by their IDs. */
+static enclave_t* _lf_rti_local_enclaves = NULL;
+
+/** Whether each environment waits for a grant, guarded by the mutex of the environment. */
+static bool* _lf_rti_local_waiting = NULL;
+
+/** Whether the wait of each environment for a grant has been interrupted, guarded by rti_mutex. */
+static bool* _lf_rti_local_interrupted = NULL;
+
+/**
+ * Add a connection with the specified delay from the enclave 'upstream' to 'e',
+ * or shorten the delay of the existing connection between them. As for the
+ * upstream_delay of enclave_t, 0LL encodes a delay of one microstep.
+ */
+static void _lf_rti_local_connect(enclave_t* e, enclave_t* upstream, interval_t delay) {
+    for (int i = 0; i < e->num_upstream; i++) {
+        if (e->upstream[i] == upstream->id) {
+            if (delay < e->upstream_delay[i]) {
+                e->upstream_delay[i] = delay;
+            }
+            return;
+        }
+    }
+    e->upstream = (int*)realloc(e->upstream, (e->num_upstream + 1) * sizeof(int));
+    e->upstream_delay = (interval_t*)realloc(e->upstream_delay, (e->num_upstream + 1) * sizeof(interval_t));
+    upstream->downstream = (int*)realloc(upstream->downstream, (upstream->num_downstream + 1) * sizeof(int));
+    lf_assert(e->upstream != NULL && e->upstream_delay != NULL && upstream->downstream != NULL, "Out of memory");
+    e->upstream[e->num_upstream] = upstream->id;
+    e->upstream_delay[e->num_upstream] = delay;
+    e->num_upstream++;
+    upstream->downstream[upstream->num_downstream++] = e->id;
+}
+
+void _lf_rti_local_init(environment_t* envs, int num_envs) {
+    if (lf_mutex_init(&rti_mutex) != 0) {
+        lf_print_error_and_exit("Could not initialize the mutex of the RTI logic.");
+    }
+    _lf_rti_local_envs = envs;
+    _lf_rti_local_enclaves = (enclave_t*)calloc(num_envs, sizeof(enclave_t));
+    _lf_rti_local.enclaves = (enclave_t**)calloc(num_envs, sizeof(enclave_t*));
+    _lf_rti_local_waiting = (bool*)calloc(num_envs, sizeof(bool));
+    _lf_rti_local_interrupted = (bool*)calloc(num_envs, sizeof(bool));
+    lf_assert(_lf_rti_local_enclaves != NULL && _lf_rti_local.enclaves != NULL
+            && _lf_rti_local_waiting != NULL && _lf_rti_local_interrupted != NULL, "Out of memory");
+    _lf_rti_local.number_of_enclaves = num_envs;
+    _lf_rti_local.max_stop_tag = NEVER_TAG;
+    _lf_rti_local.num_enclaves_handling_stop = 0;
+    _lf_rti_local.tracing_enabled = false;
+    _lf_rti_local.trace = NULL;
+    _lf_rti_local.grant_ahead = false;
+    _e_rti = &_lf_rti_local;
+
+    for (int i = 0; i < num_envs; i++) {
+        enclave_t* e = &_lf_rti_local_enclaves[i];
+        initialize_enclave(e, (uint16_t)i);
+        e->state = GRANTED;
+        e->mode = fast ? FAST : REALTIME;
+        _lf_rti_local.enclaves[i] = e;
+    }
+    // Connect the enclaves as the channels into each environment are. A
+    // channel with a delay of 0 delays messages by one microstep.
+    for (int i = 0; i < num_envs; i++) {
+        for (lf_enclave_channel_t* channel = envs[i].incoming_channels; channel != NULL; channel = channel->next) {
+            int source = (int)(channel->source - envs);
+            lf_assert(source >= 0 && source < num_envs, "A channel comes from an unknown environment.");
+            _lf_rti_local_connect(&_lf_rti_local_enclaves[i], &_lf_rti_local_enclaves[source],
+                    channel->delay > 0LL ? channel->delay : 0LL);
+        }
+        LF_PRINT_LOG("Environment %u has %d upstream and %d downstream environments.",
+                envs[i].id, _lf_rti_local_enclaves[i].num_upstream, _lf_rti_local_enclaves[i].num_downstream);
+    }
+}
+
+tag_t _lf_rti_local_next_event_tag_locked(environment_t* env, tag_t next_event_tag) {
+    if (_lf_rti_local_envs == NULL) {
+        return next_event_tag;
+    }
+    int id = (int)(env - _lf_rti_local_envs);
+    enclave_t* e = &_lf_rti_local_enclaves[id];
+    lf_mutex_lock(&rti_mutex);
+    _lf_rti_local_interrupted[id] = false;
+    update_enclave_next_event_tag_locked(e, next_event_tag);
+    if (e->num_upstream == 0) {
+        // Nothing can arrive from other environments.
+        lf_mutex_unlock(&rti_mutex);
+        return next_event_tag;
+    }
+    // Release the environment only while waiting, so that events can be
+    // scheduled into it and interrupt the wait.
+    _lf_rti_local_waiting[id] = true;
+    lf_mutex_unlock(&env->mutex);
+    while (lf_tag_compare(e->last_granted, next_event_tag) < 0
+            && lf_tag_compare(e->last_provisionally_granted, next_event_tag) < 0
+            && !_lf_rti_local_interrupted[id]) {
+        lf_cond_wait(&e->next_event_condition);
+    }
+    tag_t result = e->last_granted;
+    if (lf_tag_compare(e->last_provisionally_granted, result) > 0) {
+        result = e->last_provisionally_granted;
+    }
+    lf_mutex_unlock(&rti_mutex);
+    lf_mutex_lock(&env->mutex);
+    _lf_rti_local_waiting[id] = false;
+    LF_PRINT_DEBUG("Environment %u is granted " PRINTF_TAG " for next event " PRINTF_TAG ".", env->id,
+            result.time - lf_time_start(), result.microstep,
+            next_event_tag.time - lf_time_start(), next_event_tag.microstep);
+    return result;
+}
+
+void _lf_rti_local_logical_tag_complete_locked(environment_t* env, tag_t completed) {
+    if (_lf_rti_local_envs == NULL) {
+        return;
+    }
+    enclave_logical_tag_complete(&_lf_rti_local_enclaves[env - _lf_rti_local_envs], completed);
+}
+
+void _lf_rti_local_notify_of_event_locked(environment_t* env) {
+    if (_lf_rti_local_envs == NULL) {
+        return;
+    }
+    int id = (int)(env - _lf_rti_local_envs);
+    if (!_lf_rti_local_waiting[id]) {
+        return;
+    }
+    lf_mutex_lock(&rti_mutex);
+    _lf_rti_local_interrupted[id] = true;
+    lf_cond_signal(&_lf_rti_local_enclaves[id].next_event_condition);
+    lf_mutex_unlock(&rti_mutex);
+}
+
+void _lf_rti_local_resign_locked(environment_t* env) {
+    if (_lf_rti_local_envs == NULL) {
+        return;
+    }
+    enclave_t* e = &_lf_rti_local_enclaves[env - _lf_rti_local_envs];
+    lf_mutex_lock(&rti_mutex);
+    if (e->state != NOT_CONNECTED) {
+        LF_PRINT_LOG("Environment %u resigns from the coordination.", env->id);
+        e->state = NOT_CONNECTED;
+        update_paths_from_enclave(e);
+        bool* visited = (bool*)calloc(_lf_rti_local.number_of_enclaves, sizeof(bool));
+        lf_assert(visited != NULL, "Out of memory");
+        notify_downstream_advance_grant_if_safe(e, visited);
+        free(visited);
+    }
+    lf_mutex_unlock(&rti_mutex);
+}
+
+void _lf_rti_local_free(void) {
+    if (_lf_rti_local_envs == NULL) {
+        return;
+    }
+    for (int i = 0; i < _lf_rti_local.number_of_enclaves; i++) {
+        enclave_t* e = &_lf_rti_local_enclaves[i];
+        free(e->upstream);
+        free(e->upstream_delay);
+        free(e->downstream);
+        if (e->paths != NULL) {
+            free(e->paths->upstream);
+            free(e->paths->kind);
+            free(e->paths->delay);
+            free(e->paths->arrival);
+            free(e->paths->position);
+            for (int k = 0; k < NUMBER_OF_PATH_KINDS; k++) {
+                free(e->paths->heap[k]);
+            }
+            free(e->paths->downstream);
+            free(e->paths->downstream_path);
+            free(e->paths);
+        }
+    }
+    free(_lf_rti_local.enclaves);
+    free(_lf_rti_local_enclaves);
+    free(_lf_rti_local_waiting);
+    free(_lf_rti_local_interrupted);
+    _lf_rti_local_envs = NULL;
+}
+
+#endif
@@ -0,0 +1,613 @@
+#if !defined(LF_SINGLE_THREADED)
+/* Chain-aware non-preemptive scheduler for the threaded runtime of the C
+target of Lingua Franca. */
+
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * Chain-aware non-preemptive scheduler for the threaded runtime of the C
+ * target of Lingua Franca.
+ *
+ * The other schedulers execute reactions level by level and wait for an entire
+ * level to finish before starting the next one. This scheduler instead uses
+ * the `chain_id` of reactions, which encodes the branches of the dependency
+ * graph that each reaction has upstream. A triggered reaction is released as
+ * soon as no queued or executing reaction at a lower level shares a chain with
+ * it. Independent branches of a program therefore do not wait for each other
+ * at level boundaries. Among the released reactions, one at the lowest level is
+ * chosen.
+ *
+ * A reaction with a `chain_id` of 0 is conservatively treated as overlapping
+ * with every chain.
+ *
+ * The queued reactions are kept in one list per level. For every chain bit,
+ * the scheduler counts the queued or executing reactions at each level and
+ * tracks the lowest level at which there is one, so checking whether a
+ * reaction is blocked takes one comparison per bit of its `chain_id`. Only
+ * finishing a reaction can release others, namely those at the levels between
+ * the old and the new lowest level of one of its chains, so the lists remember
+ * which of their reactions are blocked until then. A worker is only woken up
+ * when a reaction is released for it.
+ *
+ * Because a reaction can start while reactions on other chains at lower levels
+ * are still pending, the execute-now optimization in
+ * `schedule_output_reactions` is disabled when this scheduler is selected.
+ */
+#include "lf_types.h"
+#if SCHEDULER == SCHED_CHAIN_NP || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT CHAIN_NP
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif  // NUMBER_OF_WORKERS
+
+#include <assert.h>
+
+#include "platform.h"
+#include "environment.h"
+#include "reactor_threaded.h"
+#include "scheduler_instance.h"
+#include "scheduler_sync_tag_advance.h"
+#include "scheduler.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
+#ifdef FEDERATED
+#include "federate.h"
+#endif
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+/**
+ * Number of bits of the `chain_id` of a reaction.
+ */
+#define LF_CHAIN_BITS 64
+
+/**
+ * Number of levels tracked by each word of the candidate-levels bitmap.
+ */
+#define LF_LEVELS_PER_WORD 32
+
+/**
+ * The number of pending reactions, which are queued or executing, at each
+ * level, and the lowest level at which there is one, or the number of levels
+ * if there is none.
+ */
+typedef struct pending_levels_t {
+    int* count;
+    size_t lowest;
+} pending_levels_t;
+
+typedef struct custom_scheduler_data_t {
+    /** Protects all the fields below. */
+    lf_mutex_t mutex;
+    /**
+     * Signaled when a reaction is released for a waiting worker, and broadcast
+     * when the workers should stop.
+     */
+    lf_cond_t reaction_q_changed;
+    /** The number of levels. */
+    size_t num_levels;
+    /**
+     * The triggered reactions that have not been handed to a worker yet, in
+     * one list per level. The list of level `l` starts at `level_offsets[l]`,
+     * has room for `level_offsets[l + 1] - level_offsets[l]` reactions and
+     * holds `num_queued_at[l]` of them. The first `num_blocked_at[l]` of them
+     * are known to be blocked.
+     */
+    reaction_t** queued;
+    size_t* level_offsets;
+    size_t* num_queued_at;
+    size_t* num_blocked_at;
+    /** The number of triggered reactions that have not been handed to a worker yet. */
+    size_t num_queued;
+    /** The number of reactions that are being executed by a worker. */
+    size_t num_executing;
+    /**
+     * Bitmap with one bit per level whose list may hold reactions that are not
+     * known to be blocked.
+     */
+    unsigned int* candidate_levels;
+    /** The number of words in `candidate_levels`. */
+    size_t candidate_levels_size;
+    /** The pending reactions of all chains. */
+    pending_levels_t all;
+    /** The pending reactions with a `chain_id` of 0, which block every chain. */
+    pending_levels_t unchained;
+    /** The pending reactions whose `chain_id` has each bit set. */
+    pending_levels_t chains[LF_CHAIN_BITS];
+    /** The number of workers waiting on `reaction_q_changed`. */
+    size_t num_waiting;
+    /** Whether a worker is currently advancing the tag. */
+    bool advancing_tag;
+} custom_scheduler_data_t;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * @brief Return the index of the least significant set bit in a non-zero
+ * 'word'.
+ */
+static inline size_t _lf_sched_lowest_set_bit(unsigned int word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctz(word);
+#else
+    size_t bit = 0;
+    while ((word & 1u) == 0) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Return the index of the least significant set bit in a non-zero
+ * 'chain'.
+ */
+static inline size_t _lf_sched_lowest_chain_bit(unsigned long long chain) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(chain);
+#else
+    size_t bit = 0;
+    while ((chain & 1ULL) == 0ULL) {
+        chain >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Forget which reactions at the levels from 'from' to 'to', inclusive,
+ * are blocked, because they may have been released.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static void _lf_sched_mark_candidates(custom_scheduler_data_t* data, size_t from, size_t to) {
+    if (to >= data->num_levels) {
+        to = data->num_levels - 1;
+    }
+    for (size_t level = from; level <= to; level++) {
+        data->num_blocked_at[level] = 0;
+        if (data->num_queued_at[level] > 0) {
+            data->candidate_levels[level / LF_LEVELS_PER_WORD] |= 1u << (level % LF_LEVELS_PER_WORD);
+        }
+    }
+}
+
+/**
+ * @brief Count a pending reaction at 'level' in 'pending'.
+ */
+static inline void _lf_sched_add_pending(pending_levels_t* pending, size_t level) {
+    pending->count[level]++;
+    if (level < pending->lowest) {
+        pending->lowest = level;
+    }
+}
+
+/**
+ * @brief Stop counting a pending reaction at 'level' in 'pending'. If that
+ * raises the lowest level, the reactions above the old lowest level up to the
+ * new one may be released.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static void _lf_sched_remove_pending(custom_scheduler_data_t* data, pending_levels_t* pending, size_t level) {
+    if (--pending->count[level] > 0 || level != pending->lowest) {
+        return;
+    }
+    do {
+        pending->lowest++;
+    } while (pending->lowest < data->num_levels && pending->count[pending->lowest] == 0);
+    _lf_sched_mark_candidates(data, level + 1, pending->lowest);
+}
+
+/**
+ * @brief Count 'reaction' as pending if 'add' is true, or stop counting it.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static void _lf_sched_track_pending(custom_scheduler_data_t* data, reaction_t* reaction, bool add) {
+    size_t level = LF_LEVEL(reaction->index);
+    unsigned long long chain = reaction->chain_id;
+    if (add) {
+        _lf_sched_add_pending(&data->all, level);
+        if (chain == 0ULL) {
+            _lf_sched_add_pending(&data->unchained, level);
+        }
+        for (; chain != 0ULL; chain &= chain - 1) {
+            _lf_sched_add_pending(&data->chains[_lf_sched_lowest_chain_bit(chain)], level);
+        }
+    } else {
+        _lf_sched_remove_pending(data, &data->all, level);
+        if (chain == 0ULL) {
+            _lf_sched_remove_pending(data, &data->unchained, level);
+        }
+        for (; chain != 0ULL; chain &= chain - 1) {
+            _lf_sched_remove_pending(data, &data->chains[_lf_sched_lowest_chain_bit(chain)], level);
+        }
+    }
+}
+
+/**
+ * @brief Return true if 'reaction' has to wait for a queued or executing
+ * reaction. That is the case if one of them has a lower level and shares a
+ * chain with 'reaction'.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static bool _lf_sched_is_blocked(custom_scheduler_data_t* data, reaction_t* reaction) {
+    size_t level = LF_LEVEL(reaction->index);
+    unsigned long long chain = reaction->chain_id;
+    if (chain == 0ULL) {
+        return data->all.lowest < level;
+    }
+    if (data->unchained.lowest < level) {
+        return true;
+    }
+    for (; chain != 0ULL; chain &= chain - 1) {
+        if (data->chains[_lf_sched_lowest_chain_bit(chain)].lowest < level) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Queue 'reaction', which has just been triggered.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static void _lf_sched_enqueue(custom_scheduler_data_t* data, reaction_t* reaction) {
+    size_t level = LF_LEVEL(reaction->index);
+    size_t position = data->level_offsets[level] + data->num_queued_at[level];
+    lf_assert(position < data->level_offsets[level + 1], "Scheduler: Reaction queue overflow.");
+    data->queued[position] = reaction;
+    data->num_queued_at[level]++;
+    data->num_queued++;
+    data->candidate_levels[level / LF_LEVELS_PER_WORD] |= 1u << (level % LF_LEVELS_PER_WORD);
+    // A new pending reaction can block others but never releases one.
+    _lf_sched_track_pending(data, reaction, true);
+}
+
+/**
+ * @brief Return a queued reaction at the lowest level that is not blocked, or
+ * NULL if there is none. If 'remove' is true, the reaction is also removed
+ * from the queue.
+ *
+ * Each reaction found to be blocked is remembered as such, so it is checked
+ * again only once finishing another reaction may have released it.
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static reaction_t* _lf_sched_find_released_reaction(custom_scheduler_data_t* data, bool remove) {
+    for (size_t word = 0; word < data->candidate_levels_size; word++) {
+        while (data->candidate_levels[word] != 0) {
+            size_t level = word * LF_LEVELS_PER_WORD + _lf_sched_lowest_set_bit(data->candidate_levels[word]);
+            reaction_t** list = &data->queued[data->level_offsets[level]];
+            while (data->num_blocked_at[level] < data->num_queued_at[level]) {
+                reaction_t* reaction = list[data->num_blocked_at[level]];
+                if (_lf_sched_is_blocked(data, reaction)) {
+                    data->num_blocked_at[level]++;
+                    continue;
+                }
+                if (remove) {
+                    list[data->num_blocked_at[level]] = list[--data->num_queued_at[level]];
+                    data->num_queued--;
+                }
+                return reaction;
+            }
+            data->candidate_levels[word] &= ~(1u << (level % LF_LEVELS_PER_WORD));
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Wake up one waiting worker if a reaction is released for it.
+ *
+ * This function assumes the caller holds the scheduler mutex.
+ */
+static inline void _lf_sched_notify_worker(custom_scheduler_data_t* data) {
+    if (data->num_waiting > 0 && !data->advancing_tag && _lf_sched_find_released_reaction(data, false) != NULL) {
+        lf_cond_signal(&data->reaction_q_changed);
+    }
+}
+
+/**
+ * @brief Advance the tag on behalf of all workers.
+ *
+ * This function assumes the caller holds the scheduler mutex and that no
+ * reaction is queued or executing. The scheduler mutex is released while the
+ * tag advances so that `_lf_pop_events` can trigger reactions. The calling
+ * worker then takes the first of them and wakes up the other workers as
+ * needed.
+ *
+ * @return true if the worker threads should exit.
+ */
+static bool _lf_sched_advance_tag(lf_scheduler_t* scheduler) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    environment_t* env = scheduler->env;
+    data->advancing_tag = true;
+    lf_mutex_unlock(&data->mutex);
+
+    lf_mutex_lock(&env->mutex);
+    LF_PRINT_DEBUG("Scheduler: Advancing tag.");
+    bool should_exit = _lf_sched_advance_tag_locked(scheduler);
+    lf_mutex_unlock(&env->mutex);
+
+    lf_mutex_lock(&data->mutex);
+    data->advancing_tag = false;
+    if (should_exit) {
+        LF_PRINT_DEBUG("Scheduler: Reached stop tag.");
+        scheduler->should_stop = true;
+        lf_cond_broadcast(&data->reaction_q_changed);
+    }
+    return should_exit;
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * If the scheduler is already initialized, this will be a no-op.
+ *
+ * @param env Environment within which we are executing.
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param option Pointer to a `sched_params_t` struct containing additional
+ *  scheduler parameters.
+ */
+void lf_sched_init(
+    environment_t* env,
+    size_t number_of_workers,
+    sched_params_t* params
+) {
+    assert(env != GLOBAL_ENVIRONMENT);
+
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers", number_of_workers);
+
+    // Like the NP scheduler, this scheduler requires `num_reactions_per_level`
+    // to size its queues.
+    if (init_sched_instance(env, &env->scheduler, number_of_workers, params)) {
+        // Scheduler has not been initialized before.
+        if (params == NULL || params->num_reactions_per_level == NULL) {
+            lf_print_error_and_exit(
+                "Scheduler: Internal error. The CHAIN_NP scheduler "
+                "requires params.num_reactions_per_level to be set.");
+        }
+    } else {
+        // Already initialized
+        return;
+    }
+    lf_scheduler_t* scheduler = env->scheduler;
+
+    scheduler->custom_data = (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    lf_assert(scheduler->custom_data != NULL, "Out of memory");
+    custom_scheduler_data_t* data = scheduler->custom_data;
+
+    // Each reaction is triggered at most once per tag.
+    data->num_levels = scheduler->max_reaction_level + 1;
+    data->level_offsets = (size_t*)calloc(data->num_levels + 1, sizeof(size_t));
+    lf_assert(data->level_offsets != NULL, "Out of memory");
+    for (size_t i = 0; i < data->num_levels; i++) {
+        data->level_offsets[i + 1] = data->level_offsets[i] + params->num_reactions_per_level[i];
+    }
+    data->queued = (reaction_t**)calloc(data->level_offsets[data->num_levels] + 1, sizeof(reaction_t*));
+    data->num_queued_at = (size_t*)calloc(data->num_levels, sizeof(size_t));
+    data->num_blocked_at = (size_t*)calloc(data->num_levels, sizeof(size_t));
+    data->candidate_levels_size = (data->num_levels + LF_LEVELS_PER_WORD - 1) / LF_LEVELS_PER_WORD;
+    data->candidate_levels = (unsigned int*)calloc(data->candidate_levels_size, sizeof(unsigned int));
+    lf_assert(data->queued != NULL && data->num_queued_at != NULL && data->num_blocked_at != NULL
+            && data->candidate_levels != NULL, "Out of memory");
+
+    // The counts of all the chain bits, the unchained reactions and all
+    // reactions share one allocation.
+    int* counts = (int*)calloc((LF_CHAIN_BITS + 2) * data->num_levels, sizeof(int));
+    lf_assert(counts != NULL, "Out of memory");
+    data->all = (pending_levels_t){counts, data->num_levels};
+    data->unchained = (pending_levels_t){counts + data->num_levels, data->num_levels};
+    for (size_t bit = 0; bit < LF_CHAIN_BITS; bit++) {
+        data->chains[bit] = (pending_levels_t){counts + (bit + 2) * data->num_levels, data->num_levels};
+    }
+
+    lf_mutex_init(&data->mutex);
+    lf_cond_init(&data->reaction_q_changed, &data->mutex);
+    LF_PRINT_DEBUG("Scheduler: Initialized queues with capacity %zu.", data->level_offsets[data->num_levels]);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free(lf_scheduler_t* scheduler) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    free(data->queued);
+    free(data->level_offsets);
+    free(data->num_queued_at);
+    free(data->num_blocked_at);
+    free(data->candidate_levels);
+    free(data->all.count);
+    free(data);
+    lf_semaphore_destroy(scheduler->semaphore);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for worker thread
+ * 'worker_number' or it is time for the worker thread to stop and exit (where a
+ * NULL value would be returned). If more reactions are released, it wakes up
+ * another worker to take the next one.
+ *
+ * @param worker_number
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    lf_mutex_lock(&data->mutex);
+    while (!scheduler->should_stop) {
+        if (!data->advancing_tag) {
+            reaction_t* reaction_to_return = _lf_sched_find_released_reaction(data, true);
+            if (reaction_to_return != NULL) {
+                data->num_executing++;
+                _lf_sched_notify_worker(data);
+                lf_mutex_unlock(&data->mutex);
+                LF_PRINT_DEBUG("Scheduler: Worker %d got reaction %s.",
+                        worker_number, reaction_to_return->name);
+#ifdef FEDERATED
+                // Network input ports at lower levels must be known first.
+                stall_advance_level_federation(scheduler->env, LF_LEVEL(reaction_to_return->index));
+#endif
+                return reaction_to_return;
+            }
+            if (data->num_queued == 0 && data->num_executing == 0) {
+                // Nothing more happening at this tag.
+                if (_lf_sched_advance_tag(scheduler)) {
+                    break;
+                }
+                continue;
+            }
+        }
+        LF_PRINT_DEBUG("Worker %d is out of ready reactions.", worker_number);
+        data->num_waiting++;
+        tracepoint_worker_wait_starts(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_start, worker_number);
+        lf_cond_wait(&data->reaction_q_changed);
+        tracepoint_worker_wait_ends(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_end, worker_number);
+        data->num_waiting--;
+    }
+    lf_mutex_unlock(&data->mutex);
+
+    // It's time for the worker thread to stop and exit.
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * This may release reactions that were waiting for 'done_reaction'. No worker
+ * is woken up for them here because the calling worker asks for its next
+ * reaction right after, which takes the first of them and wakes up other
+ * workers for the rest, or advances the tag if this was the last reaction.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number,
+                                 reaction_t* done_reaction) {
+    custom_scheduler_data_t* data =
+        ((self_base_t*)done_reaction->self)->environment->scheduler->custom_data;
+    lf_mutex_lock(&data->mutex);
+    data->num_executing--;
+    _lf_sched_track_pending(data, done_reaction, false);
+    if (!lf_bool_compare_and_swap(&done_reaction->status, queued, inactive)) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                             done_reaction->status, queued);
+    }
+    lf_mutex_unlock(&data->mutex);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a worker number is not available (e.g., this function is not called by a
+ * worker thread), -1 should be passed as the 'worker_number'.
+ *
+ * The scheduler will ensure that the same reaction is not triggered twice in
+ * the same tag.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ *  be used if there is only one worker (e.g., when the program is using the
+ *  single-threaded C runtime). -1 is used for an anonymous call in a context where a
+ *  worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %lld.",
+            reaction->name, LF_LEVEL(reaction->index));
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    lf_mutex_lock(&data->mutex);
+    _lf_sched_enqueue(data, reaction);
+    if (data->num_waiting > 0 && !data->advancing_tag && !_lf_sched_is_blocked(data, reaction)) {
+        lf_cond_signal(&data->reaction_q_changed);
+    }
+    lf_mutex_unlock(&data->mutex);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag. The reactions that this call wins are
+ * queued under a single acquisition of the mutex.
+ *
+ * @param reactions The reactions to trigger at the current tag.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call, or -1.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    bool locked = false;
+    for (size_t i = 0; i < count; i++) {
+        reaction_t* reaction = reactions[i];
+        if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+            continue;
+        }
+        LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %lld.",
+                reaction->name, LF_LEVEL(reaction->index));
+        if (!locked) {
+            lf_mutex_lock(&data->mutex);
+            locked = true;
+        }
+        _lf_sched_enqueue(data, reaction);
+    }
+    if (locked) {
+        // The worker that wakes up wakes up another one if more are released.
+        _lf_sched_notify_worker(data);
+        lf_mutex_unlock(&data->mutex);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler. This is never the case with this
+ * scheduler because it can start a reaction while reactions at lower levels
+ * that enable the same downstream reaction are still pending.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return false;
+}
+
+LF_SCHED_REGISTER();
+#endif
+#endif
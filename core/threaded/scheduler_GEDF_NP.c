@@ -36,7 +36,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * @author{Marten Lohstroh <marten@berkeley.edu>}
  */
 #include "lf_types.h"
-#if SCHEDULER == SCHED_GEDF_NP
+#if SCHEDULER == SCHED_GEDF_NP || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT GEDF_NP
 #ifndef NUMBER_OF_WORKERS
 #define NUMBER_OF_WORKERS 1
 #endif  // NUMBER_OF_WORKERS
@@ -46,15 +47,230 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "platform.h"
 #include "environment.h"
 #include "pqueue.h"
+#include "pqueue_dary.h"
+#include "reactor_common.h"
 #include "reactor_threaded.h"
 #include "scheduler_instance.h"
 #include "scheduler_sync_tag_advance.h"
 #include "scheduler.h"
 #include "semaphore.h"
+#include "future.h"
+#include "probes.h"
 #include "trace.h"
 #include "util.h"
 
+/////////////////// Scheduler Variables and Structs /////////////////////////
+typedef struct custom_scheduler_data_t {
+    /**
+     * The real-time priority that each worker currently runs at. This is
+     * only allocated if the workers run with real-time priorities.
+     */
+    int* worker_priorities;
+    /**
+     * The criticality mode. Reactions less critical than this are deferred
+     * or shed, according to _lf_criticality_policy.
+     */
+    volatile int criticality;
+    /**
+     * Whether a reaction at the current tag has been found at risk of missing
+     * its deadline.
+     */
+    volatile bool risk_seen;
+    /**
+     * Reactions of the current level deferred because of the criticality
+     * mode, ordered by deadline. This is accessed under the mutex of the
+     * current level.
+     */
+    pqueue_t* deferred;
+    /**
+     * The number of the first urgent worker. Workers from this one on only
+     * take reactions without deadlines if no other worker is busy.
+     */
+    size_t first_urgent_worker;
+    /**
+     * The number of workers other than the urgent ones that are not waiting
+     * for work. Such a worker decrements this under the mutex of the current
+     * level when it finds no reaction, so an urgent worker that sees it above
+     * 0 under that mutex can leave reactions to it.
+     */
+    volatile int busy_workers;
+} custom_scheduler_data_t;
+
+/**
+ * A reaction of criticality above 0 is deemed at risk of missing its deadline
+ * when its estimated completion time leaves less than this fraction of the
+ * deadline as margin.
+ */
+#define LF_CRITICALITY_MARGIN_DIVISOR 4
+
+/**
+ * The number of reactions of criticality 0 that a reserved worker looks past for
+ * one of higher criticality.
+ */
+#define LF_CRITICALITY_SEARCH_DEPTH 16
+
 /////////////////// Scheduler Private API /////////////////////////
+/**
+ * @brief Return the real-time priority for a worker executing a reaction with
+ * the given 'deadline'.
+ *
+ * Reactions without a deadline run at the lowest priority. Otherwise, the
+ * priority decreases with the number of bits needed to represent the deadline,
+ * so that reactions with tighter deadlines run at higher priorities. The
+ * highest and the lowest priority are left for other threads.
+ *
+ * @param deadline The deadline of the reaction, negative if it has none.
+ */
+static int _lf_sched_priority_for_deadline(interval_t deadline) {
+    if (deadline < 0LL) {
+        return LF_SCHED_MIN_PRIORITY;
+    }
+    int bits = 0;
+    while (deadline > 0LL) {
+        bits++;
+        deadline >>= 1;
+    }
+    int priority = LF_SCHED_MAX_PRIORITY - 1 - bits;
+    return (priority > LF_SCHED_MIN_PRIORITY) ? priority : LF_SCHED_MIN_PRIORITY + 1;
+}
+
+/**
+ * @brief Change the real-time priority of the calling worker to match the
+ * deadline of the reaction it is about to execute.
+ *
+ * The priority is only changed if it differs from the current one to avoid
+ * a system call for every reaction.
+ *
+ * @param worker_number The worker number of the calling worker.
+ * @param reaction The reaction that the worker is about to execute.
+ */
+static void _lf_sched_update_worker_priority(
+    lf_scheduler_t* scheduler,
+    int worker_number,
+    reaction_t* reaction
+) {
+    if (scheduler->custom_data->worker_priorities == NULL
+            || (size_t)worker_number >= scheduler->number_of_workers) {
+        return;
+    }
+    int priority = ((size_t)worker_number >= scheduler->custom_data->first_urgent_worker)
+            ? LF_SCHED_MAX_PRIORITY - 1 : _lf_sched_priority_for_deadline(reaction->deadline);
+    int* current_priority = &scheduler->custom_data->worker_priorities[worker_number];
+    if (priority != *current_priority) {
+        if (lf_thread_set_priority(lf_thread_self(), priority) == 0) {
+            *current_priority = priority;
+        } else {
+            LF_PRINT_DEBUG("Scheduler: Failed to set the priority of worker %d to %d.",
+                        worker_number, priority);
+        }
+    }
+}
+
+/**
+ * @brief Raise the criticality mode to that of 'reaction' if it is at risk of
+ * missing its deadline.
+ *
+ * @param worker_number The worker number of the calling worker.
+ * @param reaction The reaction that the worker is about to execute.
+ */
+static void _lf_sched_check_criticality(lf_scheduler_t* scheduler, int worker_number, reaction_t* reaction) {
+    if (reaction->criticality <= 0 || reaction->deadline <= 0LL) {
+        return;
+    }
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    instant_t completion = lf_time_physical() + _lf_reaction_exec_time_estimate(reaction)
+            + reaction->deadline / LF_CRITICALITY_MARGIN_DIVISOR;
+    if (completion <= scheduler->env->current_tag.time + reaction->deadline) {
+        return;
+    }
+    data->risk_seen = true;
+    int mode = data->criticality;
+    while (mode < reaction->criticality) {
+        if (lf_bool_compare_and_swap(&data->criticality, mode, reaction->criticality)) {
+            LF_PRINT_LOG("Scheduler: Reaction %s is at risk of missing its deadline. "
+                    "Raising the criticality mode to %d.", reaction->name, reaction->criticality);
+            tracepoint_scheduler_criticality_change(scheduler->env->trace, worker_number,
+                    reaction->criticality);
+            break;
+        }
+        mode = data->criticality;
+    }
+}
+
+/**
+ * @brief Return whether 'reaction' has a deadline, either its own or one
+ * inferred from reactions downstream of it.
+ */
+static bool _lf_sched_has_deadline(reaction_t* reaction) {
+    index_t inferred_deadline = LF_INDEX_DEADLINE(reaction->index);
+    return reaction->deadline >= 0LL
+        || (inferred_deadline > 0 && inferred_deadline < (index_t)(INT64_MAX >> 16));
+}
+
+/**
+ * @brief Pop the next reaction to execute from the queue of the current level,
+ * deferring or shedding those below the criticality mode, give reserved
+ * workers a reaction of criticality above 0 if there is one, and leave
+ * reactions without deadlines to busy workers other than the urgent ones.
+ *
+ * This assumes that the caller holds the mutex of the current level.
+ *
+ * @param worker_number The worker number of the calling worker.
+ * @return The reaction, or NULL if there is none for the worker.
+ */
+static reaction_t* _lf_sched_pop_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    pqueue_t* queue = (pqueue_t*)scheduler->executing_reactions;
+    reaction_t* reaction;
+    while ((reaction = (reaction_t*)pqueue_pop(queue)) != NULL
+            && reaction->criticality < data->criticality) {
+        if (_lf_criticality_policy == LF_CRITICALITY_SHED) {
+            LF_PRINT_LOG("Scheduler: Shedding reaction %s in criticality mode %d.",
+                    reaction->name, data->criticality);
+            lf_bool_compare_and_swap(&reaction->status, queued, inactive);
+        } else {
+            pqueue_insert(data->deferred, reaction);
+        }
+    }
+    if (reaction == NULL) {
+        reaction = (reaction_t*)pqueue_pop(data->deferred);
+        if (reaction != NULL && (size_t)worker_number >= data->first_urgent_worker
+                && !_lf_sched_has_deadline(reaction) && data->busy_workers > 0) {
+            pqueue_insert(data->deferred, reaction);
+            return NULL;
+        }
+        return reaction;
+    }
+    if ((size_t)worker_number >= data->first_urgent_worker
+            && !_lf_sched_has_deadline(reaction) && data->busy_workers > 0) {
+        // The queue is in deadline order, so no reaction with a deadline is left.
+        pqueue_insert(queue, reaction);
+        return NULL;
+    }
+    if (reaction->criticality == 0 && (size_t)worker_number < _lf_critical_workers) {
+        // Look for a more critical reaction further down the queue, putting back
+        // the ones passed over.
+        reaction_t* passed_over[LF_CRITICALITY_SEARCH_DEPTH];
+        size_t count = 0;
+        reaction_t* critical = NULL;
+        while (count < LF_CRITICALITY_SEARCH_DEPTH
+                && (critical = (reaction_t*)pqueue_pop(queue)) != NULL
+                && critical->criticality == 0) {
+            passed_over[count++] = critical;
+        }
+        for (size_t i = 0; i < count; i++) {
+            pqueue_insert(queue, passed_over[i]);
+        }
+        if (critical != NULL && critical->criticality > 0) {
+            pqueue_insert(queue, reaction);
+            reaction = critical;
+        } else if (critical != NULL) {
+            pqueue_insert(queue, critical);
+        }
+    }
+    return reaction;
+}
+
 /**
  * @brief Insert 'reaction' into scheduler->triggered_reactions
  * at the appropriate level.
@@ -82,7 +298,7 @@ static inline void _lf_sched_insert_reaction(lf_scheduler_t* scheduler, reaction
  * @return Number of reactions that were successfully distributed to worker
  * threads.
  */
-int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
+static int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
     pqueue_t* tmp_queue = NULL;
     // Note: All the threads are idle, which means that they are done inserting
     // reactions. Therefore, the reaction queues can be accessed without locking
@@ -110,7 +326,7 @@ int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
  *
  * This assumes that the caller is not holding any thread mutexes.
  */
-void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
+static void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
     // Note: All threads are idle. Therefore, there is no need to lock the mutex
     // while accessing the executing queue (which is pointing to one of the
     // reaction queues).
@@ -133,7 +349,7 @@ void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
  * @brief Signal all worker threads that it is time to stop.
  *
  */
-void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
+static void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
     scheduler->should_stop = true;
     lf_semaphore_release(scheduler->semaphore,
                          (scheduler->number_of_workers - 1));
@@ -147,7 +363,7 @@ void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
  *
  * This function assumes the caller does not hold the 'mutex' lock.
  */
-void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
+static void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
     environment_t* env = scheduler->env;
 
     // Executing queue must be empty when this is called.
@@ -160,6 +376,14 @@ void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
             lf_mutex_lock(&env->mutex);
             // Nothing more happening at this tag.
             LF_PRINT_DEBUG("Scheduler: Advancing tag.");
+            // Leave the criticality mode once a tag has passed with no reaction at risk.
+            custom_scheduler_data_t* data = scheduler->custom_data;
+            if (data->criticality > 0 && !data->risk_seen) {
+                LF_PRINT_LOG("Scheduler: Leaving criticality mode %d.", data->criticality);
+                data->criticality = 0;
+                tracepoint_scheduler_criticality_change(env->trace, -1, 0);
+            }
+            data->risk_seen = false;
             // This worker thread will take charge of advancing tag.
             if (_lf_sched_advance_tag_locked(scheduler)) {
                 LF_PRINT_DEBUG("Scheduler: Reached stop tag.");
@@ -187,15 +411,22 @@ void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
  * @param worker_number The worker number of the worker thread asking for work
  * to be assigned to it.
  */
-void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
-    // Increment the number of idle workers by 1 and check if this is the last
-    // worker thread to become idle.
-    if (lf_atomic_add_fetch(&scheduler->number_of_idle_workers,
-                            1) ==
-        scheduler->number_of_workers) {
+static void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
+    // Count this worker as idle and check if this is the last worker thread
+    // to become idle. The last one distributes the reactions that the others
+    // triggered, so each releases its writes and the last acquires them.
+    if (lf_sched_become_idle(scheduler)) {
         // Last thread to go idle
         LF_PRINT_DEBUG("Scheduler: Worker %zu is the last idle thread.",
                     worker_number);
+#ifdef LF_SUSPENDABLE_REACTIONS
+        // The level is not done while one of its reactions is suspended.
+        // Resume such reactions as they become resumable instead.
+        if (lf_sched_wait_for_resumable_reaction(scheduler)) {
+            lf_atomic_add_fetch(&scheduler->number_of_idle_workers, -1);
+            return;
+        }
+#endif
         // Call on the scheduler to distribute work or advance tag.
         _lf_scheduler_try_advance_tag_and_distribute(scheduler);
     } else {
@@ -205,7 +436,7 @@ void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
             "Scheduler: Worker %zu is trying to acquire the scheduling "
             "semaphore.",
             worker_number);
-        lf_semaphore_acquire(scheduler->semaphore);
+        lf_sched_wait_on_semaphore(scheduler, worker_number);
         LF_PRINT_DEBUG("Scheduler: Worker %zu acquired the scheduling semaphore.",
                     worker_number);
     }
@@ -245,6 +476,9 @@ void lf_sched_init(
     scheduler->array_of_mutexes = (lf_mutex_t*)calloc(
         (scheduler->max_reaction_level + 1), sizeof(lf_mutex_t));
 
+    // No reaction is ever inserted at a level without reactions, so all such
+    // levels share one empty queue.
+    pqueue_t* empty_queue = NULL;
     size_t queue_size = INITIAL_REACT_QUEUE_SIZE;
     for (size_t i = 0; i <= scheduler->max_reaction_level; i++) {
         if (params != NULL) {
@@ -253,16 +487,47 @@ void lf_sched_init(
             }
         }
         // Initialize the reaction queues
-        ((pqueue_t**)scheduler->triggered_reactions)[i] =
-            pqueue_init(queue_size, in_reverse_order, get_reaction_index,
-                        get_reaction_position, set_reaction_position,
-                        reaction_matches, print_reaction);
+        if (queue_size > 0) {
+            ((pqueue_t**)scheduler->triggered_reactions)[i] =
+                pqueue_dary_init(queue_size, in_reverse_order, get_reaction_index,
+                            get_reaction_position, set_reaction_position,
+                            reaction_matches, print_reaction);
+        } else {
+            if (empty_queue == NULL) {
+                empty_queue = pqueue_dary_init(1, in_reverse_order, get_reaction_index,
+                            get_reaction_position, set_reaction_position,
+                            reaction_matches, print_reaction);
+            }
+            ((pqueue_t**)scheduler->triggered_reactions)[i] = empty_queue;
+        }
         // Initialize the mutexes for the reaction queues
         lf_mutex_init(&scheduler->array_of_mutexes[i]);
     }
 
     scheduler->executing_reactions =
         ((pqueue_t**)scheduler->triggered_reactions)[0];
+
+    scheduler->custom_data =
+        (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    scheduler->custom_data->deferred =
+        pqueue_dary_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+                    get_reaction_position, set_reaction_position,
+                    reaction_matches, print_reaction);
+    size_t urgent_workers = LF_MIN((size_t)_lf_urgent_workers, scheduler->number_of_workers - 1);
+    scheduler->custom_data->first_urgent_worker = scheduler->number_of_workers - urgent_workers;
+    scheduler->custom_data->busy_workers = (int)scheduler->custom_data->first_urgent_worker;
+    if (_lf_realtime_workers) {
+        scheduler->custom_data->worker_priorities =
+            (int*)malloc(scheduler->number_of_workers * sizeof(int));
+        for (size_t i = 0; i < scheduler->number_of_workers; i++) {
+            scheduler->custom_data->worker_priorities[i] = LF_SCHED_MIN_PRIORITY;
+        }
+    }
+    // Workers are only released once all are idle, so the idle ones can be lent.
+    scheduler->lends_idle_workers = true;
+#ifdef LF_SUSPENDABLE_REACTIONS
+    scheduler->supports_suspension = true;
+#endif
 }
 
 /**
@@ -277,6 +542,12 @@ void lf_sched_free(lf_scheduler_t* scheduler) {
     // }
     pqueue_free((pqueue_t*)scheduler->executing_reactions);
     lf_semaphore_destroy(scheduler->semaphore);
+    pqueue_free(scheduler->custom_data->deferred);
+    free(scheduler->custom_data->worker_priorities);
+    free(scheduler->custom_data);
+#ifdef LF_SUSPENDABLE_REACTIONS
+    lf_sched_free_coroutines(scheduler);
+#endif
 }
 
 ///////////////////// Scheduler Worker API (public) /////////////////////////
@@ -294,6 +565,13 @@ void lf_sched_free(lf_scheduler_t* scheduler) {
 reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
     // Iterate until the stop_tag is reached or reaction queue is empty
     while (!scheduler->should_stop) {
+#ifdef LF_SUSPENDABLE_REACTIONS
+        // Resume suspended reactions of the current level before starting others.
+        reaction_t* resumable = lf_sched_pop_resumable_reaction(scheduler);
+        if (resumable != NULL) {
+            return resumable;
+        }
+#endif
         // Need to lock the mutex for the current level
         size_t current_level =
             scheduler->next_reaction_level - 1;
@@ -304,13 +582,18 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
             &scheduler->array_of_mutexes[current_level]);
         LF_PRINT_DEBUG("Scheduler: Worker %d locked the mutex for level %zu.",
                     worker_number, current_level);
-        reaction_t* reaction_to_return = (reaction_t*)pqueue_pop(
-            (pqueue_t*)scheduler->executing_reactions);
+        reaction_t* reaction_to_return = _lf_sched_pop_reaction(scheduler, worker_number);
+        bool urgent = (size_t)worker_number >= scheduler->custom_data->first_urgent_worker;
+        if (reaction_to_return == NULL && !urgent) {
+            lf_atomic_add_fetch(&scheduler->custom_data->busy_workers, -1);
+        }
         lf_mutex_unlock(
             &scheduler->array_of_mutexes[current_level]);
 
         if (reaction_to_return != NULL) {
             // Got a reaction
+            _lf_sched_check_criticality(scheduler, worker_number, reaction_to_return);
+            _lf_sched_update_worker_priority(scheduler, worker_number, reaction_to_return);
             return reaction_to_return;
         }
 
@@ -318,8 +601,13 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
 
         // Ask the scheduler for more work and wait
         tracepoint_worker_wait_starts(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_start, worker_number);
         _lf_sched_wait_for_work(scheduler, worker_number);
         tracepoint_worker_wait_ends(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_end, worker_number);
+        if (!urgent) {
+            lf_atomic_add_fetch(&scheduler->custom_data->busy_workers, 1);
+        }
     }
 
     // It's time for the worker thread to stop and exit.
@@ -366,4 +654,63 @@ void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reacti
             reaction->name, LF_LEVEL(reaction->index));
     _lf_sched_insert_reaction(scheduler, reaction);
 }
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions', sorted by level, at the current tag. The reactions that
+ * this call wins at a level are inserted under a single acquisition of the
+ * mutex of the level.
+ *
+ * @param reactions The reactions to trigger at the current tag.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call, or -1.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    lf_mutex_t* locked = NULL;
+    for (size_t i = 0; i < count; i++) {
+        reaction_t* reaction = reactions[i];
+        if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+            continue;
+        }
+        size_t reaction_level = LF_LEVEL(reaction->index);
+        LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %zu.",
+                reaction->name, reaction_level);
+        if (locked != &scheduler->array_of_mutexes[reaction_level]) {
+            if (locked != NULL) {
+                lf_mutex_unlock(locked);
+            }
+            locked = &scheduler->array_of_mutexes[reaction_level];
+            lf_mutex_lock(locked);
+        }
+        pqueue_insert(((pqueue_t**)scheduler->triggered_reactions)[reaction_level], (void*)reaction);
+    }
+    if (locked != NULL) {
+        lf_mutex_unlock(locked);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler.
+ *
+ * This is the case unless a reaction with an earlier deadline is waiting on the
+ * queue of the current level, which executing 'reaction' first would delay, or
+ * 'reaction' is below the criticality mode.
+ *
+ * @param reaction The reaction that would be executed immediately.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    if (reaction->criticality < scheduler->custom_data->criticality) {
+        return false;
+    }
+    size_t current_level = scheduler->next_reaction_level - 1;
+    lf_mutex_lock(&scheduler->array_of_mutexes[current_level]);
+    reaction_t* head = (reaction_t*)pqueue_peek((pqueue_t*)scheduler->executing_reactions);
+    bool may_execute_now = head == NULL
+        || LF_INDEX_DEADLINE(head->index) >= LF_INDEX_DEADLINE(reaction->index);
+    lf_mutex_unlock(&scheduler->array_of_mutexes[current_level]);
+    return may_execute_now;
+}
+
+LF_SCHED_REGISTER();
 #endif
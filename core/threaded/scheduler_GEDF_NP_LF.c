@@ -0,0 +1,484 @@
+#if !defined(LF_SINGLE_THREADED)
+/* Lock-free Global Earliest Deadline First (GEDF) non-preemptive scheduler for
+the threaded runtime of the C target of Lingua Franca. */
+
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * Lock-free variant of the Global Earliest Deadline First (GEDF)
+ * non-preemptive scheduler for the threaded runtime of the C target of Lingua
+ * Franca.
+ *
+ * The GEDF_NP scheduler keeps a priority queue per level and takes the mutex of
+ * the current level around every pop. This variant exploits the fact that,
+ * outside of federated execution, no reaction is ever inserted at the level
+ * that is currently executing. Reactions are therefore appended to a per-level
+ * array with an atomic index, as in the NP scheduler. When a level becomes
+ * current, the last idle worker sorts its array by deadline once, and workers
+ * then claim reactions in earliest-deadline-first order by atomically
+ * incrementing a shared cursor. Neither insertion nor dispatch acquires a lock.
+ *
+ * In federated execution, a reaction can be triggered at the current level by
+ * a thread that is not a worker. As in the NP scheduler, such insertions and
+ * the dispatch of the current level are then protected by the level mutex.
+ * A reaction inserted this way is appended after the sorted part and
+ * executed after it.
+ */
+#include "lf_types.h"
+#if SCHEDULER == SCHED_GEDF_NP_LF || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT GEDF_NP_LF
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif  // NUMBER_OF_WORKERS
+
+#include <assert.h>
+
+#include "platform.h"
+#include "environment.h"
+#include "reactor_threaded.h"
+#include "scheduler_instance.h"
+#include "scheduler_sync_tag_advance.h"
+#include "scheduler.h"
+#include "semaphore.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+typedef struct custom_scheduler_data_t {
+    /**
+     * Index of the next reaction to hand out from the executing array. Only
+     * modified atomically while workers are active.
+     */
+    volatile int dispatch_index;
+} custom_scheduler_data_t;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * @brief Insert 'reaction' into scheduler->triggered_reactions
+ * at the appropriate level.
+ *
+ * @param reaction The reaction to insert.
+ */
+static inline void _lf_sched_insert_reaction(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    size_t reaction_level = LF_LEVEL(reaction->index);
+#ifdef FEDERATED
+    // Lock the mutex if federated because a federate can insert reactions with
+    // a level equal to the current level. See scheduler_NP.c for why caching
+    // the current level here is safe.
+    size_t current_level = scheduler->next_reaction_level - 1;
+    if (reaction_level == current_level) {
+        LF_PRINT_DEBUG("Scheduler: Trying to lock the mutex for level %zu.",
+                    reaction_level);
+        lf_mutex_lock(&scheduler->array_of_mutexes[reaction_level]);
+        LF_PRINT_DEBUG("Scheduler: Locked the mutex for level %zu.", reaction_level);
+    }
+#endif
+    int reaction_q_level_index =
+        lf_atomic_fetch_add(&scheduler->indexes[reaction_level], 1);
+    assert(reaction_q_level_index >= 0);
+    LF_PRINT_DEBUG(
+        "Scheduler: Accessing triggered reactions at the level %zu with index %d.",
+        reaction_level,
+        reaction_q_level_index
+    );
+    ((reaction_t***)scheduler->triggered_reactions)[reaction_level][reaction_q_level_index] = reaction;
+    LF_PRINT_DEBUG("Scheduler: Index for level %zu is at %d.", reaction_level,
+                reaction_q_level_index);
+#ifdef FEDERATED
+    if (reaction_level == current_level) {
+        lf_mutex_unlock(&scheduler->array_of_mutexes[reaction_level]);
+    }
+#endif
+}
+
+/**
+ * @brief Order two reactions by their index, which places the one with the
+ * earliest deadline first. Used with qsort.
+ */
+static int _lf_sched_compare_reactions(const void* a, const void* b) {
+    index_t index_a = (*(reaction_t* const*)a)->index;
+    index_t index_b = (*(reaction_t* const*)b)->index;
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+/**
+ * @brief Distribute any reaction that is ready to execute to idle worker
+ * thread(s).
+ *
+ * The reactions of the new level are sorted by deadline before being handed
+ * out so that workers can take them in order without a lock.
+ *
+ * @return Number of reactions that are ready to execute.
+ */
+static size_t _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
+    // Note: All the threads are idle, which means that they are done inserting
+    // reactions. Therefore, the reaction arrays can be accessed without
+    // locking a mutex.
+    while (scheduler->next_reaction_level <= scheduler->max_reaction_level) {
+        LF_PRINT_DEBUG("Waiting with curr_reaction_level %zu.", scheduler->next_reaction_level);
+        try_advance_level(scheduler->env, &scheduler->next_reaction_level);
+
+        size_t level = scheduler->next_reaction_level - 1;
+        size_t reactions_to_execute = (size_t)scheduler->indexes[level];
+        if (reactions_to_execute) {
+            reaction_t** reactions = ((reaction_t***)scheduler->triggered_reactions)[level];
+            if (reactions_to_execute > 1) {
+                qsort(reactions, reactions_to_execute, sizeof(reaction_t*),
+                      _lf_sched_compare_reactions);
+            }
+            scheduler->executing_reactions = (void*)reactions;
+            scheduler->custom_data->dispatch_index = 0;
+            return reactions_to_execute;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief If there is work to be done, notify workers individually.
+ *
+ * This assumes that the caller is not holding any thread mutexes.
+ * @param num_reactions The number of reactions ready to execute.
+ */
+static void _lf_sched_notify_workers(lf_scheduler_t* scheduler, size_t num_reactions) {
+    // Note: All threads are idle. Therefore, there is no need to lock a mutex.
+    size_t workers_to_awaken = LF_MIN(scheduler->number_of_idle_workers, num_reactions);
+    LF_PRINT_DEBUG("Scheduler: Notifying %zu workers.", workers_to_awaken);
+    scheduler->number_of_idle_workers -= workers_to_awaken;
+    LF_PRINT_DEBUG("Scheduler: New number of idle workers: %zu.",
+                scheduler->number_of_idle_workers);
+    if (workers_to_awaken > 1) {
+        // Notify all the workers except the worker thread that has called this
+        // function.
+        lf_semaphore_release(scheduler->semaphore, (workers_to_awaken - 1));
+    }
+}
+
+/**
+ * @brief Signal all worker threads that it is time to stop.
+ */
+static void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
+    scheduler->should_stop = true;
+    lf_semaphore_release(scheduler->semaphore, (scheduler->number_of_workers - 1));
+}
+
+/**
+ * @brief Advance tag or distribute reactions to worker threads.
+ *
+ * Advance tag if there are no reactions left at any level of the current tag.
+ * If there are such reactions, distribute them to worker threads.
+ *
+ * This function assumes the caller does not hold the 'mutex' lock.
+ */
+static void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
+    environment_t* env = scheduler->env;
+
+    if (scheduler->next_reaction_level > 0) {
+        size_t level = scheduler->next_reaction_level - 1;
+        // In federated execution, reactions may have been appended to the
+        // current level after the other workers went idle. Execute them first.
+        int remaining = scheduler->indexes[level] - scheduler->custom_data->dispatch_index;
+        if (remaining > 0) {
+            _lf_sched_notify_workers(scheduler, (size_t)remaining);
+            return;
+        }
+        // The level that has just been executed is now empty.
+        scheduler->indexes[level] = 0;
+    }
+
+    // Loop until it's time to stop or work has been distributed
+    while (true) {
+        if (scheduler->next_reaction_level == (scheduler->max_reaction_level + 1)) {
+            scheduler->next_reaction_level = 0;
+            lf_mutex_lock(&env->mutex);
+            // Nothing more happening at this tag.
+            LF_PRINT_DEBUG("Scheduler: Advancing tag.");
+            // This worker thread will take charge of advancing tag.
+            if (_lf_sched_advance_tag_locked(scheduler)) {
+                LF_PRINT_DEBUG("Scheduler: Reached stop tag.");
+                _lf_sched_signal_stop(scheduler);
+                lf_mutex_unlock(&env->mutex);
+                break;
+            }
+            lf_mutex_unlock(&env->mutex);
+        }
+
+        size_t num_reactions = _lf_sched_distribute_ready_reactions(scheduler);
+        if (num_reactions > 0) {
+            _lf_sched_notify_workers(scheduler, num_reactions);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Wait until the scheduler assigns work.
+ *
+ * If the calling worker thread is the last to become idle, it will call on the
+ * scheduler to distribute work. Otherwise, it will wait on
+ * 'scheduler->semaphore'.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ */
+static void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
+    // Count this worker as idle and check if this is the last worker thread
+    // to become idle. The last one distributes the reactions that the others
+    // triggered, so each releases its writes and the last acquires them.
+    if (lf_sched_become_idle(scheduler)) {
+        // Last thread to go idle
+        LF_PRINT_DEBUG("Scheduler: Worker %zu is the last idle thread.", worker_number);
+        // Call on the scheduler to distribute work or advance tag.
+        _lf_scheduler_try_advance_tag_and_distribute(scheduler);
+    } else {
+        // Not the last thread to become idle. Wait for work to be released.
+        LF_PRINT_DEBUG("Scheduler: Worker %zu is trying to acquire the scheduling semaphore.",
+                worker_number);
+        lf_sched_wait_on_semaphore(scheduler, worker_number);
+        LF_PRINT_DEBUG("Scheduler: Worker %zu acquired the scheduling semaphore.", worker_number);
+    }
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * If the scheduler is already initialized, this will be a no-op.
+ *
+ * @param env Environment within which we are executing.
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param option Pointer to a `sched_params_t` struct containing additional
+ *  scheduler parameters.
+ */
+void lf_sched_init(
+    environment_t* env,
+    size_t number_of_workers,
+    sched_params_t* params
+) {
+    assert(env != GLOBAL_ENVIRONMENT);
+
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers", number_of_workers);
+
+    // Unlike GEDF_NP, this scheduler uses fixed-size arrays and therefore
+    // requires `num_reactions_per_level`.
+    if (init_sched_instance(env, &env->scheduler, number_of_workers, params)) {
+        // Scheduler has not been initialized before.
+        if (params == NULL || params->num_reactions_per_level == NULL) {
+            lf_print_error_and_exit(
+                "Scheduler: Internal error. The GEDF_NP_LF scheduler "
+                "requires params.num_reactions_per_level to be set.");
+        }
+    } else {
+        // Already initialized
+        return;
+    }
+    lf_scheduler_t* scheduler = env->scheduler;
+    size_t num_levels = scheduler->max_reaction_level + 1;
+
+    LF_PRINT_DEBUG("Scheduler: Max reaction level: %zu", scheduler->max_reaction_level);
+
+    scheduler->custom_data = (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    lf_assert(scheduler->custom_data != NULL, "Out of memory");
+
+    scheduler->triggered_reactions = calloc(num_levels, sizeof(reaction_t**));
+    lf_assert(scheduler->triggered_reactions != NULL, "Out of memory");
+
+    scheduler->array_of_mutexes = (lf_mutex_t*)calloc(num_levels, sizeof(lf_mutex_t));
+    lf_assert(scheduler->array_of_mutexes != NULL, "Out of memory");
+
+    scheduler->indexes = (volatile int*)calloc(num_levels, sizeof(volatile int));
+    lf_assert(scheduler->indexes != NULL, "Out of memory");
+
+    for (size_t i = 0; i < num_levels; i++) {
+        size_t queue_size = params->num_reactions_per_level[i];
+        ((reaction_t***)scheduler->triggered_reactions)[i] =
+            (reaction_t**)calloc(queue_size, sizeof(reaction_t*));
+        LF_PRINT_DEBUG(
+            "Scheduler: Initialized vector of reactions for level %zu with size %zu",
+            i,
+            queue_size
+        );
+        lf_mutex_init(&scheduler->array_of_mutexes[i]);
+    }
+    scheduler->executing_reactions = ((reaction_t***)scheduler->triggered_reactions)[0];
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free(lf_scheduler_t* scheduler) {
+    for (size_t j = 0; j <= scheduler->max_reaction_level; j++) {
+        free(((reaction_t***)scheduler->triggered_reactions)[j]);
+    }
+    free(scheduler->triggered_reactions);
+    free(scheduler->array_of_mutexes);
+    free((void*)scheduler->indexes);
+    free(scheduler->custom_data);
+    lf_semaphore_destroy(scheduler->semaphore);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for worker thread
+ * 'worker_number' or it is time for the worker thread to stop and exit (where a
+ * NULL value would be returned).
+ *
+ * @param worker_number
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    // Iterate until the stop tag is reached or the current level is exhausted
+    while (!scheduler->should_stop) {
+        size_t current_level = scheduler->next_reaction_level - 1;
+        reaction_t* reaction_to_return = NULL;
+        int index;
+#ifdef FEDERATED
+        // Need to lock the mutex because federate.c could trigger reactions at
+        // the current level (if there is a causality loop). Only advance the
+        // cursor on success so that such reactions are not skipped.
+        lf_mutex_lock(&scheduler->array_of_mutexes[current_level]);
+        index = scheduler->custom_data->dispatch_index;
+        if (index < scheduler->indexes[current_level]) {
+            scheduler->custom_data->dispatch_index++;
+        }
+        lf_mutex_unlock(&scheduler->array_of_mutexes[current_level]);
+#else
+        index = lf_atomic_fetch_add(&scheduler->custom_data->dispatch_index, 1);
+#endif
+        if (index < scheduler->indexes[current_level]) {
+            LF_PRINT_DEBUG(
+                "Scheduler: Worker %d popping reaction with level %zu, index "
+                "for level: %d.",
+                worker_number, current_level, index
+            );
+            reaction_to_return = ((reaction_t**)scheduler->executing_reactions)[index];
+        }
+
+        if (reaction_to_return != NULL) {
+            // Got a reaction
+            return reaction_to_return;
+        }
+
+        LF_PRINT_DEBUG("Worker %d is out of ready reactions.", worker_number);
+
+        // Ask the scheduler for more work and wait
+        tracepoint_worker_wait_starts(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_start, worker_number);
+        _lf_sched_wait_for_work(scheduler, worker_number);
+        tracepoint_worker_wait_ends(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_end, worker_number);
+    }
+
+    // It's time for the worker thread to stop and exit.
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number,
+                                 reaction_t* done_reaction) {
+    if (!lf_bool_compare_and_swap(&done_reaction->status, queued, inactive)) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                             done_reaction->status, queued);
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a worker number is not available (e.g., this function is not called by a
+ * worker thread), -1 should be passed as the 'worker_number'.
+ *
+ * The scheduler will ensure that the same reaction is not triggered twice in
+ * the same tag.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ *  be used if there is only one worker (e.g., when the program is using the
+ *  single-threaded C runtime). -1 is used for an anonymous call in a context where a
+ *  worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %lld.",
+            reaction->name, LF_LEVEL(reaction->index));
+    _lf_sched_insert_reaction(scheduler, reaction);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag. This scheduler has nothing to gain
+ * from inserting them together, so it triggers them one by one.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    for (size_t i = 0; i < count; i++) {
+        lf_scheduler_trigger_reaction(scheduler, reactions[i], worker_number);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler.
+ *
+ * This is the case unless a reaction with an earlier deadline is still waiting
+ * to be dispatched at the current level, which executing 'reaction' first would
+ * delay. Because the executing array is sorted, only the reaction under the
+ * dispatch cursor has to be checked. The check is racy with respect to other
+ * workers advancing the cursor, but a stale answer only costs the optimization.
+ *
+ * @param reaction The reaction that would be executed immediately.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    size_t current_level = scheduler->next_reaction_level - 1;
+    int index = scheduler->custom_data->dispatch_index;
+    if (index >= scheduler->indexes[current_level]) {
+        return true;
+    }
+    reaction_t* head = ((reaction_t**)scheduler->executing_reactions)[index];
+    return head == NULL
+        || LF_INDEX_DEADLINE(head->index) >= LF_INDEX_DEADLINE(reaction->index);
+}
+
+LF_SCHED_REGISTER();
+#endif
+#endif
@@ -37,7 +37,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * @author{Marten Lohstroh <marten@berkeley.edu>}
  */
 #include "lf_types.h"
-#if SCHEDULER == SCHED_NP || !defined(SCHEDULER)
+#if SCHEDULER == SCHED_NP || !defined(SCHEDULER) || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT NP
 #ifndef NUMBER_OF_WORKERS
 #define NUMBER_OF_WORKERS 1
 #endif  // NUMBER_OF_WORKERS
@@ -50,19 +51,114 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "scheduler_sync_tag_advance.h"
 #include "scheduler.h"
 #include "semaphore.h"
+#include "future.h"
+#include "probes.h"
 #include "trace.h"
 #include "util.h"
 #include "reactor_threaded.h"
 
+/////////////////// Scheduler Variables and Structs /////////////////////////
+#ifndef FEDERATED
+/**
+ * Number of levels tracked by each word of the populated-levels bitmap.
+ */
+#define LF_LEVELS_PER_WORD 32
+
+typedef struct custom_scheduler_data_t {
+    /**
+     * Bitmap with one bit per level that is set when a reaction is inserted
+     * at that level. It lets the scheduler skip over empty levels instead of
+     * visiting them one by one. Bits are only set atomically by workers and
+     * are cleared while all workers are idle.
+     */
+    volatile int* populated_levels;
+    /** The number of words in `populated_levels`. */
+    size_t populated_levels_size;
+} custom_scheduler_data_t;
+
+/**
+ * @brief Return the index of the least significant set bit in a non-zero
+ * 'word'.
+ */
+static inline size_t _lf_sched_lowest_set_bit(unsigned int word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctz(word);
+#else
+    size_t bit = 0;
+    while ((word & 1u) == 0) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Mark 'level' as populated in the bitmap.
+ * May be called concurrently by multiple workers.
+ */
+static inline void _lf_sched_mark_level_populated(lf_scheduler_t* scheduler, size_t level) {
+    volatile int* word = &scheduler->custom_data->populated_levels[level / LF_LEVELS_PER_WORD];
+    int bit = (int)(1u << (level % LF_LEVELS_PER_WORD));
+    int old = *word;
+    while (!(old & bit)) {
+        // The bitmap is read once all workers are idle, which synchronizes
+        // through number_of_idle_workers, so setting the bit orders nothing.
+        if (lf_bool_compare_and_swap_explicit(word, old, old | bit, LF_ATOMIC_RELAXED)) {
+            break;
+        }
+        old = *word;
+    }
+}
+
+/**
+ * @brief Clear 'level' in the bitmap. Assumes that all workers are idle.
+ */
+static inline void _lf_sched_clear_level_populated(lf_scheduler_t* scheduler, size_t level) {
+    scheduler->custom_data->populated_levels[level / LF_LEVELS_PER_WORD] &=
+        ~(int)(1u << (level % LF_LEVELS_PER_WORD));
+}
+
+/**
+ * @brief Return the first level at or above 'level' that is marked as
+ * populated, or a value larger than `max_reaction_level` if there is none.
+ * Assumes that all workers are idle.
+ */
+static size_t _lf_sched_next_populated_level(lf_scheduler_t* scheduler, size_t level) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    size_t word_index = level / LF_LEVELS_PER_WORD;
+    if (word_index >= data->populated_levels_size) {
+        return scheduler->max_reaction_level + 1;
+    }
+    // Ignore the bits of the levels below 'level' in the first word.
+    unsigned int word = (unsigned int)data->populated_levels[word_index]
+        & (~0u << (level % LF_LEVELS_PER_WORD));
+    while (word == 0) {
+        if (++word_index >= data->populated_levels_size) {
+            return scheduler->max_reaction_level + 1;
+        }
+        word = (unsigned int)data->populated_levels[word_index];
+    }
+    return word_index * LF_LEVELS_PER_WORD + _lf_sched_lowest_set_bit(word);
+}
+#endif // FEDERATED
+
 /////////////////// Scheduler Private API /////////////////////////
 /**
- * @brief Insert 'reaction' into
- * scheduler->triggered_reactions at the appropriate level.
+ * The largest number of reactions that lf_scheduler_trigger_reactions()
+ * inserts into the array of a level at once.
+ */
+#define LF_SCHED_BULK_INSERT_SIZE 64
+
+/**
+ * @brief Insert 'reactions', which all have the same level, into
+ * scheduler->triggered_reactions at that level, claiming their slots at once.
  *
- * @param reaction The reaction to insert.
+ * @param reactions The reactions to insert.
+ * @param count The number of reactions, which is at least 1.
  */
-static inline void _lf_sched_insert_reaction(lf_scheduler_t * scheduler, reaction_t* reaction) {
-    size_t reaction_level = LF_LEVEL(reaction->index);
+static inline void _lf_sched_insert_reactions(lf_scheduler_t * scheduler, reaction_t** reactions, int count) {
+    size_t reaction_level = LF_LEVEL(reactions[0]->index);
 #ifdef FEDERATED
     // Lock the mutex if federated because a federate can insert reactions with
     // a level equal to the current level.
@@ -90,17 +186,25 @@ static inline void _lf_sched_insert_reaction(lf_scheduler_t * scheduler, reactio
         scheduler->indexes[reaction_level] = 0;
     }
 #endif
+    // This only claims the slots. The reactions of a level are read once the level
+    // starts, which synchronizes through number_of_idle_workers or the level mutex.
     int reaction_q_level_index =
-        lf_atomic_fetch_add(&scheduler->indexes[reaction_level], 1);
+        lf_atomic_fetch_add_explicit(&scheduler->indexes[reaction_level], count, LF_ATOMIC_RELAXED);
     assert(reaction_q_level_index >= 0);
     LF_PRINT_DEBUG(
         "Scheduler: Accessing triggered reactions at the level %zu with index %d.",
         reaction_level,
         reaction_q_level_index
     );
-    ((reaction_t***)scheduler->triggered_reactions)[reaction_level][reaction_q_level_index] = reaction;
+    reaction_t** slots = &((reaction_t***)scheduler->triggered_reactions)[reaction_level][reaction_q_level_index];
+    for (int i = 0; i < count; i++) {
+        slots[i] = reactions[i];
+    }
     LF_PRINT_DEBUG("Scheduler: Index for level %zu is at %d.", reaction_level,
-                reaction_q_level_index);
+                reaction_q_level_index + count - 1);
+#ifndef FEDERATED
+    _lf_sched_mark_level_populated(scheduler, reaction_level);
+#endif
 #ifdef FEDERATED
     if (reaction_level == current_level) {
         lf_mutex_unlock(
@@ -109,27 +213,53 @@ static inline void _lf_sched_insert_reaction(lf_scheduler_t * scheduler, reactio
 #endif
 }
 
+/**
+ * @brief Insert 'reaction' into
+ * scheduler->triggered_reactions at the appropriate level.
+ *
+ * @param reaction The reaction to insert.
+ */
+static inline void _lf_sched_insert_reaction(lf_scheduler_t * scheduler, reaction_t* reaction) {
+    _lf_sched_insert_reactions(scheduler, &reaction, 1);
+}
+
 /**
  * @brief Distribute any reaction that is ready to execute to idle worker
  * thread(s).
  *
  * @return 1 if any reaction is ready. 0 otherwise.
  */
-int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
+static int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
     // Note: All the threads are idle, which means that they are done inserting
     // reactions. Therefore, the reaction vectors can be accessed without
     // locking a mutex.
     while (scheduler->next_reaction_level <= scheduler->max_reaction_level) {
         LF_PRINT_DEBUG("Waiting with curr_reaction_level %zu.", scheduler->next_reaction_level);
+#ifdef FEDERATED
+        // Every level has to be visited because advancing past a level may
+        // have to wait for network input ports at that level.
+        try_advance_level(scheduler->env, &scheduler->next_reaction_level);
+#else
+        // Jump directly to the next level that has reactions.
+        size_t level = _lf_sched_next_populated_level(
+            scheduler, scheduler->next_reaction_level);
+        if (level > scheduler->max_reaction_level) {
+            scheduler->next_reaction_level = scheduler->max_reaction_level + 1;
+            break;
+        }
+        _lf_sched_clear_level_populated(scheduler, level);
+        scheduler->next_reaction_level = level;
         try_advance_level(scheduler->env, &scheduler->next_reaction_level);
+#endif
 
         scheduler->executing_reactions =
             (void*)((reaction_t***)scheduler->triggered_reactions)[
                 scheduler->next_reaction_level - 1
             ];
 
-        LF_PRINT_DEBUG("DEBUG: start of rxn queue at %lu is %p", scheduler->next_reaction_level - 1, ((reaction_t**)scheduler->executing_reactions)[0]);
-        if (((reaction_t**)scheduler->executing_reactions)[0] != NULL) {
+        LF_PRINT_DEBUG("Scheduler: Level %zu has %d reactions.", scheduler->next_reaction_level - 1,
+                scheduler->indexes[scheduler->next_reaction_level - 1]);
+        if (scheduler->indexes[scheduler->next_reaction_level - 1] > 0) {
             // There is at least one reaction to execute
             return 1;
         }
@@ -143,7 +273,7 @@ int _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
  *
  * This assumes that the caller is not holding any thread mutexes.
  */
-void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
+static void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
     // Calculate the number of workers that we need to wake up, which is the
     // Note: All threads are idle. Therefore, there is no need to lock the mutex
     // while accessing the index for the current level.
@@ -173,7 +303,7 @@ void _lf_sched_notify_workers(lf_scheduler_t* scheduler) {
  * @brief Signal all worker threads that it is time to stop.
  *
  */
-void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
+static void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
     scheduler->should_stop = true;
     lf_semaphore_release(scheduler->semaphore,
                          (scheduler->number_of_workers - 1));
@@ -187,12 +317,15 @@ void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
  *
  * This function assumes the caller does not hold the 'mutex' lock.
  */
-void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
+static void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
     // Reset the index
     environment_t *env = scheduler->env;
     scheduler
         ->indexes[scheduler->next_reaction_level -
                             1] = 0;
+#ifndef FEDERATED
+    _lf_sched_clear_level_populated(scheduler, scheduler->next_reaction_level - 1);
+#endif
 
     // Loop until it's time to stop or work has been distributed
     while (true) {
@@ -229,15 +362,22 @@ void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
  * @param worker_number The worker number of the worker thread asking for work
  * to be assigned to it.
  */
-void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
-    // Increment the number of idle workers by 1 and check if this is the last
-    // worker thread to become idle.
-    if (lf_atomic_add_fetch(&scheduler->number_of_idle_workers,
-                            1) ==
-        scheduler->number_of_workers) {
+static void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
+    // Count this worker as idle and check if this is the last worker thread
+    // to become idle. The last one distributes the reactions that the others
+    // triggered, so each releases its writes and the last acquires them.
+    if (lf_sched_become_idle(scheduler)) {
         // Last thread to go idle
         LF_PRINT_DEBUG("Scheduler: Worker %zu is the last idle thread.",
                     worker_number);
+#ifdef LF_SUSPENDABLE_REACTIONS
+        // The level is not done while one of its reactions is suspended.
+        // Resume such reactions as they become resumable instead.
+        if (lf_sched_wait_for_resumable_reaction(scheduler)) {
+            lf_atomic_add_fetch(&scheduler->number_of_idle_workers, -1);
+            return;
+        }
+#endif
         // Call on the scheduler to distribute work or advance tag.
         _lf_scheduler_try_advance_tag_and_distribute(scheduler);
     } else {
@@ -246,7 +386,7 @@ void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
             "Scheduler: Worker %zu is trying to acquire the scheduling "
             "semaphore.",
             worker_number);
-        lf_semaphore_acquire(scheduler->semaphore);
+        lf_sched_wait_on_semaphore(scheduler, worker_number);
         LF_PRINT_DEBUG("Scheduler: Worker %zu acquired the scheduling semaphore.",
                     worker_number);
     }
@@ -292,38 +432,63 @@ void lf_sched_init(
 
     env->scheduler->triggered_reactions =
         calloc((env->scheduler->max_reaction_level + 1), sizeof(reaction_t**));
+    lf_assert(env->scheduler->triggered_reactions != NULL, "Out of memory");
 
+#ifdef FEDERATED
+    // Only a federate inserts reactions into the level being executed, which
+    // the mutex of the level protects.
     env->scheduler->array_of_mutexes = (lf_mutex_t*)calloc(
         (env->scheduler->max_reaction_level + 1), sizeof(lf_mutex_t));
+    lf_assert(env->scheduler->array_of_mutexes != NULL, "Out of memory");
+#endif
 
     env->scheduler->indexes = (volatile int*)calloc(
         (env->scheduler->max_reaction_level + 1), sizeof(volatile int));
 
-    size_t queue_size = INITIAL_REACT_QUEUE_SIZE;
+#ifndef FEDERATED
+    env->scheduler->custom_data =
+        (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    lf_assert(env->scheduler->custom_data != NULL, "Out of memory");
+    env->scheduler->custom_data->populated_levels_size =
+        env->scheduler->max_reaction_level / LF_LEVELS_PER_WORD + 1;
+    env->scheduler->custom_data->populated_levels = (volatile int*)calloc(
+        env->scheduler->custom_data->populated_levels_size, sizeof(volatile int));
+    lf_assert(env->scheduler->custom_data->populated_levels != NULL, "Out of memory");
+#endif
+
+    // The vectors of reactions of all levels are consecutive parts of one
+    // array, which is much smaller than an allocation per level when there
+    // are many levels with few reactions each and keeps consecutive levels close.
+    size_t num_reactions = 0;
     for (size_t i = 0; i <= env->scheduler->max_reaction_level; i++) {
-        if (params != NULL) {
-            if (params->num_reactions_per_level != NULL) {
-                queue_size = params->num_reactions_per_level[i];
-            }
-        }
-        // Initialize the reaction vectors
-        ((reaction_t***)env->scheduler->triggered_reactions)[i] =
-            (reaction_t**)calloc(queue_size, sizeof(reaction_t*));
+        num_reactions += params->num_reactions_per_level[i];
+    }
+    reaction_t** reactions = (reaction_t**)calloc(LF_MAX(num_reactions, 1), sizeof(reaction_t*));
+    lf_assert(reactions != NULL, "Out of memory");
+    for (size_t i = 0; i <= env->scheduler->max_reaction_level; i++) {
+        ((reaction_t***)env->scheduler->triggered_reactions)[i] = reactions;
+        reactions += params->num_reactions_per_level[i];
 
         LF_PRINT_DEBUG(
             "Scheduler: Initialized vector of reactions for level %zu with size %zu",
             i,
-            queue_size
+            params->num_reactions_per_level[i]
         );
 
+#ifdef FEDERATED
         // Initialize the mutexes for the reaction vectors
         lf_mutex_init(&env->scheduler->array_of_mutexes[i]);
-
+#endif
     }
 
     env->scheduler->executing_reactions =
         (void*)((reaction_t***)env->scheduler->
             triggered_reactions)[0];
+    // Workers are only released once all are idle, so the idle ones can be lent.
+    env->scheduler->lends_idle_workers = true;
+#ifdef LF_SUSPENDABLE_REACTIONS
+    env->scheduler->supports_suspension = true;
+#endif
 }
 
 /**
@@ -332,11 +497,20 @@ void lf_sched_init(
  * This must be called when the scheduler is no longer needed.
  */
 void lf_sched_free(lf_scheduler_t* scheduler) {
-    for (size_t j = 0; j <= scheduler->max_reaction_level; j++) {
-        free(((reaction_t***)scheduler->triggered_reactions)[j]);
-    }
+    // The vector of level 0 is at the start of the array of all levels.
+    free(((reaction_t***)scheduler->triggered_reactions)[0]);
     free(scheduler->triggered_reactions);
+#ifdef FEDERATED
+    free(scheduler->array_of_mutexes);
+#endif
+#ifndef FEDERATED
+    free((void*)scheduler->custom_data->populated_levels);
+    free(scheduler->custom_data);
+#endif
     lf_semaphore_destroy(scheduler->semaphore);
+#ifdef LF_SUSPENDABLE_REACTIONS
+    lf_sched_free_coroutines(scheduler);
+#endif
 }
 
 ///////////////////// Scheduler Worker API (public) /////////////////////////
@@ -355,6 +529,13 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
     environment_t *env = scheduler->env;
     // Iterate until the stop tag is reached or reaction vectors are empty
     while (!scheduler->should_stop) {
+#ifdef LF_SUSPENDABLE_REACTIONS
+        // Resume suspended reactions of the current level before starting others.
+        reaction_t* resumable = lf_sched_pop_resumable_reaction(scheduler);
+        if (resumable != NULL) {
+            return resumable;
+        }
+#endif
         // Calculate the current level of reactions to execute
         size_t current_level =
             scheduler->next_reaction_level - 1;
@@ -365,8 +546,9 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
         lf_mutex_lock(
             &scheduler->array_of_mutexes[current_level]);
 #endif
-        int current_level_q_index = lf_atomic_add_fetch(
-            &scheduler->indexes[current_level], -1);
+        // This only claims a reaction, which was written before the workers were released.
+        int current_level_q_index = lf_atomic_add_fetch_explicit(
+            &scheduler->indexes[current_level], -1, LF_ATOMIC_RELAXED);
         if (current_level_q_index >= 0) {
             LF_PRINT_DEBUG(
                 "Scheduler: Worker %d popping reaction with level %zu, index "
@@ -376,8 +558,6 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
             reaction_to_return =
                 ((reaction_t**)scheduler->
                     executing_reactions)[current_level_q_index];
-            ((reaction_t**)scheduler->
-                    executing_reactions)[current_level_q_index] = NULL;
         }
 #ifdef FEDERATED
         lf_mutex_unlock(
@@ -393,8 +573,10 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
 
         // Ask the scheduler for more work and wait
         tracepoint_worker_wait_starts(env->trace, worker_number);
+        LF_PROBE1(worker_wait_start, worker_number);
         _lf_sched_wait_for_work(scheduler, worker_number);
         tracepoint_worker_wait_ends(env->trace, worker_number);
+        LF_PROBE1(worker_wait_end, worker_number);
     }
 
     // It's time for the worker thread to stop and exit.
@@ -411,7 +593,7 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
  */
 void lf_sched_done_with_reaction(size_t worker_number,
                                  reaction_t* done_reaction) {
-    if (!lf_bool_compare_and_swap(&done_reaction->status, queued, inactive)) {
+    if (!lf_bool_compare_and_swap_explicit(&done_reaction->status, queued, inactive, LF_ATOMIC_RELAXED)) {
         lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
                              done_reaction->status, queued);
     }
@@ -437,12 +619,59 @@ void lf_sched_done_with_reaction(size_t worker_number,
  *
  */
 void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
-    if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+    // Only one of the workers triggering the reaction needs to win, which publishes nothing.
+    if (reaction == NULL
+            || !lf_bool_compare_and_swap_explicit(&reaction->status, inactive, queued, LF_ATOMIC_RELAXED)) {
         return;
     }
     LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %lld.",
             reaction->name, LF_LEVEL(reaction->index));
     _lf_sched_insert_reaction(scheduler, reaction);
 }
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions', sorted by level, at the current tag.
+ *
+ * The reactions that this call wins are inserted in batches of one level, each
+ * of which claims its slots in the array of the level with a single atomic add.
+ *
+ * @param reactions The reactions to trigger at the current tag.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call, or -1.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    reaction_t* batch[LF_SCHED_BULK_INSERT_SIZE];
+    int batch_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        reaction_t* reaction = reactions[i];
+        if (reaction == NULL) {
+            continue;
+        }
+        if (batch_size > 0 && (batch_size == LF_SCHED_BULK_INSERT_SIZE
+                || LF_LEVEL(reaction->index) != LF_LEVEL(batch[0]->index))) {
+            _lf_sched_insert_reactions(scheduler, batch, batch_size);
+            batch_size = 0;
+        }
+        // Only one of the workers triggering the reaction needs to win, which publishes nothing.
+        if (lf_bool_compare_and_swap_explicit(&reaction->status, inactive, queued, LF_ATOMIC_RELAXED)) {
+            batch[batch_size++] = reaction;
+        }
+    }
+    if (batch_size > 0) {
+        _lf_sched_insert_reactions(scheduler, batch, batch_size);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler. This scheduler does not order
+ * reactions by deadline, so this is always the case.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return true;
+}
+
+LF_SCHED_REGISTER();
 #endif
 #endif
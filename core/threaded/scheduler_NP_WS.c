@@ -0,0 +1,622 @@
+#if !defined(LF_SINGLE_THREADED)
+/* Work-stealing non-preemptive scheduler for the threaded runtime of the C
+target of Lingua Franca. */
+
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * Work-stealing variant of the non-preemptive scheduler for the threaded
+ * runtime of the C target of Lingua Franca.
+ *
+ * Like the NP scheduler, reactions are executed level by level. Instead of a
+ * single shared array per level, each worker owns one Chase-Lev style deque
+ * per level. A worker that triggers a reaction pushes it onto its own deque,
+ * so the common path touches only cache lines owned by that worker. Once a
+ * level is being executed, each worker pops from the bottom of its own deque
+ * and, when that is empty, steals from the top of the deques of the other
+ * workers.
+ *
+ * Reactions triggered outside of a worker (e.g., by `_lf_pop_events` while
+ * all workers are idle) are placed on the deque of the worker that last
+ * triggered them, as recorded in `worker_affinity`. In federated execution,
+ * such reactions can be triggered at the current level while workers are
+ * executing, so they are put on a mutex-protected per-level array instead.
+ */
+#include "lf_types.h"
+#if SCHEDULER == SCHED_NP_WS || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT NP_WS
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif  // NUMBER_OF_WORKERS
+
+#include <assert.h>
+
+#include "platform.h"
+#include "environment.h"
+#include "scheduler_instance.h"
+#include "scheduler_sync_tag_advance.h"
+#include "scheduler.h"
+#include "semaphore.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
+#include "reactor_threaded.h"
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+
+/**
+ * Size in bytes used to keep the indexes of different deques on separate cache
+ * lines.
+ */
+#define LF_WS_CACHE_LINE_SIZE 64
+
+/**
+ * @brief A work-stealing deque owned by one worker for one level.
+ *
+ * Only the owner pushes to and pops from the bottom. Any worker may steal from
+ * the top. Because each reaction is queued at most once per tag, the capacity
+ * is bounded by the number of reactions at the level and the deque never
+ * needs to grow. Both indexes are reset to 0 once the level has been executed.
+ */
+typedef struct {
+    volatile int top;
+    char pad0[LF_WS_CACHE_LINE_SIZE - sizeof(int)];
+    volatile int bottom;
+    char pad1[LF_WS_CACHE_LINE_SIZE - sizeof(int)];
+    reaction_t** buffer;
+    size_t capacity;
+} ws_deque_t;
+
+typedef struct custom_scheduler_data_t {
+    /** The deques, indexed first by level and then by worker. */
+    ws_deque_t** deques_by_level;
+    /**
+     * Reactions triggered at each level by threads that are not workers.
+     * Only used in federated execution, where such insertions can occur at
+     * the current level.
+     */
+    reaction_t*** shared_by_level;
+    /** The number of reactions in each entry of `shared_by_level`. */
+    volatile int* shared_sizes;
+} custom_scheduler_data_t;
+
+/////////////////// Deque Private API /////////////////////////
+
+/**
+ * @brief Push 'reaction' onto the bottom of 'deque'.
+ * Must only be called by the owner of the deque (or when no worker is active).
+ */
+static inline void ws_deque_push(ws_deque_t* deque, reaction_t* reaction) {
+    int bottom = deque->bottom;
+    lf_assert((size_t)bottom < deque->capacity,
+            "Scheduler: Work-stealing deque overflow (capacity %zu).", deque->capacity);
+    deque->buffer[bottom] = reaction;
+    // The atomic increment acts as a full barrier so that thieves can never
+    // observe the new bottom before the reaction has been stored.
+    lf_atomic_fetch_add(&deque->bottom, 1);
+}
+
+/**
+ * @brief Pop a reaction from the bottom of 'deque'.
+ * Must only be called by the owner of the deque.
+ * @return A reaction or NULL if the deque is empty.
+ */
+static inline reaction_t* ws_deque_pop(ws_deque_t* deque) {
+    // Fast path that avoids the barrier if the deque is obviously empty.
+    if (deque->bottom <= deque->top) {
+        return NULL;
+    }
+    int bottom = lf_atomic_add_fetch(&deque->bottom, -1);
+    int top = deque->top;
+    if (top > bottom) {
+        // The deque was emptied by thieves.
+        deque->bottom = top;
+        return NULL;
+    }
+    reaction_t* reaction = deque->buffer[bottom];
+    if (top == bottom) {
+        // Last element. Race against thieves for it.
+        if (!lf_bool_compare_and_swap(&deque->top, top, top + 1)) {
+            reaction = NULL;
+        }
+        deque->bottom = top + 1;
+    }
+    return reaction;
+}
+
+/**
+ * @brief Steal a reaction from the top of 'deque'.
+ * May be called by any worker.
+ * @return A reaction or NULL if the deque is empty or the steal lost a race.
+ */
+static inline reaction_t* ws_deque_steal(ws_deque_t* deque) {
+    // The atomic read of top acts as a barrier so that bottom is read after top.
+    int top = lf_atomic_fetch_add(&deque->top, 0);
+    int bottom = deque->bottom;
+    if (top >= bottom) {
+        return NULL;
+    }
+    reaction_t* reaction = deque->buffer[top];
+    if (!lf_bool_compare_and_swap(&deque->top, top, top + 1)) {
+        return NULL;
+    }
+    return reaction;
+}
+
+/**
+ * @brief Return the number of reactions on 'deque'.
+ * Only meaningful if no worker is concurrently accessing the deque.
+ */
+static inline size_t ws_deque_size(ws_deque_t* deque) {
+    int size = deque->bottom - deque->top;
+    return (size > 0) ? (size_t)size : 0;
+}
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * @brief Insert 'reaction' into the deques of the scheduler.
+ *
+ * @param reaction The reaction to insert.
+ * @param worker_number The number of the calling worker or -1 if the caller is
+ *  not a worker.
+ */
+static inline void _lf_sched_insert_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    size_t reaction_level = LF_LEVEL(reaction->index);
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    if (worker_number >= 0) {
+        reaction->worker_affinity = (size_t)worker_number;
+        ws_deque_push(&data->deques_by_level[reaction_level][worker_number], reaction);
+        LF_PRINT_DEBUG("Scheduler: Worker %d pushed reaction %s onto its deque at level %zu.",
+                worker_number, reaction->name, reaction_level);
+        return;
+    }
+#ifdef FEDERATED
+    // A federate can insert reactions from a thread that is not a worker at a
+    // level equal to the current level, so use the shared array under a mutex.
+    lf_mutex_lock(&scheduler->array_of_mutexes[reaction_level]);
+    int index = data->shared_sizes[reaction_level]++;
+    lf_assert((size_t)index < data->deques_by_level[reaction_level][0].capacity,
+            "Scheduler: Reaction array overflow at level %zu.", reaction_level);
+    data->shared_by_level[reaction_level][index] = reaction;
+    lf_mutex_unlock(&scheduler->array_of_mutexes[reaction_level]);
+    LF_PRINT_DEBUG("Scheduler: Inserted reaction %s into the shared array at level %zu.",
+            reaction->name, reaction_level);
+#else
+    // Without federation, reactions are only triggered outside of a worker
+    // while all workers are idle, so it is safe to push onto any deque. Use the
+    // deque of the worker that last triggered the reaction.
+    size_t owner = reaction->worker_affinity % scheduler->number_of_workers;
+    ws_deque_push(&data->deques_by_level[reaction_level][owner], reaction);
+    LF_PRINT_DEBUG("Scheduler: Pushed reaction %s onto the deque of worker %zu at level %zu.",
+            reaction->name, owner, reaction_level);
+#endif
+}
+
+/**
+ * @brief Return the number of reactions queued at 'level'.
+ * Assumes that all workers are idle.
+ */
+static size_t _lf_sched_num_reactions_at_level(lf_scheduler_t* scheduler, size_t level) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    size_t count = 0;
+    for (size_t i = 0; i < scheduler->number_of_workers; i++) {
+        count += ws_deque_size(&data->deques_by_level[level][i]);
+    }
+#ifdef FEDERATED
+    count += data->shared_sizes[level];
+#endif
+    return count;
+}
+
+/**
+ * @brief Reset the deques of 'level' so that they can be refilled.
+ * Assumes that all workers are idle.
+ */
+static void _lf_sched_reset_level(lf_scheduler_t* scheduler, size_t level) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    for (size_t i = 0; i < scheduler->number_of_workers; i++) {
+        data->deques_by_level[level][i].top = 0;
+        data->deques_by_level[level][i].bottom = 0;
+    }
+}
+
+/**
+ * @brief Get a reaction at 'level' for 'worker_number' to execute.
+ *
+ * First pop from the worker's own deque, then try to steal from the other
+ * workers, starting with the next worker to spread out contention.
+ *
+ * @return A reaction or NULL if no reaction could be found.
+ */
+static reaction_t* _lf_sched_get_reaction_at_level(lf_scheduler_t* scheduler, size_t level, int worker_number) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    ws_deque_t* deques = data->deques_by_level[level];
+    reaction_t* reaction = ws_deque_pop(&deques[worker_number]);
+    if (reaction != NULL) {
+        return reaction;
+    }
+    size_t num_workers = scheduler->number_of_workers;
+    // Keep trying while another deque still appears to be non-empty because a
+    // steal can fail merely due to a race with another thief.
+    bool retry = true;
+    while (retry) {
+        retry = false;
+        for (size_t i = 1; i < num_workers; i++) {
+            ws_deque_t* victim = &deques[(worker_number + i) % num_workers];
+            if (victim->bottom > victim->top) {
+                reaction = ws_deque_steal(victim);
+                if (reaction != NULL) {
+                    LF_PRINT_DEBUG("Scheduler: Worker %d stole reaction %s from worker %zu.",
+                            worker_number, reaction->name, (worker_number + i) % num_workers);
+                    return reaction;
+                }
+                retry = true;
+            }
+        }
+    }
+#ifdef FEDERATED
+    lf_mutex_lock(&scheduler->array_of_mutexes[level]);
+    if (data->shared_sizes[level] > 0) {
+        reaction = data->shared_by_level[level][--data->shared_sizes[level]];
+    }
+    lf_mutex_unlock(&scheduler->array_of_mutexes[level]);
+#endif
+    return reaction;
+}
+
+/**
+ * @brief Distribute any reaction that is ready to execute to idle worker
+ * thread(s).
+ *
+ * @return Number of reactions that are ready to execute at the new level.
+ */
+static size_t _lf_sched_distribute_ready_reactions(lf_scheduler_t* scheduler) {
+    // Note: All the threads are idle, which means that they are done inserting
+    // reactions. Therefore, the deques can be accessed without synchronization.
+    while (scheduler->next_reaction_level <= scheduler->max_reaction_level) {
+        LF_PRINT_DEBUG("Waiting with curr_reaction_level %zu.", scheduler->next_reaction_level);
+        try_advance_level(scheduler->env, &scheduler->next_reaction_level);
+
+        size_t reactions_to_execute = _lf_sched_num_reactions_at_level(
+            scheduler, scheduler->next_reaction_level - 1);
+        if (reactions_to_execute) {
+            return reactions_to_execute;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief If there is work to be done, notify workers individually.
+ *
+ * This assumes that the caller is not holding any thread mutexes.
+ * @param num_reactions The number of reactions ready to execute.
+ */
+static void _lf_sched_notify_workers(lf_scheduler_t* scheduler, size_t num_reactions) {
+    // Note: All threads are idle. Therefore, there is no need to lock a mutex.
+    size_t workers_to_awaken = LF_MIN(scheduler->number_of_idle_workers, num_reactions);
+    LF_PRINT_DEBUG("Scheduler: Notifying %zu workers.", workers_to_awaken);
+
+    scheduler->number_of_idle_workers -= workers_to_awaken;
+    LF_PRINT_DEBUG("Scheduler: New number of idle workers: %zu.",
+                scheduler->number_of_idle_workers);
+
+    if (workers_to_awaken > 1) {
+        // Notify all the workers except the worker thread that has called this
+        // function.
+        lf_semaphore_release(scheduler->semaphore, (workers_to_awaken - 1));
+    }
+}
+
+/**
+ * @brief Signal all worker threads that it is time to stop.
+ */
+static void _lf_sched_signal_stop(lf_scheduler_t* scheduler) {
+    scheduler->should_stop = true;
+    lf_semaphore_release(scheduler->semaphore, (scheduler->number_of_workers - 1));
+}
+
+/**
+ * @brief Advance tag or distribute reactions to worker threads.
+ *
+ * Advance tag if there are no reactions left at any level of the current tag.
+ * If there are such reactions, distribute them to worker threads.
+ *
+ * This function assumes the caller does not hold the 'mutex' lock.
+ */
+static void _lf_scheduler_try_advance_tag_and_distribute(lf_scheduler_t* scheduler) {
+    environment_t* env = scheduler->env;
+
+    // The level that has just been executed is now empty.
+    if (scheduler->next_reaction_level > 0) {
+        _lf_sched_reset_level(scheduler, scheduler->next_reaction_level - 1);
+    }
+
+    // Loop until it's time to stop or work has been distributed
+    while (true) {
+        if (scheduler->next_reaction_level == (scheduler->max_reaction_level + 1)) {
+            scheduler->next_reaction_level = 0;
+            lf_mutex_lock(&env->mutex);
+            // Nothing more happening at this tag.
+            LF_PRINT_DEBUG("Scheduler: Advancing tag.");
+            // This worker thread will take charge of advancing tag.
+            if (_lf_sched_advance_tag_locked(scheduler)) {
+                LF_PRINT_DEBUG("Scheduler: Reached stop tag.");
+                _lf_sched_signal_stop(scheduler);
+                lf_mutex_unlock(&env->mutex);
+                break;
+            }
+            lf_mutex_unlock(&env->mutex);
+        }
+
+        size_t num_reactions = _lf_sched_distribute_ready_reactions(scheduler);
+        if (num_reactions > 0) {
+            _lf_sched_notify_workers(scheduler, num_reactions);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Wait until the scheduler assigns work.
+ *
+ * If the calling worker thread is the last to become idle, it will call on the
+ * scheduler to distribute work. Otherwise, it will wait on
+ * 'scheduler->semaphore'.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ */
+static void _lf_sched_wait_for_work(lf_scheduler_t* scheduler, size_t worker_number) {
+    // Count this worker as idle and check if this is the last worker thread
+    // to become idle. The last one distributes the reactions that the others
+    // triggered, so each releases its writes and the last acquires them.
+    if (lf_sched_become_idle(scheduler)) {
+        // Last thread to go idle
+        LF_PRINT_DEBUG("Scheduler: Worker %zu is the last idle thread.", worker_number);
+        // Call on the scheduler to distribute work or advance tag.
+        _lf_scheduler_try_advance_tag_and_distribute(scheduler);
+    } else {
+        // Not the last thread to become idle. Wait for work to be released.
+        LF_PRINT_DEBUG("Scheduler: Worker %zu is trying to acquire the scheduling semaphore.",
+                worker_number);
+        lf_sched_wait_on_semaphore(scheduler, worker_number);
+        LF_PRINT_DEBUG("Scheduler: Worker %zu acquired the scheduling semaphore.", worker_number);
+    }
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * If the scheduler is already initialized, this will be a no-op.
+ *
+ * @param env Environment within which we are executing.
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param option Pointer to a `sched_params_t` struct containing additional
+ *  scheduler parameters.
+ */
+void lf_sched_init(
+    environment_t* env,
+    size_t number_of_workers,
+    sched_params_t* params
+) {
+    assert(env != GLOBAL_ENVIRONMENT);
+
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers", number_of_workers);
+
+    // Like the NP scheduler, this scheduler requires `num_reactions_per_level`
+    // to size the deques.
+    if (init_sched_instance(env, &env->scheduler, number_of_workers, params)) {
+        // Scheduler has not been initialized before.
+        if (params == NULL || params->num_reactions_per_level == NULL) {
+            lf_print_error_and_exit(
+                "Scheduler: Internal error. The NP_WS scheduler "
+                "requires params.num_reactions_per_level to be set.");
+        }
+    } else {
+        // Already initialized
+        return;
+    }
+    lf_scheduler_t* scheduler = env->scheduler;
+    size_t num_levels = scheduler->max_reaction_level + 1;
+
+    LF_PRINT_DEBUG("Scheduler: Max reaction level: %zu", scheduler->max_reaction_level);
+
+    scheduler->custom_data = (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    lf_assert(scheduler->custom_data != NULL, "Out of memory");
+    custom_scheduler_data_t* data = scheduler->custom_data;
+
+    data->deques_by_level = (ws_deque_t**)calloc(num_levels, sizeof(ws_deque_t*));
+    lf_assert(data->deques_by_level != NULL, "Out of memory");
+#ifdef FEDERATED
+    data->shared_by_level = (reaction_t***)calloc(num_levels, sizeof(reaction_t**));
+    lf_assert(data->shared_by_level != NULL, "Out of memory");
+    data->shared_sizes = (volatile int*)calloc(num_levels, sizeof(int));
+    lf_assert(data->shared_sizes != NULL, "Out of memory");
+#endif
+
+    scheduler->array_of_mutexes = (lf_mutex_t*)calloc(num_levels, sizeof(lf_mutex_t));
+    lf_assert(scheduler->array_of_mutexes != NULL, "Out of memory");
+
+    for (size_t i = 0; i < num_levels; i++) {
+        size_t queue_size = params->num_reactions_per_level[i];
+        data->deques_by_level[i] = (ws_deque_t*)calloc(number_of_workers, sizeof(ws_deque_t));
+        lf_assert(data->deques_by_level[i] != NULL, "Out of memory");
+        for (size_t w = 0; w < number_of_workers; w++) {
+            // Any worker could trigger every reaction at this level.
+            data->deques_by_level[i][w].capacity = queue_size;
+            data->deques_by_level[i][w].buffer = (reaction_t**)calloc(queue_size, sizeof(reaction_t*));
+            lf_assert(queue_size == 0 || data->deques_by_level[i][w].buffer != NULL, "Out of memory");
+        }
+#ifdef FEDERATED
+        data->shared_by_level[i] = (reaction_t**)calloc(queue_size, sizeof(reaction_t*));
+        lf_assert(queue_size == 0 || data->shared_by_level[i] != NULL, "Out of memory");
+#endif
+        LF_PRINT_DEBUG(
+            "Scheduler: Initialized deques for level %zu with size %zu",
+            i,
+            queue_size
+        );
+        lf_mutex_init(&scheduler->array_of_mutexes[i]);
+    }
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free(lf_scheduler_t* scheduler) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    for (size_t i = 0; i <= scheduler->max_reaction_level; i++) {
+        for (size_t w = 0; w < scheduler->number_of_workers; w++) {
+            free(data->deques_by_level[i][w].buffer);
+        }
+        free(data->deques_by_level[i]);
+#ifdef FEDERATED
+        free(data->shared_by_level[i]);
+#endif
+    }
+    free(data->deques_by_level);
+#ifdef FEDERATED
+    free(data->shared_by_level);
+    free((void*)data->shared_sizes);
+#endif
+    free(scheduler->array_of_mutexes);
+    free(data);
+    lf_semaphore_destroy(scheduler->semaphore);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for worker thread
+ * 'worker_number' or it is time for the worker thread to stop and exit (where a
+ * NULL value would be returned).
+ *
+ * @param worker_number
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    // Iterate until the stop tag is reached or the deques are empty
+    while (!scheduler->should_stop) {
+        // Calculate the current level of reactions to execute
+        size_t current_level = scheduler->next_reaction_level - 1;
+        reaction_t* reaction_to_return =
+            _lf_sched_get_reaction_at_level(scheduler, current_level, worker_number);
+
+        if (reaction_to_return != NULL) {
+            // Got a reaction
+            return reaction_to_return;
+        }
+
+        LF_PRINT_DEBUG("Worker %d is out of ready reactions.", worker_number);
+
+        // Ask the scheduler for more work and wait
+        tracepoint_worker_wait_starts(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_start, worker_number);
+        _lf_sched_wait_for_work(scheduler, worker_number);
+        tracepoint_worker_wait_ends(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_wait_end, worker_number);
+    }
+
+    // It's time for the worker thread to stop and exit.
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number,
+                                 reaction_t* done_reaction) {
+    if (!lf_bool_compare_and_swap(&done_reaction->status, queued, inactive)) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                             done_reaction->status, queued);
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a worker number is not available (e.g., this function is not called by a
+ * worker thread), -1 should be passed as the 'worker_number'.
+ *
+ * The reaction is pushed onto the deque of the calling worker, or, if the
+ * caller is not a worker, onto the deque of the worker recorded in the
+ * `worker_affinity` of the reaction.
+ *
+ * The scheduler will ensure that the same reaction is not triggered twice in
+ * the same tag.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ *  be used if there is only one worker (e.g., when the program is using the
+ *  single-threaded C runtime). -1 is used for an anonymous call in a context where a
+ *  worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Enqueueing reaction %s, which has level %lld.",
+            reaction->name, LF_LEVEL(reaction->index));
+    _lf_sched_insert_reaction(scheduler, reaction, worker_number);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag. This scheduler has nothing to gain
+ * from inserting them together, so it triggers them one by one.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    for (size_t i = 0; i < count; i++) {
+        lf_scheduler_trigger_reaction(scheduler, reactions[i], worker_number);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler. This scheduler does not order
+ * reactions by deadline, so this is always the case.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return true;
+}
+
+LF_SCHED_REGISTER();
+#endif
+#endif
@@ -0,0 +1,579 @@
+#if !defined(LF_SINGLE_THREADED)
+/* Static scheduler for the threaded runtime of the C target of Lingua Franca. */
+
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * Static scheduler for the threaded runtime of the C target of Lingua Franca.
+ *
+ * Instead of sorting triggered reactions into queues by level, this scheduler
+ * executes a schedule computed offline for time-triggered programs, which
+ * `sched_params_t` passes to `lf_sched_init` (see `lf_static_schedule_t`). At
+ * each tag, it looks up the slot of the schedule for the time of the tag, and
+ * each worker goes through its list of reactions for the slot, executing those
+ * that are triggered and waiting for the other workers at synchronization
+ * points. Triggering a reaction only marks it as queued and records it.
+ *
+ * At the end of a slot, the triggered reactions that the slot did not execute,
+ * which means that the schedule does not match the program, are executed one
+ * at a time in level order by the last worker to get there, and a warning is
+ * printed. The reactions of tags that match no slot are executed in the same
+ * way without a warning.
+ */
+#include "lf_types.h"
+#if SCHEDULER == SCHED_STATIC || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT STATIC
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif  // NUMBER_OF_WORKERS
+
+#include <assert.h>
+
+#include "platform.h"
+#include "environment.h"
+#include "reactor_threaded.h"
+#include "scheduler_instance.h"
+#include "scheduler_sync_tag_advance.h"
+#include "scheduler.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+/**
+ * Number of levels tracked by each word of the populated-levels bitmap.
+ */
+#define LF_LEVELS_PER_WORD 32
+
+typedef struct custom_scheduler_data_t {
+    /**
+     * Protects all the fields below except `triggered`, `num_triggered` and
+     * `populated_levels`.
+     */
+    lf_mutex_t mutex;
+    /** Broadcast when the workers pass a synchronization point. */
+    lf_cond_t passed;
+    /** The schedule, or NULL if there is none. */
+    const lf_static_schedule_t* schedule;
+    /** The slot of the current tag, or `schedule->num_slots` if it matches none. */
+    size_t slot;
+    /**
+     * Whether `slot` has been looked up for the start tag, which is set up
+     * after the scheduler is initialized but before the workers start.
+     */
+    bool started;
+    /** The position of each worker in its list of reactions for the slot. */
+    size_t* positions;
+    /** The number of workers that have reached the next synchronization point. */
+    size_t num_arrived;
+    /** Incremented each time the workers pass a synchronization point. */
+    unsigned int generation;
+    /**
+     * The worker that executes the reactions left after the slot, or -1 if
+     * there are none.
+     */
+    int sequential_worker;
+    /**
+     * The reactions triggered at the current tag, in one list per level. The
+     * list of level `l` starts at `level_offsets[l]` and has room for the
+     * `level_offsets[l + 1] - level_offsets[l]` reactions of that level.
+     */
+    reaction_t** triggered;
+    size_t* level_offsets;
+    /** The number of reactions in the list of each level. */
+    volatile int* num_triggered;
+    /** The number of levels. */
+    size_t num_levels;
+    /**
+     * Bitmap with one bit per level that is set when a reaction is triggered
+     * at that level, so that the leftovers and the reset of the lists skip
+     * the empty levels.
+     */
+    volatile int* populated_levels;
+    /** The number of words in `populated_levels`. */
+    size_t populated_levels_size;
+    /**
+     * The level and the position in its list of the next triggered reaction to
+     * consider as a leftover. The reactions that the leftovers trigger have
+     * higher levels, so this never moves back within a tag.
+     */
+    size_t leftover_level;
+    int leftover_position;
+} custom_scheduler_data_t;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * @brief Look up the slot of the schedule for the current tag.
+ *
+ * Tags with a microstep other than 0 match no slot.
+ */
+static void _lf_sched_find_slot(lf_scheduler_t* scheduler) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    const lf_static_schedule_t* schedule = data->schedule;
+    if (schedule == NULL) {
+        data->slot = 0;
+        return;
+    }
+    data->slot = schedule->num_slots;
+    tag_t tag = scheduler->env->current_tag;
+    if (tag.microstep != 0u || tag.time < lf_time_start()) {
+        return;
+    }
+    interval_t offset = (tag.time - lf_time_start()) % schedule->hyperperiod;
+    size_t low = 0;
+    size_t high = schedule->num_slots;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (schedule->slot_offsets[middle] < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < schedule->num_slots && schedule->slot_offsets[low] == offset) {
+        data->slot = low;
+    }
+    LF_PRINT_DEBUG("Scheduler: Tag " PRINTF_TAG " is in slot %zu.",
+            tag.time - lf_time_start(), tag.microstep, data->slot);
+}
+
+/**
+ * @brief Return the list of reactions of 'worker_number' for the current slot
+ * and store its length in 'length'. The list is empty if the current tag
+ * matches no slot or the schedule assigns no reactions to the worker.
+ */
+static reaction_t* const* _lf_sched_program(custom_scheduler_data_t* data, int worker_number, size_t* length) {
+    const lf_static_schedule_t* schedule = data->schedule;
+    if (schedule == NULL || data->slot >= schedule->num_slots || (size_t)worker_number >= schedule->num_workers) {
+        *length = 0;
+        return NULL;
+    }
+    size_t program = data->slot * schedule->num_workers + (size_t)worker_number;
+    *length = schedule->program_lengths[program];
+    return schedule->programs[program];
+}
+
+/**
+ * @brief Return the index of the least significant set bit in a non-zero
+ * 'word'.
+ */
+static inline size_t _lf_sched_lowest_set_bit(unsigned int word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctz(word);
+#else
+    size_t bit = 0;
+    while ((word & 1u) == 0) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Return the lowest populated level that is at least 'level', or
+ * `data->num_levels` if there is none.
+ */
+static size_t _lf_sched_next_populated_level(custom_scheduler_data_t* data, size_t level) {
+    size_t word = level / LF_LEVELS_PER_WORD;
+    if (word >= data->populated_levels_size) return data->num_levels;
+    unsigned int bits = (unsigned int)data->populated_levels[word] & (~0u << (level % LF_LEVELS_PER_WORD));
+    while (bits == 0) {
+        if (++word == data->populated_levels_size) return data->num_levels;
+        bits = (unsigned int)data->populated_levels[word];
+    }
+    return word * LF_LEVELS_PER_WORD + _lf_sched_lowest_set_bit(bits);
+}
+
+/**
+ * @brief Return the triggered reaction with the lowest level that has not been
+ * executed, or NULL if there is none.
+ *
+ * This walks the lists of the populated levels from where the previous call
+ * stopped, and stays at a reaction until it has been executed, so each reaction
+ * is visited a constant number of times per tag.
+ * This assumes that no other worker is executing reactions.
+ */
+static reaction_t* _lf_sched_next_leftover(custom_scheduler_data_t* data) {
+    while (true) {
+        size_t level = _lf_sched_next_populated_level(data, data->leftover_level);
+        if (level != data->leftover_level) {
+            if (level == data->num_levels) return NULL;
+            data->leftover_level = level;
+            data->leftover_position = 0;
+        }
+        reaction_t** list = &data->triggered[data->level_offsets[level]];
+        while (data->leftover_position < data->num_triggered[level]) {
+            reaction_t* reaction = list[data->leftover_position];
+            if (reaction->status == queued) return reaction;
+            data->leftover_position++;
+        }
+        data->leftover_level++;
+        data->leftover_position = 0;
+    }
+}
+
+/**
+ * @brief Wait until the other workers pass the synchronization point that the
+ * calling worker reached at 'generation'.
+ *
+ * This assumes that the caller holds the scheduler mutex.
+ */
+static void _lf_sched_wait_for_others(lf_scheduler_t* scheduler, int worker_number, unsigned int generation) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    tracepoint_worker_wait_starts(scheduler->env->trace, worker_number);
+    LF_PROBE1(worker_wait_start, worker_number);
+    while (data->generation == generation && !scheduler->should_stop) {
+        lf_cond_wait(&data->passed);
+    }
+    tracepoint_worker_wait_ends(scheduler->env->trace, worker_number);
+    LF_PROBE1(worker_wait_end, worker_number);
+}
+
+/**
+ * @brief Let all workers pass the current synchronization point.
+ *
+ * This assumes that the caller holds the scheduler mutex.
+ */
+static void _lf_sched_pass(custom_scheduler_data_t* data) {
+    data->num_arrived = 0;
+    data->generation++;
+    lf_cond_broadcast(&data->passed);
+}
+
+/**
+ * @brief Advance the tag on behalf of all workers and look up its slot.
+ *
+ * This assumes that the caller holds the scheduler mutex and that no
+ * reaction is executing. The triggers of reactions at the new tag do not
+ * need the scheduler mutex.
+ */
+static void _lf_sched_advance_tag(lf_scheduler_t* scheduler) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    environment_t* env = scheduler->env;
+    // Empty the lists of the levels that were populated.
+    for (size_t word = 0; word < data->populated_levels_size; word++) {
+        unsigned int bits = (unsigned int)data->populated_levels[word];
+        while (bits != 0) {
+            size_t bit = _lf_sched_lowest_set_bit(bits);
+            data->num_triggered[word * LF_LEVELS_PER_WORD + bit] = 0;
+            bits &= bits - 1;
+        }
+        data->populated_levels[word] = 0;
+    }
+    data->leftover_level = 0;
+    data->leftover_position = 0;
+
+    lf_mutex_lock(&env->mutex);
+    LF_PRINT_DEBUG("Scheduler: Advancing tag.");
+    if (_lf_sched_advance_tag_locked(scheduler)) {
+        LF_PRINT_DEBUG("Scheduler: Reached stop tag.");
+        scheduler->should_stop = true;
+    }
+    lf_mutex_unlock(&env->mutex);
+
+    _lf_sched_find_slot(scheduler);
+    for (size_t i = 0; i < scheduler->number_of_workers; i++) {
+        data->positions[i] = 0;
+    }
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * If the scheduler is already initialized, this will be a no-op.
+ *
+ * @param env Environment within which we are executing.
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param option Pointer to a `sched_params_t` struct containing additional
+ *  scheduler parameters, including the static schedule.
+ */
+void lf_sched_init(
+    environment_t* env,
+    size_t number_of_workers,
+    sched_params_t* params
+) {
+    assert(env != GLOBAL_ENVIRONMENT);
+
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers", number_of_workers);
+
+    // Like the NP scheduler, this scheduler requires `num_reactions_per_level`
+    // to size its list of triggered reactions.
+    if (init_sched_instance(env, &env->scheduler, number_of_workers, params)) {
+        // Scheduler has not been initialized before.
+        if (params == NULL || params->num_reactions_per_level == NULL) {
+            lf_print_error_and_exit(
+                "Scheduler: Internal error. The STATIC scheduler "
+                "requires params.num_reactions_per_level to be set.");
+        }
+    } else {
+        // Already initialized
+        return;
+    }
+    lf_scheduler_t* scheduler = env->scheduler;
+
+    scheduler->custom_data = (custom_scheduler_data_t*)calloc(1, sizeof(custom_scheduler_data_t));
+    lf_assert(scheduler->custom_data != NULL, "Out of memory");
+    custom_scheduler_data_t* data = scheduler->custom_data;
+
+    const lf_static_schedule_t* schedule = params->static_schedule;
+    if (schedule == NULL) {
+        lf_print_warning("Scheduler: No static schedule. Reactions will execute one at a time.");
+    } else {
+        if (schedule->num_workers > number_of_workers) {
+            lf_print_error_and_exit("Scheduler: The static schedule needs %zu workers, but there are %zu.",
+                    schedule->num_workers, number_of_workers);
+        }
+        if (schedule->hyperperiod <= 0LL || schedule->num_slots == 0) {
+            lf_print_error_and_exit("Scheduler: The static schedule has an empty hyperperiod.");
+        }
+        for (size_t slot = 0; slot < schedule->num_slots; slot++) {
+            if (schedule->slot_offsets[slot] < 0LL || schedule->slot_offsets[slot] >= schedule->hyperperiod
+                    || (slot > 0 && schedule->slot_offsets[slot] <= schedule->slot_offsets[slot - 1])) {
+                lf_print_error_and_exit("Scheduler: The offsets of the slots of the static schedule "
+                        "must increase within the hyperperiod.");
+            }
+            // Workers that disagree on the synchronization points would wait for each other forever.
+            size_t expected = 0;
+            for (size_t worker = 0; worker < schedule->num_workers; worker++) {
+                size_t program = slot * schedule->num_workers + worker;
+                size_t sync_points = 0;
+                for (size_t i = 0; i < schedule->program_lengths[program]; i++) {
+                    if (schedule->programs[program][i] == NULL) sync_points++;
+                }
+                if (worker > 0 && sync_points != expected) {
+                    lf_print_error_and_exit("Scheduler: Worker %zu has %zu synchronization points in slot %zu "
+                            "of the static schedule, but worker 0 has %zu.", worker, sync_points, slot, expected);
+                }
+                expected = sync_points;
+            }
+            if (expected > 0 && schedule->num_workers < number_of_workers) {
+                lf_print_error_and_exit("Scheduler: The static schedule has synchronization points in slot %zu "
+                        "but only lists %zu of the %zu workers.", slot, schedule->num_workers, number_of_workers);
+            }
+        }
+    }
+    data->schedule = schedule;
+
+    // Each reaction is triggered at most once per tag.
+    data->num_levels = scheduler->max_reaction_level + 1;
+    data->level_offsets = (size_t*)calloc(data->num_levels + 1, sizeof(size_t));
+    lf_assert(data->level_offsets != NULL, "Out of memory");
+    for (size_t i = 0; i < data->num_levels; i++) {
+        data->level_offsets[i + 1] = data->level_offsets[i] + params->num_reactions_per_level[i];
+    }
+    data->triggered = (reaction_t**)calloc(data->level_offsets[data->num_levels] + 1, sizeof(reaction_t*));
+    data->num_triggered = (volatile int*)calloc(data->num_levels, sizeof(int));
+    data->populated_levels_size = (data->num_levels + LF_LEVELS_PER_WORD - 1) / LF_LEVELS_PER_WORD;
+    data->populated_levels = (volatile int*)calloc(data->populated_levels_size, sizeof(int));
+    data->positions = (size_t*)calloc(number_of_workers, sizeof(size_t));
+    lf_assert(data->triggered != NULL && data->num_triggered != NULL && data->populated_levels != NULL
+            && data->positions != NULL, "Out of memory");
+    data->sequential_worker = -1;
+
+    lf_mutex_init(&data->mutex);
+    lf_cond_init(&data->passed, &data->mutex);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free(lf_scheduler_t* scheduler) {
+    free(scheduler->custom_data->triggered);
+    free(scheduler->custom_data->level_offsets);
+    free((void*)scheduler->custom_data->num_triggered);
+    free((void*)scheduler->custom_data->populated_levels);
+    free(scheduler->custom_data->positions);
+    free(scheduler->custom_data);
+    lf_semaphore_destroy(scheduler->semaphore);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return the next triggered reaction of the
+ * schedule of worker thread 'worker_number' or it is time for the worker
+ * thread to stop and exit (where a NULL value would be returned).
+ *
+ * @param worker_number
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    lf_mutex_lock(&data->mutex);
+    if (!data->started) {
+        data->started = true;
+        _lf_sched_find_slot(scheduler);
+    }
+    while (!scheduler->should_stop) {
+        if (data->sequential_worker >= 0) {
+            if (data->sequential_worker != worker_number) {
+                _lf_sched_wait_for_others(scheduler, worker_number, data->generation);
+                continue;
+            }
+            reaction_t* reaction = _lf_sched_next_leftover(data);
+            if (reaction != NULL) {
+                lf_mutex_unlock(&data->mutex);
+                return reaction;
+            }
+            data->sequential_worker = -1;
+            _lf_sched_advance_tag(scheduler);
+            _lf_sched_pass(data);
+            continue;
+        }
+        size_t length;
+        reaction_t* const* program = _lf_sched_program(data, worker_number, &length);
+        if (data->positions[worker_number] < length) {
+            reaction_t* reaction = program[data->positions[worker_number]++];
+            if (reaction == NULL) {
+                // A synchronization point.
+                if (++data->num_arrived == scheduler->number_of_workers) {
+                    _lf_sched_pass(data);
+                } else {
+                    _lf_sched_wait_for_others(scheduler, worker_number, data->generation);
+                }
+            } else if (reaction->status == queued) {
+                lf_mutex_unlock(&data->mutex);
+                LF_PRINT_DEBUG("Scheduler: Worker %d got reaction %s.", worker_number, reaction->name);
+                return reaction;
+            }
+            continue;
+        }
+        // The end of the slot.
+        if (++data->num_arrived < scheduler->number_of_workers) {
+            _lf_sched_wait_for_others(scheduler, worker_number, data->generation);
+            continue;
+        }
+        data->num_arrived = 0;
+        reaction_t* leftover = _lf_sched_next_leftover(data);
+        if (leftover != NULL) {
+            if (data->schedule != NULL && data->slot < data->schedule->num_slots) {
+                lf_print_warning("Scheduler: Reaction %s is triggered at tag " PRINTF_TAG
+                        " but not in slot %zu of the static schedule.", leftover->name,
+                        scheduler->env->current_tag.time - lf_time_start(),
+                        scheduler->env->current_tag.microstep, data->slot);
+            }
+            data->sequential_worker = worker_number;
+            continue;
+        }
+        _lf_sched_advance_tag(scheduler);
+        _lf_sched_pass(data);
+    }
+    lf_cond_broadcast(&data->passed);
+    lf_mutex_unlock(&data->mutex);
+
+    // It's time for the worker thread to stop and exit.
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number,
+                                 reaction_t* done_reaction) {
+    if (!lf_bool_compare_and_swap(&done_reaction->status, queued, inactive)) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                             done_reaction->status, queued);
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a worker number is not available (e.g., this function is not called by a
+ * worker thread), -1 should be passed as the 'worker_number'.
+ *
+ * The scheduler will ensure that the same reaction is not triggered twice in
+ * the same tag.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ *  be used if there is only one worker (e.g., when the program is using the
+ *  single-threaded C runtime). -1 is used for an anonymous call in a context where a
+ *  worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    if (reaction == NULL || !lf_bool_compare_and_swap(&reaction->status, inactive, queued)) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Triggering reaction %s, which has level %lld.",
+            reaction->name, LF_LEVEL(reaction->index));
+    custom_scheduler_data_t* data = scheduler->custom_data;
+    size_t level = LF_LEVEL(reaction->index);
+    int position = lf_atomic_fetch_add(&data->num_triggered[level], 1);
+    lf_assert(data->level_offsets[level] + (size_t)position < data->level_offsets[level + 1],
+            "Scheduler: Reaction queue overflow.");
+    data->triggered[data->level_offsets[level] + position] = reaction;
+    if (position == 0) {
+        // The first reaction at the level marks it as populated.
+        volatile int* word = &data->populated_levels[level / LF_LEVELS_PER_WORD];
+        int bit = (int)(1u << (level % LF_LEVELS_PER_WORD));
+        int old = *word;
+        while (!lf_bool_compare_and_swap(word, old, old | bit)) {
+            old = *word;
+        }
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag.
+ *
+ * @param reactions The reactions to trigger at the current tag.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call, or -1.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    for (size_t i = 0; i < count; i++) {
+        lf_scheduler_trigger_reaction(scheduler, reactions[i], worker_number);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler. This is never the case with this
+ * scheduler because the schedule decides which worker executes each reaction.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return false;
+}
+
+LF_SCHED_REGISTER();
+#endif
+#endif
@@ -28,23 +28,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * @author{Peter Donovan <peterdonovan@berkeley.edu>}
  */
 #include "lf_types.h"
-#if defined SCHEDULER && SCHEDULER == SCHED_ADAPTIVE
+#if (defined SCHEDULER && SCHEDULER == SCHED_ADAPTIVE) || defined(LF_SCHED_DYNAMIC)
+#define LF_SCHED_VARIANT ADAPTIVE
 #ifndef NUMBER_OF_WORKERS
 #define NUMBER_OF_WORKERS 1
 #endif // NUMBER_OF_WORKERS
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "environment.h"
+#include "probes.h"
+#include "reactor_common.h"
+#include "reactor_threaded.h"
 #include "scheduler_sync_tag_advance.h"
 #include "scheduler.h"
+#include "trace.h"
 #include "util.h"
 
 #ifndef MAX_REACTION_LEVEL
 #define MAX_REACTION_LEVEL INITIAL_REACT_QUEUE_SIZE
 #endif
 /////////////////// Forward declarations /////////////////////////
-extern bool fast;
 static void worker_states_lock(lf_scheduler_t* scheduler, size_t worker);
 static void worker_states_unlock(lf_scheduler_t* scheduler, size_t worker);
 static void data_collection_init(lf_scheduler_t* scheduler, sched_params_t* params);
@@ -71,10 +77,12 @@ typedef struct {
     lf_cond_t* worker_conds;
     /** The cumsum of the sizes of the groups of workers corresponding to each successive cond. */
     size_t* cumsum_of_worker_group_sizes;
-    /** The number of non-waiting threads. */
+    /** The number of non-waiting threads, which is the count of the level barrier. */
     volatile size_t num_loose_threads;
     /** The number of threads that were awakened for the purpose of executing the current level. */
     volatile size_t num_awakened;
+    /** The number of threads blocked on one of the condition variables. */
+    volatile size_t num_sleeping;
     /** Whether the mutex is held by each worker via this module's API. */
     bool* mutex_held;
 } worker_states_t;
@@ -120,7 +128,7 @@ typedef struct custom_scheduler_data_t {
     data_collection_t* data_collection;
     bool init_called;
     bool should_stop;
-    size_t level_counter;
+    volatile size_t level_counter;
 } custom_scheduler_data_t;
 
 ///////////////////////// Scheduler Private Functions ///////////////////////////
@@ -224,7 +232,9 @@ static void worker_assignments_free(lf_scheduler_t* scheduler) {
 static reaction_t* get_reaction(lf_scheduler_t* scheduler, size_t worker) {
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
 #ifndef FEDERATED
-    int index = lf_atomic_add_fetch(worker_assignments->num_reactions_by_worker + worker, -1);
+    // This only claims a reaction, which was assigned before the level started.
+    int index = lf_atomic_add_fetch_explicit(worker_assignments->num_reactions_by_worker + worker, -1,
+            LF_ATOMIC_RELAXED);
     if (index >= 0) {
         return worker_assignments->reactions_by_worker[worker][index];
     }
@@ -251,12 +261,17 @@ static reaction_t* get_reaction(lf_scheduler_t* scheduler, size_t worker) {
 }
 
 /**
- * @brief Get a reaction for the given worker to execute. If no such reaction exists, claim the
- * mutex.
+ * @brief Get a reaction for the given worker to execute, either one assigned to it or one that
+ * was assigned to another worker of the current level.
+ *
+ * Outside of federated execution, no reaction is added to the current level once it has started,
+ * so finding all queues empty once is final and no lock is needed. Federated programs may insert
+ * reactions into the current level while holding the mutex, so there the mutex is claimed before
+ * concluding that there is nothing to do, and it is left held.
  * @param worker A worker requesting work.
  * @return reaction_t* A reaction to execute, or NULL if no such reaction exists.
  */
-static reaction_t* worker_assignments_get_or_lock(lf_scheduler_t* scheduler, size_t worker) {
+static reaction_t* worker_assignments_get(lf_scheduler_t* scheduler, size_t worker) {
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
     assert(worker >= 0);
     // assert(worker < num_workers);  // There are edge cases where this doesn't hold.
@@ -273,11 +288,15 @@ static reaction_t* worker_assignments_get_or_lock(lf_scheduler_t* scheduler, siz
                 if ((ret = get_reaction(scheduler, victim))) return ret;
             }
         }
+#ifdef FEDERATED
         worker_states_lock(scheduler, worker);
         if (!worker_assignments->num_reactions_by_worker[worker]) {
             return NULL;
         }
         worker_states_unlock(scheduler, worker);
+#else
+        return NULL;
+#endif
     }
 }
 
@@ -302,10 +321,18 @@ static void worker_assignments_put(lf_scheduler_t* scheduler, reaction_t* reacti
     hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
     hash = hash ^ (hash >> 31);
     size_t worker = hash % worker_assignments->num_workers_by_level[level];
+#ifndef FEDERATED
+    // This only claims a slot at a later level, which is read once that level starts.
+    size_t num_preceding_reactions = lf_atomic_fetch_add_explicit(
+        &worker_assignments->num_reactions_by_worker_by_level[level][worker],
+        1, LF_ATOMIC_RELAXED
+    );
+#else
     size_t num_preceding_reactions = lf_atomic_fetch_add(
         &worker_assignments->num_reactions_by_worker_by_level[level][worker],
         1
     );
+#endif
     worker_assignments->reactions_by_worker_by_level[level][worker][num_preceding_reactions] = reaction;
 }
 
@@ -341,11 +368,14 @@ static void worker_states_free(lf_scheduler_t* scheduler) {
 /**
  * @brief Awaken the workers scheduled to work on the current level.
  *
+ * This is the release side of the level barrier. It resets the count of the barrier and then
+ * publishes the level by incrementing the level counter, on which waiting workers spin before
+ * they block. The mutex is only taken to notify workers that are blocked.
+ *
  * @param worker The calling worker.
  * @param num_to_awaken The number of workers to awaken.
- * @return A snapshot of the level counter after awakening the workers.
  */
-static void worker_states_awaken_locked(lf_scheduler_t* scheduler, size_t worker, size_t num_to_awaken) {
+static void worker_states_awaken(lf_scheduler_t* scheduler, size_t worker, size_t num_to_awaken) {
     worker_states_t* worker_states = scheduler->custom_data->worker_states;
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
     assert(num_to_awaken <= worker_assignments->max_num_workers);
@@ -355,33 +385,29 @@ static void worker_states_awaken_locked(lf_scheduler_t* scheduler, size_t worker
     }
     size_t greatest_worker_number_to_awaken = num_to_awaken - 1;
     size_t max_cond = cond_of(greatest_worker_number_to_awaken);
-    if (!worker_states->mutex_held[worker]) {
-        worker_states->mutex_held[worker] = true;
+    size_t num_awakened = worker_states->cumsum_of_worker_group_sizes[max_cond];
+    // The calling worker goes on to the new level whether or not it is among those awakened.
+    worker_states->num_loose_threads = num_awakened + (worker >= num_awakened);
+    lf_memory_barrier();
+    worker_states->num_awakened = num_awakened;
+    // Together with the increment of num_sleeping by a worker that is about to block, this
+    // ensures that either that worker sees the new level or this one sees that it must notify.
+    lf_atomic_fetch_add_explicit(&scheduler->custom_data->level_counter, 1, LF_ATOMIC_SEQ_CST);
+    if (lf_atomic_load_explicit(&worker_states->num_sleeping, LF_ATOMIC_SEQ_CST)) {
         lf_mutex_lock(&scheduler->env->mutex);
-    }
-    // The predicate of the condition variable depends on num_awakened and level_counter, so
-    // this is a critical section.
-    worker_states->num_loose_threads = worker_states->cumsum_of_worker_group_sizes[max_cond];
-    worker_states->num_loose_threads += worker >= worker_states->num_loose_threads;
-    worker_states->num_awakened = worker_states->num_loose_threads;
-    scheduler->custom_data->level_counter++;
-    for (int cond = 0; cond <= max_cond; cond++) {
-        lf_cond_broadcast(worker_states->worker_conds + cond);
+        for (int cond = 0; cond <= max_cond; cond++) {
+            lf_cond_broadcast(worker_states->worker_conds + cond);
+        }
+        lf_mutex_unlock(&scheduler->env->mutex);
     }
 }
 
-/** Lock the global mutex if needed. */
+/** Lock the global mutex if the given worker does not already hold it. */
 static void worker_states_lock(lf_scheduler_t* scheduler, size_t worker) {
     worker_states_t* worker_states = scheduler->custom_data->worker_states;
-    worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
-    assert(worker_states->num_loose_threads > 0);
-    assert(worker_states->num_loose_threads <= worker_assignments->max_num_workers);
-    size_t lt = worker_states->num_loose_threads;
-    if (lt > 1 || !fast) {  // FIXME: Lock should be partially optimized out even when !fast
-        lf_mutex_lock(&scheduler->env->mutex);
-        assert(!worker_states->mutex_held[worker]);
-        worker_states->mutex_held[worker] = true;
-    }
+    if (worker_states->mutex_held[worker]) return;
+    lf_mutex_lock(&scheduler->env->mutex);
+    worker_states->mutex_held[worker] = true;
 }
 
 /** Unlock the global mutex if needed. */
@@ -395,62 +421,93 @@ static void worker_states_unlock(lf_scheduler_t* scheduler, size_t worker) {
 /**
  * @brief Record that worker is finished working on the current level.
  *
+ * This is the arrival side of the level barrier, which is a single atomic decrement.
+ *
  * @param worker The number of a worker.
  * @return true If this is the last worker to finish working on the current level.
  * @return false If at least one other worker is still working on the current level.
  */
-static bool worker_states_finished_with_level_locked(lf_scheduler_t* scheduler, size_t worker) {
+static bool worker_states_finished_with_level(lf_scheduler_t* scheduler, size_t worker) {
     worker_states_t* worker_states = scheduler->custom_data->worker_states;
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
     assert(worker >= 0);
     assert(worker_states->num_loose_threads > 0);
     assert(worker_assignments->num_reactions_by_worker[worker] != 1);
     assert(((int64_t) worker_assignments->num_reactions_by_worker[worker]) <= 0);
-    // Why use an atomic operation when we are supposed to be "as good as locked"? Because I took a
-    // shortcut, and the shortcut was imperfect.
-    size_t ret = lf_atomic_add_fetch(&worker_states->num_loose_threads, -1);
+    // The last worker advances the level, so each releases its writes and the last acquires them.
+    size_t ret = lf_atomic_add_fetch_explicit(&worker_states->num_loose_threads, -1, LF_ATOMIC_ACQ_REL);
     assert(ret <= worker_assignments->max_num_workers);  // Check for underflow
     return !ret;
 }
 
 /**
- * @brief Make the given worker go to sleep.
+ * @brief Return whether the given worker has been awakened to execute a level that started after
+ * it took the given snapshot of the level counter.
+ */
+static bool worker_states_awakened(lf_scheduler_t* scheduler, size_t worker, size_t level_counter_snapshot) {
+    worker_states_t* worker_states = scheduler->custom_data->worker_states;
+    return lf_atomic_load_explicit(&scheduler->custom_data->level_counter, LF_ATOMIC_SEQ_CST) != level_counter_snapshot
+        && worker < lf_atomic_load_explicit(&worker_states->num_awakened, LF_ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Make the given worker wait until it is awakened for a later level.
  *
  * This should be called by the given worker when the worker will do nothing for the remainder of
- * the execution of the current level.
+ * the execution of the current level. The worker spins on the level counter for up to
+ * `scheduler->spin_limit` iterations, which adapts as in lf_sched_wait_on_semaphore(), and only
+ * then blocks on the condition variable of its group.
  *
  * @param worker The number of the calling worker.
  * @param level_counter_snapshot The value of the level counter at the time of the decision to
  * sleep.
  */
-static void worker_states_sleep_and_unlock(lf_scheduler_t* scheduler, size_t worker, size_t level_counter_snapshot) {
+static void worker_states_wait(lf_scheduler_t* scheduler, size_t worker, size_t level_counter_snapshot) {
     worker_states_t* worker_states = scheduler->custom_data->worker_states;
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
     assert(worker < worker_assignments->max_num_workers);
     assert(worker_states->num_loose_threads <= worker_assignments->max_num_workers);
-    if (!worker_states->mutex_held[worker]) {
-        lf_mutex_lock(&scheduler->env->mutex);
+    worker_states_unlock(scheduler, worker);
+    if (worker_states_awakened(scheduler, worker, level_counter_snapshot)) return;
+    unsigned int spin_limit = scheduler->spin_limit;
+    if (spin_limit > 0) {
+        tracepoint_worker_spin_starts(scheduler->env->trace, worker);
+        LF_PROBE1(worker_spin_start, worker);
+        bool awakened = false;
+        for (unsigned int i = 0; i < spin_limit && !awakened; i++) {
+            awakened = worker_states_awakened(scheduler, worker, level_counter_snapshot);
+        }
+        tracepoint_worker_spin_ends(scheduler->env->trace, worker);
+        LF_PROBE1(worker_spin_end, worker);
+        if (awakened) {
+            scheduler->spin_limit = LF_MIN(spin_limit * 2, scheduler->spin_budget);
+            return;
+        }
+        scheduler->spin_limit = LF_MAX(spin_limit / 2, 1);
     }
-    worker_states->mutex_held[worker] = false;  // This will be true soon, upon call to lf_cond_wait.
+    tracepoint_worker_wait_starts(scheduler->env->trace, worker);
+    LF_PROBE1(worker_wait_start, worker);
+    lf_mutex_lock(&scheduler->env->mutex);
+    lf_atomic_fetch_add_explicit(&worker_states->num_sleeping, 1, LF_ATOMIC_SEQ_CST);
     size_t cond = cond_of(worker);
-    if (
-        ((level_counter_snapshot == scheduler->custom_data->level_counter) || worker >= worker_states->num_awakened)
-    ) {
-        do {
-            lf_cond_wait(worker_states->worker_conds + cond);
-        } while (level_counter_snapshot == scheduler->custom_data->level_counter || worker >= worker_states->num_awakened);
+    while (!worker_states_awakened(scheduler, worker, level_counter_snapshot)) {
+        lf_cond_wait(worker_states->worker_conds + cond);
     }
-    assert(!worker_states->mutex_held[worker]);  // This thread holds the mutex, but it did not report that.
+    lf_atomic_fetch_add_explicit(&worker_states->num_sleeping, -1, LF_ATOMIC_RELAXED);
     lf_mutex_unlock(&scheduler->env->mutex);
+    tracepoint_worker_wait_ends(scheduler->env->trace, worker);
+    LF_PROBE1(worker_wait_end, worker);
 }
 
 /**
  * @brief Increment the level currently being executed, and the tag if necessary.
+ *
+ * Only the last worker to finish the current level calls this, while the others wait, so the
+ * level itself needs no lock. The mutex is held only to advance the tag.
  * @param worker The number of the calling worker.
  */
-static void advance_level_and_unlock(lf_scheduler_t* scheduler, size_t worker) {
+static void advance_level(lf_scheduler_t* scheduler, size_t worker) {
     worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
-    worker_states_t* worker_states = scheduler->custom_data->worker_states;
     size_t max_level = worker_assignments->num_levels - 1;
     while (true) {
         if (worker_assignments->current_level == max_level) {
@@ -459,21 +516,24 @@ static void advance_level_and_unlock(lf_scheduler_t* scheduler, size_t worker) {
                 worker_assignments->num_workers_by_level, 
                 worker_assignments->max_num_workers_by_level);
             set_level(scheduler, 0);
-            if (_lf_sched_advance_tag_locked(scheduler)) {
+            worker_states_lock(scheduler, worker);
+            bool should_stop = _lf_sched_advance_tag_locked(scheduler);
+            worker_states_unlock(scheduler, worker);
+            if (should_stop) {
                 scheduler->custom_data->should_stop = true;
-                worker_states_awaken_locked(scheduler, worker, worker_assignments->max_num_workers);
-                worker_states_unlock(scheduler, worker);
+                worker_states_awaken(scheduler, worker, worker_assignments->max_num_workers);
                 return;
             }
         } else {
-            set_level(scheduler, try_advance_level(scheduler->env, &worker_assignments->current_level));
+            size_t next_level = worker_assignments->current_level;
+            try_advance_level(scheduler->env, &next_level);
+            set_level(scheduler, next_level);
         }
         size_t total_num_reactions = get_num_reactions(scheduler);
         if (total_num_reactions) {
             size_t num_workers_to_awaken = LF_MIN(total_num_reactions, worker_assignments->num_workers);
             assert(num_workers_to_awaken > 0);
-            worker_states_awaken_locked(scheduler, worker, num_workers_to_awaken);
-            worker_states_unlock(scheduler, worker);
+            worker_states_awaken(scheduler, worker, num_workers_to_awaken);
             return;
         }
     }
@@ -697,6 +757,151 @@ static void data_collection_end_tag(
     }
 }
 
+/** The first word of a file that holds the state learned by this scheduler. */
+#define SCHED_STATE_MAGIC "lf-adaptive-scheduler-state"
+/** The version of the format of a file that holds the state learned by this scheduler. */
+#define SCHED_STATE_VERSION 1
+/** The maximum length of the name of a file that holds the state learned by this scheduler. */
+#define SCHED_STATE_FILE_NAME_LENGTH 256
+
+/**
+ * @brief Write the name of the file that holds the learned state of the environment
+ * of this scheduler into 'buffer'.
+ *
+ * Each enclave has its own levels, so environments other than the first one get
+ * their id appended to the file name.
+ * @return Whether the name fits in the buffer.
+ */
+static bool sched_state_file_name(lf_scheduler_t* scheduler, char* buffer, size_t length) {
+    int written = scheduler->env->id == 0
+        ? snprintf(buffer, length, "%s", _lf_sched_state_file)
+        : snprintf(buffer, length, "%s.%d", _lf_sched_state_file, scheduler->env->id);
+    return written >= 0 && (size_t) written < length;
+}
+
+/**
+ * @brief Load the number of workers per level and the execution time statistics learned
+ * in a previous run, if a file to hold them was given with --sched-state.
+ *
+ * The state is ignored if the file does not yet exist or if it was saved by a program
+ * with a different number of levels or workers.
+ */
+static void sched_state_load(lf_scheduler_t* scheduler) {
+    if (_lf_sched_state_file == NULL) return;
+    worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
+    data_collection_t* data_collection = scheduler->custom_data->data_collection;
+    char file_name[SCHED_STATE_FILE_NAME_LENGTH];
+    if (!sched_state_file_name(scheduler, file_name, sizeof(file_name))) {
+        lf_print_warning("Scheduler: State file name %s is too long.", _lf_sched_state_file);
+        return;
+    }
+    FILE* file = fopen(file_name, "r");
+    if (file == NULL) {
+        LF_PRINT_LOG("Scheduler: No learned state in %s. Starting from scratch.", file_name);
+        return;
+    }
+    char magic[sizeof(SCHED_STATE_MAGIC)];
+    int version;
+    size_t num_levels, max_num_workers, counter;
+    if (fscanf(file, "%27s %d %zu %zu %zu", magic, &version, &num_levels, &max_num_workers, &counter) != 5
+        || strcmp(magic, SCHED_STATE_MAGIC) != 0
+        || version != SCHED_STATE_VERSION
+        || num_levels != data_collection->num_levels
+        || max_num_workers != worker_assignments->max_num_workers
+    ) {
+        lf_print_warning("Scheduler: Ignoring the learned state in %s, which does not match this program.", file_name);
+        fclose(file);
+        return;
+    }
+    // Parse into temporaries first so that a truncated file leaves the scheduler untouched.
+    size_t* num_workers_by_level = (size_t*) calloc(num_levels, sizeof(size_t));
+    size_t* argmins = (size_t*) calloc(num_levels, sizeof(size_t));
+    interval_t* mins = (interval_t*) calloc(num_levels, sizeof(interval_t));
+    interval_t* execution_times = (interval_t*) calloc(num_levels * (max_num_workers + 1), sizeof(interval_t));
+    lf_assert(num_workers_by_level && argmins && mins && execution_times, "Out of memory");
+    bool valid = true;
+    for (size_t level = 0; valid && level < num_levels; level++) {
+        long long min;
+        valid = fscanf(file, "%zu %zu %lld", &num_workers_by_level[level], &argmins[level], &min) == 3
+            && num_workers_by_level[level] <= max_num_workers
+            && argmins[level] <= max_num_workers;
+        mins[level] = (interval_t) min;
+        for (size_t i = 0; valid && i <= max_num_workers; i++) {
+            long long execution_time;
+            valid = fscanf(file, "%lld", &execution_time) == 1;
+            execution_times[level * (max_num_workers + 1) + i] = (interval_t) execution_time;
+        }
+    }
+    fclose(file);
+    if (valid) {
+        for (size_t level = 0; level < num_levels; level++) {
+            size_t num_workers = num_workers_by_level[level];
+            if (num_workers < 1) num_workers = 1;
+            if (num_workers > worker_assignments->max_num_workers_by_level[level]) {
+                num_workers = worker_assignments->max_num_workers_by_level[level];
+            }
+            worker_assignments->num_workers_by_level[level] = num_workers;
+            data_collection->execution_times_argmins[level] = argmins[level];
+            data_collection->execution_times_mins[level] = mins[level];
+            for (size_t i = 0; i <= max_num_workers; i++) {
+                data_collection->execution_times_by_num_workers_by_level[level][i] =
+                    execution_times[level * (max_num_workers + 1) + i];
+            }
+        }
+        // Resume the experiments where the previous run left off rather than exploring again.
+        data_collection->data_collection_counter = counter;
+        worker_assignments->num_workers = worker_assignments->num_workers_by_level[worker_assignments->current_level];
+        LF_PRINT_LOG("Scheduler: Loaded the learned state from %s.", file_name);
+    } else {
+        lf_print_warning("Scheduler: Ignoring the malformed learned state in %s.", file_name);
+    }
+    free(num_workers_by_level);
+    free(argmins);
+    free(mins);
+    free(execution_times);
+}
+
+/**
+ * @brief Save the number of workers per level and the execution time statistics learned
+ * in this run, if a file to hold them was given with --sched-state.
+ *
+ * This must be called before the worker assignments and the data collection are freed.
+ */
+static void sched_state_save(lf_scheduler_t* scheduler) {
+    if (_lf_sched_state_file == NULL) return;
+    worker_assignments_t * worker_assignments = scheduler->custom_data->worker_assignments;
+    data_collection_t* data_collection = scheduler->custom_data->data_collection;
+    char file_name[SCHED_STATE_FILE_NAME_LENGTH];
+    if (!sched_state_file_name(scheduler, file_name, sizeof(file_name))) return;
+    FILE* file = fopen(file_name, "w");
+    if (file == NULL) {
+        lf_print_warning("Scheduler: Failed to open %s to save the learned state.", file_name);
+        return;
+    }
+    fprintf(file, "%s %d %zu %zu %zu\n",
+        SCHED_STATE_MAGIC,
+        SCHED_STATE_VERSION,
+        data_collection->num_levels,
+        worker_assignments->max_num_workers,
+        data_collection->data_collection_counter
+    );
+    for (size_t level = 0; level < data_collection->num_levels; level++) {
+        fprintf(file, "%zu %zu %lld",
+            worker_assignments->num_workers_by_level[level],
+            data_collection->execution_times_argmins[level],
+            (long long) data_collection->execution_times_mins[level]
+        );
+        for (size_t i = 0; i <= worker_assignments->max_num_workers; i++) {
+            fprintf(file, " %lld", (long long) data_collection->execution_times_by_num_workers_by_level[level][i]);
+        }
+        fprintf(file, "\n");
+    }
+    if (fclose(file) != 0) {
+        lf_print_warning("Scheduler: Failed to save the learned state to %s.", file_name);
+    } else {
+        LF_PRINT_LOG("Scheduler: Saved the learned state to %s.", file_name);
+    }
+}
 
 ///////////////////// Scheduler Init and Destroy API /////////////////////////
 void lf_sched_init(environment_t* env, size_t number_of_workers, sched_params_t* params) {
@@ -723,9 +928,11 @@ void lf_sched_init(environment_t* env, size_t number_of_workers, sched_params_t*
     worker_assignments_init(scheduler, number_of_workers, params);
     
     data_collection_init(scheduler, params);
+    sched_state_load(scheduler);
 }
 
 void lf_sched_free(lf_scheduler_t* scheduler) {
+    sched_state_save(scheduler);
     worker_states_free(scheduler);
     worker_assignments_free(scheduler);
     data_collection_free(scheduler);
@@ -739,13 +946,15 @@ reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_nu
     assert(worker_number >= 0);
     reaction_t* ret;
     while (true) {
-        size_t level_counter_snapshot = scheduler->custom_data->level_counter;
-        ret = worker_assignments_get_or_lock(scheduler, worker_number);
+        size_t level_counter_snapshot = lf_atomic_load_explicit(
+            &scheduler->custom_data->level_counter, LF_ATOMIC_ACQUIRE);
+        ret = worker_assignments_get(scheduler, worker_number);
         if (ret) return ret;
-        if (worker_states_finished_with_level_locked(scheduler, worker_number)) {
-            advance_level_and_unlock(scheduler, worker_number);
+        if (worker_states_finished_with_level(scheduler, worker_number)) {
+            advance_level(scheduler, worker_number);
+            worker_states_unlock(scheduler, worker_number);
         } else {
-            worker_states_sleep_and_unlock(scheduler, worker_number, level_counter_snapshot);
+            worker_states_wait(scheduler, worker_number, level_counter_snapshot);
         }
         if (scheduler->custom_data->should_stop) {
             return NULL;
@@ -762,7 +971,30 @@ void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction
 
 void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
     assert(worker_number >= -1);
-    if (!lf_bool_compare_and_swap(&reaction->status, inactive, queued)) return;
+    // Only one of the workers triggering the reaction needs to win, which publishes nothing.
+    if (!lf_bool_compare_and_swap_explicit(&reaction->status, inactive, queued, LF_ATOMIC_RELAXED)) return;
     worker_assignments_put(scheduler, reaction);
 }
-#endif // defined SCHEDULER && SCHEDULER == SCHED_ADAPTIVE
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag. This scheduler has nothing to gain
+ * from inserting them together, so it triggers them one by one.
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    for (size_t i = 0; i < count; i++) {
+        lf_scheduler_trigger_reaction(scheduler, reactions[i], worker_number);
+    }
+}
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler. This scheduler does not order
+ * reactions by deadline, so this is always the case.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return true;
+}
+
+LF_SCHED_REGISTER();
+#endif // (defined SCHEDULER && SCHEDULER == SCHED_ADAPTIVE) || defined(LF_SCHED_DYNAMIC)
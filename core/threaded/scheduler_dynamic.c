@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Selection of the scheduler at startup.
+ *
+ * Normally, only the scheduler chosen with SCHEDULER is linked, and the
+ * scheduler API is that of the scheduler. With LF_SCHED_DYNAMIC, all schedulers
+ * are linked under names of their own, and the scheduler API defined here
+ * forwards each call to the scheduler selected with --scheduler. This costs an
+ * indirect call per call of the API, which is why it is not the default.
+ */
+
+#if !defined(LF_SINGLE_THREADED)
+#include <string.h>
+#include "lf_types.h"
+#include "reactor_common.h"
+#include "scheduler.h"
+#include "util.h"
+
+#ifndef SCHEDULER
+#define SCHEDULER SCHED_NP
+#endif
+
+#ifdef LF_SCHED_DYNAMIC
+extern const lf_sched_vtable_t _lf_sched_vtable_ADAPTIVE;
+extern const lf_sched_vtable_t _lf_sched_vtable_CHAIN_NP;
+extern const lf_sched_vtable_t _lf_sched_vtable_GEDF_NP;
+extern const lf_sched_vtable_t _lf_sched_vtable_GEDF_NP_LF;
+extern const lf_sched_vtable_t _lf_sched_vtable_NP;
+extern const lf_sched_vtable_t _lf_sched_vtable_NP_WS;
+extern const lf_sched_vtable_t _lf_sched_vtable_STATIC;
+
+/** The schedulers that are linked. */
+static const lf_sched_vtable_t* const _lf_sched_vtables[] = {
+    &_lf_sched_vtable_NP,
+    &_lf_sched_vtable_NP_WS,
+    &_lf_sched_vtable_GEDF_NP,
+    &_lf_sched_vtable_GEDF_NP_LF,
+    &_lf_sched_vtable_ADAPTIVE,
+    &_lf_sched_vtable_CHAIN_NP,
+    &_lf_sched_vtable_STATIC
+};
+#else
+extern const lf_sched_vtable_t _lf_sched_vtable;
+
+/** The schedulers that are linked. */
+static const lf_sched_vtable_t* const _lf_sched_vtables[] = { &_lf_sched_vtable };
+#endif
+
+#define _LF_SCHED_NUM_VTABLES (sizeof(_lf_sched_vtables) / sizeof(_lf_sched_vtables[0]))
+
+/** The scheduler in use, or NULL until lf_sched_selected() is first called. */
+static const lf_sched_vtable_t* _lf_sched_vtable_selected = NULL;
+
+/** Return the linked scheduler with the given 'name', or NULL if there is none. */
+static const lf_sched_vtable_t* _lf_sched_find(const char* name) {
+    // Accept the name of the SCHED_* number as well.
+    if (strncmp(name, "SCHED_", 6) == 0) {
+        name += 6;
+    }
+    for (size_t i = 0; i < _LF_SCHED_NUM_VTABLES; i++) {
+        if (strcmp(_lf_sched_vtables[i]->name, name) == 0) {
+            return _lf_sched_vtables[i];
+        }
+    }
+    return NULL;
+}
+
+const lf_sched_vtable_t* lf_sched_selected(void) {
+    if (_lf_sched_vtable_selected != NULL) {
+        return _lf_sched_vtable_selected;
+    }
+    const lf_sched_vtable_t* selected = NULL;
+    for (size_t i = 0; i < _LF_SCHED_NUM_VTABLES; i++) {
+        if (_lf_sched_vtables[i]->kind == SCHEDULER) {
+            selected = _lf_sched_vtables[i];
+        }
+    }
+    lf_assert(selected != NULL, "The scheduler chosen with SCHEDULER is not linked.");
+    if (_lf_scheduler_name != NULL) {
+        const lf_sched_vtable_t* named = _lf_sched_find(_lf_scheduler_name);
+        if (named != NULL) {
+            selected = named;
+        } else {
+#ifdef LF_SCHED_DYNAMIC
+            lf_print_error("Unknown scheduler %s. Using the %s scheduler.", _lf_scheduler_name, selected->name);
+#else
+            lf_print_warning("Only the %s scheduler is linked. Build with LF_SCHED_DYNAMIC to use the %s scheduler.",
+                    selected->name, _lf_scheduler_name);
+#endif
+        }
+    }
+    LF_PRINT_LOG("Using the %s scheduler.", selected->name);
+    _lf_sched_vtable_selected = selected;
+    return selected;
+}
+
+#ifdef LF_SCHED_DYNAMIC
+void lf_sched_init(environment_t* env, size_t number_of_workers, sched_params_t* parameters) {
+    lf_sched_selected()->init(env, number_of_workers, parameters);
+}
+
+void lf_sched_free(lf_scheduler_t* scheduler) {
+    _lf_sched_vtable_selected->free(scheduler);
+}
+
+reaction_t* lf_sched_get_ready_reaction(lf_scheduler_t* scheduler, int worker_number) {
+    return _lf_sched_vtable_selected->get_ready_reaction(scheduler, worker_number);
+}
+
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    _lf_sched_vtable_selected->done_with_reaction(worker_number, done_reaction);
+}
+
+void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number) {
+    _lf_sched_vtable_selected->trigger_reaction(scheduler, reaction, worker_number);
+}
+
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number) {
+    _lf_sched_vtable_selected->trigger_reactions(scheduler, reactions, count, worker_number);
+}
+
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction) {
+    return _lf_sched_vtable_selected->may_execute_now(scheduler, reaction);
+}
+#endif // LF_SCHED_DYNAMIC
+#endif // !defined(LF_SINGLE_THREADED)
@@ -1,7 +1,10 @@
 #include <assert.h>
 #include "scheduler_instance.h"
+#include "environment.h"
 #include "reactor_common.h"
 #include "lf_types.h"
+#include "probes.h"
+#include "trace.h"
 #include "util.h"
 
 
@@ -42,8 +45,136 @@ bool init_sched_instance(
     (*instance)->number_of_workers = number_of_workers;
     (*instance)->next_reaction_level = 1;
 
+    (*instance)->spin_budget = (params != NULL && params->spin_budget != 0u) ? params->spin_budget : _lf_spin_budget;
+    (*instance)->spin_limit = (*instance)->spin_budget;
+
     (*instance)->should_stop = false;
     (*instance)->env = env;
 
+    lf_mutex_init(&(*instance)->parallel_jobs_mutex);
+    lf_cond_init(&(*instance)->parallel_job_helped, &(*instance)->parallel_jobs_mutex);
+
+#ifdef LF_SUSPENDABLE_REACTIONS
+    lf_mutex_init(&(*instance)->suspension_mutex);
+    lf_cond_init(&(*instance)->reaction_resumable, &(*instance)->suspension_mutex);
+#endif
+
     return true;
 }
+
+/**
+ * @brief Execute the chunks of 'job' that are left, one at a time.
+ */
+static void _lf_sched_execute_chunks(lf_parallel_job_t* job) {
+    size_t begin;
+    while ((begin = lf_atomic_fetch_add(&job->next_iteration, job->grain)) < job->count) {
+        job->body(job->arg, begin, LF_MIN(begin + job->grain, job->count));
+    }
+}
+
+/**
+ * @brief Take one of the wakeups of idle workers for parallel jobs, if there
+ * is one, and return whether there was.
+ */
+static bool _lf_sched_take_helper_wakeup(lf_scheduler_t* scheduler) {
+    int wakeups = scheduler->helper_wakeups;
+    while (wakeups > 0) {
+        if (lf_bool_compare_and_swap(&scheduler->helper_wakeups, wakeups, wakeups - 1)) {
+            return true;
+        }
+        wakeups = scheduler->helper_wakeups;
+    }
+    return false;
+}
+
+/**
+ * @brief Help execute a parallel job that has chunks left, if there is one.
+ */
+static void _lf_sched_help_with_parallel_job(lf_scheduler_t* scheduler, size_t worker_number) {
+    lf_mutex_lock(&scheduler->parallel_jobs_mutex);
+    lf_parallel_job_t* job = scheduler->parallel_jobs;
+    while (job != NULL && lf_atomic_load_explicit(&job->next_iteration, LF_ATOMIC_RELAXED) >= job->count) {
+        job = job->next;
+    }
+    if (job != NULL) {
+        job->helpers++;
+    }
+    lf_mutex_unlock(&scheduler->parallel_jobs_mutex);
+    if (job == NULL) {
+        // The job that this worker was woken up for is done.
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Worker %zu is helping with a parallel job.", worker_number);
+    _lf_sched_execute_chunks(job);
+    lf_mutex_lock(&scheduler->parallel_jobs_mutex);
+    if (--job->helpers == 0) {
+        lf_cond_broadcast(&scheduler->parallel_job_helped);
+    }
+    lf_mutex_unlock(&scheduler->parallel_jobs_mutex);
+}
+
+void lf_sched_run_parallel_job(lf_scheduler_t* scheduler, lf_parallel_job_t* job) {
+    size_t chunks = (job->count + job->grain - 1) / job->grain;
+    size_t helpers = LF_MIN(
+        (size_t)lf_atomic_load_explicit(&scheduler->number_of_idle_workers, LF_ATOMIC_RELAXED),
+        chunks - 1);
+    if (helpers == 0) {
+        _lf_sched_execute_chunks(job);
+        return;
+    }
+    lf_mutex_lock(&scheduler->parallel_jobs_mutex);
+    job->next = scheduler->parallel_jobs;
+    scheduler->parallel_jobs = job;
+    lf_mutex_unlock(&scheduler->parallel_jobs_mutex);
+
+    // Count the wakeups before making them, so that each worker that acquires
+    // the semaphore beyond those that the scheduler releases finds one. A wakeup
+    // that a worker takes after the job is done only makes it wait again.
+    lf_atomic_fetch_add(&scheduler->helper_wakeups, (int)helpers);
+    lf_semaphore_release(scheduler->semaphore, (int)helpers);
+    _lf_sched_execute_chunks(job);
+
+    // Let no more helpers join and wait for those executing chunks of the job.
+    lf_mutex_lock(&scheduler->parallel_jobs_mutex);
+    lf_parallel_job_t** link = &scheduler->parallel_jobs;
+    while (*link != job) {
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    while (job->helpers > 0) {
+        lf_cond_wait(&scheduler->parallel_job_helped);
+    }
+    lf_mutex_unlock(&scheduler->parallel_jobs_mutex);
+}
+
+/**
+ * @brief Acquire 'scheduler->semaphore', spinning before parking as
+ * described for lf_sched_wait_on_semaphore().
+ */
+static void _lf_sched_acquire_semaphore(lf_scheduler_t* scheduler, size_t worker_number) {
+    unsigned int spin_limit = scheduler->spin_limit;
+    if (spin_limit > 0) {
+        tracepoint_worker_spin_starts(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_spin_start, worker_number);
+        bool acquired = lf_semaphore_spin_acquire(scheduler->semaphore, spin_limit);
+        tracepoint_worker_spin_ends(scheduler->env->trace, worker_number);
+        LF_PROBE1(worker_spin_end, worker_number);
+        if (acquired) {
+            // Spinning paid off. Be willing to spin longer next time.
+            scheduler->spin_limit = LF_MIN(spin_limit * 2, scheduler->spin_budget);
+            return;
+        }
+        // Spinning was wasted. Back off, but keep spinning a little so that
+        // the limit can grow again when levels become short.
+        scheduler->spin_limit = LF_MAX(spin_limit / 2, 1);
+    }
+    lf_semaphore_acquire(scheduler->semaphore);
+}
+
+void lf_sched_wait_on_semaphore(lf_scheduler_t* scheduler, size_t worker_number) {
+    _lf_sched_acquire_semaphore(scheduler, worker_number);
+    while (scheduler->lends_idle_workers && _lf_sched_take_helper_wakeup(scheduler)) {
+        _lf_sched_help_with_parallel_job(scheduler, worker_number);
+        _lf_sched_acquire_semaphore(scheduler, worker_number);
+    }
+}
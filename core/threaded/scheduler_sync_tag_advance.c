@@ -37,6 +37,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "scheduler_sync_tag_advance.h"
 #include "environment.h"
+#include "rti_local.h"
 #include "trace.h"
 #include "util.h"
 
@@ -80,8 +81,14 @@ bool should_stop_locked(lf_scheduler_t * sched) {
 bool _lf_sched_advance_tag_locked(lf_scheduler_t * sched) {
     environment_t* env = sched->env;
     logical_tag_complete(env->current_tag);
+#ifdef LF_IN_PROCESS_FEDERATION
+    _lf_rti_local_logical_tag_complete_locked(env, env->current_tag);
+#endif
 
     if (should_stop_locked(sched)) {
+#ifdef LF_IN_PROCESS_FEDERATION
+        _lf_rti_local_resign_locked(env);
+#endif
         return true;
     }
 
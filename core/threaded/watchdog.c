@@ -5,19 +5,146 @@
  * @copyright (c) 2023, The University of California at Berkeley.
  * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
  * @brief Definitions for watchdogs.
+ *
+ * The watchdogs of an environment are served by a single thread, which sleeps
+ * until the earliest expiration in a heap of the running watchdogs. Starting,
+ * restarting, and stopping a watchdog update its position in the heap.
  */
 
 #include <assert.h>
 #include "watchdog.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
 
 extern int _lf_watchdog_count;
 extern watchdog_t* _lf_watchdogs;
 
+#define DARY_HEAP(token) watchdog_heap ## _ ## token
+#define E watchdog_t*
+#define P instant_t
+#define SET_POS(heap, element, position) ((element)->heap_position = (position))
+#include "impl/dary_heap.h"
+#undef DARY_HEAP
+#undef E
+#undef P
+#undef ARITY
+#undef SET_POS
+
+/**
+ * The service that runs the expiration handlers of the watchdogs of an environment.
+ * mutex: Protects the heap, the `thread_active` and `heap_position` fields of the
+ *  watchdogs, and `terminate`. It is acquired after a reactor mutex, never before.
+ * expirations_changed: Signaled when the earliest expiration changes.
+ * expirations: The running watchdogs, ordered by expiration.
+ * thread_id: The thread that runs the expiration handlers.
+ * terminate: True if the thread has to exit.
+ */
+struct watchdog_service_t {
+    lf_mutex_t mutex;
+    lf_cond_t expirations_changed;
+    watchdog_heap_t expirations;
+    lf_thread_t thread_id;
+    bool terminate;
+};
+
+/**
+ * @brief Record an expiration of a watchdog with the specified lateness.
+ */
+static void _lf_record_watchdog_lateness(lf_watchdog_stats_t* stats, interval_t lateness) {
+    if (lateness < 0) {
+        lateness = 0;
+    }
+    int bucket = 0;
+    while (bucket < LF_WATCHDOG_LATENESS_BUCKETS - 1 && lateness >= (USEC(1) << bucket)) {
+        bucket++;
+    }
+    stats->lateness_histogram[bucket]++;
+    if (stats->expirations == 0 || lateness < stats->lateness_min) {
+        stats->lateness_min = lateness;
+    }
+    if (lateness > stats->lateness_max) {
+        stats->lateness_max = lateness;
+    }
+    stats->lateness_total += lateness;
+    stats->expirations++;
+}
+
 /**
- * @brief Initialize watchdog mutexes.
+ * @brief Run the expiration handler of the specified watchdog if it has expired.
+ * The watchdog has been removed from the heap, but it may have been restarted,
+ * and thereby added again, or stopped since.
+ */
+static void _lf_expire_watchdog(watchdog_service_t* service, watchdog_t* watchdog) {
+    self_base_t* base = watchdog->base;
+    assert(base->reactor_mutex != NULL);
+    lf_mutex_lock((lf_mutex_t*)(base->reactor_mutex));
+    if (watchdog->expiration != NEVER && lf_time_physical() >= watchdog->expiration) {
+        // A restart that has already expired is handled now, and not again later.
+        // The handler may restart the watchdog.
+        lf_mutex_lock(&service->mutex);
+        if (watchdog->thread_active) {
+            watchdog_heap_remove_at(&service->expirations, watchdog->heap_position);
+            watchdog->thread_active = false;
+        }
+        lf_mutex_unlock(&service->mutex);
+        interval_t lateness = lf_time_physical() - watchdog->expiration;
+        _lf_record_watchdog_lateness(&watchdog->stats, lateness);
+        tracepoint_watchdog_expires(base, watchdog->trigger, lateness);
+        LF_PROBE2(watchdog_expire, watchdog->trigger, lateness);
+        watchdog_function_t watchdog_func = watchdog->watchdog_function;
+        (*watchdog_func)(base);
+    }
+    lf_mutex_unlock((lf_mutex_t*)(base->reactor_mutex));
+}
+
+/**
+ * @brief Thread function of the watchdog service of an environment.
+ * This function sleeps until physical time exceeds the earliest expiration time of
+ * the running watchdogs and then invokes the expiration handler of that watchdog.
+ * In normal usage, the expiration times are incremented while the thread is
+ * sleeping, so the watchdogs never expire and the handlers are never invoked.
+ * A handler is invoked with the reactor mutex of its watchdog held.
+ *
+ * @param arg A pointer to the watchdog service.
+ * @return NULL
+ */
+static void* _lf_run_watchdog_service(void* arg) {
+    watchdog_service_t* service = (watchdog_service_t*)arg;
+    lf_mutex_lock(&service->mutex);
+    while (!service->terminate) {
+        if (service->expirations.size == 0) {
+            lf_cond_wait(&service->expirations_changed);
+            continue;
+        }
+        instant_t expiration = service->expirations.entries[0].priority;
+        instant_t physical_time = lf_time_physical();
+        if (physical_time < expiration) {
+            // lf_cond_timedwait() waits until a time of the clock without the offsets
+            // that lf_time_physical() applies.
+            instant_t unadjusted_time;
+            _lf_clock_now(&unadjusted_time);
+            interval_t T = expiration - physical_time;
+            lf_cond_timedwait(&service->expirations_changed,
+                    (FOREVER - unadjusted_time > T) ? unadjusted_time + T : FOREVER);
+            continue;
+        }
+        watchdog_t* watchdog = watchdog_heap_pop(&service->expirations);
+        watchdog->thread_active = false;
+        lf_mutex_unlock(&service->mutex);
+        _lf_expire_watchdog(service, watchdog);
+        lf_mutex_lock(&service->mutex);
+    }
+    lf_mutex_unlock(&service->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Initialize watchdog mutexes and watchdog services.
  * For any reactor with one or more watchdogs, the self struct should have a non-NULL
  * `reactor_mutex` field which points to an instance of `lf_mutex_t`.
- * This function initializes those mutexes.
+ * This function initializes those mutexes and starts the watchdog service of each
+ * environment that has watchdogs.
  */
 void _lf_initialize_watchdog_mutexes() {
     for (int i = 0; i < _lf_watchdog_count; i++) {
@@ -25,59 +152,100 @@ void _lf_initialize_watchdog_mutexes() {
         if (current_base->reactor_mutex != NULL) {
             lf_mutex_init((lf_mutex_t*)(current_base->reactor_mutex));
         }
+        environment_t* env = current_base->environment;
+        if (env->watchdog_service == NULL) {
+            watchdog_service_t* service = (watchdog_service_t*)calloc(1, sizeof(watchdog_service_t));
+            if (service == NULL
+                    || !watchdog_heap_init(&service->expirations, (size_t)_lf_watchdog_count, NULL)) {
+                lf_print_error_and_exit("Out of memory.");
+            }
+            lf_mutex_init(&service->mutex);
+            lf_cond_init(&service->expirations_changed, &service->mutex);
+            env->watchdog_service = service;
+            lf_thread_create(&service->thread_id, _lf_run_watchdog_service, service);
+        }
     }
 }
 
+void _lf_terminate_watchdogs(environment_t* env) {
+    watchdog_service_t* service = env->watchdog_service;
+    if (service == NULL) {
+        return;
+    }
+    lf_mutex_lock(&service->mutex);
+    service->terminate = true;
+    lf_cond_signal(&service->expirations_changed);
+    lf_mutex_unlock(&service->mutex);
+    lf_thread_join(service->thread_id, NULL);
+
+    bool first = true;
+    for (int i = 0; i < _lf_watchdog_count; i++) {
+        watchdog_t* watchdog = &_lf_watchdogs[i];
+        if (watchdog->base->environment != env || watchdog->stats.expirations == 0) {
+            continue;
+        }
+        if (first) {
+            lf_print("---- Watchdog lateness in nanoseconds (expirations, min, avg, max):");
+            first = false;
+        }
+        lf_watchdog_stats_t* stats = &watchdog->stats;
+        lf_print("---- Watchdog %d of %p: %zu, %lld, %lld, %lld", i, (void*)watchdog->base, stats->expirations,
+                (long long)stats->lateness_min, (long long)(stats->lateness_total / (interval_t)stats->expirations),
+                (long long)stats->lateness_max);
+    }
+    watchdog_heap_destroy(&service->expirations);
+    free(service);
+    env->watchdog_service = NULL;
+}
+
 /**
- * @brief Thread function for watchdog.
- * This function sleeps until physical time exceeds the expiration time of
- * the watchdog and then invokes the watchdog expiration handler function.
- * In normal usage, the expiration time is incremented while the thread is
- * sleeping, so the watchdog never expires and the handler function is never
- * invoked.
- * This function acquires the reaction mutex and releases it while sleeping.
- * 
- * @param arg A pointer to the watchdog struct
- * @return NULL
+ * @brief Arm the specified watchdog to expire at the specified time.
+ * This assumes that the reactor mutex is held.
  */
-void* _lf_run_watchdog(void* arg) {
-    watchdog_t* watchdog = (watchdog_t*)arg;
+static void _lf_watchdog_arm(watchdog_t* watchdog, instant_t expiration) {
+    watchdog_service_t* service = watchdog->base->environment->watchdog_service;
+    assert(service != NULL);
 
-    self_base_t* base = watchdog->base;
-    assert(base->reactor_mutex != NULL);
-    lf_mutex_lock((lf_mutex_t*)(base->reactor_mutex));
-    instant_t physical_time = lf_time_physical();
-    while (physical_time < watchdog->expiration) {
-        interval_t T = watchdog->expiration - physical_time;
-        lf_mutex_unlock((lf_mutex_t*)base->reactor_mutex);
-        lf_sleep(T);
-        lf_mutex_lock((lf_mutex_t*)(base->reactor_mutex));
-        physical_time = lf_time_physical();
-    }
+    watchdog->expiration = expiration;
 
-    if (watchdog->expiration != NEVER) {
-        watchdog_function_t watchdog_func = watchdog->watchdog_function;
-        (*watchdog_func)(base);
+    lf_mutex_lock(&service->mutex);
+    if (watchdog->thread_active) {
+        watchdog_heap_remove_at(&service->expirations, watchdog->heap_position);
     }
-    watchdog->thread_active = false;
-
-    lf_mutex_unlock((lf_mutex_t*)(base->reactor_mutex));
-    return NULL;
+    if (watchdog_heap_insert(&service->expirations, watchdog, watchdog->expiration)) {
+        lf_print_error_and_exit("Out of memory.");
+    }
+    watchdog->thread_active = true;
+    // Wake up the service only if it has to wake up earlier.
+    if (watchdog->heap_position == 0) {
+        lf_cond_signal(&service->expirations_changed);
+    }
+    lf_mutex_unlock(&service->mutex);
 }
 
 void lf_watchdog_start(watchdog_t* watchdog, interval_t additional_timeout) {
     // Assumes reaction mutex is already held.
+    environment_t* env = watchdog->base->environment;
+    _lf_watchdog_arm(watchdog, env->current_tag.time + watchdog->min_expiration + additional_timeout);
+}
 
-    self_base_t* base = watchdog->base;
-
-    watchdog->expiration = base->environment->current_tag.time + watchdog->min_expiration + additional_timeout;
+void lf_watchdog_start_physical(watchdog_t* watchdog, interval_t additional_timeout) {
+    // Assumes reaction mutex is already held.
+    _lf_watchdog_arm(watchdog, lf_time_physical() + watchdog->min_expiration + additional_timeout);
+}
 
-    if (!watchdog->thread_active) {
-        lf_thread_create(&(watchdog->thread_id), _lf_run_watchdog, watchdog);
-        watchdog->thread_active = true;
-    } 
+void lf_watchdog_get_stats(watchdog_t* watchdog, lf_watchdog_stats_t* stats) {
+    *stats = watchdog->stats;
 }
 
 void lf_watchdog_stop(watchdog_t* watchdog) {
     watchdog->expiration = NEVER;
+
+    watchdog_service_t* service = watchdog->base->environment->watchdog_service;
+    lf_mutex_lock(&service->mutex);
+    if (watchdog->thread_active) {
+        watchdog_heap_remove_at(&service->expirations, watchdog->heap_position);
+        watchdog->thread_active = false;
+    }
+    lf_mutex_unlock(&service->mutex);
 }
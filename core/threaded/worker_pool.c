@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Definitions for the pool of workers shared by enclaves.
+ *
+ * The permits of an environment up to its minimum are reserved for it, so only
+ * those beyond its minimum count against the shared permits. An environment
+ * executing n reactions thus uses max(0, n - minimum) shared permits.
+ */
+
+#include "worker_pool.h"
+#include "platform.h"
+#include "util.h"
+
+/** Whether the environments share a pool. */
+static bool _lf_worker_pool_enabled = false;
+
+/** Mutex that protects the counts of the pool and of the environments. */
+static lf_mutex_t _lf_worker_pool_mutex;
+
+/** Condition variable signaled when a shared permit is returned. */
+static lf_cond_t _lf_worker_pool_released;
+
+/** The number of shared permits not in use. */
+static int _lf_worker_pool_available = 0;
+
+/** The number of workers waiting for a shared permit. */
+static int _lf_worker_pool_waiting = 0;
+
+static environment_t* _lf_worker_pool_envs = NULL;
+static int _lf_worker_pool_num_envs = 0;
+
+void _lf_worker_pool_init(environment_t* envs, int num_envs, int size) {
+    int reserved = 0;
+    bool shared = false;
+    for (int i = 0; i < num_envs; i++) {
+        reserved += envs[i].min_workers;
+        envs[i].workers_executing = 0;
+        envs[i].workers_waiting = 0;
+        if (envs[i].min_workers < envs[i].num_workers) shared = true;
+    }
+    if (!shared) return;
+
+    _lf_worker_pool_available = size - reserved;
+    if (_lf_worker_pool_available < 1) {
+        // Environments that exceed their minimum need at least one shared permit.
+        lf_print_warning("The minimum numbers of workers of the enclaves add up to %d, "
+                "which leaves none of the %d workers to share.", reserved, size);
+        _lf_worker_pool_available = 1;
+    }
+    if (lf_mutex_init(&_lf_worker_pool_mutex) != 0
+            || lf_cond_init(&_lf_worker_pool_released, &_lf_worker_pool_mutex) != 0) {
+        lf_print_error_and_exit("Could not initialize the worker pool.");
+    }
+    _lf_worker_pool_envs = envs;
+    _lf_worker_pool_num_envs = num_envs;
+    _lf_worker_pool_enabled = true;
+    LF_PRINT_LOG("Enclaves share %d workers beyond %d reserved ones.", _lf_worker_pool_available, reserved);
+}
+
+/**
+ * Return whether an environment with a higher priority than the specified one
+ * is waiting for a shared permit. This assumes that the caller holds the mutex
+ * of the pool.
+ */
+static bool _lf_worker_pool_preempted(environment_t* env) {
+    for (int i = 0; i < _lf_worker_pool_num_envs; i++) {
+        environment_t* other = &_lf_worker_pool_envs[i];
+        if (other->workers_waiting > 0 && other->worker_priority > env->worker_priority) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void _lf_worker_pool_acquire(environment_t* env) {
+    if (!_lf_worker_pool_enabled) return;
+    lf_mutex_lock(&_lf_worker_pool_mutex);
+    if (env->workers_executing >= env->min_workers) {
+        env->workers_waiting++;
+        _lf_worker_pool_waiting++;
+        while (env->workers_executing >= env->min_workers
+                && (_lf_worker_pool_available == 0 || _lf_worker_pool_preempted(env))) {
+            lf_cond_wait(&_lf_worker_pool_released);
+        }
+        env->workers_waiting--;
+        _lf_worker_pool_waiting--;
+        if (env->workers_executing >= env->min_workers) {
+            _lf_worker_pool_available--;
+        }
+    }
+    env->workers_executing++;
+    lf_mutex_unlock(&_lf_worker_pool_mutex);
+}
+
+void _lf_worker_pool_release(environment_t* env) {
+    if (!_lf_worker_pool_enabled) return;
+    lf_mutex_lock(&_lf_worker_pool_mutex);
+    env->workers_executing--;
+    if (env->workers_executing >= env->min_workers) {
+        _lf_worker_pool_available++;
+    }
+    if (_lf_worker_pool_waiting > 0) {
+        // Waiters of every priority have to reconsider.
+        lf_cond_broadcast(&_lf_worker_pool_released);
+    }
+    lf_mutex_unlock(&_lf_worker_pool_mutex);
+}
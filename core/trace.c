@@ -45,14 +45,75 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif // RTI_TRACE
 
 #include "reactor_common.h"
+#include "trace_sink.h"
 #include "util.h"
 
+#if defined(LF_SINGLE_THREADED)
+// Platforms only define memory barriers for the threaded runtime, and the
+// single-threaded runtime registers and records trace objects on one thread.
+#define lf_memory_barrier()
+#endif
+
+#ifdef LF_TRACE_COMPACT
+#include <stdint.h>
+
+// Map from pointers in the object table to their indices.
+#define HASHMAP(token) trace_object_ids ## _ ## token
+#define K void*
+#define V int
+#define HASH_OF(key) (size_t) key
+#include "impl/hashmap.h"
+#undef HASHMAP
+#undef K
+#undef V
+#undef HASH_OF
+#endif // LF_TRACE_COMPACT
+
+#ifdef LF_TRACE_TSC
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Return the count of the processor's cycle counter, which is the
+ * invariant TSC on x86 and the virtual counter on 64-bit ARM.
+ */
+static inline instant_t trace_cycle_count(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (instant_t)__rdtsc();
+#elif defined(__aarch64__)
+    uint64_t count;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(count));
+    return (instant_t)count;
+#else
+#error "LF_TRACE_TSC is only supported on x86 and 64-bit ARM processors."
+#endif
+}
+
+/**
+ * @brief Sample the cycle counter and physical time together. The count is
+ * the average of the counts read just before and after physical time.
+ */
+static void sample_trace_clocks(instant_t* cycles, instant_t* time) {
+    instant_t before = trace_cycle_count();
+    *time = lf_time_physical();
+    instant_t after = trace_cycle_count();
+    *cycles = before + (after - before) / 2;
+}
+
+/** Time stamp of a trace record. */
+#define TRACE_TIMESTAMP() trace_cycle_count()
+#else
+#define TRACE_TIMESTAMP() lf_time_physical()
+#endif // LF_TRACE_TSC
+
 /** Macro to use when access to trace file fails. */
 #define _LF_TRACE_FAILURE(trace) \
     do { \
         fprintf(stderr, "WARNING: Access to trace file failed.\n"); \
-        fclose(trace->_lf_trace_file); \
-        trace->_lf_trace_file = NULL; \
+        trace_sink_close(trace->_lf_trace_sink); \
+        trace->_lf_trace_sink = NULL; \
         lf_critical_section_exit(trace->env); \
         return -1; \
     } while(0)
@@ -64,6 +125,7 @@ trace_t* trace_new(environment_t* env, const char * filename) {
 
     trace->_lf_trace_stop=1;
     trace->env = env;
+    trace->_lf_trace_categories = trace_category_all;
 
     // Determine length of the filename
     size_t len = strlen(filename)  + 1;
@@ -78,24 +140,338 @@ trace_t* trace_new(environment_t* env, const char * filename) {
     return trace;
 }
 
+/**
+ * @brief An object in the index of the object table.
+ */
+typedef struct trace_object_slot_t {
+    void* pointer;
+    void* trigger;
+    int index;      // One plus the index of the object in the table, or 0 if the slot is empty.
+    bool selected;  // Whether the object matches a name given to trace_filter_reactor().
+} trace_object_slot_t;
+
+/**
+ * @brief Index of the object table by pointer and trigger, a hash table with open
+ * addressing whose capacity is a power of two at least twice the number of objects.
+ * Tracepoints look up objects without entering the critical section, so an index
+ * replaced by a larger one is kept until the trace is freed.
+ */
+typedef struct trace_object_index_t {
+    size_t capacity;
+    struct trace_object_index_t* replaced;
+    trace_object_slot_t slots[];
+} trace_object_index_t;
+
+static size_t trace_object_hash(void* pointer, void* trigger) {
+    uint64_t hash = (uint64_t)(uintptr_t)pointer * 0x9E3779B97F4A7C15ULL;
+    hash ^= (uint64_t)(uintptr_t)trigger * 0xC2B2AE3D27D4EB4FULL;
+    return (size_t)(hash ^ (hash >> 29));
+}
+
+/**
+ * @brief Return the slot of the object with the given pointers in the given index,
+ * or the empty slot where it would go.
+ */
+static trace_object_slot_t* find_trace_object_slot(trace_object_index_t* index, void* pointer, void* trigger) {
+    size_t mask = index->capacity - 1;
+    for (size_t i = trace_object_hash(pointer, trigger) & mask; ; i = (i + 1) & mask) {
+        trace_object_slot_t* slot = &index->slots[i];
+        if (slot->index == 0 || (slot->pointer == pointer && slot->trigger == trigger)) return slot;
+    }
+}
+
+/**
+ * @brief Replace the index of the object table by one with the given capacity.
+ * This assumes the caller has entered a critical section.
+ */
+static void grow_trace_object_index(trace_t* trace, size_t capacity) {
+    trace_object_index_t* index = (trace_object_index_t*)calloc(1,
+            sizeof(trace_object_index_t) + capacity * sizeof(trace_object_slot_t));
+    lf_assert(index, "Out of memory");
+    index->capacity = capacity;
+    trace_object_index_t* old = trace->_lf_trace_object_index;
+    if (old != NULL) {
+        for (size_t i = 0; i < old->capacity; i++) {
+            if (old->slots[i].index != 0) {
+                *find_trace_object_slot(index, old->slots[i].pointer, old->slots[i].trigger) = old->slots[i];
+            }
+        }
+    }
+    index->replaced = old;
+    // Tracepoints must not see the new index before its slots.
+    lf_memory_barrier();
+    trace->_lf_trace_object_index = index;
+}
+
 void trace_free(trace_t *trace) {
+    // Release the buffers allocated by start_trace(). Each buffer of a thread
+    // is in exactly one of the slots.
+    if (trace->_lf_trace_buffer != NULL) {
+        for (int i = 0; i < trace->_lf_number_of_trace_buffers; i++) {
+            free(trace->_lf_trace_buffer[i]);
+        }
+        free(trace->_lf_trace_buffer);
+        free(trace->_lf_trace_buffer_size);
+#if !defined(LF_SINGLE_THREADED)
+        // Empty slots of the spare stacks and pending rings are NULL.
+        for (int i = 0; i < trace->_lf_number_of_trace_buffers * TRACE_SPARE_BUFFERS; i++) {
+            free(trace->_lf_trace_spare_buffer[i]);
+            free(trace->_lf_trace_pending_buffer[i]);
+        }
+        free(trace->_lf_trace_spare_buffer);
+        free(trace->_lf_trace_spare_count);
+        free(trace->_lf_trace_pending_buffer);
+        free(trace->_lf_trace_pending_size);
+        free(trace->_lf_trace_pending_head);
+        free(trace->_lf_trace_pending_count);
+#endif
+    }
+    for (int i = 0; i < trace->_lf_trace_filter_names_size; i++) {
+        free(trace->_lf_trace_filter_names[i]);
+    }
+    free(trace->_lf_trace_filter_names);
+    free(trace->_lf_trace_object_descriptions);
+    while (trace->_lf_trace_object_index != NULL) {
+        trace_object_index_t* replaced = trace->_lf_trace_object_index->replaced;
+        free(trace->_lf_trace_object_index);
+        trace->_lf_trace_object_index = replaced;
+    }
     free(trace->filename);
     free(trace);
 }
 
+void trace_set_destination(trace_t* trace, const char* destination) {
+    // Environments other than the first get their own file or shared memory object.
+    // Socket destinations are shared, with one connection or stream per environment.
+    int id = (trace->env != NULL) ? trace->env->id : 0;
+    bool shared = strncmp(destination, "tcp://", 6) == 0 || strncmp(destination, "udp://", 6) == 0;
+    size_t length = strlen(destination) + 16;
+    char* filename = (char*)malloc(length);
+    lf_assert(filename, "Out of memory");
+    if (id > 0 && !shared) {
+        snprintf(filename, length, "%s_%d", destination, id);
+    } else {
+        snprintf(filename, length, "%s", destination);
+    }
+    free(trace->filename);
+    trace->filename = filename;
+}
+
+size_t trace_buffer_bytes(trace_t* trace) {
+    if (trace == NULL || trace->_lf_trace_buffer == NULL) return 0;
+    size_t per_buffer = TRACE_BUFFER_CAPACITY * sizeof(trace_record_t) + sizeof(trace_record_t*) + sizeof(int);
+#if !defined(LF_SINGLE_THREADED)
+    // Each thread also has spare buffers, each with a slot in the spare stack
+    // and one in the pending ring, and the counters of both.
+    per_buffer += TRACE_SPARE_BUFFERS * (per_buffer + sizeof(trace_record_t*)) + 3 * sizeof(int);
+#endif
+    size_t bytes = (size_t)trace->_lf_number_of_trace_buffers * per_buffer;
+#ifdef LF_TRACE_COMPACT
+    bytes += TRACE_BUFFER_CAPACITY * TRACE_COMPACT_RECORD_MAX_SIZE;
+#endif
+    return bytes;
+}
+
+
+/** Values of the entries of _lf_trace_filter in trace_t. */
+enum {
+    trace_filter_record = 0,
+    trace_filter_drop,
+    trace_filter_by_object
+};
+
+/** Return the trace_category_t of the given event type. */
+static int trace_category_of(trace_event_t event_type) {
+    switch (event_type) {
+        case reaction_starts:
+        case reaction_ends:
+        case reaction_deadline_missed:
+        case watchdog_expires:
+            return trace_category_reactions;
+        case worker_wait_starts:
+        case worker_wait_ends:
+        case worker_spin_starts:
+        case worker_spin_ends:
+        case gil_wait_starts:
+        case gil_wait_ends:
+        case python_call_starts:
+        case python_call_ends:
+            return trace_category_workers;
+        case schedule_called:
+        case scheduler_advancing_time_starts:
+        case scheduler_advancing_time_ends:
+        case scheduler_wakeup:
+        case scheduler_criticality_change:
+            return trace_category_scheduling;
+        case user_event:
+        case user_value:
+            return trace_category_user;
+        default:
+            return trace_category_federated;
+    }
+}
+
+/**
+ * @brief Recompute the filter of each event type from the enabled categories
+ * and the names given to trace_filter_reactor().
+ */
+static void update_trace_filter(trace_t* trace) {
+    for (int i = 0; i < NUM_EVENT_TYPES; i++) {
+        int category = trace_category_of((trace_event_t)i);
+        if (!(trace->_lf_trace_categories & category)) {
+            trace->_lf_trace_filter[i] = trace_filter_drop;
+        } else if (trace->_lf_trace_filter_names_size > 0 && (i == schedule_called
+                || category == trace_category_reactions || category == trace_category_user)) {
+            // The pointer of these events identifies an object in the object table.
+            trace->_lf_trace_filter[i] = trace_filter_by_object;
+        } else {
+            trace->_lf_trace_filter[i] = trace_filter_record;
+        }
+    }
+}
+
+/**
+ * @brief Return whether the given description matches the given name, which is
+ * the case if they are equal or, for a reactor, if the description names a
+ * reactor contained in the named one.
+ */
+static bool trace_name_matches(const char* name, object_description_t* object) {
+    size_t length = strlen(name);
+    if (strncmp(object->description, name, length) != 0) return false;
+    return object->description[length] == '\0'
+            || (object->type == trace_reactor && object->description[length] == '.');
+}
+
+/**
+ * @brief Select the given object if its description matches one of the names
+ * given to trace_filter_reactor().
+ * This assumes the caller has entered a critical section.
+ */
+static void select_trace_object(trace_t* trace, object_description_t* object) {
+    if (object->type == trace_trigger || object->description == NULL) return;
+    for (int i = 0; i < trace->_lf_trace_filter_names_size; i++) {
+        if (trace_name_matches(trace->_lf_trace_filter_names[i], object)) {
+            find_trace_object_slot(trace->_lf_trace_object_index, object->pointer, object->trigger)->selected = true;
+            return;
+        }
+    }
+}
+
+/** Return whether an event with the given pointer passes a filter by object. */
+static bool trace_object_selected(trace_t* trace, void* pointer) {
+    trace_object_index_t* index = trace->_lf_trace_object_index;
+    if (index == NULL) return false;
+    trace_object_slot_t* slot = find_trace_object_slot(index, pointer, NULL);
+    return slot->index != 0 && slot->selected;
+}
+
+void trace_set_categories(trace_t* trace, int categories) {
+    trace->_lf_trace_categories = categories;
+    update_trace_filter(trace);
+}
+
+/**
+ * @brief Add the given number of characters of the given name to the names
+ * given to trace_filter_reactor() and select the objects that match it.
+ */
+static void add_trace_filter_name(trace_t* trace, const char* name, size_t length) {
+    lf_critical_section_enter(trace->env);
+    char** names = (char**)realloc(trace->_lf_trace_filter_names,
+            sizeof(char*) * (trace->_lf_trace_filter_names_size + 1));
+    lf_assert(names, "Out of memory");
+    char* copy = (char*)malloc(length + 1);
+    lf_assert(copy, "Out of memory");
+    strncpy(copy, name, length);
+    copy[length] = '\0';
+    names[trace->_lf_trace_filter_names_size++] = copy;
+    trace->_lf_trace_filter_names = names;
+    // Match the objects that are already registered.
+    for (int i = 0; i < trace->_lf_trace_object_descriptions_size; i++) {
+        select_trace_object(trace, &trace->_lf_trace_object_descriptions[i]);
+    }
+    update_trace_filter(trace);
+    lf_critical_section_exit(trace->env);
+}
+
+void trace_filter_reactor(trace_t* trace, const char* name) {
+    add_trace_filter_name(trace, name, strlen(name));
+}
+
+int trace_set_filters(trace_t* trace, const char* categories, const char* reactors) {
+    if (categories != NULL) {
+        static const struct { const char* name; int category; } category_names[] = {
+            {"reactions", trace_category_reactions},
+            {"workers", trace_category_workers},
+            {"scheduling", trace_category_scheduling},
+            {"user", trace_category_user},
+            {"federated", trace_category_federated},
+            {"all", trace_category_all}
+        };
+        int mask = 0;
+        const char* start = categories;
+        while (true) {
+            const char* end = strchr(start, ',');
+            size_t length = (end != NULL) ? (size_t)(end - start) : strlen(start);
+            size_t i = 0;
+            while (i < sizeof(category_names) / sizeof(category_names[0])
+                    && !(strlen(category_names[i].name) == length
+                            && strncmp(category_names[i].name, start, length) == 0)) {
+                i++;
+            }
+            if (i == sizeof(category_names) / sizeof(category_names[0])) return -1;
+            mask |= category_names[i].category;
+            if (end == NULL) break;
+            start = end + 1;
+        }
+        trace_set_categories(trace, mask);
+    }
+    if (reactors != NULL) {
+        const char* start = reactors;
+        while (true) {
+            const char* end = strchr(start, ',');
+            size_t length = (end != NULL) ? (size_t)(end - start) : strlen(start);
+            if (length > 0) add_trace_filter_name(trace, start, length);
+            if (end == NULL) break;
+            start = end + 1;
+        }
+    }
+    return 0;
+}
 
 int _lf_register_trace_event(trace_t* trace, void* pointer1, void* pointer2, _lf_trace_object_t type, char* description) {
     lf_critical_section_enter(trace->env);
-    if (trace->_lf_trace_object_descriptions_size >= TRACE_OBJECT_TABLE_SIZE) {
+    int size = trace->_lf_trace_object_descriptions_size;
+    if (trace->_lf_trace_object_index == NULL
+            || 2 * (size_t)(size + 1) > trace->_lf_trace_object_index->capacity) {
+        grow_trace_object_index(trace, (trace->_lf_trace_object_index == NULL)
+                ? 2 * TRACE_OBJECT_TABLE_SIZE : 2 * trace->_lf_trace_object_index->capacity);
+    }
+    trace_object_slot_t* slot = find_trace_object_slot(trace->_lf_trace_object_index, pointer1, pointer2);
+    if (slot->index != 0) {
+        // Already registered.
         lf_critical_section_exit(trace->env);
-        fprintf(stderr, "WARNING: Exceeded trace object table size. Trace file will be incomplete.\n");
-        return 0;
+        return 1;
     }
-    trace->_lf_trace_object_descriptions[trace->_lf_trace_object_descriptions_size].pointer = pointer1;
-    trace->_lf_trace_object_descriptions[trace->_lf_trace_object_descriptions_size].trigger = pointer2;
-    trace->_lf_trace_object_descriptions[trace->_lf_trace_object_descriptions_size].type = type;
-    trace->_lf_trace_object_descriptions[trace->_lf_trace_object_descriptions_size].description = description;
+    if (size == trace->_lf_trace_object_descriptions_capacity) {
+        int capacity = (size == 0) ? TRACE_OBJECT_TABLE_SIZE : 2 * size;
+        object_description_t* descriptions = (object_description_t*)realloc(
+                trace->_lf_trace_object_descriptions, capacity * sizeof(object_description_t));
+        lf_assert(descriptions, "Out of memory");
+        trace->_lf_trace_object_descriptions = descriptions;
+        trace->_lf_trace_object_descriptions_capacity = capacity;
+    }
+    object_description_t* object = &trace->_lf_trace_object_descriptions[size];
+    object->pointer = pointer1;
+    object->trigger = pointer2;
+    object->type = type;
+    object->description = description;
     trace->_lf_trace_object_descriptions_size++;
+    slot->pointer = pointer1;
+    slot->trigger = pointer2;
+    // Tracepoints must not see the slot in use before its pointers.
+    lf_memory_barrier();
+    slot->index = size + 1;
+    select_trace_object(trace, object);
     lf_critical_section_exit(trace->env);
     return 1;
 }
@@ -113,75 +489,183 @@ int register_user_trace_event(void *self, char* description) {
  * @return The number of items written to the object table or -1 for failure.
  */
 int write_trace_header(trace_t* trace) {
-    if (trace->_lf_trace_file != NULL) {
+    if (trace->_lf_trace_sink != NULL) {
+#ifdef LF_TRACE_COMPACT
+        // Identify the format for readers.
+        instant_t marker = TRACE_COMPACT_FORMAT_MARKER;
+        if (trace_sink_write(trace->_lf_trace_sink, &marker, sizeof(instant_t)) != 0) _LF_TRACE_FAILURE(trace);
+#endif
+#ifdef LF_TRACE_TSC
+        instant_t cycles_marker = TRACE_CYCLES_FORMAT_MARKER;
+        if (trace_sink_write(trace->_lf_trace_sink, &cycles_marker, sizeof(instant_t)) != 0) _LF_TRACE_FAILURE(trace);
+#endif
         // The first item in the header is the start time.
         // This is both the starting physical time and the starting logical time.
         instant_t start_time = lf_time_start();
         // printf("DEBUG: Start time written to trace file is %lld.\n", start_time);
-        size_t items_written = fwrite(
-                &start_time,
-                sizeof(instant_t),
-                1,
-                trace->_lf_trace_file
-        );
-        if (items_written != 1) _LF_TRACE_FAILURE(trace);
+        if (trace_sink_write(trace->_lf_trace_sink, &start_time, sizeof(instant_t)) != 0) {
+            _LF_TRACE_FAILURE(trace);
+        }
 
         // The next item in the header is the size of the
         // _lf_trace_object_descriptions table.
         // printf("DEBUG: Table size written to trace file is %d.\n", _lf_trace_object_descriptions_size);
-        items_written = fwrite(
-                &trace->_lf_trace_object_descriptions_size,
-                sizeof(int),
-                1,
-                trace->_lf_trace_file
-        );
-        if (items_written != 1) _LF_TRACE_FAILURE(trace);
+        if (trace_sink_write(trace->_lf_trace_sink,
+                &trace->_lf_trace_object_descriptions_size, sizeof(int)) != 0) {
+            _LF_TRACE_FAILURE(trace);
+        }
 
         // Next we write the table.
         for (int i = 0; i < trace->_lf_trace_object_descriptions_size; i++) {
-            // printf("DEBUG: Object pointer: %p.\n", _lf_trace_object_descriptions[i].pointer);
+            object_description_t* description = &trace->_lf_trace_object_descriptions[i];
+            // printf("DEBUG: Object pointer: %p.\n", description->pointer);
             // Write the pointer to the self struct.
-            items_written = fwrite(
-                        &trace->_lf_trace_object_descriptions[i].pointer,
-                        sizeof(void*),
-                        1,
-                        trace->_lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(trace);
+            if (trace_sink_write(trace->_lf_trace_sink, &description->pointer, sizeof(void*)) != 0) {
+                _LF_TRACE_FAILURE(trace);
+            }
 
             // Write the pointer to the trigger_t struct.
-            items_written = fwrite(
-                        &trace->_lf_trace_object_descriptions[i].trigger,
-                        sizeof(trigger_t*),
-                        1,
-                        trace->_lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(trace);
+            if (trace_sink_write(trace->_lf_trace_sink, &description->trigger, sizeof(trigger_t*)) != 0) {
+                _LF_TRACE_FAILURE(trace);
+            }
 
             // Write the object type.
-            items_written = fwrite(
-                        &trace->_lf_trace_object_descriptions[i].type, // Write the pointer value.
-                        sizeof(_lf_trace_object_t),
-                        1,
-                        trace->_lf_trace_file
-            );
-            if (items_written != 1) _LF_TRACE_FAILURE(trace);
-
-            // Write the description.
-            int description_size = strlen(trace->_lf_trace_object_descriptions[i].description);
-            // printf("DEBUG: Object description: %s.\n", trace->_lf_trace_object_descriptions[i].description);
-            items_written = fwrite(
-                        trace->_lf_trace_object_descriptions[i].description,
-                        sizeof(char),
-                        description_size + 1, // Include null terminator.
-                        trace->_lf_trace_file
-            );
-            if (items_written != description_size + 1) _LF_TRACE_FAILURE(trace);
+            if (trace_sink_write(trace->_lf_trace_sink, &description->type, sizeof(_lf_trace_object_t)) != 0) {
+                _LF_TRACE_FAILURE(trace);
+            }
+
+            // Write the description, including the null terminator.
+            // printf("DEBUG: Object description: %s.\n", description->description);
+            if (trace_sink_write(trace->_lf_trace_sink, description->description,
+                    strlen(description->description) + 1) != 0) {
+                _LF_TRACE_FAILURE(trace);
+            }
         }
     }
     return trace->_lf_trace_object_descriptions_size;
 }
 
+#ifdef LF_TRACE_COMPACT
+static unsigned char* put_unsigned(unsigned char* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+static unsigned char* put_signed(unsigned char* out, int64_t value) {
+    return put_unsigned(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+/**
+ * @brief Write the identifier of the given non-NULL pointer, which is one plus its index
+ * in the object table, or zero followed by the pointer if it is not in the table.
+ */
+static unsigned char* put_object(unsigned char* out, trace_object_ids_t* ids, void* pointer) {
+    int* index = trace_object_ids_find(ids, pointer);
+    if (index != NULL) return put_unsigned(out, (uint64_t)*index + 1);
+    out = put_unsigned(out, 0);
+    return put_unsigned(out, (uintptr_t)pointer);
+}
+
+/**
+ * @brief Build the maps from pointers and triggers to their indices in the object
+ * table, which does not change once the header is written. If an object appears more
+ * than once, the first entry is used, as in the readers.
+ */
+static void build_trace_object_ids(trace_t* trace) {
+    size_t capacity = (size_t)trace->_lf_trace_object_descriptions_size;
+    trace->_lf_trace_pointer_ids = trace_object_ids_new(capacity, NULL);
+    trace->_lf_trace_trigger_ids = trace_object_ids_new(capacity, NULL);
+    for (int i = 0; i < trace->_lf_trace_object_descriptions_size; i++) {
+        object_description_t* description = &trace->_lf_trace_object_descriptions[i];
+        if (description->pointer != NULL
+                && trace_object_ids_find(trace->_lf_trace_pointer_ids, description->pointer) == NULL) {
+            trace_object_ids_put(trace->_lf_trace_pointer_ids, description->pointer, i);
+        }
+        if (description->trigger != NULL && description->type == trace_trigger
+                && trace_object_ids_find(trace->_lf_trace_trigger_ids, description->trigger) == NULL) {
+            trace_object_ids_put(trace->_lf_trace_trigger_ids, description->trigger, i);
+        }
+    }
+}
+
+/**
+ * @brief Encode the given records into the encoding buffer of the trace in the
+ * compact format described in trace.h.
+ * @return The number of bytes written.
+ */
+static size_t encode_trace_records(trace_t* trace, trace_record_t* buffer, int size) {
+    unsigned char* out = trace->_lf_trace_encoded;
+    instant_t logical_time = lf_time_start();
+    instant_t physical_time = logical_time;
+    for (int i = 0; i < size; i++) {
+        trace_record_t* record = &buffer[i];
+        unsigned char fields = 0;
+        if (record->pointer != NULL) fields |= trace_compact_pointer;
+        if (record->src_id != -1) fields |= trace_compact_src_id;
+        if (record->dst_id != -1) fields |= trace_compact_dst_id;
+        if (record->microstep != 0) fields |= trace_compact_microstep;
+        if (record->trigger != NULL) fields |= trace_compact_trigger;
+        if (record->extra_delay != 0) fields |= trace_compact_extra_delay;
+        *out++ = (unsigned char)record->event_type;
+        *out++ = fields;
+        // Differences are computed without overflow on garbage times.
+        out = put_signed(out, (int64_t)((uint64_t)record->logical_time - (uint64_t)logical_time));
+        out = put_signed(out, (int64_t)((uint64_t)record->physical_time - (uint64_t)physical_time));
+        logical_time = record->logical_time;
+        physical_time = record->physical_time;
+        if (fields & trace_compact_pointer) out = put_object(out, trace->_lf_trace_pointer_ids, record->pointer);
+        if (fields & trace_compact_src_id) out = put_signed(out, record->src_id);
+        if (fields & trace_compact_dst_id) out = put_signed(out, record->dst_id);
+        if (fields & trace_compact_microstep) out = put_unsigned(out, record->microstep);
+        if (fields & trace_compact_trigger) out = put_object(out, trace->_lf_trace_trigger_ids, record->trigger);
+        if (fields & trace_compact_extra_delay) out = put_signed(out, record->extra_delay);
+    }
+    return (size_t)(out - trace->_lf_trace_encoded);
+}
+#endif // LF_TRACE_COMPACT
+
+/**
+ * @brief Write the given records to the file, preceded by the trace header
+ * if it has not been written yet.
+ * This assumes the caller has entered a critical section.
+ * @param buffer The records to write.
+ * @param size The number of records.
+ */
+static void write_trace_records(trace_t* trace, trace_record_t* buffer, int size) {
+    // If the trace header has not been written, write it now.
+    // This is deferred to here so that user trace objects can be
+    // registered in startup reactions.
+    if (!trace->_lf_trace_header_written) {
+        write_trace_header(trace);
+        trace->_lf_trace_header_written = true;
+        if (trace->_lf_trace_sink == NULL) return;
+#ifdef LF_TRACE_COMPACT
+        build_trace_object_ids(trace);
+#endif
+    }
+
+#ifdef LF_TRACE_COMPACT
+    // Write the number of records and bytes followed by the encoded records.
+    int header[2] = {size, (int)encode_trace_records(trace, buffer, size)};
+    bool failed = trace_sink_write(trace->_lf_trace_sink, header, sizeof(header)) != 0
+            || trace_sink_write(trace->_lf_trace_sink, trace->_lf_trace_encoded, header[1]) != 0;
+#else
+    // Write first the length of the array and then the contents.
+    bool failed = trace_sink_write(trace->_lf_trace_sink, &size, sizeof(int)) != 0
+            || trace_sink_write(trace->_lf_trace_sink, buffer, sizeof(trace_record_t) * size) != 0;
+#endif // LF_TRACE_COMPACT
+    // This ends a unit of the stream, which the sink can now deliver.
+    if (failed || trace_sink_flush(trace->_lf_trace_sink) != 0) {
+        fprintf(stderr, "WARNING: Access to trace file failed.\n");
+        trace_sink_close(trace->_lf_trace_sink);
+        trace->_lf_trace_sink = NULL;
+    }
+}
+
 /**
  * @brief Flush the specified buffer to a file.
  * This assumes the caller has entered a critical section.
@@ -189,42 +673,10 @@ int write_trace_header(trace_t* trace) {
  */
 void flush_trace_locked(trace_t* trace, int worker) {
     if (trace->_lf_trace_stop == 0 
-        && trace->_lf_trace_file != NULL 
+        && trace->_lf_trace_sink != NULL 
         && trace->_lf_trace_buffer_size[worker] > 0
     ) {
-        // If the trace header has not been written, write it now.
-        // This is deferred to here so that user trace objects can be
-        // registered in startup reactions.
-        if (!trace->_lf_trace_header_written) {
-            write_trace_header(trace);
-            trace->_lf_trace_header_written = true;
-        }
-
-        // Write first the length of the array.
-        size_t items_written = fwrite(
-                &trace->_lf_trace_buffer_size[worker],
-                sizeof(int),
-                1,
-                trace->_lf_trace_file
-        );
-        if (items_written != 1) {
-            fprintf(stderr, "WARNING: Access to trace file failed.\n");
-            fclose(trace->_lf_trace_file);
-            trace->_lf_trace_file = NULL;
-        } else {
-            // Write the contents.
-            items_written = fwrite(
-                    trace->_lf_trace_buffer[worker],
-                    sizeof(trace_record_t),
-                    trace->_lf_trace_buffer_size[worker],
-                    trace->_lf_trace_file
-            );
-            if (items_written != trace->_lf_trace_buffer_size[worker]) {
-                fprintf(stderr, "WARNING: Access to trace file failed.\n");
-                fclose(trace->_lf_trace_file);
-                trace->_lf_trace_file = NULL;
-            }
-        }
+        write_trace_records(trace, trace->_lf_trace_buffer[worker], trace->_lf_trace_buffer_size[worker]);
         trace->_lf_trace_buffer_size[worker] = 0;
     }
 }
@@ -241,13 +693,174 @@ void flush_trace(trace_t* trace, int worker) {
     lf_critical_section_exit(GLOBAL_ENVIRONMENT);
 }
 
-void start_trace(trace_t* trace) {
-    // FIXME: location of trace file should be customizable.
-    trace->_lf_trace_file = fopen(trace->filename, "w");
-    if (trace->_lf_trace_file == NULL) {
-        fprintf(stderr, "WARNING: Failed to open log file with error code %d."
-                "No log will be written.\n", errno);
+#if !defined(LF_SINGLE_THREADED)
+/**
+ * @brief Lock the sink, first entering the critical section if the trace
+ * header may still have to be written, to be consistent with the object table.
+ * @return Whether the critical section was entered.
+ */
+static bool lock_trace_sink(trace_t* trace) {
+    bool header_written = trace->_lf_trace_header_written;
+    if (!header_written) lf_critical_section_enter(trace->env);
+    lf_mutex_lock(&trace->_lf_trace_sink_mutex);
+    return !header_written;
+}
+
+/** @brief Unlock the sink locked by lock_trace_sink(). */
+static void unlock_trace_sink(trace_t* trace, bool entered) {
+    lf_mutex_unlock(&trace->_lf_trace_sink_mutex);
+    if (entered) lf_critical_section_exit(trace->env);
+}
+
+/**
+ * @brief Return the first thread at or after 'start', wrapping around, that
+ * has a pending buffer, or -1 if there is none.
+ * This assumes the caller holds the trace mutex.
+ */
+static int next_pending_trace_buffer(trace_t* trace, int start) {
+    for (int i = 0; i < trace->_lf_number_of_trace_buffers; i++) {
+        int index = (start + i) % trace->_lf_number_of_trace_buffers;
+        if (trace->_lf_trace_pending_count[index] > 0) return index;
+    }
+    return -1;
+}
+
+/**
+ * @brief Remove and return the oldest pending buffer of the given thread.
+ * This assumes the caller holds the trace mutex.
+ * @param size Where to store the number of records in the buffer.
+ */
+static trace_record_t* pop_pending_trace_buffer(trace_t* trace, int index, int* size) {
+    int slot = index * TRACE_SPARE_BUFFERS + trace->_lf_trace_pending_head[index];
+    trace_record_t* buffer = trace->_lf_trace_pending_buffer[slot];
+    *size = trace->_lf_trace_pending_size[slot];
+    trace->_lf_trace_pending_buffer[slot] = NULL;
+    trace->_lf_trace_pending_head[index] = (trace->_lf_trace_pending_head[index] + 1) % TRACE_SPARE_BUFFERS;
+    trace->_lf_trace_pending_count[index]--;
+    return buffer;
+}
+
+/**
+ * @brief Return a written buffer to the spares of the given thread.
+ * This assumes the caller holds the trace mutex.
+ */
+static void push_spare_trace_buffer(trace_t* trace, int index, trace_record_t* buffer) {
+    trace->_lf_trace_spare_buffer[index * TRACE_SPARE_BUFFERS + trace->_lf_trace_spare_count[index]++] = buffer;
+}
+
+/**
+ * @brief Write the buffers handed off by traced threads to the file until
+ * the writer is stopped and no buffer is pending.
+ * @param arg The trace object.
+ */
+static void* trace_writer(void* arg) {
+    trace_t* trace = (trace_t*)arg;
+    int next = 0;
+    lf_mutex_lock(&trace->_lf_trace_mutex);
+    while (true) {
+        if (next_pending_trace_buffer(trace, next) < 0) {
+            if (!trace->_lf_trace_writer_running) break;
+            lf_cond_wait(&trace->_lf_trace_pending_changed);
+            continue;
+        }
+        lf_mutex_unlock(&trace->_lf_trace_mutex);
+
+        // Pick the buffer only once the sink is locked so that a thread that
+        // writes its own buffers in the meantime cannot get them out of order.
+        bool entered = lock_trace_sink(trace);
+        lf_mutex_lock(&trace->_lf_trace_mutex);
+        int index = next_pending_trace_buffer(trace, next);
+        trace_record_t* buffer = NULL;
+        int size = 0;
+        if (index >= 0) {
+            buffer = pop_pending_trace_buffer(trace, index, &size);
+            next = (index + 1) % trace->_lf_number_of_trace_buffers;
+        }
+        lf_mutex_unlock(&trace->_lf_trace_mutex);
+        if (buffer != NULL && trace->_lf_trace_sink != NULL) {
+            write_trace_records(trace, buffer, size);
+        }
+        unlock_trace_sink(trace, entered);
+
+        lf_mutex_lock(&trace->_lf_trace_mutex);
+        if (buffer != NULL) push_spare_trace_buffer(trace, index, buffer);
     }
+    lf_mutex_unlock(&trace->_lf_trace_mutex);
+    return NULL;
+}
+
+/**
+ * @brief Swap the full buffer at the given index with a spare and hand the
+ * full one off to the writer thread. If the writer thread still holds all of
+ * the spares, write the pending buffers of this thread and then the full one
+ * to the file from this thread instead of dropping records.
+ * @param index Index specifying the buffer to hand off.
+ */
+static void hand_off_trace_buffer(trace_t* trace, int index) {
+    lf_mutex_lock(&trace->_lf_trace_mutex);
+    int spares = trace->_lf_trace_spare_count[index];
+    if (spares > 0) {
+        int tail = (trace->_lf_trace_pending_head[index] + trace->_lf_trace_pending_count[index]) % TRACE_SPARE_BUFFERS;
+        trace->_lf_trace_pending_buffer[index * TRACE_SPARE_BUFFERS + tail] = trace->_lf_trace_buffer[index];
+        trace->_lf_trace_pending_size[index * TRACE_SPARE_BUFFERS + tail] = trace->_lf_trace_buffer_size[index];
+        trace->_lf_trace_pending_count[index]++;
+        trace->_lf_trace_buffer[index] = trace->_lf_trace_spare_buffer[index * TRACE_SPARE_BUFFERS + spares - 1];
+        trace->_lf_trace_spare_buffer[index * TRACE_SPARE_BUFFERS + spares - 1] = NULL;
+        trace->_lf_trace_spare_count[index]--;
+        trace->_lf_trace_buffer_size[index] = 0;
+        lf_cond_signal(&trace->_lf_trace_pending_changed);
+        lf_mutex_unlock(&trace->_lf_trace_mutex);
+        return;
+    }
+    trace->_lf_trace_stalls++;
+    lf_mutex_unlock(&trace->_lf_trace_mutex);
+
+    bool entered = lock_trace_sink(trace);
+    trace_record_t* pending[TRACE_SPARE_BUFFERS];
+    int sizes[TRACE_SPARE_BUFFERS];
+    int count = 0;
+    lf_mutex_lock(&trace->_lf_trace_mutex);
+    while (trace->_lf_trace_pending_count[index] > 0) {
+        pending[count] = pop_pending_trace_buffer(trace, index, &sizes[count]);
+        count++;
+    }
+    lf_mutex_unlock(&trace->_lf_trace_mutex);
+    for (int i = 0; i < count && trace->_lf_trace_sink != NULL; i++) {
+        write_trace_records(trace, pending[i], sizes[i]);
+    }
+    if (trace->_lf_trace_sink != NULL) {
+        write_trace_records(trace, trace->_lf_trace_buffer[index], trace->_lf_trace_buffer_size[index]);
+    }
+    unlock_trace_sink(trace, entered);
+    trace->_lf_trace_buffer_size[index] = 0;
+
+    lf_mutex_lock(&trace->_lf_trace_mutex);
+    for (int i = 0; i < count; i++) {
+        push_spare_trace_buffer(trace, index, pending[i]);
+    }
+    lf_mutex_unlock(&trace->_lf_trace_mutex);
+}
+
+/**
+ * @brief Stop the writer thread after it has written all pending buffers.
+ * This has no effect if the writer thread is not running.
+ */
+static void stop_trace_writer(trace_t* trace) {
+    if (trace->_lf_trace_spare_buffer == NULL) return; // Tracing never started.
+    lf_mutex_lock(&trace->_lf_trace_mutex);
+    if (!trace->_lf_trace_writer_running) {
+        lf_mutex_unlock(&trace->_lf_trace_mutex);
+        return;
+    }
+    trace->_lf_trace_writer_running = false;
+    lf_cond_signal(&trace->_lf_trace_pending_changed);
+    lf_mutex_unlock(&trace->_lf_trace_mutex);
+    lf_thread_join(trace->_lf_trace_writer, NULL);
+}
+#endif // !defined(LF_SINGLE_THREADED)
+
+void start_trace(trace_t* trace) {
+    trace->_lf_trace_sink = trace_sink_open(trace->filename, (trace->env != NULL) ? trace->env->id : 0);
     // Do not write the trace header information to the file yet
     // so that startup reactions can register user-defined trace objects.
     // write_trace_header();
@@ -263,6 +876,42 @@ void start_trace(trace_t* trace) {
     }
     // Array of counters that track the size of each trace record (per thread).
     trace->_lf_trace_buffer_size = (int*)calloc(sizeof(int), trace->_lf_number_of_trace_buffers);
+#ifdef LF_TRACE_COMPACT
+    trace->_lf_trace_encoded = (unsigned char*)malloc(TRACE_BUFFER_CAPACITY * TRACE_COMPACT_RECORD_MAX_SIZE);
+    lf_assert(trace->_lf_trace_encoded, "Out of memory");
+#endif
+
+#if !defined(LF_SINGLE_THREADED)
+    // Give each thread spare buffers so that full buffers can be written
+    // to the file by a separate thread while the traced thread continues.
+    int slots = trace->_lf_number_of_trace_buffers * TRACE_SPARE_BUFFERS;
+    trace->_lf_trace_spare_buffer = (trace_record_t**)malloc(sizeof(trace_record_t*) * slots);
+    for (int i = 0; i < slots; i++) {
+        trace->_lf_trace_spare_buffer[i] = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_BUFFER_CAPACITY);
+    }
+    trace->_lf_trace_spare_count = (int*)malloc(sizeof(int) * trace->_lf_number_of_trace_buffers);
+    for (int i = 0; i < trace->_lf_number_of_trace_buffers; i++) {
+        trace->_lf_trace_spare_count[i] = TRACE_SPARE_BUFFERS;
+    }
+    trace->_lf_trace_pending_buffer = (trace_record_t**)calloc(sizeof(trace_record_t*), slots);
+    trace->_lf_trace_pending_size = (int*)calloc(sizeof(int), slots);
+    trace->_lf_trace_pending_head = (int*)calloc(sizeof(int), trace->_lf_number_of_trace_buffers);
+    trace->_lf_trace_pending_count = (int*)calloc(sizeof(int), trace->_lf_number_of_trace_buffers);
+    trace->_lf_trace_stalls = 0;
+    if (lf_mutex_init(&trace->_lf_trace_mutex) != 0
+            || lf_mutex_init(&trace->_lf_trace_sink_mutex) != 0
+            || lf_cond_init(&trace->_lf_trace_pending_changed, &trace->_lf_trace_mutex) != 0) {
+        lf_print_error_and_exit("Could not initialize the trace writer synchronization objects.");
+    }
+    trace->_lf_trace_writer_running = true;
+    if (lf_thread_create(&trace->_lf_trace_writer, trace_writer, trace) != 0) {
+        lf_print_error_and_exit("Could not start the trace writer thread.");
+    }
+#endif
+
+#ifdef LF_TRACE_TSC
+    sample_trace_clocks(&trace->_lf_trace_start_cycles, &trace->_lf_trace_start_time);
+#endif
 
     trace->_lf_trace_stop = 0;
     LF_PRINT_DEBUG("Started tracing.");
@@ -281,9 +930,16 @@ void tracepoint(
         interval_t extra_delay,
         bool is_interval_start
 ) {
+    if (trace->_lf_trace_filter[event_type] != trace_filter_record) {
+        if (trace->_lf_trace_filter[event_type] == trace_filter_drop
+                || !trace_object_selected(trace, reactor)) return;
+    }
     instant_t time;
+#ifdef LF_TRACE_TSC
+    physical_time = NULL;
+#endif
     if (!is_interval_start && physical_time == NULL) {
-        time = lf_time_physical();
+        time = TRACE_TIMESTAMP();
         physical_time = &time;
     }
 
@@ -293,10 +949,15 @@ void tracepoint(
 
     // Flush the buffer if it is full.
     if (trace->_lf_trace_buffer_size[index] >= TRACE_BUFFER_CAPACITY) {
+#if !defined(LF_SINGLE_THREADED)
+        // No more room in the buffer. Hand it off to the writer thread.
+        hand_off_trace_buffer(trace, index);
+#else
         // No more room in the buffer. Write the buffer to the file.
         flush_trace(trace, index);
+#endif
     }
-    // The above flush_trace resets the write pointer.
+    // The above resets the write pointer.
     int i = trace->_lf_trace_buffer_size[index];
     // Write to memory buffer.
     // Get the correct time of the event
@@ -316,7 +977,7 @@ void tracepoint(
     trace->_lf_trace_buffer[index][i].trigger = trigger;
     trace->_lf_trace_buffer[index][i].extra_delay = extra_delay;
     if (is_interval_start && physical_time == NULL) {
-        time = lf_time_physical();
+        time = TRACE_TIMESTAMP();
         physical_time = &time;
     }
     trace->_lf_trace_buffer[index][i].physical_time = *physical_time;
@@ -329,7 +990,9 @@ void tracepoint(
  * @param worker The thread number of the worker thread or 0 for single-threaded execution.
  */
 void tracepoint_reaction_starts(trace_t* trace, reaction_t* reaction, int worker) {
-    tracepoint(trace, reaction_starts, reaction->self, NULL, worker, worker, reaction->number, NULL, NULL, 0, true);
+    // The level of the reaction is stored in the extra_delay field.
+    tracepoint(trace, reaction_starts, reaction->self, NULL, worker, worker, reaction->number, NULL, NULL,
+            (interval_t)LF_LEVEL(reaction->index), true);
 }
 
 /**
@@ -416,6 +1079,19 @@ void tracepoint_user_value(void* self, char* description, long long value) {
     lf_critical_section_exit(env);
 }
 
+void tracepoint_serialization(environment_t* env, trace_event_t event_type, size_t bytes) {
+    bool is_start = (event_type == serialization_starts || event_type == deserialization_starts);
+    // There is no worker number, as for tracepoint_user_value().
+    lf_critical_section_enter(env);
+    tracepoint(env->trace, event_type, NULL, NULL, -1, -1, env->id, NULL, NULL, (interval_t)bytes, is_start);
+    lf_critical_section_exit(env);
+}
+
+void tracepoint_interpreter(trace_t* trace, trace_event_t event_type, int worker) {
+    bool is_start = (event_type == gil_wait_starts || event_type == python_call_starts);
+    tracepoint(trace, event_type, NULL, NULL, worker, worker, -1, NULL, NULL, 0, is_start);
+}
+
 /**
  * Trace the start of a worker waiting for something to change on the event or reaction queue.
  * @param worker The thread number of the worker thread or 0 for single-threaded execution.
@@ -432,6 +1108,22 @@ void tracepoint_worker_wait_ends(trace_t* trace, int worker) {
     tracepoint(trace, worker_wait_ends, NULL, NULL, worker, worker, -1, NULL, NULL, 0, false);
 }
 
+/**
+ * Trace the start of a worker spinning before it parks to wait for work.
+ * @param worker The thread number of the worker thread.
+ */
+void tracepoint_worker_spin_starts(trace_t* trace, int worker) {
+    tracepoint(trace, worker_spin_starts, NULL, NULL, worker, worker, -1, NULL, NULL, 0, true);
+}
+
+/**
+ * Trace the end of a worker spinning before it parks to wait for work.
+ * @param worker The thread number of the worker thread.
+ */
+void tracepoint_worker_spin_ends(trace_t* trace, int worker) {
+    tracepoint(trace, worker_spin_ends, NULL, NULL, worker, worker, -1, NULL, NULL, 0, false);
+}
+
 /**
  * Trace the start of the scheduler waiting for logical time to advance or an event to
  * appear on the event queue.
@@ -448,6 +1140,37 @@ void tracepoint_scheduler_advancing_time_ends(trace_t* trace) {
     tracepoint(trace, scheduler_advancing_time_ends, NULL, NULL, -1, -1, -1, NULL, NULL, 0, false);
 }
 
+/**
+ * Trace the release of a tag once physical time has reached it. The lateness
+ * is stored in the extra_delay field.
+ */
+void tracepoint_scheduler_wakeup(trace_t* trace, interval_t lateness) {
+    tracepoint(trace, scheduler_wakeup, NULL, NULL, -1, -1, -1, NULL, NULL, lateness, false);
+}
+
+/**
+ * Trace a change of the criticality mode of the scheduler. The new mode
+ * is stored in the extra_delay field.
+ */
+void tracepoint_scheduler_criticality_change(trace_t* trace, int worker, int criticality) {
+    tracepoint(trace, scheduler_criticality_change, NULL, NULL, worker, worker, -1, NULL, NULL, criticality, false);
+}
+
+/**
+ * Trace the invocation of the expiration handler of a watchdog.
+ * Like user events, this is traced in the buffer that does not belong to
+ * a worker, under the mutex of the environment.
+ * @param self The self struct of the reactor of the watchdog.
+ * @param trigger The trigger of the watchdog.
+ * @param lateness How late the handler is invoked.
+ */
+void tracepoint_watchdog_expires(void* self, trigger_t* trigger, interval_t lateness) {
+    environment_t *env = ((self_base_t *)self)->environment;
+    lf_critical_section_enter(env);
+    tracepoint(env->trace, watchdog_expires, self, NULL, -1, -1, -1, NULL, trigger, lateness, false);
+    lf_critical_section_exit(env);
+}
+
 /**
  * Trace the occurrence of a deadline miss.
  * @param reaction Pointer to the reaction_t struct for the reaction.
@@ -458,9 +1181,14 @@ void tracepoint_reaction_deadline_missed(trace_t* trace, reaction_t *reaction, i
 }
 
 void stop_trace(trace_t* trace) {
+#if !defined(LF_SINGLE_THREADED)
+    // The writer thread enters the critical section, so stop it first.
+    stop_trace_writer(trace);
+#endif
     lf_critical_section_enter(trace->env);
     if (trace->_lf_trace_stop) {
         // Trace was already stopped. Nothing to do.
+        lf_critical_section_exit(trace->env);
         return;
     }
     // In multithreaded execution, thread 0 invokes wrapup reactions, so we
@@ -477,8 +1205,36 @@ void stop_trace(trace_t* trace) {
         flush_trace_locked(trace, 0);
     }
     trace->_lf_trace_stop = 1;
-    fclose(trace->_lf_trace_file);
-    trace->_lf_trace_file = NULL;
+#if !defined(LF_SINGLE_THREADED)
+    if (trace->_lf_trace_stalls > 0) {
+        lf_print_warning("Traced threads wrote their own buffers %zu times because the trace writer could not keep up.",
+                trace->_lf_trace_stalls);
+    }
+#endif
+#ifdef LF_TRACE_TSC
+    if (trace->_lf_trace_sink != NULL && trace->_lf_trace_header_written) {
+        // Follow the last trace with the samples from which readers calibrate the cycle counts.
+        int end_marker = -1;
+        instant_t samples[4] = {trace->_lf_trace_start_cycles, trace->_lf_trace_start_time};
+        sample_trace_clocks(&samples[2], &samples[3]);
+        if (trace_sink_write(trace->_lf_trace_sink, &end_marker, sizeof(int)) != 0
+                || trace_sink_write(trace->_lf_trace_sink, samples, sizeof(samples)) != 0
+                || trace_sink_flush(trace->_lf_trace_sink) != 0) {
+            fprintf(stderr, "WARNING: Access to trace file failed.\n");
+        }
+    }
+#endif
+    if (trace->_lf_trace_sink != NULL) trace_sink_close(trace->_lf_trace_sink);
+    trace->_lf_trace_sink = NULL;
+#ifdef LF_TRACE_COMPACT
+    if (trace->_lf_trace_pointer_ids != NULL) {
+        trace_object_ids_free(trace->_lf_trace_pointer_ids);
+        trace_object_ids_free(trace->_lf_trace_trigger_ids);
+        trace->_lf_trace_pointer_ids = trace->_lf_trace_trigger_ids = NULL;
+    }
+    free(trace->_lf_trace_encoded);
+    trace->_lf_trace_encoded = NULL;
+#endif
     LF_PRINT_DEBUG("Stopped tracing.");
     lf_critical_section_exit(trace->env);
 }
@@ -582,6 +1338,53 @@ void tracepoint_federate_from_federate(trace_t* trace, trace_event_t event_type,
         false   // is_interval_start
     );
 }
+
+/**
+ * Trace an adjustment of the clock synchronization offset of the federate.
+ * @param fed_id The federate identifier.
+ * @param offset The offset in effect from now on.
+ */
+void tracepoint_federate_clock_sync(trace_t* trace, int fed_id, interval_t offset) {
+    tracepoint(
+        trace,
+        clock_sync_offset,
+        NULL,   // void* pointer,
+        NULL,   // tag* tag,
+        -1,     // int worker, // no worker ID needed because this is called within a mutex
+        fed_id, // int src_id,
+        -1,     // int dst_id,
+        NULL,   // instant_t* physical_time (will be generated)
+        NULL,   // trigger_t* trigger,
+        offset, // interval_t extra_delay
+        false   // is_interval_start
+    );
+}
+
+/**
+ * Trace the start or the end of the compression or decompression of the body
+ * of a message.
+ * @param fed_id The federate identifier.
+ * @param partner_id The partner federate identifier.
+ * @param tag Pointer to the tag of the message, or NULL.
+ * @param bytes The number of bytes in or out.
+ */
+void tracepoint_federate_compression(trace_t* trace, trace_event_t event_type, int fed_id, int partner_id,
+        tag_t* tag, size_t bytes) {
+    bool is_start = (event_type == compression_starts || event_type == decompression_starts);
+    tracepoint(
+        trace,
+        event_type,
+        NULL,   // void* pointer,
+        tag,    // tag* tag,
+        -1,     // int worker
+        fed_id, // int src_id,
+        partner_id,     // int dst_id,
+        NULL,   // instant_t* physical_time (will be generated)
+        NULL,   // trigger_t* trigger,
+        (interval_t)bytes, // interval_t extra_delay
+        is_start // is_interval_start
+    );
+}
 #endif // FEDERATED
 
 ////////////////////////////////////////////////////////////
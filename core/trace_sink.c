@@ -0,0 +1,322 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file trace_sink.c
+ * @brief Destinations to which the bytes of a trace are written.
+ *
+ * See trace_sink.h for the destinations.
+ * The socket and shared memory sinks collect the bytes of a unit in a pending
+ * buffer and deliver them when the unit is flushed.
+ */
+
+#include "trace_sink.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "util.h"
+
+#if defined(PLATFORM_Linux) || defined(PLATFORM_Darwin)
+#define TRACE_SINK_POSIX
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+/** A sink that writes to a file. */
+typedef struct {
+    trace_sink_t base;
+    FILE* file;
+} file_sink_t;
+
+static int file_sink_write(trace_sink_t* sink, const void* data, size_t size) {
+    if (size == 0) return 0;
+    return (fwrite(data, size, 1, ((file_sink_t*)sink)->file) == 1) ? 0 : -1;
+}
+
+static int file_sink_flush(trace_sink_t* sink) {
+    return 0;
+}
+
+static void file_sink_close(trace_sink_t* sink) {
+    fclose(((file_sink_t*)sink)->file);
+    free(sink);
+}
+
+static trace_sink_t* file_sink_open(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        lf_print_warning("Failed to open trace file %s with error code %d. No trace will be written.",
+                filename, errno);
+        return NULL;
+    }
+    file_sink_t* sink = (file_sink_t*)malloc(sizeof(file_sink_t));
+    lf_assert(sink, "Out of memory");
+    sink->base.write = file_sink_write;
+    sink->base.flush = file_sink_flush;
+    sink->base.close = file_sink_close;
+    sink->file = file;
+    return &sink->base;
+}
+
+#ifdef TRACE_SINK_POSIX
+
+/** A sink that collects the bytes of a unit before delivering them. */
+typedef struct {
+    trace_sink_t base;
+    unsigned char* pending;
+    size_t pending_size;
+    size_t pending_capacity;
+} buffered_sink_t;
+
+static int buffered_sink_write(trace_sink_t* sink, const void* data, size_t size) {
+    buffered_sink_t* buffered = (buffered_sink_t*)sink;
+    if (buffered->pending_size + size > buffered->pending_capacity) {
+        size_t capacity = 2 * buffered->pending_capacity;
+        if (capacity < buffered->pending_size + size) capacity = buffered->pending_size + size;
+        unsigned char* pending = (unsigned char*)realloc(buffered->pending, capacity);
+        if (pending == NULL) return -1;
+        buffered->pending = pending;
+        buffered->pending_capacity = capacity;
+    }
+    memcpy(buffered->pending + buffered->pending_size, data, size);
+    buffered->pending_size += size;
+    return 0;
+}
+
+/** A sink that sends the stream over a socket. */
+typedef struct {
+    buffered_sink_t buffered;
+    int socket;
+    uint32_t stream;
+    uint32_t sequence;
+} socket_sink_t;
+
+#ifdef MSG_NOSIGNAL
+#define TRACE_SINK_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define TRACE_SINK_SEND_FLAGS 0
+#endif
+
+static int tcp_sink_flush(trace_sink_t* sink) {
+    socket_sink_t* socket_sink = (socket_sink_t*)sink;
+    size_t position = 0;
+    while (position < socket_sink->buffered.pending_size) {
+        ssize_t sent = send(socket_sink->socket, socket_sink->buffered.pending + position,
+                socket_sink->buffered.pending_size - position, TRACE_SINK_SEND_FLAGS);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        position += (size_t)sent;
+    }
+    socket_sink->buffered.pending_size = 0;
+    return 0;
+}
+
+static int udp_sink_flush(trace_sink_t* sink) {
+    socket_sink_t* socket_sink = (socket_sink_t*)sink;
+    unsigned char datagram[sizeof(trace_datagram_header_t) + TRACE_SINK_DATAGRAM_SIZE];
+    size_t position = 0;
+    while (position < socket_sink->buffered.pending_size) {
+        size_t size = socket_sink->buffered.pending_size - position;
+        if (size > TRACE_SINK_DATAGRAM_SIZE) size = TRACE_SINK_DATAGRAM_SIZE;
+        trace_datagram_header_t header = {htonl(socket_sink->stream), htonl(socket_sink->sequence++)};
+        memcpy(datagram, &header, sizeof(header));
+        memcpy(datagram + sizeof(header), socket_sink->buffered.pending + position, size);
+        // Datagrams may be lost anyway, so a failure to send one is not reported.
+        send(socket_sink->socket, datagram, sizeof(header) + size, TRACE_SINK_SEND_FLAGS);
+        position += size;
+    }
+    socket_sink->buffered.pending_size = 0;
+    return 0;
+}
+
+static void socket_sink_close(trace_sink_t* sink) {
+    socket_sink_t* socket_sink = (socket_sink_t*)sink;
+    close(socket_sink->socket);
+    free(socket_sink->buffered.pending);
+    free(socket_sink);
+}
+
+/**
+ * @brief Open a socket of the given type connected to the given address,
+ * which has the form host:port.
+ * @return The socket, or -1 on failure.
+ */
+static int connect_socket(const char* address, int type) {
+    const char* colon = strrchr(address, ':');
+    if (colon == NULL || colon == address) return -1;
+    char host[256];
+    size_t host_length = (size_t)(colon - address);
+    // Allow IPv6 addresses in brackets.
+    if (address[0] == '[' && colon[-1] == ']') {
+        address++;
+        host_length -= 2;
+    }
+    if (host_length >= sizeof(host)) return -1;
+    strncpy(host, address, host_length);
+    host[host_length] = '\0';
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    struct addrinfo* result;
+    if (getaddrinfo(host, colon + 1, &hints, &result) != 0) return -1;
+    int sock = -1;
+    for (struct addrinfo* info = result; info != NULL; info = info->ai_next) {
+        sock = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (sock < 0) continue;
+        if (connect(sock, info->ai_addr, info->ai_addrlen) == 0) break;
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(result);
+#ifdef SO_NOSIGPIPE
+    if (sock >= 0) {
+        int on = 1;
+        setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return sock;
+}
+
+static trace_sink_t* socket_sink_open(const char* address, int type, uint32_t stream) {
+    int sock = connect_socket(address, type);
+    if (sock < 0) {
+        lf_print_warning("Failed to connect to trace collector at %s. No trace will be written.", address);
+        return NULL;
+    }
+    socket_sink_t* sink = (socket_sink_t*)calloc(1, sizeof(socket_sink_t));
+    lf_assert(sink, "Out of memory");
+    sink->buffered.base.write = buffered_sink_write;
+    sink->buffered.base.flush = (type == SOCK_STREAM) ? tcp_sink_flush : udp_sink_flush;
+    sink->buffered.base.close = socket_sink_close;
+    sink->socket = sock;
+    sink->stream = stream;
+    return &sink->buffered.base;
+}
+
+/** A sink that appends units to a ring in shared memory. */
+typedef struct {
+    buffered_sink_t buffered;
+    trace_shm_ring_t* ring;
+    size_t mapped_size;
+} shm_sink_t;
+
+static int shm_sink_flush(trace_sink_t* sink) {
+    shm_sink_t* shm_sink = (shm_sink_t*)sink;
+    trace_shm_ring_t* ring = shm_sink->ring;
+    uint64_t size = shm_sink->buffered.pending_size;
+    shm_sink->buffered.pending_size = 0;
+    if (size == 0) return 0;
+    uint64_t used = ring->head - __sync_fetch_and_add(&ring->tail, 0);
+    if (ring->capacity - used < size) {
+        // Drop the whole unit so that the reader never sees a partial one.
+        ring->dropped++;
+        return 0;
+    }
+    uint64_t start = ring->head % ring->capacity;
+    uint64_t first = ring->capacity - start;
+    if (first > size) first = size;
+    memcpy(ring->data + start, shm_sink->buffered.pending, first);
+    memcpy(ring->data, shm_sink->buffered.pending + first, size - first);
+    // The atomic addition publishes the bytes to the reader.
+    __sync_fetch_and_add(&ring->head, size);
+    return 0;
+}
+
+static void shm_sink_close(trace_sink_t* sink) {
+    shm_sink_t* shm_sink = (shm_sink_t*)sink;
+    if (shm_sink->ring->dropped > 0) {
+        lf_print_warning("Dropped %llu trace units because the shared memory ring was full.",
+                (unsigned long long)shm_sink->ring->dropped);
+    }
+    // The object is left for the reader, which removes it with shm_unlink().
+    munmap(shm_sink->ring, shm_sink->mapped_size);
+    free(shm_sink->buffered.pending);
+    free(shm_sink);
+}
+
+static trace_sink_t* shm_sink_open(const char* name) {
+    char object_name[256];
+    snprintf(object_name, sizeof(object_name), "/%s", name);
+    size_t mapped_size = sizeof(trace_shm_ring_t) + TRACE_SINK_SHM_SIZE;
+    int fd = shm_open(object_name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)mapped_size) != 0) {
+        if (fd >= 0) close(fd);
+        lf_print_warning("Failed to create shared memory %s for the trace with error code %d. "
+                "No trace will be written.", object_name, errno);
+        return NULL;
+    }
+    trace_shm_ring_t* ring = (trace_shm_ring_t*)mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        lf_print_warning("Failed to map shared memory %s for the trace with error code %d. "
+                "No trace will be written.", object_name, errno);
+        return NULL;
+    }
+    ring->magic = 0;
+    ring->capacity = TRACE_SINK_SHM_SIZE;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    // Publish the magic number after the other fields.
+    __sync_fetch_and_add(&ring->magic, TRACE_SHM_RING_MAGIC);
+
+    shm_sink_t* sink = (shm_sink_t*)calloc(1, sizeof(shm_sink_t));
+    lf_assert(sink, "Out of memory");
+    sink->buffered.base.write = buffered_sink_write;
+    sink->buffered.base.flush = shm_sink_flush;
+    sink->buffered.base.close = shm_sink_close;
+    sink->ring = ring;
+    sink->mapped_size = mapped_size;
+    return &sink->buffered.base;
+}
+
+#endif // TRACE_SINK_POSIX
+
+trace_sink_t* trace_sink_open(const char* destination, uint32_t stream) {
+    if (strncmp(destination, "tcp://", 6) == 0
+            || strncmp(destination, "udp://", 6) == 0
+            || strncmp(destination, "shm://", 6) == 0) {
+#ifdef TRACE_SINK_POSIX
+        if (destination[0] == 's') return shm_sink_open(destination + 6);
+        return socket_sink_open(destination + 6, (destination[0] == 't') ? SOCK_STREAM : SOCK_DGRAM, stream);
+#else
+        lf_print_warning("Trace destination %s is not supported on this platform. No trace will be written.",
+                destination);
+        return NULL;
+#endif
+    }
+    return file_sink_open(destination);
+}
@@ -22,6 +22,7 @@
 
 #include "hashset/hashset.h"
 #include <assert.h>
+#include <string.h>
 
 static const unsigned int prime_1 = 73;
 static const unsigned int prime_2 = 5009;
@@ -108,6 +109,7 @@ static void maybe_rehash(hashset_t set) {
         set->items = (void**)calloc(set->capacity, sizeof(void*));
         set->nitems = 0;
         set->n_deleted_items = 0;
+        set->next_pop = 0;
         assert(set->items);
         for (ii = 0; ii < old_capacity; ii++) {
             hashset_add_member(set, old_items[ii]);
@@ -150,3 +152,26 @@ int hashset_is_member(hashset_t set, void *item) {
     }
     return 0;
 }
+
+void* hashset_pop_any(hashset_t set) {
+    if (set->nitems == 0) {
+        return NULL;
+    }
+    // Items added since the last call may be before the position, so wrap around.
+    size_t ii = set->next_pop;
+    while (set->items[ii] == 0 || set->items[ii] == (void*)1) {
+        ii = set->mask & (ii + 1);
+    }
+    void* item = set->items[ii];
+    set->items[ii] = (void*)1;
+    set->nitems--;
+    set->n_deleted_items++;
+    set->next_pop = set->mask & (ii + 1);
+    if (set->nitems == 0) {
+        // Clear the deleted items so that they do not lengthen later searches.
+        memset(set->items, 0, set->capacity * sizeof(void*));
+        set->n_deleted_items = 0;
+        set->next_pop = 0;
+    }
+    return item;
+}
@@ -23,13 +23,17 @@
 #include <stdio.h>
 #include "hashset/hashset_itr.h"
 
+void hashset_iterator_init(hashset_itr_t itr, hashset_t set) {
+  itr->set = set;
+  itr->index = -1;
+}
+
 hashset_itr_t hashset_iterator(hashset_t set) {
   hashset_itr_t itr = calloc(1, sizeof(struct hashset_itr_st));
   if (itr == NULL) {
     return NULL;
   }
-  itr->set = set;
-  itr->index = -1;
+  hashset_iterator_init(itr, set);
 
   return itr;
 }
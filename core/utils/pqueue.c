@@ -39,6 +39,9 @@
 
 #include "platform.h"
 #include "pqueue.h"
+#include "pqueue_calendar.h"
+#include "pqueue_dary.h"
+#include "pqueue_level.h"
 #include "util.h"
 #include "lf_types.h"
 
@@ -146,6 +149,9 @@ pqueue_t * pqueue_init(size_t n,
 
     q->size = 1;
     q->avail = q->step = (n+1);  /* see comment above about n+1 */
+    q->calendar = NULL;
+    q->dary = NULL;
+    q->level = NULL;
     q->cmppri = cmppri;
     q->getpri = getpri;
     q->getpos = getpos;
@@ -156,6 +162,18 @@ pqueue_t * pqueue_init(size_t n,
 }
 
 void pqueue_free(pqueue_t *q) {
+    if (q->calendar) {
+        pqueue_calendar_free(q);
+        return;
+    }
+    if (q->dary) {
+        pqueue_dary_free(q);
+        return;
+    }
+    if (q->level) {
+        pqueue_level_free(q);
+        return;
+    }
     free(q->d);
     free(q);
 }
@@ -215,10 +233,16 @@ static void percolate_down(pqueue_t *q, size_t i) {
 }
 
 void* pqueue_find_equal_same_priority(pqueue_t *q, void *e) {
+    if (q->calendar) return pqueue_calendar_find_equal_same_priority(q, e);
+    if (q->dary) return pqueue_dary_find_equal_same_priority(q, e);
+    if (q->level) return pqueue_level_find_equal_same_priority(q, e);
     return find_equal_same_priority(q, e, 1);
 }
 
 void* pqueue_find_equal(pqueue_t *q, void *e, pqueue_pri_t max) {
+    if (q->calendar) return pqueue_calendar_find_equal(q, e, max);
+    if (q->dary) return pqueue_dary_find_equal(q, e, max);
+    if (q->level) return pqueue_level_find_equal(q, e, max);
     return find_equal(q, e, 1, max);
 }
 
@@ -228,6 +252,9 @@ int pqueue_insert(pqueue_t *q, void *d) {
     size_t newsize;
 
     if (!q) return 1;
+    if (q->calendar) return pqueue_calendar_insert(q, d);
+    if (q->dary) return pqueue_dary_insert(q, d);
+    if (q->level) return pqueue_level_insert(q, d);
 
     /* allocate more memory if necessary */
     if (q->size >= q->avail) {
@@ -245,8 +272,41 @@ int pqueue_insert(pqueue_t *q, void *d) {
     return 0;
 }
 
+int pqueue_insert_all(pqueue_t *q, void **entries, size_t n) {
+    if (!q) return 1;
+    if (q->dary) return pqueue_dary_insert_all(q, entries, n);
+    // Rebuilding the heap only pays off if the entries at least double its size.
+    if (q->calendar || q->level || n < q->size - 1) {
+        for (size_t i = 0; i < n; i++) {
+            if (pqueue_insert(q, entries[i])) return 1;
+        }
+        return 0;
+    }
+    if (q->size + n > q->avail) {
+        size_t newsize = q->size + n + q->step;
+        void **tmp;
+        if (!(tmp = (void**)realloc(q->d, sizeof(void *) * newsize)))
+            return 1;
+        q->d = tmp;
+        q->avail = newsize;
+    }
+    memcpy(&q->d[q->size], entries, n * sizeof(void *));
+    q->size += n;
+    for (size_t i = LF_PARENT(q->size - 1); i > 0; i--) {
+        percolate_down(q, i);
+    }
+    // Entries that are leaves have not been moved by percolate_down.
+    for (size_t i = LF_PARENT(q->size - 1) + 1; i < q->size; i++) {
+        q->setpos(q->d[i], i);
+    }
+    return 0;
+}
+
 int pqueue_remove(pqueue_t *q, void *d) {
     if (q->size == 1) return 0; // Nothing to remove
+    if (q->calendar) return pqueue_calendar_remove(q, d);
+    if (q->dary) return pqueue_dary_remove(q, d);
+    if (q->level) return pqueue_level_remove(q, d);
     size_t posn = q->getpos(d);
     q->d[posn] = q->d[--q->size];
     if (q->cmppri(q->getpri(d), q->getpri(q->d[posn])))
@@ -260,6 +320,9 @@ int pqueue_remove(pqueue_t *q, void *d) {
 void* pqueue_pop(pqueue_t *q) {
     if (!q || q->size == 1)
         return NULL;
+    if (q->calendar) return pqueue_calendar_pop(q);
+    if (q->dary) return pqueue_dary_pop(q);
+    if (q->level) return pqueue_level_pop(q);
 
     void* head;
 
@@ -270,6 +333,24 @@ void* pqueue_pop(pqueue_t *q) {
     return head;
 }
 
+void* pqueue_advance_head(pqueue_t *q, pqueue_pri_t new_pri, pqueue_set_pri_f setpri) {
+    if (q->calendar || q->level) {
+        // These keep their entries in buckets by priority, so move the entry
+        // between buckets.
+        void* head = pqueue_pop(q);
+        setpri(head, new_pri);
+        pqueue_insert(q, head);
+        return head;
+    }
+    if (q->dary) return pqueue_dary_advance_head(q, new_pri, setpri);
+
+    void* head = q->d[1];
+    setpri(head, new_pri);
+    percolate_down(q, 1);
+
+    return head;
+}
+
 /**
  * @brief Empty 'src' into 'dest'.
  *
@@ -303,13 +384,38 @@ void* pqueue_peek(pqueue_t *q) {
     void *d;
     if (!q || q->size == 1)
         return NULL;
+    if (q->calendar) return pqueue_calendar_peek(q);
+    if (q->dary) return pqueue_dary_peek(q);
+    if (q->level) return pqueue_level_peek(q);
     d = q->d[1];
     return d;
 }
 
+void pqueue_copy_entries(pqueue_t *q, void **out) {
+    if (q->calendar) {
+        pqueue_calendar_copy_entries(q, out);
+        return;
+    }
+    if (q->dary) {
+        pqueue_dary_copy_entries(q, out);
+        return;
+    }
+    if (q->level) {
+        pqueue_level_copy_entries(q, out);
+        return;
+    }
+    memcpy(out, &q->d[1], (q->size - 1) * sizeof(void *));
+}
+
 void pqueue_dump(pqueue_t *q, pqueue_print_entry_f print) {
     size_t i;
 
+    if (q->calendar || q->dary || q->level) {
+        // Only the binary heap has the structure shown below.
+        pqueue_print(q, print);
+        return;
+    }
+
     LF_PRINT_DEBUG("posn\tleft\tright\tparent\tmaxchild\t...");
     for (i = 1; i < q->size ;i++) {
         LF_PRINT_DEBUG("%zu\t%zu\t%zu\t%zu\t%ul\t",
@@ -324,6 +430,21 @@ void pqueue_print(pqueue_t *q, pqueue_print_entry_f print) {
     pqueue_t *dup;
     void *e;
 
+    if (q->calendar || q->dary || q->level) {
+        // Print in order without disturbing the queue by sorting a copy.
+        size_t n = pqueue_size(q);
+        void** entries = (void**)malloc(n * sizeof(void *) + 1);
+        if (!entries) return;
+        pqueue_copy_entries(q, entries);
+        dup = pqueue_init(n, q->cmppri, q->getpri, q->getpos, q->setpos, q->eqelem, q->prt);
+        for (size_t i = 0; i < n; i++) pqueue_insert(dup, entries[i]);
+        free(entries);
+        while ((e = pqueue_pop(dup)))
+            print(e);
+        pqueue_free(dup);
+        return;
+    }
+
     dup = pqueue_init(q->size,
                       q->cmppri, q->getpri,
                       q->getpos, q->setpos, q->eqelem, q->prt);
@@ -373,6 +494,9 @@ static int subtree_is_valid(pqueue_t *q, int pos) {
 }
 
 int pqueue_is_valid(pqueue_t *q) {
+    if (q->calendar) return pqueue_calendar_is_valid(q);
+    if (q->dary) return pqueue_dary_is_valid(q);
+    if (q->level) return pqueue_level_is_valid(q);
     return subtree_is_valid(q, 1);
 }
 
@@ -415,6 +539,14 @@ pqueue_pri_t get_event_time(void *a) {
     return (pqueue_pri_t)(((event_t*) a)->time);
 }
 
+/**
+ * Set the time of the given event to the given priority.
+ * Used to move an event to a later time on the event queue.
+ */
+void set_event_time(void *a, pqueue_pri_t pri) {
+    ((event_t*) a)->time = (instant_t)pri;
+}
+
 /**
  * Report a priority equal to the index of the given reaction.
  * Used for sorting pointers to reaction_t structs in the
@@ -0,0 +1,380 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_calendar.c
+ * @brief A calendar queue that implements the pqueue_* interface.
+ *
+ * See pqueue_calendar.h for an overview. Each bucket is an array that is kept
+ * sorted with the highest-ranking entry last, so that popping is a decrement.
+ * The queue keeps track of the slot, that is, the priority divided by the
+ * bucket width, at which the last search for the highest-ranking entry ended.
+ * No entry has a smaller slot, so a search can resume there and stop at the
+ * first bucket whose head falls into the slot being visited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pqueue_calendar.h"
+#include "util.h"
+
+/** The smallest number of buckets. Must be a power of two. */
+#define CQ_MIN_BUCKETS 16
+
+/** The number of entries sampled to estimate the bucket width on a resize. */
+#define CQ_WIDTH_SAMPLES 64
+
+/**
+ * The bucket width before there are enough entries to estimate it. Priorities
+ * of the event queue are times in nanoseconds, so this is one millisecond.
+ */
+#ifndef LF_CALENDAR_INITIAL_WIDTH
+#define LF_CALENDAR_INITIAL_WIDTH 1000000ULL
+#endif
+
+typedef struct {
+    void** entries;     /**< Sorted by priority, highest-ranking (smallest) last. */
+    size_t size;
+    size_t capacity;
+} cq_bucket_t;
+
+typedef struct pqueue_calendar_t {
+    cq_bucket_t* buckets;
+    size_t num_buckets;         /**< A power of two. */
+    pqueue_pri_t width;         /**< The number of priorities covered by each bucket. */
+    pqueue_pri_t last_slot;     /**< A lower bound on the slot of every entry. */
+} pqueue_calendar_t;
+
+static inline pqueue_pri_t cq_slot(pqueue_calendar_t* cq, pqueue_pri_t pri) {
+    return pri / cq->width;
+}
+
+static inline cq_bucket_t* cq_bucket_of(pqueue_calendar_t* cq, pqueue_pri_t pri) {
+    return &cq->buckets[cq_slot(cq, pri) & (cq->num_buckets - 1)];
+}
+
+static inline size_t cq_count(pqueue_t* q) {
+    return q->size - 1;
+}
+
+/**
+ * Return the index in 'bucket' at which an entry with priority 'pri' is
+ * inserted, which is after all entries with larger priorities and before all
+ * entries with the same priority, so that those are popped first.
+ */
+static size_t cq_insertion_point(pqueue_t* q, cq_bucket_t* bucket, pqueue_pri_t pri) {
+    size_t low = 0;
+    size_t high = bucket->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (q->getpri(bucket->entries[mid]) > pri) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int cq_bucket_insert(pqueue_t* q, cq_bucket_t* bucket, void* d) {
+    if (bucket->size == bucket->capacity) {
+        size_t capacity = bucket->capacity ? 2 * bucket->capacity : 4;
+        void** entries = (void**)realloc(bucket->entries, capacity * sizeof(void*));
+        if (!entries) return 1;
+        bucket->entries = entries;
+        bucket->capacity = capacity;
+    }
+    size_t i = cq_insertion_point(q, bucket, q->getpri(d));
+    memmove(&bucket->entries[i + 1], &bucket->entries[i], (bucket->size - i) * sizeof(void*));
+    bucket->entries[i] = d;
+    bucket->size++;
+    return 0;
+}
+
+static cq_bucket_t* cq_buckets_new(size_t num_buckets) {
+    return (cq_bucket_t*)calloc(num_buckets, sizeof(cq_bucket_t));
+}
+
+static void cq_buckets_free(cq_bucket_t* buckets, size_t num_buckets) {
+    for (size_t i = 0; i < num_buckets; i++) {
+        free(buckets[i].entries);
+    }
+    free(buckets);
+}
+
+static int compare_priorities(const void* a, const void* b) {
+    pqueue_pri_t x = *(const pqueue_pri_t*)a;
+    pqueue_pri_t y = *(const pqueue_pri_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Estimate a bucket width for which buckets hold about three entries each,
+ * from the interquartile range of a sample of the entries. Using quartiles
+ * keeps outliers, such as events far in the future, from inflating the width.
+ */
+static pqueue_pri_t cq_estimate_width(pqueue_t* q, pqueue_calendar_t* cq) {
+    size_t count = cq_count(q);
+    if (count < 4) return cq->width;
+    pqueue_pri_t samples[CQ_WIDTH_SAMPLES];
+    size_t num_samples = 0;
+    size_t stride = count / CQ_WIDTH_SAMPLES + 1;
+    size_t seen = 0;
+    for (size_t b = 0; b < cq->num_buckets && num_samples < CQ_WIDTH_SAMPLES; b++) {
+        for (size_t i = 0; i < cq->buckets[b].size && num_samples < CQ_WIDTH_SAMPLES; i++) {
+            if (seen++ % stride == 0) {
+                samples[num_samples++] = q->getpri(cq->buckets[b].entries[i]);
+            }
+        }
+    }
+    qsort(samples, num_samples, sizeof(pqueue_pri_t), compare_priorities);
+    pqueue_pri_t spread = samples[(3 * num_samples) / 4] - samples[num_samples / 4];
+    // The middle half of the sample represents about half of all entries.
+    pqueue_pri_t separation = spread / (count / 2);
+    pqueue_pri_t width = 3 * separation;
+    return width > 0 ? width : 1;
+}
+
+/** Rebuild the buckets with 'num_buckets' buckets and a freshly estimated width. */
+static void cq_resize(pqueue_t* q, size_t num_buckets) {
+    pqueue_calendar_t* cq = q->calendar;
+    cq_bucket_t* new_buckets = cq_buckets_new(num_buckets);
+    if (!new_buckets) return; // Keep the current buckets, which are still valid.
+    pqueue_pri_t width = cq_estimate_width(q, cq);
+
+    cq_bucket_t* old_buckets = cq->buckets;
+    size_t old_num_buckets = cq->num_buckets;
+    cq->buckets = new_buckets;
+    cq->num_buckets = num_buckets;
+    cq->width = width;
+    cq->last_slot = (pqueue_pri_t)-1;
+    for (size_t b = 0; b < old_num_buckets; b++) {
+        // Move entries in the order they would be popped to keep equal priorities in order.
+        for (size_t i = old_buckets[b].size; i > 0; i--) {
+            void* d = old_buckets[b].entries[i - 1];
+            pqueue_pri_t pri = q->getpri(d);
+            if (cq_bucket_insert(q, cq_bucket_of(cq, pri), d)) {
+                lf_print_error_and_exit("Out of memory while resizing a calendar queue.");
+            }
+            if (cq_slot(cq, pri) < cq->last_slot) {
+                cq->last_slot = cq_slot(cq, pri);
+            }
+        }
+    }
+    if (cq_count(q) == 0) cq->last_slot = 0;
+    cq_buckets_free(old_buckets, old_num_buckets);
+}
+
+/**
+ * Return the bucket whose last entry is the highest-ranking entry of the
+ * queue, or NULL if the queue is empty. This advances the search position.
+ */
+static cq_bucket_t* cq_find_head(pqueue_t* q) {
+    pqueue_calendar_t* cq = q->calendar;
+    if (cq_count(q) == 0) return NULL;
+    pqueue_pri_t slot = cq->last_slot;
+    size_t mask = cq->num_buckets - 1;
+    for (size_t i = 0; i < cq->num_buckets; i++, slot++) {
+        cq_bucket_t* bucket = &cq->buckets[slot & mask];
+        if (bucket->size > 0
+                && cq_slot(cq, q->getpri(bucket->entries[bucket->size - 1])) <= slot) {
+            cq->last_slot = slot;
+            return bucket;
+        }
+    }
+    // No entry within a year of the search position. Search all buckets directly.
+    cq_bucket_t* head = NULL;
+    pqueue_pri_t head_pri = 0;
+    for (size_t b = 0; b < cq->num_buckets; b++) {
+        cq_bucket_t* bucket = &cq->buckets[b];
+        if (bucket->size == 0) continue;
+        pqueue_pri_t pri = q->getpri(bucket->entries[bucket->size - 1]);
+        if (head == NULL || pri < head_pri) {
+            head = bucket;
+            head_pri = pri;
+        }
+    }
+    cq->last_slot = cq_slot(cq, head_pri);
+    return head;
+}
+
+pqueue_t *
+pqueue_calendar_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt) {
+    pqueue_t *q;
+    if (!(q = (pqueue_t*)calloc(1, sizeof(pqueue_t))))
+        return NULL;
+    if (!(q->calendar = (pqueue_calendar_t*)calloc(1, sizeof(pqueue_calendar_t)))) {
+        free(q);
+        return NULL;
+    }
+    size_t num_buckets = CQ_MIN_BUCKETS;
+    while (num_buckets < n) num_buckets <<= 1;
+    if (!(q->calendar->buckets = cq_buckets_new(num_buckets))) {
+        free(q->calendar);
+        free(q);
+        return NULL;
+    }
+    q->calendar->num_buckets = num_buckets;
+    q->calendar->width = LF_CALENDAR_INITIAL_WIDTH;
+    q->calendar->last_slot = 0;
+    // As for heaps, the size is the number of entries plus 1.
+    q->size = 1;
+    q->cmppri = cmppri;
+    q->getpri = getpri;
+    q->getpos = getpos;
+    q->setpos = setpos;
+    q->eqelem = eqelem;
+    q->prt = prt;
+    return q;
+}
+
+void pqueue_calendar_free(pqueue_t *q) {
+    cq_buckets_free(q->calendar->buckets, q->calendar->num_buckets);
+    free(q->calendar);
+    free(q);
+}
+
+int pqueue_calendar_insert(pqueue_t *q, void *d) {
+    pqueue_calendar_t* cq = q->calendar;
+    pqueue_pri_t pri = q->getpri(d);
+    if (cq_bucket_insert(q, cq_bucket_of(cq, pri), d)) return 1;
+    q->size++;
+    if (cq_slot(cq, pri) < cq->last_slot) {
+        cq->last_slot = cq_slot(cq, pri);
+    }
+    if (cq_count(q) > 2 * cq->num_buckets) {
+        cq_resize(q, 2 * cq->num_buckets);
+    }
+    return 0;
+}
+
+/** Shrink the calendar if it has become sparse. */
+static void cq_maybe_shrink(pqueue_t* q) {
+    pqueue_calendar_t* cq = q->calendar;
+    if (cq->num_buckets > CQ_MIN_BUCKETS && cq_count(q) < cq->num_buckets / 2) {
+        cq_resize(q, cq->num_buckets / 2);
+    }
+}
+
+int pqueue_calendar_remove(pqueue_t *q, void *d) {
+    pqueue_calendar_t* cq = q->calendar;
+    pqueue_pri_t pri = q->getpri(d);
+    cq_bucket_t* bucket = cq_bucket_of(cq, pri);
+    // Entries with the same priority precede the insertion point.
+    for (size_t i = cq_insertion_point(q, bucket, pri); i < bucket->size; i++) {
+        if (bucket->entries[i] == d) {
+            memmove(&bucket->entries[i], &bucket->entries[i + 1], (bucket->size - i - 1) * sizeof(void*));
+            bucket->size--;
+            q->size--;
+            cq_maybe_shrink(q);
+            return 0;
+        }
+        if (q->getpri(bucket->entries[i]) != pri) break;
+    }
+    return 0; // Nothing to remove
+}
+
+void* pqueue_calendar_peek(pqueue_t *q) {
+    cq_bucket_t* bucket = cq_find_head(q);
+    if (!bucket) return NULL;
+    return bucket->entries[bucket->size - 1];
+}
+
+void* pqueue_calendar_pop(pqueue_t *q) {
+    cq_bucket_t* bucket = cq_find_head(q);
+    if (!bucket) return NULL;
+    void* head = bucket->entries[--bucket->size];
+    q->size--;
+    cq_maybe_shrink(q);
+    return head;
+}
+
+void* pqueue_calendar_find_equal_same_priority(pqueue_t *q, void *e) {
+    pqueue_pri_t pri = q->getpri(e);
+    cq_bucket_t* bucket = cq_bucket_of(q->calendar, pri);
+    // Visit the entries with the same priority in the order they would be popped.
+    size_t first = cq_insertion_point(q, bucket, pri);
+    for (size_t i = bucket->size; i > first; i--) {
+        void* curr = bucket->entries[i - 1];
+        pqueue_pri_t curr_pri = q->getpri(curr);
+        if (curr_pri < pri) continue;
+        if (curr_pri > pri) break;
+        if (q->eqelem(curr, e)) return curr;
+    }
+    return NULL;
+}
+
+void* pqueue_calendar_find_equal(pqueue_t *q, void *e, pqueue_pri_t max) {
+    pqueue_calendar_t* cq = q->calendar;
+    void* found = NULL;
+    pqueue_pri_t found_pri = 0;
+    for (size_t b = 0; b < cq->num_buckets; b++) {
+        cq_bucket_t* bucket = &cq->buckets[b];
+        for (size_t i = bucket->size; i > 0; i--) {
+            void* curr = bucket->entries[i - 1];
+            pqueue_pri_t pri = q->getpri(curr);
+            // Entries are sorted, so the rest of the bucket is beyond the maximum too.
+            if (q->cmppri(pri, max)) break;
+            if ((found == NULL || pri < found_pri) && q->eqelem(curr, e)) {
+                found = curr;
+                found_pri = pri;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+void pqueue_calendar_copy_entries(pqueue_t *q, void **out) {
+    pqueue_calendar_t* cq = q->calendar;
+    size_t n = 0;
+    for (size_t b = 0; b < cq->num_buckets; b++) {
+        memcpy(&out[n], cq->buckets[b].entries, cq->buckets[b].size * sizeof(void*));
+        n += cq->buckets[b].size;
+    }
+}
+
+int pqueue_calendar_is_valid(pqueue_t *q) {
+    pqueue_calendar_t* cq = q->calendar;
+    size_t count = 0;
+    for (size_t b = 0; b < cq->num_buckets; b++) {
+        cq_bucket_t* bucket = &cq->buckets[b];
+        for (size_t i = 0; i < bucket->size; i++) {
+            pqueue_pri_t pri = q->getpri(bucket->entries[i]);
+            if (cq_bucket_of(cq, pri) != bucket) return 0;
+            if (cq_slot(cq, pri) < cq->last_slot) return 0;
+            if (i > 0 && q->getpri(bucket->entries[i - 1]) < pri) return 0;
+        }
+        count += bucket->size;
+    }
+    return count == cq_count(q);
+}
@@ -0,0 +1,181 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_dary.c
+ * @brief A d-ary heap that implements the pqueue_* interface.
+ *
+ * See pqueue_dary.h for an overview. The heap itself is an instance of the
+ * generic heap in impl/dary_heap.h. As for the binary heap, the size of the
+ * pqueue_t is the number of entries plus one.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "pqueue_dary.h"
+#include "util.h"
+
+#ifndef LF_PQUEUE_ARITY
+#define LF_PQUEUE_ARITY 4
+#endif
+
+#define DARY_HEAP(token) pqueue_dary_heap ## _ ## token
+#define E void*
+#define P pqueue_pri_t
+#define ARITY LF_PQUEUE_ARITY
+#define SET_POS(heap, element, position) ((pqueue_t*)(heap)->context)->setpos(element, position)
+#include "impl/dary_heap.h"
+#undef DARY_HEAP
+#undef E
+#undef P
+#undef ARITY
+#undef SET_POS
+
+pqueue_t *
+pqueue_dary_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt) {
+    pqueue_t *q;
+    if (!(q = (pqueue_t*)calloc(1, sizeof(pqueue_t))))
+        return NULL;
+    if (!(q->dary = (pqueue_dary_heap_t*)malloc(sizeof(pqueue_dary_heap_t)))) {
+        free(q);
+        return NULL;
+    }
+    if (!pqueue_dary_heap_init(q->dary, n, q)) {
+        free(q->dary);
+        free(q);
+        return NULL;
+    }
+    q->size = 1;
+    q->cmppri = cmppri;
+    q->getpri = getpri;
+    q->getpos = getpos;
+    q->setpos = setpos;
+    q->eqelem = eqelem;
+    q->prt = prt;
+    return q;
+}
+
+void pqueue_dary_free(pqueue_t *q) {
+    pqueue_dary_heap_destroy(q->dary);
+    free(q->dary);
+    free(q);
+}
+
+int pqueue_dary_insert(pqueue_t *q, void *d) {
+    if (pqueue_dary_heap_insert(q->dary, d, q->getpri(d))) return 1;
+    q->size++;
+    return 0;
+}
+
+int pqueue_dary_insert_all(pqueue_t *q, void **entries, size_t n) {
+    // Rebuilding the heap costs time linear in its size, so it pays off
+    // only when the entries at least double the size of the heap.
+    if (n < q->dary->size) {
+        for (size_t i = 0; i < n; i++) {
+            if (pqueue_dary_insert(q, entries[i])) return 1;
+        }
+        return 0;
+    }
+    int result = 0;
+    for (size_t i = 0; i < n && !result; i++) {
+        result = pqueue_dary_heap_append(q->dary, entries[i], q->getpri(entries[i]));
+        if (!result) q->size++;
+    }
+    pqueue_dary_heap_heapify(q->dary);
+    return result;
+}
+
+int pqueue_dary_remove(pqueue_t *q, void *d) {
+    pqueue_dary_heap_remove_at(q->dary, q->getpos(d));
+    q->size--;
+    return 0;
+}
+
+void* pqueue_dary_pop(pqueue_t *q) {
+    q->size--;
+    return pqueue_dary_heap_pop(q->dary);
+}
+
+void* pqueue_dary_advance_head(pqueue_t *q, pqueue_pri_t new_pri, pqueue_set_pri_f setpri) {
+    void* head = q->dary->entries[0].element;
+    setpri(head, new_pri);
+    q->dary->entries[0].priority = new_pri;
+    pqueue_dary_heap_sift_down(q->dary, 0);
+    return head;
+}
+
+void* pqueue_dary_peek(pqueue_t *q) {
+    return q->dary->entries[0].element;
+}
+
+/**
+ * Find an entry in the subtree rooted at position 'i' that matches 'e' and
+ * has a priority of at most 'max' and, if 'same' is true, at least 'max'.
+ * Subtrees whose root exceeds 'max' are skipped without visiting their
+ * entries.
+ */
+static void* dary_find_equal(pqueue_t *q, void *e, size_t i, pqueue_pri_t max, bool same) {
+    pqueue_dary_heap_entry_t* entries = q->dary->entries;
+    if (i >= q->dary->size || entries[i].priority > max) return NULL;
+    if ((!same || entries[i].priority == max) && q->eqelem(entries[i].element, e)) {
+        return entries[i].element;
+    }
+    size_t end = i * LF_PQUEUE_ARITY + LF_PQUEUE_ARITY;
+    for (size_t child = i * LF_PQUEUE_ARITY + 1; child <= end; child++) {
+        void* found = dary_find_equal(q, e, child, max, same);
+        if (found) return found;
+    }
+    return NULL;
+}
+
+void* pqueue_dary_find_equal_same_priority(pqueue_t *q, void *e) {
+    return dary_find_equal(q, e, 0, q->getpri(e), true);
+}
+
+void* pqueue_dary_find_equal(pqueue_t *q, void *e, pqueue_pri_t max) {
+    return dary_find_equal(q, e, 0, max, false);
+}
+
+void pqueue_dary_copy_entries(pqueue_t *q, void **out) {
+    for (size_t i = 0; i < q->dary->size; i++) {
+        out[i] = q->dary->entries[i].element;
+    }
+}
+
+int pqueue_dary_is_valid(pqueue_t *q) {
+    pqueue_dary_heap_entry_t* entries = q->dary->entries;
+    for (size_t i = 0; i < q->dary->size; i++) {
+        if (entries[i].priority != q->getpri(entries[i].element)) return 0;
+        if (q->getpos(entries[i].element) != i) return 0;
+        if (i > 0 && entries[i].priority < entries[(i - 1) / LF_PQUEUE_ARITY].priority) return 0;
+    }
+    return q->dary->size + 1 == q->size;
+}
@@ -0,0 +1,347 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_level.c
+ * @brief A queue of FIFOs per level that implements the pqueue_* interface.
+ *
+ * See pqueue_level.h for an overview. Each FIFO is an array whose live entries
+ * lie between `head` and `tail`. An entry removed from the middle leaves a
+ * NULL behind, and `head` always points at a live entry of a nonempty FIFO.
+ * The position of an entry in a FIFO is its index in the array, which is
+ * rebased when the array is compacted. The queue keeps track of a level below
+ * which all FIFOs are empty, so that the search of the bitmap for the lowest
+ * nonempty level resumes where the last one ended.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pqueue_level.h"
+#include "pqueue_dary.h"
+#include "util.h"
+
+/** The number of low bits of a priority that hold its level. */
+#define LF_PQUEUE_LEVEL_BITS 16
+
+/** The smallest number of levels. Must be a multiple of 64. */
+#define LQ_MIN_LEVELS 64
+
+#define LQ_LEVEL_MASK ((1ULL << LF_PQUEUE_LEVEL_BITS) - 1)
+
+typedef struct {
+    void** entries;     /**< Live entries and NULLs between head and tail. */
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    size_t count;       /**< The number of live entries. */
+} lq_fifo_t;
+
+typedef struct pqueue_level_t {
+    lq_fifo_t* fifos;
+    uint64_t* nonempty; /**< One bit per level whose FIFO is not empty. */
+    size_t num_levels;  /**< A multiple of 64. */
+    pqueue_pri_t key;   /**< The key of the entries in the FIFOs. */
+    size_t count;       /**< The number of entries in the FIFOs. */
+    size_t lowest;      /**< No FIFO below this level is nonempty. */
+    pqueue_t* heap;     /**< The entries with other keys. */
+} pqueue_level_t;
+
+static inline int lq_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+    while (!(bits & 1ULL)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/** Return the lowest nonempty level. There must be an entry in a FIFO. */
+static size_t lq_lowest_level(pqueue_level_t* lq) {
+    size_t word = lq->lowest / 64;
+    uint64_t bits = lq->nonempty[word] & (~0ULL << (lq->lowest % 64));
+    while (!bits) {
+        bits = lq->nonempty[++word];
+    }
+    lq->lowest = word * 64 + lq_lowest_bit(bits);
+    return lq->lowest;
+}
+
+/** Make room for the given level. @return 0 on success. */
+static int lq_grow_levels(pqueue_level_t* lq, size_t level) {
+    size_t num_levels = lq->num_levels;
+    while (num_levels <= level) num_levels *= 2;
+    lq_fifo_t* fifos = (lq_fifo_t*)realloc(lq->fifos, num_levels * sizeof(lq_fifo_t));
+    if (!fifos) return 1;
+    lq->fifos = fifos;
+    uint64_t* nonempty = (uint64_t*)realloc(lq->nonempty, num_levels / 64 * sizeof(uint64_t));
+    if (!nonempty) return 1;
+    lq->nonempty = nonempty;
+    memset(&fifos[lq->num_levels], 0, (num_levels - lq->num_levels) * sizeof(lq_fifo_t));
+    memset(&nonempty[lq->num_levels / 64], 0, (num_levels - lq->num_levels) / 64 * sizeof(uint64_t));
+    lq->num_levels = num_levels;
+    return 0;
+}
+
+/** Make room at the tail of the FIFO. @return 0 on success. */
+static int lq_make_room(pqueue_t* q, lq_fifo_t* fifo) {
+    if (fifo->head > 0) {
+        // Move the entries to the front of the array.
+        size_t n = fifo->tail - fifo->head;
+        memmove(fifo->entries, &fifo->entries[fifo->head], n * sizeof(void*));
+        for (size_t i = 0; i < n; i++) {
+            if (fifo->entries[i]) q->setpos(fifo->entries[i], i);
+        }
+        fifo->head = 0;
+        fifo->tail = n;
+        return 0;
+    }
+    size_t capacity = fifo->capacity ? 2 * fifo->capacity : 4;
+    void** entries = (void**)realloc(fifo->entries, capacity * sizeof(void*));
+    if (!entries) return 1;
+    fifo->entries = entries;
+    fifo->capacity = capacity;
+    return 0;
+}
+
+/** Account for the removal of an entry of the FIFO of the given level. */
+static void lq_removed(pqueue_t* q, size_t level) {
+    pqueue_level_t* lq = q->level;
+    lq_fifo_t* fifo = &lq->fifos[level];
+    if (--fifo->count == 0) {
+        fifo->head = fifo->tail = 0;
+        lq->nonempty[level / 64] &= ~(1ULL << (level % 64));
+    } else {
+        while (!fifo->entries[fifo->head]) fifo->head++;
+    }
+    lq->count--;
+    q->size--;
+}
+
+/** Return whether the entry is in a FIFO rather than in the heap. */
+static bool lq_in_fifo(pqueue_t* q, void* d, pqueue_pri_t pri) {
+    pqueue_level_t* lq = q->level;
+    size_t level = (size_t)(pri & LQ_LEVEL_MASK);
+    if (lq->count == 0 || (pri >> LF_PQUEUE_LEVEL_BITS) != lq->key || level >= lq->num_levels) {
+        return false;
+    }
+    lq_fifo_t* fifo = &lq->fifos[level];
+    size_t pos = q->getpos(d);
+    return pos >= fifo->head && pos < fifo->tail && fifo->entries[pos] == d;
+}
+
+pqueue_t *
+pqueue_level_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt) {
+    pqueue_t *q;
+    if (!(q = (pqueue_t*)calloc(1, sizeof(pqueue_t))))
+        return NULL;
+    pqueue_level_t* lq = (pqueue_level_t*)calloc(1, sizeof(pqueue_level_t));
+    if (!lq) {
+        free(q);
+        return NULL;
+    }
+    q->level = lq;
+    lq->fifos = (lq_fifo_t*)calloc(LQ_MIN_LEVELS, sizeof(lq_fifo_t));
+    lq->nonempty = (uint64_t*)calloc(LQ_MIN_LEVELS / 64, sizeof(uint64_t));
+    lq->num_levels = LQ_MIN_LEVELS;
+    // Entries with other keys are expected to be few.
+    lq->heap = pqueue_dary_init(n / 4 + 1, cmppri, getpri, getpos, setpos, eqelem, prt);
+    if (!lq->fifos || !lq->nonempty || !lq->heap) {
+        if (lq->heap) pqueue_free(lq->heap);
+        free(lq->fifos);
+        free(lq->nonempty);
+        free(lq);
+        free(q);
+        return NULL;
+    }
+    q->size = 1;
+    q->cmppri = cmppri;
+    q->getpri = getpri;
+    q->getpos = getpos;
+    q->setpos = setpos;
+    q->eqelem = eqelem;
+    q->prt = prt;
+    return q;
+}
+
+void pqueue_level_free(pqueue_t *q) {
+    pqueue_level_t* lq = q->level;
+    for (size_t i = 0; i < lq->num_levels; i++) {
+        free(lq->fifos[i].entries);
+    }
+    free(lq->fifos);
+    free(lq->nonempty);
+    pqueue_free(lq->heap);
+    free(lq);
+    free(q);
+}
+
+int pqueue_level_insert(pqueue_t *q, void *d) {
+    pqueue_level_t* lq = q->level;
+    pqueue_pri_t pri = q->getpri(d);
+    size_t level = (size_t)(pri & LQ_LEVEL_MASK);
+    if (lq->count == 0) {
+        lq->key = pri >> LF_PQUEUE_LEVEL_BITS;
+        lq->lowest = level;
+    } else if ((pri >> LF_PQUEUE_LEVEL_BITS) != lq->key) {
+        if (pqueue_insert(lq->heap, d)) return 1;
+        q->size++;
+        return 0;
+    }
+    if (level >= lq->num_levels && lq_grow_levels(lq, level)) return 1;
+    lq_fifo_t* fifo = &lq->fifos[level];
+    if (fifo->tail == fifo->capacity && lq_make_room(q, fifo)) return 1;
+    fifo->entries[fifo->tail] = d;
+    q->setpos(d, fifo->tail++);
+    if (fifo->count++ == 0) {
+        lq->nonempty[level / 64] |= 1ULL << (level % 64);
+    }
+    if (level < lq->lowest) lq->lowest = level;
+    lq->count++;
+    q->size++;
+    return 0;
+}
+
+int pqueue_level_remove(pqueue_t *q, void *d) {
+    pqueue_pri_t pri = q->getpri(d);
+    if (lq_in_fifo(q, d, pri)) {
+        size_t level = (size_t)(pri & LQ_LEVEL_MASK);
+        q->level->fifos[level].entries[q->getpos(d)] = NULL;
+        lq_removed(q, level);
+        return 0;
+    }
+    if (pqueue_remove(q->level->heap, d)) return 1;
+    q->size--;
+    return 0;
+}
+
+void* pqueue_level_peek(pqueue_t *q) {
+    pqueue_level_t* lq = q->level;
+    void* from_heap = pqueue_peek(lq->heap);
+    if (lq->count == 0) return from_heap;
+    size_t level = lq_lowest_level(lq);
+    lq_fifo_t* fifo = &lq->fifos[level];
+    if (from_heap && q->getpri(from_heap) < ((lq->key << LF_PQUEUE_LEVEL_BITS) | level)) {
+        return from_heap;
+    }
+    return fifo->entries[fifo->head];
+}
+
+void* pqueue_level_pop(pqueue_t *q) {
+    pqueue_level_t* lq = q->level;
+    if (lq->count > 0) {
+        size_t level = lq_lowest_level(lq);
+        void* from_heap = pqueue_peek(lq->heap);
+        if (!from_heap || q->getpri(from_heap) >= ((lq->key << LF_PQUEUE_LEVEL_BITS) | level)) {
+            lq_fifo_t* fifo = &lq->fifos[level];
+            void* head = fifo->entries[fifo->head++];
+            lq_removed(q, level);
+            return head;
+        }
+    }
+    q->size--;
+    return pqueue_pop(lq->heap);
+}
+
+/** Return the first entry of the FIFO of the given level that matches 'e', or NULL. */
+static void* lq_find_in_fifo(pqueue_t* q, size_t level, void* e) {
+    lq_fifo_t* fifo = &q->level->fifos[level];
+    for (size_t i = fifo->head; i < fifo->tail; i++) {
+        if (fifo->entries[i] && q->eqelem(fifo->entries[i], e)) return fifo->entries[i];
+    }
+    return NULL;
+}
+
+void* pqueue_level_find_equal_same_priority(pqueue_t *q, void *e) {
+    pqueue_level_t* lq = q->level;
+    pqueue_pri_t pri = q->getpri(e);
+    size_t level = (size_t)(pri & LQ_LEVEL_MASK);
+    if (lq->count > 0 && (pri >> LF_PQUEUE_LEVEL_BITS) == lq->key && level < lq->num_levels) {
+        void* found = lq_find_in_fifo(q, level, e);
+        if (found) return found;
+    }
+    return pqueue_find_equal_same_priority(lq->heap, e);
+}
+
+void* pqueue_level_find_equal(pqueue_t *q, void *e, pqueue_pri_t max) {
+    pqueue_level_t* lq = q->level;
+    void* from_heap = pqueue_find_equal(lq->heap, e, max);
+    if (lq->count == 0 || (max >> LF_PQUEUE_LEVEL_BITS) < lq->key) return from_heap;
+    pqueue_pri_t base = lq->key << LF_PQUEUE_LEVEL_BITS;
+    for (size_t level = lq_lowest_level(lq); level < lq->num_levels && base + level <= max; level++) {
+        if (from_heap && q->getpri(from_heap) <= base + level) break;
+        if (lq->fifos[level].count == 0) continue;
+        void* found = lq_find_in_fifo(q, level, e);
+        if (found) return found;
+    }
+    return from_heap;
+}
+
+void pqueue_level_copy_entries(pqueue_t *q, void **out) {
+    pqueue_level_t* lq = q->level;
+    pqueue_copy_entries(lq->heap, out);
+    size_t n = pqueue_size(lq->heap);
+    for (size_t level = 0; level < lq->num_levels; level++) {
+        lq_fifo_t* fifo = &lq->fifos[level];
+        for (size_t i = fifo->head; i < fifo->tail; i++) {
+            if (fifo->entries[i]) out[n++] = fifo->entries[i];
+        }
+    }
+}
+
+int pqueue_level_is_valid(pqueue_t *q) {
+    pqueue_level_t* lq = q->level;
+    if (!pqueue_is_valid(lq->heap)) return 0;
+    size_t count = 0;
+    for (size_t level = 0; level < lq->num_levels; level++) {
+        lq_fifo_t* fifo = &lq->fifos[level];
+        bool nonempty = (lq->nonempty[level / 64] >> (level % 64)) & 1ULL;
+        if (nonempty != (fifo->count > 0)) return 0;
+        if (fifo->count == 0) continue;
+        if (level < lq->lowest || !fifo->entries[fifo->head]) return 0;
+        size_t live = 0;
+        for (size_t i = fifo->head; i < fifo->tail; i++) {
+            void* d = fifo->entries[i];
+            if (!d) continue;
+            if (q->getpri(d) != ((lq->key << LF_PQUEUE_LEVEL_BITS) | level)) return 0;
+            if (q->getpos(d) != i) return 0;
+            live++;
+        }
+        if (live != fifo->count) return 0;
+        count += live;
+    }
+    return count == lq->count && q->size == 1 + pqueue_size(lq->heap) + lq->count;
+}
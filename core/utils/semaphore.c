@@ -34,6 +34,23 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "semaphore.h"
 #include <assert.h>
 
+#if defined(PLATFORM_Linux)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+
+/** Sleep while the count of the semaphore is zero, which the kernel checks atomically. */
+static void _lf_semaphore_sleep(lf_semaphore_t* semaphore) {
+    syscall(SYS_futex, (int*)&semaphore->count, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 0, NULL, NULL, 0);
+}
+
+/** Wake up to 'n' threads sleeping on the semaphore. */
+static void _lf_semaphore_wake(lf_semaphore_t* semaphore, int n) {
+    syscall(SYS_futex, (int*)&semaphore->count, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, NULL, NULL, 0);
+}
+#endif
+
 /**
  * @brief Create a new semaphore.
  *
@@ -42,9 +59,13 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 lf_semaphore_t* lf_semaphore_new(int count) {
     lf_semaphore_t* semaphore = (lf_semaphore_t*)malloc(sizeof(lf_semaphore_t));
+    if (semaphore == NULL) {
+        return NULL;
+    }
     lf_mutex_init(&semaphore->mutex);
     lf_cond_init(&semaphore->cond, &semaphore->mutex);
     semaphore->count = count;
+    semaphore->waiters = 0;
     return semaphore;
 }
 
@@ -56,10 +77,47 @@ lf_semaphore_t* lf_semaphore_new(int count) {
  */
 void lf_semaphore_release(lf_semaphore_t* semaphore, int i) {
     assert(semaphore != NULL);
+    if (i <= 0) {
+        return;
+    }
+    // This is a full barrier, so a thread that registers as a waiter after the
+    // check below sees the new count before it sleeps.
+    lf_atomic_fetch_add(&semaphore->count, i);
+    if (semaphore->waiters == 0) {
+        return;
+    }
+#if defined(PLATFORM_Linux)
+    _lf_semaphore_wake(semaphore, i);
+#else
     lf_mutex_lock(&semaphore->mutex);
-    semaphore->count += i;
     lf_cond_broadcast(&semaphore->cond);
     lf_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+/**
+ * @brief Sleep until the count of the 'semaphore' is not 0, or, if 'acquire'
+ * is true, until it is acquired.
+ */
+static void _lf_semaphore_block(lf_semaphore_t* semaphore, bool acquire) {
+    lf_atomic_fetch_add(&semaphore->waiters, 1);
+#if defined(PLATFORM_Linux)
+    while (acquire ? !lf_semaphore_try_acquire(semaphore) : semaphore->count == 0) {
+        _lf_semaphore_sleep(semaphore);
+    }
+    if (!acquire && semaphore->waiters > 1) {
+        // This thread took one of the wakeups meant for acquirers without
+        // taking a count, so pass it on.
+        _lf_semaphore_wake(semaphore, 1);
+    }
+#else
+    lf_mutex_lock(&semaphore->mutex);
+    while (acquire ? !lf_semaphore_try_acquire(semaphore) : semaphore->count == 0) {
+        lf_cond_wait(&semaphore->cond);
+    }
+    lf_mutex_unlock(&semaphore->mutex);
+#endif
+    lf_atomic_fetch_add(&semaphore->waiters, -1);
 }
 
 /**
@@ -69,12 +127,46 @@ void lf_semaphore_release(lf_semaphore_t* semaphore, int i) {
  */
 void lf_semaphore_acquire(lf_semaphore_t* semaphore) {
     assert(semaphore != NULL);
-    lf_mutex_lock(&semaphore->mutex);
-    while (semaphore->count == 0) {
-        lf_cond_wait(&semaphore->cond);
+    if (!lf_semaphore_try_acquire(semaphore)) {
+        _lf_semaphore_block(semaphore, true);
     }
-    semaphore->count--;
-    lf_mutex_unlock(&semaphore->mutex);
+}
+
+/**
+ * @brief Acquire the 'semaphore' if its count is not 0. Never blocks.
+ *
+ * @param semaphore Instance of a semaphore.
+ * @return true if the semaphore was acquired.
+ */
+bool lf_semaphore_try_acquire(lf_semaphore_t* semaphore) {
+    assert(semaphore != NULL);
+    int count = semaphore->count;
+    while (count > 0) {
+        if (lf_bool_compare_and_swap(&semaphore->count, count, count - 1)) {
+            return true;
+        }
+        count = semaphore->count;
+    }
+    return false;
+}
+
+/**
+ * @brief Busy-wait for up to 'spins' iterations for the 'semaphore' to be
+ * released and acquire it if it is.
+ *
+ * @param semaphore Instance of a semaphore.
+ * @param spins The maximum number of iterations to spin.
+ * @return true if the semaphore was acquired, false if the spin budget ran out.
+ */
+bool lf_semaphore_spin_acquire(lf_semaphore_t* semaphore, unsigned int spins) {
+    assert(semaphore != NULL);
+    for (unsigned int i = 0; i < spins; i++) {
+        // Only attempt the atomic update once the count looks non-zero.
+        if (semaphore->count > 0 && lf_semaphore_try_acquire(semaphore)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
@@ -84,11 +176,9 @@ void lf_semaphore_acquire(lf_semaphore_t* semaphore) {
  */
 void lf_semaphore_wait(lf_semaphore_t* semaphore) {
     assert(semaphore != NULL);
-    lf_mutex_lock(&semaphore->mutex);
-    while (semaphore->count == 0) {
-        lf_cond_wait(&semaphore->cond);
+    if (semaphore->count == 0) {
+        _lf_semaphore_block(semaphore, false);
     }
-    lf_mutex_unlock(&semaphore->mutex);
 }
 
 /**
@@ -41,6 +41,10 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <time.h>       // Defines nanosleep()
 #include <stdbool.h>      
 
+#if (defined(LF_ASYNC_LOGGING) && !defined(LF_SINGLE_THREADED)) || defined(LF_BINARY_LOGGING)
+#include "platform.h"
+#endif
+
 #ifndef NUMBER_OF_FEDERATES
 #define NUMBER_OF_FEDERATES 1
 #endif
@@ -72,6 +76,152 @@ int lf_fed_id() {
 	return _lf_my_fed_id;
 }
 
+/** The size of the buffer on the stack that holds the format of a message with its prefix. */
+#define MESSAGE_FORMAT_SIZE 256
+
+#if defined(LF_ASYNC_LOGGING) && !defined(LF_SINGLE_THREADED)
+
+/** The number of messages that a thread can have waiting to be written, a power of two. */
+#ifndef LF_ASYNC_LOG_SLOTS
+#define LF_ASYNC_LOG_SLOTS 128
+#endif
+
+/** The maximum length of a message written asynchronously, including its newline. */
+#ifndef LF_ASYNC_LOG_SLOT_SIZE
+#define LF_ASYNC_LOG_SLOT_SIZE 256
+#endif
+
+/** How long the writer thread sleeps when no message is waiting. */
+#define LF_ASYNC_LOG_INTERVAL MSEC(1)
+
+/**
+ * The messages of one thread waiting to be written. Only the thread appends
+ * messages, by advancing the tail, and only the thread that holds
+ * _lf_log_draining writes them out, by advancing the head.
+ */
+typedef struct _lf_log_ring_t {
+    struct _lf_log_ring_t* next;
+    volatile size_t head;
+    volatile size_t tail;
+    struct {
+        size_t length;
+        char text[LF_ASYNC_LOG_SLOT_SIZE];
+    } slots[LF_ASYNC_LOG_SLOTS];
+} _lf_log_ring_t;
+
+/** The rings of all threads that have logged, which are never freed. */
+static _lf_log_ring_t* volatile _lf_log_rings = NULL;
+
+/** The ring of the calling thread, created when it first logs. */
+static LF_THREAD_LOCAL _lf_log_ring_t* _lf_log_ring = NULL;
+
+/** Whether a thread is writing out the messages of the rings. */
+static volatile bool _lf_log_draining = false;
+
+/** Whether the writer thread has been started. */
+static volatile bool _lf_log_writer_started = false;
+
+/** The number of messages dropped because the ring of their thread was full. */
+static volatile int _lf_log_dropped = 0;
+
+/**
+ * Write out the messages waiting in the rings of all threads, followed by
+ * the number of messages dropped since the last time, if any.
+ */
+static void _lf_log_drain(void) {
+    while (!lf_bool_compare_and_swap(&_lf_log_draining, false, true)) {
+        // Another thread is writing out the messages.
+    }
+    bool written = false;
+    for (_lf_log_ring_t* ring = _lf_log_rings; ring != NULL; ring = ring->next) {
+        size_t tail = ring->tail;
+        // Read the messages only after reading the tail that covers them.
+        lf_memory_barrier();
+        for (size_t head = ring->head; head != tail; head++) {
+            size_t slot = head & (LF_ASYNC_LOG_SLOTS - 1);
+            fwrite(ring->slots[slot].text, 1, ring->slots[slot].length, stdout);
+            written = true;
+        }
+        lf_memory_barrier();
+        ring->head = tail;
+    }
+    int dropped = _lf_log_dropped;
+    if (dropped > 0) {
+        lf_atomic_fetch_add(&_lf_log_dropped, -dropped);
+        fprintf(stdout, "WARNING: Dropped %d log messages.\n", dropped);
+        written = true;
+    }
+    if (written) fflush(stdout);
+    lf_memory_barrier();
+    _lf_log_draining = false;
+}
+
+/**
+ * Body of the thread that writes out the messages of the rings.
+ */
+static void* _lf_log_writer(void* arg) {
+    while (true) {
+        _lf_log_drain();
+        lf_sleep(LF_ASYNC_LOG_INTERVAL);
+    }
+    return NULL;
+}
+
+/**
+ * Render the message into the ring of the calling thread to be written out
+ * by the writer thread, or count it as dropped if the ring is full.
+ * @return False if the message is too long to be written asynchronously.
+ */
+static bool _lf_log_capture(const char* prefix, const char* format, va_list args) {
+    _lf_log_ring_t* ring = _lf_log_ring;
+    if (ring == NULL) {
+        ring = (_lf_log_ring_t*)calloc(1, sizeof(_lf_log_ring_t));
+        if (ring == NULL) return false;
+        do {
+            ring->next = _lf_log_rings;
+        } while (!lf_bool_compare_and_swap(&_lf_log_rings, ring->next, ring));
+        _lf_log_ring = ring;
+        if (lf_bool_compare_and_swap(&_lf_log_writer_started, false, true)) {
+            lf_thread_t writer;
+            atexit(lf_flush_log);
+            lf_thread_create(&writer, _lf_log_writer, NULL);
+        }
+    }
+    size_t tail = ring->tail;
+    if (tail - ring->head == LF_ASYNC_LOG_SLOTS) {
+        lf_atomic_fetch_add(&_lf_log_dropped, 1);
+        return true;
+    }
+    char* text = ring->slots[tail & (LF_ASYNC_LOG_SLOTS - 1)].text;
+    int length = (_lf_my_fed_id < 0)
+        ? snprintf(text, LF_ASYNC_LOG_SLOT_SIZE, "%s", prefix)
+        : snprintf(text, LF_ASYNC_LOG_SLOT_SIZE, "Federate %d: %s", _lf_my_fed_id, prefix);
+    if (length >= 0 && length < LF_ASYNC_LOG_SLOT_SIZE) {
+        int added = vsnprintf(text + length, LF_ASYNC_LOG_SLOT_SIZE - length, format, args);
+        length = (added < 0) ? -1 : length + added;
+    }
+    // Leave room for the newline.
+    if (length < 0 || length >= LF_ASYNC_LOG_SLOT_SIZE - 1) return false;
+    text[length++] = '\n';
+    ring->slots[tail & (LF_ASYNC_LOG_SLOTS - 1)].length = (size_t)length;
+    // Publish the message only after writing it.
+    lf_memory_barrier();
+    ring->tail = tail + 1;
+    return true;
+}
+
+void lf_flush_log(void) {
+    if (_lf_log_writer_started) _lf_log_drain();
+}
+
+#else
+
+void lf_flush_log(void) {
+    fflush(stdout);
+}
+
+#endif // LF_ASYNC_LOGGING
+
 // Declaration needed to attach attributes to suppress warnings of the form:
 // "warning: function '_lf_message_print' might be a candidate for 'gnu_printf'
 // format attribute [-Wsuggest-attribute=format]"
@@ -79,6 +229,281 @@ void _lf_message_print(
 		int is_error, const char* prefix, const char* format, va_list args, int log_level
 ) ATTRIBUTE_FORMAT_PRINTF(3, 0);
 
+const char* _lf_binary_log_file = "lf_log.lfb";
+
+#if defined(LF_BINARY_LOGGING)
+
+/** The size of the buffer of each thread for the binary log. */
+#define BINARY_LOG_BUFFER_SIZE 65536
+
+/** The maximum size of a record in the binary log. */
+#define BINARY_LOG_MAX_RECORD_SIZE (32 + LF_BINARY_LOG_MAX_ARGS * 256)
+
+/** The kinds of arguments, with BINARY_LOG_UNSIGNED added for unsigned integers. */
+enum {
+    BINARY_LOG_INT = 1,
+    BINARY_LOG_LONG,
+    BINARY_LOG_LONG_LONG,
+    BINARY_LOG_SIZE,
+    BINARY_LOG_INTMAX,
+    BINARY_LOG_PTRDIFF,
+    BINARY_LOG_DOUBLE,
+    BINARY_LOG_LONG_DOUBLE,
+    BINARY_LOG_STRING,
+    BINARY_LOG_POINTER
+};
+#define BINARY_LOG_UNSIGNED 0x80
+
+/** A buffer of records of one thread that have not been written to the log yet. */
+typedef struct _lf_binary_log_buffer_t {
+    struct _lf_binary_log_buffer_t* next;
+    size_t used;
+    unsigned char data[BINARY_LOG_BUFFER_SIZE];
+} _lf_binary_log_buffer_t;
+
+static _lf_binary_log_buffer_t* volatile _lf_binary_log_buffers = NULL;
+static LF_THREAD_LOCAL _lf_binary_log_buffer_t* _lf_binary_log_buffer = NULL;
+static FILE* _lf_binary_log_stream = NULL;
+static volatile bool _lf_binary_log_locked = false;
+static volatile int _lf_binary_log_sites = 0;
+
+/**
+ * Return the kinds of the arguments that the format consumes in 'kinds'.
+ * @return The number of arguments or -1 if there are too many.
+ */
+static int _lf_binary_log_parse(const char* format, unsigned char* kinds) {
+    int count = 0;
+    for (const char* p = format; *p != '\0'; p++) {
+        if (*p != '%') continue;
+        p++;
+        if (*p == '%') continue;
+        while (*p != '\0' && strchr("-+ #0'", *p) != NULL) p++;
+        // A width or precision of '*' is an argument of type int.
+        for (int i = 0; i < 2; i++) {
+            if (*p == '*') {
+                if (count == LF_BINARY_LOG_MAX_ARGS) return -1;
+                kinds[count++] = BINARY_LOG_INT;
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9') p++;
+            }
+            if (i == 0 && *p == '.') p++;
+            else if (i == 0) break;
+        }
+        unsigned char kind = BINARY_LOG_INT;
+        if (*p == 'h') {
+            while (*p == 'h') p++;
+        } else if (*p == 'l') {
+            kind = (p[1] == 'l') ? BINARY_LOG_LONG_LONG : BINARY_LOG_LONG;
+            p += (p[1] == 'l') ? 2 : 1;
+        } else if (*p == 'z') {
+            kind = BINARY_LOG_SIZE; p++;
+        } else if (*p == 'j') {
+            kind = BINARY_LOG_INTMAX; p++;
+        } else if (*p == 't') {
+            kind = BINARY_LOG_PTRDIFF; p++;
+        } else if (*p == 'L') {
+            kind = BINARY_LOG_LONG_DOUBLE; p++;
+        }
+        switch (*p) {
+            case '\0':
+                return count;
+            case 'd': case 'i': case 'c':
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                kind |= BINARY_LOG_UNSIGNED;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (kind != BINARY_LOG_LONG_DOUBLE) kind = BINARY_LOG_DOUBLE;
+                break;
+            case 's':
+                kind = BINARY_LOG_STRING;
+                break;
+            default:
+                // Pointers, and %n, which is not honored.
+                kind = BINARY_LOG_POINTER;
+        }
+        if (count == LF_BINARY_LOG_MAX_ARGS) return -1;
+        kinds[count++] = kind;
+    }
+    return count;
+}
+
+/** Append the specified bytes to the binary log, opening it first if needed. */
+static void _lf_binary_log_write(const unsigned char* data, size_t length) {
+    while (!lf_bool_compare_and_swap(&_lf_binary_log_locked, false, true)) {
+        // Another thread is writing to the log.
+    }
+    if (_lf_binary_log_stream == NULL) {
+        _lf_binary_log_stream = fopen(_lf_binary_log_file, "wb");
+        if (_lf_binary_log_stream != NULL) {
+            uint32_t version = 1;
+            fwrite("LFBL", 1, 4, _lf_binary_log_stream);
+            fwrite(&version, sizeof(version), 1, _lf_binary_log_stream);
+            atexit(lf_flush_binary_log);
+        } else {
+            fprintf(stderr, "WARNING: Failed to open the binary log %s.\n", _lf_binary_log_file);
+        }
+    }
+    if (_lf_binary_log_stream != NULL) {
+        fwrite(data, 1, length, _lf_binary_log_stream);
+    }
+    lf_memory_barrier();
+    _lf_binary_log_locked = false;
+}
+
+void lf_flush_binary_log(void) {
+    for (_lf_binary_log_buffer_t* buffer = _lf_binary_log_buffers; buffer != NULL; buffer = buffer->next) {
+        if (buffer->used > 0) {
+            _lf_binary_log_write(buffer->data, buffer->used);
+            buffer->used = 0;
+        }
+    }
+    if (_lf_binary_log_stream != NULL) fflush(_lf_binary_log_stream);
+}
+
+/** Append the specified bytes to a record in the buffer, which has room for them. */
+static inline void _lf_binary_log_put(_lf_binary_log_buffer_t* buffer, const void* data, size_t length) {
+    memcpy(buffer->data + buffer->used, data, length);
+    buffer->used += length;
+}
+
+/** Append a string of up to 'max' bytes, preceded by its length. */
+static void _lf_binary_log_put_string(_lf_binary_log_buffer_t* buffer, const char* string, size_t max) {
+    size_t length = strlen(string);
+    if (length > max) length = max;
+    if (max > UINT8_MAX) {
+        uint16_t prefix = (uint16_t)length;
+        _lf_binary_log_put(buffer, &prefix, sizeof(prefix));
+    } else {
+        uint8_t prefix = (uint8_t)length;
+        _lf_binary_log_put(buffer, &prefix, sizeof(prefix));
+    }
+    _lf_binary_log_put(buffer, string, length);
+}
+
+void _lf_binary_log(lf_log_site_t* site, ...) {
+    va_list args;
+    va_start(args, site);
+    int id = site->id;
+    unsigned char kinds[LF_BINARY_LOG_MAX_ARGS];
+    bool define = false;
+    if (id == 0) {
+        // First message of the site. Each racing thread finds the same arguments.
+        int num_args = _lf_binary_log_parse(site->format, kinds);
+        site->num_args = num_args;
+        memcpy(site->kinds, kinds, sizeof(kinds));
+        lf_memory_barrier();
+        id = lf_atomic_add_fetch(&_lf_binary_log_sites, 1);
+        define = lf_bool_compare_and_swap(&site->id, 0, id);
+        if (!define) id = site->id;
+    } else {
+        lf_memory_barrier();
+    }
+    if (site->num_args < 0) {
+        // Too many arguments to record them.
+        _lf_message_print(0, site->level == LOG_LEVEL_DEBUG ? "DEBUG: " : "LOG: ", site->format, args, site->level);
+        va_end(args);
+        return;
+    }
+
+    _lf_binary_log_buffer_t* buffer = _lf_binary_log_buffer;
+    if (buffer == NULL) {
+        buffer = (_lf_binary_log_buffer_t*)calloc(1, sizeof(_lf_binary_log_buffer_t));
+        if (buffer == NULL) {
+            va_end(args);
+            return;
+        }
+        do {
+            buffer->next = _lf_binary_log_buffers;
+        } while (!lf_bool_compare_and_swap(&_lf_binary_log_buffers, buffer->next, buffer));
+        _lf_binary_log_buffer = buffer;
+    }
+    if (buffer->used + 2 * BINARY_LOG_MAX_RECORD_SIZE > BINARY_LOG_BUFFER_SIZE) {
+        _lf_binary_log_write(buffer->data, buffer->used);
+        buffer->used = 0;
+    }
+
+    uint32_t fields[3];
+    if (define) {
+        // Record what the offline decoder needs to render the messages of the site.
+        uint8_t num_args = (uint8_t)site->num_args;
+        _lf_binary_log_put(buffer, "D", 1);
+        fields[0] = (uint32_t)id;
+        fields[1] = (uint32_t)site->level;
+        fields[2] = (uint32_t)site->line;
+        _lf_binary_log_put(buffer, fields, sizeof(fields));
+        _lf_binary_log_put_string(buffer, site->file, 1024);
+        _lf_binary_log_put_string(buffer, site->format, 8192 - 1024);
+        _lf_binary_log_put(buffer, &num_args, 1);
+        _lf_binary_log_put(buffer, site->kinds, num_args);
+    }
+    _lf_binary_log_put(buffer, "E", 1);
+    fields[0] = (uint32_t)id;
+    _lf_binary_log_put(buffer, fields, sizeof(uint32_t));
+    // The length of the rest of the entry, filled in below, lets the decoder
+    // skip entries that precede the definition of their site.
+    size_t length_offset = buffer->used;
+    buffer->used += sizeof(uint16_t);
+    // Read the clock directly because lf_time_physical() itself logs.
+    instant_t now = 0;
+    _lf_clock_now(&now);
+    _lf_binary_log_put(buffer, &now, sizeof(now));
+    for (int i = 0; i < site->num_args; i++) {
+        unsigned char kind = site->kinds[i];
+        bool is_unsigned = (kind & BINARY_LOG_UNSIGNED) != 0;
+        uint64_t value = 0;
+        double real;
+        switch (kind & ~BINARY_LOG_UNSIGNED) {
+            case BINARY_LOG_INT:
+                value = is_unsigned ? (uint64_t)va_arg(args, unsigned int) : (uint64_t)(int64_t)va_arg(args, int);
+                break;
+            case BINARY_LOG_LONG:
+                value = is_unsigned ? (uint64_t)va_arg(args, unsigned long) : (uint64_t)(int64_t)va_arg(args, long);
+                break;
+            case BINARY_LOG_LONG_LONG:
+                value = is_unsigned ? (uint64_t)va_arg(args, unsigned long long) : (uint64_t)va_arg(args, long long);
+                break;
+            case BINARY_LOG_SIZE:
+                value = (uint64_t)va_arg(args, size_t);
+                break;
+            case BINARY_LOG_INTMAX:
+                value = (uint64_t)va_arg(args, intmax_t);
+                break;
+            case BINARY_LOG_PTRDIFF:
+                value = (uint64_t)(int64_t)va_arg(args, ptrdiff_t);
+                break;
+            case BINARY_LOG_DOUBLE:
+                real = va_arg(args, double);
+                memcpy(&value, &real, sizeof(value));
+                break;
+            case BINARY_LOG_LONG_DOUBLE:
+                real = (double)va_arg(args, long double);
+                memcpy(&value, &real, sizeof(value));
+                break;
+            case BINARY_LOG_STRING: {
+                const char* string = va_arg(args, const char*);
+                _lf_binary_log_put_string(buffer, string != NULL ? string : "(null)", UINT8_MAX);
+                continue;
+            }
+            default:
+                value = (uint64_t)(uintptr_t)va_arg(args, void*);
+        }
+        _lf_binary_log_put(buffer, &value, sizeof(value));
+    }
+    va_end(args);
+    uint16_t length = (uint16_t)(buffer->used - length_offset - sizeof(uint16_t));
+    memcpy(buffer->data + length_offset, &length, sizeof(length));
+}
+
+#else // LF_BINARY_LOGGING
+
+void lf_flush_binary_log(void) {
+    // Messages are printed as text.
+}
+
+#endif // LF_BINARY_LOGGING
+
 /**
  * Internal implementation of the next few reporting functions.
  */
@@ -102,13 +527,27 @@ void _lf_message_print(
 		print_level = LOG_LEVEL_INFO;
 	}
 	if (log_level <= print_level) {
+#if defined(LF_ASYNC_LOGGING) && !defined(LF_SINGLE_THREADED)
+		if (!is_error && print_message_function == NULL) {
+			va_list copy;
+			va_copy(copy, args);
+			bool captured = _lf_log_capture(prefix, format, copy);
+			va_end(copy);
+			if (captured) return;
+		}
+		// Write out the messages that precede this one.
+		lf_flush_log();
+#endif
 		// Rather than calling printf() multiple times, we need to call it just
 		// once because this function is invoked by multiple threads.
 		// If we make multiple calls to printf(), then the results could be
 		// interleaved between threads.
 		// vprintf() is a version that takes an arg list rather than multiple args.
+		// The format is assembled on the stack unless it is unusually long.
+		char buffer[MESSAGE_FORMAT_SIZE];
 		size_t length = strlen(prefix) + strlen(format) + 32;
-		char* message = (char*) malloc(length + 1);
+		char* message = (length < sizeof(buffer)) ? buffer : (char*) malloc(length + 1);
+		if (message == NULL) return;
 		if (_lf_my_fed_id < 0) {
 			snprintf(message, length, "%s%s\n",
 					prefix, format);
@@ -125,7 +564,7 @@ void _lf_message_print(
 		} else {
 			(*print_message_function)(message, args);
 		}
-		free(message);
+		if (message != buffer) free(message);
 	}
 }
 
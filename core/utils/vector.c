@@ -5,22 +5,42 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "vector.h"
 
 #define REQUIRED_VOTES_TO_SHRINK 15
 #define CAPACITY_TO_SIZE_RATIO_FOR_SHRINK_VOTE 4
 #define SCALE_FACTOR 2
+#define MINIMUM_CAPACITY 4
 
 static void vector_resize(vector_t* v, size_t new_capacity);
 
+/**
+ * Grow the given vector to a capacity of at least `required` elements, at
+ * least doubling its capacity. This counts as a reason not to shrink it.
+ * @param v A vector that is to grow.
+ * @param required The number of elements that the vector must be able to hold.
+ */
+static void vector_grow(vector_t* v, size_t required) {
+    size_t capacity = (v->end - v->start) * SCALE_FACTOR;
+    if (capacity < MINIMUM_CAPACITY) capacity = MINIMUM_CAPACITY;
+    while (capacity < required) capacity *= SCALE_FACTOR;
+    v->votes_required++;
+    vector_resize(v, capacity);
+}
+
 /**
  * Allocate and initialize a new vector.
  * @param initial_capacity The desired initial capacity to allocate.
+ *  If it is 0, nothing is allocated until the first element is added.
  */
 vector_t vector_new(size_t initial_capacity) {
-    void** start = (void**) malloc(initial_capacity * sizeof(void*));
-    assert(start);
+    void** start = NULL;
+    if (initial_capacity > 0) {
+        start = (void**) malloc(initial_capacity * sizeof(void*));
+        assert(start);
+    }
     return (vector_t) {
         .start = start,
         .next = start,
@@ -46,8 +66,7 @@ void vector_free(vector_t* v) {
  */
 void vector_push(vector_t* v, void* element) {
     if (v->next == v->end) {
-        v->votes_required++;
-        vector_resize(v, (v->end - v->start) * SCALE_FACTOR);
+        vector_grow(v, (v->end - v->start) + 1);
     }
     *(v->next++) = element;
 }
@@ -60,17 +79,49 @@ void vector_push(vector_t* v, void* element) {
  * @param size The size of the given array.
  */
 void vector_pushall(vector_t* v, void** array, size_t size) {
-    void** required_end = v->next + size;
-    if (required_end > v->end) {
-        vector_resize(v, (required_end - v->start) * SCALE_FACTOR);
-    }
     for (size_t i = 0; i < size; i++) {
         assert(array[i]);
-        v->next[i] = array[i];
     }
+    vector_extend(v, array, size);
+}
+
+/**
+ * Add all elements of the given array to the vector, which may include
+ * null elements.
+ * @param v A vector that is to grow.
+ * @param array An array of items to be added to the vector.
+ * @param size The size of the given array.
+ */
+void vector_extend(vector_t* v, void** array, size_t size) {
+    if (size == 0) return;
+    size_t required = vector_size(v) + size;
+    if (required > (size_t) (v->end - v->start)) {
+        vector_grow(v, required);
+    }
+    memcpy(v->next, array, size * sizeof(void*));
     v->next += size;
 }
 
+/**
+ * Make sure that the vector can hold the given number of elements without
+ * allocating memory.
+ * @param v Any vector.
+ * @param capacity The number of elements.
+ */
+void vector_reserve(vector_t* v, size_t capacity) {
+    if (capacity > (size_t) (v->end - v->start)) {
+        vector_resize(v, capacity);
+    }
+}
+
+/**
+ * Remove all elements from the vector, keeping its memory.
+ * @param v Any vector.
+ */
+void vector_clear(vector_t* v) {
+    v->next = v->start;
+}
+
 /**
  * Remove and return some pointer that is contained in the given vector,
  * or return NULL if the given vector is empty.
@@ -103,21 +154,15 @@ void* vector_pop(vector_t* v) {
  * @return A pointer to the element at 'idx', which is itself a pointer.
  */
 void** vector_at(vector_t* v, size_t idx) {
-    void** vector_position = v->start + idx;
-    if ((vector_position + 1) > v->next) {
-        v->next = vector_position + 1;
-    }
-    if (v->next >= v->end) {
-        v->votes_required++;
-        size_t new_size = (v->end - v->start) * SCALE_FACTOR;
-        // Find a size that includes idx
-        while (new_size <= idx) {
-            new_size *= SCALE_FACTOR;
+    size_t size = vector_size(v);
+    if (idx >= size) {
+        if (idx >= (size_t) (v->end - v->start)) {
+            vector_grow(v, idx + 1);
         }
-        vector_resize(v, new_size);
+        // Elements that were never set are NULL.
+        memset(v->start + size, 0, (idx + 1 - size) * sizeof(void*));
+        v->next = v->start + idx + 1;
     }
-    // Note: Can't re-use vector_position because v->start can move after
-    // resizing.
     return v->start + idx;
 }
 
@@ -157,6 +157,52 @@ trigger_handle_t lf_schedule_copy(void* action, interval_t offset, void* value,
  */
 trigger_handle_t lf_schedule_value(void* action, interval_t extra_delay, void* value, int length);
 
+/**
+ * Schedule several actions at once, each with a token as a payload.
+ * The effect is that of calling lf_schedule_token() for each request in
+ * order, but the critical section is entered and anyone waiting for new
+ * events is notified only once for each run of requests whose actions
+ * belong to the same environment. Events are inserted into the event queue
+ * together, which is considerably cheaper for large bursts of events, such
+ * as samples received from the network.
+ *
+ * @param requests The actions to schedule with their delays and tokens.
+ * @param count The number of requests.
+ * @param handles An array of at least count entries that receives the
+ *  handle returned for each request, or NULL if the handles are not needed.
+ * @return The number of requests for which an error (-1) was returned.
+ */
+int lf_schedule_batch(lf_schedule_request_t* requests, size_t count, trigger_handle_t* handles);
+
+/**
+ * Bound the number of events of a physical action that may be queued at once,
+ * so that producers that schedule it faster than its reactions keep up do not
+ * make the event queue and the latency grow without bound. A schedule that
+ * would exceed the bound is handled according to the policy: the oldest queued
+ * event is dropped, the new one is dropped, its value replaces that of the
+ * latest queued event, or the calling thread waits until an event has been
+ * handled (see lf_overflow_policy_t). lf_get_overflow_stats() reports how
+ * often each of these happened.
+ *
+ * Physical actions are unbounded by default. Their bounds may be set or
+ * changed at any time, typically by a startup reaction.
+ *
+ * @param action The physical action.
+ * @param max_queued The bound, or 0 to remove it.
+ * @param policy What a schedule that would exceed the bound does.
+ * @return 0 on success, or -1 if the action is not physical.
+ */
+int lf_set_action_bound(void* action, size_t max_queued, lf_overflow_policy_t policy);
+
+/**
+ * Store how often schedules of a physical action have hit the bound set with
+ * lf_set_action_bound(), by outcome.
+ *
+ * @param action The physical action.
+ * @param stats The place to store the statistics.
+ */
+void lf_get_overflow_stats(void* action, lf_overflow_stats_t* stats);
+
 /**
  * Check the deadline of the currently executing reaction against the
  * current physical time. If the deadline has passed, invoke the deadline
@@ -170,6 +216,47 @@ trigger_handle_t lf_schedule_value(void* action, interval_t extra_delay, void* v
  */
 bool lf_check_deadline(void* self, bool invoke_deadline_handler);
 
+/**
+ * Execute the iterations 0 to count - 1 of a loop in chunks of 'grain'
+ * consecutive iterations, some of which workers of the environment of the
+ * reactor that have no reaction to execute may take on, and return once all
+ * chunks are executed. The calling reaction executes chunks too, and executes
+ * all of them if no worker is idle, if the scheduler does not lend its idle
+ * workers, as only the NP and GEDF_NP schedulers do, or in the single-threaded
+ * runtime. The chunks are not reactions, so the calling reaction is simply
+ * done once they are.
+ *
+ * As chunks may execute concurrently on other threads, the body must not
+ * call functions of this API, such as lf_set() or lf_schedule(), and must not
+ * write to memory that other chunks access.
+ *
+ * @param self The self struct of the reactor.
+ * @param count The number of iterations.
+ * @param grain The number of iterations per chunk, or 0 to let the runtime
+ *  give each worker several chunks.
+ * @param body The function that executes a range of iterations.
+ * @param arg The argument to pass to the body.
+ */
+void lf_parallel_for(void* self, size_t count, size_t grain, lf_parallel_body_t body, void* arg);
+
+/**
+ * Allocate memory for use by a reaction until the end of the current tag, at
+ * which point it is reclaimed in bulk along with all other such memory of the
+ * environment of the reactor, so it must not be freed. The memory is not
+ * zeroed and is aligned like memory returned by malloc(). Each worker bumps a
+ * pointer in a per-tag arena of its own, so this is much cheaper than a call to
+ * malloc() and free() for a temporary buffer of a reaction.
+ *
+ * The memory must not be used after the tag, so it must not be the payload of a
+ * token, which may outlive the tag, such as one given to lf_set_array() or
+ * lf_schedule_token(). Payloads of tokens are recycled by a pool of their own.
+ *
+ * @param self The self struct of the reactor.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void* lf_scratch_alloc(void* self, size_t size);
+
 /**
  * Compare two tags. Return -1 if the first is less than
  * the second, 0 if they are equal, and +1 if the first is
@@ -79,6 +79,30 @@ do { \
         _LF_SET(out, val); \
 } while (0)
 
+/**
+ * Set the channels of the specified output multiport (or multiport input of
+ * a contained reactor) from 'start' up to but not including 'start + count'
+ * to the specified value, as if lf_set() were called on each of them.
+ * The channels are marked present in one operation, which is cheaper than
+ * calling lf_set() in a loop when many channels are written at once.
+ * If the value is a pointer to dynamically allocated memory, the channels
+ * share one token, so the memory is freed once after the last reader.
+ * @param out The output multiport (by name).
+ * @param start The first channel to set.
+ * @param count The number of channels to set.
+ * @param val The value to insert into the channels.
+ */
+#define lf_set_range(out, start, count, val) _LF_SET_RANGE(out, start, count, val)
+
+/**
+ * Set every channel of the specified output multiport (or multiport input
+ * of a contained reactor) to the specified value. See lf_set_range().
+ * This uses the width variable that is in scope in the reaction body.
+ * @param out The output multiport (by name).
+ * @param val The value to insert into the channels.
+ */
+#define lf_set_all(out, val) _LF_SET_RANGE(out, 0, out##_width, val)
+
 /**
  * Version of lf_set for output types given as `type[]` or `type*` where you
  * want to send a previously dynamically allocated array.
@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Checkpoints of the state of an environment, from which a restarted program resumes.
+ *
+ * A checkpoint holds the tag of an environment, its pending events with the
+ * payloads of their tokens, and the state regions registered with
+ * lf_checkpoint_register_state(). Triggers and state regions are identified by
+ * name, so that they are found again in the restarted program, which must be
+ * the same program. The data is written in the byte order and layout of the
+ * machine, and tokens whose type has a destructor or a copy constructor cannot
+ * be saved because their payload refers to other memory.
+ *
+ * A reaction requests a checkpoint with lf_request_checkpoint(). It is written
+ * when the current tag completes, before the environment advances to the next
+ * one, when no reaction of the environment executes. Given the --resume option,
+ * the program starts from the checkpoint in the specified file instead of the
+ * start tag, without startup reactions and initial timer events. Logical time
+ * is shifted so that the elapsed logical time of the checkpoint coincides with
+ * the physical time at the restart. If the file does not exist, the program
+ * starts normally. Environments other than the first one get their id appended
+ * to the file name, as with --sched-state.
+ *
+ * Modes, the values of ports, and the state of federates are not part of a
+ * checkpoint.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lf_types.h"
+
+/**
+ * @brief Register a trigger whose pending events are saved in checkpoints.
+ * This is meant to be called when the trigger objects are initialized.
+ * @param env The environment of the trigger.
+ * @param name A name of the trigger that is unique in the environment and the
+ *  same in every run of the program, such as its fully qualified name.
+ * @param trigger The trigger.
+ */
+void lf_checkpoint_register_trigger(environment_t* env, const char* name, trigger_t* trigger);
+
+/**
+ * @brief Register a region of memory, such as the state variables of a reactor,
+ * that is saved in checkpoints and restored upon resumption.
+ * The region must not contain pointers.
+ * @param env The environment of the reactor.
+ * @param name A name of the region that is unique in the environment and the
+ *  same in every run of the program.
+ * @param state The region.
+ * @param size The size of the region in bytes.
+ */
+void lf_checkpoint_register_state(environment_t* env, const char* name, void* state, size_t size);
+
+/**
+ * @brief Return the name with which 'trigger' is registered, or NULL if it is not registered.
+ * @param env The environment of the trigger.
+ * @param trigger The trigger.
+ */
+const char* _lf_checkpoint_name_of_trigger(environment_t* env, trigger_t* trigger);
+
+/**
+ * @brief Return the trigger registered with the name given by the first 'length'
+ * characters of 'name', or NULL if there is none.
+ * @param env The environment of the trigger.
+ * @param name The name, which need not be terminated by a null character.
+ * @param length The length of the name.
+ */
+trigger_t* _lf_checkpoint_trigger_named(environment_t* env, const char* name, size_t length);
+
+/**
+ * @brief Request a checkpoint of the specified environment when its current tag
+ * completes. A later request at the same tag replaces an earlier one.
+ * @param env The environment.
+ * @param file_name The file to write the checkpoint to, which is replaced
+ *  only once the checkpoint is complete.
+ */
+void lf_request_checkpoint(environment_t* env, const char* file_name);
+
+/**
+ * @brief Write a checkpoint of the specified environment. This assumes that the
+ * caller holds the mutex of the environment and that no reaction of the
+ * environment executes, as between two tags.
+ * @param env The environment.
+ * @param file_name The file to write the checkpoint to, without the id of the environment.
+ * @return 0 on success or -1 if the checkpoint could not be written.
+ */
+int lf_checkpoint_save(environment_t* env, const char* file_name);
+
+/**
+ * @brief Write the checkpoint requested during the tag that just completed, if any.
+ * This assumes that the caller holds the mutex of the environment.
+ * @param env The environment.
+ */
+void _lf_checkpoint_at_tag_end(environment_t* env);
+
+/**
+ * @brief Restore the specified environment from the checkpoint given with the
+ * --resume option, if any. This is to be called instead of triggering the
+ * startup reactions and initializing the timers of the environment, after its
+ * start and stop tags have been initialized.
+ * @param env The environment.
+ * @return Whether the environment was restored from a checkpoint.
+ */
+bool _lf_checkpoint_resume(environment_t* env);
+
+/**
+ * @brief Free the registrations of the specified environment.
+ * @param env The environment.
+ */
+void _lf_checkpoint_free(environment_t* env);
+
+#endif // CHECKPOINT_H
@@ -56,6 +56,42 @@ typedef struct mode_environment_t mode_environment_t;
  */
 #define GLOBAL_ENVIRONMENT NULL
 
+/**
+ * @brief A contiguous chunk of events owned by an environment.
+ * Events that are not in use are linked through their `next` field into the
+ * free list of the environment, so getting and recycling an event never
+ * allocates or frees memory once enough slabs exist.
+ */
+typedef struct lf_event_slab_t {
+    struct lf_event_slab_t* next;
+    size_t size;
+    event_t events[];
+} lf_event_slab_t;
+
+/**
+ * @brief The reactions downstream of each output of a reaction, flattened across
+ * the triggers of the output, without duplicates, and sorted by index, hence by
+ * level. The reactions of output i are `reactions[offsets[i]]` up to, but not
+ * including, `reactions[offsets[i + 1]]`. A fan-out is built when its reaction
+ * first produces an output and is freed with the environment.
+ */
+typedef struct lf_fan_out_t {
+    struct lf_fan_out_t* next;
+    size_t* offsets;
+    reaction_t** reactions;
+} lf_fan_out_t;
+
+/**
+ * @brief A growable list of the is_present fields that one worker thread has set
+ * in the current tag. Each worker appends only to its own list, so marking a port
+ * present does not contend with other workers.
+ */
+typedef struct lf_present_list_t {
+    bool** fields;
+    int size;
+    int capacity;
+} lf_present_list_t;
+
 /**
  * @brief Execution environment.
  * This struct contains information about the execution environment.
@@ -70,8 +106,22 @@ typedef struct environment_t {
     tag_t current_tag;
     tag_t stop_tag;
     pqueue_t *event_q;
-    pqueue_t *recycle_q;
-    pqueue_t *next_q;
+    event_t* free_events;
+    struct lf_event_slab_t* event_slabs;
+    struct lf_fan_out_t* fan_outs; // The fan-outs of the reactions that have produced outputs.
+    struct lf_checkpoint_registry_t* checkpoint; // What checkpoints of this environment hold, if anything.
+    struct lf_replay_t* replay; // The recording and replay of the inputs of this environment, if any.
+    size_t events_allocated;
+    size_t events_live;
+    size_t events_peak;
+    size_t event_budget; // The number of events preallocated from the memory profile or 0 if none.
+    lf_token_t** token_copies; // Lists of tokens allocated in reactions, one per worker and one shared.
+    int num_token_copy_lists;
+    struct lf_scratch_chunk_t** scratch_arenas; // Chunks of memory from lf_scratch_alloc(), one list per token copy list.
+    size_t scratch_bytes; // Bytes reserved by the scratch arenas.
+    vector_t next_microstep;
+    vector_t draining_microstep;
+    vector_t* batched_events;
     bool** is_present_fields;
     int is_present_fields_size;
     bool** is_present_fields_abbreviated;
@@ -80,6 +130,7 @@ typedef struct environment_t {
     trigger_handle_t _lf_handle;
     trigger_t** timer_triggers;
     int timer_triggers_size;
+    trigger_t* timer_groups;
     reaction_t** startup_reactions;
     int startup_reactions_size;
     reaction_t** shutdown_reactions;
@@ -88,6 +139,16 @@ typedef struct environment_t {
     int reset_reactions_size;
     mode_environment_t* modes;
     trace_t* trace;
+#ifdef LF_REACTION_STATS
+    struct lf_reaction_stats_t* reaction_stats; // Statistics of the reactions that have executed.
+#endif
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    bool* port_presence;                  // Contiguous presence flags of the ports that have been bound.
+    int* port_presence_group;             // The first slot of the group of each slot.
+    int* port_presence_width;             // The width of the group starting at a slot, or -1 if it is shared.
+    int port_presence_size;
+    int port_presence_used;
+#endif
 #if defined(LF_SINGLE_THREADED)
     pqueue_t *reaction_q;
 #else
@@ -95,9 +156,22 @@ typedef struct environment_t {
     lf_thread_t* thread_ids;
     lf_mutex_t mutex;
     lf_cond_t event_q_changed;
+    lf_cond_t bounded_event_handled; // Signaled for producers blocked on a bounded physical action.
+    int producers_blocked; // Threads waiting in lf_schedule() for a bounded physical action.
     lf_scheduler_t* scheduler;
     _lf_tag_advancement_barrier barrier;
     lf_cond_t global_tag_barrier_requestors_reached_zero;
+    struct _lf_inbox_entry_t* volatile inbox;
+    struct lf_enclave_channel_t* incoming_channels; // Channels from other enclaves into this one.
+    instant_t sleeping_until;
+    volatile unsigned int notifications; // Counts calls to lf_notify_of_event() so that a thread spinning without the mutex sees new events.
+    lf_present_list_t* present_lists; // One per worker.
+    int worker_slots_claimed;
+    struct watchdog_service_t* watchdog_service; // The service of the watchdogs of this environment, if any.
+    int min_workers; // Workers reserved for this environment in the pool shared by enclaves.
+    int worker_priority; // Priority of this environment for the workers of the pool beyond the minimum.
+    int workers_executing; // Workers of this environment executing reactions, if the pool is shared.
+    int workers_waiting; // Workers of this environment waiting for the shared pool.
 #endif // LF_SINGLE_THREADED
 #if defined(FEDERATED)
     tag_t** _lf_intended_tag_fields;
@@ -112,6 +186,10 @@ struct mode_environment_t {
     int modal_reactor_states_size;
     mode_state_variable_reset_data_t* state_resets;
     int state_resets_size;
+    char* state_reset_snapshot; // The initial values of the state variables reset by all modes.
+    _lf_suspended_event_t* unused_suspended_events; // Reusable elements of the lists of suspended events.
+    _lf_suspended_event_t* allocated_suspended_events; // Last allocated element of the lists of suspended events.
+    size_t suspended_events_size; // Number of events suspended in all modes.
 };
 #endif
 
@@ -138,6 +216,21 @@ int environment_init(
  */
 void environment_free(environment_t* env);
 
+/**
+ * @brief Set the bounds of the number of workers of an environment and its
+ * priority in the pool of workers that enclaves share (see worker_pool.h).
+ * This resizes what environment_init() allocated per worker, so it must be called
+ * right after it, before the scheduler of the environment is initialized.
+ * It does nothing in the single-threaded runtime.
+ * @param env The environment.
+ * @param min_workers The number of workers that the environment can always use.
+ * @param max_workers The number of worker threads of the environment, or 0 for
+ *  the number of workers of the program.
+ * @param priority The priority of the environment when the shared workers are
+ *  contended. Higher values have precedence.
+ */
+void environment_set_workers(environment_t* env, int min_workers, int max_workers, int priority);
+
 /**
  * @brief Initialize the start and stop tags on the environment struct.
  */
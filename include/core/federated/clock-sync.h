@@ -49,6 +49,48 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define _LF_CLOCK_SYNC_ATTENUATION 10
 #endif
 
+/**
+ * With _LF_CLOCK_SYNC_DRIFT_COMPENSATION, clock synchronization estimates the
+ * drift of the local clock with a proportional-integral (PI) controller and
+ * slews the physical clock rather than stepping it. At the end of each
+ * synchronization interval, the average clock error divided by the duration of
+ * the interval is the rate of correction needed. The estimated drift accumulates
+ * this rate times the integral gain, and the clock then drifts at the estimated
+ * drift plus this rate times the proportional gain until the next interval.
+ * Gains are in percent.
+ */
+#ifndef _LF_CLOCK_SYNC_PROPORTIONAL_GAIN
+#define _LF_CLOCK_SYNC_PROPORTIONAL_GAIN 70
+#endif
+
+/** Integral gain, in percent, of the drift compensation. */
+#ifndef _LF_CLOCK_SYNC_INTEGRAL_GAIN
+#define _LF_CLOCK_SYNC_INTEGRAL_GAIN 30
+#endif
+
+/**
+ * Bound, in nanoseconds per second, on the rate at which the drift compensation
+ * changes the physical clock, which keeps the physical clock monotonic.
+ */
+#define CLOCK_SYNC_MAX_DRIFT USEC(500)
+
+/**
+ * Clock error beyond which the drift compensation steps the physical clock
+ * rather than slewing it, as slewing would take too long.
+ */
+#ifndef _LF_CLOCK_SYNC_STEP_THRESHOLD
+#define _LF_CLOCK_SYNC_STEP_THRESHOLD MSEC(1)
+#endif
+
+/**
+ * Bound, in nanoseconds per second, on the drift of the physical clock relative
+ * to the clock of the RTI, by which the bound given by lf_clock_sync_error_bound()
+ * grows between synchronizations. This must be positive.
+ */
+#ifndef _LF_CLOCK_SYNC_DRIFT_BOUND
+#define _LF_CLOCK_SYNC_DRIFT_BOUND USEC(100)
+#endif
+
 /**
  * Define a guard band to filter clock synchronization
  * messages based on discrepancies in the network delay.
@@ -88,6 +130,8 @@ typedef struct socket_stat_t {
     /*** Clock sync stats ***/
     interval_t clock_synchronization_error_bound; // A bound on the differences between this federate's clock and
                                                   // the remote clock.
+    interval_t window_round_trip_delay_max;       // Maximum round trip delay in the current sync window.
+    interval_t window_clock_error_sum;            // Sum of the estimated clock errors in the current sync window.
     // Note: The following array should come last because g++ will not allow 
     // designated initialization (e.g., .network_stat_sample_index = 0) out of 
     // order and we do not want to (and cannot) initialize this array statically
@@ -198,4 +242,25 @@ void* listen_to_rti_UDP_thread(void* args);
  */
 int create_clock_sync_thread(lf_thread_t* thread_id);
 
+/**
+ * Return a bound on the difference between the physical clock of this federate
+ * and that of the RTI. At the end of a synchronization interval, this is half the
+ * largest round trip delay to the RTI in the interval plus the clock error left
+ * uncorrected, and it grows by _LF_CLOCK_SYNC_DRIFT_BOUND until the next one.
+ * With _LF_CLOCK_SYNC_EXTERNAL, this is the maximum error reported by the
+ * external source instead.
+ * @return The bound, or FOREVER if it is unknown, e.g., if clock synchronization is off.
+ */
+interval_t lf_clock_sync_error_bound(void);
+
+/**
+ * Return the STA offset to apply to the current tag. With _LF_CLOCK_SYNC_ADAPTIVE_STP
+ * defined, its value is the part of the STP offset set by lf_set_stp_offset() that
+ * allows for clock synchronization error, which this replaces by twice the current
+ * bound given by lf_clock_sync_error_bound() when that is smaller, assuming
+ * that the other federates are synchronized no worse than this one. Otherwise, this
+ * is the STP offset.
+ */
+interval_t _lf_adaptive_STA_offset(void);
+
 #endif // CLOCK_SYNC_H
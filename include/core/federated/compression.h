@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * Compression of the bodies of messages between federates.
+ *
+ * A federate compiled with FEDERATED_COMPRESSION_LZ4 or
+ * FEDERATED_COMPRESSION_ZSTD offers the algorithms it supports to each peer
+ * it sends messages to (see MSG_TYPE_P2P_COMPRESSION), and the peer picks
+ * one it also supports. Bodies of at least FEDERATED_COMPRESSION_THRESHOLD
+ * bytes sent to the peer are then compressed with that algorithm, unless
+ * compressing them does not make them smaller
+ * (see MSG_TYPE_P2P_COMPRESSED_MESSAGE).
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of bytes below which message bodies are sent uncompressed.
+ */
+#ifndef FEDERATED_COMPRESSION_THRESHOLD
+#define FEDERATED_COMPRESSION_THRESHOLD 1024
+#endif
+
+/**
+ * The compression level. For zstd, this is the level passed to
+ * ZSTD_compress(), where 0 selects the default of the library and negative
+ * levels trade ratio for speed. For LZ4, a level of 0 or less selects the
+ * fast compressor, and a positive level selects the high compression
+ * compressor with that level.
+ */
+#ifndef FEDERATED_COMPRESSION_LEVEL
+#define FEDERATED_COMPRESSION_LEVEL 0
+#endif
+
+/**
+ * Compression algorithms. Each is a bit in the set of algorithms a federate
+ * offers to its peers.
+ */
+typedef enum {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_LZ4 = 1,
+    COMPRESSION_ZSTD = 2
+} compression_t;
+
+/**
+ * Return the set of algorithms that this federate supports, as bits,
+ * or 0 if it was compiled without support for compression.
+ */
+uint8_t compression_supported(void);
+
+/**
+ * Return the algorithm that this federate prefers among the given ones,
+ * or COMPRESSION_NONE if it supports none of them.
+ * @param offered A set of algorithms, as bits.
+ */
+compression_t compression_choose(uint8_t offered);
+
+/**
+ * Return the name of the given algorithm, for use in messages.
+ */
+const char* compression_name(compression_t algorithm);
+
+/**
+ * Return the number of bytes that compressing a body of the given length with
+ * the given algorithm can take in the worst case, or 0 if the algorithm is
+ * not supported.
+ * @param algorithm The algorithm.
+ * @param length The length of the body.
+ */
+size_t compression_bound(compression_t algorithm, size_t length);
+
+/**
+ * Compress the given body with the given algorithm.
+ * @param algorithm The algorithm, which must be supported.
+ * @param length The length of the body.
+ * @param body The body.
+ * @param capacity The size of the destination, normally compression_bound().
+ * @param destination Where to put the compressed body.
+ * @return The length of the compressed body, or 0 if compression failed.
+ */
+size_t compression_compress(
+        compression_t algorithm,
+        size_t length,
+        const unsigned char* body,
+        size_t capacity,
+        unsigned char* destination);
+
+/**
+ * Decompress the given compressed body.
+ * @param algorithm The algorithm with which the body was compressed.
+ * @param length The length of the compressed body.
+ * @param compressed The compressed body.
+ * @param original_length The length of the body before compression.
+ * @param destination Where to put the body, which has room for original_length bytes.
+ * @return 0 on success, or -1 if the algorithm is not supported, the
+ *  compressed body is corrupt, or it does not decompress to original_length bytes.
+ */
+int compression_decompress(
+        compression_t algorithm,
+        size_t length,
+        const unsigned char* compressed,
+        size_t original_length,
+        unsigned char* destination);
+
+#endif // COMPRESSION_H
@@ -32,17 +32,82 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef FEDERATE_H
 #define FEDERATE_H
 
+#include <netinet/in.h>
 #include <stdbool.h>
 
 #include "tag.h"
 #include "lf_types.h"
 #include "environment.h"
 #include "platform.h"
+#include "compression.h"
+#include "outbound_queue.h"
+#include "socket_poller.h"
 
 #ifndef ADVANCE_MESSAGE_INTERVAL
 #define ADVANCE_MESSAGE_INTERVAL MSEC(10)
 #endif
 
+/**
+ * The minimum delay, in nanoseconds, between the tag at which this federate
+ * sends a message and the tag of the message, across all of its outgoing
+ * connections. If positive, it is declared to the RTI, which can then grant
+ * downstream federates tags further ahead, and sending a message with an
+ * earlier tag is an error.
+ */
+#ifndef FEDERATED_MIN_OUTPUT_DELAY
+#define FEDERATED_MIN_OUTPUT_DELAY 0LL
+#endif
+
+/**
+ * The size in bytes of the largest datagram in which, with
+ * FEDERATED_UDP_PHYSICAL, a message of a physical connection is sent,
+ * header included (see MSG_TYPE_P2P_DATAGRAM). Larger messages go through the
+ * socket. The default fits in the payload of an Ethernet frame.
+ */
+#ifndef FEDERATED_UDP_MAX_DATAGRAM
+#define FEDERATED_UDP_MAX_DATAGRAM 1472
+#endif
+
+/**
+ * The largest number of segments into which the serializer of a port (see
+ * lf_port_serializer_t) may split a value.
+ */
+#ifndef FEDERATED_MAX_SEGMENTS
+#define FEDERATED_MAX_SEGMENTS 16
+#endif
+
+/**
+ * The serializer of the values of a network port whose type is not a
+ * contiguous byte buffer, for example a struct that points to other memory.
+ * Rather than packing a value into a buffer, the sender describes it as a list
+ * of segments, which are copied straight into the outbound queue of the
+ * connection (see send_timed_value()). The receiver reads the body of a message
+ * for the port and deserializes it directly into the payload of the token that
+ * carries it (see lf_set_port_serializer()), so that the reactions of the port
+ * get the value rather than its serialized form.
+ */
+typedef struct lf_port_serializer_t {
+    /**
+     * Describe the serialized form of the given value as a list of segments,
+     * which stay valid until the send returns.
+     * @param value The value.
+     * @param segments Where to put the segments, in order.
+     * @param max_segments The number of segments that fit, FEDERATED_MAX_SEGMENTS.
+     * @return The number of segments, or -1 if more are needed.
+     */
+    int (*gather)(void* value, struct iovec* segments, int max_segments);
+    /**
+     * Deserialize the given body of a message into the given value, which has
+     * the element size of the type of the port and is freed with the
+     * destructor of that type, if any.
+     * @param length The length of the body.
+     * @param body The body.
+     * @param value The value to fill in.
+     * @return 0 on success, or -1 if the body is malformed.
+     */
+    int (*scatter)(size_t length, const unsigned char* body, void* value);
+} lf_port_serializer_t;
+
 /**
  * Structure that a federate instance uses to keep track of its own state.
  */
@@ -59,9 +124,18 @@ typedef struct federate_instance_t {
      */
     lf_thread_t RTI_socket_listener;
 
+    /**
+     * The poller that waits for messages from the RTI and from other
+     * federates on FEDERATED_LISTENER_THREADS threads, instead of the
+     * listener threads. If FEDERATED_LISTENER_THREADS is defined, this is
+     * opened by connect_to_rti(). While it is not open, its threads field
+     * is NULL and there is a listener thread per socket.
+     */
+    socket_poller_t socket_poller;
+
     /**
      * Thread responsible for setting ports to absent by an STAA offset if they
-     * aren't already known.
+     * aren't already known. This is not used with FEDERATED_EVENT_DRIVEN_STAA.
      */
     #ifdef FEDERATED_DECENTRALIZED
     lf_thread_t staaSetter;
@@ -81,6 +155,14 @@ typedef struct federate_instance_t {
      */
     lf_thread_t *inbound_socket_listeners;
 
+    /**
+     * Number of threads at the start of inbound_socket_listeners that read
+     * transports (see transport.h), which the socket poller cannot watch, for
+     * connections handed over by the socket poller. This is zero unless the
+     * socket poller is open.
+     */
+    size_t number_of_transport_listeners;
+
     /**
      * Number of outbound peer-to-peer connections from the federate.
      * This can be either physical connections, or logical connections
@@ -118,6 +200,62 @@ typedef struct federate_instance_t {
      */
     int sockets_for_outbound_p2p_connections[NUMBER_OF_FEDERATES];
 
+    /**
+     * The queue of messages waiting to be written to the RTI.
+     * This is opened by connect_to_rti() and its writer thread is started by
+     * synchronize_with_other_federates().
+     */
+    outbound_queue_t outbound_queue_to_RTI;
+
+    /**
+     * The queues of messages waiting to be written to the sockets in
+     * sockets_for_outbound_p2p_connections, indexed the same way.
+     * Each is opened by connect_to_federate() when the socket is opened.
+     */
+    outbound_queue_t outbound_queues_for_p2p_connections[NUMBER_OF_FEDERATES];
+
+    /**
+     * The algorithm with which the bodies of large messages sent to each
+     * remote federate are compressed, indexed by the federate ID of the remote
+     * receiving federate, or COMPRESSION_NONE. Each is set by
+     * connect_to_federate() if the federate accepts MSG_TYPE_P2P_COMPRESSION.
+     */
+    compression_t compression_for_p2p_connections[NUMBER_OF_FEDERATES];
+
+    /**
+     * The UDP socket on which this federate receives the messages of physical
+     * connections sent as datagrams (see MSG_TYPE_P2P_DATAGRAM), or -1. With
+     * FEDERATED_UDP_PHYSICAL, this is opened by create_server() and read by
+     * the udp_datagram_listener thread.
+     */
+    int udp_socket_for_inbound_datagrams;
+
+    /**
+     * Thread that reads the udp_socket_for_inbound_datagrams socket.
+     */
+    lf_thread_t udp_datagram_listener;
+
+    /**
+     * The UDP socket from which this federate sends the messages of physical
+     * connections as datagrams, or -1. This is opened by connect_to_federate()
+     * once a federate accepts MSG_TYPE_P2P_UDP.
+     */
+    int udp_socket_for_outbound_datagrams;
+
+    /**
+     * The addresses to which messages of physical connections to each remote
+     * federate are sent as datagrams, indexed by the federate ID of the remote
+     * receiving federate. The port of an address is 0 unless the federate has
+     * accepted MSG_TYPE_P2P_UDP.
+     */
+    struct sockaddr_in udp_addresses_for_p2p_connections[NUMBER_OF_FEDERATES];
+
+    /**
+     * The sequence numbers of the last datagrams sent to each remote federate,
+     * indexed by the federate ID of the remote receiving federate.
+     */
+    uint32_t udp_sequence_numbers[NUMBER_OF_FEDERATES];
+
     /**
      * Thread ID for a thread that accepts sockets and then supervises
      * listening to those sockets for incoming P2P (physical) connections.
@@ -242,7 +380,9 @@ void send_neighbor_structure_to_RTI(int);
 /**
  * @brief Spawns a thread to iterate through STAA structs, setting its associated ports absent
  * at an offset if the port is not present with a value by a certain physical time.
- * 
+ * With FEDERATED_EVENT_DRIVEN_STAA, no thread is spawned. Instead, a worker stalled
+ * in stall_advance_level_federation() waits only until the earliest such offset
+ * and then sets the ports absent itself.
  */
 #ifdef FEDERATED_DECENTRALIZED
 void spawn_staa_thread(void);
@@ -342,6 +482,10 @@ void* handle_p2p_connections_from_federates(void*);
  *  program, -1 is passed.
  * @param port_ID The ID of the receiving port.
  * @param fed_ID The fed ID of the receiving federate.
+ *
+ * With FEDERATED_BATCH_MESSAGES, the port is added to a batch of ports
+ * found absent at the same tag for the same federate
+ * (see MSG_TYPE_PORT_ABSENT_BATCH).
  */
 void send_port_absent_to_federate(environment_t* env, interval_t, unsigned short, unsigned short);
 
@@ -360,6 +504,13 @@ void enqueue_port_absent_reactions(environment_t* env);
  */
 void stall_advance_level_federation(environment_t* env, size_t level);
 
+/**
+ * @brief End the batches of timed and port absent messages being built for
+ * the RTI and for other federates so that they get written. With FEDERATED_BATCH_MESSAGES,
+ * this is called at the end of each tag and before waiting for network inputs.
+ */
+void _lf_end_outbound_batches(void);
+
 /**
  * @brief Update the max level allowed to advance (MLAA).
  * If the specified tag is greater than the current_tag of the top-level environment
@@ -378,8 +529,9 @@ bool update_max_level(tag_t tag, bool is_provisional);
 
 /**
  * Send a message to another federate directly or via the RTI.
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
- * which it acquires to perform the send.
+ * The message is copied into the outbound queue of the destination and
+ * written by that queue's writer thread, so this does not wait for the network
+ * unless the queue is full.
  *
  * If the socket connection to the remote federate or the RTI has been broken,
  * then this returns 0 without sending. Otherwise, it returns 1.
@@ -417,8 +569,9 @@ int send_message(int message_type,
  * If the socket connection to the remote federate or the RTI has been broken,
  * then this returns 0 without sending. Otherwise, it returns 1.
  *
- * This method assumes that the caller does not hold the outbound_socket_mutex lock,
- * which it acquires to perform the send.
+ * The message is copied into the outbound queue of the destination and
+ * written by that queue's writer thread, so this does not wait for the network
+ * unless the queue is full.
  *
  * @note This function is similar to send_message() except that it
  *   sends timed messages and also contains logics related to time.
@@ -449,6 +602,46 @@ int send_timed_message(environment_t*,
                         size_t,
                         unsigned char*);
 
+/**
+ * Send the specified value as a timestamped message, as send_timed_message()
+ * does, but with the body given by the segments that the specified serializer
+ * describes rather than by a contiguous buffer. The segments are copied
+ * straight into the outbound queue, or written with a single gathering write
+ * before it is started, so the value is never packed into a temporary buffer.
+ * A body that is to be compressed is the exception, since the compression
+ * needs a contiguous input.
+ *
+ * @param env The environment in which we are executing
+ * @param additional_delay As for send_timed_message().
+ * @param message_type As for send_timed_message().
+ * @param port The ID of the destination port.
+ * @param federate The ID of the destination federate.
+ * @param next_destination_str As for send_timed_message().
+ * @param serializer The serializer of the values of the port.
+ * @param value The value.
+ * @return 1 if the message has been sent, 0 otherwise.
+ */
+int send_timed_value(environment_t* env,
+                        interval_t additional_delay,
+                        int message_type,
+                        unsigned short port,
+                        unsigned short federate,
+                        const char* next_destination_str,
+                        const lf_port_serializer_t* serializer,
+                        void* value);
+
+/**
+ * Deserialize the messages received for the specified network input port
+ * with the scatter function of the specified serializer, into a token whose
+ * payload has the element size of the type of the port, instead of handing
+ * the reactions of the port the serialized bytes. This is to be called during
+ * initialization, before any message can arrive.
+ * @param port_id The ID of the network input port.
+ * @param serializer The serializer, which must outlive the execution, or NULL
+ *  to receive the serialized bytes.
+ */
+void lf_set_port_serializer(int port_id, const lf_port_serializer_t* serializer);
+
 /**
  * Synchronize the start with other federates via the RTI.
  * This assumes that a connection to the RTI is already made
@@ -217,14 +217,22 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FED_COM_BUFFER_SIZE 256u
 
 /**
- * Number of nanoseconds that elapse between a federate's attempts
+ * Maximum number of nanoseconds that elapse between a federate's attempts
  * to connect to the RTI.
  */
 #define CONNECT_RETRY_INTERVAL 2000000000LL
 
+/**
+ * Number of nanoseconds that elapse before a federate's first retry to connect
+ * to the RTI. The interval doubles with each retry up to CONNECT_RETRY_INTERVAL,
+ * and a random fraction of up to half of it is subtracted so that federates that
+ * start together do not retry together.
+ */
+#define CONNECT_RETRY_INITIAL_INTERVAL 10000000LL
+
 /**
  * Bound on the number of retries to connect to the RTI.
- * A federate will retry every CONNECT_RETRY_INTERVAL seconds
+ * A federate will retry at most every CONNECT_RETRY_INTERVAL seconds
  * this many times before giving up. E.g., 500 retries every
  * 2 seconds results in retrying for about 16 minutes.
  */
@@ -685,6 +693,175 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MSG_TYPE_NEIGHBOR_STRUCTURE 24
 #define MSG_TYPE_NEIGHBOR_STRUCTURE_HEADER_SIZE 9
 
+/**
+ * Byte identifying a batch of timestamped messages that a federate sends, at
+ * the same tag, to ports of the same destination federate. This is a variant
+ * of @see MSG_TYPE_TAGGED_MESSAGE that pays for the header and the write once
+ * for many small messages. Federates send batches only when compiled with
+ * FEDERATED_BATCH_MESSAGES. The header has the same layout as that of
+ * MSG_TYPE_TAGGED_MESSAGE, so the RTI forwards it the same way:
+ *
+ * The next two bytes are unused and set to zero.
+ * The next two bytes are the destination federate ID.
+ * The four bytes after that will be the length of the entries that follow.
+ * The next eight bytes will be the timestamp of the messages.
+ * The next four bytes will be the microstep of the messages.
+ *
+ * The remaining bytes are the entries, each of which is:
+ * two bytes for the ID of the destination port,
+ * four bytes for the length of the message,
+ * and then the message.
+ *
+ * With decentralized coordination, batches are sent peer-to-peer and are
+ * marked with MSG_TYPE_P2P_TAGGED_MESSAGE_BATCH.
+ */
+#define MSG_TYPE_TAGGED_MESSAGE_BATCH 25
+
+/**
+ * Byte identifying a batch of timestamped messages sent directly to another
+ * federate. This is to @see MSG_TYPE_TAGGED_MESSAGE_BATCH what
+ * MSG_TYPE_P2P_TAGGED_MESSAGE is to MSG_TYPE_TAGGED_MESSAGE.
+ */
+#define MSG_TYPE_P2P_TAGGED_MESSAGE_BATCH 26
+
+/**
+ * Byte identifying an offer to send the messages of a P2P connection through
+ * a ring in shared memory instead of the socket (see shm_ring.h). A federate
+ * compiled with FEDERATED_SHARED_MEMORY sends this as the first message after
+ * MSG_TYPE_P2P_SENDING_FED_ID has been acknowledged, if the address that the
+ * RTI gave for the remote federate in reply to MSG_TYPE_ADDRESS_QUERY is an
+ * address of its own host.
+ *
+ * The next byte is the length of the name of the shared memory object.
+ * The remaining bytes are the name.
+ *
+ * The remote federate replies on the socket with MSG_TYPE_ACK if it has
+ * attached to the ring, after which the sender writes all further messages
+ * into the ring, or with MSG_TYPE_REJECT followed by a rejection code,
+ * after which the sender keeps using the socket. Either way, the socket
+ * stays open, and an EOF on it tells each side that the other has gone away.
+ */
+#define MSG_TYPE_P2P_SHARED_MEMORY 27
+
+/**
+ * Byte identifying an offer to send the messages of a P2P connection over
+ * RDMA instead of the socket (see rdma_transport.h). A federate compiled with
+ * FEDERATED_RDMA sends this as the first message after
+ * MSG_TYPE_P2P_SENDING_FED_ID has been acknowledged, unless it uses shared
+ * memory for the connection.
+ *
+ * The next RDMA_ENDPOINT_SIZE bytes are the endpoint of the sender.
+ *
+ * As for MSG_TYPE_P2P_SHARED_MEMORY, the remote federate replies with
+ * MSG_TYPE_REJECT followed by a rejection code, or with MSG_TYPE_ACK
+ * followed by its own endpoint in RDMA_ENDPOINT_SIZE bytes, once it is ready
+ * for the sender to write.
+ */
+#define MSG_TYPE_P2P_RDMA 28
+
+/**
+ * Byte identifying an offer to compress the bodies of large messages of a
+ * P2P connection (see compression.h). A federate compiled with
+ * FEDERATED_COMPRESSION_LZ4 or FEDERATED_COMPRESSION_ZSTD sends this after
+ * MSG_TYPE_P2P_SENDING_FED_ID has been acknowledged and any offer of a
+ * transport has been answered, unless a transport was accepted.
+ *
+ * The next byte is the set of algorithms the sender supports, as the bits
+ * of compression_t.
+ *
+ * The remote federate replies with MSG_TYPE_ACK followed by one byte, the
+ * algorithm it has picked, or with MSG_TYPE_REJECT followed by a rejection
+ * code if it supports none of them.
+ */
+#define MSG_TYPE_P2P_COMPRESSION 29
+
+/**
+ * Byte identifying a P2P message whose body is compressed. This can only be
+ * sent on a connection for which MSG_TYPE_P2P_COMPRESSION was accepted.
+ *
+ * The next byte is the algorithm, one of compression_t.
+ * The next four bytes are the length of the body before compression.
+ * The remaining bytes are a MSG_TYPE_P2P_MESSAGE or
+ * MSG_TYPE_P2P_TAGGED_MESSAGE whose length field holds the length of the
+ * compressed body, followed by the compressed body.
+ */
+#define MSG_TYPE_P2P_COMPRESSED_MESSAGE 30
+#define MSG_TYPE_P2P_COMPRESSED_MESSAGE_HEADER_SIZE (1 + 1 + sizeof(int32_t))
+
+/**
+ * Byte identifying the minimum output delay of a federate, sent to the RTI.
+ * A federate compiled with a positive FEDERATED_MIN_OUTPUT_DELAY sends this
+ * right before its MSG_TYPE_TIMESTAMP, promising that any message it sends
+ * while at tag (t, m) has a tag no earlier than (t + delay, 0).
+ *
+ * The next eight bytes are the delay in nanoseconds.
+ *
+ * An RTI started with --grant_ahead adds the delay to those of the
+ * connections out of the federate, and it may then grant downstream
+ * federates tags beyond their next event tags. Without this message, the
+ * delay is 0.
+ */
+#define MSG_TYPE_MIN_OUTPUT_DELAY 31
+#define MSG_TYPE_MIN_OUTPUT_DELAY_LENGTH (1 + sizeof(int64_t))
+
+/**
+ * Byte identifying a batch of port absent messages that a federate sends,
+ * at the same tag, for ports of the same destination federate. Like
+ * @see MSG_TYPE_PORT_ABSENT, it informs the receiver that each of the ports
+ * is absent at all tags up to and including the given tag. Federates send
+ * batches only when compiled with FEDERATED_BATCH_MESSAGES. With centralized
+ * coordination, the RTI forwards them as they are.
+ *
+ * The next two bytes are unused and set to zero.
+ * The next two bytes are the destination federate ID.
+ * The next four bytes are the length of the port IDs that follow.
+ * The next eight bytes are the intended time of the absent messages.
+ * The next four bytes are the intended microstep of the absent messages.
+ *
+ * The remaining bytes are the IDs of the absent ports, two bytes each.
+ */
+#define MSG_TYPE_PORT_ABSENT_BATCH 32
+#define MSG_TYPE_PORT_ABSENT_BATCH_HEADER_SIZE \
+        (1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(int32_t) + sizeof(instant_t) + sizeof(microstep_t))
+
+/**
+ * Byte identifying an offer to send the messages of physical connections
+ * (MSG_TYPE_P2P_MESSAGE) as UDP datagrams (see MSG_TYPE_P2P_DATAGRAM), so
+ * that a lost or late message does not hold up the ones after it, as it does
+ * on a TCP socket. A federate compiled with FEDERATED_UDP_PHYSICAL sends this
+ * after MSG_TYPE_P2P_SENDING_FED_ID has been acknowledged and any offer of a
+ * transport or of compression has been answered.
+ *
+ * The offer has no body. The remote federate replies with MSG_TYPE_ACK
+ * followed by the two bytes of the UDP port on which it receives datagrams,
+ * at the address that the RTI gave for it in reply to MSG_TYPE_ADDRESS_QUERY,
+ * or with MSG_TYPE_REJECT followed by a rejection code. Tagged messages and
+ * messages too large for one datagram still go through the socket.
+ */
+#define MSG_TYPE_P2P_UDP 33
+
+/**
+ * Byte identifying a message of a physical connection sent as a UDP datagram
+ * to a federate that has accepted MSG_TYPE_P2P_UDP. Each datagram holds one
+ * whole message.
+ *
+ * The next two bytes are the ID of the sending federate.
+ * The next two bytes are the ID of the destination port.
+ * The next two bytes are the ID of the destination federate.
+ * The next four bytes are the sequence number of the datagram.
+ * The next four bytes are the length of the body.
+ * The remaining bytes are the body.
+ *
+ * The datagrams that a federate sends to another one are numbered from 1,
+ * wrapping around. Since a physical connection carries samples of which only
+ * the latest matters, the receiver drops a datagram whose sequence number is
+ * not after that of the last datagram it delivered to the same port, rather
+ * than deliver it out of order.
+ */
+#define MSG_TYPE_P2P_DATAGRAM 34
+#define MSG_TYPE_P2P_DATAGRAM_HEADER_SIZE \
+        (1 + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(int32_t))
+
 /////////////////////////////////////////////
 //// Rejection codes
 
@@ -711,4 +888,13 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /** HMAC authentication failed. */
 #define HMAC_DOES_NOT_MATCH 6
 
+/** A transport offered by a peer federate cannot be used. */
+#define TRANSPORT_UNAVAILABLE 7
+
+/** None of the compression algorithms offered by a peer federate is supported. */
+#define COMPRESSION_UNAVAILABLE 8
+
+/** A peer federate does not receive the messages of physical connections as UDP datagrams. */
+#define UDP_UNAVAILABLE 9
+
 #endif /* NET_COMMON_H */
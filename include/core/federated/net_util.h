@@ -42,6 +42,8 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #error To be implemented. No support for federation on Arduino yet.
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 #include <regex.h>
 #endif
 
@@ -50,6 +52,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "../platform.h"
 #include "../tag.h"
+#include "transport.h"
 
 #define HOST_LITTLE_ENDIAN 1
 #define HOST_BIG_ENDIAN 2
@@ -72,6 +75,13 @@ int host_is_big_endian(void);
  */
 int create_real_time_tcp_socket_errexit();
 
+/**
+ * Return whether the given IPv4 address is an address of this host,
+ * which is the case if a socket can be bound to it.
+ * @param address The address, in network byte order.
+ */
+bool host_address_is_local(struct in_addr address);
+
 /**
  * Read the specified number of bytes from the specified socket into the
  * specified buffer. If a disconnect or an EOF occurs during this
@@ -109,6 +119,128 @@ ssize_t write_to_socket(int socket, size_t num_bytes, unsigned char* buffer);
  */
 ssize_t read_from_socket(int socket, size_t num_bytes, unsigned char* buffer);
 
+/**
+ * Sources of the timestamps of the datagrams sent and received on a UDP socket
+ * (see enable_socket_timestamps()).
+ */
+typedef enum socket_timestamps_t {
+    /** Timestamps are taken by the caller with lf_time_physical(). */
+    SOCKET_TIMESTAMPS_NONE,
+    /** Timestamps are taken by the kernel when datagrams pass through the network stack. */
+    SOCKET_TIMESTAMPS_SOFTWARE,
+    /**
+     * Timestamps are taken by the network interface when datagrams go on or off the
+     * wire, falling back on the kernel. The clock of the interface has to be
+     * synchronized with the system clock (e.g., by phc2sys) and hardware timestamping
+     * has to be enabled on the interface (e.g., by ptp4l or hwstamp_ctl).
+     */
+    SOCKET_TIMESTAMPS_HARDWARE
+} socket_timestamps_t;
+
+/**
+ * Have the kernel or the network interface timestamp the datagrams sent and
+ * received on the specified socket (SO_TIMESTAMPING), so that the timestamps
+ * exclude the delays of the system calls and of the scheduling of threads.
+ * This is only supported on Linux.
+ * @param socket The UDP socket.
+ * @param source The source of the timestamps.
+ * @param transmit Whether to also timestamp the datagrams sent, in which case
+ *  every timestamp has to be collected with get_transmit_timestamp().
+ * @return 0 on success, or -1 if timestamping is not supported, with errno set.
+ */
+int enable_socket_timestamps(int socket, socket_timestamps_t source, bool transmit);
+
+/**
+ * Receive a datagram of at most the specified number of bytes on a socket
+ * and report the physical time at which it was received, as given by the
+ * timestamp of the kernel or of the network interface if the socket has
+ * timestamps enabled, and by lf_time_physical() otherwise.
+ * @param socket The UDP socket.
+ * @param num_bytes The size of the buffer.
+ * @param buffer The buffer into which to put the datagram.
+ * @param sender If not NULL, where to put the address of the sender.
+ * @param timestamp Where to put the time of reception.
+ * @return The number of bytes received, or a negative number for an error.
+ */
+ssize_t receive_timestamped_datagram(int socket, size_t num_bytes, unsigned char* buffer,
+        struct sockaddr_in* sender, instant_t* timestamp);
+
+/**
+ * Get the physical time at which the last datagram sent on a socket with
+ * timestamps enabled left the host, as reported by the kernel or the network
+ * interface, waiting for the report for up to one millisecond.
+ * @param socket The UDP socket.
+ * @param timestamp Where to put the time of transmission.
+ * @return 0 on success, or -1 if no timestamp was reported.
+ */
+int get_transmit_timestamp(int socket, instant_t* timestamp);
+
+/**
+ * The size of the buffer of a socket reader. Reads of at least this many
+ * bytes bypass the buffer.
+ */
+#ifndef SOCKET_READER_BUFFER_SIZE
+#define SOCKET_READER_BUFFER_SIZE 16384
+#endif
+
+/**
+ * A buffered reader of a socket. A thread that is the only one reading
+ * a socket can use a reader to get several small messages with a single
+ * system call. Once a reader is used, all reads of the socket have to go
+ * through it, since it may hold bytes that have already been received.
+ */
+typedef struct socket_reader_t {
+    /** The socket being read. */
+    int socket;
+    /**
+     * If not NULL, the transport that is read instead of the socket, once
+     * the peer has switched to it (see transport.h).
+     */
+    transport_t* transport;
+    /** The offset of the first byte received but not yet consumed. */
+    size_t start;
+    /** The offset past the last byte received. */
+    size_t end;
+    /** Bytes received but not yet consumed. */
+    unsigned char buffer[SOCKET_READER_BUFFER_SIZE];
+} socket_reader_t;
+
+/**
+ * Initialize the given reader to read from the given socket.
+ * @param reader The reader.
+ * @param socket The socket ID.
+ */
+void socket_reader_init(socket_reader_t* reader, int socket);
+
+/**
+ * Read the specified number of bytes through the given reader into the
+ * specified buffer. Bytes already received are copied from the buffer of
+ * the reader. If more bytes than fit in that buffer are still needed, they
+ * are read from the socket directly into the specified buffer, so large
+ * messages are not copied. Otherwise, the reader reads as many bytes as
+ * are available, up to the size of its buffer, keeping those not needed yet.
+ * Errors are handled as by read_from_socket_errexit().
+ * @param reader The reader.
+ * @param num_bytes The number of bytes to read.
+ * @param buffer The buffer into which to put the bytes.
+ * @param format A printf-style format string, followed by arguments to
+ *  fill the string, or NULL to not exit with an error message.
+ * @return The number of bytes read, or 0 if an EOF is received, or
+ *  a negative number for an error.
+ */
+ssize_t read_from_socket_reader_errexit(
+		socket_reader_t* reader,
+		size_t num_bytes,
+		unsigned char* buffer,
+		char* format, ...);
+
+/**
+ * Return whether the given reader holds bytes that have been received but
+ * not yet read through it.
+ * @param reader The reader.
+ */
+bool socket_reader_has_input(socket_reader_t* reader);
+
 /**
  * Write the specified number of bytes to the specified socket from the
  * specified buffer. If a disconnect or an EOF occurs during this
@@ -133,6 +265,47 @@ ssize_t write_to_socket_with_mutex(
 		lf_mutex_t* mutex,
 		char* format, ...);
 
+/**
+ * Write the specified header followed by the specified body to the specified
+ * socket using a gathering write, so that a message whose header and payload
+ * live in separate buffers costs one system call (and, with Nagle's algorithm
+ * disabled, usually one TCP segment) instead of two. Partial writes are
+ * resumed until both buffers have been written. Errors are handled as in
+ * write_to_socket_with_mutex().
+ * @param socket The socket ID.
+ * @param header_length The number of bytes in the header.
+ * @param header The buffer holding the header.
+ * @param body_length The number of bytes in the body, which may be 0.
+ * @param body The buffer holding the body.
+ * @param mutex If non-NULL, the mutex to unlock before exiting.
+ * @param format A format string for error messages, followed by any number of
+ *  fields that will be used to fill the format string as in printf, or NULL
+ *  to prevent exit on error.
+ * @return The total number of bytes written, or 0 if an EOF was received, or a
+ *  negative number if an error occurred.
+ */
+ssize_t write_header_and_body_to_socket_with_mutex(
+		int socket,
+		size_t header_length,
+		unsigned char* header,
+		size_t body_length,
+		unsigned char* body,
+		lf_mutex_t* mutex,
+		char* format, ...);
+
+/**
+ * Write the specified buffers, in order, to the specified socket using
+ * gathering writes, resuming partial writes until all of them have been
+ * written. Unlike write_header_and_body_to_socket_with_mutex(), this neither
+ * closes the socket nor exits on error.
+ * @param socket The socket ID.
+ * @param count The number of buffers.
+ * @param vector The buffers, which are updated to skip what has been written.
+ * @return The total number of bytes written, or 0 if an EOF was received, or a
+ *  negative number if an error occurred.
+ */
+ssize_t write_vector_to_socket(int socket, int count, struct iovec* vector);
+
 /**
  * Write the specified number of bytes to the specified socket from the
  * specified buffer. If a disconnect or an EOF occurs during this
@@ -170,6 +343,32 @@ ssize_t write_to_socket_errexit(
  */
 int write_to_socket2(int socket, int num_bytes, unsigned char* buffer);
 
+/**
+ * The number of bytes from which forward_socket_bytes() moves the bytes
+ * within the kernel on Linux. Below this, setting up a pipe costs more
+ * than copying the bytes.
+ */
+#ifndef SOCKET_SPLICE_THRESHOLD
+#define SOCKET_SPLICE_THRESHOLD 4096
+#endif
+
+/**
+ * Forward the specified number of bytes from one socket to another.
+ * On Linux, if there are at least SOCKET_SPLICE_THRESHOLD bytes, they are
+ * moved through a pipe with splice() without being copied to user space.
+ * Otherwise, they are copied in chunks through the given buffer.
+ * If writing fails, the remaining bytes are still read and discarded, so
+ * that the source socket stays at the boundary of a message.
+ * @param from The socket to read from.
+ * @param to The socket to write to.
+ * @param num_bytes The number of bytes to forward.
+ * @param buffer A buffer for the bytes that are copied.
+ * @param buffer_size The size of the buffer.
+ * @return The number of bytes written, which is less than num_bytes if
+ *  writing failed, or a negative number if reading failed or an EOF was received.
+ */
+ssize_t forward_socket_bytes(int from, int to, size_t num_bytes, unsigned char* buffer, size_t buffer_size);
+
 #endif // FEDERATED
 
 /**
@@ -253,6 +452,13 @@ uint16_t swap_bytes_if_big_endian_uint16(uint16_t src);
  */
 int32_t extract_int32(unsigned char* bytes);
 
+/**
+ * Extract an uint32_t from the specified byte sequence.
+ * This will swap the order of the bytes if this machine is big endian.
+ * @param bytes The address of the start of the sequence of bytes.
+ */
+uint32_t extract_uint32(unsigned char* bytes);
+
 /**
  * This will swap the order of the bytes if this machine is big endian.
  * @param bytes The address of the start of the sequence of bytes.
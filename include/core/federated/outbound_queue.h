@@ -0,0 +1,264 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Per-connection queues of outgoing messages for federates.
+ *
+ * Each outbound connection of a federate (the one to the RTI and one per
+ * peer federate) has its own queue. A thread that sends a message copies
+ * the serialized message into the queue of the connection and returns
+ * without touching the network, so a slow peer only holds up the threads
+ * sending to that peer. A writer thread per connection writes out whatever
+ * has accumulated since its last write, in order, with a single system call.
+ *
+ * Small messages can also be packed into batches, which are frames holding a
+ * batch header followed by any number of entries. Consecutive entries with
+ * the same batch header share one frame, which is written once it is ended by
+ * outbound_queue_end_batch(), by a message that is not part of the batch, or
+ * by reaching OUTBOUND_QUEUE_MAX_BATCH bytes.
+ *
+ * Until outbound_queue_start() has been called, a queue writes each message
+ * synchronously on the calling thread. This is what the startup handshakes
+ * need, since they expect a reply before sending anything else.
+ *
+ * A queue can also write into a transport instead of its socket (see
+ * transport.h). Since transports do their own buffering, such a queue always
+ * writes synchronously and has no writer thread.
+ *
+ * With LF_IO_URING on Linux, the queues share a single writer thread instead,
+ * which submits the writes of all the queues that have messages ready through
+ * one io_uring, with one system call, and resubmits the rest of partial writes
+ * as their completions arrive. If io_uring is not available, for example because
+ * the kernel is older than 5.6 or forbids it, each queue has its own writer thread.
+ */
+
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "platform.h"
+#include "transport.h"
+
+/**
+ * The number of queued bytes beyond which a thread sending a message waits
+ * for the writer to catch up. A single message larger than this is queued
+ * once the queue is empty.
+ */
+#ifndef OUTBOUND_QUEUE_MAX_PENDING
+#define OUTBOUND_QUEUE_MAX_PENDING (16 * 1024 * 1024)
+#endif
+
+/**
+ * The number of bytes of entries beyond which a batch is ended and a new one
+ * is started.
+ */
+#ifndef OUTBOUND_QUEUE_MAX_BATCH
+#define OUTBOUND_QUEUE_MAX_BATCH (64 * 1024)
+#endif
+
+/**
+ * With LF_IO_URING, the number of entries of the io_uring shared by the queues,
+ * which bounds the number of writes in flight.
+ */
+#ifndef OUTBOUND_QUEUE_URING_ENTRIES
+#define OUTBOUND_QUEUE_URING_ENTRIES 64
+#endif
+
+/**
+ * The state of the queue of outgoing messages for one connection.
+ * A queue whose fields are all zero is closed; sending to it drops the message.
+ */
+typedef struct outbound_queue_t {
+    /** Whether the queue has been opened. This never reverts to false. */
+    bool initialized;
+    /** The socket the queue writes to. */
+    int socket;
+    /** The name of the destination, used in error messages. */
+    char destination[32];
+    /** Mutex guarding the fields below. */
+    lf_mutex_t mutex;
+    /** Signaled when messages are queued, when a write completes, and on close. */
+    lf_cond_t changed;
+    /** Messages waiting to be written. */
+    unsigned char* pending;
+    size_t pending_length;
+    size_t pending_capacity;
+    /** The buffer being written by the writer thread, swapped with pending. */
+    unsigned char* sending;
+    size_t sending_capacity;
+    /** Whether the end of the pending messages is a batch that can still grow. */
+    bool batch_open;
+    /** The offset of the header of the open batch in the pending buffer. */
+    size_t batch_start;
+    /** The length of the header of the open batch. */
+    size_t batch_header_length;
+    /** The offset of the length field in the header of the open batch. */
+    size_t batch_length_offset;
+    /** Whether the writer thread is writing the sending buffer. */
+    bool writing;
+    /** Whether the writer thread has been started. */
+    bool started;
+    /** Whether the queue has been closed. */
+    bool closed;
+    /** The errno of a failed write, or 0. After a failure, messages are dropped. */
+    int error;
+    /** The writer thread, which is shared by the queues that use io_uring. */
+    lf_thread_t writer;
+#if defined(LF_IO_URING)
+    /** Whether the writes of the queue are submitted to the shared io_uring. */
+    bool uring;
+    /** The number of bytes of the sending buffer being written, and those written so far. */
+    size_t sending_length;
+    size_t sending_offset;
+#endif
+    /** If not NULL, the transport that messages are written into instead of the socket. */
+    transport_t* transport;
+} outbound_queue_t;
+
+/**
+ * Open the given queue for writing to the given socket. Messages sent before
+ * outbound_queue_start() is called are written synchronously.
+ * This must be called before any other thread can use the queue.
+ * @param queue The queue.
+ * @param socket The socket to write to.
+ * @param destination The name of the destination, used in error messages.
+ */
+void outbound_queue_open(outbound_queue_t* queue, int socket, const char* destination);
+
+/**
+ * Have the given queue write messages into the given transport instead of its
+ * socket, synchronously on the calling thread. The queue takes over the
+ * transport and closes it when the queue is closed. This must be called
+ * before outbound_queue_start(), which then does nothing, and before any
+ * other thread can use the queue.
+ * @param queue The queue, which must be open.
+ * @param transport The writing side of the transport.
+ */
+void outbound_queue_use_transport(outbound_queue_t* queue, transport_t* transport);
+
+/**
+ * Start the writer thread of the given queue. From then on, sending to
+ * the queue only copies the message into the queue.
+ * @param queue The queue, which must be open.
+ * @return 0 on success, or the error code of lf_thread_create(), in which case
+ *  messages continue to be written synchronously. For a queue that writes
+ *  into a transport, this returns 0 without starting a thread.
+ */
+int outbound_queue_start(outbound_queue_t* queue);
+
+/**
+ * Queue the message given by a header and a body for the connection of the
+ * given queue. Messages sent to the same queue are written in the order in
+ * which they were sent. This blocks only while the queue holds more than
+ * OUTBOUND_QUEUE_MAX_PENDING bytes or, before the writer thread is started,
+ * while the message is being written.
+ * @param queue The queue.
+ * @param header_length The number of bytes in the header.
+ * @param header The header.
+ * @param body_length The number of bytes in the body, which may be 0.
+ * @param body The body, or NULL if body_length is 0.
+ * @return 1 if the message was queued (or written), 0 if the queue is closed,
+ *  or -1 if a write to the connection has failed, with errno set to the error
+ *  of that write.
+ */
+int outbound_queue_send(
+        outbound_queue_t* queue,
+        size_t header_length,
+        unsigned char* header,
+        size_t body_length,
+        unsigned char* body);
+
+/**
+ * Queue the message given by a header and a body made of the given segments,
+ * as outbound_queue_send() does. The segments are copied straight into the
+ * queue or, before the writer thread is started, written with a gathering
+ * write, so a body scattered across several buffers is not packed first.
+ * @param queue The queue.
+ * @param header_length The number of bytes in the header.
+ * @param header The header.
+ * @param count The number of segments of the body, which may be 0.
+ * @param segments The segments of the body, in order.
+ * @return As for outbound_queue_send().
+ */
+int outbound_queue_sendv(
+        outbound_queue_t* queue,
+        size_t header_length,
+        unsigned char* header,
+        int count,
+        const struct iovec* segments);
+
+/**
+ * Queue an entry of a batch for the connection of the given queue. If the
+ * last message queued is an open batch whose header equals the given one,
+ * the entry is appended to it. Otherwise, a new batch is started.
+ * The batch is not written until it is ended (see outbound_queue_end_batch()).
+ * @param queue The queue.
+ * @param batch_header_length The number of bytes in the batch header.
+ * @param batch_header The batch header. The four bytes at length_offset hold
+ *  the number of bytes of entries in the batch, which the queue maintains,
+ *  and are ignored when comparing batch headers.
+ * @param length_offset The offset of the length field in the batch header.
+ * @param entry_header_length The number of bytes in the header of the entry.
+ * @param entry_header The header of the entry.
+ * @param count The number of segments of the body of the entry, which may be 0.
+ * @param segments The segments of the body of the entry, in order
+ *  (see outbound_queue_sendv()).
+ * @return 1 if the entry was queued (or written), 0 if the queue is closed,
+ *  or -1 if a write to the connection has failed, with errno set to the error
+ *  of that write.
+ */
+int outbound_queue_send_batched(
+        outbound_queue_t* queue,
+        size_t batch_header_length,
+        unsigned char* batch_header,
+        size_t length_offset,
+        size_t entry_header_length,
+        unsigned char* entry_header,
+        int count,
+        const struct iovec* segments);
+
+/**
+ * End the open batch of the given queue, if any, so that it gets written.
+ * @param queue The queue.
+ */
+void outbound_queue_end_batch(outbound_queue_t* queue);
+
+/**
+ * Close the given queue and stop its writer thread. This does not close
+ * the socket, which the caller should do afterwards. Closing a queue that
+ * was never opened or is already closed does nothing.
+ * @param queue The queue.
+ * @param flush If true, first wait until the queued messages, including an
+ *  open batch, have been written.
+ *  Otherwise, drop them and shut down the socket so that a blocked write returns.
+ */
+void outbound_queue_close(outbound_queue_t* queue, bool flush);
+
+#endif // OUTBOUND_QUEUE_H
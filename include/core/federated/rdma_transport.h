@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A transport (see transport.h) that carries a one-way byte stream between
+ * federates over RDMA, for clusters with InfiniBand or RoCE.
+ *
+ * The reader registers a ring buffer that the writer fills with one-sided
+ * RDMA writes. Each write carries its length as immediate data, so the
+ * reader learns about new bytes by polling its completion queue, which
+ * takes no system call. The writer keeps a copy of the ring from which the
+ * writes are made, and the reader tells the writer how far it has read with
+ * small RDMA writes into memory that the writer has registered. A reader
+ * that finds nothing to read for RDMA_TRANSPORT_SPIN_COUNT polls sleeps on
+ * the completion channel until the next write arrives.
+ *
+ * The two sides exchange the parameters of their queue pairs and memory as
+ * rdma_endpoint_t over the socket of the P2P connection (see MSG_TYPE_P2P_RDMA).
+ * This is only compiled with FEDERATED_RDMA, which links with libibverbs.
+ */
+
+#ifndef RDMA_TRANSPORT_H
+#define RDMA_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "transport.h"
+
+/** The number of bytes in the ring of the reader. */
+#ifndef RDMA_TRANSPORT_CAPACITY
+#define RDMA_TRANSPORT_CAPACITY (1024 * 1024)
+#endif
+
+/** The maximum number of RDMA writes in flight from each side. */
+#ifndef RDMA_TRANSPORT_QUEUE_DEPTH
+#define RDMA_TRANSPORT_QUEUE_DEPTH 64
+#endif
+
+/** The number of times a side polls before it sleeps waiting for the other side. */
+#ifndef RDMA_TRANSPORT_SPIN_COUNT
+#define RDMA_TRANSPORT_SPIN_COUNT 4096
+#endif
+
+/** The port of the RDMA device to use. */
+#ifndef RDMA_TRANSPORT_PORT
+#define RDMA_TRANSPORT_PORT 1
+#endif
+
+/** The index of the GID of the port to use, which selects the RoCE version and address. */
+#ifndef RDMA_TRANSPORT_GID_INDEX
+#define RDMA_TRANSPORT_GID_INDEX 0
+#endif
+
+/** The number of bytes of an encoded rdma_endpoint_t. */
+#define RDMA_ENDPOINT_SIZE 42
+
+/**
+ * What one side tells the other about itself to connect their queue pairs.
+ */
+typedef struct rdma_endpoint_t {
+    /** The local identifier of the port (InfiniBand). */
+    uint16_t lid;
+    /** The number of the queue pair. */
+    uint32_t qp_number;
+    /** The first packet sequence number. */
+    uint32_t psn;
+    /** The global identifier of the port (RoCE), or zeros. */
+    uint8_t gid[16];
+    /** The address of the memory that the other side writes into. */
+    uint64_t address;
+    /** The key of that memory. */
+    uint32_t rkey;
+    /** The number of bytes in the ring of the reader, or 0 for the writer. */
+    uint32_t capacity;
+} rdma_endpoint_t;
+
+/**
+ * Encode the given endpoint into RDMA_ENDPOINT_SIZE bytes in the given buffer.
+ */
+void rdma_endpoint_encode(const rdma_endpoint_t* endpoint, unsigned char* buffer);
+
+/**
+ * Decode an endpoint from RDMA_ENDPOINT_SIZE bytes in the given buffer.
+ */
+void rdma_endpoint_decode(unsigned char* buffer, rdma_endpoint_t* endpoint);
+
+/**
+ * Open one side of an RDMA transport on the first RDMA device, or on the
+ * device named by RDMA_TRANSPORT_DEVICE if that is defined. The transport
+ * cannot be used until rdma_transport_connect() has been called, but it
+ * can be closed with transport_close().
+ * @param writing Whether this is the writing side.
+ * @param peer_socket A socket connected to the other side. While waiting,
+ *  an EOF on this socket means that the other side has gone away.
+ * @param result Where to put the transport.
+ * @param local Where to put the endpoint to send to the other side.
+ * @return 0 on success, or an error code.
+ */
+int rdma_transport_open(bool writing, int peer_socket, transport_t** result, rdma_endpoint_t* local);
+
+/**
+ * Connect the given side of an RDMA transport to the other side.
+ * The reading side has to be connected before the writing side.
+ * @param transport A transport returned by rdma_transport_open().
+ * @param remote The endpoint received from the other side.
+ * @return 0 on success, or an error code.
+ */
+int rdma_transport_connect(transport_t* transport, const rdma_endpoint_t* remote);
+
+#endif // RDMA_TRANSPORT_H
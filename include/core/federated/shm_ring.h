@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A one-way stream of bytes between two processes on the same host, held in
+ * a ring buffer in POSIX shared memory.
+ *
+ * Federates on the same host use a ring as the transport (see transport.h)
+ * of the messages one sends to the other, so that sending and receiving a
+ * message copies it through memory without system calls. The writer only
+ * makes a system call to wake up the reader when the reader has been waiting
+ * for longer than SHM_RING_SPIN_COUNT checks of the ring (or at all, on a
+ * single processor), and similarly for a writer waiting for room.
+ *
+ * Rings need a futex to wait, so they are only supported on Linux. On other
+ * platforms, creating or attaching a ring fails with ENOTSUP.
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "transport.h"
+
+/** The number of bytes of data in a ring. */
+#ifndef SHM_RING_CAPACITY
+#define SHM_RING_CAPACITY (1024 * 1024)
+#endif
+
+/**
+ * The number of times a reader or writer checks the ring before it goes to
+ * sleep waiting for the other side.
+ */
+#ifndef SHM_RING_SPIN_COUNT
+#define SHM_RING_SPIN_COUNT 4096
+#endif
+
+/**
+ * The maximum time in nanoseconds that a reader or writer sleeps before
+ * checking whether the other side has gone away without closing the ring.
+ */
+#ifndef SHM_RING_CHECK_INTERVAL
+#define SHM_RING_CHECK_INTERVAL 100000000LL
+#endif
+
+/** The maximum length of the name of a ring, including the terminating null. */
+#define SHM_RING_NAME_LENGTH 64
+
+/** Value of the magic field of a ring once it is initialized. */
+#define SHM_RING_MAGIC 0x4c4652494e473031ULL
+
+/**
+ * Layout of the shared memory object of a ring. Head and tail count all the
+ * bytes written and consumed so far and only increase. They are on separate
+ * cache lines so that the writer and the reader do not slow each other down.
+ */
+typedef struct shm_ring_control_t {
+    /** SHM_RING_MAGIC, written after the other fields are initialized. */
+    uint64_t magic;
+    /** Number of bytes of data. */
+    uint64_t capacity;
+    /** Nonzero once either side has closed the ring. */
+    uint32_t closed;
+    unsigned char padding0[44];
+    /** Number of bytes written, advanced by the writer. */
+    uint64_t head;
+    /** Nonzero while the reader sleeps waiting for bytes. */
+    uint32_t reader_waiting;
+    /** Futex word that the writer increments to wake up the reader. */
+    uint32_t written;
+    unsigned char padding1[48];
+    /** Number of bytes consumed, advanced by the reader. */
+    uint64_t tail;
+    /** Nonzero while the writer sleeps waiting for room. */
+    uint32_t writer_waiting;
+    /** Futex word that the reader increments to wake up the writer. */
+    uint32_t consumed;
+    unsigned char padding2[48];
+} shm_ring_control_t;
+
+/**
+ * One side of a ring, local to the process using it.
+ */
+typedef struct shm_ring_t {
+    /** The functions of the ring as a transport. */
+    transport_t base;
+    /** The mapped control block, followed by the bytes of the ring. */
+    shm_ring_control_t* control;
+    unsigned char* data;
+    size_t mapped_size;
+    /**
+     * A socket connected to the process on the other side, or -1. When a wait
+     * for the other side times out, an EOF on this socket means that the other
+     * process has gone away, and the ring is treated as closed.
+     */
+    int peer_socket;
+    /** Whether this side created the shared memory object. */
+    bool creator;
+    /** The name of the shared memory object. */
+    char name[SHM_RING_NAME_LENGTH];
+} shm_ring_t;
+
+/**
+ * Create a ring in a new shared memory object with the given name, which
+ * must start with a slash, and return the writing side of it. An existing
+ * object with the same name, presumably left over by a process that failed,
+ * is replaced. Closing the writing side removes the name, if the other side
+ * has not done it already.
+ * @param name The name of the shared memory object.
+ * @param peer_socket A socket connected to the process that will attach to
+ *  the ring, or -1.
+ * @param result Where to put the transport.
+ * @return 0 on success, or an error code.
+ */
+int shm_ring_create(const char* name, int peer_socket, transport_t** result);
+
+/**
+ * Attach to the ring in the shared memory object with the given name, return
+ * the reading side of it, and remove the name, so that the object disappears
+ * once both sides have closed the ring.
+ * @param name The name given to shm_ring_create().
+ * @param peer_socket A socket connected to the process that created the ring, or -1.
+ * @param result Where to put the transport.
+ * @return 0 on success, or an error code.
+ */
+int shm_ring_attach(const char* name, int peer_socket, transport_t** result);
+
+#endif // SHM_RING_H
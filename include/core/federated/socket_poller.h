@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * A small pool of threads that waits for input on many sockets.
+ *
+ * Instead of dedicating a thread to each connection that blocks reading it,
+ * connections can be watched by a poller, which uses epoll (on Linux) or
+ * kqueue (on macOS) to wait for any of them to become readable. When one
+ * does, one of the threads of the poller calls the handler of the connection,
+ * which reads and handles what has arrived. A connection is handled by at
+ * most one thread at a time, so its messages are handled in order, and the
+ * handler can block reading the rest of a message that has partly arrived.
+ * While a handler blocks for another reason, its thread is not available to
+ * other connections, so handlers should not wait for input on other
+ * connections watched by the same poller.
+ */
+
+#ifndef SOCKET_POLLER_H
+#define SOCKET_POLLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "platform.h"
+
+/**
+ * Function that reads and handles input that has arrived on a connection.
+ * @param connection The connection given to socket_poller_add().
+ * @return true to keep watching the connection, or false if it has been
+ *  closed, in which case the poller forgets it.
+ */
+typedef bool (*socket_poller_handler_t)(void* connection);
+
+/**
+ * The state of a poller.
+ */
+typedef struct socket_poller_t {
+    /** The epoll or kqueue descriptor. */
+    int descriptor;
+    /** Pipe whose read end becomes readable when the poller is closed. */
+    int stop_pipe[2];
+    /** Mutex guarding the number of watched connections. */
+    lf_mutex_t mutex;
+    /** Signaled when a connection is forgotten. */
+    lf_cond_t changed;
+    /** The number of connections being watched. */
+    size_t watched;
+    /** The threads of the poller, or NULL if it is not open. */
+    lf_thread_t* threads;
+    size_t number_of_threads;
+} socket_poller_t;
+
+/**
+ * Open the given poller and start its threads.
+ * @param poller The poller.
+ * @param number_of_threads The number of threads, which must be at least 1.
+ * @return 0 on success, or an error code, such as ENOTSUP on platforms
+ *  that have neither epoll nor kqueue. The poller is then not open.
+ */
+int socket_poller_open(socket_poller_t* poller, size_t number_of_threads);
+
+/**
+ * Start watching the given socket, calling the given handler with the
+ * given connection whenever input arrives on the socket (or it is closed
+ * by the peer). Any input that the handler leaves unread causes it to be
+ * called again. The socket must not be closed by anything other than its
+ * handler while it is being watched.
+ * @param poller The poller, which must be open.
+ * @param socket The socket.
+ * @param handler The handler.
+ * @param connection The argument to pass to the handler.
+ * @return 0 on success or an error code.
+ */
+int socket_poller_add(
+        socket_poller_t* poller,
+        int socket,
+        socket_poller_handler_t handler,
+        void* connection);
+
+/**
+ * Wait until the handlers of all sockets watched by the given poller
+ * have returned false. Called from a thread of the poller, for example
+ * by a handler that exits the program, this returns immediately.
+ * @param poller The poller, which must be open.
+ */
+void socket_poller_wait(socket_poller_t* poller);
+
+/**
+ * Stop the threads of the given poller and close it. This waits for handlers
+ * that are running to return, but sockets that are still being watched are
+ * not closed. Closing a poller that is not open, or closing it from one of
+ * its own threads, does nothing.
+ * @param poller The poller.
+ */
+void socket_poller_close(socket_poller_t* poller);
+
+#endif // SOCKET_POLLER_H
@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+ * @section DESCRIPTION
+ * Byte streams that carry the messages of a P2P connection in place of its
+ * socket.
+ *
+ * A federate connects to a peer with a TCP socket, and by default all
+ * messages go through that socket. Once the connection is established, the
+ * sending federate can offer a faster transport, which the receiving federate
+ * may accept (see MSG_TYPE_P2P_SHARED_MEMORY and MSG_TYPE_P2P_RDMA). From then
+ * on, the outbound queue of the sender writes into the transport and the
+ * socket reader of the receiver reads from it, so the code that builds and
+ * handles messages does not depend on the transport. The socket stays open
+ * for close requests and so that each side notices when the other goes away.
+ *
+ * The transports are:
+ * * Shared memory (shm_ring.h), for federates on the same host.
+ * * RDMA (rdma_transport.h), with FEDERATED_RDMA, for federates connected
+ *   by InfiniBand or RoCE.
+ *
+ * With FEDERATED_UDP_PHYSICAL, messages of physical connections that would go
+ * through the socket are sent as UDP datagrams instead (see MSG_TYPE_P2P_UDP).
+ * Since datagrams may be lost or reordered, they are not a transport.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct transport_t transport_t;
+
+/**
+ * A one-way byte stream between two federates. Each kind of transport fills
+ * in the name and the functions. A transport has one writing and one reading
+ * thread at a time, one on each side.
+ */
+struct transport_t {
+    /** The name of the kind of transport, used in log messages. */
+    const char* name;
+    /**
+     * Write all the given bytes, waiting for room as needed. Return the
+     * number of bytes, or -1 with errno set if the stream is broken.
+     */
+    ssize_t (*write)(transport_t* transport, size_t length, const unsigned char* bytes);
+    /**
+     * Read at most the given number of bytes, waiting until at least one is
+     * available. Return the number of bytes read, 0 once the writer has closed
+     * the stream and everything has been read, or -1 with errno set if the
+     * stream is broken.
+     */
+    ssize_t (*read)(transport_t* transport, size_t length, unsigned char* buffer);
+    /** Return the number of bytes that can be read without waiting. */
+    size_t (*available)(transport_t* transport);
+    /**
+     * Release the resources of this side of the stream, including the
+     * transport itself. Closing the writing side gives the reader an EOF
+     * after what has been written.
+     */
+    void (*close)(transport_t* transport);
+};
+
+/** @brief Write all the given bytes to the transport. */
+static inline ssize_t transport_write(transport_t* transport, size_t length, const unsigned char* bytes) {
+    return transport->write(transport, length, bytes);
+}
+
+/** @brief Read at most the given number of bytes from the transport. */
+static inline ssize_t transport_read(transport_t* transport, size_t length, unsigned char* buffer) {
+    return transport->read(transport, length, buffer);
+}
+
+/** @brief Return the number of bytes that can be read without waiting. */
+static inline size_t transport_available(transport_t* transport) {
+    return transport->available(transport);
+}
+
+/** @brief Close this side of the transport and free it. */
+static inline void transport_close(transport_t* transport) {
+    transport->close(transport);
+}
+
+#endif // TRANSPORT_H
@@ -66,6 +66,7 @@
 
 // Forward declarations
 struct environment_t;
+struct reaction_t;
 
 //////////////////////////////////////////////////////////
 //// Constants and enums
@@ -78,6 +79,16 @@ typedef enum token_freed {
     TOKEN_AND_VALUE_FREED // Both were freed
 } token_freed;
 
+/**
+ * Payloads of at most this many bytes whose type has no destructor are stored
+ * in the token that carries them rather than allocated separately, so that
+ * sending a small struct or array costs only a recycled token.
+ * Setting LF_TOKEN_INLINE_SIZE to 0 disables this.
+ */
+#ifndef LF_TOKEN_INLINE_SIZE
+#define LF_TOKEN_INLINE_SIZE 32
+#endif
+
 //////////////////////////////////////////////////////////
 //// Data structures
 
@@ -124,14 +135,27 @@ typedef struct lf_token_t {
     size_t ref_count;
     /** Convenience for constructing a temporary list of tokens. */
     struct lf_token_t* next;
+    /** Size class of the payload pool that the value came from, -2 if it is inline, or -1 if none. */
+    int payload_class;
+#if LF_TOKEN_INLINE_SIZE > 0
+    /** Storage for a payload of at most LF_TOKEN_INLINE_SIZE bytes, aligned as malloc() would. */
+    union {
+        long double alignment;
+        void* pointer;
+        unsigned char bytes[LF_TOKEN_INLINE_SIZE];
+    } inline_value;
+#endif
 } lf_token_t;
 
 /**
  * A record of the subset of channels of a multiport that have present inputs.
+ * For a wide multiport, the storage of present_channels is reused as a bitmap
+ * with one bit per channel once bitmap_width is nonzero.
  */
 typedef struct lf_sparse_io_record_t {
 	int size;  			// -1 if overflowed. 0 if empty.
 	size_t capacity;    // Max number of writes to be considered sparse.
+	int bitmap_width;   // The number of channels in the bitmap or 0 if present_channels is a list.
 	size_t present_channels[];  // Array of channel indices that are present.
 } lf_sparse_io_record_t;
 
@@ -168,6 +192,9 @@ typedef struct lf_port_base_t {
     self_base_t* source_reactor;          // Pointer to the self struct of the reactor that provides data to this port.
                                           // If this is an input, that reactor will normally be the container of the
                                           // output port that sends it data.
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    bool* presence;                       // Slot in the presence array of the environment or NULL if there is none.
+#endif
 } lf_port_base_t;
 
 //////////////////////////////////////////////////////////
@@ -184,6 +211,8 @@ typedef struct lf_port_base_t {
  * the token to live on until used. For example, a new token created
  * by lf_writable_copy could become the new template token for an output
  * via a call to lf_set.
+ * Each environment keeps such lists of its own, one per worker; this global
+ * list only holds the tokens copied from ports that have no source reactor.
  */
 extern lf_token_t* _lf_tokens_allocated_in_reactions;
 
@@ -196,6 +225,12 @@ extern lf_token_t* _lf_tokens_allocated_in_reactions;
  */
 extern int _lf_count_token_allocations;
 
+/**
+ * The largest value that _lf_count_token_allocations has reached.
+ * In the threaded runtime, both counters are updated atomically.
+ */
+extern int _lf_count_token_allocations_peak;
+
 //////////////////////////////////////////////////////////
 //// Functions that users may call
 
@@ -225,6 +260,9 @@ lf_token_t* lf_new_token(void* port_or_action, void* val, size_t len);
  * rather than a copy. The reference count will be 1.
  * Otherwise, if the size of the token payload is zero, this also
  * returns the original token, again with reference count of 1.
+ * It also returns the original token if readers have been declared for the
+ * port with _lf_declare_port_readers() and all of them except the calling
+ * reaction have completed at the current tag.
  * Otherwise, this returns a new token with a reference count of 1.
  * The new token is added to a list of tokens whose reference counts will
  * be decremented at the start of the next tag.
@@ -242,9 +280,10 @@ lf_token_t* lf_writable_copy(lf_port_base_t* port);
  * If the reference count is greater than 0, then do not free 
  * anything. Otherwise, the token value (payload) will be freed,
  * if there is one. Then the token itself will be freed.
- * The freed token will be put on the recycling bin unless that
- * bin has reached the designated capacity, in which case free()
- * will be used.
+ * The freed token will be put on the recycling bin of the calling
+ * thread. When that is full, its tokens move to a lock-free bin that
+ * is shared by all threads unless that bin has reached the designated
+ * capacity, in which case free() will be used.
  *
  * @param token Pointer to a token.
  * @return NOT_FREED if nothing was freed, VALUE_FREED if the value
@@ -268,6 +307,28 @@ token_freed _lf_free_token(lf_token_t* token);
  */
 lf_token_t* _lf_new_token(token_type_t* type, void* value, size_t length);
 
+/**
+ * @brief Return a new token as _lf_new_token() does, carrying newly allocated
+ * memory of the given size that is not initialized. The memory comes from
+ * the same pools as that allocated by _lf_initialize_token(), so it is
+ * recycled when the token is freed. The caller fills in the value,
+ * for example by reading it directly from a socket.
+ * @param type The type of the token.
+ * @param length The array length of the value, or 1 to not be an array.
+ * @param size The number of bytes to allocate for the value.
+ * @return A new token, or NULL if the memory could not be allocated.
+ */
+lf_token_t* _lf_new_token_with_payload(token_type_t* type, size_t length, size_t size);
+
+/**
+ * @brief Return a new token of the given type carrying a copy of the value of
+ * the given token, made with the copy constructor of the type if it has one.
+ * The reference count of the new token is 0.
+ * @param type The type of the new token.
+ * @param token The token to copy.
+ */
+lf_token_t* _lf_copy_token(token_type_t* type, lf_token_t* token);
+
 /**
  * Get a token for the specified template.
  * If the template already has a token and the reference count is 1,
@@ -291,6 +352,23 @@ lf_token_t* _lf_get_token(token_template_t* tmplt);
  */
 void _lf_initialize_template(token_template_t* tmplt, size_t element_size);
 
+/**
+ * Make _lf_initialize_template() on the calling thread only record the templates
+ * that it is given until _lf_complete_template_initialization() is called, which
+ * registers them and creates their tokens under a single critical section. This
+ * lets threads that initialize reactors in parallel avoid contending for the
+ * global mutex on every port and action (@see _lf_initialize_in_parallel()).
+ * The element size of a template without a token is set immediately.
+ */
+void _lf_defer_template_initialization(void);
+
+/**
+ * Complete the initialization of the templates deferred by the calling thread
+ * since it called _lf_defer_template_initialization(), in the order in which
+ * they were given to _lf_initialize_template().
+ */
+void _lf_complete_template_initialization(void);
+
 /**
  * Return a token storing the specified value, which is assumed to
  * be either a scalar (if length is 1) or an array of the specified length.
@@ -328,13 +406,55 @@ lf_token_t* _lf_initialize_token_with_value(token_template_t* tmplt, void* value
  */
 lf_token_t* _lf_initialize_token(token_template_t* tmplt, size_t length);
 
+/**
+ * @brief Preallocate enough tokens for recycling that the given number can be in
+ * use at once, and make allocating any more tokens a fatal error.
+ * In the threaded runtime, this includes the tokens that the free lists of
+ * the threads can hold. The reserved tokens are never freed before
+ * _lf_free_all_tokens().
+ * @param count The number of tokens that may be in use at once.
+ */
+void _lf_reserve_tokens(int count);
+
+/**
+ * @brief Report the recycled memory that is available to the calling thread.
+ * This includes the recycling bins of the calling thread and, in the threaded
+ * runtime, the shared ones, but not the bins of other threads that have not
+ * called _lf_release_token_cache().
+ * @param recycled_tokens Where to store the number of recycled tokens.
+ * @param pooled_payload_bytes Where to store the number of bytes of recycled payloads.
+ */
+void _lf_get_token_stats(size_t* recycled_tokens, size_t* pooled_payload_bytes);
+
 /**
  * @brief Free all tokens.
- * Free tokens on the _lf_token_recycling_bin hashset and all
+ * Free the recycled tokens and payloads of the calling thread, those that
+ * other threads have released with _lf_release_token_cache(), and all
  * template tokens.
  */
 void _lf_free_all_tokens();
 
+/**
+ * @brief Declare the reactions that may read the value of the given port at a tag.
+ * These are the reactions that have the port as a trigger or source, or (for an
+ * output) a later reaction of the writing reactor. With this declaration,
+ * lf_writable_copy() hands the token of the port to a reaction with a mutable
+ * input without copying it if all other readers have completed at the current tag.
+ * Without it, a copy is made unless the port has a single destination.
+ * This is meant to be called by generated code before execution starts.
+ * @param port The port, as passed to lf_writable_copy().
+ * @param readers Array of the reading reactions, which is copied.
+ * @param num_readers The size of the array.
+ */
+void _lf_declare_port_readers(lf_port_base_t* port, struct reaction_t** readers, size_t num_readers);
+
+/**
+ * @brief Give the recycled tokens and payloads of the calling thread to the other threads.
+ * A thread that frees tokens and then exits should call this before exiting
+ * to make its recycled memory available to others and to _lf_free_all_tokens().
+ */
+void _lf_release_token_cache();
+
 /**
  * @brief Replace the token in the specified template, if there is one,
  * with a new one. If the new token is the same as the token in the template,
@@ -359,7 +479,8 @@ token_freed _lf_done_using(lf_token_t* token);
 /**
  * @brief Free token copies made for mutable inputs.
  * This function should be called at the beginning of each time step
- * to avoid memory leaks.
+ * to avoid memory leaks. It releases the tokens that reactions of the given
+ * environment copied, so that enclaves do not release each other's tokens.
  * @param env Environment in which we are executing.
  */
 void _lf_free_token_copies(struct environment_t* env);
@@ -70,6 +70,10 @@ typedef unsigned short int ushort;
 #define SCHED_ADAPTIVE 1
 #define SCHED_GEDF_NP 2
 #define SCHED_NP 3
+#define SCHED_NP_WS 4
+#define SCHED_GEDF_NP_LF 5
+#define SCHED_CHAIN_NP 6
+#define SCHED_STATIC 7
 
 /*
  * A struct representing a barrier in threaded
@@ -77,9 +81,13 @@ typedef unsigned short int ushort;
  * of tag if
  * 1- Number of requestors is larger than 0
  * 2- Value of horizon is not (FOREVER, 0)
+ *
+ * The barrier is updated without the mutex of the environment. The version
+ * is odd while an update is in progress, so that the requestors and the
+ * horizon can be read consistently by comparing the version before and after.
  */
 typedef struct _lf_tag_advancement_barrier {
-    int requestors; // Used to indicate the number of
+    volatile int requestors; // Used to indicate the number of
                     // requestors that have asked
                     // for a barrier to be raised
                     // on tag.
@@ -87,6 +95,8 @@ typedef struct _lf_tag_advancement_barrier {
                     // then the runtime should not
                     // advance its tag beyond the
                     // horizon.
+    volatile int version; // Incremented before and after each update.
+    volatile int waiting; // Threads waiting for the requestors to reach zero.
 } _lf_tag_advancement_barrier;
 
 /**
@@ -103,6 +113,34 @@ typedef struct _lf_tag_advancement_barrier {
  */
 typedef enum {defer, drop, replace} lf_spacing_policy_t;
 
+/**
+ * Policy for handling a schedule of a physical action that already has as many
+ * events queued as its bound allows (@see lf_set_action_bound()).
+ * LF_OVERFLOW_DROP_OLDEST discards the earliest queued event to make room.
+ * LF_OVERFLOW_DROP_NEWEST discards the new event.
+ * LF_OVERFLOW_COALESCE gives the value of the new event to the latest queued
+ * event instead.
+ * LF_OVERFLOW_BLOCK makes the thread calling lf_schedule() wait until an event
+ * has been handled. Workers, which handle the events, and calls made by
+ * lf_schedule_batch() or in the single-threaded runtime cannot wait, and drop
+ * the new event instead.
+ */
+typedef enum {
+    LF_OVERFLOW_DROP_OLDEST,
+    LF_OVERFLOW_DROP_NEWEST,
+    LF_OVERFLOW_COALESCE,
+    LF_OVERFLOW_BLOCK
+} lf_overflow_policy_t;
+
+/**
+ * How often the bound of a physical action has been hit, by outcome.
+ */
+typedef struct lf_overflow_stats_t {
+    size_t dropped;   // Events discarded, new or oldest.
+    size_t coalesced; // Values given to the latest queued event instead of a new one.
+    size_t blocked;   // Schedules that waited for an event to be handled.
+} lf_overflow_stats_t;
+
 /**
  * Status of a given port at a given logical time.
  *
@@ -210,6 +248,18 @@ struct reaction_t {
                                 // the reaction number.
     reactor_mode_t* mode;       // The enclosing mode of this reaction (if exists).
                                 // If enclosed in multiple, this will point to the innermost mode.
+    tag_t completed_tag;        // The tag at which the reaction last completed. RUNTIME.
+    struct lf_fan_out_t* fan_out; // The reactions downstream of each output, or NULL before an output is first produced. RUNTIME.
+    interval_t exec_time_estimate; // Estimated execution time used by --deadline-admission, or 0 to use the
+                                   // shortest measured one if LF_REACTION_STATS is defined. INSTANCE.
+    int criticality;            // Criticality level, 0 being the lowest, for mixed-criticality scheduling. INSTANCE.
+    bool suspendable;           // Whether lf_await() may suspend the reaction, releasing its worker (see future.h). INSTANCE.
+#ifdef LF_SUSPENDABLE_REACTIONS
+    struct lf_coroutine_t* coroutine; // The coroutine executing the reaction, or NULL if it is not executing. RUNTIME.
+#endif
+#ifdef LF_REACTION_STATS
+    struct lf_reaction_stats_t* stats; // Execution time statistics, or NULL before the first execution. RUNTIME.
+#endif
 };
 
 /** Typedef for event_t struct, used for storing activation records. */
@@ -222,10 +272,13 @@ struct event_t {
     size_t pos;               // Position in the priority queue.
     lf_token_t* token;        // Pointer to the token wrapping the value.
     bool is_dummy;            // Flag to indicate whether this event is merely a placeholder or an actual event.
+    bool is_counted;          // Whether the event counts toward the queued events of its physical action.
 #ifdef FEDERATED
     tag_t intended_tag;       // The intended tag.
 #endif
     event_t* next;            // Pointer to the next event lined up in superdense time.
+    event_t* next_pending;    // The next event on the event queue with the same trigger, if any.
+    event_t* prev_pending;    // The previous event on the event queue with the same trigger, if any.
 };
 
 /**
@@ -240,7 +293,12 @@ struct trigger_t {
     interval_t period;        // Minimum interarrival time of an action. For a timer, this is also the maximal interarrival time.
     bool is_physical;         // Indicator that this denotes a physical action.
     event_t* last;            // Pointer to the last event that was scheduled for this action.
+    event_t* pending;         // The events for this trigger on the event queue, most recently queued first.
     lf_spacing_policy_t policy;          // Indicates which policy to use when an event is scheduled too early.
+    size_t max_queued;        // Bound on the queued events of a physical action, or 0 for none.
+    lf_overflow_policy_t overflow_policy; // What to do when a schedule would exceed max_queued.
+    size_t num_queued;        // The queued events of a physical action. RUNTIME.
+    lf_overflow_stats_t overflow_stats;   // Outcomes of schedules that hit max_queued. RUNTIME.
     port_status_t status;     // Determines the status of the port at the current logical time. Therefore, this
                               // value needs to be reset at the beginning of each logical time.
                               //
@@ -259,6 +317,8 @@ struct trigger_t {
                               //   downstream messages have been produced for the same port for the same logical time.
     reactor_mode_t* mode;     // The enclosing mode of this reaction (if exists).
                               // If enclosed in multiple, this will point to the innermost mode.
+    trigger_t** coalesced;    // For a timer that stands for several coalesced timers, those timers. Otherwise NULL.
+    int number_of_coalesced;  // The number of coalesced timers.
 #ifdef FEDERATED
     tag_t last_known_status_tag;        // Last known status of the port, either via a timed message, a port absent, or a
                                         // TAG from the RTI.
@@ -321,6 +381,21 @@ typedef struct {
     bool has_value;
 } lf_action_base_t;
 
+/**
+ * A request to schedule an action, as passed to lf_schedule_batch().
+ */
+typedef struct {
+    void* action;              // Pointer to an action on a self struct.
+    interval_t extra_delay;    // The time offset over and above that in the action.
+    lf_token_t* token;         // The token to carry the payload or NULL for no payload.
+} lf_schedule_request_t;
+
+/**
+ * The body of a loop split with lf_parallel_for(), which executes the
+ * iterations from 'begin' up to but not including 'end'.
+ */
+typedef void (*lf_parallel_body_t)(void* arg, size_t begin, size_t end);
+
 /**
  * Internal part of the action structs.
  */
@@ -339,6 +414,9 @@ typedef struct {
     self_base_t* source_reactor;          // Pointer to the self struct of the reactor that provides data to this port.
                                           // If this is an input, that reactor will normally be the container of the
                                           // output port that sends it data.
+#ifdef LF_PORT_PRESENCE_ARRAYS
+    bool* presence;                       // Slot in the presence array of the environment or NULL if there is none.
+#endif
 } lf_port_internal_t;
 
 #endif
@@ -97,14 +97,36 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Representation of a permuted mixed radix integer.
  * The three arrays (digits, radixes, and permutation) are all
  * assumed to have the same size as given by the size field.
+ * The remaining fields are NULL unless mixed_radix_precompute()
+ * has been called, so they can be omitted from initializers.
  */
 typedef struct mixed_radix_int_t {
 	int size;
 	int* digits;
 	int* radixes;
 	int* permutation;
+	int* strides; // strides[n * size + i] is the place value of digit i after dropping n digits, or 0 if i < n.
+	int* values;  // values[n] is the value after dropping n digits, for n from 0 to size.
 } mixed_radix_int_t;
 
+/**
+ * Precompute the place values of the digits of the mixed-radix number for
+ * every number of dropped digits, and its current value for each of them,
+ * so that mixed_radix_parent() and mixed_radix_to_int() take constant time
+ * and mixed_radix_incr() keeps the values up to date. This is worth doing
+ * before iterating over the banks and channels of a connection with
+ * nested banks. Call it again after changing the digits directly.
+ * The tables are freed by mixed_radix_free().
+ * @param mixed A pointer to the mixed-radix number.
+ */
+void mixed_radix_precompute(mixed_radix_int_t* mixed);
+
+/**
+ * Free the tables allocated by mixed_radix_precompute(), if any.
+ * @param mixed A pointer to the mixed-radix number.
+ */
+void mixed_radix_free(mixed_radix_int_t* mixed);
+
 /**
  * Increment the mixed radix number by one according to the permutation matrix.
  * @param mixed A pointer to the mixed-radix number.
@@ -90,6 +90,14 @@ typedef struct reactor_mode_t reactor_mode_t;
 typedef struct reactor_mode_state_t reactor_mode_state_t;
 /** Typedef for mode_state_variable_reset_data_t struct, used for storing data for resetting state variables nested in modes. */
 typedef struct mode_state_variable_reset_data_t mode_state_variable_reset_data_t;
+/** Typedef for _lf_suspended_event_t struct, used for storing an event suspended in an inactive mode. */
+typedef struct _lf_suspended_event_t _lf_suspended_event_t;
+
+// Bit masks for the internally used flags on modes
+#define _LF_MODE_FLAG_MASK_ACTIVE        (1 << 0)
+#define _LF_MODE_FLAG_MASK_NEEDS_STARTUP (1 << 1)
+#define _LF_MODE_FLAG_MASK_HAD_STARTUP   (1 << 2)
+#define _LF_MODE_FLAG_MASK_NEEDS_RESET   (1 << 3)
 
 /** Type of the mode change. */
 typedef enum {no_transition, reset_transition, history_transition} lf_mode_change_type_t;
@@ -100,6 +108,9 @@ struct reactor_mode_t {
     char* name;                     // Name of this mode.
     instant_t deactivation_time;    // Time when the mode was left.
     uint8_t flags;                  // Bit vector for several internal flags related to the mode.
+    _lf_suspended_event_t* suspended_events; // Events of triggers in this mode suspended while it is inactive.
+    int state_resets_start;         // Index of the first reset data of this mode (@see _lf_initialize_modes).
+    int state_resets_size;          // Number of reset data of this mode.
 };
 
 /** A struct to store state of the modes in a reactor instance and/or its relation to enclosing modes. */
@@ -110,6 +121,19 @@ struct reactor_mode_state_t {
     reactor_mode_t* next_mode;      // Pointer to the next mode to activate at the end of this step (if set).
     lf_mode_change_type_t mode_change;  // A mode change type flag.
 };
+/**
+ * An element of the doubly-linked list of events suspended in a mode (@see reactor_mode_t),
+ * or of the list of reusable elements of an environment.
+ * The elements of an environment are additionally chained by allocation order, so that
+ * they can all be freed when the environment terminates.
+ */
+struct _lf_suspended_event_t {
+    _lf_suspended_event_t* next;        // Next element in the list.
+    _lf_suspended_event_t* prev;        // Previous element in the list, NULL if this is its head.
+    _lf_suspended_event_t* allocated;   // Previously allocated element of the environment.
+    event_t* event;                     // The suspended event, NULL if the element is unused.
+};
+
 /** A struct to store data for resetting state variables nested in modes. */
 struct mode_state_variable_reset_data_t {
     reactor_mode_t* mode;           // Pointer to the enclosing mode.
@@ -118,6 +142,19 @@ struct mode_state_variable_reset_data_t {
     size_t size;                    // The size of the variable.
 };
 
+/**
+ * Return true if the given mode is active.
+ * This includes all enclosing modes: if any of those is inactive, then so is this one.
+ * The activity of each mode is cached in its flags by _lf_process_mode_changes (and
+ * _lf_initialize_mode_states), so this is a single bit test. It is inline because it is
+ * called for every event and every triggered reaction.
+ *
+ * @param mode The mode instance to check, or NULL for reactors outside of modes.
+ */
+static inline bool _lf_mode_is_active(reactor_mode_t* mode) {
+    return mode == NULL || (mode->flags & _LF_MODE_FLAG_MASK_ACTIVE);
+}
+
 ////////////////////////////////////////////////////////////
 //// Forward declaration 
 typedef struct environment_t environment_t;
@@ -127,7 +164,6 @@ typedef struct environment_t environment_t;
 void _lf_initialize_modes(environment_t* env);
 void _lf_handle_mode_changes(environment_t* env);
 void _lf_handle_mode_triggered_reactions(environment_t* env);
-bool _lf_mode_is_active(reactor_mode_t* mode);
 void _lf_initialize_mode_states(
     environment_t* env,
     reactor_mode_state_t* states[], 
@@ -141,7 +177,7 @@ void _lf_process_mode_changes(
     trigger_t* timer_triggers[],
     int timer_triggers_size
 );
-void _lf_add_suspended_event(event_t* event);
+void _lf_add_suspended_event(environment_t* env, event_t* event);
 void _lf_handle_mode_startup_reset_reactions(
         environment_t* env,
         reaction_t** startup_reactions,
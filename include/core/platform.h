@@ -96,6 +96,17 @@ int lf_critical_section_exit(environment_t* env);
 
 #define LF_TIMEOUT 1
 
+/**
+ * @brief Storage-class specifier for variables that each thread has its own copy of.
+ * In the single-threaded runtime, there is only one thread, so it expands to nothing.
+ */
+#if defined(LF_SINGLE_THREADED)
+#define LF_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define LF_THREAD_LOCAL __declspec(thread)
+#else
+#define LF_THREAD_LOCAL _Thread_local
+#endif
 
 // To support the single-threaded runtime, we need the following functions. They
 //  are not required by the threaded runtime and is thus hidden behind a #ifdef.
@@ -150,6 +161,83 @@ int lf_thread_create(lf_thread_t* thread, void *(*lf_thread) (void *), void* arg
  */
 int lf_thread_join(lf_thread_t thread, void** thread_return);
 
+/**
+ * @brief Return the handle of the calling thread.
+ */
+lf_thread_t lf_thread_self();
+
+/**
+ * @brief Pin a thread to a CPU core.
+ *
+ * @param thread The thread.
+ * @param cpu_number The number of the core, starting at 0.
+ * @return 0 on success, platform-specific error number otherwise. Returns a
+ *  non-zero value on platforms that do not support thread affinity.
+ */
+int lf_thread_set_cpu(lf_thread_t thread, size_t cpu_number);
+
+/**
+ * @brief Restrict a thread to the CPU cores of a NUMA node.
+ *
+ * On platforms that allocate memory on the node of the thread that first
+ * touches it (e.g., Linux), memory that the thread initializes afterwards is
+ * local to the node.
+ *
+ * @param thread The thread.
+ * @param node The number of the NUMA node, starting at 0.
+ * @return 0 on success, platform-specific error number otherwise. Returns a
+ *  non-zero value on platforms that do not support NUMA placement.
+ */
+int lf_thread_set_numa_node(lf_thread_t thread, size_t node);
+
+/**
+ * @brief The thread scheduling policies.
+ */
+typedef enum {
+    LF_SCHED_FAIR,      // Non real-time scheduling policy (e.g., SCHED_OTHER).
+    LF_SCHED_TIMESLICE, // Real-time priority-based policy with time slicing (e.g., SCHED_RR).
+    LF_SCHED_PRIORITY,  // Real-time priority-based policy without time slicing (e.g., SCHED_FIFO).
+} lf_scheduling_policy_type_t;
+
+/**
+ * @brief A thread scheduling policy and its parameters.
+ */
+typedef struct {
+    lf_scheduling_policy_type_t policy;
+    int priority; // Only used by LF_SCHED_PRIORITY and LF_SCHED_TIMESLICE.
+} lf_scheduling_policy_t;
+
+/**
+ * The range of thread priorities used by the runtime. Platforms map this range
+ * onto the range of priorities that they support. Larger is more urgent.
+ */
+#define LF_SCHED_MIN_PRIORITY 0
+#define LF_SCHED_MAX_PRIORITY 99
+
+/**
+ * @brief Set the scheduling policy and priority of a thread.
+ *
+ * Real-time policies usually require elevated privileges.
+ *
+ * @param thread The thread.
+ * @param policy The policy to use.
+ * @return 0 on success, platform-specific error number otherwise. Returns a
+ *  non-zero value on platforms that do not support the policy.
+ */
+int lf_thread_set_scheduling_policy(lf_thread_t thread, lf_scheduling_policy_t* policy);
+
+/**
+ * @brief Set the priority of a thread, keeping its scheduling policy.
+ *
+ * This only has an effect if the thread has a real-time scheduling policy.
+ *
+ * @param thread The thread.
+ * @param priority A priority between LF_SCHED_MIN_PRIORITY and
+ *  LF_SCHED_MAX_PRIORITY.
+ * @return 0 on success, platform-specific error number otherwise.
+ */
+int lf_thread_set_priority(lf_thread_t thread, int priority);
+
 /**
  * Initialize a mutex.
  *
@@ -210,6 +298,26 @@ int lf_cond_wait(lf_cond_t* cond);
  */
 int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
 
+#if !defined(PLATFORM_ARDUINO) && !defined(PLATFORM_ZEPHYR) && !defined(PLATFORM_NRF52) \
+        && !defined(PLATFORM_RP2040)
+/**
+ * A function that the calling thread runs before it blocks in lf_cond_wait() or
+ * lf_cond_timedwait(), and that a worker runs before it exits, or NULL. Each thread has
+ * its own. A target runtime sets it while the thread holds a resource that other threads
+ * may need in order to wake it up, such as the GIL of Python (see LF_PYTHON_GIL_TIME_SLICE),
+ * so that the function releases the resource. The function may clear the hook.
+ * Only supported on hosted platforms.
+ */
+extern LF_THREAD_LOCAL void (*lf_thread_release_hook)(void);
+#define _LF_RUN_THREAD_RELEASE_HOOK() \
+    do { \
+        void (*_lf_hook)(void) = lf_thread_release_hook; \
+        if (_lf_hook != NULL) _lf_hook(); \
+    } while (0)
+#else
+#define _LF_RUN_THREAD_RELEASE_HOOK()
+#endif
+
 /*
  * Atomically increment the variable that ptr points to by the given value, and return the original value of the variable.
  * @param ptr A pointer to a variable. The value of this variable will be replaced with the result of the operation.
@@ -218,6 +326,8 @@ int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
  */
 #if defined(PLATFORM_ZEPHYR)
 #define lf_atomic_fetch_add(ptr, value) _zephyr_atomic_fetch_add((int*) ptr, value)
+#elif defined(PLATFORM_RP2040)
+#define lf_atomic_fetch_add(ptr, value) _rp2040_atomic_fetch_add((int*) ptr, value)
 #elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 // Assume that an integer is 32 bits.
 #define lf_atomic_fetch_add(ptr, value) InterlockedExchangeAdd(ptr, value)
@@ -235,6 +345,8 @@ int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
  */
 #if defined(PLATFORM_ZEPHYR)
 #define lf_atomic_add_fetch(ptr, value) _zephyr_atomic_add_fetch((int*) ptr, value)
+#elif defined(PLATFORM_RP2040)
+#define lf_atomic_add_fetch(ptr, value) _rp2040_atomic_add_fetch((int*) ptr, value)
 #elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 // Assume that an integer is 32 bits.
 #define lf_atomic_add_fetch(ptr, value) InterlockedAdd(ptr, value)
@@ -254,6 +366,8 @@ int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
  */
 #if defined(PLATFORM_ZEPHYR)
 #define lf_bool_compare_and_swap(ptr, value, newval) _zephyr_bool_compare_and_swap((bool*) ptr, value, newval)
+#elif defined(PLATFORM_RP2040)
+#define lf_bool_compare_and_swap(ptr, value, newval) _rp2040_bool_compare_and_swap((bool*) ptr, value, newval)
 #elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 // Assume that a boolean is represented with a 32-bit integer.
 #define lf_bool_compare_and_swap(ptr, oldval, newval) (InterlockedCompareExchange(ptr, newval, oldval) == oldval)
@@ -273,6 +387,8 @@ int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
  */
 #if defined(PLATFORM_ZEPHYR)
 #define lf_val_compare_and_swap(ptr, value, newval) _zephyr_val_compare_and_swap((int*) ptr, value, newval)
+#elif defined(PLATFORM_RP2040)
+#define lf_val_compare_and_swap(ptr, value, newval) _rp2040_val_compare_and_swap((int*) ptr, value, newval)
 #elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #define lf_val_compare_and_swap(ptr, oldval, newval) InterlockedCompareExchange(ptr, newval, oldval)
 #elif defined(__GNUC__) || defined(__clang__)
@@ -281,6 +397,82 @@ int lf_cond_timedwait(lf_cond_t* cond, instant_t absolute_time_ns);
 #error "Compiler not supported"
 #endif
 
+/*
+ * Memory orders for the explicit variants of the atomic operations below, which are
+ * those of C11 (see memory_order in <stdatomic.h>). The operations above are full
+ * barriers, which code whose correctness depends on a weaker order can avoid,
+ * e.g., to only claim a slot in an array that is published by other means.
+ * Platforms without these orders use the full barriers instead.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define LF_ATOMIC_RELAXED __ATOMIC_RELAXED
+#define LF_ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#define LF_ATOMIC_RELEASE __ATOMIC_RELEASE
+#define LF_ATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+#define LF_ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+#else
+#define LF_ATOMIC_RELAXED 0
+#define LF_ATOMIC_ACQUIRE 2
+#define LF_ATOMIC_RELEASE 3
+#define LF_ATOMIC_ACQ_REL 4
+#define LF_ATOMIC_SEQ_CST 5
+#endif
+
+/*
+ * Variants of lf_atomic_fetch_add(), lf_atomic_add_fetch(), and lf_bool_compare_and_swap()
+ * with the given memory order, which is one of the LF_ATOMIC_* orders above, and an
+ * atomic load, lf_atomic_load_explicit(), with the given order, which is one of
+ * LF_ATOMIC_RELAXED, LF_ATOMIC_ACQUIRE, and LF_ATOMIC_SEQ_CST.
+ * For lf_bool_compare_and_swap_explicit(), the order applies when the comparison is
+ * successful. Otherwise, the operation is only a load, with the acquire part of the order.
+ */
+#if defined(PLATFORM_ZEPHYR) || defined(PLATFORM_RP2040) \
+        || defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define lf_atomic_fetch_add_explicit(ptr, value, order) lf_atomic_fetch_add(ptr, value)
+#define lf_atomic_add_fetch_explicit(ptr, value, order) lf_atomic_add_fetch(ptr, value)
+#define lf_bool_compare_and_swap_explicit(ptr, oldval, newval, order) lf_bool_compare_and_swap(ptr, oldval, newval)
+#define lf_atomic_load_explicit(ptr, order) lf_atomic_fetch_add(ptr, 0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define lf_atomic_fetch_add_explicit(ptr, value, order) __atomic_fetch_add(ptr, value, order)
+#define lf_atomic_add_fetch_explicit(ptr, value, order) __atomic_add_fetch(ptr, value, order)
+#define lf_atomic_load_explicit(ptr, order) __atomic_load_n(ptr, order)
+#define lf_bool_compare_and_swap_explicit(ptr, oldval, newval, order) __extension__({ \
+    __typeof__((void)0, *(ptr)) _lf_expected = (oldval); \
+    __atomic_compare_exchange_n(ptr, &_lf_expected, newval, 0, order, \
+            (order) == __ATOMIC_RELEASE ? __ATOMIC_RELAXED \
+            : (order) == __ATOMIC_ACQ_REL ? __ATOMIC_ACQUIRE : (order)); \
+})
+#else
+#error "Compiler not supported"
+#endif
+
+/*
+ * Issue a full memory barrier, which orders all memory accesses before it
+ * with respect to all memory accesses after it for all threads.
+ */
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define lf_memory_barrier() MemoryBarrier()
+#elif defined(__GNUC__) || defined(__clang__)
+#define lf_memory_barrier() __sync_synchronize()
+#else
+#error "Compiler not supported"
+#endif
+
+#endif
+
+/*
+ * Tell the processor that the calling thread is spinning in a wait loop, so
+ * that it can save power and give way to a thread sharing the core. This does
+ * nothing on processors without such a hint.
+ */
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define lf_spin_pause() YieldProcessor()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define lf_spin_pause() __builtin_ia32_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7))
+#define lf_spin_pause() __asm__ __volatile__("yield")
+#else
+#define lf_spin_pause() ((void)0)
 #endif
 
 /**
@@ -316,6 +508,46 @@ int lf_sleep(interval_t sleep_duration);
  */
 int _lf_interruptable_sleep_until_locked(environment_t* env, instant_t wakeup_time);
 
+#if defined(PLATFORM_NRF52) || defined(PLATFORM_RP2040) \
+        || (defined(PLATFORM_ZEPHYR) && defined(LF_ZEPHYR_CLOCK_COUNTER))
+/**
+ * Statistics of the wakeups of _lf_interruptable_sleep_until_locked() on the
+ * embedded platforms whose sleep is tickless, i.e., programs a hardware timer to
+ * fire at the wakeup time and sleeps until it does or an interrupt signals an event.
+ * The latency of a wakeup is how late the sleep resumed after the timer fired,
+ * which includes leaving the sleep state and handling the interrupt.
+ */
+typedef struct lf_wakeup_stats_t {
+    /** The number of wakeups by the timer, excluding those by events. */
+    size_t wakeups;
+    /** The sum of the latencies of the wakeups. */
+    interval_t latency_total;
+    /** The largest latency of a wakeup. */
+    interval_t latency_max;
+} lf_wakeup_stats_t;
+
+/**
+ * Get the statistics of the wakeups from sleeps so far.
+ * @param stats Where to put the statistics.
+ */
+void lf_get_wakeup_stats(lf_wakeup_stats_t* stats);
+
+/**
+ * Record a wakeup with the given latency in the given statistics.
+ * This is for use by the platform support.
+ */
+static inline void _lf_record_wakeup(lf_wakeup_stats_t* stats, interval_t latency) {
+    if (latency < 0) {
+        latency = 0;
+    }
+    stats->wakeups++;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+}
+#endif
+
 /**
  * Macros for marking function as deprecated
  */
@@ -37,11 +37,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <pthread.h>
 
+// With LF_FUTEX_LOCKS, lf_linux_support.h defines the mutexes and condition variables.
+#if !defined(LF_FUTEX_LOCKS)
 typedef pthread_mutex_t lf_mutex_t;
 typedef struct {
     lf_mutex_t* mutex;
     pthread_cond_t condition;
 } lf_cond_t;
+#endif
 typedef pthread_t lf_thread_t;
 
 #endif
\ No newline at end of file
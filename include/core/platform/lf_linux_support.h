@@ -40,7 +40,33 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "lf_tag_64_32.h"
 
 #if !defined LF_SINGLE_THREADED
-    #if __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
+    #if defined(LF_FUTEX_LOCKS)
+        // POSIX threads, with mutexes and condition variables built on futexes
+        // (see lf_linux_support.c) rather than on those of pthreads.
+        #include "lf_POSIX_threads_support.h"
+
+        /**
+         * A recursive mutex. The state is 0 if the mutex is unlocked, 1 if it is
+         * locked, and 2 if it is locked and threads may be waiting for it.
+         */
+        typedef struct {
+            uint32_t state;
+            uintptr_t owner;       // Identity of the thread holding the mutex, or 0.
+            uint32_t count;        // Number of times the owner has locked the mutex.
+            uint32_t spins;        // Running average of the spins needed to lock the mutex.
+        } lf_mutex_t;
+
+        /**
+         * A condition variable. Waiters wait on the sequence, which every signal
+         * and broadcast increments, and a broadcast wakes only one of them and
+         * moves the others to wait on the mutex, which wakes them one at a time.
+         */
+        typedef struct {
+            lf_mutex_t* mutex;
+            uint32_t sequence;
+            uint32_t waiters;      // Number of threads waiting, to skip waking when there are none.
+        } lf_cond_t;
+    #elif __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
         // (Not C++11 or later) or no threads support
         #include "lf_POSIX_threads_support.h"
     #else
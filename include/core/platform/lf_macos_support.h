@@ -33,13 +33,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LF_MACOS_SUPPORT_H
 
 #include <stdint.h> // For fixed-width integral types
-#include <time.h>   // For CLOCK_MONOTONIC
+#include <time.h>   // For CLOCK_UPTIME_RAW
 
 // Use 64-bit times and 32-bit unsigned microsteps
 #include "lf_tag_64_32.h"
 
-// The underlying physical clock for MacOS
-#define _LF_CLOCK CLOCK_MONOTONIC
+// The underlying physical clock for MacOS, which counts the same ticks as
+// mach_absolute_time() and mach_wait_until() and stops while the machine sleeps
+#define _LF_CLOCK CLOCK_UPTIME_RAW
 
 #if !defined LF_SINGLE_THREADED
     #if __STDC_VERSION__ < 201112L || defined (__STDC_NO_THREADS__)
@@ -20,4 +20,44 @@
 #define LF_TIME_BUFFER_LENGTH 80
 #define _LF_TIMEOUT 1
 
+#if !defined(LF_SINGLE_THREADED)
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * In the threaded runtime, each of the two cores runs one thread,
+ * which is identified by the number of its core.
+ */
+typedef recursive_mutex_t lf_mutex_t;
+typedef struct {
+    lf_mutex_t* mutex;
+    /** The number of notifications, which waiting threads wait to change. */
+    volatile uint32_t sequence;
+} lf_cond_t;
+typedef int lf_thread_t;
+
+/**
+ * @brief Add `value` to `*ptr` and return original value of `*ptr`
+ */
+int _rp2040_atomic_fetch_add(int *ptr, int value);
+/**
+ * @brief Add `value` to `*ptr` and return new updated value of `*ptr`
+ */
+int _rp2040_atomic_add_fetch(int *ptr, int value);
+
+/**
+ * @brief Compare and swap for boolean value.
+ * If `*ptr` is equal to `value` then overwrite it
+ * with `newval`. If not do nothing. Returns true on overwrite.
+ */
+bool _rp2040_bool_compare_and_swap(bool *ptr, bool value, bool newval);
+
+/**
+ * @brief Compare and swap for integers. If `*ptr` is equal
+ * to `value`, it is updated to `newval`. The function returns
+ * the original value of `*ptr`.
+ */
+int _rp2040_val_compare_and_swap(int *ptr, int value, int newval);
+#endif // !LF_SINGLE_THREADED
+
 #endif // LF_PICO_SUPPORT_H
@@ -25,3 +25,18 @@ struct timespec convert_ns_to_timespec(instant_t t);
  * time reported by CLOCK_REALTIME.
  */
 void calculate_epoch_offset(void);
+
+#ifdef PLATFORM_Darwin
+#include <stdint.h>
+
+/**
+ * @brief Convert a count of ticks of mach_absolute_time() to nanoseconds.
+ */
+instant_t convert_mach_ticks_to_ns(uint64_t ticks);
+
+/**
+ * @brief Convert a nonnegative number of nanoseconds to ticks of
+ * mach_absolute_time(), rounding up.
+ */
+uint64_t convert_ns_to_mach_ticks(instant_t t);
+#endif
@@ -78,6 +78,13 @@
  */
 #define LF_SPARSE_CAPACITY_DIVIDER 10
 
+/**
+ * Minimum width of a sparse multiport for which the record of present
+ * channels is kept as a bitmap, which is iterated in channel order
+ * without sorting and never overflows.
+ */
+#define LF_SPARSE_BITMAP_WIDTH 64
+
 /**
  * An iterator over a record of the subset of channels of a multiport that
  * have present inputs.  To use this, create an iterator using the function
@@ -101,6 +108,22 @@ typedef struct lf_multiport_iterator_t {
  */
 lf_multiport_iterator_t _lf_multiport_iterator_impl(lf_port_base_t** port, int width);
 
+struct environment_t;
+
+/**
+ * Give the channels of a multiport consecutive slots in the presence array of the
+ * environment so that lf_multiport_next() can scan them as contiguous bytes rather
+ * than visiting one port struct per channel. The code generator is expected to call
+ * this for every input multiport, in channel order, after connections are set up.
+ * A channel that belongs to more than one multiport keeps the slot it was given
+ * first, and the multiports sharing it fall back to visiting the port structs.
+ * This does nothing unless LF_PORT_PRESENCE_ARRAYS is defined.
+ * @param env The environment of the reactor that reads the multiport.
+ * @param port An array of pointers to port structs.
+ * @param width The width of the multiport.
+ */
+void _lf_bind_port_presence(struct environment_t* env, lf_port_base_t** port, int width);
+
 /**
  * Macro for creating an iterator over an input multiport.
  * The argument is the port name. This returns an instance of
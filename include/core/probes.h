@@ -0,0 +1,80 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file probes.h
+ * @brief Static probes (USDT) at the hot points of the runtime.
+ *
+ * Unlike the tracepoints of trace.h, which write trace files when LF_TRACE is
+ * defined, these probes are always compiled in where sys/sdt.h is available.
+ * Each compiles to a nop instruction and a note in the ELF file, so it costs
+ * next to nothing until a tool such as bpftrace or perf attaches to it, e.g.:
+ *
+ *     bpftrace -e 'usdt:./Program:lf:reaction_start { @[str(arg0)] = count(); }'
+ *
+ * The probes of provider "lf" and their arguments are:
+ * - reaction_start, reaction_end: reaction name, worker, tag time, microstep.
+ * - deadline_missed: reaction name, worker.
+ * - schedule: trigger, time of the scheduled event relative to the current tag.
+ * - tag_advance: new tag time, microstep.
+ * - level_advance: the level that the workers of a threaded scheduler start.
+ * - worker_wait_start, worker_wait_end, worker_spin_start, worker_spin_end: worker.
+ * - wakeup: lateness of the main thread waking up for the next tag.
+ * - watchdog_expire: trigger of the watchdog, lateness.
+ * - token_alloc, token_free: token.
+ * - federate_send, federate_receive: message type, peer federate or -1 for
+ *   the RTI, payload length, intended tag time, microstep.
+ *
+ * Defining LF_USDT as 0 removes the probes. Defining it as 1 requires sys/sdt.h.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(LF_USDT)
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define LF_USDT 1
+#endif
+#endif
+#endif
+
+#if defined(LF_USDT) && LF_USDT
+
+#include <sys/sdt.h>
+
+#define LF_PROBE1(name, a) DTRACE_PROBE1(lf, name, a)
+#define LF_PROBE2(name, a, b) DTRACE_PROBE2(lf, name, a, b)
+#define LF_PROBE4(name, a, b, c, d) DTRACE_PROBE4(lf, name, a, b, c, d)
+#define LF_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(lf, name, a, b, c, d, e)
+
+#else
+
+#define LF_PROBE1(name, a)
+#define LF_PROBE2(name, a, b)
+#define LF_PROBE4(name, a, b, c, d)
+#define LF_PROBE5(name, a, b, c, d, e)
+
+#endif // LF_USDT
+#endif // PROBES_H
@@ -0,0 +1,210 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file reaction_stats.h
+ * @brief Execution time statistics of reactions collected without tracing.
+ *
+ * If LF_REACTION_STATS is defined, each execution of a reaction is timed and
+ * counted in a histogram of that reaction kept by the worker that executed it.
+ * The histograms are log-linear, like those of HdrHistogram: each power of two
+ * is divided into LF_REACTION_STATS_SUB_BUCKETS buckets, so that percentiles
+ * are accurate to within 1 / LF_REACTION_STATS_SUB_BUCKETS of their value.
+ * Since only the worker executing a reaction writes to its histogram, recording
+ * takes no lock. Readers merge the histograms of the workers. The counts are read
+ * without synchronization, so statistics read while workers execute reactions
+ * are approximate. The statistics of each environment are printed at termination.
+ *
+ * If LF_REACTION_COUNTERS is defined, which implies LF_REACTION_STATS in CMake builds, each
+ * thread that executes reactions opens a group of hardware performance counters
+ * with perf_event_open() on Linux (cycles, instructions, cache misses, and branch
+ * misses in user space), reads the group before and after each reaction, and adds
+ * the differences to the totals of the reaction kept by the worker. This costs
+ * two system calls per reaction. Where the counters are not available, for example
+ * if /proc/sys/kernel/perf_event_paranoid forbids them, a warning is printed once
+ * and the counts stay zero.
+ */
+
+#ifndef REACTION_STATS_H
+#define REACTION_STATS_H
+
+#include "lf_types.h"
+
+/**
+ * Execution time statistics of a reaction, in nanoseconds.
+ * All are zero if the reaction has not executed.
+ */
+typedef struct lf_exec_time_stats_t {
+    size_t count;    // The number of executions.
+    interval_t min;  // The shortest execution time.
+    interval_t max;  // The longest execution time.
+    interval_t mean; // The average execution time.
+    interval_t p50;  // The median execution time.
+    interval_t p99;  // The execution time that 99% of the executions do not exceed.
+} lf_exec_time_stats_t;
+
+/**
+ * Hardware event counts of the executions of a reaction.
+ * All are zero unless LF_REACTION_COUNTERS is defined and the counters are available.
+ */
+typedef struct lf_reaction_counters_t {
+    size_t count;            // The number of executions counted.
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+    uint64_t branch_misses;
+} lf_reaction_counters_t;
+
+#ifdef LF_REACTION_STATS
+
+#include <stdint.h>
+
+#ifdef LF_REACTION_COUNTERS
+/** The hardware events counted, in the order of lf_reaction_counters_t. */
+#define LF_REACTION_NUM_COUNTERS 4
+
+/** A reading of the hardware counters of a thread. */
+typedef struct lf_counter_sample_t {
+    uint64_t time_enabled;                        // The time that the counters were enabled.
+    uint64_t time_running;                        // The time that they counted, which is less if multiplexed.
+    uint64_t values[LF_REACTION_NUM_COUNTERS];
+} lf_counter_sample_t;
+#endif
+
+/** The number of buckets into which each power of two is divided. Must be a power of two. */
+#ifndef LF_REACTION_STATS_SUB_BUCKETS
+#define LF_REACTION_STATS_SUB_BUCKETS 8
+#endif
+
+/**
+ * The number of buckets of a histogram, which covers execution times up to
+ * 2^40 times LF_REACTION_STATS_SUB_BUCKETS nanoseconds. Longer times are counted
+ * in the last bucket.
+ */
+#define LF_REACTION_STATS_BUCKETS (41 * LF_REACTION_STATS_SUB_BUCKETS)
+
+/** Histogram of the execution times of a reaction on one worker. */
+typedef struct lf_exec_time_histogram_t {
+    uint32_t counts[LF_REACTION_STATS_BUCKETS];
+    size_t count;
+    interval_t min;
+    interval_t max;
+    interval_t total;
+#ifdef LF_REACTION_COUNTERS
+    size_t counted;                                 // The number of executions counted.
+    uint64_t counters[LF_REACTION_NUM_COUNTERS];    // The totals of the hardware events.
+#endif
+} lf_exec_time_histogram_t;
+
+/** The histograms of a reaction, allocated when it first executes. */
+typedef struct lf_reaction_stats_t {
+    reaction_t* reaction;
+    struct lf_reaction_stats_t* next;       // The next reaction of the same environment.
+    int num_workers;
+    lf_exec_time_histogram_t histograms[];  // One per worker.
+} lf_reaction_stats_t;
+
+/**
+ * @brief Record an execution of the given reaction by the given worker.
+ * @param env The environment of the reaction.
+ * @param reaction The reaction.
+ * @param worker The number of the worker, or 0 in single-threaded execution.
+ * @param execution_time The execution time of the reaction.
+ */
+void _lf_record_reaction_time(environment_t* env, reaction_t* reaction, int worker, interval_t execution_time);
+
+#ifdef LF_REACTION_COUNTERS
+/**
+ * @brief Read the hardware counters of the calling thread, opening them on first use.
+ * @param sample The place to store the reading, which is all zero if the counters
+ *  are not available.
+ */
+void _lf_read_reaction_counters(lf_counter_sample_t* sample);
+
+/**
+ * @brief Read the hardware counters of the calling thread again and add the events
+ * since the given values to those of the given reaction and worker.
+ * @param env The environment of the reaction.
+ * @param reaction The reaction.
+ * @param worker The number of the worker, or 0 in single-threaded execution.
+ * @param start The values returned by _lf_read_reaction_counters() before the reaction.
+ */
+void _lf_record_reaction_counters(environment_t* env, reaction_t* reaction, int worker,
+        const lf_counter_sample_t* start);
+
+/**
+ * @brief Get the hardware event counts of the given reaction.
+ * @param reaction The reaction.
+ * @param worker The worker whose executions to include, or -1 to include all.
+ * @param counters The place to store the counts.
+ */
+void lf_get_reaction_counters(reaction_t* reaction, int worker, lf_reaction_counters_t* counters);
+#else
+#define lf_get_reaction_counters(reaction, worker, counters) memset(counters, 0, sizeof(lf_reaction_counters_t))
+#endif // LF_REACTION_COUNTERS
+
+/**
+ * @brief Get the execution time statistics of the given reaction.
+ * @param reaction The reaction.
+ * @param worker The worker whose executions to include, or -1 to include all.
+ * @param stats The place to store the statistics.
+ */
+void lf_get_reaction_stats(reaction_t* reaction, int worker, lf_exec_time_stats_t* stats);
+
+/**
+ * @brief Return an execution time of the given reaction that the given fraction of
+ * its executions by all workers do not exceed, or 0 if it has not executed.
+ * This is cheaper than lf_get_reaction_stats(), e.g. for use by a scheduler.
+ * @param percentile A number between 0 and 1.
+ */
+interval_t lf_reaction_exec_time_percentile(reaction_t* reaction, double percentile);
+
+/**
+ * @brief Return the shortest execution time of the given reaction by any worker,
+ * or 0 if it has not executed. This takes time proportional to the number of workers.
+ */
+interval_t lf_reaction_exec_time_min(reaction_t* reaction);
+
+/**
+ * @brief Print the execution time statistics of the reactions of the given environment.
+ */
+void lf_print_reaction_stats(environment_t* env);
+
+/**
+ * @brief Free the statistics of the reactions of the given environment.
+ */
+void _lf_free_reaction_stats(environment_t* env);
+
+#else
+
+#define _lf_record_reaction_time(...)
+#define lf_get_reaction_stats(reaction, worker, stats) memset(stats, 0, sizeof(lf_exec_time_stats_t))
+#define lf_get_reaction_counters(reaction, worker, counters) memset(counters, 0, sizeof(lf_reaction_counters_t))
+#define lf_reaction_exec_time_percentile(...) 0
+#define lf_reaction_exec_time_min(...) 0
+#define lf_print_reaction_stats(...)
+#define _lf_free_reaction_stats(...)
+
+#endif // LF_REACTION_STATS
+#endif // REACTION_STATS_H
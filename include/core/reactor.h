@@ -79,6 +79,18 @@
  */
 void _lf_set_present(lf_port_base_t* port);
 
+/**
+ * Mark the channels of a multiport from start up to but not including
+ * start + count present, as _lf_set_present() does for each of them, but
+ * recording their is_present fields and their channels in the sparse
+ * records of their destinations in bulk.
+ * This assumes that the mutex is not held.
+ * @param ports The array of pointers to the channels of the multiport.
+ * @param start The first channel.
+ * @param count The number of channels.
+ */
+void _lf_set_present_range(lf_port_base_t** ports, int start, int count);
+
 // NOTE: Ports passed to these macros can be cast to:
 // lf_port_base_t: which has the field bool is_present (and more);
 // token_template_t: which has a lf_token_t* token field; or
@@ -118,6 +130,42 @@ do { \
     } \
 } while(0)
 
+/**
+ * Set the channels of the specified output multiport (or multiport input
+ * of a contained reactor) from start up to but not including start + count
+ * to the specified value, which is evaluated once.
+ *
+ * For types that are copied by value, this stores the value in each channel
+ * and then marks the channels present with one call to
+ * _lf_set_present_range(). For token types, the first channel gets a token
+ * as with _LF_SET and the other channels share it as with _LF_SET_TOKEN,
+ * which is defined below.
+ * @param out The multiport (by name).
+ * @param start The first channel.
+ * @param count The number of channels.
+ * @param val The value to insert into the channels.
+ */
+#define _LF_SET_RANGE(out, start, count, val) \
+do { \
+    int _lf_start = (start); \
+    int _lf_end = _lf_start + (count); \
+    if (_lf_end > _lf_start) { \
+        if (((token_template_t*)out[_lf_start])->token != NULL) { \
+            _LF_SET(out[_lf_start], val); \
+            lf_token_t* _lf_token = ((token_template_t*)out[_lf_start])->token; \
+            for (int _lf_i = _lf_start + 1; _lf_i < _lf_end; _lf_i++) { \
+                _LF_SET_TOKEN(out[_lf_i], _lf_token); \
+            } \
+        } else { \
+            out[_lf_start]->value = val; \
+            for (int _lf_i = _lf_start + 1; _lf_i < _lf_end; _lf_i++) { \
+                out[_lf_i]->value = out[_lf_start]->value; \
+            } \
+            _lf_set_present_range((lf_port_base_t**)out, _lf_start, _lf_end - _lf_start); \
+        } \
+    } \
+} while(0)
+
 /**
  * Version of set for output types given as 'type[]' where you
  * want to send a previously dynamically allocated array.
@@ -328,6 +376,30 @@ void lf_print_snapshot(environment_t* env);
  */
 void lf_request_stop();
 
+#if defined(LF_SINGLE_THREADED) && defined(LF_EVENT_LOOP)
+/**
+ * Register a file descriptor with the event loop of the single-threaded runtime,
+ * which, with LF_EVENT_LOOP on Linux, waits for the next event on an epoll set
+ * rather than sleeping. Whenever the file descriptor is ready for the specified
+ * events, the specified physical action is scheduled with no payload, so that a
+ * reaction to it can do the I/O without another thread. Readiness is level-triggered,
+ * so the action is scheduled again until the reaction has read or written enough.
+ * The program should be run with keepalive, or it stops when the event queue is empty.
+ * @param fd The file descriptor, which should be non-blocking.
+ * @param events The epoll events to wait for, e.g., EPOLLIN.
+ * @param action The physical action to schedule.
+ * @return 0 on success, or -1 with errno set on failure.
+ */
+int lf_event_loop_add_fd(int fd, uint32_t events, void* action);
+
+/**
+ * Unregister a file descriptor registered with lf_event_loop_add_fd().
+ * @param fd The file descriptor.
+ * @return 0 on success, or -1 with errno set on failure.
+ */
+int lf_event_loop_remove_fd(int fd);
+#endif
+
 /**
  * Allocate zeroed-out memory and record the allocated memory on
  * the specified list so that it will be freed when calling
@@ -366,6 +438,44 @@ void* _lf_new_reactor(size_t size);
  */
 void _lf_free_all_reactors(void);
 
+/**
+ * Return the number of bytes that the arena for reactors occupies, which is
+ * zero unless the runtime was compiled with a positive LF_ARENA_CHUNK_SIZE.
+ * In that mode, reactors and the memory recorded by
+ * {@link _lf_allocate(size_t, size_t, allocation_record_t**)} are allocated
+ * from chunks of this size, which are all freed by _lf_free_all_reactors().
+ * @param used If not NULL, the place to store the number of those bytes
+ *  that have been allocated.
+ */
+size_t lf_arena_footprint(size_t* used);
+
+/**
+ * Memory used by the runtime, as reported by lf_get_memory_stats().
+ */
+typedef struct lf_memory_stats_t {
+    int tokens_live;           // Tokens that have been allocated and not freed or recycled.
+    int tokens_peak;           // The largest value of tokens_live so far.
+    size_t tokens_recycled;    // Tokens in the recycling bins available to the calling thread.
+    int payloads_live;         // Message payloads that have not been freed.
+    size_t payload_pool_bytes; // Bytes of recycled payloads available to the calling thread.
+    size_t events_allocated;   // Events allocated by all environments.
+    size_t events_live;        // Events that are in use rather than free for reuse.
+    size_t events_peak;        // The sum over environments of the largest value of events_live.
+    size_t event_queue_size;   // Events on the event queues.
+    size_t reactor_bytes;      // Bytes allocated for reactors and the memory recorded on them.
+    size_t trace_buffer_bytes; // Bytes allocated for trace buffers.
+    size_t scratch_bytes;      // Bytes reserved by the scratch arenas (@see lf_scratch_alloc()).
+} lf_memory_stats_t;
+
+/**
+ * Report the memory that the runtime uses for tokens, events, reactors, and
+ * trace buffers. The counters are updated without synchronization, so
+ * values read while workers execute reactions are approximate.
+ * At termination, the statistics are printed at the log level.
+ * @param stats The place to store the statistics.
+ */
+void lf_get_memory_stats(lf_memory_stats_t* stats);
+
 /**
  * Free memory recorded on the allocations list of the specified reactor.
  * @param self The self struct of the reactor.
@@ -390,6 +500,25 @@ void _lf_start_time_step(environment_t *env);
  */
 void _lf_initialize_trigger_objects();
 
+/**
+ * Call the specified function on consecutive chunks of the range from 0 to
+ * count - 1, in parallel if the runtime is threaded. This lets the generated
+ * `_lf_initialize_trigger_objects` function create and wire up the members of
+ * large banks on as many threads as there are workers, which have not started
+ * yet. While the chunks are initialized, _lf_new_reactor(), _lf_allocate(), and
+ * _lf_initialize_template() may be called from several threads. The function
+ * must otherwise only write to the reactors of its chunk and to elements of
+ * shared arrays at positions that depend on the indexes in its chunk.
+ * @param count The number of instances to initialize, such as the width of a bank.
+ * @param chunk_size The number of instances per chunk, or 0 to let the runtime
+ *  choose it.
+ * @param initialize The function that initializes the instances from first
+ *  up to, but not including, end.
+ * @param arg The argument to pass to the function.
+ */
+void _lf_initialize_in_parallel(
+        size_t count, size_t chunk_size, void (*initialize)(size_t first, size_t end, void* arg), void* arg);
+
 /**
  * Pop all events from event_q with timestamp equal to current_time, extract all
  * the reactions triggered by these events, and stick them into the reaction
@@ -523,6 +652,59 @@ trigger_handle_t _lf_schedule_value(lf_action_base_t* action, interval_t extra_d
  */
 trigger_handle_t _lf_schedule_copy(lf_action_base_t* action, interval_t offset, void* value, size_t length);
 
+/**
+ * Schedule several actions at once. For each run of requests whose actions
+ * belong to the same environment, this enters the critical section once,
+ * inserts the resulting events into the event queue together, and notifies
+ * anyone waiting for new events once.
+ * See _lf_schedule_token() for details.
+ * @param requests The actions to schedule with their delays and tokens.
+ * @param count The number of requests.
+ * @param handles An array of at least count entries that receives the
+ *  handle returned for each request, or NULL.
+ * @return The number of requests for which an error (-1) was returned.
+ */
+int _lf_schedule_batch(lf_schedule_request_t* requests, size_t count, trigger_handle_t* handles);
+
+/**
+ * Bound the number of events of a physical action that may be queued at once
+ * and set what a schedule of it that would exceed the bound does. See
+ * lf_set_action_bound() for details.
+ * @param action The physical action.
+ * @param max_queued The bound, or 0 for none.
+ * @param policy The overflow policy.
+ * @return 0 on success, or -1 if the action is not physical.
+ */
+int _lf_set_action_bound(lf_action_base_t* action, size_t max_queued, lf_overflow_policy_t policy);
+
+/**
+ * Store how often schedules of a physical action have hit its bound.
+ * @param action The physical action.
+ * @param stats The place to store the statistics.
+ */
+void _lf_get_overflow_stats(lf_action_base_t* action, lf_overflow_stats_t* stats);
+
+/**
+ * Execute the iterations 0 to count - 1 of a loop in chunks of 'grain'
+ * iterations, which idle workers of the environment may help execute if the
+ * scheduler lends them. See lf_parallel_for() for details.
+ * @param env The environment of the calling reaction.
+ * @param count The number of iterations.
+ * @param grain The number of iterations per chunk, or 0 for a default.
+ * @param body The function that executes a range of iterations.
+ * @param arg The argument to pass to the body.
+ */
+void _lf_parallel_for(environment_t* env, size_t count, size_t grain, lf_parallel_body_t body, void* arg);
+
+/**
+ * Allocate memory that remains valid until the end of the current tag of the
+ * given environment from the scratch arena of the calling thread. See
+ * lf_scratch_alloc() for details.
+ * @param env The environment of the calling reaction.
+ * @param size The number of bytes to allocate.
+ */
+void* _lf_scratch_alloc(environment_t* env, size_t size);
+
 // See reactor.h for doc.
 int _lf_fd_send_stop_request_to_rti(tag_t stop_tag);
 
@@ -10,9 +10,38 @@
 #include "modes.h"
 #include "port.h"
 
+/** Values of _lf_deadline_admission. */
+#define LF_DEADLINE_ADMISSION_OFF 0   // Deadlines are checked when reactions start.
+#define LF_DEADLINE_ADMISSION_EARLY 1 // Also, reactions must be able to complete by their deadline.
+#define LF_DEADLINE_ADMISSION_PRUNE 2 // Also, reactions feeding a doomed deadline are not triggered.
+
+/** Values of _lf_criticality_policy. */
+#define LF_CRITICALITY_DEFER 0 // Less critical reactions run after the others of their level.
+#define LF_CRITICALITY_SHED 1  // Less critical reactions do not run.
 
 //  ******** Global Variables :( ********  //
 extern unsigned int _lf_number_of_workers;
+extern unsigned int _lf_spin_budget;
+extern size_t _lf_event_pool_size;
+extern interval_t _lf_busy_wait_guard;
+extern bool _lf_pin_workers;
+extern unsigned int _lf_numa_nodes;
+extern const char* _lf_sched_state_file;
+extern const char* _lf_scheduler_name;
+extern const char* _lf_memory_profile_file;
+extern const char* _lf_resume_file;
+extern const char* _lf_record_file;
+extern const char* _lf_replay_file;
+extern double _lf_replay_speed;
+extern const char* _lf_trace_destination;
+extern const char* _lf_trace_events;
+extern const char* _lf_trace_reactors;
+extern bool _lf_realtime_workers;
+extern int _lf_deadline_admission;
+extern int _lf_criticality_policy;
+extern unsigned int _lf_critical_workers;
+extern unsigned int _lf_urgent_workers;
+extern int _lf_network_thread_priority;
 extern bool fast;
 extern instant_t duration;
 extern bool _lf_execution_started;
@@ -46,14 +75,32 @@ void _lf_set_stop_tag(environment_t* env, tag_t tag);
 extern interval_t lf_get_stp_offset();
 void lf_set_stp_offset(interval_t offset);
 void _lf_trigger_reaction(environment_t* env, reaction_t* reaction, int worker_number);
+void _lf_trigger_reactions(environment_t* env, reaction_t** reactions, size_t count, int worker_number);
 void _lf_start_time_step(environment_t *env);
+void _lf_scratch_reset(environment_t* env);
+void _lf_scratch_free(environment_t* env);
 bool _lf_is_tag_after_stop_tag(environment_t* env, tag_t tag);
 void _lf_pop_events(environment_t *env);
 void _lf_initialize_timer(environment_t* env, trigger_t* timer);
 void _lf_initialize_timers(environment_t* env);
+void _lf_print_startup_times(interval_t environments, interval_t trigger_objects, interval_t start_tags);
 void _lf_trigger_startup_reactions(environment_t* env);
 void _lf_trigger_shutdown_reactions(environment_t *env);
+void _lf_insert_event(environment_t* env, event_t* e);
+void _lf_remove_event(environment_t* env, event_t* e);
+event_t* _lf_peek_event(environment_t* env);
+size_t _lf_event_count(environment_t* env);
+event_t* _lf_find_pending_event(trigger_t* trigger, instant_t time);
 void _lf_recycle_event(environment_t* env, event_t* e);
+
+/**
+ * Preallocate the events of the given environment from the memory profile, if
+ * one was loaded with --memory-profile, after which needing more events is a
+ * fatal error. The first call also reserves the tokens of the profile.
+ * @param env The environment, whose event fields must be initialized.
+ * @return The number of preallocated events or 0 if there is no profile.
+ */
+size_t _lf_apply_memory_profile(environment_t* env);
 event_t* _lf_create_dummy_events(
     environment_t* env,
     trigger_t* trigger,
@@ -62,6 +109,13 @@ event_t* _lf_create_dummy_events(
     microstep_t offset
 );
 int _lf_schedule_at_tag(environment_t* env, trigger_t* trigger, tag_t tag, lf_token_t* token);
+trigger_handle_t _lf_schedule_at_physical_time(
+    environment_t* env,
+    trigger_t* trigger,
+    interval_t extra_delay,
+    lf_token_t* token,
+    instant_t physical_time
+);
 trigger_handle_t _lf_schedule(environment_t* env, trigger_t* trigger, interval_t extra_delay, lf_token_t* token);
 trigger_handle_t _lf_insert_reactions_for_trigger(environment_t* env, trigger_t* trigger, lf_token_t* token);
 
@@ -74,7 +128,12 @@ trigger_handle_t _lf_insert_reactions_for_trigger(environment_t* env, trigger_t*
  */
 void _lf_advance_logical_time(environment_t *env, instant_t next_time);
 trigger_handle_t _lf_schedule_int(lf_action_base_t* action, interval_t extra_delay, int value);
+void _lf_reaction_begins(environment_t* env, reaction_t* reaction, int worker);
+void _lf_reaction_ends(environment_t* env, reaction_t* reaction, int worker);
 void _lf_invoke_reaction(environment_t* env, reaction_t* reaction, int worker);
+interval_t _lf_reaction_exec_time_estimate(reaction_t* reaction);
+bool _lf_is_deadline_violated(environment_t* env, reaction_t* reaction, instant_t physical_time);
+bool _lf_is_pruned_for_deadline(environment_t* env, reaction_t* reaction);
 void schedule_output_reactions(environment_t *env, reaction_t* reaction, int worker);
 int process_args(int argc, const char* argv[]);
 void initialize_global();
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Recording and replay of the external inputs of a program.
+ *
+ * Given the --record option, every schedule of a physical action is written to
+ * a binary log with the physical time at which it was made, relative to the
+ * start time, its extra delay, and the payload of its token. So is every tagged
+ * message that a federate receives, with its time of arrival and its tag.
+ * Triggers are identified by the names with which they are registered for
+ * checkpoints (see checkpoint.h), which are written once per log, so physical
+ * actions that are not registered are not recorded.
+ *
+ * Given the --replay option, a thread of each environment feeds the schedules
+ * of physical actions in the log back into the program at their recorded times
+ * divided by the --replay-speed factor, which defaults to 1. At that speed, the
+ * replayed events get the tags that they had when recorded. Schedules of the
+ * physical actions that the log holds which are not made by the replay, such as
+ * those of the threads that listen to sensors, are discarded, so that the log
+ * is the only source of their inputs. The tagged messages of a federate are not
+ * replayed, as the other federates and the RTI still provide them.
+ *
+ * As with checkpoints, the log is written in the byte order and layout of the
+ * machine, and environments other than the first one get their id appended to
+ * the file name. Replay requires the threaded runtime.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include "lf_types.h"
+
+/**
+ * @brief Start recording or replaying the inputs of the specified environment,
+ * as requested with the --record and --replay options. This is to be called
+ * when the start tag of the environment is initialized, with its mutex held.
+ * @param env The environment.
+ */
+void _lf_replay_start(environment_t* env);
+
+/**
+ * @brief Record a schedule of the physical action 'trigger' and return whether
+ * it is to be carried out. A schedule made other than by the replay of a
+ * trigger whose inputs are replayed is not. This assumes that the caller holds
+ * the mutex of the environment and that recording or replay has started.
+ * @param env The environment.
+ * @param trigger The physical action.
+ * @param physical_time The physical time at which the schedule was made.
+ * @param extra_delay The extra delay given to schedule.
+ * @param token The token to carry, or NULL.
+ */
+bool _lf_replay_schedule(environment_t* env, trigger_t* trigger, instant_t physical_time,
+        interval_t extra_delay, lf_token_t* token);
+
+/**
+ * @brief Record the arrival of a tagged message from the network at 'trigger'.
+ * This assumes that the caller holds the mutex of the environment.
+ * @param env The environment.
+ * @param trigger The network input action.
+ * @param tag The tag of the message.
+ * @param token The token carrying the message, or NULL.
+ */
+void _lf_replay_record_message(environment_t* env, trigger_t* trigger, tag_t tag, lf_token_t* token);
+
+/**
+ * @brief Stop the replay of the specified environment, if any, and complete its
+ * recording, if any.
+ * @param env The environment.
+ */
+void _lf_replay_free(environment_t* env);
+
+#endif // REPLAY_H
@@ -92,6 +92,86 @@ tag_t lf_tag(void* env);
  */
 int lf_tag_compare(tag_t tag1, tag_t tag2);
 
+/**
+ * A tag packed into an integer key whose unsigned order is the order of tags,
+ * so that tags can be compared and their minimum taken without branches. The
+ * key has 96 significant bits: the time with its sign bit flipped, followed by
+ * the microstep. It is a single 128-bit integer where the compiler provides
+ * one and a pair of integers otherwise.
+ */
+#if defined(__SIZEOF_INT128__)
+typedef unsigned __int128 lf_packed_tag_t;
+#else
+typedef struct {
+    uint64_t time;
+    uint32_t microstep;
+} lf_packed_tag_t;
+#endif
+
+/**
+ * Return the packed key of a tag.
+ * @param tag The tag.
+ */
+static inline lf_packed_tag_t lf_tag_pack(tag_t tag) {
+    uint64_t time = (uint64_t)tag.time ^ ((uint64_t)1 << 63);
+#if defined(__SIZEOF_INT128__)
+    return ((lf_packed_tag_t)time << 32) | tag.microstep;
+#else
+    lf_packed_tag_t result = { time, tag.microstep };
+    return result;
+#endif
+}
+
+/**
+ * Return the tag of a packed key.
+ * @param key The key returned by lf_tag_pack.
+ */
+static inline tag_t lf_tag_unpack(lf_packed_tag_t key) {
+    tag_t result;
+#if defined(__SIZEOF_INT128__)
+    result.time = (instant_t)((uint64_t)(key >> 32) ^ ((uint64_t)1 << 63));
+    result.microstep = (microstep_t)key;
+#else
+    result.time = (instant_t)(key.time ^ ((uint64_t)1 << 63));
+    result.microstep = key.microstep;
+#endif
+    return result;
+}
+
+/**
+ * Compare two packed tags like lf_tag_compare compares tags.
+ * @return -1, 0, or 1 depending on the relation.
+ */
+static inline int lf_packed_tag_compare(lf_packed_tag_t key1, lf_packed_tag_t key2) {
+#if defined(__SIZEOF_INT128__)
+    return (key1 > key2) - (key1 < key2);
+#else
+    int time_order = (key1.time > key2.time) - (key1.time < key2.time);
+    int microstep_order = (key1.microstep > key2.microstep) - (key1.microstep < key2.microstep);
+    return time_order + (time_order == 0) * microstep_order;
+#endif
+}
+
+/**
+ * Return the smaller of two packed tags.
+ */
+static inline lf_packed_tag_t lf_packed_tag_min(lf_packed_tag_t key1, lf_packed_tag_t key2) {
+#if defined(__SIZEOF_INT128__)
+    return (key2 < key1) ? key2 : key1;
+#else
+    return (lf_packed_tag_compare(key2, key1) < 0) ? key2 : key1;
+#endif
+}
+
+/**
+ * Return the smallest of the given tags, or FOREVER_TAG if there are none.
+ * The tags are packed and reduced in independent streams, which avoids the
+ * branches of lf_tag_compare and lets their comparisons overlap.
+ * @param tags The tags.
+ * @param count The number of tags.
+ */
+tag_t lf_tag_min(const tag_t* tags, size_t count);
+
 /**
  * Delay a tag by the specified time interval to realize the "after" keyword.
  * Any interval less than 0 (including NEVER) is interpreted as "no delay",
@@ -129,6 +209,47 @@ tag_t lf_delay_tag(tag_t tag, interval_t interval);
  */
 tag_t lf_delay_strict(tag_t tag, interval_t interval);
 
+/**
+ * Return the sum of a time and a nonnegative interval, saturated at FOREVER.
+ * @param time The time.
+ * @param interval The interval, which must not be negative.
+ */
+static inline instant_t lf_time_add(instant_t time, interval_t interval) {
+#if defined(__GNUC__) || defined(__clang__)
+    instant_t sum;
+    return __builtin_add_overflow(time, interval, &sum) ? FOREVER : sum;
+#else
+    return (time > FOREVER - interval) ? FOREVER : time + interval;
+#endif
+}
+
+/**
+ * Inlineable lf_delay_tag for hot paths such as those of the RTI and of
+ * federates, which computes the result without a branch for the interval.
+ */
+static inline tag_t _lf_delay_tag(tag_t tag, interval_t interval) {
+    if (tag.time == NEVER || interval < 0LL) return tag;
+    tag_t result;
+    result.time = lf_time_add(tag.time, interval);
+    // A zero interval is one microstep, whose overflow wraps around.
+    result.microstep = (interval == 0LL) ? tag.microstep + 1u : 0u;
+    return result;
+}
+
+/**
+ * Inlineable lf_delay_strict for hot paths such as those of the RTI and of
+ * federates.
+ */
+static inline tag_t _lf_delay_strict(tag_t tag, interval_t interval) {
+    tag_t result = _lf_delay_tag(tag, interval);
+    if (interval != 0LL && interval != NEVER && interval != FOREVER
+            && result.time != NEVER && result.time != FOREVER) {
+        result.time -= 1;
+        result.microstep = UINT_MAX;
+    }
+    return result;
+}
+
 /**
  * Return the current logical time in nanoseconds.
  * On many platforms, this is the number of nanoseconds
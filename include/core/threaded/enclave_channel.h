@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Declarations for channels that carry tagged tokens between enclaves.
+ *
+ * A channel connects a sender in one environment to a trigger, such as an action,
+ * in another environment. Sending is lock free: the message is written to a
+ * bounded single-producer single-consumer ring, and the mutex of the destination
+ * is only acquired to wake it up when the ring was empty, or to make room when
+ * the ring is full. The thread that advances the time of the destination drains
+ * its channels when it looks for the next tag, as it does for the inbox of
+ * physical actions, and schedules each message at its tag.
+ *
+ * The sender is the only producer of a channel. Hence, a channel must be used by
+ * the reactions of a single reactor, which never execute at the same time, such
+ * as those writing to the port of one connection.
+ */
+
+#ifndef ENCLAVE_CHANNEL_H
+#define ENCLAVE_CHANNEL_H 1
+
+#include "lf_types.h"
+#include "environment.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A message on its way to another enclave. */
+typedef struct lf_enclave_message_t {
+    tag_t tag;
+    lf_token_t* token;
+} lf_enclave_message_t;
+
+/**
+ * A channel from one enclave to another.
+ * source: The environment of the sender.
+ * destination: The environment of the receiver.
+ * trigger: The trigger in the destination that the messages trigger.
+ * delay: The delay added to the tag of the sender, as for a connection with an after delay.
+ * messages: The ring of messages, whose capacity is a power of two.
+ * capacity: The number of messages that the ring holds.
+ * head: The number of messages taken out of the ring, written by the destination.
+ * tail: The number of messages put into the ring, written by the sender.
+ * next: The next channel into the same destination.
+ */
+typedef struct lf_enclave_channel_t {
+    environment_t* source;
+    environment_t* destination;
+    trigger_t* trigger;
+    interval_t delay;
+    lf_enclave_message_t* messages;
+    size_t capacity;
+    volatile size_t head;
+    volatile size_t tail;
+    struct lf_enclave_channel_t* next;
+} lf_enclave_channel_t;
+
+/**
+ * @brief Create a channel from one environment to a trigger in another and
+ * register it with the destination, which frees it when it is freed.
+ * This is meant to be called before execution starts.
+ * @param source The environment of the sender.
+ * @param destination The environment of the trigger.
+ * @param trigger The trigger that messages trigger in the destination.
+ * @param delay The delay added to the current tag of the sender to obtain the tag
+ *  of a message. A delay of 0 yields the next microstep.
+ * @param capacity The number of messages that may be in flight before the sender
+ *  has to make room, which is rounded up to a power of two.
+ * @return The channel.
+ */
+lf_enclave_channel_t* lf_enclave_channel_create(
+    environment_t* source,
+    environment_t* destination,
+    trigger_t* trigger,
+    interval_t delay,
+    size_t capacity
+);
+
+/**
+ * @brief Send a message with the specified token on the channel, tagged with the
+ * current tag of the source plus the delay of the channel.
+ * A token with a reference count of 0, such as one just created with lf_new_token(),
+ * is handed over to the destination. A token that is referenced, such as that of an
+ * output port, is copied, because reference counts are not shared across enclaves.
+ * If the destination has already advanced past the tag of the message when it
+ * receives it, the message is scheduled at the next microstep of the destination.
+ * @param channel The channel.
+ * @param token The token or NULL for a message without payload.
+ */
+void lf_enclave_channel_send(lf_enclave_channel_t* channel, lf_token_t* token);
+
+/**
+ * @brief Schedule the messages waiting in the channels into the specified
+ * environment. This assumes that the caller holds the mutex of the environment.
+ * @param env The environment.
+ */
+void _lf_enclave_channels_drain(environment_t* env);
+
+/**
+ * @brief Free the channels into the specified environment and the messages
+ * left in them.
+ * @param env The environment.
+ */
+void _lf_enclave_channels_free(environment_t* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
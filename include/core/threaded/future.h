@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Futures and the reactions that await them without holding a worker.
+ *
+ * A future is a value that becomes available later, typically once some I/O
+ * or a call to a slow service that another thread carries out completes. A
+ * reaction obtains the value with lf_await(), which blocks the calling thread
+ * until the future is completed with lf_future_complete().
+ *
+ * With LF_SUSPENDABLE_REACTIONS, on Linux and macOS, a reaction whose
+ * `suspendable` field is set executes on a coroutine with a stack of its own,
+ * of LF_SUSPENDABLE_STACK_SIZE bytes. If it awaits a future that is not yet
+ * complete, it is suspended and its worker moves on to the other reactions of
+ * the level. Once the future is completed, an available worker resumes the
+ * reaction where it left off. The level is not considered done before all of
+ * its suspended reactions have completed, so the reactions that depend on
+ * them still execute after them.
+ *
+ * Since a reaction may be resumed by a worker other than the one that started
+ * it, it must not keep thread-local state, such as the address of errno, or
+ * a locked mutex across a call to lf_await(). Reactions are only suspended
+ * with the NP and GEDF_NP schedulers and if their reactor has no mutex, as
+ * reactors with watchdogs have. Otherwise, lf_await() blocks the worker.
+ */
+
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include <stdbool.h>
+#include "lf_types.h"
+#include "environment.h"
+#include "platform.h"
+#include "scheduler_instance.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A value that is produced once by one thread and awaited by reactions. The
+ * members are private to future.c.
+ */
+typedef struct lf_future_t {
+    lf_mutex_t mutex;                 // Protects the other members.
+    lf_cond_t completed_cond;         // Signaled when the future completes, for blocked threads.
+    bool completed;                   // Whether lf_future_complete() has been called.
+    void* value;                      // The value given to lf_future_complete().
+    struct lf_coroutine_t* waiters;   // The reactions suspended on the future.
+} lf_future_t;
+
+/**
+ * @brief Initialize a future that is not complete. A future that has been
+ * completed and that no reaction awaits any longer may be initialized again.
+ * @param future The future.
+ * @return 0 on success, or the error code of the platform.
+ */
+int lf_future_init(lf_future_t* future);
+
+/**
+ * @brief Complete a future with the specified value, which releases the
+ * threads blocked on it and makes the reactions suspended on it resumable.
+ * This may be called by any thread, once per initialization of the future.
+ * @param future The future.
+ * @param value The value that lf_await() returns.
+ */
+void lf_future_complete(lf_future_t* future, void* value);
+
+/**
+ * @brief Return whether the specified future has been completed.
+ * @param future The future.
+ */
+bool lf_future_is_complete(lf_future_t* future);
+
+/**
+ * @brief Return the value of the specified future once it is completed. Called
+ * by a suspendable reaction, this suspends the reaction until then rather than
+ * blocking its worker, if possible.
+ * @param future The future.
+ * @return The value given to lf_future_complete().
+ */
+void* lf_await(lf_future_t* future);
+
+#ifdef LF_SUSPENDABLE_REACTIONS
+
+#ifndef LF_SUSPENDABLE_STACK_SIZE
+#define LF_SUSPENDABLE_STACK_SIZE (256 * 1024)
+#endif
+
+/**
+ * @brief Return whether 'reaction' is to be executed on a coroutine, which the
+ * scheduler of 'env' resumes if the reaction suspends itself.
+ * @param env The environment.
+ * @param reaction The reaction.
+ */
+static inline bool _lf_is_suspendable(environment_t* env, reaction_t* reaction) {
+    return reaction->suspendable && env->scheduler->supports_suspension
+        && ((self_base_t*)reaction->self)->reactor_mutex == NULL;
+}
+
+/**
+ * @brief Execute the function of 'reaction' on a coroutine, starting it if the
+ * reaction is not suspended and resuming it otherwise, until the function
+ * returns or the reaction suspends itself on a future that is not complete.
+ * The reaction is then resumable once the future completes.
+ * @param env The environment.
+ * @param reaction The reaction.
+ * @return true if the function has returned, false if the reaction is suspended.
+ */
+bool _lf_run_suspendable_reaction(environment_t* env, reaction_t* reaction);
+
+/**
+ * @brief Return a reaction of the current level whose future has completed,
+ * which the caller is to resume, or NULL if there is none.
+ * @param scheduler The scheduler.
+ */
+reaction_t* lf_sched_pop_resumable_reaction(lf_scheduler_t* scheduler);
+
+/**
+ * @brief Called by the last worker to become idle, wait until a reaction of the
+ * current level can be resumed and return true, or return false immediately if
+ * no reaction is suspended, in which case the level is done.
+ * @param scheduler The scheduler.
+ */
+bool lf_sched_wait_for_resumable_reaction(lf_scheduler_t* scheduler);
+
+/**
+ * @brief Free the coroutines of reactions that have been suspendable.
+ * @param scheduler The scheduler.
+ */
+void lf_sched_free_coroutines(lf_scheduler_t* scheduler);
+
+#endif // LF_SUSPENDABLE_REACTIONS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUTURE_H
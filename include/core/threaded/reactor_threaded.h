@@ -30,13 +30,14 @@ void enqueue_port_absent_reactions(environment_t* env);
  * to release the barrier.
  *
  * If there is already a barrier raised at a tag later than future_tag, this
- * function will change the barrier to future_tag or the current tag, whichever
- * is larger. If the existing barrier is earlier
- * than future_tag, this function will not change the barrier. If there are
- * no existing barriers and future_tag is in the past relative to the
- * current tag, this function will raise a barrier to the current tag plus one microstep.
+ * function will change the barrier to future_tag. If the existing barrier is earlier
+ * than future_tag, this function will not change the barrier. If future_tag is
+ * in the past relative to the current tag, the barrier at future_tag prevents
+ * any further advance of the current tag.
  *
- * This function acquires the mutex on the specified environment.
+ * This function does not acquire the mutex on the specified environment, so
+ * that threads receiving messages do not contend with the workers for it.
+ * The barrier is updated atomically with respect to the thread advancing time.
  *
  * @note This function is only useful in threaded applications to facilitate
  *  certain non-blocking functionalities such as receiving timed messages
@@ -52,7 +53,7 @@ void _lf_increment_tag_barrier(environment_t *env, tag_t future_tag);
 
 /**
  * @brief Version of _lf_increment_tag_barrier to call when the caller holds the mutex.
- * This version does not acquire the mutex belonging to env.
+ * Since neither version acquires the mutex belonging to env, the two are the same.
  *
  * @param env Environment within which we are executing.
  * @param future_tag A desired tag for the barrier. This function will guarantee
@@ -68,7 +69,8 @@ void _lf_increment_tag_barrier_locked(environment_t *env, tag_t future_tag);
  * tag barrier to FOREVER_TAG and notifies all threads that are waiting
  * on the barrier that the number of requests has reached zero.
  *
- * This function assumes that the caller already holds the mutex lock on env.
+ * This function assumes that the caller already holds the mutex lock on env,
+ * which is only needed to notify the threads that are waiting, if any.
  *
  * @note This function is only useful in threaded applications to facilitate
  *  certain non-blocking functionalities such as receiving timed messages
@@ -78,6 +80,62 @@ void _lf_increment_tag_barrier_locked(environment_t *env, tag_t future_tag);
  */
 void _lf_decrement_tag_barrier_locked(environment_t* env);
 
+/**
+ * @brief Record a request to schedule a physical action without acquiring
+ * the mutex of the environment.
+ *
+ * The request is pushed onto a lock-free inbox that may have many producers
+ * and is drained by the thread that advances logical time, which schedules
+ * the action with the physical time of the request. Unless the inbox was
+ * empty, no lock is acquired, not even to notify the thread that advances
+ * time, which a previous request will have notified already.
+ * The inbox is used by _lf_schedule_token() for physical actions if
+ * LF_PHYSICAL_ACTION_INBOX is defined.
+ *
+ * @param env The environment of the action.
+ * @param trigger The trigger of the physical action.
+ * @param extra_delay The extra delay, as for _lf_schedule().
+ * @param token The token wrapping the payload or NULL for no payload.
+ * @return 1, which stands for an event that will be scheduled, because the
+ *  actual handle is not known yet.
+ */
+trigger_handle_t _lf_inbox_push(environment_t* env, trigger_t* trigger, interval_t extra_delay, lf_token_t* token);
+
+/**
+ * @brief Schedule the requests recorded in the inbox of the environment.
+ * This assumes that the caller holds the mutex of the environment.
+ * @param env The environment.
+ */
+void _lf_inbox_drain(environment_t* env);
+
+/**
+ * @brief Free any requests left in the inbox of the environment, together with
+ * the tokens that they carry unless something else references them.
+ * @param env The environment.
+ */
+void _lf_inbox_free(environment_t* env);
+
+/**
+ * @brief Return the slot of the calling thread among the workers of the given
+ * environment, which indexes the per-worker lists of the environment, or -1
+ * if the calling thread is not one of its workers.
+ * @param env The environment.
+ */
+int _lf_worker_slot(environment_t* env);
+
+/**
+ * @brief Return true if the calling thread is a worker of some environment,
+ * as opposed to the main thread or a thread that the runtime or the program
+ * created for another purpose.
+ */
+bool lf_is_worker_thread(void);
+
+/**
+ * @brief Return the number of the calling worker thread, which is the number that
+ * it gives to tracepoints, or -1 if the calling thread is not a worker thread.
+ */
+int lf_worker_number(void);
+
 int _lf_wait_on_tag_barrier(environment_t* env, tag_t proposed_tag);
 void synchronize_with_other_federates(void);
 bool wait_until(environment_t* env, instant_t logical_time_ns, lf_cond_t* condition);
@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief In-process federation, in which the enclaves of a program are
+ * coordinated like the federates of a federation with centralized coordination.
+ *
+ * With LF_IN_PROCESS_FEDERATION, the grant logic of the RTI (see enclave.h)
+ * runs within the program, with one enclave_t per environment. The connections
+ * between enclaves are the channels into each environment (see
+ * enclave_channel.h), whose delays play the role of the after delays of the
+ * connections between federates. Messages are still handed over by pointer
+ * through the channels, but an environment only advances to a tag once the
+ * environments upstream of it have completed the tags from which a message
+ * could still arrive at that tag or earlier, as it would if the enclaves were
+ * federates talking to an RTI. Messages therefore never arrive late, and the
+ * execution is the same as that of the distributed deployment.
+ *
+ * Instead of sending NET and LTC messages over sockets, the thread that
+ * advances the time of an environment updates the state of its enclave
+ * directly, under the mutex of the RTI logic, and waits for a grant on the
+ * condition variable of the enclave. Events scheduled into the environment
+ * while it waits, such as physical actions, interrupt the wait, as a message
+ * from the RTI would.
+ *
+ * All channels must be created before execution starts. Since a channel adds
+ * at least one microstep of delay, no provisional grants are needed.
+ */
+
+#ifndef RTI_LOCAL_H
+#define RTI_LOCAL_H
+
+#include "lf_types.h"
+#include "environment.h"
+#include "tag.h"
+
+#ifdef LF_IN_PROCESS_FEDERATION
+
+/**
+ * @brief Create an enclave for each of the specified environments and connect
+ * the enclaves as the channels between the environments are. This is to be
+ * called once the trigger objects are initialized, before any worker starts.
+ * @param envs The environments.
+ * @param num_envs The number of environments.
+ */
+void _lf_rti_local_init(environment_t* envs, int num_envs);
+
+/**
+ * @brief Inform the RTI logic of the next event tag of the specified
+ * environment and wait until the environment may advance to it, or until an
+ * event is scheduled into the environment. This assumes that the caller holds
+ * the mutex of the environment, which is released during the wait.
+ * @param env The environment.
+ * @param next_event_tag The tag of the earliest event of the environment.
+ * @return The latest tag to which the environment may advance, which is less
+ *  than next_event_tag if the wait was interrupted.
+ */
+tag_t _lf_rti_local_next_event_tag_locked(environment_t* env, tag_t next_event_tag);
+
+/**
+ * @brief Inform the RTI logic that the specified environment has completed a
+ * tag, which may let the environments downstream of it advance. This assumes
+ * that the caller holds the mutex of the environment.
+ * @param env The environment.
+ * @param completed The tag.
+ */
+void _lf_rti_local_logical_tag_complete_locked(environment_t* env, tag_t completed);
+
+/**
+ * @brief Interrupt the wait of the specified environment for a grant, if any,
+ * because an event has been scheduled into it. This assumes that the caller
+ * holds the mutex of the environment.
+ * @param env The environment.
+ */
+void _lf_rti_local_notify_of_event_locked(environment_t* env);
+
+/**
+ * @brief Withdraw the specified environment, which has stopped executing,
+ * from the coordination, so that it holds back none of the environments
+ * downstream of it. This assumes that the caller holds the mutex of the
+ * environment.
+ * @param env The environment.
+ */
+void _lf_rti_local_resign_locked(environment_t* env);
+
+/**
+ * @brief Free the enclaves created by _lf_rti_local_init().
+ */
+void _lf_rti_local_free(void);
+
+#endif // LF_IN_PROCESS_FEDERATION
+
+#endif // RTI_LOCAL_H
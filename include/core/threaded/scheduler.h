@@ -40,6 +40,23 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "lf_types.h"
 #include "scheduler_instance.h"
+
+#define _LF_SCHED_CONCAT(a, b) a##b
+#define _LF_SCHED_VARIANT_NAME(name, variant) _LF_SCHED_CONCAT(name, variant)
+#define _LF_SCHED_STRING(x) #x
+#define _LF_SCHED_VARIANT_STRING(variant) _LF_SCHED_STRING(variant)
+
+#if defined(LF_SCHED_DYNAMIC) && defined(LF_SCHED_VARIANT)
+// Within the scheduler LF_SCHED_VARIANT of a runtime that links all schedulers,
+// the functions below are named after the variant, e.g., lf_sched_init_NP.
+#define lf_sched_init _LF_SCHED_VARIANT_NAME(lf_sched_init_, LF_SCHED_VARIANT)
+#define lf_sched_free _LF_SCHED_VARIANT_NAME(lf_sched_free_, LF_SCHED_VARIANT)
+#define lf_sched_get_ready_reaction _LF_SCHED_VARIANT_NAME(lf_sched_get_ready_reaction_, LF_SCHED_VARIANT)
+#define lf_sched_done_with_reaction _LF_SCHED_VARIANT_NAME(lf_sched_done_with_reaction_, LF_SCHED_VARIANT)
+#define lf_scheduler_trigger_reaction _LF_SCHED_VARIANT_NAME(lf_scheduler_trigger_reaction_, LF_SCHED_VARIANT)
+#define lf_scheduler_trigger_reactions _LF_SCHED_VARIANT_NAME(lf_scheduler_trigger_reactions_, LF_SCHED_VARIANT)
+#define lf_sched_may_execute_now _LF_SCHED_VARIANT_NAME(lf_sched_may_execute_now_, LF_SCHED_VARIANT)
+#endif
 /**
  * @brief Default value that is assumed to be the maximum reaction level in the
  *  program.
@@ -121,4 +138,90 @@ void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction
  */
 void lf_scheduler_trigger_reaction(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number);
 
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reactions' at the current tag, as lf_scheduler_trigger_reaction()
+ * does for each of them.
+ *
+ * The reactions must be sorted by level, which lets a scheduler reserve space for
+ * all the reactions of a level at once.
+ *
+ * @param scheduler The scheduler
+ * @param reactions The reactions to trigger at the current tag, sorted by level.
+ * @param count The number of reactions.
+ * @param worker_number The ID of the worker that is making this call, or -1
+ *  (@see lf_scheduler_trigger_reaction).
+ */
+void lf_scheduler_trigger_reactions(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number);
+
+/**
+ * @brief Return whether the worker that has just enabled 'reaction' may execute
+ * it immediately, bypassing the scheduler.
+ *
+ * This is used by the execute-now optimization in `schedule_output_reactions`.
+ * A scheduler that orders reactions by deadline should return false if a
+ * reaction with an earlier deadline is ready to execute. A scheduler for which
+ * the optimization is not valid should always return false.
+ *
+ * @param scheduler The scheduler
+ * @param reaction The reaction that would be executed immediately.
+ */
+bool lf_sched_may_execute_now(lf_scheduler_t* scheduler, reaction_t* reaction);
+
+/**
+ * @brief The functions above as implemented by one scheduler.
+ *
+ * Each scheduler defines its table with LF_SCHED_REGISTER(). Normally, only the
+ * scheduler chosen with the SCHEDULER compile definition is linked. With
+ * LF_SCHED_DYNAMIC, all schedulers are linked, and the functions above call
+ * those of the scheduler selected with the --scheduler command-line option,
+ * which applies to all environments.
+ */
+typedef struct lf_sched_vtable_t {
+    /** The SCHED_* number of the scheduler. */
+    int kind;
+    /** The name of the scheduler, which is its SCHED_* number without the prefix. */
+    const char* name;
+    void (*init)(environment_t* env, size_t number_of_workers, sched_params_t* parameters);
+    void (*free)(lf_scheduler_t* scheduler);
+    reaction_t* (*get_ready_reaction)(lf_scheduler_t* scheduler, int worker_number);
+    void (*done_with_reaction)(size_t worker_number, reaction_t* done_reaction);
+    void (*trigger_reaction)(lf_scheduler_t* scheduler, reaction_t* reaction, int worker_number);
+    void (*trigger_reactions)(lf_scheduler_t* scheduler, reaction_t** reactions, size_t count, int worker_number);
+    bool (*may_execute_now)(lf_scheduler_t* scheduler, reaction_t* reaction);
+} lf_sched_vtable_t;
+
+#ifdef LF_SCHED_DYNAMIC
+#define _LF_SCHED_VTABLE _LF_SCHED_VARIANT_NAME(_lf_sched_vtable_, LF_SCHED_VARIANT)
+#else
+#define _LF_SCHED_VTABLE _lf_sched_vtable
+#endif
+
+/**
+ * @brief Define the table of the scheduler LF_SCHED_VARIANT, which the source
+ * file of the scheduler defines to its SCHED_* number without the prefix.
+ */
+#define LF_SCHED_REGISTER() \
+    const lf_sched_vtable_t _LF_SCHED_VTABLE = { \
+        _LF_SCHED_VARIANT_NAME(SCHED_, LF_SCHED_VARIANT), \
+        _LF_SCHED_VARIANT_STRING(LF_SCHED_VARIANT), \
+        lf_sched_init, \
+        lf_sched_free, \
+        lf_sched_get_ready_reaction, \
+        lf_sched_done_with_reaction, \
+        lf_scheduler_trigger_reaction, \
+        lf_scheduler_trigger_reactions, \
+        lf_sched_may_execute_now \
+    }
+
+/**
+ * @brief Return the scheduler that the functions above use.
+ *
+ * The first call selects it: the scheduler named by the --scheduler
+ * command-line option if it is linked, and otherwise the one chosen with the
+ * SCHEDULER compile definition. This must first be called before the worker
+ * threads start, as lf_sched_init() does.
+ */
+const lf_sched_vtable_t* lf_sched_selected(void);
+
 #endif // LF_SCHEDULER_H
@@ -43,12 +43,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif  // NUMBER_OF_WORKERS
 
 #include "semaphore.h"
+#include "tag.h"
+#include "lf_types.h"
 #include <stdbool.h>
 
 #define DEFAULT_MAX_REACTION_LEVEL 100
 
 // Forward declarations
 typedef struct environment_t environment_t;
+typedef struct reaction_t reaction_t;
 typedef struct custom_scheduler_data_t custom_scheduler_data_t;
 
 /**
@@ -131,12 +134,111 @@ typedef struct lf_scheduler_t {
      */
     volatile size_t next_reaction_level;
 
+    /**
+     * @brief The current number of iterations that an idle worker spins on
+     * the semaphore before parking.
+     *
+     * Adapted at run time between 1 and `spin_budget`: it is doubled when
+     * spinning succeeds and halved when a worker has to park. It is 0 if
+     * spinning is disabled. Updates are racy, which is harmless.
+     */
+    volatile unsigned int spin_limit;
+
+    /**
+     * @brief The largest value of `spin_limit`, which is the `spin_budget` of
+     * the `sched_params_t` if it is not 0 and `_lf_spin_budget` otherwise.
+     */
+    unsigned int spin_budget;
+
+    /**
+     * @brief Whether the scheduler lends its idle workers to the loops of
+     * reactions split with lf_parallel_for(). Set by the schedulers that only
+     * release `semaphore` once all workers are idle, so that the workers that
+     * acquire it beyond those that it releases are the lent ones.
+     */
+    bool lends_idle_workers;
+
+    /**
+     * @brief The number of times that `semaphore` has been released to wake
+     * up idle workers to help with parallel jobs and that no worker has
+     * taken yet. Adding to/subtracting from this variable must be done atomically.
+     */
+    volatile int helper_wakeups;
+
+    /**
+     * @brief The parallel jobs in progress, most recent first, which
+     * `parallel_jobs_mutex` protects.
+     */
+    struct lf_parallel_job_t* parallel_jobs;
+
+    /**
+     * @brief Protect `parallel_jobs` and the number of helpers of each job. It
+     * is also the mutex of `parallel_job_helped`.
+     */
+    lf_mutex_t parallel_jobs_mutex;
+
+    /**
+     * @brief Signaled when the last helper of a parallel job leaves it.
+     */
+    lf_cond_t parallel_job_helped;
+
+#ifdef LF_SUSPENDABLE_REACTIONS
+    /**
+     * @brief Whether the scheduler resumes suspended reactions (see future.h).
+     * Set by the schedulers that do.
+     */
+    bool supports_suspension;
+
+    /**
+     * @brief Protect the members below. It is also the mutex of
+     * `reaction_resumable`.
+     */
+    lf_mutex_t suspension_mutex;
+
+    /**
+     * @brief Signaled when a suspended reaction becomes resumable.
+     */
+    lf_cond_t reaction_resumable;
+
+    /**
+     * @brief The number of reactions of the current level that are suspended,
+     * including those that are resumable but not yet resumed.
+     */
+    size_t number_of_suspended_reactions;
+
+    /**
+     * @brief The coroutines of the resumable reactions, in the order in which
+     * they became resumable, and the last of them.
+     */
+    struct lf_coroutine_t* resumable_coroutines;
+    struct lf_coroutine_t* last_resumable_coroutine;
+
+    /**
+     * @brief The coroutines not executing a reaction, which are reused.
+     */
+    struct lf_coroutine_t* free_coroutines;
+#endif
+
     // Pointer to an optional custom data structure that each scheduler can define.
     // The type is forward declared here and must be declared again in the scheduler source file
     // Is not touched by `init_sched_instance` and must be initialized by each scheduler that needs it
     custom_scheduler_data_t * custom_data;
 } lf_scheduler_t;
 
+/**
+ * @brief A loop of a reaction, split into chunks with lf_parallel_for(), that
+ * idle workers help execute.
+ */
+typedef struct lf_parallel_job_t {
+    lf_parallel_body_t body;          // The function that executes a range of iterations.
+    void* arg;                        // The argument to pass to the body.
+    size_t count;                     // The number of iterations.
+    size_t grain;                     // The number of iterations per chunk.
+    volatile size_t next_iteration;   // The first iteration of the next chunk to claim.
+    int helpers;                      // The number of idle workers executing chunks.
+    struct lf_parallel_job_t* next;   // The next job in progress.
+} lf_parallel_job_t;
+
 /**
  * @brief Struct representing the most common scheduler parameters.
  *
@@ -151,12 +253,54 @@ typedef struct lf_scheduler_t {
  * `num_reactions_per_level` array if it is not NULL. If set, it should be the
  * maximum level over all reactions in the program plus 1. If not set,
  * `DEFAULT_MAX_REACTION_LEVEL` will be used.
+ * @param static_schedule Optional. Default: NULL. The schedule that the STATIC
+ * scheduler executes. Ignored by the other schedulers.
+ * @param spin_budget Optional. Default: 0. If not 0, the largest number of
+ * iterations that an idle worker spins before it sleeps, which overrides the
+ * --spin command-line option and the LF_SPIN_BUDGET compile definition.
+ *
+ * @note Tuning parameters of the schedulers belong here. Their default must be
+ * 0 or NULL so that code that only sets some of the members keeps working.
  */
 typedef struct {
     size_t* num_reactions_per_level;
     size_t num_reactions_per_level_size;
+    const struct lf_static_schedule_t* static_schedule;
+    unsigned int spin_budget;
 } sched_params_t;
 
+/**
+ * @brief A schedule computed offline for the STATIC scheduler.
+ *
+ * The schedule covers one hyperperiod, which repeats from the start time. It
+ * has one slot per tag in the hyperperiod, at the time offsets in
+ * `slot_offsets`, which increase. For each slot and each of the first
+ * `num_workers` workers, it lists the reactions that the worker executes at the
+ * tags of the slot, in order. A NULL entry is a synchronization point, which
+ * each worker passes only once all workers have reached it, so a reaction can
+ * follow the reactions that it depends on if they are executed by other
+ * workers. The lists of a slot must have the same number of synchronization
+ * points, and the end of a slot is an implicit one.
+ *
+ * Reactions listed in a slot that are not triggered at a tag are skipped.
+ * Triggered reactions that are not listed, as well as those of tags that match
+ * no slot, are executed one at a time in level order after the slot.
+ */
+typedef struct lf_static_schedule_t {
+    /** The length of the hyperperiod. */
+    interval_t hyperperiod;
+    /** The number of slots in the hyperperiod. */
+    size_t num_slots;
+    /** The offset of each slot from the start of its hyperperiod. */
+    const interval_t* slot_offsets;
+    /** The number of workers that the schedule assigns reactions to. */
+    size_t num_workers;
+    /** The list of the worker 'w' in slot 's' is programs[s * num_workers + w]. */
+    reaction_t* const* const* programs;
+    /** The lengths of the lists in `programs`. */
+    const size_t* program_lengths;
+} lf_static_schedule_t;
+
 /**
  * @brief Initialize `instance` using the provided information.
  *
@@ -176,4 +320,58 @@ bool init_sched_instance(
     size_t number_of_workers,
     sched_params_t* params);
 
+/**
+ * @brief Wait for 'scheduler->semaphore' on behalf of worker 'worker_number'.
+ *
+ * The worker first spins for up to `scheduler->spin_limit` iterations and only
+ * parks on the semaphore if it did not get released in the meantime. This
+ * avoids a sleep and a wake-up when the next level becomes ready shortly
+ * after the worker went idle.
+ *
+ * If the scheduler lends its idle workers, a worker that acquires the
+ * semaphore on behalf of a parallel job helps execute the job and then waits
+ * again, so that it only returns once the scheduler releases it.
+ *
+ * @param scheduler The scheduler.
+ * @param worker_number The number of the calling worker.
+ */
+void lf_sched_wait_on_semaphore(lf_scheduler_t* scheduler, size_t worker_number);
+
+/**
+ * @brief Execute 'job' with the help of the idle workers of 'scheduler',
+ * waking up as many of them as could take a chunk, and return once all of its
+ * chunks have been executed. If no worker is idle, the calling thread executes
+ * all chunks itself.
+ *
+ * @param scheduler The scheduler, which lends its idle workers.
+ * @param job The job, which the calling thread owns.
+ */
+void lf_sched_run_parallel_job(lf_scheduler_t* scheduler, lf_parallel_job_t* job);
+
+/**
+ * @brief Count the calling worker as idle and return whether it is the last
+ * worker to become idle, which then advances the tag or distributes reactions.
+ *
+ * If all other workers are already idle, as in a sparse program where a single
+ * worker executes the reactions of each tag, none of them can change the count
+ * until the calling worker releases them. The calling worker then takes the
+ * fast path of storing the count rather than incrementing it atomically, so
+ * that it moves on to the next level or tag without a read-modify-write on the
+ * count that it would otherwise do for every level.
+ *
+ * @param scheduler The scheduler.
+ * @return true if all workers are now idle.
+ */
+static inline bool lf_sched_become_idle(lf_scheduler_t* scheduler) {
+    // The acquire pairs with the increments of the other workers, which release
+    // the reactions that they triggered.
+    if (lf_atomic_load_explicit(&scheduler->number_of_idle_workers, LF_ATOMIC_ACQUIRE)
+            == scheduler->number_of_workers - 1) {
+        scheduler->number_of_idle_workers = scheduler->number_of_workers;
+        return true;
+    }
+    return lf_atomic_add_fetch_explicit(&scheduler->number_of_idle_workers, 1, LF_ATOMIC_ACQ_REL)
+            == scheduler->number_of_workers;
+}
+
 #endif // LF_SCHEDULER_PARAMS_H
@@ -24,25 +24,52 @@ extern "C" {
  */
 typedef void(*watchdog_function_t)(void*);
 
+/**
+ * Number of buckets of the histogram of the lateness of the expirations of a watchdog.
+ * Bucket 0 counts handlers invoked within one microsecond of the expiration time, and
+ * bucket i > 0 counts those invoked less than 2^i microseconds late. The last bucket
+ * counts the rest.
+ */
+#define LF_WATCHDOG_LATENESS_BUCKETS 24
+
+/**
+ * Statistics of the lateness of the expirations of a watchdog, that is, of the
+ * physical time when its handler is invoked minus its expiration time, in nanoseconds.
+ */
+typedef struct lf_watchdog_stats_t {
+    size_t expirations;                                 // The number of invocations of the handler.
+    interval_t lateness_min;                            // The smallest lateness.
+    interval_t lateness_max;                            // The largest lateness.
+    interval_t lateness_total;                          // The sum of the latenesses.
+    size_t lateness_histogram[LF_WATCHDOG_LATENESS_BUCKETS];
+} lf_watchdog_stats_t;
+
 /** Typdef for watchdog_t struct, used to call watchdog handler. */
 typedef struct watchdog_t watchdog_t;
 
+/** The service that runs the expiration handlers of the watchdogs of an environment. */
+typedef struct watchdog_service_t watchdog_service_t;
+
 /** Watchdog struct for handler. */
 struct watchdog_t {
     struct self_base_t* base;               // The reactor that contains the watchdog.
     trigger_t* trigger;                     // The trigger associated with this watchdog.
     instant_t expiration;                   // The expiration instant for the watchdog. (Initialized to NEVER)
     interval_t min_expiration;              // The minimum expiration interval for the watchdog.
-    lf_thread_t thread_id;                  // The thread that the watchdog is meant to run on.
-    bool thread_active;                     // Boolean indicating whether or not thread is active.  
+    lf_thread_t thread_id;                  // Unused: the watchdogs of an environment share the thread of its watchdog service.
+    bool thread_active;                     // Boolean indicating whether or not the watchdog service is waiting for its expiration.
     watchdog_function_t watchdog_function;  // The function/handler for the watchdog.
+    size_t heap_position;                   // The position of the watchdog in the heap of its watchdog service.
+    lf_watchdog_stats_t stats;              // The lateness of its expirations.
 };
 
 /** 
  * @brief Start or restart the watchdog timer.
  * This function sets the expiration time of the watchdog to the current logical time
  * plus the minimum timeout of the watchdog plus the specified `additional_timeout`.
- * If a watchdog timer thread is not already running, then this function will start one.
+ * The watchdog service of the environment then invokes the expiration handler at that
+ * time unless the watchdog is restarted or stopped before. This does not create a thread
+ * and takes time logarithmic in the number of running watchdogs.
  * This function assumes the reactor mutex is held when it is called; this assumption
  * is satisfied whenever this function is called from within a reaction that declares
  * the watchdog as an effect.
@@ -53,14 +80,48 @@ struct watchdog_t {
  */
 void lf_watchdog_start(watchdog_t* watchdog, interval_t additional_timeout);
 
+/**
+ * @brief Start or restart the watchdog timer relative to physical time.
+ * This is like lf_watchdog_start() except that the expiration time is the current
+ * physical time, rather than the current logical time, plus the minimum timeout of the
+ * watchdog plus the specified `additional_timeout`. Logical time may lag physical
+ * time, by as much as the execution times of the reactions at the current tag, in which
+ * case lf_watchdog_start() arms the watchdog to expire earlier than the full timeout
+ * after the call.
+ *
+ * @param watchdog The watchdog to be started
+ * @param additional_timeout Additional timeout to be added to the watchdog's
+ * minimum expiration.
+ */
+void lf_watchdog_start_physical(watchdog_t* watchdog, interval_t additional_timeout);
+
 /**
  * @brief Stop the specified watchdog without invoking the expiration handler.
  * This function sets the expiration time of the watchdog to `NEVER`.
+ * Like lf_watchdog_start(), it assumes that the reactor mutex is held.
  * 
  * @param watchdog The watchdog.
  */
 void lf_watchdog_stop(watchdog_t* watchdog);
 
+/**
+ * @brief Get the statistics of the lateness of the expirations of the specified watchdog.
+ * Like lf_watchdog_start(), this assumes that the reactor mutex is held.
+ *
+ * @param watchdog The watchdog.
+ * @param stats Where to put the statistics.
+ */
+void lf_watchdog_get_stats(watchdog_t* watchdog, lf_watchdog_stats_t* stats);
+
+/**
+ * @brief Stop the watchdog service of the specified environment, if any, and wait
+ * for its thread to exit. This is called when the program terminates, and prints
+ * the lateness statistics of the watchdogs of the environment that have expired.
+ *
+ * @param env The environment.
+ */
+void _lf_terminate_watchdogs(environment_t* env);
+
 #ifdef __cplusplus
 }
 #endif
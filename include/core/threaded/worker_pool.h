@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @copyright (c) 2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Declarations for the pool of workers shared by enclaves.
+ *
+ * By default, each environment executes reactions on as many workers as it was
+ * given by environment_init(). If environment_set_workers() gives an environment
+ * a minimum below its maximum, the environments share a pool of as many workers
+ * as the program has (see --workers). Each environment then spawns its maximum
+ * number of worker threads, but a worker has to take a permit from the pool to
+ * execute a reaction. An environment always obtains permits up to its minimum,
+ * and the remaining permits go to whichever environment has reactions ready,
+ * preferring those with a higher priority. The capacity of an idle enclave thus
+ * serves the busy ones. A worker holds its permit only while it executes a
+ * reaction, so waiting for time to advance does not hold on to the pool.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H 1
+
+#include "lf_types.h"
+#include "environment.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set up the pool shared by the specified environments, if any of them
+ * has a minimum number of workers below its maximum. This is to be called
+ * before the workers start.
+ * @param envs The environments.
+ * @param num_envs The number of environments.
+ * @param size The number of reactions that may execute at the same time across
+ *  all the environments.
+ */
+void _lf_worker_pool_init(environment_t* envs, int num_envs, int size);
+
+/**
+ * @brief Take a permit from the pool to execute a reaction in the specified
+ * environment, waiting until one is available. This does nothing if the
+ * environments do not share a pool.
+ * @param env The environment of the calling worker.
+ */
+void _lf_worker_pool_acquire(environment_t* env);
+
+/**
+ * @brief Return the permit taken by _lf_worker_pool_acquire().
+ * @param env The environment of the calling worker.
+ */
+void _lf_worker_pool_release(environment_t* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
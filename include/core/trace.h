@@ -43,6 +43,28 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Traces:
  * A sequence of traces, each of which begins with an int giving the length of the trace
  * followed by binary representations of the trace_record struct written using fwrite().
+ *
+ * If LF_TRACE_COMPACT is defined, the file begins with TRACE_COMPACT_FORMAT_MARKER
+ * before the header, and each trace begins with an int giving the number of records and
+ * an int giving the number of bytes that follow. Each record is then encoded as:
+ * * A byte giving the event type.
+ * * A byte with a trace_compact_field_t bit for each of the optional fields below that
+ *   is present. Absent fields have their default values, NULL, -1, or 0.
+ * * The logical and physical times as the difference from those of the previous record
+ *   in the same trace, or from the start time for the first record.
+ * * The optional fields in the order of their bits. Pointers and triggers are given by
+ *   one plus their index in the object table, or by zero followed by the raw pointer
+ *   value for objects that are not in the table.
+ * Integers are variable-length, with seven bits per byte and the high bit set on all
+ * bytes but the last. Signed integers are zigzag encoded so that small negative
+ * numbers are short.
+ *
+ * If LF_TRACE_TSC is defined, the physical times of the records are raw counts of the
+ * processor's cycle counter rather than nanoseconds. The header is then preceded by
+ * TRACE_CYCLES_FORMAT_MARKER, after the compact format marker if there is one, and the
+ * last trace is followed by an int -1 and four instant_t values: the cycle count and
+ * physical time sampled when tracing started, and the same when it stopped. Readers
+ * convert the cycle counts to physical times by interpolating between these samples.
  */
 
 #ifdef RTI_TRACE
@@ -53,6 +75,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define TRACE_H
 
 #include "lf_types.h"
+#include "platform.h"
 #include <stdio.h>
 
 #ifdef FEDERATED
@@ -74,8 +97,18 @@ typedef enum
     user_value,
     worker_wait_starts,
     worker_wait_ends,
+    worker_spin_starts,
+    worker_spin_ends,
     scheduler_advancing_time_starts,
     scheduler_advancing_time_ends,
+    scheduler_wakeup,
+    scheduler_criticality_change,
+    watchdog_expires,
+    // Execution of reactions by the interpreter of a target runtime such as that of Python
+    gil_wait_starts,
+    gil_wait_ends,
+    python_call_starts,
+    python_call_ends,
     federated, // Everything above this is tracing federated interactions.
     // Sending messages
     send_ACK,
@@ -120,9 +153,34 @@ typedef enum
     receive_ADR_AD,
     receive_ADR_QR,
     receive_UNIDENTIFIED,
+    // Clock synchronization
+    clock_sync_offset,
+    // Compression of message bodies
+    compression_starts,
+    compression_ends,
+    decompression_starts,
+    decompression_ends,
+    // Serialization of message values by a target runtime
+    serialization_starts,
+    serialization_ends,
+    deserialization_starts,
+    deserialization_ends,
     NUM_EVENT_TYPES
 } trace_event_t;
 
+/**
+ * Categories of trace events that can be recorded or dropped at run time.
+ * See trace_set_categories().
+ */
+typedef enum {
+    trace_category_reactions = 1,   // Reaction starts, ends, and deadline misses, and watchdog expirations.
+    trace_category_workers = 2,     // Worker waits and spins, and their use of an interpreter.
+    trace_category_scheduling = 4,  // Calls to schedule() and the advancement of time.
+    trace_category_user = 8,        // User-defined events and values.
+    trace_category_federated = 16,  // Messages exchanged with the RTI and other federates.
+    trace_category_all = 31
+} trace_category_t;
+
 #ifdef LF_TRACE
 
 /**
@@ -137,8 +195,17 @@ static const char *trace_event_names[] = {
     "User-defined valued event",
     "Worker wait starts",
     "Worker wait ends",
+    "Worker spin starts",
+    "Worker spin ends",
     "Scheduler advancing time starts",
     "Scheduler advancing time ends",
+    "Scheduler wakeup",
+    "Scheduler criticality change",
+    "Watchdog expires",
+    "GIL wait starts",
+    "GIL wait ends",
+    "Python call starts",
+    "Python call ends",
     "Federated marker",
     // Sending messages
     "Sending ACK",
@@ -183,13 +250,56 @@ static const char *trace_event_names[] = {
     "Receiving ADR_AD",
     "Receiving ADR_QR",
     "Receiving UNIDENTIFIED",
+    "Clock sync offset",
+    "Compression starts",
+    "Compression ends",
+    "Decompression starts",
+    "Decompression ends",
+    "Serialization starts",
+    "Serialization ends",
+    "Deserialization starts",
+    "Deserialization ends",
 };
 
 // FIXME: Target property should specify the capacity of the trace buffer.
 #define TRACE_BUFFER_CAPACITY 2048
 
-/** Size of the table of trace objects. */
-#define TRACE_OBJECT_TABLE_SIZE 1024
+/**
+ * Number of full buffers that each thread can hand off to the trace writer
+ * thread before it has to write its buffers to the file itself.
+ */
+#define TRACE_SPARE_BUFFERS 4
+
+/** Initial capacity of the table of trace objects, which grows as objects are registered. */
+#define TRACE_OBJECT_TABLE_SIZE 64
+
+/**
+ * Value written in place of the start time at the beginning of a trace file in the
+ * compact format. It is followed by the start time, which is never negative.
+ */
+#define TRACE_COMPACT_FORMAT_MARKER ((instant_t)-2LL)
+
+/**
+ * Value written before the start time of a trace file whose physical times
+ * are cycle counts.
+ */
+#define TRACE_CYCLES_FORMAT_MARKER ((instant_t)-3LL)
+
+/** Upper bound on the number of bytes of one record in the compact format. */
+#define TRACE_COMPACT_RECORD_MAX_SIZE 96
+
+/**
+ * Bits identifying the optional fields that are present in a record
+ * in the compact format.
+ */
+typedef enum {
+    trace_compact_pointer = 1,
+    trace_compact_src_id = 2,
+    trace_compact_dst_id = 4,
+    trace_compact_microstep = 8,
+    trace_compact_trigger = 16,
+    trace_compact_extra_delay = 32
+} trace_compact_field_t;
 
 /**
  * @brief A trace record that is written in binary to the trace file.
@@ -234,31 +344,108 @@ struct object_description_t {
 typedef struct trace_t {
     /**
      * Array of buffers into which traces are written.
-     * When a buffer becomes full, the contents is flushed to the file,
-     * which will create a significant pause in the calling thread.
+     * When a buffer becomes full in single-threaded execution, the contents
+     * is flushed to the file, which will create a significant pause in the
+     * calling thread. Otherwise, it is handed off to the writer thread below.
      */
     trace_record_t** _lf_trace_buffer;
     int* _lf_trace_buffer_size;
 
+#if !defined(LF_SINGLE_THREADED)
+    /**
+     * Stack of empty buffers of each thread, TRACE_SPARE_BUFFERS slots per
+     * thread, of which the first _lf_trace_spare_count[i] are in use.
+     * A full buffer is swapped with one of these so that the traced thread can
+     * continue without waiting for the file.
+     */
+    trace_record_t** _lf_trace_spare_buffer;
+    int* _lf_trace_spare_count;
+
+    /**
+     * Ring of full buffers of each thread waiting for the writer thread, in
+     * the order in which they were filled, with TRACE_SPARE_BUFFERS slots per
+     * thread starting at _lf_trace_pending_head[i].
+     */
+    trace_record_t** _lf_trace_pending_buffer;
+    int* _lf_trace_pending_size;
+    int* _lf_trace_pending_head;
+    int* _lf_trace_pending_count;
+
+    /** Number of times a thread wrote its buffers itself because it ran out of spares. */
+    size_t _lf_trace_stalls;
+
+    /** Mutex protecting the spare and pending buffers. */
+    lf_mutex_t _lf_trace_mutex;
+
+    /**
+     * Mutex held by the thread that writes buffers to the sink. A thread that
+     * may write the trace header enters the critical section first.
+     */
+    lf_mutex_t _lf_trace_sink_mutex;
+
+    /** Condition variable signaled when a buffer is pending or the writer should stop. */
+    lf_cond_t _lf_trace_pending_changed;
+
+    /** The thread that writes the pending buffers to the file. */
+    lf_thread_t _lf_trace_writer;
+
+    /** Indicator that the writer thread is running. */
+    bool _lf_trace_writer_running;
+#endif
+
     /** The number of trace buffers allocated when tracing starts. */
     int _lf_number_of_trace_buffers;
 
     /** Marker that tracing is stopping or has stopped. */
     int _lf_trace_stop;
 
-    /** The file into which traces are written. */
-    FILE* _lf_trace_file;
+    /** The sink to which traces are written, or NULL if writing failed. */
+    struct trace_sink_t* _lf_trace_sink;
 
-    /** The file name where the traces are written*/
+    /** The file name or other destination where the traces are written (see trace_sink.h). */
     char *filename;
 
     /** Table of pointers to a description of the object. */
-    object_description_t _lf_trace_object_descriptions[TRACE_OBJECT_TABLE_SIZE];
+    object_description_t* _lf_trace_object_descriptions;
     int _lf_trace_object_descriptions_size;
+    int _lf_trace_object_descriptions_capacity;
+
+    /** Index of the object table by pointer and trigger (see trace.c). */
+    struct trace_object_index_t* _lf_trace_object_index;
 
     /** Indicator that the trace header information has been written to the file. */
     bool _lf_trace_header_written;
 
+    /**
+     * For each event type, zero to record its events, or nonzero to drop them or
+     * to check whether their pointer is that of an object selected by the names
+     * given to trace_filter_reactor(). This is derived from the fields below so
+     * that a tracepoint that is not filtered costs one branch.
+     */
+    unsigned char _lf_trace_filter[NUM_EVENT_TYPES];
+
+    /** Bitwise or of the trace_category_t values of the events to record. */
+    int _lf_trace_categories;
+
+    /** Names given to trace_filter_reactor(), or NULL if there are none. */
+    char** _lf_trace_filter_names;
+    int _lf_trace_filter_names_size;
+
+#ifdef LF_TRACE_COMPACT
+    /** Maps from the pointers and triggers in the object table to their indices. */
+    struct trace_object_ids_t* _lf_trace_pointer_ids;
+    struct trace_object_ids_t* _lf_trace_trigger_ids;
+
+    /** Buffer into which a trace is encoded before it is written to the file. */
+    unsigned char* _lf_trace_encoded;
+#endif
+
+#ifdef LF_TRACE_TSC
+    /** Cycle count and physical time sampled together when tracing started. */
+    instant_t _lf_trace_start_cycles;
+    instant_t _lf_trace_start_time;
+#endif
+
     /** Pointer back to the environment which we are tracing within*/
     environment_t* env;
 } trace_t;
@@ -280,6 +467,21 @@ trace_t* trace_new(environment_t *env, const char *filename);
  */
 void trace_free(trace_t *trace);
 
+/**
+ * @brief Write the trace to the given destination instead of the file given to
+ * trace_new(). This must be called before start_trace().
+ * @param destination A file name or one of the other destinations in trace_sink.h.
+ *  For environments other than the first, `_` and the environment ID are appended
+ *  to file and shared memory destinations.
+ */
+void trace_set_destination(trace_t* trace, const char* destination);
+
+/**
+ * @brief Return the number of bytes allocated for the trace buffers of the given
+ * trace object, which is zero until tracing starts.
+ */
+size_t trace_buffer_bytes(trace_t* trace);
+
 
 /**
  * Register a trace object.
@@ -288,7 +490,8 @@ void trace_free(trace_t *trace);
  * @param pointer2 Further identifying pointer, typically to a trigger (action or timer) or NULL if irrelevant.
  * @param type The type of trace object.
  * @param description The human-readable description of the object.
- * @return 1 if successful, 0 if the trace object table is full.
+ * @return 1 if successful. If an object with the same pointers was registered
+ *  before, its description is kept.
  */
 int _lf_register_trace_event(trace_t* trace, void* pointer1, void* pointer2, _lf_trace_object_t type, char* description);
 
@@ -297,10 +500,39 @@ int _lf_register_trace_event(trace_t* trace, void* pointer1, void* pointer2, _lf
  * that describes a phenomenon being traced. Use the same pointer as the first argument to
  * tracepoint_user_event() and tracepoint_user_value().
  * @param description Pointer to a human-readable description of the event.
- * @return 1 if successful, 0 if the trace object table is full.
+ * @return 1 if successful.
  */
 int register_user_trace_event(void* self, char* description);
 
+/**
+ * @brief Record only the events in the given categories. All categories are
+ * recorded by default. This may be called at any time, but not concurrently with
+ * another call to it or to trace_filter_reactor().
+ * @param categories Bitwise or of trace_category_t values.
+ */
+void trace_set_categories(trace_t* trace, int categories);
+
+/**
+ * @brief Record reaction, schedule, and user events only for the objects with the
+ * given name. The name is matched against the descriptions in the object table: it
+ * selects a reactor with that fully qualified name and all reactors contained in it,
+ * or a user-defined event with that description. Objects registered later are also
+ * matched. Calling this more than once selects the objects matching any of the names.
+ * Other events are not affected.
+ * @param name The name, which is copied.
+ */
+void trace_filter_reactor(trace_t* trace, const char* name);
+
+/**
+ * @brief Apply the filters given on the command line.
+ * @param categories Comma-separated list of the categories to record, each one of
+ *  reactions, workers, scheduling, user, federated, or all, or NULL for all.
+ * @param reactors Comma-separated list of names to give to trace_filter_reactor(),
+ *  or NULL for none.
+ * @return 0 on success, or -1 if a category is not recognized.
+ */
+int trace_set_filters(trace_t* trace, const char* categories, const char* reactors);
+
 /**
  * Open a trace file and start tracing.
  * @param filename The filename for the trace file.
@@ -322,6 +554,7 @@ void start_trace(trace_t* trace);
  * @param physical_time If the caller has already accessed physical time, provide it here.
  *  Otherwise, provide NULL. This argument avoids a second call to lf_time_physical()
  *  and ensures that the physical time in the trace is the same as that used by the caller.
+ *  If LF_TRACE_TSC is defined, this is ignored and the cycle counter is read instead.
  * @param trigger Pointer to the trigger_t struct for calls to schedule or NULL otherwise.
  * @param extra_delay The extra delay passed to schedule(). If not relevant for this event
  *  type, pass 0.
@@ -346,6 +579,8 @@ void tracepoint(
 
 /**
  * Trace the start of a reaction execution.
+ * The level of the reaction is stored in the "extra_delay" field of the record,
+ * so that tools can tell which reactions may depend on which.
  * @param env The environment in which we are executing
  * @param reaction Pointer to the reaction_t struct for the reaction.
  * @param worker The thread number of the worker thread or 0 for single-threaded execution.
@@ -394,6 +629,33 @@ void tracepoint_user_event(void* self, char* description);
  */
 void tracepoint_user_value(void* self, char* description, long long value);
 
+/**
+ * Trace the start or the end of the serialization of a value into a message, or of
+ * the deserialization of a message into a value, by a target runtime such as that of
+ * Python. The extra delay of the record is the number of bytes of the message, which
+ * is 0 at the start of a serialization, and the destination ID is the ID of the
+ * environment, so that tools can match the start and the end of each.
+ * These records belong to the federated category (see trace_set_categories()).
+ * This acquires the mutex of the environment, so the caller must not hold it.
+ * @param env The environment in which the value is serialized or deserialized.
+ * @param event_type One of serialization_starts, serialization_ends,
+ *  deserialization_starts, and deserialization_ends.
+ * @param bytes The number of bytes of the message.
+ */
+void tracepoint_serialization(environment_t* env, trace_event_t event_type, size_t bytes);
+
+/**
+ * Trace the start or the end of a wait of a worker for the lock of the interpreter of a
+ * target runtime, such as the GIL of Python, or of the execution of code by that
+ * interpreter on behalf of a reaction, which starts once the lock is acquired.
+ * These records belong to the workers category (see trace_set_categories()).
+ * @param trace The trace of the environment of the reaction.
+ * @param event_type One of gil_wait_starts, gil_wait_ends, python_call_starts,
+ *  and python_call_ends.
+ * @param worker The thread number of the worker thread or 0 for single-threaded execution.
+ */
+void tracepoint_interpreter(trace_t* trace, trace_event_t event_type, int worker);
+
 /**
  * Trace the start of a worker waiting for something to change on the reaction queue.
  * @param env The environment in which we are executing
@@ -408,6 +670,20 @@ void tracepoint_worker_wait_starts(trace_t* trace, int worker);
  */
 void tracepoint_worker_wait_ends(trace_t* trace, int worker);
 
+/**
+ * Trace the start of a worker spinning before it parks to wait for work.
+ * @param trace The trace object.
+ * @param worker The thread number of the worker thread.
+ */
+void tracepoint_worker_spin_starts(trace_t* trace, int worker);
+
+/**
+ * Trace the end of a worker spinning before it parks to wait for work.
+ * @param trace The trace object.
+ * @param worker The thread number of the worker thread.
+ */
+void tracepoint_worker_spin_ends(trace_t* trace, int worker);
+
 /**
  * Trace the start of the scheduler waiting for logical time to advance or an event to
  * appear on the event queue.
@@ -422,6 +698,32 @@ void tracepoint_scheduler_advancing_time_starts(trace_t* trace);
  */
 void tracepoint_scheduler_advancing_time_ends(trace_t* trace);
 
+/**
+ * Trace the release of a tag once physical time has reached it.
+ * @param trace The trace object.
+ * @param lateness Physical time minus the time of the tag, which is negative
+ *  if the tag is released early.
+ */
+void tracepoint_scheduler_wakeup(trace_t* trace, interval_t lateness);
+
+/**
+ * Trace a change of the criticality mode of the scheduler.
+ * @param trace The trace object.
+ * @param worker The worker that changes the mode, or -1 if the caller holds
+ *  the mutex of the environment instead.
+ * @param criticality The new criticality mode.
+ */
+void tracepoint_scheduler_criticality_change(trace_t* trace, int worker, int criticality);
+
+/**
+ * Trace the invocation of the expiration handler of a watchdog.
+ * @param self The self struct of the reactor of the watchdog.
+ * @param trigger The trigger of the watchdog.
+ * @param lateness Physical time when the handler is invoked minus the expiration
+ *  time of the watchdog.
+ */
+void tracepoint_watchdog_expires(void* self, trigger_t* trigger, interval_t lateness);
+
 /**
  * Trace the occurence of a deadline miss.
  * @param env The environment in which we are executing
@@ -479,6 +781,34 @@ void tracepoint_federate_to_federate(trace_t* trace, trace_event_t event_type, i
  */
 void tracepoint_federate_from_federate(trace_t* trace, trace_event_t event_type, int fed_id, int partner_id, tag_t *tag);
 
+/**
+ * Trace an adjustment of the offset added to the physical clock of the federate
+ * by clock synchronization. The physical time of the record is taken after the
+ * adjustment, and its extra delay is the new offset, so that tools merging the
+ * traces of a federation can correct the physical times of the federate between
+ * adjustments.
+ * @param fed_id The federate identifier.
+ * @param offset The offset in effect from now on.
+ */
+void tracepoint_federate_clock_sync(trace_t* trace, int fed_id, interval_t offset);
+
+/**
+ * Trace the start or the end of the compression of the body of a message
+ * sent to another federate, or of the decompression of the body of a message
+ * received from another federate. The extra delay of the record is the
+ * number of bytes given to the algorithm at the start and the number of
+ * bytes it produced at the end, so that the ratio and the time taken can be
+ * computed from a pair of records.
+ * @param event_type One of compression_starts, compression_ends,
+ *  decompression_starts, and decompression_ends.
+ * @param fed_id The federate identifier.
+ * @param partner_id The partner federate identifier.
+ * @param tag Pointer to the tag of the message, or NULL.
+ * @param bytes The number of bytes in or out.
+ */
+void tracepoint_federate_compression(trace_t* trace, trace_event_t event_type, int fed_id, int partner_id,
+        tag_t* tag, size_t bytes);
+
 #endif // FEDERATED
 
 ////////////////////////////////////////////////////////////
@@ -517,15 +847,24 @@ void tracepoint_rti_from_federate(trace_t* trace, trace_event_t event_type, int
 #define tracepoint_schedule(...)
 #define tracepoint_user_event(...)
 #define tracepoint_user_value(...)
+#define tracepoint_serialization(...)
+#define tracepoint_interpreter(...)
 #define tracepoint_worker_wait_starts(...)
 #define tracepoint_worker_wait_ends(...)
+#define tracepoint_worker_spin_starts(...)
+#define tracepoint_worker_spin_ends(...)
 #define tracepoint_scheduler_advancing_time_starts(...);
 #define tracepoint_scheduler_advancing_time_ends(...);
+#define tracepoint_scheduler_wakeup(...);
+#define tracepoint_scheduler_criticality_change(...);
+#define tracepoint_watchdog_expires(...);
 #define tracepoint_reaction_deadline_missed(...);
 #define tracepoint_federate_to_rti(...);
 #define tracepoint_federate_from_rti(...);
 #define tracepoint_federate_to_federate(...) ;
 #define tracepoint_federate_from_federate(...) ;
+#define tracepoint_federate_clock_sync(...) ;
+#define tracepoint_federate_compression(...) ;
 #define tracepoint_rti_to_federate(...);
 #define tracepoint_rti_from_federate(...) ;
 
@@ -533,6 +872,11 @@ void tracepoint_rti_from_federate(trace_t* trace, trace_event_t event_type, int
 #define stop_trace(...)
 #define trace_new(...) NULL
 #define trace_free(...)
+#define trace_buffer_bytes(...) 0
+#define trace_set_destination(...)
+#define trace_set_categories(...)
+#define trace_filter_reactor(...)
+#define trace_set_filters(...) 0
 
 
 #endif // LF_TRACE
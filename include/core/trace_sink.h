@@ -0,0 +1,139 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file trace_sink.h
+ * @brief Destinations to which the bytes of a trace are written.
+ *
+ * A trace is written as a stream of bytes in the format described in trace.h.
+ * The stream is divided into units, each of which is either the header together
+ * with the first trace, or a later trace, or the trailer of the LF_TRACE_TSC format.
+ * A sink receives the bytes of a unit through trace_sink_write() and then
+ * trace_sink_flush() at the end of the unit. The sink is selected by a
+ * destination string given to trace_sink_open():
+ * * `tcp://host:port`: The stream is sent over a TCP connection to a collector.
+ * * `udp://host:port`: The stream is sent as datagrams, each of which begins
+ *   with a trace_datagram_header_t so that a collector can detect lost or
+ *   reordered datagrams, after which the rest of the stream cannot be decoded.
+ * * `shm://name`: The units are appended to a trace_shm_ring_t in the POSIX
+ *   shared memory object `/name`. A unit that does not fit in the free space
+ *   is dropped whole, so that the stream remains decodable by a reader that
+ *   falls behind. Dropping the first unit, which holds the header, is avoided
+ *   by making the ring larger than one unit.
+ * * Anything else: The stream is written to the file with that name.
+ * Sockets and shared memory are only supported on Linux and macOS.
+ */
+
+#ifndef TRACE_SINK_H
+#define TRACE_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size in bytes of the data area of a shared memory ring. */
+#ifndef TRACE_SINK_SHM_SIZE
+#define TRACE_SINK_SHM_SIZE (16 * 1024 * 1024)
+#endif
+
+/** Maximum number of bytes of the stream carried by one datagram. */
+#ifndef TRACE_SINK_DATAGRAM_SIZE
+#define TRACE_SINK_DATAGRAM_SIZE 8192
+#endif
+
+/** Value of the magic field of a trace_shm_ring_t once it is initialized. */
+#define TRACE_SHM_RING_MAGIC 0x4c46545243524e47ULL
+
+typedef struct trace_sink_t trace_sink_t;
+
+/**
+ * A destination for the bytes of a trace. Each kind of sink fills in the
+ * functions, which return 0 on success and -1 on failure.
+ */
+struct trace_sink_t {
+    /** Append the given bytes to the current unit. */
+    int (*write)(trace_sink_t* sink, const void* data, size_t size);
+    /** Deliver the current unit. */
+    int (*flush)(trace_sink_t* sink);
+    /** Release the resources of the sink, including the sink itself. */
+    void (*close)(trace_sink_t* sink);
+};
+
+/**
+ * Header of each datagram sent by a UDP sink, in network byte order.
+ */
+typedef struct trace_datagram_header_t {
+    /** Identifier of the stream, which is the same for all datagrams of a sink. */
+    uint32_t stream;
+    /** Index of the datagram in the stream, starting at zero. */
+    uint32_t sequence;
+} trace_datagram_header_t;
+
+/**
+ * Layout of the shared memory object of a shm sink. A reader consumes the
+ * bytes between tail and head, modulo capacity, and then advances tail.
+ * Head and tail count all the bytes written and consumed so far and only
+ * increase. The writer advances head with an atomic operation after writing
+ * the bytes of a unit, and reads tail with an atomic operation.
+ */
+typedef struct trace_shm_ring_t {
+    /** TRACE_SHM_RING_MAGIC, written after the other fields are initialized. */
+    uint64_t magic;
+    /** Number of bytes of data. */
+    uint64_t capacity;
+    /** Number of bytes written. */
+    uint64_t head;
+    /** Number of bytes consumed, advanced by the reader. */
+    uint64_t tail;
+    /** Number of units dropped because the ring was full. */
+    uint64_t dropped;
+    /** The bytes of the ring. */
+    unsigned char data[];
+} trace_shm_ring_t;
+
+/**
+ * @brief Open the sink for the given destination.
+ * @param destination A destination string as described above.
+ * @param stream Identifier of the stream, such as the environment ID, which
+ *  is sent in the datagrams of a UDP sink.
+ * @return The sink, or NULL if it could not be opened, in which case a
+ *  warning is printed.
+ */
+trace_sink_t* trace_sink_open(const char* destination, uint32_t stream);
+
+/** @brief Append the given bytes to the current unit of the sink. */
+static inline int trace_sink_write(trace_sink_t* sink, const void* data, size_t size) {
+    return sink->write(sink, data, size);
+}
+
+/** @brief Deliver the current unit of the sink. */
+static inline int trace_sink_flush(trace_sink_t* sink) {
+    return sink->flush(sink);
+}
+
+/** @brief Close the sink and free it. */
+static inline void trace_sink_close(trace_sink_t* sink) {
+    sink->close(sink);
+}
+
+#endif // TRACE_SINK_H
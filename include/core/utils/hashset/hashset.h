@@ -35,6 +35,7 @@ extern "C" {
         void** items;
         size_t nitems;
         size_t n_deleted_items;
+        size_t next_pop; // Where hashset_pop_any() resumes its scan.
     };
 
     typedef struct hashset_st *hashset_t;
@@ -78,6 +79,15 @@ extern "C" {
      */
     int hashset_is_member(hashset_t set, void *item);
 
+    /**
+     * @brief Remove an arbitrary item from the hashset and return it,
+     * or return NULL if the hashset is empty.
+     * Successive calls resume scanning where the previous one stopped,
+     * so emptying the hashset this way takes time proportional to its capacity
+     * rather than to the capacity for each item.
+     */
+    void* hashset_pop_any(hashset_t set);
+
 #ifdef __cplusplus
 }
 #endif
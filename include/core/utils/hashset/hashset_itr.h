@@ -33,6 +33,22 @@ struct hashset_itr_st {
 
 typedef struct hashset_itr_st *hashset_itr_t;
 
+/**
+ * @brief Initialize an iterator over the hashset in storage provided by the
+ * caller, such as a local variable, which avoids the allocation made by
+ * hashset_iterator(). The caller iterates as follows:
+ * ```
+ *   struct hashset_itr_st iterator;
+ *   hashset_iterator_init(&iterator, my_hashset);
+ *   while (hashset_iterator_next(&iterator) >= 0) {
+ *     void* my_value = hashset_iterator_value(&iterator);
+ *     ...
+ *   }
+ * ```
+ * The hashset must not be modified during the iteration.
+ */
+void hashset_iterator_init(hashset_itr_t itr, hashset_t set);
+
 /**
  * @brief Create a hashset iterator.
  * The caller should then iterate over the hashset as follows:
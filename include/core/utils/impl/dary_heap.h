@@ -0,0 +1,213 @@
+/**
+ * @brief Defines a generic d-ary min-heap data type that stores priorities inline.
+ *
+ * Heaps are defined by redefining E, P, ARITY, SET_POS, and DARY_HEAP, and including this file. A
+ * default heap type is defined here. See core/utils/pqueue_dary.c for an example of a heap
+ * declaration.
+ * - E and P must be the types of elements and priorities of the heap, respectively. Priorities
+ *   are compared with `<`, and elements with smaller priorities are closer to the root.
+ * - DARY_HEAP_LESS(a, b) may be defined to compare priorities for which `<` is not defined, such
+ *   as structs. It is undefined at the end of this file.
+ * - ARITY must be the number of children of each node. Four or eight children fill one or two
+ *   cache lines with the priorities that are compared when moving an element down the heap.
+ * - SET_POS(heap, element, position) is invoked whenever an element is moved to a position in the
+ *   heap, which is required for removing elements other than the root. The heap has a `context`
+ *   field for use by this macro.
+ * - DARY_HEAP must be a function-like macro that prefixes tokens with the name of the heap. For
+ *   example, the name of the heap data type is given by evaluation of the macro DARY_HEAP(t) so
+ *   that it is "t" prefixed with the name of the heap. The function names associated with the
+ *   data type are similar.
+ *
+ * Because priorities are stored next to the element pointers, comparisons never dereference the
+ * elements, and the children of a node are adjacent in memory.
+ */
+
+#ifndef E
+#define E void*
+#endif
+#ifndef P
+#define P unsigned long long
+#endif
+#ifndef ARITY
+#define ARITY 4
+#endif
+#ifndef SET_POS
+#define SET_POS(heap, element, position)
+#endif
+#ifndef DARY_HEAP
+#define DARY_HEAP(token) dary_heap ## _ ## token
+#endif
+#ifndef DARY_HEAP_LESS
+#define DARY_HEAP_LESS(a, b) ((a) < (b))
+#endif
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+
+////////////////////////// Type definitions ///////////////////////////
+
+typedef struct DARY_HEAP(entry_t) {
+    P priority;
+    E element;
+} DARY_HEAP(entry_t);
+
+typedef struct DARY_HEAP(t) {
+    DARY_HEAP(entry_t)* entries;
+    size_t size;
+    size_t capacity;
+    void* context;
+} DARY_HEAP(t);
+
+//////////////////////// Function declarations ////////////////////////
+
+/**
+ * @brief Initialize the given heap.
+ * @param capacity The number of elements for which memory should be preallocated.
+ * @param context A pointer that is available to SET_POS.
+ * @return true on success or false for insufficient memory.
+ */
+static inline bool DARY_HEAP(init)(DARY_HEAP(t)* heap, size_t capacity, void* context);
+
+/** @brief Free the memory used by the entries of the given heap. */
+static inline void DARY_HEAP(destroy)(DARY_HEAP(t)* heap);
+
+/**
+ * @brief Insert an element with the given priority.
+ * @return 0 on success or 1 for insufficient memory.
+ */
+static inline int DARY_HEAP(insert)(DARY_HEAP(t)* heap, E element, P priority);
+
+/**
+ * @brief Append an element with the given priority without restoring the heap order.
+ * DARY_HEAP(heapify) must be called before the heap is used otherwise.
+ * @return 0 on success or 1 for insufficient memory.
+ */
+static inline int DARY_HEAP(append)(DARY_HEAP(t)* heap, E element, P priority);
+
+/** @brief Restore the heap order in time linear in the size of the heap. */
+static inline void DARY_HEAP(heapify)(DARY_HEAP(t)* heap);
+
+/**
+ * @brief Remove and return the element with the smallest priority.
+ * Precondition: The heap must not be empty.
+ */
+static inline E DARY_HEAP(pop)(DARY_HEAP(t)* heap);
+
+/**
+ * @brief Remove the element at the given position.
+ * Precondition: The position must be less than the size of the heap.
+ */
+static inline void DARY_HEAP(remove_at)(DARY_HEAP(t)* heap, size_t position);
+
+/////////////////////////// Private helpers ///////////////////////////
+
+#define DARY_HEAP_PARENT(i) (((i) - 1) / ARITY)
+#define DARY_HEAP_FIRST_CHILD(i) ((i) * ARITY + 1)
+
+static inline void DARY_HEAP(sift_up)(DARY_HEAP(t)* heap, size_t i) {
+    DARY_HEAP(entry_t) moving = heap->entries[i];
+    while (i > 0) {
+        size_t parent = DARY_HEAP_PARENT(i);
+        if (!DARY_HEAP_LESS(moving.priority, heap->entries[parent].priority)) break;
+        heap->entries[i] = heap->entries[parent];
+        SET_POS(heap, heap->entries[i].element, i);
+        i = parent;
+    }
+    heap->entries[i] = moving;
+    SET_POS(heap, moving.element, i);
+}
+
+static inline void DARY_HEAP(sift_down)(DARY_HEAP(t)* heap, size_t i) {
+    DARY_HEAP(entry_t) moving = heap->entries[i];
+    size_t child;
+    while ((child = DARY_HEAP_FIRST_CHILD(i)) < heap->size) {
+        size_t end = child + ARITY < heap->size ? child + ARITY : heap->size;
+        size_t smallest = child;
+        for (child++; child < end; child++) {
+            if (DARY_HEAP_LESS(heap->entries[child].priority, heap->entries[smallest].priority)) smallest = child;
+        }
+        if (!DARY_HEAP_LESS(heap->entries[smallest].priority, moving.priority)) break;
+        heap->entries[i] = heap->entries[smallest];
+        SET_POS(heap, heap->entries[i].element, i);
+        i = smallest;
+    }
+    heap->entries[i] = moving;
+    SET_POS(heap, moving.element, i);
+}
+
+//////////////////////// Function definitions /////////////////////////
+
+static inline bool DARY_HEAP(init)(DARY_HEAP(t)* heap, size_t capacity, void* context) {
+    if (capacity == 0) capacity = 1;
+    heap->entries = (DARY_HEAP(entry_t)*) malloc(capacity * sizeof(DARY_HEAP(entry_t)));
+    if (!heap->entries) return false;
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->context = context;
+    return true;
+}
+
+static inline void DARY_HEAP(destroy)(DARY_HEAP(t)* heap) {
+    free(heap->entries);
+    heap->entries = NULL;
+    heap->size = heap->capacity = 0;
+}
+
+static inline int DARY_HEAP(append)(DARY_HEAP(t)* heap, E element, P priority) {
+    if (heap->size == heap->capacity) {
+        size_t capacity = 2 * heap->capacity;
+        DARY_HEAP(entry_t)* entries = (DARY_HEAP(entry_t)*) realloc(
+            heap->entries, capacity * sizeof(DARY_HEAP(entry_t))
+        );
+        if (!entries) return 1;
+        heap->entries = entries;
+        heap->capacity = capacity;
+    }
+    size_t i = heap->size++;
+    heap->entries[i].priority = priority;
+    heap->entries[i].element = element;
+    SET_POS(heap, element, i);
+    return 0;
+}
+
+static inline int DARY_HEAP(insert)(DARY_HEAP(t)* heap, E element, P priority) {
+    if (DARY_HEAP(append)(heap, element, priority)) return 1;
+    DARY_HEAP(sift_up)(heap, heap->size - 1);
+    return 0;
+}
+
+static inline void DARY_HEAP(heapify)(DARY_HEAP(t)* heap) {
+    if (heap->size < 2) return;
+    // Sift down every node that has children, starting with the last one.
+    for (size_t i = DARY_HEAP_PARENT(heap->size - 1) + 1; i > 0; i--) {
+        DARY_HEAP(sift_down)(heap, i - 1);
+    }
+}
+
+static inline E DARY_HEAP(pop)(DARY_HEAP(t)* heap) {
+    assert(heap->size > 0);
+    E head = heap->entries[0].element;
+    if (--heap->size > 0) {
+        heap->entries[0] = heap->entries[heap->size];
+        DARY_HEAP(sift_down)(heap, 0);
+    }
+    return head;
+}
+
+static inline void DARY_HEAP(remove_at)(DARY_HEAP(t)* heap, size_t position) {
+    assert(position < heap->size);
+    if (position == --heap->size) return;
+    P removed = heap->entries[position].priority;
+    heap->entries[position] = heap->entries[heap->size];
+    if (DARY_HEAP_LESS(heap->entries[position].priority, removed)) {
+        DARY_HEAP(sift_up)(heap, position);
+    } else {
+        DARY_HEAP(sift_down)(heap, position);
+    }
+}
+
+#undef DARY_HEAP_PARENT
+#undef DARY_HEAP_FIRST_CHILD
+#undef DARY_HEAP_LESS
@@ -1,6 +1,6 @@
 /**
  * @author Peter Donovan (peterdonovan@berkeley.edu)
- * @brief Defines a generic, non-resizing hashmap data type.
+ * @brief Defines a generic hashmap data type that grows as entries are added.
  *
  * Hashmaps are defined by redefining K, V, HASH_OF, and HASHMAP, and including this file. A default
  * hashmap type is defined here. See pointer_hashmap.h for an example of a hashmap declaration.
@@ -10,6 +10,13 @@
  *   example, the name of the hashmap data type is given by evaluation of the macro HASHMAP(t) so
  *   that it is "t" prefixed with the name of the hashmap. The function names associated with the
  *   data type are similar.
+ *
+ * The table uses open addressing in the manner of Swiss tables. Besides the entries, it holds one
+ * control byte per slot, which is either EMPTY or seven bits of the hash of the key in the slot.
+ * The slots are divided into groups of HASHMAP_GROUP_SIZE, and a lookup compares the control bytes
+ * of a whole group at once (with SSE2 where available) before it compares any key, moving on to
+ * the next group of a triangular sequence only if the group is full. The table doubles its
+ * capacity when it becomes seven-eighths full, so a group with an empty slot always ends the search.
  */
 
 #ifndef K
@@ -26,9 +33,62 @@
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <stdbool.h>
 
+///////////////////// Helpers shared by all hashmaps //////////////////////
+
+#ifndef HASHMAP_GROUP_SIZE
+/** The number of slots whose control bytes are compared at once. */
+#define HASHMAP_GROUP_SIZE 16
+
+/** The control byte of an empty slot. Those of full slots are below 0x80. */
+#define HASHMAP_EMPTY 0x80
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Return a mask with bit i set if the control byte at group[i] equals `byte`.
+ */
+static inline unsigned hashmap_group_match(const unsigned char* group, unsigned char byte) {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    __m128i control = _mm_loadu_si128((const __m128i*) group);
+    return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char) byte)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < HASHMAP_GROUP_SIZE; i++) {
+        mask |= (unsigned) (group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+/** @brief Return the index of the lowest bit set in the nonzero `mask`. */
+static inline int hashmap_lowest_bit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/** @brief Spread the bits of a hash so that both its low and high bits depend on all of them. */
+static inline size_t hashmap_mix(size_t hash) {
+    uint64_t mixed = (uint64_t) hash * 0x9E3779B97F4A7C15ull;
+    return (size_t) (mixed ^ (mixed >> 32));
+}
+#endif // HASHMAP_GROUP_SIZE
+
 ////////////////////////// Type definitions ///////////////////////////
 
 typedef struct HASHMAP(entry_t) {
@@ -37,6 +97,7 @@ typedef struct HASHMAP(entry_t) {
 } HASHMAP(entry_t);
 
 typedef struct HASHMAP(t) {
+    unsigned char* control;
     HASHMAP(entry_t)* entries;
     size_t capacity;
     size_t num_entries;
@@ -47,8 +108,8 @@ typedef struct HASHMAP(t) {
 
 /**
  * @brief Construct a new hashmap object.
- * @param capacity A number that is much larger than the maximum number of items that this
- * hashmap will contain. Insufficient surplus capacity will cause poor performance.
+ * @param capacity The number of items that the hashmap is expected to contain. The hashmap
+ * grows beyond it as needed.
  * @param nothing A key that is guaranteed never to be used.
  */
 HASHMAP(t)* HASHMAP(new)(size_t capacity, K nothing);
@@ -56,80 +117,139 @@ HASHMAP(t)* HASHMAP(new)(size_t capacity, K nothing);
 /** @brief Free all memory used by the given hashmap. */
 void HASHMAP(free)(HASHMAP(t)* hashmap);
 
-/** @brief Associate a value with the given key. */
+/** @brief Associate a value with the given key, replacing any value it had. */
 void HASHMAP(put)(HASHMAP(t)* hashmap, K key, V value);
 
 /**
- * @brief Get the value associated with the given key.
- * Precondition: The key must be present in the map.
+ * @brief Get the value associated with the given key, or a value whose bytes are all zero,
+ * such as 0 or NULL, if the key is not present.
  */
 V HASHMAP(get)(HASHMAP(t)* hashmap, K key);
 
-/////////////////////////// Private helpers ///////////////////////////
+/**
+ * @brief Return the address of the value associated with the given key, or NULL if the key is
+ * not present. The address is valid until the next call to put.
+ */
+V* HASHMAP(find)(HASHMAP(t)* hashmap, K key);
 
-static HASHMAP(entry_t)* HASHMAP(get_ideal_address)(HASHMAP(t)* hashmap, K key) {
-    HASHMAP(entry_t)* address = hashmap->entries + (HASH_OF(key) % hashmap->capacity);
-    assert(address >= hashmap->entries);
-    assert(address < hashmap->entries + hashmap->capacity);
-    return address;
-}
+/**
+ * @brief Return the next entry of the hashmap at or after `*position`, which the caller
+ * initializes to 0, and advance `*position` past it, or return NULL if there is none.
+ * The order is unspecified.
+ */
+HASHMAP(entry_t)* HASHMAP(next)(HASHMAP(t)* hashmap, size_t* position);
+
+/////////////////////////// Private helpers ///////////////////////////
 
 /**
- * @brief Return the actual address of the hashmap entry corresponding to `key`, or the address of
- * the closest empty entry if no such entry exists.
- * @param key The key from which to begin a search.
- * @param desired The key that the desired returnable entry should have.
+ * @brief Return the slot holding `key`, or if there is none and `insert` is true, the first empty
+ * slot of its probe sequence, or otherwise -1.
  */
-static HASHMAP(entry_t)* HASHMAP(get_actual_address)(HASHMAP(t)* hashmap, K key) {
-    HASHMAP(entry_t)* address = HASHMAP(get_ideal_address)(hashmap, key);
-    HASHMAP(entry_t)* upper_limit = hashmap->entries + hashmap->capacity;
-    while ((address->key != hashmap->nothing) & (address->key != key)) address++;
-    if (address == upper_limit) {
-        address = hashmap->entries;
-        while ((address->key != hashmap->nothing) & (address->key != key)) address++;
-        if (address == upper_limit) return NULL;
+static inline ptrdiff_t HASHMAP(find_slot)(HASHMAP(t)* hashmap, K key, bool insert) {
+    size_t hash = hashmap_mix(HASH_OF(key));
+    unsigned char tag = (unsigned char) (hash & 0x7F);
+    size_t group_mask = hashmap->capacity / HASHMAP_GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t stride = 1; ; stride++) {
+        size_t base = group * HASHMAP_GROUP_SIZE;
+        unsigned char* control = hashmap->control + base;
+        unsigned matches = hashmap_group_match(control, tag);
+        while (matches) {
+            size_t slot = base + hashmap_lowest_bit(matches);
+            if (hashmap->entries[slot].key == key) return (ptrdiff_t) slot;
+            matches &= matches - 1;
+        }
+        unsigned empty = hashmap_group_match(control, HASHMAP_EMPTY);
+        if (empty) {
+            if (!insert) return -1;
+            size_t slot = base + hashmap_lowest_bit(empty);
+            control[slot - base] = tag;
+            return (ptrdiff_t) slot;
+        }
+        // The groups are a power of two in number, so this visits all of them.
+        assert(stride <= group_mask + 1);
+        group = (group + stride) & group_mask;
     }
-    assert(address->key == key || address->key == hashmap->nothing);
-    return address;
+}
+
+/** @brief Allocate the slots of a hashmap with the given capacity, which is a multiple of the group size. */
+static inline void HASHMAP(allocate)(HASHMAP(t)* hashmap, size_t capacity) {
+    hashmap->control = (unsigned char*) malloc(capacity);
+    hashmap->entries = (HASHMAP(entry_t)*) malloc(capacity * sizeof(HASHMAP(entry_t)));
+    if (!hashmap->control || !hashmap->entries) exit(1);
+    memset(hashmap->control, HASHMAP_EMPTY, capacity);
+    hashmap->capacity = capacity;
+}
+
+/** @brief Double the capacity of the hashmap and reinsert its entries. */
+static inline void HASHMAP(grow)(HASHMAP(t)* hashmap) {
+    unsigned char* control = hashmap->control;
+    HASHMAP(entry_t)* entries = hashmap->entries;
+    size_t capacity = hashmap->capacity;
+    HASHMAP(allocate)(hashmap, 2 * capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        if (control[i] == HASHMAP_EMPTY) continue;
+        hashmap->entries[HASHMAP(find_slot)(hashmap, entries[i].key, true)] = entries[i];
+    }
+    free(control);
+    free(entries);
 }
 
 //////////////////////// Function definitions /////////////////////////
 
 HASHMAP(t)* HASHMAP(new)(size_t capacity, K nothing) {
-    HASHMAP(entry_t)* entries = (HASHMAP(entry_t)*) malloc(
-        (capacity + 1) * sizeof(HASHMAP(entry_t))
-    );
-    if (!entries) exit(1);
     HASHMAP(t)* ret = (HASHMAP(t)*) malloc(sizeof(HASHMAP(t)));
     if (!ret) exit(1);
-    // The entry at the end is used as a boundary. It will never again be written to.
-    for (size_t i = 0; i < capacity + 1; i++) {
-        entries[i].key = nothing;
-    }
-    ret->entries = entries;
-    ret->capacity = capacity;
+    // Round up to a power of two number of groups with room for `capacity` at the maximum load.
+    size_t slots = HASHMAP_GROUP_SIZE;
+    while (slots / 8 * 7 < capacity) slots *= 2;
+    HASHMAP(allocate)(ret, slots);
     ret->num_entries = 0;
-    // A second nothing may be required if removal is to be supported and we want to make removal
-    // a constant-time operation.
     ret->nothing = nothing;
     return ret;
 }
 
 void HASHMAP(free)(HASHMAP(t)* hashmap) {
+    free(hashmap->control);
     free(hashmap->entries);
     free(hashmap);
 }
 
 void HASHMAP(put)(HASHMAP(t)* hashmap, K key, V value) {
     assert(key != hashmap->nothing);
-    assert(key >= 0);
-    HASHMAP(entry_t)* write_to = HASHMAP(get_actual_address)(hashmap, key);
-    write_to->key = key;
-    write_to->value = value;
+    ptrdiff_t slot = HASHMAP(find_slot)(hashmap, key, false);
+    if (slot < 0) {
+        if (hashmap->num_entries + 1 > hashmap->capacity / 8 * 7) HASHMAP(grow)(hashmap);
+        slot = HASHMAP(find_slot)(hashmap, key, true);
+        hashmap->entries[slot].key = key;
+        hashmap->num_entries++;
+    }
+    hashmap->entries[slot].value = value;
 }
 
 V HASHMAP(get)(HASHMAP(t)* hashmap, K key) {
     assert(key != hashmap->nothing);
-    HASHMAP(entry_t)* read_from = HASHMAP(get_actual_address)(hashmap, key);
-    return read_from->value; // Crash the program if the key cannot be found
+    ptrdiff_t slot = HASHMAP(find_slot)(hashmap, key, false);
+    if (slot < 0) {
+        V missing;
+        memset(&missing, 0, sizeof(V));
+        return missing;
+    }
+    return hashmap->entries[slot].value;
+}
+
+V* HASHMAP(find)(HASHMAP(t)* hashmap, K key) {
+    ptrdiff_t slot = HASHMAP(find_slot)(hashmap, key, false);
+    return slot < 0 ? NULL : &hashmap->entries[slot].value;
+}
+
+HASHMAP(entry_t)* HASHMAP(next)(HASHMAP(t)* hashmap, size_t* position) {
+    for (size_t i = *position; i < hashmap->capacity; i++) {
+        if (hashmap->control[i] != HASHMAP_EMPTY) {
+            *position = i + 1;
+            return &hashmap->entries[i];
+        }
+    }
+    *position = hashmap->capacity;
+    return NULL;
 }
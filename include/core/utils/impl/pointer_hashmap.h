@@ -9,20 +9,21 @@
  * ```
  * hashmap_object2int_t my_map = hashmap_object2int_new(CAPACITY, NOTHING);
  * ```
- * where CAPACITY is the maximum capacity of the hashmap and NOTHING is
+ * where CAPACITY is the expected number of entries of the hashmap and NOTHING is
  * a pointer key that is guaranteed to be never used (e.g., NULL).
  * To put an entry into the hashmap:
  * ```
  * hashmap_object2int_put(POINTER, VALUE);
  * ```
  * where POINTER is a pointer not equal to NOTHING and VALUE is an integer.
- * This will segfault if the hashmap is already at capacity.
+ * The hashmap grows if it already holds CAPACITY entries.
  *
  * To retrieve a value from the hashmap:
  * ```
  * int value = hashmap_object2int_get(POINTER);
  * ```
- * This will segfault if the entry is not in the hashmap.
+ * This will segfault if the entry is not in the hashmap. To test whether it is, use
+ * hashmap_object2int_find(POINTER), which returns NULL if it is not.
  *
  * See hashmap.h for documentation on how to declare other hashmap types.
  */
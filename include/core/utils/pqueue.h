@@ -72,6 +72,9 @@ typedef struct pqueue_t
     pqueue_eq_elem_f eqelem;    /**< callback to compare elements */
     pqueue_print_entry_f prt;   /**< callback to print elements */
     void **d;                   /**< The actual queue in binary heap form */
+    struct pqueue_calendar_t* calendar; /**< The buckets if this is a calendar queue, NULL otherwise */
+    struct pqueue_dary_heap_t* dary;    /**< The heap if this is a d-ary heap, NULL otherwise */
+    struct pqueue_level_t* level;       /**< The FIFOs if this is a level queue, NULL otherwise */
 } pqueue_t;
 
 /**
@@ -119,6 +122,17 @@ size_t pqueue_size(pqueue_t *q);
  */
 int pqueue_insert(pqueue_t *q, void *d);
 
+/**
+ * Insert several elements into the queue. When there are many elements
+ * compared to the size of the queue, this rebuilds the heap once rather than
+ * inserting the elements one by one.
+ * @param q the queue
+ * @param entries the elements
+ * @param n the number of elements
+ * @return 0 on success
+ */
+int pqueue_insert_all(pqueue_t *q, void **entries, size_t n);
+
 /**
  * Move an existing entry to a different priority.
  * @param q the queue
@@ -138,6 +152,18 @@ pqueue_change_priority(pqueue_t *q,
  */
 void *pqueue_pop(pqueue_t *q);
 
+/**
+ * Give the highest-ranking item of the queue a new priority that ranks no
+ * higher than its current one and restore the order of the queue. For heaps,
+ * this sifts the item down from the root in place, which is cheaper than
+ * popping it and inserting it again.
+ * @param q the queue, which must not be empty
+ * @param new_pri the new priority
+ * @param setpri the callback function to set the priority of the item
+ * @return the item
+ */
+void *pqueue_advance_head(pqueue_t *q, pqueue_pri_t new_pri, pqueue_set_pri_f setpri);
+
 /**
  * @brief Empty 'src' into 'dest'.
  *
@@ -175,6 +201,14 @@ void* pqueue_find_equal(pqueue_t *q, void *e, pqueue_pri_t max_priority);
  */
 int pqueue_remove(pqueue_t *q, void *e);
 
+/**
+ * Copy pointers to all entries of the queue, in no particular order, into
+ * 'out', which must have room for pqueue_size() entries.
+ * @param q the queue
+ * @param out the destination
+ */
+void pqueue_copy_entries(pqueue_t *q, void **out);
+
 /**
  * Access highest-ranking item without removing it.
  * @param q the queue
@@ -218,6 +252,7 @@ int in_no_particular_order(pqueue_pri_t thiz, pqueue_pri_t that);
 int event_matches(void* next, void* curr);
 int reaction_matches(void* next, void* curr);
 pqueue_pri_t get_event_time(void *a);
+void set_event_time(void *a, pqueue_pri_t pri);
 pqueue_pri_t get_reaction_index(void *a);
 size_t get_event_position(void *a);
 size_t get_reaction_position(void *a);
@@ -0,0 +1,76 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_calendar.h
+ * @brief A calendar queue that implements the pqueue_* interface.
+ *
+ * A calendar queue (R. Brown, "Calendar Queues: A Fast O(1) Priority Queue
+ * Implementation for the Simulation Event Set Problem", CACM 31(10), 1988)
+ * hashes each entry by its priority into one of a power-of-two number of
+ * buckets, each of which covers an interval of `width` priorities, with the
+ * buckets wrapping around like the days of a year. When priorities are spread
+ * roughly evenly, as for the times of timer and action events, insertion and
+ * removal of the highest-ranking entry take constant expected time. The number
+ * of buckets and their width adapt as the queue grows and shrinks.
+ *
+ * A queue created with pqueue_calendar_init() is used through the usual
+ * pqueue_* functions. Unlike a binary heap, it always ranks entries with smaller
+ * priorities higher, as in_reverse_order does, and it does not use the position
+ * callbacks. Entries with equal priorities are popped in insertion order.
+ */
+
+#ifndef PQUEUE_CALENDAR_H
+#define PQUEUE_CALENDAR_H
+
+#include "pqueue.h"
+
+/**
+ * Initialize a calendar queue.
+ * The arguments are those of pqueue_init().
+ * @return the handle or NULL for insufficient memory
+ */
+pqueue_t *
+pqueue_calendar_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt);
+
+// The following implement the pqueue_* functions of the same name for
+// calendar queues. They are called by those functions and should not be
+// called directly.
+void pqueue_calendar_free(pqueue_t *q);
+int pqueue_calendar_insert(pqueue_t *q, void *d);
+int pqueue_calendar_remove(pqueue_t *q, void *d);
+void* pqueue_calendar_pop(pqueue_t *q);
+void* pqueue_calendar_peek(pqueue_t *q);
+void* pqueue_calendar_find_equal_same_priority(pqueue_t *q, void *e);
+void* pqueue_calendar_find_equal(pqueue_t *q, void *e, pqueue_pri_t max_priority);
+void pqueue_calendar_copy_entries(pqueue_t *q, void **out);
+int pqueue_calendar_is_valid(pqueue_t *q);
+
+#endif /* PQUEUE_CALENDAR_H */
@@ -0,0 +1,76 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_dary.h
+ * @brief A d-ary heap that implements the pqueue_* interface.
+ *
+ * Where the binary heap of pqueue.c stores pointers to its entries and calls
+ * a callback to obtain a priority for every comparison, this heap stores each
+ * priority next to the pointer to its entry and compares priorities directly.
+ * Each node has LF_PQUEUE_ARITY (by default 4) children, which are adjacent in
+ * memory, so a large queue is shallower and moving an entry touches fewer
+ * cache lines.
+ *
+ * A queue created with pqueue_dary_init() is used through the usual pqueue_*
+ * functions. It always ranks entries with smaller priorities higher, as
+ * in_reverse_order does, and the priority of an entry must not change while
+ * it is in the queue, except through pqueue_advance_head().
+ */
+
+#ifndef PQUEUE_DARY_H
+#define PQUEUE_DARY_H
+
+#include "pqueue.h"
+
+/**
+ * Initialize a d-ary heap.
+ * The arguments are those of pqueue_init().
+ * @return the handle or NULL for insufficient memory
+ */
+pqueue_t *
+pqueue_dary_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt);
+
+// The following implement the pqueue_* functions of the same name for
+// d-ary heaps. They are called by those functions and should not be
+// called directly.
+void pqueue_dary_free(pqueue_t *q);
+int pqueue_dary_insert(pqueue_t *q, void *d);
+int pqueue_dary_insert_all(pqueue_t *q, void **entries, size_t n);
+int pqueue_dary_remove(pqueue_t *q, void *d);
+void* pqueue_dary_pop(pqueue_t *q);
+void* pqueue_dary_advance_head(pqueue_t *q, pqueue_pri_t new_pri, pqueue_set_pri_f setpri);
+void* pqueue_dary_peek(pqueue_t *q);
+void* pqueue_dary_find_equal_same_priority(pqueue_t *q, void *e);
+void* pqueue_dary_find_equal(pqueue_t *q, void *e, pqueue_pri_t max_priority);
+void pqueue_dary_copy_entries(pqueue_t *q, void **out);
+int pqueue_dary_is_valid(pqueue_t *q);
+
+#endif /* PQUEUE_DARY_H */
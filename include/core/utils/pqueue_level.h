@@ -0,0 +1,77 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file pqueue_level.h
+ * @brief A queue of FIFOs per level that implements the pqueue_* interface.
+ *
+ * The low LF_PQUEUE_LEVEL_BITS (16) bits of a priority are its level, as for
+ * the index of a reaction, and the other bits are its key. The queue keeps the
+ * entries whose key is its bucket key in one FIFO per level, together with a
+ * bitmap of the levels whose FIFOs are not empty, so that inserting and
+ * popping them takes constant time without a single comparison of priorities.
+ * The entries with other keys, such as those of reactions with deadlines, go
+ * into a d-ary heap, and pop compares the head of the heap with that of the
+ * lowest nonempty level. When no entry is in a FIFO, the key of the next entry
+ * inserted becomes the bucket key.
+ *
+ * A queue created with pqueue_level_init() is used through the usual pqueue_*
+ * functions. It always ranks entries with smaller priorities higher, as
+ * in_reverse_order does, and the priority of an entry must not change while
+ * it is in the queue. Entries in the same FIFO are popped in insertion order.
+ */
+
+#ifndef PQUEUE_LEVEL_H
+#define PQUEUE_LEVEL_H
+
+#include "pqueue.h"
+
+/**
+ * Initialize a level queue.
+ * The arguments are those of pqueue_init().
+ * @return the handle or NULL for insufficient memory
+ */
+pqueue_t *
+pqueue_level_init(size_t n,
+            pqueue_cmp_pri_f cmppri,
+            pqueue_get_pri_f getpri,
+            pqueue_get_pos_f getpos,
+            pqueue_set_pos_f setpos,
+            pqueue_eq_elem_f eqelem,
+            pqueue_print_entry_f prt);
+
+// The following implement the pqueue_* functions of the same name for
+// level queues. They are called by those functions and should not be
+// called directly.
+void pqueue_level_free(pqueue_t *q);
+int pqueue_level_insert(pqueue_t *q, void *d);
+int pqueue_level_remove(pqueue_t *q, void *d);
+void* pqueue_level_pop(pqueue_t *q);
+void* pqueue_level_peek(pqueue_t *q);
+void* pqueue_level_find_equal_same_priority(pqueue_t *q, void *e);
+void* pqueue_level_find_equal(pqueue_t *q, void *e, pqueue_pri_t max_priority);
+void pqueue_level_copy_entries(pqueue_t *q, void **out);
+int pqueue_level_is_valid(pqueue_t *q);
+
+#endif /* PQUEUE_LEVEL_H */
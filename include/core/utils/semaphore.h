@@ -38,11 +38,20 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif // NUMBER_OF_WORKERS
 
 #include "platform.h"
+#include <stdbool.h>
 #include <stdlib.h>
 
+/**
+ * A counting semaphore whose count is changed with atomic operations, so that
+ * acquiring and releasing do not take a lock while the count is non-zero.
+ * Threads that find the count at zero sleep, on Linux in a futex on the count
+ * itself and elsewhere on the condition variable. Releasing wakes sleepers
+ * only if there are any, with a single futex wake for up to the released count.
+ */
 typedef struct {
-    int count;
-    lf_mutex_t mutex;
+    volatile int count;
+    volatile int waiters; // The number of threads that sleep or are about to.
+    lf_mutex_t mutex;     // Only used for sleeping on platforms other than Linux.
     lf_cond_t cond;
 } lf_semaphore_t;
 
@@ -69,6 +78,27 @@ void lf_semaphore_release(lf_semaphore_t* semaphore, int i);
  */
 void lf_semaphore_acquire(lf_semaphore_t* semaphore);
 
+/**
+ * @brief Acquire the 'semaphore' if its count is not 0. Never blocks.
+ *
+ * @param semaphore Instance of a semaphore.
+ * @return true if the semaphore was acquired.
+ */
+bool lf_semaphore_try_acquire(lf_semaphore_t* semaphore);
+
+/**
+ * @brief Busy-wait for up to 'spins' iterations for the 'semaphore' to be
+ * released and acquire it if it is.
+ *
+ * The count is only read until it looks non-zero, so spinning does not
+ * contend with threads that release the semaphore.
+ *
+ * @param semaphore Instance of a semaphore.
+ * @param spins The maximum number of iterations to spin.
+ * @return true if the semaphore was acquired, false if the spin budget ran out.
+ */
+bool lf_semaphore_spin_acquire(lf_semaphore_t* semaphore, unsigned int spins);
+
 /**
  * @brief Wait on the 'semaphore' if count is 0.
  *
@@ -77,6 +77,13 @@ typedef struct lf_stat_ll {
  */
 #define LF_LEVEL(index) (index & 0xffffLL)
 
+/**
+ * The deadline part of a reaction index. The upper 48 bits of the index
+ * hold the inferred deadline of the reaction, so a reaction whose index has
+ * a smaller deadline part has an earlier deadline.
+ */
+#define LF_INDEX_DEADLINE(index) ((index) >> 16)
+
 /** Utility for finding the maximum of two values. */
 #ifndef LF_MAX
 #define LF_MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
@@ -123,6 +130,59 @@ extern int _lf_my_fed_id;
  */
 int lf_fed_id(void);
 
+/** The maximum number of arguments of a message logged in binary. */
+#define LF_BINARY_LOG_MAX_ARGS 16
+
+/**
+ * A site in the code that logs messages with LF_PRINT_LOG or LF_PRINT_DEBUG
+ * when LF_BINARY_LOGGING is defined. Each site is a static variable, so the
+ * format of its messages has to be a string literal.
+ * format, file, line, level: Where the site is and what it logs.
+ * id: The number of the site in the binary log, assigned when it first logs.
+ * num_args, kinds: The arguments that the format consumes, found when the site first logs.
+ */
+typedef struct lf_log_site_t {
+    const char* format;
+    const char* file;
+    int line;
+    int level;
+    volatile int id;
+    int num_args;
+    unsigned char kinds[LF_BINARY_LOG_MAX_ARGS];
+} lf_log_site_t;
+
+/**
+ * The file that messages logged in binary are appended to. This can be set with
+ * the --binary-log command-line option.
+ */
+extern const char* _lf_binary_log_file;
+
+/**
+ * Record a message of the specified site in the binary log. Rather than
+ * rendering the message, this records the time and the raw arguments into a
+ * buffer of the calling thread, which is appended to the binary log when it
+ * is full and at exit. The first message of a site also records its format,
+ * so that util/tracing/binary_log_to_text can render the messages offline.
+ * Strings are copied up to a length of 255 bytes.
+ * @param site The site.
+ */
+void _lf_binary_log(lf_log_site_t* site, ...);
+
+/** Write the messages buffered for the binary log of all threads to the log. */
+void lf_flush_binary_log(void);
+
+/**
+ * Log a message in binary at the specified level, which is eliminated at
+ * compile time if LOG_LEVEL is lower.
+ */
+#define _LF_BINARY_LOG(level, format, ...) \
+            do { if(LOG_LEVEL >= level) { \
+                    static lf_log_site_t _lf_log_site = {format, __FILE__, __LINE__, level}; \
+                    _lf_binary_log(&_lf_log_site, ##__VA_ARGS__); \
+                    /* Let the compiler check the arguments against the format. */ \
+                    if (0) lf_print_log(format, ##__VA_ARGS__); \
+                } } while (0)
+
 /**
  * Report an informational message on stdout with
  * a newline appended at the end.
@@ -170,10 +230,14 @@ void lf_vprint_log(const char* format, va_list args) ATTRIBUTE_FORMAT_PRINTF(1,
  * (e.g., -O2 for gcc) is used as long as the arguments passed to
  * it do not themselves incur significant overhead to evaluate.
  */
+#if defined(LF_BINARY_LOGGING)
+#define LF_PRINT_LOG(format, ...) _LF_BINARY_LOG(LOG_LEVEL_LOG, format, ##__VA_ARGS__)
+#else
 #define LF_PRINT_LOG(format, ...) \
             do { if(LOG_LEVEL >= LOG_LEVEL_LOG) { \
                     lf_print_log(format, ##__VA_ARGS__); \
                 } } while (0)
+#endif
 
 /**
  * Report an debug message on stdout with the prefix
@@ -206,10 +270,14 @@ void lf_vprint_debug(const char* format, va_list args) ATTRIBUTE_FORMAT_PRINTF(1
  * (e.g., -O2 for gcc) is used as long as the arguments passed to
  * it do not themselves incur significant overhead to evaluate.
  */
+#if defined(LF_BINARY_LOGGING)
+#define LF_PRINT_DEBUG(format, ...) _LF_BINARY_LOG(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
 #define LF_PRINT_DEBUG(format, ...) \
             do { if(LOG_LEVEL >= LOG_LEVEL_DEBUG) { \
                     lf_print_debug(format, ##__VA_ARGS__); \
                 } } while (0)
+#endif
 
 /**
  * Print the error defined by the errno variable with the
@@ -258,6 +326,16 @@ void lf_assert(bool condition, const char* format, ...) ATTRIBUTE_FORMAT_PRINTF(
 void lf_vprint_error_and_exit(const char* format, va_list args)
 		ATTRIBUTE_FORMAT_PRINTF(1, 0);
 
+/**
+ * Write out the messages that are waiting to be written. With LF_ASYNC_LOGGING in
+ * the threaded runtime, messages other than errors and warnings are rendered into
+ * a buffer of the calling thread and written out by a background thread, and
+ * messages that do not fit into a full buffer are dropped and counted. Errors and
+ * warnings are written synchronously after the waiting messages, and this is also
+ * called at exit. Otherwise, this only flushes stdout.
+ */
+void lf_flush_log(void);
+
 /**
  * Message print function type. The arguments passed to one of
  * these print functions are a printf-style format string followed
@@ -25,7 +25,7 @@ typedef struct vector_t {
 /**
  * Allocate and initialize a new vector.
  * @param initial_capacity The desired initial capacity to allocate.
- *  Must be more than 0
+ *  If it is 0, nothing is allocated until the first element is added.
  */
 vector_t vector_new(size_t initial_capacity);
 
@@ -52,6 +52,31 @@ void vector_push(vector_t* v, void* element);
  */
 void vector_pushall(vector_t* v, void** array, size_t size);
 
+/**
+ * Add all elements of the given array to the vector, which may include
+ * null elements. If the vector has to grow, its capacity at least doubles,
+ * so that repeated calls take amortized constant time per element.
+ * @param v A vector that is to grow.
+ * @param array An array of items to be added to the vector.
+ * @param size The size of the given array.
+ */
+void vector_extend(vector_t* v, void** array, size_t size);
+
+/**
+ * Make sure that the vector can hold the given number of elements without
+ * allocating memory. This does not change its size.
+ * @param v Any vector.
+ * @param capacity The number of elements.
+ */
+void vector_reserve(vector_t* v, size_t capacity);
+
+/**
+ * Remove all elements from the vector, keeping its memory so that it can be
+ * filled again without allocating.
+ * @param v Any vector.
+ */
+void vector_clear(vector_t* v);
+
 /**
  * Remove and return some pointer that is contained in the given vector,
  * or return NULL if the given vector is empty.
@@ -178,6 +178,43 @@ trigger_handle_t lf_schedule_value(void* action, interval_t extra_delay, void* v
 }
 
 
+/**
+ * Schedule several actions at once, each with a token as a payload.
+ * See lf_schedule_batch() in api.h for details.
+ *
+ * @param requests The actions to schedule with their delays and tokens.
+ * @param count The number of requests.
+ * @param handles An array of at least count entries that receives the
+ *  handle returned for each request, or NULL if the handles are not needed.
+ * @return The number of requests for which an error (-1) was returned.
+ */
+int lf_schedule_batch(lf_schedule_request_t* requests, size_t count, trigger_handle_t* handles) {
+    return _lf_schedule_batch(requests, count, handles);
+}
+
+/**
+ * Bound the number of events of a physical action that may be queued at once.
+ * See lf_set_action_bound() in api.h for details.
+ *
+ * @param action The physical action.
+ * @param max_queued The bound, or 0 to remove it.
+ * @param policy What a schedule that would exceed the bound does.
+ * @return 0 on success, or -1 if the action is not physical.
+ */
+int lf_set_action_bound(void* action, size_t max_queued, lf_overflow_policy_t policy) {
+    return _lf_set_action_bound((lf_action_base_t*)action, max_queued, policy);
+}
+
+/**
+ * Store how often schedules of a physical action have hit its bound.
+ *
+ * @param action The physical action.
+ * @param stats The place to store the statistics.
+ */
+void lf_get_overflow_stats(void* action, lf_overflow_stats_t* stats) {
+    _lf_get_overflow_stats((lf_action_base_t*)action, stats);
+}
+
 /**
  * Check the deadline of the currently executing reaction against the
  * current physical time. If the deadline has passed, invoke the deadline
@@ -199,3 +236,28 @@ bool lf_check_deadline(void* self, bool invoke_deadline_handler) {
     }
     return false;
 }
+
+/**
+ * Execute a loop in chunks, some of which idle workers may take on.
+ * See lf_parallel_for() in api.h for details.
+ *
+ * @param self The self struct of the reactor.
+ * @param count The number of iterations.
+ * @param grain The number of iterations per chunk, or 0 for a default.
+ * @param body The function that executes a range of iterations.
+ * @param arg The argument to pass to the body.
+ */
+void lf_parallel_for(void* self, size_t count, size_t grain, lf_parallel_body_t body, void* arg) {
+    _lf_parallel_for(((self_base_t*)self)->environment, count, grain, body, arg);
+}
+
+/**
+ * Allocate memory that remains valid until the end of the current tag.
+ * See lf_scratch_alloc() in api.h for details.
+ *
+ * @param self The self struct of the reactor.
+ * @param size The number of bytes to allocate.
+ */
+void* lf_scratch_alloc(void* self, size_t size) {
+    return _lf_scratch_alloc(((self_base_t*)self)->environment, size);
+}
@@ -40,7 +40,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "python_capsule_extension.h"
 #include "lf_types.h"
 
-extern PyTypeObject py_action_capsule_t;
+extern PyType_Spec py_action_capsule_spec;
 
 /**
  * The struct used to instantiate an action.
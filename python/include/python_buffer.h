@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Transfer of Python objects that support the buffer protocol without pickling.
+ *
+ * Values of ports that carry objects supporting the buffer protocol, such as NumPy
+ * arrays, memoryviews, and bytes, can be sent between federates (or copied between
+ * interpreters) as raw data with a small header that describes their shape and element
+ * format, instead of being pickled. The receiving side gets a memoryview over the data
+ * of the message itself, with the same shape and format, so that `numpy.asarray()` on
+ * it does not copy either.
+ *
+ * The message consists of a header, whose integers are little endian, followed by the
+ * data in C order, aligned to PY_BUFFER_ALIGNMENT bytes from the start of the message:
+ * - The bytes 'L', 'F', 'P', 'B'.
+ * - The number of dimensions (4 bytes).
+ * - The length of the format string (4 bytes), excluding its terminating null byte.
+ * - The offset of the data from the start of the message (4 bytes).
+ * - The size of an element in bytes (8 bytes).
+ * - The size of each dimension in elements (8 bytes each).
+ * - The format string, as given by the struct module, and a null byte.
+ * The elements are in the byte order of the sender unless the format says otherwise.
+ */
+
+#ifndef PYTHON_BUFFER_H
+#define PYTHON_BUFFER_H
+
+#include <Python.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The alignment of the data in a message, which suffices for any element type. */
+#define PY_BUFFER_ALIGNMENT 16
+
+extern PyType_Spec py_buffer_spec;
+
+/**
+ * Return true if the specified value can be serialized by py_buffer_serialize(),
+ * that is, if it supports the buffer protocol.
+ * @param value The value.
+ */
+bool py_buffer_check(PyObject* value);
+
+/**
+ * Serialize the specified value, which supports the buffer protocol, into a new message
+ * allocated with malloc(). This copies the data once, into the message, making it
+ * contiguous if it is not. The calling thread must hold the GIL.
+ * @param value The value.
+ * @param length Where to store the length of the message in bytes.
+ * @return The message, or NULL with a Python exception set if the value does not support
+ *  the buffer protocol or memory cannot be allocated.
+ */
+unsigned char* py_buffer_serialize(PyObject* value, size_t* length);
+
+/**
+ * Return a memoryview over the data of the specified message, which was created by
+ * py_buffer_serialize(), with the shape and format of the serialized value. The data is
+ * not copied. The memoryview takes ownership of the message, which must have been allocated
+ * with malloc() and which is freed when the memoryview and the objects viewing its data
+ * have been collected. Messages received by federates of the Python target are allocated
+ * that way, and the runtime does not free them unless the network input action has a
+ * destructor. The calling thread must hold the GIL.
+ * @param message The message, which is freed even if this fails.
+ * @param length The length of the message in bytes.
+ * @return A new reference, or NULL with a Python exception set if the message is malformed.
+ */
+PyObject* py_buffer_deserialize(unsigned char* message, size_t length);
+
+/**
+ * Return a writable memoryview of bytes over the specified message, without copying it.
+ * As with py_buffer_deserialize(), the memoryview takes ownership of the message.
+ * @param message The message, which is freed even if this fails.
+ * @param length The length of the message in bytes.
+ * @return A new reference, or NULL with a Python exception set.
+ */
+PyObject* py_buffer_wrap(unsigned char* message, size_t length);
+
+/** Write the specified value into 8 bytes of the specified buffer in little-endian order. */
+void py_buffer_encode_uint64(uint64_t value, unsigned char* buffer);
+
+/** Read a value from 8 bytes of the specified buffer in little-endian order. */
+uint64_t py_buffer_extract_uint64(const unsigned char* buffer);
+
+#endif // PYTHON_BUFFER_H
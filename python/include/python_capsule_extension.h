@@ -40,17 +40,19 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     tag_t intended_tag; \
     instant_t physical_time_of_arrival;
 
-#define FEDERATED_CAPSULE_EXTENSION \
-    py_tag_t* intended_tag; \
-    instant_t physical_time_of_arrival;
+// The intended tag is copied as a tag_t, and the Tag object is only created
+// when Python code accesses it.
+#define FEDERATED_CAPSULE_EXTENSION FEDERATED_GENERIC_EXTENSION
 
 #define FEDERATED_CAPSULE_MEMBER \
-    {"intended_tag", T_OBJECT, offsetof(generic_port_capsule_struct, intended_tag), READONLY, "Original intended tag of the event."}, \
     {"physical_time_of_arrival", T_LONG, offsetof(generic_port_capsule_struct, physical_time_of_arrival), READONLY, "Physical time of arrival of the original message."},
 
+#define FEDERATED_CAPSULE_GETSET \
+    {"intended_tag", (getter) py_port_capsule_get_intended_tag, NULL, "Original intended tag of the event.", NULL},
+
 #define FEDERATED_ASSIGN_FIELDS(py_port, c_port) \
 do { \
-    py_port->intended_tag = convert_C_tag_to_py(c_port->intended_tag); \
+    py_port->intended_tag = c_port->intended_tag; \
     py_port->physical_time_of_arrival = c_port->physical_time_of_arrival; \
 } while(0)
 
@@ -63,6 +65,8 @@ do { \
 #define FEDERATED_CAPSULE_MEMBER \
     {"physical_time_of_arrival", T_INT, offsetof(generic_port_capsule_struct, physical_time_of_arrival), READONLY, "Physical time of arrival of the original message."},
 
+#define FEDERATED_CAPSULE_GETSET // Empty
+
 #define FEDERATED_ASSIGN_FIELDS(py_port, c_port) \
 do { \
     py_port->physical_time_of_arrival = c_port->physical_time_of_arrival; \
@@ -72,6 +76,7 @@ do { \
 #define FEDERATED_GENERIC_EXTENSION // Empty
 #define FEDERATED_CAPSULE_EXTENSION // Empty
 #define FEDERATED_CAPSULE_MEMBER // Empty
+#define FEDERATED_CAPSULE_GETSET // Empty
 #define FEDERATED_ASSIGN_FIELDS(py_port, c_port) // Empty
 #define FEDERATED_COPY_FIELDS(py_port1, py_port2) // Empty
 #endif // FEDERATED
@@ -43,7 +43,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "port.h"
 #include "python_action.h"
 
-extern PyTypeObject py_port_capsule_t;
+extern PyType_Spec py_port_capsule_spec;
 
 /**
  * The struct used to instantiate a port in Lingua Franca. This is used
@@ -71,7 +71,7 @@ typedef struct {
  * This template is used as a blueprint to create
  * Python objects that follow the same structure.
  * The resulting Python object will have the type
- * py_port_capsule_t in C (LinguaFranca.port_capsule in Python).
+ * py_interpreter_state()->port_capsule_type in C (LinguaFranca.port_capsule in Python).
  *
  * port: A PyCapsule (https://docs.python.org/3/c-api/capsule.html)
  *       that safely holds a C void* inside a Python object. This capsule
@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Pluggable serialization of the values of Python ports into messages.
+ *
+ * Values sent to other federates, or copied between interpreters, are serialized by
+ * py_serialize() and deserialized by py_deserialize(), which use the serializer of the
+ * calling interpreter and record the time they take in the trace (see
+ * tracepoint_serialization()). The default serializer uses pickle with protocol 5,
+ * whose out-of-band buffers carry the data of objects such as NumPy arrays without
+ * copying it into the pickle. Other serializers can be plugged in from C with
+ * py_use_serializer() or from Python with set_serializer().
+ */
+
+#ifndef PYTHON_SERIALIZATION_H
+#define PYTHON_SERIALIZATION_H
+
+#include <Python.h>
+#include <stddef.h>
+
+/**
+ * A serializer of Python values into messages.
+ * name: The name of the serializer, which set_serializer() accepts.
+ * serialize: Serialize a value into a new message allocated with malloc(), storing its
+ *  length into the second argument. Return NULL with a Python exception set on failure.
+ * deserialize: Deserialize a message created by serialize() into a new reference,
+ *  taking ownership of the message, even on failure, which returns NULL with a Python
+ *  exception set.
+ */
+typedef struct py_serializer_t {
+    const char* name;
+    unsigned char* (*serialize)(PyObject* value, size_t* length);
+    PyObject* (*deserialize)(unsigned char* message, size_t length);
+} py_serializer_t;
+
+/**
+ * The state of serialization in an interpreter, which is part of py_interpreter_state_t.
+ * serializer: The serializer in use, or NULL for py_pickle_serializer.
+ * pickle_dumps, pickle_loads: pickle.dumps and pickle.loads, looked up upon first use.
+ * pickle_protocol: The protocol given to pickle.dumps.
+ * pickle_buffers: A list reused to collect the out-of-band buffers of a value.
+ * pickle_buffer_callback: The append method of pickle_buffers.
+ * dumps_kwnames, loads_kwnames: The names of the keyword arguments of the calls.
+ * custom_dumps, custom_loads: The functions given to set_serializer(), if any.
+ */
+typedef struct {
+    const py_serializer_t* serializer;
+    PyObject* pickle_dumps;
+    PyObject* pickle_loads;
+    PyObject* pickle_protocol;
+    PyObject* pickle_buffers;
+    PyObject* pickle_buffer_callback;
+    PyObject* dumps_kwnames;
+    PyObject* loads_kwnames;
+    PyObject* custom_dumps;
+    PyObject* custom_loads;
+} py_serialization_state_t;
+
+/**
+ * Serializer that uses pickle with protocol 5. The message consists of the number of
+ * out-of-band buffers, the length of the pickle, and the length of each buffer, each
+ * as 8 bytes in little-endian order, followed by the pickle and the buffers, each
+ * of them aligned to PY_BUFFER_ALIGNMENT bytes. The deserialized value views the
+ * buffers in the message without copying them.
+ */
+extern const py_serializer_t py_pickle_serializer;
+
+/**
+ * Serializer of values that support the buffer protocol only, which become memoryviews
+ * when deserialized (@see py_buffer_serialize).
+ */
+extern const py_serializer_t py_buffer_serializer;
+
+/**
+ * Use the specified serializer in the interpreter of the calling thread, which must
+ * hold its GIL. All federates must use the same serializer for a connection.
+ * @param serializer The serializer, or NULL for py_pickle_serializer.
+ */
+void py_use_serializer(const py_serializer_t* serializer);
+
+/**
+ * Serialize the specified value with the serializer of the interpreter of the calling
+ * thread, which must hold its GIL.
+ * @param value The value.
+ * @param length Where to store the length of the message in bytes.
+ * @return A new message allocated with malloc(), or NULL with a Python exception set.
+ */
+unsigned char* py_serialize(PyObject* value, size_t* length);
+
+/**
+ * Deserialize the specified message with the serializer of the interpreter of the
+ * calling thread, which must hold its GIL.
+ * @param message The message, allocated with malloc(), which this takes ownership of.
+ * @param length The length of the message in bytes.
+ * @return A new reference, or NULL with a Python exception set.
+ */
+PyObject* py_deserialize(unsigned char* message, size_t length);
+
+/**
+ * Set the serializer of the interpreter from Python. This function is callable in
+ * Python as set_serializer(name) with the name of a serializer, "pickle" or "buffer",
+ * as set_serializer(dumps, loads) with two functions, of which dumps returns a
+ * bytes-like object and loads is given a memoryview, or as set_serializer() to
+ * restore the default.
+ */
+PyObject* py_set_serializer(PyObject* self, PyObject* args);
+
+#endif // PYTHON_SERIALIZATION_H
@@ -35,7 +35,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <structmember.h>
 #include "tag.h"
 
-extern PyTypeObject PyTagType;
+extern PyType_Spec py_tag_spec;
 
 /**
  * Python wrapper for the tag_t struct in the C target.
@@ -54,6 +54,6 @@ typedef struct {
 py_tag_t* convert_C_tag_to_py(tag_t c_tag);
 
 PyObject* py_lf_tag(PyObject *self, PyObject *args);
-PyObject* py_tag_compare(PyObject *self, PyObject *args);
+PyObject* py_tag_compare(PyObject *self, PyObject *const *args, Py_ssize_t nargs);
 
 #endif
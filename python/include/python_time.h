@@ -38,7 +38,5 @@ PyObject* py_lf_time_physical(PyObject *self, PyObject *args);
 PyObject* py_lf_time_physical_elapsed(PyObject *self, PyObject *args);
 PyObject* py_lf_time_start(PyObject *self, PyObject *args);
 
-extern PyTypeObject PyTimeType;
-
 extern PyMethodDef PyTimeTypeMethods[];
-extern PyTypeObject PyTimeType;
+extern PyType_Spec py_time_spec;
@@ -38,6 +38,18 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * APIs which interact with the internal _lf_SET and _lf_schedule APIs. This file can act as a
  * template for future runtime developement for target languages.
  * For source generation, see xtext/org.icyphy.linguafranca/src/org/icyphy/generator/PythonGenerator.xtend.
+ *
+ * The runtime also supports free-threaded interpreters (Python 3.13 or later built without
+ * the GIL, which defines Py_GIL_DISABLED). There, PyGILState_Ensure() only attaches a worker
+ * to the interpreter, so reactions that the scheduler runs in parallel also run in parallel
+ * in Python.
+ *
+ * Alternatively, with LF_PYTHON_SUBINTERPRETERS defined (Python 3.12 or later), each environment
+ * (enclave) other than the top-level one runs its reactions in its own sub-interpreter, which
+ * has its own GIL (PEP 684), so that enclaves execute Python code in parallel. Each interpreter
+ * has its own instance of this module, its own types, and its own copy of the generated Python
+ * module (see py_interpreter_state_t). Python objects belong to the interpreter that created
+ * them and must not be passed between enclaves other than in serialized form.
  */
 
 #ifndef PYTHON_TARGET_H
@@ -52,6 +64,21 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "python_tag.h"
 #include "python_port.h"
 #include "python_action.h"
+#include "python_buffer.h"
+#include "python_serialization.h"
+
+/*
+ * Critical sections on a Python object, which guard the fields of capsules that
+ * can be used by more than one thread at a time with a free-threaded interpreter.
+ * With the GIL, they do nothing.
+ */
+#if PY_VERSION_HEX >= 0x030D0000
+#define LF_PY_BEGIN_CRITICAL_SECTION(op) Py_BEGIN_CRITICAL_SECTION(op)
+#define LF_PY_END_CRITICAL_SECTION() Py_END_CRITICAL_SECTION()
+#else
+#define LF_PY_BEGIN_CRITICAL_SECTION(op) {
+#define LF_PY_END_CRITICAL_SECTION() }
+#endif
 
 #ifdef _MSC_VER
 #ifndef PATH_MAX
@@ -71,11 +98,121 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 ////////////// Global variables ///////////////
-extern PyObject *globalPythonModule;
-extern PyObject *globalPythonModuleDict;
-extern PyObject* global_pickler;
+/**
+ * A map from the C ports and actions given to reactions to their capsules,
+ * which are created upon first use and updated in place afterwards
+ * (@see convert_C_port_to_py). The map holds a reference to each capsule.
+ * It uses open addressing with linear probing and never removes entries,
+ * since ports and actions exist until the end of the program.
+ */
+typedef struct {
+    const void** keys;
+    PyObject** capsules;
+    size_t capacity; // Zero or a power of two
+    size_t size;
+#ifdef Py_GIL_DISABLED
+    PyMutex mutex;
+#endif
+} py_capsule_cache_t;
+
+/**
+ * The state of the runtime in a Python interpreter, which is the main interpreter
+ * unless LF_PYTHON_SUBINTERPRETERS is defined.
+ * interpreter: The interpreter, or NULL for the main interpreter.
+ * env: The environment whose reactions are executed in this interpreter.
+ * module, module_dict: The generated Python module and its dictionary.
+ * pickler: The pickle module, used to serialize values (@see python_serialization.h).
+ * *_type: The types defined by this module in the interpreter.
+ * capsules: The capsules of the ports and actions used in the interpreter.
+ * serialization: The serializer of the values of ports and its state.
+ * current_tag: The Tag object last returned by lf.tag(), which is shared by the calls
+ *  at the same tag (@see py_lf_tag).
+ * deferred_references: The references released by threads without the GIL, which
+ *  the next thread to acquire the GIL releases (@see py_release_reference()).
+ */
+typedef struct {
+    PyInterpreterState* interpreter;
+    environment_t* env;
+    PyObject* module;
+    PyObject* module_dict;
+    PyObject* pickler;
+    PyTypeObject* port_capsule_type;
+    PyTypeObject* action_capsule_type;
+    PyTypeObject* tag_type;
+    PyTypeObject* time_type;
+    PyTypeObject* mode_capsule_type;
+    PyTypeObject* buffer_type;
+    py_capsule_cache_t capsules;
+    py_serialization_state_t serialization;
+    py_tag_t* current_tag;
+    void* volatile deferred_references;
+} py_interpreter_state_t;
+
+/**
+ * Return the state of the runtime in the interpreter of the calling thread.
+ * The calling thread must hold the GIL of an interpreter.
+ */
+py_interpreter_state_t* py_interpreter_state(void);
+
+// The state of the interpreter under the names used by generated code.
+#define globalPythonModule (py_interpreter_state()->module)
+#define globalPythonModuleDict (py_interpreter_state()->module_dict)
+#define global_pickler (py_interpreter_state()->pickler)
+
 extern environment_t* top_level_environment;
 
+/**
+ * Release a reference to the specified object, which the runtime held, for example
+ * in a token. The calling thread need not hold the GIL, for workers free the tokens of
+ * a tag without it. If it does not, the reference is released when a thread next
+ * acquires the GIL of the interpreter that owns the object.
+ * @param object The object, or NULL.
+ */
+void py_release_reference(PyObject* object);
+
+#if defined(LF_SINGLE_THREADED) || defined(Py_GIL_DISABLED)
+#undef LF_PYTHON_GIL_TIME_SLICE
+#endif
+
+/**
+ * The state returned by py_acquire_interpreter(), to be given back to py_release_interpreter().
+ */
+typedef struct {
+    PyGILState_STATE gstate;
+    PyThreadState* tstate;
+#ifdef LF_PYTHON_GIL_TIME_SLICE
+    py_interpreter_state_t* interpreter; // The interpreter whose GIL was acquired.
+    bool kept;                           // Whether the calling thread already held the GIL.
+#endif
+#ifdef LF_TRACE
+    environment_t* env;                  // The environment in whose trace the call is recorded.
+#endif
+} py_gil_state_t;
+
+/**
+ * Attach the calling thread to the interpreter that executes the reactions of the specified
+ * environment and acquire its GIL. Without LF_PYTHON_SUBINTERPRETERS, this is the same as
+ * PyGILState_Ensure(). Otherwise, the calling thread must not be attached to an interpreter
+ * for environments other than the top-level one.
+ * @param env The environment, or NULL for the top-level one.
+ * @return The state to give to py_release_interpreter().
+ */
+py_gil_state_t py_acquire_interpreter(environment_t* env);
+
+/**
+ * Release the GIL acquired by py_acquire_interpreter() and detach the calling thread.
+ *
+ * With LF_PYTHON_GIL_TIME_SLICE set to a duration in nanoseconds, a worker thread keeps
+ * the GIL instead, so that the next Python reaction that it executes in the same
+ * interpreter does not have to acquire it again. The worker releases the GIL once it has
+ * kept it for that long, before it blocks waiting for work (see lf_thread_release_hook),
+ * before it executes a reaction in another interpreter, and when it exits. Other threads
+ * that need the GIL wait meanwhile, including Python threads of the program, so the slice
+ * bounds the latency that this adds to them. It has no effect without the GIL.
+ * @param state The value returned by py_acquire_interpreter().
+ */
+void py_release_interpreter(py_gil_state_t state);
+
 //////////////////////////////////////////////////////////////
 /////////////  schedule Functions (to schedule an action)
 /**
@@ -83,11 +220,25 @@ extern environment_t* top_level_environment;
  * with no payload (no value conveyed).
  * See schedule_token(), which this uses, for details.
  * @param self Pointer to the calling object.
- * @param args contains:
- *      - action: Pointer to an action on the self struct.
+ * @param args contains, with the vectorcall convention (METH_FASTCALL):
  *      - offset: The time offset over and above that in the action.
+ *      - value: The value (optional).
+ * @param nargs The number of arguments.
+ **/
+PyObject* py_schedule(PyObject *self, PyObject *const *args, Py_ssize_t nargs);
+
+/**
+ * Schedule an action once for each of a sequence of values, each with its own time
+ * offset or all with the same one, in one critical section.
+ * See lf_schedule_batch(), which this uses, for details.
+ * @param self Pointer to the calling object.
+ * @param args contains either:
+ *      - pairs: An iterable of (offset, value) pairs.
+ *      or:
+ *      - offsets: One offset or a sequence of them, one per value.
+ *      - values: A sequence of values, such as a list or a NumPy array.
  **/
-PyObject* py_schedule(PyObject *self, PyObject *args);
+PyObject* py_schedule_batch(PyObject *self, PyObject *args);
 
 /**
  * Schedule an action to occur with the specified value and time offset
@@ -126,6 +277,11 @@ PyObject* py_main(PyObject *self, PyObject *args);
  * For multiports, the value of the port_capsule (i.e., port.value) is always
  * set to None and is_present is set to false.
  * Individual ports can then later be accessed in Python code as port[idx].
+ *
+ * The port_capsule of a port is created the first time that the port is
+ * converted and then updated in place, so a reaction that keeps a reference
+ * to it sees its value at later tags.
+ * @return A new reference to the port_capsule.
  */
 PyObject* convert_C_port_to_py(void* port, int width);
 
@@ -150,6 +306,9 @@ PyObject* convert_C_port_to_py(void* port, int width);
  * capsule can then be treated as a PyObject* and safely passed through Python code. On the other end
  * (which is in schedule functions), PyCapsule_GetPointer(recieved_action,"action") can be called to retrieve
  * the void* pointer into recieved_action.
+ *
+ * As for ports, the capsule of an action is created once and then updated in place.
+ * @return A new reference to the action capsule.
  **/
 PyObject* convert_C_action_to_py(void* action);
 
@@ -168,11 +327,48 @@ PyObject* convert_C_action_to_py(void* action);
  *               be set to "__main__"
  * @param class The name of the list of classes in the generated Python code
  * @param instance_id The element number in the list of classes. class[instance_id] points to a class instance
- * @param func The reaction functino to be called
- * @param pArgs the PyList of arguments to be sent to function func()
+ * @param func The reaction function to be called
+ * @return A new reference to the function, or to None on error.
  */
 PyObject* get_python_function(string module, string class, int instance_id, string func);
 
+/**
+ * Like get_python_function(), but load the function in the interpreter of the specified
+ * environment (@see py_acquire_interpreter). The reaction must then be invoked in the same
+ * interpreter. In a sub-interpreter, the module "__main__" refers to the copy of the main
+ * script that the sub-interpreter has loaded.
+ * @param env The environment of the reactor, or NULL for the top-level one.
+ */
+PyObject* get_python_function_in_environment(environment_t* env, string module, string class,
+                                             int instance_id, string func);
+
+/**
+ * A function to load with get_python_functions().
+ * class, instance_id, func: The class list, the element in it, and the function,
+ *  as given to get_python_function().
+ * function: Where to store a new reference to the function, or to None on error.
+ */
+typedef struct {
+    string class;
+    int instance_id;
+    string func;
+    PyObject** function;
+} py_function_request_t;
+
+/**
+ * Load several functions at once from the specified module, for example the reactions
+ * of all reactor instances at startup. Unlike repeated calls of get_python_function(),
+ * this acquires the GIL once, looks up the class list once for consecutive requests of
+ * the same class, and creates the Python strings of the names once.
+ * @param env The environment of the reactors, or NULL for the top-level one
+ *  (@see get_python_function_in_environment()).
+ * @param module The Python module to load the functions from.
+ * @param requests The functions to load.
+ * @param count The number of requests.
+ * @return The number of functions that could not be loaded.
+ */
+size_t get_python_functions(environment_t* env, string module, py_function_request_t* requests, size_t count);
+
 /*
  * The Python runtime will call this function to initialize the module.
  * The name of this function is dynamically generated to follow
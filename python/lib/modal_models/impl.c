@@ -31,6 +31,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "modal_models/definitions.h"
+#include "pythontarget.h"
 #include "util.h"
 
 //////////// set Function /////////////
@@ -71,18 +72,25 @@ static PyMethodDef mode_capsule_methods[] = {
 };
 
 /*
- * The definition of mode_capsule type object, which is
+ * The slots of the mode_capsule type.
+ */
+static PyType_Slot mode_capsule_slots[] = {
+    {Py_tp_doc, (void*) "mode_capsule objects"},
+    {Py_tp_new, (void*) PyType_GenericNew},
+    {Py_tp_methods, (void*) mode_capsule_methods},
+    {0, NULL}
+};
+
+/*
+ * The specification of the mode_capsule type, which is
  * used to describe how mode_capsule behaves.
  */
-static PyTypeObject mode_capsule_t = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "LinguaFranca.mode_capsule",
-    .tp_doc = "mode_capsule objects",
-    .tp_basicsize = sizeof(mode_capsule_struct_t),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = PyType_GenericNew,
-    .tp_methods = mode_capsule_methods,
+static PyType_Spec mode_capsule_spec = {
+    .name = "LinguaFranca.mode_capsule",
+    .basicsize = sizeof(mode_capsule_struct_t),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = mode_capsule_slots,
 };
 
 
@@ -93,16 +101,17 @@ static PyTypeObject mode_capsule_t = {
  *
  */
 void initialize_mode_capsule_t(PyObject* current_module) {
-    // Initialize the mode_capsule type
-    if (PyType_Ready(&mode_capsule_t) < 0) {
+    // Create the mode_capsule type in the interpreter of the module
+    PyTypeObject* mode_capsule_t = (PyTypeObject*) PyType_FromSpec(&mode_capsule_spec);
+    if (mode_capsule_t == NULL) {
         return;
     }
+    py_interpreter_state()->mode_capsule_type = mode_capsule_t;
 
     // Add the mode_capsule type to the module's dictionary.
-    Py_INCREF(&mode_capsule_t);
-    if (PyModule_AddObject(current_module, "mode_capsule", (PyObject *) &mode_capsule_t) < 0) {
-        Py_DECREF(&mode_capsule_t);
-        Py_DECREF(current_module);
+    Py_INCREF(mode_capsule_t);
+    if (PyModule_AddObject(current_module, "mode_capsule", (PyObject *) mode_capsule_t) < 0) {
+        Py_DECREF(mode_capsule_t);
         return;
     }
 }
@@ -117,7 +126,7 @@ PyObject* convert_C_mode_to_py(
 ) {
     // Create the mode struct in Python
 	mode_capsule_struct_t* cap =
-        (mode_capsule_struct_t*)PyObject_New(mode_capsule_struct_t, &mode_capsule_t);
+        (mode_capsule_struct_t*)PyObject_New(mode_capsule_struct_t, py_interpreter_state()->mode_capsule_type);
     if (cap == NULL) {
         lf_print_error_and_exit("Failed to convert mode.");
     }
@@ -35,8 +35,6 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "python_action.h"
 
-PyTypeObject py_action_capsule_t;
-
 ///////////////// Functions used in action creation, initialization and deletion /////////////
 /**
  * Called when an action in Python is deallocated (generally
@@ -44,9 +42,12 @@ PyTypeObject py_action_capsule_t;
  * @param self
  */
 void py_action_capsule_dealloc(generic_action_capsule_struct *self) {
+    PyTypeObject* type = Py_TYPE(self);
     Py_XDECREF(self->action);
     Py_XDECREF(self->value);
-    Py_TYPE(self)->tp_free((PyObject *) self);
+    type->tp_free((PyObject *) self);
+    // Instances of heap types hold a reference to their type.
+    Py_DECREF(type);
 }
 
 /**
@@ -54,7 +55,7 @@ void py_action_capsule_dealloc(generic_action_capsule_struct *self) {
  * follows the same structure as the @see generic_action_capsule_struct.
  *
  * To initialize the action_capsule, this function first calls the tp_alloc
- * method of type py_action_capsule_t and then assign default values of NULL, NULL, 0
+ * method of the action_capsule type and then assign default values of NULL, NULL, 0
  * to the members of the generic_action_capsule_struct.
  */
 PyObject *py_action_capsule_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
@@ -126,24 +127,33 @@ PyMemberDef py_action_capsule_members[] = {
  * The function members of action capsule
  */
 PyMethodDef py_action_capsule_methods[] = {
-    {"schedule", (PyCFunction)py_schedule, METH_VARARGS, "Schedule the action with the given offset"},
+    {"schedule", (PyCFunction)(void(*)(void))py_schedule, METH_FASTCALL, "Schedule the action with the given offset"},
+    {"schedule_batch", (PyCFunction)py_schedule_batch, METH_VARARGS,
+        "Schedule the action once for each value, with one offset or one offset per value"},
     {NULL}  /* Sentinel */
 };
 
 /*
- * The definition of action_capsule type object.
+ * The slots of the action_capsule type.
+ */
+static PyType_Slot py_action_capsule_slots[] = {
+    {Py_tp_doc, (void*) "action_instance object"},
+    {Py_tp_new, (void*) py_action_capsule_new},
+    {Py_tp_init, (void*) py_action_capsule_init},
+    {Py_tp_dealloc, (void*) py_action_capsule_dealloc},
+    {Py_tp_members, (void*) py_action_capsule_members},
+    {Py_tp_methods, (void*) py_action_capsule_methods},
+    {0, NULL}
+};
+
+/*
+ * The specification of the action_capsule type.
  * Used to describe how an action_capsule behaves.
  */
-PyTypeObject py_action_capsule_t = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "LinguaFranca.action_instance",
-    .tp_doc = "action_instance object",
-    .tp_basicsize = sizeof(generic_action_capsule_struct),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = py_action_capsule_new,
-    .tp_init = (initproc) py_action_capsule_init,
-    .tp_dealloc = (destructor) py_action_capsule_dealloc,
-    .tp_members = py_action_capsule_members,
-    .tp_methods = py_action_capsule_methods,
+PyType_Spec py_action_capsule_spec = {
+    .name = "LinguaFranca.action_instance",
+    .basicsize = sizeof(generic_action_capsule_struct),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = py_action_capsule_slots,
 };
\ No newline at end of file
@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Implementation of functions defined in @see python_buffer.h
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_buffer.h"
+#include "pythontarget.h"
+
+/** The length of the part of the header that precedes the sizes of the dimensions. */
+#define PY_BUFFER_FIXED_HEADER_LENGTH 24
+
+/**
+ * The object that exports the data of a received message through the buffer protocol.
+ * The memoryview returned by py_buffer_deserialize() views it.
+ * message: The message, which this object frees.
+ * data: The data in the message.
+ * length: The length of the data in bytes.
+ * itemsize: The size of an element in bytes.
+ * ndim: The number of dimensions.
+ * format: The format of an element, which is in the message.
+ * shape: The size of each dimension in elements, followed by the strides in bytes.
+ */
+typedef struct {
+    PyObject_HEAD
+    unsigned char* message;
+    void* data;
+    Py_ssize_t length;
+    Py_ssize_t itemsize;
+    int ndim;
+    char* format;
+    Py_ssize_t* shape;
+} py_buffer_t;
+
+static void py_buffer_encode_uint32(uint32_t value, unsigned char* buffer) {
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+void py_buffer_encode_uint64(uint64_t value, unsigned char* buffer) {
+    for (int i = 0; i < 8; i++) {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint32_t py_buffer_extract_uint32(const unsigned char* buffer) {
+    uint32_t result = 0;
+    for (int i = 3; i >= 0; i--) {
+        result = (result << 8) | buffer[i];
+    }
+    return result;
+}
+
+uint64_t py_buffer_extract_uint64(const unsigned char* buffer) {
+    uint64_t result = 0;
+    for (int i = 7; i >= 0; i--) {
+        result = (result << 8) | buffer[i];
+    }
+    return result;
+}
+
+bool py_buffer_check(PyObject* value) {
+    return PyObject_CheckBuffer(value);
+}
+
+unsigned char* py_buffer_serialize(PyObject* value, size_t* length) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(value, &view, PyBUF_RECORDS_RO) < 0) {
+        return NULL;
+    }
+    const char* format = view.format != NULL ? view.format : "B";
+    size_t format_length = strlen(format);
+    size_t header_length = PY_BUFFER_FIXED_HEADER_LENGTH + 8 * (size_t)view.ndim + format_length + 1;
+    size_t offset = (header_length + PY_BUFFER_ALIGNMENT - 1) & ~(size_t)(PY_BUFFER_ALIGNMENT - 1);
+    unsigned char* message = (unsigned char*)malloc(offset + (size_t)view.len);
+    if (message == NULL) {
+        PyBuffer_Release(&view);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memcpy(message, "LFPB", 4);
+    py_buffer_encode_uint32((uint32_t)view.ndim, message + 4);
+    py_buffer_encode_uint32((uint32_t)format_length, message + 8);
+    py_buffer_encode_uint32((uint32_t)offset, message + 12);
+    py_buffer_encode_uint64((uint64_t)view.itemsize, message + 16);
+    for (int i = 0; i < view.ndim; i++) {
+        py_buffer_encode_uint64((uint64_t)view.shape[i], message + PY_BUFFER_FIXED_HEADER_LENGTH + 8 * i);
+    }
+    memcpy(message + header_length - format_length - 1, format, format_length + 1);
+    memset(message + header_length, 0, offset - header_length);
+
+    int result = 0;
+    if (PyBuffer_IsContiguous(&view, 'C')) {
+        memcpy(message + offset, view.buf, (size_t)view.len);
+    } else {
+        result = PyBuffer_ToContiguous(message + offset, &view, view.len, 'C');
+    }
+    *length = offset + (size_t)view.len;
+    PyBuffer_Release(&view);
+    if (result < 0) {
+        free(message);
+        return NULL;
+    }
+    return message;
+}
+
+PyObject* py_buffer_deserialize(unsigned char* message, size_t length) {
+    if (length < PY_BUFFER_FIXED_HEADER_LENGTH || memcmp(message, "LFPB", 4) != 0) {
+        free(message);
+        PyErr_SetString(PyExc_ValueError, "Not a serialized buffer.");
+        return NULL;
+    }
+    uint32_t ndim = py_buffer_extract_uint32(message + 4);
+    uint32_t format_length = py_buffer_extract_uint32(message + 8);
+    uint32_t offset = py_buffer_extract_uint32(message + 12);
+    uint64_t itemsize = py_buffer_extract_uint64(message + 16);
+    size_t header_length = PY_BUFFER_FIXED_HEADER_LENGTH + 8 * (size_t)ndim + (size_t)format_length + 1;
+    if (ndim > PyBUF_MAX_NDIM || itemsize == 0 || itemsize > PY_SSIZE_T_MAX
+            || header_length > offset || offset > length
+            || message[header_length - 1] != '\0') {
+        free(message);
+        PyErr_SetString(PyExc_ValueError, "Malformed header of a serialized buffer.");
+        return NULL;
+    }
+    // Check that the data has the length that the shape implies.
+    uint64_t elements = 1;
+    for (uint32_t i = 0; i < ndim; i++) {
+        uint64_t size = py_buffer_extract_uint64(message + PY_BUFFER_FIXED_HEADER_LENGTH + 8 * i);
+        if (size != 0 && elements > UINT64_MAX / size) {
+            elements = UINT64_MAX;
+            break;
+        }
+        elements *= size;
+    }
+    if (elements > (length - offset) / itemsize || elements * itemsize != length - offset) {
+        free(message);
+        PyErr_SetString(PyExc_ValueError, "The data of a serialized buffer does not match its shape.");
+        return NULL;
+    }
+
+    PyTypeObject* type = py_interpreter_state()->buffer_type;
+    py_buffer_t* self = (py_buffer_t*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        free(message);
+        return NULL;
+    }
+    self->message = message;
+    self->data = message + offset;
+    self->length = (Py_ssize_t)(length - offset);
+    self->itemsize = (Py_ssize_t)itemsize;
+    self->ndim = (int)ndim;
+    self->format = (char*)message + header_length - format_length - 1;
+    self->shape = NULL;
+    if (ndim > 0) {
+        self->shape = PyMem_Malloc(2 * ndim * sizeof(Py_ssize_t));
+        if (self->shape == NULL) {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+        // The strides of C order.
+        Py_ssize_t stride = self->itemsize;
+        for (int i = (int)ndim - 1; i >= 0; i--) {
+            self->shape[i] = (Py_ssize_t)py_buffer_extract_uint64(message + PY_BUFFER_FIXED_HEADER_LENGTH + 8 * i);
+            self->shape[ndim + i] = stride;
+            stride *= self->shape[i];
+        }
+    }
+    PyObject* result = PyMemoryView_FromObject((PyObject*)self);
+    Py_DECREF(self);
+    return result;
+}
+
+PyObject* py_buffer_wrap(unsigned char* message, size_t length) {
+    PyTypeObject* type = py_interpreter_state()->buffer_type;
+    py_buffer_t* self = (py_buffer_t*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        free(message);
+        return NULL;
+    }
+    self->message = message;
+    self->data = message;
+    self->length = (Py_ssize_t)length;
+    self->itemsize = 1;
+    self->ndim = 1;
+    self->format = "B";
+    self->shape = PyMem_Malloc(2 * sizeof(Py_ssize_t));
+    if (self->shape == NULL) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    self->shape[0] = self->length;
+    self->shape[1] = 1;
+    PyObject* result = PyMemoryView_FromObject((PyObject*)self);
+    Py_DECREF(self);
+    return result;
+}
+
+/**
+ * Export the data of the message through the buffer protocol.
+ * The data is writable, since the message belongs to the object.
+ */
+static int py_buffer_get_buffer(PyObject* obj, Py_buffer* view, int flags) {
+    py_buffer_t* self = (py_buffer_t*)obj;
+    view->buf = self->data;
+    view->obj = obj;
+    Py_INCREF(obj);
+    view->len = self->length;
+    view->readonly = 0;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->ndim = self->ndim;
+    view->shape = NULL;
+    view->strides = NULL;
+    if ((flags & PyBUF_ND) == PyBUF_ND) {
+        view->shape = self->shape;
+        if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES && self->shape != NULL) {
+            view->strides = self->shape + self->ndim;
+        }
+    } else {
+        // The consumer views the data as bytes.
+        view->ndim = 1;
+        view->itemsize = 1;
+    }
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void py_buffer_dealloc(py_buffer_t* self) {
+    PyTypeObject* type = Py_TYPE(self);
+    free(self->message);
+    PyMem_Free(self->shape);
+    type->tp_free((PyObject*)self);
+    // Instances of heap types hold a reference to their type.
+    Py_DECREF(type);
+}
+
+/**
+ * Slots of the buffer type.
+ **/
+static PyType_Slot py_buffer_slots[] = {
+    {Py_tp_doc, (void*) "The data of a message received without pickling"},
+    {Py_tp_dealloc, (void*) py_buffer_dealloc},
+    {Py_bf_getbuffer, (void*) py_buffer_get_buffer},
+    {0, NULL}
+};
+
+/**
+ * Specification of the buffer type.
+ **/
+PyType_Spec py_buffer_spec = {
+    .name = "LinguaFranca.buffer",
+    .basicsize = sizeof(py_buffer_t),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = py_buffer_slots,
+};
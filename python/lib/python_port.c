@@ -39,19 +39,31 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "api/api.h"
 #include "api/set.h"
 
-PyTypeObject py_port_capsule_t;
-
 //////////// destructor Function(s) /////////////
 /**
  * Decrease the reference count of PyObject. When the reference count hits zero,
- * Python can free its memory.
+ * Python can free its memory. This is the destructor of tokens, which may be freed
+ * by a thread that does not hold the GIL (@see py_release_reference()).
  * @param py_object A PyObject with count 1 or greater.
  */
 void python_count_decrement(void* py_object) {
-    Py_XDECREF((PyObject*)py_object);
+    py_release_reference((PyObject*)py_object);
 }
 
 //////////// set Function(s) /////////////
+/**
+ * Set the value of the specified C port, which becomes present, to a token that holds
+ * a reference to the specified value.
+ * @param port The C port, or a channel of a multiport.
+ * @param val The value.
+ */
+static void py_port_set_value(generic_port_instance_struct* port, PyObject* val) {
+    lf_token_t* token = lf_new_token((void*)port, val, 1);
+    lf_set_destructor(port, python_count_decrement);
+    lf_set_token(port, token);
+    Py_INCREF(val);
+}
+
 /**
  * Set the value and is_present field of self which is of type
  * LinguaFranca.port_capsule
@@ -77,17 +89,10 @@ void python_count_decrement(void* py_object) {
  * appropriately handling types on the recieveing end of this port.
  * @param self The output port (by name) or input of a contained
  *                 reactor in form instance_name.port_name.
- * @param args contains:
- *      - val: The value to insert into the port struct.
+ * @param val The value to insert into the port struct (METH_O).
  */
-PyObject* py_port_set(PyObject* self, PyObject* args) {
+PyObject* py_port_set(PyObject* self, PyObject* val) {
     generic_port_capsule_struct* p = (generic_port_capsule_struct*)self;
-    PyObject* val = NULL;
-
-    if (!PyArg_ParseTuple(args, "O", &val)) {
-        PyErr_SetString(PyExc_TypeError, "Could not set objects.");
-        return NULL;
-    }
 
     generic_port_instance_struct* port =
         PyCapsule_GetPointer(p->port, "port");
@@ -96,34 +101,178 @@ PyObject* py_port_set(PyObject* self, PyObject* args) {
         exit(1);
     }
 
+    // A port capsule can be used by more than one reaction.
+    LF_PY_BEGIN_CRITICAL_SECTION(self);
     if (val) {
         LF_PRINT_DEBUG("Setting value %p with reference count %d.", val, (int) Py_REFCNT(val));
         //Py_INCREF(val);
         //python_count_decrement(port->value);
        
-        lf_token_t* token = lf_new_token((void*)port, val, 1);
-        lf_set_destructor(port, python_count_decrement);
-        lf_set_token(port, token);
+        py_port_set_value(port, val);
+
+        // Also set the values for the port capsule, which holds its own
+        // reference to the value since it outlives the reaction.
+        PyObject* previous = p->value;
         Py_INCREF(val);
-       
-        // Also set the values for the port capsule.
         p->value = val;
+        Py_XDECREF(previous);
         p->is_present = true;
     }
+    LF_PY_END_CRITICAL_SECTION();
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
+/**
+ * Return the C ports of the channels of the specified multiport capsule, or NULL
+ * with a Python exception set if it is not a multiport.
+ */
+static generic_port_instance_struct** py_multiport_channels(generic_port_capsule_struct* port) {
+    if (port->width < 0) {
+        PyErr_SetString(PyExc_TypeError, "The port is not a multiport.");
+        return NULL;
+    }
+    generic_port_instance_struct** cport =
+        (generic_port_instance_struct**)PyCapsule_GetPointer(port->port, "port");
+    if (cport == NULL) {
+        lf_print_error_and_exit("Null pointer received.");
+    }
+    return cport;
+}
+
+/**
+ * Return the channels of a multiport that are present and their values, in one
+ * pass over the channels, without creating a port capsule for each of them.
+ * This function is callable in Python as
+ *  channels, values = multiport.present_values()
+ * where channels is a list of the indices of the present channels and values
+ * is a list of their values, in the same order.
+ * @param self The multiport.
+ */
+PyObject* py_port_present_values(PyObject* self, PyObject* unused) {
+    generic_port_instance_struct** cport = py_multiport_channels((generic_port_capsule_struct*)self);
+    if (cport == NULL) {
+        return NULL;
+    }
+    int width = ((generic_port_capsule_struct*)self)->width;
+    Py_ssize_t count = 0;
+    for (int i = 0; i < width; i++) {
+        if (cport[i]->is_present) count++;
+    }
+    PyObject* channels = PyList_New(count);
+    PyObject* values = PyList_New(count);
+    if (channels == NULL || values == NULL) {
+        Py_XDECREF(channels);
+        Py_XDECREF(values);
+        return NULL;
+    }
+    Py_ssize_t j = 0;
+    for (int i = 0; i < width && j < count; i++) {
+        if (!cport[i]->is_present) continue;
+        PyObject* channel = PyLong_FromLong(i);
+        if (channel == NULL) {
+            Py_DECREF(channels);
+            Py_DECREF(values);
+            return NULL;
+        }
+        PyObject* value = (cport[i]->value == NULL) ? Py_None : cport[i]->value;
+        Py_INCREF(value);
+        PyList_SET_ITEM(channels, j, channel);
+        PyList_SET_ITEM(values, j, value);
+        j++;
+    }
+    return Py_BuildValue("(NN)", channels, values);
+}
+
+/**
+ * Set several channels of a multiport in one call. This function is callable in
+ * Python as
+ *  multiport.set_values(values)
+ * to set channel i to values[i] for each element of a sequence, such as a list or
+ * a NumPy array, which must not be longer than the multiport is wide, or as
+ *  multiport.set_values(values, channels)
+ * to set channel channels[i] to values[i]. The arguments are checked before any
+ * channel is set, so that either all or none of them are.
+ * @param self The multiport.
+ * @param args The values and, optionally, the channels (METH_FASTCALL).
+ * @param nargs The number of arguments.
+ */
+PyObject* py_port_set_values(PyObject* self, PyObject* const* args, Py_ssize_t nargs) {
+    if (nargs < 1 || nargs > 2) {
+        PyErr_Format(PyExc_TypeError, "set_values() takes 1 or 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+    generic_port_instance_struct** cport = py_multiport_channels((generic_port_capsule_struct*)self);
+    if (cport == NULL) {
+        return NULL;
+    }
+    int width = ((generic_port_capsule_struct*)self)->width;
+    PyObject* values = PySequence_Fast(args[0], "Expected a sequence of values.");
+    if (values == NULL) {
+        return NULL;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(values);
+    PyObject** items = PySequence_Fast_ITEMS(values);
+    PyObject* channels = NULL;
+    int* indices = NULL;
+    if (nargs == 2 && args[1] != Py_None) {
+        channels = PySequence_Fast(args[1], "Expected a sequence of channels.");
+        if (channels == NULL) {
+            goto error;
+        }
+        if (PySequence_Fast_GET_SIZE(channels) != count) {
+            PyErr_SetString(PyExc_ValueError, "The values and the channels differ in length.");
+            goto error;
+        }
+        indices = PyMem_Malloc((count > 0 ? count : 1) * sizeof(int));
+        if (indices == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        for (Py_ssize_t i = 0; i < count; i++) {
+            long channel = PyLong_AsLong(PySequence_Fast_GET_ITEM(channels, i));
+            if (channel == -1 && PyErr_Occurred()) {
+                goto error;
+            }
+            if (channel < 0 || channel >= width) {
+                PyErr_Format(PyExc_IndexError, "Multiport index %ld out of range.", channel);
+                goto error;
+            }
+            indices[i] = (int)channel;
+        }
+    } else if (count > width) {
+        PyErr_Format(PyExc_ValueError, "%zd values are too many for a multiport of width %d.", count, width);
+        goto error;
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        py_port_set_value(cport[indices != NULL ? indices[i] : i], items[i]);
+    }
+    PyMem_Free(indices);
+    Py_XDECREF(channels);
+    Py_DECREF(values);
+    Py_RETURN_NONE;
+
+error:
+    PyMem_Free(indices);
+    Py_XDECREF(channels);
+    Py_DECREF(values);
+    return NULL;
+}
+
 /**
  * Called when a port_capsule has to be deallocated (generally by the Python
  * garbage collector).
  * @param self An instance of generic_port_instance_struct*
  */
 void py_port_capsule_dealloc(generic_port_capsule_struct *self) {
+    PyTypeObject* type = Py_TYPE(self);
     Py_XDECREF(self->port);
     Py_XDECREF(self->value);
-    Py_TYPE(self)->tp_free((PyObject *) self);
+    type->tp_free((PyObject *) self);
+    // Instances of heap types hold a reference to their type.
+    Py_DECREF(type);
 }
 
 /**
@@ -132,10 +281,10 @@ void py_port_capsule_dealloc(generic_port_capsule_struct *self) {
  *
  * To initialize the port_capsule, this function first initializes a
  * generic_port_capsule_struct* self using the tp_alloc property of
- * port_capsule (@see py_port_capsule_t) and then assigns the members
+ * port_capsule (@see py_port_capsule_spec) and then assigns the members
  * of self with default values of port= NULL, value = NULL, is_present = false,
  * current_index = 0, width = -2.
- * @param type The Python type object. In this case, py_port_capsule_t
+ * @param type The Python type object. In this case, the port_capsule type
  * @param args The optional arguments that are:
  *      - port: A capsule that holds a void* to the underlying C port
  *      - value: value of the port
@@ -185,7 +334,6 @@ PyObject *py_port_iter(PyObject *self) {
  */
 PyObject *py_port_iter_next(PyObject *self) {
     generic_port_capsule_struct* port = (generic_port_capsule_struct*)self;
-    generic_port_capsule_struct* pyport = (generic_port_capsule_struct*)self->ob_type->tp_new(self->ob_type, NULL, NULL);
 
     if (port->width < 1) {
         PyErr_Format(PyExc_TypeError,
@@ -193,8 +341,13 @@ PyObject *py_port_iter_next(PyObject *self) {
         return NULL;
     }
 
-    if (port->current_index >= port->width) {
-        port->current_index = 0;
+    // Take the next index atomically, since threads may iterate over the same multiport.
+    long index;
+    LF_PY_BEGIN_CRITICAL_SECTION(self);
+    index = port->current_index;
+    port->current_index = (index >= port->width) ? 0 : index + 1;
+    LF_PY_END_CRITICAL_SECTION();
+    if (index >= port->width) {
         return NULL;
     }
 
@@ -204,22 +357,8 @@ PyObject *py_port_iter_next(PyObject *self) {
         lf_print_error_and_exit("Null pointer received.");
     }
 
-    // Py_XINCREF(cport[index]->value);
-    pyport->port = PyCapsule_New(cport[port->current_index], "port", NULL);
-    pyport->value = cport[port->current_index]->value;
-    pyport->is_present = cport[port->current_index]->is_present;
-    pyport->width = -2;
-    FEDERATED_ASSIGN_FIELDS(pyport, cport[port->current_index]);
-
-    port->current_index++;
-
-    if (pyport->value == NULL) {
-        Py_INCREF(Py_None);
-        pyport->value = Py_None;
-    }
-
-    Py_XINCREF(pyport);
-    return (PyObject*)pyport;
+    // The port_capsule of the channel, which is updated in place.
+    return convert_C_port_to_py(cport[index], -2);
 }
 /**
  * Get an item from a Linugua Franca port capsule type.
@@ -228,8 +367,8 @@ PyObject *py_port_iter_next(PyObject *self) {
  * return the port capsule itself.
  * If a port is a multiport, this function will convert the index
  * item and convert it into a C long long, and use it to access
- * the underlying array stored in the PyCapsule as "port". A new
- * non-multiport capsule is created and returned, which in turn can be
+ * the underlying array stored in the PyCapsule as "port". The
+ * non-multiport capsule of the channel is returned, which in turn can be
  * used as an ordinary LinguaFranca.port_capsule.
  * @param self The port which can be a multiport or a singular port
  * @param key The index (key) which is used to retrieve an item from the underlying
@@ -240,6 +379,7 @@ PyObject *py_port_capsule_get_item(PyObject *self, PyObject *key) {
 
     // Port is not a multiport
     if (port->width == -2) {
+        Py_INCREF(self);
         return self;
     }
 
@@ -250,8 +390,6 @@ PyObject *py_port_capsule_get_item(PyObject *self, PyObject *key) {
         return NULL;
     }
 
-    generic_port_capsule_struct* pyport =
-        (generic_port_capsule_struct*)self->ob_type->tp_new(self->ob_type, NULL, NULL);
     long long index = -3;
 
     index = PyLong_AsLong(key);
@@ -261,6 +399,10 @@ PyObject *py_port_capsule_get_item(PyObject *self, PyObject *key) {
                      Py_TYPE(key)->tp_name);
         return NULL;
     }
+    if (index < 0 || index >= port->width) {
+        PyErr_Format(PyExc_IndexError, "Multiport index %lld out of range.", index);
+        return NULL;
+    }
 
     generic_port_instance_struct **cport =
         (generic_port_instance_struct **)PyCapsule_GetPointer(port->port,"port");
@@ -268,26 +410,10 @@ PyObject *py_port_capsule_get_item(PyObject *self, PyObject *key) {
         lf_print_error_and_exit("Null pointer received.");
     }
 
-    // Py_INCREF(cport[index]->value);
-    pyport->port = PyCapsule_New(cport[index], "port", NULL);
-    pyport->value = cport[index]->value;
-    pyport->is_present = cport[index]->is_present;
-    pyport->width = -2;
-    FEDERATED_ASSIGN_FIELDS(pyport, cport[index]);
-
+    LF_PRINT_LOG("Getting item index %lld. Is present is %d.", index, cport[index]->is_present);
 
-    LF_PRINT_LOG("Getting item index %lld. Is present is %d.", index, pyport->is_present);
-
-
-    if (pyport->value == NULL) {
-        Py_INCREF(Py_None);
-        pyport->value = Py_None;
-    }
-
-    //Py_INCREF(((generic_port_capsule_struct*)port)->value);
-    Py_XINCREF(pyport);
-    //Py_INCREF(self);
-    return (PyObject*)pyport;
+    // The port_capsule of the channel, which is updated in place.
+    return convert_C_port_to_py(cport[index], -2);
 }
 
 /**
@@ -314,16 +440,6 @@ Py_ssize_t py_port_length(PyObject *self) {
     return (Py_ssize_t)port->width;
 }
 
-/**
- * Methods that convert a LinguaFranca.port_capsule into a mapping,
- * which allows it to be subscriptble.
- */
-PyMappingMethods py_port_as_mapping = {
-    (lenfunc) py_port_length,
-    (binaryfunc) py_port_capsule_get_item,
-    (objobjargproc) py_port_capsule_assign_get_item
-};
-
 /**
  * Initialize the port capsule self with the given optional values for
  * port, value, is_present, and num_destinations. If any of these arguments
@@ -384,35 +500,71 @@ PyMemberDef py_port_capsule_members[] = {
     {NULL}  /* Sentinel */
 };
 
+#ifdef FEDERATED_DECENTRALIZED
+/**
+ * Getter of the "intended_tag" attribute, which creates the Tag object only
+ * when it is accessed.
+ */
+static PyObject* py_port_capsule_get_intended_tag(generic_port_capsule_struct* self, void* closure) {
+    return (PyObject*) convert_C_tag_to_py(self->intended_tag);
+}
+#endif
+
+/*
+ * The attributes of a port_capsule computed upon access.
+ */
+static PyGetSetDef py_port_capsule_getsetters[] = {
+    FEDERATED_CAPSULE_GETSET
+    {NULL}  /* Sentinel */
+};
+
 /*
  * The function members of port_capsule
  * __getitem__ is used to reference a multiport with an index (e.g., foo[2])
  * set is used to set a port value and its is_present field.
+ * present_values and set_values get and set the channels of a multiport in bulk.
  */
 PyMethodDef py_port_capsule_methods[] = {
     {"__getitem__", (PyCFunction)py_port_capsule_get_item, METH_O|METH_COEXIST, "x.__getitem__(y) <==> x[y]"},
-    {"set", (PyCFunction)py_port_set, METH_VARARGS, "Set value of the port as well as the is_present field"},
+    {"set", (PyCFunction)py_port_set, METH_O, "Set value of the port as well as the is_present field"},
+    {"present_values", (PyCFunction)py_port_present_values, METH_NOARGS,
+            "Return the indices of the present channels of the multiport and their values"},
+    {"set_values", (PyCFunction)(void(*)(void))py_port_set_values, METH_FASTCALL,
+            "Set the channels of the multiport to the given values"},
     {NULL}  /* Sentinel */
 };
 
 
 /*
- * The definition of port_capsule type object, which is
- * used to describe how port_capsule behaves.
+ * The slots of the port_capsule type. The mapping slots convert
+ * a LinguaFranca.port_capsule into a mapping, which allows it
+ * to be subscriptable.
+ */
+static PyType_Slot py_port_capsule_slots[] = {
+    {Py_tp_doc, (void*) "port_capsule objects"},
+    {Py_mp_length, (void*) py_port_length},
+    {Py_mp_subscript, (void*) py_port_capsule_get_item},
+    {Py_mp_ass_subscript, (void*) py_port_capsule_assign_get_item},
+    {Py_tp_iter, (void*) py_port_iter},
+    {Py_tp_iternext, (void*) py_port_iter_next},
+    {Py_tp_new, (void*) py_port_capsule_new},
+    {Py_tp_init, (void*) py_port_capsule_init},
+    {Py_tp_dealloc, (void*) py_port_capsule_dealloc},
+    {Py_tp_members, (void*) py_port_capsule_members},
+    {Py_tp_getset, (void*) py_port_capsule_getsetters},
+    {Py_tp_methods, (void*) py_port_capsule_methods},
+    {0, NULL}
+};
+
+/*
+ * The specification of the port_capsule type, which is
+ * used to describe how port_capsule behaves. The type is
+ * created in each interpreter that imports the module.
  */
-PyTypeObject py_port_capsule_t = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "LinguaFranca.port_capsule",
-    .tp_doc = "port_capsule objects",
-    .tp_basicsize = sizeof(generic_port_capsule_struct),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_as_mapping = &py_port_as_mapping,
-    .tp_iter = py_port_iter,
-    .tp_iternext = py_port_iter_next,
-    .tp_new = py_port_capsule_new,
-    .tp_init = (initproc) py_port_capsule_init,
-    .tp_dealloc = (destructor) py_port_capsule_dealloc,
-    .tp_members = py_port_capsule_members,
-    .tp_methods = py_port_capsule_methods,
+PyType_Spec py_port_capsule_spec = {
+    .name = "LinguaFranca.port_capsule",
+    .basicsize = sizeof(generic_port_capsule_struct),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = py_port_capsule_slots,
 };
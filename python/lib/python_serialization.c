@@ -0,0 +1,341 @@
+/**
+ * @file
+ * @copyright (c) 2020-2023, The University of California at Berkeley.
+ * License: <a href="https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md">BSD 2-clause</a>
+ * @brief Implementation of functions defined in @see python_serialization.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_serialization.h"
+#include "python_buffer.h"
+#include "pythontarget.h"
+#include "environment.h"
+#include "trace.h"
+
+/** The length of the part of a pickle message that precedes the lengths of the buffers. */
+#define PY_PICKLE_FIXED_HEADER_LENGTH 16
+
+/** Return the given offset rounded up to a multiple of PY_BUFFER_ALIGNMENT. */
+static size_t py_align(size_t offset) {
+    return (offset + PY_BUFFER_ALIGNMENT - 1) & ~(size_t)(PY_BUFFER_ALIGNMENT - 1);
+}
+
+/**
+ * Record the start or the end of a serialization or a deserialization in the trace
+ * of the environment of the calling interpreter.
+ */
+static void py_trace_serialization(trace_event_t event_type, size_t bytes) {
+#ifdef LF_TRACE
+    environment_t* env = py_interpreter_state()->env;
+    if (env != NULL) {
+        tracepoint_serialization(env, event_type, bytes);
+    }
+#endif
+}
+
+/**
+ * Look up the functions of the pickle module and create the objects reused by
+ * each call, if not done yet.
+ * @return 0 on success and -1 with a Python exception set on failure.
+ */
+static int py_pickle_initialize(py_serialization_state_t* state) {
+    if (state->pickle_dumps != NULL) {
+        return 0;
+    }
+    PyObject* pickler = global_pickler;
+    if (pickler == NULL) {
+        pickler = PyImport_ImportModule("pickle");
+        if (pickler == NULL) {
+            return -1;
+        }
+        global_pickler = pickler;
+    }
+    PyObject* dumps = PyObject_GetAttrString(pickler, "dumps");
+    PyObject* loads = PyObject_GetAttrString(pickler, "loads");
+    state->pickle_protocol = PyLong_FromLong(5);
+    state->pickle_buffers = PyList_New(0);
+    state->pickle_buffer_callback =
+        state->pickle_buffers == NULL ? NULL : PyObject_GetAttrString(state->pickle_buffers, "append");
+    state->dumps_kwnames = Py_BuildValue("(s)", "buffer_callback");
+    state->loads_kwnames = Py_BuildValue("(s)", "buffers");
+    if (dumps == NULL || loads == NULL || state->pickle_protocol == NULL || state->pickle_buffer_callback == NULL
+            || state->dumps_kwnames == NULL || state->loads_kwnames == NULL) {
+        Py_XDECREF(dumps);
+        Py_XDECREF(loads);
+        Py_CLEAR(state->pickle_protocol);
+        Py_CLEAR(state->pickle_buffers);
+        Py_CLEAR(state->pickle_buffer_callback);
+        Py_CLEAR(state->dumps_kwnames);
+        Py_CLEAR(state->loads_kwnames);
+        return -1;
+    }
+    state->pickle_loads = loads;
+    // Set last, since it indicates that the rest is set.
+    state->pickle_dumps = dumps;
+    return 0;
+}
+
+static unsigned char* py_pickle_serialize(PyObject* value, size_t* length) {
+    py_serialization_state_t* state = &py_interpreter_state()->serialization;
+    if (py_pickle_initialize(state) < 0) {
+        return NULL;
+    }
+#ifdef Py_GIL_DISABLED
+    // Without the GIL, threads may serialize concurrently.
+    PyObject* buffers = PyList_New(0);
+    PyObject* callback = buffers == NULL ? NULL : PyObject_GetAttrString(buffers, "append");
+    if (callback == NULL) {
+        Py_XDECREF(buffers);
+        return NULL;
+    }
+#else
+    PyObject* buffers = Py_NewRef(state->pickle_buffers);
+    PyObject* callback = Py_NewRef(state->pickle_buffer_callback);
+#endif
+    PyObject* args[] = {value, state->pickle_protocol, callback};
+    PyObject* pickle = PyObject_Vectorcall(state->pickle_dumps, args, 2, state->dumps_kwnames);
+    Py_DECREF(callback);
+
+    unsigned char* message = NULL;
+    Py_ssize_t num_buffers = PyList_GET_SIZE(buffers);
+    Py_buffer* views = NULL;
+    Py_ssize_t num_views = 0;
+    if (pickle == NULL) {
+        goto done;
+    }
+    if (num_buffers > 0) {
+        views = PyMem_Malloc(num_buffers * sizeof(Py_buffer));
+        if (views == NULL) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        for (; num_views < num_buffers; num_views++) {
+            if (PyObject_GetBuffer(PyList_GET_ITEM(buffers, num_views), &views[num_views], PyBUF_RECORDS_RO) < 0) {
+                goto done;
+            }
+        }
+    }
+    size_t pickle_length = (size_t)PyBytes_GET_SIZE(pickle);
+    size_t offset = py_align(PY_PICKLE_FIXED_HEADER_LENGTH + 8 * (size_t)num_buffers);
+    size_t total = offset + pickle_length;
+    for (Py_ssize_t i = 0; i < num_buffers; i++) {
+        total = py_align(total) + (size_t)views[i].len;
+    }
+    message = (unsigned char*)malloc(total);
+    if (message == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(message, 0, offset);
+    py_buffer_encode_uint64((uint64_t)num_buffers, message);
+    py_buffer_encode_uint64((uint64_t)pickle_length, message + 8);
+    memcpy(message + offset, PyBytes_AS_STRING(pickle), pickle_length);
+    offset += pickle_length;
+    for (Py_ssize_t i = 0; i < num_buffers; i++) {
+        py_buffer_encode_uint64((uint64_t)views[i].len, message + PY_PICKLE_FIXED_HEADER_LENGTH + 8 * i);
+        size_t start = py_align(offset);
+        memset(message + offset, 0, start - offset);
+        if (PyBuffer_IsContiguous(&views[i], 'C')) {
+            memcpy(message + start, views[i].buf, (size_t)views[i].len);
+        } else if (PyBuffer_ToContiguous(message + start, &views[i], views[i].len, 'C') < 0) {
+            free(message);
+            message = NULL;
+            goto done;
+        }
+        offset = start + (size_t)views[i].len;
+    }
+    *length = total;
+
+done:
+    for (Py_ssize_t i = 0; i < num_views; i++) {
+        PyBuffer_Release(&views[i]);
+    }
+    PyMem_Free(views);
+    if (num_buffers > 0) {
+        PyList_SetSlice(buffers, 0, num_buffers, NULL);
+    }
+    Py_DECREF(buffers);
+    Py_XDECREF(pickle);
+    return message;
+}
+
+static PyObject* py_pickle_deserialize(unsigned char* message, size_t length) {
+    py_serialization_state_t* state = &py_interpreter_state()->serialization;
+    if (py_pickle_initialize(state) < 0) {
+        free(message);
+        return NULL;
+    }
+    uint64_t num_buffers = 0;
+    uint64_t pickle_length = 0;
+    size_t offset = 0;
+    if (length >= PY_PICKLE_FIXED_HEADER_LENGTH) {
+        num_buffers = py_buffer_extract_uint64(message);
+        pickle_length = py_buffer_extract_uint64(message + 8);
+        offset = (num_buffers <= (length - PY_PICKLE_FIXED_HEADER_LENGTH) / 8)
+            ? py_align(PY_PICKLE_FIXED_HEADER_LENGTH + 8 * (size_t)num_buffers) : SIZE_MAX;
+    }
+    if (length < PY_PICKLE_FIXED_HEADER_LENGTH || offset > length || pickle_length > length - offset) {
+        free(message);
+        PyErr_SetString(PyExc_ValueError, "Malformed header of a pickled message.");
+        return NULL;
+    }
+
+    if (num_buffers == 0) {
+        // Nothing can refer to the message once it is unpickled.
+        PyObject* pickle = PyMemoryView_FromMemory((char*)message + offset, (Py_ssize_t)pickle_length, PyBUF_READ);
+        PyObject* result = pickle == NULL ? NULL : PyObject_CallOneArg(state->pickle_loads, pickle);
+        Py_XDECREF(pickle);
+        free(message);
+        return result;
+    }
+
+    // The buffers view the message, which is freed once the value no longer uses them.
+    PyObject* whole = py_buffer_wrap(message, length);
+    if (whole == NULL) {
+        return NULL;
+    }
+    PyObject* result = NULL;
+    PyObject* pickle = PySequence_GetSlice(whole, (Py_ssize_t)offset, (Py_ssize_t)(offset + pickle_length));
+    PyObject* buffers = PyList_New((Py_ssize_t)num_buffers);
+    if (pickle == NULL || buffers == NULL) {
+        goto done;
+    }
+    offset += pickle_length;
+    for (uint64_t i = 0; i < num_buffers; i++) {
+        uint64_t buffer_length = py_buffer_extract_uint64(message + PY_PICKLE_FIXED_HEADER_LENGTH + 8 * i);
+        size_t start = py_align(offset);
+        if (start > length || buffer_length > length - start) {
+            PyErr_SetString(PyExc_ValueError, "The buffers of a pickled message exceed its length.");
+            goto done;
+        }
+        PyObject* buffer = PySequence_GetSlice(whole, (Py_ssize_t)start, (Py_ssize_t)(start + buffer_length));
+        if (buffer == NULL) {
+            goto done;
+        }
+        PyList_SET_ITEM(buffers, (Py_ssize_t)i, buffer);
+        offset = start + buffer_length;
+    }
+    PyObject* args[] = {pickle, buffers};
+    result = PyObject_Vectorcall(state->pickle_loads, args, 1, state->loads_kwnames);
+
+done:
+    Py_XDECREF(pickle);
+    Py_XDECREF(buffers);
+    Py_DECREF(whole);
+    return result;
+}
+
+const py_serializer_t py_pickle_serializer = {
+    .name = "pickle",
+    .serialize = py_pickle_serialize,
+    .deserialize = py_pickle_deserialize,
+};
+
+const py_serializer_t py_buffer_serializer = {
+    .name = "buffer",
+    .serialize = py_buffer_serialize,
+    .deserialize = py_buffer_deserialize,
+};
+
+/** Serialize with the function given to set_serializer(). */
+static unsigned char* py_custom_serialize(PyObject* value, size_t* length) {
+    PyObject* serialized = PyObject_CallOneArg(py_interpreter_state()->serialization.custom_dumps, value);
+    if (serialized == NULL) {
+        return NULL;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(serialized, &view, PyBUF_SIMPLE) < 0) {
+        Py_DECREF(serialized);
+        return NULL;
+    }
+    // Allocate at least one byte, since malloc(0) may return NULL.
+    unsigned char* message = (unsigned char*)malloc(view.len > 0 ? (size_t)view.len : 1);
+    if (message == NULL) {
+        PyErr_NoMemory();
+    } else {
+        memcpy(message, view.buf, (size_t)view.len);
+        *length = (size_t)view.len;
+    }
+    PyBuffer_Release(&view);
+    Py_DECREF(serialized);
+    return message;
+}
+
+/** Deserialize with the function given to set_serializer(). */
+static PyObject* py_custom_deserialize(unsigned char* message, size_t length) {
+    // The function may keep the memoryview, so it owns the message.
+    PyObject* view = py_buffer_wrap(message, length);
+    if (view == NULL) {
+        return NULL;
+    }
+    PyObject* result = PyObject_CallOneArg(py_interpreter_state()->serialization.custom_loads, view);
+    Py_DECREF(view);
+    return result;
+}
+
+static const py_serializer_t py_custom_serializer = {
+    .name = "custom",
+    .serialize = py_custom_serialize,
+    .deserialize = py_custom_deserialize,
+};
+
+void py_use_serializer(const py_serializer_t* serializer) {
+    py_interpreter_state()->serialization.serializer = serializer;
+}
+
+unsigned char* py_serialize(PyObject* value, size_t* length) {
+    const py_serializer_t* serializer = py_interpreter_state()->serialization.serializer;
+    if (serializer == NULL) {
+        serializer = &py_pickle_serializer;
+    }
+    py_trace_serialization(serialization_starts, 0);
+    unsigned char* result = serializer->serialize(value, length);
+    py_trace_serialization(serialization_ends, result == NULL ? 0 : *length);
+    return result;
+}
+
+PyObject* py_deserialize(unsigned char* message, size_t length) {
+    const py_serializer_t* serializer = py_interpreter_state()->serialization.serializer;
+    if (serializer == NULL) {
+        serializer = &py_pickle_serializer;
+    }
+    py_trace_serialization(deserialization_starts, length);
+    PyObject* result = serializer->deserialize(message, length);
+    py_trace_serialization(deserialization_ends, length);
+    return result;
+}
+
+PyObject* py_set_serializer(PyObject* self, PyObject* args) {
+    PyObject* dumps = NULL;
+    PyObject* loads = NULL;
+    if (!PyArg_ParseTuple(args, "|OO", &dumps, &loads)) {
+        return NULL;
+    }
+    py_serialization_state_t* state = &py_interpreter_state()->serialization;
+    const py_serializer_t* serializer = NULL;
+    if (dumps != NULL && loads == NULL) {
+        const char* name = PyUnicode_Check(dumps) ? PyUnicode_AsUTF8(dumps) : NULL;
+        if (name != NULL && strcmp(name, py_pickle_serializer.name) == 0) {
+            serializer = &py_pickle_serializer;
+        } else if (name != NULL && strcmp(name, py_buffer_serializer.name) == 0) {
+            serializer = &py_buffer_serializer;
+        } else {
+            PyErr_SetString(PyExc_ValueError, "Expected \"pickle\", \"buffer\", or the functions dumps and loads.");
+            return NULL;
+        }
+    } else if (dumps != NULL) {
+        if (!PyCallable_Check(dumps) || !PyCallable_Check(loads)) {
+            PyErr_SetString(PyExc_TypeError, "The functions dumps and loads must be callable.");
+            return NULL;
+        }
+        Py_INCREF(dumps);
+        Py_INCREF(loads);
+        Py_XSETREF(state->custom_dumps, dumps);
+        Py_XSETREF(state->custom_loads, loads);
+        serializer = &py_custom_serializer;
+    }
+    py_use_serializer(serializer);
+    Py_RETURN_NONE;
+}
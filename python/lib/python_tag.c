@@ -33,17 +33,30 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "python_tag.h"
 #include "python_port.h"
 
-PyTypeObject PyTagType;
-
 /**
- * Return the current tag object.
+ * Return the current tag object. Since tags are immutable, the calls at the
+ * same tag share one object, which the interpreter state keeps.
  */
 PyObject* py_lf_tag(PyObject *self, PyObject *args) {
-    py_tag_t *t = (py_tag_t *) PyType_GenericNew(&PyTagType, NULL, NULL);
+    py_interpreter_state_t* state = py_interpreter_state();
+    tag_t tag = lf_tag(state->env);
+#ifndef Py_GIL_DISABLED
+    py_tag_t* current = state->current_tag;
+    if (current != NULL && lf_tag_compare(current->tag, tag) == 0) {
+        Py_INCREF(current);
+        return (PyObject *) current;
+    }
+#endif
+    py_tag_t *t = (py_tag_t *) state->tag_type->tp_alloc(state->tag_type, 0);
     if (t == NULL) {
         return NULL;
     }
-    t->tag = lf_tag(top_level_environment);
+    t->tag = tag;
+#ifndef Py_GIL_DISABLED
+    Py_INCREF(t);
+    state->current_tag = t;
+    Py_XDECREF(current);
+#endif
     return (PyObject *) t;
 }
 
@@ -57,14 +70,15 @@ PyObject* py_lf_tag(PyObject *self, PyObject *args) {
  * @param tag2
  * @return -1, 0, or 1 depending on the relation.
  */
-PyObject* py_tag_compare(PyObject *self, PyObject *args) {
-    PyObject *tag1;
-    PyObject *tag2;
-    if (!PyArg_UnpackTuple(args, "args", 2, 2, &tag1, &tag2)) {
+PyObject* py_tag_compare(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError, "tag_compare() takes 2 arguments (%zd given)", nargs);
         return NULL;
     }
-    if (!PyObject_IsInstance(tag1, (PyObject *) &PyTagType)
-     || !PyObject_IsInstance(tag2, (PyObject *) &PyTagType)) {
+    PyObject *tag1 = args[0];
+    PyObject *tag2 = args[1];
+    PyTypeObject* tag_type = py_interpreter_state()->tag_type;
+    if (!Py_IS_TYPE(tag1, tag_type) || !Py_IS_TYPE(tag2, tag_type)) {
         PyErr_SetString(PyExc_TypeError, "Arguments must be Tag type.");
         return NULL;
     }
@@ -75,19 +89,27 @@ PyObject* py_tag_compare(PyObject *self, PyObject *args) {
 
 
 /**
- * Initialize the Tag object with the given values for "time" and "microstep",
- * both of which are required.
- * @param self A py_tag_t object.
+ * Create a Tag object with the given values for "time" and "microstep",
+ * both of which are required. Tags are immutable, so that they can be shared,
+ * which is why they are initialized here rather than in tp_init.
+ * @param type The Tag type.
  * @param args The arguments are:
  *      - time: A logical time.
  *      - microstep: A microstep within the logical time "time".
  */
-static int Tag_init(py_tag_t *self, PyObject *args, PyObject *kwds) {
+static PyObject *Tag_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
     static char *kwlist[] = {"time", "microstep", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Lk", kwlist, &(self->tag.time), &(self->tag.microstep))) {
-        return -1;
+    long long time;
+    unsigned long microstep;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Lk", kwlist, &time, &microstep)) {
+        return NULL;
     }
-    return 0;
+    py_tag_t *self = (py_tag_t *) type->tp_alloc(type, 0);
+    if (self != NULL) {
+        self->tag.time = time;
+        self->tag.microstep = (microstep_t) microstep;
+    }
+    return (PyObject *) self;
 }
 
 /**
@@ -98,34 +120,12 @@ static int Tag_init(py_tag_t *self, PyObject *args, PyObject *kwds) {
  * @param op the comparison operator
  */
 static PyObject *Tag_richcompare(py_tag_t *self, PyObject *other, int op) {
-    if (!PyObject_IsInstance(other, (PyObject *) &PyTagType)) {
+    // The Tag type cannot be subclassed, so other is a Tag if it has the type of self.
+    if (!Py_IS_TYPE(other, Py_TYPE(self))) {
         PyErr_SetString(PyExc_TypeError, "Cannot compare a Tag with a non-Tag type.");
         return NULL;
     }
-
-    tag_t other_tag = ((py_tag_t *) other)->tag;
-    int c = -1;
-    if (op == Py_LT) {
-        c = (lf_tag_compare(self->tag, other_tag) < 0);
-    } else if (op == Py_LE) {
-        c = (lf_tag_compare(self->tag, other_tag) <= 0);
-    } else if (op == Py_EQ) {
-        c = (lf_tag_compare(self->tag, other_tag) == 0);
-    } else if (op == Py_NE) {
-        c = (lf_tag_compare(self->tag, other_tag) != 0);
-    } else if (op == Py_GT) {
-        c = (lf_tag_compare(self->tag, other_tag) > 0);
-    } else if (op == Py_GE) {
-        c = (lf_tag_compare(self->tag, other_tag) >= 0);
-    }
-    if (c < 0) {
-        PyErr_SetString(PyExc_RuntimeError, "Invalid comparator (This statement should never be reached). ");
-        return NULL;
-    } else if (c) {
-        Py_RETURN_TRUE;
-    } else {
-        Py_RETURN_FALSE;
-    }
+    Py_RETURN_RICHCOMPARE(lf_tag_compare(self->tag, ((py_tag_t *) other)->tag), 0, op);
 }
 
 /**
@@ -160,39 +160,31 @@ static PyGetSetDef Tag_getsetters[] = {
  * String representation for Tag object
  **/
 PyObject *Tag_str(PyObject *self) {
-    // Get PyLong representation of the "time" attribute. 
-    PyObject *time = Tag_get_time((py_tag_t*)self, NULL);
-    // Get PyLong representation of the "microstep" attribute. 
-    PyObject *microstep = Tag_get_microstep((py_tag_t*)self, NULL);
-
-    // Create the tag's string representation
-    PyObject *str = PyUnicode_FromFormat(
-        "Tag(time=%U, microstep=%U)",
-        PyObject_Str(time),
-        PyObject_Str(microstep) 
-    ); 
-    
-    Py_DECREF(time);
-    Py_DECREF(microstep);
-
-    return str;
+    tag_t tag = ((py_tag_t*)self)->tag;
+    return PyUnicode_FromFormat("Tag(time=%lld, microstep=%lu)", (long long) tag.time, (unsigned long) tag.microstep);
 }
 
 /**
- * Definition of the PyTagType Object.
+ * Slots of the Tag type.
+ **/
+static PyType_Slot py_tag_slots[] = {
+    {Py_tp_doc, (void*) "Tag object"},
+    {Py_tp_new, (void*) Tag_new},
+    {Py_tp_richcompare, (void*) Tag_richcompare},
+    {Py_tp_getset, (void*) Tag_getsetters},
+    {Py_tp_str, (void*) Tag_str},
+    {0, NULL}
+};
+
+/**
+ * Specification of the Tag type.
  **/
-PyTypeObject PyTagType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "LinguaFranca.Tag",
-    .tp_doc = "Tag object",
-    .tp_basicsize = sizeof(py_tag_t),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = PyType_GenericNew,
-    .tp_init = (initproc) Tag_init,
-    .tp_richcompare = (richcmpfunc) Tag_richcompare,
-    .tp_getset = Tag_getsetters,
-    .tp_str = Tag_str,
+PyType_Spec py_tag_spec = {
+    .name = "LinguaFranca.Tag",
+    .basicsize = sizeof(py_tag_t),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = py_tag_slots,
 };
 
 /**
@@ -202,7 +194,7 @@ PyTypeObject PyTagType = {
  * @return PyObject* The tag in Python.
  */
 py_tag_t* convert_C_tag_to_py(tag_t c_tag) {
-    py_tag_t* py_tag = PyObject_New(py_tag_t, &PyTagType);
+    py_tag_t* py_tag = PyObject_New(py_tag_t, py_interpreter_state()->tag_type);
     if (py_tag == NULL) {
         lf_print_error_and_exit("Failed to convert tag from C to Python.");
     }
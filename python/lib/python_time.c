@@ -41,14 +41,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Return the logical time in nanoseconds.
  */
 PyObject* py_lf_time_logical(PyObject *self, PyObject *args) {
-    return PyLong_FromLongLong(lf_time_logical(top_level_environment));
+    return PyLong_FromLongLong(lf_time_logical(py_interpreter_state()->env));
 }
 
 /**
  * Return the elapsed logical time in nanoseconds.
  */
 PyObject* py_lf_time_logical_elapsed(PyObject *self, PyObject *args) {
-    return PyLong_FromLongLong(lf_time_logical_elapsed(top_level_environment));
+    return PyLong_FromLongLong(lf_time_logical_elapsed(py_interpreter_state()->env));
 }
 
 /**
@@ -72,8 +72,6 @@ PyObject* py_lf_time_start(PyObject *self, PyObject *args) {
     return PyLong_FromLongLong(lf_time_start());
 }
 
-PyTypeObject PyTimeType;
-
 PyMethodDef PyTimeTypeMethods[] = {
     {"logical", (PyCFunction) py_lf_time_logical, METH_NOARGS|METH_STATIC, "Get the current logical time."},
     {"logical_elapsed", (PyCFunction) py_lf_time_logical_elapsed, METH_NOARGS|METH_STATIC, "Get the current elapsed logical time"},
@@ -84,15 +82,22 @@ PyMethodDef PyTimeTypeMethods[] = {
 };
 
 /**
- * Definition of the PyTimeType Object.
+ * Slots of the time type.
+ **/
+static PyType_Slot py_time_slots[] = {
+    {Py_tp_doc, (void*) "Time object"},
+    {Py_tp_new, (void*) PyType_GenericNew},
+    {Py_tp_methods, (void*) PyTimeTypeMethods},
+    {0, NULL}
+};
+
+/**
+ * Specification of the time type.
  **/
-PyTypeObject PyTimeType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "LinguaFranca.TimeType",
-    .tp_doc = "Time object",
-    .tp_basicsize = 0,
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = PyType_GenericNew,
-    .tp_methods = PyTimeTypeMethods,
+PyType_Spec py_time_spec = {
+    .name = "LinguaFranca.TimeType",
+    .basicsize = 0,
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = py_time_slots,
 };
@@ -42,21 +42,310 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "reactor.h"
 #include "tag.h"
 #include "util.h"
+#include "trace.h"
+#if defined(LF_PYTHON_GIL_TIME_SLICE) || defined(LF_PYTHON_SUBINTERPRETERS) \
+        || (defined(LF_TRACE) && !defined(LF_SINGLE_THREADED))
+#include "reactor_threaded.h" // For lf_is_worker_thread() and lf_worker_number()
+#endif
 
 ////////////// Global variables ///////////////
-// The global Python object that holds the .py module that the
-// C runtime interacts with
-PyObject *globalPythonModule = NULL;
+// The state of the runtime in the main interpreter, which holds the .py module
+// that the C runtime interacts with, the dictionary of that module that is used
+// to load class objects from, and pickle to enable native serialization.
+static py_interpreter_state_t main_interpreter_state = {0};
+
+#ifdef Py_GIL_DISABLED
+// Without the GIL, this guards the loading of the generated module by the first
+// call to get_python_function(), which threads could otherwise race to do.
+static PyMutex global_module_mutex;
+#define LF_PY_MODULE_LOCK() PyMutex_Lock(&global_module_mutex)
+#define LF_PY_MODULE_UNLOCK() PyMutex_Unlock(&global_module_mutex)
+#else
+#define LF_PY_MODULE_LOCK()
+#define LF_PY_MODULE_UNLOCK()
+#endif
+
+#ifdef LF_PYTHON_SUBINTERPRETERS
+#if PY_VERSION_HEX < 0x030C0000
+#error "LF_PYTHON_SUBINTERPRETERS requires Python 3.12 or later"
+#endif
+// The states of the sub-interpreters, where subinterpreter_states[i] is that of the
+// interpreter of environment i + 1.
+static py_interpreter_state_t* subinterpreter_states = NULL;
+static int num_subinterpreters = 0;
+
+// The thread state of the calling thread in each sub-interpreter, created on first use.
+// Worker threads only use the interpreter of their environment.
+static LF_THREAD_LOCAL PyThreadState** thread_states = NULL;
+#endif
+
+#ifdef LF_PYTHON_GIL_TIME_SLICE
+// The GIL that the calling worker thread kept after its last Python reaction,
+// if any, and when it started keeping it.
+static LF_THREAD_LOCAL py_gil_state_t kept_gil_state = {.interpreter = NULL};
+static LF_THREAD_LOCAL instant_t kept_gil_since = NEVER;
+#endif
+
+// The state of the interpreter whose GIL the calling thread released to call into
+// the runtime (see LF_PY_BEGIN_ALLOW_THREADS), if any.
+static LF_THREAD_LOCAL py_interpreter_state_t* detached_state = NULL;
+
+#if PY_VERSION_HEX >= 0x030D0000
+#define LF_PY_ATTACHED_THREAD_STATE() PyThreadState_GetUnchecked()
+#else
+#define LF_PY_ATTACHED_THREAD_STATE() _PyThreadState_UncheckedGet()
+#endif
+
+// Atomically replace a pointer. Unlike lf_bool_compare_and_swap(), this is also
+// defined for the single-threaded runtime, where threads that schedule physical
+// actions can release references concurrently with the main thread.
+#if defined(_MSC_VER)
+#define LF_PY_POINTER_COMPARE_AND_SWAP(ptr, oldval, newval) \
+    (InterlockedCompareExchangePointer(ptr, newval, oldval) == (oldval))
+#else
+#define LF_PY_POINTER_COMPARE_AND_SWAP(ptr, oldval, newval) __sync_bool_compare_and_swap(ptr, oldval, newval)
+#endif
 
-// The dictionary of the Python module that is used to load
-// class objects from
-PyObject *globalPythonModuleDict = NULL;
+/**
+ * Release the GIL of the interpreter of the calling thread around a call into the
+ * runtime that may block on the mutex of an environment, such as _lf_schedule_token(),
+ * so that other threads can run Python code meanwhile, including a worker that holds
+ * the mutex and needs the GIL to proceed. References to Python objects released by
+ * the runtime in the meantime are released when the GIL is acquired again.
+ */
+#define LF_PY_BEGIN_ALLOW_THREADS() \
+    { \
+        py_interpreter_state_t* _lf_py_state = py_interpreter_state(); \
+        detached_state = _lf_py_state; \
+        Py_BEGIN_ALLOW_THREADS
+#define LF_PY_END_ALLOW_THREADS() \
+        Py_END_ALLOW_THREADS \
+        detached_state = NULL; \
+        py_release_deferred_references(_lf_py_state); \
+    }
 
+environment_t* top_level_environment = NULL;
 
-// Import pickle to enable native serialization
-PyObject* global_pickler = NULL;
+py_interpreter_state_t* py_interpreter_state(void) {
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    if (num_subinterpreters > 0) {
+        PyInterpreterState* interpreter = PyInterpreterState_Get();
+        for (int i = 0; i < num_subinterpreters; i++) {
+            if (subinterpreter_states[i].interpreter == interpreter) {
+                return &subinterpreter_states[i];
+            }
+        }
+    }
+#endif
+    return &main_interpreter_state;
+}
 
-environment_t* top_level_environment = NULL;
+/**
+ * Return the state of the interpreter that executes the reactions of the specified environment.
+ * @param env The environment, or NULL for the top-level one.
+ */
+static py_interpreter_state_t* py_environment_state(environment_t* env) {
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    if (env != NULL && env != top_level_environment && num_subinterpreters > 0) {
+        int index = (int)(env - top_level_environment) - 1;
+        lf_assert(index >= 0 && index < num_subinterpreters, "Environment %d has no Python interpreter.", env->id);
+        return &subinterpreter_states[index];
+    }
+#endif
+    return &main_interpreter_state;
+}
+
+/**
+ * A reference to a Python object that a thread without the GIL released (see
+ * py_release_reference()), in a list of such references.
+ */
+typedef struct py_deferred_reference_t {
+    struct py_deferred_reference_t* next;
+    PyObject* object;
+} py_deferred_reference_t;
+
+/**
+ * Return the state of the interpreter that owns the objects released by the calling
+ * thread, which does not hold a GIL.
+ */
+static py_interpreter_state_t* py_detached_state(void) {
+    if (detached_state != NULL) {
+        return detached_state;
+    }
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    // Worker threads only use the interpreter of their environment.
+    if (thread_states != NULL && lf_is_worker_thread()) {
+        for (int i = 0; i < num_subinterpreters; i++) {
+            if (thread_states[i] != NULL) {
+                return &subinterpreter_states[i];
+            }
+        }
+    }
+#endif
+    return &main_interpreter_state;
+}
+
+void py_release_reference(PyObject* object) {
+    if (object == NULL) {
+        return;
+    }
+    if (LF_PY_ATTACHED_THREAD_STATE() != NULL) {
+        Py_DECREF(object);
+        return;
+    }
+    py_deferred_reference_t* reference = (py_deferred_reference_t*)malloc(sizeof(py_deferred_reference_t));
+    if (reference == NULL) {
+        lf_print_error_and_exit("Out of memory.");
+    }
+    reference->object = object;
+    py_interpreter_state_t* state = py_detached_state();
+    do {
+        reference->next = (py_deferred_reference_t*)state->deferred_references;
+    } while (!LF_PY_POINTER_COMPARE_AND_SWAP(&state->deferred_references, reference->next, reference));
+}
+
+/**
+ * Release the references that threads without the GIL released in the specified
+ * interpreter, whose GIL the calling thread holds.
+ * @param state The state of the interpreter.
+ */
+static void py_release_deferred_references(py_interpreter_state_t* state) {
+    if (state->deferred_references == NULL) {
+        return;
+    }
+    py_deferred_reference_t* reference;
+    do {
+        reference = (py_deferred_reference_t*)state->deferred_references;
+    } while (!LF_PY_POINTER_COMPARE_AND_SWAP(&state->deferred_references, reference, NULL));
+    while (reference != NULL) {
+        py_deferred_reference_t* next = reference->next;
+        Py_DECREF(reference->object);
+        free(reference);
+        reference = next;
+    }
+}
+
+#ifdef LF_TRACE
+/**
+ * Record the wait for the GIL or the execution of Python code by the calling worker
+ * in the trace of the specified environment (see tracepoint_interpreter()). Other
+ * threads are not traced, for the trace only has buffers of its own for workers.
+ * @param env The environment, or NULL for the top-level one.
+ * @param event_type The event.
+ */
+static void py_tracepoint(environment_t* env, trace_event_t event_type) {
+#ifdef LF_SINGLE_THREADED
+    int worker = 0;
+#else
+    int worker = lf_worker_number();
+    if (worker < 0) return;
+#endif
+    if (env == NULL) env = top_level_environment;
+    if (env != NULL && env->trace != NULL && !env->trace->_lf_trace_stop) {
+        tracepoint_interpreter(env->trace, event_type, worker);
+    }
+}
+#define LF_PY_TRACEPOINT(env, event_type) py_tracepoint(env, event_type)
+#else
+#define LF_PY_TRACEPOINT(env, event_type)
+#endif
+
+/**
+ * Release the GIL that a worker thread has kept (see py_release_interpreter()).
+ * Without LF_PYTHON_GIL_TIME_SLICE, release the GIL acquired with the given state.
+ * @param state The state of the acquisition.
+ */
+static void py_release_gil(py_gil_state_t state) {
+    if (state.tstate != NULL) {
+        PyEval_SaveThread();
+    } else {
+        PyGILState_Release(state.gstate);
+    }
+}
+
+#ifdef LF_PYTHON_GIL_TIME_SLICE
+/**
+ * Release the GIL kept by the calling worker thread, if any.
+ * This is the lf_thread_release_hook of the thread while it keeps the GIL.
+ */
+static void py_release_kept_gil(void) {
+    lf_thread_release_hook = NULL;
+    if (kept_gil_state.interpreter != NULL) {
+        py_gil_state_t state = kept_gil_state;
+        kept_gil_state.interpreter = NULL;
+        py_release_gil(state);
+    }
+}
+#endif
+
+py_gil_state_t py_acquire_interpreter(environment_t* env) {
+    py_gil_state_t state = {.tstate = NULL};
+    py_interpreter_state_t* interpreter = py_environment_state(env);
+#ifdef LF_TRACE
+    state.env = env;
+#endif
+#ifdef LF_PYTHON_GIL_TIME_SLICE
+    state.interpreter = interpreter;
+    if (kept_gil_state.interpreter == interpreter) {
+        state.kept = true;
+        py_release_deferred_references(interpreter);
+        LF_PY_TRACEPOINT(env, python_call_starts);
+        return state;
+    }
+    py_release_kept_gil();
+#endif
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    if (interpreter != &main_interpreter_state) {
+        int index = (int)(interpreter - subinterpreter_states);
+        if (thread_states == NULL) {
+            thread_states = (PyThreadState**)calloc(num_subinterpreters, sizeof(PyThreadState*));
+            if (thread_states == NULL) {
+                lf_print_error_and_exit("Out of memory.");
+            }
+        }
+        if (thread_states[index] == NULL) {
+            thread_states[index] = PyThreadState_New(interpreter->interpreter);
+            if (thread_states[index] == NULL) {
+                lf_print_error_and_exit("Failed to create a Python thread state for environment %d.", env->id);
+            }
+        }
+        state.tstate = thread_states[index];
+        LF_PY_TRACEPOINT(env, gil_wait_starts);
+        PyEval_RestoreThread(state.tstate);
+        LF_PY_TRACEPOINT(env, gil_wait_ends);
+        py_release_deferred_references(interpreter);
+        LF_PY_TRACEPOINT(env, python_call_starts);
+        return state;
+    }
+#endif
+    LF_PY_TRACEPOINT(env, gil_wait_starts);
+    state.gstate = PyGILState_Ensure();
+    LF_PY_TRACEPOINT(env, gil_wait_ends);
+    py_release_deferred_references(interpreter);
+    LF_PY_TRACEPOINT(env, python_call_starts);
+    return state;
+}
+
+void py_release_interpreter(py_gil_state_t state) {
+    LF_PY_TRACEPOINT(state.env, python_call_ends);
+#ifdef LF_PYTHON_GIL_TIME_SLICE
+    if (state.kept) {
+        if (lf_time_physical() - kept_gil_since >= LF_PYTHON_GIL_TIME_SLICE) {
+            py_release_kept_gil();
+        }
+        return;
+    }
+    // Only keep a GIL that the calling thread did not hold before, and only on
+    // workers, which release it before blocking.
+    if ((state.tstate != NULL || state.gstate == PyGILState_UNLOCKED) && lf_is_worker_thread()) {
+        kept_gil_state = state;
+        kept_gil_since = lf_time_physical();
+        lf_thread_release_hook = py_release_kept_gil;
+        return;
+    }
+#endif
+    py_release_gil(state);
+}
 
 
 //////////// schedule Function(s) /////////////
@@ -70,17 +359,22 @@ environment_t* top_level_environment = NULL;
  *  action_name.schedule(NSEC(5))
  * See schedule_token(), which this uses, for details.
  * @param self Pointer to the calling object.
- * @param args contains:
- *      - action: Pointer to an action on the self struct.
+ * @param args contains, with the vectorcall convention (METH_FASTCALL):
  *      - offset: The time offset over and above that in the action.
+ *      - value: The value (optional).
+ * @param nargs The number of arguments.
  **/
-PyObject* py_schedule(PyObject *self, PyObject *args) {
+PyObject* py_schedule(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
     generic_action_capsule_struct* act = (generic_action_capsule_struct*)self;
-    long long offset;
-    PyObject* value = NULL;
-
-    if (!PyArg_ParseTuple(args, "L|O", &offset, &value))
+    if (nargs < 1 || nargs > 2) {
+        PyErr_Format(PyExc_TypeError, "schedule() takes 1 or 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+    long long offset = PyLong_AsLongLong(args[0]);
+    if (offset == -1 && PyErr_Occurred()) {
         return NULL;
+    }
+    PyObject* value = nargs > 1 ? args[1] : NULL;
 
     lf_action_base_t* action = (lf_action_base_t*)PyCapsule_GetPointer(act->action,"action");
     if (action == NULL) {
@@ -91,26 +385,190 @@ PyObject* py_schedule(PyObject *self, PyObject *args) {
     trigger_t* trigger = action->trigger;
     lf_token_t* t = NULL;
 
-    // Check to see if value exists and token is not NULL
+    // Check to see if value exists and token is not NULL.
+    // The action capsule may be shared by threads scheduling a physical action.
+    LF_PY_BEGIN_CRITICAL_SECTION(self);
     if (value && (trigger->tmplt.token != NULL)) {
         // DEBUG: adjust the element_size (might not be necessary)
         trigger->tmplt.token->type->element_size = sizeof(PyObject*);
         trigger->tmplt.type.element_size = sizeof(PyObject*);
+        // The token holds a reference to the value, which the destructor releases.
+        Py_INCREF(value);
         t = _lf_initialize_token_with_value(&trigger->tmplt, value, 1);
 
         // Also give the new value back to the Python action itself
+        PyObject* previous = act->value;
         Py_INCREF(value);
         act->value = value;
+        Py_XDECREF(previous);
     }
+    LF_PY_END_CRITICAL_SECTION();
 
 
     // Pass the token along
+    LF_PY_BEGIN_ALLOW_THREADS();
     _lf_schedule_token(action, offset, t);
+    LF_PY_END_ALLOW_THREADS();
 
     // FIXME: handle is not passed to the Python side
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    Py_RETURN_NONE;
+}
+
+/**
+ * Read the delays given to py_schedule_batch() directly from a contiguous buffer
+ * of 64-bit integers, such as a NumPy array of int64, if they are given that way.
+ * @param delays The delays.
+ * @param count The number of values, which the buffer must have.
+ * @param requests Where to store the delays.
+ * @return 1 if the delays were read, 0 if they are not in such a buffer, and -1
+ *  with a Python exception set on error.
+ */
+static int py_read_delay_buffer(PyObject* delays, Py_ssize_t count, lf_schedule_request_t* requests) {
+    if (!PyObject_CheckBuffer(delays)) {
+        return 0;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(delays, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    const char* format = view.format;
+    if (format[0] == '@' || format[0] == '=') format++;
+    int result = 0;
+    if (view.itemsize == 8 && (strcmp(format, "q") == 0 || strcmp(format, "l") == 0)) {
+        if (view.len / 8 != count) {
+            PyErr_SetString(PyExc_ValueError, "The delays and the values differ in length.");
+            result = -1;
+        } else {
+            const int64_t* values = (const int64_t*)view.buf;
+            for (Py_ssize_t i = 0; i < count; i++) {
+                requests[i].extra_delay = values[i];
+            }
+            result = 1;
+        }
+    }
+    PyBuffer_Release(&view);
+    return result;
+}
+
+/**
+ * Schedule an action several times at once, with a value and a time offset each,
+ * in one critical section and with one notification (see lf_schedule_batch()).
+ * This function is callable in Python as
+ *  action_name.schedule_batch(pairs)
+ * with an iterable of (offset, value) pairs, or as
+ *  action_name.schedule_batch(offsets, values)
+ * with a sequence of values, such as a list or a NumPy array, and either one offset
+ * for all of them or a sequence of as many offsets, such as a NumPy array of int64.
+ * The value of the action seen by the calling reaction is the last value.
+ * @param self Pointer to the calling object.
+ * @param args contains:
+ *      - pairs or offsets
+ *      - values (optional)
+ */
+PyObject* py_schedule_batch(PyObject* self, PyObject* args) {
+    generic_action_capsule_struct* act = (generic_action_capsule_struct*)self;
+    PyObject* first = NULL;
+    PyObject* second = NULL;
+    if (!PyArg_ParseTuple(args, "O|O", &first, &second)) {
+        return NULL;
+    }
+    lf_action_base_t* action = (lf_action_base_t*)PyCapsule_GetPointer(act->action, "action");
+    if (action == NULL) {
+        lf_print_error("Null pointer received.");
+        exit(1);
+    }
+
+    // The sequences of offsets and values. With pairs, offsets is NULL.
+    PyObject* values = PySequence_Fast(second != NULL ? second : first, "Expected a sequence of values.");
+    if (values == NULL) {
+        return NULL;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(values);
+    PyObject** items = PySequence_Fast_ITEMS(values);
+    PyObject* offsets = NULL;
+    lf_schedule_request_t* requests = PyMem_Malloc((count > 0 ? count : 1) * sizeof(lf_schedule_request_t));
+    if (requests == NULL) {
+        Py_DECREF(values);
+        return PyErr_NoMemory();
+    }
+
+    // Collect the offsets and the values.
+    bool failed = false;
+    if (second != NULL && PyLong_Check(first)) {
+        long long offset = PyLong_AsLongLong(first);
+        failed = (offset == -1 && PyErr_Occurred());
+        for (Py_ssize_t i = 0; i < count; i++) {
+            requests[i].extra_delay = offset;
+        }
+    } else if (second != NULL) {
+        int read = py_read_delay_buffer(first, count, requests);
+        failed = (read < 0);
+        if (read == 0) {
+            offsets = PySequence_Fast(first, "Expected an offset or a sequence of offsets.");
+            failed = (offsets == NULL);
+            if (!failed && PySequence_Fast_GET_SIZE(offsets) != count) {
+                PyErr_SetString(PyExc_ValueError, "The offsets and the values differ in length.");
+                failed = true;
+            }
+            for (Py_ssize_t i = 0; !failed && i < count; i++) {
+                requests[i].extra_delay = PyLong_AsLongLong(PySequence_Fast_GET_ITEM(offsets, i));
+                failed = (requests[i].extra_delay == -1 && PyErr_Occurred());
+            }
+        }
+    }
+    for (Py_ssize_t i = 0; !failed && i < count; i++) {
+        if (second == NULL) {
+            // An (offset, value) pair.
+            if (!PyTuple_Check(items[i]) || PyTuple_GET_SIZE(items[i]) != 2) {
+                PyErr_SetString(PyExc_TypeError, "Expected (offset, value) tuples.");
+                failed = true;
+                break;
+            }
+            requests[i].extra_delay = PyLong_AsLongLong(PyTuple_GET_ITEM(items[i], 0));
+            failed = (requests[i].extra_delay == -1 && PyErr_Occurred());
+        }
+        requests[i].action = action;
+        requests[i].token = NULL;
+    }
+    Py_XDECREF(offsets);
+    if (failed) {
+        PyMem_Free(requests);
+        Py_DECREF(values);
+        return NULL;
+    }
+
+    trigger_t* trigger = action->trigger;
+    if (trigger->tmplt.token != NULL) {
+        trigger->tmplt.type.element_size = sizeof(PyObject*);
+        for (Py_ssize_t i = 0; i < count; i++) {
+            PyObject* value = second != NULL ? items[i] : PyTuple_GET_ITEM(items[i], 1);
+            // Each token holds a reference to its value, which the destructor releases.
+            Py_INCREF(value);
+            requests[i].token = _lf_new_token((token_type_t*)&trigger->tmplt, value, 1);
+        }
+    }
+
+    if (count > 0) {
+        LF_PY_BEGIN_ALLOW_THREADS();
+        _lf_schedule_batch(requests, (size_t)count, NULL);
+        LF_PY_END_ALLOW_THREADS();
+    }
+
+    // Also give the last value back to the Python action itself.
+    if (count > 0 && trigger->tmplt.token != NULL) {
+        PyObject* last = second != NULL ? items[count - 1] : PyTuple_GET_ITEM(items[count - 1], 1);
+        LF_PY_BEGIN_CRITICAL_SECTION(self);
+        PyObject* previous = act->value;
+        Py_INCREF(last);
+        act->value = last;
+        Py_XDECREF(previous);
+        LF_PY_END_CRITICAL_SECTION();
+    }
+    PyMem_Free(requests);
+    Py_DECREF(values);
+    Py_RETURN_NONE;
 }
 
 
@@ -134,7 +592,9 @@ PyObject* py_schedule_copy(PyObject *self, PyObject *args) {
         exit(1);
     }
 
+    LF_PY_BEGIN_ALLOW_THREADS();
     _lf_schedule_copy(action, offset, value, length);
+    LF_PY_END_ALLOW_THREADS();
 
     // FIXME: handle is not passed to the Python side
 
@@ -158,7 +618,10 @@ void lf_request_stop(void);
  * Stop execution at the conclusion of the current logical time.
  */
 PyObject* py_request_stop(PyObject *self, PyObject *args) {
+    // This acquires the mutex of every environment.
+    LF_PY_BEGIN_ALLOW_THREADS();
     lf_request_stop();
+    LF_PY_END_ALLOW_THREADS();
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -250,6 +713,95 @@ void py_initialize_interpreter(void) {
     }
 }
 
+#ifdef LF_PYTHON_SUBINTERPRETERS
+/**
+ * Create a sub-interpreter with its own GIL for each environment but the top-level one.
+ * Each sub-interpreter gets the module search path of the main interpreter and loads
+ * its own copy of the main script under the name "__lf_main__", so that it instantiates
+ * the reactor classes without starting the program again, and its own pickle module.
+ * This function assumes that the caller holds the GIL of the main interpreter, which it
+ * still holds upon returning.
+ * @param envs The environments.
+ * @param num_environments The number of environments.
+ */
+static void py_initialize_subinterpreters(environment_t* envs, int num_environments) {
+    if (num_environments < 2) {
+        return;
+    }
+    // The code that loads the main script, with the values of the main interpreter
+    // given as literals, since objects cannot be shared between interpreters.
+    PyObject* main_module = PyImport_AddModule("__main__");
+    PyObject* main_file = (main_module == NULL) ? NULL : PyObject_GetAttrString(main_module, "__file__");
+    PyObject* path = PySys_GetObject("path");
+    if (main_file == NULL || path == NULL) {
+        PyErr_Print();
+        lf_print_error_and_exit("Failed to find the main script to load in Python sub-interpreters.");
+    }
+    PyObject* setup = PyUnicode_FromFormat(
+        "import sys, importlib.util\n"
+        "sys.path[:] = %R\n"
+        "_lf_spec = importlib.util.spec_from_file_location('__lf_main__', %R)\n"
+        "_lf_main = importlib.util.module_from_spec(_lf_spec)\n"
+        "sys.modules['__lf_main__'] = _lf_main\n"
+        "_lf_spec.loader.exec_module(_lf_main)\n"
+        "del _lf_spec, _lf_main\n",
+        path, main_file);
+    Py_DECREF(main_file);
+    if (setup == NULL) {
+        PyErr_Print();
+        lf_print_error_and_exit("Failed to prepare Python sub-interpreters.");
+    }
+    char* setup_code = strdup(PyUnicode_AsUTF8(setup));
+    Py_DECREF(setup);
+
+    num_subinterpreters = num_environments - 1;
+    subinterpreter_states = (py_interpreter_state_t*)calloc(num_subinterpreters, sizeof(py_interpreter_state_t));
+    thread_states = (PyThreadState**)calloc(num_subinterpreters, sizeof(PyThreadState*));
+    if (setup_code == NULL || subinterpreter_states == NULL || thread_states == NULL) {
+        lf_print_error_and_exit("Out of memory.");
+    }
+
+    const PyInterpreterConfig config = {
+        .use_main_obmalloc = 0,
+        .allow_fork = 0,
+        .allow_exec = 0,
+        .allow_threads = 1,
+        .allow_daemon_threads = 0,
+        .check_multi_interp_extensions = 1,
+        .gil = PyInterpreterConfig_OWN_GIL,
+    };
+    PyThreadState* main_thread_state = PyThreadState_Get();
+    for (int i = 0; i < num_subinterpreters; i++) {
+        py_interpreter_state_t* state = &subinterpreter_states[i];
+        state->env = &envs[i + 1];
+        // Upon success, the new interpreter is attached and holds its GIL,
+        // whereas that of the main interpreter is released.
+        PyStatus status = Py_NewInterpreterFromConfig(&thread_states[i], &config);
+        if (PyStatus_Exception(status)) {
+            lf_print_error_and_exit("Failed to create a Python sub-interpreter for environment %d.", i + 1);
+        }
+        // Register the interpreter before the extension module is imported into it.
+        state->interpreter = PyThreadState_GetInterpreter(thread_states[i]);
+        if (PyRun_SimpleString(setup_code) != 0) {
+            lf_print_error_and_exit("Failed to load the main script in the Python sub-interpreter of environment %d.",
+                                    i + 1);
+        }
+        state->module = PyImport_ImportModule("__lf_main__");
+        state->pickler = PyImport_ImportModule("pickle");
+        if (state->module == NULL || state->pickler == NULL) {
+            PyErr_Print();
+            lf_print_error_and_exit("Failed to load modules in the Python sub-interpreter of environment %d.", i + 1);
+        }
+        state->module_dict = PyModule_GetDict(state->module);
+        Py_INCREF(state->module_dict);
+        PyEval_SaveThread();
+        PyEval_RestoreThread(main_thread_state);
+    }
+    free(setup_code);
+    LF_PRINT_LOG("Created %d Python sub-interpreters.", num_subinterpreters);
+}
+#endif // LF_PYTHON_SUBINTERPRETERS
+
 //////////////////////////////////////////////////////////////
 ///////////// Main function callable from Python code
 /**
@@ -268,9 +820,9 @@ PyObject* py_main(PyObject* self, PyObject* py_args) {
     py_initialize_interpreter();
 
     // Load the pickle module
-    if (global_pickler == NULL) {
-        global_pickler = PyImport_ImportModule("pickle");
-        if (global_pickler == NULL) {
+    if (main_interpreter_state.pickler == NULL) {
+        main_interpreter_state.pickler = PyImport_ImportModule("pickle");
+        if (main_interpreter_state.pickler == NULL) {
             if (PyErr_Occurred()) {
                 PyErr_Print();
             }
@@ -280,7 +832,13 @@ PyObject* py_main(PyObject* self, PyObject* py_args) {
 
     // Store a reference to the top-level environment
     int num_environments = _lf_get_environments(&top_level_environment);
-    lf_assert(num_environments == 1, "Python target only supports programs with a single environment/enclave");
+    main_interpreter_state.env = top_level_environment;
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    py_initialize_subinterpreters(top_level_environment, num_environments);
+#else
+    lf_assert(num_environments == 1, "Python target only supports programs with a single environment/enclave"
+              " unless LF_PYTHON_SUBINTERPRETERS is defined");
+#endif
 
     Py_BEGIN_ALLOW_THREADS
     lf_reactor_c_main(argc, argv);
@@ -301,32 +859,114 @@ PyObject* py_main(PyObject* self, PyObject* py_args) {
  * start() initiates the main loop in the C core library
  * @see schedule_copy
  * @see request_stop
+ * @see set_serializer
  */
 static PyMethodDef GEN_NAME(MODULE_NAME,_methods)[] = {
   {"start", py_main, METH_VARARGS, NULL},
   {"schedule_copy", py_schedule_copy, METH_VARARGS, NULL},
   {"tag", py_lf_tag, METH_NOARGS, NULL},
-  {"tag_compare", py_tag_compare, METH_VARARGS, NULL},
+  {"tag_compare", (PyCFunction)(void(*)(void)) py_tag_compare, METH_FASTCALL, NULL},
   {"request_stop", py_request_stop, METH_NOARGS, "Request stop"},
+  {"set_serializer", py_set_serializer, METH_VARARGS, "Set the serializer of values sent to other federates"},
   {NULL, NULL, 0, NULL}
 };
 
 
+
+//////////////////////////////////////////////////////////////
+/////////////  Module Initialization
+
+/**
+ * Create a type of this module in the interpreter that executes the module
+ * and add it to the module's dictionary.
+ * @param m The module.
+ * @param name The name of the type in the module.
+ * @param spec The specification of the type.
+ * @param type Where to store the type, which is kept for the lifetime of the interpreter.
+ * @return 0 on success and -1 on failure.
+ */
+static int py_add_type(PyObject* m, const char* name, PyType_Spec* spec, PyTypeObject** type) {
+    *type = (PyTypeObject*) PyType_FromSpec(spec);
+    if (*type == NULL) {
+        return -1;
+    }
+    Py_INCREF(*type);
+    if (PyModule_AddObject(m, name, (PyObject *) *type) < 0) {
+        Py_DECREF(*type);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Execute the module in an interpreter, which may be a sub-interpreter.
+ * The types are created in each interpreter and stored in its
+ * py_interpreter_state_t, since interpreters with their own GIL
+ * cannot share objects.
+ * @param m The module.
+ * @return 0 on success and -1 on failure.
+ */
+static int py_module_exec(PyObject* m) {
+    py_interpreter_state_t* state = py_interpreter_state();
+
+    // Add the port_capsule type to the module's dictionary
+    if (py_add_type(m, "port_capsule", &py_port_capsule_spec, &state->port_capsule_type) < 0) {
+        return -1;
+    }
+
+    // Add the action_capsule type to the module's dictionary
+    if (py_add_type(m, "action_capsule_t", &py_action_capsule_spec, &state->action_capsule_type) < 0) {
+        return -1;
+    }
+
+    // Add the Tag type to the module's dictionary
+    if (py_add_type(m, "Tag", &py_tag_spec, &state->tag_type) < 0) {
+        return -1;
+    }
+
+    // Add the Time type to the module's dictionary
+    if (py_add_type(m, "time", &py_time_spec, &state->time_type) < 0) {
+        return -1;
+    }
+
+    // Add the buffer type, which exports the data of messages sent without pickling
+    if (py_add_type(m, "buffer", &py_buffer_spec, &state->buffer_type) < 0) {
+        return -1;
+    }
+
+    initialize_mode_capsule_t(m);
+    return 0;
+}
+
+/**
+ * The slots of the module, which use multi-phase initialization (PEP 489)
+ * so that the module can be imported in sub-interpreters.
+ */
+static PyModuleDef_Slot GEN_NAME(MODULE_NAME,_slots)[] = {
+    {Py_mod_exec, (void*) py_module_exec},
+#ifdef LF_PYTHON_SUBINTERPRETERS
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_GIL_DISABLED
+    // Declare that the module does not need the GIL, or importing it would enable the GIL again.
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
 /**
  * Define the Lingua Franca module.
  * The MODULE_NAME is given by the generated code.
  */
 static PyModuleDef MODULE_NAME = {
     PyModuleDef_HEAD_INIT,
-    TOSTRING(MODULE_NAME),
-    "LinguaFranca Python Module",
-    -1,
-    GEN_NAME(MODULE_NAME,_methods)
+    .m_name = TOSTRING(MODULE_NAME),
+    .m_doc = "LinguaFranca Python Module",
+    .m_size = 0,
+    .m_methods = GEN_NAME(MODULE_NAME,_methods),
+    .m_slots = GEN_NAME(MODULE_NAME,_slots),
 };
 
-//////////////////////////////////////////////////////////////
-/////////////  Module Initialization
-
 /*
  * The Python runtime will call this function to initialize the module.
  * The name of this function is dynamically generated to follow
@@ -338,73 +978,11 @@ static PyModuleDef MODULE_NAME = {
  */
 PyMODINIT_FUNC
 GEN_NAME(PyInit_,MODULE_NAME)(void) {
-
-    PyObject *m;
-
     // As of Python 11, this function may be called before py_main, so we need to
     // initialize the interpreter.
     py_initialize_interpreter();
 
-    // Initialize the port_capsule type
-    if (PyType_Ready(&py_port_capsule_t) < 0) {
-        return NULL;
-    }
-
-    // Initialize the action_capsule type
-    if (PyType_Ready(&py_action_capsule_t) < 0) {
-        return NULL;
-    }
-
-    // Initialize the Tag type
-    if (PyType_Ready(&PyTagType) < 0) {
-        return NULL;
-    }
-
-    // Initialize the Time type
-    if (PyType_Ready(&PyTimeType) < 0) {
-        return NULL;
-    }
-
-    m = PyModule_Create(&MODULE_NAME);
-
-    if (m == NULL) {
-        return NULL;
-    }
-
-    initialize_mode_capsule_t(m);
-
-    // Add the port_capsule type to the module's dictionary
-    Py_INCREF(&py_port_capsule_t);
-    if (PyModule_AddObject(m, "port_capsule", (PyObject *) &py_port_capsule_t) < 0) {
-        Py_DECREF(&py_port_capsule_t);
-        Py_DECREF(m);
-        return NULL;
-    }
-
-    // Add the action_capsule type to the module's dictionary
-    Py_INCREF(&py_action_capsule_t);
-    if (PyModule_AddObject(m, "action_capsule_t", (PyObject *) &py_action_capsule_t) < 0) {
-        Py_DECREF(&py_action_capsule_t);
-        Py_DECREF(m);
-        return NULL;
-    }
-
-    // Add the Tag type to the module's dictionary
-    Py_INCREF(&PyTagType);
-    if (PyModule_AddObject(m, "Tag", (PyObject *) &PyTagType) < 0) {
-        Py_DECREF(&PyTagType);
-        Py_DECREF(m);
-        return NULL;
-    }
-
-    // Add the Time type to the module's dictionary
-    Py_INCREF(&PyTimeType);
-    if (PyModule_AddObject(m, "time", (PyObject *) &PyTimeType) < 0) {
-        Py_DECREF(&PyTimeType);
-        Py_DECREF(m);
-        return NULL;
-    }
-    return m;
+    return PyModuleDef_Init(&MODULE_NAME);
 }
 
 //////////////////////////////////////////////////////////////
@@ -419,6 +997,86 @@ void destroy_action_capsule(PyObject* capsule) {
     free(PyCapsule_GetPointer(capsule, "action"));
 }
 
+/**
+ * Return the index of the slot of the specified key in the cache,
+ * which is the slot that holds the key or else the empty slot where
+ * to insert it. The cache must not be full.
+ */
+static size_t py_capsule_cache_slot(py_capsule_cache_t* cache, const void* key) {
+    size_t mask = cache->capacity - 1;
+    size_t i = (size_t)(((uintptr_t)key >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+    while (cache->keys[i] != NULL && cache->keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * Return the capsule for the specified key in the cache (a borrowed
+ * reference), or NULL if there is none.
+ */
+static PyObject* py_capsule_cache_get(py_capsule_cache_t* cache, const void* key) {
+    PyObject* capsule = NULL;
+#ifdef Py_GIL_DISABLED
+    PyMutex_Lock(&cache->mutex);
+#endif
+    if (cache->capacity > 0) {
+        capsule = cache->capsules[py_capsule_cache_slot(cache, key)];
+    }
+#ifdef Py_GIL_DISABLED
+    PyMutex_Unlock(&cache->mutex);
+#endif
+    return capsule;
+}
+
+/**
+ * Add the specified capsule to the cache, which takes over the reference to
+ * it, unless the key already has a capsule, in which case the specified capsule
+ * is released. The table doubles in size when it becomes half full.
+ * @return The capsule of the key in the cache (a borrowed reference).
+ */
+static PyObject* py_capsule_cache_put(py_capsule_cache_t* cache, const void* key, PyObject* capsule) {
+#ifdef Py_GIL_DISABLED
+    PyMutex_Lock(&cache->mutex);
+#endif
+    if (2 * (cache->size + 1) > cache->capacity) {
+        py_capsule_cache_t larger = *cache;
+        larger.capacity = (cache->capacity == 0) ? 64 : 2 * cache->capacity;
+        larger.keys = (const void**)calloc(larger.capacity, sizeof(void*));
+        larger.capsules = (PyObject**)calloc(larger.capacity, sizeof(PyObject*));
+        if (larger.keys == NULL || larger.capsules == NULL) {
+            lf_print_error_and_exit("Out of memory.");
+        }
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->keys[i] != NULL) {
+                size_t j = py_capsule_cache_slot(&larger, cache->keys[i]);
+                larger.keys[j] = cache->keys[i];
+                larger.capsules[j] = cache->capsules[i];
+            }
+        }
+        free(cache->keys);
+        free(cache->capsules);
+        cache->keys = larger.keys;
+        cache->capsules = larger.capsules;
+        cache->capacity = larger.capacity;
+    }
+    size_t i = py_capsule_cache_slot(cache, key);
+    PyObject* existing = cache->capsules[i];
+    if (existing == NULL) {
+        cache->keys[i] = key;
+        cache->capsules[i] = capsule;
+        cache->size++;
+    }
+#ifdef Py_GIL_DISABLED
+    PyMutex_Unlock(&cache->mutex);
+#endif
+    if (existing != NULL) {
+        Py_DECREF(capsule);
+        return existing;
+    }
+    return capsule;
+}
+
 /**
  * A function that is called any time a Python reaction is called with
  * ports as inputs and outputs. This function converts ports that are
@@ -433,50 +1091,53 @@ void destroy_action_capsule(PyObject* capsule) {
  * For multiports, the value of the port_capsule (i.e., port.value) is always
  * set to None and is_present is set to false.
  * Individual ports can then later be accessed in Python code as port[idx].
+ *
+ * The port_capsule and its PyCapsule are only created the first time, after which
+ * the value and is_present fields are updated in place.
  */
 PyObject* convert_C_port_to_py(void* port, int width) {
-    // Create the port struct in Python
-    PyObject* cap =
-        (PyObject*)PyObject_New(generic_port_capsule_struct, &py_port_capsule_t);
+    py_interpreter_state_t* state = py_interpreter_state();
+    generic_port_capsule_struct* cap =
+        (generic_port_capsule_struct*)py_capsule_cache_get(&state->capsules, port);
     if (cap == NULL) {
-        lf_print_error_and_exit("Failed to convert port.");
-    }
+        // Create the port struct in Python, with value None and is_present false
+        PyTypeObject* type = state->port_capsule_type;
+        cap = (generic_port_capsule_struct*)type->tp_new(type, NULL, NULL);
+        if (cap == NULL) {
+            lf_print_error_and_exit("Failed to convert port.");
+        }
 
-    // Create the capsule to hold the void* port
-    PyObject* capsule = PyCapsule_New(port, "port", NULL);
-    if (capsule == NULL) {
-        lf_print_error_and_exit("Failed to convert port.");
+        // Create the capsule to hold the void* port
+        cap->port = PyCapsule_New(port, "port", NULL);
+        if (cap->port == NULL) {
+            lf_print_error_and_exit("Failed to convert port.");
+        }
+        cap->width = width;
+        cap = (generic_port_capsule_struct*)py_capsule_cache_put(&state->capsules, port, (PyObject*)cap);
     }
 
-    // Fill in the Python port struct
-    ((generic_port_capsule_struct*)cap)->port = capsule;
-    ((generic_port_capsule_struct*)cap)->width = width;
-
-    if (width == -2) {
-        generic_port_instance_struct* cport = (generic_port_instance_struct *) port;
-        FEDERATED_ASSIGN_FIELDS(((generic_port_capsule_struct*)cap), cport);
-
-        ((generic_port_capsule_struct*)cap)->is_present =
-            cport->is_present;
-
-        if (cport->value == NULL) {
-            // Value is absent
-            Py_INCREF(Py_None);
-            ((generic_port_capsule_struct*)cap)->value = Py_None;
-            return cap;
-        }
+    // Multiport. Value of the multiport itself cannot be accessed, so it remains None.
+    if (width != -2) {
+        Py_INCREF(cap);
+        return (PyObject*)cap;
+    }
 
-        //Py_INCREF(cport->value);
-        ((generic_port_capsule_struct*)cap)->value = cport->value;
-    } else {
-        // Multiport. Value of the multiport itself cannot be accessed, so we set it to
-        // None.
-        Py_INCREF(Py_None);
-        ((generic_port_capsule_struct*)cap)->value = Py_None;
-        ((generic_port_capsule_struct*)cap)->is_present = false;
+    // Update the Python port struct. Value is None if absent.
+    generic_port_instance_struct* cport = (generic_port_instance_struct *) port;
+    PyObject* value = (cport->value == NULL) ? Py_None : cport->value;
+    LF_PY_BEGIN_CRITICAL_SECTION((PyObject*)cap);
+    FEDERATED_ASSIGN_FIELDS(cap, cport);
+    cap->is_present = cport->is_present;
+    if (cap->value != value) {
+        PyObject* previous = cap->value;
+        Py_INCREF(value);
+        cap->value = value;
+        Py_XDECREF(previous);
     }
+    LF_PY_END_CRITICAL_SECTION();
 
-    return cap;
+    Py_INCREF(cap);
+    return (PyObject*)cap;
 }
 
 /**
@@ -500,45 +1161,58 @@ PyObject* convert_C_port_to_py(void* port, int width) {
  * capsule can then be treated as a PyObject* and safely passed through Python code. On the other end
  * (which is in schedule functions), PyCapsule_GetPointer(received_action,"action") can be called to retrieve
  * the void* pointer into received_action.
+ *
+ * As for ports, the action capsule is only created the first time and then updated in place.
  **/
 PyObject* convert_C_action_to_py(void* action) {
     // Convert to trigger_t
     trigger_t* trigger = ((lf_action_base_t*)action)->trigger;
 
-    // Create the action struct in Python
-    PyObject* cap = (PyObject*)PyObject_New(generic_action_capsule_struct, &py_action_capsule_t);
+    py_interpreter_state_t* state = py_interpreter_state();
+    generic_action_capsule_struct* cap =
+        (generic_action_capsule_struct*)py_capsule_cache_get(&state->capsules, action);
     if (cap == NULL) {
-        lf_print_error_and_exit("Failed to convert action.");
-    }
+        // Create the action struct in Python
+        PyTypeObject* type = state->action_capsule_type;
+        cap = (generic_action_capsule_struct*)type->tp_new(type, NULL, NULL);
+        if (cap == NULL) {
+            lf_print_error_and_exit("Failed to convert action.");
+        }
 
-    // Create the capsule to hold the void* action
-    PyObject* capsule = PyCapsule_New(action, "action", NULL);
-    if (capsule == NULL) {
-        lf_print_error_and_exit("Failed to convert action.");
+        // Create the capsule to hold the void* action
+        cap->action = PyCapsule_New(action, "action", NULL);
+        if (cap->action == NULL) {
+            lf_print_error_and_exit("Failed to convert action.");
+        }
+        cap = (generic_action_capsule_struct*)py_capsule_cache_put(&state->capsules, action, (PyObject*)cap);
     }
 
-    // Fill in the Python action struct
-    ((generic_action_capsule_struct*)cap)->action = capsule;
-    ((generic_action_capsule_struct*)cap)->is_present = trigger->status;
-    FEDERATED_ASSIGN_FIELDS(((generic_port_capsule_struct*)cap), ((generic_action_instance_struct*)action));
-
-    // If token is not initialized, that is all we need to set
-    if (trigger->tmplt.token == NULL) {
-        Py_INCREF(Py_None);
-        ((generic_action_capsule_struct*)cap)->value = Py_None;
-        return cap;
+    // If token is not initialized, the value is None
+    PyObject* value = Py_None;
+    if (trigger->tmplt.token != NULL) {
+        // Default value is None
+        if (trigger->tmplt.token->value == NULL) {
+            Py_INCREF(Py_None);
+            trigger->tmplt.token->value = Py_None;
+        }
+        // Actions in Python always use token type
+        value = trigger->tmplt.token->value;
     }
 
-    // Default value is None
-    if (trigger->tmplt.token->value == NULL) {
-        Py_INCREF(Py_None);
-        trigger->tmplt.token->value = Py_None;
+    // Update the Python action struct
+    LF_PY_BEGIN_CRITICAL_SECTION((PyObject*)cap);
+    cap->is_present = trigger->status;
+    FEDERATED_ASSIGN_FIELDS(cap, ((generic_action_instance_struct*)action));
+    if (cap->value != value) {
+        PyObject* previous = cap->value;
+        Py_INCREF(value);
+        cap->value = value;
+        Py_XDECREF(previous);
     }
+    LF_PY_END_CRITICAL_SECTION();
 
-    // Actions in Python always use token type
-    ((generic_action_capsule_struct*)cap)->value = trigger->tmplt.token->value;
-
-    return cap;
+    Py_INCREF(cap);
+    return (PyObject*)cap;
 }
 
 /**
@@ -556,37 +1230,33 @@ PyObject* convert_C_action_to_py(void* action) {
  *               be set to "__main__"
  * @param class The name of the list of classes in the generated Python code
  * @param instance_id The element number in the list of classes. class[instance_id] points to a class instance
- * @param func The reaction functino to be called
- * @param pArgs the PyList of arguments to be sent to function func()
- * @return The function or NULL on error.
+ * @param func The reaction function to be called
+ * @return A new reference to the function, or to None on error.
  */
 PyObject*
 get_python_function(string module, string class, int instance_id, string func) {
-    LF_PRINT_DEBUG("Starting the function start().");
+    return get_python_function_in_environment(NULL, module, class, instance_id, func);
+}
 
-    // Necessary PyObject variables to load the react() function from test.py
-    PyObject* pFileName = NULL;
-    PyObject* pModule = NULL;
-    PyObject* pDict = NULL;
-    PyObject* pClasses = NULL;
-    PyObject* pClass = NULL;
-    PyObject* pFunc = NULL;
-
-    // According to
-    // https://docs.python.org/3/c-api/init.html#non-python-created-threads
-    // the following code does the following:
-    // - Register this thread with the interpreter
-    // - Acquire the GIL (Global Interpreter Lock)
-    // - Store (return) the thread pointer
-    // When done, we should always call PyGILState_Release(gstate);
-    PyGILState_STATE gstate;
-    gstate = PyGILState_Ensure();
-
-    // If the Python module is already loaded, skip this.
-    if (globalPythonModule == NULL) {
-        // Decode the MODULE name into a filesystem compatible string
-        pFileName = PyUnicode_DecodeFSDefault(module);
+PyObject*
+get_python_function_in_environment(environment_t* env, string module, string class,
+                                   int instance_id, string func) {
+    PyObject* function = NULL;
+    py_function_request_t request = {class, instance_id, func, &function};
+    get_python_functions(env, module, &request, 1);
+    return function;
+}
 
+/**
+ * Load the specified module into the specified interpreter, unless it has already
+ * been loaded. The calling thread must hold the GIL of the interpreter.
+ * @param state The state of the interpreter.
+ * @param module The name of the module.
+ * @return true if the module is loaded.
+ */
+static bool py_load_module(py_interpreter_state_t* state, string module) {
+    LF_PY_MODULE_LOCK();
+    if (state->module == NULL) {
         // Set the Python search path to be the current working directory
         char cwd[PATH_MAX];
         if ( getcwd(cwd, sizeof(cwd)) == NULL) {
@@ -610,94 +1280,138 @@ get_python_function(string module, string class, int instance_id, string func) {
 
         LF_PRINT_DEBUG("Loading module %s in %s.", module, cwd);
 
-        pModule = PyImport_Import(pFileName);
+        // Decode the MODULE name into a filesystem compatible string
+        PyObject* pFileName = PyUnicode_DecodeFSDefault(module);
+        PyObject* pModule = pFileName == NULL ? NULL : PyImport_Import(pFileName);
+        Py_XDECREF(pFileName);
 
         LF_PRINT_DEBUG("Loaded module %p.", pModule);
 
-        // Free the memory occupied by pFileName
-        Py_DECREF(pFileName);
-
         // Check if the module was correctly loaded
         if (pModule != NULL) {
             // Get contents of module. pDict is a borrowed reference.
-            pDict = PyModule_GetDict(pModule);
+            PyObject* pDict = PyModule_GetDict(pModule);
             if (pDict == NULL) {
                 PyErr_Print();
                 lf_print_error("Failed to load contents of module %s.", module);
-                /* Release the thread. No Python API allowed beyond this point. */
-                PyGILState_Release(gstate);
-                return NULL;
+                Py_DECREF(pModule);
+            } else {
+                // The state holds the reference returned by the import.
+                state->module = pModule;
+                Py_INCREF(pDict);
+                state->module_dict = pDict;
             }
-
-            Py_INCREF(pModule);
-            globalPythonModule = pModule;
-            Py_INCREF(pDict);
-            globalPythonModuleDict = pDict;
-
+        } else {
+            PyErr_Print();
+            lf_print_error("Failed to load \"%s\".", module);
         }
     }
+    bool loaded = state->module != NULL && state->module_dict != NULL;
+    LF_PY_MODULE_UNLOCK();
+    return loaded;
+}
 
-    if (globalPythonModule != NULL && globalPythonModuleDict != NULL) {
-        Py_INCREF(globalPythonModule);
-        // Convert the class name to a PyObject
-        PyObject* list_name = PyUnicode_DecodeFSDefault(class);
-
-        // Get the class list
-        Py_INCREF(globalPythonModuleDict);
-        pClasses = PyDict_GetItem(globalPythonModuleDict, list_name);
-        if (pClasses == NULL){
-            PyErr_Print();
-            lf_print_error("Failed to load class list \"%s\" in module %s.", class, module);
-            /* Release the thread. No Python API allowed beyond this point. */
-            PyGILState_Release(gstate);
-            return NULL;
-        }
+/** The number of distinct names that get_python_functions() interns at most. */
+#define PY_NAME_CACHE_SIZE 32
 
-        Py_DECREF(globalPythonModuleDict);
+/**
+ * Names of classes and functions interned by get_python_functions(), which the
+ * generated code gives as the same few strings for all instances of a class.
+ */
+typedef struct {
+    int size;
+    string names[PY_NAME_CACHE_SIZE];
+    PyObject* objects[PY_NAME_CACHE_SIZE];
+} py_name_cache_t;
 
-        pClass = PyList_GetItem(pClasses, instance_id);
-        if (pClass == NULL) {
-            PyErr_Print();
-            lf_print_error("Failed to load class \"%s[%d]\" in module %s.", class, instance_id, module);
-            /* Release the thread. No Python API allowed beyond this point. */
-            PyGILState_Release(gstate);
-            return NULL;
+/**
+ * Return a new reference to the interned Python string of the specified name,
+ * creating it only if the cache does not have it.
+ * @return The string, or NULL with a Python exception set.
+ */
+static PyObject* py_intern_name(py_name_cache_t* cache, string name) {
+    for (int i = 0; i < cache->size; i++) {
+        if (cache->names[i] == name || strcmp(cache->names[i], name) == 0) {
+            Py_INCREF(cache->objects[i]);
+            return cache->objects[i];
         }
+    }
+    PyObject* object = PyUnicode_InternFromString(name);
+    if (object != NULL && cache->size < PY_NAME_CACHE_SIZE) {
+        cache->names[cache->size] = name;
+        Py_INCREF(object);
+        cache->objects[cache->size++] = object;
+    }
+    return object;
+}
 
-        LF_PRINT_DEBUG("Loading function %s.", func);
-
-        // Get the function react from test.py
-        pFunc = PyObject_GetAttrString(pClass, func);
-
-        LF_PRINT_DEBUG("Loaded function %p.", pFunc);
-
-        // Check if the funciton is loaded properly
-        // and if it is callable
-        if (pFunc && PyCallable_Check(pFunc)) {
-            LF_PRINT_DEBUG("Calling function %s from class %s[%d].", func , class, instance_id);
-            Py_INCREF(pFunc);
-            /* Release the thread. No Python API allowed beyond this point. */
-            PyGILState_Release(gstate);
-            return pFunc;
+size_t get_python_functions(environment_t* env, string module, py_function_request_t* requests, size_t count) {
+    // The interpreter is that of the environment (see py_acquire_interpreter).
+    // The GIL is acquired once for all the functions.
+    py_gil_state_t gstate = py_acquire_interpreter(env);
+    py_interpreter_state_t* state = py_environment_state(env);
+    bool loaded = py_load_module(state, module);
+
+    size_t failures = 0;
+    py_name_cache_t names = {.size = 0};
+    // The class list of the previous request, which consecutive requests usually share.
+    string class = NULL;
+    PyObject* pClasses = NULL;
+    for (size_t i = 0; i < count; i++) {
+        py_function_request_t* request = &requests[i];
+        PyObject* pFunc = NULL;
+        if (loaded && (class == NULL || strcmp(class, request->class) != 0)) {
+            Py_XDECREF(pClasses);
+            class = request->class;
+            // Get the class list
+            PyObject* list_name = py_intern_name(&names, class);
+            pClasses = list_name == NULL ? NULL : PyDict_GetItemWithError(state->module_dict, list_name);
+            Py_XDECREF(list_name);
+            if (pClasses == NULL) {
+                if (PyErr_Occurred()) {
+                    PyErr_Print();
+                }
+                lf_print_error("Failed to load class list \"%s\" in module %s.", class, module);
+            }
+            // The dictionary only lends the list, which reactors could remove from it.
+            Py_XINCREF(pClasses);
         }
-        else {
-            // Function is not found or it is not callable
-            if (PyErr_Occurred()) {
-                PyErr_Print();
+        PyObject* pClass = pClasses == NULL ? NULL : PySequence_GetItem(pClasses, request->instance_id);
+        if (pClasses != NULL && pClass == NULL) {
+            PyErr_Print();
+            lf_print_error("Failed to load class \"%s[%d]\" in module %s.", request->class, request->instance_id, module);
+        }
+        if (pClass != NULL) {
+            LF_PRINT_DEBUG("Loading function %s.", request->func);
+            PyObject* func_name = py_intern_name(&names, request->func);
+            pFunc = func_name == NULL ? NULL : PyObject_GetAttr(pClass, func_name);
+            Py_XDECREF(func_name);
+            Py_DECREF(pClass);
+            LF_PRINT_DEBUG("Loaded function %p.", pFunc);
+
+            // Check if the function is loaded properly and if it is callable
+            if (pFunc == NULL || !PyCallable_Check(pFunc)) {
+                // Function is not found or it is not callable
+                if (PyErr_Occurred()) {
+                    PyErr_Print();
+                }
+                lf_print_error("Function %s was not found or is not callable.", request->func);
+                Py_CLEAR(pFunc);
             }
-            lf_print_error("Function %s was not found or is not callable.", func);
         }
-        Py_XDECREF(pFunc);
-        Py_DECREF(globalPythonModule);
-    } else {
-        PyErr_Print();
-        lf_print_error("Failed to load \"%s\".", module);
+        if (pFunc == NULL) {
+            failures++;
+            Py_INCREF(Py_None);
+            pFunc = Py_None;
+        }
+        *request->function = pFunc;
+    }
+    Py_XDECREF(pClasses);
+    for (int i = 0; i < names.size; i++) {
+        Py_DECREF(names.objects[i]);
     }
 
-    LF_PRINT_DEBUG("Done with start().");
-
-    Py_INCREF(Py_None);
     /* Release the thread. No Python API allowed beyond this point. */
-    PyGILState_Release(gstate);
-    return Py_None;
+    py_release_interpreter(gstate);
+    return failures;
 }
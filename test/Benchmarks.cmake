@@ -0,0 +1,67 @@
+# This adds the benchmarks in the benchmark directory. Benchmarks link the
+# core library directly and provide their own stand-ins for generated code or
+# use those of the test library, and only a quick run of each is registered as
+# a test. Run the
+# executables directly to measure performance. The scheduler benchmark
+# measures the scheduler selected with -DSCHEDULER, or with -s if the runtime
+# is built with -DLF_SCHED_DYNAMIC to link all schedulers; see
+# test/benchmark/run_scheduler_benchmarks.sh to compare several schedulers.
+# The tag benchmark compares the tag arithmetic with its former implementation.
+# The sleep benchmark reports how precisely the platform wakes up from sleeps
+# and timed waits.
+# The Savina benchmark runs actor benchmarks on the whole runtime; the
+# savina_benchmarks target runs test/benchmark/run_savina_benchmarks.sh to
+# collect their results for several schedulers in savina_benchmarks.csv.
+
+set(BENCHMARK_DIR ${CMAKE_CURRENT_SOURCE_DIR}/test/benchmark)
+
+if(NOT DEFINED LF_SINGLE_THREADED AND NOT DEFINED FEDERATED)
+    add_executable(scheduler_benchmark ${BENCHMARK_DIR}/scheduler_benchmark.c)
+    target_link_libraries(
+        scheduler_benchmark PUBLIC
+        ${CoreLib} ${Lib}
+    )
+    add_test(NAME benchmark_scheduler_benchmark_quick COMMAND scheduler_benchmark -q -r 2 -w 4)
+    if(DEFINED LF_SCHED_DYNAMIC)
+        foreach(SCHEDULER_NAME NP NP_WS GEDF_NP GEDF_NP_LF ADAPTIVE CHAIN_NP STATIC)
+            add_test(
+                NAME benchmark_scheduler_benchmark_quick_${SCHEDULER_NAME}
+                COMMAND scheduler_benchmark -q -r 2 -w 4 -s ${SCHEDULER_NAME}
+            )
+        endforeach()
+    endif()
+endif()
+
+add_executable(tag_benchmark ${BENCHMARK_DIR}/tag_benchmark.c)
+target_link_libraries(
+    tag_benchmark PUBLIC
+    ${CoreLib} ${Lib} ${TestLib}
+)
+add_test(NAME benchmark_tag_benchmark_quick COMMAND tag_benchmark -q)
+
+add_executable(sleep_benchmark ${BENCHMARK_DIR}/sleep_benchmark.c)
+target_link_libraries(
+    sleep_benchmark PUBLIC
+    ${CoreLib} ${Lib} ${TestLib}
+)
+add_test(NAME benchmark_sleep_benchmark_quick COMMAND sleep_benchmark -q)
+
+if(NOT DEFINED FEDERATED)
+    add_executable(savina_benchmark ${BENCHMARK_DIR}/savina_benchmark.c)
+    target_link_libraries(
+        savina_benchmark PUBLIC
+        ${CoreLib} ${Lib}
+    )
+    foreach(SAVINA_BENCHMARK PingPong ThreadRing Counting Big Chameneos Philosophers)
+        add_test(
+            NAME benchmark_savina_${SAVINA_BENCHMARK}_quick
+            COMMAND savina_benchmark -b ${SAVINA_BENCHMARK} -q
+        )
+    endforeach()
+    add_custom_target(
+        savina_benchmarks
+        COMMAND ${BENCHMARK_DIR}/run_savina_benchmarks.sh -o ${CMAKE_BINARY_DIR}/savina_benchmarks.csv
+        WORKING_DIRECTORY ${CMAKE_BINARY_DIR}
+        USES_TERMINAL
+    )
+endif()
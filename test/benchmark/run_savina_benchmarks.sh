@@ -0,0 +1,43 @@
+#!/bin/bash
+# Build and run the Savina benchmarks for each of the given schedulers and
+# collect the results in a CSV file.
+# Usage: run_savina_benchmarks.sh [-o file] [scheduler...] [-- benchmark arguments]
+# The file defaults to savina_benchmarks.csv, to which rows are appended. The
+# schedulers default to all of them, and SINGLE_THREADED selects the
+# single-threaded runtime. The builds are placed in build-savina-<scheduler>
+# in the current directory and use the Release build type so that the results
+# are not dominated by assertions. The benchmark arguments are passed to each
+# run, for example, "-q" for a quick run or "-- -w 4" for four workers.
+
+set -e
+
+SOURCE_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BENCHMARKS=(PingPong ThreadRing Counting Big Chameneos Philosophers)
+OUTPUT="savina_benchmarks.csv"
+SCHEDULERS=()
+if [ "$1" = "-o" ]; then
+    OUTPUT="$2"
+    shift 2
+fi
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    SCHEDULERS+=("$1")
+    shift
+done
+[ "$1" = "--" ] && shift
+[ ${#SCHEDULERS[@]} -eq 0 ] && SCHEDULERS=(SINGLE_THREADED NP NP_WS GEDF_NP GEDF_NP_LF ADAPTIVE CHAIN_NP STATIC)
+
+for SCHEDULER in "${SCHEDULERS[@]}"; do
+    BUILD_DIR="build-savina-${SCHEDULER}"
+    if [ "${SCHEDULER}" = "SINGLE_THREADED" ]; then
+        RUNTIME_FLAGS=(-DLF_SINGLE_THREADED=1)
+    else
+        RUNTIME_FLAGS=(-DNUMBER_OF_WORKERS=0 -DSCHEDULER="SCHED_${SCHEDULER}")
+    fi
+    cmake -S "${SOURCE_DIR}" -B "${BUILD_DIR}" \
+        -DCMAKE_BUILD_TYPE=Release "${RUNTIME_FLAGS[@]}" > /dev/null
+    cmake --build "${BUILD_DIR}" --target savina_benchmark > /dev/null
+    for BENCHMARK in "${BENCHMARKS[@]}"; do
+        "${BUILD_DIR}/savina_benchmark" -b "${BENCHMARK}" -o "${OUTPUT}" "$@" > /dev/null
+    done
+done
+echo "Results appended to ${OUTPUT}."
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Build and run the scheduler benchmark for each of the given schedulers.
+# Usage: run_scheduler_benchmarks.sh [--futex] [--unity] [scheduler...] [-- benchmark arguments]
+# The schedulers default to NP, GEDF_NP, and ADAPTIVE. The builds are placed
+# in build-benchmark-<scheduler> in the current directory and use the Release
+# build type so that the results are not dominated by assertions. With --futex,
+# each scheduler is also built with LF_FUTEX_LOCKS, in build-benchmark-<scheduler>-futex,
+# to compare the futex-based mutexes and condition variables with the default ones.
+# With --unity, each scheduler is also built with LF_UNITY_BUILD and LF_LTO, in
+# build-benchmark-<scheduler>-unity, to measure the gain of inlining across the
+# files of the runtime.
+
+set -e
+
+SOURCE_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+SCHEDULERS=()
+VARIANTS=(default)
+while [ "$1" = "--futex" ] || [ "$1" = "--unity" ]; do
+    VARIANTS+=("${1#--}")
+    shift
+done
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    SCHEDULERS+=("$1")
+    shift
+done
+[ "$1" = "--" ] && shift
+[ ${#SCHEDULERS[@]} -eq 0 ] && SCHEDULERS=(NP GEDF_NP ADAPTIVE)
+
+for SCHEDULER in "${SCHEDULERS[@]}"; do
+    for VARIANT in "${VARIANTS[@]}"; do
+        BUILD_DIR="build-benchmark-${SCHEDULER}"
+        VARIANT_FLAGS=()
+        if [ "${VARIANT}" = "futex" ]; then
+            BUILD_DIR="${BUILD_DIR}-futex"
+            VARIANT_FLAGS=(-DLF_FUTEX_LOCKS=1)
+        elif [ "${VARIANT}" = "unity" ]; then
+            BUILD_DIR="${BUILD_DIR}-unity"
+            VARIANT_FLAGS=(-DLF_UNITY_BUILD=1 -DLF_LTO=1)
+        fi
+        cmake -S "${SOURCE_DIR}" -B "${BUILD_DIR}" \
+            -DCMAKE_BUILD_TYPE=Release \
+            -DNUMBER_OF_WORKERS=0 \
+            -DSCHEDULER="SCHED_${SCHEDULER}" "${VARIANT_FLAGS[@]}" > /dev/null
+        cmake --build "${BUILD_DIR}" --target scheduler_benchmark > /dev/null
+        "${BUILD_DIR}/scheduler_benchmark" "$@"
+    done
+done
@@ -0,0 +1,522 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file
+ * @brief Savina actor benchmarks running on the whole runtime.
+ *
+ * This runs one of the Savina actor benchmarks (PingPong, ThreadRing,
+ * Counting, Big, Chameneos, and Philosophers) through `lf_reactor_c_main`,
+ * so that it exercises the event queue, tokens, tag advancement, and the
+ * scheduler selected at compile time together. The reactors are wired by
+ * hand in `_lf_initialize_trigger_objects` instead of by generated code.
+ * Each actor is a reactor with an int logical action as its mailbox and one
+ * reaction triggered by it, and sending a message schedules the mailbox of
+ * the receiver with no delay, so every message is delivered at a later
+ * microstep. The program stops when no messages are left.
+ *
+ * It reports the number of messages and the throughput from the startup to
+ * the shutdown reaction, and, with `-o`, appends them as a row of a CSV file.
+ * It exits with a nonzero status if the actors did not do what the benchmark
+ * prescribes, so a short run with `-q` of each benchmark is registered as a
+ * test. See test/benchmark/run_savina_benchmarks.sh to run all of them with
+ * several schedulers.
+ *
+ * Usage: savina_benchmark -b benchmark [-n size] [-q] [-o file] [-- runtime options]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api.h"
+#include "environment.h"
+#include "lf_token.h"
+#include "platform.h"
+#include "reactor.h"
+#include "reactor_common.h"
+#include "util.h"
+#if !defined(LF_SINGLE_THREADED)
+#include "scheduler.h"
+#include "watchdog.h"
+#endif
+
+/** The index of a reaction at level 0 without a deadline. */
+#define INDEX_WITHOUT_DEADLINE (((index_t)(INT64_MAX >> 16)) << 16)
+
+/** Messages carry a kind in their high bits and an argument in their low bits. */
+#define MESSAGE(kind, argument) (((kind) << 24) | (argument))
+#define MESSAGE_KIND(message) ((message) >> 24)
+#define MESSAGE_ARGUMENT(message) ((message) & 0xFFFFFF)
+
+/** A reactor with an int logical action as its mailbox and a reaction to it. */
+typedef struct actor_t {
+    self_base_t base;               // Must be first, as for generated self structs.
+    lf_action_base_t mailbox;
+    trigger_t trigger;
+    reaction_t reaction;
+    reaction_t* reactions[1];
+    int id;
+    int count;                      // The number of rounds that the actor has done.
+    int state;                      // Benchmark-specific state.
+    uint32_t seed;                  // The state of the random numbers of the actor.
+    size_t sent;                    // The number of messages that the actor has sent.
+} actor_t;
+
+/** A Savina benchmark. */
+typedef struct {
+    const char* name;
+    int default_size;               // The number of rounds for a full run.
+    int quick_size;                 // The number of rounds for a quick check.
+    int num_actors;
+    void (*start)(void);            // Send the first messages.
+    void (*react)(actor_t* self, int message);
+    bool (*check)(void);            // Return whether the actors did what the benchmark prescribes.
+} benchmark_t;
+
+static const benchmark_t* benchmark = NULL;
+static int size = 0;
+static actor_t* actors = NULL;
+static environment_t environment;
+
+/** The reactor with the startup and shutdown reactions. */
+static self_base_t runner;
+static reaction_t startup_reaction;
+static reaction_t shutdown_reaction;
+static instant_t started = NEVER;
+static instant_t finished = NEVER;
+
+// Definitions that are otherwise provided by generated code.
+#if !defined(LF_SINGLE_THREADED)
+int _lf_watchdog_count = 0;
+watchdog_t* _lf_watchdogs = NULL;
+#endif
+void terminate_execution(environment_t* env) {}
+void _lf_set_default_command_line_options() {}
+void logical_tag_complete(tag_t tag_to_send) {}
+int lf_reactor_c_main(int argc, const char* argv[]);
+
+static const char* scheduler_name() {
+#if defined(LF_SINGLE_THREADED)
+    return "SINGLE_THREADED";
+#else
+    return lf_sched_selected()->name;
+#endif
+}
+
+static void send(actor_t* from, actor_t* to, int message) {
+    from->sent++;
+    lf_schedule_int(&to->mailbox, 0, message);
+}
+
+/** Return a random number below 'bound' from the random numbers of 'actor'. */
+static int random_below(actor_t* actor, int bound) {
+    uint32_t x = actor->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    actor->seed = x;
+    return (int)(x % (uint32_t)bound);
+}
+
+////////////////////////////// PingPong //////////////////////////////
+
+// Actor 0 sends a ping to actor 1, which answers with a pong, 'size' times.
+
+static void ping_pong_start(void) {
+    send(&actors[0], &actors[1], 0);
+}
+
+static void ping_pong_react(actor_t* self, int message) {
+    self->count++;
+    if (self->id == 1) {
+        send(self, &actors[0], message);
+    } else if (self->count < size) {
+        send(self, &actors[1], self->count);
+    }
+}
+
+static bool ping_pong_check(void) {
+    return actors[0].count == size && actors[1].count == size;
+}
+
+////////////////////////////// ThreadRing //////////////////////////////
+
+// A token that can take 'size' more hops is passed around a ring of actors.
+
+#define RING_SIZE 100
+
+static void thread_ring_start(void) {
+    send(&actors[0], &actors[1], size);
+}
+
+static void thread_ring_react(actor_t* self, int message) {
+    self->count++;
+    if (message > 0) {
+        send(self, &actors[(self->id + 1) % RING_SIZE], message - 1);
+    }
+}
+
+static bool thread_ring_check(void) {
+    int hops = 0;
+    for (int i = 0; i < RING_SIZE; i++) hops += actors[i].count;
+    return hops == size + 1;
+}
+
+////////////////////////////// Counting //////////////////////////////
+
+// Actor 0 sends 'size' increments to actor 1, scheduling itself for each.
+
+static void counting_start(void) {
+    send(&actors[0], &actors[0], 0);
+}
+
+static void counting_react(actor_t* self, int message) {
+    self->count++;
+    if (self->id == 0) {
+        send(self, &actors[1], 1);
+        if (self->count < size) send(self, self, 0);
+    } else {
+        self->state += message;
+    }
+}
+
+static bool counting_check(void) {
+    return actors[0].count == size && actors[1].state == size;
+}
+
+////////////////////////////// Big //////////////////////////////
+
+// Each actor sends 'size' pings, one at a time, to random other actors,
+// which answer with a pong.
+
+#define BIG_ACTORS 120
+#define BIG_PING 0
+#define BIG_PONG 1
+
+static void big_ping(actor_t* self) {
+    int to = random_below(self, BIG_ACTORS - 1);
+    if (to >= self->id) to++;
+    send(self, &actors[to], MESSAGE(BIG_PING, self->id));
+}
+
+static void big_start(void) {
+    for (int i = 0; i < BIG_ACTORS; i++) big_ping(&actors[i]);
+}
+
+static void big_react(actor_t* self, int message) {
+    if (MESSAGE_KIND(message) == BIG_PING) {
+        self->state++;
+        send(self, &actors[MESSAGE_ARGUMENT(message)], MESSAGE(BIG_PONG, self->id));
+    } else if (++self->count < size) {
+        big_ping(self);
+    }
+}
+
+static bool big_check(void) {
+    int pings = 0;
+    for (int i = 0; i < BIG_ACTORS; i++) {
+        if (actors[i].count != size) return false;
+        pings += actors[i].state;
+    }
+    return pings == BIG_ACTORS * size;
+}
+
+////////////////////////////// Chameneos //////////////////////////////
+
+// Actor 0 is a mall at which the other actors meet in pairs, each changing
+// its color to the complement of its color and that of the other, until
+// there have been 'size' meetings.
+
+#define CHAMENEOS_CREATURES 100
+#define CHAMENEOS_MEET 0
+#define CHAMENEOS_CHANGE 1
+#define CHAMENEOS_STOP 2
+#define NOBODY 0xFFFFFF
+
+static int complement(int color, int other) {
+    return color == other ? color : 3 - color - other;
+}
+
+static void chameneos_start(void) {
+    actors[0].state = NOBODY;
+    for (int i = 1; i <= CHAMENEOS_CREATURES; i++) {
+        actors[i].state = i % 3;
+        send(&actors[i], &actors[0], MESSAGE(CHAMENEOS_MEET, i << 2 | actors[i].state));
+    }
+}
+
+static void chameneos_react(actor_t* self, int message) {
+    int kind = MESSAGE_KIND(message);
+    if (self->id != 0) {
+        if (kind == CHAMENEOS_CHANGE) {
+            self->count++;
+            self->state = complement(self->state, MESSAGE_ARGUMENT(message));
+            send(self, &actors[0], MESSAGE(CHAMENEOS_MEET, self->id << 2 | self->state));
+        }
+        return;
+    }
+    int creature = MESSAGE_ARGUMENT(message) >> 2;
+    int color = MESSAGE_ARGUMENT(message) & 3;
+    if (self->count == size) {
+        send(self, &actors[creature], MESSAGE(CHAMENEOS_STOP, 0));
+    } else if (self->state == NOBODY) {
+        self->state = MESSAGE_ARGUMENT(message);
+    } else {
+        self->count++;
+        send(self, &actors[self->state >> 2], MESSAGE(CHAMENEOS_CHANGE, color));
+        send(self, &actors[creature], MESSAGE(CHAMENEOS_CHANGE, self->state & 3));
+        self->state = NOBODY;
+    }
+}
+
+static bool chameneos_check(void) {
+    int meetings = 0;
+    for (int i = 1; i <= CHAMENEOS_CREATURES; i++) meetings += actors[i].count;
+    return actors[0].count == size && meetings == 2 * size;
+}
+
+////////////////////////////// Philosophers //////////////////////////////
+
+// Actor 0 is an arbitrator that grants the two forks of each of the other
+// actors, philosophers at a round table, when both are free. Each
+// philosopher eats 'size' times and asks again when it is denied.
+
+#define PHILOSOPHERS 20
+#define PHILOSOPHERS_HUNGRY 0
+#define PHILOSOPHERS_DONE 1
+#define PHILOSOPHERS_EXIT 2
+#define PHILOSOPHERS_GRANTED 3
+#define PHILOSOPHERS_DENIED 4
+
+static bool forks[PHILOSOPHERS];
+
+static void philosophers_start(void) {
+    for (int i = 1; i <= PHILOSOPHERS; i++) {
+        send(&actors[i], &actors[0], MESSAGE(PHILOSOPHERS_HUNGRY, i));
+    }
+}
+
+static void philosophers_react(actor_t* self, int message) {
+    int kind = MESSAGE_KIND(message);
+    if (self->id != 0) {
+        if (kind == PHILOSOPHERS_GRANTED) {
+            self->count++;
+            send(self, &actors[0], MESSAGE(PHILOSOPHERS_DONE, self->id));
+            kind = self->count < size ? PHILOSOPHERS_HUNGRY : PHILOSOPHERS_EXIT;
+        } else {
+            self->state++; // Denied.
+            kind = PHILOSOPHERS_HUNGRY;
+        }
+        send(self, &actors[0], MESSAGE(kind, self->id));
+        return;
+    }
+    int philosopher = MESSAGE_ARGUMENT(message);
+    int left = philosopher - 1;
+    int right = philosopher % PHILOSOPHERS;
+    if (kind == PHILOSOPHERS_HUNGRY) {
+        bool available = !forks[left] && !forks[right];
+        if (available) forks[left] = forks[right] = true;
+        send(self, &actors[philosopher], MESSAGE(available ? PHILOSOPHERS_GRANTED : PHILOSOPHERS_DENIED, 0));
+    } else if (kind == PHILOSOPHERS_DONE) {
+        forks[left] = forks[right] = false;
+    } else {
+        self->count++;
+    }
+}
+
+static bool philosophers_check(void) {
+    for (int i = 1; i <= PHILOSOPHERS; i++) {
+        if (actors[i].count != size) return false;
+    }
+    return actors[0].count == PHILOSOPHERS;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static const benchmark_t benchmarks[] = {
+    { "PingPong", 400000, 1000, 2, ping_pong_start, ping_pong_react, ping_pong_check },
+    { "ThreadRing", 1000000, 1000, RING_SIZE, thread_ring_start, thread_ring_react, thread_ring_check },
+    { "Counting", 1000000, 1000, 2, counting_start, counting_react, counting_check },
+    { "Big", 2000, 10, BIG_ACTORS, big_start, big_react, big_check },
+    { "Chameneos", 200000, 1000, CHAMENEOS_CREATURES + 1, chameneos_start, chameneos_react, chameneos_check },
+    { "Philosophers", 10000, 20, PHILOSOPHERS + 1, philosophers_start, philosophers_react, philosophers_check },
+};
+
+static void actor_reaction(void* self) {
+    actor_t* actor = (actor_t*)self;
+    benchmark->react(actor, *(int*)actor->trigger.tmplt.token->value);
+}
+
+static void startup(void* self) {
+    started = lf_time_physical();
+    benchmark->start();
+}
+
+static void shutdown(void* self) {
+    finished = lf_time_physical();
+}
+
+static void initialize_reaction(reaction_t* reaction, reaction_function_t function, void* self,
+        unsigned long long chain_id) {
+    reaction->function = function;
+    reaction->self = self;
+    reaction->index = INDEX_WITHOUT_DEADLINE;
+    reaction->chain_id = chain_id;
+    reaction->deadline = -1LL;
+    reaction->status = inactive;
+    reaction->name = benchmark->name;
+}
+
+int _lf_get_environments(environment_t** envs) {
+    *envs = &environment;
+    return 1;
+}
+
+void _lf_create_environments() {
+    environment_init(&environment, 0, _lf_number_of_workers, 0, 1, 1, 0, 0, 0, 0, "savina.lft");
+}
+
+void _lf_initialize_trigger_objects() {
+    runner.environment = &environment;
+    initialize_reaction(&startup_reaction, startup, &runner, 0);
+    initialize_reaction(&shutdown_reaction, shutdown, &runner, 0);
+    environment.startup_reactions[0] = &startup_reaction;
+    environment.shutdown_reactions[0] = &shutdown_reaction;
+
+    actors = (actor_t*)calloc(benchmark->num_actors, sizeof(actor_t));
+    lf_assert(actors != NULL, "Out of memory");
+    for (int i = 0; i < benchmark->num_actors; i++) {
+        actor_t* actor = &actors[i];
+        actor->base.environment = &environment;
+        actor->id = i;
+        actor->seed = 2463534242u + (uint32_t)i * 7919u;
+        _lf_initialize_template((token_template_t*)&actor->mailbox, sizeof(int));
+        actor->mailbox.trigger = &actor->trigger;
+        actor->mailbox.parent = &actor->base;
+        _lf_initialize_template((token_template_t*)&actor->trigger, sizeof(int));
+        actor->trigger.reactions = actor->reactions;
+        actor->trigger.number_of_reactions = 1;
+        actor->trigger.period = -1LL; // No minimum spacing.
+        actor->reactions[0] = &actor->reaction;
+        // Actors share no state, so their reactions are on separate chains.
+        initialize_reaction(&actor->reaction, actor_reaction, actor, 1ULL << (i % 64));
+    }
+
+#if !defined(LF_SINGLE_THREADED)
+    // All reactions are at level 0.
+    static size_t num_reactions_per_level[1];
+    num_reactions_per_level[0] = (size_t)benchmark->num_actors + 2;
+    sched_params_t params = {
+        .num_reactions_per_level = num_reactions_per_level,
+        .num_reactions_per_level_size = 1
+    };
+    lf_sched_init(&environment, (size_t)environment.num_workers, &params);
+#endif
+}
+
+static void usage(const char* command) {
+    printf("Usage: %s -b benchmark [-n size] [-q] [-o file] [-- runtime options]\n", command);
+    printf("  -b  The benchmark to run, which is one of");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        printf(" %s", benchmarks[i].name);
+    }
+    printf(".\n");
+    printf("  -n  The number of rounds of the benchmark (default: depends on the benchmark).\n");
+    printf("  -q  Use few rounds for a quick check of correctness.\n");
+    printf("  -o  Append the results to a CSV file, writing a header if it is new.\n");
+    printf("  Options after -- are passed to the runtime, for example, -w to set the number of workers.\n");
+}
+
+int main(int argc, const char* argv[]) {
+    const char* file_name = NULL;
+    bool quick = false;
+    int i = 1;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            for (size_t j = 0; j < sizeof(benchmarks) / sizeof(benchmarks[0]); j++) {
+                if (strcmp(benchmarks[j].name, name) == 0) benchmark = &benchmarks[j];
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            file_name = argv[++i];
+        } else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (benchmark == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (size <= 0) size = quick ? benchmark->quick_size : benchmark->default_size;
+
+    // Pass the remaining arguments to the runtime.
+    const char** runtime_argv = (const char**)malloc((argc - i + 1) * sizeof(const char*));
+    lf_assert(runtime_argv != NULL, "Out of memory");
+    runtime_argv[0] = argv[0];
+    for (int j = i; j < argc; j++) runtime_argv[j - i + 1] = argv[j];
+    // Do not wait for physical time to match logical time.
+    fast = true;
+    if (lf_reactor_c_main(argc - i + 1, runtime_argv) != 0) return 1;
+    free(runtime_argv);
+
+    size_t messages = 0;
+    for (int j = 0; j < benchmark->num_actors; j++) messages += actors[j].sent;
+    double seconds = (double)(finished - started) / BILLION;
+#if defined(LF_SINGLE_THREADED)
+    unsigned int workers = 1;
+#else
+    unsigned int workers = (unsigned int)environment.num_workers;
+#endif
+    printf("%-12s %-15s %7s %12s %12s %14s\n",
+            "benchmark", "scheduler", "workers", "messages", "seconds", "messages/s");
+    printf("%-12s %-15s %7u %12zu %12.6f %14.0f\n",
+            benchmark->name, scheduler_name(), workers, messages, seconds, messages / seconds);
+    if (file_name != NULL) {
+        FILE* file = fopen(file_name, "a");
+        if (file == NULL) {
+            lf_print_error("Could not open %s.", file_name);
+            return 1;
+        }
+        if (ftell(file) == 0) {
+            fprintf(file, "benchmark,scheduler,workers,size,messages,seconds,messages_per_second\n");
+        }
+        fprintf(file, "%s,%s,%u,%d,%zu,%.6f,%.0f\n",
+                benchmark->name, scheduler_name(), workers, size, messages, seconds, messages / seconds);
+        fclose(file);
+    }
+    if (!benchmark->check()) {
+        lf_print_error("%s did not do what the benchmark prescribes.", benchmark->name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file
+ * @brief Microbenchmark for the schedulers of the threaded runtime.
+ *
+ * This drives the scheduler selected at compile time with SCHEDULER, or with
+ * `-s` in a runtime built with LF_SCHED_DYNAMIC, directly through `lf_sched_init`, `lf_scheduler_trigger_reaction`,
+ * `lf_sched_get_ready_reaction`, and `lf_sched_done_with_reaction`, using
+ * synthetic reaction graphs instead of generated code. Each tag executes one
+ * instance of a graph. For each graph and each number of workers from 1 to
+ * the maximum, it reports the throughput, the worker time per reaction that
+ * is not spent in reaction bodies, and the percentiles of the latency from
+ * triggering a reaction to the start of its execution. The implementation of
+ * mutexes and condition variables is reported as well, since the workers
+ * synchronize through them; see LF_FUTEX_LOCKS. So is whether the core
+ * library was built as a single translation unit or with link-time
+ * optimization, which lets the helpers that the scheduler calls be inlined;
+ * see LF_UNITY_BUILD and LF_LTO.
+ *
+ * The benchmark also checks that every reachable reaction executes exactly
+ * once per tag and exits with a nonzero status otherwise, so a short run
+ * with `-q` is registered as a test.
+ *
+ * Usage: scheduler_benchmark [-w max_workers] [-r tags] [-n work_ns] [-s scheduler] [-q]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "environment.h"
+#include "platform.h"
+#include "reactor_common.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "util.h"
+#include "watchdog.h"
+
+/** A reaction of a synthetic graph. */
+typedef struct bench_reaction_t {
+    reaction_t base;                        // Must be first so that the scheduler's pointers can be cast.
+    struct bench_reaction_t** downstream;   // The reactions triggered by this one.
+    size_t num_downstream;
+    bool reachable;                         // Whether this reaction executes at every tag.
+    volatile instant_t triggered_at;        // Physical time of the most recent trigger.
+    volatile int executions;                // The number of executions in the current tag.
+} bench_reaction_t;
+
+/** A synthetic reaction graph. */
+typedef struct {
+    const char* name;
+    size_t num_levels;
+    size_t* num_reactions_per_level;
+    bench_reaction_t** reactions_by_level;
+    size_t num_reachable;
+} bench_graph_t;
+
+/** The state of one worker thread in one tag. */
+typedef struct {
+    lf_scheduler_t* scheduler;
+    int worker_number;
+} bench_worker_t;
+
+/** Synthetic work done by each reaction, in nanoseconds. */
+static interval_t work_ns = 0;
+
+/** Latency samples for the current configuration. */
+static interval_t* latencies = NULL;
+static volatile int num_latencies = 0;
+static size_t latencies_capacity = 0;
+
+/** The number of erroneous executions seen in the current configuration. */
+static int errors = 0;
+
+// Definitions that are otherwise provided by generated code.
+int _lf_watchdog_count = 0;
+watchdog_t* _lf_watchdogs = NULL;
+void _lf_create_environments() {}
+void _lf_initialize_trigger_objects() {}
+void _lf_set_default_command_line_options() {}
+void terminate_execution() {}
+void logical_tag_complete(tag_t tag_to_send) {}
+int _lf_get_environments(environment_t** envs) {
+    *envs = NULL;
+    return 0;
+}
+
+static const char* scheduler_name() {
+    return lf_sched_selected()->name;
+}
+
+/** The implementation of mutexes and condition variables, which LF_FUTEX_LOCKS selects. */
+static const char* locks_name() {
+#if defined(LF_FUTEX_LOCKS) && defined(PLATFORM_Linux)
+    return "futex";
+#else
+    return "default";
+#endif
+}
+
+/** How the core library was built, which LF_UNITY_BUILD and LF_LTO select. */
+static const char* build_name() {
+#if defined(LF_UNITY_BUILD) && defined(LF_LTO)
+    return "unity+lto";
+#elif defined(LF_UNITY_BUILD)
+    return "unity";
+#elif defined(LF_LTO)
+    return "lto";
+#else
+    return "default";
+#endif
+}
+
+////////////////////////////// Graphs //////////////////////////////
+
+/**
+ * Create a graph with the given number of reactions at each level and no
+ * connections. Reactions get pseudo-random deadlines in their index so that
+ * deadline-driven schedulers have something to sort.
+ */
+static bench_graph_t* graph_new(const char* name, size_t num_levels, size_t* widths) {
+    bench_graph_t* graph = (bench_graph_t*)calloc(1, sizeof(bench_graph_t));
+    lf_assert(graph, "Out of memory");
+    graph->name = name;
+    graph->num_levels = num_levels;
+    graph->num_reactions_per_level = widths;
+    graph->reactions_by_level = (bench_reaction_t**)calloc(num_levels, sizeof(bench_reaction_t*));
+    lf_assert(graph->reactions_by_level, "Out of memory");
+    for (size_t level = 0; level < num_levels; level++) {
+        graph->reactions_by_level[level] = (bench_reaction_t*)calloc(widths[level], sizeof(bench_reaction_t));
+        lf_assert(graph->reactions_by_level[level], "Out of memory");
+        for (size_t i = 0; i < widths[level]; i++) {
+            bench_reaction_t* reaction = &graph->reactions_by_level[level][i];
+            index_t deadline = (index_t)((level * 31 + i * 7919) % 1024 + 1);
+            reaction->base.index = (deadline << 16) | level;
+            reaction->base.deadline = -1LL;
+            reaction->base.status = inactive;
+            reaction->base.name = name;
+            reaction->base.chain_id = 0;
+        }
+    }
+    return graph;
+}
+
+/** Make 'upstream' trigger 'downstream'. */
+static void graph_connect(bench_reaction_t* upstream, bench_reaction_t* downstream) {
+    upstream->downstream = (bench_reaction_t**)realloc(
+        upstream->downstream, (upstream->num_downstream + 1) * sizeof(bench_reaction_t*));
+    lf_assert(upstream->downstream, "Out of memory");
+    upstream->downstream[upstream->num_downstream++] = downstream;
+}
+
+/** Mark the reactions reachable from level 0, which is triggered at every tag. */
+static void graph_finish(bench_graph_t* graph) {
+    for (size_t i = 0; i < graph->num_reactions_per_level[0]; i++) {
+        graph->reactions_by_level[0][i].reachable = true;
+    }
+    for (size_t level = 0; level < graph->num_levels; level++) {
+        for (size_t i = 0; i < graph->num_reactions_per_level[level]; i++) {
+            bench_reaction_t* reaction = &graph->reactions_by_level[level][i];
+            if (!reaction->reachable) continue;
+            graph->num_reachable++;
+            for (size_t j = 0; j < reaction->num_downstream; j++) {
+                reaction->downstream[j]->reachable = true;
+            }
+        }
+    }
+}
+
+static size_t* widths_new(size_t num_levels, size_t width) {
+    size_t* widths = (size_t*)malloc(num_levels * sizeof(size_t));
+    lf_assert(widths, "Out of memory");
+    for (size_t level = 0; level < num_levels; level++) {
+        widths[level] = width;
+    }
+    return widths;
+}
+
+/** Few levels with many independent reactions each, connected one to one. */
+static bench_graph_t* graph_wide(size_t num_levels, size_t width) {
+    bench_graph_t* graph = graph_new("wide", num_levels, widths_new(num_levels, width));
+    for (size_t level = 0; level + 1 < num_levels; level++) {
+        for (size_t i = 0; i < width; i++) {
+            graph_connect(&graph->reactions_by_level[level][i], &graph->reactions_by_level[level + 1][i]);
+        }
+    }
+    graph_finish(graph);
+    return graph;
+}
+
+/** A few long independent chains, each with its own chain ID. */
+static bench_graph_t* graph_chains(size_t num_chains, size_t depth) {
+    bench_graph_t* graph = graph_new("chains", depth, widths_new(depth, num_chains));
+    for (size_t level = 0; level < depth; level++) {
+        for (size_t i = 0; i < num_chains; i++) {
+            graph->reactions_by_level[level][i].base.chain_id = 1ULL << (i % 64);
+            if (level + 1 < depth) {
+                graph_connect(&graph->reactions_by_level[level][i], &graph->reactions_by_level[level + 1][i]);
+            }
+        }
+    }
+    graph_finish(graph);
+    return graph;
+}
+
+/** Levels that alternate between one reaction that fans out and many that fan in. */
+static bench_graph_t* graph_fan(size_t num_stages, size_t width) {
+    size_t num_levels = 2 * num_stages + 1;
+    size_t* widths = widths_new(num_levels, 1);
+    for (size_t level = 1; level < num_levels; level += 2) {
+        widths[level] = width;
+    }
+    bench_graph_t* graph = graph_new("fan", num_levels, widths);
+    for (size_t level = 0; level + 1 < num_levels; level += 2) {
+        for (size_t i = 0; i < width; i++) {
+            graph_connect(&graph->reactions_by_level[level][0], &graph->reactions_by_level[level + 1][i]);
+            graph_connect(&graph->reactions_by_level[level + 1][i], &graph->reactions_by_level[level + 2][0]);
+        }
+    }
+    graph_finish(graph);
+    return graph;
+}
+
+/** Many levels of which only every 'stride'th has triggered reactions. */
+static bench_graph_t* graph_sparse(size_t num_levels, size_t width, size_t stride) {
+    bench_graph_t* graph = graph_new("sparse", num_levels, widths_new(num_levels, width));
+    for (size_t level = 0; level + stride < num_levels; level += stride) {
+        for (size_t i = 0; i < width; i++) {
+            graph_connect(&graph->reactions_by_level[level][i], &graph->reactions_by_level[level + stride][i]);
+        }
+    }
+    graph_finish(graph);
+    return graph;
+}
+
+static void graph_free(bench_graph_t* graph) {
+    for (size_t level = 0; level < graph->num_levels; level++) {
+        for (size_t i = 0; i < graph->num_reactions_per_level[level]; i++) {
+            free(graph->reactions_by_level[level][i].downstream);
+        }
+        free(graph->reactions_by_level[level]);
+    }
+    free(graph->reactions_by_level);
+    free(graph->num_reactions_per_level);
+    free(graph);
+}
+
+////////////////////////////// Execution //////////////////////////////
+
+static void* bench_worker(void* arg) {
+    bench_worker_t* worker = (bench_worker_t*)arg;
+    reaction_t* done;
+    while ((done = lf_sched_get_ready_reaction(worker->scheduler, worker->worker_number)) != NULL) {
+        bench_reaction_t* reaction = (bench_reaction_t*)done;
+        instant_t start = lf_time_physical();
+        int sample = lf_atomic_fetch_add(&num_latencies, 1);
+        if ((size_t)sample < latencies_capacity) {
+            latencies[sample] = start - reaction->triggered_at;
+        }
+        lf_atomic_fetch_add(&reaction->executions, 1);
+        if (work_ns > 0) {
+            while (lf_time_physical() - start < work_ns);
+        }
+        for (size_t i = 0; i < reaction->num_downstream; i++) {
+            bench_reaction_t* downstream = reaction->downstream[i];
+            // With fan-in, only the first trigger queues the reaction, so the
+            // latency of such reactions is measured from the last trigger.
+            downstream->triggered_at = lf_time_physical();
+            lf_scheduler_trigger_reaction(worker->scheduler, &downstream->base, worker->worker_number);
+        }
+        lf_sched_done_with_reaction(worker->worker_number, done);
+    }
+    return NULL;
+}
+
+/**
+ * Execute one tag of 'graph' with a fresh scheduler and 'num_workers' workers.
+ * @return The physical time that the tag took.
+ */
+static interval_t run_tag(bench_graph_t* graph, size_t num_workers) {
+    environment_t env;
+    memset(&env, 0, sizeof(env));
+    environment_init(&env, 0, (int)num_workers, 0, 0, 0, 0, 0, 0, 0, "scheduler_benchmark.lft");
+    // Stop after the first tag.
+    environment_init_tags(&env, 0LL, 0LL);
+    sched_params_t params = {
+        .num_reactions_per_level = graph->num_reactions_per_level,
+        .num_reactions_per_level_size = graph->num_levels
+    };
+    lf_sched_init(&env, num_workers, &params);
+#ifdef LF_TRACE
+    // The scheduler traces the workers into buffers that start_trace()
+    // allocates, one for each worker.
+    _lf_number_of_workers = (unsigned int)num_workers;
+    start_trace(env.trace);
+#endif
+
+    self_base_t self = { .environment = &env };
+    for (size_t level = 0; level < graph->num_levels; level++) {
+        for (size_t i = 0; i < graph->num_reactions_per_level[level]; i++) {
+            bench_reaction_t* reaction = &graph->reactions_by_level[level][i];
+            reaction->base.self = &self;
+            reaction->base.status = inactive;
+            reaction->base.pos = 0;
+            reaction->executions = 0;
+        }
+    }
+
+    bench_worker_t* workers = (bench_worker_t*)calloc(num_workers, sizeof(bench_worker_t));
+    lf_assert(workers, "Out of memory");
+    instant_t start = lf_time_physical();
+    for (size_t i = 0; i < graph->num_reactions_per_level[0]; i++) {
+        bench_reaction_t* reaction = &graph->reactions_by_level[0][i];
+        reaction->triggered_at = start;
+        lf_scheduler_trigger_reaction(env.scheduler, &reaction->base, -1);
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        workers[i].scheduler = env.scheduler;
+        workers[i].worker_number = (int)i;
+        lf_thread_create(&env.thread_ids[i], bench_worker, &workers[i]);
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        lf_thread_join(env.thread_ids[i], NULL);
+    }
+    interval_t elapsed = lf_time_physical() - start;
+
+    for (size_t level = 0; level < graph->num_levels; level++) {
+        for (size_t i = 0; i < graph->num_reactions_per_level[level]; i++) {
+            bench_reaction_t* reaction = &graph->reactions_by_level[level][i];
+            int expected = reaction->reachable ? 1 : 0;
+            if (reaction->executions != expected) {
+                lf_print_error("%s: reaction %zu at level %zu executed %d times instead of %d.",
+                        graph->name, i, level, reaction->executions, expected);
+                errors++;
+            }
+        }
+    }
+    free(workers);
+#ifdef LF_TRACE
+    stop_trace(env.trace);
+#endif
+    environment_free(&env);
+    return elapsed;
+}
+
+static int compare_intervals(const void* a, const void* b) {
+    interval_t x = *(const interval_t*)a;
+    interval_t y = *(const interval_t*)b;
+    return (x > y) - (x < y);
+}
+
+/** Run 'num_tags' tags of 'graph' with 'num_workers' workers and print the results. */
+static void benchmark(bench_graph_t* graph, size_t num_workers, size_t num_tags) {
+    // Warm up, which also gets the one-time initialization of the runtime out of the way.
+    latencies_capacity = 0;
+    run_tag(graph, num_workers);
+
+    latencies_capacity = graph->num_reachable * num_tags;
+    latencies = (interval_t*)malloc(latencies_capacity * sizeof(interval_t));
+    lf_assert(latencies, "Out of memory");
+    num_latencies = 0;
+    interval_t elapsed = 0;
+    for (size_t tag = 0; tag < num_tags; tag++) {
+        elapsed += run_tag(graph, num_workers);
+    }
+
+    size_t num_samples = LF_MIN((size_t)num_latencies, latencies_capacity);
+    qsort(latencies, num_samples, sizeof(interval_t), compare_intervals);
+    double reactions = (double)(graph->num_reachable * num_tags);
+    double seconds = (double)elapsed / BILLION;
+    double overhead = ((double)elapsed * num_workers - reactions * work_ns) / reactions;
+    interval_t p50 = num_samples ? latencies[num_samples / 2] : 0;
+    interval_t p99 = num_samples ? latencies[(num_samples * 99) / 100] : 0;
+    interval_t max = num_samples ? latencies[num_samples - 1] : 0;
+    printf("%-10s %-8s %-10s %-8s %7zu %14.0f %14.1f %12lld %12lld %12lld\n",
+            scheduler_name(), locks_name(), build_name(), graph->name, num_workers,
+            reactions / seconds, overhead,
+            (long long)p50, (long long)p99, (long long)max);
+    free(latencies);
+    latencies = NULL;
+}
+
+static void usage(const char* command) {
+    printf("Usage: %s [-w max_workers] [-r tags] [-n work_ns] [-s scheduler] [-q]\n", command);
+    printf("  -w  Benchmark with 1 to max_workers workers (default: number of cores).\n");
+    printf("  -r  Number of tags to execute per configuration (default: 20).\n");
+    printf("  -n  Synthetic work per reaction in nanoseconds (default: 0).\n");
+    printf("  -s  Scheduler to use, such as NP or GEDF_NP, if built with LF_SCHED_DYNAMIC.\n");
+    printf("  -q  Use small graphs for a quick check of correctness.\n");
+}
+
+int main(int argc, const char* argv[]) {
+    size_t max_workers = (size_t)lf_available_cores();
+    size_t num_tags = 20;
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            max_workers = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            num_tags = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            work_ns = (interval_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            _lf_scheduler_name = argv[++i];
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quick = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_workers < 1) max_workers = 1;
+    if (num_tags < 1) num_tags = 1;
+
+    // Do not wait for physical time to match logical time.
+    fast = true;
+
+    size_t scale = quick ? 1 : 16;
+    bench_graph_t* graphs[] = {
+        graph_wide(8, 64 * scale),
+        graph_chains(4, 32 * scale),
+        graph_fan(4 * scale, 64),
+        graph_sparse(32 * scale, 16, 8)
+    };
+    size_t num_graphs = sizeof(graphs) / sizeof(graphs[0]);
+
+    printf("%-10s %-8s %-10s %-8s %7s %14s %14s %12s %12s %12s\n",
+            "scheduler", "locks", "build", "graph", "workers", "reactions/s", "ns/reaction",
+            "p50 lat(ns)", "p99 lat(ns)", "max lat(ns)");
+    for (size_t g = 0; g < num_graphs; g++) {
+        for (size_t workers = 1; workers <= max_workers; workers++) {
+            benchmark(graphs[g], workers, num_tags);
+        }
+        graph_free(graphs[g]);
+    }
+    if (errors) {
+        lf_print_error("%d reactions executed an unexpected number of times.", errors);
+        return 1;
+    }
+    return 0;
+}
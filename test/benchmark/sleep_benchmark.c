@@ -0,0 +1,178 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file
+ * @brief Microbenchmark for the precision of the wakeups of the platform.
+ *
+ * This sleeps for a range of durations with `lf_sleep` and, unless the
+ * runtime is single-threaded, waits for the same durations with
+ * `lf_cond_timedwait` on a condition variable that is never signaled, which
+ * is how `wait_until` waits for physical time to reach the next tag. For each
+ * duration, it reports by how much the wakeups miss the requested time: the
+ * mean, the 99th percentile, and the maximum lateness, and the earliest
+ * wakeup, which is negative if a wakeup came early.
+ *
+ * With `-p`, the benchmark first gives its thread the real-time scheduling
+ * policy that `--realtime true` gives to workers, since some platforms, such
+ * as macOS, only wake up threads with such a policy without delay.
+ *
+ * The benchmark exits with a nonzero status if a sleep or a wait fails, so a
+ * short run with `-q` is registered as a test.
+ *
+ * Usage: sleep_benchmark [-n samples] [-p] [-q]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "tag.h"
+#include "util.h"
+
+static const interval_t durations[] = { USEC(50), USEC(200), MSEC(1), MSEC(5), MSEC(20) };
+#define NUM_DURATIONS (sizeof(durations) / sizeof(durations[0]))
+
+static int compare_intervals(const void* a, const void* b) {
+    interval_t x = *(const interval_t*)a;
+    interval_t y = *(const interval_t*)b;
+    return (x > y) - (x < y);
+}
+
+/** Print the statistics of the given wakeup errors, which are sorted in place. */
+static void report(const char* function, interval_t duration, interval_t* errors, size_t samples) {
+    qsort(errors, samples, sizeof(interval_t), compare_intervals);
+    double sum = 0.0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += (double)errors[i];
+    }
+    size_t p99 = (samples * 99) / 100;
+    if (p99 >= samples) p99 = samples - 1;
+    printf("%-18s %10.1f %10.1f %10.1f %10.1f %10.1f\n", function, (double)duration / 1000.0,
+            sum / (double)samples / 1000.0, (double)errors[p99] / 1000.0,
+            (double)errors[samples - 1] / 1000.0, (double)errors[0] / 1000.0);
+}
+
+/** Sleep 'samples' times for the given duration and store how late each wakeup is in 'errors'. */
+static int measure_sleep(interval_t duration, interval_t* errors, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        instant_t start, end;
+        _lf_clock_now(&start);
+        if (lf_sleep(duration) != 0) {
+            lf_print_error("lf_sleep failed.");
+            return 1;
+        }
+        _lf_clock_now(&end);
+        errors[i] = end - start - duration;
+    }
+    return 0;
+}
+
+#if !defined(LF_SINGLE_THREADED)
+/** Wait 'samples' times for the given duration and store how late each wakeup is in 'errors'. */
+static int measure_timedwait(interval_t duration, interval_t* errors, size_t samples) {
+    lf_mutex_t mutex;
+    lf_cond_t cond;
+    if (lf_mutex_init(&mutex) != 0 || lf_cond_init(&cond, &mutex) != 0) {
+        lf_print_error("Could not initialize the condition variable.");
+        return 1;
+    }
+    lf_mutex_lock(&mutex);
+    for (size_t i = 0; i < samples; i++) {
+        instant_t start, end;
+        _lf_clock_now(&start);
+        int result;
+        // Wait again after spurious wakeups.
+        while ((result = lf_cond_timedwait(&cond, start + duration)) == 0);
+        _lf_clock_now(&end);
+        if (result != LF_TIMEOUT) {
+            lf_print_error("lf_cond_timedwait failed.");
+            lf_mutex_unlock(&mutex);
+            return 1;
+        }
+        errors[i] = end - start - duration;
+    }
+    lf_mutex_unlock(&mutex);
+    return 0;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    size_t samples = 200;
+    bool quick = false;
+    bool realtime = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            samples = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            realtime = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quick = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-n samples] [-p] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (quick) {
+        samples = 5;
+    }
+    if (samples == 0) {
+        samples = 1;
+    }
+    _lf_initialize_clock();
+    if (realtime) {
+#if !defined(LF_SINGLE_THREADED)
+        lf_scheduling_policy_t policy = {
+            .policy = LF_SCHED_PRIORITY,
+            .priority = LF_SCHED_MIN_PRIORITY
+        };
+        if (lf_thread_set_scheduling_policy(lf_thread_self(), &policy) != 0) {
+            lf_print_warning("Failed to set a real-time scheduling policy. Measuring without it.");
+        }
+#else
+        lf_print_warning("The single-threaded runtime has no scheduling policies. Measuring without one.");
+#endif
+    }
+    interval_t* errors = (interval_t*)malloc(samples * sizeof(interval_t));
+    if (errors == NULL) {
+        lf_print_error("Out of memory.");
+        return 1;
+    }
+
+    int failures = 0;
+    printf("%-18s %10s %10s %10s %10s %10s\n", "function", "wait us", "mean us", "p99 us", "max us", "min us");
+    for (size_t d = 0; d < NUM_DURATIONS && failures == 0; d++) {
+        failures += measure_sleep(durations[d], errors, samples);
+        if (failures == 0) report("lf_sleep", durations[d], errors, samples);
+    }
+#if !defined(LF_SINGLE_THREADED)
+    for (size_t d = 0; d < NUM_DURATIONS && failures == 0; d++) {
+        failures += measure_timedwait(durations[d], errors, samples);
+        if (failures == 0) report("lf_cond_timedwait", durations[d], errors, samples);
+    }
+#endif
+    free(errors);
+    return failures > 0 ? 1 : 0;
+}
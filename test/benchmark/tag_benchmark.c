@@ -0,0 +1,160 @@
+/*************
+Copyright (c) 2023, The University of California at Berkeley.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************/
+
+/**
+ * @file
+ * @brief Microbenchmark for the tag arithmetic on the hot paths of the RTI.
+ *
+ * This compares the branchy implementation that `lf_delay_tag` and
+ * `lf_delay_strict` used to have, kept here as a reference, with the
+ * exported functions and with their inlineable versions `_lf_delay_tag` and
+ * `_lf_delay_strict`, over a mix of tags and intervals that includes NEVER,
+ * FOREVER, zero, and overflowing sums. It reports the time per call of each.
+ *
+ * The benchmark also checks that all versions agree on every input and exits
+ * with a nonzero status otherwise, so a short run with `-q` is registered as a
+ * test.
+ *
+ * Usage: tag_benchmark [-r rounds] [-q]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "tag.h"
+#include "util.h"
+
+/** The number of inputs, a power of two. */
+#define NUM_INPUTS 1024
+
+static tag_t tags[NUM_INPUTS];
+static interval_t intervals[NUM_INPUTS];
+
+/** The former implementation of lf_delay_tag. */
+static tag_t reference_delay_tag(tag_t tag, interval_t interval) {
+    if (tag.time == NEVER || interval < 0LL) return tag;
+    tag_t result = tag;
+    if (interval == 0LL) {
+        result.microstep++;
+    } else {
+        if (FOREVER - interval < result.time) {
+            result.time = FOREVER;
+        } else {
+            result.time += interval;
+        }
+        result.microstep = 0;
+    }
+    return result;
+}
+
+/** The former implementation of lf_delay_strict. */
+static tag_t reference_delay_strict(tag_t tag, interval_t interval) {
+    tag_t result = reference_delay_tag(tag, interval);
+    if (interval != 0 && interval != NEVER && interval != FOREVER && result.time != NEVER && result.time != FOREVER) {
+        result.time -= 1;
+        result.microstep = UINT_MAX;
+    }
+    return result;
+}
+
+static void make_inputs(void) {
+    const instant_t special_times[] = { NEVER, FOREVER, 0LL, FOREVER - 5LL, -7LL };
+    const interval_t special_intervals[] = { NEVER, FOREVER, 0LL, -3LL, 10LL };
+    srand(42);
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        tags[i].time = (i % 8 == 0) ? special_times[(i / 8) % 5] : (instant_t)rand() * 1000LL;
+        tags[i].microstep = (i % 16 == 1) ? UINT_MAX : (microstep_t)(rand() % 4);
+        intervals[i] = (i % 4 == 0) ? special_intervals[(i / 4) % 5] : (interval_t)(rand() % 100000);
+    }
+}
+
+static int check(void) {
+    int errors = 0;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        tag_t expected = reference_delay_tag(tags[i], intervals[i]);
+        tag_t strict = reference_delay_strict(tags[i], intervals[i]);
+        tag_t results[] = { lf_delay_tag(tags[i], intervals[i]), _lf_delay_tag(tags[i], intervals[i]) };
+        tag_t strict_results[] = { lf_delay_strict(tags[i], intervals[i]), _lf_delay_strict(tags[i], intervals[i]) };
+        for (int j = 0; j < 2; j++) {
+            if (lf_tag_compare(results[j], expected) != 0 || lf_tag_compare(strict_results[j], strict) != 0) {
+                lf_print_error("Delaying " PRINTF_TAG " by " PRINTF_TIME " gives a different result.",
+                        tags[i].time, tags[i].microstep, intervals[i]);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+/** Time 'rounds' passes over the inputs with the given delay function and return ns per call. */
+#define TIME_DELAYS(delay, rounds, sink) ({ \
+    instant_t start = lf_time_physical(); \
+    for (size_t round = 0; round < (rounds); round++) { \
+        for (int i = 0; i < NUM_INPUTS; i++) { \
+            tag_t result = delay(tags[i], intervals[i]); \
+            sink += (uint64_t)result.time + result.microstep; \
+        } \
+    } \
+    (double)(lf_time_physical() - start) / ((double)(rounds) * NUM_INPUTS); \
+})
+
+int main(int argc, char* argv[]) {
+    size_t rounds = 10000;
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quick = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-r rounds] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (quick) {
+        rounds = 10;
+    }
+    make_inputs();
+    int errors = check();
+
+    volatile uint64_t sink = 0;
+    uint64_t sum = 0;
+    printf("%-24s %10s\n", "function", "ns/call");
+    printf("%-24s %10.2f\n", "reference lf_delay_tag", TIME_DELAYS(reference_delay_tag, rounds, sum));
+    printf("%-24s %10.2f\n", "lf_delay_tag", TIME_DELAYS(lf_delay_tag, rounds, sum));
+    printf("%-24s %10.2f\n", "_lf_delay_tag", TIME_DELAYS(_lf_delay_tag, rounds, sum));
+    printf("%-24s %10.2f\n", "reference lf_delay_strict", TIME_DELAYS(reference_delay_strict, rounds, sum));
+    printf("%-24s %10.2f\n", "lf_delay_strict", TIME_DELAYS(lf_delay_strict, rounds, sum));
+    printf("%-24s %10.2f\n", "_lf_delay_strict", TIME_DELAYS(_lf_delay_strict, rounds, sum));
+    sink = sum;
+    (void)sink;
+
+    if (errors > 0) {
+        lf_print_error("%d results differ.", errors);
+        return 1;
+    }
+    return 0;
+}
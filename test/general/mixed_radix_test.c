@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mixed_radix.h"
+
+#define MAX_SIZE 4
+
+/**
+ * Check that a mixed-radix number with precomputed tables agrees with one
+ * without them at every step of a full cycle and after wrapping around.
+ */
+static void test_precompute(int size, int* radixes, int* permutation, int* start) {
+  int plain_digits[MAX_SIZE];
+  int fast_digits[MAX_SIZE];
+  int total = 1;
+  for (int i = 0; i < size; i++) {
+    plain_digits[i] = start[i];
+    fast_digits[i] = start[i];
+    total *= radixes[i];
+  }
+  mixed_radix_int_t plain = { size, plain_digits, radixes, permutation };
+  mixed_radix_int_t fast = { size, fast_digits, radixes, permutation };
+  mixed_radix_precompute(&fast);
+  for (int step = 0; step <= total; step++) {
+    for (int n = 0; n <= size + 1; n++) {
+      assert(mixed_radix_parent(&fast, n) == mixed_radix_parent(&plain, n));
+    }
+    assert(mixed_radix_to_int(&fast) == mixed_radix_to_int(&plain));
+    mixed_radix_incr(&plain);
+    mixed_radix_incr(&fast);
+  }
+  // Changing the digits directly requires precomputing again.
+  for (int i = 0; i < size; i++) {
+    fast_digits[i] = radixes[i] - 1;
+  }
+  mixed_radix_precompute(&fast);
+  assert(mixed_radix_to_int(&fast) == total - 1);
+  mixed_radix_incr(&fast);
+  // The number wraps around to zero.
+  assert(mixed_radix_to_int(&fast) == 0);
+  mixed_radix_free(&fast);
+  assert(fast.strides == NULL && fast.values == NULL);
+}
+
+int main(int argc, char **argv) {
+  srand(1729);
+  for (int round = 0; round < 200; round++) {
+    int size = 1 + rand() % MAX_SIZE;
+    int radixes[MAX_SIZE];
+    int permutation[MAX_SIZE];
+    int start[MAX_SIZE];
+    for (int i = 0; i < size; i++) {
+      radixes[i] = 1 + rand() % 5;
+      start[i] = rand() % radixes[i];
+      permutation[i] = i;
+    }
+    for (int i = size - 1; i > 0; i--) {
+      int j = rand() % (i + 1);
+      int swap = permutation[i];
+      permutation[i] = permutation[j];
+      permutation[j] = swap;
+    }
+    test_precompute(size, radixes, permutation, start);
+  }
+  printf("Mixed-radix tests passed.\n");
+  return 0;
+}
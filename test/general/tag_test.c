@@ -1,10 +1,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "lf_types.h"
+#include "util.h"
+
+static void test_compare(void) {
+  tag_t tags[] = {
+    NEVER_TAG, { -5LL, 3u }, { 0LL, 0u }, { 0LL, 1u }, { 0LL, UINT_MAX }, { 1LL, 0u }, { LLONG_MAX, 0u }, FOREVER_TAG
+  };
+  size_t count = sizeof(tags) / sizeof(tags[0]);
+  for (size_t i = 0; i < count; i++) {
+    tag_t unpacked = lf_tag_unpack(lf_tag_pack(tags[i]));
+    if (unpacked.time != tags[i].time || unpacked.microstep != tags[i].microstep) {
+      lf_print_error_and_exit("Packing and unpacking changed tag %zu.", i);
+    }
+    for (size_t j = 0; j < count; j++) {
+      int expected = (i > j) - (i < j);
+      if (lf_tag_compare(tags[i], tags[j]) != expected) {
+        lf_print_error_and_exit("Expected comparing tags %zu and %zu to give %d.", i, j, expected);
+      }
+      if (lf_packed_tag_compare(lf_tag_pack(tags[i]), lf_tag_pack(tags[j])) != expected) {
+        lf_print_error_and_exit("Expected comparing packed tags %zu and %zu to give %d.", i, j, expected);
+      }
+    }
+  }
+}
+
+static void test_min(void) {
+  tag_t none = lf_tag_min(NULL, 0);
+  if (lf_tag_compare(none, FOREVER_TAG) != 0) {
+    lf_print_error_and_exit("Expected the minimum of no tags to be FOREVER_TAG.");
+  }
+  tag_t tags[11];
+  for (size_t i = 0; i < 11; i++) {
+    tags[i] = (tag_t) { .time = 100LL - (instant_t)(i % 5), .microstep = (microstep_t)i };
+  }
+  // The smallest time is 96, at microsteps 4 and 9.
+  tag_t min = lf_tag_min(tags, 11);
+  if (min.time != 96LL || min.microstep != 4u) {
+    lf_print_error_and_exit("Expected a minimum of (96, 4) but got (%lld, %u).", (long long)min.time, min.microstep);
+  }
+  tags[10] = (tag_t) { .time = -1LL, .microstep = 7u };
+  min = lf_tag_min(tags, 11);
+  if (min.time != -1LL || min.microstep != 7u) {
+    lf_print_error_and_exit("Expected a minimum of (-1, 7) but got (%lld, %u).", (long long)min.time, min.microstep);
+  }
+}
 
 int main(int argc, char **argv) {
   char* buf = malloc(sizeof(char) * 128);
   lf_readable_time(buf, 0);
   printf("%s", buf);
+  test_compare();
+  test_min();
   return 0;
 }
@@ -1,6 +1,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "core/utils/impl/pointer_hashmap.h"
 #include "rand_utils.h"
 #include "core/utils/util.h"
@@ -65,7 +66,42 @@ void run_test(hashmap_object2int_t* h, int* distribution) {
     }
 }
 
+/**
+ * @brief Check that a hashmap created with a small capacity grows to hold many more entries,
+ * and that its entries are found, replaced, and enumerated.
+ */
+void test_growth() {
+    hashmap_object2int_t* h = hashmap_object2int_new(1, NULL);
+    for (int i = 1; i <= N; i++) {
+        hashmap_object2int_put(h, (void*)((uintptr_t)i * 64), i);
+    }
+    hashmap_object2int_put(h, (void*)64, -1);
+    if (h->num_entries != N) {
+        lf_print_error_and_exit("Expected %d entries but got %zu.", N, h->num_entries);
+    }
+    for (int i = 1; i <= N; i++) {
+        int expected = (i == 1) ? -1 : i;
+        if (hashmap_object2int_get(h, (void*)((uintptr_t)i * 64)) != expected) {
+            lf_print_error_and_exit("Lost entry %d when growing a hashmap.", i);
+        }
+        if (hashmap_object2int_find(h, (void*)((uintptr_t)i * 64 + 1)) != NULL) {
+            lf_print_error_and_exit("Found a key that was never put into a hashmap.");
+        }
+        if (hashmap_object2int_get(h, (void*)((uintptr_t)i * 64 + 1)) != 0) {
+            lf_print_error_and_exit("Got a nonzero value for a key that was never put into a hashmap.");
+        }
+    }
+    size_t position = 0;
+    size_t count = 0;
+    while (hashmap_object2int_next(h, &position) != NULL) count++;
+    if (count != N) {
+        lf_print_error_and_exit("Expected to enumerate %d entries but got %zu.", N, count);
+    }
+    hashmap_object2int_free(h);
+}
+
 int main() {
+    test_growth();
     srand(RANDOM_SEED);
     for (int i = 0; i < N; i++) {
         int perturbed[2];
@@ -207,6 +207,48 @@ static void test_fill_with_deleted_items()
     hashset_destroy(set);
 }
 
+static void test_iterating_in_place(void)
+{
+    hashset_t set = hashset_create(3);
+    for (size_t i = 2; i < 100; i++) {
+        hashset_add(set, (void *)(i * 8));
+    }
+    hashset_remove(set, (void *)16);
+
+    struct hashset_itr_st iter;
+    hashset_iterator_init(&iter, set);
+    size_t count = 0;
+    while (hashset_iterator_next(&iter) >= 0) {
+        assert(hashset_iterator_value(&iter) != (void *)16);
+        count++;
+    }
+    assert(count == hashset_num_items(set));
+    hashset_destroy(set);
+}
+
+static void test_pop_any(void)
+{
+    hashset_t set = hashset_create(3);
+    assert(hashset_pop_any(set) == NULL);
+    for (size_t i = 2; i < 100; i++) {
+        hashset_add(set, (void *)(i * 8));
+    }
+    size_t popped = 0;
+    void* item;
+    while ((item = hashset_pop_any(set)) != NULL) {
+        assert(hashset_is_member(set, item) == 0);
+        popped++;
+        if (popped == 50) {
+            // Items added in the middle are popped as well.
+            hashset_add(set, (void *)8);
+        }
+    }
+    assert(popped == 99);
+    assert(hashset_num_items(set) == 0);
+    assert(set->n_deleted_items == 0);
+    hashset_destroy(set);
+}
+
 int main(int argc, char *argv[])
 {
     trivial();
@@ -215,6 +257,8 @@ int main(int argc, char *argv[])
     test_rehashing_items_placed_beyond_nitems();
     test_iterating();
     test_fill_with_deleted_items();
+    test_iterating_in_place();
+    test_pop_any();
 
     (void)argc;
     (void)argv;
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "pqueue_calendar.h"
+#include "rand_utils.h"
+#include "util.h"
+
+#define CAPACITY 2000
+#define N 40
+#define STEPS 3000
+#define NUM_KEYS 8
+#define RANDOM_SEED 1614
+
+typedef struct {
+    pqueue_pri_t pri;
+    int key;                // Entries with the same key are equal.
+    size_t sequence_number; // The order of insertion.
+    size_t pos;
+    bool queued;
+} entry_t;
+
+static entry_t entries[CAPACITY];
+static size_t num_entries = 0;
+static size_t sequence_number = 0;
+
+static int distribution[4] = {50, 30, 10, 10};
+
+static int compare_pri(pqueue_pri_t thiz, pqueue_pri_t that) { return thiz > that; }
+static pqueue_pri_t get_pri(void* a) { return ((entry_t*)a)->pri; }
+static size_t get_pos(void* a) { return ((entry_t*)a)->pos; }
+static void set_pos(void* a, size_t pos) { ((entry_t*)a)->pos = pos; }
+static void set_pri(void* a, pqueue_pri_t pri) { ((entry_t*)a)->pri = pri; }
+static int matches(void* next, void* curr) { return ((entry_t*)next)->key == ((entry_t*)curr)->key; }
+static void print_entry(void* a) { LF_PRINT_DEBUG("pri: %llu", ((entry_t*)a)->pri); }
+
+/**
+ * @brief Return a random priority near 'base'. Occasional far-away priorities,
+ * as for timers with long periods, exercise the direct search.
+ */
+static pqueue_pri_t random_priority(pqueue_pri_t base) {
+    int choice = rand() % 100;
+    if (choice < 5) return base + (pqueue_pri_t)rand() * 1000000ULL;
+    if (choice < 20) return base; // Equal priorities
+    return base + (pqueue_pri_t)(rand() % 10000000);
+}
+
+/**
+ * @brief Return the queued entry with the smallest priority and, among those,
+ * the smallest sequence number, or NULL if there is none.
+ */
+static entry_t* expected_head() {
+    entry_t* head = NULL;
+    for (size_t i = 0; i < num_entries; i++) {
+        entry_t* e = &entries[i];
+        if (e->queued && (head == NULL || e->pri < head->pri
+                || (e->pri == head->pri && e->sequence_number < head->sequence_number))) {
+            head = e;
+        }
+    }
+    return head;
+}
+
+static void test_insert(pqueue_t* q, pqueue_pri_t base) {
+    if (num_entries == CAPACITY) return;
+    LF_PRINT_DEBUG("insert.");
+    entry_t* e = &entries[num_entries++];
+    e->pri = random_priority(base);
+    e->key = rand() % NUM_KEYS;
+    e->sequence_number = sequence_number++;
+    e->queued = true;
+    if (pqueue_insert(q, e)) {
+        lf_print_error_and_exit("Failed to insert into a calendar queue.");
+    }
+}
+
+static pqueue_pri_t test_pop(pqueue_t* q, pqueue_pri_t base) {
+    LF_PRINT_DEBUG("pop.");
+    entry_t* expected = expected_head();
+    entry_t* found = (entry_t*)pqueue_peek(q);
+    if (found != expected) {
+        lf_print_error_and_exit("Expected %p but got %p while peeking at a calendar queue.",
+                (void*)expected, (void*)found);
+    }
+    found = (entry_t*)pqueue_pop(q);
+    if (found != expected) {
+        lf_print_error_and_exit("Expected %p but got %p while popping from a calendar queue.",
+                (void*)expected, (void*)found);
+    }
+    if (found) {
+        found->queued = false;
+        // Like logical time, later insertions do not precede what has been popped.
+        return found->pri;
+    }
+    return base;
+}
+
+/**
+ * @brief Move the head to a later priority, as is done for the event of a
+ * periodic timer.
+ */
+static void test_advance_head(pqueue_t* q) {
+    entry_t* head = (entry_t*)pqueue_peek(q);
+    if (head == NULL) return;
+    LF_PRINT_DEBUG("advance head.");
+    pqueue_pri_t pri = head->pri + (pqueue_pri_t)(rand() % 10000000);
+    if (pqueue_advance_head(q, pri, set_pri) != head || head->pri != pri) {
+        lf_print_error_and_exit("Failed to advance the head of a calendar queue.");
+    }
+    head->sequence_number = sequence_number++;
+}
+
+static void test_remove(pqueue_t* q) {
+    if (num_entries == 0) return;
+    entry_t* e = &entries[rand() % num_entries];
+    if (!e->queued) return;
+    LF_PRINT_DEBUG("remove.");
+    pqueue_remove(q, e);
+    e->queued = false;
+}
+
+static void test_find(pqueue_t* q) {
+    LF_PRINT_DEBUG("find.");
+    entry_t* probe = &entries[rand() % CAPACITY];
+    for (int i = 0; i < 2; i++) {
+        entry_t* found = i == 0
+                ? (entry_t*)pqueue_find_equal_same_priority(q, probe)
+                : (entry_t*)pqueue_find_equal(q, probe, probe->pri);
+        entry_t* expected = NULL;
+        for (size_t j = 0; j < num_entries; j++) {
+            entry_t* e = &entries[j];
+            if (e->queued && e->key == probe->key
+                    && (i == 0 ? e->pri == probe->pri : e->pri <= probe->pri)
+                    && (expected == NULL || e->pri < expected->pri
+                        || (e->pri == expected->pri && e->sequence_number < expected->sequence_number))) {
+                expected = e;
+            }
+        }
+        if ((found == NULL) != (expected == NULL)
+                || (found && (found->key != probe->key || found->pri != expected->pri))) {
+            lf_print_error_and_exit("Expected %p but got %p while searching a calendar queue.",
+                    (void*)expected, (void*)found);
+        }
+    }
+}
+
+int main() {
+    srand(RANDOM_SEED);
+    for (int i = 0; i < N; i++) {
+        int perturbed[4];
+        perturb(distribution, 4, perturbed);
+        pqueue_t* q = pqueue_calendar_init(rand() % 100, compare_pri, get_pri,
+                get_pos, set_pos, matches, print_entry);
+        num_entries = 0;
+        pqueue_pri_t base = 0;
+        for (int j = 0; j < STEPS; j++) {
+            int choice = rand() % 100;
+            if ((choice = choice - perturbed[0]) < 0) {
+                test_insert(q, base);
+            } else if ((choice = choice - perturbed[1]) < 0) {
+                if (rand() % 4 == 0) {
+                    test_advance_head(q);
+                } else {
+                    base = test_pop(q, base);
+                }
+            } else if ((choice = choice - perturbed[2]) < 0) {
+                test_remove(q);
+            } else {
+                test_find(q);
+            }
+            if (!pqueue_is_valid(q)) {
+                lf_print_error_and_exit("Invalid calendar queue after %d steps.", j);
+            }
+        }
+        size_t queued = 0;
+        for (size_t j = 0; j < num_entries; j++) queued += entries[j].queued;
+        if (pqueue_size(q) != queued) {
+            lf_print_error_and_exit("Expected %zu entries but the calendar queue has %zu.",
+                    queued, pqueue_size(q));
+        }
+        while (pqueue_size(q) > 0) base = test_pop(q, base);
+        pqueue_free(q);
+    }
+    return 0;
+}
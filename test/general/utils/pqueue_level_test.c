@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "pqueue_level.h"
+#include "util.h"
+
+#define NUM_ENTRIES 64
+#define KEY ((pqueue_pri_t)(INT64_MAX >> 16) << 16)
+
+typedef struct {
+    pqueue_pri_t pri;
+    int key;                // Entries with the same key are equal.
+    size_t pos;
+} entry_t;
+
+static entry_t entries[NUM_ENTRIES];
+
+static int compare_pri(pqueue_pri_t thiz, pqueue_pri_t that) { return thiz > that; }
+static pqueue_pri_t get_pri(void* a) { return ((entry_t*)a)->pri; }
+static size_t get_pos(void* a) { return ((entry_t*)a)->pos; }
+static void set_pos(void* a, size_t pos) { ((entry_t*)a)->pos = pos; }
+static int matches(void* next, void* curr) { return ((entry_t*)next)->key == ((entry_t*)curr)->key; }
+static void print_entry(void* a) { LF_PRINT_DEBUG("pri: %llx", ((entry_t*)a)->pri); }
+
+/** @brief Return a new level queue with a small capacity so that its FIFOs have to grow. */
+static pqueue_t* new_queue() {
+    pqueue_t* q = pqueue_level_init(2, compare_pri, get_pri, get_pos, set_pos, matches, print_entry);
+    if (!q) lf_print_error_and_exit("Failed to create a level queue.");
+    return q;
+}
+
+/** @brief Set entry 'i' to have the bucket key, the given level and key, and insert it. */
+static entry_t* insert(pqueue_t* q, size_t i, pqueue_pri_t level, int key) {
+    entry_t* e = &entries[i];
+    e->pri = KEY | level;
+    e->key = key;
+    if (pqueue_insert(q, e)) lf_print_error_and_exit("Failed to insert into a level queue.");
+    if (!pqueue_is_valid(q)) lf_print_error_and_exit("Invalid level queue after inserting %zu.", i);
+    return e;
+}
+
+static void remove_entry(pqueue_t* q, size_t i) {
+    if (pqueue_remove(q, &entries[i])) lf_print_error_and_exit("Failed to remove %zu.", i);
+    if (!pqueue_is_valid(q)) lf_print_error_and_exit("Invalid level queue after removing %zu.", i);
+}
+
+/** @brief Pop the next entry and check that it is entry 'i'. */
+static void expect_pop(pqueue_t* q, size_t i) {
+    entry_t* peeked = (entry_t*)pqueue_peek(q);
+    entry_t* popped = (entry_t*)pqueue_pop(q);
+    if (peeked != &entries[i] || popped != &entries[i]) {
+        lf_print_error_and_exit("Expected entry %zu but peeked at %td and popped %td.", i,
+                peeked ? peeked - entries : -1, popped ? popped - entries : -1);
+    }
+    if (!pqueue_is_valid(q)) lf_print_error_and_exit("Invalid level queue after popping %zu.", i);
+}
+
+static void expect_empty(pqueue_t* q) {
+    if (pqueue_size(q) != 0 || pqueue_peek(q) != NULL || pqueue_pop(q) != NULL) {
+        lf_print_error_and_exit("Expected an empty level queue but it has %zu entries.", pqueue_size(q));
+    }
+}
+
+/** @brief Entries of one level are popped in insertion order, and lower levels first. */
+static void test_fifo_order() {
+    pqueue_t* q = new_queue();
+    for (size_t i = 0; i < 10; i++) insert(q, i, 5, 0);
+    for (size_t i = 10; i < 20; i++) insert(q, i, 3, 0);
+    for (size_t i = 10; i < 20; i++) expect_pop(q, i);
+    for (size_t i = 0; i < 10; i++) expect_pop(q, i);
+    expect_empty(q);
+    pqueue_free(q);
+}
+
+/**
+ * @brief Removing entries from the middle of a FIFO leaves holes that pop,
+ * peek, find and size skip, and removing the head advances it past them.
+ */
+static void test_holes() {
+    pqueue_t* q = new_queue();
+    for (size_t i = 0; i < 8; i++) insert(q, i, 7, (int)i);
+    remove_entry(q, 2);
+    remove_entry(q, 3);
+    remove_entry(q, 5);
+    if (pqueue_size(q) != 5) lf_print_error_and_exit("Expected 5 entries but got %zu.", pqueue_size(q));
+    if (pqueue_find_equal_same_priority(q, &entries[3]) != NULL) {
+        lf_print_error_and_exit("Found a removed entry in a hole.");
+    }
+    if (pqueue_find_equal_same_priority(q, &entries[4]) != &entries[4]) {
+        lf_print_error_and_exit("Failed to find an entry behind a hole.");
+    }
+    // Removing the head makes the next live entry, behind two holes, the head.
+    remove_entry(q, 0);
+    remove_entry(q, 1);
+    expect_pop(q, 4);
+    expect_pop(q, 6);
+    expect_pop(q, 7);
+    expect_empty(q);
+    // A FIFO that became empty through removals takes new entries again.
+    insert(q, 8, 7, 0);
+    insert(q, 9, 7, 0);
+    remove_entry(q, 8);
+    remove_entry(q, 9);
+    expect_empty(q);
+    insert(q, 10, 7, 0);
+    expect_pop(q, 10);
+    expect_empty(q);
+    pqueue_free(q);
+}
+
+/**
+ * @brief A FIFO whose head has advanced keeps its order when it grows and
+ * its live entries are moved to the front.
+ */
+static void test_head_advance_and_growth() {
+    pqueue_t* q = new_queue();
+    for (size_t i = 0; i < 4; i++) insert(q, i, 1, 0);
+    expect_pop(q, 0);
+    expect_pop(q, 1);
+    remove_entry(q, 3);
+    for (size_t i = 4; i < NUM_ENTRIES; i++) insert(q, i, 1, 0);
+    expect_pop(q, 2);
+    for (size_t i = 4; i < NUM_ENTRIES; i++) expect_pop(q, i);
+    expect_empty(q);
+    pqueue_free(q);
+}
+
+/** @brief Entries with a smaller key than the bucket key go into the heap and come first. */
+static void test_heap_entries() {
+    pqueue_t* q = new_queue();
+    insert(q, 0, 2, 0);
+    insert(q, 1, 2, 0);
+    entry_t* e = &entries[2];
+    e->pri = ((pqueue_pri_t)1 << 16) | 9;
+    e->key = 0;
+    if (pqueue_insert(q, e) || !pqueue_is_valid(q)) {
+        lf_print_error_and_exit("Failed to insert an entry with a deadline.");
+    }
+    remove_entry(q, 0);
+    expect_pop(q, 2);
+    expect_pop(q, 1);
+    expect_empty(q);
+    pqueue_free(q);
+}
+
+int main() {
+    test_fifo_order();
+    test_holes();
+    test_head_advance_and_growth();
+    test_heap_entries();
+    return 0;
+}
@@ -116,7 +116,43 @@ int run_test(vector_t* v, int* distribution) {
     return result;
 }
 
+/**
+ * @brief Test reserving, extending, clearing, and indexing past the end of a
+ * vector that starts without memory.
+ */
+void test_bulk_operations() {
+    vector_t v = vector_new(0);
+    if (vector_pop(&v) != NULL || vector_size(&v) != 0) {
+        lf_print_error_and_exit("Expected an empty vector.");
+    }
+    vector_reserve(&v, 10);
+    void** reserved = v.start;
+    void* items[20] = {NULL};
+    for (int i = 1; i < 20; i++) items[i] = mock + i;
+    vector_extend(&v, items, 10);
+    if (v.start != reserved || vector_size(&v) != 10 || *vector_at(&v, 0) != NULL) {
+        lf_print_error_and_exit("Extending within the reserved capacity reallocated or lost elements.");
+    }
+    vector_extend(&v, items + 10, 10);
+    for (int i = 0; i < 20; i++) {
+        if (*vector_at(&v, i) != items[i]) {
+            lf_print_error_and_exit("Expected element %d to be %p.", i, items[i]);
+        }
+    }
+    void** start = v.start;
+    vector_clear(&v);
+    if (vector_size(&v) != 0 || v.start != start) {
+        lf_print_error_and_exit("Clearing a vector should keep its memory.");
+    }
+    vector_push(&v, mock);
+    if (*vector_at(&v, 5) != NULL || vector_size(&v) != 6 || *vector_at(&v, 0) != mock) {
+        lf_print_error_and_exit("Indexing past the end should fill with NULL.");
+    }
+    vector_free(&v);
+}
+
 int main() {
+    test_bulk_operations();
     srand(RANDOM_SEED);
     for (int i = 0; i < N; i++) {
         int perturbed[4];
@@ -125,9 +161,7 @@ int main() {
             "Distribution: %d, %d, %d, %d",
             perturbed[0], perturbed[1], perturbed[2], perturbed[3]
         );
-        // FIXME: Decide whether it should be possible to initialize
-        //  vectors with zero capacity.
-        vector_t v = vector_new(rand() % CAPACITY + 1);
+        vector_t v = vector_new(rand() % CAPACITY);
         mock_size = 0;
         int j = 0;
         while (j < CAPACITY) {
@@ -1,8 +1,18 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include "tag.h"
 
+typedef struct environment_t environment_t;
+typedef struct watchdog_t watchdog_t;
+
+int _lf_watchdog_count = 0;
+watchdog_t* _lf_watchdogs = NULL;
+void _lf_create_environments() {}
+int _lf_get_environments(environment_t** envs) {
+    *envs = NULL;
+    return 0;
+}
 void _lf_initialize_trigger_objects() {}
 void terminate_execution() {}
 void _lf_set_default_command_line_options() {}
-void _lf_initialize_watchdog_mutexes() {}
 void logical_tag_complete(tag_t tag_to_send) {}
@@ -20,6 +20,8 @@
         "/lib/c/reactor-c/util/audio_loop_mac.c",
         "/lib/c/reactor-c/util/audio_loop.h",
         "/lib/c/reactor-c/util/audio_loop_linux.c",
+        "/lib/c/reactor-c/util/audio_loop_mixer.c",
+        "/lib/c/reactor-c/util/audio_loop_mixer.h",
     ],
     cmake-include: [
         "/lib/c/reactor-c/util/audio_loop.cmake"
@@ -37,6 +39,7 @@
 #ifndef AUDIO_LOOP_H
 #define AUDIO_LOOP_H
 
+#include <stdint.h>
 #include "wave_file_reader.h" // Defines lf_waveform_t.
 #include "tag.h"         // Defines instant_t.
 
@@ -50,6 +53,20 @@
 
 #define NUM_NOTES 8  // Maximum number of notes that can play simultaneously.
 
+/**
+ * Counts of the audio glitches since the audio loop started.
+ */
+typedef struct lf_audio_stats_t {
+    /** Buffers that the audio output ran out of before they were filled. */
+    uint64_t underruns;
+    /** Waveforms that started late because audio playback had already passed their start time. */
+    uint64_t late_notes;
+    /** Times that lf_play_audio_waveform() had to wait because its queue to the audio thread was full. */
+    uint64_t stalls;
+    /** Waveforms cut off because more than NUM_NOTES were playing. */
+    uint64_t cut_notes;
+} lf_audio_stats_t;
+
 /**
  * Start an audio loop thread that becomes ready to receive
  * audio amplitude samples via add_to_sound(). If there is
@@ -83,4 +100,11 @@ void lf_stop_audio_loop();
  */
 int lf_play_audio_waveform(lf_waveform_t* waveform, float emphasis, instant_t start_time);
 
+/**
+ * Get the counts of audio glitches since the audio loop started.
+ * This may be called from any thread.
+ * @param result The place to put the counts.
+ */
+void lf_audio_get_stats(lf_audio_stats_t* result);
+
 #endif // AUDIO_LOOP_H
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include "audio_loop.h"
+#include "audio_loop_mixer.h"
 #include <unistd.h>
 #include <poll.h>
 #include <alsa/asoundlib.h>
@@ -26,107 +27,26 @@
 // Audio device to use for playback
 #define AUDIO_DEVICE "default"
 
-pthread_mutex_t lf_audio_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t lf_audio_cond = PTHREAD_COND_INITIALIZER;
-
-// Pointer to the buffer into which to currently write.
-// This is null before the buffer is ready.
-int16_t* next_buffer = NULL;
-instant_t next_buffer_start_time = NEVER;
-
 snd_pcm_t *playback_handle;
 snd_async_handler_t *pcm_callback;
 
-struct note {
-    lf_waveform_t* waveform;
-    int position;   // Starts at 0 when note starts.
-    double volume;  // 0.0 for not active.
-};
-
-// Array keeping track of notes being played.
-struct note notes[NUM_NOTES] = { 0 };
-
-// Notes are added sequentially.
-// When we reach the end of the notes array, we cycle
-// back to the beginning. If the oldest note has not
-// yet finished playing, it will be replaced by the new note.
-int note_counter = 0;
-
 /**
- * Add the given value to the current write buffer at the specified index.
- * If the resulting value is larger than what can be represented in
- * the 16-bit short, truncate it.
- * @param index Where in the buffer to add the amplitude.
- * @param value The amplitude to add to whatever amplitude is already there.
- */
-void add_to_sound(int index_offset, double value) {
-    int sample_value = next_buffer[index_offset] + value;
-    if (sample_value > MAX_AMPLITUDE) {
-        sample_value = MAX_AMPLITUDE;
-    } else if (sample_value < -MAX_AMPLITUDE) {
-        sample_value = -MAX_AMPLITUDE;
-    }
-    next_buffer[index_offset] = (int16_t)sample_value;
-}
-
-/**
- * Function that is called by the audio loop to fill the audio buffer
- * with the next batch of audio data.  When this callback occurs,
- * this grabs the mutex lock, copies the buffer that the main program 
- * has been filling into the destination buffer, clears the next
- * buffer, and updates the start time of the next buffer.
+ * Write the specified buffer of AUDIO_BUFFER_SIZE samples to the audio interface.
+ * If the interface ran out of data, count an underrun, prepare the interface
+ * again, and retry once.
  * @param playback_handle Handle for the audio interface
- * @param buffer_ref Reference to the buffer of size AUDIO_BUFFER_SIZE to be copied to the hardware
+ * @param buffer The buffer to be copied to the hardware
  */
-int callback (snd_pcm_t *playback_handle,  int16_t buf_ref[]) {
-    int error_number;
-    pthread_mutex_lock(&lf_audio_mutex);
-
-    // next_buffer = buf_ref;
-    next_buffer = buf_ref;
-    // memset(next_buffer, 0, AUDIO_BUFFER_SIZE * sizeof(int16_t));
-
-    // Clear out the next buffer.
-    next_buffer_start_time += BUFFER_DURATION_NS;
-    
-    // Fill the buffer with any trailing sample data that
-    // didn't fit in the previous buffer.
-    for (int note_to_use = 0; note_to_use < NUM_NOTES; note_to_use++) {
-        struct note* note_instance = &(notes[note_to_use]);
-
-        // Add as much of the note instance into the buffer as will fit.
-        for (int i = 0; i < AUDIO_BUFFER_SIZE; i++) {
-            if (note_instance->waveform == NULL || note_instance->volume == 0.0) {
-                continue;
-            }
-            // Calculate the value to add to the sound by averaging all the channels.
-            int value = 0;
-            for (int channel = 0; channel < note_instance->waveform->num_channels; channel++) {
-                value += note_instance->waveform->waveform[note_instance->position + channel];
-            }
-            value = value / note_instance->waveform->num_channels;
-            add_to_sound(i, value * note_instance->volume);
-
-            note_instance->position += note_instance->waveform->num_channels;
-            if (note_instance->position >= note_instance->waveform->length - note_instance->waveform->num_channels) {
-                // Reached the end of the note. Reset the note.
-                note_instance->volume = 0.0;
-                note_instance->position = 0;
-                note_instance->waveform = NULL;
-                break;
-            }
-        }
-    }
-    
-    // Reinsert this same audio buffer at the end of the queue.
-    if ((error_number = snd_pcm_writei(playback_handle, buf_ref, AUDIO_BUFFER_SIZE)) < 0) {
+int write_buffer(snd_pcm_t *playback_handle, int16_t buffer[]) {
+    int error_number = snd_pcm_writei(playback_handle, buffer, AUDIO_BUFFER_SIZE);
+    if (error_number == -EPIPE) {
+        _lf_audio_count_underrun();
+        snd_pcm_prepare(playback_handle);
+        error_number = snd_pcm_writei(playback_handle, buffer, AUDIO_BUFFER_SIZE);
+    }
+    if (error_number < 0) {
         lf_print_error("Writing to sound buffer failed: %s", snd_strerror(error_number));
     }
-
-    // In case the other thread is waiting for this event, notify
-    // (the other thread should not be waiting).
-    pthread_cond_signal(&lf_audio_cond);
-    pthread_mutex_unlock(&lf_audio_mutex);
     return error_number;
 }
 
@@ -236,9 +156,7 @@ void* run_audio_loop(void* ignored) {
     }
 
 
-    int16_t buffer[buffer_size_bytes];
-    memset(buffer, 0, buffer_size_bytes * sizeof(int16_t));
-    int head = 0;
+    int16_t buffer[AUDIO_BUFFER_SIZE];
     while (!stop_audio) {
         /*
          * Wait until the interface is ready for data, or BUFFER_DURATION_NS
@@ -246,7 +164,13 @@ void* run_audio_loop(void* ignored) {
         */
 
         if ((error_number = snd_pcm_wait(playback_handle, BUFFER_DURATION_NS/1000)) < 0) {
-            lf_print_error("Poll failed (%s)\n", strerror(errno));
+            if (error_number == -EPIPE) {
+                // The interface ran out of data.
+                _lf_audio_count_underrun();
+                snd_pcm_prepare(playback_handle);
+                continue;
+            }
+            lf_print_error("Poll failed (%s)\n", snd_strerror(error_number));
             break;
         }
 
@@ -254,7 +178,9 @@ void* run_audio_loop(void* ignored) {
 
         if ((frames_to_deliver = snd_pcm_avail_update(playback_handle)) < 0) {
             if (frames_to_deliver == -EPIPE) {
-                lf_print_error("An xrun occured\n");
+                // The interface ran out of data.
+                _lf_audio_count_underrun();
+                snd_pcm_prepare(playback_handle);
                 continue;
             } else {
                 lf_print_error("Unknown ALSA avail update return value (%d)\n",
@@ -268,17 +194,8 @@ void* run_audio_loop(void* ignored) {
         }
 
         /* deliver the data */
-        callback(playback_handle, &(buffer[head]));
-
-
-        if (head <= (buffer_size_bytes - (2 * AUDIO_BUFFER_SIZE))) {
-            head += AUDIO_BUFFER_SIZE;
-        } else {
-            head = 0;
-        }
-        // Clear out the next buffer.
-        memset(&(buffer[head]), 0, AUDIO_BUFFER_SIZE * sizeof(int16_t));
-        next_buffer = &(buffer[head]);
+        _lf_audio_fill(buffer);
+        write_buffer(playback_handle, buffer);
     }
 
     snd_pcm_close(playback_handle);
@@ -295,17 +212,13 @@ void lf_start_audio_loop(instant_t start_time) {
     if (loop_thread_started) return;
     loop_thread_started = true;
     
-    // Set the start time of the current buffer to the current time
-    // minus twice the buffer duration. The two calls to callback()
-    // during setup will increment this to equal to the start time.
-    // Then create a thread to
-    // start the audio loop. That thread will place
-    // two empty audio buffers in the queue and will schedule the
-    // audio to start at the current logical time plus the buffer
-    // duration. The current buffer being filled (the second buffer)
-    // will have logical start time 0, but will play later by less
-    // than the buffer duration.
-    next_buffer_start_time = start_time - 2 * BUFFER_DURATION_NS;
+    // Set the start time of the first buffer to the current time
+    // minus twice the buffer duration. Then create a thread to
+    // start the audio loop. That thread will write the first two
+    // buffers as soon as the interface is ready for them, so that
+    // the third buffer, which will have logical start time 0, will
+    // play later by less than the buffer duration.
+    _lf_audio_set_fill_time(start_time - 2 * BUFFER_DURATION_NS);
     
     // Start the audio loop thread.
     pthread_create(&loop_thread_id, NULL, &run_audio_loop, NULL);
@@ -314,80 +227,3 @@ void lf_start_audio_loop(instant_t start_time) {
 void lf_stop_audio_loop() {
     stop_audio = true;
 }
-
-int lf_play_audio_waveform(lf_waveform_t* waveform, float emphasis, instant_t start_time) {
-    int result = 0;
-    pthread_mutex_lock(&lf_audio_mutex);
-    
-    // If the buffer into which to write has not yet been set up, wait.
-    while (next_buffer == NULL) {
-        pthread_cond_wait(&lf_audio_cond, &lf_audio_mutex);
-    }
-    instant_t time_offset = start_time - next_buffer_start_time;
-    
-    // If this is late, then tick right away.
-    if (time_offset < 0) {
-        // printf("WARNING: audio has passed the specified time by %lld.\n", time_offset);
-        time_offset = 0;
-        result = 1;
-    }
-    // Calculate the index of the tick.
-    size_t index_offset = (time_offset * SAMPLE_RATE) / BILLION;
-    
-    // If the offset is beyond the end of the audio buffer, then the program
-    // has gotten ahead of the audio. Wait for audio to catch up.
-    // This happens when a timestamp is at or close to the start time
-    // for the buffer because the audio system has not yet invoked the
-    // callback to swap buffers.  Here, we wait for the callback to
-    // occur.
-    while (index_offset >= AUDIO_BUFFER_SIZE) {
-        pthread_cond_wait(&lf_audio_cond, &lf_audio_mutex);
-        // next_buffer_start_time has been incremented by BUFFER_DURATION_NS.
-        time_offset = start_time - next_buffer_start_time;
-        // time_offset should be >= 0, but just in case:
-        if (time_offset < 0) {
-            time_offset = 0;
-            result = 1;
-        }
-        index_offset = (time_offset * SAMPLE_RATE) / BILLION;
-    }
-    
-    if (waveform == NULL) {
-        // Waveform ID is out of range. Just emit a tick.
-        add_to_sound(index_offset, MAX_AMPLITUDE * emphasis);
-    } else {
-        int note_to_use = note_counter++; // Increment so that the next note uses a new slot.
-        if (note_counter >= NUM_NOTES) {
-            note_counter = 0; // Wrap around.
-        }
-        // Initialize the note instance to start playing.
-        struct note* note_instance = &notes[note_to_use];
-        note_instance->waveform = waveform;
-        // If the waveform length is 0, do not play anything.
-        if (waveform->length > 0) {
-            note_instance->volume = emphasis;
-            note_instance->position = 0;
-                        
-            // Add as much of the note instance into the buffer as will fit.
-            for (int i = index_offset; i < AUDIO_BUFFER_SIZE; i++) {
-                // Calculate the value to add to the sound by averaging all the channels.
-                int value = 0;
-                for (int channel = 0; channel < waveform->num_channels; channel++) {
-                    value += waveform->waveform[note_instance->position + channel];
-                }
-                value = value / waveform->num_channels;
-                add_to_sound(i, value * emphasis);
-            
-                note_instance->position += note_instance->waveform->num_channels;
-                if (note_instance->position >= note_instance->waveform->length - note_instance->waveform->num_channels) {
-                    // Reached the end of the note. Reset the note.
-                    note_instance->volume = 0.0;
-                    note_instance->position = 0;
-                    break;
-                }
-            }
-        }
-    }
-    pthread_mutex_unlock(&lf_audio_mutex);
-    return result;
-}
@@ -0,0 +1,294 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ * @copyright (c) 2020-2023, The University of California at Berkeley and UT Dallas.
+ * License in [BSD 2-clause](https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md)
+ *
+ * @brief Mixer shared by the Linux and MacOS audio loops.
+ *
+ * See audio_loop_mixer.h.
+ *
+ * The command queue is a ring of slots that each carry a sequence number, so
+ * that producers claim slots with a compare-and-swap on the enqueue position
+ * and publish them by advancing the sequence number of the slot, and the audio
+ * thread sees a slot as filled only once its sequence number says so.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "audio_loop_mixer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/** The number of commands that the queue holds, which is a power of two. */
+#define COMMAND_QUEUE_SIZE 256
+
+/** A request to play a waveform. */
+typedef struct command_t {
+    volatile size_t sequence;
+    lf_waveform_t* waveform;
+    float emphasis;
+    instant_t start_time;
+} command_t;
+
+static command_t commands[COMMAND_QUEUE_SIZE];
+static volatile size_t enqueue_position = 0;
+static size_t dequeue_position = 0;
+static pthread_once_t commands_initialized = PTHREAD_ONCE_INIT;
+
+/** A waveform being played, which only the audio thread accesses. */
+struct voice {
+    const int16_t* samples;  // NULL for an unused voice.
+    int num_channels;
+    uint32_t num_frames;
+    uint32_t position;       // The next frame to play.
+    uint32_t delay;          // The number of frames before the voice starts.
+    int16_t gain;            // Volume in Q15 fixed point.
+};
+
+static struct voice voices[NUM_NOTES];
+
+// Notes are added sequentially.
+// When we reach the end of the voices array, we cycle
+// back to the beginning. If the oldest note has not
+// yet finished playing, it will be replaced by the new note.
+static int voice_counter = 0;
+
+/** The one-sample waveform of a tick. */
+static const int16_t tick[1] = { MAX_AMPLITUDE };
+
+/** The start time of the buffer that the audio thread fills next. */
+static volatile instant_t fill_time = NEVER;
+
+/** Mutex and condition variable with which reactions wait for the audio to catch up. */
+static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+
+static lf_audio_stats_t stats = { 0 };
+
+static void initialize_commands(void) {
+    for (size_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        commands[i].sequence = i;
+    }
+}
+
+void _lf_audio_set_fill_time(instant_t start_time) {
+    pthread_once(&commands_initialized, initialize_commands);
+    __atomic_store_n(&fill_time, start_time, __ATOMIC_RELEASE);
+}
+
+void _lf_audio_count_underrun(void) {
+    __atomic_fetch_add(&stats.underruns, 1, __ATOMIC_RELAXED);
+}
+
+void lf_audio_get_stats(lf_audio_stats_t* result) {
+    result->underruns = __atomic_load_n(&stats.underruns, __ATOMIC_RELAXED);
+    result->late_notes = __atomic_load_n(&stats.late_notes, __ATOMIC_RELAXED);
+    result->stalls = __atomic_load_n(&stats.stalls, __ATOMIC_RELAXED);
+    result->cut_notes = __atomic_load_n(&stats.cut_notes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Put a command on the queue.
+ * @return false if the queue is full.
+ */
+static bool push_command(lf_waveform_t* waveform, float emphasis, instant_t start_time) {
+    size_t position = __atomic_load_n(&enqueue_position, __ATOMIC_RELAXED);
+    command_t* command;
+    while (true) {
+        command = &commands[position & (COMMAND_QUEUE_SIZE - 1)];
+        size_t sequence = __atomic_load_n(&command->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&enqueue_position, &position, position + 1,
+                    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The audio thread has not taken the command that was put here
+            // a whole queue ago.
+            return false;
+        } else {
+            position = __atomic_load_n(&enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+    command->waveform = waveform;
+    command->emphasis = emphasis;
+    command->start_time = start_time;
+    __atomic_store_n(&command->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Take a command from the queue into 'result'.
+ * @return false if the queue is empty.
+ */
+static bool pop_command(command_t* result) {
+    command_t* command = &commands[dequeue_position & (COMMAND_QUEUE_SIZE - 1)];
+    if (__atomic_load_n(&command->sequence, __ATOMIC_ACQUIRE) != dequeue_position + 1) {
+        return false;
+    }
+    result->waveform = command->waveform;
+    result->emphasis = command->emphasis;
+    result->start_time = command->start_time;
+    __atomic_store_n(&command->sequence, dequeue_position + COMMAND_QUEUE_SIZE, __ATOMIC_RELEASE);
+    dequeue_position++;
+    return true;
+}
+
+/**
+ * Add the samples of 'in' scaled by 'gain' (in Q15 fixed point) to those of
+ * 'out', saturating at the limits of int16_t.
+ */
+static void mix(int16_t* out, const int16_t* in, int count, int16_t gain) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i g = _mm_set1_epi16(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+        // Form the 32-bit products from their low and high halves.
+        __m128i low = _mm_mullo_epi16(x, g);
+        __m128i high = _mm_mulhi_epi16(x, g);
+        __m128i products_low = _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 15);
+        __m128i products_high = _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 15);
+        __m128i scaled = _mm_packs_epi32(products_low, products_high);
+        __m128i y = _mm_loadu_si128((const __m128i*)(out + i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_adds_epi16(y, scaled));
+    }
+#elif defined(__ARM_NEON)
+    int16x8_t g = vdupq_n_s16(gain);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t scaled = vqrdmulhq_s16(vld1q_s16(in + i), g);
+        vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), scaled));
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t sample = out[i] + ((in[i] * (int32_t)gain) >> 15);
+        if (sample > INT16_MAX) sample = INT16_MAX;
+        else if (sample < INT16_MIN) sample = INT16_MIN;
+        out[i] = (int16_t)sample;
+    }
+}
+
+/** Start a voice for the specified command. */
+static void start_voice(command_t* command) {
+    instant_t offset = command->start_time - fill_time;
+    uint32_t delay = (offset > 0) ? (uint32_t)((offset * SAMPLE_RATE) / BILLION) : 0;
+    float emphasis = command->emphasis;
+    if (emphasis > 1.0f) emphasis = 1.0f;
+    if (emphasis <= 0.0f) return;
+
+    struct voice* voice = &voices[voice_counter++];
+    if (voice_counter >= NUM_NOTES) {
+        voice_counter = 0; // Wrap around.
+    }
+    if (voice->samples != NULL) {
+        __atomic_fetch_add(&stats.cut_notes, 1, __ATOMIC_RELAXED);
+    }
+    lf_waveform_t* waveform = command->waveform;
+    if (waveform == NULL) {
+        // Just emit a tick.
+        voice->samples = tick;
+        voice->num_channels = 1;
+        voice->num_frames = 1;
+    } else {
+        voice->samples = waveform->waveform;
+        voice->num_channels = waveform->num_channels > 0 ? waveform->num_channels : 1;
+        voice->num_frames = waveform->length / voice->num_channels;
+        if (voice->num_frames == 0) {
+            voice->samples = NULL;
+            return;
+        }
+    }
+    voice->position = 0;
+    voice->delay = delay;
+    voice->gain = (int16_t)(emphasis * INT16_MAX);
+}
+
+void _lf_audio_fill(int16_t* buffer) {
+    memset(buffer, 0, AUDIO_BUFFER_SIZE * sizeof(int16_t));
+    command_t command;
+    while (pop_command(&command)) {
+        start_voice(&command);
+    }
+    for (int v = 0; v < NUM_NOTES; v++) {
+        struct voice* voice = &voices[v];
+        if (voice->samples == NULL) continue;
+        if (voice->delay >= AUDIO_BUFFER_SIZE) {
+            voice->delay -= AUDIO_BUFFER_SIZE;
+            continue;
+        }
+        int start = (int)voice->delay;
+        voice->delay = 0;
+        int count = AUDIO_BUFFER_SIZE - start;
+        if ((uint32_t)count > voice->num_frames - voice->position) {
+            count = (int)(voice->num_frames - voice->position);
+        }
+        if (voice->num_channels == 1) {
+            mix(buffer + start, voice->samples + voice->position, count, voice->gain);
+        } else {
+            // Average the channels of each frame first.
+            int16_t frames[AUDIO_BUFFER_SIZE];
+            const int16_t* samples = voice->samples + (size_t)voice->position * voice->num_channels;
+            for (int i = 0; i < count; i++) {
+                int32_t sum = 0;
+                for (int channel = 0; channel < voice->num_channels; channel++) {
+                    sum += samples[i * voice->num_channels + channel];
+                }
+                frames[i] = (int16_t)(sum / voice->num_channels);
+            }
+            mix(buffer + start, frames, count, voice->gain);
+        }
+        voice->position += count;
+        if (voice->position >= voice->num_frames) {
+            // Reached the end of the note.
+            voice->samples = NULL;
+        }
+    }
+    __atomic_store_n(&fill_time, fill_time + BUFFER_DURATION_NS, __ATOMIC_RELEASE);
+    // Reactions waiting for the window to advance wait with a timeout, so the
+    // audio thread can signal without taking the mutex.
+    pthread_cond_broadcast(&wait_cond);
+}
+
+int lf_play_audio_waveform(lf_waveform_t* waveform, float emphasis, instant_t start_time) {
+    int result = 0;
+    pthread_once(&commands_initialized, initialize_commands);
+
+    // If the time is beyond the end of the buffer that the audio thread fills
+    // next, then the program has gotten ahead of the audio. Wait for audio to
+    // catch up.
+    if (start_time >= __atomic_load_n(&fill_time, __ATOMIC_ACQUIRE) + BUFFER_DURATION_NS) {
+        pthread_mutex_lock(&wait_mutex);
+        while (start_time >= __atomic_load_n(&fill_time, __ATOMIC_ACQUIRE) + BUFFER_DURATION_NS) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += BUFFER_DURATION_NS / 10;
+            if (deadline.tv_nsec >= BILLION) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= BILLION;
+            }
+            pthread_cond_timedwait(&wait_cond, &wait_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&wait_mutex);
+    }
+    // If this is late, then play it right away.
+    if (start_time < __atomic_load_n(&fill_time, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&stats.late_notes, 1, __ATOMIC_RELAXED);
+        result = 1;
+    }
+    while (!push_command(waveform, emphasis, start_time)) {
+        // The audio thread is behind by a whole queue of commands.
+        __atomic_fetch_add(&stats.stalls, 1, __ATOMIC_RELAXED);
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ * @copyright (c) 2020-2023, The University of California at Berkeley and UT Dallas.
+ * License in [BSD 2-clause](https://github.com/lf-lang/reactor-c/blob/main/LICENSE.md)
+ *
+ * @brief Mixer shared by the Linux and MacOS audio loops.
+ *
+ * Reactions do not write into audio buffers. lf_play_audio_waveform() puts a
+ * command on a bounded lock-free queue that any number of threads may push to,
+ * and the audio thread, which is the only consumer, turns the commands into
+ * voices when it fills the next buffer with _lf_audio_fill(). The audio thread
+ * thus never waits for a reaction, and reactions only wait for the audio thread
+ * when they are a whole buffer ahead of it, as before.
+ */
+
+#ifndef AUDIO_LOOP_MIXER_H
+#define AUDIO_LOOP_MIXER_H
+
+#include <stdint.h>
+#include "audio_loop.h"
+
+/**
+ * Set the logical time at which the first buffer filled by _lf_audio_fill()
+ * starts. This is to be called before the audio thread starts.
+ * @param start_time The start time of the first buffer.
+ */
+void _lf_audio_set_fill_time(instant_t start_time);
+
+/**
+ * Fill the specified buffer of AUDIO_BUFFER_SIZE samples, which this clears
+ * first, with the voices that play during its time window, starting the voices
+ * of the commands received since the last call. Then advance the window by
+ * BUFFER_DURATION_NS and wake up reactions waiting for it to advance.
+ * This is to be called only by the audio thread.
+ * @param buffer The buffer.
+ */
+void _lf_audio_fill(int16_t* buffer);
+
+/**
+ * Count a buffer that the audio output ran out of before it was filled.
+ */
+void _lf_audio_count_underrun(void);
+
+#endif // AUDIO_LOOP_MIXER_H
@@ -29,7 +29,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 @section DESCRIPTION
 
 This provides an implementation of a double-ended queue.
-Each node contains a void* pointer.
+Each element is a void* pointer held in a circular buffer.
 
 To use this, include the following in your target properties:
 To use this, include the following in your target properties:
@@ -57,16 +57,19 @@ Alternatively, you can call initialize:
 </pre>
 */
 
+#include <string.h>
 #include "deque.h"
+#include "platform.h"
 
-/**
- * A node in the queue.
- */
-typedef struct deque_node_t {
-    struct deque_node_t *next;
-    struct deque_node_t *prev;
-    void* value;
-} deque_node_t;
+#if defined(LF_SINGLE_THREADED)
+// Platforms only define memory barriers for the threaded runtime, but the
+// producer of a bounded queue may still be another thread or an interrupt.
+#if defined(__GNUC__) || defined(__clang__)
+#define lf_memory_barrier() __sync_synchronize()
+#else
+#define lf_memory_barrier()
+#endif
+#endif
 
 /**
  * Initialize the specified deque to an empty deque.
@@ -74,8 +77,9 @@ typedef struct deque_node_t {
  */
 void deque_initialize(deque_t* d) {
     if (d != NULL) {
-        d->front = NULL;
-        d->back = NULL;
+        d->items = NULL;
+        d->capacity = 0;
+        d->front = 0;
         d->size = 0;
     }
 }
@@ -86,7 +90,7 @@ void deque_initialize(deque_t* d) {
  */
 bool deque_is_empty(deque_t* d) {
     if (d != NULL) {
-        return (d->front == NULL);
+        return (d->size == 0);
     }
     return true;
 }
@@ -101,16 +105,28 @@ size_t deque_size(deque_t* d) {
 }
 
 /**
- * Internal function to create a node to insert in the deque.
+ * Internal function to make room for one more value in the deque.
  * Users should not call this function. It is used internally
- * by deque_push_front and deque_push_back. It allocates memory
- * that is freed in popped using deque_pop_back and deque_pop_front.
- * @param value The payload of the node.
+ * by deque_push_front and deque_push_back. If the buffer is full,
+ * it doubles its size, moving the values to the start of the new buffer.
+ * @param d The deque.
  */
-deque_node_t* _deque_create_node(void* value) {
-    deque_node_t *new_node = (deque_node_t *) calloc(1, sizeof(deque_node_t));
-    new_node->value = value;
-    return new_node;
+static void _deque_reserve(deque_t* d) {
+    if (d->size < d->capacity) return;
+    size_t capacity = (d->capacity == 0) ? 8 : 2 * d->capacity;
+    void** items = (void**) malloc(capacity * sizeof(void*));
+    if (items == NULL) abort();
+    // The values from the front to the end of the old buffer, then those that wrapped around.
+    size_t first = d->capacity - d->front;
+    if (first > d->size) first = d->size;
+    if (d->size > 0) {
+        memcpy(items, d->items + d->front, first * sizeof(void*));
+        memcpy(items + first, d->items, (d->size - first) * sizeof(void*));
+    }
+    free(d->items);
+    d->items = items;
+    d->capacity = capacity;
+    d->front = 0;
 }
 
 /**
@@ -119,16 +135,10 @@ deque_node_t* _deque_create_node(void* value) {
  * @param value The value to push.
  */
 void deque_push_front(deque_t* d, void* value) {
-    deque_node_t *n = _deque_create_node(value);
-    if (d->front == NULL) {
-    	d->back = d->front = n;
-        d->size = 1;
-    } else {
-        d->front->prev = n;
-        n->next = d->front;
-        d->front = n;
-        d->size++;
-    }
+    _deque_reserve(d);
+    d->front = (d->front - 1) & (d->capacity - 1);
+    d->items[d->front] = value;
+    d->size++;
 }
 
 /**
@@ -137,16 +147,9 @@ void deque_push_front(deque_t* d, void* value) {
  * @param value The value to push.
  */
 void deque_push_back(deque_t* d, void* value) {
-    deque_node_t *n = _deque_create_node(value);
-    if (d->back == NULL) {
-        d->back = d->front = n;
-        d->size++;
-    } else {
-        d->back->next = n;
-        n->prev = d->back;
-        d->back = n;
-        d->size++;
-    }
+    _deque_reserve(d);
+    d->items[(d->front + d->size) & (d->capacity - 1)] = value;
+    d->size++;
 }
 
 /**
@@ -155,20 +158,11 @@ void deque_push_back(deque_t* d, void* value) {
  * @return The value on the front of the queue or NULL if the queue is empty.
  */
 void* deque_pop_front(deque_t* d) {
-    if (d == NULL || d->front == NULL) {
+    if (d == NULL || d->size == 0) {
         return NULL;
     }
-
-    void* value = d->front->value;
-    deque_node_t *temp = d->front; // temporary pointer for freeing up memory
-
-    if (d->front == d->back) {
-        // popping last element in deque
-        d->front = d->back = NULL;
-    } else {
-        d->front = d->front->next;
-    }
-    free(temp); // free memory for popped node
+    void* value = d->items[d->front];
+    d->front = (d->front + 1) & (d->capacity - 1);
     d->size--;
     return value;
 }
@@ -179,21 +173,11 @@ void* deque_pop_front(deque_t* d) {
  * @return The value on the back of the queue or NULL if the queue is empty.
  */
 void* deque_pop_back(deque_t* d) {
-    if (d == NULL || d->back == NULL) {
+    if (d == NULL || d->size == 0) {
         return NULL;
     }
-
-    void* value = d->back->value;
-    deque_node_t *temp = d->back; // temporary pointer for freeing up memory
-    if (d->front == d->back) {
-        // popping last element in deque
-        d->front = d->back = NULL;
-    } else {
-        d->back = d->back->prev;
-    }
-    free(temp);
     d->size--;
-    return value;
+    return d->items[(d->front + d->size) & (d->capacity - 1)];
 }
 
 /**
@@ -202,10 +186,10 @@ void* deque_pop_back(deque_t* d) {
  * @return The value on the front of the queue or NULL if the queue is empty.
  */
 void* deque_peek_back(deque_t* d) {
-    if (d == NULL || d->back == NULL) {
+    if (d == NULL || d->size == 0) {
         return NULL;
     }
-    return d->back->value;
+    return d->items[(d->front + d->size - 1) & (d->capacity - 1)];
 }
 
 /**
@@ -214,8 +198,99 @@ void* deque_peek_back(deque_t* d) {
  * @return The value on the back of the queue or NULL if the queue is empty.
  */
 void* deque_peek_front(deque_t* d) {
-    if (d == NULL || d->front == NULL) {
+    if (d == NULL || d->size == 0) {
+        return NULL;
+    }
+    return d->items[d->front];
+}
+
+/**
+ * Free the memory used by the queue, leaving it empty. The values on the
+ * queue, if any, are not freed.
+ * @param d The queue.
+ */
+void deque_free(deque_t* d) {
+    if (d != NULL) {
+        free(d->items);
+        deque_initialize(d);
+    }
+}
+
+/**
+ * Initialize the specified bounded queue to an empty queue.
+ * @param q The queue.
+ * @param capacity The number of values that the queue can hold, which is
+ *  rounded up to a power of two.
+ * @return true on success or false if memory could not be allocated.
+ */
+bool deque_spsc_initialize(deque_spsc_t* q, size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    q->items = (void**) malloc(rounded * sizeof(void*));
+    q->capacity = rounded;
+    q->head = 0;
+    q->tail = 0;
+    return q->items != NULL;
+}
+
+/**
+ * Push a value to the back of the bounded queue. This is to be called only by
+ * the producer thread.
+ * @param q The queue.
+ * @param value The value to push.
+ * @return true on success or false if the queue is full.
+ */
+bool deque_spsc_push(deque_spsc_t* q, void* value) {
+    size_t tail = q->tail;
+    if (tail - q->head == q->capacity) {
+        return false;
+    }
+    // Do not overwrite the slot before the consumer has read it.
+    lf_memory_barrier();
+    q->items[tail & (q->capacity - 1)] = value;
+    // Publish the value only after writing it.
+    lf_memory_barrier();
+    q->tail = tail + 1;
+    return true;
+}
+
+/**
+ * Pop a value from the front of the bounded queue. This is to be called only
+ * by the consumer thread.
+ * @param q The queue.
+ * @return The value on the front of the queue or NULL if the queue is empty.
+ */
+void* deque_spsc_pop(deque_spsc_t* q) {
+    size_t head = q->head;
+    if (head == q->tail) {
         return NULL;
     }
-    return d->front->value;
+    // Read the value only after reading the tail that covers it.
+    lf_memory_barrier();
+    void* value = q->items[head & (q->capacity - 1)];
+    // Release the slot only after reading it.
+    lf_memory_barrier();
+    q->head = head + 1;
+    return value;
+}
+
+/**
+ * Return the number of values on the bounded queue. If called by a thread
+ * other than the consumer, the result may be out of date when it returns.
+ * @param q The queue.
+ */
+size_t deque_spsc_size(deque_spsc_t* q) {
+    size_t head = q->head;
+    return q->tail - head;
+}
+
+/**
+ * Free the memory used by the bounded queue once neither thread uses it.
+ * @param q The queue.
+ */
+void deque_spsc_free(deque_spsc_t* q) {
+    free(q->items);
+    q->items = NULL;
+    q->capacity = 0;
+    q->head = q->tail = 0;
 }
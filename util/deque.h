@@ -29,7 +29,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 @section DESCRIPTION
 
 This is the header file for an implementation of a double-ended queue.
-Each node in the queue contains a void* pointer.
+Each element of the queue is a void* pointer. The elements are held in a
+circular buffer that doubles in size when it is full, so pushing and popping
+do not allocate memory except when the queue grows beyond its largest size so
+far. Call deque_free() to release the buffer when the deque is no longer used.
+
+This file also declares deque_spsc_t, a bounded queue through which one
+producer thread, such as one that schedules physical actions, hands values to
+one consumer thread, such as one executing reactions, without locks.
 
 To use this, include the following in your target properties:
 <pre>
@@ -67,11 +74,27 @@ Alternatively, you can call initialize:
  * A double-ended queue data structure.
  */
 typedef struct deque_t {
-    struct deque_node_t* front;
-    struct deque_node_t* back;
+    void** items;    // The circular buffer, or NULL if nothing was pushed yet.
+    size_t capacity; // The size of the buffer, which is zero or a power of two.
+    size_t front;    // The index of the front of the queue in the buffer.
     size_t size;
 } deque_t;
 
+/**
+ * A bounded queue for one producer and one consumer thread. The producer calls
+ * only deque_spsc_push() and the consumer only deque_spsc_pop().
+ */
+typedef struct deque_spsc_t {
+    void** items;
+    size_t capacity; // A power of two.
+    // The number of values pushed, written only by the producer.
+    volatile size_t tail;
+    // Keep the counts in separate cache lines so the threads do not contend.
+    char padding[64];
+    // The number of values popped, written only by the consumer.
+    volatile size_t head;
+} deque_spsc_t;
+
 /**
  * Initialize the specified deque to an empty deque.
  * @param d The deque.
@@ -133,4 +156,50 @@ void* deque_peek_back(deque_t* d);
  */
 void* deque_peek_front(deque_t* d);
 
+/**
+ * Free the memory used by the queue, leaving it empty. The values on the
+ * queue, if any, are not freed.
+ * @param d The queue.
+ */
+void deque_free(deque_t* d);
+
+/**
+ * Initialize the specified bounded queue to an empty queue.
+ * @param q The queue.
+ * @param capacity The number of values that the queue can hold, which is
+ *  rounded up to a power of two.
+ * @return true on success or false if memory could not be allocated.
+ */
+bool deque_spsc_initialize(deque_spsc_t* q, size_t capacity);
+
+/**
+ * Push a value to the back of the bounded queue. This is to be called only by
+ * the producer thread.
+ * @param q The queue.
+ * @param value The value to push.
+ * @return true on success or false if the queue is full.
+ */
+bool deque_spsc_push(deque_spsc_t* q, void* value);
+
+/**
+ * Pop a value from the front of the bounded queue. This is to be called only
+ * by the consumer thread.
+ * @param q The queue.
+ * @return The value on the front of the queue or NULL if the queue is empty.
+ */
+void* deque_spsc_pop(deque_spsc_t* q);
+
+/**
+ * Return the number of values on the bounded queue. If called by a thread
+ * other than the consumer, the result may be out of date when it returns.
+ * @param q The queue.
+ */
+size_t deque_spsc_size(deque_spsc_t* q);
+
+/**
+ * Free the memory used by the bounded queue once neither thread uses it.
+ * @param q The queue.
+ */
+void deque_spsc_free(deque_spsc_t* q);
+
 #endif // DEQUE_H
@@ -21,20 +21,24 @@
 // Maximum number of milliseconds that wgetchr will block for.
 #define WGETCHR_TIMEOUT 1000
 
+// Interval between screen updates. Messages posted in between are shown together.
+#define LF_SENSOR_REFRESH_INTERVAL MSEC(33)
+
 // Support ASCII characters SPACE (32) through DEL (127).
 #define LF_SENSOR_TRIGGER_TABLE_SIZE 96
 
-/** Table of Lingua Franca trigger objects to schedule in response to keypresses. */
-trigger_t* _lf_sensor_trigger_table[LF_SENSOR_TRIGGER_TABLE_SIZE];
+/**
+ * Table of Lingua Franca trigger objects to schedule in response to keypresses.
+ * Entries are set once with a compare-and-swap, so the input thread reads
+ * them without a lock.
+ */
+trigger_t* volatile _lf_sensor_trigger_table[LF_SENSOR_TRIGGER_TABLE_SIZE];
 
 /** Trigger for the newline character '\n', which is platform dependent. */
-trigger_t* _lf_sensor_sensor_newline_trigger = NULL;
+trigger_t* volatile _lf_sensor_sensor_newline_trigger = NULL;
 
 /** Trigger for any key. */
-trigger_t* _lf_sensor_any_key_trigger = NULL;
-
-lf_mutex_t _lf_sensor_mutex;
-lf_cond_t _lf_sensor_simulator_cond_var;
+trigger_t* volatile _lf_sensor_any_key_trigger = NULL;
 
 enum _lf_sensor_message_type {
 	_lf_sensor_message, _lf_sensor_tick, _lf_sensor_close_windows
@@ -84,8 +88,12 @@ struct {
 	/** The length of the welcome message. */
 	int welcome_message_length;
 
-	struct _lf_sensor_message_t* message_q;
-	struct _lf_sensor_message_t* message_recycle_q;
+	/**
+	 * Messages posted and not yet shown, most recent first.
+	 * Any thread pushes onto this with a compare-and-swap, and the
+	 * output thread takes all of them at once.
+	 */
+	struct _lf_sensor_message_t* volatile message_q;
 
 	/** The width of the tick window. */
 	int tick_window_width;
@@ -96,7 +104,7 @@ struct {
  * The message will be left justified, with each string
  * in the specified array on a new line.
  * This should not be called directly by the user.
- * It assumes the mutex lock is held.
+ * It is called only by the output thread.
  * @param message_lines The message lines.
  * @param number_of_lines The number of lines.
  */
@@ -129,7 +137,7 @@ void _lf_show_message(const char* message_lines[], int number_of_lines) {
 /**
  * Start a tick window on the right of the terminal window.
  * This should not be called directly by the user.
- * It assumes the mutex lock is held.
+ * It is called only by the output thread.
  * @param width The width of the window.
  */
 void _lf_start_tick_window(int width) {
@@ -147,7 +155,7 @@ void _lf_start_tick_window(int width) {
  * Start a window on the bottom left of the terminal window
  * for printed messages from the application.
  * This should not be called directly by the user.
- * It assumes the mutex lock is held.
+ * It is called only by the output thread.
  * @param above Space to leave above the window.
  * @param right Space to leave to the right of the window.
  */
@@ -163,52 +171,52 @@ void _lf_start_print_window(int above, int right) {
 }
 
 /**
- * Post a message to be displayed.
- * This acquires the mutex lock.
+ * Post a message to be displayed at the next screen update.
+ * This does not block.
  * @param type The message type, one of
  *  _lf_sensor_message, _lf_sensor_tick, or _lf_sensor_close_window.
  * @param body The message, or NULL for exit type.
  */
 void _lf_sensor_post_message(enum _lf_sensor_message_type type, char* body) {
-    lf_mutex_lock(&_lf_sensor_mutex);
-    _lf_sensor_message_t* message = _lf_sensor.message_recycle_q;
-    if (message == NULL) {
-    	// Create a new message struct.
-    	message = calloc(1, sizeof(_lf_sensor_message_t));
-    } else {
-    	// Take this item off the recycle queue.
-    	_lf_sensor.message_recycle_q = _lf_sensor.message_recycle_q->next;
-    }
+    _lf_sensor_message_t* message = malloc(sizeof(_lf_sensor_message_t));
     message->message = body;
     message->type = type;
-	message->next = NULL; // Will be the new last message in the queue.
-	// Find the tail of the message queue and put the message there.
-	_lf_sensor_message_t* tail = _lf_sensor.message_q;
-	if (tail == NULL) {
-		_lf_sensor.message_q = message;
-	} else {
-		while (tail != NULL) {
-			if (tail->next == NULL) {
-				// tail is the last message in the queue.
-				tail->next = message;
-				break;
-			}
-			// Not yet at the last message.
-			tail = tail->next;
-		}
-	}
-	lf_cond_signal(&_lf_sensor_simulator_cond_var);
-    lf_mutex_unlock(&_lf_sensor_mutex);
+    do {
+        message->next = _lf_sensor.message_q;
+    } while (!lf_bool_compare_and_swap(&_lf_sensor.message_q, message->next, message));
+}
+
+/**
+ * Take all the messages posted so far off the queue.
+ * @return The messages in the order in which they were posted.
+ */
+_lf_sensor_message_t* _lf_sensor_take_messages() {
+    _lf_sensor_message_t* messages;
+    do {
+        messages = _lf_sensor.message_q;
+    } while (messages != NULL && !lf_bool_compare_and_swap(&_lf_sensor.message_q, messages, NULL));
+    // Reverse the list, which is most recent first.
+    _lf_sensor_message_t* result = NULL;
+    while (messages != NULL) {
+        _lf_sensor_message_t* next = messages->next;
+        messages->next = result;
+        result = messages;
+        messages = next;
+    }
+    return result;
 }
 
 /**
  * Function to register to handle printing of messages in util.h/c.
- * This acquires the mutex lock.
+ * This does not block on the output thread.
  */
 void _lf_print_message_function(const char* format, va_list args) {
 	if (_lf_sensor.log_file != NULL) {
 		// Write to a log file in addition to the window.
-		vfprintf(_lf_sensor.log_file, format, args);
+		va_list log_args;
+		va_copy(log_args, args);
+		vfprintf(_lf_sensor.log_file, format, log_args);
+		va_end(log_args);
 	}
     char* copy;
     vasprintf(&copy, format, args);
@@ -232,11 +240,8 @@ void* _lf_sensor_read_input(void* ignored) {
             // wgetch returns ERR if it times out, in which case, we continue
             // and check whether _lf_sensor.thread_created has been set to 0.
             // So here, ERR was not returned.
-            // It is imperative that we not hold the _lf_sensor_mutex when
-            // calling schedule(), because schedule() acquires another mutex.
-            // We would create a deadlock risk.  The following code is correct
-            // because a _lf_sensor_trigger_table entry, once assigned a value, becomes
-            // immutable.
+            // No lock is needed here because a _lf_sensor_trigger_table entry,
+            // once assigned a value, becomes immutable.
             if (c == '\n' && _lf_sensor_sensor_newline_trigger != NULL) {
                 lf_schedule_copy(_lf_sensor_sensor_newline_trigger, 0, &c, 1);
             } else if (c - 32 >= 0 && c - 32 < LF_SENSOR_TRIGGER_TABLE_SIZE && _lf_sensor_trigger_table[c-32] != NULL) {
@@ -256,7 +261,6 @@ void* _lf_sensor_read_input(void* ignored) {
  * message window.
  */
 void* _lf_sensor_simulator_thread(void* ignored) {
-    lf_mutex_lock(&_lf_sensor_mutex);
     _lf_sensor.thread_created = 1;
     // Clean up any previous curses state.
     if (!isendwin()) {
@@ -293,22 +297,31 @@ void* _lf_sensor_simulator_thread(void* ignored) {
 
     while(_lf_sensor.thread_created != 0) {
     	// Sadly, ncurses is not thread safe, so this thread deals with all messages.
-    	while (_lf_sensor.message_q == NULL) {
-            lf_cond_wait(&_lf_sensor_simulator_cond_var);
-    	}
-    	// Show all messages in the queue.
-		while (_lf_sensor.message_q != NULL) {
-			if (_lf_sensor.message_q->type == _lf_sensor_close_windows) {
+    	// Rather than refreshing the screen for each message, it shows all the
+    	// messages posted since the last update at once.
+    	lf_sleep(LF_SENSOR_REFRESH_INTERVAL);
+    	_lf_sensor_message_t* messages = _lf_sensor_take_messages();
+    	if (messages == NULL) continue;
+    	bool tick_window_changed = false;
+    	bool print_window_changed = false;
+		while (messages != NULL) {
+			if (messages->type == _lf_sensor_close_windows) {
 			    lf_register_print_function(NULL, -1);
 			    endwin();
-			    lf_mutex_unlock(&_lf_sensor_mutex);
+			    // Discard any messages posted after this one.
+			    while (messages != NULL) {
+			        _lf_sensor_message_t* next = messages->next;
+			        free(messages->message);
+			        free(messages);
+			        messages = next;
+			    }
 				return NULL;
-			} else if (_lf_sensor.message_q->type == _lf_sensor_tick) {
+			} else if (messages->type == _lf_sensor_tick) {
 			    wmove(_lf_sensor.tick_window, _lf_sensor.tick_cursor_y, _lf_sensor.tick_cursor_x);
-			    wprintw(_lf_sensor.tick_window, _lf_sensor.message_q->message);
+			    wprintw(_lf_sensor.tick_window, messages->message);
 			    int tick_height, tick_width;
 			    getmaxyx(_lf_sensor.tick_window, tick_height, tick_width);
-			    _lf_sensor.tick_cursor_x += strlen(_lf_sensor.message_q->message);
+			    _lf_sensor.tick_cursor_x += strlen(messages->message);
 			    if (_lf_sensor.tick_cursor_x >= tick_width - 1) {
 			        _lf_sensor.tick_cursor_x = 1;
 			        _lf_sensor.tick_cursor_y++;
@@ -317,11 +330,11 @@ void* _lf_sensor_simulator_thread(void* ignored) {
 			        _lf_sensor.tick_cursor_y = 1;
 			    }
 			    wmove(_lf_sensor.tick_window, _lf_sensor.tick_cursor_y, _lf_sensor.tick_cursor_x);
-			    wrefresh(_lf_sensor.tick_window);
-			} else if (_lf_sensor.message_q->type == _lf_sensor_message) {
+			    tick_window_changed = true;
+			} else if (messages->type == _lf_sensor_message) {
 				wmove(_lf_sensor.print_window, _lf_sensor.print_cursor_y, _lf_sensor.print_cursor_x);
 				wclrtoeol(_lf_sensor.print_window);
-				wprintw(_lf_sensor.print_window, _lf_sensor.message_q->message);
+				wprintw(_lf_sensor.print_window, messages->message);
 				_lf_sensor.print_cursor_x = 0;
 				_lf_sensor.print_cursor_y += 1;
 				if (_lf_sensor.print_cursor_y >= _lf_sensor.print_window_height - 1) {
@@ -329,19 +342,19 @@ void* _lf_sensor_simulator_thread(void* ignored) {
 				}
 				wmove(_lf_sensor.print_window, _lf_sensor.print_cursor_y, _lf_sensor.print_cursor_x);
 				wclrtoeol(_lf_sensor.print_window);
-				wrefresh(_lf_sensor.print_window);
-
-				free(_lf_sensor.message_q->message);
+				print_window_changed = true;
 			}
-			refresh();
-			_lf_sensor_message_t* tmp_recycle = _lf_sensor.message_recycle_q;
-			_lf_sensor_message_t* tmp_message = _lf_sensor.message_q;
-			_lf_sensor.message_recycle_q = _lf_sensor.message_q;
-			_lf_sensor.message_q = tmp_message->next;
-			_lf_sensor.message_recycle_q->next = tmp_recycle;
+			_lf_sensor_message_t* next = messages->next;
+			free(messages->message);
+			free(messages);
+			messages = next;
 		}
+		// Copy the changed windows to the virtual screen and then
+		// update the terminal once.
+		if (tick_window_changed) wnoutrefresh(_lf_sensor.tick_window);
+		if (print_window_changed) wnoutrefresh(_lf_sensor.print_window);
+		doupdate();
     }
-    lf_mutex_unlock(&_lf_sensor_mutex);
     return NULL;
 }
 
@@ -373,9 +386,7 @@ int start_sensor_simulator(
     _lf_sensor.welcome_message_length = number_of_lines;
     _lf_sensor.tick_window_width = tick_window_width;
     _lf_sensor.message_q = NULL;
-    _lf_sensor.message_recycle_q = NULL;
     _lf_sensor.thread_created = 0;
-    lf_cond_init(&_lf_sensor_simulator_cond_var, &_lf_sensor_mutex);
     if (_lf_sensor.thread_created == 0) {
         // Thread has not been created.
         // Zero out the trigger table.
@@ -426,26 +437,16 @@ int register_sensor_key(char key, void* action) {
     if (key != '\n' && key != '\0' && (index < 0 || index >= LF_SENSOR_TRIGGER_TABLE_SIZE)) {
         return 2;
     }
-    int result = 0;
-    lf_mutex_lock(&_lf_sensor_mutex);
+    // Set the trigger only if there is none yet, without a lock,
+    // since the input thread reads the triggers without one.
+    bool set;
     if (key == '\n') {
-        if (_lf_sensor_sensor_newline_trigger != NULL) {
-            result = 1;
-        } else {
-            _lf_sensor_sensor_newline_trigger = action;
-        }
+        set = lf_bool_compare_and_swap(&_lf_sensor_sensor_newline_trigger, NULL, action);
     } else if (key == '\0') {
         // Any key trigger.
-        if (_lf_sensor_any_key_trigger != NULL) {
-            result = 1;
-        } else {
-            _lf_sensor_any_key_trigger = action;
-        }
-    } else if (_lf_sensor_trigger_table[index] != NULL) {
-        result = 1;
+        set = lf_bool_compare_and_swap(&_lf_sensor_any_key_trigger, NULL, action);
     } else {
-        _lf_sensor_trigger_table[index] = action;
+        set = lf_bool_compare_and_swap(&_lf_sensor_trigger_table[index], NULL, action);
     }
-    lf_mutex_unlock(&_lf_sensor_mutex);
-    return result;
+    return set ? 0 : 1;
 }
@@ -0,0 +1,309 @@
+/**
+ * @file
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program to render the binary log written by a program compiled
+ * with LF_BINARY_LOGGING (see util.h) as text on standard output.
+ *
+ * The log starts with "LFBL" and a 32-bit version, followed by the records
+ * that the threads of the program appended in chunks:
+ * * 'D', id, level, line (32 bits each), the file and the format (each a
+ *   16-bit length followed by the characters), the number of arguments (8 bits),
+ *   and the kind of each argument (8 bits each);
+ * * 'E', id (32 bits), the length of the rest (16 bits), the physical time
+ *   (64 bits), and the arguments, which are 64-bit integers or doubles, or
+ *   strings given as an 8-bit length followed by the characters.
+ * The chunks of different threads are not in time order, and an entry may
+ * precede the definition of its site, so the definitions are read first and
+ * the entries are sorted by time before they are rendered.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/** Kinds of arguments as recorded by util.c. */
+#define KIND_INT 1
+#define KIND_DOUBLE 7
+#define KIND_LONG_DOUBLE 8
+#define KIND_STRING 9
+#define KIND_POINTER 10
+#define KIND_UNSIGNED 0x80
+
+/** A site that logs messages. */
+typedef struct site_t {
+    bool defined;
+    uint32_t level;
+    uint32_t line;
+    char* file;
+    char* format;
+    uint8_t num_args;
+    uint8_t kinds[256];
+} site_t;
+
+/** An entry, which refers to the log in memory. */
+typedef struct entry_t {
+    int64_t time;
+    size_t offset;   // Offset of the arguments.
+    size_t sequence; // Position in the log, to keep entries at the same time in order.
+    uint32_t id;
+} entry_t;
+
+unsigned char* log_data = NULL;
+size_t log_size = 0;
+site_t* sites = NULL;
+size_t num_sites = 0;
+entry_t* entries = NULL;
+size_t num_entries = 0;
+
+/**
+ * Print a usage message.
+ */
+void usage() {
+    printf("\nUsage: binary_log_to_text [options] binary_log_file (with .lfb extension)\n\n");
+    printf("Options: \n\n");
+    printf("  -r, --relative\n");
+    printf("   Print times relative to the first message rather than as absolute times.\n\n");
+    printf("\n\n");
+}
+
+/** Return whether 'size' more bytes are available at 'offset'. */
+static bool available(size_t offset, size_t size) {
+    return offset <= log_size && size <= log_size - offset;
+}
+
+/** Return a copy of the string with a 16-bit length at 'offset' and advance 'offset'. */
+static char* read_string(size_t* offset) {
+    uint16_t length;
+    if (!available(*offset, sizeof(length))) return NULL;
+    memcpy(&length, log_data + *offset, sizeof(length));
+    *offset += sizeof(length);
+    if (!available(*offset, length)) return NULL;
+    char* result = (char*)malloc(length + 1);
+    memcpy(result, log_data + *offset, length);
+    result[length] = '\0';
+    *offset += length;
+    return result;
+}
+
+/** Return the site with the specified id, making room for it. */
+static site_t* site(uint32_t id) {
+    if (id >= num_sites) {
+        size_t size = num_sites == 0 ? 64 : num_sites;
+        while (size <= id) size *= 2;
+        sites = (site_t*)realloc(sites, size * sizeof(site_t));
+        memset(sites + num_sites, 0, (size - num_sites) * sizeof(site_t));
+        num_sites = size;
+    }
+    return &sites[id];
+}
+
+/**
+ * Read the definitions of the sites and the positions of the entries.
+ * @return 0 on success or -1 if the log is malformed.
+ */
+static int read_records() {
+    size_t offset = 8;
+    size_t capacity = 0;
+    while (offset < log_size) {
+        unsigned char type = log_data[offset++];
+        uint32_t fields[3];
+        if (type == 'D') {
+            if (!available(offset, sizeof(fields))) return -1;
+            memcpy(fields, log_data + offset, sizeof(fields));
+            offset += sizeof(fields);
+            site_t* s = site(fields[0]);
+            s->level = fields[1];
+            s->line = fields[2];
+            s->file = read_string(&offset);
+            s->format = read_string(&offset);
+            if (s->file == NULL || s->format == NULL || !available(offset, 1)) return -1;
+            s->num_args = log_data[offset++];
+            if (!available(offset, s->num_args)) return -1;
+            memcpy(s->kinds, log_data + offset, s->num_args);
+            offset += s->num_args;
+            s->defined = true;
+        } else if (type == 'E') {
+            uint16_t length;
+            if (!available(offset, sizeof(uint32_t) + sizeof(length))) return -1;
+            if (num_entries == capacity) {
+                capacity = capacity == 0 ? 1024 : 2 * capacity;
+                entries = (entry_t*)realloc(entries, capacity * sizeof(entry_t));
+            }
+            entry_t* entry = &entries[num_entries];
+            memcpy(&entry->id, log_data + offset, sizeof(uint32_t));
+            offset += sizeof(uint32_t);
+            memcpy(&length, log_data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (length < sizeof(int64_t) || !available(offset, length)) return -1;
+            memcpy(&entry->time, log_data + offset, sizeof(int64_t));
+            entry->offset = offset + sizeof(int64_t);
+            entry->sequence = num_entries++;
+            offset += length;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** Order entries by time and then by their position in the log. */
+static int compare_entries(const void* a, const void* b) {
+    const entry_t* x = (const entry_t*)a;
+    const entry_t* y = (const entry_t*)b;
+    if (x->time != y->time) return x->time < y->time ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : (x->sequence > y->sequence);
+}
+
+/**
+ * Print the message of the specified entry by walking the format of its site
+ * and printing each conversion with the recorded argument.
+ */
+static void print_entry(entry_t* entry, site_t* s) {
+    size_t offset = entry->offset;
+    int arg = 0;
+    const char* p = s->format;
+    while (*p != '\0') {
+        if (*p != '%') {
+            putchar(*p++);
+            continue;
+        }
+        if (p[1] == '%') {
+            putchar('%');
+            p += 2;
+            continue;
+        }
+        // Copy the flags, width, and precision of the conversion, with the
+        // recorded values in place of '*', and drop its length modifier.
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p != '\0' && strchr("-+ #0'.123456789*hlzjtL", *p) != NULL && n < sizeof(spec) - 8) {
+            if (*p == '*' && arg < s->num_args) {
+                int64_t value;
+                memcpy(&value, log_data + offset, sizeof(value));
+                offset += sizeof(value);
+                arg++;
+                n += snprintf(spec + n, sizeof(spec) - 8 - n, "%d", (int)value);
+            } else if (strchr("hlzjtL", *p) == NULL) {
+                spec[n++] = *p;
+            }
+            p++;
+        }
+        if (*p == '\0' || arg >= s->num_args) break;
+        char conversion = *p++;
+        unsigned char kind = s->kinds[arg++];
+        if ((kind & ~KIND_UNSIGNED) == KIND_STRING) {
+            uint8_t length = log_data[offset++];
+            spec[n++] = 's';
+            spec[n] = '\0';
+            char string[UINT8_MAX + 1];
+            memcpy(string, log_data + offset, length);
+            string[length] = '\0';
+            offset += length;
+            printf(spec, string);
+            continue;
+        }
+        uint64_t value;
+        memcpy(&value, log_data + offset, sizeof(value));
+        offset += sizeof(value);
+        if (kind == KIND_DOUBLE || kind == KIND_LONG_DOUBLE) {
+            double real;
+            memcpy(&real, &value, sizeof(real));
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            printf(spec, real);
+        } else if (kind == KIND_POINTER) {
+            printf("0x%" PRIx64, value);
+        } else {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            if (conversion == 'c') {
+                putchar((int)value);
+            } else if (kind & KIND_UNSIGNED) {
+                printf(spec, (unsigned long long)value);
+            } else {
+                printf(spec, (long long)value);
+            }
+        }
+    }
+    putchar('\n');
+}
+
+int main(int argc, char* argv[]) {
+    bool relative = false;
+    const char* filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--relative") == 0) {
+            relative = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (filename == NULL) {
+        usage();
+        exit(0);
+    }
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "WARNING: Failed to open %s.\n", filename);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    log_size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    log_data = (unsigned char*)malloc(log_size + 1);
+    if (log_data == NULL || fread(log_data, 1, log_size, file) != log_size) {
+        fprintf(stderr, "ERROR: Failed to read %s.\n", filename);
+        exit(1);
+    }
+    fclose(file);
+    if (log_size < 8 || memcmp(log_data, "LFBL", 4) != 0) {
+        fprintf(stderr, "ERROR: %s is not a binary log.\n", filename);
+        exit(1);
+    }
+    if (read_records() != 0) {
+        fprintf(stderr, "WARNING: The log is truncated or malformed. Rendering what precedes.\n");
+    }
+    qsort(entries, num_entries, sizeof(entry_t), compare_entries);
+
+    int64_t start = (relative && num_entries > 0) ? entries[0].time : 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        entry_t* entry = &entries[i];
+        if (entry->id >= num_sites || !sites[entry->id].defined) {
+            printf("%" PRId64 " <message of unknown site %" PRIu32 ">\n", entry->time - start, entry->id);
+            continue;
+        }
+        site_t* s = &sites[entry->id];
+        printf("%" PRId64 " %s", entry->time - start, s->level >= 4 ? "DEBUG: " : "LOG: ");
+        print_entry(entry, s);
+    }
+    return 0;
+}
@@ -8,7 +8,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <curl/curl.h>
+#include <zlib.h>
 
 /*
   Usage:
@@ -58,10 +60,44 @@ typedef struct _influx_v2_client_t
     char* token; // http only
 } influx_v2_client_t;
 
+/*
+  A batch writer sends the lines given to influx_batch_add() to InfluxDB v2 in batches of
+  batch_lines lines, each in one HTTP request, which is gzip-compressed if gzip is nonzero.
+  Up to max_requests requests are in flight at once, on connections that are kept open
+  between requests, while the next batch is formed. Usage:
+    influx_batch_t b;
+    influx_batch_init(&b, c, 5000, 4, 1);
+    influx_batch_add(&b, INFLUX_MEAS("foo"), INFLUX_F_INT("i", 1), INFLUX_END);
+    ...
+    influx_batch_finish(&b);
+ */
+typedef struct _influx_batch_t
+{
+    influx_v2_client_t* client;
+    size_t batch_lines;
+    int    max_requests;
+    int    gzip;
+    CURLM* multi;
+    struct curl_slist* headers;
+    char*  url;
+    char*  buf;          // The batch being formed.
+    size_t len;          // Size of buf.
+    size_t used;         // Bytes of buf used.
+    size_t num_lines;    // Lines in buf.
+    int    in_flight;    // Requests in flight.
+    size_t lines_sent;   // Lines of the requests that succeeded.
+    int    failures;     // Requests that failed.
+} influx_batch_t;
+
 int format_line(char **buf, int *len, size_t used, ...);
 int post_http(influx_client_t* c, ...);
 int send_udp(influx_client_t* c, ...);
 int post_curl(influx_v2_client_t* c, ...);
+int influx_batch_init(influx_batch_t* b, influx_v2_client_t* c, size_t batch_lines, int max_requests, int gzip);
+int influx_batch_add(influx_batch_t* b, ...);
+int influx_batch_flush(influx_batch_t* b);
+int influx_batch_poll(influx_batch_t* b, int timeout_ms);
+int influx_batch_finish(influx_batch_t* b);
 
 #define IF_TYPE_ARG_END       0
 #define IF_TYPE_MEAS          1
@@ -305,6 +341,186 @@ int post_curl(influx_v2_client_t* c, ...)
     return res;
 }
 
+int influx_batch_init(influx_batch_t* b, influx_v2_client_t* c, size_t batch_lines, int max_requests, int gzip)
+{
+    memset(b, 0, sizeof(influx_batch_t));
+    b->client = c;
+    b->batch_lines = batch_lines > 0 ? batch_lines : 1;
+    b->max_requests = max_requests > 0 ? max_requests : 1;
+    b->gzip = gzip;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    if(!(b->multi = curl_multi_init()))
+        return CURLE_FAILED_INIT;
+    curl_multi_setopt(b->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)b->max_requests);
+    // Multiplex the requests on one connection if the server speaks HTTP/2.
+    curl_multi_setopt(b->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    int len = snprintf(NULL, 0, "http://%s:%d/api/v2/write?org=%s&bucket=%s&precision=%s",
+            c->host ? c->host : "localhost", c->port ? c->port : 8086, c->org, c->bucket,
+            c->precision ? c->precision : "ns");
+    if(!(b->url = (char*)malloc(len + 1)))
+        return -1;
+    snprintf(b->url, len + 1, "http://%s:%d/api/v2/write?org=%s&bucket=%s&precision=%s",
+            c->host ? c->host : "localhost", c->port ? c->port : 8086, c->org, c->bucket,
+            c->precision ? c->precision : "ns");
+
+    len = snprintf(NULL, 0, "Authorization: Token %s", c->token ? c->token : "");
+    char* token_string = (char*)malloc(len + 1);
+    if(!token_string)
+        return -1;
+    snprintf(token_string, len + 1, "Authorization: Token %s", c->token ? c->token : "");
+    b->headers = curl_slist_append(b->headers, token_string);
+    free(token_string);
+    b->headers = curl_slist_append(b->headers, "Content-Type: text/plain; charset=utf-8");
+    if(gzip)
+        b->headers = curl_slist_append(b->headers, "Content-Encoding: gzip");
+    return 0;
+}
+
+int influx_batch_add(influx_batch_t* b, ...)
+{
+    va_list ap;
+    va_start(ap, b);
+    int used = _format_line2(&b->buf, ap, &b->len, b->used);
+    va_end(ap);
+    if(used < 0) {
+        // The lines of the batch are freed by _format_line2().
+        b->len = b->used = b->num_lines = 0;
+        return used;
+    }
+    b->used = used;
+    if(++b->num_lines >= b->batch_lines)
+        return influx_batch_flush(b);
+    return 0;
+}
+
+/* A request in flight, attached to its curl handle. */
+typedef struct _influx_request_t
+{
+    char*  body;
+    size_t num_lines;
+} _influx_request_t;
+
+/* Compress the given data with gzip into a buffer that must be freed. */
+int _influx_gzip(const char* data, size_t size, char** out, size_t* out_size)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 added to the window bits selects the gzip format.
+    if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+    size_t capacity = deflateBound(&stream, size);
+    if(!(*out = (char*)malloc(capacity))) {
+        deflateEnd(&stream);
+        return -1;
+    }
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)size;
+    stream.next_out = (Bytef*)*out;
+    stream.avail_out = (uInt)capacity;
+    int ret = deflate(&stream, Z_FINISH);
+    *out_size = stream.total_out;
+    deflateEnd(&stream);
+    if(ret != Z_STREAM_END) {
+        free(*out);
+        return -1;
+    }
+    return 0;
+}
+
+int influx_batch_flush(influx_batch_t* b)
+{
+    if(b->num_lines == 0)
+        return 0;
+    while(b->in_flight >= b->max_requests)
+        influx_batch_poll(b, 1000);
+
+    _influx_request_t* request = (_influx_request_t*)malloc(sizeof(_influx_request_t));
+    CURL* curl = curl_easy_init();
+    if(!request || !curl) {
+        free(request);
+        return CURLE_FAILED_INIT;
+    }
+    request->num_lines = b->num_lines;
+    size_t size = b->used;
+    if(b->gzip) {
+        if(_influx_gzip(b->buf, b->used, &request->body, &size)) {
+            free(request);
+            curl_easy_cleanup(curl);
+            return -1;
+        }
+        free(b->buf);
+    } else {
+        request->body = b->buf;
+    }
+    b->buf = NULL;
+    b->len = b->used = b->num_lines = 0;
+
+    curl_easy_setopt(curl, CURLOPT_URL, b->url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, b->headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)size);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+    curl_multi_add_handle(b->multi, curl);
+    b->in_flight++;
+    return influx_batch_poll(b, 0);
+}
+
+int influx_batch_poll(influx_batch_t* b, int timeout_ms)
+{
+    int running = 0, queued = 0;
+    curl_multi_perform(b->multi, &running);
+    if(timeout_ms > 0 && running > 0) {
+        curl_multi_wait(b->multi, NULL, 0, timeout_ms, NULL);
+        curl_multi_perform(b->multi, &running);
+    }
+    CURLMsg* msg;
+    while((msg = curl_multi_info_read(b->multi, &queued))) {
+        if(msg->msg != CURLMSG_DONE)
+            continue;
+        CURL* curl = msg->easy_handle;
+        _influx_request_t* request;
+        long response_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&request);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+        if(msg->data.result != CURLE_OK) {
+            fprintf(stderr, "influxdb-c::influx_batch_poll: request failed: %s\n", curl_easy_strerror(msg->data.result));
+            b->failures++;
+        } else if(response_code / 100 != 2) {
+            fprintf(stderr, "influxdb-c::influx_batch_poll: response code: %ld\n", response_code);
+            b->failures++;
+        } else {
+            b->lines_sent += request->num_lines;
+        }
+        curl_multi_remove_handle(b->multi, curl);
+        curl_easy_cleanup(curl);
+        free(request->body);
+        free(request);
+        b->in_flight--;
+    }
+    return b->failures ? -1 : 0;
+}
+
+int influx_batch_finish(influx_batch_t* b)
+{
+    influx_batch_flush(b);
+    while(b->in_flight > 0)
+        influx_batch_poll(b, 1000);
+    curl_multi_cleanup(b->multi);
+    curl_slist_free_all(b->headers);
+    curl_global_cleanup();
+    free(b->url);
+    free(b->buf);
+    b->multi = NULL;
+    b->headers = NULL;
+    b->url = NULL;
+    b->buf = NULL;
+    return b->failures ? -1 : 0;
+}
+
 int format_line(char **buf, int *len, size_t used, ...)
 {
     va_list ap;
@@ -338,12 +554,14 @@ int _format_line2(char** buf, va_list ap, size_t *_len, size_t used)
     for(;;) {\
         if((written = snprintf(*buf + used, len - used, ##fmter)) < 0)\
             goto FAIL;\
-        if(used + written >= len && !(*buf = (char*)realloc(*buf, len *= 2)))\
-            return -1;\
-        else {\
-            used += written;\
-            break;\
+        if(used + written >= len) {\
+            /* Grow the buffer and format again. */\
+            if(!(*buf = (char*)realloc(*buf, len *= 2)))\
+                return -1;\
+            continue;\
         }\
+        used += written;\
+        break;\
     }
 
     size_t len = *_len;
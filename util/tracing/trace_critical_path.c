@@ -0,0 +1,447 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program to analyze the parallelism of the execution of each tag in a
+ * Lingua Franca trace file and write a report to a comma-separated values file.
+ *
+ * The reactions executed at a tag are grouped by their level, which is recorded
+ * with the start of each reaction. The schedulers execute the levels one after
+ * another, so the critical path of a tag is taken to be the sum over its levels
+ * of the longest execution time of a reaction in the level, which is the time
+ * the tag would take with unlimited workers. The report gives:
+ * * the total execution time of the reactions, the critical path, and the time
+ *   observed from the first reaction start to the last reaction end of each tag;
+ * * the estimated time and speedup with N workers, obtained by assigning the
+ *   reactions of each level, longest first, to the least loaded of N workers;
+ * * the idle time of the workers between the reactions of each level, assuming
+ *   that all the workers seen in the trace take part in every tag, and the time
+ *   the workers report waiting and the scheduler reports advancing time;
+ * * percentiles of the lag of physical time behind logical time when a tag
+ *   starts executing;
+ * * the reactions most often on the critical path.
+ */
+#define LF_TRACE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "reactor.h"
+#include "trace.h"
+#include "trace_util.h"
+
+/**
+ * Maximum number of workers for which the speedup is estimated. The speedup is
+ * estimated for the powers of two up to this number.
+ */
+#define MAX_ESTIMATED_WORKERS 64
+
+/** Maximum number of reactions listed as most often on the critical path. */
+#define MAX_CRITICAL_REACTIONS 20
+
+/** File containing the trace binary data. */
+FILE* trace_file = NULL;
+
+/** File for writing the output data. */
+FILE* output_file = NULL;
+
+/** File for writing summary statistics. Not used. */
+FILE* summary_file = NULL;
+
+/**
+ * Print a usage message.
+ */
+void usage() {
+    printf("\nUsage: trace_critical_path trace_file (with .lft extension)\n\n");
+}
+
+/** An execution of a reaction. */
+typedef struct execution_t {
+    void* reactor;
+    int number;
+    int level;
+    int worker;
+    instant_t logical_time;
+    microstep_t microstep;
+    instant_t start;
+    instant_t end;
+} execution_t;
+
+/** Time spent on the critical path by a reaction. */
+typedef struct critical_reaction_t {
+    void* reactor;
+    int number;
+    size_t count;
+    interval_t time;
+} critical_reaction_t;
+
+/** All records of the trace file. */
+trace_record_t* records = NULL;
+size_t num_records = 0;
+
+/** The reaction executions, sorted by tag, level, and then execution time. */
+execution_t* executions = NULL;
+size_t num_executions = 0;
+
+/** The number of workers seen in the trace. */
+int num_workers = 0;
+
+/**
+ * Report that memory could not be allocated and exit.
+ */
+static void out_of_memory() {
+    fprintf(stderr, "Out of memory.\n");
+    exit(3);
+}
+
+/**
+ * Read all the records of the trace file, sorted by physical time.
+ */
+static void read_records() {
+    size_t capacity = TRACE_BUFFER_CAPACITY;
+    records = (trace_record_t*)malloc(capacity * sizeof(trace_record_t));
+    if (records == NULL) out_of_memory();
+    int trace_length;
+    while ((trace_length = read_trace()) != 0) {
+        if (num_records + trace_length > capacity) {
+            capacity *= 2;
+            records = (trace_record_t*)realloc(records, capacity * sizeof(trace_record_t));
+            if (records == NULL) out_of_memory();
+        }
+        memcpy(&records[num_records], trace, trace_length * sizeof(trace_record_t));
+        num_records += trace_length;
+    }
+    // Each worker writes its own traces, which are interleaved in the trace file.
+    trace_record_t* scratch = (trace_record_t*)malloc((num_records + 1) * sizeof(trace_record_t));
+    if (scratch == NULL) out_of_memory();
+    // Bottom-up merge sort, which keeps records with equal times in the order of the file.
+    trace_record_t* from = records;
+    trace_record_t* to = scratch;
+    for (size_t width = 1; width < num_records; width *= 2) {
+        for (size_t left = 0; left < num_records; left += 2 * width) {
+            size_t middle = (left + width < num_records) ? left + width : num_records;
+            size_t right = (left + 2 * width < num_records) ? left + 2 * width : num_records;
+            size_t i = left, j = middle, k = left;
+            while (i < middle && j < right) {
+                to[k++] = (from[j].physical_time < from[i].physical_time) ? from[j++] : from[i++];
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < right) to[k++] = from[j++];
+        }
+        trace_record_t* tmp = from;
+        from = to;
+        to = tmp;
+    }
+    if (from != records) {
+        free(records);
+        records = from;
+    } else {
+        free(scratch);
+    }
+}
+
+static int compare_executions(const void* a, const void* b) {
+    const execution_t* x = (const execution_t*)a;
+    const execution_t* y = (const execution_t*)b;
+    if (x->logical_time != y->logical_time) return (x->logical_time < y->logical_time) ? -1 : 1;
+    if (x->microstep != y->microstep) return (x->microstep < y->microstep) ? -1 : 1;
+    if (x->level != y->level) return (x->level < y->level) ? -1 : 1;
+    // Longest first.
+    interval_t duration_x = x->end - x->start;
+    interval_t duration_y = y->end - y->start;
+    return (duration_x > duration_y) ? -1 : (duration_x < duration_y);
+}
+
+/**
+ * Pair the starts and ends of the reactions executed by each worker into
+ * executions and sort them.
+ */
+static void find_executions() {
+    for (size_t i = 0; i < num_records; i++) {
+        if (records[i].event_type <= reaction_ends && records[i].src_id >= num_workers) {
+            num_workers = records[i].src_id + 1;
+        }
+    }
+    // The reaction being executed by each worker, or -1.
+    long* executing = (long*)malloc((num_workers + 1) * sizeof(long));
+    if (executing == NULL) out_of_memory();
+    for (int i = 0; i < num_workers; i++) executing[i] = -1;
+    executions = (execution_t*)malloc((num_records / 2 + 1) * sizeof(execution_t));
+    if (executions == NULL) out_of_memory();
+    for (size_t i = 0; i < num_records; i++) {
+        trace_record_t* record = &records[i];
+        if (record->event_type > reaction_ends || record->src_id < 0) continue;
+        if (record->event_type == reaction_starts) {
+            executing[record->src_id] = (long)i;
+        } else if (executing[record->src_id] >= 0) {
+            trace_record_t* start = &records[executing[record->src_id]];
+            executing[record->src_id] = -1;
+            if (start->pointer != record->pointer || start->dst_id != record->dst_id) continue;
+            execution_t* execution = &executions[num_executions++];
+            execution->reactor = start->pointer;
+            execution->number = start->dst_id;
+            execution->level = (int)start->extra_delay;
+            execution->worker = start->src_id;
+            execution->logical_time = start->logical_time;
+            execution->microstep = start->microstep;
+            execution->start = start->physical_time;
+            execution->end = record->physical_time;
+        }
+    }
+    free(executing);
+    qsort(executions, num_executions, sizeof(execution_t), compare_executions);
+}
+
+/**
+ * Return the time to execute the given reactions of one level, longest first,
+ * by assigning each to the least loaded of the given number of workers.
+ */
+static interval_t estimate_level_time(execution_t* level, size_t length, int workers) {
+    interval_t loads[MAX_ESTIMATED_WORKERS] = {0};
+    interval_t longest = 0;
+    for (size_t i = 0; i < length; i++) {
+        int least = 0;
+        for (int w = 1; w < workers; w++) {
+            if (loads[w] < loads[least]) least = w;
+        }
+        loads[least] += level[i].end - level[i].start;
+        if (loads[least] > longest) longest = loads[least];
+    }
+    return longest;
+}
+
+static int compare_times(const void* a, const void* b) {
+    instant_t x = *(const instant_t*)a;
+    instant_t y = *(const instant_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_critical_by_reaction(const void* a, const void* b) {
+    const critical_reaction_t* x = (const critical_reaction_t*)a;
+    const critical_reaction_t* y = (const critical_reaction_t*)b;
+    if (x->reactor != y->reactor) return ((uintptr_t)x->reactor < (uintptr_t)y->reactor) ? -1 : 1;
+    return (x->number > y->number) - (x->number < y->number);
+}
+
+static int compare_critical_by_time(const void* a, const void* b) {
+    const critical_reaction_t* x = (const critical_reaction_t*)a;
+    const critical_reaction_t* y = (const critical_reaction_t*)b;
+    return (x->time < y->time) - (x->time > y->time);
+}
+
+/** Return the given percentile of the given sorted times. */
+static instant_t percentile(instant_t* times, size_t length, double fraction) {
+    if (length == 0) return 0;
+    size_t index = (size_t)(fraction * (double)(length - 1) + 0.5);
+    return times[index];
+}
+
+/**
+ * Sum the durations of the intervals between the given start and end events,
+ * matched by worker.
+ * @param count Place to store the number of intervals.
+ */
+static interval_t sum_intervals(trace_event_t start_event, trace_event_t end_event, size_t* count) {
+    // Index 0 is for records without a worker.
+    instant_t* started = (instant_t*)calloc(num_workers + 2, sizeof(instant_t));
+    if (started == NULL) out_of_memory();
+    for (int i = 0; i < num_workers + 2; i++) started[i] = NEVER;
+    interval_t total = 0;
+    *count = 0;
+    for (size_t i = 0; i < num_records; i++) {
+        trace_record_t* record = &records[i];
+        if (record->event_type != start_event && record->event_type != end_event) continue;
+        int slot = (record->src_id >= 0 && record->src_id <= num_workers) ? record->src_id + 1 : 0;
+        if (record->event_type == start_event) {
+            started[slot] = record->physical_time;
+        } else if (started[slot] != NEVER) {
+            total += record->physical_time - started[slot];
+            started[slot] = NEVER;
+            (*count)++;
+        }
+    }
+    free(started);
+    return total;
+}
+
+/**
+ * Analyze the executions of each tag and write the report.
+ */
+static void write_report() {
+    int max_workers = (num_workers > 0) ? num_workers : 1;
+    size_t max_level_size = 0;
+    interval_t work = 0, critical_path = 0, observed = 0, idle = 0;
+    // Estimated times for 1, 2, 4, ... workers.
+    interval_t estimates[MAX_ESTIMATED_WORKERS + 1] = {0};
+    size_t num_tags = 0;
+    instant_t* lags = (instant_t*)malloc((num_executions + 1) * sizeof(instant_t));
+    critical_reaction_t* critical = (critical_reaction_t*)malloc((num_executions + 1) * sizeof(critical_reaction_t));
+    if (lags == NULL || critical == NULL) out_of_memory();
+    size_t num_critical = 0;
+
+    size_t tag_start = 0;
+    while (tag_start < num_executions) {
+        execution_t* first = &executions[tag_start];
+        size_t tag_end = tag_start;
+        instant_t earliest = first->start, latest = first->end;
+        while (tag_end < num_executions && executions[tag_end].logical_time == first->logical_time
+                && executions[tag_end].microstep == first->microstep) {
+            if (executions[tag_end].start < earliest) earliest = executions[tag_end].start;
+            if (executions[tag_end].end > latest) latest = executions[tag_end].end;
+            tag_end++;
+        }
+        num_tags++;
+        observed += latest - earliest;
+        lags[num_tags - 1] = earliest - first->logical_time;
+
+        size_t level_start = tag_start;
+        while (level_start < tag_end) {
+            size_t level_end = level_start;
+            instant_t level_earliest = executions[level_start].start;
+            instant_t level_latest = executions[level_start].end;
+            interval_t level_work = 0;
+            while (level_end < tag_end && executions[level_end].level == executions[level_start].level) {
+                execution_t* execution = &executions[level_end++];
+                level_work += execution->end - execution->start;
+                if (execution->start < level_earliest) level_earliest = execution->start;
+                if (execution->end > level_latest) level_latest = execution->end;
+            }
+            size_t level_size = level_end - level_start;
+            if (level_size > max_level_size) max_level_size = level_size;
+            work += level_work;
+            // The longest reaction of the level comes first.
+            execution_t* longest = &executions[level_start];
+            critical_path += longest->end - longest->start;
+            critical[num_critical].reactor = longest->reactor;
+            critical[num_critical].number = longest->number;
+            critical[num_critical].count = 1;
+            critical[num_critical++].time = longest->end - longest->start;
+            interval_t level_idle = (interval_t)max_workers * (level_latest - level_earliest) - level_work;
+            if (level_idle > 0) idle += level_idle;
+            for (int w = 1; w <= MAX_ESTIMATED_WORKERS; w *= 2) {
+                estimates[w] += estimate_level_time(&executions[level_start], level_size, w);
+            }
+            level_start = level_end;
+        }
+        tag_start = tag_end;
+    }
+
+    fprintf(output_file, "Tags executed:, %zu\n", num_tags);
+    fprintf(output_file, "Reactions executed:, %zu\n", num_executions);
+    fprintf(output_file, "Workers seen:, %d\n", num_workers);
+    fprintf(output_file, "\nExecution Times\n");
+    fprintf(output_file, "Total reaction execution time:, %lld\n", (long long)work);
+    fprintf(output_file, "Critical path:, %lld\n", (long long)critical_path);
+    fprintf(output_file, "Observed time executing tags:, %lld\n", (long long)observed);
+    fprintf(output_file, "Average parallelism:, %f\n", (critical_path > 0) ? (double)work / (double)critical_path : 0.0);
+    fprintf(output_file, "Idle time at level barriers:, %lld\n", (long long)idle);
+    size_t count;
+    interval_t waiting = sum_intervals(worker_wait_starts, worker_wait_ends, &count);
+    fprintf(output_file, "Time workers waited:, %lld, in %zu waits\n", (long long)waiting, count);
+    interval_t advancing = sum_intervals(scheduler_advancing_time_starts, scheduler_advancing_time_ends, &count);
+    fprintf(output_file, "Time advancing time:, %lld, in %zu advances\n", (long long)advancing, count);
+    interval_t gil_waiting = sum_intervals(gil_wait_starts, gil_wait_ends, &count);
+    if (count > 0) {
+        fprintf(output_file, "Time waiting for the GIL:, %lld, in %zu waits\n", (long long)gil_waiting, count);
+        interval_t python = sum_intervals(python_call_starts, python_call_ends, &count);
+        fprintf(output_file, "Time executing Python:, %lld, in %zu calls\n", (long long)python, count);
+    }
+
+    fprintf(output_file, "\nEstimated Speedup\n");
+    fprintf(output_file, "Workers, Time, Speedup\n");
+    for (int w = 1; w <= MAX_ESTIMATED_WORKERS; w *= 2) {
+        fprintf(output_file, "%d, %lld, %f\n", w, (long long)estimates[w],
+                (estimates[w] > 0) ? (double)estimates[1] / (double)estimates[w] : 1.0);
+        // More workers than reactions in any level do not help.
+        if ((size_t)w >= max_level_size) break;
+    }
+
+    qsort(lags, num_tags, sizeof(instant_t), compare_times);
+    fprintf(output_file, "\nLag of Physical Time Behind Logical Time at the Start of Each Tag\n");
+    fprintf(output_file, "Min, 50th Percentile, 90th Percentile, 99th Percentile, Max\n");
+    fprintf(output_file, "%lld, %lld, %lld, %lld, %lld\n",
+            (long long)percentile(lags, num_tags, 0.0),
+            (long long)percentile(lags, num_tags, 0.5),
+            (long long)percentile(lags, num_tags, 0.9),
+            (long long)percentile(lags, num_tags, 0.99),
+            (long long)percentile(lags, num_tags, 1.0));
+
+    // Aggregate the time on the critical path by reaction.
+    qsort(critical, num_critical, sizeof(critical_reaction_t), compare_critical_by_reaction);
+    size_t num_reactions = 0;
+    for (size_t i = 0; i < num_critical; i++) {
+        if (num_reactions > 0 && compare_critical_by_reaction(&critical[num_reactions - 1], &critical[i]) == 0) {
+            critical[num_reactions - 1].count++;
+            critical[num_reactions - 1].time += critical[i].time;
+        } else {
+            critical[num_reactions++] = critical[i];
+        }
+    }
+    qsort(critical, num_reactions, sizeof(critical_reaction_t), compare_critical_by_time);
+    fprintf(output_file, "\nReactions on the Critical Path\n");
+    fprintf(output_file, "Reactor, Reaction, Occurrences, Time, Pct Critical Path\n");
+    for (size_t i = 0; i < num_reactions && i < MAX_CRITICAL_REACTIONS; i++) {
+        char* reactor_name = get_object_description(critical[i].reactor, NULL);
+        fprintf(output_file, "%s, %d, %zu, %lld, %f\n",
+                (reactor_name == NULL) ? "UNKNOWN" : reactor_name,
+                critical[i].number,
+                critical[i].count,
+                (long long)critical[i].time,
+                (critical_path > 0) ? (100.0 * (double)critical[i].time) / (double)critical_path : 0.0);
+    }
+    free(lags);
+    free(critical);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        usage();
+        exit(0);
+    }
+    // Open the trace file.
+    trace_file = open_file(argv[1], "r");
+    if (trace_file == NULL) exit(1);
+
+    // Construct the name of the report file and open it.
+    char* root = root_name(argv[1]);
+    char report_filename[strlen(root) + 19];
+    strcpy(report_filename, root);
+    strcat(report_filename, "_critical_path.csv");
+    output_file = open_file(report_filename, "w");
+    if (output_file == NULL) exit(1);
+    free(root);
+
+    if (read_header() >= 0) {
+        read_records();
+        find_executions();
+        write_report();
+        printf("Analyzed %zu reaction executions. Wrote %s.\n", num_executions, report_filename);
+        free(executions);
+        free(records);
+
+        // File closing is handled by termination function.
+    }
+}
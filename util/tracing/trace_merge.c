@@ -0,0 +1,392 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program to merge the trace files of the federates of a federation and
+ * of the RTI into a single trace file sorted by physical time, which can be converted
+ * by the other programs.
+ *
+ * The physical times in the trace of a federate include the offset that clock
+ * synchronization adds to its physical clock, which changes in steps recorded by
+ * "Clock sync offset" events. Unless disabled, the physical times of such a trace are
+ * corrected by removing the offset in effect when each record was written and adding
+ * instead the offset interpolated linearly between the adjustments, so that the clock
+ * drift between adjustments is spread over the records rather than appearing as jumps.
+ * Traces without these events, such as that of the RTI, are left unchanged.
+ *
+ * The records of each trace file are sorted, and then the files are merged with a
+ * k-way merge. Since the pointers of the object tables of different processes may
+ * coincide, the highest byte of the pointers of each file is replaced by an identifier
+ * of the file, which makes them distinct while keeping the object table consistent.
+ */
+#define LF_TRACE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "reactor.h"
+#include "trace.h"
+#include "trace_util.h"
+
+/** File containing the trace binary data. */
+FILE* trace_file = NULL;
+
+/** File for writing the output data. */
+FILE* output_file = NULL;
+
+/** File for writing summary statistics. Not used. */
+FILE* summary_file = NULL;
+
+/**
+ * Print a usage message.
+ */
+void usage() {
+    printf("\nUsage: trace_merge [options] trace_file ... (with .lft extension)\n");
+    printf("Options: \n");
+    printf("  -o, --output file\n");
+    printf("   Write the merged trace to the given file rather than federation.lft.\n");
+    printf("  -n, --no-clock-correction\n");
+    printf("   Do not correct the physical times for clock synchronization.\n");
+    printf("\n");
+}
+
+/** The records and objects of a trace file. */
+typedef struct trace_input_t {
+    trace_record_t* records;
+    size_t length;
+    instant_t start_time;
+    object_description_t* objects;
+    int num_objects;
+} trace_input_t;
+
+/** An adjustment of the clock synchronization offset. */
+typedef struct clock_adjustment_t {
+    instant_t time;     // Physical time, including the new offset.
+    interval_t offset;  // The new offset.
+} clock_adjustment_t;
+
+/**
+ * Report that memory could not be allocated and exit.
+ */
+static void out_of_memory() {
+    fprintf(stderr, "Out of memory.\n");
+    exit(3);
+}
+
+/**
+ * Return the given pointer of the given trace file made distinct from
+ * the pointers of the other trace files.
+ */
+static void* remap_pointer(void* pointer, int file) {
+    if (pointer == NULL) return NULL;
+    return (void*)((uintptr_t)pointer ^ ((uintptr_t)(file + 1) << (8 * sizeof(void*) - 8)));
+}
+
+/**
+ * Read the trace file with the given path into the given input.
+ */
+static void read_input(const char* path, int file, trace_input_t* input) {
+    trace_file = open_file(path, "r");
+    if (read_header() == (size_t)-1) exit(1);
+    input->start_time = start_time;
+    input->num_objects = object_table_size;
+    input->objects = (object_description_t*)calloc(object_table_size + 1, sizeof(object_description_t));
+    if (input->objects == NULL) out_of_memory();
+    for (int i = 0; i < object_table_size; i++) {
+        input->objects[i] = object_table[i];
+        input->objects[i].pointer = remap_pointer(object_table[i].pointer, file);
+        input->objects[i].trigger = (trigger_t*)remap_pointer(object_table[i].trigger, file);
+        input->objects[i].description = strdup(object_table[i].description);
+        if (input->objects[i].description == NULL) out_of_memory();
+    }
+
+    size_t capacity = TRACE_BUFFER_CAPACITY;
+    input->records = (trace_record_t*)malloc(capacity * sizeof(trace_record_t));
+    input->length = 0;
+    if (input->records == NULL) out_of_memory();
+    int trace_length;
+    while ((trace_length = read_trace()) != 0) {
+        if (input->length + trace_length > capacity) {
+            capacity *= 2;
+            input->records = (trace_record_t*)realloc(input->records, capacity * sizeof(trace_record_t));
+            if (input->records == NULL) out_of_memory();
+        }
+        for (int i = 0; i < trace_length; i++) {
+            trace_record_t* record = &input->records[input->length++];
+            *record = trace[i];
+            record->pointer = remap_pointer(trace[i].pointer, file);
+            record->trigger = (trigger_t*)remap_pointer(trace[i].trigger, file);
+        }
+    }
+    close_trace_file();
+    printf("Read %zu records from %s.\n", input->length, path);
+}
+
+static int compare_adjustments(const void* a, const void* b) {
+    instant_t time_a = ((const clock_adjustment_t*)a)->time;
+    instant_t time_b = ((const clock_adjustment_t*)b)->time;
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+/**
+ * Correct the physical times of the given trace for the clock synchronization
+ * adjustments it records, if any.
+ */
+static void correct_clock(trace_input_t* input) {
+    size_t count = 0;
+    for (size_t i = 0; i < input->length; i++) {
+        if (input->records[i].event_type == clock_sync_offset) count++;
+    }
+    if (count == 0) return;
+    clock_adjustment_t* adjustments = (clock_adjustment_t*)malloc(count * sizeof(clock_adjustment_t));
+    if (adjustments == NULL) out_of_memory();
+    count = 0;
+    for (size_t i = 0; i < input->length; i++) {
+        if (input->records[i].event_type == clock_sync_offset) {
+            adjustments[count].time = input->records[i].physical_time;
+            adjustments[count++].offset = input->records[i].extra_delay;
+        }
+    }
+    qsort(adjustments, count, sizeof(clock_adjustment_t), compare_adjustments);
+
+    for (size_t i = 0; i < input->length; i++) {
+        instant_t time = input->records[i].physical_time;
+        // Find the last adjustment before the record by binary search. Before the
+        // first adjustment, the offset was zero.
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (adjustments[middle].time <= time) low = middle + 1;
+            else high = middle;
+        }
+        interval_t offset = (low == 0) ? 0 : adjustments[low - 1].offset;
+        instant_t local_time = time - offset;
+
+        // Interpolate the offset at the local time between the adjustments,
+        // whose local times are their times minus their offsets.
+        interval_t corrected_offset;
+        instant_t next_local = 0;
+        if (low < count) next_local = adjustments[low].time - adjustments[low].offset;
+        if (low == 0) {
+            corrected_offset = adjustments[0].offset;
+        } else if (low == count || next_local <= local_time) {
+            corrected_offset = adjustments[low - 1].offset;
+        } else {
+            clock_adjustment_t* previous = &adjustments[low - 1];
+            instant_t previous_local = previous->time - previous->offset;
+            double fraction = (local_time <= previous_local) ? 0.0
+                    : (double)(local_time - previous_local) / (double)(next_local - previous_local);
+            corrected_offset = previous->offset
+                    + (interval_t)(fraction * (double)(adjustments[low].offset - previous->offset));
+        }
+        input->records[i].physical_time = local_time + corrected_offset;
+    }
+    printf("Corrected physical times for %zu clock synchronization adjustments.\n", count);
+    free(adjustments);
+}
+
+/**
+ * Sort the records of the given trace by physical time, keeping records with
+ * equal times in the order of the trace file.
+ */
+static void sort_records(trace_input_t* input) {
+    trace_record_t* scratch = (trace_record_t*)malloc((input->length + 1) * sizeof(trace_record_t));
+    if (scratch == NULL) out_of_memory();
+    trace_record_t* from = input->records;
+    trace_record_t* to = scratch;
+    size_t length = input->length;
+    // Bottom-up merge sort, which is stable.
+    for (size_t width = 1; width < length; width *= 2) {
+        for (size_t left = 0; left < length; left += 2 * width) {
+            size_t middle = (left + width < length) ? left + width : length;
+            size_t right = (left + 2 * width < length) ? left + 2 * width : length;
+            size_t i = left, j = middle, k = left;
+            while (i < middle && j < right) {
+                to[k++] = (from[j].physical_time < from[i].physical_time) ? from[j++] : from[i++];
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < right) to[k++] = from[j++];
+        }
+        trace_record_t* tmp = from;
+        from = to;
+        to = tmp;
+    }
+    if (from != input->records) {
+        free(input->records);
+        input->records = from;
+    } else {
+        free(scratch);
+    }
+}
+
+/** Position of the next record of a trace file in the merge. */
+typedef struct merge_cursor_t {
+    trace_input_t* input;
+    size_t next;
+    int file;
+} merge_cursor_t;
+
+/** Return true if the next record of cursor a precedes that of cursor b. */
+static bool cursor_precedes(merge_cursor_t* a, merge_cursor_t* b) {
+    instant_t time_a = a->input->records[a->next].physical_time;
+    instant_t time_b = b->input->records[b->next].physical_time;
+    return time_a < time_b || (time_a == time_b && a->file < b->file);
+}
+
+/** Restore the heap property of the given heap below the given index. */
+static void sift_down(merge_cursor_t* heap, int size, int index) {
+    while (true) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < size && cursor_precedes(&heap[left], &heap[smallest])) smallest = left;
+        if (right < size && cursor_precedes(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == index) return;
+        merge_cursor_t tmp = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = tmp;
+        index = smallest;
+    }
+}
+
+/**
+ * Write the header of the merged trace file in the format of write_trace_header()
+ * in trace.c.
+ */
+static void write_header(trace_input_t* inputs, int num_inputs, instant_t merged_start_time) {
+    int num_objects = 0;
+    for (int i = 0; i < num_inputs; i++) num_objects += inputs[i].num_objects;
+    if (fwrite(&merged_start_time, sizeof(instant_t), 1, output_file) != 1
+            || fwrite(&num_objects, sizeof(int), 1, output_file) != 1) {
+        _LF_TRACE_FAILURE(output_file);
+    }
+    for (int i = 0; i < num_inputs; i++) {
+        for (int j = 0; j < inputs[i].num_objects; j++) {
+            object_description_t* object = &inputs[i].objects[j];
+            if (fwrite(&object->pointer, sizeof(void*), 1, output_file) != 1
+                    || fwrite(&object->trigger, sizeof(trigger_t*), 1, output_file) != 1
+                    || fwrite(&object->type, sizeof(_lf_trace_object_t), 1, output_file) != 1
+                    || fwrite(object->description, strlen(object->description) + 1, 1, output_file) != 1) {
+                _LF_TRACE_FAILURE(output_file);
+            }
+        }
+    }
+}
+
+/** Write the given records as one trace of the merged trace file. */
+static void write_records(trace_record_t* records, int length) {
+    if (fwrite(&length, sizeof(int), 1, output_file) != 1
+            || fwrite(records, sizeof(trace_record_t), length, output_file) != (size_t)length) {
+        _LF_TRACE_FAILURE(output_file);
+    }
+}
+
+/**
+ * Merge the sorted records of the given traces into the output file.
+ * @return The number of records written.
+ */
+static size_t merge_records(trace_input_t* inputs, int num_inputs) {
+    merge_cursor_t* heap = (merge_cursor_t*)malloc(num_inputs * sizeof(merge_cursor_t));
+    if (heap == NULL) out_of_memory();
+    int size = 0;
+    for (int i = 0; i < num_inputs; i++) {
+        if (inputs[i].length == 0) continue;
+        heap[size].input = &inputs[i];
+        heap[size].next = 0;
+        heap[size++].file = i;
+    }
+    for (int i = size / 2 - 1; i >= 0; i--) sift_down(heap, size, i);
+
+    size_t written = 0;
+    int buffered = 0;
+    while (size > 0) {
+        trace[buffered++] = heap[0].input->records[heap[0].next++];
+        if (buffered == TRACE_BUFFER_CAPACITY) {
+            write_records(trace, buffered);
+            written += buffered;
+            buffered = 0;
+        }
+        if (heap[0].next == heap[0].input->length) heap[0] = heap[--size];
+        sift_down(heap, size, 0);
+    }
+    if (buffered > 0) {
+        write_records(trace, buffered);
+        written += buffered;
+    }
+    free(heap);
+    return written;
+}
+
+int main(int argc, char* argv[]) {
+    char* output_filename = "federation.lft";
+    bool correct = true;
+    char** paths = (char**)malloc(argc * sizeof(char*));
+    if (paths == NULL) out_of_memory();
+    int num_inputs = 0;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--no-clock-correction") == 0) {
+            correct = false;
+        } else if (argv[i][0] != '-') {
+            paths[num_inputs++] = argv[i];
+        } else {
+            usage();
+            exit(0);
+        }
+    }
+    if (num_inputs == 0 || num_inputs > 255) {
+        usage();
+        exit(0);
+    }
+
+    trace_input_t* inputs = (trace_input_t*)calloc(num_inputs, sizeof(trace_input_t));
+    if (inputs == NULL) out_of_memory();
+    // The federates start at the same time, and the RTI no later.
+    instant_t merged_start_time = NEVER;
+    for (int i = 0; i < num_inputs; i++) {
+        read_input(paths[i], i, &inputs[i]);
+        if (correct) correct_clock(&inputs[i]);
+        sort_records(&inputs[i]);
+        if (inputs[i].start_time > merged_start_time) merged_start_time = inputs[i].start_time;
+    }
+
+    output_file = open_file(output_filename, "wb");
+    write_header(inputs, num_inputs, merged_start_time);
+    size_t written = merge_records(inputs, num_inputs);
+    printf("Wrote %zu records from %d trace files to %s.\n", written, num_inputs, output_filename);
+
+    for (int i = 0; i < num_inputs; i++) {
+        for (int j = 0; j < inputs[i].num_objects; j++) {
+            free(inputs[i].objects[j].description);
+        }
+        free(inputs[i].objects);
+        free(inputs[i].records);
+    }
+    free(inputs);
+    free(paths);
+    // File closing is handled by termination function.
+}
@@ -0,0 +1,648 @@
+/**
+ * @file
+ * @author Edward A. Lee
+ *
+ * @section LICENSE
+Copyright (c) 2023, The University of California at Berkeley
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * @section DESCRIPTION
+ * Standalone program to convert a Lingua Franca trace file to an Apache Arrow IPC
+ * file, which can be loaded without parsing by pyarrow, pandas, Polars, DuckDB, and
+ * other analytics tools, and converted by them to Parquet.
+ *
+ * The file has one row per trace record with the columns below. The event type,
+ * reactor, and trigger are dictionary-encoded, with the names of the event types
+ * as the dictionary of the event column and the descriptions of the object table
+ * as the dictionaries of the reactor and trigger columns.
+ * * event: dictionary<int32, utf8>
+ * * reactor: dictionary<int32, utf8>, null if the record has no reactor
+ * * source: int32, the worker or federate ID, or -1
+ * * destination: int32, the reaction or federate ID, or -1
+ * * logical_time: timestamp[ns]
+ * * microstep: uint32
+ * * physical_time: timestamp[ns]
+ * * trigger: dictionary<int32, utf8>, null if the record has no trigger
+ * * extra_delay: int64
+ *
+ * The file is written without the Arrow libraries. Its metadata are flatbuffers
+ * following Schema.fbs, Message.fbs, and File.fbs of the Arrow format, which are
+ * built front to back by the fb_* functions below.
+ */
+#define LF_TRACE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "reactor.h"
+#include "trace.h"
+#include "trace_util.h"
+
+/** Maximum number of rows in a record batch. */
+#define ARROW_BATCH_SIZE 65536
+
+/** File containing the trace binary data. */
+FILE* trace_file = NULL;
+
+/** File for writing the output data. */
+FILE* output_file = NULL;
+
+/** File for writing summary statistics. Not used. */
+FILE* summary_file = NULL;
+
+/**
+ * Print a usage message.
+ */
+void usage() {
+    printf("\nUsage: trace_to_arrow trace_file (with .lft extension)\n\n");
+}
+
+/**
+ * Report that memory could not be allocated and exit.
+ */
+static void out_of_memory() {
+    fprintf(stderr, "Out of memory.\n");
+    exit(3);
+}
+
+////////////////////////////////////////////////////////////
+//// Flatbuffers
+
+/**
+ * A flatbuffer under construction. Objects are appended after the objects
+ * that refer to them, as required by the unsigned offsets of flatbuffers,
+ * and the offsets are filled in by fb_patch() once the objects are written.
+ * The buffer begins with the offset of the root table.
+ */
+typedef struct fb_t {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} fb_t;
+
+/** Maximum number of fields of a table. */
+#define FB_MAX_FIELDS 8
+
+/**
+ * The fields of a table to be written by fb_table(). Fields of size zero
+ * are absent. Offset fields have size 4 and are filled in by fb_patch()
+ * at the positions stored by fb_table().
+ */
+typedef struct fb_table_t {
+    int num_fields;
+    int sizes[FB_MAX_FIELDS];
+    uint64_t values[FB_MAX_FIELDS];
+    size_t positions[FB_MAX_FIELDS];
+} fb_table_t;
+
+/**
+ * Append the given number of zero bytes to the flatbuffer, preceded by padding
+ * such that the given offset from their position is a multiple of the given
+ * alignment.
+ * @return The position of the bytes.
+ */
+static size_t fb_reserve(fb_t* fb, size_t size, size_t alignment, size_t offset) {
+    size_t position = fb->size;
+    while ((position + offset) % alignment != 0) position++;
+    if (position + size > fb->capacity) {
+        fb->capacity = (position + size) * 2;
+        fb->data = (unsigned char*)realloc(fb->data, fb->capacity);
+        if (fb->data == NULL) out_of_memory();
+    }
+    memset(fb->data + fb->size, 0, position + size - fb->size);
+    fb->size = position + size;
+    return position;
+}
+
+/** Start a flatbuffer with room for the offset of its root table. */
+static void fb_init(fb_t* fb) {
+    fb->size = 0;
+    fb_reserve(fb, sizeof(uint32_t), 8, 0);
+}
+
+/** Store in the offset at the given position a reference to the given position. */
+static void fb_patch(fb_t* fb, size_t position, size_t target) {
+    uint32_t offset = (uint32_t)(target - position);
+    memcpy(fb->data + position, &offset, sizeof(offset));
+}
+
+/** Set a scalar field of a table. */
+static void fb_scalar(fb_table_t* table, int field, int size, uint64_t value) {
+    table->sizes[field] = size;
+    table->values[field] = value;
+    if (field >= table->num_fields) table->num_fields = field + 1;
+}
+
+/** Add an offset field to a table, to be filled in by fb_patch(). */
+static void fb_offset(fb_table_t* table, int field) {
+    fb_scalar(table, field, sizeof(uint32_t), 0);
+}
+
+/**
+ * Write a table with the given fields, preceded by its vtable. The fields are
+ * laid out from the largest to the smallest, after the offset to the vtable,
+ * which is placed so that the fields are aligned to their sizes.
+ * @return The position of the table.
+ */
+static size_t fb_table(fb_t* fb, fb_table_t* table) {
+    uint16_t vtable[2 + FB_MAX_FIELDS];
+    uint16_t inline_size = sizeof(int32_t);
+    for (int size = 8; size > 0; size /= 2) {
+        for (int i = 0; i < table->num_fields; i++) {
+            if (table->sizes[i] == size) {
+                vtable[2 + i] = inline_size;
+                inline_size += size;
+            } else if (table->sizes[i] == 0) {
+                vtable[2 + i] = 0;
+            }
+        }
+    }
+    vtable[0] = (uint16_t)((2 + table->num_fields) * sizeof(uint16_t));
+    vtable[1] = inline_size;
+    size_t vtable_position = fb_reserve(fb, vtable[0], 2, 0);
+    memcpy(fb->data + vtable_position, vtable, vtable[0]);
+    size_t position = fb_reserve(fb, inline_size, 8, 4);
+    int32_t vtable_offset = (int32_t)(position - vtable_position);
+    memcpy(fb->data + position, &vtable_offset, sizeof(vtable_offset));
+    for (int i = 0; i < table->num_fields; i++) {
+        if (table->sizes[i] == 0) continue;
+        table->positions[i] = position + vtable[2 + i];
+        // Little endian, as is the Arrow format on the platforms we support.
+        memcpy(fb->data + table->positions[i], &table->values[i], table->sizes[i]);
+    }
+    return position;
+}
+
+/**
+ * Write a vector of the given number of elements of the given size and alignment,
+ * which are copied from the given data, if it is not NULL.
+ * @return The position of the vector.
+ */
+static size_t fb_vector(fb_t* fb, size_t count, size_t size, size_t alignment, const void* data) {
+    if (alignment < sizeof(uint32_t)) alignment = sizeof(uint32_t);
+    size_t position = fb_reserve(fb, sizeof(uint32_t) + count * size, alignment, sizeof(uint32_t));
+    uint32_t length = (uint32_t)count;
+    memcpy(fb->data + position, &length, sizeof(length));
+    if (data != NULL) memcpy(fb->data + position + sizeof(uint32_t), data, count * size);
+    return position;
+}
+
+/**
+ * Write a string.
+ * @return The position of the string.
+ */
+static size_t fb_string(fb_t* fb, const char* string) {
+    size_t length = strlen(string);
+    // The terminating null is included, but not counted.
+    size_t position = fb_vector(fb, length + 1, 1, 1, string);
+    uint32_t count = (uint32_t)length;
+    memcpy(fb->data + position, &count, sizeof(count));
+    return position;
+}
+
+////////////////////////////////////////////////////////////
+//// Arrow metadata
+
+/** Arrow metadata version V5. */
+#define ARROW_VERSION 4
+
+/** Members of the Type union of Schema.fbs. */
+typedef enum {
+    arrow_int = 2,
+    arrow_utf8 = 5,
+    arrow_timestamp = 10
+} arrow_type_t;
+
+/** Members of the MessageHeader union of Message.fbs. */
+typedef enum {
+    arrow_schema_message = 1,
+    arrow_dictionary_message = 2,
+    arrow_record_batch_message = 3
+} arrow_message_t;
+
+/** Buffer struct of Schema.fbs, giving the location of a buffer in a message body. */
+typedef struct arrow_buffer_t {
+    int64_t offset;
+    int64_t length;
+} arrow_buffer_t;
+
+/** FieldNode struct of Message.fbs. */
+typedef struct arrow_field_node_t {
+    int64_t length;
+    int64_t null_count;
+} arrow_field_node_t;
+
+/** Block struct of File.fbs, giving the location of a message in the file. */
+typedef struct arrow_block_t {
+    int64_t offset;
+    int32_t metadata_length;
+    int64_t body_length;
+} arrow_block_t;
+
+/** A column of the file. */
+typedef struct arrow_column_t {
+    const char* name;
+    arrow_type_t type;
+    int bit_width;         // For integers.
+    bool is_signed;        // For integers.
+    bool nullable;
+    int dictionary;        // The ID of the dictionary of the column or -1.
+} arrow_column_t;
+
+/** The columns, in the order described at the top of this file. */
+static const arrow_column_t columns[] = {
+    {"event", arrow_utf8, 0, false, false, 0},
+    {"reactor", arrow_utf8, 0, false, true, 1},
+    {"source", arrow_int, 32, true, false, -1},
+    {"destination", arrow_int, 32, true, false, -1},
+    {"logical_time", arrow_timestamp, 64, true, false, -1},
+    {"microstep", arrow_int, 32, false, false, -1},
+    {"physical_time", arrow_timestamp, 64, true, false, -1},
+    {"trigger", arrow_utf8, 0, false, true, 2},
+    {"extra_delay", arrow_int, 64, true, false, -1}
+};
+#define NUM_COLUMNS (int)(sizeof(columns) / sizeof(columns[0]))
+
+/** Write an Int table of Schema.fbs. */
+static size_t write_int_type(fb_t* fb, int bit_width, bool is_signed) {
+    fb_table_t table = {0};
+    fb_scalar(&table, 0, 4, bit_width);
+    fb_scalar(&table, 1, 1, is_signed);
+    return fb_table(fb, &table);
+}
+
+/** Write a Field table of Schema.fbs for the given column. */
+static size_t write_field(fb_t* fb, const arrow_column_t* column) {
+    fb_table_t table = {0};
+    fb_offset(&table, 0);                       // name
+    fb_scalar(&table, 1, 1, column->nullable);  // nullable
+    fb_scalar(&table, 2, 1, column->type);      // type_type
+    fb_offset(&table, 3);                       // type
+    if (column->dictionary >= 0) {
+        fb_offset(&table, 4);                   // dictionary
+    }
+    fb_offset(&table, 5);                       // children
+    size_t position = fb_table(fb, &table);
+
+    fb_patch(fb, table.positions[0], fb_string(fb, column->name));
+    fb_table_t type = {0};
+    if (column->type == arrow_int) {
+        fb_patch(fb, table.positions[3], write_int_type(fb, column->bit_width, column->is_signed));
+    } else if (column->type == arrow_timestamp) {
+        fb_scalar(&type, 0, 2, 3);              // unit: NANOSECOND, no timezone
+        fb_patch(fb, table.positions[3], fb_table(fb, &type));
+    } else {
+        fb_patch(fb, table.positions[3], fb_table(fb, &type));
+    }
+    if (column->dictionary >= 0) {
+        fb_table_t encoding = {0};
+        fb_scalar(&encoding, 0, 8, column->dictionary);  // id
+        fb_offset(&encoding, 1);                           // indexType
+        size_t encoding_position = fb_table(fb, &encoding);
+        fb_patch(fb, table.positions[4], encoding_position);
+        fb_patch(fb, encoding.positions[1], write_int_type(fb, 32, true));
+    }
+    // Readers require the children, even if there are none.
+    fb_patch(fb, table.positions[5], fb_vector(fb, 0, sizeof(uint32_t), 4, NULL));
+    return position;
+}
+
+/** Write a Schema table of Schema.fbs. */
+static size_t write_schema(fb_t* fb) {
+    fb_table_t table = {0};
+    fb_offset(&table, 1);  // fields
+    size_t position = fb_table(fb, &table);
+    size_t fields = fb_vector(fb, NUM_COLUMNS, sizeof(uint32_t), 4, NULL);
+    fb_patch(fb, table.positions[1], fields);
+    for (int i = 0; i < NUM_COLUMNS; i++) {
+        size_t element = fields + sizeof(uint32_t) * (i + 1);
+        fb_patch(fb, element, write_field(fb, &columns[i]));
+    }
+    return position;
+}
+
+/**
+ * Write a RecordBatch table of Message.fbs.
+ */
+static size_t write_record_batch(fb_t* fb, int64_t length, arrow_field_node_t* nodes, int num_nodes,
+        arrow_buffer_t* buffers, int num_buffers) {
+    fb_table_t table = {0};
+    fb_scalar(&table, 0, 8, length);  // length
+    fb_offset(&table, 1);             // nodes
+    fb_offset(&table, 2);             // buffers
+    size_t position = fb_table(fb, &table);
+    fb_patch(fb, table.positions[1], fb_vector(fb, num_nodes, sizeof(arrow_field_node_t), 8, nodes));
+    fb_patch(fb, table.positions[2], fb_vector(fb, num_buffers, sizeof(arrow_buffer_t), 8, buffers));
+    return position;
+}
+
+/**
+ * Start the flatbuffer of a message with the given header type and body length.
+ * @return The position of the offset to the header, to be filled in by fb_patch().
+ */
+static size_t start_message(fb_t* fb, arrow_message_t header_type, size_t body_length) {
+    fb_init(fb);
+    fb_table_t table = {0};
+    fb_scalar(&table, 0, 2, ARROW_VERSION);  // version
+    fb_scalar(&table, 1, 1, header_type);    // header_type
+    fb_offset(&table, 2);                    // header
+    fb_scalar(&table, 3, 8, body_length);    // bodyLength
+    fb_patch(fb, 0, fb_table(fb, &table));
+    return table.positions[2];
+}
+
+////////////////////////////////////////////////////////////
+//// Arrow file
+
+/** Number of bytes written to the output file. */
+size_t file_position = 0;
+
+/** Locations of the dictionary batches and record batches written. */
+arrow_block_t* dictionary_blocks = NULL;
+int num_dictionary_blocks = 0;
+arrow_block_t* record_batch_blocks = NULL;
+int num_record_batch_blocks = 0;
+
+/** Write the given bytes to the output file followed by padding to a multiple of 8 bytes. */
+static void write_padded(const void* data, size_t size) {
+    static const unsigned char padding[8] = {0};
+    if (size > 0 && fwrite(data, 1, size, output_file) != size) {
+        fprintf(stderr, "ERROR: Failed to write the output file.\n");
+        exit(1);
+    }
+    size_t padding_size = (8 - size % 8) % 8;
+    fwrite(padding, 1, padding_size, output_file);
+    file_position += size + padding_size;
+}
+
+/**
+ * The body of a message, which is a sequence of buffers, each padded to a
+ * multiple of 8 bytes.
+ */
+typedef struct arrow_body_t {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    arrow_buffer_t buffers[2 * NUM_COLUMNS];
+    int num_buffers;
+} arrow_body_t;
+
+/** Append a buffer with the given bytes to a body. */
+static void add_buffer(arrow_body_t* body, const void* data, size_t size) {
+    size_t padded_size = (size + 7) & ~(size_t)7;
+    if (body->size + padded_size > body->capacity) {
+        body->capacity = (body->size + padded_size) * 2;
+        body->data = (unsigned char*)realloc(body->data, body->capacity);
+        if (body->data == NULL) out_of_memory();
+    }
+    if (size > 0) memcpy(body->data + body->size, data, size);
+    memset(body->data + body->size + size, 0, padded_size - size);
+    body->buffers[body->num_buffers].offset = (int64_t)body->size;
+    body->buffers[body->num_buffers].length = (int64_t)size;
+    body->num_buffers++;
+    body->size += padded_size;
+}
+
+/**
+ * Write a message, consisting of a continuation marker, the length of the
+ * metadata, the metadata, and the body, and record its location in the given
+ * array of blocks, unless it is NULL.
+ */
+static void write_message(fb_t* fb, arrow_body_t* body, arrow_block_t** blocks, int* num_blocks) {
+    // The metadata length includes padding to align the body to 8 bytes.
+    int32_t prefix[2] = {-1, (int32_t)((fb->size + 7) & ~(size_t)7)};
+    arrow_block_t block = {(int64_t)file_position, (int32_t)sizeof(prefix) + prefix[1], 0};
+    write_padded(prefix, sizeof(prefix));
+    write_padded(fb->data, fb->size);
+    if (body != NULL) {
+        write_padded(body->data, body->size);
+        block.body_length = (int64_t)body->size;
+    }
+    if (blocks != NULL) {
+        *blocks = (arrow_block_t*)realloc(*blocks, (*num_blocks + 1) * sizeof(arrow_block_t));
+        if (*blocks == NULL) out_of_memory();
+        (*blocks)[(*num_blocks)++] = block;
+    }
+}
+
+/** Write a dictionary batch with the given strings. */
+static void write_dictionary(fb_t* fb, int id, const char** strings, int count) {
+    arrow_body_t body = {0};
+    int32_t* offsets = (int32_t*)malloc((count + 1) * sizeof(int32_t));
+    if (offsets == NULL) out_of_memory();
+    offsets[0] = 0;
+    for (int i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + (int32_t)strlen(strings[i]);
+    }
+    char* characters = (char*)malloc(offsets[count] + 1);
+    if (characters == NULL) out_of_memory();
+    for (int i = 0; i < count; i++) {
+        memcpy(characters + offsets[i], strings[i], offsets[i + 1] - offsets[i]);
+    }
+    add_buffer(&body, NULL, 0);  // validity
+    add_buffer(&body, offsets, (count + 1) * sizeof(int32_t));
+    add_buffer(&body, characters, offsets[count]);
+    free(offsets);
+    free(characters);
+
+    size_t header = start_message(fb, arrow_dictionary_message, body.size);
+    fb_table_t table = {0};
+    fb_scalar(&table, 0, 8, id);  // id
+    fb_offset(&table, 1);         // data
+    fb_patch(fb, header, fb_table(fb, &table));
+    arrow_field_node_t node = {count, 0};
+    fb_patch(fb, table.positions[1], write_record_batch(fb, count, &node, 1, body.buffers, body.num_buffers));
+    write_message(fb, &body, &dictionary_blocks, &num_dictionary_blocks);
+    free(body.data);
+}
+
+/** The columns of the rows that are not yet written. */
+int num_rows = 0;
+int32_t events[ARROW_BATCH_SIZE];
+int32_t reactors[ARROW_BATCH_SIZE];
+uint8_t reactors_valid[ARROW_BATCH_SIZE / 8];
+int reactors_null = 0;
+int32_t sources[ARROW_BATCH_SIZE];
+int32_t destinations[ARROW_BATCH_SIZE];
+int64_t logical_times[ARROW_BATCH_SIZE];
+uint32_t microsteps[ARROW_BATCH_SIZE];
+int64_t physical_times[ARROW_BATCH_SIZE];
+int32_t triggers[ARROW_BATCH_SIZE];
+uint8_t triggers_valid[ARROW_BATCH_SIZE / 8];
+int triggers_null = 0;
+int64_t extra_delays[ARROW_BATCH_SIZE];
+
+/** Write the rows that are not yet written as a record batch. */
+static void write_rows(fb_t* fb) {
+    if (num_rows == 0) return;
+    size_t bitmap_size = (num_rows + 7) / 8;
+    arrow_body_t body = {0};
+    arrow_field_node_t nodes[NUM_COLUMNS];
+    for (int i = 0; i < NUM_COLUMNS; i++) {
+        nodes[i].length = num_rows;
+        nodes[i].null_count = 0;
+    }
+    nodes[1].null_count = reactors_null;
+    nodes[7].null_count = triggers_null;
+    // Each column has a validity buffer, which is empty if there are no nulls.
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, events, num_rows * sizeof(int32_t));
+    add_buffer(&body, reactors_valid, reactors_null > 0 ? bitmap_size : 0);
+    add_buffer(&body, reactors, num_rows * sizeof(int32_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, sources, num_rows * sizeof(int32_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, destinations, num_rows * sizeof(int32_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, logical_times, num_rows * sizeof(int64_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, microsteps, num_rows * sizeof(uint32_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, physical_times, num_rows * sizeof(int64_t));
+    add_buffer(&body, triggers_valid, triggers_null > 0 ? bitmap_size : 0);
+    add_buffer(&body, triggers, num_rows * sizeof(int32_t));
+    add_buffer(&body, NULL, 0);
+    add_buffer(&body, extra_delays, num_rows * sizeof(int64_t));
+
+    size_t header = start_message(fb, arrow_record_batch_message, body.size);
+    fb_patch(fb, header, write_record_batch(fb, num_rows, nodes, NUM_COLUMNS, body.buffers, body.num_buffers));
+    write_message(fb, &body, &record_batch_blocks, &num_record_batch_blocks);
+    free(body.data);
+
+    num_rows = 0;
+    reactors_null = 0;
+    triggers_null = 0;
+    memset(reactors_valid, 0, sizeof(reactors_valid));
+    memset(triggers_valid, 0, sizeof(triggers_valid));
+}
+
+/**
+ * Read a trace in the trace_file and add its records to the rows,
+ * writing a record batch whenever the rows are full.
+ * @return The number of records read or 0 upon seeing an EOF.
+ */
+size_t read_and_write_trace(fb_t* fb) {
+    int trace_length = read_trace();
+    if (trace_length == 0) return 0;
+    for (int i = 0; i < trace_length; i++) {
+        int row = num_rows++;
+        int index;
+        events[row] = trace[i].event_type;
+        if (get_object_description(trace[i].pointer, &index) != NULL) {
+            reactors[row] = index;
+            reactors_valid[row / 8] |= (uint8_t)(1 << (row % 8));
+        } else {
+            reactors[row] = 0;
+            reactors_null++;
+        }
+        sources[row] = trace[i].src_id;
+        destinations[row] = trace[i].dst_id;
+        logical_times[row] = trace[i].logical_time;
+        microsteps[row] = trace[i].microstep;
+        physical_times[row] = trace[i].physical_time;
+        if (get_trigger_name(trace[i].trigger, &index) != NULL) {
+            triggers[row] = index;
+            triggers_valid[row / 8] |= (uint8_t)(1 << (row % 8));
+        } else {
+            triggers[row] = 0;
+            triggers_null++;
+        }
+        extra_delays[row] = trace[i].extra_delay;
+        if (num_rows == ARROW_BATCH_SIZE) write_rows(fb);
+    }
+    return trace_length;
+}
+
+/**
+ * Write the end of the stream of messages and the footer, which repeats the
+ * schema and gives the locations of the batches.
+ */
+static void write_footer(fb_t* fb) {
+    int32_t end_of_stream[2] = {-1, 0};
+    write_padded(end_of_stream, sizeof(end_of_stream));
+
+    fb_init(fb);
+    fb_table_t table = {0};
+    fb_scalar(&table, 0, 2, ARROW_VERSION);  // version
+    fb_offset(&table, 1);                    // schema
+    fb_offset(&table, 2);                    // dictionaries
+    fb_offset(&table, 3);                    // recordBatches
+    fb_patch(fb, 0, fb_table(fb, &table));
+    fb_patch(fb, table.positions[1], write_schema(fb));
+    fb_patch(fb, table.positions[2],
+            fb_vector(fb, num_dictionary_blocks, sizeof(arrow_block_t), 8, dictionary_blocks));
+    fb_patch(fb, table.positions[3],
+            fb_vector(fb, num_record_batch_blocks, sizeof(arrow_block_t), 8, record_batch_blocks));
+    write_padded(fb->data, fb->size);
+    int32_t footer_length = (int32_t)((fb->size + 7) & ~(size_t)7);
+    fwrite(&footer_length, sizeof(footer_length), 1, output_file);
+    fwrite("ARROW1", 1, 6, output_file);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        usage();
+        exit(0);
+    }
+    // Open the trace file.
+    trace_file = open_file(argv[1], "r");
+    if (trace_file == NULL) exit(1);
+
+    // Construct the name of the arrow output file and open it.
+    char* root = root_name(argv[1]);
+    char arrow_filename[strlen(root) + 7];
+    strcpy(arrow_filename, root);
+    strcat(arrow_filename, ".arrow");
+    output_file = open_file(arrow_filename, "wb");
+    if (output_file == NULL) exit(1);
+    free(root);
+
+    if (read_header() >= 0) {
+        fb_t fb = {0};
+        write_padded("ARROW1", 6);
+
+        size_t header = start_message(&fb, arrow_schema_message, 0);
+        fb_patch(&fb, header, write_schema(&fb));
+        write_message(&fb, NULL, NULL, NULL);
+
+        write_dictionary(&fb, 0, trace_event_names, NUM_EVENT_TYPES);
+        const char** descriptions = (const char**)malloc((object_table_size + 1) * sizeof(char*));
+        if (descriptions == NULL) out_of_memory();
+        for (int i = 0; i < object_table_size; i++) {
+            descriptions[i] = object_table[i].description;
+        }
+        write_dictionary(&fb, 1, descriptions, object_table_size);
+        write_dictionary(&fb, 2, descriptions, object_table_size);
+        free(descriptions);
+
+        size_t records = 0;
+        size_t records_read;
+        while ((records_read = read_and_write_trace(&fb)) != 0) {
+            records += records_read;
+        }
+        write_rows(&fb);
+        write_footer(&fb);
+        free(fb.data);
+        printf("Wrote %zu records to %s.\n", records, arrow_filename);
+
+        // File closing is handled by termination function.
+    }
+}
@@ -92,6 +92,12 @@ size_t read_and_write_trace() {
         if (reactor_name == NULL) {
             if (trace[i].event_type == worker_wait_starts || trace[i].event_type == worker_wait_ends) {
                 reactor_name = "WAIT";
+            } else if (trace[i].event_type == worker_spin_starts || trace[i].event_type == worker_spin_ends) {
+                reactor_name = "SPIN";
+            } else if (trace[i].event_type == gil_wait_starts || trace[i].event_type == gil_wait_ends) {
+                reactor_name = "GIL WAIT";
+            } else if (trace[i].event_type == python_call_starts || trace[i].event_type == python_call_ends) {
+                reactor_name = "PYTHON";
             } else if (trace[i].event_type == scheduler_advancing_time_starts
                     || trace[i].event_type == scheduler_advancing_time_starts) {
                 reactor_name = "ADVANCE TIME";
@@ -185,6 +191,25 @@ size_t read_and_write_trace() {
                 pid = PID_FOR_WORKER_WAIT;
                 phase = "E";
                 break;
+            case worker_spin_starts:
+                pid = PID_FOR_WORKER_WAIT;
+                phase = "B";
+                break;
+            case worker_spin_ends:
+                pid = PID_FOR_WORKER_WAIT;
+                phase = "E";
+                break;
+            case gil_wait_starts:
+            case python_call_starts:
+                // Nested within the reaction on the thread of the worker.
+                pid = PID_FOR_WORKER_WAIT;
+                phase = "B";
+                break;
+            case gil_wait_ends:
+            case python_call_ends:
+                pid = PID_FOR_WORKER_WAIT;
+                phase = "E";
+                break;
             case scheduler_advancing_time_starts:
                 pid = PID_FOR_WORKER_ADVANCING_TIME;
                 phase = "B";
@@ -193,6 +218,26 @@ size_t read_and_write_trace() {
                 pid = PID_FOR_WORKER_ADVANCING_TIME;
                 phase = "E";
                 break;
+            case scheduler_wakeup:
+                pid = PID_FOR_WORKER_ADVANCING_TIME;
+                phase = "i";
+                free(args);
+                asprintf(&args, "{\"lateness\": %lld}", trace[i].extra_delay);
+                break;
+            case scheduler_criticality_change:
+                pid = PID_FOR_WORKER_ADVANCING_TIME;
+                phase = "i";
+                free(args);
+                asprintf(&args, "{\"criticality\": %lld}", trace[i].extra_delay);
+                break;
+            case watchdog_expires:
+                phase = "i";
+                pid = reactor_index + 1; // One pid per reactor.
+                thread_id = trigger_index;
+                name = trigger_name;
+                free(args);
+                asprintf(&args, "{\"lateness\": %lld}", trace[i].extra_delay);
+                break;
             default:
                 fprintf(stderr, "WARNING: Unrecognized event type %d: %s\n",
                         trace[i].event_type, trace_event_names[trace[i].event_type]);
@@ -32,6 +32,10 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LF_TRACE
 #include <stdio.h>
 #include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "reactor.h"
 #include "trace.h"
 #include "trace_util.h"
@@ -55,13 +59,14 @@ int table_size;
  * Print a usage message.
  */
 void usage() {
-    printf("\nUsage: trace_to_csv [options] trace_file_root (without .lft extension)\n\n");
-    /* No options yet:
+    printf("\nUsage: trace_to_csv [options] trace_file (with .lft extension)\n\n");
     printf("\nOptions: \n\n");
-    printf("  -f, --fast [true | false]\n");
-    printf("   Whether to wait for physical time to match logical time.\n\n");
+    printf("  -j, --jobs <n>\n");
+    printf("   Decode the traces of the workers with n threads and write the records\n");
+    printf("   in the order of their physical times. 0 uses one thread per processor.\n\n");
+    printf("  -s, --summary-only\n");
+    printf("   Write only the summary file.\n");
     printf("\n\n");
-    */
 }
 
 /**
@@ -97,176 +102,447 @@ summary_stats_t** summary_stats;
 instant_t latest_time = 0LL;
 
 /**
- * Read a trace in the trace_file and write it to the output_file as CSV.
- * @return The number of records read or 0 upon seeing an EOF.
+ * Number of buckets in the histogram of wakeup latencies. Bucket 0 counts
+ * early wakeups and wakeups within one microsecond, and bucket i > 0 counts
+ * latencies of less than 2^i microseconds. The last bucket counts the rest.
  */
-size_t read_and_write_trace() {
-    int trace_length = read_trace();
-    if (trace_length == 0) return 0;
-    // Write each line.
-    for (int i = 0; i < trace_length; i++) {
-        // printf("DEBUG: reactor self struct pointer: %p\n", trace[i].pointer);
-        int object_instance = -1;
-        char* reactor_name = get_object_description(trace[i].pointer, &object_instance);
-        if (reactor_name == NULL) {
-            reactor_name = "NO REACTOR";
+#define NUM_WAKEUP_BUCKETS 16
+
+/** Histogram of the latencies of scheduler wakeups. */
+int wakeup_histogram[NUM_WAKEUP_BUCKETS];
+
+/** Summary statistics of the latencies of scheduler wakeups. */
+reaction_stats_t wakeup_stats;
+
+/** Histogram of the lateness of watchdog expirations, with the buckets of wakeup_histogram. */
+int watchdog_histogram[NUM_WAKEUP_BUCKETS];
+
+/** Summary statistics of the lateness of watchdog expirations. */
+reaction_stats_t watchdog_stats;
+
+/**
+ * Update the given summary statistics and histogram of latenesses, such as those
+ * of scheduler wakeups, with the given lateness.
+ */
+void update_lateness_stats(reaction_stats_t* stats, int* histogram, interval_t lateness) {
+    int index = 0;
+    while (index < NUM_WAKEUP_BUCKETS - 1 && lateness >= (USEC(1) << index)) {
+        index++;
+    }
+    histogram[index]++;
+    if (stats->occurrences == 0 || lateness > stats->max_exec_time) {
+        stats->max_exec_time = lateness;
+    }
+    if (stats->occurrences == 0 || lateness < stats->min_exec_time) {
+        stats->min_exec_time = lateness;
+    }
+    stats->occurrences++;
+    stats->total_exec_time += lateness;
+}
+
+/**
+ * Write a table of the given summary statistics and histogram of latenesses, if any,
+ * to the summary file.
+ */
+void write_lateness_stats(const char* title, reaction_stats_t* stats, int* histogram) {
+    if (stats->occurrences == 0) return;
+    fprintf(summary_file, "\n%s\n", title);
+    fprintf(summary_file, "Occurrences, Avg Lateness, Max Lateness, Min Lateness\n");
+    fprintf(summary_file, "%d, %lld, %lld, %lld\n",
+            stats->occurrences,
+            stats->total_exec_time / stats->occurrences,
+            stats->max_exec_time,
+            stats->min_exec_time
+    );
+    fprintf(summary_file, "Lateness Below (us), Occurrences\n");
+    for (int i = 0; i < NUM_WAKEUP_BUCKETS; i++) {
+        if (i < NUM_WAKEUP_BUCKETS - 1) {
+            fprintf(summary_file, "%lld, %d\n", 1LL << i, histogram[i]);
+        } else {
+            fprintf(summary_file, "inf, %d\n", histogram[i]);
         }
-        int trigger_instance = -1;
-        char* trigger_name = get_trigger_name(trace[i].trigger, &trigger_instance);
-        if (trigger_name == NULL) {
-            trigger_name = "NO TRIGGER";
+    }
+}
+
+/**
+ * Summary statistics of the compression or the decompression of message bodies,
+ * or of the serialization or the deserialization of message values.
+ * The end of each is matched with the latest start for the same partner federate,
+ * or for the same environment in the case of serialization.
+ */
+typedef struct codec_stats_t {
+    int occurrences;
+    long long bytes_in;
+    long long bytes_out;
+    interval_t total_time;
+    interval_t max_time;
+    instant_t* start_times;   // Indexed by partner federate, or 0 if none is pending.
+    size_t* start_bytes;      // Bytes in of the pending start, indexed the same way.
+    int num_partners;         // Size of the above arrays.
+} codec_stats_t;
+
+/**
+ * Summary statistics of compression (0), decompression (1), serialization (2),
+ * and deserialization (3).
+ */
+codec_stats_t codec_stats[4];
+
+/**
+ * Update the summary statistics of compression, decompression, serialization,
+ * or deserialization with the given record.
+ */
+void update_codec_stats(trace_record_t* record) {
+    bool start;
+    codec_stats_t* stats;
+    switch (record->event_type) {
+        case compression_starts:
+        case compression_ends:
+            start = (record->event_type == compression_starts);
+            stats = &codec_stats[0];
+            break;
+        case decompression_starts:
+        case decompression_ends:
+            start = (record->event_type == decompression_starts);
+            stats = &codec_stats[1];
+            break;
+        case serialization_starts:
+        case serialization_ends:
+            start = (record->event_type == serialization_starts);
+            stats = &codec_stats[2];
+            break;
+        default:
+            start = (record->event_type == deserialization_starts);
+            stats = &codec_stats[3];
+            break;
+    }
+    int partner = record->dst_id;
+    if (partner < 0) return;
+    if (partner >= stats->num_partners) {
+        int size = partner + 1;
+        stats->start_times = (instant_t*)realloc(stats->start_times, size * sizeof(instant_t));
+        stats->start_bytes = (size_t*)realloc(stats->start_bytes, size * sizeof(size_t));
+        if (stats->start_times == NULL || stats->start_bytes == NULL) {
+            fprintf(stderr, "WARNING: Out of memory. Compression will not be shown in summary file.\n");
+            return;
         }
-        fprintf(output_file, "%s, %s, %d, %d, %lld, %d, %lld, %s, %lld\n",
-                trace_event_names[trace[i].event_type],
-                reactor_name,
-                trace[i].src_id,
-                trace[i].dst_id,
-                trace[i].logical_time - start_time,
-                trace[i].microstep,
-                trace[i].physical_time - start_time,
-                trigger_name,
-                trace[i].extra_delay
-        );
-        // Update summary statistics.
-        if (trace[i].physical_time > latest_time) {
-            latest_time = trace[i].physical_time;
+        for (int i = stats->num_partners; i < size; i++) stats->start_times[i] = 0LL;
+        stats->num_partners = size;
+    }
+    if (start) {
+        stats->start_times[partner] = record->physical_time;
+        stats->start_bytes[partner] = (size_t)record->extra_delay;
+    } else if (stats->start_times[partner] != 0LL) {
+        interval_t time = record->physical_time - stats->start_times[partner];
+        stats->start_times[partner] = 0LL;
+        stats->occurrences++;
+        stats->bytes_in += stats->start_bytes[partner];
+        stats->bytes_out += record->extra_delay;
+        stats->total_time += time;
+        if (time > stats->max_time) {
+            stats->max_time = time;
         }
-        if (object_instance >= 0 && summary_stats[NUM_EVENT_TYPES + object_instance] == NULL) {
-            summary_stats[NUM_EVENT_TYPES + object_instance] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+    }
+}
+
+/**
+ * Summary statistics of the waits of each worker for the GIL of Python (at index
+ * 2 * worker) and of its execution of Python code (at index 2 * worker + 1).
+ */
+reaction_stats_t* interpreter_stats = NULL;
+
+/** Number of entries in interpreter_stats. */
+int interpreter_stats_size = 0;
+
+/**
+ * Update the summary statistics of the waits for the GIL and of the execution
+ * of Python code with the given record.
+ */
+void update_interpreter_stats(trace_record_t* record) {
+    if (record->src_id < 0) return;
+    int index = record->src_id * 2;
+    if (record->event_type == python_call_starts || record->event_type == python_call_ends) {
+        index += 1;
+    }
+    if (index >= interpreter_stats_size) {
+        int size = record->src_id * 2 + 2;
+        reaction_stats_t* stats = (reaction_stats_t*)realloc(interpreter_stats, size * sizeof(reaction_stats_t));
+        if (stats == NULL) {
+            fprintf(stderr, "WARNING: Out of memory. The GIL will not be shown in summary file.\n");
+            return;
         }
-        if (trigger_instance >= 0 && summary_stats[NUM_EVENT_TYPES + trigger_instance] == NULL) {
-            summary_stats[NUM_EVENT_TYPES + trigger_instance] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+        memset(stats + interpreter_stats_size, 0, (size - interpreter_stats_size) * sizeof(reaction_stats_t));
+        interpreter_stats = stats;
+        interpreter_stats_size = size;
+    }
+    reaction_stats_t* rstats = &interpreter_stats[index];
+    if (record->event_type == gil_wait_starts || record->event_type == python_call_starts) {
+        rstats->latest_start_time = record->physical_time;
+    } else if (rstats->latest_start_time != 0LL) {
+        interval_t exec_time = record->physical_time - rstats->latest_start_time;
+        rstats->latest_start_time = 0LL;
+        rstats->occurrences++;
+        rstats->total_exec_time += exec_time;
+        if (exec_time > rstats->max_exec_time) {
+            rstats->max_exec_time = exec_time;
+        }
+        if (exec_time < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
+            rstats->min_exec_time = exec_time;
         }
+    }
+}
 
-        summary_stats_t* stats = NULL;
-        interval_t exec_time;
-        reaction_stats_t* rstats;
-        int index;
+/** Size of the buffer for a line of the CSV file. */
+#define LINE_SIZE (2 * BUFFER_SIZE + 256)
 
-        // Count of event type.
-        if (summary_stats[trace[i].event_type] == NULL) {
-            summary_stats[trace[i].event_type] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
-        }
-        summary_stats[trace[i].event_type]->event_type = trace[i].event_type;
-        summary_stats[trace[i].event_type]->description = trace_event_names[trace[i].event_type];
-        summary_stats[trace[i].event_type]->occurrences++;
-
-        switch(trace[i].event_type) {
-            case reaction_starts:
-            case reaction_ends:
-                // This code relies on the mutual exclusion of reactions in a reactor
-                // and the ordering of reaction_starts and reaction_ends events.
-                if (trace[i].dst_id >= MAX_NUM_REACTIONS) {
-                    fprintf(stderr, "WARNING: Too many reactions. Not all will be shown in summary file.\n");
-                    continue;
-                }
-                stats = summary_stats[NUM_EVENT_TYPES + object_instance];
-                stats->description = reactor_name;
-                if (trace[i].dst_id >= stats->num_reactions_seen) {
-                    stats->num_reactions_seen = trace[i].dst_id + 1;
-                }
-                rstats = &stats->reactions[trace[i].dst_id];
-                if (trace[i].event_type == reaction_starts) {
-                    rstats->latest_start_time = trace[i].physical_time;
-                } else {
-                    rstats->occurrences++;
-                    exec_time = trace[i].physical_time - rstats->latest_start_time;
-                    rstats->latest_start_time = 0LL;
-                    rstats->total_exec_time += exec_time;
-                    if (exec_time > rstats->max_exec_time) {
-                        rstats->max_exec_time = exec_time;
-                    }
-                    if (exec_time < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
-                        rstats->min_exec_time = exec_time;
-                    }
-                }
-                break;
-            case schedule_called:
-                if (trigger_instance < 0) {
-                    // No trigger. Do not report.
-                    continue;
-                }
-                stats = summary_stats[NUM_EVENT_TYPES + trigger_instance];
-                stats->description = trigger_name;
-                break;
-            case user_event:
-                // Although these are not exec times and not reactions,
-                // commandeer the first entry in the reactions array to track values.
-                stats = summary_stats[NUM_EVENT_TYPES + object_instance];
-                stats->description = reactor_name;
-                break;
-            case user_value:
-                // Although these are not exec times and not reactions,
-                // commandeer the first entry in the reactions array to track values.
-                stats = summary_stats[NUM_EVENT_TYPES + object_instance];
-                stats->description = reactor_name;
-                rstats = &stats->reactions[0];
+/**
+ * A trace record together with the objects to which it refers.
+ */
+typedef struct resolved_record_t {
+    trace_record_t record;
+    char* reactor_name;
+    int object_instance;
+    char* trigger_name;
+    int trigger_instance;
+    int sequence;   // Position of the record in its trace.
+    size_t line;    // Offset of the line of the record in the text of its trace.
+} resolved_record_t;
+
+/**
+ * Look up the objects to which the given record refers.
+ */
+void resolve_record(trace_record_t* record, resolved_record_t* resolved) {
+    resolved->record = *record;
+    // printf("DEBUG: reactor self struct pointer: %p\n", record->pointer);
+    resolved->object_instance = -1;
+    resolved->reactor_name = get_object_description(record->pointer, &resolved->object_instance);
+    if (resolved->reactor_name == NULL) {
+        resolved->reactor_name = "NO REACTOR";
+    }
+    resolved->trigger_instance = -1;
+    resolved->trigger_name = get_trigger_name(record->trigger, &resolved->trigger_instance);
+    if (resolved->trigger_name == NULL) {
+        resolved->trigger_name = "NO TRIGGER";
+    }
+}
+
+/**
+ * Format the CSV line of the given record into the given buffer.
+ * @return The length of the line.
+ */
+int format_record(resolved_record_t* resolved, char* line, size_t size) {
+    trace_record_t* record = &resolved->record;
+    int length = snprintf(line, size, "%s, %s, %d, %d, %lld, %d, %lld, %s, %lld\n",
+            trace_event_names[record->event_type],
+            resolved->reactor_name,
+            record->src_id,
+            record->dst_id,
+            record->logical_time - start_time,
+            record->microstep,
+            record->physical_time - start_time,
+            resolved->trigger_name,
+            record->extra_delay
+    );
+    return (length < (int)size) ? length : (int)size - 1;
+}
+
+/**
+ * Update the summary statistics with the given record.
+ */
+void update_summary(resolved_record_t* resolved) {
+    trace_record_t* record = &resolved->record;
+    char* reactor_name = resolved->reactor_name;
+    int object_instance = resolved->object_instance;
+    char* trigger_name = resolved->trigger_name;
+    int trigger_instance = resolved->trigger_instance;
+    // Update summary statistics.
+    if (record->physical_time > latest_time) {
+        latest_time = record->physical_time;
+    }
+    if (object_instance >= 0 && summary_stats[NUM_EVENT_TYPES + object_instance] == NULL) {
+        summary_stats[NUM_EVENT_TYPES + object_instance] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+    }
+    if (trigger_instance >= 0 && summary_stats[NUM_EVENT_TYPES + trigger_instance] == NULL) {
+        summary_stats[NUM_EVENT_TYPES + trigger_instance] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+    }
+
+    summary_stats_t* stats = NULL;
+    interval_t exec_time;
+    reaction_stats_t* rstats;
+    int index;
+
+    // Count of event type.
+    if (summary_stats[record->event_type] == NULL) {
+        summary_stats[record->event_type] = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+    }
+    summary_stats[record->event_type]->event_type = record->event_type;
+    summary_stats[record->event_type]->description = trace_event_names[record->event_type];
+    summary_stats[record->event_type]->occurrences++;
+
+    switch(record->event_type) {
+        case reaction_starts:
+        case reaction_ends:
+            // This code relies on the mutual exclusion of reactions in a reactor
+            // and the ordering of reaction_starts and reaction_ends events.
+            if (record->dst_id >= MAX_NUM_REACTIONS) {
+                fprintf(stderr, "WARNING: Too many reactions. Not all will be shown in summary file.\n");
+                return;
+            }
+            stats = summary_stats[NUM_EVENT_TYPES + object_instance];
+            stats->description = reactor_name;
+            if (record->dst_id >= stats->num_reactions_seen) {
+                stats->num_reactions_seen = record->dst_id + 1;
+            }
+            rstats = &stats->reactions[record->dst_id];
+            if (record->event_type == reaction_starts) {
+                rstats->latest_start_time = record->physical_time;
+            } else {
                 rstats->occurrences++;
-                // User values are stored in the "extra_delay" field, which is an interval_t.
-                interval_t value = trace[i].extra_delay;
-                rstats->total_exec_time += value;
-                if (value > rstats->max_exec_time) {
-                    rstats->max_exec_time = value;
-                }
-                if (value < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
-                     rstats->min_exec_time = value;
+                exec_time = record->physical_time - rstats->latest_start_time;
+                rstats->latest_start_time = 0LL;
+                rstats->total_exec_time += exec_time;
+                if (exec_time > rstats->max_exec_time) {
+                    rstats->max_exec_time = exec_time;
                 }
-                break;
-            case worker_wait_starts:
-            case worker_wait_ends:
-            case scheduler_advancing_time_starts:
-            case scheduler_advancing_time_ends:
-                // Use the reactions array to store data.
-                // There will be two entries per worker, one for waits on the
-                // reaction queue and one for waits while advancing time.
-                index = trace[i].src_id * 2;
-                // Even numbered indices are used for waits on reaction queue.
-                // Odd numbered indices for waits for time advancement.
-                if (trace[i].event_type == scheduler_advancing_time_starts
-                        || trace[i].event_type == scheduler_advancing_time_ends) {
-                    index++;
+                if (exec_time < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
+                    rstats->min_exec_time = exec_time;
                 }
-                if (object_table_size + index >= table_size) {
-                    fprintf(stderr, "WARNING: Too many workers. Not all will be shown in summary file.\n");
-                    continue;
-                }
-                stats = summary_stats[NUM_EVENT_TYPES + object_table_size + index];
-                if (stats == NULL) {
-                    stats = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
-                    summary_stats[NUM_EVENT_TYPES + object_table_size + index] = stats;
-                }
-                // num_reactions_seen here will be used to store the number of
-                // entries in the reactions array, which is twice the number of workers.
-                if (index >= stats->num_reactions_seen) {
-                    stats->num_reactions_seen = index;
+            }
+            break;
+        case schedule_called:
+            if (trigger_instance < 0) {
+                // No trigger. Do not report.
+                return;
+            }
+            stats = summary_stats[NUM_EVENT_TYPES + trigger_instance];
+            stats->description = trigger_name;
+            break;
+        case user_event:
+            // Although these are not exec times and not reactions,
+            // commandeer the first entry in the reactions array to track values.
+            stats = summary_stats[NUM_EVENT_TYPES + object_instance];
+            stats->description = reactor_name;
+            break;
+        case user_value:
+            // Although these are not exec times and not reactions,
+            // commandeer the first entry in the reactions array to track values.
+            stats = summary_stats[NUM_EVENT_TYPES + object_instance];
+            stats->description = reactor_name;
+            rstats = &stats->reactions[0];
+            rstats->occurrences++;
+            // User values are stored in the "extra_delay" field, which is an interval_t.
+            interval_t value = record->extra_delay;
+            rstats->total_exec_time += value;
+            if (value > rstats->max_exec_time) {
+                rstats->max_exec_time = value;
+            }
+            if (value < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
+                 rstats->min_exec_time = value;
+            }
+            break;
+        case worker_wait_starts:
+        case worker_wait_ends:
+        case worker_spin_starts:
+        case worker_spin_ends:
+        case scheduler_advancing_time_starts:
+        case scheduler_advancing_time_ends:
+            // Use the reactions array to store data.
+            // There will be three entries per worker, one for waits on the
+            // reaction queue, one for waits while advancing time, and one
+            // for spinning before waiting on the reaction queue.
+            index = record->src_id * 3;
+            if (record->event_type == scheduler_advancing_time_starts
+                    || record->event_type == scheduler_advancing_time_ends) {
+                index += 1;
+            } else if (record->event_type == worker_spin_starts
+                    || record->event_type == worker_spin_ends) {
+                index += 2;
+            }
+            if (object_table_size + index >= table_size) {
+                fprintf(stderr, "WARNING: Too many workers. Not all will be shown in summary file.\n");
+                return;
+            }
+            stats = summary_stats[NUM_EVENT_TYPES + object_table_size + index];
+            if (stats == NULL) {
+                stats = (summary_stats_t*)calloc(1, sizeof(summary_stats_t));
+                summary_stats[NUM_EVENT_TYPES + object_table_size + index] = stats;
+            }
+            // num_reactions_seen here will be used to store the number of
+            // entries in the reactions array, which is three times the number of workers.
+            if (index >= stats->num_reactions_seen) {
+                stats->num_reactions_seen = index;
+            }
+            rstats = &stats->reactions[index];
+            if (record->event_type == worker_wait_starts
+                    || record->event_type == worker_spin_starts
+                    || record->event_type == scheduler_advancing_time_starts
+            ) {
+                rstats->latest_start_time = record->physical_time;
+            } else {
+                rstats->occurrences++;
+                exec_time = record->physical_time - rstats->latest_start_time;
+                rstats->latest_start_time = 0LL;
+                rstats->total_exec_time += exec_time;
+                if (exec_time > rstats->max_exec_time) {
+                    rstats->max_exec_time = exec_time;
                 }
-                rstats = &stats->reactions[index];
-                if (trace[i].event_type == worker_wait_starts
-                        || trace[i].event_type == scheduler_advancing_time_starts
-                ) {
-                    rstats->latest_start_time = trace[i].physical_time;
-                } else {
-                    rstats->occurrences++;
-                    exec_time = trace[i].physical_time - rstats->latest_start_time;
-                    rstats->latest_start_time = 0LL;
-                    rstats->total_exec_time += exec_time;
-                    if (exec_time > rstats->max_exec_time) {
-                        rstats->max_exec_time = exec_time;
-                    }
-                    if (exec_time < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
-                        rstats->min_exec_time = exec_time;
-                    }
+                if (exec_time < rstats->min_exec_time || rstats->min_exec_time == 0LL) {
+                    rstats->min_exec_time = exec_time;
                 }
-                break;
-            default:
-                // No special summary statistics for the rest.
-                break;
-        }
-        // Common stats across event types.
-        if (stats != NULL) {
-            stats->occurrences++;
-            stats->event_type = trace[i].event_type;
+            }
+            break;
+        case scheduler_wakeup:
+            // The lateness of the wakeup is stored in the "extra_delay" field.
+            update_lateness_stats(&wakeup_stats, wakeup_histogram, record->extra_delay);
+            break;
+        case watchdog_expires:
+            // The lateness of the expiration is stored in the "extra_delay" field.
+            update_lateness_stats(&watchdog_stats, watchdog_histogram, record->extra_delay);
+            break;
+        case gil_wait_starts:
+        case gil_wait_ends:
+        case python_call_starts:
+        case python_call_ends:
+            update_interpreter_stats(record);
+            break;
+        case compression_starts:
+        case compression_ends:
+        case decompression_starts:
+        case decompression_ends:
+        case serialization_starts:
+        case serialization_ends:
+        case deserialization_starts:
+        case deserialization_ends:
+            update_codec_stats(record);
+            break;
+        default:
+            // No special summary statistics for the rest.
+            break;
+    }
+    // Common stats across event types.
+    if (stats != NULL) {
+        stats->occurrences++;
+        stats->event_type = record->event_type;
+    }
+}
+
+/**
+ * Read a trace in the trace_file and write it to the output_file as CSV,
+ * unless it is NULL.
+ * @return The number of records read or 0 upon seeing an EOF.
+ */
+size_t read_and_write_trace() {
+    int trace_length = read_trace();
+    if (trace_length == 0) return 0;
+    char line[LINE_SIZE];
+    // Write each line.
+    for (int i = 0; i < trace_length; i++) {
+        resolved_record_t resolved;
+        resolve_record(&trace[i], &resolved);
+        if (output_file != NULL) {
+            format_record(&resolved, line, sizeof(line));
+            fputs(line, output_file);
         }
+        update_summary(&resolved);
     }
     return trace_length;
 }
@@ -363,6 +639,7 @@ void write_summary_file() {
         summary_stats_t* stats = summary_stats[i];
         if (stats != NULL && (
                 stats->event_type == worker_wait_ends
+                || stats->event_type == worker_spin_ends
                 || stats->event_type == scheduler_advancing_time_ends)
         ) {
             if (first) {
@@ -370,16 +647,18 @@ void write_summary_file() {
                 fprintf(summary_file, "\nWorkers Waiting\n");
                 fprintf(summary_file, "Worker, Waiting On, Occurrences, Total Time, Pct Total Time, Avg Time, Max Time, Min Time\n");
             }
-            char* waitee = "reaction queue";
-            if (stats->event_type == scheduler_advancing_time_ends
-                    || stats->event_type == scheduler_advancing_time_starts) {
-                waitee = "advancing time";
-            }
             for (int j = 0; j <= stats->num_reactions_seen; j++) {
                 reaction_stats_t* rstats = &stats->reactions[j];
+                // See the layout of the entries in read_and_write_trace().
+                char* waitee = "reaction queue";
+                if (j % 3 == 1) {
+                    waitee = "advancing time";
+                } else if (j % 3 == 2) {
+                    waitee = "spinning on reaction queue";
+                }
                 if (rstats->occurrences > 0) {
                     fprintf(summary_file, "%d, %s, %d, %lld, %f, %lld, %lld, %lld\n",
-                            j / 2,
+                            j / 3,
                             waitee,
                             rstats->occurrences,
                             rstats->total_exec_time,
@@ -392,24 +671,360 @@ void write_summary_file() {
             }
         }
     }
+
+    // Then the waits for the GIL of Python and the execution of Python code.
+    first = true;
+    for (int i = 0; i < interpreter_stats_size; i++) {
+        reaction_stats_t* rstats = &interpreter_stats[i];
+        if (rstats->occurrences == 0) continue;
+        if (first) {
+            first = false;
+            fprintf(summary_file, "\nPython Interpreter\n");
+            fprintf(summary_file, "Worker, Activity, Occurrences, Total Time, Pct Total Time, Avg Time, Max Time, Min Time\n");
+        }
+        fprintf(summary_file, "%d, %s, %d, %lld, %f, %lld, %lld, %lld\n",
+                i / 2,
+                (i % 2 == 0) ? "waiting for the GIL" : "executing Python",
+                rstats->occurrences,
+                rstats->total_exec_time,
+                rstats->total_exec_time * 100.0 / (latest_time - start_time),
+                rstats->total_exec_time / rstats->occurrences,
+                rstats->max_exec_time,
+                rstats->min_exec_time
+        );
+    }
+
+    // Finally, the latencies of scheduler wakeups and watchdog expirations.
+    write_lateness_stats("Scheduler Wakeups", &wakeup_stats, wakeup_histogram);
+    write_lateness_stats("Watchdog Expirations", &watchdog_stats, watchdog_histogram);
+
+    // And the compression and decompression of message bodies.
+    if (codec_stats[0].occurrences > 0 || codec_stats[1].occurrences > 0) {
+        fprintf(summary_file, "\nMessage Compression\n");
+        fprintf(summary_file, "Operation, Occurrences, Bytes In, Bytes Out, Ratio, Total Time, Avg Time, Max Time\n");
+        for (int i = 0; i < 2; i++) {
+            codec_stats_t* stats = &codec_stats[i];
+            if (stats->occurrences == 0) continue;
+            // The ratio is that of uncompressed to compressed bytes either way.
+            long long uncompressed = (i == 0) ? stats->bytes_in : stats->bytes_out;
+            long long compressed = (i == 0) ? stats->bytes_out : stats->bytes_in;
+            fprintf(summary_file, "%s, %d, %lld, %lld, %f, %lld, %lld, %lld\n",
+                    (i == 0) ? "Compression" : "Decompression",
+                    stats->occurrences,
+                    stats->bytes_in,
+                    stats->bytes_out,
+                    (compressed > 0) ? (double)uncompressed / compressed : 0.0,
+                    stats->total_time,
+                    stats->total_time / stats->occurrences,
+                    stats->max_time
+            );
+        }
+    }
+
+    // And the serialization and deserialization of message values.
+    if (codec_stats[2].occurrences > 0 || codec_stats[3].occurrences > 0) {
+        fprintf(summary_file, "\nMessage Serialization\n");
+        fprintf(summary_file, "Operation, Occurrences, Bytes, Total Time, Avg Time, Max Time\n");
+        for (int i = 2; i < 4; i++) {
+            codec_stats_t* stats = &codec_stats[i];
+            if (stats->occurrences == 0) continue;
+            // The size of the message is at the end of a serialization and at the start of a deserialization.
+            fprintf(summary_file, "%s, %d, %lld, %lld, %lld, %lld\n",
+                    (i == 2) ? "Serialization" : "Deserialization",
+                    stats->occurrences,
+                    (i == 2) ? stats->bytes_out : stats->bytes_in,
+                    stats->total_time,
+                    stats->total_time / stats->occurrences,
+                    stats->max_time
+            );
+        }
+    }
 }
 
+#ifndef _WIN32
+
+/**
+ * A trace decoded by a converter thread, with its records sorted by physical
+ * time and, unless only the summary is written, their lines formatted.
+ */
+typedef struct converted_trace_t {
+    trace_chunk_t* chunk;
+    resolved_record_t* records;
+    char* text;      // The lines of the records, or NULL.
+    int next;        // The next record to merge.
+    bool ready;      // Whether a converter thread is done with the trace.
+} converted_trace_t;
+
+/**
+ * The traces of the trace file in the order of the physical times of their
+ * first records, which is the order in which they are converted and merged.
+ */
+converted_trace_t* converted;
+int num_traces;
+
+/** Index of the next trace to convert. */
+int next_to_convert = 0;
+
+/**
+ * Index of the trace at which conversion waits for the merge, which bounds
+ * the memory taken by traces that are converted but not yet merged.
+ */
+int convert_limit;
+
+/** Number of traces that may be converted ahead of the merge per thread. */
+#define TRACES_AHEAD_PER_THREAD 4
+
+pthread_mutex_t convert_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t trace_converted = PTHREAD_COND_INITIALIZER;
+pthread_cond_t limit_advanced = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Compare traces by the physical times of their first records, and then
+ * by their positions in the trace file.
+ */
+static int compare_first_times(const void* a, const void* b) {
+    trace_chunk_t* chunk_a = ((const converted_trace_t*)a)->chunk;
+    trace_chunk_t* chunk_b = ((const converted_trace_t*)b)->chunk;
+    if (chunk_a->first_time != chunk_b->first_time) {
+        return (chunk_a->first_time < chunk_b->first_time) ? -1 : 1;
+    }
+    return (chunk_a->offset < chunk_b->offset) ? -1 : (chunk_a->offset > chunk_b->offset);
+}
+
+/**
+ * Compare records by physical time, and then by their positions in the trace.
+ */
+static int compare_records(const void* a, const void* b) {
+    const resolved_record_t* record_a = (const resolved_record_t*)a;
+    const resolved_record_t* record_b = (const resolved_record_t*)b;
+    if (record_a->record.physical_time != record_b->record.physical_time) {
+        return (record_a->record.physical_time < record_b->record.physical_time) ? -1 : 1;
+    }
+    return record_a->sequence - record_b->sequence;
+}
+
+/**
+ * Decode, sort, and format the records of the given trace.
+ */
+static void convert_trace(converted_trace_t* result, trace_record_t* records) {
+    int length = result->chunk->length;
+    decode_trace_chunk(result->chunk, records);
+    result->records = (resolved_record_t*)malloc(length * sizeof(resolved_record_t));
+    if (result->records == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(3);
+    }
+    for (int i = 0; i < length; i++) {
+        resolve_record(&records[i], &result->records[i]);
+        result->records[i].sequence = i;
+    }
+    qsort(result->records, length, sizeof(resolved_record_t), compare_records);
+    if (output_file == NULL) return;
+
+    size_t capacity = (size_t)length * 128;
+    size_t size = 0;
+    result->text = (char*)malloc(capacity);
+    for (int i = 0; i < length; i++) {
+        if (result->text != NULL && capacity - size < LINE_SIZE) {
+            capacity *= 2;
+            result->text = (char*)realloc(result->text, capacity);
+        }
+        if (result->text == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            exit(3);
+        }
+        result->records[i].line = size;
+        size += format_record(&result->records[i], result->text + size, capacity - size) + 1;
+    }
+}
+
+/**
+ * Body of a converter thread, which converts traces in order.
+ */
+static void* converter(void* ignored) {
+    trace_record_t* records = (trace_record_t*)malloc(TRACE_BUFFER_CAPACITY * sizeof(trace_record_t));
+    if (records == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(3);
+    }
+    pthread_mutex_lock(&convert_mutex);
+    while (true) {
+        while (next_to_convert < num_traces && next_to_convert >= convert_limit) {
+            pthread_cond_wait(&limit_advanced, &convert_mutex);
+        }
+        if (next_to_convert >= num_traces) break;
+        converted_trace_t* result = &converted[next_to_convert++];
+        pthread_mutex_unlock(&convert_mutex);
+        convert_trace(result, records);
+        pthread_mutex_lock(&convert_mutex);
+        result->ready = true;
+        pthread_cond_broadcast(&trace_converted);
+    }
+    pthread_mutex_unlock(&convert_mutex);
+    free(records);
+    return NULL;
+}
+
+/** Return the physical time of the next record of the given trace to merge. */
+static instant_t next_time(int index) {
+    return converted[index].records[converted[index].next].record.physical_time;
+}
+
+/**
+ * Return whether the next record of the first trace precedes that of the second,
+ * breaking ties by the order of the traces.
+ */
+static bool precedes(int a, int b) {
+    instant_t time_a = next_time(a);
+    instant_t time_b = next_time(b);
+    return time_a < time_b || (time_a == time_b && a < b);
+}
+
+/** Restore the heap property of the given heap after its root changed. */
+static void sift_down(int* heap, int size) {
+    int i = 0;
+    while (true) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && precedes(heap[left], heap[smallest])) smallest = left;
+        if (right < size && precedes(heap[right], heap[smallest])) smallest = right;
+        if (smallest == i) return;
+        int tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/** Restore the heap property of the given heap after a trace was appended to it. */
+static void sift_up(int* heap, int size) {
+    int i = size - 1;
+    while (i > 0 && precedes(heap[i], heap[(i - 1) / 2])) {
+        int tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * Convert the traces of the mapped trace file with the given number of threads,
+ * while merging their records in the order of their physical times to update the
+ * summary statistics and write the CSV file. The traces of a worker follow one
+ * another in time, so a trace is merged as soon as the merge reaches the physical
+ * time of its first record, and only the traces that overlap in time, those of
+ * different workers, are held in memory at once.
+ * @return false if the trace file is not mapped.
+ */
+bool convert_in_parallel(int num_threads) {
+    trace_chunk_t* chunks;
+    num_traces = index_traces(&chunks);
+    if (num_traces < 0) return false;
+    printf("Converting %d traces with %d threads.\n", num_traces, num_threads);
+
+    converted = (converted_trace_t*)calloc(num_traces + 1, sizeof(converted_trace_t));
+    int* heap = (int*)malloc((num_traces + 1) * sizeof(int));
+    if (converted == NULL || heap == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(3);
+    }
+    for (int i = 0; i < num_traces; i++) {
+        converted[i].chunk = &chunks[i];
+    }
+    qsort(converted, num_traces, sizeof(converted_trace_t), compare_first_times);
+
+    int window = num_threads * TRACES_AHEAD_PER_THREAD;
+    convert_limit = window;
+    pthread_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, converter, NULL) != 0) {
+            fprintf(stderr, "Failed to create a converter thread.\n");
+            exit(1);
+        }
+    }
+
+    int heap_size = 0;
+    int loaded = 0;
+    while (true) {
+        // Add the traces whose first records precede the next record to merge.
+        while (loaded < num_traces
+                && (heap_size == 0 || converted[loaded].chunk->first_time <= next_time(heap[0]))) {
+            pthread_mutex_lock(&convert_mutex);
+            convert_limit = loaded + window;
+            pthread_cond_broadcast(&limit_advanced);
+            while (!converted[loaded].ready) {
+                pthread_cond_wait(&trace_converted, &convert_mutex);
+            }
+            pthread_mutex_unlock(&convert_mutex);
+            heap[heap_size++] = loaded++;
+            sift_up(heap, heap_size);
+        }
+        if (heap_size == 0) break;
+
+        converted_trace_t* next = &converted[heap[0]];
+        resolved_record_t* resolved = &next->records[next->next];
+        if (output_file != NULL) {
+            fputs(next->text + resolved->line, output_file);
+        }
+        update_summary(resolved);
+        if (++next->next == next->chunk->length) {
+            free(next->records);
+            free(next->text);
+            heap[0] = heap[--heap_size];
+        }
+        sift_down(heap, heap_size);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(heap);
+    free(converted);
+    free(chunks);
+    return true;
+}
+
+#endif // _WIN32
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    int num_threads = 1;
+    bool summary_only = false;
+    char* trace_filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads <= 0) {
+#ifndef _WIN32
+                num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+                if (num_threads <= 0) num_threads = 1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--summary-only") == 0) {
+            summary_only = true;
+        } else if (trace_filename == NULL && argv[i][0] != '-') {
+            trace_filename = argv[i];
+        } else {
+            usage();
+            exit(0);
+        }
+    }
+    if (trace_filename == NULL) {
         usage();
         exit(0);
     }
     // Open the trace file.
-    trace_file = open_file(argv[1], "r");
+    trace_file = open_file(trace_filename, "r");
     if (trace_file == NULL) exit(1);
 
     // Construct the name of the csv output file and open it.
-    char* root = root_name(argv[1]);
-    char csv_filename[strlen(root) + 5];
-    strcpy(csv_filename, root);
-    strcat(csv_filename, ".csv");
-    output_file = open_file(csv_filename, "w");
-    if (output_file == NULL) exit(1);
+    char* root = root_name(trace_filename);
+    if (!summary_only) {
+        char csv_filename[strlen(root) + 5];
+        strcpy(csv_filename, root);
+        strcat(csv_filename, ".csv");
+        output_file = open_file(csv_filename, "w");
+        if (output_file == NULL) exit(1);
+    }
 
     // Construct the name of the summary output file and open it.
     char summary_filename[strlen(root) + 13];
@@ -426,8 +1041,21 @@ int main(int argc, char* argv[]) {
         summary_stats = (summary_stats_t**)calloc(table_size, sizeof(summary_stats_t*));
 
         // Write a header line into the CSV file.
-        fprintf(output_file, "Event, Reactor, Source, Destination, Elapsed Logical Time, Microstep, Elapsed Physical Time, Trigger, Extra Delay\n");
-        while (read_and_write_trace() != 0) {};
+        if (output_file != NULL) {
+            fprintf(output_file, "Event, Reactor, Source, Destination, Elapsed Logical Time, Microstep, Elapsed Physical Time, Trigger, Extra Delay\n");
+        }
+        bool converted = false;
+#ifndef _WIN32
+        if (num_threads > 1) {
+            converted = convert_in_parallel(num_threads);
+            if (!converted) {
+                fprintf(stderr, "WARNING: Trace file cannot be mapped into memory. Converting with one thread.\n");
+            }
+        }
+#endif
+        if (!converted) {
+            while (read_and_write_trace() != 0) {};
+        }
 
         write_summary_file();
 
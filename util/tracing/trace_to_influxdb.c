@@ -102,12 +102,18 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * You can also specify the following command-line options:
  * * -h, --host: The host name running InfluxDB. If not given, this defaults to "localhost".
  * * -p, --port: The port for accessing InfluxDB. This defaults to 8086. If you used 8087, as shown above, then you have to give this option.
+ * * -n, --batch: The number of records sent in each HTTP request. This defaults to 5000.
+ * * -c, --connections: The number of requests in flight at once. This defaults to 4.
+ * * -z, --gzip: Compress the requests with gzip.
+ * * -f, --follow: Keep uploading records as they are appended to the trace file by a
+ *   running program, like `tail -f`, until interrupted with Control-C.
  *
  * The data can then be viewed in the InfluxDB browser, or you can configure an external
  * tool such as Grafana to visualize it (see https://grafana.com/docs/grafana/latest/datasources/influxdb/).
  */
 #define LF_TRACE
 #include <stdio.h>
+#include <signal.h>
 #include "reactor.h"
 #include "trace.h"
 #include "trace_util.h"
@@ -122,6 +128,15 @@ FILE* trace_file = NULL;
 /** Struct identifying the influx client. */
 influx_client_t influx_client;
 influx_v2_client_t influx_v2_client;
+
+/** Writer that sends the records to InfluxDB in batches. */
+influx_batch_t influx_batch;
+
+/** Interval in microseconds at which a followed trace file is checked for new records. */
+#define FOLLOW_INTERVAL 100000
+
+/** Indicator that the program was interrupted while following the trace file. */
+volatile sig_atomic_t interrupted = 0;
 /**
  * Print a usage message.
  */
@@ -138,6 +153,14 @@ void usage() {
     printf("   The organization for access to InfluxDB (default is 'iCyPhy').\n\n");
     printf("   -b, --bucket BUCKET\n");
     printf("   The bucket into which to put the data (default is 'test').\n\n");
+    printf("   -n, --batch RECORDS\n");
+    printf("   The number of records sent in each request (default is 5000).\n\n");
+    printf("   -c, --connections CONNECTIONS\n");
+    printf("   The number of requests in flight at once (default is 4).\n\n");
+    printf("   -z, --gzip\n");
+    printf("   Compress the requests with gzip.\n\n");
+    printf("   -f, --follow\n");
+    printf("   Keep sending records as they are appended to the trace file until interrupted.\n\n");
     printf("\n\n");
 }
 
@@ -157,10 +180,11 @@ size_t read_and_write_trace() {
         // Ignore federated traces.
         if (trace[i].event_type > federated) continue;
 
+        char reaction_number[12];
         char* reaction_name = "none";
         if (trace[i].dst_id >= 0) {
-            reaction_name = (char*)malloc(4);
-            snprintf(reaction_name, 4, "%d", trace[i].dst_id);
+            snprintf(reaction_number, sizeof(reaction_number), "%d", trace[i].dst_id);
+            reaction_name = reaction_number;
         }
         // printf("DEBUG: reactor self struct pointer: %p\n", trace[i].pointer);
         int object_instance = -1;
@@ -178,7 +202,7 @@ size_t read_and_write_trace() {
         // FIXME: What is the difference between a TAG and F_STR (presumably, Field String)?
         // Presumably, the HTTP post is formatted as a "line protocol" command. See:
         // https://docs.influxdata.com/influxdb/v2.0/reference/syntax/line-protocol/
-        int response_code = post_curl(&influx_v2_client,
+        int response_code = influx_batch_add(&influx_batch,
             INFLUX_MEAS(trace_event_names[trace[i].event_type]),
             INFLUX_TAG("Reactor", reactor_name),
             INFLUX_TAG("Reaction", reaction_name),
@@ -198,6 +222,29 @@ size_t read_and_write_trace() {
     return trace_length;
 }
 
+/**
+ * Record that the program was interrupted.
+ */
+void interrupt(int signal) {
+    interrupted = 1;
+}
+
+/**
+ * Function called at the end of a followed trace file that sends the records
+ * read so far and waits for more.
+ * @return false if the program was interrupted.
+ */
+bool wait_for_trace() {
+    if (interrupted) return false;
+    influx_batch_flush(&influx_batch);
+    if (influx_batch.in_flight > 0) {
+        influx_batch_poll(&influx_batch, FOLLOW_INTERVAL / 1000);
+    } else {
+        usleep(FOLLOW_INTERVAL);
+    }
+    return !interrupted;
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         usage();
@@ -211,6 +258,9 @@ int main(int argc, char* argv[]) {
     influx_v2_client.bucket = "test";
 
     char* filename = NULL;
+    size_t batch_lines = 5000;
+    int connections = 4;
+    bool gzip = false;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp("-t", argv[i]) == 0 || strcmp("--token", argv[i]) == 0) {
@@ -251,6 +301,25 @@ int main(int argc, char* argv[]) {
                 exit(1);
             }
             influx_v2_client.bucket = argv[i];
+        } else if (strcmp("-n", argv[i]) == 0 || strcmp("--batch", argv[i]) == 0) {
+            if (i++ == argc - 1 || atoi(argv[i]) <= 0) {
+                usage();
+                fprintf(stderr, "No valid batch size specified.\n");
+                exit(1);
+            }
+            batch_lines = (size_t)atoi(argv[i]);
+        } else if (strcmp("-c", argv[i]) == 0 || strcmp("--connections", argv[i]) == 0) {
+            if (i++ == argc - 1 || atoi(argv[i]) <= 0) {
+                usage();
+                fprintf(stderr, "No valid number of connections specified.\n");
+                exit(1);
+            }
+            connections = atoi(argv[i]);
+        } else if (strcmp("-z", argv[i]) == 0 || strcmp("--gzip", argv[i]) == 0) {
+            gzip = true;
+        } else if (strcmp("-f", argv[i]) == 0 || strcmp("--follow", argv[i]) == 0) {
+            trace_follow = wait_for_trace;
+            signal(SIGINT, interrupt);
         } else {
             // Must be the filename.
             filename = argv[i];
@@ -268,12 +337,16 @@ int main(int argc, char* argv[]) {
     // Open the trace file.
     trace_file = open_file(filename, "r");
 
+    if (influx_batch_init(&influx_batch, &influx_v2_client, batch_lines, connections, gzip) != 0) {
+        fprintf(stderr, "Failed to initialize the connection to InfluxDB.\n");
+        exit(1);
+    }
     if (read_header() >= 0) {
-        size_t num_records = 0, result;
-        while ((result = read_and_write_trace()) != 0) {
-            num_records = result;
-        };
-        printf("***** %zu records written to InfluxDB.\n", num_records);
+        while (read_and_write_trace() != 0) {};
+        if (influx_batch_finish(&influx_batch) != 0) {
+            fprintf(stderr, "****** %d requests to InfluxDB failed.\n", influx_batch.failures);
+        }
+        printf("***** %zu records written to InfluxDB.\n", influx_batch.lines_sent);
         // File closing is handled by termination function.
     }
 }
@@ -33,6 +33,12 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "reactor.h"
 #include "trace.h"
 #include "trace_util.h"
@@ -46,14 +52,49 @@ trace_record_t trace[TRACE_BUFFER_CAPACITY];
 /** The start time read from the trace file. */
 instant_t start_time;
 
+/** Indicator that the trace file is in the compact format. See trace.h. */
+bool compact_format = false;
+
+/** Indicator that the physical times in the trace file are cycle counts. See trace.h. */
+bool cycles_format = false;
+
+/**
+ * Cycle counts and physical times sampled when tracing started and stopped,
+ * from which cycle counts are converted to physical times.
+ */
+instant_t calibration[4];
+
+/** Buffer for reading a trace in the compact format. */
+unsigned char encoded[TRACE_BUFFER_CAPACITY * TRACE_COMPACT_RECORD_MAX_SIZE];
+
+/**
+ * Contents of the trace file if it could be mapped into memory, or NULL,
+ * in which case the trace file is read with fread().
+ */
+unsigned char* mapped_file = NULL;
+size_t mapped_size = 0;
+
+/** Position of the next byte to read in the mapped trace file. */
+size_t mapped_position = 0;
+
+bool (*trace_follow)(void) = NULL;
+
 /** Name of the top-level reactor (first entry in symbol table). */
 char* top_level = NULL;
 
 /** Table of pointers to the self struct of a reactor. */
-// FIXME: Replace with hash table implementation.
 object_description_t* object_table;
 int object_table_size = 0;
 
+/**
+ * Hash tables with open addressing that map the pointers and the triggers of the
+ * object table to one plus the index of their first entry, or 0 for empty slots.
+ * Their capacity is a power of two at least twice the size of the object table.
+ */
+int* pointer_index = NULL;
+int* trigger_index = NULL;
+size_t index_capacity = 0;
+
 typedef struct open_file_t open_file_t;
 typedef struct open_file_t {
     FILE* file;
@@ -75,6 +116,9 @@ void termination() {
         free(_open_files);
         _open_files = tmp;
     }
+#ifndef _WIN32
+    if (mapped_file != NULL) munmap(mapped_file, mapped_size);
+#endif
     printf("Done!\n");
 }
 
@@ -122,6 +166,44 @@ FILE* open_file(const char* path, const char* mode) {
     return result;
 }
 
+/**
+ * Return the slot of the given pointer or trigger in the given index of the
+ * object table, or the empty slot where it would go, or NULL if there is no index.
+ */
+static int* find_object_slot(int* index, void* key, bool is_trigger) {
+    if (index == NULL) return NULL;
+    uint64_t hash = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+    size_t mask = index_capacity - 1;
+    for (size_t i = (size_t)(hash ^ (hash >> 29)) & mask; ; i = (i + 1) & mask) {
+        if (index[i] == 0) return &index[i];
+        object_description_t* object = &object_table[index[i] - 1];
+        if ((is_trigger ? object->trigger : object->pointer) == key) return &index[i];
+    }
+}
+
+/**
+ * Index the pointers and triggers of the object table, keeping the first
+ * entry of each.
+ */
+static void index_object_table() {
+    index_capacity = 16;
+    while (index_capacity < 2 * (size_t)object_table_size) index_capacity *= 2;
+    pointer_index = (int*)calloc(index_capacity, sizeof(int));
+    trigger_index = (int*)calloc(index_capacity, sizeof(int));
+    if (pointer_index == NULL || trigger_index == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(3);
+    }
+    for (int i = 0; i < object_table_size; i++) {
+        int* slot = find_object_slot(pointer_index, object_table[i].pointer, false);
+        if (*slot == 0) *slot = i + 1;
+        if (object_table[i].type == trace_trigger) {
+            slot = find_object_slot(trigger_index, object_table[i].trigger, true);
+            if (*slot == 0) *slot = i + 1;
+        }
+    }
+}
+
 /**
  * Get the description of the object pointed to by the specified pointer.
  * For example, this can be the name of a reactor (pointer points to
@@ -134,14 +216,12 @@ FILE* open_file(const char* path, const char* mode) {
  * @param index An optional pointer into which to write the index.
  */
 char* get_object_description(void* pointer, int* index) {
-    // FIXME: Replace with a hash table implementation.
-    for (int i = 0; i < object_table_size; i++) {
-        if (object_table[i].pointer == pointer) {
-            if (index != NULL) {
-                *index = i;
-            }
-            return object_table[i].description;
+    int* slot = find_object_slot(pointer_index, pointer, false);
+    if (slot != NULL && *slot != 0) {
+        if (index != NULL) {
+            *index = *slot - 1;
         }
+        return object_table[*slot - 1].description;
     }
     if (index != NULL) {
         *index = 0;
@@ -159,14 +239,12 @@ char* get_object_description(void* pointer, int* index) {
  * @param index An optional pointer into which to write the index.
  */
 char* get_trigger_name(void* trigger, int* index) {
-    // FIXME: Replace with a hash table implementation.
-    for (int i = 0; i < object_table_size; i++) {
-        if (object_table[i].trigger == trigger && object_table[i].type == trace_trigger) {
-            if (index != NULL) {
-                *index = i;
-            }
-            return object_table[i].description;
+    int* slot = find_object_slot(trigger_index, trigger, true);
+    if (slot != NULL && *slot != 0) {
+        if (index != NULL) {
+            *index = *slot - 1;
         }
+        return object_table[*slot - 1].description;
     }
     if (index != NULL) {
         *index = 0;
@@ -199,21 +277,124 @@ void print_table() {
     printf("-------\n");
 }
 
+/**
+ * Map the trace file into memory, if possible, so that reading it takes no
+ * system calls and its traces can be decoded in parallel.
+ */
+static void map_trace_file() {
+#ifndef _WIN32
+    // A trace file that is still growing is read with fread().
+    if (trace_follow != NULL) return;
+    struct stat file_stat;
+    long position = ftell(trace_file);
+    if (position < 0 || fstat(fileno(trace_file), &file_stat) != 0
+            || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= position) {
+        return;
+    }
+    void* contents = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fileno(trace_file), 0);
+    if (contents == MAP_FAILED) return;
+    madvise(contents, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+    mapped_file = (unsigned char*)contents;
+    mapped_size = (size_t)file_stat.st_size;
+    mapped_position = (size_t)position;
+#endif
+}
+
+/**
+ * Read the given number of items of the given size from the trace file,
+ * or from its contents if it is mapped, like fread().
+ * @return The number of items read.
+ */
+static size_t read_items(void* destination, size_t size, size_t count) {
+    if (mapped_file == NULL && trace_follow != NULL) {
+        // Read bytes rather than items so that no partially written item is lost.
+        size_t total = size * count;
+        size_t done = 0;
+        while (true) {
+            done += fread((char*)destination + done, 1, total - done, trace_file);
+            if (done == total || ferror(trace_file)) return done / size;
+            clearerr(trace_file);
+            if (!trace_follow()) return done / size;
+        }
+    }
+    if (mapped_file == NULL) return fread(destination, size, count, trace_file);
+    size_t available = (mapped_size - mapped_position) / size;
+    if (count > available) count = available;
+    memcpy(destination, mapped_file + mapped_position, size * count);
+    mapped_position += size * count;
+    return count;
+}
+
+/**
+ * Read the cycle count calibration at the end of the trace file and return
+ * to the current position.
+ */
+static void read_calibration() {
+    int end_marker = 0;
+    size_t trailer_size = sizeof(int) + sizeof(calibration);
+    bool failed;
+    if (mapped_file != NULL) {
+        failed = mapped_size < trailer_size;
+        if (!failed) {
+            memcpy(&end_marker, mapped_file + mapped_size - trailer_size, sizeof(int));
+            memcpy(calibration, mapped_file + mapped_size - sizeof(calibration), sizeof(calibration));
+        }
+    } else {
+        long position = ftell(trace_file);
+        failed = position < 0
+                || fseek(trace_file, -(long)trailer_size, SEEK_END) != 0
+                || fread(&end_marker, sizeof(int), 1, trace_file) != 1
+                || fread(calibration, sizeof(instant_t), 4, trace_file) != 4
+                || fseek(trace_file, position, SEEK_SET) != 0;
+    }
+    if (failed || end_marker != -1 || calibration[2] <= calibration[0]) {
+        fprintf(stderr, "ERROR: Trace file has no cycle count calibration. Was tracing stopped?\n");
+        exit(4);
+    }
+}
+
+/**
+ * Convert the physical times of the given records from cycle counts
+ * to nanoseconds.
+ */
+static void convert_cycles(trace_record_t* records, int trace_length) {
+    double nsec_per_cycle = (double)(calibration[3] - calibration[1]) / (double)(calibration[2] - calibration[0]);
+    for (int i = 0; i < trace_length; i++) {
+        records[i].physical_time = calibration[1]
+                + (instant_t)((double)(records[i].physical_time - calibration[0]) * nsec_per_cycle);
+    }
+}
+
 size_t read_header() {
+    map_trace_file();
     // Read the start time.
-    int items_read = fread(&start_time, sizeof(instant_t), 1, trace_file);
+    int items_read = read_items(&start_time, sizeof(instant_t), 1);
     if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
+    // The start time follows the markers of the formats, if any.
+    while (start_time == TRACE_COMPACT_FORMAT_MARKER || start_time == TRACE_CYCLES_FORMAT_MARKER) {
+        if (start_time == TRACE_COMPACT_FORMAT_MARKER) compact_format = true;
+        else cycles_format = true;
+        items_read = read_items(&start_time, sizeof(instant_t), 1);
+        if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
+    }
+    if (cycles_format) {
+        if (trace_follow != NULL) {
+            fprintf(stderr, "ERROR: Trace files with cycle counts cannot be followed.\n");
+            exit(4);
+        }
+        read_calibration();
+    }
 
     printf("Start time is %lld.\n", start_time);
 
     // Read the table mapping pointers to descriptions.
     // First read its length.
-    items_read = fread(&object_table_size, sizeof(int), 1, trace_file);
+    items_read = read_items(&object_table_size, sizeof(int), 1);
     if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
 
     printf("There are %d objects traced.\n", object_table_size);
 
-    object_table = calloc(object_table_size, sizeof(trace_record_t));
+    object_table = calloc(object_table_size, sizeof(object_description_t));
     if (object_table == NULL) {
         fprintf(stderr, "ERROR: Memory allocation failure %d.\n", errno);
         return -1;
@@ -222,29 +403,29 @@ size_t read_header() {
     // Next, read each table entry.
     for (int i = 0; i < object_table_size; i++) {
         void* reactor;
-        items_read = fread(&reactor, sizeof(void*), 1, trace_file);
+        items_read = read_items(&reactor, sizeof(void*), 1);
         if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
         object_table[i].pointer = reactor;
 
         void* trigger;
-        items_read = fread(&trigger, sizeof(trigger_t*), 1, trace_file);
+        items_read = read_items(&trigger, sizeof(trigger_t*), 1);
         if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
         object_table[i].trigger = trigger;
 
         // Next, read the type.
         _lf_trace_object_t trace_type;
-        items_read = fread(&trace_type, sizeof(_lf_trace_object_t), 1, trace_file);
+        items_read = read_items(&trace_type, sizeof(_lf_trace_object_t), 1);
         if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
         object_table[i].type = trace_type;
 
         // Next, read the string description into the buffer.
         int description_length = 0;
         char character;
-        items_read = fread(&character, sizeof(char), 1, trace_file);
+        items_read = read_items(&character, sizeof(char), 1);
         if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
         while(character != 0 && description_length < BUFFER_SIZE - 1) {
             buffer[description_length++] = character;
-            items_read = fread(&character, sizeof(char), 1, trace_file);
+            items_read = read_items(&character, sizeof(char), 1);
             if (items_read != 1) _LF_TRACE_FAILURE(trace_file);
         }
         // Terminate with null.
@@ -258,29 +439,225 @@ size_t read_header() {
             top_level = object_table[i].description;
         }
     }
+    index_object_table();
     print_table();
     return object_table_size;
 }
 
+void close_trace_file() {
+    for (int i = 0; i < object_table_size; i++) {
+        free(object_table[i].description);
+    }
+    free(object_table);
+    object_table = NULL;
+    object_table_size = 0;
+    free(pointer_index);
+    free(trigger_index);
+    pointer_index = trigger_index = NULL;
+    top_level = NULL;
+    compact_format = false;
+    cycles_format = false;
+#ifndef _WIN32
+    if (mapped_file != NULL) munmap(mapped_file, mapped_size);
+#endif
+    mapped_file = NULL;
+    mapped_size = 0;
+    mapped_position = 0;
+    // The file is no longer closed at termination.
+    for (open_file_t** record = &_open_files; *record != NULL; record = &(*record)->next) {
+        if ((*record)->file == trace_file) {
+            open_file_t* tmp = *record;
+            *record = tmp->next;
+            free(tmp);
+            break;
+        }
+    }
+    if (trace_file != NULL) fclose(trace_file);
+    trace_file = NULL;
+}
+
+/**
+ * Report that the trace file is garbled and exit.
+ */
+static void garbled() {
+    fprintf(stderr, "ERROR: Trace record could not be decoded. File is garbled.\n");
+    exit(4);
+}
+
+/**
+ * Read an unsigned variable-length integer from the compact format,
+ * advancing the given position, which must be before end.
+ */
+static uint64_t get_unsigned(unsigned char** position, unsigned char* end) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*position >= end) garbled();
+        unsigned char byte = *(*position)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return result;
+    }
+    garbled();
+    return 0;
+}
+
+static int64_t get_signed(unsigned char** position, unsigned char* end) {
+    uint64_t value = get_unsigned(position, end);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Read the identifier of a pointer or trigger from the compact format and
+ * return the pointer from the object table or that follows the identifier.
+ */
+static void* get_object(unsigned char** position, unsigned char* end, bool is_trigger) {
+    uint64_t id = get_unsigned(position, end);
+    if (id == 0) return (void*)(uintptr_t)get_unsigned(position, end);
+    if (id > (uint64_t)object_table_size) garbled();
+    return is_trigger ? object_table[id - 1].trigger : object_table[id - 1].pointer;
+}
+
+/**
+ * Decode the given number of records in the compact format into the
+ * given array.
+ * @return The position following the last record decoded.
+ */
+static unsigned char* decode_trace(trace_record_t* records, int trace_length, unsigned char* position, unsigned char* end) {
+    instant_t logical_time = start_time;
+    instant_t physical_time = start_time;
+    for (int i = 0; i < trace_length; i++) {
+        trace_record_t* record = &records[i];
+        if (end - position < 2) garbled();
+        record->event_type = (trace_event_t)*position++;
+        unsigned char fields = *position++;
+        // Differences are added without overflow on garbage times.
+        logical_time = (instant_t)((uint64_t)logical_time + (uint64_t)get_signed(&position, end));
+        physical_time = (instant_t)((uint64_t)physical_time + (uint64_t)get_signed(&position, end));
+        record->logical_time = logical_time;
+        record->physical_time = physical_time;
+        record->pointer = (fields & trace_compact_pointer) ? get_object(&position, end, false) : NULL;
+        record->src_id = (fields & trace_compact_src_id) ? (int)get_signed(&position, end) : -1;
+        record->dst_id = (fields & trace_compact_dst_id) ? (int)get_signed(&position, end) : -1;
+        record->microstep = (fields & trace_compact_microstep) ? (microstep_t)get_unsigned(&position, end) : 0;
+        record->trigger = (fields & trace_compact_trigger) ? get_object(&position, end, true) : NULL;
+        record->extra_delay = (fields & trace_compact_extra_delay) ? get_signed(&position, end) : 0;
+    }
+    return position;
+}
+
+/**
+ * Check the length of a trace read from the trace file.
+ */
+static void check_trace_length(int trace_length) {
+    if (trace_length < 0 || trace_length > TRACE_BUFFER_CAPACITY) {
+        fprintf(stderr, "ERROR: Trace length %d exceeds capacity. File is garbled.\n", trace_length);
+        exit(4);
+    }
+}
+
 int read_trace() {
     // Read first the int giving the length of the trace.
     int trace_length;
-    int items_read = fread(&trace_length, sizeof(int), 1, trace_file);
+    int items_read = read_items(&trace_length, sizeof(int), 1);
     if (items_read != 1) {
-        if (feof(trace_file)) return 0;
+        if (mapped_file != NULL || trace_follow != NULL || feof(trace_file)) return 0;
         fprintf(stderr, "Failed to read trace length.\n");
         exit(3);
     }
-    if (trace_length > TRACE_BUFFER_CAPACITY) {
-        fprintf(stderr, "ERROR: Trace length %d exceeds capacity. File is garbled.\n", trace_length);
-        exit(4);
-    }
+    // The calibration of the cycle counts follows the last trace.
+    if (cycles_format && trace_length == -1) return 0;
+    check_trace_length(trace_length);
     // printf("DEBUG: Trace of length %d being converted.\n", trace_length);
 
-    items_read = fread(&trace, sizeof(trace_record_t), trace_length, trace_file);
-    if (items_read != trace_length) {
-        fprintf(stderr, "Failed to read trace of length %d.\n", trace_length);
-        exit(5);
+    if (compact_format) {
+        // Read the number of bytes of the encoded records.
+        int encoded_length;
+        items_read = read_items(&encoded_length, sizeof(int), 1);
+        if (items_read != 1 || encoded_length < 0 || encoded_length > (int)sizeof(encoded)) {
+            fprintf(stderr, "Failed to read trace of length %d.\n", trace_length);
+            exit(5);
+        }
+        unsigned char* position = encoded;
+        if (mapped_file != NULL && mapped_size - mapped_position >= (size_t)encoded_length) {
+            // Decode in place.
+            position = mapped_file + mapped_position;
+            mapped_position += encoded_length;
+        } else if (read_items(encoded, 1, encoded_length) != (size_t)encoded_length) {
+            fprintf(stderr, "Failed to read trace of length %d.\n", trace_length);
+            exit(5);
+        }
+        if (decode_trace(trace, trace_length, position, position + encoded_length)
+                != position + encoded_length) {
+            garbled();
+        }
+    } else {
+        items_read = read_items(&trace, sizeof(trace_record_t), trace_length);
+        if (items_read != trace_length) {
+            fprintf(stderr, "Failed to read trace of length %d.\n", trace_length);
+            exit(5);
+        }
     }
+    if (cycles_format) convert_cycles(trace, trace_length);
     return trace_length;
 }
+
+int index_traces(trace_chunk_t** chunks) {
+    if (mapped_file == NULL) return -1;
+    int capacity = 64;
+    int count = 0;
+    *chunks = (trace_chunk_t*)malloc(capacity * sizeof(trace_chunk_t));
+    if (*chunks == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(3);
+    }
+    int trace_length;
+    while (read_items(&trace_length, sizeof(int), 1) == 1) {
+        if (cycles_format && trace_length == -1) break;
+        check_trace_length(trace_length);
+        trace_chunk_t chunk;
+        chunk.length = trace_length;
+        if (compact_format) {
+            if (read_items(&chunk.encoded_length, sizeof(int), 1) != 1 || chunk.encoded_length < 0) garbled();
+        } else {
+            chunk.encoded_length = trace_length * (int)sizeof(trace_record_t);
+        }
+        chunk.offset = mapped_position;
+        if (mapped_size - mapped_position < (size_t)chunk.encoded_length) {
+            fprintf(stderr, "Failed to read trace of length %d.\n", trace_length);
+            exit(5);
+        }
+        mapped_position += chunk.encoded_length;
+        if (trace_length == 0) continue;
+
+        // Only the first record is decoded now.
+        trace_record_t first;
+        if (compact_format) {
+            decode_trace(&first, 1, mapped_file + chunk.offset, mapped_file + mapped_position);
+        } else {
+            memcpy(&first, mapped_file + chunk.offset, sizeof(trace_record_t));
+        }
+        if (cycles_format) convert_cycles(&first, 1);
+        chunk.first_time = first.physical_time;
+
+        if (count == capacity) {
+            capacity *= 2;
+            *chunks = (trace_chunk_t*)realloc(*chunks, capacity * sizeof(trace_chunk_t));
+            if (*chunks == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                exit(3);
+            }
+        }
+        (*chunks)[count++] = chunk;
+    }
+    return count;
+}
+
+void decode_trace_chunk(trace_chunk_t* chunk, trace_record_t* records) {
+    unsigned char* position = mapped_file + chunk->offset;
+    unsigned char* end = position + chunk->encoded_length;
+    if (compact_format) {
+        if (decode_trace(records, chunk->length, position, end) != end) garbled();
+    } else {
+        memcpy(records, position, chunk->encoded_length);
+    }
+    if (cycles_format) convert_cycles(records, chunk->length);
+}
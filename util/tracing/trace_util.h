@@ -62,6 +62,14 @@ extern FILE* summary_file;
  */
 void usage();
 
+/**
+ * If not NULL, the trace file is treated as still being written. Upon reaching
+ * its end, read_header() and read_trace() call this function, which may wait,
+ * and try again, until the function returns false, after which read_trace()
+ * returns 0. Files with cycle counts cannot be followed.
+ */
+extern bool (*trace_follow)(void);
+
 /** The start time read from the trace file. */
 extern instant_t start_time;
 
@@ -132,3 +140,36 @@ size_t read_header();
  * @return The number of trace record read or 0 upon seeing an EOF.
  */
 int read_trace();
+
+/**
+ * Close the trace file and forget what read_header() read from it, including
+ * the object table, so that another trace file can be opened and read.
+ */
+void close_trace_file();
+
+/**
+ * A trace in the trace file, located by index_traces().
+ */
+typedef struct trace_chunk_t {
+    size_t offset;         // Offset of the encoded records in the trace file.
+    int length;            // Number of records.
+    int encoded_length;    // Number of bytes of the encoded records.
+    instant_t first_time;  // Physical time of the first record.
+} trace_chunk_t;
+
+/**
+ * Locate the traces that follow the header without decoding them, so that
+ * they can be decoded in any order, or in parallel, by decode_trace_chunk().
+ * This requires that read_header() was able to map the trace file into memory.
+ * Empty traces are skipped.
+ * @param chunks Place to store a pointer to an array of the traces in the order
+ *  in which they appear in the trace file, which the caller must free.
+ * @return The number of traces, or -1 if the trace file is not mapped.
+ */
+int index_traces(trace_chunk_t** chunks);
+
+/**
+ * Decode the records of the given trace into the given array, which must
+ * have room for its length. This may be called by several threads at once.
+ */
+void decode_trace_chunk(trace_chunk_t* chunk, trace_record_t* records);
@@ -14,6 +14,10 @@
 #include <string.h>
 #include "wave_file_reader.h"
 
+#if !(_WIN32 || WIN32)
+#include <sys/mman.h>
+#endif
+
 #if _WIN32 || WIN32
 #define FILE_PATH_SEPARATOR '\\';
 #else
@@ -66,14 +70,26 @@ typedef struct {
    lf_wav_data_t data;
 } lf_wav_t;
 
-lf_waveform_t* read_wave_file(const char* path) {
-    FILE *fp = NULL;
-    
-    lf_wav_t wav;
-    fp = fopen(path, "rb");
+/**
+ * A waveform returned by map_wave_file(). The waveform points into
+ * the mapping, or, where files cannot be mapped, to memory on the heap,
+ * in which case map is NULL.
+ */
+typedef struct {
+    lf_waveform_t waveform;
+    void* map;
+    size_t map_size;
+} lf_mapped_waveform_t;
+
+/**
+ * Open the specified file for reading or, if that fails, the file
+ * with the same path in the "src-gen" directory.
+ * On a remote host, the waveform files will be put in that directory.
+ * @return The file or NULL if neither can be opened.
+ */
+static FILE* open_file(const char* path) {
+    FILE* fp = fopen(path, "rb");
     if (!fp) {
-        // Try prefixing the file name with "src-gen".
-        // On a remote host, the waveform files will be put in that directory.
         char alt_path[strlen(path) + 9];
         strcpy(alt_path, "src-gen");
         alt_path[7] = FILE_PATH_SEPARATOR;
@@ -81,13 +97,24 @@ lf_waveform_t* read_wave_file(const char* path) {
         fp = fopen(alt_path, "rb");
         if (!fp) {
             fprintf(stderr, "WARNING: Failed to open waveform sample file: %s\n", path);
-            return NULL;
         }
     }
- 
+    return fp;
+}
+
+/**
+ * Read the headers of a wave file up to the start of its sample data,
+ * reporting on stderr if the format is not supported.
+ * @param fp The file, which is left positioned at the start of the sample data.
+ * @param path The path to the file, for error messages.
+ * @param fmt The place to put the format of the file.
+ * @return The size of the sample data in bytes.
+ */
+static uint32_t read_headers(FILE* fp, const char* path, lf_wav_format_t* fmt) {
+    lf_wav_t wav;
     fread(&wav, 1, sizeof(lf_wav_t), fp);
      
-    lf_wav_format_t fmt = wav.fmt;
+    *fmt = wav.fmt;
     lf_wav_data_t data = wav.data;
  
     // Wave file format is described here:
@@ -97,11 +124,11 @@ lf_waveform_t* read_wave_file(const char* path) {
     uint32_t expected_subchunk_id = (uint32_t)' tmf';  // Little-endian version of 'fmt '.
     if (*(uint32_t*)wav.riff.chunk_id != expected_chunk_id
         || *(uint32_t*)wav.riff.format != expected_format
-        || *(uint32_t*)fmt.subchunk_id != expected_subchunk_id
-        || fmt.subchunk_size != 16
-        || fmt.audio_format != 1
-        || fmt.sample_rate != 44100
-        || fmt.bits_per_sample != 16
+        || *(uint32_t*)fmt->subchunk_id != expected_subchunk_id
+        || fmt->subchunk_size != 16
+        || fmt->audio_format != 1
+        || fmt->sample_rate != 44100
+        || fmt->bits_per_sample != 16
     ) {
         fprintf(stderr, "WARNING: Waveform sample not a supported format.\n");
         fprintf(stderr, "Chunk ID was expected to be 'RIFF'. Got: '%c%c%c%c'.\n",
@@ -109,53 +136,163 @@ lf_waveform_t* read_wave_file(const char* path) {
         fprintf(stderr, "Format was expected to be 'WAVE'. Got: '%c%c%c%c'.\n",
                 wav.riff.format[0], wav.riff.format[1], wav.riff.format[2], wav.riff.format[3]);
         fprintf(stderr, "Subchunk ID was expected to be 'fmt '. Got: '%c%c%c%c'.\n",
-                fmt.subchunk_id[0], fmt.subchunk_id[1], fmt.subchunk_id[2], fmt.subchunk_id[3]);
+                fmt->subchunk_id[0], fmt->subchunk_id[1], fmt->subchunk_id[2], fmt->subchunk_id[3]);
         fprintf(stderr, "Subchunk size was expected to be 16. Got: '%d'.\n",
-                fmt.subchunk_size);
+                fmt->subchunk_size);
         fprintf(stderr, "Audio format was expected to be 1 (LPCM, no compression). Got: '%d'.\n",
-                fmt.audio_format);
+                fmt->audio_format);
         fprintf(stderr, "Sample rate was expected to be 44100). Got: '%d'.\n",
-                fmt.sample_rate);
+                fmt->sample_rate);
         fprintf(stderr, "Bits per sample was expected to be 16. Got: '%d'.\n",
-                fmt.bits_per_sample);
+                fmt->bits_per_sample);
     }
     // Ignore any intermediate chunks that are not 'data' chunks.
     // Apparently, Apple software sometimes inserts junk here.
     uint32_t expected_data_id = (uint32_t)'atad';      // Little-endian version of 'data'.
     while (*(uint32_t*)data.subchunk_id != expected_data_id) {
-        char junk[data.subchunk_size];
-        size_t bytes_read = fread(junk, 1, data.subchunk_size , fp);
-        if (bytes_read != data.subchunk_size) {
+        if (fseek(fp, data.subchunk_size, SEEK_CUR) != 0) {
             fprintf(stderr, "Intermediate junk chunk '%c%c%c%c' could not be read. Giving up.\n",
                 data.subchunk_id[0], data.subchunk_id[1], data.subchunk_id[2], data.subchunk_id[3]);
             break;
         }
-        bytes_read = fread(&data, 1, sizeof(lf_wav_data_t) , fp);
+        size_t bytes_read = fread(&data, 1, sizeof(lf_wav_data_t) , fp);
         if (bytes_read != sizeof(lf_wav_data_t)) {
             fprintf(stderr, "Missing 'data' chunk in file %s.\n", path);
             break;
         }
     }
 
-    uint16_t num_channels = fmt.num_channels;     
-
     // Ignoring the following fields. Should we?
-    // printf("byte_rate \t%d\n", fmt.byte_rate);
-    // printf("BlockAlign \t%d\n", fmt.BlockAlign);
+    // printf("byte_rate \t%d\n", fmt->byte_rate);
+    // printf("BlockAlign \t%d\n", fmt->BlockAlign);
 
     // printf("Data subchunk size \t%d\n", data.subchunk_size);
+    return data.subchunk_size;
+}
+
+lf_waveform_t* read_wave_file(const char* path) {
+    FILE* fp = open_file(path);
+    if (!fp) {
+        return NULL;
+    }
+    lf_wav_format_t fmt;
+    uint32_t data_size = read_headers(fp, path, &fmt);
 
     lf_waveform_t* result = (lf_waveform_t*)malloc(sizeof(lf_waveform_t));
-    // printf("Size of lf_waveform_t %d", sizeof(lf_waveform_t));
-    result->length = data.subchunk_size/2; // Subchunk size is in bytes, but length is number of samples.
-    result->num_channels = num_channels;
-    result->waveform = (int16_t*)calloc(data.subchunk_size/2, sizeof(int16_t));
-
-    size_t bytes_read = fread(result->waveform, sizeof(int16_t), data.subchunk_size/2 , fp);
-    if (bytes_read != data.subchunk_size/2) {
-        fprintf(stderr, "WARNING: Expected %d bytes, but got %zu.\n", data.subchunk_size, bytes_read);
+    result->length = data_size/2; // Subchunk size is in bytes, but length is number of samples.
+    result->num_channels = fmt.num_channels;
+    result->waveform = (int16_t*)calloc(data_size/2, sizeof(int16_t));
+
+    size_t bytes_read = fread(result->waveform, sizeof(int16_t), data_size/2 , fp);
+    if (bytes_read != data_size/2) {
+        fprintf(stderr, "WARNING: Expected %d bytes, but got %zu.\n", data_size, bytes_read);
     }
+    fclose(fp);
 
-    // printf("duration \t%f\n", (data.subchunk_size * 1.0) / fmt.byte_rate);
+    // printf("duration \t%f\n", (data_size * 1.0) / fmt.byte_rate);
     return result;
- }
+}
+
+lf_waveform_t* map_wave_file(const char* path) {
+    FILE* fp = open_file(path);
+    if (!fp) {
+        return NULL;
+    }
+    lf_wav_format_t fmt;
+    uint32_t data_size = read_headers(fp, path, &fmt);
+    long data_offset = ftell(fp);
+
+    lf_mapped_waveform_t* result = (lf_mapped_waveform_t*)calloc(1, sizeof(lf_mapped_waveform_t));
+    result->waveform.num_channels = fmt.num_channels;
+#if !(_WIN32 || WIN32)
+    // Samples must be aligned to be accessed in place.
+    if (data_offset > 0 && data_offset % sizeof(int16_t) == 0 && fseek(fp, 0, SEEK_END) == 0) {
+        long file_size = ftell(fp);
+        if (data_offset + (long)data_size > file_size) {
+            fprintf(stderr, "WARNING: Expected %d bytes, but got %ld.\n", data_size, file_size - data_offset);
+            data_size = (uint32_t)(file_size - data_offset);
+        }
+        void* map = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (map != MAP_FAILED) {
+            // Samples are read in order as they play.
+            madvise(map, (size_t)file_size, MADV_SEQUENTIAL);
+            result->map = map;
+            result->map_size = (size_t)file_size;
+            result->waveform.length = data_size/2;
+            result->waveform.waveform = (int16_t*)((char*)map + data_offset);
+            fclose(fp);
+            return (lf_waveform_t*)result;
+        }
+    }
+#endif
+    // Fall back to reading the samples.
+    fseek(fp, data_offset, SEEK_SET);
+    result->waveform.waveform = (int16_t*)calloc(data_size/2, sizeof(int16_t));
+    size_t samples_read = fread(result->waveform.waveform, sizeof(int16_t), data_size/2, fp);
+    if (samples_read != data_size/2) {
+        fprintf(stderr, "WARNING: Expected %d bytes, but got %zu.\n", data_size, samples_read * 2);
+    }
+    result->waveform.length = (uint32_t)samples_read;
+    fclose(fp);
+    return (lf_waveform_t*)result;
+}
+
+void unmap_wave_file(lf_waveform_t* waveform) {
+    if (waveform == NULL) return;
+    lf_mapped_waveform_t* mapped = (lf_mapped_waveform_t*)waveform;
+#if !(_WIN32 || WIN32)
+    if (mapped->map != NULL) {
+        munmap(mapped->map, mapped->map_size);
+    } else
+#endif
+    {
+        free(mapped->waveform.waveform);
+    }
+    free(mapped);
+}
+
+lf_wave_stream_t* open_wave_stream(const char* path) {
+    FILE* fp = open_file(path);
+    if (!fp) {
+        return NULL;
+    }
+    lf_wav_format_t fmt;
+    uint32_t data_size = read_headers(fp, path, &fmt);
+
+    lf_wave_stream_t* result = (lf_wave_stream_t*)malloc(sizeof(lf_wave_stream_t));
+    result->file = fp;
+    result->data_offset = ftell(fp);
+    result->num_channels = fmt.num_channels > 0 ? fmt.num_channels : 1;
+    result->length = data_size/2;
+    result->position = 0;
+    return result;
+}
+
+uint32_t read_wave_stream(lf_wave_stream_t* stream, lf_waveform_t* chunk, uint32_t max_frames) {
+    uint32_t samples = max_frames * stream->num_channels;
+    if (samples > stream->length - stream->position) {
+        samples = stream->length - stream->position;
+    }
+    size_t samples_read = fread(chunk->waveform, sizeof(int16_t), samples, stream->file);
+    // Keep whole frames only, so that the next chunk starts with the first channel.
+    samples_read -= samples_read % stream->num_channels;
+    if (samples_read < samples) {
+        fseek(stream->file, stream->data_offset + (long)(stream->position + samples_read) * 2, SEEK_SET);
+        stream->length = stream->position + (uint32_t)samples_read;
+    }
+    stream->position += (uint32_t)samples_read;
+    chunk->length = (uint32_t)samples_read;
+    chunk->num_channels = stream->num_channels;
+    return (uint32_t)samples_read / stream->num_channels;
+}
+
+void rewind_wave_stream(lf_wave_stream_t* stream) {
+    fseek(stream->file, stream->data_offset, SEEK_SET);
+    stream->position = 0;
+}
+
+void close_wave_stream(lf_wave_stream_t* stream) {
+    if (stream == NULL) return;
+    fclose(stream->file);
+    free(stream);
+}
@@ -10,6 +10,11 @@
  * a path to a .wav file, reads the file and, if the format of the file is
  * supported, returns an lf_waveform_t struct, which contains the raw
  * audio data in 16-bit linear PCM form.
+ *
+ * For long recordings, map_wave_file() maps the file into memory instead
+ * of reading it, so that the samples are read from the file as they are
+ * first played, and open_wave_stream() reads the samples in chunks on
+ * demand into buffers provided by the caller, so that memory use is bounded.
  * 
  * This code has few dependencies, so it should run on just about any platform.
  * 
@@ -37,6 +42,9 @@ target C {
 #ifndef WAVE_FILE_READER_H
 #define WAVE_FILE_READER_H
 
+#include <stdint.h>
+#include <stdio.h>
+
 /**
  * Waveform in 16-bit linear-PCM format.
  * The waveform element is an array containing audio samples.
@@ -66,4 +74,74 @@ typedef struct lf_waveform_t {
  */
 lf_waveform_t* read_wave_file(const char* path);
 
+/**
+ * Open a wave file and check that the format is supported, like
+ * read_wave_file(), but map the file into memory instead of reading
+ * the sample data, so that no time is spent reading samples up front.
+ * The waveform element of the returned struct points into the mapping.
+ * Where files cannot be mapped, this reads the sample data instead.
+ * The caller must release the result with unmap_wave_file() rather
+ * than free it.
+ *
+ * @param path The path to the file.
+ * @return The waveform or NULL if the file can't be opened.
+ */
+lf_waveform_t* map_wave_file(const char* path);
+
+/**
+ * Release a waveform returned by map_wave_file().
+ * @param waveform The waveform, which may be NULL.
+ */
+void unmap_wave_file(lf_waveform_t* waveform);
+
+/**
+ * A wave file being read in chunks.
+ * The length and position are in samples, counting all channels.
+ */
+typedef struct lf_wave_stream_t {
+    FILE* file;
+    long data_offset;       // Offset of the sample data in the file.
+    uint32_t length;        // Number of samples in the file.
+    uint32_t position;      // Number of samples read so far.
+    uint16_t num_channels;
+} lf_wave_stream_t;
+
+/**
+ * Open a wave file, check that the format is supported, and
+ * prepare to read its sample data with read_wave_stream().
+ * The caller must close the result with close_wave_stream().
+ *
+ * @param path The path to the file.
+ * @return The stream or NULL if the file can't be opened.
+ */
+lf_wave_stream_t* open_wave_stream(const char* path);
+
+/**
+ * Read the next chunk of the sample data of a wave stream into the
+ * specified waveform, whose waveform element must point to room for
+ * max_frames times the number of channels of the stream. This sets
+ * the length and the number of channels of the waveform to those of
+ * the chunk, so that it can be played like any other waveform. To
+ * play a file while reading it, alternate between at least two
+ * chunks, since a chunk is played after it is handed to the audio loop.
+ *
+ * @param stream The stream.
+ * @param chunk The waveform to fill.
+ * @param max_frames The maximum number of frames (samples per channel) to read.
+ * @return The number of frames read, which is 0 at the end of the stream.
+ */
+uint32_t read_wave_stream(lf_wave_stream_t* stream, lf_waveform_t* chunk, uint32_t max_frames);
+
+/**
+ * Go back to the start of the sample data of a wave stream.
+ * @param stream The stream.
+ */
+void rewind_wave_stream(lf_wave_stream_t* stream);
+
+/**
+ * Close a wave stream and free its memory.
+ * @param stream The stream, which may be NULL.
+ */
+void close_wave_stream(lf_wave_stream_t* stream);
+
 #endif // WAVE_FILE_READER_H
\ No newline at end of file